@@ -0,0 +1,353 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/app/benchmark.h"
+
+#include <cstdio>
+#include <map>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/string_util.h"
+#include "xenia/cpu/export_resolver.h"
+#include "xenia/emulator.h"
+#include "xenia/gpu/graphics_system.h"
+#include "xenia/kernel/kernel_state.h"
+#include "xenia/kernel/xthread.h"
+
+DEFINE_int32(benchmark_frames, 0,
+             "If above 0, run the launched title for this many guest vertical "
+             "blanking intervals without vsync, then write the guest frame "
+             "rate, the CPU time of the subsystems and the translation and "
+             "GPU cache statistics as JSON, and quit.",
+             "General");
+DEFINE_path(benchmark_output, "",
+            "Path to write the benchmark JSON to, or empty to write it to the "
+            "standard output.",
+            "General");
+
+namespace xe {
+namespace app {
+
+namespace {
+
+std::string EscapeJsonString(const std::string_view str) {
+  std::string escaped;
+  escaped.reserve(str.size());
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      escaped.push_back('\\');
+      escaped.push_back(c);
+    } else if (uint8_t(c) < 0x20) {
+      escaped.append(fmt::format("\\u{:04x}", uint8_t(c)));
+    } else {
+      escaped.push_back(c);
+    }
+  }
+  return escaped;
+}
+
+// The subsystem the CPU time of a kernel thread is attributed to.
+const char* GetThreadCategory(kernel::XThread* thread) {
+  if (thread->is_guest_thread()) {
+    // Translated guest code and the kernel calls from it.
+    return "guest_threads";
+  }
+  const std::string& name = thread->name();
+  if (xe::utf8::starts_with(name, "GPU Commands")) {
+    return "gpu_command_processor";
+  }
+  if (xe::utf8::starts_with(name, "XMA")) {
+    return "xma_decoder";
+  }
+  if (xe::utf8::starts_with(name, "Audio")) {
+    return "audio";
+  }
+  if (xe::utf8::starts_with(name, "Kernel")) {
+    return "kernel_host_threads";
+  }
+  return "other_host_threads";
+}
+
+// Like a command line value, the override is not written to the config, unlike
+// with OVERRIDE_bool, which is also only usable in the defining file.
+void OverrideBoolForRun(const char* name, bool value) {
+  if (!cvar::ConfigVars) {
+    return;
+  }
+  auto it = cvar::ConfigVars->find(name);
+  if (it == cvar::ConfigVars->end()) {
+    return;
+  }
+  auto config_var = dynamic_cast<cvar::ConfigVar<bool>*>(it->second);
+  if (config_var) {
+    config_var->SetCommandLineValue(value);
+  }
+}
+
+}  // namespace
+
+bool Benchmark::IsEnabled() { return cvars::benchmark_frames > 0; }
+
+void Benchmark::ApplyConfigOverrides() {
+  if (!IsEnabled()) {
+    return;
+  }
+  OverrideBoolForRun("vsync", false);
+  OverrideBoolForRun("profile_kernel_calls", true);
+}
+
+std::unique_ptr<Benchmark> Benchmark::Create(
+    Emulator* emulator, std::function<void()> on_finished) {
+  if (!IsEnabled()) {
+    return nullptr;
+  }
+  auto benchmark = std::unique_ptr<Benchmark>(
+      new Benchmark(emulator, std::move(on_finished)));
+  Benchmark* benchmark_ptr = benchmark.get();
+  benchmark->thread_ = xe::threading::Thread::Create(
+      {}, [benchmark_ptr]() { benchmark_ptr->ThreadMain(); });
+  if (!benchmark->thread_) {
+    XELOGE("Failed to create the benchmark thread");
+    return nullptr;
+  }
+  benchmark->thread_->set_name("Benchmark");
+  return benchmark;
+}
+
+Benchmark::Benchmark(Emulator* emulator, std::function<void()> on_finished)
+    : emulator_(emulator), on_finished_(std::move(on_finished)) {
+  launch_event_ = xe::threading::Event::CreateManualResetEvent(false);
+}
+
+Benchmark::~Benchmark() {
+  if (thread_) {
+    shutting_down_ = true;
+    launch_event_->Set();
+    xe::threading::Wait(thread_.get(), false);
+  }
+}
+
+void Benchmark::OnTitleLaunched(const std::string_view title_name) {
+  if (xe::threading::Wait(launch_event_.get(), false,
+                          std::chrono::milliseconds(0)) !=
+      xe::threading::WaitResult::kTimeout) {
+    // Only measuring the first title.
+    return;
+  }
+  title_name_ = title_name;
+  launch_event_->Set();
+}
+
+void Benchmark::ThreadMain() {
+  xe::threading::Wait(launch_event_.get(), false);
+  if (shutting_down_) {
+    return;
+  }
+  gpu::GraphicsSystem* graphics_system = emulator_->graphics_system();
+  if (!graphics_system) {
+    XELOGE("Benchmark: no graphics system to count the vblanks of");
+    return;
+  }
+
+  Sample start;
+  TakeSample(start);
+  uint64_t end_vblank = start.vblanks + uint64_t(cvars::benchmark_frames);
+  XELOGI("Benchmark: running {} vblanks", cvars::benchmark_frames);
+  while (graphics_system->vblank_count() < end_vblank) {
+    if (shutting_down_) {
+      return;
+    }
+    xe::threading::Sleep(std::chrono::milliseconds(10));
+  }
+  Sample end;
+  TakeSample(end);
+
+  std::string json = FormatResults(start, end);
+  if (cvars::benchmark_output.empty()) {
+    fwrite(json.data(), 1, json.size(), stdout);
+    fflush(stdout);
+  } else {
+    xe::filesystem::CreateParentFolder(cvars::benchmark_output);
+    FILE* file = xe::filesystem::OpenFile(cvars::benchmark_output, "wb");
+    bool written = false;
+    if (file) {
+      written = fwrite(json.data(), 1, json.size(), file) == json.size();
+      fclose(file);
+    }
+    if (!written) {
+      XELOGE("Failed to write the benchmark results to {}",
+             xe::path_to_utf8(cvars::benchmark_output));
+    }
+  }
+  if (on_finished_) {
+    on_finished_();
+  }
+}
+
+void Benchmark::TakeSample(Sample& sample_out) {
+  gpu::GraphicsSystem* graphics_system = emulator_->graphics_system();
+  gpu::CommandProcessor* command_processor =
+      graphics_system->command_processor();
+  sample_out.host_ticks = Clock::QueryHostTickCount();
+  sample_out.vblanks = graphics_system->vblank_count();
+  sample_out.swaps = command_processor->swap_count();
+
+  sample_out.thread_cpu_times.clear();
+  for (const auto& thread :
+       emulator_->kernel_state()->object_table()->GetObjectsByType<
+           kernel::XThread>()) {
+    if (thread->thread()) {
+      sample_out.thread_cpu_times.emplace(thread->handle(),
+                                          thread->thread()->QueryCpuTime());
+    }
+  }
+
+  sample_out.translation =
+      emulator_->processor()->QueryTranslationStatistics();
+
+  // The caches are modified on the command processor thread.
+  sample_out.gpu_caches = gpu::CommandProcessor::CacheStatistics();
+  auto statistics = std::make_shared<gpu::CommandProcessor::CacheStatistics>();
+  auto statistics_event = std::shared_ptr<xe::threading::Event>(
+      xe::threading::Event::CreateManualResetEvent(false));
+  command_processor->CallInThread(
+      [command_processor, statistics, statistics_event]() {
+        command_processor->GetCacheStatistics(*statistics);
+        statistics_event->Set();
+      });
+  if (xe::threading::Wait(statistics_event.get(), false,
+                          std::chrono::seconds(1)) ==
+      xe::threading::WaitResult::kSuccess) {
+    sample_out.gpu_caches = *statistics;
+  } else {
+    XELOGW("Benchmark: timed out getting the GPU cache statistics");
+  }
+
+  sample_out.kernel_call_ticks = 0;
+  for (const auto& function :
+       emulator_->export_resolver()->GetCalledFunctions()) {
+    sample_out.kernel_call_ticks += function.second->function_data.call_ticks;
+  }
+}
+
+std::string Benchmark::FormatResults(const Sample& start, const Sample& end) {
+  double host_tick_frequency = double(Clock::QueryHostTickFrequency());
+  double seconds = double(end.host_ticks - start.host_ticks) /
+                   host_tick_frequency;
+  uint64_t vblanks = end.vblanks - start.vblanks;
+  uint64_t swaps = end.swaps - start.swaps;
+
+  // Sorted for the output to be comparable between runs. Threads that have
+  // exited during the run are not included.
+  std::map<std::string, std::chrono::microseconds> category_cpu_times;
+  for (const auto& thread :
+       emulator_->kernel_state()->object_table()->GetObjectsByType<
+           kernel::XThread>()) {
+    auto end_it = end.thread_cpu_times.find(thread->handle());
+    if (end_it == end.thread_cpu_times.end()) {
+      continue;
+    }
+    std::chrono::microseconds cpu_time = end_it->second;
+    auto start_it = start.thread_cpu_times.find(thread->handle());
+    if (start_it != start.thread_cpu_times.end()) {
+      cpu_time -= start_it->second;
+    }
+    category_cpu_times[GetThreadCategory(thread.get())] += cpu_time;
+  }
+  category_cpu_times["translation_workers"] =
+      end.translation.translation_worker_cpu_time -
+      start.translation.translation_worker_cpu_time;
+
+  uint64_t functions_translated = end.translation.functions_translated -
+                                  start.translation.functions_translated;
+  uint64_t functions_loaded = end.translation.functions_loaded_from_storage -
+                              start.translation.functions_loaded_from_storage;
+  uint64_t functions_defined = functions_translated + functions_loaded;
+
+  std::string json = "{\n";
+  json += fmt::format("  \"title\": \"{}\",\n", EscapeJsonString(title_name_));
+  json += fmt::format("  \"vblanks\": {},\n", vblanks);
+  json += fmt::format("  \"frames\": {},\n", swaps);
+  json += fmt::format("  \"seconds\": {:.3f},\n", seconds);
+  json += fmt::format("  \"guest_fps\": {:.2f},\n",
+                      seconds > 0.0 ? double(swaps) / seconds : 0.0);
+  json += fmt::format("  \"vblanks_per_second\": {:.2f},\n",
+                      seconds > 0.0 ? double(vblanks) / seconds : 0.0);
+  json += "  \"cpu_ms\": {\n";
+  for (const auto& category : category_cpu_times) {
+    json += fmt::format("    \"{}\": {:.3f},\n", category.first,
+                        double(category.second.count()) / 1000.0);
+  }
+  // Included in the time of the guest threads.
+  json += fmt::format(
+      "    \"kernel_calls\": {:.3f}\n",
+      double(end.kernel_call_ticks - start.kernel_call_ticks) * 1000.0 /
+          host_tick_frequency);
+  json += "  },\n";
+  json += "  \"translation\": {\n";
+  json += fmt::format("    \"functions_translated\": {},\n",
+                      functions_translated);
+  json += fmt::format("    \"functions_loaded_from_storage\": {},\n",
+                      functions_loaded);
+  json += fmt::format(
+      "    \"storage_hit_rate\": {:.4f},\n",
+      functions_defined ? double(functions_loaded) / double(functions_defined)
+                        : 0.0);
+  json += fmt::format("    \"functions_retranslated\": {}\n",
+                      end.translation.functions_retranslated -
+                          start.translation.functions_retranslated);
+  json += "  },\n";
+  json += "  \"gpu_caches\": {\n";
+  json += fmt::format(
+      "    \"pipelines_created\": {},\n",
+      end.gpu_caches.pipelines_created - start.gpu_caches.pipelines_created);
+  json += fmt::format(
+      "    \"textures_created\": {},\n",
+      end.gpu_caches.textures_created - start.gpu_caches.textures_created);
+  json += fmt::format(
+      "    \"texture_loads\": {},\n",
+      end.gpu_caches.texture_loads - start.gpu_caches.texture_loads);
+  json += fmt::format("    \"texture_reloads_skipped\": {},\n",
+                      end.gpu_caches.texture_reloads_skipped -
+                          start.gpu_caches.texture_reloads_skipped);
+  json += fmt::format("    \"render_passes_begun\": {},\n",
+                      end.gpu_caches.render_passes_begun -
+                          start.gpu_caches.render_passes_begun);
+  uint64_t attachment_bytes = end.gpu_caches.attachment_load_bytes -
+                              start.gpu_caches.attachment_load_bytes +
+                              end.gpu_caches.attachment_store_bytes -
+                              start.gpu_caches.attachment_store_bytes;
+  json += fmt::format("    \"attachment_load_bytes\": {},\n",
+                      end.gpu_caches.attachment_load_bytes -
+                          start.gpu_caches.attachment_load_bytes);
+  json += fmt::format("    \"attachment_store_bytes\": {},\n",
+                      end.gpu_caches.attachment_store_bytes -
+                          start.gpu_caches.attachment_store_bytes);
+  json += fmt::format("    \"attachment_bytes_per_frame\": {},\n",
+                      swaps ? attachment_bytes / swaps : 0);
+  json += fmt::format("    \"scaled_resolve_committed_bytes\": {},\n",
+                      end.gpu_caches.scaled_resolve_committed_bytes);
+  json += fmt::format("    \"scaled_resolve_used_bytes\": {},\n",
+                      end.gpu_caches.scaled_resolve_used_bytes);
+  json += fmt::format("    \"scaled_resolve_on_demand_commits\": {}\n",
+                      end.gpu_caches.scaled_resolve_on_demand_commits -
+                          start.gpu_caches.scaled_resolve_on_demand_commits);
+  json += "  },\n";
+  json += fmt::format("  \"peak_working_set_bytes\": {}\n",
+                      xe::memory::peak_working_set_size());
+  json += "}\n";
+  return json;
+}
+
+}  // namespace app
+}  // namespace xe
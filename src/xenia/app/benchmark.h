@@ -0,0 +1,84 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APP_BENCHMARK_H_
+#define XENIA_APP_BENCHMARK_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "xenia/base/threading.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/gpu/command_processor.h"
+
+namespace xe {
+class Emulator;
+}  // namespace xe
+
+namespace xe {
+namespace app {
+
+// With --benchmark_frames, runs the launched title for that many guest
+// vertical blanking intervals as fast as possible, then writes the guest frame
+// rate, the CPU time of the subsystems, and the translation and GPU cache
+// statistics as JSON, and quits.
+class Benchmark {
+ public:
+  static bool IsEnabled();
+  // Must be called before the emulator is set up, disables the pacing to
+  // the real time.
+  static void ApplyConfigOverrides();
+
+  // Returns null if benchmarking is not enabled. on_finished is called from
+  // the benchmark thread after the results have been written.
+  static std::unique_ptr<Benchmark> Create(Emulator* emulator,
+                                           std::function<void()> on_finished);
+  ~Benchmark();
+
+  // Starts measuring, called when the title is launched to not include the
+  // emulator setup.
+  void OnTitleLaunched(const std::string_view title_name);
+
+ private:
+  struct Sample {
+    uint64_t host_ticks;
+    uint64_t vblanks;
+    uint64_t swaps;
+    // CPU time of the kernel threads by handle, as the same thread may be in
+    // both samples.
+    std::unordered_map<uint32_t, std::chrono::microseconds> thread_cpu_times;
+    cpu::Processor::TranslationStatistics translation;
+    gpu::CommandProcessor::CacheStatistics gpu_caches;
+    uint64_t kernel_call_ticks;
+  };
+
+  Benchmark(Emulator* emulator, std::function<void()> on_finished);
+
+  void ThreadMain();
+  void TakeSample(Sample& sample_out);
+  std::string FormatResults(const Sample& start, const Sample& end);
+
+  Emulator* emulator_;
+  std::function<void()> on_finished_;
+  std::string title_name_;
+
+  std::unique_ptr<xe::threading::Event> launch_event_;
+  std::atomic<bool> shutting_down_{false};
+  std::unique_ptr<xe::threading::Thread> thread_;
+};
+
+}  // namespace app
+}  // namespace xe
+
+#endif  // XENIA_APP_BENCHMARK_H_
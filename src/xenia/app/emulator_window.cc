@@ -9,6 +9,7 @@
 
 #include "xenia/app/emulator_window.h"
 
+#include <algorithm>
 #include <filesystem>
 #include <functional>
 #include <memory>
@@ -501,6 +502,114 @@ void EmulatorWindow::DisplayConfigDialog::OnDraw(ImGuiIO& io) {
   }
 }
 
+EmulatorWindow::FrameBreakdownDialog::FrameBreakdownDialog(
+    ui::ImGuiDrawer* imgui_drawer, EmulatorWindow& emulator_window)
+    : ui::ImGuiDialog(imgui_drawer), emulator_window_(emulator_window) {
+  frame_breakdown::SetEnabled(true);
+}
+
+EmulatorWindow::FrameBreakdownDialog::~FrameBreakdownDialog() {
+  frame_breakdown::SetEnabled(false);
+}
+
+void EmulatorWindow::FrameBreakdownDialog::OnDraw(ImGuiIO& io) {
+  size_t frame_count = frame_breakdown::GetHistory(frames_);
+  for (size_t i = 0; i < frame_count; ++i) {
+    frame_times_ms_[i] = float(frames_[i].duration_us) * 0.001f;
+  }
+  // Stutter is a frame taking much longer than the typical one.
+  float median_ms = 0.0f;
+  float max_ms = 0.0f;
+  size_t worst_frame = 0;
+  if (frame_count) {
+    float sorted_ms[frame_breakdown::kHistoryLength];
+    std::copy(frame_times_ms_, frame_times_ms_ + frame_count, sorted_ms);
+    std::nth_element(sorted_ms, sorted_ms + frame_count / 2,
+                     sorted_ms + frame_count);
+    median_ms = sorted_ms[frame_count / 2];
+    for (size_t i = 0; i < frame_count; ++i) {
+      if (frame_times_ms_[i] > max_ms) {
+        max_ms = frame_times_ms_[i];
+        worst_frame = i;
+      }
+    }
+  }
+  float stutter_ms = median_ms * 2.0f;
+
+  ImGui::SetNextWindowPos(ImVec2(io.DisplaySize.x - 20, 20),
+                          ImGuiCond_FirstUseEver, ImVec2(1.0f, 0.0f));
+  ImGui::SetNextWindowBgAlpha(0.6f);
+  bool dialog_open = true;
+  if (!ImGui::Begin("Frame breakdown", &dialog_open,
+                    ImGuiWindowFlags_NoCollapse |
+                        ImGuiWindowFlags_AlwaysAutoResize |
+                        ImGuiWindowFlags_NoFocusOnAppearing)) {
+    ImGui::End();
+  } else {
+    std::string graph_overlay =
+        fmt::format("median {:.1f} ms, max {:.1f} ms", median_ms, max_ms);
+    ImVec2 graph_size(480.0f, 80.0f);
+    ImGui::PlotLines("##FrameTimes", frame_times_ms_, int(frame_count), 0,
+                     graph_overlay.c_str(), 0.0f,
+                     std::max(max_ms, stutter_ms) * 1.1f, graph_size);
+    // Stutter markers over the graph, at the positions of the plotted frames.
+    if (frame_count > 1 && median_ms > 0.0f) {
+      ImVec2 graph_min = ImGui::GetItemRectMin();
+      ImVec2 graph_max = ImGui::GetItemRectMax();
+      const ImVec2& padding = ImGui::GetStyle().FramePadding;
+      float x_min = graph_min.x + padding.x;
+      float x_step =
+          (graph_max.x - padding.x - x_min) / float(frame_count - 1);
+      ImDrawList* draw_list = ImGui::GetWindowDrawList();
+      for (size_t i = 0; i < frame_count; ++i) {
+        if (frame_times_ms_[i] > stutter_ms) {
+          float x = x_min + x_step * float(i);
+          draw_list->AddLine(ImVec2(x, graph_min.y + padding.y),
+                             ImVec2(x, graph_max.y - padding.y),
+                             IM_COL32(255, 64, 64, 160));
+        }
+      }
+    }
+
+    auto draw_frame = [](const char* label,
+                         const frame_breakdown::Frame& frame) {
+      ImGui::Text("%s: %.1f ms", label, float(frame.duration_us) * 0.001f);
+      ImGui::Indent();
+      for (size_t i = 0; i < frame_breakdown::kCategoryCount; ++i) {
+        ImGui::Text("%s: %.1f ms",
+                    frame_breakdown::GetCategoryName(
+                        frame_breakdown::Category(i)),
+                    float(frame.category_us[i]) * 0.001f);
+      }
+      ImGui::Unindent();
+    };
+    if (frame_count) {
+      draw_frame("Last frame", frames_[frame_count - 1]);
+      draw_frame(max_ms > stutter_ms ? "Worst frame (stutter)" : "Worst frame",
+                 frames_[worst_frame]);
+    } else {
+      ImGui::TextUnformatted("Waiting for guest frames.");
+    }
+    ImGui::TextDisabled("The time is summed over all threads.");
+    ImGui::End();
+  }
+
+  if (!dialog_open) {
+    emulator_window_.ToggleFrameBreakdownDialog();
+    // `this` might have been destroyed by ToggleFrameBreakdownDialog.
+    return;
+  }
+
+  // Continuous repaint to follow the frames.
+  gpu::GraphicsSystem* graphics_system =
+      emulator_window_.emulator_->graphics_system();
+  ui::Presenter* presenter =
+      graphics_system ? graphics_system->presenter() : nullptr;
+  if (presenter) {
+    presenter->RequestUIPaintFromUIThread();
+  }
+}
+
 bool EmulatorWindow::Initialize() {
   window_->AddListener(&window_listener_);
   window_->AddInputListener(&window_listener_, kZOrderEmulatorWindowInput);
@@ -551,6 +660,9 @@ bool EmulatorWindow::Initialize() {
     cpu_menu->AddChild(MenuItem::Create(MenuItem::Type::kString,
                                         "&Pause/Resume Profiler", "`",
                                         []() { Profiler::TogglePause(); }));
+    cpu_menu->AddChild(MenuItem::Create(
+        MenuItem::Type::kString, "Start/Stop Profiler &Trace Capture",
+        "Shift+F3", []() { Profiler::ToggleTraceCapture(); }));
   }
   cpu_menu->AddChild(MenuItem::Create(MenuItem::Type::kSeparator));
   {
@@ -585,6 +697,9 @@ bool EmulatorWindow::Initialize() {
     display_menu->AddChild(MenuItem::Create(
         MenuItem::Type::kString, "&Post-processing settings", "F6",
         std::bind(&EmulatorWindow::ToggleDisplayConfigDialog, this)));
+    display_menu->AddChild(MenuItem::Create(
+        MenuItem::Type::kString, "Frame &Breakdown", "Shift+F6",
+        std::bind(&EmulatorWindow::ToggleFrameBreakdownDialog, this)));
   }
   display_menu->AddChild(MenuItem::Create(MenuItem::Type::kSeparator));
   {
@@ -771,7 +886,11 @@ void EmulatorWindow::OnKeyDown(ui::KeyEvent& e) {
     } break;
 
     case ui::VirtualKey::kF3: {
-      Profiler::ToggleDisplay();
+      if (e.is_shift_pressed()) {
+        Profiler::ToggleTraceCapture();
+      } else {
+        Profiler::ToggleDisplay();
+      }
     } break;
 
     case ui::VirtualKey::kF4: {
@@ -782,7 +901,11 @@ void EmulatorWindow::OnKeyDown(ui::KeyEvent& e) {
     } break;
 
     case ui::VirtualKey::kF6: {
-      ToggleDisplayConfigDialog();
+      if (e.is_shift_pressed()) {
+        ToggleFrameBreakdownDialog();
+      } else {
+        ToggleDisplayConfigDialog();
+      }
     } break;
     case ui::VirtualKey::kF11: {
       ToggleFullscreen();
@@ -1039,6 +1162,15 @@ void EmulatorWindow::ToggleDisplayConfigDialog() {
   }
 }
 
+void EmulatorWindow::ToggleFrameBreakdownDialog() {
+  if (!frame_breakdown_dialog_) {
+    frame_breakdown_dialog_ = std::unique_ptr<FrameBreakdownDialog>(
+        new FrameBreakdownDialog(imgui_drawer_.get(), *this));
+  } else {
+    frame_breakdown_dialog_.reset();
+  }
+}
+
 void EmulatorWindow::PerformancePresetLow() {
   // Low preset: Maximum performance
   OVERRIDE_string(postprocess_antialiasing, "");
@@ -13,6 +13,7 @@
 #include <memory>
 #include <string>
 
+#include "xenia/base/frame_breakdown.h"
 #include "xenia/emulator.h"
 #include "xenia/gpu/command_processor.h"
 #include "xenia/ui/imgui_dialog.h"
@@ -105,6 +106,23 @@ class EmulatorWindow {
     EmulatorWindow& emulator_window_;
   };
 
+  // Per guest frame time spent in the work that commonly causes stutter, with
+  // a rolling frame time graph. The time is only measured while it's open.
+  class FrameBreakdownDialog final : public ui::ImGuiDialog {
+   public:
+    FrameBreakdownDialog(ui::ImGuiDrawer* imgui_drawer,
+                         EmulatorWindow& emulator_window);
+    ~FrameBreakdownDialog();
+
+   protected:
+    void OnDraw(ImGuiIO& io) override;
+
+   private:
+    EmulatorWindow& emulator_window_;
+    frame_breakdown::Frame frames_[frame_breakdown::kHistoryLength];
+    float frame_times_ms_[frame_breakdown::kHistoryLength];
+  };
+
   explicit EmulatorWindow(Emulator* emulator,
                           ui::WindowedAppContext& app_context);
 
@@ -141,6 +159,7 @@ class EmulatorWindow {
   void GpuTraceFrame();
   void GpuClearCaches();
   void ToggleDisplayConfigDialog();
+  void ToggleFrameBreakdownDialog();
   void PerformancePresetLow();
   void PerformancePresetMedium();
   void PerformancePresetHigh();
@@ -164,6 +183,7 @@ class EmulatorWindow {
   bool initializing_shader_storage_ = false;
 
   std::unique_ptr<DisplayConfigDialog> display_config_dialog_;
+  std::unique_ptr<FrameBreakdownDialog> frame_breakdown_dialog_;
 };
 
 }  // namespace app
@@ -0,0 +1,248 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/app/frame_recorder.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/string_util.h"
+#include "xenia/emulator.h"
+#include "xenia/gpu/graphics_system.h"
+
+DEFINE_path(record_frames_path, "",
+            "Path to continuously record the guest output to as an "
+            "uncompressed Y4M video, for automated testing, or empty to not "
+            "record.",
+            "General");
+DEFINE_uint32(record_frames_buffers, 4,
+              "Number of captured guest output images that may be waiting "
+              "for being written when recording the frames. If the writing "
+              "falls behind by more, the new frames are dropped.",
+              "General");
+DEFINE_uint32(record_frames_rate, 60,
+              "Frame rate to write to the header of the recorded Y4M video.",
+              "General");
+
+namespace xe {
+namespace app {
+
+bool FrameRecorder::IsEnabled() { return !cvars::record_frames_path.empty(); }
+
+std::unique_ptr<FrameRecorder> FrameRecorder::Create(Emulator* emulator) {
+  if (!IsEnabled()) {
+    return nullptr;
+  }
+  gpu::GraphicsSystem* graphics_system = emulator->graphics_system();
+  ui::Presenter* presenter =
+      graphics_system ? graphics_system->presenter() : nullptr;
+  if (!presenter) {
+    XELOGE("FrameRecorder: No presenter to capture the guest output from");
+    return nullptr;
+  }
+
+  auto recorder = std::unique_ptr<FrameRecorder>(new FrameRecorder(presenter));
+  xe::filesystem::CreateParentFolder(cvars::record_frames_path);
+  recorder->file_ = xe::filesystem::OpenFile(cvars::record_frames_path, "wb");
+  if (!recorder->file_) {
+    XELOGE("FrameRecorder: Failed to open {} for writing",
+           xe::path_to_utf8(cvars::record_frames_path));
+    return nullptr;
+  }
+  uint32_t buffer_count = std::max(cvars::record_frames_buffers, uint32_t(1));
+  for (uint32_t i = 0; i < buffer_count; ++i) {
+    recorder->free_images_.push_back(std::make_unique<ui::RawImage>());
+  }
+
+  FrameRecorder* recorder_ptr = recorder.get();
+  recorder->encoder_thread_ = xe::threading::Thread::Create(
+      {}, [recorder_ptr]() { recorder_ptr->EncoderThreadMain(); });
+  if (!recorder->encoder_thread_) {
+    XELOGE("FrameRecorder: Failed to create the encoder thread");
+    return nullptr;
+  }
+  recorder->encoder_thread_->set_name("Frame Recorder Encoder");
+  recorder->capture_thread_ = xe::threading::Thread::Create(
+      {}, [recorder_ptr]() { recorder_ptr->CaptureThreadMain(); });
+  if (!recorder->capture_thread_) {
+    XELOGE("FrameRecorder: Failed to create the capture thread");
+    return nullptr;
+  }
+  recorder->capture_thread_->set_name("Frame Recorder Capture");
+  presenter->SetGuestOutputRefreshEvent(recorder->refresh_event_.get());
+  XELOGI("FrameRecorder: Recording the guest output to {}",
+         xe::path_to_utf8(cvars::record_frames_path));
+  return recorder;
+}
+
+FrameRecorder::FrameRecorder(ui::Presenter* presenter)
+    : presenter_(presenter) {
+  refresh_event_ = xe::threading::Event::CreateAutoResetEvent(false);
+}
+
+FrameRecorder::~FrameRecorder() {
+  presenter_->SetGuestOutputRefreshEvent(nullptr);
+  {
+    std::lock_guard<std::mutex> images_lock(images_mutex_);
+    shutting_down_ = true;
+  }
+  images_cond_.notify_all();
+  refresh_event_->Set();
+  if (capture_thread_) {
+    xe::threading::Wait(capture_thread_.get(), false);
+  }
+  if (encoder_thread_) {
+    xe::threading::Wait(encoder_thread_.get(), false);
+  }
+  if (file_) {
+    fclose(file_);
+    XELOGI("FrameRecorder: Wrote {} frames, dropped {}", frames_written_,
+           frames_dropped_.load(std::memory_order_relaxed));
+  }
+}
+
+void FrameRecorder::CaptureThreadMain() {
+  while (true) {
+    xe::threading::Wait(refresh_event_.get(), false);
+    if (shutting_down_) {
+      return;
+    }
+    std::unique_ptr<ui::RawImage> image;
+    {
+      std::lock_guard<std::mutex> images_lock(images_mutex_);
+      if (!free_images_.empty()) {
+        image = std::move(free_images_.back());
+        free_images_.pop_back();
+      }
+    }
+    if (!image) {
+      frames_dropped_.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    // Only waits for the readback of this image on the host GPU, not for the
+    // GPU thread.
+    bool captured = presenter_->CaptureGuestOutput(*image);
+    {
+      std::lock_guard<std::mutex> images_lock(images_mutex_);
+      if (captured) {
+        captured_images_.push_back(std::move(image));
+      } else {
+        free_images_.push_back(std::move(image));
+      }
+    }
+    if (captured) {
+      images_cond_.notify_one();
+    }
+  }
+}
+
+void FrameRecorder::EncoderThreadMain() {
+  while (true) {
+    std::unique_ptr<ui::RawImage> image;
+    {
+      std::unique_lock<std::mutex> images_lock(images_mutex_);
+      images_cond_.wait(images_lock, [this]() {
+        return shutting_down_ || !captured_images_.empty();
+      });
+      // Writing the remaining frames before exiting.
+      if (captured_images_.empty()) {
+        return;
+      }
+      image = std::move(captured_images_.front());
+      captured_images_.pop_front();
+    }
+    if (WriteFrame(*image)) {
+      ++frames_written_;
+    } else {
+      frames_dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> images_lock(images_mutex_);
+    free_images_.push_back(std::move(image));
+  }
+}
+
+bool FrameRecorder::WriteFrame(const ui::RawImage& image) {
+  if (!image.width || !image.height) {
+    return false;
+  }
+  if (!width_) {
+    width_ = image.width;
+    height_ = image.height;
+    std::string header =
+        fmt::format("YUV4MPEG2 W{} H{} F{}:1 Ip A1:1 C420jpeg\n", width_,
+                    height_, std::max(cvars::record_frames_rate, uint32_t(1)));
+    fwrite(header.data(), 1, header.size(), file_);
+  } else if (image.width != width_ || image.height != height_) {
+    // Y4M doesn't support changing the frame size within a stream.
+    XELOGW(
+        "FrameRecorder: Dropping a {}x{} frame in a {}x{} stream, the frame "
+        "size can't be changed while recording",
+        image.width, image.height, width_, height_);
+    return false;
+  }
+
+  // BT.601 with the limited range, with the chroma of each 2x2 quad averaged.
+  uint32_t chroma_width = (width_ + 1) >> 1;
+  uint32_t chroma_height = (height_ + 1) >> 1;
+  size_t luma_size = size_t(width_) * height_;
+  size_t chroma_size = size_t(chroma_width) * chroma_height;
+  frame_buffer_.resize(luma_size + chroma_size * 2);
+  uint8_t* luma = frame_buffer_.data();
+  uint8_t* chroma_b = luma + luma_size;
+  uint8_t* chroma_r = chroma_b + chroma_size;
+  const uint8_t* pixels = image.data.data();
+  for (uint32_t y = 0; y < height_; ++y) {
+    const uint8_t* row = pixels + image.stride * y;
+    for (uint32_t x = 0; x < width_; ++x) {
+      const uint8_t* pixel = row + sizeof(uint32_t) * x;
+      int32_t r = pixel[0], g = pixel[1], b = pixel[2];
+      luma[size_t(width_) * y + x] =
+          uint8_t(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8));
+    }
+  }
+  for (uint32_t y = 0; y < chroma_height; ++y) {
+    const uint8_t* row_0 = pixels + image.stride * (y << 1);
+    const uint8_t* row_1 =
+        pixels + image.stride * std::min((y << 1) + 1, height_ - 1);
+    for (uint32_t x = 0; x < chroma_width; ++x) {
+      size_t offset_0 = sizeof(uint32_t) * (x << 1);
+      size_t offset_1 = sizeof(uint32_t) * std::min((x << 1) + 1, width_ - 1);
+      int32_t rgb[3];
+      for (uint32_t i = 0; i < 3; ++i) {
+        rgb[i] = (row_0[offset_0 + i] + row_0[offset_1 + i] +
+                  row_1[offset_0 + i] + row_1[offset_1 + i] + 2) >>
+                 2;
+      }
+      size_t chroma_index = size_t(chroma_width) * y + x;
+      chroma_b[chroma_index] = uint8_t(
+          128 + ((-38 * rgb[0] - 74 * rgb[1] + 112 * rgb[2] + 128) >> 8));
+      chroma_r[chroma_index] = uint8_t(
+          128 + ((112 * rgb[0] - 94 * rgb[1] - 18 * rgb[2] + 128) >> 8));
+    }
+  }
+
+  static const char kFrameHeader[] = "FRAME\n";
+  bool written =
+      fwrite(kFrameHeader, 1, sizeof(kFrameHeader) - 1, file_) ==
+          sizeof(kFrameHeader) - 1 &&
+      fwrite(frame_buffer_.data(), 1, frame_buffer_.size(), file_) ==
+          frame_buffer_.size();
+  // The emulator may exit without destroying the recorder, keep the file
+  // usable up to the last frame.
+  fflush(file_);
+  return written;
+}
+
+}  // namespace app
+}  // namespace xe
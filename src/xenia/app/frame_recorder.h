@@ -0,0 +1,81 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APP_FRAME_RECORDER_H_
+#define XENIA_APP_FRAME_RECORDER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "xenia/base/threading.h"
+#include "xenia/ui/presenter.h"
+
+namespace xe {
+class Emulator;
+}  // namespace xe
+
+namespace xe {
+namespace app {
+
+// With --record_frames_path, continuously captures the guest output after
+// every refresh and writes it as an uncompressed Y4M video, for automated test
+// recording. The readback happens on the capture thread and the conversion and
+// writing on the encoder thread, with a ring of captured images between them,
+// so the GPU thread is never waited for - if the encoder falls behind and the
+// ring is full, frames are dropped instead.
+class FrameRecorder {
+ public:
+  static bool IsEnabled();
+
+  // Returns null if recording is not enabled or has failed to start.
+  static std::unique_ptr<FrameRecorder> Create(Emulator* emulator);
+  ~FrameRecorder();
+
+ private:
+  explicit FrameRecorder(ui::Presenter* presenter);
+
+  void CaptureThreadMain();
+  void EncoderThreadMain();
+  // Returns whether the frame has been written.
+  bool WriteFrame(const ui::RawImage& image);
+
+  ui::Presenter* presenter_;
+  FILE* file_ = nullptr;
+  // Of the stream, taken from the first frame.
+  uint32_t width_ = 0;
+  uint32_t height_ = 0;
+  std::vector<uint8_t> frame_buffer_;
+
+  std::unique_ptr<xe::threading::Event> refresh_event_;
+  std::atomic<bool> shutting_down_{false};
+
+  std::mutex images_mutex_;
+  std::condition_variable images_cond_;
+  // Images not used by either thread currently.
+  std::vector<std::unique_ptr<ui::RawImage>> free_images_;
+  // Captured, in the order of capturing.
+  std::deque<std::unique_ptr<ui::RawImage>> captured_images_;
+
+  uint64_t frames_written_ = 0;
+  std::atomic<uint64_t> frames_dropped_{0};
+
+  std::unique_ptr<xe::threading::Thread> capture_thread_;
+  std::unique_ptr<xe::threading::Thread> encoder_thread_;
+};
+
+}  // namespace app
+}  // namespace xe
+
+#endif  // XENIA_APP_FRAME_RECORDER_H_
@@ -15,6 +15,8 @@
 #include <thread>
 #include <vector>
 
+#include "xenia/app/benchmark.h"
+#include "xenia/app/frame_recorder.h"
 #include "xenia/app/discord/discord_presence.h"
 #include "xenia/app/emulator_window.h"
 #include "xenia/base/assert.h"
@@ -227,6 +229,11 @@ class EmulatorApp final : public xe::ui::WindowedApp {
   // Created on demand, used by the emulator.
   std::unique_ptr<xe::debug::ui::DebugWindow> debug_window_;
 
+  // Created by the emulator thread if benchmarking.
+  std::unique_ptr<Benchmark> benchmark_;
+  // Created by the emulator thread if recording the frames.
+  std::unique_ptr<FrameRecorder> frame_recorder_;
+
   // Refreshing the emulator - placed after its dependencies.
   std::atomic<bool> emulator_thread_quit_requested_;
   std::unique_ptr<xe::threading::Event> emulator_thread_event_;
@@ -441,6 +448,8 @@ bool EmulatorApp::OnInitialize() {
   XELOGI("Storage root: {}", xe::path_to_utf8(storage_root));
 
   config::SetupConfig(storage_root);
+  // After loading the config so it doesn't replace the overrides.
+  Benchmark::ApplyConfigOverrides();
 
   std::filesystem::path content_root = cvars::content_root;
   if (content_root.empty()) {
@@ -537,6 +546,13 @@ void EmulatorApp::EmulatorThread() {
   app_context().CallInUIThread(
       [this]() { emulator_window_->SetupGraphicsSystemPresenterPainting(); });
 
+  benchmark_ = Benchmark::Create(emulator_.get(), [this]() {
+    XELOGI("Benchmark finished, quitting");
+    app_context().RequestDeferredQuit();
+  });
+
+  frame_recorder_ = FrameRecorder::Create(emulator_.get());
+
   if (cvars::mount_scratch) {
     auto scratch_device = std::make_unique<xe::vfs::HostPathDevice>(
         "\\SCRATCH", "scratch", false);
@@ -619,6 +635,9 @@ void EmulatorApp::EmulatorThread() {
           game_title.empty() ? "Unknown Title" : std::string(game_title));
     }
     app_context().CallInUIThread([this]() { emulator_window_->UpdateTitle(); });
+    if (benchmark_) {
+      benchmark_->OnTitleLaunched(game_title);
+    }
     emulator_thread_event_->Set();
   });
 
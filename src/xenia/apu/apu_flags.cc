@@ -10,3 +10,27 @@
 #include "xenia/apu/apu_flags.h"
 
 DEFINE_bool(mute, false, "Mutes all audio output.", "APU")
+DEFINE_uint32(apu_max_queued_frames, 64,
+              "Maximum number of 256-sample audio frames (5.33 ms each) a "
+              "client may have queued for playback. Lower values reduce the "
+              "audio latency, but may cause crackling if the emulator can't "
+              "keep up. [1-64]",
+              "APU")
+DEFINE_uint32(apu_target_latency, 0,
+              "Target audio output latency in milliseconds (such as 20 to 60) "
+              "for the SDL audio driver, which then lets clients queue only "
+              "as many frames as needed for it. Raised automatically when "
+              "playback runs out of audio, and lowered back over time. 0 to "
+              "let clients queue up to apu_max_queued_frames.",
+              "APU")
+DEFINE_double(apu_dynamic_rate, 0.0,
+              "Maximum relative change of the audio playback rate (for "
+              "example, 0.02 for 2%) used to slow down playback while the "
+              "emulator is running below full speed, such as during shader "
+              "compilation, instead of running out of audio. 0 to disable.",
+              "APU")
+DEFINE_uint32(apu_statistics_log_interval, 0,
+              "Interval in seconds between log lines with the XMA decoding "
+              "time, guest audio callback time and audio underruns, for "
+              "diagnosing audio performance. 0 to disable.",
+              "APU")
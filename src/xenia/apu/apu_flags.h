@@ -12,5 +12,9 @@
 
 #include "xenia/base/cvar.h"
 DECLARE_bool(mute)
+DECLARE_uint32(apu_max_queued_frames)
+DECLARE_uint32(apu_target_latency)
+DECLARE_double(apu_dynamic_rate)
+DECLARE_uint32(apu_statistics_log_interval)
 
 #endif  // XENIA_APU_APU_FLAGS_H_
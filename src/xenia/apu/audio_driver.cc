@@ -9,6 +9,11 @@
 
 #include "xenia/apu/audio_driver.h"
 
+#include <algorithm>
+
+#include "xenia/apu/apu_flags.h"
+#include "xenia/base/profiling.h"
+
 namespace xe {
 namespace apu {
 
@@ -16,5 +21,27 @@ AudioDriver::AudioDriver(Memory* memory) : memory_(memory) {}
 
 AudioDriver::~AudioDriver() = default;
 
+void AudioDriver::RecordUnderrun() {
+  underrun_count_.fetch_add(1, std::memory_order_relaxed);
+  COUNT_profile_add("apu/underruns", 1);
+}
+
+double AudioDriver::GetDynamicRateRatio(uint32_t queued_frames,
+                                        uint32_t full_queued_frames) {
+  double max_deviation = std::min(std::max(cvars::apu_dynamic_rate, 0.0), 0.5);
+  if (!max_deviation) {
+    return 1.0;
+  }
+  // Same limits as in the audio system.
+  uint32_t max_queued_frames =
+      full_queued_frames
+          ? full_queued_frames
+          : std::min(std::max(cvars::apu_max_queued_frames, uint32_t(1)),
+                     uint32_t(64));
+  double fill =
+      std::min(double(queued_frames) / double(max_queued_frames), 1.0);
+  return 1.0 - max_deviation * (1.0 - fill);
+}
+
 }  // namespace apu
 }  // namespace xe
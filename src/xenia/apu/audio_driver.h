@@ -10,6 +10,9 @@
 #ifndef XENIA_APU_AUDIO_DRIVER_H_
 #define XENIA_APU_AUDIO_DRIVER_H_
 
+#include <atomic>
+#include <cstdint>
+
 #include "xenia/memory.h"
 #include "xenia/xbox.h"
 
@@ -23,12 +26,29 @@ class AudioDriver {
 
   virtual void SubmitFrame(uint32_t samples_ptr) = 0;
 
+  // Returns the number of times playback ran out of frames since the
+  // previous call.
+  uint64_t TakeUnderrunCount() {
+    return underrun_count_.exchange(0, std::memory_order_relaxed);
+  }
+
  protected:
   inline uint8_t* TranslatePhysical(uint32_t guest_address) const {
     return memory_->TranslatePhysical(guest_address);
   }
 
+  // Playback rate multiplier for the number of frames currently queued. The
+  // audio system keeps the queue full while the guest runs at full speed, so
+  // with apu_dynamic_rate, playback is gradually slowed down as the queue
+  // drains, stretching the remaining audio over hitches. The queue is full at
+  // full_queued_frames, or at apu_max_queued_frames if it's 0.
+  static double GetDynamicRateRatio(uint32_t queued_frames,
+                                    uint32_t full_queued_frames = 0);
+
+  void RecordUnderrun();
+
   Memory* memory_ = nullptr;
+  std::atomic<uint64_t> underrun_count_ = {0};
 };
 
 }  // namespace apu
@@ -9,11 +9,14 @@
 
 #include "xenia/apu/audio_system.h"
 
+#include <algorithm>
+
 #include "xenia/apu/apu_flags.h"
 #include "xenia/apu/audio_driver.h"
 #include "xenia/apu/xma_decoder.h"
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_stream.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
@@ -43,6 +46,10 @@ AudioSystem::AudioSystem(cpu::Processor* processor)
       worker_running_(false) {
   std::memset(clients_, 0, sizeof(clients_));
 
+  queued_frame_count_ =
+      std::min(std::max(size_t(cvars::apu_max_queued_frames), size_t(1)),
+               kMaximumQueuedFrames);
+
   for (size_t i = 0; i < kMaximumClientCount; ++i) {
     client_semaphores_[i] =
         xe::threading::Semaphore::Create(0, kMaximumQueuedFrames);
@@ -117,21 +124,27 @@ void AudioSystem::WorkerThreadMain() {
     if (result.first == xe::threading::WaitResult::kSuccess) {
       auto index = result.second;
 
-      auto global_lock = global_critical_region_.Acquire();
+      std::unique_lock<std::mutex> clients_lock(clients_mutex_);
       uint32_t client_callback = clients_[index].callback;
       uint32_t client_callback_arg = clients_[index].wrapped_callback_arg;
-      global_lock.unlock();
+      clients_lock.unlock();
 
       if (client_callback) {
         SCOPE_profile_cpu_i("apu", "xe::apu::AudioSystem->client_callback");
+        uint64_t callback_start_host_ticks = Clock::QueryHostTickCount();
         uint64_t args[] = {client_callback_arg};
         processor_->Execute(worker_thread_->thread_state(), client_callback,
                             args, xe::countof(args));
+        ++statistics_callback_count_;
+        statistics_callback_host_ticks_ +=
+            Clock::QueryHostTickCount() - callback_start_host_ticks;
       }
 
       pumped = true;
     }
 
+    MaybeLogStatistics();
+
     if (!worker_running_) {
       break;
     }
@@ -146,6 +159,53 @@ void AudioSystem::WorkerThreadMain() {
   // TODO(benvanik): call module API to kill?
 }
 
+void AudioSystem::MaybeLogStatistics() {
+  if (!cvars::apu_statistics_log_interval) {
+    return;
+  }
+  uint64_t host_tick_frequency = Clock::QueryHostTickFrequency();
+  uint64_t now_host_ticks = Clock::QueryHostTickCount();
+  if (!statistics_last_log_host_ticks_) {
+    // Start the first interval.
+    statistics_last_log_host_ticks_ = now_host_ticks;
+    return;
+  }
+  uint64_t interval_host_ticks =
+      now_host_ticks - statistics_last_log_host_ticks_;
+  if (interval_host_ticks <
+      host_tick_frequency * cvars::apu_statistics_log_interval) {
+    return;
+  }
+  statistics_last_log_host_ticks_ = now_host_ticks;
+
+  auto host_ticks_to_ms = [host_tick_frequency](uint64_t host_ticks) {
+    return double(host_ticks) * 1000.0 / double(host_tick_frequency);
+  };
+  double interval_s = host_ticks_to_ms(interval_host_ticks) / 1000.0;
+  XmaDecoder::Statistics xma_statistics = xma_decoder_->TakeStatistics();
+  uint64_t underrun_count = 0;
+  {
+    std::lock_guard<std::mutex> clients_lock(clients_mutex_);
+    for (size_t i = 0; i < kMaximumClientCount; ++i) {
+      if (clients_[i].driver) {
+        underrun_count += clients_[i].driver->TakeUnderrunCount();
+      }
+    }
+  }
+  XELOGI(
+      "APU: in {:.1f} s, {} XMA decoder passes decoded {} contexts in "
+      "{:.2f} ms (longest {:.3f} ms), {} guest audio callbacks took {:.2f} "
+      "ms, {} underruns",
+      interval_s, xma_statistics.pass_count,
+      xma_statistics.decoded_context_count,
+      host_ticks_to_ms(xma_statistics.decode_host_ticks),
+      host_ticks_to_ms(xma_statistics.max_context_decode_host_ticks),
+      statistics_callback_count_,
+      host_ticks_to_ms(statistics_callback_host_ticks_), underrun_count);
+  statistics_callback_count_ = 0;
+  statistics_callback_host_ticks_ = 0;
+}
+
 int AudioSystem::FindFreeClient() {
   for (int i = 0; i < kMaximumClientCount; i++) {
     auto& client = clients_[i];
@@ -170,25 +230,28 @@ void AudioSystem::Shutdown() {
 
 X_STATUS AudioSystem::RegisterClient(uint32_t callback, uint32_t callback_arg,
                                      size_t* out_index) {
-  auto global_lock = global_critical_region_.Acquire();
+  // Allocated before locking the clients, as the heap takes the global
+  // critical region.
+  uint32_t ptr = memory()->SystemHeapAlloc(0x4);
+  xe::store_and_swap<uint32_t>(memory()->TranslateVirtual(ptr), callback_arg);
+
+  std::lock_guard<std::mutex> clients_lock(clients_mutex_);
 
   auto index = FindFreeClient();
   assert_true(index >= 0);
 
   auto client_semaphore = client_semaphores_[index].get();
-  auto ret = client_semaphore->Release(kMaximumQueuedFrames, nullptr);
+  auto ret = client_semaphore->Release(queued_frame_count_, nullptr);
   assert_true(ret);
 
   AudioDriver* driver;
   auto result = CreateDriver(index, client_semaphore, &driver);
   if (XFAILED(result)) {
+    memory()->SystemHeapFree(ptr);
     return result;
   }
   assert_not_null(driver);
 
-  uint32_t ptr = memory()->SystemHeapAlloc(0x4);
-  xe::store_and_swap<uint32_t>(memory()->TranslateVirtual(ptr), callback_arg);
-
   clients_[index] = {driver, callback, callback_arg, ptr, true};
 
   if (out_index) {
@@ -201,7 +264,7 @@ X_STATUS AudioSystem::RegisterClient(uint32_t callback, uint32_t callback_arg,
 void AudioSystem::SubmitFrame(size_t index, uint32_t samples_ptr) {
   SCOPE_profile_cpu_f("apu");
 
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::mutex> clients_lock(clients_mutex_);
   assert_true(index < kMaximumClientCount);
   assert_true(clients_[index].driver != NULL);
   (clients_[index].driver)->SubmitFrame(samples_ptr);
@@ -210,10 +273,10 @@ void AudioSystem::SubmitFrame(size_t index, uint32_t samples_ptr) {
 void AudioSystem::UnregisterClient(size_t index) {
   SCOPE_profile_cpu_f("apu");
 
-  auto global_lock = global_critical_region_.Acquire();
+  std::unique_lock<std::mutex> clients_lock(clients_mutex_);
   assert_true(index < kMaximumClientCount);
   DestroyDriver(clients_[index].driver);
-  memory()->SystemHeapFree(clients_[index].wrapped_callback_arg);
+  uint32_t wrapped_callback_arg = clients_[index].wrapped_callback_arg;
   clients_[index] = {0};
 
   // Drain the semaphore of its count.
@@ -224,6 +287,9 @@ void AudioSystem::UnregisterClient(size_t index) {
                                       std::chrono::milliseconds(0));
   } while (wait_result == xe::threading::WaitResult::kSuccess);
   assert_true(wait_result == xe::threading::WaitResult::kTimeout);
+  clients_lock.unlock();
+
+  memory()->SystemHeapFree(wrapped_callback_arg);
 }
 
 bool AudioSystem::Save(ByteStream* stream) {
@@ -279,7 +345,7 @@ bool AudioSystem::Restore(ByteStream* stream) {
     client.in_use = true;
 
     auto client_semaphore = client_semaphores_[id].get();
-    auto ret = client_semaphore->Release(kMaximumQueuedFrames, nullptr);
+    auto ret = client_semaphore->Release(queued_frame_count_, nullptr);
     assert_true(ret);
 
     AudioDriver* driver = nullptr;
@@ -11,6 +11,7 @@
 #define XENIA_APU_AUDIO_SYSTEM_H_
 
 #include <atomic>
+#include <mutex>
 #include <queue>
 
 #include "xenia/base/mutex.h"
@@ -57,6 +58,9 @@ class AudioSystem {
   virtual void Initialize();
 
   void WorkerThreadMain();
+  // Logs the statistics if apu_statistics_log_interval has passed since they
+  // were last logged.
+  void MaybeLogStatistics();
 
   virtual X_STATUS CreateDriver(size_t index,
                                 xe::threading::Semaphore* semaphore,
@@ -66,6 +70,8 @@ class AudioSystem {
   // TODO(gibbed): respect XAUDIO2_MAX_QUEUED_BUFFERS somehow (ie min(64,
   // XAUDIO2_MAX_QUEUED_BUFFERS))
   static const size_t kMaximumQueuedFrames = 64;
+  // From the apu_max_queued_frames cvar.
+  size_t queued_frame_count_ = kMaximumQueuedFrames;
 
   Memory* memory_ = nullptr;
   cpu::Processor* processor_ = nullptr;
@@ -74,7 +80,14 @@ class AudioSystem {
   std::atomic<bool> worker_running_ = {false};
   kernel::object_ref<kernel::XHostThread> worker_thread_;
 
-  xe::global_critical_region global_critical_region_;
+  // Collected by the worker thread.
+  uint64_t statistics_callback_count_ = 0;
+  uint64_t statistics_callback_host_ticks_ = 0;
+  uint64_t statistics_last_log_host_ticks_ = 0;
+
+  // Only protects the clients, so that frame submission doesn't contend with
+  // the rest of the kernel over the global critical region.
+  std::mutex clients_mutex_;
   static const size_t kMaximumClientCount = 8;
   struct {
     AudioDriver* driver;
@@ -0,0 +1,131 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/conversion.h"
+
+#if XE_ARCH_AMD64
+#include "third_party/xbyak/xbyak/xbyak_util.h"
+#endif  // XE_ARCH_AMD64
+
+// The project is built for AVX, the AVX2 functions must be compiled for it
+// explicitly and only called after checking that the host supports it.
+#if XE_ARCH_AMD64 && !XE_COMPILER_MSVC
+#define XE_APU_CONVERSION_AVX2 __attribute__((target("avx2")))
+#else
+#define XE_APU_CONVERSION_AVX2
+#endif
+
+namespace xe {
+namespace apu {
+namespace conversion {
+
+#if XE_ARCH_AMD64
+bool IsAVX2Supported() {
+  static const bool is_avx2_supported =
+      Xbyak::util::Cpu().has(Xbyak::util::Cpu::tAVX2);
+  return is_avx2_supported;
+}
+
+XE_APU_CONVERSION_AVX2 void sequential_6_BE_to_interleaved_2_LE_avx2(
+    float* output, const float* input, size_t ch_sample_count) {
+  assert_true(ch_sample_count % 8 == 0);
+  const __m256i byte_swap_shuffle = _mm256_set_epi8(
+      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15, 8,
+      9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 two_fifths = _mm256_set1_ps(1.0f / 2.5f);
+
+  // put center on left and right, discard low frequency
+  for (size_t sample = 0; sample < ch_sample_count; sample += 8) {
+    // load 8 samples from 6 channels each, and byte swap
+    __m256 fl = _mm256_castsi256_ps(_mm256_shuffle_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+            &input[0 * ch_sample_count + sample])),
+        byte_swap_shuffle));
+    __m256 fr = _mm256_castsi256_ps(_mm256_shuffle_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+            &input[1 * ch_sample_count + sample])),
+        byte_swap_shuffle));
+    __m256 fc = _mm256_castsi256_ps(_mm256_shuffle_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+            &input[2 * ch_sample_count + sample])),
+        byte_swap_shuffle));
+    __m256 bl = _mm256_castsi256_ps(_mm256_shuffle_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+            &input[4 * ch_sample_count + sample])),
+        byte_swap_shuffle));
+    __m256 br = _mm256_castsi256_ps(_mm256_shuffle_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+            &input[5 * ch_sample_count + sample])),
+        byte_swap_shuffle));
+
+    __m256 center_halved = _mm256_mul_ps(fc, half);
+    __m256 left = _mm256_add_ps(_mm256_add_ps(fl, bl), center_halved);
+    __m256 right = _mm256_add_ps(_mm256_add_ps(fr, br), center_halved);
+    left = _mm256_mul_ps(left, two_fifths);
+    right = _mm256_mul_ps(right, two_fifths);
+    // Unpacking works within 128-bit lanes, giving samples 0, 1, 4, 5 and
+    // 2, 3, 6, 7.
+    __m256 left_right_lo = _mm256_unpacklo_ps(left, right);
+    __m256 left_right_hi = _mm256_unpackhi_ps(left, right);
+    _mm256_storeu_ps(&output[sample * 2],
+                     _mm256_permute2f128_ps(left_right_lo, left_right_hi,
+                                            0x20));
+    _mm256_storeu_ps(&output[(sample + 4) * 2],
+                     _mm256_permute2f128_ps(left_right_lo, left_right_hi,
+                                            0x31));
+  }
+}
+
+XE_APU_CONVERSION_AVX2 void planar_f32_to_interleaved_s16_BE_avx2(
+    int16_t* output, const float* const* input, bool is_two_channel,
+    size_t ch_sample_count) {
+  assert_true(ch_sample_count % 16 == 0);
+  const float* in_channel_0 = input[0];
+  const __m256 scale = _mm256_set1_ps(float((1 << 15) - 1));
+  if (is_two_channel) {
+    const float* in_channel_1 = input[1];
+    // Packing works within 128-bit lanes, so each lane contains 4 samples of
+    // each channel, to be interleaved and byte swapped.
+    const __m256i shuffle = _mm256_set_epi8(
+        14, 15, 6, 7, 12, 13, 4, 5, 10, 11, 2, 3, 8, 9, 0, 1, 14, 15, 6, 7, 12,
+        13, 4, 5, 10, 11, 2, 3, 8, 9, 0, 1);
+    for (size_t i = 0; i < ch_sample_count; i += 8) {
+      __m256i out_0 = _mm256_cvtps_epi32(
+          _mm256_mul_ps(_mm256_loadu_ps(&in_channel_0[i]), scale));
+      __m256i out_1 = _mm256_cvtps_epi32(
+          _mm256_mul_ps(_mm256_loadu_ps(&in_channel_1[i]), scale));
+      // Saturated cast and pack to int16.
+      __m256i out = _mm256_packs_epi32(out_0, out_1);
+      out = _mm256_shuffle_epi8(out, shuffle);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(&output[i * 2]), out);
+    }
+  } else {
+    const __m256i byte_swap_shuffle = _mm256_set_epi8(
+        14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1, 14, 15, 12, 13,
+        10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+    for (size_t i = 0; i < ch_sample_count; i += 16) {
+      __m256i out_0 = _mm256_cvtps_epi32(
+          _mm256_mul_ps(_mm256_loadu_ps(&in_channel_0[i]), scale));
+      __m256i out_1 = _mm256_cvtps_epi32(
+          _mm256_mul_ps(_mm256_loadu_ps(&in_channel_0[i + 8]), scale));
+      // Saturated cast and pack to int16, which gives samples 0-3, 8-11, 4-7
+      // and 12-15.
+      __m256i out = _mm256_packs_epi32(out_0, out_1);
+      out = _mm256_permute4x64_epi64(out, _MM_SHUFFLE(3, 1, 2, 0));
+      out = _mm256_shuffle_epi8(out, byte_swap_shuffle);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(&output[i]), out);
+    }
+  }
+}
+#endif  // XE_ARCH_AMD64
+
+}  // namespace conversion
+}  // namespace apu
+}  // namespace xe
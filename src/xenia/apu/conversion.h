@@ -12,6 +12,7 @@
 
 #include <cstdint>
 
+#include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
 #include "xenia/base/platform.h"
 
@@ -20,6 +21,18 @@ namespace apu {
 namespace conversion {
 
 #if XE_ARCH_AMD64
+// Wider versions of the conversions, for hosts supporting AVX2.
+bool IsAVX2Supported();
+void sequential_6_BE_to_interleaved_2_LE_avx2(float* output,
+                                              const float* input,
+                                              size_t ch_sample_count);
+// Converts planar float samples to interleaved big-endian int16 ones, for
+// mono or stereo audio.
+void planar_f32_to_interleaved_s16_BE_avx2(int16_t* output,
+                                           const float* const* input,
+                                           bool is_two_channel,
+                                           size_t ch_sample_count);
+
 inline void sequential_6_BE_to_interleaved_6_LE(float* output,
                                                 const float* input,
                                                 size_t ch_sample_count) {
@@ -46,6 +59,10 @@ inline void sequential_6_BE_to_interleaved_2_LE(float* output,
                                                 const float* input,
                                                 size_t ch_sample_count) {
   assert_true(ch_sample_count % 4 == 0);
+  if (!(ch_sample_count % 8) && IsAVX2Supported()) {
+    sequential_6_BE_to_interleaved_2_LE_avx2(output, input, ch_sample_count);
+    return;
+  }
   const uint32_t* in = reinterpret_cast<const uint32_t*>(input);
   uint32_t* out = reinterpret_cast<uint32_t*>(output);
   const __m128i byte_swap_shuffle =
@@ -9,6 +9,7 @@
 
 #include "xenia/apu/sdl/sdl_audio_driver.h"
 
+#include <algorithm>
 #include <array>
 #include <cstring>
 
@@ -25,12 +26,11 @@ namespace sdl {
 
 SDLAudioDriver::SDLAudioDriver(Memory* memory,
                                xe::threading::Semaphore* semaphore)
-    : AudioDriver(memory), semaphore_(semaphore) {}
+    : AudioDriver(memory),
+      semaphore_(semaphore),
+      frames_(new float[frame_count_ * frame_samples_]) {}
 
-SDLAudioDriver::~SDLAudioDriver() {
-  assert_true(frames_queued_.empty());
-  assert_true(frames_unused_.empty());
-};
+SDLAudioDriver::~SDLAudioDriver() = default;
 
 bool SDLAudioDriver::Initialize() {
   SDL_version ver = {};
@@ -58,8 +58,11 @@ bool SDLAudioDriver::Initialize() {
   desired_spec.samples = channel_samples_;
   desired_spec.callback = SDLCallback;
   desired_spec.userdata = this;
-  // Allow the hardware to decide between 5.1 and stereo
-  int allowed_change = SDL_AUDIO_ALLOW_CHANNELS_CHANGE;
+  // Allow the hardware to decide between 5.1 and stereo, and use its native
+  // frequency and period size.
+  int allowed_change = SDL_AUDIO_ALLOW_CHANNELS_CHANGE |
+                       SDL_AUDIO_ALLOW_FREQUENCY_CHANGE |
+                       SDL_AUDIO_ALLOW_SAMPLES_CHANGE;
   for (int i = 0; i < 2; i++) {
     sdl_device_id_ = SDL_OpenAudioDevice(nullptr, 0, &desired_spec,
                                          &obtained_spec, allowed_change);
@@ -80,6 +83,35 @@ bool SDLAudioDriver::Initialize() {
     return false;
   }
   sdl_device_channels_ = obtained_spec.channels;
+  sdl_device_frequency_ = uint32_t(obtained_spec.freq);
+  sdl_device_samples_ = obtained_spec.samples;
+  // The playback rate is adjusted during resampling.
+  if (sdl_device_frequency_ != frame_frequency_ ||
+      sdl_device_samples_ != channel_samples_ || cvars::apu_dynamic_rate) {
+    XELOGI("SDLAudioDriver: resampling to {} Hz, {} samples per period",
+           sdl_device_frequency_, sdl_device_samples_);
+    resample_buffer_ = std::make_unique<float[]>(
+        (resample_history_ + channel_samples_) * sdl_device_channels_);
+    // Start with the history, which is silence, consumed.
+    resample_position_ = double(resample_history_ + channel_samples_);
+    resample_step_ = double(frame_frequency_) / double(sdl_device_frequency_);
+  }
+
+  if (cvars::apu_target_latency) {
+    // The device period is a part of the latency too.
+    uint32_t period_ms = sdl_device_samples_ * 1000 / sdl_device_frequency_;
+    uint32_t queue_ms =
+        cvars::apu_target_latency - std::min(cvars::apu_target_latency,
+                                             period_ms);
+    uint32_t frame_count = (queue_ms * frame_frequency_ +
+                            1000 * channel_samples_ - 1) /
+                           (1000 * channel_samples_);
+    min_target_queued_frames_ =
+        std::min(std::max(frame_count, uint32_t(1)), frame_count_);
+    target_queued_frames_ = min_target_queued_frames_;
+    XELOGI("SDLAudioDriver: targeting {} ms of latency, {} frames queued",
+           cvars::apu_target_latency, target_queued_frames_);
+  }
 
   SDL_PauseAudioDevice(sdl_device_id_, 0);
 
@@ -87,24 +119,17 @@ bool SDLAudioDriver::Initialize() {
 }
 
 void SDLAudioDriver::SubmitFrame(uint32_t frame_ptr) {
-  const auto input_frame = memory_->TranslateVirtual<float*>(frame_ptr);
-  float* output_frame;
-  {
-    std::unique_lock<std::mutex> guard(frames_mutex_);
-    if (frames_unused_.empty()) {
-      output_frame = new float[frame_samples_];
-    } else {
-      output_frame = frames_unused_.top();
-      frames_unused_.pop();
-    }
-  }
-
-  std::memcpy(output_frame, input_frame, frame_samples_ * sizeof(float));
-
-  {
-    std::unique_lock<std::mutex> guard(frames_mutex_);
-    frames_queued_.push(output_frame);
+  uint32_t frames_written = frames_written_.load(std::memory_order_relaxed);
+  if (frames_written - frames_read_.load(std::memory_order_acquire) >=
+      frame_count_) {
+    // Shouldn't happen as the audio system waits for frames to be played.
+    XELOGW("SDLAudioDriver: frame queue is full, dropping a frame");
+    return;
   }
+  const auto input_frame = memory_->TranslateVirtual<float*>(frame_ptr);
+  std::memcpy(&frames_[(frames_written % frame_count_) * frame_samples_],
+              input_frame, frame_size_);
+  frames_written_.store(frames_written + 1, std::memory_order_release);
 }
 
 void SDLAudioDriver::Shutdown() {
@@ -116,15 +141,6 @@ void SDLAudioDriver::Shutdown() {
     SDL_QuitSubSystem(SDL_INIT_AUDIO);
     sdl_initialized_ = false;
   }
-  std::unique_lock<std::mutex> guard(frames_mutex_);
-  while (!frames_unused_.empty()) {
-    delete[] frames_unused_.top();
-    frames_unused_.pop();
-  };
-  while (!frames_queued_.empty()) {
-    delete[] frames_queued_.front();
-    frames_queued_.pop();
-  };
 }
 
 void SDLAudioDriver::SDLCallback(void* userdata, Uint8* stream, int len) {
@@ -134,38 +150,132 @@ void SDLAudioDriver::SDLCallback(void* userdata, Uint8* stream, int len) {
     return;
   }
   const auto driver = static_cast<SDLAudioDriver*>(userdata);
-  assert_true(len ==
-              sizeof(float) * channel_samples_ * driver->sdl_device_channels_);
+  assert_true(len % (sizeof(float) * driver->sdl_device_channels_) == 0);
+  auto output = reinterpret_cast<float*>(stream);
 
-  std::unique_lock<std::mutex> guard(driver->frames_mutex_);
-  if (driver->frames_queued_.empty()) {
-    std::memset(stream, 0, len);
+  if (driver->resample_buffer_) {
+    driver->ResampleFrames(
+        output, uint32_t(len / (sizeof(float) * driver->sdl_device_channels_)));
   } else {
-    auto buffer = driver->frames_queued_.front();
-    driver->frames_queued_.pop();
-    if (cvars::mute) {
+    assert_true(len == sizeof(float) * channel_samples_ *
+                           driver->sdl_device_channels_);
+    if (!driver->PopFrame(output)) {
       std::memset(stream, 0, len);
-    } else {
-      switch (driver->sdl_device_channels_) {
-        case 2:
-          conversion::sequential_6_BE_to_interleaved_2_LE(
-              reinterpret_cast<float*>(stream), buffer, channel_samples_);
-          break;
-        case 6:
-          conversion::sequential_6_BE_to_interleaved_6_LE(
-              reinterpret_cast<float*>(stream), buffer, channel_samples_);
-          break;
-        default:
-          assert_unhandled_case(driver->sdl_device_channels_);
-          break;
+      if (driver->frames_read_.load(std::memory_order_relaxed)) {
+        driver->OnUnderrun();
       }
     }
-    driver->frames_unused_.push(buffer);
-
-    auto ret = driver->semaphore_->Release(1, nullptr);
-    assert_true(ret);
+  }
+  if (cvars::mute) {
+    std::memset(stream, 0, len);
   }
 };
+
+bool SDLAudioDriver::PopFrame(float* output) {
+  uint32_t frames_read = frames_read_.load(std::memory_order_relaxed);
+  if (frames_read == frames_written_.load(std::memory_order_acquire)) {
+    return false;
+  }
+  const float* buffer = &frames_[(frames_read % frame_count_) * frame_samples_];
+  switch (sdl_device_channels_) {
+    case 2:
+      conversion::sequential_6_BE_to_interleaved_2_LE(output, buffer,
+                                                      channel_samples_);
+      break;
+    case 6:
+      conversion::sequential_6_BE_to_interleaved_6_LE(output, buffer,
+                                                      channel_samples_);
+      break;
+    default:
+      assert_unhandled_case(sdl_device_channels_);
+      break;
+  }
+  frames_read_.store(frames_read + 1, std::memory_order_release);
+
+  ReleaseClient(frames_written_.load(std::memory_order_relaxed) -
+                (frames_read + 1));
+  return true;
+}
+
+void SDLAudioDriver::ReleaseClient(uint32_t queued_frames) {
+  int32_t release_count = 1;
+  if (target_queued_frames_) {
+    if (target_queued_frames_ > min_target_queued_frames_ &&
+        ++frames_since_target_change_ >= target_lowering_interval_) {
+      --target_queued_frames_;
+      frames_since_target_change_ = 0;
+    }
+    // The client submits a frame for every release, and the releases held
+    // back are given back once the queue is below the target.
+    if (queued_frames >= target_queued_frames_) {
+      ++withheld_client_releases_;
+      return;
+    }
+    uint32_t extra_release_count =
+        std::min(withheld_client_releases_,
+                 target_queued_frames_ - 1 - queued_frames);
+    withheld_client_releases_ -= extra_release_count;
+    release_count += int32_t(extra_release_count);
+  }
+  auto ret = semaphore_->Release(release_count, nullptr);
+  assert_true(ret);
+}
+
+void SDLAudioDriver::OnUnderrun() {
+  RecordUnderrun();
+  if (target_queued_frames_ && target_queued_frames_ < frame_count_) {
+    ++target_queued_frames_;
+    frames_since_target_change_ = 0;
+  }
+}
+
+void SDLAudioDriver::ResampleFrames(float* output, uint32_t sample_count) {
+  const uint32_t channels = sdl_device_channels_;
+  float* buffer = resample_buffer_.get();
+  double step =
+      resample_step_ *
+      GetDynamicRateRatio(frames_written_.load(std::memory_order_relaxed) -
+                              frames_read_.load(std::memory_order_relaxed),
+                          target_queued_frames_);
+  for (uint32_t i = 0; i < sample_count; ++i) {
+    auto index = uint32_t(resample_position_);
+    if (index + 2 >= resample_history_ + channel_samples_) {
+      // Keep the end of the current frame as the history and append the next
+      // one.
+      float* frame = buffer + resample_history_ * channels;
+      float history[resample_history_ * 6];
+      std::memcpy(history, buffer + channel_samples_ * channels,
+                  sizeof(float) * resample_history_ * channels);
+      if (!PopFrame(frame)) {
+        std::memset(output + i * channels, 0,
+                    sizeof(float) * (sample_count - i) * channels);
+        if (frames_read_.load(std::memory_order_relaxed)) {
+          OnUnderrun();
+        }
+        return;
+      }
+      std::memcpy(buffer, history,
+                  sizeof(float) * resample_history_ * channels);
+      resample_position_ -= double(channel_samples_);
+      index -= channel_samples_;
+    }
+    // Cubic Hermite (Catmull-Rom) interpolation between the samples at index
+    // and index + 1.
+    float t = float(resample_position_ - double(index));
+    const float* s = buffer + (index - 1) * channels;
+    for (uint32_t c = 0; c < channels; ++c) {
+      float y0 = s[c];
+      float y1 = s[channels + c];
+      float y2 = s[2 * channels + c];
+      float y3 = s[3 * channels + c];
+      float c1 = 0.5f * (y2 - y0);
+      float c2 = y0 - 2.5f * y1 + 2.0f * y2 - 0.5f * y3;
+      float c3 = 0.5f * (y3 - y0) + 1.5f * (y1 - y2);
+      output[i * channels + c] = ((c3 * t + c2) * t + c1) * t + y1;
+    }
+    resample_position_ += step;
+  }
+}
 }  // namespace sdl
 }  // namespace apu
 }  // namespace xe
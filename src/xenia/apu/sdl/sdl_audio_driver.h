@@ -10,9 +10,8 @@
 #ifndef XENIA_APU_SDL_SDL_AUDIO_DRIVER_H_
 #define XENIA_APU_SDL_SDL_AUDIO_DRIVER_H_
 
-#include <mutex>
-#include <queue>
-#include <stack>
+#include <atomic>
+#include <memory>
 
 #include "SDL.h"
 #include "xenia/apu/audio_driver.h"
@@ -33,21 +32,68 @@ class SDLAudioDriver : public AudioDriver {
 
  protected:
   static void SDLCallback(void* userdata, Uint8* stream, int len);
+  // Converts the next queued frame to the device channel layout, returning
+  // false if there are no frames queued.
+  bool PopFrame(float* output);
+  // Resamples the queued frames to the device frequency, filling the rest of
+  // the output with silence if the queue runs out.
+  void ResampleFrames(float* output, uint32_t sample_count);
+  // Lets the client submit more frames after one has been played, with
+  // queued_frames still queued after it.
+  void ReleaseClient(uint32_t queued_frames);
+  // Playback ran out of frames.
+  void OnUnderrun();
 
   xe::threading::Semaphore* semaphore_ = nullptr;
 
   SDL_AudioDeviceID sdl_device_id_ = -1;
   bool sdl_initialized_ = false;
   uint8_t sdl_device_channels_ = 0;
+  uint32_t sdl_device_frequency_ = 0;
+  uint32_t sdl_device_samples_ = 0;
 
   static const uint32_t frame_frequency_ = 48000;
   static const uint32_t frame_channels_ = 6;
   static const uint32_t channel_samples_ = 256;
   static const uint32_t frame_samples_ = frame_channels_ * channel_samples_;
   static const uint32_t frame_size_ = sizeof(float) * frame_samples_;
-  std::queue<float*> frames_queued_ = {};
-  std::stack<float*> frames_unused_ = {};
-  std::mutex frames_mutex_ = {};
+  // Single-producer (SubmitFrame), single-consumer (SDLCallback) queue of
+  // frames. The audio system never has more frames in flight than this, as
+  // the client semaphore is released once a frame has been played.
+  static const uint32_t frame_count_ = 64;
+  std::unique_ptr<float[]> frames_;
+  // Incremented by the consumer and the producer respectively, the frame
+  // index being the value modulo frame_count_.
+  std::atomic<uint32_t> frames_read_ = {0};
+  std::atomic<uint32_t> frames_written_ = {0};
+
+  // With apu_target_latency, the client semaphore is released for fewer of
+  // the played frames, so the client keeps about this many frames queued
+  // rather than as many as the audio system allows. Raised by a frame on every
+  // underrun, and lowered back to the minimum, which is from the configured
+  // latency, after a while without underruns. 0 if not limiting the latency.
+  // Only accessed by the SDL callback, like the rest of the state below.
+  uint32_t target_queued_frames_ = 0;
+  uint32_t min_target_queued_frames_ = 0;
+  // Releases of the client semaphore held back to keep fewer frames queued.
+  uint32_t withheld_client_releases_ = 0;
+  // Frames played since the target was last changed.
+  uint32_t frames_since_target_change_ = 0;
+  // About 10 seconds of frames.
+  static const uint32_t target_lowering_interval_ = 1875;
+
+  // If the device doesn't run at the guest frequency and period size, frames
+  // are resampled here rather than by SDL or the host sound server, which
+  // may add a lot of latency. The interpolation needs one sample before and
+  // two samples after the position, so the last samples of the previous
+  // frame are kept in front of the current one.
+  static const uint32_t resample_history_ = 3;
+  // Interleaved, (resample_history_ + channel_samples_) * channels.
+  std::unique_ptr<float[]> resample_buffer_;
+  // Position in the resample buffer, in samples.
+  double resample_position_ = 0.0;
+  // Input samples per output sample at the normal playback rate.
+  double resample_step_ = 1.0;
 };
 
 }  // namespace sdl
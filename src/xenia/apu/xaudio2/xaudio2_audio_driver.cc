@@ -201,6 +201,10 @@ void XAudio2AudioDriver::SubmitFrame(uint32_t frame_ptr) {
     objects_.api_2_7.pcm_voice->GetState(&state);
   }
   assert_true(state.BuffersQueued < frame_count_);
+  if (!state.BuffersQueued && frame_submitted_) {
+    RecordUnderrun();
+  }
+  frame_submitted_ = true;
 
   auto input_frame = memory_->TranslateVirtual<float*>(frame_ptr);
   auto output_frame = reinterpret_cast<float*>(frames_[current_frame_]);
@@ -234,7 +238,9 @@ void XAudio2AudioDriver::SubmitFrame(uint32_t frame_ptr) {
 
   // Update playback ratio to our time scalar.
   // This will keep audio in sync with the game clock.
-  float frequency_ratio = static_cast<float>(xe::Clock::guest_time_scalar());
+  float frequency_ratio = static_cast<float>(
+      xe::Clock::guest_time_scalar() *
+      GetDynamicRateRatio(state.BuffersQueued + 1));
   if (api_minor_version_ >= 8) {
     objects_.api_2_8.pcm_voice->SetFrequencyRatio(frequency_ratio);
   } else {
@@ -12,14 +12,21 @@
 #include <algorithm>
 #include <cstring>
 
+#include "xenia/apu/conversion.h"
 #include "xenia/apu/xma_decoder.h"
 #include "xenia/apu/xma_helpers.h"
 #include "xenia/base/bit_stream.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/frame_breakdown.h"
+#include "xenia/base/lock_profiling.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/ring_buffer.h"
 
+DECLARE_int32(xma_look_ahead_frames);
+
 extern "C" {
 #if XE_COMPILER_MSVC
 #pragma warning(push)
@@ -91,22 +98,36 @@ int XmaContext::Setup(uint32_t id, Memory* memory, uint32_t guest_ptr) {
 }
 
 bool XmaContext::Work() {
-  std::lock_guard<std::mutex> lock(lock_);
+  auto lock = lock_profiling::Acquire(lock_, "XmaContext::lock_");
   if (!is_allocated() || !is_enabled()) {
     return false;
   }
 
   set_is_enabled(false);
 
+  uint64_t decode_start_host_ticks = Clock::QueryHostTickCount();
   auto context_ptr = memory()->TranslateVirtual(guest_ptr());
   XMA_CONTEXT_DATA data(context_ptr);
+  if (look_ahead_frame_count_ &&
+      (data.input_buffer_read_offset != look_ahead_input_read_offset_ ||
+       data.current_buffer != look_ahead_current_buffer_ ||
+       data.is_stereo != look_ahead_is_stereo_)) {
+    // The guest has seeked or restarted the input, so the frames decoded
+    // ahead are not the ones it expects anymore.
+    look_ahead_frame_count_ = 0;
+  }
   Decode(&data);
+  look_ahead_input_read_offset_ = data.input_buffer_read_offset;
+  look_ahead_current_buffer_ = data.current_buffer;
+  look_ahead_is_stereo_ = data.is_stereo;
   data.Store(context_ptr);
+  last_decode_host_ticks_ =
+      Clock::QueryHostTickCount() - decode_start_host_ticks;
   return true;
 }
 
 void XmaContext::Enable() {
-  std::lock_guard<std::mutex> lock(lock_);
+  auto lock = lock_profiling::Acquire(lock_, "XmaContext::lock_");
 
   auto context_ptr = memory()->TranslateVirtual(guest_ptr());
   XMA_CONTEXT_DATA data(context_ptr);
@@ -134,7 +155,7 @@ bool XmaContext::Block(bool poll) {
 }
 
 void XmaContext::Clear() {
-  std::lock_guard<std::mutex> lock(lock_);
+  auto lock = lock_profiling::Acquire(lock_, "XmaContext::lock_");
   XELOGAPU("XmaContext: reset context {}", id());
 
   auto context_ptr = memory()->TranslateVirtual(guest_ptr());
@@ -148,22 +169,26 @@ void XmaContext::Clear() {
   data.output_buffer_write_offset = 0;
 
   data.Store(context_ptr);
+
+  look_ahead_frame_count_ = 0;
 }
 
 void XmaContext::Disable() {
-  std::lock_guard<std::mutex> lock(lock_);
+  auto lock = lock_profiling::Acquire(lock_, "XmaContext::lock_");
   XELOGAPU("XmaContext: disabling context {}", id());
   set_is_enabled(false);
 }
 
 void XmaContext::Release() {
   // Lock it in case the decoder thread is working on it now.
-  std::lock_guard<std::mutex> lock(lock_);
+  auto lock = lock_profiling::Acquire(lock_, "XmaContext::lock_");
   assert_true(is_allocated_ == true);
 
   set_is_allocated(false);
   auto context_ptr = memory()->TranslateVirtual(guest_ptr());
   std::memset(context_ptr, 0, sizeof(XMA_CONTEXT_DATA));  // Zero it.
+
+  look_ahead_frame_count_ = 0;
 }
 
 void XmaContext::SwapInputBuffer(XMA_CONTEXT_DATA* data) {
@@ -291,6 +316,8 @@ static void dump_raw(AVFrame* frame, int id) {
 
 void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
   SCOPE_profile_cpu_f("apu");
+  frame_breakdown::ScopedTimer frame_breakdown_timer(
+      frame_breakdown::Category::kXmaDecode);
 
   // What I see:
   // XMA outputs 2 bytes per sample
@@ -319,7 +346,8 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
   }
 
   // No available data.
-  if (!data->input_buffer_0_valid && !data->input_buffer_1_valid) {
+  if (!data->input_buffer_0_valid && !data->input_buffer_1_valid &&
+      !look_ahead_frame_count_) {
     data->output_buffer_valid = 0;
     return;
   }
@@ -378,6 +406,20 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
   output_remaining_bytes -=
       output_remaining_bytes % (kBytesPerFrameChannel << data->is_stereo);
 
+  // Frames decoded ahead during the previous kicks go first.
+  while (look_ahead_frame_count_ && output_remaining_bytes > 0) {
+    auto byte_count = kBytesPerFrameChannel << data->is_stereo;
+    output_rb.Write(&look_ahead_frames_[look_ahead_frame_first_ *
+                                        kBytesPerFrameChannel * 2],
+                    byte_count);
+    output_remaining_bytes -= byte_count;
+    look_ahead_frame_first_ =
+        (look_ahead_frame_first_ + 1) % kMaxLookAheadFrames;
+    --look_ahead_frame_count_;
+  }
+  data->output_buffer_write_offset = output_rb.write_offset() / 256;
+  uint32_t look_ahead_frame_limit = GetLookAheadFrameLimit();
+
   // is_dirty_ = true; // TODO
   // is_dirty_ = false;  // TODO
   assert_false(data->stop_when_done);
@@ -385,7 +427,8 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
   static int total_samples = 0;
   bool reuse_input_buffer = false;
   // Decode until we can't write any more data.
-  while (output_remaining_bytes > 0) {
+  while (output_remaining_bytes > 0 ||
+         look_ahead_frame_count_ < look_ahead_frame_limit) {
     if (!data->input_buffer_0_valid && !data->input_buffer_1_valid) {
       // Out of data.
       break;
@@ -603,12 +646,9 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
       XELOGW("XmaContext {}: Error sending packet for decoding (error code: {})", id(), ret);
       XELOGW("  Continuing with silence output to prevent crash");
       // Output silence instead of crashing
-      auto byte_count = kBytesPerFrameChannel << data->is_stereo;
-      if (output_remaining_bytes >= byte_count) {
-        std::vector<uint8_t> silence(byte_count, 0);
-        output_rb.Write(silence.data(), byte_count);
-        output_remaining_bytes -= byte_count;
-      }
+      OutputFrame(output_rb, output_remaining_bytes, nullptr,
+                  bool(data->is_stereo));
+      data->output_buffer_write_offset = output_rb.write_offset() / 256;
       continue;  // Skip this frame and continue
     }
 
@@ -630,12 +670,9 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
       XELOGW("XmaContext {}: Error during decoding (error code: {})", id(), ret);
       XELOGW("  Outputting silence to prevent crash - game audio may be degraded");
       // Output silence instead of crashing
-      auto byte_count = kBytesPerFrameChannel << data->is_stereo;
-      if (output_remaining_bytes >= byte_count) {
-        std::vector<uint8_t> silence(byte_count, 0);
-        output_rb.Write(silence.data(), byte_count);
-        output_remaining_bytes -= byte_count;
-      }
+      OutputFrame(output_rb, output_remaining_bytes, nullptr,
+                  bool(data->is_stereo));
+      data->output_buffer_write_offset = output_rb.write_offset() / 256;
       return;  // Skip this decode attempt but don't crash
     }
     assert_true(ret == 0);
@@ -650,14 +687,10 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
       // assert_true(frame_is_split == (frame_idx == -1));
 
       //			dump_raw(av_frame_, id());
-      ConvertFrame((const uint8_t**)av_frame_->data, bool(data->is_stereo),
-                   raw_frame_.data());
       // decoded_consumed_samples_ += kSamplesPerFrame;
 
-      auto byte_count = kBytesPerFrameChannel << data->is_stereo;
-      assert_true(output_remaining_bytes >= byte_count);
-      output_rb.Write(raw_frame_.data(), byte_count);
-      output_remaining_bytes -= byte_count;
+      OutputFrame(output_rb, output_remaining_bytes,
+                  (const uint8_t**)av_frame_->data, bool(data->is_stereo));
       data->output_buffer_write_offset = output_rb.write_offset() / 256;
 
       total_samples += id_ == 0 ? kSamplesPerFrame : 0;
@@ -905,7 +938,13 @@ void XmaContext::ConvertFrame(const uint8_t** samples, bool is_two_channel,
   // since the first menu frame; the intro cutscene also has more than 2
   // channels.
 #if XE_ARCH_AMD64
-  static_assert(kSamplesPerFrame % 8 == 0);
+  static_assert(kSamplesPerFrame % 16 == 0);
+  if (conversion::IsAVX2Supported()) {
+    conversion::planar_f32_to_interleaved_s16_BE_avx2(
+        out, reinterpret_cast<const float* const*>(samples), is_two_channel,
+        kSamplesPerFrame);
+    return;
+  }
   const auto in_channel_0 = reinterpret_cast<const float*>(samples[0]);
   const __m128 scale_mm = _mm_set1_ps(scale);
   if (is_two_channel) {
@@ -969,5 +1008,62 @@ void XmaContext::ConvertFrame(const uint8_t** samples, bool is_two_channel,
 #endif
 }
 
+void XmaContext::WriteFrame(RingBuffer& output_rb, const uint8_t** samples,
+                            bool is_two_channel) {
+  size_t byte_count = kBytesPerFrameChannel << uint32_t(is_two_channel);
+  if (output_rb.capacity() - output_rb.write_offset() >= byte_count) {
+    ConvertFrame(samples, is_two_channel,
+                 reinterpret_cast<uint8_t*>(output_rb.write_ptr()));
+    output_rb.AdvanceWrite(byte_count);
+    return;
+  }
+  ConvertFrame(samples, is_two_channel, raw_frame_.data());
+  output_rb.Write(raw_frame_.data(), byte_count);
+}
+
+void XmaContext::OutputFrame(RingBuffer& output_rb,
+                             size_t& output_remaining_bytes,
+                             const uint8_t** samples, bool is_two_channel) {
+  size_t byte_count = kBytesPerFrameChannel << uint32_t(is_two_channel);
+  if (output_remaining_bytes >= byte_count) {
+    if (samples) {
+      WriteFrame(output_rb, samples, is_two_channel);
+    } else {
+      WriteSilence(output_rb, byte_count);
+    }
+    output_remaining_bytes -= byte_count;
+    return;
+  }
+  assert_true(look_ahead_frame_count_ < kMaxLookAheadFrames);
+  uint8_t* look_ahead_frame =
+      &look_ahead_frames_[((look_ahead_frame_first_ + look_ahead_frame_count_) %
+                           kMaxLookAheadFrames) *
+                          kBytesPerFrameChannel * 2];
+  if (samples) {
+    ConvertFrame(samples, is_two_channel, look_ahead_frame);
+  } else {
+    std::memset(look_ahead_frame, 0, byte_count);
+  }
+  ++look_ahead_frame_count_;
+}
+
+uint32_t XmaContext::GetLookAheadFrameLimit() const {
+  return uint32_t(std::min(std::max(cvars::xma_look_ahead_frames, int32_t(0)),
+                           int32_t(kMaxLookAheadFrames)));
+}
+
+void XmaContext::WriteSilence(RingBuffer& output_rb, size_t byte_count) {
+  size_t first_byte_count =
+      std::min(byte_count, output_rb.capacity() - output_rb.write_offset());
+  std::memset(reinterpret_cast<void*>(output_rb.write_ptr()), 0,
+              first_byte_count);
+  output_rb.AdvanceWrite(first_byte_count);
+  if (byte_count > first_byte_count) {
+    std::memset(reinterpret_cast<void*>(output_rb.write_ptr()), 0,
+                byte_count - first_byte_count);
+    output_rb.AdvanceWrite(byte_count - first_byte_count);
+  }
+}
+
 }  // namespace apu
 }  // namespace xe
@@ -36,6 +36,10 @@ struct AVCodecContext;
 struct AVFrame;
 struct AVPacket;
 
+namespace xe {
+class RingBuffer;
+}  // namespace xe
+
 namespace xe {
 namespace apu {
 
@@ -165,6 +169,8 @@ class XmaContext {
   uint32_t guest_ptr() { return guest_ptr_; }
   bool is_allocated() { return is_allocated_; }
   bool is_enabled() { return is_enabled_; }
+  // Host ticks spent in the last Work call that decoded the context.
+  uint64_t last_decode_host_ticks() const { return last_decode_host_ticks_; }
 
   void set_is_allocated(bool is_allocated) { is_allocated_ = is_allocated; }
   void set_is_enabled(bool is_enabled) { is_enabled_ = is_enabled; }
@@ -190,6 +196,16 @@ class XmaContext {
   // Convert sample format and swap bytes
   static void ConvertFrame(const uint8_t** samples, bool is_two_channel,
                            uint8_t* output_buffer);
+  // Converts a decoded frame straight into the output buffer, going through
+  // the conversion buffer only if the frame wraps around its end.
+  void WriteFrame(RingBuffer& output_rb, const uint8_t** samples,
+                  bool is_two_channel);
+  static void WriteSilence(RingBuffer& output_rb, size_t byte_count);
+  // Writes a decoded frame, or silence if samples is null, to the output
+  // buffer if it has space, or after the frames decoded ahead otherwise.
+  void OutputFrame(RingBuffer& output_rb, size_t& output_remaining_bytes,
+                   const uint8_t** samples, bool is_two_channel);
+  uint32_t GetLookAheadFrameLimit() const;
 
   bool ValidFrameOffset(uint8_t* block, size_t size_bytes,
                         size_t frame_offset_bits);
@@ -203,6 +219,7 @@ class XmaContext {
   std::mutex lock_;
   bool is_allocated_ = false;
   bool is_enabled_ = false;
+  uint64_t last_decode_host_ticks_ = 0;
   // bool is_dirty_ = true;
 
   // ffmpeg structures
@@ -231,6 +248,19 @@ class XmaContext {
   // uint8_t* current_frame_ = nullptr;
   // conversion buffer for 2 channel frame
   std::array<uint8_t, kBytesPerFrameChannel * 2> raw_frame_;
+
+  // Frames decoded beyond the space in the output buffer, written to it on
+  // the next kick so that the guest doesn't have to wait for decoding. They
+  // are dropped if the guest moves the input in the meantime, which is
+  // detected by comparing the input position with the one after decoding.
+  static const uint32_t kMaxLookAheadFrames = 4;
+  std::array<uint8_t, kBytesPerFrameChannel * 2 * kMaxLookAheadFrames>
+      look_ahead_frames_;
+  uint32_t look_ahead_frame_first_ = 0;
+  uint32_t look_ahead_frame_count_ = 0;
+  uint32_t look_ahead_input_read_offset_ = 0;
+  uint32_t look_ahead_current_buffer_ = 0;
+  uint32_t look_ahead_is_stereo_ = 0;
   // std::vector<uint8_t> current_frame_ = std::vector<uint8_t>(0);
 };
 
@@ -9,6 +9,9 @@
 
 #include "xenia/apu/xma_decoder.h"
 
+#include <algorithm>
+
+#include "third_party/fmt/include/fmt/format.h"
 #include "xenia/apu/xma_context.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
@@ -50,6 +53,16 @@ extern "C" {
 
 DEFINE_bool(ffmpeg_verbose, false, "Verbose FFmpeg output (debug and above)",
             "APU");
+DEFINE_int32(xma_decoder_threads, 0,
+             "Number of threads decoding XMA audio, including the main XMA "
+             "decoder thread. 0 to choose automatically based on the number "
+             "of logical processors.",
+             "APU");
+DEFINE_int32(xma_look_ahead_frames, 2,
+             "Number of XMA frames (512 samples each) every context may "
+             "decode ahead when the guest output buffer is full, to be written "
+             "as soon as space frees up on the next kick. [0-4]",
+             "APU");
 
 namespace xe {
 namespace apu {
@@ -149,42 +162,159 @@ X_STATUS XmaDecoder::Setup(kernel::KernelState* kernel_state) {
   worker_thread_->set_can_debugger_suspend(true);
   worker_thread_->Create();
 
+  uint32_t decoder_thread_count =
+      cvars::xma_decoder_threads > 0
+          ? uint32_t(cvars::xma_decoder_threads)
+          : std::min(std::max(xe::threading::logical_processor_count() / 4,
+                              uint32_t(1)),
+                     uint32_t(4));
+  decoder_threads_shutting_down_ = false;
+  for (uint32_t i = 1; i < decoder_thread_count; ++i) {
+    auto decoder_thread = xe::threading::Thread::Create(
+        {}, [this]() { DecoderThreadMain(); });
+    if (!decoder_thread) {
+      XELOGE("Failed to create XMA decoder thread {}", i);
+      break;
+    }
+    decoder_thread->set_name(fmt::format("XMA Decoder {}", i));
+    decoder_threads_.push_back(std::move(decoder_thread));
+  }
+
   return X_STATUS_SUCCESS;
 }
 
 void XmaDecoder::WorkerThreadMain() {
-  uint32_t idle_loop_count = 0;
   while (worker_running_) {
-    // Okay, let's loop through XMA contexts to find ones we need to decode!
-    bool did_work = false;
-    for (uint32_t n = 0; n < kContextCount; n++) {
-      XmaContext& context = contexts_[n];
-      did_work = context.Work() || did_work;
-
-      // TODO: Need thread safety to do this.
-      // Probably not too important though.
-      // registers_.current_context = n;
-      // registers_.next_context = (n + 1) % kContextCount;
-    }
+    // Okay, let's decode the XMA contexts that have been kicked!
+    WorkContexts();
+    // TODO: Need thread safety to update registers_.current_context and
+    // registers_.next_context. Probably not too important though.
 
     if (paused_) {
       pause_fence_.Signal();
       resume_fence_.Wait();
     }
 
-    if (!did_work) {
-      idle_loop_count++;
-    } else {
-      idle_loop_count = 0;
+    // Sleep until more contexts are kicked (or until pausing or shutting down
+    // is requested). Contexts kicked while decoding have already set the
+    // event, so they're not lost.
+    xe::threading::Wait(work_event_.get(), false);
+  }
+}
+
+void XmaDecoder::WorkContexts() {
+  work_contexts_.clear();
+  for (uint32_t i = 0; i < xe::countof(kicked_contexts_); ++i) {
+    uint64_t kicked_contexts_remaining =
+        kicked_contexts_[i].exchange(0, std::memory_order_acquire);
+    uint32_t kicked_context_bit;
+    while (xe::bit_scan_forward(kicked_contexts_remaining,
+                                &kicked_context_bit)) {
+      kicked_contexts_remaining &= ~(UINT64_C(1) << kicked_context_bit);
+      // Whether the context is still allocated and enabled is checked with
+      // the context locked in Work.
+      work_contexts_.push_back(i * 64 + kicked_context_bit);
     }
+  }
+  if (work_contexts_.empty()) {
+    return;
+  }
+  statistics_pass_count_.fetch_add(1, std::memory_order_relaxed);
+  COUNT_profile_set("apu/xma/kicked_contexts", work_contexts_.size());
 
-    if (idle_loop_count > 500) {
-      // Idle for an extended period. Introduce a 20ms wait.
-      xe::threading::Wait(work_event_.get(), false,
-                          std::chrono::milliseconds(20));
+  if (decoder_threads_.empty() || work_contexts_.size() == 1) {
+    for (uint32_t n : work_contexts_) {
+      WorkContext(n);
     }
+    return;
+  }
+
+  SCOPE_profile_cpu_f("apu");
+  std::sort(work_contexts_.begin(), work_contexts_.end(),
+            [this](uint32_t a, uint32_t b) {
+              return contexts_[a].last_decode_host_ticks() >
+                     contexts_[b].last_decode_host_ticks();
+            });
+  {
+    std::lock_guard<std::mutex> lock(decoder_mutex_);
+    work_context_next_.store(0, std::memory_order_relaxed);
+    ++decoder_pass_;
+    decoder_threads_pending_ = uint32_t(decoder_threads_.size());
+  }
+  decoder_work_cond_.notify_all();
+  DecodeWorkContexts();
+  // Wait for all the decoder threads to finish the pass, so none of them
+  // accesses work_contexts_ while it's being rebuilt for the next one.
+  std::unique_lock<std::mutex> lock(decoder_mutex_);
+  decoder_done_cond_.wait(lock,
+                          [this]() { return !decoder_threads_pending_; });
+}
 
-    xe::threading::MaybeYield();
+void XmaDecoder::DecodeWorkContexts() {
+  uint32_t work_context_count = uint32_t(work_contexts_.size());
+  while (true) {
+    uint32_t index =
+        work_context_next_.fetch_add(1, std::memory_order_relaxed);
+    if (index >= work_context_count) {
+      break;
+    }
+    WorkContext(work_contexts_[index]);
+  }
+}
+
+void XmaDecoder::WorkContext(uint32_t context_id) {
+  XmaContext& context = contexts_[context_id];
+  if (!context.Work()) {
+    return;
+  }
+  uint64_t decode_host_ticks = context.last_decode_host_ticks();
+  statistics_decoded_context_count_.fetch_add(1, std::memory_order_relaxed);
+  statistics_decode_host_ticks_.fetch_add(decode_host_ticks,
+                                          std::memory_order_relaxed);
+  uint64_t max_decode_host_ticks =
+      statistics_max_context_decode_host_ticks_.load(
+          std::memory_order_relaxed);
+  while (decode_host_ticks > max_decode_host_ticks &&
+         !statistics_max_context_decode_host_ticks_.compare_exchange_weak(
+             max_decode_host_ticks, decode_host_ticks,
+             std::memory_order_relaxed)) {
+  }
+}
+
+XmaDecoder::Statistics XmaDecoder::TakeStatistics() {
+  Statistics statistics;
+  statistics.pass_count =
+      statistics_pass_count_.exchange(0, std::memory_order_relaxed);
+  statistics.decoded_context_count =
+      statistics_decoded_context_count_.exchange(0, std::memory_order_relaxed);
+  statistics.decode_host_ticks =
+      statistics_decode_host_ticks_.exchange(0, std::memory_order_relaxed);
+  statistics.max_context_decode_host_ticks =
+      statistics_max_context_decode_host_ticks_.exchange(
+          0, std::memory_order_relaxed);
+  return statistics;
+}
+
+void XmaDecoder::DecoderThreadMain() {
+  uint64_t pass_done = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(decoder_mutex_);
+      decoder_work_cond_.wait(lock, [this, pass_done]() {
+        return decoder_threads_shutting_down_ || decoder_pass_ != pass_done;
+      });
+      if (decoder_threads_shutting_down_) {
+        return;
+      }
+      pass_done = decoder_pass_;
+    }
+    DecodeWorkContexts();
+    {
+      std::lock_guard<std::mutex> lock(decoder_mutex_);
+      if (!--decoder_threads_pending_) {
+        decoder_done_cond_.notify_one();
+      }
+    }
   }
 }
 
@@ -205,6 +335,16 @@ void XmaDecoder::Shutdown() {
     worker_thread_.reset();
   }
 
+  {
+    std::lock_guard<std::mutex> lock(decoder_mutex_);
+    decoder_threads_shutting_down_ = true;
+  }
+  decoder_work_cond_.notify_all();
+  for (auto& decoder_thread : decoder_threads_) {
+    xe::threading::Wait(decoder_thread.get(), false);
+  }
+  decoder_threads_.clear();
+
   if (context_data_first_ptr_) {
     memory()->SystemHeapFree(context_data_first_ptr_);
   }
@@ -243,6 +383,8 @@ void XmaDecoder::ReleaseContext(uint32_t guest_ptr) {
   XmaContext& context = contexts_[context_id];
   assert_true(context.is_allocated());
   context.Release();
+  kicked_contexts_[context_id >> 6].fetch_and(
+      ~(UINT64_C(1) << (context_id & 63)), std::memory_order_relaxed);
   context_bitmap_.Release(context_id);
 }
 
@@ -313,6 +455,8 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
         uint32_t context_id = base_context_id + i;
         auto& context = contexts_[context_id];
         context.Enable();
+        kicked_contexts_[context_id >> 6].fetch_or(
+            UINT64_C(1) << (context_id & 63), std::memory_order_release);
       }
     }
     // Signal the decoder thread to start processing.
@@ -327,6 +471,8 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
         uint32_t context_id = base_context_id + i;
         auto& context = contexts_[context_id];
         context.Disable();
+        kicked_contexts_[context_id >> 6].fetch_and(
+            ~(UINT64_C(1) << (context_id & 63)), std::memory_order_relaxed);
       }
     }
     // Signal the decoder thread to start processing.
@@ -375,6 +521,10 @@ void XmaDecoder::Pause() {
   }
   paused_ = true;
 
+  // Wake up the worker thread if it's waiting for contexts to be kicked.
+  if (work_event_) {
+    work_event_->Set();
+  }
   pause_fence_.Wait();
 }
 
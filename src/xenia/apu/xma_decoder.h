@@ -11,12 +11,16 @@
 #define XENIA_APU_XMA_DECODER_H_
 
 #include <atomic>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <queue>
+#include <vector>
 
 #include "xenia/apu/xma_context.h"
 #include "xenia/apu/xma_register_file.h"
 #include "xenia/base/bit_map.h"
+#include "xenia/base/threading.h"
 #include "xenia/kernel/xthread.h"
 #include "xenia/xbox.h"
 
@@ -51,11 +55,27 @@ class XmaDecoder {
   void Pause();
   void Resume();
 
+  struct Statistics {
+    // Passes of the worker thread over the kicked contexts.
+    uint64_t pass_count;
+    uint64_t decoded_context_count;
+    // Sum of the time spent decoding each context, across all threads.
+    uint64_t decode_host_ticks;
+    uint64_t max_context_decode_host_ticks;
+  };
+  // Returns the statistics collected since the previous call.
+  Statistics TakeStatistics();
+
  protected:
   int GetContextId(uint32_t guest_ptr);
 
  private:
   void WorkerThreadMain();
+  // Decodes the kicked contexts on the worker thread and the decoder threads.
+  void WorkContexts();
+  void DecodeWorkContexts();
+  void WorkContext(uint32_t context_id);
+  void DecoderThreadMain();
 
   static uint32_t MMIOReadRegisterThunk(void* ppc_context, XmaDecoder* as,
                                         uint32_t addr) {
@@ -83,6 +103,30 @@ class XmaDecoder {
   static const uint32_t kContextCount = 320;
   XmaContext contexts_[kContextCount];
   BitMap context_bitmap_;
+  // Contexts kicked since the worker thread last collected them, so it only
+  // needs to wake up and look at the contexts that have work to do.
+  std::atomic<uint64_t> kicked_contexts_[kContextCount / 64] = {};
+
+  // Threads helping the worker thread decode the contexts, taking the next
+  // context to decode from the list of the current pass, so the decoding of
+  // many voices playing at once is spread across multiple cores.
+  std::vector<std::unique_ptr<xe::threading::Thread>> decoder_threads_;
+  std::mutex decoder_mutex_;
+  std::condition_variable decoder_work_cond_;
+  std::condition_variable decoder_done_cond_;
+  bool decoder_threads_shutting_down_ = false;
+  uint64_t decoder_pass_ = 0;
+  // Decoder threads that haven't finished the current pass yet.
+  uint32_t decoder_threads_pending_ = 0;
+  // Indices of the contexts to decode in the current pass, those that took the
+  // longest last time first, so the threads finish at around the same time.
+  std::vector<uint32_t> work_contexts_;
+  std::atomic<uint32_t> work_context_next_ = {0};
+
+  std::atomic<uint64_t> statistics_pass_count_ = {0};
+  std::atomic<uint64_t> statistics_decoded_context_count_ = {0};
+  std::atomic<uint64_t> statistics_decode_host_ticks_ = {0};
+  std::atomic<uint64_t> statistics_max_context_decode_host_ticks_ = {0};
 
   uint32_t context_data_first_ptr_ = 0;
   uint32_t context_data_last_ptr_ = 0;
@@ -9,6 +9,9 @@
 
 #include "xenia/base/bit_map.h"
 
+#include <cstring>
+#include <utility>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/atomic.h"
 #include "xenia/base/math.h"
@@ -23,35 +26,48 @@ BitMap::BitMap(uint64_t* data, size_t size_bits) {
   assert_true(size_bits % kDataSizeBits == 0);
 
   data_.resize(size_bits / kDataSizeBits);
-  std::memcpy(data_.data(), data, size_bits / kDataSizeBits);
+  std::memcpy(data_.data(), data, data_.size() * sizeof(uint64_t));
+  RebuildSummary();
 }
 
 size_t BitMap::Acquire() {
-  for (size_t i = 0; i < data_.size(); i++) {
-    uint64_t entry = 0;
-    uint64_t new_entry = 0;
-    int64_t acquired_idx = -1;
-
-    do {
-      entry = data_[i];
-      uint8_t index = lzcnt(entry);
-      if (index == kDataSizeBits) {
-        // None free.
-        acquired_idx = -1;
-        break;
+  for (size_t i = 0; i < summary_.size(); i++) {
+    uint64_t summary = summary_[i];
+    while (summary) {
+      size_t word_index = i * kDataSizeBits + tzcnt(summary);
+      summary &= summary - 1;
+
+      uint64_t entry = 0;
+      uint64_t new_entry = 0;
+      int64_t acquired_idx = -1;
+
+      do {
+        entry = data_[word_index];
+        uint8_t index = lzcnt(entry);
+        if (index == kDataSizeBits) {
+          // None free.
+          acquired_idx = -1;
+          break;
+        }
+
+        // Entry has a free bit. Acquire it.
+        uint64_t bit = 1ull << (kDataSizeBits - index - 1);
+        new_entry = entry & ~bit;
+        assert_not_zero(entry & bit);
+
+        acquired_idx = index;
+      } while (!atomic_cas(entry, new_entry, &data_[word_index]));
+
+      if (!new_entry) {
+        // Either the last free entry has been acquired, or the summary bit has
+        // been stale.
+        ClearSummaryBit(word_index);
       }
 
-      // Entry has a free bit. Acquire it.
-      uint64_t bit = 1ull << (kDataSizeBits - index - 1);
-      new_entry = entry & ~bit;
-      assert_not_zero(entry & bit);
-
-      acquired_idx = index;
-    } while (!atomic_cas(entry, new_entry, &data_[i]));
-
-    if (acquired_idx != -1) {
-      // Acquired.
-      return (i * kDataSizeBits) + acquired_idx;
+      if (acquired_idx != -1) {
+        // Acquired.
+        return (word_index * kDataSizeBits) + acquired_idx;
+      }
     }
   }
 
@@ -72,6 +88,10 @@ void BitMap::Release(size_t index) {
 
     new_entry = entry | bit;
   } while (!atomic_cas(entry, new_entry, &data_[slot]));
+
+  if (!entry) {
+    SetSummaryBit(slot);
+  }
 }
 
 void BitMap::Resize(size_t new_size_bits) {
@@ -85,12 +105,60 @@ void BitMap::Resize(size_t new_size_bits) {
       data_[i] = -1;
     }
   }
+
+  RebuildSummary();
 }
 
 void BitMap::Reset() {
   for (size_t i = 0; i < data_.size(); i++) {
     data_[i] = -1;
   }
+  RebuildSummary();
+}
+
+void BitMap::SetData(std::vector<uint64_t> data) {
+  data_ = std::move(data);
+  RebuildSummary();
+}
+
+void BitMap::SetSummaryBit(size_t word_index) {
+  uint64_t* summary_word = &summary_[word_index / kDataSizeBits];
+  uint64_t bit = 1ull << (word_index % kDataSizeBits);
+  uint64_t summary = 0;
+  do {
+    summary = *summary_word;
+    if (summary & bit) {
+      return;
+    }
+  } while (!atomic_cas(summary, summary | bit, summary_word));
+}
+
+void BitMap::ClearSummaryBit(size_t word_index) {
+  uint64_t* summary_word = &summary_[word_index / kDataSizeBits];
+  uint64_t bit = 1ull << (word_index % kDataSizeBits);
+  uint64_t summary = 0;
+  do {
+    summary = *summary_word;
+    if (!(summary & bit)) {
+      return;
+    }
+  } while (!atomic_cas(summary, summary & ~bit, summary_word));
+  // If an entry has been released before the summary bit was cleared, the
+  // release may have seen the summary bit still set, so set it back to keep
+  // the entry reachable.
+  if (data_[word_index]) {
+    SetSummaryBit(word_index);
+  }
+}
+
+void BitMap::RebuildSummary() {
+  summary_.clear();
+  summary_.resize((data_.size() + kDataSizeBits - 1) / kDataSizeBits);
+  for (size_t i = 0; i < data_.size(); i++) {
+    if (data_[i]) {
+      summary_[i / kDataSizeBits] |= 1ull << (i % kDataSizeBits);
+    }
+  }
 }
 
-}  // namespace xe
\ No newline at end of file
+}  // namespace xe
@@ -17,6 +17,9 @@
 namespace xe {
 
 // Bit Map: Efficient lookup of free/used entries.
+// A summary bit per 64-entry word tells whether the word may have free
+// entries, so a free entry is found with a bit scan of the summary words rather
+// than by trying every word.
 class BitMap {
  public:
   BitMap();
@@ -43,12 +46,27 @@ class BitMap {
   void Reset();
 
   const std::vector<uint64_t> data() const { return data_; }
-  std::vector<uint64_t>& data() { return data_; }
+  // Replaces all the entries, such as when restoring a saved state. The size
+  // of the bitmap becomes data.size() * 64 entries.
+  void SetData(std::vector<uint64_t> data);
 
  private:
   const static size_t kDataSize = 8;
   const static size_t kDataSizeBits = kDataSize * 8;
+
+  // Marks the data word as possibly having free entries.
+  void SetSummaryBit(size_t word_index);
+  // Marks the data word as full, unless an entry in it has been released
+  // concurrently.
+  void ClearSummaryBit(size_t word_index);
+  void RebuildSummary();
+
   std::vector<uint64_t> data_;
+  // Bit i of summary word j is set if data word j * 64 + i may have free
+  // entries. Set after an entry is released in a full word, and cleared after
+  // the last free entry in a word is acquired, so a set bit may be stale, but
+  // a clear bit is not.
+  std::vector<uint64_t> summary_;
 };
 
 }  // namespace xe
@@ -16,6 +16,10 @@
 #include "xenia/base/assert.h"
 #include "xenia/base/math.h"
 
+#if XE_COMPILER_MSVC
+#include <intrin.h>
+#endif
+
 DEFINE_bool(clock_no_scaling, false,
             "Disable scaling code. Time management and locking is bypassed. "
             "Guest system time is directly pulled from host.",
@@ -38,13 +42,67 @@ uint64_t guest_system_time_base_ = Clock::QueryHostSystemTime();
 // Computed by RecomputeGuestTickScalar.
 std::pair<uint64_t, uint64_t> guest_tick_ratio_ = std::make_pair(1, 1);
 
-// Native guest ticks.
-uint64_t last_guest_tick_count_ = 0;
-// Last sampled host tick count.
-uint64_t last_host_tick_count_ = Clock::QueryHostTickCount();
-// Mutex to ensure last_host_tick_count_ and last_guest_tick_count_ are in sync
+// Current conversion of host ticks to guest ticks, starting from 0 guest ticks
+// at app start. The guest tick ratio changes only a few times in a session, so
+// the replaced conversions, which may still be being read by other threads,
+// are leaked.
+std::atomic<const Clock::GuestTickConversion*> guest_tick_conversion_{
+    new Clock::GuestTickConversion{Clock::QueryHostTickCount(), 0, 1, 0}};
+static_assert(
+    std::atomic<const Clock::GuestTickConversion*>::is_always_lock_free,
+    "The JIT loads the guest tick conversion pointer directly");
+// Mutex for replacing guest_tick_ratio_ and guest_tick_conversion_.
 std::mutex tick_mutex_;
 
+inline uint64_t MultiplyShiftRight(uint64_t a, uint64_t b, uint32_t shift) {
+#if XE_COMPILER_MSVC
+  uint64_t low = a * b;
+  uint64_t high = __umulh(a, b);
+  return shift ? (low >> shift) | (high << (64 - shift)) : low;
+#else
+  return static_cast<uint64_t>(
+      (static_cast<unsigned __int128>(a) * static_cast<unsigned __int128>(b)) >>
+      shift);
+#endif  // XE_COMPILER_MSVC
+}
+
+inline uint64_t ConvertHostToGuestTickCount(
+    const Clock::GuestTickConversion& conversion, uint64_t host_tick_count) {
+  // Host tick counts may be slightly behind the base on other threads.
+  uint64_t host_tick_delta = host_tick_count > conversion.host_base
+                                 ? host_tick_count - conversion.host_base
+                                 : 0;
+  return conversion.guest_base +
+         MultiplyShiftRight(host_tick_delta, conversion.multiplier,
+                            conversion.shift);
+}
+
+// Converts the ratio to a fixed-point multiplier with as many fractional bits
+// (up to 63) as possible.
+void ComputeFixedPointRatio(std::pair<uint64_t, uint64_t> ratio,
+                            uint64_t& multiplier_out, uint32_t& shift_out) {
+  uint64_t integer_part = ratio.first / ratio.second;
+  uint64_t remainder = ratio.first % ratio.second;
+  uint32_t shift = 63;
+  while (shift && (integer_part >> (64 - shift))) {
+    --shift;
+  }
+  // Long division for the fractional bits.
+  uint64_t multiplier = integer_part;
+  for (uint32_t i = 0; i < shift; ++i) {
+    // The remainder is below the denominator, but doubling it may overflow.
+    bool remainder_overflow = (remainder >> 63) != 0;
+    remainder <<= 1;
+    multiplier <<= 1;
+    if (remainder_overflow || remainder >= ratio.second) {
+      remainder -= ratio.second;
+      multiplier |= 1;
+    }
+  }
+  multiplier_out = multiplier;
+  shift_out = shift;
+}
+
 void RecomputeGuestTickScalar() {
   // Create a rational number with numerator (first) and denominator (second)
   auto frac =
@@ -61,36 +119,18 @@ void RecomputeGuestTickScalar() {
   // Keep this a rational calculation and reduce the fraction
   reduce_fraction(frac);
 
+  auto conversion = new Clock::GuestTickConversion;
+  ComputeFixedPointRatio(frac, conversion->multiplier, conversion->shift);
+
   std::lock_guard<std::mutex> lock(tick_mutex_);
   guest_tick_ratio_ = frac;
-}
-
-// Update the guest timer for all threads.
-// Return a copy of the value so locking is reduced.
-uint64_t UpdateGuestClock() {
+  // Continue from the current guest tick count so it stays monotonic.
   uint64_t host_tick_count = Clock::QueryHostTickCount();
-
-  if (cvars::clock_no_scaling) {
-    // Nothing to update, calculate on the fly
-    return host_tick_count * guest_tick_ratio_.first / guest_tick_ratio_.second;
-  }
-
-  std::unique_lock<std::mutex> lock(tick_mutex_, std::defer_lock);
-  if (lock.try_lock()) {
-    // Translate host tick count to guest tick count.
-    uint64_t host_tick_delta = host_tick_count > last_host_tick_count_
-                                   ? host_tick_count - last_host_tick_count_
-                                   : 0;
-    last_host_tick_count_ = host_tick_count;
-    uint64_t guest_tick_delta =
-        host_tick_delta * guest_tick_ratio_.first / guest_tick_ratio_.second;
-    last_guest_tick_count_ += guest_tick_delta;
-    return last_guest_tick_count_;
-  } else {
-    // Wait until another thread has finished updating the clock.
-    lock.lock();
-    return last_guest_tick_count_;
-  }
+  conversion->host_base = host_tick_count;
+  conversion->guest_base = ConvertHostToGuestTickCount(
+      *guest_tick_conversion_.load(std::memory_order_relaxed),
+      host_tick_count);
+  guest_tick_conversion_.store(conversion, std::memory_order_release);
 }
 
 // Offset of the current guest system file time relative to the guest base time.
@@ -99,7 +139,7 @@ inline uint64_t QueryGuestSystemTimeOffset() {
     return Clock::QueryHostSystemTime() - guest_system_time_base_;
   }
 
-  auto guest_tick_count = UpdateGuestClock();
+  auto guest_tick_count = Clock::QueryGuestTickCount();
 
   uint64_t numerator = 10000000;  // 100ns/10MHz resolution
   uint64_t denominator = guest_tick_frequency_;
@@ -141,6 +181,11 @@ std::pair<uint64_t, uint64_t> Clock::guest_tick_ratio() {
   return guest_tick_ratio_;
 }
 
+const std::atomic<const Clock::GuestTickConversion*>&
+Clock::guest_tick_conversion() {
+  return guest_tick_conversion_;
+}
+
 uint64_t Clock::guest_tick_frequency() { return guest_tick_frequency_; }
 
 void Clock::set_guest_tick_frequency(uint64_t frequency) {
@@ -155,8 +200,9 @@ void Clock::set_guest_system_time_base(uint64_t time_base) {
 }
 
 uint64_t Clock::QueryGuestTickCount() {
-  auto guest_tick_count = UpdateGuestClock();
-  return guest_tick_count;
+  return ConvertHostToGuestTickCount(
+      *guest_tick_conversion_.load(std::memory_order_acquire),
+      QueryHostTickCount());
 }
 
 uint64_t Clock::QueryGuestSystemTime() {
@@ -202,6 +248,18 @@ uint32_t Clock::ScaleGuestDurationMillis(uint32_t guest_ms) {
   return static_cast<uint32_t>(std::min(scaled_ms, max));
 }
 
+uint64_t Clock::ScaleGuestDurationMicros(uint64_t guest_us) {
+  if (cvars::clock_no_scaling || !guest_us) {
+    return guest_us;
+  }
+
+  double scaled_us = double(guest_us) * guest_time_scalar_;
+  if (scaled_us >= double(std::numeric_limits<uint64_t>::max())) {
+    return std::numeric_limits<uint64_t>::max();
+  }
+  return static_cast<uint64_t>(scaled_us);
+}
+
 int64_t Clock::ScaleGuestDurationFileTime(int64_t guest_file_time) {
   if (cvars::clock_no_scaling) {
     return static_cast<uint64_t>(guest_file_time);
@@ -10,8 +10,10 @@
 #ifndef XENIA_BASE_CLOCK_H_
 #define XENIA_BASE_CLOCK_H_
 
+#include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <utility>
 
 #include "xenia/base/cvar.h"
 #include "xenia/base/platform.h"
@@ -57,6 +59,20 @@ class Clock {
   static void set_guest_time_scalar(double scalar);
   // Get the tick ration between host and guest including time scaling if set.
   static std::pair<uint64_t, uint64_t> guest_tick_ratio();
+  // Conversion from the host tick count to the guest tick count, so the latter
+  // can be calculated without locking and without division, including by the
+  // JIT - computed as guest_base +
+  // ((max(host, host_base) - host_base) * multiplier >> shift). Published as a
+  // whole, and replaced by a new one rebased at the current guest tick count
+  // when the ratio changes. Published conversions are never freed.
+  struct GuestTickConversion {
+    uint64_t host_base;
+    uint64_t guest_base;
+    uint64_t multiplier;
+    uint32_t shift;
+  };
+  static const std::atomic<const GuestTickConversion*>&
+  guest_tick_conversion();
   // Guest ticks-per-second.
   static uint64_t guest_tick_frequency();
   // Sets the guest ticks-per-second.
@@ -80,6 +96,8 @@ class Clock {
 
   // Scales a time duration in milliseconds, from guest time.
   static uint32_t ScaleGuestDurationMillis(uint32_t guest_ms);
+  // Scales a time duration in microseconds, from guest time.
+  static uint64_t ScaleGuestDurationMicros(uint64_t guest_us);
   // Scales a time duration in 100ns ticks like FILETIME, from guest time.
   static int64_t ScaleGuestDurationFileTime(int64_t guest_file_time);
   // Scales a time duration represented as a timeval, from guest time.
@@ -196,6 +196,8 @@ void CrashRecoveryManager::Initialize(const std::string& learning_db_path) {
     return;
   }
 
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+
   learning_db_path_ = learning_db_path;
   g_crash_manager = this;
 
@@ -248,7 +250,10 @@ void CrashRecoveryManager::InstallCrashHandlers() {
 }
 
 void CrashRecoveryManager::RecordCrash(const CrashInfo& crash) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+
   total_crashes_++;
+  unsaved_crashes_.insert(crash.address);
 
   // Update crash history
   auto it = crash_history_.find(crash.address);
@@ -279,40 +284,106 @@ void CrashRecoveryManager::RecordCrash(const CrashInfo& crash) {
   if (total_crashes_ % 10 == 0) {
     AnalyzeCrashPatterns();
   }
+
+  PublishLookupSnapshot();
 }
 
+namespace {
+
+template <typename Address>
+WorkaroundStrategy FindWorkaround(
+    const std::vector<std::pair<Address, WorkaroundStrategy>>& workarounds,
+    Address address) {
+  auto it = std::lower_bound(
+      workarounds.begin(), workarounds.end(), address,
+      [](const std::pair<Address, WorkaroundStrategy>& workaround,
+         Address value) { return workaround.first < value; });
+  if (it != workarounds.end() && it->first == address) {
+    return it->second;
+  }
+  return WorkaroundStrategy::IgnoreError;
+}
+
+}  // namespace
+
 bool CrashRecoveryManager::IsProblematicAddress(uint64_t address) const {
-  return blacklisted_addresses_.count(address) > 0 ||
-         crash_history_.count(address) > 0;
+  const LookupSnapshot* snapshot =
+      lookup_snapshot_.load(std::memory_order_acquire);
+  return snapshot && std::binary_search(snapshot->problematic_addresses.begin(),
+                                        snapshot->problematic_addresses.end(),
+                                        address);
 }
 
 bool CrashRecoveryManager::IsProblematicGuestAddress(
     uint32_t guest_address) const {
-  return blacklisted_guest_addresses_.count(guest_address) > 0 ||
-         guest_crash_history_.count(guest_address) > 0;
+  const LookupSnapshot* snapshot =
+      lookup_snapshot_.load(std::memory_order_acquire);
+  return snapshot &&
+         std::binary_search(snapshot->problematic_guest_addresses.begin(),
+                            snapshot->problematic_guest_addresses.end(),
+                            guest_address);
 }
 
 WorkaroundStrategy CrashRecoveryManager::GetWorkaround(uint64_t address) const {
-  auto it = workarounds_.find(address);
-  if (it != workarounds_.end() && it->second.enabled) {
-    return it->second.strategy;
+  const LookupSnapshot* snapshot =
+      lookup_snapshot_.load(std::memory_order_acquire);
+  if (!snapshot) {
+    return WorkaroundStrategy::IgnoreError;
   }
-  return WorkaroundStrategy::IgnoreError;
+  return FindWorkaround(snapshot->workarounds, address);
 }
 
 WorkaroundStrategy CrashRecoveryManager::GetGuestWorkaround(
     uint32_t guest_address) const {
-  // Check guest crash history
-  auto it = guest_crash_history_.find(guest_address);
-  if (it != guest_crash_history_.end()) {
-    return DetermineWorkaround(it->second);
+  // Determined from the guest crash history.
+  const LookupSnapshot* snapshot =
+      lookup_snapshot_.load(std::memory_order_acquire);
+  if (!snapshot) {
+    return WorkaroundStrategy::IgnoreError;
   }
-  return WorkaroundStrategy::IgnoreError;
+  return FindWorkaround(snapshot->guest_workarounds, guest_address);
+}
+
+void CrashRecoveryManager::PublishLookupSnapshot() {
+  auto snapshot = std::make_unique<LookupSnapshot>();
+  snapshot->problematic_addresses.assign(blacklisted_addresses_.begin(),
+                                         blacklisted_addresses_.end());
+  for (const auto& pair : crash_history_) {
+    snapshot->problematic_addresses.push_back(pair.first);
+  }
+  std::sort(snapshot->problematic_addresses.begin(),
+            snapshot->problematic_addresses.end());
+  snapshot->problematic_addresses.erase(
+      std::unique(snapshot->problematic_addresses.begin(),
+                  snapshot->problematic_addresses.end()),
+      snapshot->problematic_addresses.end());
+  snapshot->problematic_guest_addresses.assign(
+      blacklisted_guest_addresses_.begin(), blacklisted_guest_addresses_.end());
+  for (const auto& pair : guest_crash_history_) {
+    snapshot->problematic_guest_addresses.push_back(pair.first);
+    snapshot->guest_workarounds.emplace_back(pair.first,
+                                             DetermineWorkaround(pair.second));
+  }
+  std::sort(snapshot->problematic_guest_addresses.begin(),
+            snapshot->problematic_guest_addresses.end());
+  snapshot->problematic_guest_addresses.erase(
+      std::unique(snapshot->problematic_guest_addresses.begin(),
+                  snapshot->problematic_guest_addresses.end()),
+      snapshot->problematic_guest_addresses.end());
+  for (const auto& pair : workarounds_) {
+    if (pair.second.enabled) {
+      snapshot->workarounds.emplace_back(pair.first, pair.second.strategy);
+    }
+  }
+  lookup_snapshot_.store(snapshot.get(), std::memory_order_release);
+  lookup_snapshots_.push_back(std::move(snapshot));
 }
 
 void CrashRecoveryManager::ApplyWorkaround(uint64_t address,
                                             WorkaroundStrategy strategy,
                                             const std::string& reason) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+
   Workaround workaround;
   workaround.address = address;
   workaround.strategy = strategy;
@@ -321,6 +392,8 @@ void CrashRecoveryManager::ApplyWorkaround(uint64_t address,
   workaround.enabled = true;
 
   workarounds_[address] = workaround;
+  unsaved_workarounds_.insert(address);
+  PublishLookupSnapshot();
 
   XELOGI("Workaround applied at 0x{:X}: {} ({})", address,
          static_cast<int>(strategy), reason);
@@ -328,7 +401,11 @@ void CrashRecoveryManager::ApplyWorkaround(uint64_t address,
 
 void CrashRecoveryManager::BlacklistAddress(uint64_t address,
                                              const std::string& reason) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+
   blacklisted_addresses_.insert(address);
+  unsaved_blacklisted_addresses_.insert(address);
+  // Publishes the snapshot.
   ApplyWorkaround(address, WorkaroundStrategy::Skip, reason);
 
   XELOGI("Address blacklisted: 0x{:X} ({})", address, reason);
@@ -336,7 +413,10 @@ void CrashRecoveryManager::BlacklistAddress(uint64_t address,
 
 void CrashRecoveryManager::BlacklistGuestAddress(uint32_t guest_address,
                                                   const std::string& reason) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+
   blacklisted_guest_addresses_.insert(guest_address);
+  PublishLookupSnapshot();
 
   XELOGI("Guest address blacklisted: 0x{:X} ({})", guest_address, reason);
 }
@@ -344,10 +424,12 @@ void CrashRecoveryManager::BlacklistGuestAddress(uint32_t guest_address,
 std::vector<CrashInfo> CrashRecoveryManager::GetRecentCrashes(
     size_t count) const {
   std::vector<CrashInfo> crashes;
-  crashes.reserve(crash_history_.size());
-
-  for (const auto& pair : crash_history_) {
-    crashes.push_back(pair.second);
+  {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    crashes.reserve(crash_history_.size());
+    for (const auto& pair : crash_history_) {
+      crashes.push_back(pair.second);
+    }
   }
 
   // Sort by timestamp (most recent first)
@@ -366,10 +448,12 @@ std::vector<CrashInfo> CrashRecoveryManager::GetRecentCrashes(
 std::vector<CrashInfo> CrashRecoveryManager::GetFrequentCrashes(
     size_t count) const {
   std::vector<CrashInfo> crashes;
-  crashes.reserve(crash_history_.size());
-
-  for (const auto& pair : crash_history_) {
-    crashes.push_back(pair.second);
+  {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    crashes.reserve(crash_history_.size());
+    for (const auto& pair : crash_history_) {
+      crashes.push_back(pair.second);
+    }
   }
 
   // Sort by frequency (most frequent first)
@@ -385,55 +469,113 @@ std::vector<CrashInfo> CrashRecoveryManager::GetFrequentCrashes(
   return crashes;
 }
 
+namespace {
+
+void WriteCrashRecord(std::ofstream& file, const CrashInfo& crash) {
+  file << fmt::format("0x{:X}|{}|{}|{}|{}\n", crash.address,
+                      static_cast<int>(crash.type), crash.frequency,
+                      crash.timestamp, crash.details);
+}
+
+void WriteWorkaroundRecord(std::ofstream& file, const Workaround& wa) {
+  file << fmt::format("0x{:X}|{}|{}|{}|{}\n", wa.address,
+                      static_cast<int>(wa.strategy), wa.times_applied,
+                      wa.enabled ? 1 : 0, wa.reason);
+}
+
+}  // namespace
+
 void CrashRecoveryManager::SaveLearningDatabase() {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+
   if (learning_db_path_.empty()) {
     return;
   }
 
-  std::ofstream file(learning_db_path_);
+  size_t unsaved_count = unsaved_crashes_.size() +
+                         unsaved_workarounds_.size() +
+                         unsaved_blacklisted_addresses_.size();
+  if (!unsaved_count) {
+    return;
+  }
+  // Records are appended, with later ones replacing earlier ones for the same
+  // address when loading, so a save during a crash doesn't need to rewrite the
+  // whole file. Rewrite it without the replaced records once they're the
+  // majority.
+  size_t record_count = crash_history_.size() + workarounds_.size() +
+                        blacklisted_addresses_.size();
+  bool rewrite = !database_record_count_ ||
+                 database_record_count_ + unsaved_count > record_count * 2;
+
+  std::ofstream file(learning_db_path_,
+                     rewrite ? std::ios::out | std::ios::trunc
+                             : std::ios::out | std::ios::app);
   if (!file.is_open()) {
     XELOGW("Failed to save learning database to: {}", learning_db_path_);
     return;
   }
 
-  // Write header
-  file << "# Xenia Crash Recovery Learning Database\n";
-  file << "# Generated: " << GetCurrentTimestamp() << "\n";
-  file << "# Total crashes: " << total_crashes_ << "\n";
-  file << "# Recovered: " << recovered_crashes_ << "\n";
-  file << "\n";
-
-  // Write crash history
-  file << "[CrashHistory]\n";
-  for (const auto& pair : crash_history_) {
-    const auto& crash = pair.second;
-    file << fmt::format("0x{:X}|{}|{}|{}|{}\n", crash.address,
-                        static_cast<int>(crash.type), crash.frequency,
-                        crash.timestamp, crash.details);
-  }
-  file << "\n";
+  if (rewrite) {
+    // Write header
+    file << "# Xenia Crash Recovery Learning Database\n";
+    file << "# Generated: " << GetCurrentTimestamp() << "\n";
+    file << "# Total crashes: " << total_crashes_ << "\n";
+    file << "# Recovered: " << recovered_crashes_ << "\n";
+    file << "\n";
+
+    // Write crash history
+    file << "[CrashHistory]\n";
+    for (const auto& pair : crash_history_) {
+      WriteCrashRecord(file, pair.second);
+    }
+    file << "\n";
 
-  // Write workarounds
-  file << "[Workarounds]\n";
-  for (const auto& pair : workarounds_) {
-    const auto& wa = pair.second;
-    file << fmt::format("0x{:X}|{}|{}|{}|{}\n", wa.address,
-                        static_cast<int>(wa.strategy), wa.times_applied,
-                        wa.enabled ? 1 : 0, wa.reason);
-  }
-  file << "\n";
+    // Write workarounds
+    file << "[Workarounds]\n";
+    for (const auto& pair : workarounds_) {
+      WriteWorkaroundRecord(file, pair.second);
+    }
+    file << "\n";
 
-  // Write blacklisted addresses
-  file << "[Blacklist]\n";
-  for (uint64_t addr : blacklisted_addresses_) {
-    file << fmt::format("0x{:X}\n", addr);
+    // Write blacklisted addresses
+    file << "[Blacklist]\n";
+    for (uint64_t addr : blacklisted_addresses_) {
+      file << fmt::format("0x{:X}\n", addr);
+    }
+    database_record_count_ = record_count;
+  } else {
+    file << "\n# Appended: " << GetCurrentTimestamp() << "\n";
+    if (!unsaved_crashes_.empty()) {
+      file << "[CrashHistory]\n";
+      for (uint64_t address : unsaved_crashes_) {
+        WriteCrashRecord(file, crash_history_[address]);
+      }
+    }
+    if (!unsaved_workarounds_.empty()) {
+      file << "[Workarounds]\n";
+      for (uint64_t address : unsaved_workarounds_) {
+        WriteWorkaroundRecord(file, workarounds_[address]);
+      }
+    }
+    if (!unsaved_blacklisted_addresses_.empty()) {
+      file << "[Blacklist]\n";
+      for (uint64_t addr : unsaved_blacklisted_addresses_) {
+        file << fmt::format("0x{:X}\n", addr);
+      }
+    }
+    database_record_count_ += unsaved_count;
   }
 
   file.close();
+  unsaved_crashes_.clear();
+  unsaved_workarounds_.clear();
+  unsaved_blacklisted_addresses_.clear();
   XELOGI("Learning database saved: {}", learning_db_path_);
 }
 
 void CrashRecoveryManager::LoadLearningDatabase() {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+
   if (learning_db_path_.empty()) {
     return;
   }
@@ -477,6 +619,7 @@ void CrashRecoveryManager::LoadLearningDatabase() {
       std::getline(iss, crash.details);
 
       crash_history_[crash.address] = crash;
+      ++database_record_count_;
     } else if (section == "Workarounds") {
       // Parse workaround: address|strategy|times|enabled|reason
       std::istringstream iss(line);
@@ -494,13 +637,16 @@ void CrashRecoveryManager::LoadLearningDatabase() {
       std::getline(iss, wa.reason);
 
       workarounds_[wa.address] = wa;
+      ++database_record_count_;
     } else if (section == "Blacklist") {
       uint64_t addr = std::stoull(line, nullptr, 16);
       blacklisted_addresses_.insert(addr);
+      ++database_record_count_;
     }
   }
 
   file.close();
+  PublishLookupSnapshot();
   XELOGI("Learning database loaded from: {}", learning_db_path_);
 }
 
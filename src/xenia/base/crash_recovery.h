@@ -10,11 +10,15 @@
 #ifndef XENIA_BASE_CRASH_RECOVERY_H_
 #define XENIA_BASE_CRASH_RECOVERY_H_
 
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace xe {
@@ -76,7 +80,8 @@ class CrashRecoveryManager {
   // Record a crash
   void RecordCrash(const CrashInfo& crash);
 
-  // Check if an address is known to be problematic
+  // Check if an address is known to be problematic. The lookups don't take
+  // locks, so they can be done from crash handlers and frequently.
   bool IsProblematicAddress(uint64_t address) const;
   bool IsProblematicGuestAddress(uint32_t guest_address) const;
 
@@ -93,12 +98,14 @@ class CrashRecoveryManager {
   void BlacklistGuestAddress(uint32_t guest_address, const std::string& reason);
 
   // Get crash statistics
-  uint32_t GetTotalCrashes() const { return total_crashes_; }
-  uint32_t GetRecoveredCrashes() const { return recovered_crashes_; }
+  uint32_t GetTotalCrashes() const { return total_crashes_.load(); }
+  uint32_t GetRecoveredCrashes() const { return recovered_crashes_.load(); }
   std::vector<CrashInfo> GetRecentCrashes(size_t count = 10) const;
   std::vector<CrashInfo> GetFrequentCrashes(size_t count = 10) const;
 
-  // Save/load learning database
+  // Save/load learning database. Saving appends the changes since the last
+  // save, and the database is rewritten only once it's mostly made of
+  // replaced records.
   void SaveLearningDatabase();
   void LoadLearningDatabase();
 
@@ -131,9 +138,30 @@ class CrashRecoveryManager {
   CrashRecoveryManager(const CrashRecoveryManager&) = delete;
   CrashRecoveryManager& operator=(const CrashRecoveryManager&) = delete;
 
+  // Immutable view of the data used by the lookups, replaced on every change.
+  struct LookupSnapshot {
+    // All sorted.
+    std::vector<uint64_t> problematic_addresses;
+    std::vector<uint32_t> problematic_guest_addresses;
+    // Only the enabled workarounds.
+    std::vector<std::pair<uint64_t, WorkaroundStrategy>> workarounds;
+    std::vector<std::pair<uint32_t, WorkaroundStrategy>> guest_workarounds;
+  };
+
   uint64_t GetCurrentTimestamp() const;
   void AnalyzeCrashPatterns();
   WorkaroundStrategy DetermineWorkaround(const CrashInfo& crash) const;
+  // Must be called with the mutex locked after changing the data used by the
+  // lookups.
+  void PublishLookupSnapshot();
+
+  // Recursive as the changes call each other, and a crash handler may run on
+  // a thread that's making a change.
+  mutable std::recursive_mutex mutex_;
+  std::atomic<const LookupSnapshot*> lookup_snapshot_{nullptr};
+  // Lookups on other threads may still be using older snapshots, and changes
+  // are rare, so the snapshots are kept.
+  std::vector<std::unique_ptr<LookupSnapshot>> lookup_snapshots_;
 
   std::string learning_db_path_;
   std::map<uint64_t, CrashInfo> crash_history_;      // Address -> crash info
@@ -142,8 +170,15 @@ class CrashRecoveryManager {
   std::set<uint64_t> blacklisted_addresses_;
   std::set<uint32_t> blacklisted_guest_addresses_;
 
-  uint32_t total_crashes_ = 0;
-  uint32_t recovered_crashes_ = 0;
+  // Entries changed since the database was last written.
+  std::set<uint64_t> unsaved_crashes_;
+  std::set<uint64_t> unsaved_workarounds_;
+  std::set<uint64_t> unsaved_blacklisted_addresses_;
+  // Records in the database file, including ones replaced by later records.
+  size_t database_record_count_ = 0;
+
+  std::atomic<uint32_t> total_crashes_{0};
+  std::atomic<uint32_t> recovered_crashes_{0};
   bool learning_enabled_ = true;
   bool workarounds_enabled_ = true;
   bool initialized_ = false;
@@ -0,0 +1,385 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/crypto.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/platform.h"
+
+#if XE_ARCH_AMD64
+#include <immintrin.h>
+
+#include "third_party/xbyak/xbyak/xbyak_util.h"
+#endif
+
+namespace xe {
+namespace crypto {
+
+#if XE_ARCH_AMD64
+
+// The AES and SHA instructions aren't implied by the AVX baseline the project
+// is built for, the functions using them must be compiled for them explicitly.
+#if !XE_COMPILER_MSVC
+#define XE_CRYPTO_AES __attribute__((target("aes")))
+#define XE_CRYPTO_SHA __attribute__((target("sha")))
+#else
+#define XE_CRYPTO_AES
+#define XE_CRYPTO_SHA
+#endif
+
+bool HasAesInstructions() {
+  static const bool has_aes_instructions =
+      Xbyak::util::Cpu().has(Xbyak::util::Cpu::tAESNI);
+  return has_aes_instructions;
+}
+
+bool HasShaInstructions() {
+  static const bool has_sha_instructions =
+      Xbyak::util::Cpu().has(Xbyak::util::Cpu::tSHA);
+  return has_sha_instructions;
+}
+
+template <int kRcon>
+XE_CRYPTO_AES static __m128i Aes128ExpandKeyStep(__m128i key) {
+  __m128i assist = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(key, kRcon),
+                                     _MM_SHUFFLE(3, 3, 3, 3));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  return _mm_xor_si128(key, assist);
+}
+
+XE_CRYPTO_AES void Aes128ExpandKey(const uint8_t* key, uint8_t* round_keys) {
+  __m128i keys[11];
+  keys[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+  keys[1] = Aes128ExpandKeyStep<0x01>(keys[0]);
+  keys[2] = Aes128ExpandKeyStep<0x02>(keys[1]);
+  keys[3] = Aes128ExpandKeyStep<0x04>(keys[2]);
+  keys[4] = Aes128ExpandKeyStep<0x08>(keys[3]);
+  keys[5] = Aes128ExpandKeyStep<0x10>(keys[4]);
+  keys[6] = Aes128ExpandKeyStep<0x20>(keys[5]);
+  keys[7] = Aes128ExpandKeyStep<0x40>(keys[6]);
+  keys[8] = Aes128ExpandKeyStep<0x80>(keys[7]);
+  keys[9] = Aes128ExpandKeyStep<0x1B>(keys[8]);
+  keys[10] = Aes128ExpandKeyStep<0x36>(keys[9]);
+  for (size_t i = 0; i < 11; ++i) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(round_keys + i * 16),
+                     keys[i]);
+  }
+}
+
+XE_CRYPTO_AES void Aes128InvertRoundKeys(const uint8_t* round_keys,
+                                         uint8_t* decryption_round_keys) {
+  auto source = reinterpret_cast<const __m128i*>(round_keys);
+  auto dest = reinterpret_cast<__m128i*>(decryption_round_keys);
+  // Loaded first in case the buffers are the same.
+  __m128i keys[11];
+  for (size_t i = 0; i < 11; ++i) {
+    keys[i] = _mm_loadu_si128(source + i);
+  }
+  _mm_storeu_si128(dest, keys[10]);
+  for (size_t i = 1; i < 10; ++i) {
+    _mm_storeu_si128(dest + i, _mm_aesimc_si128(keys[10 - i]));
+  }
+  _mm_storeu_si128(dest + 10, keys[0]);
+}
+
+XE_CRYPTO_AES static void Aes128LoadRoundKeys(const uint8_t* round_keys,
+                                              __m128i* keys) {
+  for (size_t i = 0; i < 11; ++i) {
+    keys[i] =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(round_keys) + i);
+  }
+}
+
+XE_CRYPTO_AES static __m128i Aes128EncryptBlock(const __m128i* keys,
+                                                __m128i block) {
+  block = _mm_xor_si128(block, keys[0]);
+  for (size_t i = 1; i < 10; ++i) {
+    block = _mm_aesenc_si128(block, keys[i]);
+  }
+  return _mm_aesenclast_si128(block, keys[10]);
+}
+
+XE_CRYPTO_AES static __m128i Aes128DecryptBlock(const __m128i* keys,
+                                                __m128i block) {
+  block = _mm_xor_si128(block, keys[0]);
+  for (size_t i = 1; i < 10; ++i) {
+    block = _mm_aesdec_si128(block, keys[i]);
+  }
+  return _mm_aesdeclast_si128(block, keys[10]);
+}
+
+// Independent blocks are processed 4 at a time so the latency of the rounds
+// overlaps.
+XE_CRYPTO_AES static void Aes128DecryptBlocks4(const __m128i* keys,
+                                               __m128i* blocks) {
+  for (size_t j = 0; j < 4; ++j) {
+    blocks[j] = _mm_xor_si128(blocks[j], keys[0]);
+  }
+  for (size_t i = 1; i < 10; ++i) {
+    for (size_t j = 0; j < 4; ++j) {
+      blocks[j] = _mm_aesdec_si128(blocks[j], keys[i]);
+    }
+  }
+  for (size_t j = 0; j < 4; ++j) {
+    blocks[j] = _mm_aesdeclast_si128(blocks[j], keys[10]);
+  }
+}
+
+XE_CRYPTO_AES void Aes128EncryptEcb(const uint8_t* round_keys,
+                                    const uint8_t* input, uint8_t* output,
+                                    size_t size) {
+  __m128i keys[11];
+  Aes128LoadRoundKeys(round_keys, keys);
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    __m128i blocks[4];
+    for (size_t j = 0; j < 4; ++j) {
+      blocks[j] = _mm_xor_si128(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i) + j),
+          keys[0]);
+    }
+    for (size_t k = 1; k < 10; ++k) {
+      for (size_t j = 0; j < 4; ++j) {
+        blocks[j] = _mm_aesenc_si128(blocks[j], keys[k]);
+      }
+    }
+    for (size_t j = 0; j < 4; ++j) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i) + j,
+                       _mm_aesenclast_si128(blocks[j], keys[10]));
+    }
+  }
+  for (; i + 16 <= size; i += 16) {
+    __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i),
+                     Aes128EncryptBlock(keys, block));
+  }
+}
+
+XE_CRYPTO_AES void Aes128DecryptEcb(const uint8_t* decryption_round_keys,
+                                    const uint8_t* input, uint8_t* output,
+                                    size_t size) {
+  __m128i keys[11];
+  Aes128LoadRoundKeys(decryption_round_keys, keys);
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    __m128i blocks[4];
+    for (size_t j = 0; j < 4; ++j) {
+      blocks[j] =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i) + j);
+    }
+    Aes128DecryptBlocks4(keys, blocks);
+    for (size_t j = 0; j < 4; ++j) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i) + j, blocks[j]);
+    }
+  }
+  for (; i + 16 <= size; i += 16) {
+    __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i),
+                     Aes128DecryptBlock(keys, block));
+  }
+}
+
+XE_CRYPTO_AES void Aes128EncryptCbc(const uint8_t* round_keys,
+                                    const uint8_t* input, uint8_t* output,
+                                    size_t size, uint8_t* iv) {
+  // Each block depends on the previous one, so there's nothing to overlap.
+  __m128i keys[11];
+  Aes128LoadRoundKeys(round_keys, keys);
+  __m128i feed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(iv));
+  for (size_t i = 0; i + 16 <= size; i += 16) {
+    __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+    feed = Aes128EncryptBlock(keys, _mm_xor_si128(feed, block));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), feed);
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(iv), feed);
+}
+
+XE_CRYPTO_AES void Aes128DecryptCbc(const uint8_t* decryption_round_keys,
+                                    const uint8_t* input, uint8_t* output,
+                                    size_t size, uint8_t* iv) {
+  __m128i keys[11];
+  Aes128LoadRoundKeys(decryption_round_keys, keys);
+  __m128i feed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(iv));
+  size_t i = 0;
+  // Unlike encryption, the blocks are decrypted independently, only the XOR
+  // depends on the previous ciphertext. The ciphertext is loaded before
+  // storing in case the input and the output are the same.
+  for (; i + 64 <= size; i += 64) {
+    __m128i ciphertext[4], blocks[4];
+    for (size_t j = 0; j < 4; ++j) {
+      ciphertext[j] = blocks[j] =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i) + j);
+    }
+    Aes128DecryptBlocks4(keys, blocks);
+    for (size_t j = 0; j < 4; ++j) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i) + j,
+                       _mm_xor_si128(blocks[j], feed));
+      feed = ciphertext[j];
+    }
+  }
+  for (; i + 16 <= size; i += 16) {
+    __m128i ciphertext =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(output + i),
+        _mm_xor_si128(Aes128DecryptBlock(keys, ciphertext), feed));
+    feed = ciphertext;
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(iv), feed);
+}
+
+// 4 of the 80 rounds, with the message schedule for the later groups
+// interleaved. The E values in e alternate between the groups.
+template <int kGroup>
+XE_CRYPTO_SHA static void Sha1Rounds4(__m128i& abcd, __m128i* e,
+                                      __m128i* msg) {
+  __m128i& message = msg[kGroup & 3];
+  __m128i& current_e = e[kGroup & 1];
+  if constexpr (kGroup == 0) {
+    current_e = _mm_add_epi32(current_e, message);
+  } else {
+    current_e = _mm_sha1nexte_epu32(current_e, message);
+  }
+  e[(kGroup + 1) & 1] = abcd;
+  if constexpr (kGroup >= 3 && kGroup < 19) {
+    msg[(kGroup + 1) & 3] = _mm_sha1msg2_epu32(msg[(kGroup + 1) & 3], message);
+  }
+  abcd = _mm_sha1rnds4_epu32(abcd, current_e, kGroup / 5);
+  if constexpr (kGroup >= 1 && kGroup < 17) {
+    msg[(kGroup + 3) & 3] = _mm_sha1msg1_epu32(msg[(kGroup + 3) & 3], message);
+  }
+  if constexpr (kGroup >= 2 && kGroup < 18) {
+    msg[(kGroup + 2) & 3] = _mm_xor_si128(msg[(kGroup + 2) & 3], message);
+  }
+}
+
+XE_CRYPTO_SHA void Sha1ProcessBlocks(uint32_t* state, const uint8_t* data,
+                                     size_t block_count) {
+  // The message words are big-endian.
+  const __m128i byte_swap =
+      _mm_set_epi64x(0x0001020304050607ULL, 0x08090A0B0C0D0E0FULL);
+  __m128i abcd = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1B);
+  __m128i e0 = _mm_set_epi32(int(state[4]), 0, 0, 0);
+  for (size_t i = 0; i < block_count; ++i, data += 64) {
+    __m128i abcd_save = abcd;
+    __m128i e_save = e0;
+    __m128i e[2] = {e0, _mm_setzero_si128()};
+    __m128i msg[4];
+    for (size_t j = 0; j < 4; ++j) {
+      msg[j] = _mm_shuffle_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(data) + j),
+          byte_swap);
+    }
+    Sha1Rounds4<0>(abcd, e, msg);
+    Sha1Rounds4<1>(abcd, e, msg);
+    Sha1Rounds4<2>(abcd, e, msg);
+    Sha1Rounds4<3>(abcd, e, msg);
+    Sha1Rounds4<4>(abcd, e, msg);
+    Sha1Rounds4<5>(abcd, e, msg);
+    Sha1Rounds4<6>(abcd, e, msg);
+    Sha1Rounds4<7>(abcd, e, msg);
+    Sha1Rounds4<8>(abcd, e, msg);
+    Sha1Rounds4<9>(abcd, e, msg);
+    Sha1Rounds4<10>(abcd, e, msg);
+    Sha1Rounds4<11>(abcd, e, msg);
+    Sha1Rounds4<12>(abcd, e, msg);
+    Sha1Rounds4<13>(abcd, e, msg);
+    Sha1Rounds4<14>(abcd, e, msg);
+    Sha1Rounds4<15>(abcd, e, msg);
+    Sha1Rounds4<16>(abcd, e, msg);
+    Sha1Rounds4<17>(abcd, e, msg);
+    Sha1Rounds4<18>(abcd, e, msg);
+    Sha1Rounds4<19>(abcd, e, msg);
+    e0 = _mm_sha1nexte_epu32(e[0], e_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+                   _mm_shuffle_epi32(abcd, 0x1B));
+  state[4] = uint32_t(_mm_extract_epi32(e0, 3));
+}
+
+#else
+
+bool HasAesInstructions() { return false; }
+bool HasShaInstructions() { return false; }
+
+void Aes128ExpandKey(const uint8_t* key, uint8_t* round_keys) {
+  assert_always();
+}
+
+void Aes128InvertRoundKeys(const uint8_t* round_keys,
+                           uint8_t* decryption_round_keys) {
+  assert_always();
+}
+
+void Aes128EncryptEcb(const uint8_t* round_keys, const uint8_t* input,
+                      uint8_t* output, size_t size) {
+  assert_always();
+}
+
+void Aes128DecryptEcb(const uint8_t* decryption_round_keys,
+                      const uint8_t* input, uint8_t* output, size_t size) {
+  assert_always();
+}
+
+void Aes128EncryptCbc(const uint8_t* round_keys, const uint8_t* input,
+                      uint8_t* output, size_t size, uint8_t* iv) {
+  assert_always();
+}
+
+void Aes128DecryptCbc(const uint8_t* decryption_round_keys,
+                      const uint8_t* input, uint8_t* output, size_t size,
+                      uint8_t* iv) {
+  assert_always();
+}
+
+void Sha1ProcessBlocks(uint32_t* state, const uint8_t* data,
+                       size_t block_count) {
+  assert_always();
+}
+
+#endif  // XE_ARCH_AMD64
+
+void Sha1ProcessBytes(sha1::SHA1* sha, const void* data, size_t size) {
+  auto bytes = static_cast<const uint8_t*>(data);
+  if (!HasShaInstructions() || size < 64) {
+    sha->processBytes(bytes, size);
+    return;
+  }
+  // Complete the block already started with the portable implementation.
+  size_t head_size = std::min(size, (64 - sha->getBlockByteIndex()) % 64);
+  sha->processBytes(bytes, head_size);
+  bytes += head_size;
+  size -= head_size;
+  size_t block_count = size / 64;
+  if (block_count) {
+    uint32_t digest[5];
+    std::memcpy(digest, sha->getDigest(), sizeof(digest));
+    Sha1ProcessBlocks(digest, bytes, block_count);
+    size_t blocks_size = block_count * 64;
+    // The partial block is empty here, only the digest and the count change.
+    sha->init(digest, sha->getBlock(),
+              uint32_t(sha->getByteCount() + blocks_size));
+    bytes += blocks_size;
+    size -= blocks_size;
+  }
+  sha->processBytes(bytes, size);
+}
+
+}  // namespace crypto
+}  // namespace xe
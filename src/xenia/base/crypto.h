@@ -0,0 +1,63 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_CRYPTO_H_
+#define XENIA_BASE_CRYPTO_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "third_party/crypto/TinySHA1.hpp"
+
+namespace xe {
+namespace crypto {
+
+// AES-128 and SHA-1 using the instructions of the host CPU. The AES and SHA
+// functions below may be called only if HasAesInstructions and
+// HasShaInstructions respectively return true - otherwise the callers must
+// use their portable implementations.
+bool HasAesInstructions();
+bool HasShaInstructions();
+
+// 11 round keys, in the byte order of FIPS-197, which is also the order of
+// the key schedule in the XeCrypt AES state.
+constexpr size_t kAes128RoundKeysSize = 11 * 16;
+
+void Aes128ExpandKey(const uint8_t* key, uint8_t* round_keys);
+// Converts the encryption round keys to the ones for the equivalent inverse
+// cipher, used by the decryption functions.
+void Aes128InvertRoundKeys(const uint8_t* round_keys,
+                           uint8_t* decryption_round_keys);
+
+// The size must be a multiple of 16 bytes. The input and the output may be
+// the same buffer.
+void Aes128EncryptEcb(const uint8_t* round_keys, const uint8_t* input,
+                      uint8_t* output, size_t size);
+void Aes128DecryptEcb(const uint8_t* decryption_round_keys,
+                      const uint8_t* input, uint8_t* output, size_t size);
+// The 16-byte iv is replaced with the last ciphertext block, so the next call
+// continues the chain.
+void Aes128EncryptCbc(const uint8_t* round_keys, const uint8_t* input,
+                      uint8_t* output, size_t size, uint8_t* iv);
+void Aes128DecryptCbc(const uint8_t* decryption_round_keys,
+                      const uint8_t* input, uint8_t* output, size_t size,
+                      uint8_t* iv);
+
+// Updates the SHA-1 state (in host byte order) with whole 64-byte blocks.
+void Sha1ProcessBlocks(uint32_t* state, const uint8_t* data,
+                       size_t block_count);
+
+// Same as sha->processBytes, hashing the whole blocks with the SHA
+// instructions if the host has them.
+void Sha1ProcessBytes(sha1::SHA1* sha, const void* data, size_t size);
+
+}  // namespace crypto
+}  // namespace xe
+
+#endif  // XENIA_BASE_CRYPTO_H_
@@ -27,6 +27,7 @@ cxxopts::Options options("xenia", "Xbox 360 Emulator");
 std::map<std::string, ICommandVar*>* CmdVars;
 std::map<std::string, IConfigVar*>* ConfigVars;
 std::multimap<uint32_t, const IConfigVarUpdate*>* IConfigVarUpdate::updates_;
+std::atomic<uint32_t> value_generation{0};
 
 void PrintHelpAndExit() {
   std::cout << options.help({""}) << std::endl;
@@ -10,6 +10,7 @@
 #ifndef XENIA_CVAR_H_
 #define XENIA_CVAR_H_
 
+#include <atomic>
 #include <filesystem>
 #include <map>
 #include <string>
@@ -33,6 +34,38 @@ namespace toml {
 std::string EscapeString(const std::string_view str);
 }
 
+// Incremented whenever the value of any variable is changed - by the command
+// line, the config, a game config or an override.
+extern std::atomic<uint32_t> value_generation;
+inline uint32_t GetValueGeneration() {
+  return value_generation.load(std::memory_order_acquire);
+}
+
+// Values derived from variables that are too expensive to derive on every use
+// on a hot path (such as parsed strings or combinations of multiple variables),
+// derived again only after a variable has been changed. Values must be
+// default-constructible and have a void Load() member function reading the
+// variables. Not thread-safe - needs a lock or an instance per thread if used
+// on multiple threads.
+template <typename Values>
+class Snapshot {
+ public:
+  const Values& Get() {
+    uint32_t generation = GetValueGeneration();
+    if (!loaded_ || generation_ != generation) {
+      values_.Load();
+      generation_ = generation;
+      loaded_ = true;
+    }
+    return values_;
+  }
+
+ private:
+  Values values_;
+  uint32_t generation_ = 0;
+  bool loaded_ = false;
+};
+
 class ICommandVar {
  public:
   virtual ~ICommandVar() = default;
@@ -50,6 +83,7 @@ class IConfigVar : virtual public ICommandVar {
   virtual std::string config_value() const = 0;
   virtual void LoadConfigValue(std::shared_ptr<cpptoml::base> result) = 0;
   virtual void LoadGameConfigValue(std::shared_ptr<cpptoml::base> result) = 0;
+  virtual bool has_game_config_value() const = 0;
   virtual void ResetConfigValueToDefault() = 0;
 };
 
@@ -95,6 +129,9 @@ class ConfigVar : public CommandVar<T>, virtual public IConfigVar {
   // one that will be stored when the global config is written next time. After
   // overriding, however, the next game config loaded may still change it.
   void OverrideConfigValue(T val);
+  bool has_game_config_value() const override {
+    return game_config_value_ != nullptr;
+  }
 
  private:
   std::string category_;
@@ -234,7 +271,11 @@ std::string CommandVar<T>::ToString(T val) {
 
 template <class T>
 void CommandVar<T>::SetValue(T val) {
+  if (*current_value_ == val) {
+    return;
+  }
   *current_value_ = val;
+  value_generation.fetch_add(1, std::memory_order_acq_rel);
 }
 template <class T>
 const std::string& ConfigVar<T>::category() const {
@@ -24,5 +24,16 @@ bool CreateParentFolder(const std::filesystem::path& path) {
   return true;
 }
 
+bool LockStdioFileIfUnchanged(FILE* file, uint64_t expected_size) {
+  if (!LockStdioFile(file, true)) {
+    return false;
+  }
+  if (!Seek(file, 0, SEEK_END) || Tell(file) != int64_t(expected_size)) {
+    UnlockStdioFile(file);
+    return false;
+  }
+  return true;
+}
+
 }  // namespace filesystem
 }  // namespace xe
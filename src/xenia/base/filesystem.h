@@ -61,6 +61,23 @@ int64_t Tell(FILE* file);
 // undefined.
 bool TruncateStdioFile(FILE* file, uint64_t length);
 
+// Advisory locking of a whole stdio file between processes, for files shared
+// by multiple emulator instances running concurrently, such as caches of
+// translated code. A shared lock is for reading, an exclusive one for modifying
+// the file. Locking blocks until the lock is acquired, and locks are not
+// recursive. Unlocking flushes the buffered writes first, so they're visible to
+// other processes once they acquire the lock.
+bool LockStdioFile(FILE* file, bool exclusive);
+bool UnlockStdioFile(FILE* file);
+
+// For files only appended to by other processes, acquires the exclusive lock,
+// and keeps it only if the size of the file is still the expected one - if it's
+// different, another process has modified the file since it has been read, so
+// truncating or rewriting it would discard the data written by that process.
+// Returns whether the lock has been kept. The file pointer is at the end of the
+// file afterwards.
+bool LockStdioFileIfUnchanged(FILE* file, uint64_t expected_size);
+
 struct FileAccess {
   // Implies kFileReadData.
   static const uint32_t kGenericRead = 0x80000000;
@@ -14,12 +14,14 @@
 
 #include <assert.h>
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <ftw.h>
 #include <libgen.h>
 #include <pwd.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -106,6 +108,21 @@ bool TruncateStdioFile(FILE* file, uint64_t length) {
   return true;
 }
 
+bool LockStdioFile(FILE* file, bool exclusive) {
+  int fd = fileno(file);
+  while (flock(fd, exclusive ? LOCK_EX : LOCK_SH)) {
+    if (errno != EINTR) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool UnlockStdioFile(FILE* file) {
+  bool flushed = !fflush(file);
+  return !flock(fileno(file), LOCK_UN) && flushed;
+}
+
 static int removeCallback(const char* fpath, const struct stat* sb,
                           int typeflag, struct FTW* ftwbuf) {
   int rv = remove(fpath);
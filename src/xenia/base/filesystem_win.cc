@@ -103,6 +103,35 @@ bool TruncateStdioFile(FILE* file, uint64_t length) {
   return true;
 }
 
+// Byte range locks are mandatory on Windows, so a range beyond any real file
+// size is locked instead of the contents, which keeps the lock advisory.
+static OVERLAPPED GetStdioFileLockOverlapped() {
+  OVERLAPPED overlapped = {};
+  overlapped.Offset = 0xFFFFFFFE;
+  overlapped.OffsetHigh = 0x7FFFFFFF;
+  return overlapped;
+}
+
+bool LockStdioFile(FILE* file, bool exclusive) {
+  auto handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file)));
+  if (handle == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  OVERLAPPED overlapped = GetStdioFileLockOverlapped();
+  return LockFileEx(handle, exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, 1, 0,
+                    &overlapped) != 0;
+}
+
+bool UnlockStdioFile(FILE* file) {
+  bool flushed = !fflush(file);
+  auto handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file)));
+  if (handle == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  OVERLAPPED overlapped = GetStdioFileLockOverlapped();
+  return UnlockFileEx(handle, 0, 1, 0, &overlapped) && flushed;
+}
+
 class Win32FileHandle : public FileHandle {
  public:
   Win32FileHandle(const std::filesystem::path& path, HANDLE handle)
@@ -0,0 +1,134 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/frame_breakdown.h"
+
+#include <atomic>
+#include <mutex>
+
+#include "xenia/base/clock.h"
+
+namespace xe {
+namespace frame_breakdown {
+
+namespace {
+
+struct Tracker {
+  std::atomic<bool> enabled{false};
+  // Host ticks of the current frame.
+  std::atomic<uint64_t> category_ticks[kCategoryCount] = {};
+  std::mutex mutex;
+  uint64_t frame_start_tick = 0;
+  // Ring of the latest frames.
+  Frame history[kHistoryLength];
+  size_t history_count = 0;
+  size_t history_next = 0;
+};
+
+Tracker& GetTracker() {
+  static Tracker tracker;
+  return tracker;
+}
+
+thread_local uint32_t scope_depths[kCategoryCount] = {};
+
+uint64_t TicksToMicroseconds(uint64_t ticks) {
+  return ticks * 1000000 / Clock::QueryHostTickFrequency();
+}
+
+}  // namespace
+
+const char* GetCategoryName(Category category) {
+  switch (category) {
+    case Category::kTranslation:
+      return "JIT translation";
+    case Category::kPipelineCreation:
+      return "Pipeline creation";
+    case Category::kTextureLoad:
+      return "Texture loads";
+    case Category::kEdramTransfer:
+      return "EDRAM transfers";
+    case Category::kXmaDecode:
+      return "XMA decode";
+    case Category::kKernelWait:
+      return "Kernel waits";
+    default:
+      return "Unknown";
+  }
+}
+
+bool IsEnabled() {
+  return GetTracker().enabled.load(std::memory_order_relaxed);
+}
+
+void SetEnabled(bool enabled) {
+  Tracker& tracker = GetTracker();
+  std::lock_guard<std::mutex> lock(tracker.mutex);
+  if (enabled && !tracker.enabled.load(std::memory_order_relaxed)) {
+    for (std::atomic<uint64_t>& ticks : tracker.category_ticks) {
+      ticks.store(0, std::memory_order_relaxed);
+    }
+    tracker.frame_start_tick = Clock::QueryHostTickCount();
+    tracker.history_count = 0;
+    tracker.history_next = 0;
+  }
+  tracker.enabled.store(enabled, std::memory_order_relaxed);
+}
+
+ScopedTimer::ScopedTimer(Category category)
+    : category_(category), start_tick_(0) {
+  if (scope_depths[size_t(category)]++ || !IsEnabled()) {
+    return;
+  }
+  start_tick_ = Clock::QueryHostTickCount();
+}
+
+ScopedTimer::~ScopedTimer() {
+  --scope_depths[size_t(category_)];
+  if (!start_tick_) {
+    return;
+  }
+  GetTracker().category_ticks[size_t(category_)].fetch_add(
+      Clock::QueryHostTickCount() - start_tick_, std::memory_order_relaxed);
+}
+
+void OnGuestSwap() {
+  Tracker& tracker = GetTracker();
+  if (!tracker.enabled.load(std::memory_order_relaxed)) {
+    return;
+  }
+  uint64_t tick = Clock::QueryHostTickCount();
+  std::lock_guard<std::mutex> lock(tracker.mutex);
+  Frame& frame = tracker.history[tracker.history_next];
+  frame.duration_us = TicksToMicroseconds(tick - tracker.frame_start_tick);
+  for (size_t i = 0; i < kCategoryCount; ++i) {
+    frame.category_us[i] = TicksToMicroseconds(
+        tracker.category_ticks[i].exchange(0, std::memory_order_relaxed));
+  }
+  tracker.frame_start_tick = tick;
+  tracker.history_next = (tracker.history_next + 1) % kHistoryLength;
+  if (tracker.history_count < kHistoryLength) {
+    ++tracker.history_count;
+  }
+}
+
+size_t GetHistory(Frame* frames_out) {
+  Tracker& tracker = GetTracker();
+  std::lock_guard<std::mutex> lock(tracker.mutex);
+  size_t first = (tracker.history_next + kHistoryLength -
+                  tracker.history_count) %
+                 kHistoryLength;
+  for (size_t i = 0; i < tracker.history_count; ++i) {
+    frames_out[i] = tracker.history[(first + i) % kHistoryLength];
+  }
+  return tracker.history_count;
+}
+
+}  // namespace frame_breakdown
+}  // namespace xe
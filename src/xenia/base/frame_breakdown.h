@@ -0,0 +1,74 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_FRAME_BREAKDOWN_H_
+#define XENIA_BASE_FRAME_BREAKDOWN_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace xe {
+namespace frame_breakdown {
+
+// Aggregates the host time spent in the work that commonly causes stutter per
+// guest frame (between two guest swaps), for the frame breakdown overlay. The
+// time is summed over all threads, so it may exceed the duration of the frame
+// when the work is done in parallel. Nothing is measured unless enabled.
+
+enum class Category : uint32_t {
+  kTranslation,
+  kPipelineCreation,
+  kTextureLoad,
+  kEdramTransfer,
+  kXmaDecode,
+  kKernelWait,
+
+  kCount,
+};
+constexpr size_t kCategoryCount = size_t(Category::kCount);
+
+const char* GetCategoryName(Category category);
+
+struct Frame {
+  uint64_t duration_us;
+  uint64_t category_us[kCategoryCount];
+};
+
+// Frames kept in the history.
+constexpr size_t kHistoryLength = 240;
+
+bool IsEnabled();
+// Clears the history when enabling.
+void SetEnabled(bool enabled);
+
+// Measures the time until the end of the scope if enabled. Nested scopes of
+// the same category on a thread are only measured once.
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(Category category);
+  ~ScopedTimer();
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+ private:
+  Category category_;
+  // 0 if not measuring.
+  uint64_t start_tick_;
+};
+
+// Completes the current guest frame.
+void OnGuestSwap();
+
+// Writes up to kHistoryLength frames, from the oldest, returning the count.
+size_t GetHistory(Frame* frames_out);
+
+}  // namespace frame_breakdown
+}  // namespace xe
+
+#endif  // XENIA_BASE_FRAME_BREAKDOWN_H_
@@ -11,16 +11,316 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <fstream>
 #include <sstream>
+#include <unordered_map>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/crash_recovery.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 
 namespace xe {
 namespace game_compatibility {
 
+// Binary database: the header, the game entries sorted by title ID, the
+// string pool, and the details of the games, all in host byte order.
+struct GameCompatibilityDatabase::BinaryHeader {
+  // 'XGCD'.
+  static constexpr uint32_t kMagic = 0x44434758;
+  static constexpr uint32_t kVersion = 3;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t game_count;
+  uint32_t strings_offset;
+  uint32_t strings_size;
+  uint32_t details_offset;
+  uint32_t details_size;
+  uint32_t reserved;
+};
+
+// Enough to check the existence and the status of a game without reading its
+// details.
+struct GameCompatibilityDatabase::BinaryGameEntry {
+  uint32_t title_id;
+  uint32_t status;
+  uint32_t title_name_offset;
+  uint32_t title_name_length;
+  uint32_t details_offset;
+  uint32_t details_size;
+};
+
+namespace {
+
+// The details are a sequence of 32-bit values, with strings as an offset and a
+// length in the pool, and lists preceded by their length.
+class BinaryDetailsWriter {
+ public:
+  void Write(uint32_t value) {
+    details_.insert(details_.end(), reinterpret_cast<const uint8_t*>(&value),
+                    reinterpret_cast<const uint8_t*>(&value) + sizeof(value));
+  }
+  void Write64(uint64_t value) {
+    Write(uint32_t(value));
+    Write(uint32_t(value >> 32));
+  }
+  void WriteString(const std::string& value) {
+    Write(AddString(value));
+    Write(uint32_t(value.size()));
+  }
+  // Returns the offset of the string in the pool.
+  uint32_t AddString(const std::string& value) {
+    auto [it, inserted] =
+        string_offsets_.emplace(value, uint32_t(strings_.size()));
+    if (inserted) {
+      strings_ += value;
+    }
+    return it->second;
+  }
+
+  const std::vector<uint8_t>& details() const { return details_; }
+  const std::string& strings() const { return strings_; }
+
+ private:
+  std::vector<uint8_t> details_;
+  std::string strings_;
+  // Deduplicates the strings.
+  std::unordered_map<std::string, uint32_t> string_offsets_;
+};
+
+class BinaryDetailsReader {
+ public:
+  BinaryDetailsReader(const uint8_t* details, size_t details_size,
+                      const char* strings, size_t strings_size)
+      : details_(details),
+        details_size_(details_size),
+        strings_(strings),
+        strings_size_(strings_size) {}
+
+  bool ok() const { return ok_; }
+
+  uint32_t Read() {
+    if (details_size_ - position_ < sizeof(uint32_t)) {
+      ok_ = false;
+      return 0;
+    }
+    uint32_t value;
+    std::memcpy(&value, details_ + position_, sizeof(value));
+    position_ += sizeof(value);
+    return value;
+  }
+  uint64_t Read64() {
+    uint64_t low = Read();
+    return low | (uint64_t(Read()) << 32);
+  }
+  bool ReadBool() { return Read() != 0; }
+  std::string ReadString() {
+    uint32_t offset = Read();
+    uint32_t length = Read();
+    if (offset > strings_size_ || strings_size_ - offset < length) {
+      ok_ = false;
+      return std::string();
+    }
+    return std::string(strings_ + offset, length);
+  }
+  // Limits list lengths to what the remaining data can contain.
+  uint32_t ReadCount(size_t element_size) {
+    uint32_t count = Read();
+    if (count > (details_size_ - position_) / element_size) {
+      ok_ = false;
+      return 0;
+    }
+    return count;
+  }
+
+ private:
+  const uint8_t* details_;
+  size_t details_size_;
+  const char* strings_;
+  size_t strings_size_;
+  size_t position_ = 0;
+  bool ok_ = true;
+};
+
+void WriteBinaryGameDetails(BinaryDetailsWriter& writer, const GameInfo& info) {
+  writer.WriteString(info.region);
+  writer.WriteString(info.notes);
+  writer.WriteString(info.tested_version);
+  writer.Write64(info.last_updated);
+  writer.Write(uint32_t(info.known_issues.size()));
+  for (IssueType issue : info.known_issues) {
+    writer.Write(uint32_t(issue));
+  }
+  writer.Write(uint32_t(info.fixes.size()));
+  for (const GameFix& fix : info.fixes) {
+    writer.Write(uint32_t(fix.type));
+    writer.WriteString(fix.description);
+    writer.Write(fix.enabled);
+    writer.Write(uint32_t(fix.priority));
+
+    const MemoryConfig& memory = fix.memory_config;
+    writer.Write(memory.heap_size_4kb);
+    writer.Write(memory.heap_size_64kb);
+    writer.Write(memory.heap_size_16mb);
+    writer.Write(memory.use_large_pages);
+    writer.Write(memory.disable_write_combine);
+    writer.Write(uint32_t(memory.reserved_regions.size()));
+    for (const auto& region : memory.reserved_regions) {
+      writer.Write(region.first);
+      writer.Write(region.second);
+    }
+
+    const GraphicsConfig& graphics = fix.graphics_config;
+    writer.Write(graphics.disable_vsync);
+    writer.Write(graphics.force_msaa);
+    writer.Write(uint32_t(graphics.msaa_samples));
+    writer.Write(graphics.disable_tessellation);
+    writer.Write(graphics.use_safe_shader_cache);
+    writer.Write(uint32_t(graphics.max_texture_size));
+    writer.Write(graphics.disable_render_cache);
+
+    const CPUConfig& cpu = fix.cpu_config;
+    writer.Write(cpu.use_safe_jit);
+    writer.Write(cpu.disable_fast_math);
+    writer.Write(uint32_t(cpu.blacklisted_addresses.size()));
+    for (uint32_t address : cpu.blacklisted_addresses) {
+      writer.Write(address);
+    }
+    writer.Write(uint32_t(cpu.code_patches.size()));
+    for (const auto& patch : cpu.code_patches) {
+      writer.Write(patch.first);
+      writer.Write(patch.second);
+    }
+    writer.Write(uint32_t(cpu.disabled_functions.size()));
+    for (const std::string& function : cpu.disabled_functions) {
+      writer.WriteString(function);
+    }
+    writer.Write(uint32_t(cpu.spin_loop_yield_iterations));
+
+    writer.Write(uint32_t(fix.settings.size()));
+    for (const auto& setting : fix.settings) {
+      writer.WriteString(setting.first);
+      writer.WriteString(setting.second);
+    }
+  }
+}
+
+void ReadBinaryGameDetails(BinaryDetailsReader& reader, GameInfo& info) {
+  info.region = reader.ReadString();
+  info.notes = reader.ReadString();
+  info.tested_version = reader.ReadString();
+  info.last_updated = reader.Read64();
+  uint32_t issue_count = reader.ReadCount(sizeof(uint32_t));
+  for (uint32_t i = 0; i < issue_count; ++i) {
+    info.known_issues.push_back(IssueType(reader.Read()));
+  }
+  uint32_t fix_count = reader.ReadCount(sizeof(uint32_t));
+  for (uint32_t i = 0; reader.ok() && i < fix_count; ++i) {
+    GameFix fix;
+    fix.type = FixType(reader.Read());
+    fix.description = reader.ReadString();
+    fix.enabled = reader.ReadBool();
+    fix.priority = int(reader.Read());
+
+    MemoryConfig& memory = fix.memory_config;
+    memory.heap_size_4kb = reader.Read();
+    memory.heap_size_64kb = reader.Read();
+    memory.heap_size_16mb = reader.Read();
+    memory.use_large_pages = reader.ReadBool();
+    memory.disable_write_combine = reader.ReadBool();
+    uint32_t region_count = reader.ReadCount(sizeof(uint32_t) * 2);
+    for (uint32_t j = 0; j < region_count; ++j) {
+      uint32_t start = reader.Read();
+      memory.reserved_regions.emplace_back(start, reader.Read());
+    }
+
+    GraphicsConfig& graphics = fix.graphics_config;
+    graphics.disable_vsync = reader.ReadBool();
+    graphics.force_msaa = reader.ReadBool();
+    graphics.msaa_samples = int(reader.Read());
+    graphics.disable_tessellation = reader.ReadBool();
+    graphics.use_safe_shader_cache = reader.ReadBool();
+    graphics.max_texture_size = int(reader.Read());
+    graphics.disable_render_cache = reader.ReadBool();
+
+    CPUConfig& cpu = fix.cpu_config;
+    cpu.use_safe_jit = reader.ReadBool();
+    cpu.disable_fast_math = reader.ReadBool();
+    uint32_t address_count = reader.ReadCount(sizeof(uint32_t));
+    for (uint32_t j = 0; j < address_count; ++j) {
+      cpu.blacklisted_addresses.insert(reader.Read());
+    }
+    uint32_t patch_count = reader.ReadCount(sizeof(uint32_t) * 2);
+    for (uint32_t j = 0; j < patch_count; ++j) {
+      uint32_t address = reader.Read();
+      cpu.code_patches[address] = reader.Read();
+    }
+    uint32_t function_count = reader.ReadCount(sizeof(uint32_t) * 2);
+    for (uint32_t j = 0; j < function_count; ++j) {
+      cpu.disabled_functions.insert(reader.ReadString());
+    }
+    cpu.spin_loop_yield_iterations = int32_t(reader.Read());
+
+    uint32_t setting_count = reader.ReadCount(sizeof(uint32_t) * 4);
+    for (uint32_t j = 0; j < setting_count; ++j) {
+      std::string name = reader.ReadString();
+      fix.settings[std::move(name)] = reader.ReadString();
+    }
+
+    info.fixes.push_back(std::move(fix));
+  }
+}
+
+// The user's game config takes precedence over the database. Set as a game
+// config value so it's not written to the global config.
+template <typename T>
+void SetCvarUnlessInGameConfig(const char* name, T value) {
+  if (!cvar::ConfigVars) {
+    return;
+  }
+  auto it = cvar::ConfigVars->find(name);
+  if (it == cvar::ConfigVars->end()) {
+    return;
+  }
+  auto config_var = dynamic_cast<cvar::ConfigVar<T>*>(it->second);
+  if (config_var && !config_var->has_game_config_value()) {
+    XELOGI("    {} = {}", name, value);
+    config_var->SetGameConfigValue(value);
+  }
+}
+
+// For settings of any type, with the value in the TOML syntax.
+void SetCvarFromTomlUnlessInGameConfig(const std::string& name,
+                                       const std::string& value) {
+  if (!cvar::ConfigVars) {
+    return;
+  }
+  auto it = cvar::ConfigVars->find(name);
+  if (it == cvar::ConfigVars->end()) {
+    XELOGW("    Unknown setting {}", name);
+    return;
+  }
+  cvar::IConfigVar* config_var = it->second;
+  if (config_var->has_game_config_value()) {
+    return;
+  }
+  std::istringstream value_stream("value = " + value);
+  std::shared_ptr<cpptoml::base> parsed_value;
+  try {
+    parsed_value = cpptoml::parser(value_stream).parse()->get("value");
+  } catch (const cpptoml::parse_exception& e) {
+    XELOGW("    Failed to parse the value of {}: {}", name, e.what());
+    return;
+  }
+  XELOGI("    {} = {}", name, value);
+  config_var->LoadGameConfigValue(parsed_value);
+}
+
+}  // namespace
+
 GameCompatibilityDatabase& GameCompatibilityDatabase::GetInstance() {
   static GameCompatibilityDatabase instance;
   return instance;
@@ -51,6 +351,9 @@ void GameCompatibilityDatabase::Shutdown() {
 
   XELOGI("Game Compatibility Database shutdown");
   games_.clear();
+  binary_games_ = nullptr;
+  binary_game_count_ = 0;
+  binary_file_.reset();
   initialized_ = false;
 }
 
@@ -347,7 +650,7 @@ void GameCompatibilityDatabase::RegisterKnownGame(
 }
 
 bool GameCompatibilityDatabase::HasGameInfo(uint32_t title_id) const {
-  return games_.find(title_id) != games_.end();
+  return games_.find(title_id) != games_.end() || FindBinaryGame(title_id);
 }
 
 GameInfo GameCompatibilityDatabase::GetGameInfo(uint32_t title_id) const {
@@ -355,6 +658,13 @@ GameInfo GameCompatibilityDatabase::GetGameInfo(uint32_t title_id) const {
   if (it != games_.end()) {
     return it->second;
   }
+  const BinaryGameEntry* binary_game = FindBinaryGame(title_id);
+  if (binary_game) {
+    GameInfo info;
+    if (ReadBinaryGame(*binary_game, info)) {
+      return info;
+    }
+  }
 
   // Return unknown game
   GameInfo unknown;
@@ -369,6 +679,10 @@ CompatibilityStatus GameCompatibilityDatabase::GetStatus(uint32_t title_id) cons
   if (it != games_.end()) {
     return it->second.status;
   }
+  const BinaryGameEntry* binary_game = FindBinaryGame(title_id);
+  if (binary_game) {
+    return CompatibilityStatus(binary_game->status);
+  }
   return CompatibilityStatus::Unknown;
 }
 
@@ -405,6 +719,10 @@ void GameCompatibilityDatabase::ApplyFixes(uint32_t title_id) {
           crash_recovery::CrashRecoveryManager::GetInstance()
               .BlacklistGuestAddress(addr, fix.description);
         }
+        if (fix.cpu_config.spin_loop_yield_iterations >= 0) {
+          SetCvarUnlessInGameConfig("spin_loop_yield_iterations",
+                                    fix.cpu_config.spin_loop_yield_iterations);
+        }
         break;
 
       case FixType::GraphicsSettings:
@@ -415,6 +733,12 @@ void GameCompatibilityDatabase::ApplyFixes(uint32_t title_id) {
         // Already handled in CPUWorkaround
         break;
 
+      case FixType::ForceSettings:
+        for (const auto& setting : fix.settings) {
+          SetCvarFromTomlUnlessInGameConfig(setting.first, setting.second);
+        }
+        break;
+
       default:
         XELOGW("    Fix type not yet implemented");
         break;
@@ -427,6 +751,13 @@ std::vector<GameFix> GameCompatibilityDatabase::GetFixes(uint32_t title_id) cons
   if (it != games_.end()) {
     return it->second.fixes;
   }
+  const BinaryGameEntry* binary_game = FindBinaryGame(title_id);
+  if (binary_game) {
+    GameInfo info;
+    if (ReadBinaryGame(*binary_game, info)) {
+      return info.fixes;
+    }
+  }
   return {};
 }
 
@@ -437,34 +768,77 @@ void GameCompatibilityDatabase::AddGame(const GameInfo& info) {
 
 void GameCompatibilityDatabase::UpdateStatus(uint32_t title_id,
                                               CompatibilityStatus status) {
-  auto it = games_.find(title_id);
-  if (it != games_.end()) {
-    it->second.status = status;
-    it->second.last_updated =
+  GameInfo* game = GetMutableGame(title_id);
+  if (game) {
+    game->status = status;
+    game->last_updated =
         std::chrono::system_clock::now().time_since_epoch().count();
   }
 }
 
 void GameCompatibilityDatabase::AddIssue(uint32_t title_id, IssueType issue) {
-  auto it = games_.find(title_id);
-  if (it != games_.end()) {
-    it->second.known_issues.push_back(issue);
+  GameInfo* game = GetMutableGame(title_id);
+  if (game) {
+    game->known_issues.push_back(issue);
   }
 }
 
 void GameCompatibilityDatabase::AddFix(uint32_t title_id, const GameFix& fix) {
-  auto it = games_.find(title_id);
-  if (it != games_.end()) {
-    it->second.fixes.push_back(fix);
+  GameInfo* game = GetMutableGame(title_id);
+  if (game) {
+    game->fixes.push_back(fix);
+  }
+}
+
+void GameCompatibilityDatabase::SetSettingsFix(
+    uint32_t title_id, const std::string& title_name,
+    const std::string& description,
+    const std::map<std::string, std::string>& settings) {
+  GameInfo* game = GetMutableGame(title_id);
+  if (!game) {
+    GameInfo info;
+    info.title_id = title_id;
+    info.title_name = title_name;
+    info.status = CompatibilityStatus::Unknown;
+    game = &(games_[title_id] = std::move(info));
+  }
+  game->last_updated =
+      std::chrono::system_clock::now().time_since_epoch().count();
+  auto fix_it = std::find_if(
+      game->fixes.begin(), game->fixes.end(), [&](const GameFix& fix) {
+        return fix.type == FixType::ForceSettings &&
+               fix.description == description;
+      });
+  if (fix_it == game->fixes.end()) {
+    GameFix fix;
+    fix.type = FixType::ForceSettings;
+    fix.description = description;
+    fix.enabled = true;
+    fix.priority = 0;
+    fix_it = game->fixes.insert(game->fixes.end(), std::move(fix));
+  }
+  fix_it->settings = settings;
+}
+
+void GameCompatibilityDatabase::DetachBinaryFile() {
+  for (uint32_t i = 0; i < binary_game_count_; ++i) {
+    GetMutableGame(binary_games_[i].title_id);
   }
+  binary_games_ = nullptr;
+  binary_game_count_ = 0;
+  binary_strings_ = nullptr;
+  binary_strings_size_ = 0;
+  binary_details_ = nullptr;
+  binary_details_size_ = 0;
+  binary_file_.reset();
 }
 
 std::vector<uint32_t> GameCompatibilityDatabase::GetGamesByStatus(
     CompatibilityStatus status) const {
   std::vector<uint32_t> result;
-  for (const auto& pair : games_) {
-    if (pair.second.status == status) {
-      result.push_back(pair.first);
+  for (uint32_t title_id : GetTitleIds()) {
+    if (GetStatus(title_id) == status) {
+      result.push_back(title_id);
     }
   }
   return result;
@@ -472,17 +846,199 @@ std::vector<uint32_t> GameCompatibilityDatabase::GetGamesByStatus(
 
 std::vector<GameInfo> GameCompatibilityDatabase::GetProblematicGames() const {
   std::vector<GameInfo> result;
-  for (const auto& pair : games_) {
-    if (pair.second.status == CompatibilityStatus::Broken ||
-        pair.second.status == CompatibilityStatus::Loads ||
-        !pair.second.known_issues.empty()) {
-      result.push_back(pair.second);
+  for (uint32_t title_id : GetTitleIds()) {
+    GameInfo info = GetGameInfo(title_id);
+    if (info.status == CompatibilityStatus::Broken ||
+        info.status == CompatibilityStatus::Loads ||
+        !info.known_issues.empty()) {
+      result.push_back(std::move(info));
     }
   }
   return result;
 }
 
+GameInfo* GameCompatibilityDatabase::GetMutableGame(uint32_t title_id) {
+  auto it = games_.find(title_id);
+  if (it != games_.end()) {
+    return &it->second;
+  }
+  const BinaryGameEntry* binary_game = FindBinaryGame(title_id);
+  if (!binary_game) {
+    return nullptr;
+  }
+  GameInfo info;
+  if (!ReadBinaryGame(*binary_game, info)) {
+    return nullptr;
+  }
+  return &(games_[title_id] = std::move(info));
+}
+
+std::vector<uint32_t> GameCompatibilityDatabase::GetTitleIds() const {
+  std::vector<uint32_t> title_ids;
+  title_ids.reserve(games_.size() + binary_game_count_);
+  for (const auto& pair : games_) {
+    title_ids.push_back(pair.first);
+  }
+  for (uint32_t i = 0; i < binary_game_count_; ++i) {
+    title_ids.push_back(binary_games_[i].title_id);
+  }
+  std::sort(title_ids.begin(), title_ids.end());
+  title_ids.erase(std::unique(title_ids.begin(), title_ids.end()),
+                  title_ids.end());
+  return title_ids;
+}
+
+const GameCompatibilityDatabase::BinaryGameEntry*
+GameCompatibilityDatabase::FindBinaryGame(uint32_t title_id) const {
+  const BinaryGameEntry* end = binary_games_ + binary_game_count_;
+  const BinaryGameEntry* it = std::lower_bound(
+      binary_games_, end, title_id,
+      [](const BinaryGameEntry& entry, uint32_t value) {
+        return entry.title_id < value;
+      });
+  if (it == end || it->title_id != title_id) {
+    return nullptr;
+  }
+  return it;
+}
+
+bool GameCompatibilityDatabase::ReadBinaryGame(const BinaryGameEntry& entry,
+                                               GameInfo& info) const {
+  // The offsets of the entries are checked when loading.
+  info.title_id = entry.title_id;
+  info.status = CompatibilityStatus(entry.status);
+  info.title_name.assign(binary_strings_ + entry.title_name_offset,
+                         entry.title_name_length);
+  BinaryDetailsReader reader(binary_details_ + entry.details_offset,
+                             entry.details_size, binary_strings_,
+                             binary_strings_size_);
+  ReadBinaryGameDetails(reader, info);
+  if (!reader.ok()) {
+    XELOGW("Compatibility database entry for title {:08X} is corrupted",
+           entry.title_id);
+    return false;
+  }
+  return true;
+}
+
+bool GameCompatibilityDatabase::LoadBinaryFile(
+    std::unique_ptr<MappedMemory> file) {
+  BinaryHeader header;
+  std::memcpy(&header, file->data(), sizeof(header));
+  size_t file_size = file->size();
+  size_t entries_size = sizeof(BinaryGameEntry) * size_t(header.game_count);
+  if (header.version != BinaryHeader::kVersion ||
+      (file_size - sizeof(header)) / sizeof(BinaryGameEntry) <
+          header.game_count ||
+      header.strings_offset < sizeof(header) + entries_size ||
+      header.strings_offset > file_size ||
+      file_size - header.strings_offset < header.strings_size ||
+      header.details_offset > file_size ||
+      file_size - header.details_offset < header.details_size) {
+    XELOGW("Compatibility database header is corrupted");
+    return false;
+  }
+  auto games = reinterpret_cast<const BinaryGameEntry*>(file->data() +
+                                                        sizeof(header));
+  for (uint32_t i = 0; i < header.game_count; ++i) {
+    const BinaryGameEntry& entry = games[i];
+    if ((i && games[i - 1].title_id >= entry.title_id) ||
+        entry.title_name_offset > header.strings_size ||
+        header.strings_size - entry.title_name_offset <
+            entry.title_name_length ||
+        entry.details_offset > header.details_size ||
+        header.details_size - entry.details_offset < entry.details_size) {
+      XELOGW("Compatibility database game entry {} is corrupted", i);
+      return false;
+    }
+  }
+
+  binary_file_ = std::move(file);
+  binary_games_ = games;
+  binary_game_count_ = header.game_count;
+  binary_strings_ = reinterpret_cast<const char*>(binary_file_->data()) +
+                    header.strings_offset;
+  binary_strings_size_ = header.strings_size;
+  binary_details_ = binary_file_->data() + header.details_offset;
+  binary_details_size_ = header.details_size;
+  // The file replaces the built-in entries, but games added or changed later
+  // are still looked up in games_ first.
+  for (uint32_t i = 0; i < binary_game_count_; ++i) {
+    games_.erase(binary_games_[i].title_id);
+  }
+  return true;
+}
+
+bool GameCompatibilityDatabase::SaveBinaryFile(const std::string& path) const {
+  std::vector<uint32_t> title_ids = GetTitleIds();
+  std::vector<BinaryGameEntry> entries;
+  entries.reserve(title_ids.size());
+  BinaryDetailsWriter writer;
+  for (uint32_t title_id : title_ids) {
+    GameInfo info = GetGameInfo(title_id);
+    BinaryGameEntry entry;
+    entry.title_id = title_id;
+    entry.status = uint32_t(info.status);
+    entry.title_name_offset = writer.AddString(info.title_name);
+    entry.title_name_length = uint32_t(info.title_name.size());
+    size_t details_offset = writer.details().size();
+    WriteBinaryGameDetails(writer, info);
+    entry.details_offset = uint32_t(details_offset);
+    entry.details_size = uint32_t(writer.details().size() - details_offset);
+    entries.push_back(entry);
+  }
+
+  BinaryHeader header;
+  header.magic = BinaryHeader::kMagic;
+  header.version = BinaryHeader::kVersion;
+  header.game_count = uint32_t(entries.size());
+  header.strings_offset =
+      uint32_t(sizeof(header) + sizeof(BinaryGameEntry) * entries.size());
+  header.strings_size = uint32_t(writer.strings().size());
+  header.details_offset = header.strings_offset + header.strings_size;
+  header.details_size = uint32_t(writer.details().size());
+  header.reserved = 0;
+
+  FILE* file = xe::filesystem::OpenFile(xe::to_path(path), "wb");
+  if (!file) {
+    XELOGW("Failed to save compatibility database to: {}", path);
+    return false;
+  }
+  bool written =
+      fwrite(&header, sizeof(header), 1, file) == 1 &&
+      fwrite(entries.data(), sizeof(BinaryGameEntry), entries.size(), file) ==
+          entries.size() &&
+      fwrite(writer.strings().data(), 1, writer.strings().size(), file) ==
+          writer.strings().size() &&
+      fwrite(writer.details().data(), 1, writer.details().size(), file) ==
+          writer.details().size();
+  fclose(file);
+  if (!written) {
+    XELOGW("Failed to write compatibility database to: {}", path);
+    return false;
+  }
+  XELOGI("Compatibility database with {} games saved to: {}", entries.size(),
+         path);
+  return true;
+}
+
 bool GameCompatibilityDatabase::LoadFromFile(const std::string& path) {
+  auto mapping =
+      MappedMemory::Open(xe::to_path(path), MappedMemory::Mode::kRead);
+  if (mapping && mapping->size() >= sizeof(BinaryHeader)) {
+    uint32_t magic;
+    std::memcpy(&magic, mapping->data(), sizeof(magic));
+    if (magic == BinaryHeader::kMagic) {
+      if (!LoadBinaryFile(std::move(mapping))) {
+        return false;
+      }
+      XELOGI("Mapped compatibility database with {} games from: {}",
+             binary_game_count_, path);
+      return true;
+    }
+  }
+  mapping.reset();
+
   std::ifstream file(path);
   if (!file.is_open()) {
     XELOGW("Failed to load compatibility database from: {}", path);
@@ -506,8 +1062,8 @@ bool GameCompatibilityDatabase::SaveToFile(const std::string& path) {
   file << "# Xenia Game Compatibility Database\n";
   file << "# Generated: " << std::chrono::system_clock::now().time_since_epoch().count() << "\n\n";
 
-  for (const auto& pair : games_) {
-    const auto& game = pair.second;
+  for (uint32_t title_id : GetTitleIds()) {
+    GameInfo game = GetGameInfo(title_id);
     file << fmt::format("[{:08X}]\n", game.title_id);
     file << "Name=" << game.title_name << "\n";
     file << "Status=" << static_cast<int>(game.status) << "\n";
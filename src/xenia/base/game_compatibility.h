@@ -12,10 +12,13 @@
 
 #include <cstdint>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include <set>
 
+#include "xenia/base/mapped_memory.h"
+
 namespace xe {
 namespace game_compatibility {
 
@@ -85,6 +88,9 @@ struct CPUConfig {
   std::set<uint32_t> blacklisted_addresses;
   std::map<uint32_t, uint32_t> code_patches;  // address -> replacement
   std::set<std::string> disabled_functions;
+  // Overrides spin_loop_yield_iterations unless set by the game config, -1 to
+  // keep it.
+  int32_t spin_loop_yield_iterations = -1;
 };
 
 // A specific fix/workaround
@@ -98,6 +104,9 @@ struct GameFix {
   MemoryConfig memory_config;
   GraphicsConfig graphics_config;
   CPUConfig cpu_config;
+  // For ForceSettings, config variable names and their values in the TOML
+  // syntax, applied unless set in the game config.
+  std::map<std::string, std::string> settings;
 };
 
 // Information about a specific game
@@ -124,9 +133,14 @@ class GameCompatibilityDatabase {
   void Initialize();
   void Shutdown();
 
-  // Load/save external database
+  // Load/save external database. Binary databases are mapped and queried in
+  // place rather than loaded, and replace the built-in entries for the same
+  // titles.
   bool LoadFromFile(const std::string& path);
   bool SaveToFile(const std::string& path);
+  // Writes the whole database in the binary format, with the titles sorted by
+  // ID and the strings in a shared pool.
+  bool SaveBinaryFile(const std::string& path) const;
 
   // Load from community sources
   bool UpdateFromURL(const std::string& url);
@@ -146,9 +160,17 @@ class GameCompatibilityDatabase {
   void UpdateStatus(uint32_t title_id, CompatibilityStatus status);
   void AddIssue(uint32_t title_id, IssueType issue);
   void AddFix(uint32_t title_id, const GameFix& fix);
+  // Replaces the ForceSettings fix with the same description, or adds one,
+  // adding the game if it's not in the database yet.
+  void SetSettingsFix(uint32_t title_id, const std::string& title_name,
+                      const std::string& description,
+                      const std::map<std::string, std::string>& settings);
+  // Copies all the games from the mapped binary database and unmaps it, so the
+  // file can be overwritten.
+  void DetachBinaryFile();
 
   // Statistics
-  size_t GetGameCount() const { return games_.size(); }
+  size_t GetGameCount() const { return GetTitleIds().size(); }
   std::vector<uint32_t> GetGamesByStatus(CompatibilityStatus status) const;
 
   // Get all games with issues
@@ -167,7 +189,29 @@ class GameCompatibilityDatabase {
                          CompatibilityStatus status);
   void AddBuiltInFixes();
 
+  struct BinaryHeader;
+  struct BinaryGameEntry;
+
+  bool LoadBinaryFile(std::unique_ptr<MappedMemory> file);
+  const BinaryGameEntry* FindBinaryGame(uint32_t title_id) const;
+  bool ReadBinaryGame(const BinaryGameEntry& entry, GameInfo& info) const;
+  // Copies the game from the binary database to games_ to change it.
+  GameInfo* GetMutableGame(uint32_t title_id);
+  // Sorted IDs of all the titles in both games_ and the binary database.
+  std::vector<uint32_t> GetTitleIds() const;
+
+  // Games added at runtime, or copied from the binary database when changed,
+  // taking precedence over the binary database.
   std::map<uint32_t, GameInfo> games_;
+
+  std::unique_ptr<MappedMemory> binary_file_;
+  const BinaryGameEntry* binary_games_ = nullptr;
+  uint32_t binary_game_count_ = 0;
+  const char* binary_strings_ = nullptr;
+  uint32_t binary_strings_size_ = 0;
+  const uint8_t* binary_details_ = nullptr;
+  uint32_t binary_details_size_ = 0;
+
   bool initialized_ = false;
 };
 
@@ -0,0 +1,223 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/input_latency.h"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/profiling.h"
+
+DEFINE_bool(input_latency_tracking, false,
+            "Measure the latency from new controller input reaching the "
+            "emulator to the guest frame using it being presented, reported "
+            "in the profiler counters and in the log.",
+            "HID");
+
+namespace xe {
+namespace input_latency {
+
+namespace {
+
+constexpr uint32_t kUserCount = 4;
+// Inputs in the window the percentiles are calculated for.
+constexpr size_t kSampleCount = 256;
+// Swapped frames not presented yet - older ones are dropped to bound the
+// memory usage if presentation has stopped.
+constexpr size_t kMaxPendingFrames = 8;
+constexpr size_t kMaxInputsPerFrame = 16;
+
+struct InputRead {
+  uint64_t received_tick;
+  uint64_t read_tick;
+};
+
+struct Frame {
+  uint64_t swap;
+  uint64_t swap_tick;
+  std::vector<InputRead> inputs;
+};
+
+// Latencies in microseconds.
+struct Sample {
+  uint64_t total;
+  uint64_t received_to_read;
+  uint64_t read_to_swap;
+  uint64_t swap_to_present;
+};
+
+struct User {
+  bool received_valid = false;
+  uint32_t received_packet = 0;
+  uint64_t received_tick = 0;
+  bool read_valid = false;
+  uint32_t read_packet = 0;
+};
+
+struct Tracker {
+  std::mutex mutex;
+  User users[kUserCount];
+  std::vector<InputRead> unswapped_inputs;
+  std::deque<Frame> frames;
+  uint64_t last_swap = 0;
+  // Ring of the latest samples.
+  Sample samples[kSampleCount];
+  size_t sample_count = 0;
+  size_t next_sample = 0;
+  size_t samples_since_log = 0;
+};
+
+Tracker& GetTracker() {
+  static Tracker tracker;
+  return tracker;
+}
+
+uint64_t TicksToMicroseconds(uint64_t ticks) {
+  return ticks * 1000000 / Clock::QueryHostTickFrequency();
+}
+
+uint64_t GetPercentile(std::vector<uint64_t>& values, size_t percent) {
+  auto nth = values.begin() + (values.size() - 1) * percent / 100;
+  std::nth_element(values.begin(), nth, values.end());
+  return *nth;
+}
+
+void ReportSamples(Tracker& tracker) {
+  std::vector<uint64_t> values(tracker.sample_count);
+  auto fill_values = [&](uint64_t Sample::*member) {
+    for (size_t i = 0; i < tracker.sample_count; ++i) {
+      values[i] = tracker.samples[i].*member;
+    }
+  };
+  fill_values(&Sample::total);
+  uint64_t p50 = GetPercentile(values, 50);
+  uint64_t p90 = GetPercentile(values, 90);
+  uint64_t p99 = GetPercentile(values, 99);
+  uint64_t max = *std::max_element(values.begin(), values.end());
+  fill_values(&Sample::received_to_read);
+  uint64_t received_to_read = GetPercentile(values, 50);
+  fill_values(&Sample::read_to_swap);
+  uint64_t read_to_swap = GetPercentile(values, 50);
+  fill_values(&Sample::swap_to_present);
+  uint64_t swap_to_present = GetPercentile(values, 50);
+
+  COUNT_profile_set("hid/input_latency/p50_us", p50);
+  COUNT_profile_set("hid/input_latency/p90_us", p90);
+  COUNT_profile_set("hid/input_latency/p99_us", p99);
+  COUNT_profile_set("hid/input_latency/max_us", max);
+  COUNT_profile_set("hid/input_latency/received_to_read_p50_us",
+                    received_to_read);
+  COUNT_profile_set("hid/input_latency/read_to_swap_p50_us", read_to_swap);
+  COUNT_profile_set("hid/input_latency/swap_to_present_p50_us",
+                    swap_to_present);
+
+  if (tracker.samples_since_log >= kSampleCount) {
+    tracker.samples_since_log = 0;
+    XELOGI(
+        "Input latency over the last {} inputs: p50 {} us, p90 {} us, p99 {} "
+        "us, max {} us; medians: received to read {} us, read to swap {} us, "
+        "swap to present {} us",
+        tracker.sample_count, p50, p90, p99, max, received_to_read,
+        read_to_swap, swap_to_present);
+  }
+}
+
+}  // namespace
+
+void OnInputReceived(uint32_t user_index, uint32_t packet_number) {
+  if (user_index >= kUserCount) {
+    return;
+  }
+  Tracker& tracker = GetTracker();
+  std::lock_guard<std::mutex> lock(tracker.mutex);
+  User& user = tracker.users[user_index];
+  if (user.received_valid && user.received_packet == packet_number) {
+    return;
+  }
+  user.received_valid = true;
+  user.received_packet = packet_number;
+  user.received_tick = Clock::QueryHostTickCount();
+}
+
+void OnInputRead(uint32_t user_index, uint32_t packet_number) {
+  if (user_index >= kUserCount) {
+    return;
+  }
+  Tracker& tracker = GetTracker();
+  std::lock_guard<std::mutex> lock(tracker.mutex);
+  User& user = tracker.users[user_index];
+  if (user.read_valid && user.read_packet == packet_number) {
+    return;
+  }
+  user.read_valid = true;
+  user.read_packet = packet_number;
+  if (user.received_valid && user.received_packet == packet_number &&
+      tracker.unswapped_inputs.size() < kMaxInputsPerFrame) {
+    tracker.unswapped_inputs.push_back(
+        {user.received_tick, Clock::QueryHostTickCount()});
+  }
+}
+
+uint64_t OnGuestSwap() {
+  Tracker& tracker = GetTracker();
+  std::lock_guard<std::mutex> lock(tracker.mutex);
+  ++tracker.last_swap;
+  if (!tracker.unswapped_inputs.empty()) {
+    if (tracker.frames.size() >= kMaxPendingFrames) {
+      tracker.frames.pop_front();
+    }
+    Frame& frame = tracker.frames.emplace_back();
+    frame.swap = tracker.last_swap;
+    frame.swap_tick = Clock::QueryHostTickCount();
+    frame.inputs.swap(tracker.unswapped_inputs);
+  }
+  return tracker.last_swap;
+}
+
+uint64_t GetLastGuestSwap() {
+  Tracker& tracker = GetTracker();
+  std::lock_guard<std::mutex> lock(tracker.mutex);
+  return tracker.last_swap;
+}
+
+void OnGuestOutputPresented(uint64_t last_swap) {
+  Tracker& tracker = GetTracker();
+  std::lock_guard<std::mutex> lock(tracker.mutex);
+  if (tracker.frames.empty() || tracker.frames.front().swap > last_swap) {
+    return;
+  }
+  uint64_t present_tick = Clock::QueryHostTickCount();
+  // Frames replaced in the mailbox before being presented are shown by the
+  // newer one.
+  while (!tracker.frames.empty() && tracker.frames.front().swap <= last_swap) {
+    const Frame& frame = tracker.frames.front();
+    for (const InputRead& input : frame.inputs) {
+      Sample& sample = tracker.samples[tracker.next_sample];
+      sample.total = TicksToMicroseconds(present_tick - input.received_tick);
+      sample.received_to_read =
+          TicksToMicroseconds(input.read_tick - input.received_tick);
+      sample.read_to_swap =
+          TicksToMicroseconds(frame.swap_tick - input.read_tick);
+      sample.swap_to_present =
+          TicksToMicroseconds(present_tick - frame.swap_tick);
+      tracker.next_sample = (tracker.next_sample + 1) % kSampleCount;
+      tracker.sample_count = std::min(tracker.sample_count + 1, kSampleCount);
+      ++tracker.samples_since_log;
+    }
+    tracker.frames.pop_front();
+  }
+  ReportSamples(tracker);
+}
+
+}  // namespace input_latency
+}  // namespace xe
@@ -0,0 +1,45 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_INPUT_LATENCY_H_
+#define XENIA_BASE_INPUT_LATENCY_H_
+
+#include <cstdint>
+
+#include "xenia/base/cvar.h"
+
+DECLARE_bool(input_latency_tracking);
+
+namespace xe {
+namespace input_latency {
+
+// Measures the time from a new controller state (a new packet number) being
+// received from the host by the input system, through the guest reading it and
+// issuing a swap, to the frame from that swap being presented on the host. The
+// percentiles are reported as profiler counters and periodically logged.
+// The hooks do nothing unless input_latency_tracking is enabled.
+
+inline bool IsEnabled() { return cvars::input_latency_tracking; }
+
+// The input system got the state with the packet number from the drivers.
+void OnInputReceived(uint32_t user_index, uint32_t packet_number);
+// The state with the packet number has been returned to the guest.
+void OnInputRead(uint32_t user_index, uint32_t packet_number);
+// The guest has issued a swap, the inputs read since the previous one are
+// attributed to its frame. Returns the identifier of the swap.
+uint64_t OnGuestSwap();
+// Identifier of the latest swap, to pass to OnGuestOutputPresented once the
+// guest output available now has been presented.
+uint64_t GetLastGuestSwap();
+void OnGuestOutputPresented(uint64_t last_swap);
+
+}  // namespace input_latency
+}  // namespace xe
+
+#endif  // XENIA_BASE_INPUT_LATENCY_H_
@@ -0,0 +1,184 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/lock_profiling.h"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/cvar.h"
+
+DEFINE_bool(profile_locks, false,
+            "Record how long threads wait for the contended host locks and "
+            "for guest synchronization objects, per lock and per call site. "
+            "The statistics are reset when a profiler trace capture starts, "
+            "written next to the trace when it ends, and logged on shutdown.",
+            "General");
+
+namespace xe {
+namespace lock_profiling {
+
+namespace {
+
+struct LockRecord {
+  uint64_t wait_count = 0;
+  uint64_t wait_us = 0;
+  uint64_t max_wait_us = 0;
+  uint64_t histogram[kHistogramBucketCount] = {};
+  // By "file:line".
+  std::map<std::string, std::pair<uint64_t, uint64_t>> call_sites;
+};
+
+struct Profiler {
+  std::mutex mutex;
+  std::map<std::string, LockRecord> locks;
+};
+
+Profiler& GetProfiler() {
+  static Profiler profiler;
+  return profiler;
+}
+
+std::string EscapeJsonString(const std::string_view str) {
+  std::string escaped;
+  escaped.reserve(str.size());
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      escaped.push_back('\\');
+      escaped.push_back(c);
+    } else if (uint8_t(c) < 0x20) {
+      escaped.append(fmt::format("\\u{:04x}", uint8_t(c)));
+    } else {
+      escaped.push_back(c);
+    }
+  }
+  return escaped;
+}
+
+}  // namespace
+
+bool IsEnabled() { return cvars::profile_locks; }
+
+void RecordWait(const char* lock_name, const char* file, uint32_t line,
+                uint64_t wait_host_ticks) {
+  // Dividing the whole and the fractional seconds separately to avoid
+  // overflowing with long waits.
+  uint64_t tick_frequency = Clock::QueryHostTickFrequency();
+  uint64_t wait_us =
+      wait_host_ticks / tick_frequency * 1000000 +
+      wait_host_ticks % tick_frequency * 1000000 / tick_frequency;
+  size_t bucket = 0;
+  while (bucket + 1 < kHistogramBucketCount &&
+         wait_us >= (uint64_t(1) << bucket)) {
+    ++bucket;
+  }
+  std::string location =
+      file ? std::string(file) + ':' + std::to_string(line) : "unknown";
+  Profiler& profiler = GetProfiler();
+  std::lock_guard<std::mutex> lock(profiler.mutex);
+  LockRecord& record = profiler.locks[lock_name];
+  ++record.wait_count;
+  record.wait_us += wait_us;
+  record.max_wait_us = std::max(record.max_wait_us, wait_us);
+  ++record.histogram[bucket];
+  std::pair<uint64_t, uint64_t>& call_site = record.call_sites[location];
+  ++call_site.first;
+  call_site.second += wait_us;
+}
+
+std::vector<LockStatistics> GetStatistics() {
+  std::vector<LockStatistics> statistics;
+  {
+    Profiler& profiler = GetProfiler();
+    std::lock_guard<std::mutex> lock(profiler.mutex);
+    statistics.reserve(profiler.locks.size());
+    for (const auto& [name, record] : profiler.locks) {
+      LockStatistics& lock_statistics = statistics.emplace_back();
+      lock_statistics.name = name;
+      lock_statistics.wait_count = record.wait_count;
+      lock_statistics.wait_us = record.wait_us;
+      lock_statistics.max_wait_us = record.max_wait_us;
+      std::copy(std::begin(record.histogram), std::end(record.histogram),
+                lock_statistics.histogram);
+      lock_statistics.call_sites.reserve(record.call_sites.size());
+      for (const auto& [location, call_site] : record.call_sites) {
+        lock_statistics.call_sites.push_back(
+            {location, call_site.first, call_site.second});
+      }
+    }
+  }
+  for (LockStatistics& lock_statistics : statistics) {
+    std::stable_sort(
+        lock_statistics.call_sites.begin(), lock_statistics.call_sites.end(),
+        [](const CallSiteStatistics& a, const CallSiteStatistics& b) {
+          return a.wait_us > b.wait_us;
+        });
+  }
+  std::stable_sort(statistics.begin(), statistics.end(),
+                   [](const LockStatistics& a, const LockStatistics& b) {
+                     return a.wait_us > b.wait_us;
+                   });
+  return statistics;
+}
+
+void Reset() {
+  Profiler& profiler = GetProfiler();
+  std::lock_guard<std::mutex> lock(profiler.mutex);
+  profiler.locks.clear();
+}
+
+std::string FormatStatisticsJson() {
+  std::vector<LockStatistics> statistics = GetStatistics();
+  std::string json = "{\n  \"locks\": [";
+  for (size_t i = 0; i < statistics.size(); ++i) {
+    const LockStatistics& lock_statistics = statistics[i];
+    json += fmt::format(
+        "{}\n    {{\"name\": \"{}\", \"wait_count\": {}, \"wait_us\": {}, "
+        "\"max_wait_us\": {}, \"histogram_log2_us\": [",
+        i ? "," : "", EscapeJsonString(lock_statistics.name),
+        lock_statistics.wait_count, lock_statistics.wait_us,
+        lock_statistics.max_wait_us);
+    for (size_t j = 0; j < kHistogramBucketCount; ++j) {
+      json += fmt::format("{}{}", j ? ", " : "", lock_statistics.histogram[j]);
+    }
+    json += "], \"call_sites\": [";
+    for (size_t j = 0; j < lock_statistics.call_sites.size(); ++j) {
+      const CallSiteStatistics& call_site = lock_statistics.call_sites[j];
+      json += fmt::format(
+          "{}\n      {{\"location\": \"{}\", \"wait_count\": {}, "
+          "\"wait_us\": {}}}",
+          j ? "," : "", EscapeJsonString(call_site.location),
+          call_site.wait_count, call_site.wait_us);
+    }
+    json += "]}";
+  }
+  json += "\n  ]\n}\n";
+  return json;
+}
+
+ScopedWait::ScopedWait(const char* lock_name, const char* file,
+                       uint32_t line)
+    : lock_name_(lock_name), file_(file), line_(line), start_tick_(0) {
+  if (IsEnabled()) {
+    start_tick_ = Clock::QueryHostTickCount();
+  }
+}
+
+ScopedWait::~ScopedWait() {
+  if (!start_tick_) {
+    return;
+  }
+  RecordWait(lock_name_, file_, line_,
+             Clock::QueryHostTickCount() - start_tick_);
+}
+
+}  // namespace lock_profiling
+}  // namespace xe
@@ -0,0 +1,106 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_LOCK_PROFILING_H_
+#define XENIA_BASE_LOCK_PROFILING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "xenia/base/clock.h"
+
+namespace xe {
+namespace lock_profiling {
+
+// Records how long threads wait for host locks and guest synchronization
+// objects, per lock and per call site, when the profile_locks option is
+// enabled. Host locks are only measured when they're contended, so that
+// uncontended acquisitions stay cheap.
+
+// Bucket i contains the waits shorter than 2^i microseconds, and longer than
+// the previous bucket, except for the last, which contains all the longer ones.
+constexpr size_t kHistogramBucketCount = 20;
+
+struct CallSiteStatistics {
+  // "file:line".
+  std::string location;
+  uint64_t wait_count;
+  uint64_t wait_us;
+};
+
+struct LockStatistics {
+  std::string name;
+  uint64_t wait_count;
+  uint64_t wait_us;
+  uint64_t max_wait_us;
+  uint64_t histogram[kHistogramBucketCount];
+  // In the descending order of the total waiting time.
+  std::vector<CallSiteStatistics> call_sites;
+};
+
+bool IsEnabled();
+
+void RecordWait(const char* lock_name, const char* file, uint32_t line,
+                uint64_t wait_host_ticks);
+
+// In the descending order of the total waiting time.
+std::vector<LockStatistics> GetStatistics();
+void Reset();
+// The statistics as a JSON object.
+std::string FormatStatisticsJson();
+
+// Acquires the mutex, measuring the wait if it's contended. The default
+// arguments are evaluated at the call site.
+template <typename Mutex>
+std::unique_lock<Mutex> Acquire(Mutex& mutex, const char* lock_name,
+                                const char* file = __builtin_FILE(),
+                                uint32_t line = __builtin_LINE());
+
+// Measures the time until the end of the scope as a wait, for blocking waits
+// that are always of interest, such as guest waits for kernel objects.
+class ScopedWait {
+ public:
+  explicit ScopedWait(const char* lock_name,
+                      const char* file = __builtin_FILE(),
+                      uint32_t line = __builtin_LINE());
+  ~ScopedWait();
+  ScopedWait(const ScopedWait&) = delete;
+  ScopedWait& operator=(const ScopedWait&) = delete;
+
+ private:
+  const char* lock_name_;
+  const char* file_;
+  uint32_t line_;
+  // 0 if not measuring.
+  uint64_t start_tick_;
+};
+
+template <typename Mutex>
+std::unique_lock<Mutex> Acquire(Mutex& mutex, const char* lock_name,
+                                const char* file, uint32_t line) {
+  if (!IsEnabled()) {
+    return std::unique_lock<Mutex>(mutex);
+  }
+  std::unique_lock<Mutex> lock(mutex, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    uint64_t start_tick = Clock::QueryHostTickCount();
+    lock.lock();
+    RecordWait(lock_name, file, line,
+               Clock::QueryHostTickCount() - start_tick);
+  }
+  return lock;
+}
+
+}  // namespace lock_profiling
+}  // namespace xe
+
+#endif  // XENIA_BASE_LOCK_PROFILING_H_
@@ -22,6 +22,7 @@
 #include "third_party/disruptorplus/include/disruptorplus/spin_wait_strategy.hpp"
 #include "xenia/base/assert.h"
 #include "xenia/base/atomic.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/console.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/debugging.h"
@@ -53,8 +54,19 @@ DEFINE_path(log_file, "", "Logs are written to the given file", "Logging");
 DEFINE_bool(log_to_stdout, true, "Write log output to stdout", "Logging");
 DEFINE_bool(log_to_debugprint, false, "Dump the log to DebugPrint.", "Logging");
 #endif  // XE_PLATFORM_ANDROID
-DEFINE_bool(flush_log, true, "Flush log file after each log line batch.",
+DEFINE_bool(flush_log, true,
+            "Flush the log file once all the pending lines have been written, "
+            "not after every line while more lines are waiting.",
             "Logging");
+DEFINE_bool(log_deferred_formatting, true,
+            "Copy the arguments of log lines and format them on the logging "
+            "thread rather than on the thread that logs.",
+            "Logging");
+DEFINE_uint32(log_max_lines_per_second, 0,
+              "Maximum number of lines with the same format string logged per "
+              "second, with the rest dropped, not limiting errors. 0 for no "
+              "limit.",
+              "Logging");
 DEFINE_int32(
     log_level, 2,
     "Maximum level to be logged. (0=error, 1=warning, 2=info, 3=debug)",
@@ -72,13 +84,23 @@ Logger* logger_ = nullptr;
 struct LogLine {
   size_t buffer_length;
   uint32_t thread_id;
-  uint16_t _pad_0;  // (2b) padding
+  // The buffer is a logging::internal::DeferredLogLineHeader record.
+  bool deferred;
+  uint8_t _pad_0;  // (1b) padding
   bool terminate;
   char prefix_char;
 };
 
 thread_local char thread_log_buffer_[64_KiB];
 
+// Lossy table of call sites by the address of their format string.
+struct RateLimitSlot {
+  std::atomic<const char*> format{nullptr};
+  std::atomic<uint64_t> second{0};
+  std::atomic<uint32_t> line_count{0};
+};
+RateLimitSlot rate_limit_slots_[256];
+
 FileLogSink::~FileLogSink() {
   if (file_) {
     fflush(file_);
@@ -264,6 +286,14 @@ class Logger {
 
   std::unique_ptr<xe::threading::Thread> write_thread_;
 
+  // Lines being appended or not written yet, to flush only when there are no
+  // more lines waiting.
+  std::atomic<size_t> pending_line_count_{0};
+
+  // Used by the writer thread for deferred lines.
+  uint8_t deferred_record_[64_KiB];
+  char deferred_text_[64_KiB];
+
   void Write(const char* buf, size_t size) {
     for (const auto& sink : sinks_) {
       sink->Write(buf, size);
@@ -330,7 +360,9 @@ class Logger {
             Write(prefix, sizeof(prefix) - 1);
           }
 
-          if (line.buffer_length) {
+          if (line.deferred) {
+            WriteDeferredLine(rb, line.buffer_length);
+          } else if (line.buffer_length) {
             // Get access to the line data - which may be split in the ring
             // buffer - and write it out in parts.
             auto line_range = rb.BeginRead(line.buffer_length);
@@ -358,6 +390,8 @@ class Logger {
             Write(suffix, 1);
           }
 
+          pending_line_count_.fetch_sub(1, std::memory_order_relaxed);
+
           if (line.terminate) {
             terminate = true;
             break;
@@ -378,7 +412,8 @@ class Logger {
 
         desired_count = 1;
 
-        if (cvars::flush_log) {
+        if (cvars::flush_log &&
+            !pending_line_count_.load(std::memory_order_relaxed)) {
           for (const auto& sink : sinks_) {
             sink->Flush();
           }
@@ -396,10 +431,44 @@ class Logger {
     }
   }
 
+  void WriteDeferredLine(RingBuffer& rb, size_t record_length) {
+    assert_true(record_length >=
+                    sizeof(logging::internal::DeferredLogLineHeader) &&
+                record_length <= sizeof(deferred_record_));
+    rb.Read(deferred_record_, record_length);
+    logging::internal::DeferredLogLineHeader header;
+    std::memcpy(&header, deferred_record_, sizeof(header));
+    auto format = reinterpret_cast<const char*>(deferred_record_) +
+                  sizeof(header);
+    size_t text_length;
+    try {
+      text_length = std::min(
+          header.format_function(
+              format, header.format_length,
+              deferred_record_ + sizeof(header) + header.format_length,
+              deferred_text_, sizeof(deferred_text_)),
+          sizeof(deferred_text_));
+    } catch (const fmt::format_error&) {
+      // Would have been thrown on the calling thread without deferring.
+      text_length = std::min(header.format_length, sizeof(deferred_text_));
+      std::memcpy(deferred_text_, format, text_length);
+    }
+    if (text_length) {
+      Write(deferred_text_, text_length);
+    }
+    // Always ensure there is a newline.
+    if (!text_length || deferred_text_[text_length - 1] != '\n') {
+      const char suffix[1] = {'\n'};
+      Write(suffix, 1);
+    }
+  }
+
  public:
   void AppendLine(uint32_t thread_id, const char prefix_char,
                   const char* buffer_data, size_t buffer_length,
-                  bool terminate = false) {
+                  bool terminate = false, bool deferred = false) {
+    pending_line_count_.fetch_add(1, std::memory_order_relaxed);
+
     size_t count = BlockCount(sizeof(LogLine) + buffer_length);
 
     auto range = claim_strategy_.claim(count);
@@ -412,6 +481,7 @@ class Logger {
     LogLine line = {};
     line.buffer_length = buffer_length;
     line.thread_id = thread_id;
+    line.deferred = deferred;
     line.prefix_char = prefix_char;
     line.terminate = terminate;
 
@@ -485,6 +555,56 @@ void logging::internal::AppendLogLine(LogLevel log_level,
                       thread_log_buffer_, written);
 }
 
+bool logging::internal::IsRateLimited(LogLevel log_level,
+                                      const char* format) {
+  uint32_t max_lines = cvars::log_max_lines_per_second;
+  if (!max_lines || log_level == LogLevel::Error) {
+    return false;
+  }
+  RateLimitSlot& slot =
+      rate_limit_slots_[(reinterpret_cast<uintptr_t>(format) >> 2) %
+                        xe::countof(rate_limit_slots_)];
+  uint64_t second = Clock::QueryHostUptimeMillis() / 1000;
+  // Races between threads only make the limit approximate.
+  if (slot.format.load(std::memory_order_relaxed) != format ||
+      slot.second.load(std::memory_order_relaxed) != second) {
+    slot.format.store(format, std::memory_order_relaxed);
+    slot.second.store(second, std::memory_order_relaxed);
+    slot.line_count.store(1, std::memory_order_relaxed);
+    return false;
+  }
+  uint32_t line_count =
+      slot.line_count.fetch_add(1, std::memory_order_relaxed) + 1;
+  if (line_count <= max_lines) {
+    return false;
+  }
+  if (line_count == max_lines + 1) {
+    // The format string may not outlive the call, so it's reported now.
+    char note[256];
+    auto result = fmt::format_to_n(
+        note, sizeof(note),
+        "Dropping lines like \"{}\" for the rest of the second", format);
+    logging::AppendLogLine(
+        LogLevel::Warning, kPrefixCharWarning,
+        std::string_view(note, std::min(result.size, sizeof(note))));
+  }
+  return true;
+}
+
+bool logging::internal::IsDeferredFormattingEnabled() {
+  return cvars::log_deferred_formatting;
+}
+
+void logging::internal::AppendDeferredLogLine(LogLevel log_level,
+                                              const char prefix_char,
+                                              size_t written) {
+  if (!ShouldLog(log_level) || !written) {
+    return;
+  }
+  logger_->AppendLine(xe::threading::current_thread_id(), prefix_char,
+                      thread_log_buffer_, written, false, true);
+}
+
 void logging::AppendLogLine(LogLevel log_level, const char prefix_char,
                             const std::string_view str) {
   if (!ShouldLog(log_level) || !str.size()) {
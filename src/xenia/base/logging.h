@@ -12,7 +12,11 @@
 
 #include <cstdarg>
 #include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/string.h"
@@ -84,16 +88,170 @@ std::pair<char*, size_t> GetThreadBuffer();
 
 void AppendLogLine(LogLevel log_level, const char prefix_char, size_t written);
 
+// Whether the line should be dropped because too many lines with the same
+// format string have been logged in the last second.
+bool IsRateLimited(LogLevel log_level, const char* format);
+
+bool IsDeferredFormattingEnabled();
+
+// Appends a deferred line record written to the thread buffer, formatted on
+// the logging thread.
+void AppendDeferredLogLine(LogLevel log_level, const char prefix_char,
+                           size_t written);
+
+// Formats a deferred line record's arguments, returns the formatted length
+// without truncation.
+using DeferredFormatFunction = size_t (*)(const char* format,
+                                          size_t format_length,
+                                          const uint8_t* args, char* out,
+                                          size_t out_size);
+
+struct DeferredLogLineHeader {
+  DeferredFormatFunction format_function;
+  size_t format_length;
+  // Followed by the format string and the arguments.
+};
+
+// Arguments that can be copied into a deferred line record: arithmetic types
+// and pointers are stored as they are, and strings are copied after their
+// length, so the caller may free them right after logging.
+template <typename T, typename Enable = void>
+struct DeferredArg {
+  static constexpr bool kSupported = false;
+};
+
+template <typename T>
+struct DeferredArg<T, std::enable_if_t<std::is_arithmetic_v<T>>> {
+  static constexpr bool kSupported = true;
+  using Type = T;
+  static size_t Size(const T& value) { return sizeof(T); }
+  static uint8_t* Write(uint8_t* out, const T& value) {
+    std::memcpy(out, &value, sizeof(T));
+    return out + sizeof(T);
+  }
+  static T Read(const uint8_t*& in) {
+    T value;
+    std::memcpy(&value, in, sizeof(T));
+    in += sizeof(T);
+    return value;
+  }
+};
+
+template <>
+struct DeferredArg<const void*> : DeferredArg<uintptr_t> {
+  using Type = const void*;
+  static size_t Size(const void* value) { return sizeof(uintptr_t); }
+  static uint8_t* Write(uint8_t* out, const void* value) {
+    return DeferredArg<uintptr_t>::Write(out,
+                                         reinterpret_cast<uintptr_t>(value));
+  }
+  static const void* Read(const uint8_t*& in) {
+    return reinterpret_cast<const void*>(DeferredArg<uintptr_t>::Read(in));
+  }
+};
+
+template <>
+struct DeferredArg<void*> : DeferredArg<const void*> {};
+
+struct DeferredStringArg {
+  static constexpr bool kSupported = true;
+  using Type = std::string_view;
+  static size_t Size(std::string_view value) {
+    return sizeof(size_t) + value.size();
+  }
+  static uint8_t* Write(uint8_t* out, std::string_view value) {
+    out = DeferredArg<size_t>::Write(out, value.size());
+    std::memcpy(out, value.data(), value.size());
+    return out + value.size();
+  }
+  static std::string_view Read(const uint8_t*& in) {
+    size_t length = DeferredArg<size_t>::Read(in);
+    std::string_view value(reinterpret_cast<const char*>(in), length);
+    in += length;
+    return value;
+  }
+};
+
+template <>
+struct DeferredArg<std::string> : DeferredStringArg {};
+template <>
+struct DeferredArg<std::string_view> : DeferredStringArg {};
+// Null strings, which {fmt} throws for, are written as empty.
+template <>
+struct DeferredArg<const char*> : DeferredStringArg {
+  static size_t Size(const char* value) {
+    return DeferredStringArg::Size(value ? value : "");
+  }
+  static uint8_t* Write(uint8_t* out, const char* value) {
+    return DeferredStringArg::Write(out, value ? value : "");
+  }
+};
+template <>
+struct DeferredArg<char*> : DeferredArg<const char*> {};
+// Literals, formatted up to the terminator like by {fmt}.
+template <size_t N>
+struct DeferredArg<char[N]> : DeferredStringArg {};
+
+template <typename... Args>
+size_t FormatDeferredLogLine(const char* format, size_t format_length,
+                             const uint8_t* args, char* out, size_t out_size) {
+  // Braced initialization reads the arguments in order.
+  std::tuple<typename DeferredArg<Args>::Type...> values{
+      DeferredArg<Args>::Read(args)...};
+  return std::apply(
+      [&](const auto&... arg_values) {
+        return fmt::vformat_to_n(out, out_size,
+                                 fmt::string_view(format, format_length),
+                                 fmt::make_format_args(arg_values...))
+            .size;
+      },
+      values);
+}
+
+// Writes a deferred line record to the buffer, returns 0 if it doesn't fit.
+template <typename... Args>
+size_t WriteDeferredLogLine(char* buffer, size_t buffer_size,
+                            const char* format, const Args&... args) {
+  size_t format_length = std::strlen(format);
+  size_t size = sizeof(DeferredLogLineHeader) + format_length;
+  ((size += DeferredArg<Args>::Size(args)), ...);
+  if (size > buffer_size) {
+    return 0;
+  }
+  DeferredLogLineHeader header;
+  header.format_function = FormatDeferredLogLine<Args...>;
+  header.format_length = format_length;
+  auto out = reinterpret_cast<uint8_t*>(buffer);
+  std::memcpy(out, &header, sizeof(header));
+  out += sizeof(header);
+  std::memcpy(out, format, format_length);
+  out += format_length;
+  ((out = DeferredArg<Args>::Write(out, args)), ...);
+  return size;
+}
+
 }  // namespace internal
 
-// Appends a line to the log with {fmt}-style formatting.
+// Appends a line to the log with {fmt}-style formatting. If all the arguments
+// can be copied, they're formatted on the logging thread instead of the
+// calling one.
 template <typename... Args>
 void AppendLogLineFormat(LogLevel log_level, const char prefix_char,
                          const char* format, const Args&... args) {
-  if (!ShouldLog(log_level)) {
+  if (!ShouldLog(log_level) || internal::IsRateLimited(log_level, format)) {
     return;
   }
   auto target = internal::GetThreadBuffer();
+  if constexpr ((internal::DeferredArg<Args>::kSupported && ...)) {
+    if (internal::IsDeferredFormattingEnabled()) {
+      size_t written = internal::WriteDeferredLogLine(
+          target.first, target.second, format, args...);
+      if (written) {
+        internal::AppendDeferredLogLine(log_level, prefix_char, written);
+        return;
+      }
+    }
+  }
   auto result = fmt::format_to_n(target.first, target.second, format, args...);
   internal::AppendLogLine(log_level, prefix_char, result.size);
 }
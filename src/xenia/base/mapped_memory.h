@@ -59,6 +59,23 @@ class MappedMemory {
   // Changes the offset inside the file. This will update data() and size()!
   virtual bool Remap(size_t offset, size_t length) { return false; }
 
+  // Hints that the range will be accessed soon, so its pages can be read from
+  // the file in large requests ahead of the accesses instead of faulting one
+  // page at a time. If sequential, pages are also read further ahead and
+  // dropped sooner after they're accessed where supported. Works on slices.
+  void Prefetch(size_t offset, size_t length, bool sequential = false);
+
+  // Hints that the whole pages in the range of a read-only mapping won't be
+  // accessed again soon, so they can be removed from the working set of the
+  // process rather than competing with the memory the data has been copied
+  // to. Later accesses read them from the file again. Works on slices.
+  void Discard(size_t offset, size_t length);
+
+  // Number of page faults that required reading from the backing storage
+  // taken by the calling thread so far, for measuring the cost of accessing
+  // mappings, or 0 if not available on the platform.
+  static uint64_t GetThreadHardFaultCount();
+
  protected:
   void* data_;
   size_t size_;
@@ -11,11 +11,14 @@
 
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <algorithm>
 #include <memory>
 
 #include "xenia/base/filesystem.h"
+#include "xenia/base/memory.h"
 #include "xenia/base/platform.h"
 
 namespace xe {
@@ -107,6 +110,43 @@ std::unique_ptr<MappedMemory> MappedMemory::Open(
                                                length);
 }
 
+void MappedMemory::Prefetch(size_t offset, size_t length, bool sequential) {
+  if (!data_ || offset >= size_ || !length) {
+    return;
+  }
+  length = std::min(length, size_ - offset);
+  // madvise requires a page-aligned start.
+  uintptr_t start = uintptr_t(data() + offset);
+  uintptr_t aligned_start = start & ~uintptr_t(memory::page_size() - 1);
+  void* address = reinterpret_cast<void*>(aligned_start);
+  size_t aligned_length = length + (start - aligned_start);
+  if (sequential) {
+    madvise(address, aligned_length, MADV_SEQUENTIAL);
+  }
+  madvise(address, aligned_length, MADV_WILLNEED);
+}
+
+void MappedMemory::Discard(size_t offset, size_t length) {
+  if (!data_ || offset >= size_ || !length) {
+    return;
+  }
+  length = std::min(length, size_ - offset);
+  uintptr_t page_mask = uintptr_t(memory::page_size() - 1);
+  uintptr_t start = (uintptr_t(data() + offset) + page_mask) & ~page_mask;
+  uintptr_t end = uintptr_t(data() + offset + length) & ~page_mask;
+  if (start < end) {
+    madvise(reinterpret_cast<void*>(start), end - start, MADV_DONTNEED);
+  }
+}
+
+uint64_t MappedMemory::GetThreadHardFaultCount() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_THREAD, &usage)) {
+    return 0;
+  }
+  return uint64_t(usage.ru_majflt);
+}
+
 #if XE_PLATFORM_ANDROID
 std::unique_ptr<MappedMemory> MappedMemory::OpenForAndroidContentUri(
     const std::string_view uri, Mode mode, size_t offset, size_t length) {
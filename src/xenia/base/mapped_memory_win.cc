@@ -7,6 +7,7 @@
  ******************************************************************************
  */
 
+#include <algorithm>
 #include <memory>
 #include <mutex>
 #include <vector>
@@ -112,7 +113,9 @@ std::unique_ptr<MappedMemory> MappedMemory::Open(
   switch (mode) {
     case Mode::kRead:
       file_access |= GENERIC_READ;
-      file_share |= FILE_SHARE_READ;
+      // Files still being appended to, such as caches shared between emulator
+      // instances, may be mapped for reading too.
+      file_share |= FILE_SHARE_READ | FILE_SHARE_WRITE;
       create_mode |= OPEN_EXISTING;
       mapping_protect |= PAGE_READONLY;
       view_access |= FILE_MAP_READ;
@@ -194,6 +197,55 @@ std::unique_ptr<MappedMemory> MappedMemory::Open(
   return std::move(mm);
 }
 
+void MappedMemory::Prefetch(size_t offset, size_t length, bool sequential) {
+  if (!data_ || offset >= size_ || !length) {
+    return;
+  }
+  // PrefetchVirtualMemory is available since Windows 8. There's no equivalent
+  // of sequential access hints for views.
+  struct MemoryRangeEntry {
+    PVOID virtual_address;
+    SIZE_T number_of_bytes;
+  };
+  typedef BOOL(WINAPI * PrefetchVirtualMemoryFn)(HANDLE process,
+                                                 ULONG_PTR number_of_entries,
+                                                 MemoryRangeEntry* entries,
+                                                 ULONG flags);
+  static const auto prefetch_virtual_memory = []() {
+    HMODULE kernel = GetModuleHandleW(L"kernel32.dll");
+    return kernel ? reinterpret_cast<PrefetchVirtualMemoryFn>(
+                        GetProcAddress(kernel, "PrefetchVirtualMemory"))
+                  : nullptr;
+  }();
+  if (!prefetch_virtual_memory) {
+    return;
+  }
+  MemoryRangeEntry entry;
+  entry.virtual_address = data() + offset;
+  entry.number_of_bytes = std::min(length, size_ - offset);
+  prefetch_virtual_memory(GetCurrentProcess(), 1, &entry, 0);
+}
+
+void MappedMemory::Discard(size_t offset, size_t length) {
+  if (!data_ || offset >= size_ || !length) {
+    return;
+  }
+  length = std::min(length, size_ - offset);
+  uintptr_t page_mask = uintptr_t(memory::page_size() - 1);
+  uintptr_t start = (uintptr_t(data() + offset) + page_mask) & ~page_mask;
+  uintptr_t end = uintptr_t(data() + offset + length) & ~page_mask;
+  if (start < end) {
+    // Unlocking pages that aren't locked removes them from the working set
+    // (and fails with ERROR_NOT_LOCKED).
+    VirtualUnlock(reinterpret_cast<void*>(start), end - start);
+  }
+}
+
+uint64_t MappedMemory::GetThreadHardFaultCount() {
+  // Only process-wide fault counts that include soft faults are available.
+  return 0;
+}
+
 class Win32ChunkedMappedMemoryWriter : public ChunkedMappedMemoryWriter {
  public:
   Win32ChunkedMappedMemoryWriter(const std::filesystem::path& path,
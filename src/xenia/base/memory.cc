@@ -9,9 +9,12 @@
 
 #include "xenia/base/memory.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/math.h"
 #include "xenia/base/platform.h"
 
-#if XE_ARCH_ARM64
+#if XE_ARCH_AMD64
+#include "third_party/xbyak/xbyak/xbyak_util.h"
+#elif XE_ARCH_ARM64
 #include <arm_neon.h>
 #endif
 
@@ -31,9 +34,35 @@ bool IsWritableExecutableMemoryPreferred() {
          cvars::writable_executable_memory;
 }
 
+void ProtectionBatch::Add(void* base_address, size_t length,
+                          PageAccess access) {
+  if (!length) {
+    return;
+  }
+  auto address = reinterpret_cast<uint8_t*>(base_address);
+  if (!changes_.empty()) {
+    Change& last = changes_.back();
+    if (last.access == access && last.base_address + last.length == address) {
+      last.length += length;
+      return;
+    }
+  }
+  changes_.push_back({address, length, access});
+}
+
+bool ProtectionBatch::Apply() {
+  bool applied = true;
+  for (const Change& change : changes_) {
+    if (!Protect(change.base_address, change.length, change.access)) {
+      applied = false;
+    }
+  }
+  changes_.clear();
+  return applied;
+}
+
 }  // namespace memory
 
-// TODO(benvanik): fancy AVX versions.
 // https://github.com/gnuradio/volk/blob/master/kernels/volk/volk_16u_byteswap.h
 // https://github.com/gnuradio/volk/blob/master/kernels/volk/volk_32u_byteswap.h
 // https://github.com/gnuradio/volk/blob/master/kernels/volk/volk_64u_byteswap.h
@@ -57,6 +86,52 @@ void copy_128_aligned(void* dest, const void* src, size_t count) {
 #else
 #define XE_WORKAROUND_CONSTANT_RETURN_IF(x)
 #endif
+
+// The project is built for AVX, the AVX2 functions must be compiled for it
+// explicitly and only called after checking that the host supports it.
+#if !XE_COMPILER_MSVC
+#define XE_MEMORY_AVX2 __attribute__((target("avx2")))
+#else
+#define XE_MEMORY_AVX2
+#endif
+
+static bool IsAVX2Supported() {
+  static const bool is_avx2_supported =
+      Xbyak::util::Cpu().has(Xbyak::util::Cpu::tAVX2);
+  return is_avx2_supported;
+}
+
+// Swaps the bytes of 32-byte blocks with the shuffle applied to both 128-bit
+// halves, two blocks at a time, returning how many bytes were processed so the
+// caller can handle the rest with 128-bit operations and scalar code.
+XE_MEMORY_AVX2 static size_t copy_and_swap_avx2(void* dest_ptr,
+                                                const void* src_ptr,
+                                                size_t size,
+                                                __m128i shufmask_128) {
+  auto dest = reinterpret_cast<uint8_t*>(dest_ptr);
+  auto src = reinterpret_cast<const uint8_t*>(src_ptr);
+  __m256i shufmask = _mm256_broadcastsi128_si256(shufmask_128);
+  size_t i;
+  for (i = 0; i + 64 <= size; i += 64) {
+    __m256i input0 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i]));
+    __m256i input1 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i + 32]));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dest[i]),
+                        _mm256_shuffle_epi8(input0, shufmask));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dest[i + 32]),
+                        _mm256_shuffle_epi8(input1, shufmask));
+  }
+  if (i + 32 <= size) {
+    __m256i input =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i]));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dest[i]),
+                        _mm256_shuffle_epi8(input, shufmask));
+    i += 32;
+  }
+  return i;
+}
+
 void copy_and_swap_16_aligned(void* dest_ptr, const void* src_ptr,
                               size_t count) {
   assert_zero(reinterpret_cast<uintptr_t>(dest_ptr) & 0xF);
@@ -69,7 +144,11 @@ void copy_and_swap_16_aligned(void* dest_ptr, const void* src_ptr,
                    0x04, 0x05, 0x02, 0x03, 0x00, 0x01);
 
   size_t i = 0;
-  for (i = 0; i + 8 <= count; i += 8) {
+  if (IsAVX2Supported()) {
+    i = copy_and_swap_avx2(dest, src, count * sizeof(uint16_t), shufmask) /
+        sizeof(uint16_t);
+  }
+  for (; i + 8 <= count; i += 8) {
     __m128i input = _mm_load_si128(reinterpret_cast<const __m128i*>(&src[i]));
     __m128i output = _mm_shuffle_epi8(input, shufmask);
     _mm_store_si128(reinterpret_cast<__m128i*>(&dest[i]), output);
@@ -88,8 +167,12 @@ void copy_and_swap_16_unaligned(void* dest_ptr, const void* src_ptr,
       _mm_set_epi8(0x0E, 0x0F, 0x0C, 0x0D, 0x0A, 0x0B, 0x08, 0x09, 0x06, 0x07,
                    0x04, 0x05, 0x02, 0x03, 0x00, 0x01);
 
-  size_t i;
-  for (i = 0; i + 8 <= count; i += 8) {
+  size_t i = 0;
+  if (IsAVX2Supported()) {
+    i = copy_and_swap_avx2(dest, src, count * sizeof(uint16_t), shufmask) /
+        sizeof(uint16_t);
+  }
+  for (; i + 8 <= count; i += 8) {
     __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i]));
     __m128i output = _mm_shuffle_epi8(input, shufmask);
     _mm_storeu_si128(reinterpret_cast<__m128i*>(&dest[i]), output);
@@ -111,8 +194,12 @@ void copy_and_swap_32_aligned(void* dest_ptr, const void* src_ptr,
       _mm_set_epi8(0x0C, 0x0D, 0x0E, 0x0F, 0x08, 0x09, 0x0A, 0x0B, 0x04, 0x05,
                    0x06, 0x07, 0x00, 0x01, 0x02, 0x03);
 
-  size_t i;
-  for (i = 0; i + 4 <= count; i += 4) {
+  size_t i = 0;
+  if (IsAVX2Supported()) {
+    i = copy_and_swap_avx2(dest, src, count * sizeof(uint32_t), shufmask) /
+        sizeof(uint32_t);
+  }
+  for (; i + 4 <= count; i += 4) {
     __m128i input = _mm_load_si128(reinterpret_cast<const __m128i*>(&src[i]));
     __m128i output = _mm_shuffle_epi8(input, shufmask);
     _mm_store_si128(reinterpret_cast<__m128i*>(&dest[i]), output);
@@ -131,8 +218,12 @@ void copy_and_swap_32_unaligned(void* dest_ptr, const void* src_ptr,
       _mm_set_epi8(0x0C, 0x0D, 0x0E, 0x0F, 0x08, 0x09, 0x0A, 0x0B, 0x04, 0x05,
                    0x06, 0x07, 0x00, 0x01, 0x02, 0x03);
 
-  size_t i;
-  for (i = 0; i + 4 <= count; i += 4) {
+  size_t i = 0;
+  if (IsAVX2Supported()) {
+    i = copy_and_swap_avx2(dest, src, count * sizeof(uint32_t), shufmask) /
+        sizeof(uint32_t);
+  }
+  for (; i + 4 <= count; i += 4) {
     __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i]));
     __m128i output = _mm_shuffle_epi8(input, shufmask);
     _mm_storeu_si128(reinterpret_cast<__m128i*>(&dest[i]), output);
@@ -154,8 +245,12 @@ void copy_and_swap_64_aligned(void* dest_ptr, const void* src_ptr,
       _mm_set_epi8(0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x00, 0x01,
                    0x02, 0x03, 0x04, 0x05, 0x06, 0x07);
 
-  size_t i;
-  for (i = 0; i + 2 <= count; i += 2) {
+  size_t i = 0;
+  if (IsAVX2Supported()) {
+    i = copy_and_swap_avx2(dest, src, count * sizeof(uint64_t), shufmask) /
+        sizeof(uint64_t);
+  }
+  for (; i + 2 <= count; i += 2) {
     __m128i input = _mm_load_si128(reinterpret_cast<const __m128i*>(&src[i]));
     __m128i output = _mm_shuffle_epi8(input, shufmask);
     _mm_store_si128(reinterpret_cast<__m128i*>(&dest[i]), output);
@@ -174,8 +269,12 @@ void copy_and_swap_64_unaligned(void* dest_ptr, const void* src_ptr,
       _mm_set_epi8(0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x00, 0x01,
                    0x02, 0x03, 0x04, 0x05, 0x06, 0x07);
 
-  size_t i;
-  for (i = 0; i + 2 <= count; i += 2) {
+  size_t i = 0;
+  if (IsAVX2Supported()) {
+    i = copy_and_swap_avx2(dest, src, count * sizeof(uint64_t), shufmask) /
+        sizeof(uint64_t);
+  }
+  for (; i + 2 <= count; i += 2) {
     __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i]));
     __m128i output = _mm_shuffle_epi8(input, shufmask);
     _mm_storeu_si128(reinterpret_cast<__m128i*>(&dest[i]), output);
@@ -190,8 +289,15 @@ void copy_and_swap_16_in_32_aligned(void* dest_ptr, const void* src_ptr,
                                     size_t count) {
   auto dest = reinterpret_cast<uint32_t*>(dest_ptr);
   auto src = reinterpret_cast<const uint32_t*>(src_ptr);
-  size_t i;
-  for (i = 0; i + 4 <= count; i += 4) {
+  size_t i = 0;
+  if (IsAVX2Supported()) {
+    __m128i shufmask =
+        _mm_set_epi8(0x0D, 0x0C, 0x0F, 0x0E, 0x09, 0x08, 0x0B, 0x0A, 0x05,
+                     0x04, 0x07, 0x06, 0x01, 0x00, 0x03, 0x02);
+    i = copy_and_swap_avx2(dest, src, count * sizeof(uint32_t), shufmask) /
+        sizeof(uint32_t);
+  }
+  for (; i + 4 <= count; i += 4) {
     __m128i input = _mm_load_si128(reinterpret_cast<const __m128i*>(&src[i]));
     __m128i output =
         _mm_or_si128(_mm_slli_epi32(input, 16), _mm_srli_epi32(input, 16));
@@ -207,8 +313,15 @@ void copy_and_swap_16_in_32_unaligned(void* dest_ptr, const void* src_ptr,
                                       size_t count) {
   auto dest = reinterpret_cast<uint32_t*>(dest_ptr);
   auto src = reinterpret_cast<const uint32_t*>(src_ptr);
-  size_t i;
-  for (i = 0; i + 4 <= count; i += 4) {
+  size_t i = 0;
+  if (IsAVX2Supported()) {
+    __m128i shufmask =
+        _mm_set_epi8(0x0D, 0x0C, 0x0F, 0x0E, 0x09, 0x08, 0x0B, 0x0A, 0x05,
+                     0x04, 0x07, 0x06, 0x01, 0x00, 0x03, 0x02);
+    i = copy_and_swap_avx2(dest, src, count * sizeof(uint32_t), shufmask) /
+        sizeof(uint32_t);
+  }
+  for (; i + 4 <= count; i += 4) {
     __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i]));
     __m128i output =
         _mm_or_si128(_mm_slli_epi32(input, 16), _mm_srli_epi32(input, 16));
@@ -406,4 +519,237 @@ void copy_and_swap_16_in_32_unaligned(void* dst_ptr, const void* src_ptr,
 
 #endif
 
+// Below this, the destination likely fits in the cache, and regular stores are
+// faster than non-temporal ones.
+constexpr size_t kStreamingMinSize = 1024 * 1024;
+
+void fill_streaming(void* dest_ptr, uint8_t value, size_t count) {
+#if XE_ARCH_AMD64
+  if (count >= kStreamingMinSize) {
+    auto dest = reinterpret_cast<uint8_t*>(dest_ptr);
+    // Non-temporal stores need an aligned destination.
+    size_t head = (32 - (reinterpret_cast<uintptr_t>(dest) & 31)) & 31;
+    std::memset(dest, value, head);
+    dest += head;
+    count -= head;
+    __m256i pattern = _mm256_set1_epi8(char(value));
+    size_t i;
+    for (i = 0; i + 128 <= count; i += 128) {
+      auto line = reinterpret_cast<__m256i*>(dest + i);
+      _mm256_stream_si256(line, pattern);
+      _mm256_stream_si256(line + 1, pattern);
+      _mm256_stream_si256(line + 2, pattern);
+      _mm256_stream_si256(line + 3, pattern);
+    }
+    _mm_sfence();
+    std::memset(dest + i, value, count - i);
+    return;
+  }
+#endif
+  std::memset(dest_ptr, value, count);
+}
+
+void copy_streaming(void* dest_ptr, const void* src_ptr, size_t count) {
+#if XE_ARCH_AMD64
+  if (count >= kStreamingMinSize) {
+    auto dest = reinterpret_cast<uint8_t*>(dest_ptr);
+    auto src = reinterpret_cast<const uint8_t*>(src_ptr);
+    size_t head = (32 - (reinterpret_cast<uintptr_t>(dest) & 31)) & 31;
+    std::memcpy(dest, src, head);
+    dest += head;
+    src += head;
+    count -= head;
+    size_t i;
+    for (i = 0; i + 128 <= count; i += 128) {
+      auto source_line = reinterpret_cast<const __m256i*>(src + i);
+      __m256i data0 = _mm256_loadu_si256(source_line);
+      __m256i data1 = _mm256_loadu_si256(source_line + 1);
+      __m256i data2 = _mm256_loadu_si256(source_line + 2);
+      __m256i data3 = _mm256_loadu_si256(source_line + 3);
+      auto line = reinterpret_cast<__m256i*>(dest + i);
+      _mm256_stream_si256(line, data0);
+      _mm256_stream_si256(line + 1, data1);
+      _mm256_stream_si256(line + 2, data2);
+      _mm256_stream_si256(line + 3, data3);
+    }
+    _mm_sfence();
+    std::memcpy(dest + i, src + i, count - i);
+    return;
+  }
+#endif
+  std::memcpy(dest_ptr, src_ptr, count);
+}
+
+const uint32_t* search_aligned_32(const uint32_t* begin, const uint32_t* end,
+                                  const uint32_t* values, size_t value_count) {
+  auto matches_rest = [values, value_count](const uint32_t* p) {
+    for (size_t n = 1; n < value_count; ++n) {
+      if (p[n] != values[n]) {
+        return false;
+      }
+    }
+    return true;
+  };
+  const uint32_t* p = begin;
+#if XE_ARCH_AMD64
+  // Compare 4 elements at once with the first value, checking the rest of the
+  // sequence only where it matches.
+  __m128i first_value = _mm_set1_epi32(int(values[0]));
+  for (; end - p >= 4; p += 4) {
+    __m128i elements = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    uint32_t mask = uint32_t(_mm_movemask_ps(
+        _mm_castsi128_ps(_mm_cmpeq_epi32(elements, first_value))));
+    while (mask) {
+      uint32_t index = xe::tzcnt(mask);
+      if (matches_rest(p + index)) {
+        return p + index;
+      }
+      mask &= mask - 1;
+    }
+  }
+#endif
+  for (; p != end; ++p) {
+    if (*p == values[0] && matches_rest(p)) {
+      return p;
+    }
+  }
+  return nullptr;
+}
+
+size_t count_equal_8(const void* a, const void* b, size_t count) {
+  auto a_bytes = reinterpret_cast<const uint8_t*>(a);
+  auto b_bytes = reinterpret_cast<const uint8_t*>(b);
+  size_t equal_count = 0;
+  size_t i = 0;
+#if XE_ARCH_AMD64
+  for (; i + 16 <= count; i += 16) {
+    __m128i a_vector =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_bytes + i));
+    __m128i b_vector =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(b_bytes + i));
+    equal_count += xe::bit_count(
+        uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(a_vector, b_vector))));
+  }
+#endif
+  for (; i < count; ++i) {
+    if (a_bytes[i] == b_bytes[i]) {
+      ++equal_count;
+    }
+  }
+  return equal_count;
+}
+
+size_t count_equal_32(const uint32_t* elements, size_t count, uint32_t value) {
+  size_t equal_count = 0;
+  size_t i = 0;
+#if XE_ARCH_AMD64
+  __m128i value_vector = _mm_set1_epi32(int(value));
+  for (; i + 4 <= count; i += 4) {
+    __m128i element_vector =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements + i));
+    equal_count += xe::bit_count(uint32_t(_mm_movemask_ps(
+        _mm_castsi128_ps(_mm_cmpeq_epi32(element_vector, value_vector)))));
+  }
+#endif
+  for (; i < count; ++i) {
+    if (elements[i] == value) {
+      ++equal_count;
+    }
+  }
+  return equal_count;
+}
+
+void fill_32(uint32_t* dest, uint32_t value, size_t count) {
+  size_t i = 0;
+#if XE_ARCH_AMD64
+  __m128i value_vector = _mm_set1_epi32(int(value));
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), value_vector);
+  }
+#endif
+  for (; i < count; ++i) {
+    dest[i] = value;
+  }
+}
+
+void widen_8_to_16_be(uint16_t* dest, const uint8_t* src, size_t count) {
+  size_t i = 0;
+#if XE_ARCH_AMD64
+  // Interleaving with zeros before the characters gives the big-endian order.
+  __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= count; i += 16) {
+    __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i),
+                     _mm_unpacklo_epi8(zero, chars));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i + 8),
+                     _mm_unpackhi_epi8(zero, chars));
+  }
+#endif
+  for (; i < count; ++i) {
+    dest[i] = byte_swap(uint16_t(src[i]));
+  }
+}
+
+void narrow_16_be_to_8(uint8_t* dest, const uint16_t* src, size_t count,
+                       uint8_t replacement) {
+  size_t i = 0;
+#if XE_ARCH_AMD64
+  __m128i low_byte_mask = _mm_set1_epi16(0x00FF);
+  __m128i replacement_vector = _mm_set1_epi16(int16_t(replacement));
+  __m128i zero = _mm_setzero_si128();
+  // Loaded as little-endian, the high byte of the character is in the low 8
+  // bits of the 16-bit lane.
+  auto narrow = [&](__m128i chars) {
+    __m128i fits =
+        _mm_cmpeq_epi16(_mm_and_si128(chars, low_byte_mask), zero);
+    return _mm_blendv_epi8(replacement_vector, _mm_srli_epi16(chars, 8),
+                           fits);
+  };
+  for (; i + 16 <= count; i += 16) {
+    __m128i chars_low =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i chars_high =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8));
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(dest + i),
+        _mm_packus_epi16(narrow(chars_low), narrow(chars_high)));
+  }
+#endif
+  for (; i < count; ++i) {
+    uint16_t c = byte_swap(src[i]);
+    dest[i] = c <= 0xFF ? uint8_t(c) : replacement;
+  }
+}
+
+size_t string_length_16(const uint16_t* str, size_t max_count) {
+  size_t i = 0;
+#if XE_ARCH_AMD64
+  // Aligned loads don't cross pages, but the string must be aligned to the
+  // character size for them to contain whole characters.
+  if (!(reinterpret_cast<uintptr_t>(str) & 1)) {
+    // Up to the first aligned 16 bytes.
+    for (; i < max_count && (reinterpret_cast<uintptr_t>(str + i) & 15);
+         ++i) {
+      if (!str[i]) {
+        return i;
+      }
+    }
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= max_count; i += 8) {
+      uint32_t zero_mask = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi16(
+          _mm_load_si128(reinterpret_cast<const __m128i*>(str + i)), zero)));
+      if (zero_mask) {
+        return i + xe::tzcnt(zero_mask) / 2;
+      }
+    }
+  }
+#endif
+  for (; i < max_count; ++i) {
+    if (!str[i]) {
+      return i;
+    }
+  }
+  return max_count;
+}
+
 }  // namespace xe
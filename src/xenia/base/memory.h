@@ -17,6 +17,7 @@
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <vector>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
@@ -62,6 +63,10 @@ size_t page_size();
 // This is likely 64KiB.
 size_t allocation_granularity();
 
+// Returns the largest amount of physical memory used by the process so far, in
+// bytes, or 0 if not known.
+size_t peak_working_set_size();
+
 enum class PageAccess {
   kNoAccess = 0,
   kReadOnly = 1 << 0,
@@ -114,6 +119,31 @@ bool Protect(void* base_address, size_t length, PageAccess access,
 // the region.
 bool QueryProtect(void* base_address, size_t& length, PageAccess& access_out);
 
+// Accumulates protection changes, merging each with the previous one if it
+// continues it with the same access, and applies them in order when Apply is
+// called or the batch is destroyed, so runs of pages changed one by one take a
+// single Protect call. Nothing may rely on a change being made before the
+// batch is applied.
+class ProtectionBatch {
+ public:
+  ProtectionBatch() = default;
+  ProtectionBatch(const ProtectionBatch&) = delete;
+  ProtectionBatch& operator=(const ProtectionBatch&) = delete;
+  ~ProtectionBatch() { Apply(); }
+
+  void Add(void* base_address, size_t length, PageAccess access);
+  // Returns whether all the changes were made.
+  bool Apply();
+
+ private:
+  struct Change {
+    uint8_t* base_address;
+    size_t length;
+    PageAccess access;
+  };
+  std::vector<Change> changes_;
+};
+
 // Allocates a block of memory for a type with the given alignment.
 // The memory must be freed with AlignedFree.
 template <typename T>
@@ -158,6 +188,19 @@ void* MapFileView(FileMappingHandle handle, void* base_address, size_t length,
                   PageAccess access, size_t file_offset);
 bool UnmapFileView(FileMappingHandle handle, void* base_address, size_t length);
 
+// Hints that the parts of the range aligned to huge host pages should be
+// backed by them, for fewer TLB misses. Returns the number of bytes the hint
+// was applied to, 0 if the host doesn't support it.
+size_t AdviseHugePages(void* base_address, size_t length);
+
+// Makes the host physical pages backing the range be allocated, when they're
+// first touched, from the host NUMA nodes in the mask - interleaved between
+// them if requested, or from the nearest of them otherwise. Returns false if
+// the host doesn't support it, in which case pages are usually allocated from
+// the node of the processor first touching them.
+bool SetNumaPolicy(void* base_address, size_t length, uint64_t node_mask,
+                   bool interleave);
+
 inline size_t hash_combine(size_t seed) { return seed; }
 
 template <typename T, typename... Ts>
@@ -187,6 +230,35 @@ void copy_and_swap_16_in_32_aligned(void* dest, const void* src, size_t count);
 void copy_and_swap_16_in_32_unaligned(void* dest, const void* src,
                                       size_t count);
 
+// Like memset and memcpy, but large sizes are written with non-temporal stores
+// bypassing the cache, so clearing or copying megabytes doesn't evict the rest
+// of the working set. The ranges must not overlap.
+void fill_streaming(void* dest, uint8_t value, size_t count);
+void copy_streaming(void* dest, const void* src, size_t count);
+
+// Returns the first element in [begin, end) starting the sequence of
+// value_count values, or nullptr if there's none. The sequence may extend past
+// end.
+const uint32_t* search_aligned_32(const uint32_t* begin, const uint32_t* end,
+                                  const uint32_t* values, size_t value_count);
+
+// Returns the number of positions at which the bytes in the two ranges are
+// equal.
+size_t count_equal_8(const void* a, const void* b, size_t count);
+// Returns the number of elements equal to value.
+size_t count_equal_32(const uint32_t* elements, size_t count, uint32_t value);
+void fill_32(uint32_t* dest, uint32_t value, size_t count);
+// Zero-extends 8-bit characters to big-endian 16-bit ones.
+void widen_8_to_16_be(uint16_t* dest, const uint8_t* src, size_t count);
+// Converts big-endian 16-bit characters to 8-bit ones, with the ones above
+// 0xFF replaced.
+void narrow_16_be_to_8(uint8_t* dest, const uint16_t* src, size_t count,
+                       uint8_t replacement);
+// Like strnlen for 16-bit characters (of any endianness). Doesn't read past
+// the aligned 16 bytes containing the terminator, so doesn't fault if the
+// string ends just before an inaccessible page.
+size_t string_length_16(const uint16_t* str, size_t max_count);
+
 template <typename T>
 void copy_and_swap(T* dest, const T* src, size_t count) {
   bool is_aligned = reinterpret_cast<uintptr_t>(dest) % 32 == 0 &&
@@ -11,6 +11,8 @@
 
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <cstddef>
 
@@ -61,6 +63,15 @@ void AndroidShutdown() {
 size_t page_size() { return getpagesize(); }
 size_t allocation_granularity() { return page_size(); }
 
+size_t peak_working_set_size() {
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage)) {
+    return 0;
+  }
+  // In kilobytes.
+  return size_t(usage.ru_maxrss) * 1024;
+}
+
 uint32_t ToPosixProtectFlags(PageAccess access) {
   switch (access) {
     case PageAccess::kNoAccess:
@@ -187,5 +198,45 @@ bool UnmapFileView(FileMappingHandle handle, void* base_address,
   return munmap(base_address, length) == 0;
 }
 
+size_t AdviseHugePages(void* base_address, size_t length) {
+#ifdef MADV_HUGEPAGE
+  // Transparent huge pages, unlike MAP_HUGETLB, are split by the kernel when
+  // a part of them is protected, so guest pages can still be protected
+  // individually.
+  constexpr uintptr_t kHugePageSize = 2 * 1024 * 1024;
+  uintptr_t address = reinterpret_cast<uintptr_t>(base_address);
+  uintptr_t start = xe::align(address, kHugePageSize);
+  uintptr_t end = (address + length) & ~(kHugePageSize - 1);
+  if (end <= start ||
+      madvise(reinterpret_cast<void*>(start), end - start, MADV_HUGEPAGE)) {
+    return 0;
+  }
+  return end - start;
+#else
+  return 0;
+#endif
+}
+
+bool SetNumaPolicy(void* base_address, size_t length, uint64_t node_mask,
+                   bool interleave) {
+#if XE_PLATFORM_LINUX && defined(SYS_mbind)
+  // Not using libnuma for a single system call. For shared memory, the policy
+  // is set for the pages of the object itself, so it applies to all the views
+  // of them.
+  constexpr int kMpolBind = 2;
+  constexpr int kMpolInterleave = 3;
+  unsigned long mbind_node_mask = (unsigned long)(node_mask);
+  if (!mbind_node_mask) {
+    return false;
+  }
+  // The kernel ignores the last bit of the maximum node count.
+  return !syscall(SYS_mbind, base_address, length,
+                  interleave ? kMpolInterleave : kMpolBind, &mbind_node_mask,
+                  sizeof(mbind_node_mask) * 8 + 1, 0);
+#else
+  return false;
+#endif
+}
+
 }  // namespace memory
 }  // namespace xe
@@ -11,6 +11,8 @@
 
 #include "xenia/base/platform_win.h"
 
+#include <psapi.h>
+
 #if WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP | \
                             WINAPI_PARTITION_SYSTEM | WINAPI_PARTITION_GAMES)
 #define XE_BASE_MEMORY_WIN_USE_DESKTOP_FUNCTIONS
@@ -39,6 +41,15 @@ size_t allocation_granularity() {
   return value;
 }
 
+size_t peak_working_set_size() {
+  PROCESS_MEMORY_COUNTERS memory_counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &memory_counters,
+                            sizeof(memory_counters))) {
+    return 0;
+  }
+  return memory_counters.PeakWorkingSetSize;
+}
+
 DWORD ToWin32ProtectFlags(PageAccess access) {
   switch (access) {
     case PageAccess::kNoAccess:
@@ -245,5 +256,20 @@ bool UnmapFileView(FileMappingHandle handle, void* base_address,
   return UnmapViewOfFile(base_address) ? true : false;
 }
 
+size_t AdviseHugePages(void* base_address, size_t length) {
+  // Large pages can only back sections created with SEC_LARGE_PAGES, fully
+  // committed and locked with SeLockMemoryPrivilege, and can't be protected
+  // with the granularity of guest pages.
+  return 0;
+}
+
+bool SetNumaPolicy(void* base_address, size_t length, uint64_t node_mask,
+                   bool interleave) {
+  // The preferred node can only be specified when creating a section or
+  // allocating, and there's no interleaving - the pages are allocated from the
+  // node of the processor first touching them.
+  return false;
+}
+
 }  // namespace memory
 }  // namespace xe
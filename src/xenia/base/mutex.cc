@@ -9,11 +9,118 @@
 
 #include "xenia/base/mutex.h"
 
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <utility>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/lock_profiling.h"
+
 namespace xe {
 
+namespace {
+
+// The pointer and the line are stored separately, so they may be mismatched
+// occasionally, which is acceptable for diagnostics.
+std::atomic<const char*> contention_holder_file_{nullptr};
+std::atomic<uint32_t> contention_holder_line_{0};
+
+struct ContentionStatistics {
+  uint64_t wait_count = 0;
+  uint64_t wait_time_ns = 0;
+};
+
+std::mutex& contention_records_mutex() {
+  static std::mutex records_mutex;
+  return records_mutex;
+}
+
+// By the waiter and the holder locations.
+std::map<std::pair<std::string, std::string>, ContentionStatistics>&
+contention_records() {
+  static std::map<std::pair<std::string, std::string>, ContentionStatistics>
+      records;
+  return records;
+}
+
+std::string FormatContentionLocation(const char* file, uint32_t line) {
+  if (!file) {
+    return "unknown";
+  }
+  return std::string(file) + ':' + std::to_string(line);
+}
+
+}  // namespace
+
+std::atomic<bool> global_critical_region::contention_tracking_enabled_(false);
+
 std::recursive_mutex& global_critical_region::mutex() {
   static std::recursive_mutex global_mutex;
   return global_mutex;
 }
 
+void global_critical_region::SetContentionTrackingEnabled(bool enabled) {
+  contention_tracking_enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+std::vector<global_critical_region::ContentionRecord>
+global_critical_region::GetContentionRecords() {
+  std::vector<ContentionRecord> records;
+  {
+    std::lock_guard<std::mutex> records_lock(contention_records_mutex());
+    records.reserve(contention_records().size());
+    for (const auto& [locations, statistics] : contention_records()) {
+      ContentionRecord& record = records.emplace_back();
+      record.waiter_location = locations.first;
+      record.holder_location = locations.second;
+      record.wait_count = statistics.wait_count;
+      record.wait_time_ns = statistics.wait_time_ns;
+    }
+  }
+  std::stable_sort(records.begin(), records.end(),
+                   [](const ContentionRecord& a, const ContentionRecord& b) {
+                     return a.wait_time_ns > b.wait_time_ns;
+                   });
+  return records;
+}
+
+void global_critical_region::ResetContentionRecords() {
+  std::lock_guard<std::mutex> records_lock(contention_records_mutex());
+  contention_records().clear();
+}
+
+std::unique_lock<std::recursive_mutex> global_critical_region::AcquireTracked(
+    const char* file, uint32_t line) {
+  std::unique_lock<std::recursive_mutex> lock(mutex(), std::try_to_lock);
+  if (!lock.owns_lock()) {
+    const char* holder_file =
+        contention_holder_file_.load(std::memory_order_relaxed);
+    uint32_t holder_line =
+        contention_holder_line_.load(std::memory_order_relaxed);
+    uint64_t wait_start_host_tick = Clock::QueryHostTickCount();
+    auto wait_start = std::chrono::steady_clock::now();
+    lock.lock();
+    uint64_t wait_time_ns = uint64_t(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - wait_start)
+            .count());
+    if (lock_profiling::IsEnabled()) {
+      lock_profiling::RecordWait(
+          "global_critical_region", file, line,
+          Clock::QueryHostTickCount() - wait_start_host_tick);
+    }
+    std::lock_guard<std::mutex> records_lock(contention_records_mutex());
+    ContentionStatistics& statistics =
+        contention_records()[std::make_pair(
+            FormatContentionLocation(file, line),
+            FormatContentionLocation(holder_file, holder_line))];
+    ++statistics.wait_count;
+    statistics.wait_time_ns += wait_time_ns;
+  }
+  contention_holder_file_.store(file, std::memory_order_relaxed);
+  contention_holder_line_.store(line, std::memory_order_relaxed);
+  return lock;
+}
+
 }  // namespace xe
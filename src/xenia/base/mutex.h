@@ -10,7 +10,11 @@
 #ifndef XENIA_BASE_MUTEX_H_
 #define XENIA_BASE_MUTEX_H_
 
+#include <atomic>
+#include <cstdint>
 #include <mutex>
+#include <string>
+#include <vector>
 
 namespace xe {
 
@@ -52,21 +56,52 @@ namespace xe {
 //   xe::global_critical_region global_critical_region_;
 //   std::list<...> my_list_;
 // };
+//
+// Subsystems whose state is never touched while suspending threads may use
+// their own locks instead, to not be serialized with the rest of the system.
+// Such locks are acquired after the global critical region if both are
+// needed, and the global critical region must never be acquired while holding
+// them. The order of them, from the outermost, is:
+// - xe::global_critical_region.
+// - xe::vfs::VirtualFileSystem::mutex_.
+// - xe::vfs::Device::entry_mutex().
+//
+// To find the remaining call sites where threads wait for the global critical
+// region the most, contention tracking can be enabled. While it's enabled,
+// Acquire and AcquireDirect remember their call site, and if they have to wait,
+// they accumulate the time spent waiting for the pair of their call site and
+// the call site of the last acquisition by another thread.
 class global_critical_region {
  public:
+  struct ContentionRecord {
+    // "file:line" of the acquisition that had to wait.
+    std::string waiter_location;
+    // "file:line" of the last acquisition before the wait started.
+    std::string holder_location;
+    uint64_t wait_count;
+    uint64_t wait_time_ns;
+  };
+
   static std::recursive_mutex& mutex();
 
   // Acquires a lock on the global critical section.
   // Use this when keeping an instance is not possible. Otherwise, prefer
   // to keep an instance of global_critical_region near the members requiring
   // it to keep things readable.
-  static std::unique_lock<std::recursive_mutex> AcquireDirect() {
+  // The default arguments are evaluated at the call site for contention
+  // tracking.
+  static std::unique_lock<std::recursive_mutex> AcquireDirect(
+      const char* file = __builtin_FILE(), uint32_t line = __builtin_LINE()) {
+    if (contention_tracking_enabled_.load(std::memory_order_relaxed)) {
+      return AcquireTracked(file, line);
+    }
     return std::unique_lock<std::recursive_mutex>(mutex());
   }
 
   // Acquires a lock on the global critical section.
-  inline std::unique_lock<std::recursive_mutex> Acquire() {
-    return std::unique_lock<std::recursive_mutex>(mutex());
+  inline std::unique_lock<std::recursive_mutex> Acquire(
+      const char* file = __builtin_FILE(), uint32_t line = __builtin_LINE()) {
+    return AcquireDirect(file, line);
   }
 
   // Acquires a deferred lock on the global critical section.
@@ -79,6 +114,21 @@ class global_critical_region {
   inline std::unique_lock<std::recursive_mutex> TryAcquire() {
     return std::unique_lock<std::recursive_mutex>(mutex(), std::try_to_lock);
   }
+
+  static bool contention_tracking_enabled() {
+    return contention_tracking_enabled_.load(std::memory_order_relaxed);
+  }
+  static void SetContentionTrackingEnabled(bool enabled);
+  // Returns the contention records in the descending order of the total time
+  // spent waiting.
+  static std::vector<ContentionRecord> GetContentionRecords();
+  static void ResetContentionRecords();
+
+ private:
+  static std::unique_lock<std::recursive_mutex> AcquireTracked(
+      const char* file, uint32_t line);
+
+  static std::atomic<bool> contention_tracking_enabled_;
 };
 
 }  // namespace xe
@@ -8,6 +8,9 @@
  */
 
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
 #include <string>
 
 // NOTE: this must be included before microprofile as macro expansion needs
@@ -36,6 +39,8 @@
 
 #include "xenia/base/assert.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/lock_profiling.h"
 #include "xenia/base/profiling.h"
 #include "xenia/ui/ui_event.h"
 #include "xenia/ui/virtual_key.h"
@@ -52,6 +57,23 @@
 DEFINE_bool(profiler_dpi_scaling, false,
             "Apply window DPI scaling to the profiler.", "UI");
 DEFINE_bool(show_profiler, false, "Show profiling UI by default.", "UI");
+DEFINE_bool(
+    profiler_gpu_timers, false,
+    "Enable the host GPU timestamp profiling scopes by default. They can also "
+    "be enabled in the groups menu of the profiler.",
+    "UI");
+DEFINE_path(profiler_trace_path, "",
+            "Path to write the profiler trace captures to, in the Chrome trace "
+            "event format. If empty, profiler_trace.json in the executable "
+            "folder.",
+            "UI");
+DEFINE_double(profiler_trace_seconds, 10.0,
+              "Duration of a profiler trace capture, or 0 to capture until "
+              "stopped with Shift+F3.",
+              "UI");
+DEFINE_bool(profiler_trace_on_start, false,
+            "Start a profiler trace capture when the profiler is initialized.",
+            "UI");
 
 namespace xe {
 
@@ -60,6 +82,7 @@ namespace xe {
 Profiler::ProfilerWindowInputListener Profiler::input_listener_;
 size_t Profiler::z_order_ = 0;
 ui::Window* Profiler::window_ = nullptr;
+Profiler::GpuTimerSource* Profiler::gpu_timer_source_ = nullptr;
 #if XE_OPTION_PROFILING_UI
 Profiler::ProfilerUIDrawer Profiler::ui_drawer_;
 ui::Presenter* Profiler::presenter_ = nullptr;
@@ -67,6 +90,256 @@ std::unique_ptr<ui::MicroprofileDrawer> Profiler::drawer_;
 bool Profiler::dpi_scaling_ = false;
 #endif  // XE_OPTION_PROFILING_UI
 
+namespace {
+
+struct TraceCapture {
+  std::mutex mutex;
+  FILE* file = nullptr;
+  bool first_event = true;
+  uint64_t start_host_tick = 0;
+  // The CPU tick the timestamps are relative to, the start of the first frame
+  // exported.
+  bool base_tick_valid = false;
+  int64_t base_tick = 0;
+  // The scopes entered on each thread, to drop the leave events of the scopes
+  // entered before the capture, and to close the scopes still open at the end.
+  uint32_t depths[MICROPROFILE_MAX_THREADS] = {};
+  int64_t last_ticks[MICROPROFILE_MAX_THREADS] = {};
+  std::string thread_names[MICROPROFILE_MAX_THREADS];
+  fmt::memory_buffer buffer;
+};
+
+TraceCapture& GetTraceCapture() {
+  static TraceCapture capture;
+  return capture;
+}
+
+void AppendTraceJsonString(fmt::memory_buffer& buffer, const char* str) {
+  for (; *str; ++str) {
+    char c = *str;
+    if (c == '"' || c == '\\') {
+      buffer.push_back('\\');
+      buffer.push_back(c);
+    } else if (uint8_t(c) >= 0x20) {
+      buffer.push_back(c);
+    }
+  }
+}
+
+void AppendTraceEventSeparator(TraceCapture& capture) {
+  if (capture.first_event) {
+    capture.first_event = false;
+  } else {
+    capture.buffer.push_back(',');
+  }
+  capture.buffer.push_back('\n');
+}
+
+double TraceTickToMicroseconds(const TraceCapture& capture, int64_t tick) {
+  return double(MicroProfileLogTickDifference(capture.base_tick, tick)) *
+         1000000.0 / double(MicroProfileTicksPerSecondCpu());
+}
+
+void AppendTraceScopeEvent(TraceCapture& capture, uint32_t log_index,
+                           bool enter, uint32_t timer_index, int64_t tick) {
+  const MicroProfileTimerInfo& timer_info = g_MicroProfile.TimerInfo[
+      std::min(timer_index, uint32_t(MICROPROFILE_MAX_TIMERS - 1))];
+  AppendTraceEventSeparator(capture);
+  fmt::format_to(std::back_inserter(capture.buffer),
+                 "{{\"ph\":\"{}\",\"pid\":1,\"tid\":{},\"ts\":{:.3f}",
+                 enter ? 'B' : 'E', log_index,
+                 TraceTickToMicroseconds(capture, tick));
+  if (enter) {
+    fmt::format_to(std::back_inserter(capture.buffer), ",\"name\":\"");
+    AppendTraceJsonString(capture.buffer, timer_info.pName);
+    fmt::format_to(std::back_inserter(capture.buffer), "\",\"cat\":\"");
+    AppendTraceJsonString(
+        capture.buffer,
+        g_MicroProfile.GroupInfo[timer_info.nGroupIndex].pName);
+    capture.buffer.push_back('"');
+  }
+  capture.buffer.push_back('}');
+}
+
+void FlushTraceCapture(TraceCapture& capture) {
+  if (capture.buffer.size()) {
+    fwrite(capture.buffer.data(), 1, capture.buffer.size(), capture.file);
+    capture.buffer.clear();
+  }
+}
+
+// Exports the frame that has just been processed by MicroProfileFlip, with the
+// GPU timestamps resolved.
+void ExportTraceFrame(TraceCapture& capture) {
+  MicroProfile& profile = g_MicroProfile;
+  if (!profile.nRunning) {
+    return;
+  }
+  uint32_t frame_index = profile.nFrameCurrent;
+  uint32_t frame_next_index =
+      (frame_index + 1) % MICROPROFILE_MAX_FRAME_HISTORY;
+  const MicroProfileFrameState& frame = profile.Frames[frame_index];
+  const MicroProfileFrameState& frame_next = profile.Frames[frame_next_index];
+  if (!capture.base_tick_valid) {
+    capture.base_tick_valid = true;
+    capture.base_tick = frame.nFrameStartCpu;
+  }
+  int64_t cpu_ticks_per_second = MicroProfileTicksPerSecondCpu();
+  uint64_t gpu_ticks_per_second = MicroProfileTicksPerSecondGpu();
+  for (uint32_t i = 0; i < MICROPROFILE_MAX_THREADS; ++i) {
+    MicroProfileThreadLog* log = profile.Pool[i];
+    if (!log) {
+      continue;
+    }
+    if (log->nGpu && (!frame.nFrameStartGpu || !gpu_ticks_per_second)) {
+      continue;
+    }
+    if (capture.thread_names[i] != log->ThreadName) {
+      // A new thread, or a log reused for another thread.
+      capture.thread_names[i] = log->ThreadName;
+      capture.depths[i] = 0;
+      AppendTraceEventSeparator(capture);
+      fmt::format_to(std::back_inserter(capture.buffer),
+                     "{{\"ph\":\"M\",\"pid\":1,\"tid\":{},"
+                     "\"name\":\"thread_name\",\"args\":{{\"name\":\"",
+                     i);
+      AppendTraceJsonString(capture.buffer, log->ThreadName);
+      fmt::format_to(std::back_inserter(capture.buffer), "\"}}}}");
+    }
+    uint32_t range[2][2] = {};
+    MicroProfileGetRange(frame_next.nLogStart[i], frame.nLogStart[i], range);
+    for (uint32_t j = 0; j < 2; ++j) {
+      for (uint32_t k = range[j][0]; k < range[j][1]; ++k) {
+        MicroProfileLogEntry entry = log->Log[k];
+        uint64_t type = MicroProfileLogType(entry);
+        if (type != MP_LOG_ENTER && type != MP_LOG_LEAVE) {
+          continue;
+        }
+        int64_t tick = MicroProfileLogGetTick(entry);
+        if (log->nGpu) {
+          // From the GPU timeline, aligned at the start of the frame.
+          tick = frame.nFrameStartCpu +
+                 (tick - frame.nFrameStartGpu) * cpu_ticks_per_second /
+                     int64_t(gpu_ticks_per_second);
+        }
+        bool enter = type == MP_LOG_ENTER;
+        if (enter) {
+          ++capture.depths[i];
+        } else {
+          if (!capture.depths[i]) {
+            continue;
+          }
+          --capture.depths[i];
+        }
+        capture.last_ticks[i] = tick;
+        AppendTraceScopeEvent(capture, i, enter,
+                              uint32_t(MicroProfileLogTimerIndex(entry)),
+                              tick);
+      }
+    }
+  }
+  FlushTraceCapture(capture);
+}
+
+std::filesystem::path GetTracePath() {
+  if (!cvars::profiler_trace_path.empty()) {
+    return cvars::profiler_trace_path;
+  }
+  return xe::filesystem::GetExecutableFolder() / "profiler_trace.json";
+}
+
+void StopTraceCaptureLocked(TraceCapture& capture) {
+  if (!capture.file) {
+    return;
+  }
+  // Closing the scopes still open to keep them in the trace.
+  for (uint32_t i = 0; i < MICROPROFILE_MAX_THREADS; ++i) {
+    for (; capture.depths[i]; --capture.depths[i]) {
+      AppendTraceEventSeparator(capture);
+      fmt::format_to(
+          std::back_inserter(capture.buffer),
+          "{{\"ph\":\"E\",\"pid\":1,\"tid\":{},\"ts\":{:.3f}}}", i,
+          TraceTickToMicroseconds(capture, capture.last_ticks[i]));
+    }
+  }
+  fmt::format_to(std::back_inserter(capture.buffer), "\n]}}\n");
+  FlushTraceCapture(capture);
+  fclose(capture.file);
+  capture.file = nullptr;
+  XELOGI("Profiler trace capture finished");
+
+  // The lock waits during the capture, alongside the trace.
+  if (lock_profiling::IsEnabled()) {
+    std::filesystem::path lock_statistics_path = GetTracePath();
+    lock_statistics_path.replace_extension(".locks.json");
+    FILE* lock_statistics_file =
+        xe::filesystem::OpenFile(lock_statistics_path, "wb");
+    if (lock_statistics_file) {
+      std::string lock_statistics_json =
+          lock_profiling::FormatStatisticsJson();
+      fwrite(lock_statistics_json.data(), 1, lock_statistics_json.size(),
+             lock_statistics_file);
+      fclose(lock_statistics_file);
+      XELOGI("Lock wait statistics written to {}",
+             xe::path_to_utf8(lock_statistics_path));
+    } else {
+      XELOGE("Failed to open the lock wait statistics file {}",
+             xe::path_to_utf8(lock_statistics_path));
+    }
+  }
+}
+
+}  // namespace
+
+void Profiler::StartTraceCapture() {
+  TraceCapture& capture = GetTraceCapture();
+  std::lock_guard<std::mutex> lock(capture.mutex);
+  if (capture.file) {
+    return;
+  }
+  std::filesystem::path path = GetTracePath();
+  xe::filesystem::CreateParentFolder(path);
+  capture.file = xe::filesystem::OpenFile(path, "wb");
+  if (!capture.file) {
+    XELOGE("Failed to open the profiler trace file {}",
+           xe::path_to_utf8(path));
+    return;
+  }
+  capture.first_event = true;
+  capture.start_host_tick = MP_TICK();
+  capture.base_tick_valid = false;
+  std::memset(capture.depths, 0, sizeof(capture.depths));
+  for (std::string& thread_name : capture.thread_names) {
+    thread_name.clear();
+  }
+  capture.buffer.clear();
+  fmt::format_to(std::back_inserter(capture.buffer),
+                 "{{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  lock_profiling::Reset();
+  XELOGI("Profiler trace capture started, writing to {}",
+         xe::path_to_utf8(path));
+}
+
+void Profiler::StopTraceCapture() {
+  TraceCapture& capture = GetTraceCapture();
+  std::lock_guard<std::mutex> lock(capture.mutex);
+  StopTraceCaptureLocked(capture);
+}
+
+void Profiler::ToggleTraceCapture() {
+  if (is_capturing_trace()) {
+    StopTraceCapture();
+  } else {
+    StartTraceCapture();
+  }
+}
+
+bool Profiler::is_capturing_trace() {
+  TraceCapture& capture = GetTraceCapture();
+  std::lock_guard<std::mutex> lock(capture.mutex);
+  return capture.file != nullptr;
+}
+
 bool Profiler::is_enabled() { return true; }
 
 bool Profiler::is_visible() { return is_enabled() && MicroProfileIsDrawing(); }
@@ -78,6 +351,11 @@ void Profiler::Initialize() {
   MicroProfileForceEnableGroup("cpu", MicroProfileTokenTypeCpu);
   MicroProfileForceEnableGroup("gpu", MicroProfileTokenTypeCpu);
   MicroProfileForceEnableGroup("internal", MicroProfileTokenTypeCpu);
+  if (cvars::profiler_gpu_timers) {
+    // All GPU scopes are in the GPU group regardless of the group name passed
+    // to the macros.
+    MicroProfileForceEnableGroup("GPU", MicroProfileTokenTypeGpu);
+  }
   g_MicroProfile.nGroupMask = g_MicroProfile.nForceGroup;
   g_MicroProfile.nActiveGroup = g_MicroProfile.nActiveGroupWanted =
       g_MicroProfile.nGroupMask;
@@ -100,6 +378,10 @@ void Profiler::Initialize() {
   MicroProfileSetEnableAllGroups(true);
   MicroProfileSetForceMetaCounters(false);
 #endif  // XE_OPTION_PROFILING_UI
+
+  if (cvars::profiler_trace_on_start) {
+    StartTraceCapture();
+  }
 }
 
 void Profiler::Dump() {
@@ -111,6 +393,7 @@ void Profiler::Dump() {
 }
 
 void Profiler::Shutdown() {
+  StopTraceCapture();
   SetUserIO(0, nullptr, nullptr, nullptr);
   window_ = nullptr;
   MicroProfileShutdown();
@@ -275,11 +558,61 @@ void Profiler::SetUserIO(size_t z_order, ui::Window* window,
 
 void Profiler::Flip() {
   MicroProfileFlip();
+  {
+    TraceCapture& capture = GetTraceCapture();
+    std::lock_guard<std::mutex> lock(capture.mutex);
+    if (capture.file) {
+      ExportTraceFrame(capture);
+      if (cvars::profiler_trace_seconds > 0.0 &&
+          double(MP_TICK() - capture.start_host_tick) >=
+              cvars::profiler_trace_seconds *
+                  double(MicroProfileTicksPerSecondCpu())) {
+        StopTraceCaptureLocked(capture);
+      }
+    }
+  }
   // This can be called from non-UI threads, so not trying to access the drawer
   // to trigger redraw here as it's owned and managed exclusively by the UI
   // thread. Relying on continuous painting currently.
 }
 
+void Profiler::SetGpuTimerSource(GpuTimerSource* source) {
+  std::lock_guard<std::recursive_mutex> lock(MicroProfileMutex());
+  gpu_timer_source_ = source;
+  MicroProfileGpu& gpu = g_MicroProfile.GPU;
+  // Shutdown and GetTickReference are not needed - the source is owned by the
+  // GPU backend, and the tick reference is not used by the profiler.
+  std::memset(&gpu, 0, sizeof(gpu));
+  if (source) {
+    gpu.Flip = GpuTimerFlip;
+    gpu.InsertTimer = GpuTimerInsertTimer;
+    gpu.GetTimeStamp = GpuTimerGetTimestamp;
+    gpu.GetTicksPerSecond = GpuTimerGetTicksPerSecond;
+  }
+}
+
+void Profiler::SetGpuContext(void* context) {
+  MicroProfileGpuSetContext(context);
+}
+
+uint32_t Profiler::GpuTimerFlip() {
+  // The frame start timestamp, written to the context of the flipping thread.
+  MicroProfileThreadLog* log = MicroProfileGetOrCreateThreadLog();
+  return gpu_timer_source_->InsertTimer(log ? log->pContextGpu : nullptr);
+}
+
+uint32_t Profiler::GpuTimerInsertTimer(void* context) {
+  return gpu_timer_source_->InsertTimer(context);
+}
+
+uint64_t Profiler::GpuTimerGetTimestamp(uint32_t index) {
+  return gpu_timer_source_->GetTimestamp(index);
+}
+
+uint64_t Profiler::GpuTimerGetTicksPerSecond() {
+  return gpu_timer_source_->GetTicksPerSecond();
+}
+
 #if XE_OPTION_PROFILING_UI
 void Profiler::ProfilerUIDrawer::Draw(ui::UIDrawContext& ui_draw_context) {
   if (!window_ || !presenter_ || !drawer_) {
@@ -347,6 +680,12 @@ void Profiler::SetUserIO(size_t z_order, ui::Window* window,
                          ui::Presenter* presenter,
                          ui::ImmediateDrawer* immediate_drawer) {}
 void Profiler::Flip() {}
+void Profiler::StartTraceCapture() {}
+void Profiler::StopTraceCapture() {}
+void Profiler::ToggleTraceCapture() {}
+bool Profiler::is_capturing_trace() { return false; }
+void Profiler::SetGpuTimerSource(GpuTimerSource* source) {}
+void Profiler::SetGpuContext(void* context) {}
 
 #endif  // XE_OPTION_PROFILING
 
@@ -55,11 +55,13 @@ namespace xe {
 // Declares a previously defined profile scope. Use in a translation unit.
 #define DECLARE_profile_cpu(name) MICROPROFILE_DECLARE(name)
 
-// Defines a profiling scope for GPU tasks.
-// Use `COUNT_profile_gpu(name)` to activate the scope.
+// Defines a profiling scope for host GPU tasks, timed with host GPU timestamps
+// written to the command list set with Profiler::SetGpuContext. All GPU scopes
+// are in the single GPU group of the profiler, and the group name is only for
+// consistency with the CPU scopes.
+// Use `SCOPE_profile_gpu(name)` to activate the scope.
 #define DEFINE_profile_gpu(name, group_name, scope_name) \
-  MICROPROFILE_DEFINE_GPU(name, group_name, scope_name,  \
-                          xe::Profiler::GetColor(scope_name))
+  MICROPROFILE_DEFINE_GPU(name, scope_name, xe::Profiler::GetColor(scope_name))
 
 // Declares a previously defined profile scope. Use in a translation unit.
 #define DECLARE_profile_gpu(name) MICROPROFILE_DECLARE_GPU(name)
@@ -87,14 +89,12 @@ namespace xe {
 // Enters a GPU profiling scope, active for the duration of the containing
 // block. No previous definition required.
 #define SCOPE_profile_gpu_i(group_name, scope_name) \
-  MICROPROFILE_SCOPEGPUI(group_name, scope_name,    \
-                         xe::Profiler::GetColor(scope_name))
+  MICROPROFILE_SCOPEGPUI(scope_name, xe::Profiler::GetColor(scope_name))
 
 // Enters a GPU profiling scope by function name, active for the duration of
 // the containing block. No previous definition required.
-#define SCOPE_profile_gpu_f(group_name)            \
-  MICROPROFILE_SCOPEGPUI(group_name, __FUNCTION__, \
-                         xe::Profiler::GetColor(__FUNCTION__))
+#define SCOPE_profile_gpu_f(group_name) \
+  MICROPROFILE_SCOPEGPUI(__FUNCTION__, xe::Profiler::GetColor(__FUNCTION__))
 
 // Adds a number to a counter
 #define COUNT_profile_add(name, count) MICROPROFILE_COUNTER_ADD(name, count)
@@ -160,6 +160,21 @@ namespace xe {
 
 class Profiler {
  public:
+  // Writer of host GPU timestamps for the GPU profiling scopes, provided by the
+  // GPU backend. Called only on the thread that has set the source, which must
+  // be the thread entering the GPU scopes and flipping the profiler frames.
+  class GpuTimerSource {
+   public:
+    virtual ~GpuTimerSource() = default;
+    // Writes a timestamp to the context (set with SetGpuContext, may be
+    // nullptr), returning its index, or UINT32_MAX if it can't be written.
+    virtual uint32_t InsertTimer(void* context) = 0;
+    // Returns the value of the timestamp written earlier, or UINT64_MAX if it's
+    // not available (yet or anymore).
+    virtual uint64_t GetTimestamp(uint32_t index) = 0;
+    virtual uint64_t GetTicksPerSecond() = 0;
+  };
+
   static bool is_enabled();
   static bool is_visible();
 
@@ -200,6 +215,22 @@ class Profiler {
   // Starts a new frame on the profiler
   static void Flip();
 
+  // Streams the CPU and GPU scopes of the frames flipped from now on, with the
+  // names of the threads, to profiler_trace_path in the Chrome trace event
+  // format (for chrome://tracing or Perfetto), for profiler_trace_seconds or
+  // until stopped.
+  static void StartTraceCapture();
+  static void StopTraceCapture();
+  static void ToggleTraceCapture();
+  static bool is_capturing_trace();
+
+  // The source must be valid until it's replaced, or reset to nullptr.
+  static void SetGpuTimerSource(GpuTimerSource* source);
+  // Sets the host GPU command list (or another command recording object,
+  // depending on the GpuTimerSource) the GPU scopes entered on the calling
+  // thread write timestamps to, or nullptr if none is open.
+  static void SetGpuContext(void* context);
+
  private:
 #if XE_OPTION_PROFILING
   class ProfilerWindowInputListener final : public ui::WindowInputListener {
@@ -228,9 +259,15 @@ class Profiler {
 #endif  // XE_OPTION_PROFILING_UI
   static void PostInputEvent();
 
+  static uint32_t GpuTimerFlip();
+  static uint32_t GpuTimerInsertTimer(void* context);
+  static uint64_t GpuTimerGetTimestamp(uint32_t index);
+  static uint64_t GpuTimerGetTicksPerSecond();
+
   static ProfilerWindowInputListener input_listener_;
   static size_t z_order_;
   static ui::Window* window_;
+  static GpuTimerSource* gpu_timer_source_;
 #if XE_OPTION_PROFILING_UI
   static ProfilerUIDrawer ui_drawer_;
   static ui::Presenter* presenter_;
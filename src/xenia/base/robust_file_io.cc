@@ -63,9 +63,52 @@ uint64_t GetCurrentTimeMs() {
 
 }  // namespace
 
+// RetryPolicy implementation
+RetryPolicy::RetryPolicy(const RobustIOConfig& config) : config_(config) {}
+
+std::chrono::milliseconds RetryPolicy::GetRetryDelay(int retry_count) const {
+  int shift = config_.exponential_backoff ? std::min(retry_count - 1, 16) : 0;
+  switch (InterferenceDetector::GetInstance().current_level()) {
+    case InterferenceDetector::InterferenceLevel::None:
+      shift = 0;
+      break;
+    case InterferenceDetector::InterferenceLevel::Low:
+      shift = std::min(shift, 1);
+      break;
+    default:
+      break;
+  }
+  int64_t delay_ms = int64_t(config_.retry_delay_ms) << std::max(shift, 0);
+  return std::chrono::milliseconds(std::min(delay_ms, int64_t(5000)));
+}
+
+bool RetryPolicy::WaitBeforeRetry(int retry_count) {
+  if (retry_count > config_.max_retries) {
+    return false;
+  }
+  auto delay = GetRetryDelay(retry_count);
+  XELOGI("Waiting {}ms before retry...", delay.count());
+  std::unique_lock<std::mutex> lock(mutex_);
+  return !cancel_cond_.wait_for(lock, delay, [this]() { return cancelled_; });
+}
+
+void RetryPolicy::Cancel() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancelled_ = true;
+  }
+  cancel_cond_.notify_all();
+}
+
+bool RetryPolicy::is_cancelled() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cancelled_;
+}
+
 // RobustFileReader implementation
 RobustFileReader::RobustFileReader(const RobustIOConfig& config)
     : config_(config),
+      retry_policy_(config),
       total_retries_(0),
       interference_count_(0),
       recovered_errors_(0) {}
@@ -224,50 +267,77 @@ IOResult RobustFileReader::VerifyFileAccess(const std::filesystem::path& path) {
 IOResult RobustFileReader::ReadWithRetry(const std::filesystem::path& path,
                                          std::vector<uint8_t>& data) {
   IOResult last_result;
+  // Offset up to which the file has been read, kept across attempts so only
+  // the part that failed is read again.
+  size_t bytes_read = 0;
+  size_t file_size = 0;
+  bool size_known = false;
 
   for (int retry = 0; retry <= config_.max_retries; retry++) {
     if (retry > 0) {
-      XELOGW("Retry attempt {} of {}", retry, config_.max_retries);
+      XELOGW("Retry attempt {} of {} at offset {}", retry, config_.max_retries,
+             bytes_read);
       total_retries_++;
-      WaitBeforeRetry(retry);
+      if (!retry_policy_.WaitBeforeRetry(retry)) {
+        XELOGW("Retrying the read of {} was cancelled",
+               xe::path_to_utf8(path));
+        break;
+      }
     }
 
     try {
       std::ifstream file(path, std::ios::binary | std::ios::ate);
       if (!file.is_open()) {
-        last_result = {IOErrorType::FileNotFound, "Could not open file", 0,
-                       retry, false};
+        last_result = {IOErrorType::FileNotFound, "Could not open file",
+                       bytes_read, retry, false};
         continue;
       }
 
-      size_t file_size = file.tellg();
-      file.seekg(0, std::ios::beg);
-
+      size_t current_size = file.tellg();
+      if (size_known && current_size != file_size) {
+        // Changed since the previous attempt, start over.
+        bytes_read = 0;
+      }
+      file_size = current_size;
+      size_known = true;
       data.resize(file_size);
+      file.seekg(bytes_read, std::ios::beg);
+
+      while (bytes_read < file_size) {
+        size_t to_read =
+            std::min(std::max(config_.read_chunk_size, size_t(1)),
+                     file_size - bytes_read);
+        auto start_time = GetCurrentTimeMs();
+        file.read(reinterpret_cast<char*>(data.data() + bytes_read), to_read);
+        auto duration = GetCurrentTimeMs() - start_time;
+        size_t chunk_bytes_read = size_t(file.gcount());
+        bytes_read += chunk_bytes_read;
+        if (chunk_bytes_read == to_read) {
+          continue;
+        }
 
-      auto start_time = GetCurrentTimeMs();
-      file.read(reinterpret_cast<char*>(data.data()), file_size);
-      auto duration = GetCurrentTimeMs() - start_time;
-
-      if (!file.good() && !file.eof()) {
-        XELOGE("Read error occurred");
-        last_result = {IOErrorType::ReadError, "Read operation failed", 0,
-                       retry, false};
-
-        // Detect interference
-        if (DetectInterference(duration, file_size)) {
-          interference_count_++;
-          last_result.error = IOErrorType::InterferenceDetected;
+        if (!file.eof()) {
+          XELOGE("Read error occurred at offset {}", bytes_read);
+          last_result = {IOErrorType::ReadError, "Read operation failed",
+                         bytes_read, retry, false};
+
+          // Detect interference
+          if (DetectInterference(duration, to_read)) {
+            interference_count_++;
+            InterferenceDetector::GetInstance().RecordIOTiming(duration,
+                                                               to_read);
+            last_result.error = IOErrorType::InterferenceDetected;
+          }
+        } else {
+          XELOGW("Partial read: {} of {} bytes", bytes_read, file_size);
+          last_result = {
+              IOErrorType::PartialRead,
+              fmt::format("Read {} of {} bytes", bytes_read, file_size),
+              bytes_read, retry, false};
         }
-        continue;
+        break;
       }
-
-      size_t bytes_read = file.gcount();
       if (bytes_read != file_size) {
-        XELOGW("Partial read: {} of {} bytes", bytes_read, file_size);
-        last_result = {IOErrorType::PartialRead,
-                       fmt::format("Read {} of {} bytes", bytes_read, file_size),
-                       bytes_read, retry, false};
         continue;
       }
 
@@ -283,7 +353,7 @@ IOResult RobustFileReader::ReadWithRetry(const std::filesystem::path& path,
 
     } catch (const std::exception& e) {
       XELOGE("Exception during read: {}", e.what());
-      last_result = {IOErrorType::Unknown, e.what(), 0, retry, false};
+      last_result = {IOErrorType::Unknown, e.what(), bytes_read, retry, false};
     }
   }
 
@@ -329,18 +399,6 @@ bool RobustFileReader::DetectInterference(uint64_t read_time_ms,
   return false;
 }
 
-void RobustFileReader::WaitBeforeRetry(int retry_count) {
-  int delay_ms = config_.retry_delay_ms;
-
-  if (config_.exponential_backoff) {
-    delay_ms = config_.retry_delay_ms * (1 << (retry_count - 1));
-    delay_ms = std::min(delay_ms, 5000);  // Max 5 seconds
-  }
-
-  XELOGI("Waiting {}ms before retry...", delay_ms);
-  std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
-}
-
 // InterferenceDetector implementation
 InterferenceDetector& InterferenceDetector::GetInstance() {
   static InterferenceDetector instance;
@@ -356,6 +414,11 @@ InterferenceDetector::~InterferenceDetector() = default;
 
 InterferenceDetector::InterferenceLevel
 InterferenceDetector::DetectCurrentLevel() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return UpdateLevel();
+}
+
+InterferenceDetector::InterferenceLevel InterferenceDetector::UpdateLevel() {
   if (recent_samples_.empty()) {
     return InterferenceLevel::None;
   }
@@ -365,16 +428,17 @@ InterferenceDetector::DetectCurrentLevel() {
   for (const auto& sample : recent_samples_) {
     total_time += sample.duration_ms;
   }
-  avg_io_time_ms_ = total_time / recent_samples_.size();
+  uint64_t avg_io_time_ms = total_time / recent_samples_.size();
+  avg_io_time_ms_ = avg_io_time_ms;
 
   // Determine interference level
-  if (avg_io_time_ms_ < 100) {
+  if (avg_io_time_ms < 100) {
     current_level_ = InterferenceLevel::None;
-  } else if (avg_io_time_ms_ < 300) {
+  } else if (avg_io_time_ms < 300) {
     current_level_ = InterferenceLevel::Low;
-  } else if (avg_io_time_ms_ < 1000) {
+  } else if (avg_io_time_ms < 1000) {
     current_level_ = InterferenceLevel::Medium;
-  } else if (avg_io_time_ms_ < 3000) {
+  } else if (avg_io_time_ms < 3000) {
     current_level_ = InterferenceLevel::High;
   } else {
     current_level_ = InterferenceLevel::Critical;
@@ -389,6 +453,7 @@ void InterferenceDetector::RecordIOTiming(uint64_t duration_ms, size_t bytes) {
   sample.duration_ms = duration_ms;
   sample.bytes = bytes;
 
+  std::lock_guard<std::mutex> lock(mutex_);
   recent_samples_.push_back(sample);
 
   // Keep only last 20 samples
@@ -397,7 +462,7 @@ void InterferenceDetector::RecordIOTiming(uint64_t duration_ms, size_t bytes) {
   }
 
   // Update interference detection
-  DetectCurrentLevel();
+  UpdateLevel();
 }
 
 bool InterferenceDetector::IsInterferenceActive() const {
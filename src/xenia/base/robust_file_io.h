@@ -10,8 +10,12 @@
 #ifndef XENIA_BASE_ROBUST_FILE_IO_H_
 #define XENIA_BASE_ROBUST_FILE_IO_H_
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <filesystem>
 #include <functional>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -77,6 +81,33 @@ struct RobustIOConfig {
   bool log_errors = true;
 };
 
+// Decides how long to wait before retrying failed I/O. The delay only grows
+// with the attempts while the InterferenceDetector reports slow I/O, as
+// waiting longer doesn't help with other errors. Waits can be cancelled from
+// another thread.
+class RetryPolicy {
+ public:
+  explicit RetryPolicy(const RobustIOConfig& config = RobustIOConfig());
+
+  // Delay before retry attempt retry_count, starting at 1.
+  std::chrono::milliseconds GetRetryDelay(int retry_count) const;
+
+  // Waits before retry attempt retry_count. Returns false, without waiting
+  // for the whole delay, if there are no attempts left or if the policy has
+  // been cancelled.
+  bool WaitBeforeRetry(int retry_count);
+
+  // Makes the current and all future waits fail.
+  void Cancel();
+  bool is_cancelled() const;
+
+ private:
+  RobustIOConfig config_;
+  mutable std::mutex mutex_;
+  std::condition_variable cancel_cond_;
+  bool cancelled_ = false;
+};
+
 // Robust file reader with retry logic and error recovery
 class RobustFileReader {
  public:
@@ -100,6 +131,10 @@ class RobustFileReader {
   // Check if file is accessible and ready
   IOResult VerifyFileAccess(const std::filesystem::path& path);
 
+  // Stops waiting for retries, failing the current read, for use from
+  // another thread.
+  void Cancel() { retry_policy_.Cancel(); }
+
   // Get statistics
   int GetTotalRetries() const { return total_retries_; }
   int GetInterferenceDetections() const { return interference_count_; }
@@ -111,9 +146,9 @@ class RobustFileReader {
   IOResult VerifyData(const std::vector<uint8_t>& data, size_t expected_size);
   uint32_t CalculateCRC32(const std::vector<uint8_t>& data);
   bool DetectInterference(uint64_t read_time_ms, size_t bytes_read);
-  void WaitBeforeRetry(int retry_count);
 
   RobustIOConfig config_;
+  RetryPolicy retry_policy_;
   int total_retries_;
   int interference_count_;
   int recovered_errors_;
@@ -175,6 +210,7 @@ class InterferenceDetector {
   // Statistics
   uint64_t GetAverageIOTime() const { return avg_io_time_ms_; }
   size_t GetInterferenceCount() const { return interference_count_; }
+  InterferenceLevel current_level() const { return current_level_; }
 
  private:
   InterferenceDetector();
@@ -189,10 +225,16 @@ class InterferenceDetector {
     size_t bytes;
   };
 
+  // Updates the level from the samples, mutex_ must be held.
+  InterferenceLevel UpdateLevel();
+
+  // Samples are recorded by the threads doing I/O, and retries may check the
+  // level from any thread.
+  std::mutex mutex_;
   std::vector<IOSample> recent_samples_;
-  uint64_t avg_io_time_ms_;
-  size_t interference_count_;
-  InterferenceLevel current_level_;
+  std::atomic<uint64_t> avg_io_time_ms_;
+  std::atomic<size_t> interference_count_;
+  std::atomic<InterferenceLevel> current_level_;
 };
 
 // Helper functions for common operations
@@ -0,0 +1,165 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/startup_timeline.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/threading.h"
+
+DEFINE_path(startup_trace_path, "",
+            "Path to write the timeline of the title startup phases to, in the "
+            "Chrome trace event format, when the first guest frame is issued.",
+            "General");
+
+namespace xe {
+namespace startup_timeline {
+
+namespace {
+
+struct Phase {
+  const char* name;
+  uint32_t thread_id;
+  uint64_t begin_tick;
+  // 0 while the phase is still running.
+  uint64_t end_tick;
+};
+
+struct Timeline {
+  std::mutex mutex;
+  // Whether the phases are being recorded - cleared on the first frame to
+  // make the per-swap check cheap.
+  std::atomic<bool> recording{false};
+  uint64_t reset_tick = 0;
+  std::vector<Phase> phases;
+};
+
+Timeline& GetTimeline() {
+  static Timeline timeline;
+  return timeline;
+}
+
+uint64_t TicksToMicroseconds(uint64_t ticks) {
+  return ticks * 1000000 / Clock::QueryHostTickFrequency();
+}
+
+void WriteChromeTrace(const Timeline& timeline, uint64_t first_frame_tick,
+                      uint32_t first_frame_thread_id) {
+  std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  for (const Phase& phase : timeline.phases) {
+    // Phase names are literals without characters needing escaping.
+    json += fmt::format(
+        "{{\"name\":\"{}\",\"cat\":\"startup\",\"ph\":\"X\",\"pid\":1,"
+        "\"tid\":{},\"ts\":{},\"dur\":{}}},\n",
+        phase.name, phase.thread_id,
+        TicksToMicroseconds(phase.begin_tick - timeline.reset_tick),
+        TicksToMicroseconds(phase.end_tick - phase.begin_tick));
+  }
+  json += fmt::format(
+      "{{\"name\":\"First frame\",\"cat\":\"startup\",\"ph\":\"i\","
+      "\"s\":\"g\",\"pid\":1,\"tid\":{},\"ts\":{}}}\n]}}\n",
+      first_frame_thread_id,
+      TicksToMicroseconds(first_frame_tick - timeline.reset_tick));
+
+  const std::filesystem::path& path = cvars::startup_trace_path;
+  xe::filesystem::CreateParentFolder(path);
+  FILE* file = xe::filesystem::OpenFile(path, "wb");
+  bool written = false;
+  if (file) {
+    written = fwrite(json.data(), 1, json.size(), file) == json.size();
+    fclose(file);
+  }
+  if (!written) {
+    XELOGE("Failed to write the startup trace to {}",
+           xe::path_to_utf8(path));
+  }
+}
+
+}  // namespace
+
+void Reset() {
+  Timeline& timeline = GetTimeline();
+  std::lock_guard<std::mutex> lock(timeline.mutex);
+  timeline.reset_tick = Clock::QueryHostTickCount();
+  timeline.phases.clear();
+  timeline.recording.store(true, std::memory_order_release);
+}
+
+void BeginPhase(const char* name) {
+  Timeline& timeline = GetTimeline();
+  if (!timeline.recording.load(std::memory_order_acquire)) {
+    return;
+  }
+  uint64_t tick = Clock::QueryHostTickCount();
+  std::lock_guard<std::mutex> lock(timeline.mutex);
+  timeline.phases.push_back(
+      {name, xe::threading::current_thread_system_id(), tick, 0});
+}
+
+void EndPhase(const char* name) {
+  Timeline& timeline = GetTimeline();
+  if (!timeline.recording.load(std::memory_order_acquire)) {
+    return;
+  }
+  uint64_t tick = Clock::QueryHostTickCount();
+  std::lock_guard<std::mutex> lock(timeline.mutex);
+  // The latest running phase with the name, as phases may be nested or
+  // repeated.
+  for (auto it = timeline.phases.rbegin(); it != timeline.phases.rend();
+       ++it) {
+    if (!it->end_tick && !std::strcmp(it->name, name)) {
+      it->end_tick = tick;
+      return;
+    }
+  }
+}
+
+void OnGuestSwap() {
+  Timeline& timeline = GetTimeline();
+  if (!timeline.recording.load(std::memory_order_acquire)) {
+    return;
+  }
+  uint64_t tick = Clock::QueryHostTickCount();
+  uint32_t thread_id = xe::threading::current_thread_system_id();
+  std::lock_guard<std::mutex> lock(timeline.mutex);
+  if (!timeline.recording.exchange(false, std::memory_order_acq_rel)) {
+    return;
+  }
+  // Phases still running (such as those of a failed launch that hasn't
+  // cleaned up) end at the first frame.
+  for (Phase& phase : timeline.phases) {
+    if (!phase.end_tick) {
+      phase.end_tick = tick;
+    }
+  }
+  XELOGI("Startup timeline, {:.3f} ms from the launch to the first frame:",
+         TicksToMicroseconds(tick - timeline.reset_tick) / 1000.0);
+  for (const Phase& phase : timeline.phases) {
+    XELOGI("  {:>10.3f} ms +{:>10.3f} ms  thread {:>6}  {}",
+           TicksToMicroseconds(phase.begin_tick - timeline.reset_tick) /
+               1000.0,
+           TicksToMicroseconds(phase.end_tick - phase.begin_tick) / 1000.0,
+           phase.thread_id, phase.name);
+  }
+  if (!cvars::startup_trace_path.empty()) {
+    WriteChromeTrace(timeline, tick, thread_id);
+  }
+}
+
+}  // namespace startup_timeline
+}  // namespace xe
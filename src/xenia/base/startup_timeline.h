@@ -0,0 +1,51 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_STARTUP_TIMELINE_H_
+#define XENIA_BASE_STARTUP_TIMELINE_H_
+
+#include "xenia/base/cvar.h"
+
+DECLARE_path(startup_trace_path);
+
+namespace xe {
+namespace startup_timeline {
+
+// Records the phases of launching a title, from the launch request to the
+// first guest frame, with the host timestamps and the threads they ran on.
+// When the first frame is issued, the timeline is logged and, if
+// startup_trace_path is set, written in the Chrome trace event format (for
+// chrome://tracing or Perfetto). Phases after the first frame are ignored
+// until the next launch.
+
+// Starts a new timeline, called when a title launch is requested.
+void Reset();
+// Phase names must be string literals. Ending a phase that hasn't been begun
+// on any thread is ignored, so an optional phase may be ended unconditionally.
+void BeginPhase(const char* name);
+void EndPhase(const char* name);
+// The guest has issued a swap - the first one after Reset completes the
+// timeline.
+void OnGuestSwap();
+
+class ScopedPhase {
+ public:
+  explicit ScopedPhase(const char* name) : name_(name) { BeginPhase(name); }
+  ~ScopedPhase() { EndPhase(name_); }
+  ScopedPhase(const ScopedPhase&) = delete;
+  ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+ private:
+  const char* name_;
+};
+
+}  // namespace startup_timeline
+}  // namespace xe
+
+#endif  // XENIA_BASE_STARTUP_TIMELINE_H_
@@ -0,0 +1,92 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/bit_map.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+TEST_CASE("BitMap acquires every entry once", "[bit_map]") {
+  // More than 64 words to use multiple summary words.
+  constexpr size_t kEntryCount = 64 * 65;
+  BitMap bit_map(kEntryCount);
+  std::vector<bool> acquired(kEntryCount, false);
+  for (size_t i = 0; i < kEntryCount; ++i) {
+    size_t index = bit_map.Acquire();
+    REQUIRE(index < kEntryCount);
+    REQUIRE(!acquired[index]);
+    acquired[index] = true;
+  }
+  REQUIRE(bit_map.Acquire() == size_t(-1));
+
+  // Releasing in the last and in a full word in the middle.
+  bit_map.Release(kEntryCount - 1);
+  bit_map.Release(64 * 30 + 5);
+  size_t first = bit_map.Acquire();
+  size_t second = bit_map.Acquire();
+  REQUIRE(std::min(first, second) == 64 * 30 + 5);
+  REQUIRE(std::max(first, second) == kEntryCount - 1);
+  REQUIRE(bit_map.Acquire() == size_t(-1));
+
+  bit_map.Reset();
+  REQUIRE(bit_map.Acquire() == 0);
+}
+
+TEST_CASE("BitMap data can be replaced", "[bit_map]") {
+  BitMap bit_map(128);
+  // Only the first entry of the second word is free.
+  bit_map.SetData({0, 1ull << 63});
+  REQUIRE(bit_map.Acquire() == 64);
+  REQUIRE(bit_map.Acquire() == size_t(-1));
+}
+
+TEST_CASE("BitMap is thread-safe", "[bit_map]") {
+  constexpr size_t kEntryCount = 64 * 8;
+  constexpr size_t kThreadCount = 4;
+  BitMap bit_map(kEntryCount);
+  std::vector<std::vector<size_t>> thread_indices(kThreadCount);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    threads.emplace_back([&bit_map, &indices = thread_indices[i]]() {
+      for (size_t j = 0; j < 10000; ++j) {
+        size_t index = bit_map.Acquire();
+        if (index != size_t(-1)) {
+          indices.push_back(index);
+        }
+        if (indices.size() > kEntryCount / kThreadCount / 2) {
+          bit_map.Release(indices.front());
+          indices.erase(indices.begin());
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  std::vector<size_t> all_indices;
+  for (const std::vector<size_t>& indices : thread_indices) {
+    all_indices.insert(all_indices.end(), indices.begin(), indices.end());
+  }
+  std::sort(all_indices.begin(), all_indices.end());
+  REQUIRE(std::adjacent_find(all_indices.begin(), all_indices.end()) ==
+          all_indices.end());
+  // All the entries not held are reachable.
+  size_t free_count = 0;
+  while (bit_map.Acquire() != size_t(-1)) {
+    ++free_count;
+  }
+  REQUIRE(free_count + all_indices.size() == kEntryCount);
+}
+
+}  // namespace xe::base::test
@@ -0,0 +1,53 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/clock.h"
+
+#include <chrono>
+#include <thread>
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+TEST_CASE("Guest tick count follows the ratio", "[clock]") {
+  cvars::clock_no_scaling = false;
+  uint64_t original_frequency = Clock::guest_tick_frequency();
+  Clock::set_guest_time_scalar(1.0);
+
+  SECTION("Host frequency") {
+    Clock::set_guest_tick_frequency(Clock::QueryHostTickFrequency());
+    uint64_t host_start = Clock::QueryHostTickCount();
+    uint64_t guest_start = Clock::QueryGuestTickCount();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint64_t guest_end = Clock::QueryGuestTickCount();
+    uint64_t host_end = Clock::QueryHostTickCount();
+    // The guest interval is within the host one, and has the same length
+    // except for the time between the queries.
+    uint64_t guest_delta = guest_end - guest_start;
+    uint64_t host_delta = host_end - host_start;
+    REQUIRE(guest_delta <= host_delta);
+    REQUIRE(guest_delta >= host_delta - Clock::QueryHostTickFrequency() / 100);
+  }
+
+  SECTION("Monotonic across ratio changes") {
+    Clock::set_guest_tick_frequency(50000000);
+    uint64_t before = Clock::QueryGuestTickCount();
+    Clock::set_guest_time_scalar(2.0);
+    uint64_t scaled = Clock::QueryGuestTickCount();
+    REQUIRE(scaled >= before);
+    Clock::set_guest_time_scalar(0.5);
+    REQUIRE(Clock::QueryGuestTickCount() >= scaled);
+  }
+
+  Clock::set_guest_time_scalar(1.0);
+  Clock::set_guest_tick_frequency(original_frequency);
+}
+
+}  // namespace xe::base::test
@@ -0,0 +1,129 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <cstring>
+#include <vector>
+
+#include "xenia/base/crypto.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+using namespace xe::crypto;
+
+static std::vector<uint8_t> CryptoTestData(size_t size) {
+  std::vector<uint8_t> data(size);
+  uint32_t seed = 1;
+  for (uint8_t& byte : data) {
+    seed = seed * 1103515245 + 12345;
+    byte = uint8_t(seed >> 16);
+  }
+  return data;
+}
+
+TEST_CASE("AES-128 with the host instructions", "[crypto]") {
+  if (!HasAesInstructions()) {
+    WARN("The host doesn't have the AES instructions");
+    return;
+  }
+
+  // FIPS-197 appendix A.1 key expansion.
+  const uint8_t expansion_key[16] = {0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE,
+                                     0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88,
+                                     0x09, 0xCF, 0x4F, 0x3C};
+  const uint8_t last_round_key[16] = {0xD0, 0x14, 0xF9, 0xA8, 0xC9, 0xEE,
+                                      0x25, 0x89, 0xE1, 0x3F, 0x0C, 0xC8,
+                                      0xB6, 0x63, 0x0C, 0xA6};
+  uint8_t round_keys[kAes128RoundKeysSize];
+  Aes128ExpandKey(expansion_key, round_keys);
+  REQUIRE(!std::memcmp(round_keys, expansion_key, 16));
+  REQUIRE(!std::memcmp(round_keys + 10 * 16, last_round_key, 16));
+
+  // FIPS-197 appendix C.1 example.
+  uint8_t key[16], plaintext[16];
+  for (uint8_t i = 0; i < 16; ++i) {
+    key[i] = i;
+    plaintext[i] = uint8_t(i * 0x11);
+  }
+  const uint8_t ciphertext[16] = {0x69, 0xC4, 0xE0, 0xD8, 0x6A, 0x7B,
+                                  0x04, 0x30, 0xD8, 0xCD, 0xB7, 0x80,
+                                  0x70, 0xB4, 0xC5, 0x5A};
+  uint8_t decryption_round_keys[kAes128RoundKeysSize];
+  Aes128ExpandKey(key, round_keys);
+  Aes128InvertRoundKeys(round_keys, decryption_round_keys);
+  uint8_t block[16];
+  Aes128EncryptEcb(round_keys, plaintext, block, sizeof(block));
+  REQUIRE(!std::memcmp(block, ciphertext, sizeof(block)));
+  Aes128DecryptEcb(decryption_round_keys, block, block, sizeof(block));
+  REQUIRE(!std::memcmp(block, plaintext, sizeof(block)));
+
+  // Enough blocks for both the 4-block and the single-block loops, with CBC
+  // checked against chaining the ECB blocks.
+  std::vector<uint8_t> data = CryptoTestData(7 * 16);
+  std::vector<uint8_t> ecb(data.size()), cbc(data.size());
+  Aes128EncryptEcb(round_keys, data.data(), ecb.data(), data.size());
+  uint8_t iv[16] = {};
+  Aes128EncryptCbc(round_keys, data.data(), cbc.data(), 3 * 16, iv);
+  Aes128EncryptCbc(round_keys, data.data() + 3 * 16, cbc.data() + 3 * 16,
+                   4 * 16, iv);
+  REQUIRE(!std::memcmp(iv, cbc.data() + 6 * 16, sizeof(iv)));
+  uint8_t feed[16] = {};
+  for (size_t i = 0; i < data.size(); i += 16) {
+    for (size_t j = 0; j < 16; ++j) {
+      feed[j] ^= data[i + j];
+    }
+    Aes128EncryptEcb(round_keys, feed, feed, sizeof(feed));
+    REQUIRE(!std::memcmp(feed, cbc.data() + i, sizeof(feed)));
+  }
+
+  std::vector<uint8_t> decrypted(ecb);
+  Aes128DecryptEcb(decryption_round_keys, decrypted.data(), decrypted.data(),
+                   decrypted.size());
+  REQUIRE(decrypted == data);
+  std::memset(iv, 0, sizeof(iv));
+  decrypted = cbc;
+  Aes128DecryptCbc(decryption_round_keys, decrypted.data(), decrypted.data(),
+                   decrypted.size(), iv);
+  REQUIRE(decrypted == data);
+  REQUIRE(!std::memcmp(iv, cbc.data() + 6 * 16, sizeof(iv)));
+}
+
+TEST_CASE("SHA-1 with the host instructions", "[crypto]") {
+  std::vector<uint8_t> data = CryptoTestData(1000);
+  // Split so the blocks don't start at the beginning of the calls.
+  const size_t splits[][2] = {{0, 1000}, {3, 997}, {64, 200}, {100, 900}};
+  for (const auto& split : splits) {
+    sha1::SHA1 portable;
+    portable.processBytes(data.data(), split[0]);
+    portable.processBytes(data.data() + split[0], split[1]);
+    sha1::SHA1 sha;
+    Sha1ProcessBytes(&sha, data.data(), split[0]);
+    Sha1ProcessBytes(&sha, data.data() + split[0], split[1]);
+    REQUIRE(sha.getByteCount() == portable.getByteCount());
+    uint8_t digest[20], portable_digest[20];
+    sha.finalize(digest);
+    portable.finalize(portable_digest);
+    REQUIRE(!std::memcmp(digest, portable_digest, sizeof(digest)));
+  }
+
+  if (HasShaInstructions()) {
+    // FIPS 180-2 "abc" example, padded manually.
+    uint8_t block[64] = {'a', 'b', 'c', 0x80};
+    block[63] = 24;
+    uint32_t state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                         0xC3D2E1F0};
+    Sha1ProcessBlocks(state, block, 1);
+    const uint32_t digest[5] = {0xA9993E36, 0x4706816A, 0xBA3E2571,
+                                0x7850C26C, 0x9CD0D89D};
+    REQUIRE(!std::memcmp(state, digest, sizeof(digest)));
+  }
+}
+
+}  // namespace xe::base::test
@@ -0,0 +1,53 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/cvar.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+namespace {
+int32_t snapshot_test_value = 1;
+
+struct SnapshotTestValues {
+  int32_t doubled_value;
+  uint32_t load_count = 0;
+  void Load() {
+    doubled_value = snapshot_test_value * 2;
+    ++load_count;
+  }
+};
+}  // namespace
+
+TEST_CASE("Cvar snapshot is reloaded only after a change", "[cvar]") {
+  cvar::ConfigVar<int32_t> config_var("snapshot_test_value",
+                                      &snapshot_test_value, "", "General",
+                                      true);
+  cvar::Snapshot<SnapshotTestValues> snapshot;
+  REQUIRE(snapshot.Get().doubled_value == 2);
+  REQUIRE(snapshot.Get().load_count == 1);
+
+  // Setting the same value is not a change.
+  uint32_t generation = cvar::GetValueGeneration();
+  config_var.SetConfigValue(1);
+  REQUIRE(cvar::GetValueGeneration() == generation);
+  REQUIRE(snapshot.Get().load_count == 1);
+
+  config_var.SetConfigValue(3);
+  REQUIRE(cvar::GetValueGeneration() != generation);
+  REQUIRE(snapshot.Get().doubled_value == 6);
+  REQUIRE(snapshot.Get().load_count == 2);
+
+  config_var.SetGameConfigValue(4);
+  REQUIRE(snapshot.Get().doubled_value == 8);
+  REQUIRE(snapshot.Get().load_count == 3);
+}
+
+}  // namespace xe::base::test
@@ -0,0 +1,54 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/filesystem.h"
+
+#include <cstdio>
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+TEST_CASE("Shared stdio file is modified only if unchanged", "[filesystem]") {
+  auto path = std::filesystem::temp_directory_path() /
+              "xenia_filesystem_test_shared_file.bin";
+  std::filesystem::remove(path);
+  FILE* file = filesystem::OpenFile(path, "a+b");
+  REQUIRE(file);
+  FILE* other_file = filesystem::OpenFile(path, "a+b");
+  REQUIRE(other_file);
+
+  const uint32_t record = 0x12345678;
+  REQUIRE(filesystem::LockStdioFile(file, true));
+  REQUIRE(fwrite(&record, sizeof(record), 1, file) == 1);
+  // Unlocking flushes the record for the other handle.
+  REQUIRE(filesystem::UnlockStdioFile(file));
+  REQUIRE(filesystem::LockStdioFile(other_file, false));
+  REQUIRE(filesystem::Seek(other_file, 0, SEEK_END));
+  REQUIRE(filesystem::Tell(other_file) == int64_t(sizeof(record)));
+  REQUIRE(filesystem::UnlockStdioFile(other_file));
+
+  // Appended by the other handle since the size was obtained.
+  REQUIRE(filesystem::LockStdioFile(other_file, true));
+  REQUIRE(fwrite(&record, sizeof(record), 1, other_file) == 1);
+  REQUIRE(filesystem::UnlockStdioFile(other_file));
+  REQUIRE_FALSE(filesystem::LockStdioFileIfUnchanged(file, sizeof(record)));
+
+  REQUIRE(filesystem::LockStdioFileIfUnchanged(file, sizeof(record) * 2));
+  REQUIRE(filesystem::TruncateStdioFile(file, sizeof(record)));
+  REQUIRE(filesystem::UnlockStdioFile(file));
+  REQUIRE(filesystem::LockStdioFileIfUnchanged(other_file, sizeof(record)));
+  REQUIRE(filesystem::UnlockStdioFile(other_file));
+
+  fclose(other_file);
+  fclose(file);
+  std::filesystem::remove(path);
+}
+
+}  // namespace xe::base::test
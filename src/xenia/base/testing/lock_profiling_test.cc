@@ -0,0 +1,66 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/lock_profiling.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+TEST_CASE("Lock waits are aggregated per lock and call site",
+          "[lock_profiling]") {
+  lock_profiling::Reset();
+  uint64_t ticks_per_us = Clock::QueryHostTickFrequency() / 1000000;
+  REQUIRE(ticks_per_us > 0);
+
+  lock_profiling::RecordWait("a", "a.cc", 1, 3 * ticks_per_us);
+  lock_profiling::RecordWait("a", "a.cc", 1, 5 * ticks_per_us);
+  lock_profiling::RecordWait("a", "a.cc", 2, 100 * ticks_per_us);
+  lock_profiling::RecordWait("b", "b.cc", 1, 0);
+
+  auto statistics = lock_profiling::GetStatistics();
+  REQUIRE(statistics.size() == 2);
+  const lock_profiling::LockStatistics& a = statistics[0];
+  REQUIRE(a.name == "a");
+  REQUIRE(a.wait_count == 3);
+  REQUIRE(a.wait_us >= 107);
+  REQUIRE(a.max_wait_us >= 100);
+  // [2, 4) us, [4, 8) us, [64, 128) us.
+  REQUIRE(a.histogram[2] == 1);
+  REQUIRE(a.histogram[3] == 1);
+  REQUIRE(a.histogram[7] == 1);
+  REQUIRE(a.call_sites.size() == 2);
+  REQUIRE(a.call_sites[0].location == "a.cc:2");
+  REQUIRE(a.call_sites[1].location == "a.cc:1");
+  REQUIRE(a.call_sites[1].wait_count == 2);
+  REQUIRE(statistics[1].name == "b");
+  REQUIRE(statistics[1].histogram[0] == 1);
+
+  std::string json = lock_profiling::FormatStatisticsJson();
+  REQUIRE(json.find("\"name\": \"a\"") != std::string::npos);
+  REQUIRE(json.find("\"location\": \"a.cc:2\"") != std::string::npos);
+
+  lock_profiling::Reset();
+  REQUIRE(lock_profiling::GetStatistics().empty());
+}
+
+TEST_CASE("Very long lock waits go to the last histogram bucket",
+          "[lock_profiling]") {
+  lock_profiling::Reset();
+  lock_profiling::RecordWait("long", nullptr, 0,
+                             Clock::QueryHostTickFrequency() * 3600);
+  auto statistics = lock_profiling::GetStatistics();
+  REQUIRE(statistics.size() == 1);
+  REQUIRE(statistics[0].histogram[lock_profiling::kHistogramBucketCount - 1] ==
+          1);
+  REQUIRE(statistics[0].call_sites[0].location == "unknown");
+  lock_profiling::Reset();
+}
+
+}  // namespace xe::base::test
@@ -0,0 +1,67 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "xenia/base/logging.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+using namespace xe::logging::internal;
+
+template <typename... Args>
+std::string FormatDeferred(const char* format, const Args&... args) {
+  std::vector<char> record(4096);
+  size_t size =
+      WriteDeferredLogLine(record.data(), record.size(), format, args...);
+  REQUIRE(size);
+  DeferredLogLineHeader header;
+  std::memcpy(&header, record.data(), sizeof(header));
+  REQUIRE(header.format_length == std::strlen(format));
+  auto format_copy = record.data() + sizeof(header);
+  char text[4096];
+  size_t text_length = header.format_function(
+      format_copy, header.format_length,
+      reinterpret_cast<const uint8_t*>(format_copy + header.format_length),
+      text, sizeof(text));
+  return std::string(text, text_length);
+}
+
+TEST_CASE("Deferred log line formatting", "[logging]") {
+  std::string string = "string";
+  // Freed before formatting, the text is copied into the record.
+  std::string formatted = FormatDeferred("{} {}", std::string("temporary"),
+                                         std::string_view(string));
+  REQUIRE(formatted == "temporary string");
+
+  const char* c_string = "c string";
+  int value = 0;
+  REQUIRE(FormatDeferred("{} {:08X} {:.2f} {} {} {} {}", -1, 0xABCDu, 0.5,
+                         true, 'c', c_string, "literal") ==
+          fmt::format("{} {:08X} {:.2f} {} {} {} {}", -1, 0xABCDu, 0.5, true,
+                      'c', c_string, "literal"));
+  REQUIRE(FormatDeferred("{}", static_cast<const void*>(&value)) ==
+          fmt::format("{}", static_cast<const void*>(&value)));
+  REQUIRE(FormatDeferred("No arguments") == "No arguments");
+
+  REQUIRE(DeferredArg<uint64_t>::kSupported);
+  REQUIRE(!DeferredArg<std::vector<int>>::kSupported);
+}
+
+TEST_CASE("Deferred log line too long", "[logging]") {
+  char record[32];
+  REQUIRE(!WriteDeferredLogLine(record, sizeof(record), "{}",
+                                std::string(64, 'a')));
+}
+
+}  // namespace xe::base::test
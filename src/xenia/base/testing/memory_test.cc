@@ -14,7 +14,12 @@
 
 #include "xenia/base/clock.h"
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <vector>
 
 namespace xe {
 namespace base {
@@ -506,6 +511,239 @@ TEST_CASE("copy_and_swap_16_in_32_unaligned", "[copy_and_swap]") {
   }
 }
 
+TEST_CASE("copy_and_swap long unaligned", "[copy_and_swap]") {
+  // Long enough for the widest vector loops, with the source and the
+  // destination at different offsets from the vector alignment and residual
+  // elements.
+  std::vector<uint8_t> src(1024), dst(1024), expected(1024);
+  for (size_t i = 0; i < src.size(); ++i) {
+    src[i] = static_cast<uint8_t>(i * 7 + 1);
+  }
+  using CopyAndSwap = void (*)(void*, const void*, size_t);
+  auto check = [&](CopyAndSwap function, size_t element_size,
+                   size_t src_offset, size_t dst_offset, size_t count,
+                   bool swap_16_in_32) {
+    std::fill(dst.begin(), dst.end(), uint8_t(0));
+    std::fill(expected.begin(), expected.end(), uint8_t(0));
+    function(&dst[dst_offset], &src[src_offset], count);
+    for (size_t i = 0; i < count; ++i) {
+      const uint8_t* element = &src[src_offset + i * element_size];
+      uint8_t* expected_element = &expected[dst_offset + i * element_size];
+      for (size_t j = 0; j < element_size; ++j) {
+        expected_element[j] =
+            swap_16_in_32 ? element[j ^ 2] : element[element_size - 1 - j];
+      }
+    }
+    return dst == expected;
+  };
+  for (size_t src_offset : {0, 1, 3, 8}) {
+    for (size_t dst_offset : {0, 2, 5}) {
+      for (size_t count : {1, 15, 31, 63, 100, 123}) {
+        REQUIRE(check(copy_and_swap_16_unaligned, 2, src_offset, dst_offset,
+                      count, false));
+        REQUIRE(check(copy_and_swap_32_unaligned, 4, src_offset, dst_offset,
+                      count, false));
+        REQUIRE(check(copy_and_swap_64_unaligned, 8, src_offset, dst_offset,
+                      count, false));
+        REQUIRE(check(copy_and_swap_16_in_32_unaligned, 4, src_offset,
+                      dst_offset, count, true));
+      }
+    }
+  }
+}
+
+TEST_CASE("fill_streaming", "[memory]") {
+  // Both below and above the size where non-temporal stores are used, with an
+  // unaligned start and end.
+  for (size_t size : {size_t(100), size_t(3 * 1024 * 1024 + 77)}) {
+    std::vector<uint8_t> buffer(size + 2, 0xAA);
+    xe::fill_streaming(buffer.data() + 1, 0x5C, size);
+    REQUIRE(buffer.front() == 0xAA);
+    REQUIRE(buffer.back() == 0xAA);
+    REQUIRE(std::all_of(buffer.begin() + 1, buffer.end() - 1,
+                        [](uint8_t value) { return value == 0x5C; }));
+  }
+}
+
+TEST_CASE("copy_streaming", "[memory]") {
+  for (size_t size : {size_t(100), size_t(3 * 1024 * 1024 + 77)}) {
+    std::vector<uint8_t> source(size + 3);
+    for (size_t i = 0; i < source.size(); ++i) {
+      source[i] = uint8_t(i * 31 + i / 977);
+    }
+    std::vector<uint8_t> dest(size + 2, 0xAA);
+    xe::copy_streaming(dest.data() + 1, source.data() + 3, size);
+    REQUIRE(dest.front() == 0xAA);
+    REQUIRE(dest.back() == 0xAA);
+    REQUIRE(!std::memcmp(dest.data() + 1, source.data() + 3, size));
+  }
+}
+
+TEST_CASE("search_aligned_32", "[memory]") {
+  std::vector<uint32_t> data(1000);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = uint32_t(i % 7);
+  }
+  data[601] = 0x12345678;
+  data[602] = 0x9ABCDEF0;
+  data[901] = 0x12345678;
+  data[902] = 0x9ABCDEF0;
+  data[903] = 0x0F0F0F0F;
+  const uint32_t pair[] = {0x12345678, 0x9ABCDEF0};
+  const uint32_t triple[] = {0x12345678, 0x9ABCDEF0, 0x0F0F0F0F};
+  const uint32_t* begin = data.data();
+  const uint32_t* end = data.data() + data.size();
+  REQUIRE(xe::search_aligned_32(begin, end, pair, 2) == begin + 601);
+  REQUIRE(xe::search_aligned_32(begin, end, triple, 3) == begin + 901);
+  REQUIRE(xe::search_aligned_32(begin + 602, end, pair, 2) == begin + 901);
+  REQUIRE(!xe::search_aligned_32(begin, begin + 601, pair, 2));
+  // The last elements, compared without the vector loop.
+  REQUIRE(xe::search_aligned_32(begin + 998, end, data.data() + 999, 1) ==
+          begin + 999);
+}
+
+TEST_CASE("count_equal_8 and count_equal_32", "[memory]") {
+  std::vector<uint8_t> a(1003), b(1003);
+  size_t expected_equal_8 = 0;
+  for (size_t i = 0; i < a.size(); ++i) {
+    a[i] = uint8_t(i);
+    b[i] = uint8_t(i % 3 ? i : ~i);
+    if (a[i] == b[i]) {
+      ++expected_equal_8;
+    }
+  }
+  REQUIRE(xe::count_equal_8(a.data(), b.data(), a.size()) == expected_equal_8);
+  REQUIRE(xe::count_equal_8(a.data() + 1, b.data() + 1, 2) == 2);
+
+  std::vector<uint32_t> elements(1003);
+  size_t expected_equal_32 = 0;
+  for (size_t i = 0; i < elements.size(); ++i) {
+    elements[i] = i % 5 ? uint32_t(i) : 0xDEADBEEF;
+    if (elements[i] == 0xDEADBEEF) {
+      ++expected_equal_32;
+    }
+  }
+  REQUIRE(xe::count_equal_32(elements.data(), elements.size(), 0xDEADBEEF) ==
+          expected_equal_32);
+  REQUIRE(xe::count_equal_32(elements.data() + 1, 3, 0xDEADBEEF) == 0);
+}
+
+TEST_CASE("fill_32", "[memory]") {
+  std::vector<uint32_t> dest(1003, 0);
+  xe::fill_32(dest.data() + 1, 0x12345678, dest.size() - 2);
+  REQUIRE(dest.front() == 0);
+  REQUIRE(dest.back() == 0);
+  REQUIRE(std::all_of(dest.begin() + 1, dest.end() - 1,
+                      [](uint32_t value) { return value == 0x12345678; }));
+}
+
+TEST_CASE("widen_8_to_16_be and narrow_16_be_to_8", "[memory]") {
+  std::vector<uint8_t> narrow(1003);
+  for (size_t i = 0; i < narrow.size(); ++i) {
+    narrow[i] = uint8_t(i * 7);
+  }
+  std::vector<uint16_t> wide(narrow.size());
+  xe::widen_8_to_16_be(wide.data(), narrow.data(), narrow.size());
+  for (size_t i = 0; i < narrow.size(); ++i) {
+    REQUIRE(xe::load_and_swap<uint16_t>(&wide[i]) == narrow[i]);
+  }
+
+  std::vector<uint8_t> narrowed(narrow.size());
+  xe::narrow_16_be_to_8(narrowed.data(), wide.data(), wide.size(), '?');
+  REQUIRE(narrowed == narrow);
+
+  wide[5] = xe::byte_swap(uint16_t(0x0100));
+  wide[20] = xe::byte_swap(uint16_t(0x3042));
+  wide[1001] = xe::byte_swap(uint16_t(0xFFFF));
+  xe::narrow_16_be_to_8(narrowed.data(), wide.data(), wide.size(), '?');
+  REQUIRE(narrowed[4] == narrow[4]);
+  REQUIRE(narrowed[5] == '?');
+  REQUIRE(narrowed[20] == '?');
+  REQUIRE(narrowed[1001] == '?');
+  REQUIRE(narrowed[1002] == narrow[1002]);
+}
+
+TEST_CASE("string_length_16", "[memory]") {
+  alignas(16) uint16_t str[64];
+  for (size_t offset = 0; offset < 8; ++offset) {
+    for (size_t length = 0; length < 40; ++length) {
+      std::fill(std::begin(str), std::end(str), uint16_t(0x4100));
+      str[offset + length] = 0;
+      REQUIRE(xe::string_length_16(str + offset, 48) == length);
+      REQUIRE(xe::string_length_16(str + offset, length / 2) == length / 2);
+    }
+  }
+}
+
+TEST_CASE("count_equal_8 and narrow_16_be_to_8 benchmark",
+          "[.][memory][benchmark]") {
+  constexpr size_t kSize = 64 * 1024;
+  constexpr int kIterations = 1024;
+  std::vector<uint8_t> a(kSize, 1), b(kSize, 1);
+  std::vector<uint16_t> wide(kSize, xe::byte_swap(uint16_t('a')));
+  volatile size_t sink = 0;
+  auto measure = [](const std::function<void()>& fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIterations; ++i) {
+      fn();
+    }
+    return std::chrono::duration<double, std::micro>(
+               std::chrono::steady_clock::now() - start)
+               .count() /
+           kIterations;
+  };
+  double loop_compare_time = measure([&]() {
+    size_t count = 0;
+    for (size_t i = 0; i < kSize; ++i) {
+      count += a[i] == b[i];
+    }
+    sink = count;
+  });
+  double compare_time =
+      measure([&]() { sink = xe::count_equal_8(a.data(), b.data(), kSize); });
+  double loop_narrow_time = measure([&]() {
+    for (size_t i = 0; i < kSize; ++i) {
+      uint16_t c = xe::load_and_swap<uint16_t>(&wide[i]);
+      a[i] = c < 256 ? uint8_t(c) : '?';
+    }
+  });
+  double narrow_time = measure(
+      [&]() { xe::narrow_16_be_to_8(a.data(), wide.data(), kSize, '?'); });
+  WARN(fmt::format("64K elements: compare loop {:.2f} us, count_equal_8 "
+                   "{:.2f} us, narrowing loop {:.2f} us, narrow_16_be_to_8 "
+                   "{:.2f} us",
+                   loop_compare_time, compare_time, loop_narrow_time,
+                   narrow_time));
+}
+
+TEST_CASE("fill_streaming and copy_streaming benchmark",
+          "[.][memory][benchmark]") {
+  constexpr size_t kSize = 64 * 1024 * 1024;
+  constexpr int kIterations = 16;
+  std::vector<uint8_t> source(kSize, 1);
+  std::vector<uint8_t> dest(kSize);
+  auto measure = [](const std::function<void()>& fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIterations; ++i) {
+      fn();
+    }
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+               .count() /
+           kIterations;
+  };
+  double memset_time = measure([&]() { std::memset(dest.data(), 0, kSize); });
+  double fill_time =
+      measure([&]() { xe::fill_streaming(dest.data(), 0, kSize); });
+  double memcpy_time =
+      measure([&]() { std::memcpy(dest.data(), source.data(), kSize); });
+  double copy_time = measure(
+      [&]() { xe::copy_streaming(dest.data(), source.data(), kSize); });
+  WARN(fmt::format("64 MB: memset {:.2f} ms, fill_streaming {:.2f} ms, "
+                   "memcpy {:.2f} ms, copy_streaming {:.2f} ms",
+                   memset_time, fill_time, memcpy_time, copy_time));
+}
+
 TEST_CASE("create_and_close_file_mapping", "Virtual Memory Mapping") {
   auto path = fmt::format("xenia_test_{}", Clock::QueryHostTickCount());
   auto memory = xe::memory::CreateFileMappingHandle(
@@ -0,0 +1,67 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/mutex.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+TEST_CASE("Global critical region contention is tracked", "[mutex]") {
+  global_critical_region::ResetContentionRecords();
+  global_critical_region::SetContentionTrackingEnabled(true);
+
+  std::atomic<bool> waiter_started = false;
+  std::thread waiter;
+  {
+    auto holder_lock = global_critical_region::AcquireDirect();
+    waiter = std::thread([&waiter_started]() {
+      waiter_started = true;
+      auto waiter_lock = global_critical_region::AcquireDirect();
+    });
+    while (!waiter_started) {
+      std::this_thread::yield();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  waiter.join();
+
+  global_critical_region::SetContentionTrackingEnabled(false);
+  auto records = global_critical_region::GetContentionRecords();
+  REQUIRE(records.size() == 1);
+  REQUIRE(records[0].wait_count == 1);
+  REQUIRE(records[0].wait_time_ns > 0);
+  REQUIRE(records[0].waiter_location.find("mutex_test.cc") !=
+          std::string::npos);
+  REQUIRE(records[0].holder_location.find("mutex_test.cc") !=
+          std::string::npos);
+  REQUIRE(records[0].waiter_location != records[0].holder_location);
+
+  global_critical_region::ResetContentionRecords();
+  REQUIRE(global_critical_region::GetContentionRecords().empty());
+}
+
+TEST_CASE("Global critical region is recursive with tracking", "[mutex]") {
+  global_critical_region::SetContentionTrackingEnabled(true);
+  {
+    auto outer_lock = global_critical_region::AcquireDirect();
+    auto inner_lock = global_critical_region::AcquireDirect();
+    REQUIRE(outer_lock.owns_lock());
+    REQUIRE(inner_lock.owns_lock());
+  }
+  global_critical_region::SetContentionTrackingEnabled(false);
+  REQUIRE(global_critical_region::GetContentionRecords().empty());
+  global_critical_region::ResetContentionRecords();
+}
+
+}  // namespace xe::base::test
@@ -90,10 +90,30 @@ class Fence {
 // Returns the total number of logical processors in the host system.
 uint32_t logical_processor_count();
 
+// Returns the affinity masks of the logical processors sharing each physical
+// core of the host (more than one bit is set for SMT siblings), for the first
+// 64 logical processors, or an empty vector if the topology is unknown.
+std::vector<uint64_t> GetProcessorCoreAffinityMasks();
+
+// Returns the affinity masks of the logical processors of each NUMA node of the
+// host, indexed by the node number (zero for nodes without logical processors),
+// for the first 64 logical processors, or an empty vector if the topology is
+// unknown.
+std::vector<uint64_t> GetProcessorNodeAffinityMasks();
+
 // Enables the current process to set thread affinity.
 // Must be called at startup before attempting to set thread affinity.
 void EnableAffinityConfiguration();
 
+// Returns the mask of the first 64 logical processors the threads of the
+// process are allowed to run on, or 0 if unknown.
+uint64_t GetProcessAffinity();
+
+// Restricts all the threads of the process, including the ones created later,
+// to the logical processors in the mask. The affinity masks set for individual
+// threads afterwards must be within it.
+bool RestrictProcessAffinity(uint64_t mask);
+
 // Gets a stable thread-specific ID, but may not be. Use for informative
 // purposes only.
 uint32_t current_thread_system_id();
@@ -460,6 +480,10 @@ class Thread : public WaitHandle {
   // Suspends the specified thread.
   virtual bool Suspend(uint32_t* out_previous_suspend_count = nullptr) = 0;
 
+  // Returns the CPU time the thread has spent in user and kernel mode so far,
+  // or zero if it can't be queried.
+  virtual std::chrono::microseconds QueryCpuTime() = 0;
+
   // Terminates the thread.
   // No destructors are called, and this function does not return.
   // The state of the thread object becomes signaled, releasing any other
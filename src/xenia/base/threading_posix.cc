@@ -14,18 +14,24 @@
 #include "xenia/base/platform.h"
 #include "xenia/base/threading_timer_queue.h"
 
+#include <dirent.h>
 #include <pthread.h>
 #include <sched.h>
 #include <signal.h>
 #include <sys/eventfd.h>
+#include <sys/resource.h>
 #include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <algorithm>
 #include <array>
 #include <cstddef>
+#include <cstdio>
+#include <cstdlib>
 #include <ctime>
 #include <memory>
+#include <vector>
 
 #if XE_PLATFORM_ANDROID
 #include <dlfcn.h>
@@ -130,8 +136,120 @@ void install_signal_handler(SignalType type) {
 }
 
 // TODO(dougvj)
+std::vector<uint64_t> GetProcessorCoreAffinityMasks() {
+  std::vector<uint64_t> masks;
+#if XE_PLATFORM_LINUX
+  std::vector<std::pair<int, int>> cores;
+  for (uint32_t i = 0; i < 64; ++i) {
+    char path[80];
+    int ids[2];
+    const char* const kIdNames[] = {"physical_package_id", "core_id"};
+    bool ids_read = true;
+    for (size_t j = 0; j < 2 && ids_read; ++j) {
+      std::snprintf(path, sizeof(path),
+                    "/sys/devices/system/cpu/cpu%u/topology/%s", i,
+                    kIdNames[j]);
+      FILE* file = std::fopen(path, "r");
+      ids_read = file && std::fscanf(file, "%d", &ids[j]) == 1;
+      if (file) {
+        std::fclose(file);
+      }
+    }
+    // Offline or missing logical processors are skipped.
+    if (!ids_read) {
+      continue;
+    }
+    auto core = std::make_pair(ids[0], ids[1]);
+    auto it = std::find(cores.begin(), cores.end(), core);
+    if (it == cores.end()) {
+      cores.push_back(core);
+      masks.push_back(0);
+      it = cores.end() - 1;
+    }
+    masks[it - cores.begin()] |= uint64_t(1) << i;
+  }
+#endif
+  return masks;
+}
+
+std::vector<uint64_t> GetProcessorNodeAffinityMasks() {
+  std::vector<uint64_t> masks;
+#if XE_PLATFORM_LINUX
+  for (uint32_t i = 0; i < 64; ++i) {
+    char path[64];
+    std::snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist",
+                  i);
+    FILE* file = std::fopen(path, "r");
+    if (!file) {
+      continue;
+    }
+    // Ranges like "0-7,16-23".
+    uint64_t mask = 0;
+    unsigned int first, last;
+    int ranges_read;
+    while ((ranges_read = std::fscanf(file, "%u-%u", &first, &last)) >= 1) {
+      if (ranges_read == 1) {
+        last = first;
+      }
+      for (unsigned int j = first; j <= last && j < 64; ++j) {
+        mask |= uint64_t(1) << j;
+      }
+      if (std::fgetc(file) != ',') {
+        break;
+      }
+    }
+    std::fclose(file);
+    masks.resize(i + 1);
+    masks[i] = mask;
+  }
+#endif
+  return masks;
+}
+
 void EnableAffinityConfiguration() {}
 
+uint64_t GetProcessAffinity() {
+  cpu_set_t cpu_set;
+  if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set)) {
+    return 0;
+  }
+  uint64_t mask = 0;
+  for (int i = 0; i < std::min(CPU_SETSIZE, 64); ++i) {
+    if (CPU_ISSET(i, &cpu_set)) {
+      mask |= uint64_t(1) << i;
+    }
+  }
+  return mask;
+}
+
+bool RestrictProcessAffinity(uint64_t mask) {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (int i = 0; i < 64; ++i) {
+    if (mask & (uint64_t(1) << i)) {
+      CPU_SET(i, &cpu_set);
+    }
+  }
+  // The affinity is per thread, and new threads inherit it from the thread
+  // creating them, so it's enough to set it for all the existing threads.
+  DIR* tasks = opendir("/proc/self/task");
+  if (!tasks) {
+    return !sched_setaffinity(0, sizeof(cpu_set), &cpu_set);
+  }
+  bool restricted = true;
+  while (dirent* task = readdir(tasks)) {
+    if (task->d_name[0] == '.') {
+      continue;
+    }
+    pid_t tid = pid_t(std::strtol(task->d_name, nullptr, 10));
+    if (sched_setaffinity(tid, sizeof(cpu_set), &cpu_set)) {
+      restricted = false;
+    }
+  }
+  closedir(tasks);
+  return restricted;
+}
+
 // uint64_t ticks() { return mach_absolute_time(); }
 
 uint32_t current_thread_system_id() {
@@ -190,94 +308,146 @@ bool SetTlsValue(TlsHandle handle, uintptr_t value) {
                              reinterpret_cast<void*>(value)) == 0;
 }
 
+// A thread blocked in a wait, registered in the conditions it's waiting on,
+// so that signaling a condition wakes only the threads waiting on it rather
+// than every waiting thread in the process.
+struct PosixConditionWaiter {
+  std::mutex mutex;
+  std::condition_variable cond;
+  // Under mutex, set when any of the conditions may have become signaled.
+  bool notified = false;
+};
+
 class PosixConditionBase {
  public:
   virtual bool Signal() = 0;
 
   WaitResult Wait(std::chrono::milliseconds timeout) {
-    bool executed;
-    auto predicate = [this] { return this->signaled(); };
-    auto lock = std::unique_lock<std::mutex>(mutex_);
-    if (predicate()) {
-      executed = true;
-    } else {
-      if (timeout == std::chrono::milliseconds::max()) {
-        cond_.wait(lock, predicate);
-        executed = true;  // Did not time out;
-      } else {
-        executed = cond_.wait_for(lock, timeout, predicate);
-      }
-    }
-    if (executed) {
-      post_execution();
-      return WaitResult::kSuccess;
-    } else {
-      return WaitResult::kTimeout;
-    }
+    PosixConditionBase* handle = this;
+    return WaitMultiple(&handle, 1, false, timeout).first;
   }
 
+  // Each condition has its own mutex. To check and acquire multiple
+  // conditions atomically, all their mutexes are locked, in the order of
+  // their addresses so that concurrent waits for overlapping sets of
+  // conditions don't deadlock. If the wait can't be satisfied yet, the
+  // waiter is registered in all of them, and the mutexes are released while
+  // waiting for a notification from any of them to check again.
   static std::pair<WaitResult, size_t> WaitMultiple(
-      std::vector<PosixConditionBase*>&& handles, bool wait_all,
+      PosixConditionBase* const* handles, size_t handle_count, bool wait_all,
       std::chrono::milliseconds timeout) {
-    assert_true(handles.size() > 0);
+    assert_true(handle_count > 0);
+
+    std::vector<PosixConditionBase*> lock_order(handles,
+                                                handles + handle_count);
+    if (handle_count > 1) {
+      std::sort(lock_order.begin(), lock_order.end());
+      lock_order.erase(std::unique(lock_order.begin(), lock_order.end()),
+                       lock_order.end());
+    }
 
-    // Construct a condition for all or any depending on wait_all
-    std::function<bool()> predicate;
-    {
-      using iter_t = std::vector<PosixConditionBase*>::const_iterator;
-      const auto predicate_inner = [](auto h) { return h->signaled(); };
-      const auto operation =
-          wait_all ? std::all_of<iter_t, decltype(predicate_inner)>
-                   : std::any_of<iter_t, decltype(predicate_inner)>;
-      predicate = [&handles, operation, predicate_inner] {
-        return operation(handles.cbegin(), handles.cend(), predicate_inner);
-      };
+    bool timeout_infinite = timeout == std::chrono::milliseconds::max();
+    std::chrono::steady_clock::time_point deadline;
+    if (!timeout_infinite) {
+      deadline = std::chrono::steady_clock::now() + timeout;
     }
 
     // TODO(bwrsandman, Triang3l) This is controversial, see issue #1677
-    // This will probably cause a deadlock on the next thread doing any waiting
-    // if the thread is suspended between locking and waiting
-    std::unique_lock<std::mutex> lock(PosixConditionBase::mutex_);
-
-    bool wait_success = true;
-    // If the timeout is infinite, wait without timeout.
-    // The predicate will be checked before beginning the wait
-    if (timeout == std::chrono::milliseconds::max()) {
-      PosixConditionBase::cond_.wait(lock, predicate);
-    } else {
-      // Wait with timeout.
-      wait_success =
-          PosixConditionBase::cond_.wait_for(lock, timeout, predicate);
-    }
-    if (wait_success) {
+    // This will probably cause a deadlock on the next thread waiting on the
+    // same objects if the thread is suspended between locking and waiting
+    PosixConditionWaiter waiter;
+    bool waiter_registered = false;
+    while (true) {
+      for (PosixConditionBase* handle : lock_order) {
+        handle->mutex_.lock();
+      }
+      if (waiter_registered) {
+        for (PosixConditionBase* handle : lock_order) {
+          handle->RemoveWaiter(&waiter);
+        }
+        waiter_registered = false;
+      }
+
+      bool wait_success;
+      if (wait_all) {
+        wait_success = std::all_of(handles, handles + handle_count,
+                                   [](auto h) { return h->signaled(); });
+      } else {
+        wait_success = std::any_of(handles, handles + handle_count,
+                                   [](auto h) { return h->signaled(); });
+      }
       auto first_signaled = std::numeric_limits<size_t>::max();
-      for (auto i = 0u; i < handles.size(); ++i) {
-        if (handles[i]->signaled()) {
-          if (first_signaled > i) {
-            first_signaled = i;
+      if (wait_success) {
+        for (size_t i = 0; i < handle_count; ++i) {
+          if (handles[i]->signaled()) {
+            if (first_signaled > i) {
+              first_signaled = i;
+            }
+            handles[i]->post_execution();
+            if (!wait_all) break;
           }
-          handles[i]->post_execution();
-          if (!wait_all) break;
         }
+        assert_true(std::numeric_limits<size_t>::max() != first_signaled);
+      } else if (timeout_infinite ||
+                 std::chrono::steady_clock::now() < deadline) {
+        // Nothing references the waiter while it's not registered.
+        waiter.notified = false;
+        for (PosixConditionBase* handle : lock_order) {
+          handle->waiters_.push_back(&waiter);
+        }
+        waiter_registered = true;
+      }
+
+      for (auto it = lock_order.rbegin(); it != lock_order.rend(); ++it) {
+        (*it)->mutex_.unlock();
+      }
+
+      if (wait_success) {
+        return std::make_pair(WaitResult::kSuccess, first_signaled);
+      }
+      if (!waiter_registered) {
+        return std::make_pair<WaitResult, size_t>(WaitResult::kTimeout, 0);
+      }
+
+      std::unique_lock<std::mutex> waiter_lock(waiter.mutex);
+      auto predicate = [&waiter] { return waiter.notified; };
+      if (timeout_infinite) {
+        waiter.cond.wait(waiter_lock, predicate);
+      } else {
+        // Checked again after timing out, but not waited for anymore.
+        waiter.cond.wait_until(waiter_lock, deadline, predicate);
       }
-      assert_true(std::numeric_limits<size_t>::max() != first_signaled);
-      return std::make_pair(WaitResult::kSuccess, first_signaled);
-    } else {
-      return std::make_pair<WaitResult, size_t>(WaitResult::kTimeout, 0);
     }
   }
 
-  virtual void* native_handle() const { return cond_.native_handle(); }
+  virtual void* native_handle() const {
+    return const_cast<PosixConditionBase*>(this);
+  }
 
  protected:
   inline virtual bool signaled() const = 0;
   inline virtual void post_execution() = 0;
-  static std::condition_variable cond_;
-  static std::mutex mutex_;
-};
 
-std::condition_variable PosixConditionBase::cond_;
-std::mutex PosixConditionBase::mutex_;
+  // Must be called with mutex_ locked after the condition may have become
+  // signaled.
+  void NotifyWaiters() {
+    for (PosixConditionWaiter* waiter : waiters_) {
+      std::lock_guard<std::mutex> waiter_lock(waiter->mutex);
+      waiter->notified = true;
+      waiter->cond.notify_one();
+    }
+  }
+  void RemoveWaiter(PosixConditionWaiter* waiter) {
+    auto it = std::find(waiters_.begin(), waiters_.end(), waiter);
+    assert_true(it != waiters_.end());
+    *it = waiters_.back();
+    waiters_.pop_back();
+  }
+
+  mutable std::mutex mutex_;
+  // Under mutex_.
+  std::vector<PosixConditionWaiter*> waiters_;
+};
 
 // There really is no native POSIX handle for a single wait/signal construct
 // pthreads is at a lower level with more handles for such a mechanism.
@@ -296,7 +466,7 @@ class PosixCondition<Event> : public PosixConditionBase {
   bool Signal() override {
     auto lock = std::unique_lock<std::mutex>(mutex_);
     signal_ = true;
-    cond_.notify_all();
+    NotifyWaiters();
     return true;
   }
 
@@ -325,11 +495,11 @@ class PosixCondition<Semaphore> : public PosixConditionBase {
   bool Signal() override { return Release(1, nullptr); }
 
   bool Release(uint32_t release_count, int* out_previous_count) {
+    auto lock = std::unique_lock<std::mutex>(mutex_);
     if (maximum_count_ - count_ >= release_count) {
-      auto lock = std::unique_lock<std::mutex>(mutex_);
       if (out_previous_count) *out_previous_count = count_;
       count_ += release_count;
-      cond_.notify_all();
+      NotifyWaiters();
       return true;
     }
     return false;
@@ -337,10 +507,7 @@ class PosixCondition<Semaphore> : public PosixConditionBase {
 
  private:
   inline bool signaled() const override { return count_ > 0; }
-  inline void post_execution() override {
-    count_--;
-    cond_.notify_all();
-  }
+  inline void post_execution() override { count_--; }
   uint32_t count_;
   const uint32_t maximum_count_;
 };
@@ -358,12 +525,12 @@ class PosixCondition<Mutant> : public PosixConditionBase {
   bool Signal() override { return Release(); }
 
   bool Release() {
+    auto lock = std::unique_lock<std::mutex>(mutex_);
     if (owner_ == std::this_thread::get_id() && count_ > 0) {
-      auto lock = std::unique_lock<std::mutex>(mutex_);
       --count_;
       // Free to be acquired by another thread
       if (count_ == 0) {
-        cond_.notify_all();
+        NotifyWaiters();
       }
       return true;
     }
@@ -395,7 +562,7 @@ class PosixCondition<Timer> : public PosixConditionBase {
   bool Signal() override {
     std::lock_guard<std::mutex> lock(mutex_);
     signal_ = true;
-    cond_.notify_all();
+    NotifyWaiters();
     return true;
   }
 
@@ -498,18 +665,8 @@ class PosixCondition<Thread> : public PosixConditionBase {
       pthread_attr_destroy(&attr);
       return false;
     }
-    if (params.initial_priority != 0) {
-      sched_param sched{};
-      sched.sched_priority = params.initial_priority + 1;
-      if (pthread_attr_setschedpolicy(&attr, SCHED_FIFO) != 0) {
-        pthread_attr_destroy(&attr);
-        return false;
-      }
-      if (pthread_attr_setschedparam(&attr, &sched) != 0) {
-        pthread_attr_destroy(&attr);
-        return false;
-      }
-    }
+    // Applied by the thread itself once it knows its system ID.
+    priority_ = params.initial_priority;
     if (pthread_create(&thread_, &attr, ThreadStartRoutine, start_data) != 0) {
       pthread_attr_destroy(&attr);
       return false;
@@ -522,6 +679,7 @@ class PosixCondition<Thread> : public PosixConditionBase {
   /// Thread::GetCurrentThread() on the main thread
   explicit PosixCondition(pthread_t thread)
       : thread_(thread),
+        system_tid_(pid_t(syscall(SYS_gettid))),
         signaled_(false),
         exit_code_(0),
         state_(State::kRunning) {
@@ -601,6 +759,18 @@ class PosixCondition<Thread> : public PosixConditionBase {
 
   uint32_t system_id() const { return static_cast<uint32_t>(thread_); }
 
+  std::chrono::microseconds cpu_time() {
+    WaitStarted();
+    clockid_t clock_id;
+    timespec time;
+    if (pthread_getcpuclockid(thread_, &clock_id) != 0 ||
+        clock_gettime(clock_id, &time) != 0) {
+      return std::chrono::microseconds(0);
+    }
+    return std::chrono::microseconds(uint64_t(time.tv_sec) * 1000000 +
+                                     uint64_t(time.tv_nsec) / 1000);
+  }
+
   uint64_t affinity_mask() {
     WaitStarted();
     cpu_set_t cpu_set;
@@ -617,8 +787,9 @@ class PosixCondition<Thread> : public PosixConditionBase {
     uint64_t result = 0;
     auto cpu_count = std::min(CPU_SETSIZE, 64);
     for (auto i = 0u; i < cpu_count; i++) {
-      auto set = CPU_ISSET(i, &cpu_set);
-      result |= set << i;
+      if (CPU_ISSET(i, &cpu_set)) {
+        result |= uint64_t(1) << i;
+      }
     }
     return result;
   }
@@ -628,7 +799,7 @@ class PosixCondition<Thread> : public PosixConditionBase {
     cpu_set_t cpu_set;
     CPU_ZERO(&cpu_set);
     for (auto i = 0u; i < 64; i++) {
-      if (mask & (1 << i)) {
+      if (mask & (uint64_t(1) << i)) {
         CPU_SET(i, &cpu_set);
       }
     }
@@ -646,22 +817,25 @@ class PosixCondition<Thread> : public PosixConditionBase {
 
   int priority() {
     WaitStarted();
-    int policy;
-    sched_param param{};
-    int ret = pthread_getschedparam(thread_, &policy, &param);
-    if (ret != 0) {
-      return -1;
-    }
-
-    return param.sched_priority;
+    return priority_;
   }
 
   void set_priority(int new_priority) {
     WaitStarted();
-    sched_param param{};
-    param.sched_priority = new_priority;
-    if (pthread_setschedparam(thread_, SCHED_FIFO, &param) != 0)
-      assert_always();
+    priority_ = new_priority;
+    ApplyPriority();
+  }
+
+  // Real-time policies need elevated privileges, and a guest thread spinning
+  // under one could starve the rest of the system, so priorities are applied
+  // as nice values of the normal policy, which is per-thread on Linux. Raising
+  // the priority above normal may not be permitted, and is best-effort.
+  void ApplyPriority() {
+#if XE_PLATFORM_LINUX
+    if (system_tid_) {
+      setpriority(PRIO_PROCESS, id_t(system_tid_), -5 * priority_);
+    }
+#endif
   }
 
   void QueueUserCallback(std::function<void()> callback) {
@@ -739,7 +913,7 @@ class PosixCondition<Thread> : public PosixConditionBase {
 
       exit_code_ = exit_code;
       signaled_ = true;
-      cond_.notify_all();
+      NotifyWaiters();
     }
     if (is_current_thread) {
       pthread_exit(reinterpret_cast<void*>(exit_code));
@@ -783,6 +957,8 @@ class PosixCondition<Thread> : public PosixConditionBase {
     }
   }
   pthread_t thread_;
+  pid_t system_tid_ = 0;
+  int priority_ = 0;
   bool signaled_;
   int exit_code_;
   volatile State state_;
@@ -892,8 +1068,8 @@ std::pair<WaitResult, size_t> WaitMultiple(WaitHandle* wait_handles[],
     conditions.push_back(&handle->condition());
   }
   if (is_alertable) alertable_state_ = true;
-  auto result = PosixConditionBase::WaitMultiple(std::move(conditions),
-                                                 wait_all, timeout);
+  auto result = PosixConditionBase::WaitMultiple(
+      conditions.data(), conditions.size(), wait_all, timeout);
   if (is_alertable) alertable_state_ = false;
   return result;
 }
@@ -1037,6 +1213,10 @@ class PosixThread : public PosixConditionHandle<Thread> {
 
   uint32_t system_id() const override { return handle_.system_id(); }
 
+  std::chrono::microseconds QueryCpuTime() override {
+    return handle_.cpu_time();
+  }
+
   uint64_t affinity_mask() override { return handle_.affinity_mask(); }
   void set_affinity_mask(uint64_t mask) override {
     handle_.set_affinity_mask(mask);
@@ -1084,6 +1264,10 @@ void* PosixCondition<Thread>::ThreadStartRoutine(void* parameter) {
   delete start_data;
 
   current_thread_ = thread;
+  thread->handle_.system_tid_ = pid_t(syscall(SYS_gettid));
+  if (thread->handle_.priority_) {
+    thread->handle_.ApplyPriority();
+  }
   {
     std::unique_lock<std::mutex> lock(thread->handle_.state_mutex_);
     thread->handle_.state_ =
@@ -1105,10 +1289,10 @@ void* PosixCondition<Thread>::ThreadStartRoutine(void* parameter) {
     thread->handle_.state_ = State::kFinished;
   }
 
-  std::unique_lock<std::mutex> lock(mutex_);
+  std::unique_lock<std::mutex> lock(thread->handle_.mutex_);
   thread->handle_.exit_code_ = 0;
   thread->handle_.signaled_ = true;
-  cond_.notify_all();
+  thread->handle_.NotifyWaiters();
 
   current_thread_ = nullptr;
   return nullptr;
@@ -23,6 +23,44 @@ typedef HANDLE (*SetThreadDescriptionFn)(HANDLE hThread,
 namespace xe {
 namespace threading {
 
+std::vector<uint64_t> GetProcessorCoreAffinityMasks() {
+  std::vector<uint64_t> masks;
+  DWORD length = 0;
+  GetLogicalProcessorInformation(nullptr, &length);
+  std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> infos(
+      length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+  if (infos.empty() || !GetLogicalProcessorInformation(infos.data(), &length)) {
+    return masks;
+  }
+  for (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& info : infos) {
+    if (info.Relationship == RelationProcessorCore) {
+      masks.push_back(uint64_t(info.ProcessorMask));
+    }
+  }
+  return masks;
+}
+
+std::vector<uint64_t> GetProcessorNodeAffinityMasks() {
+  std::vector<uint64_t> masks;
+  DWORD length = 0;
+  GetLogicalProcessorInformation(nullptr, &length);
+  std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> infos(
+      length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+  if (infos.empty() || !GetLogicalProcessorInformation(infos.data(), &length)) {
+    return masks;
+  }
+  for (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& info : infos) {
+    if (info.Relationship == RelationNumaNode) {
+      DWORD node = info.NumaNode.NodeNumber;
+      if (masks.size() <= node) {
+        masks.resize(node + 1);
+      }
+      masks[node] |= uint64_t(info.ProcessorMask);
+    }
+  }
+  return masks;
+}
+
 void EnableAffinityConfiguration() {
   HANDLE process_handle = GetCurrentProcess();
   DWORD_PTR process_affinity_mask;
@@ -32,6 +70,20 @@ void EnableAffinityConfiguration() {
   SetProcessAffinityMask(process_handle, system_affinity_mask);
 }
 
+uint64_t GetProcessAffinity() {
+  DWORD_PTR process_affinity_mask;
+  DWORD_PTR system_affinity_mask;
+  if (!GetProcessAffinityMask(GetCurrentProcess(), &process_affinity_mask,
+                              &system_affinity_mask)) {
+    return 0;
+  }
+  return uint64_t(process_affinity_mask);
+}
+
+bool RestrictProcessAffinity(uint64_t mask) {
+  return SetProcessAffinityMask(GetCurrentProcess(), DWORD_PTR(mask)) != 0;
+}
+
 uint32_t current_thread_system_id() {
   return static_cast<uint32_t>(GetCurrentThreadId());
 }
@@ -392,6 +444,20 @@ class Win32Thread : public Win32Handle<Thread> {
   int32_t priority() override { return GetThreadPriority(handle_); }
   uint32_t system_id() const override { return GetThreadId(handle_); }
 
+  std::chrono::microseconds QueryCpuTime() override {
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    if (!GetThreadTimes(handle_, &creation_time, &exit_time, &kernel_time,
+                        &user_time)) {
+      return std::chrono::microseconds(0);
+    }
+    // In 100-nanosecond units.
+    uint64_t total_time =
+        ((uint64_t(kernel_time.dwHighDateTime) << 32) |
+         kernel_time.dwLowDateTime) +
+        ((uint64_t(user_time.dwHighDateTime) << 32) | user_time.dwLowDateTime);
+    return std::chrono::microseconds(total_time / 10);
+  }
+
   void set_priority(int32_t new_priority) override {
     SetThreadPriority(handle_, new_priority);
   }
@@ -0,0 +1,271 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cache_bundle.h"
+
+#include <cstring>
+#include <string_view>
+#include <system_error>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/mapped_memory.h"
+#include "xenia/base/utf8.h"
+#include "xenia/base/xxhash.h"
+
+namespace xe {
+
+// 'XECB'.
+static const uint32_t kCacheBundleMagic = 0x42434558;
+static const uint32_t kCacheBundleVersion = 1;
+static const char kCacheBundleManifestName[] = "manifest.xcb";
+
+// Manifests may come from other machines, so only paths inside the cache root
+// are accepted.
+static bool IsBundlePathValid(std::string_view path) {
+  if (path.empty()) {
+    return false;
+  }
+  size_t component_start = 0;
+  while (component_start <= path.size()) {
+    size_t component_end = path.find('/', component_start);
+    if (component_end == std::string_view::npos) {
+      component_end = path.size();
+    }
+    std::string_view component =
+        path.substr(component_start, component_end - component_start);
+    if (component.empty() || component == "." || component == ".." ||
+        component.find_first_of("\\:") != std::string_view::npos) {
+      return false;
+    }
+    component_start = component_end + 1;
+  }
+  return true;
+}
+
+std::filesystem::path CacheBundle::GetPath(
+    const std::filesystem::path& bundle_root, uint32_t title_id) {
+  return bundle_root / fmt::format("{:08X}", title_id);
+}
+
+bool CacheBundle::Export(const std::filesystem::path& cache_root,
+                         const std::filesystem::path& bundle_root,
+                         uint32_t title_id, uint64_t module_hash) {
+  // Directories relative to the cache root and the prefix of the names of the
+  // files of the title in them. Host-specific caches, such as the pipeline
+  // caches of the driver in shaders/local, aren't bundled.
+  const std::pair<const char*, std::string> sources[] = {
+      {"shaders/shareable", fmt::format("{:08X}.", title_id)},
+      {"jit", fmt::format("{:016X}.", module_hash)},
+      {"functions", fmt::format("{:016X}.", module_hash)},
+  };
+
+  auto bundle_path = GetPath(bundle_root, title_id);
+  std::error_code ec;
+  std::filesystem::remove_all(bundle_path, ec);
+  std::vector<File> files;
+  for (const auto& source : sources) {
+    for (const auto& file_info :
+         xe::filesystem::ListFiles(cache_root / xe::to_path(source.first))) {
+      std::string name = xe::path_to_utf8(file_info.name);
+      if (file_info.type != xe::filesystem::FileInfo::Type::kFile ||
+          !xe::utf8::starts_with(name, source.second)) {
+        continue;
+      }
+      File file;
+      file.path = fmt::format("{}/{}", source.first, name);
+      auto target_path = bundle_path / xe::to_path(file.path);
+      if (!xe::filesystem::CreateParentFolder(target_path) ||
+          !std::filesystem::copy_file(cache_root / xe::to_path(file.path),
+                                      target_path, ec)) {
+        XELOGE("Cache bundle: failed to copy {} to {}", file.path,
+               xe::path_to_utf8(bundle_path));
+        return false;
+      }
+      // Of the copy, the cache may still be appended to.
+      file.size = uint64_t(std::filesystem::file_size(target_path, ec));
+      if (ec || !HashFile(target_path, file.size, &file.hash)) {
+        XELOGE("Cache bundle: failed to read {}",
+               xe::path_to_utf8(target_path));
+        return false;
+      }
+      files.push_back(std::move(file));
+    }
+  }
+  if (files.empty()) {
+    return true;
+  }
+  if (!WriteManifest(bundle_path / kCacheBundleManifestName, title_id,
+                     files)) {
+    return false;
+  }
+  XELOGI("Cache bundle: exported {} files of title {:08X} to {}",
+         files.size(), title_id, xe::path_to_utf8(bundle_path));
+  return true;
+}
+
+size_t CacheBundle::Install(const std::filesystem::path& bundle_root,
+                            const std::filesystem::path& cache_root,
+                            uint32_t title_id) {
+  auto bundle_path = GetPath(bundle_root, title_id);
+  auto manifest_path = bundle_path / kCacheBundleManifestName;
+  if (!std::filesystem::exists(manifest_path)) {
+    return 0;
+  }
+  std::vector<File> files;
+  if (!ReadManifest(manifest_path, title_id, &files)) {
+    XELOGW("Cache bundle manifest {} is stale or corrupted, ignoring it",
+           xe::path_to_utf8(manifest_path));
+    return 0;
+  }
+
+  size_t installed_count = 0;
+  for (const File& file : files) {
+    auto target_path = cache_root / xe::to_path(file.path);
+    std::error_code ec;
+    uint64_t local_size = uint64_t(std::filesystem::file_size(target_path, ec));
+    if (!ec && local_size >= file.size) {
+      continue;
+    }
+    // Checking the size first avoids hashing files that are being replaced.
+    auto source_path = bundle_path / xe::to_path(file.path);
+    uint64_t hash;
+    if (uint64_t(std::filesystem::file_size(source_path, ec)) != file.size ||
+        ec || !HashFile(source_path, file.size, &hash) || hash != file.hash) {
+      XELOGW("Cache bundle file {} doesn't match the manifest, skipping it",
+             xe::path_to_utf8(source_path));
+      continue;
+    }
+    // Copied next to the target first so an interrupted copy doesn't leave a
+    // truncated cache.
+    auto temp_path = target_path;
+    temp_path += ".tmp";
+    if (!xe::filesystem::CreateParentFolder(target_path) ||
+        !std::filesystem::copy_file(
+            source_path, temp_path,
+            std::filesystem::copy_options::overwrite_existing, ec)) {
+      XELOGE("Cache bundle: failed to copy {} to {}",
+             xe::path_to_utf8(source_path), xe::path_to_utf8(temp_path));
+      continue;
+    }
+    std::filesystem::rename(temp_path, target_path, ec);
+    if (ec) {
+      XELOGE("Cache bundle: failed to replace {}: {}",
+             xe::path_to_utf8(target_path), ec.message());
+      std::filesystem::remove(temp_path, ec);
+      continue;
+    }
+    ++installed_count;
+  }
+  XELOGI("Cache bundle: installed {} of {} files of title {:08X} from {}",
+         installed_count, files.size(), title_id,
+         xe::path_to_utf8(bundle_path));
+  return installed_count;
+}
+
+bool CacheBundle::ReadManifest(const std::filesystem::path& path,
+                               uint32_t title_id,
+                               std::vector<File>* files_out) {
+  auto mapping = xe::MappedMemory::Open(path, xe::MappedMemory::Mode::kRead);
+  if (!mapping || mapping->size() < sizeof(ManifestHeader)) {
+    return false;
+  }
+  ManifestHeader header;
+  std::memcpy(&header, mapping->data(), sizeof(header));
+  const uint8_t* files_data = mapping->data() + sizeof(header);
+  size_t files_size = mapping->size() - sizeof(header);
+  if (header.magic != kCacheBundleMagic ||
+      header.version != kCacheBundleVersion || header.title_id != title_id ||
+      XXH3_64bits(files_data, files_size) != header.files_hash) {
+    return false;
+  }
+
+  std::vector<File> files;
+  size_t offset = 0;
+  for (uint32_t i = 0; i < header.file_count; ++i) {
+    ManifestFile manifest_file;
+    if (files_size - offset < sizeof(manifest_file)) {
+      return false;
+    }
+    std::memcpy(&manifest_file, files_data + offset, sizeof(manifest_file));
+    offset += sizeof(manifest_file);
+    if (files_size - offset < manifest_file.path_length) {
+      return false;
+    }
+    File file;
+    file.path.assign(reinterpret_cast<const char*>(files_data + offset),
+                     manifest_file.path_length);
+    offset += manifest_file.path_length;
+    if (!IsBundlePathValid(file.path)) {
+      return false;
+    }
+    file.size = manifest_file.size;
+    file.hash = manifest_file.hash;
+    files.push_back(std::move(file));
+  }
+  *files_out = std::move(files);
+  return true;
+}
+
+bool CacheBundle::WriteManifest(const std::filesystem::path& path,
+                                uint32_t title_id,
+                                const std::vector<File>& files) {
+  std::vector<uint8_t> files_data;
+  for (const File& file : files) {
+    ManifestFile manifest_file;
+    std::memset(&manifest_file, 0, sizeof(manifest_file));
+    manifest_file.size = file.size;
+    manifest_file.hash = file.hash;
+    manifest_file.path_length = uint32_t(file.path.size());
+    auto manifest_file_data = reinterpret_cast<const uint8_t*>(&manifest_file);
+    files_data.insert(files_data.end(), manifest_file_data,
+                      manifest_file_data + sizeof(manifest_file));
+    files_data.insert(files_data.end(), file.path.begin(), file.path.end());
+  }
+  ManifestHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = kCacheBundleMagic;
+  header.version = kCacheBundleVersion;
+  header.title_id = title_id;
+  header.file_count = uint32_t(files.size());
+  header.files_hash = XXH3_64bits(files_data.data(), files_data.size());
+
+  FILE* file = xe::filesystem::OpenFile(path, "wb");
+  if (!file) {
+    XELOGE("Failed to open the cache bundle manifest for writing: {}",
+           xe::path_to_utf8(path));
+    return false;
+  }
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(files_data.data(), 1, files_data.size(), file) ==
+                     files_data.size();
+  fclose(file);
+  if (!written) {
+    XELOGE("Failed to write the cache bundle manifest: {}",
+           xe::path_to_utf8(path));
+  }
+  return written;
+}
+
+bool CacheBundle::HashFile(const std::filesystem::path& path, uint64_t size,
+                           uint64_t* hash_out) {
+  if (!size) {
+    *hash_out = XXH3_64bits(nullptr, 0);
+    return true;
+  }
+  auto mapping = xe::MappedMemory::Open(path, xe::MappedMemory::Mode::kRead);
+  if (!mapping || mapping->size() != size) {
+    return false;
+  }
+  *hash_out = XXH3_64bits(mapping->data(), mapping->size());
+  return true;
+}
+
+}  // namespace xe
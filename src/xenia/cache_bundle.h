@@ -0,0 +1,82 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CACHE_BUNDLE_H_
+#define XENIA_CACHE_BUNDLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace xe {
+
+// Caches of a title that can be moved between hosts - the shareable shader
+// and pipeline storage, the translated code and the function database of the
+// executable - gathered in one directory named after the title ID, so they can
+// be built on one machine and installed into the cache root of others for
+// titles to start with warm caches. The files keep their paths relative to the
+// cache root, and a manifest lists their sizes and hashes, checked before
+// installing. The caches check their own versions when they're loaded.
+class CacheBundle {
+ public:
+  static std::filesystem::path GetPath(const std::filesystem::path& bundle_root,
+                                       uint32_t title_id);
+
+  // Replaces the bundle of the title with the current cache files of the
+  // title and of its executable identified by module_hash.
+  static bool Export(const std::filesystem::path& cache_root,
+                     const std::filesystem::path& bundle_root,
+                     uint32_t title_id, uint64_t module_hash);
+
+  // Copies the files of the bundle of the title that are missing from the
+  // cache root or larger than the ones there, as the caches only grow. Returns
+  // the number of files installed.
+  static size_t Install(const std::filesystem::path& bundle_root,
+                        const std::filesystem::path& cache_root,
+                        uint32_t title_id);
+
+ private:
+  struct ManifestHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t title_id;
+    uint32_t file_count;
+    // Hash of the file records, to detect truncated writes.
+    uint64_t files_hash;
+  };
+
+  // Followed by path_length bytes of the UTF-8 path relative to the cache
+  // root, with '/' separators.
+  struct ManifestFile {
+    uint64_t size;
+    uint64_t hash;
+    uint32_t path_length;
+    uint32_t reserved;
+  };
+
+  struct File {
+    std::string path;
+    uint64_t size;
+    uint64_t hash;
+  };
+
+  static bool ReadManifest(const std::filesystem::path& path,
+                           uint32_t title_id, std::vector<File>* files_out);
+  static bool WriteManifest(const std::filesystem::path& path,
+                            uint32_t title_id, const std::vector<File>& files);
+  // Returns false if the file can't be read.
+  static bool HashFile(const std::filesystem::path& path, uint64_t size,
+                       uint64_t* hash_out);
+};
+
+}  // namespace xe
+
+#endif  // XENIA_CACHE_BUNDLE_H_
@@ -10,6 +10,8 @@
 #ifndef XENIA_CPU_BACKEND_BACKEND_H_
 #define XENIA_CPU_BACKEND_BACKEND_H_
 
+#include <cstdint>
+#include <filesystem>
 #include <memory>
 
 #include "xenia/cpu/backend/machine_info.h"
@@ -54,6 +56,21 @@ class Backend {
   virtual std::unique_ptr<GuestFunction> CreateGuestFunction(
       Module* module, uint32_t address) = 0;
 
+  // Opens persistent storage of translated code for the module with the given
+  // hash, if the backend supports it.
+  virtual void InitializeCodeStorage(const std::filesystem::path& storage_root,
+                                     uint64_t module_hash) {}
+  virtual void ShutdownCodeStorage() {}
+  // Defines the function from the code storage instead of translating it.
+  // Returns false if it isn't stored or was stored for different guest code.
+  virtual bool DefineStoredFunction(GuestFunction* function) { return false; }
+  // Makes further calls to the function resolve it again rather than run its
+  // current code, after the guest code it was translated from has changed.
+  virtual void InvalidateFunction(GuestFunction* function) {}
+  // Options that are baked into the translated code, taken from the current
+  // config. Code translated with different options must be translated again.
+  virtual uint32_t QueryCodegenOptions() const { return 0; }
+
   // Calculates the next host instruction based on the current thread state and
   // current PC. This will look for branches and other control flow
   // instructions.
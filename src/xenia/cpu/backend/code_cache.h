@@ -13,6 +13,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include "xenia/cpu/function.h"
 
@@ -20,6 +21,20 @@ namespace xe {
 namespace cpu {
 namespace backend {
 
+// The unwind info returned by LookupUnwindInfo on platforms other than
+// Windows, where a RUNTIME_FUNCTION is returned.
+struct UnwindTableEntry {
+  // Relative to execute_base_address().
+  uint32_t begin_address;
+  uint32_t end_address;
+  // Offset of the instruction after the stack allocation in the prolog.
+  uint32_t prolog_stack_alloc_offset;
+  // Allocated below the return address after the prolog.
+  uint32_t stack_size;
+  // The call frame information registered with the unwinder, or nullptr.
+  void* frame_registration;
+};
+
 class CodeCache {
  public:
   CodeCache() = default;
@@ -33,8 +48,21 @@ class CodeCache {
   // function).
   virtual GuestFunction* LookupFunction(uint64_t host_pc) = 0;
 
-  // Finds platform-specific function unwind info for the given host PC.
+  // Finds platform-specific function unwind info for the given host PC, or
+  // returns nullptr if there's none.
   virtual void* LookupUnwindInfo(uint64_t host_pc) = 0;
+
+  // Size of the code superseded by retranslations that hasn't been reclaimed
+  // yet.
+  virtual size_t retired_code_size() const { return 0; }
+  // Frees the retired code that none of the given host PCs (of every thread
+  // that can run guest code, return addresses included) are in for new code
+  // to be placed in. Code is only freed on the call after the one that first
+  // saw it retired, so that threads that had loaded its address without
+  // calling it yet have gotten to it. Returns the number of bytes freed.
+  virtual size_t ReclaimRetiredCode(const std::vector<uint64_t>& host_pcs) {
+    return 0;
+  }
 };
 
 }  // namespace backend
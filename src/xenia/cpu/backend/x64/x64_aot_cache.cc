@@ -0,0 +1,401 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/x64/x64_aot_cache.h"
+
+#include <cstring>
+
+#include "build/version.h"
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/xxhash.h"
+#include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
+#include "xenia/cpu/backend/x64/x64_emitter.h"
+#include "xenia/cpu/backend/x64/x64_function.h"
+#include "xenia/cpu/backend/x64/x64_sequences.h"
+#include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/processor.h"
+
+DEFINE_bool(x64_aot_cache, false,
+            "Store machine code emitted by the x64 backend on disk and reuse "
+            "it on later launches of the same title instead of translating "
+            "the guest functions again.",
+            "x64");
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+// 'XEJC'.
+static const uint32_t kAotCacheMagic = 0x434A4558;
+// Bump when anything affecting the emitted code or the file layout changes.
+static const uint32_t kAotCacheVersion = 3;
+
+X64AotCache::X64AotCache(X64Backend* backend) : backend_(backend) {}
+
+X64AotCache::~X64AotCache() { Shutdown(); }
+
+uintptr_t X64AotCache::GetHostImageAnchor() {
+  return reinterpret_cast<uintptr_t>(&X64AotCache::GetHostImageAnchor);
+}
+
+void X64AotCache::FillFileHeader(FileHeader& header) const {
+  std::memset(&header, 0, sizeof(header));
+  header.magic = kAotCacheMagic;
+  header.version = kAotCacheVersion;
+  // Host image relocations are only valid for the exact same executable.
+  header.build_hash =
+      XXH3_64bits(XE_BUILD_COMMIT, std::strlen(XE_BUILD_COMMIT));
+  header.module_hash = module_hash_;
+  header.feature_flags = X64Emitter::DetectFeatureFlags();
+  header.codegen_flags = backend_->QueryCodegenOptions();
+  header.emitter_data = uint64_t(backend_->emitter_data());
+  header.host_to_guest_thunk = uint64_t(backend_->host_to_guest_thunk());
+  header.guest_to_host_thunk = uint64_t(backend_->guest_to_host_thunk());
+  header.resolve_function_thunk = uint64_t(backend_->resolve_function_thunk());
+}
+
+uint64_t X64AotCache::HashGuestCode(uint32_t address,
+                                    uint32_t end_address) const {
+  // The end address is the address of the last instruction.
+  Memory* memory = backend_->processor()->memory();
+  return XXH3_64bits(memory->TranslateVirtual(address),
+                     end_address - address + 4);
+}
+
+bool X64AotCache::Initialize(const std::filesystem::path& storage_root,
+                             uint64_t module_hash) {
+  Shutdown();
+  // Reopened while translation threads may be storing functions when the code
+  // generation options are changed by a game config.
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // Instrumented code references per-session trace buffers.
+  if (cvars::trace_functions || cvars::trace_function_coverage ||
+      cvars::trace_function_references || cvars::trace_function_data ||
+      cvars::disassemble_functions || cvars::debug) {
+    XELOGW("x64 AOT cache disabled because function tracing or debugging is "
+           "enabled");
+    return false;
+  }
+
+  module_hash_ = module_hash;
+  FileHeader expected_header;
+  FillFileHeader(expected_header);
+
+  // Launches with a different build or code generation options use a separate
+  // file rather than reinitializing one that other emulator instances may be
+  // using concurrently.
+  auto file_path =
+      storage_root / "jit" /
+      fmt::format("{:016X}.{:04X}.{:016X}.x64.xjit", module_hash,
+                  expected_header.feature_flags,
+                  XXH3_64bits(&expected_header, sizeof(expected_header)));
+  if (!xe::filesystem::CreateParentFolder(file_path)) {
+    XELOGE("Failed to create the x64 AOT cache directory: {}",
+           xe::path_to_utf8(file_path.parent_path()));
+    return false;
+  }
+  file_ = xe::filesystem::OpenFile(file_path, "a+b");
+  if (!file_) {
+    XELOGE("Failed to open the x64 AOT cache file for writing: {}",
+           xe::path_to_utf8(file_path));
+    return false;
+  }
+
+  // Other emulator instances may be using the same file concurrently. It's
+  // read under a shared lock, functions are only appended to it under an
+  // exclusive lock, and it's truncated or reinitialized only if no other
+  // instance has appended anything since it's been read. The stored code is
+  // mapped rather than copied, so all the instances share one copy of it.
+  xe::filesystem::LockStdioFile(file_, false);
+  FileHeader file_header;
+  xe::filesystem::Seek(file_, 0, SEEK_SET);
+  bool file_header_valid =
+      fread(&file_header, sizeof(file_header), 1, file_) &&
+      !std::memcmp(&file_header, &expected_header, sizeof(file_header));
+  xe::filesystem::Seek(file_, 0, SEEK_END);
+  int64_t file_end = xe::filesystem::Tell(file_);
+  if (!file_header_valid) {
+    xe::filesystem::UnlockStdioFile(file_);
+    // Missing or corrupted - start over.
+    if (xe::filesystem::LockStdioFileIfUnchanged(file_, uint64_t(file_end))) {
+      xe::filesystem::TruncateStdioFile(file_, 0);
+      fwrite(&expected_header, sizeof(expected_header), 1, file_);
+      xe::filesystem::UnlockStdioFile(file_);
+      XELOGI("x64 AOT cache: created new storage {}",
+             xe::path_to_utf8(file_path));
+    }
+    return true;
+  }
+  if (file_end > int64_t(sizeof(file_header))) {
+    stored_data_mapping_ = MappedMemory::Open(
+        file_path, MappedMemory::Mode::kRead, 0, size_t(file_end));
+    if (stored_data_mapping_) {
+      stored_data_ = stored_data_mapping_->data() + sizeof(file_header);
+      stored_data_size_ = size_t(file_end) - sizeof(file_header);
+    } else {
+      XELOGW("x64 AOT cache: failed to map {}, only storing new functions",
+             xe::path_to_utf8(file_path));
+    }
+  }
+  xe::filesystem::UnlockStdioFile(file_);
+
+  // Index the stored functions, stopping at the first corrupted record. Later
+  // records for the same address (retranslations after the guest code
+  // changed) replace earlier ones.
+  size_t offset = 0;
+  while (offset + sizeof(FunctionHeader) <= stored_data_size_) {
+    FunctionHeader header;
+    std::memcpy(&header, stored_data_ + offset, sizeof(header));
+    size_t payload_size =
+        size_t(header.code_size) +
+        sizeof(StoredRelocation) * header.relocation_count +
+        sizeof(SourceMapEntry) * header.source_map_count +
+        sizeof(vec128_t) * header.constant_count;
+    size_t payload_offset = offset + sizeof(header);
+    if (payload_offset + payload_size > stored_data_size_ ||
+        XXH3_64bits(stored_data_ + payload_offset, payload_size) !=
+            header.payload_hash) {
+      break;
+    }
+    stored_functions_[header.guest_address] = offset;
+    offset = payload_offset + payload_size;
+  }
+  if (offset != stored_data_size_) {
+    XELOGW("x64 AOT cache: discarding {} corrupted bytes at the end of {}",
+           stored_data_size_ - offset, xe::path_to_utf8(file_path));
+    // Mapped files can't be truncated on Windows, map only the valid records
+    // again afterwards.
+    stored_data_mapping_.reset();
+    stored_data_ = nullptr;
+    stored_data_size_ = 0;
+    if (xe::filesystem::LockStdioFileIfUnchanged(file_, uint64_t(file_end))) {
+      xe::filesystem::TruncateStdioFile(file_, sizeof(file_header) + offset);
+      xe::filesystem::UnlockStdioFile(file_);
+    }
+    if (offset) {
+      stored_data_mapping_ =
+          MappedMemory::Open(file_path, MappedMemory::Mode::kRead, 0,
+                             sizeof(file_header) + offset);
+    }
+    if (stored_data_mapping_) {
+      stored_data_ = stored_data_mapping_->data() + sizeof(file_header);
+      stored_data_size_ = offset;
+    } else {
+      stored_functions_.clear();
+    }
+  }
+
+  XELOGI("x64 AOT cache: {} stored functions in {}", stored_functions_.size(),
+         xe::path_to_utf8(file_path));
+  return true;
+}
+
+void X64AotCache::Shutdown() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!file_) {
+    return;
+  }
+  XELOGI("x64 AOT cache: loaded {} functions, stored {} new functions",
+         stored_function_loaded_count_, stored_function_written_count_);
+  fclose(file_);
+  file_ = nullptr;
+  stored_data_mapping_.reset();
+  stored_data_ = nullptr;
+  stored_data_size_ = 0;
+  stored_functions_.clear();
+  stored_function_loaded_count_ = 0;
+  stored_function_written_count_ = 0;
+}
+
+bool X64AotCache::DefineFunction(GuestFunction* function) {
+  std::vector<uint8_t> code;
+  std::vector<SourceMapEntry> source_map;
+  FunctionHeader header;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!file_) {
+      return false;
+    }
+    auto it = stored_functions_.find(function->address());
+    if (it == stored_functions_.end()) {
+      return false;
+    }
+    const uint8_t* record = stored_data_ + it->second;
+    std::memcpy(&header, record, sizeof(header));
+    if (HashGuestCode(header.guest_address, header.guest_end_address) !=
+        header.guest_code_hash) {
+      // Guest code was patched or is from a different module revision.
+      stored_functions_.erase(it);
+      return false;
+    }
+
+    const uint8_t* payload = record + sizeof(header);
+    code.assign(payload, payload + header.code_size);
+    payload += header.code_size;
+
+    uintptr_t anchor = GetHostImageAnchor();
+    const uint8_t* constants =
+        payload + sizeof(StoredRelocation) * header.relocation_count +
+        sizeof(SourceMapEntry) * header.source_map_count;
+    for (uint32_t i = 0; i < header.relocation_count; ++i) {
+      StoredRelocation relocation;
+      std::memcpy(&relocation, payload, sizeof(relocation));
+      payload += sizeof(relocation);
+      uint64_t value;
+      size_t value_size;
+      switch (relocation.type) {
+        case X64RelocationType::kHostImage:
+          value = uint64_t(anchor + relocation.value);
+          value_size = sizeof(uint64_t);
+          break;
+        case X64RelocationType::kConstantPool: {
+          if (uint64_t(relocation.value) >= header.constant_count) {
+            assert_always();
+            return false;
+          }
+          vec128_t constant;
+          std::memcpy(&constant,
+                      constants + sizeof(vec128_t) * relocation.value,
+                      sizeof(constant));
+          value = backend_->PoolConstant(constant);
+          if (!value) {
+            return false;
+          }
+          value_size = sizeof(uint32_t);
+        } break;
+        default:
+          assert_unhandled_case(relocation.type);
+          return false;
+      }
+      if (relocation.code_offset + value_size > code.size()) {
+        assert_always();
+        return false;
+      }
+      std::memcpy(code.data() + relocation.code_offset, &value, value_size);
+    }
+
+    source_map.resize(header.source_map_count);
+    std::memcpy(source_map.data(), payload,
+                sizeof(SourceMapEntry) * header.source_map_count);
+    ++stored_function_loaded_count_;
+  }
+
+  EmitFunctionInfo func_info = {};
+  func_info.code_size.prolog = header.prolog_size;
+  func_info.code_size.body = header.body_size;
+  func_info.code_size.epilog = header.epilog_size;
+  func_info.code_size.tail = header.tail_size;
+  func_info.code_size.total = header.code_size;
+  func_info.prolog_stack_alloc_offset = header.prolog_stack_alloc_offset;
+  func_info.stack_size = header.stack_size;
+
+  function->set_end_address(header.guest_end_address);
+  function->source_map() = std::move(source_map);
+
+  // Placing the code also installs it into the indirection table.
+  void* code_execute_address;
+  void* code_write_address;
+  backend_->code_cache()->PlaceGuestCode(
+      function->address(), code.data(), func_info, function,
+      code_execute_address, code_write_address);
+  static_cast<X64Function*>(function)->Setup(
+      reinterpret_cast<uint8_t*>(code_execute_address), header.code_size);
+  return true;
+}
+
+void X64AotCache::StoreFunction(
+    GuestFunction* function, const uint8_t* machine_code,
+    const EmitFunctionInfo& func_info,
+    const std::vector<X64Relocation>& relocations) {
+  if (!file_ || !function->end_address()) {
+    return;
+  }
+
+  FunctionHeader header = {};
+  header.guest_address = function->address();
+  header.guest_end_address = function->end_address();
+  header.guest_code_hash =
+      HashGuestCode(header.guest_address, header.guest_end_address);
+  header.code_size = uint32_t(func_info.code_size.total);
+  header.relocation_count = uint32_t(relocations.size());
+  header.source_map_count = uint32_t(function->source_map().size());
+  header.prolog_size = uint32_t(func_info.code_size.prolog);
+  header.body_size = uint32_t(func_info.code_size.body);
+  header.epilog_size = uint32_t(func_info.code_size.epilog);
+  header.tail_size = uint32_t(func_info.code_size.tail);
+  header.prolog_stack_alloc_offset =
+      uint32_t(func_info.prolog_stack_alloc_offset);
+  header.stack_size = uint32_t(func_info.stack_size);
+
+  std::vector<uint8_t> payload(
+      header.code_size + sizeof(StoredRelocation) * header.relocation_count +
+      sizeof(SourceMapEntry) * header.source_map_count);
+  uint8_t* payload_code = payload.data();
+  std::memcpy(payload_code, machine_code, header.code_size);
+  uint8_t* payload_relocations = payload_code + header.code_size;
+  uintptr_t anchor = GetHostImageAnchor();
+  std::vector<vec128_t> constants;
+  for (const X64Relocation& relocation : relocations) {
+    StoredRelocation stored_relocation;
+    stored_relocation.code_offset = relocation.code_offset;
+    stored_relocation.type = relocation.type;
+    // Keep the stored code independent of this session's image base and
+    // constant pool layout.
+    if (relocation.type == X64RelocationType::kConstantPool) {
+      uint32_t address;
+      std::memcpy(&address, payload_code + relocation.code_offset,
+                  sizeof(address));
+      stored_relocation.value = int64_t(constants.size());
+      constants.push_back(
+          *reinterpret_cast<const vec128_t*>(uintptr_t(address)));
+      std::memset(payload_code + relocation.code_offset, 0, sizeof(address));
+    } else {
+      uint64_t value;
+      std::memcpy(&value, payload_code + relocation.code_offset,
+                  sizeof(value));
+      stored_relocation.value = int64_t(value - anchor);
+      std::memset(payload_code + relocation.code_offset, 0, sizeof(value));
+    }
+    std::memcpy(payload_relocations, &stored_relocation,
+                sizeof(stored_relocation));
+    payload_relocations += sizeof(stored_relocation);
+  }
+  std::memcpy(payload_relocations, function->source_map().data(),
+              sizeof(SourceMapEntry) * header.source_map_count);
+  header.constant_count = uint32_t(constants.size());
+  payload.insert(payload.end(),
+                 reinterpret_cast<const uint8_t*>(constants.data()),
+                 reinterpret_cast<const uint8_t*>(constants.data() +
+                                                  constants.size()));
+  header.payload_hash = XXH3_64bits(payload.data(), payload.size());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!file_) {
+    return;
+  }
+  // The whole record is written under the lock, so records of different
+  // emulator instances are not interleaved. Unlocking also flushes it, so a
+  // crash doesn't lose the functions translated during the session.
+  xe::filesystem::LockStdioFile(file_, true);
+  fwrite(&header, sizeof(header), 1, file_);
+  fwrite(payload.data(), 1, payload.size(), file_);
+  xe::filesystem::UnlockStdioFile(file_);
+  ++stored_function_written_count_;
+}
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
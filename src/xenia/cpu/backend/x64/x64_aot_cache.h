@@ -0,0 +1,153 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_BACKEND_X64_X64_AOT_CACHE_H_
+#define XENIA_CPU_BACKEND_X64_X64_AOT_CACHE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/mapped_memory.h"
+#include "xenia/cpu/function.h"
+
+DECLARE_bool(x64_aot_cache);
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+class X64Backend;
+struct EmitFunctionInfo;
+
+enum class X64RelocationType : uint32_t {
+  // 64-bit immediate holding the absolute address of code or data inside the
+  // emulator executable image. Stored relative to GetHostImageAnchor() so it
+  // survives ASLR between runs of the same build.
+  kHostImage = 0,
+  // 32-bit displacement holding the address of an entry in the constant pool
+  // of the backend. Stored as the constant itself, as the pool is filled in a
+  // different order every run.
+  kConstantPool = 1,
+};
+
+struct X64Relocation {
+  // Offset of the relocated field from the start of the function code.
+  uint32_t code_offset;
+  X64RelocationType type;
+};
+
+// Persistent storage for machine code emitted by the x64 backend.
+// Code is stored per guest module (keyed by the module hash and the enabled
+// host instruction set extensions) and mapped back into the code cache when
+// the function is demanded, so warm starts skip the frontend, HIR passes and
+// the emitter entirely.
+//
+// Only functions that reference nothing but the module itself, the fixed code
+// cache thunks, the emitter constant table and pool and the emulator image are
+// stored; anything touching session-specific heap objects is left to the
+// translator.
+class X64AotCache {
+ public:
+  explicit X64AotCache(X64Backend* backend);
+  ~X64AotCache();
+
+  // Any address inside the emulator image, used as the base for kHostImage
+  // relocations.
+  static uintptr_t GetHostImageAnchor();
+
+  bool is_open() const { return file_ != nullptr; }
+
+  bool Initialize(const std::filesystem::path& storage_root,
+                  uint64_t module_hash);
+  void Shutdown();
+
+  // Places stored code for the function into the code cache if the guest code
+  // it was translated from is unchanged. Returns false if the function must
+  // be translated.
+  bool DefineFunction(GuestFunction* function);
+
+  // Appends freshly emitted code to the storage.
+  void StoreFunction(GuestFunction* function, const uint8_t* machine_code,
+                     const EmitFunctionInfo& func_info,
+                     const std::vector<X64Relocation>& relocations);
+
+ private:
+  struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t build_hash;
+    uint64_t module_hash;
+    uint32_t feature_flags;
+    // Options changing the emitted code, as CodegenOptions.
+    uint32_t codegen_flags;
+    // Locations baked into emitted code as absolute addresses. If any of these
+    // differ the stored code cannot be used.
+    uint64_t emitter_data;
+    uint64_t host_to_guest_thunk;
+    uint64_t guest_to_host_thunk;
+    uint64_t resolve_function_thunk;
+  };
+
+  struct FunctionHeader {
+    uint32_t guest_address;
+    uint32_t guest_end_address;
+    uint64_t guest_code_hash;
+    uint32_t code_size;
+    uint32_t relocation_count;
+    uint32_t source_map_count;
+    uint32_t prolog_size;
+    uint32_t body_size;
+    uint32_t epilog_size;
+    uint32_t tail_size;
+    uint32_t prolog_stack_alloc_offset;
+    uint32_t stack_size;
+    uint32_t constant_count;
+    // Hash of everything after the header, to detect truncated writes.
+    uint64_t payload_hash;
+  };
+
+  struct StoredRelocation {
+    uint32_t code_offset;
+    X64RelocationType type;
+    int64_t value;
+  };
+
+  void FillFileHeader(FileHeader& header) const;
+  uint64_t HashGuestCode(uint32_t address, uint32_t end_address) const;
+
+  X64Backend* backend_ = nullptr;
+
+  std::mutex mutex_;
+  FILE* file_ = nullptr;
+  uint64_t module_hash_ = 0;
+  // Read-only mapping of the storage file as of initialization, shared with
+  // the other emulator instances using the same file.
+  std::unique_ptr<MappedMemory> stored_data_mapping_;
+  // The valid records in the mapping, after the file header.
+  const uint8_t* stored_data_ = nullptr;
+  size_t stored_data_size_ = 0;
+  // Guest address -> offset of the FunctionHeader in stored_data_.
+  std::unordered_map<uint32_t, size_t> stored_functions_;
+  uint32_t stored_function_loaded_count_ = 0;
+  uint32_t stored_function_written_count_ = 0;
+};
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_BACKEND_X64_X64_AOT_CACHE_H_
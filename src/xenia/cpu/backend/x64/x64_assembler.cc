@@ -16,6 +16,7 @@
 #include "xenia/base/profiling.h"
 #include "xenia/base/reset_scope.h"
 #include "xenia/base/string.h"
+#include "xenia/cpu/backend/x64/x64_aot_cache.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 #include "xenia/cpu/backend/x64/x64_emitter.h"
@@ -78,8 +79,10 @@ bool X64Assembler::Assemble(GuestFunction* function, HIRBuilder* builder,
   // Lower HIR -> x64.
   void* machine_code = nullptr;
   size_t code_size = 0;
+  EmitFunctionInfo func_info;
   if (!emitter_->Emit(function, builder, debug_info_flags, debug_info.get(),
-                      &machine_code, &code_size, &function->source_map())) {
+                      &machine_code, &code_size, &function->source_map(),
+                      &func_info)) {
     return false;
   }
 
@@ -98,9 +101,22 @@ bool X64Assembler::Assemble(GuestFunction* function, HIRBuilder* builder,
   // Install into indirection table.
   uint64_t host_address = reinterpret_cast<uint64_t>(machine_code);
   assert_true((host_address >> 32) == 0);
-  reinterpret_cast<X64CodeCache*>(backend_->code_cache())
-      ->AddIndirection(function->address(),
-                       static_cast<uint32_t>(host_address));
+  auto code_cache = reinterpret_cast<X64CodeCache*>(backend_->code_cache());
+  code_cache->AddIndirection(function->address(),
+                             static_cast<uint32_t>(host_address));
+
+  // Persist for later runs. Done before any breakpoints get patched in.
+  X64AotCache* aot_cache = x64_backend_->aot_cache();
+  if (aot_cache && emitter_->is_persistable()) {
+    aot_cache->StoreFunction(function,
+                             reinterpret_cast<const uint8_t*>(machine_code),
+                             func_info, emitter_->relocations());
+  }
+
+  // Link calls to functions already translated, and to the rest once they
+  // are.
+  code_cache->AddCallSites(reinterpret_cast<const uint8_t*>(machine_code),
+                           emitter_->call_sites());
 
   return true;
 }
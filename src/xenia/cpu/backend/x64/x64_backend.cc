@@ -14,8 +14,10 @@
 #include "third_party/capstone/include/capstone/capstone.h"
 #include "third_party/capstone/include/capstone/x86.h"
 
+#include "xenia/base/clock.h"
 #include "xenia/base/exception_handler.h"
 #include "xenia/base/logging.h"
+#include "xenia/cpu/backend/x64/x64_aot_cache.h"
 #include "xenia/cpu/backend/x64/x64_assembler.h"
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 #include "xenia/cpu/backend/x64/x64_emitter.h"
@@ -23,6 +25,7 @@
 #include "xenia/cpu/backend/x64/x64_sequences.h"
 #include "xenia/cpu/backend/x64/x64_stack_layout.h"
 #include "xenia/cpu/breakpoint.h"
+#include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/cpu/stack_walker.h"
 
@@ -79,6 +82,8 @@ X64Backend::X64Backend() : Backend(), code_cache_(nullptr) {
 }
 
 X64Backend::~X64Backend() {
+  aot_cache_.reset();
+
   if (capstone_handle_) {
     cs_close(&capstone_handle_);
   }
@@ -98,13 +103,9 @@ bool X64Backend::Initialize(Processor* processor) {
     return false;
   }
 
-  // Need movbe to do advanced LOAD/STORE tricks.
-  if (cvars::x64_extension_mask & kX64EmitMovbe) {
-    machine_info_.supports_extended_load_store =
-        cpu.has(Xbyak::util::Cpu::tMOVBE);
-  } else {
-    machine_info_.supports_extended_load_store = false;
-  }
+  // Byte-swapped loads and stores use movbe if available, and fall back to
+  // swapping in a register, which is still no worse than separate swaps.
+  machine_info_.supports_extended_load_store = true;
 
   auto& gprs = machine_info_.register_sets[0];
   gprs.id = 0;
@@ -147,14 +148,78 @@ bool X64Backend::Initialize(Processor* processor) {
   // Setup exception callback
   ExceptionHandler::Install(&ExceptionCallbackThunk, this);
 
+  if (cvars::x64_aot_cache) {
+    aot_cache_ = std::make_unique<X64AotCache>(this);
+  }
+
   return true;
 }
 
+uint32_t X64Backend::PoolConstant(const vec128_t& value) {
+  std::lock_guard<std::mutex> lock(constant_pool_mutex_);
+  auto it = constant_pool_.find(value);
+  if (it != constant_pool_.end()) {
+    return it->second;
+  }
+  size_t offset = constant_pool_.size() * sizeof(vec128_t);
+  if (offset >= X64Emitter::kConstPoolSize) {
+    return 0;
+  }
+  auto entry = reinterpret_cast<vec128_t*>(
+      emitter_data_ + X64Emitter::GetConstPoolOffset() + offset);
+  *entry = value;
+  uint32_t address = uint32_t(reinterpret_cast<uintptr_t>(entry));
+  constant_pool_.emplace(value, address);
+  return address;
+}
+
 void X64Backend::CommitExecutableRange(uint32_t guest_low,
                                        uint32_t guest_high) {
   code_cache_->CommitExecutableRange(guest_low, guest_high);
 }
 
+void X64Backend::InitializeCodeStorage(
+    const std::filesystem::path& storage_root, uint64_t module_hash) {
+  if (aot_cache_) {
+    aot_cache_->Initialize(storage_root, module_hash);
+  }
+}
+
+void X64Backend::ShutdownCodeStorage() {
+  if (aot_cache_) {
+    aot_cache_->Shutdown();
+  }
+}
+
+bool X64Backend::DefineStoredFunction(GuestFunction* function) {
+  return aot_cache_ && aot_cache_->DefineFunction(function);
+}
+
+void X64Backend::InvalidateFunction(GuestFunction* function) {
+  code_cache_->InvalidateGuestCode(function);
+}
+
+uint32_t X64Backend::QueryCodegenOptions() const {
+  uint32_t options = 0;
+  if (cvars::x64_relaxed_dot_product_overflow) {
+    options |= kCodegenRelaxedDotProductOverflow;
+  }
+  if (cvars::guest_safepoints) {
+    options |= kCodegenGuestSafepoints;
+  }
+  if (cvars::spin_loop_hints) {
+    options |= kCodegenSpinLoopHints;
+  }
+  if (cvars::inline_tls_exports) {
+    options |= kCodegenInlineTlsExports;
+  }
+  // Selects the instructions emitted for OPCODE_LOAD_CLOCK.
+  if (cvars::clock_source_raw) {
+    options |= kCodegenRawClockSource;
+  }
+  return options;
+}
+
 std::unique_ptr<Assembler> X64Backend::CreateAssembler() {
   return std::make_unique<X64Assembler>(this);
 }
@@ -11,8 +11,11 @@
 #define XENIA_CPU_BACKEND_X64_X64_BACKEND_H_
 
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include "xenia/base/cvar.h"
+#include "xenia/base/vec128.h"
 #include "xenia/cpu/backend/backend.h"
 
 DECLARE_int32(x64_extension_mask);
@@ -25,12 +28,23 @@ namespace cpu {
 namespace backend {
 namespace x64 {
 
+class X64AotCache;
 class X64CodeCache;
 
 typedef void* (*HostToGuestThunk)(void* target, void* arg0, void* arg1);
 typedef void* (*GuestToHostThunk)(void* target, void* arg0, void* arg1);
 typedef void (*ResolveFunctionThunk)();
 
+// Options from the config baked into the emitted code, stored in the AOT cache
+// file header, so the values must not be changed.
+enum CodegenOptions : uint32_t {
+  kCodegenRelaxedDotProductOverflow = 1 << 0,
+  kCodegenGuestSafepoints = 1 << 1,
+  kCodegenSpinLoopHints = 1 << 2,
+  kCodegenInlineTlsExports = 1 << 3,
+  kCodegenRawClockSource = 1 << 4,
+};
+
 class X64Backend : public Backend {
  public:
   static const uint32_t kForceReturnAddress = 0x9FFF0000u;
@@ -39,8 +53,16 @@ class X64Backend : public Backend {
   ~X64Backend() override;
 
   X64CodeCache* code_cache() const { return code_cache_.get(); }
+  // Non-null if emitted code should be placed in the persistent AOT cache.
+  X64AotCache* aot_cache() const { return aot_cache_.get(); }
   uintptr_t emitter_data() const { return emitter_data_; }
 
+  // Address of a copy of the constant in the pool shared by all emitted code,
+  // so functions using the same constants don't each materialize them. The
+  // address is below 2 GB to be usable as an absolute displacement. Returns 0
+  // if the pool is full.
+  uint32_t PoolConstant(const vec128_t& value);
+
   // Call a generated function, saving all stack parameters.
   HostToGuestThunk host_to_guest_thunk() const { return host_to_guest_thunk_; }
   // Function that guest code can call to transition into host code.
@@ -54,6 +76,13 @@ class X64Backend : public Backend {
 
   void CommitExecutableRange(uint32_t guest_low, uint32_t guest_high) override;
 
+  void InitializeCodeStorage(const std::filesystem::path& storage_root,
+                             uint64_t module_hash) override;
+  void ShutdownCodeStorage() override;
+  bool DefineStoredFunction(GuestFunction* function) override;
+  void InvalidateFunction(GuestFunction* function) override;
+  uint32_t QueryCodegenOptions() const override;
+
   std::unique_ptr<Assembler> CreateAssembler() override;
 
   std::unique_ptr<GuestFunction> CreateGuestFunction(Module* module,
@@ -73,8 +102,17 @@ class X64Backend : public Backend {
   uintptr_t capstone_handle_ = 0;
 
   std::unique_ptr<X64CodeCache> code_cache_;
+  std::unique_ptr<X64AotCache> aot_cache_;
   uintptr_t emitter_data_ = 0;
 
+  struct ConstantHasher {
+    size_t operator()(const vec128_t& value) const {
+      return size_t(value.low * 0x9E3779B97F4A7C15ull ^ value.high);
+    }
+  };
+  std::mutex constant_pool_mutex_;
+  std::unordered_map<vec128_t, uint32_t, ConstantHasher> constant_pool_;
+
   HostToGuestThunk host_to_guest_thunk_;
   GuestToHostThunk guest_to_host_thunk_;
   ResolveFunctionThunk resolve_function_thunk_;
@@ -9,6 +9,7 @@
 
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 
@@ -19,13 +20,18 @@
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/assert.h"
+#include "xenia/base/atomic.h"
 #include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/literals.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/module.h"
+#include "xenia/memory.h"
+
+DECLARE_bool(host_huge_pages);
 
 namespace xe {
 namespace cpu {
@@ -120,6 +126,27 @@ bool X64CodeCache::Initialize() {
     }
   }
 
+  if (cvars::host_huge_pages) {
+    size_t huge_page_size = xe::memory::AdviseHugePages(
+        generated_code_execute_base_, kGeneratedCodeSize);
+    if (generated_code_write_base_ != generated_code_execute_base_) {
+      xe::memory::AdviseHugePages(generated_code_write_base_,
+                                  kGeneratedCodeSize);
+    }
+    XELOGI("Code cache: {} of {} MB may be backed by huge host pages",
+           huge_page_size >> 20, size_t(kGeneratedCodeSize) >> 20);
+  }
+
+  if (!Memory::PlaceOnHostNumaNodes(generated_code_execute_base_,
+                                    kGeneratedCodeSize) ||
+      (generated_code_write_base_ != generated_code_execute_base_ &&
+       !Memory::PlaceOnHostNumaNodes(generated_code_write_base_,
+                                     kGeneratedCodeSize))) {
+    XELOGW(
+        "Code cache: the host doesn't support NUMA placement, pages will be "
+        "on the nodes of the threads first touching them");
+  }
+
   // Preallocate the function map to a large, reasonable size.
   generated_code_map_.reserve(kMaximumFunctionCount);
 
@@ -136,9 +163,60 @@ void X64CodeCache::AddIndirection(uint32_t guest_address,
     return;
   }
 
+  std::lock_guard<std::mutex> lock(call_site_mutex_);
   uint32_t* indirection_slot = reinterpret_cast<uint32_t*>(
       indirection_table_base_ + (guest_address - kIndirectionTableBase));
   *indirection_slot = host_address;
+
+  // Point calls that were going through the table straight at the new code.
+  auto it = call_sites_.find(guest_address);
+  if (it != call_sites_.end()) {
+    for (const uint8_t* site : it->second) {
+      PatchCallSite(site, host_address);
+    }
+  }
+}
+
+void X64CodeCache::AddCallSites(const uint8_t* machine_code,
+                                const std::vector<X64CallSite>& call_sites) {
+  if (!indirection_table_base_ || call_sites.empty()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(call_site_mutex_);
+  for (const X64CallSite& call_site : call_sites) {
+    const uint8_t* site = machine_code + call_site.code_offset;
+    call_sites_[call_site.guest_address].push_back(site);
+    uint32_t host_address = *reinterpret_cast<const uint32_t*>(
+        indirection_table_base_ +
+        (call_site.guest_address - kIndirectionTableBase));
+    if (host_address != indirection_default_value_) {
+      PatchCallSite(site, host_address);
+    }
+  }
+}
+
+void X64CodeCache::PatchCallSite(const uint8_t* site_execute_address,
+                                 uint32_t host_address) {
+  // The execute and write views are page aligned, so the alignment of the
+  // site within them is the same.
+  uint8_t* site_write_address =
+      generated_code_write_base_ +
+      (site_execute_address - generated_code_execute_base_);
+  size_t qword_offset = uintptr_t(site_write_address) & 7;
+  assert_true(qword_offset <= 2);
+  auto qword_address = reinterpret_cast<volatile int64_t*>(
+      uintptr_t(site_write_address) & ~uintptr_t(7));
+  uint8_t qword[8];
+  int64_t old_value = *qword_address;
+  std::memcpy(qword, &old_value, sizeof(qword));
+  // mov eax, imm32
+  qword[qword_offset] = 0xC7;
+  qword[qword_offset + 1] = 0xC0;
+  std::memcpy(qword + qword_offset + 2, &host_address, sizeof(host_address));
+  int64_t new_value;
+  std::memcpy(&new_value, qword, sizeof(new_value));
+  xe::atomic_exchange(new_value, qword_address);
 }
 
 void X64CodeCache::CommitExecutableRange(uint32_t guest_low,
@@ -184,67 +262,133 @@ void X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
   {
     auto global_lock = global_critical_region_.Acquire();
 
-    low_mark = generated_code_offset_;
+    // The previous code of a retranslated function may still be running, so
+    // it's only retired here, to be reclaimed once nothing is in it.
+    if (function_info && function_info->machine_code()) {
+      size_t old_index = FindCodeEntry(function_info->machine_code());
+      if (old_index != SIZE_MAX &&
+          generated_code_map_[old_index].second == function_info) {
+        uint32_t old_code_size = generated_code_ranges_[old_index].code_size;
+        newly_retired_code_.push_back(old_index);
+        retired_code_size_ += old_code_size;
+        live_code_size_ -= old_code_size;
+        --live_function_count_;
+      }
+    }
 
-    // Reserve code.
-    // Always move the code to land on 16b alignment.
-    code_execute_address =
-        generated_code_execute_base_ + generated_code_offset_;
-    code_execute_address_out = code_execute_address;
-    uint8_t* code_write_address =
-        generated_code_write_base_ + generated_code_offset_;
-    code_write_address_out = code_write_address;
-    generated_code_offset_ += xe::round_up(func_info.code_size.total, 16);
-
-    auto tail_write_address =
-        generated_code_write_base_ + generated_code_offset_;
-
-    // Reserve unwind info.
-    // We go on the high size of the unwind info as we don't know how big we
-    // need it, and a few extra bytes of padding isn't the worst thing.
-    unwind_reservation = RequestUnwindReservation(generated_code_write_base_ +
-                                                  generated_code_offset_);
-    generated_code_offset_ += xe::round_up(unwind_reservation.data_size, 16);
-
-    auto end_write_address =
-        generated_code_write_base_ + generated_code_offset_;
+    // Reuse reclaimed space if there's a range the code fits in without
+    // leaving too much of it unused.
+    size_t code_capacity = xe::round_up(func_info.code_size.total, 16);
+    auto free_range = free_code_ranges_.end();
+    if (function_info) {
+      free_range = free_code_ranges_.lower_bound(uint32_t(code_capacity));
+      if (free_range != free_code_ranges_.end() &&
+          free_range->first > code_capacity * 2) {
+        free_range = free_code_ranges_.end();
+      }
+    }
 
-    high_mark = generated_code_offset_;
+    uint8_t* code_write_address;
+    uint8_t* tail_write_address;
+    uint8_t* end_write_address;
+    if (free_range != free_code_ranges_.end()) {
+      size_t map_index = free_range->second;
+      free_code_size_ -= free_range->first;
+      free_code_ranges_.erase(free_range);
+      auto& map_entry = generated_code_map_[map_index];
+      CodeRange& code_range = generated_code_ranges_[map_index];
+      map_entry.second = function_info;
+      code_range.code_size = uint32_t(func_info.code_size.total);
+      code_range.pinned = false;
+      low_mark = size_t(map_entry.first >> 32);
+      high_mark = size_t(uint32_t(map_entry.first));
+      code_execute_address = generated_code_execute_base_ + low_mark;
+      code_write_address = generated_code_write_base_ + low_mark;
+      // The unwind info is rewritten in place by PlaceCode.
+      tail_write_address = code_write_address + func_info.code_size.total;
+      end_write_address = code_write_address + code_range.code_capacity;
+      unwind_reservation = code_range.unwind_reservation;
+    } else {
+      low_mark = generated_code_offset_;
+
+      // Reserve code.
+      // Always move the code to land on 16b alignment.
+      code_execute_address =
+          generated_code_execute_base_ + generated_code_offset_;
+      code_write_address = generated_code_write_base_ + generated_code_offset_;
+      generated_code_offset_ += code_capacity;
+
+      tail_write_address = generated_code_write_base_ + generated_code_offset_;
+
+      // Reserve unwind info.
+      // We go on the high size of the unwind info as we don't know how big we
+      // need it, and a few extra bytes of padding isn't the worst thing.
+      unwind_reservation = RequestUnwindReservation(generated_code_write_base_ +
+                                                    generated_code_offset_);
+      generated_code_offset_ += xe::round_up(unwind_reservation.data_size, 16);
+
+      end_write_address = generated_code_write_base_ + generated_code_offset_;
+
+      high_mark = generated_code_offset_;
+      if (high_mark > kGeneratedCodeSize) {
+        LogStatistics();
+        xe::FatalError(
+            "The generated code region is full. Please report the title this "
+            "happened with.");
+      }
 
-    // Store in map. It is maintained in sorted order of host PC dependent on
-    // us also being append-only.
-    generated_code_map_.emplace_back(
-        (uint64_t(code_execute_address - generated_code_execute_base_) << 32) |
-            generated_code_offset_,
-        function_info);
-
-    // TODO(DrChat): The following code doesn't really need to be under the
-    // global lock except for PlaceCode (but it depends on the previous code
-    // already being ran)
-
-    // If we are going above the high water mark of committed memory, commit
-    // some more. It's ok if multiple threads do this, as redundant commits
-    // aren't harmful.
-    size_t old_commit_mark, new_commit_mark;
-    do {
-      old_commit_mark = generated_code_commit_mark_;
-      if (high_mark <= old_commit_mark) break;
-
-      new_commit_mark = old_commit_mark + 16_MiB;
-      if (generated_code_execute_base_ == generated_code_write_base_) {
-        xe::memory::AllocFixed(generated_code_execute_base_, new_commit_mark,
-                               xe::memory::AllocationType::kCommit,
-                               xe::memory::PageAccess::kExecuteReadWrite);
-      } else {
-        xe::memory::AllocFixed(generated_code_execute_base_, new_commit_mark,
-                               xe::memory::AllocationType::kCommit,
-                               xe::memory::PageAccess::kExecuteReadOnly);
-        xe::memory::AllocFixed(generated_code_write_base_, new_commit_mark,
-                               xe::memory::AllocationType::kCommit,
-                               xe::memory::PageAccess::kReadWrite);
+      // Store in map. It is maintained in sorted order of host PC dependent on
+      // us also being append-only.
+      generated_code_map_.emplace_back(
+          (uint64_t(code_execute_address - generated_code_execute_base_)
+           << 32) |
+              generated_code_offset_,
+          function_info);
+      CodeRange code_range;
+      code_range.code_capacity = uint32_t(code_capacity);
+      code_range.code_size = uint32_t(func_info.code_size.total);
+      code_range.unwind_reservation = unwind_reservation;
+      code_range.pinned = false;
+      generated_code_ranges_.push_back(code_range);
+
+      // TODO(DrChat): The following code doesn't really need to be under the
+      // global lock except for PlaceCode (but it depends on the previous code
+      // already being ran)
+
+      // If we are going above the high water mark of committed memory, commit
+      // some more. It's ok if multiple threads do this, as redundant commits
+      // aren't harmful.
+      size_t old_commit_mark, new_commit_mark;
+      bool committed = false;
+      do {
+        old_commit_mark = generated_code_commit_mark_;
+        if (high_mark <= old_commit_mark) break;
+
+        new_commit_mark = old_commit_mark + 16_MiB;
+        if (generated_code_execute_base_ == generated_code_write_base_) {
+          xe::memory::AllocFixed(generated_code_execute_base_, new_commit_mark,
+                                 xe::memory::AllocationType::kCommit,
+                                 xe::memory::PageAccess::kExecuteReadWrite);
+        } else {
+          xe::memory::AllocFixed(generated_code_execute_base_, new_commit_mark,
+                                 xe::memory::AllocationType::kCommit,
+                                 xe::memory::PageAccess::kExecuteReadOnly);
+          xe::memory::AllocFixed(generated_code_write_base_, new_commit_mark,
+                                 xe::memory::AllocationType::kCommit,
+                                 xe::memory::PageAccess::kReadWrite);
+        }
+        committed = true;
+      } while (generated_code_commit_mark_.compare_exchange_weak(
+          old_commit_mark, new_commit_mark));
+      // Report occupancy as the code grows.
+      if (committed) {
+        LogStatistics();
       }
-    } while (generated_code_commit_mark_.compare_exchange_weak(
-        old_commit_mark, new_commit_mark));
+    }
+    live_code_size_ += func_info.code_size.total;
+    if (function_info) {
+      ++live_function_count_;
+    }
 
     // Copy code.
     std::memcpy(code_write_address, machine_code, func_info.code_size.total);
@@ -303,6 +447,12 @@ uint32_t X64CodeCache::PlaceData(const void* data, size_t length) {
     generated_code_offset_ += xe::round_up(length, 16);
 
     high_mark = generated_code_offset_;
+    if (high_mark > kGeneratedCodeSize) {
+      LogStatistics();
+      xe::FatalError(
+          "The generated code region is full. Please report the title this "
+          "happened with.");
+    }
   }
 
   // If we are going above the high water mark of committed memory, commit some
@@ -335,6 +485,180 @@ uint32_t X64CodeCache::PlaceData(const void* data, size_t length) {
   return uint32_t(uintptr_t(data_address));
 }
 
+size_t X64CodeCache::FindCodeEntry(const uint8_t* code_execute_address) const {
+  uint32_t offset =
+      uint32_t(code_execute_address - generated_code_execute_base_);
+  auto it = std::upper_bound(
+      generated_code_map_.cbegin(), generated_code_map_.cend(), offset,
+      [](uint32_t offset, const std::pair<uint64_t, GuestFunction*>& entry) {
+        return offset < uint32_t(entry.first >> 32);
+      });
+  if (it == generated_code_map_.cbegin()) {
+    return SIZE_MAX;
+  }
+  --it;
+  if (offset >= uint32_t(it->first)) {
+    return SIZE_MAX;
+  }
+  return size_t(it - generated_code_map_.cbegin());
+}
+
+void X64CodeCache::PinCode(const uint8_t* code_execute_address) {
+  auto global_lock = global_critical_region_.Acquire();
+  size_t map_index = FindCodeEntry(code_execute_address);
+  if (map_index != SIZE_MAX) {
+    generated_code_ranges_[map_index].pinned = true;
+  }
+}
+
+void X64CodeCache::InvalidateGuestCode(GuestFunction* function) {
+  if (!indirection_table_base_) {
+    return;
+  }
+  uint32_t guest_address = function->address();
+  AddIndirection(guest_address, indirection_default_value_);
+
+  // Direct calls jump to the entry, which the emitter always starts with a
+  // 7 byte `sub rsp, imm32`. Its first 5 bytes are replaced with a jump to a
+  // stub for the resolve thunk, in a single atomic store like call sites, and
+  // as there's no instruction boundary between them threads entering the code
+  // see either the old or the new form.
+  const uint8_t* entry_execute_address = function->machine_code();
+  if (!entry_execute_address) {
+    return;
+  }
+  uint8_t* entry_write_address =
+      generated_code_write_base_ +
+      (entry_execute_address - generated_code_execute_base_);
+  assert_zero(uintptr_t(entry_write_address) & 7);
+  auto qword_address = reinterpret_cast<volatile int64_t*>(entry_write_address);
+  uint8_t qword[8];
+  int64_t old_value = *qword_address;
+  std::memcpy(qword, &old_value, sizeof(qword));
+  if (qword[0] != 0x48 || qword[1] != 0x81 || qword[2] != 0xEC) {
+    // Already redirected, or not from the emitter.
+    return;
+  }
+  // mov ebx, guest_address; mov eax, resolve thunk; jmp rax
+  uint8_t stub[12];
+  stub[0] = 0xBB;
+  std::memcpy(stub + 1, &guest_address, sizeof(guest_address));
+  stub[5] = 0xB8;
+  std::memcpy(stub + 6, &indirection_default_value_,
+              sizeof(indirection_default_value_));
+  stub[10] = 0xFF;
+  stub[11] = 0xE0;
+  uint32_t stub_write_address = PlaceData(stub, sizeof(stub));
+  const uint8_t* stub_execute_address =
+      generated_code_execute_base_ +
+      (uintptr_t(stub_write_address) - uintptr_t(generated_code_write_base_));
+  // jmp rel32
+  int32_t displacement =
+      int32_t(stub_execute_address - (entry_execute_address + 5));
+  qword[0] = 0xE9;
+  std::memcpy(qword + 1, &displacement, sizeof(displacement));
+  int64_t new_value;
+  std::memcpy(&new_value, qword, sizeof(new_value));
+  xe::atomic_exchange(new_value, qword_address);
+}
+
+size_t X64CodeCache::ReclaimRetiredCode(const std::vector<uint64_t>& host_pcs) {
+  std::vector<uint64_t> sorted_host_pcs(host_pcs);
+  std::sort(sorted_host_pcs.begin(), sorted_host_pcs.end());
+
+  auto global_lock = global_critical_region_.Acquire();
+  size_t freed_size = 0;
+  // Execute address ranges of the freed code, in order.
+  std::vector<std::pair<uintptr_t, uintptr_t>> freed_ranges;
+  size_t still_retired_count = 0;
+  for (size_t i = 0; i < retired_code_.size(); ++i) {
+    size_t map_index = retired_code_[i];
+    auto& map_entry = generated_code_map_[map_index];
+    uintptr_t range_start =
+        uintptr_t(generated_code_execute_base_) + (map_entry.first >> 32);
+    uintptr_t range_end =
+        uintptr_t(generated_code_execute_base_) + uint32_t(map_entry.first);
+    auto host_pc = std::lower_bound(sorted_host_pcs.cbegin(),
+                                    sorted_host_pcs.cend(), range_start);
+    if (host_pc != sorted_host_pcs.cend() && *host_pc < range_end) {
+      retired_code_[still_retired_count++] = map_index;
+      continue;
+    }
+    CodeRange& code_range = generated_code_ranges_[map_index];
+    // Other code may call it directly at any time.
+    if (code_range.pinned) {
+      retired_code_size_ -= code_range.code_size;
+      continue;
+    }
+    // Nothing to look up once nothing is running it.
+    map_entry.second = nullptr;
+    retired_code_size_ -= code_range.code_size;
+    freed_size += code_range.code_size;
+    free_code_ranges_.emplace(code_range.code_capacity, map_index);
+    free_code_size_ += code_range.code_capacity;
+    freed_ranges.emplace_back(range_start, range_end);
+  }
+  retired_code_.resize(still_retired_count);
+  retired_code_.insert(retired_code_.end(), newly_retired_code_.cbegin(),
+                       newly_retired_code_.cend());
+  newly_retired_code_.clear();
+
+  // Call sites in the freed code must not be patched once other code is
+  // placed there.
+  if (!freed_ranges.empty()) {
+    std::sort(freed_ranges.begin(), freed_ranges.end());
+    std::lock_guard<std::mutex> lock(call_site_mutex_);
+    for (auto& target_call_sites : call_sites_) {
+      auto& sites = target_call_sites.second;
+      sites.erase(
+          std::remove_if(
+              sites.begin(), sites.end(),
+              [&freed_ranges](const uint8_t* site) {
+                auto range = std::upper_bound(
+                    freed_ranges.cbegin(), freed_ranges.cend(),
+                    std::make_pair(uintptr_t(site), UINTPTR_MAX));
+                if (range == freed_ranges.cbegin()) {
+                  return false;
+                }
+                --range;
+                return uintptr_t(site) < range->second;
+              }),
+          sites.end());
+    }
+    XELOGI("Code cache: reclaimed {} KiB of retired code", freed_size / 1024);
+    LogStatistics();
+  }
+  return freed_size;
+}
+
+X64CodeCache::Statistics X64CodeCache::GetStatistics() {
+  auto global_lock = global_critical_region_.Acquire();
+  Statistics statistics;
+  statistics.reserved_size = kGeneratedCodeSize;
+  statistics.committed_size = generated_code_commit_mark_;
+  statistics.used_size = generated_code_offset_;
+  statistics.live_code_size = live_code_size_;
+  statistics.live_function_count = live_function_count_;
+  statistics.retired_code_size = retired_code_size_;
+  statistics.retired_function_count =
+      uint32_t(retired_code_.size() + newly_retired_code_.size());
+  statistics.free_code_size = free_code_size_;
+  statistics.free_range_count = uint32_t(free_code_ranges_.size());
+  return statistics;
+}
+
+void X64CodeCache::LogStatistics() {
+  Statistics statistics = GetStatistics();
+  XELOGI(
+      "Code cache: {} of {} MiB used, {} MiB committed; {} KiB live in {} "
+      "functions, {} KiB retired in {} functions, {} KiB free in {} ranges",
+      statistics.used_size >> 20, statistics.reserved_size >> 20,
+      statistics.committed_size >> 20, statistics.live_code_size >> 10,
+      statistics.live_function_count, statistics.retired_code_size >> 10,
+      statistics.retired_function_count, statistics.free_code_size >> 10,
+      statistics.free_range_count);
+}
+
 GuestFunction* X64CodeCache::LookupFunction(uint64_t host_pc) {
   uint32_t key = uint32_t(host_pc - kGeneratedCodeExecuteBase);
   void* fn_entry = std::bsearch(
@@ -13,8 +13,11 @@
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -39,6 +42,17 @@ struct EmitFunctionInfo {
   size_t stack_size;
 };
 
+// Call through the indirection table that can be patched into a direct call
+// once the target has been translated. The site is a 6 byte
+// `mov eax, dword [ebx + disp32]` that doesn't cross an 8 byte boundary, which
+// gets replaced with a `mov eax, imm32` of the same length in a single atomic
+// store, so threads running the code see either the old or the new form.
+struct X64CallSite {
+  // Offset of the load from the start of the function code.
+  uint32_t code_offset;
+  uint32_t guest_address;
+};
+
 class X64CodeCache : public CodeCache {
  public:
   ~X64CodeCache() override;
@@ -60,6 +74,10 @@ class X64CodeCache : public CodeCache {
   bool has_indirection_table() { return indirection_table_base_ != nullptr; }
   void set_indirection_default(uint32_t default_value);
   void AddIndirection(uint32_t guest_address, uint32_t host_address);
+  // Registers patchable call sites in placed code. Sites of already translated
+  // targets are patched right away, the rest on AddIndirection.
+  void AddCallSites(const uint8_t* machine_code,
+                    const std::vector<X64CallSite>& call_sites);
 
   void CommitExecutableRange(uint32_t guest_low, uint32_t guest_high);
 
@@ -74,8 +92,37 @@ class X64CodeCache : public CodeCache {
                       void*& code_write_address_out);
   uint32_t PlaceData(const void* data, size_t length);
 
+  // Keeps the code from being reclaimed once retired, as it's called directly
+  // from other code.
+  void PinCode(const uint8_t* code_execute_address);
+  // Sends calls that would run the current code of the function, whether
+  // through the indirection table, patched call sites or direct calls to its
+  // entry, to the resolve thunk, so the function gets defined again.
+  void InvalidateGuestCode(GuestFunction* function);
+
   GuestFunction* LookupFunction(uint64_t host_pc) override;
 
+  size_t retired_code_size() const override { return retired_code_size_; }
+  size_t ReclaimRetiredCode(const std::vector<uint64_t>& host_pcs) override;
+
+  // Occupancy of the generated code region.
+  struct Statistics {
+    size_t reserved_size;
+    size_t committed_size;
+    // Bump allocated, including data and unwind info.
+    size_t used_size;
+    size_t live_code_size;
+    uint32_t live_function_count;
+    // Superseded by retranslations, but possibly still running.
+    size_t retired_code_size;
+    uint32_t retired_function_count;
+    // Reclaimed, to be reused by new code.
+    size_t free_code_size;
+    uint32_t free_range_count;
+  };
+  Statistics GetStatistics();
+  void LogStatistics();
+
  protected:
   // All executable code falls within 0x80000000 to 0x9FFFFFFF, so we can
   // only map enough for lookups within that range.
@@ -111,6 +158,14 @@ class X64CodeCache : public CodeCache {
                          void* code_execute_address,
                          UnwindReservation unwind_reservation) {}
 
+  // Requires the global critical region. Returns the index of the
+  // generated_code_map_ entry containing the code, or SIZE_MAX.
+  size_t FindCodeEntry(const uint8_t* code_execute_address) const;
+
+  // Requires call_site_mutex_.
+  void PatchCallSite(const uint8_t* site_execute_address,
+                     uint32_t host_address);
+
   std::filesystem::path file_name_;
   xe::memory::FileMappingHandle mapping_ =
       xe::memory::kFileMappingHandleInvalid;
@@ -141,6 +196,33 @@ class X64CodeCache : public CodeCache {
   // This can be used to bsearch on host PC to find the guest function.
   // The key is [start address | end address].
   std::vector<std::pair<uint64_t, GuestFunction*>> generated_code_map_;
+  // Space of each generated_code_map_ entry, so that it can be reused in place
+  // once the code in it is retired and no longer running. The unwind info
+  // stays after the code at the same address, keeping the unwind table
+  // sorted.
+  struct CodeRange {
+    uint32_t code_capacity;
+    uint32_t code_size;
+    UnwindReservation unwind_reservation;
+    bool pinned;
+  };
+  std::vector<CodeRange> generated_code_ranges_;
+  // generated_code_map_ indices of superseded code, retired since the last
+  // ReclaimRetiredCode call and before it.
+  std::vector<size_t> newly_retired_code_;
+  std::vector<size_t> retired_code_;
+  std::atomic<size_t> retired_code_size_ = {0};
+  // generated_code_map_ indices of reclaimed ranges by code capacity.
+  std::multimap<uint32_t, size_t> free_code_ranges_;
+  size_t free_code_size_ = 0;
+  size_t live_code_size_ = 0;
+  uint32_t live_function_count_ = 0;
+
+  // Guest target address -> execute addresses of patchable call sites.
+  // Also held while writing indirection table entries, so a site can't miss
+  // the target being installed between it being registered and patched.
+  std::mutex call_site_mutex_;
+  std::unordered_map<uint32_t, std::vector<const uint8_t*>> call_sites_;
 };
 
 }  // namespace x64
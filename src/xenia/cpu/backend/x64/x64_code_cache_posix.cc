@@ -9,11 +9,48 @@
 
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 
+#include <cstdlib>
+#include <cstring>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/math.h"
+#include "xenia/base/platform.h"
+#include "xenia/cpu/backend/code_cache.h"
+
+// Registration of the DWARF call frame information for the generated code
+// with the unwinder, provided by libgcc or libunwind.
+extern "C" void __register_frame(void* begin);
+extern "C" void __deregister_frame(void* begin);
+
 namespace xe {
 namespace cpu {
 namespace backend {
 namespace x64 {
 
+// https://refspecs.linuxfoundation.org/LSB_5.0.0/LSB-Core-generic/LSB-Core-generic/ehframechpt.html
+// http://dwarfstd.org/doc/DWARF4.pdf - 6.4 Call Frame Information.
+enum : uint8_t {
+  DW_CFA_nop = 0x00,
+  DW_CFA_advance_loc1 = 0x02,
+  DW_CFA_def_cfa = 0x0C,
+  DW_CFA_def_cfa_offset = 0x0E,
+  DW_CFA_advance_loc = 0x40,
+  DW_CFA_offset = 0x80,
+};
+enum : uint8_t {
+  DW_EH_PE_absptr = 0x00,
+};
+// DWARF x86-64 register numbers.
+enum : uint8_t {
+  DW_REG_RSP = 7,
+  DW_REG_RIP = 16,
+};
+
+// One CIE and one FDE per function, followed by the zero terminator, so every
+// function is registered separately and can be replaced in place when its
+// code range is reused. The CIE is 24 bytes and the FDE is up to 32 bytes.
+static const uint32_t kUnwindInfoSize = 64;
+
 class PosixX64CodeCache : public X64CodeCache {
  public:
   PosixX64CodeCache();
@@ -21,19 +58,24 @@ class PosixX64CodeCache : public X64CodeCache {
 
   bool Initialize() override;
 
-  void* LookupUnwindInfo(uint64_t host_pc) override { return nullptr; }
+  void* LookupUnwindInfo(uint64_t host_pc) override;
 
  private:
-  /*
   UnwindReservation RequestUnwindReservation(uint8_t* entry_address) override;
-  void PlaceCode(uint32_t guest_address, void* machine_code, size_t code_size,
-                 size_t stack_size, void* code_execute_address,
+  void PlaceCode(uint32_t guest_address, void* machine_code,
+                 const EmitFunctionInfo& func_info, void* code_execute_address,
                  UnwindReservation unwind_reservation) override;
 
   void InitializeUnwindEntry(uint8_t* unwind_entry_address,
-                             size_t unwind_table_slot, void* code_address,
-                             size_t code_size, size_t stack_size);
-  */
+                             size_t unwind_table_slot,
+                             void* code_execute_address,
+                             const EmitFunctionInfo& func_info);
+
+  // The unwind table entries, sorted by the code address like the code, for
+  // walking the generated code frames without the unwinder.
+  std::vector<UnwindTableEntry> unwind_table_;
+  // Current number of entries in the table.
+  std::atomic<uint32_t> unwind_table_count_ = {0};
 };
 
 std::unique_ptr<X64CodeCache> X64CodeCache::Create() {
@@ -41,11 +83,170 @@ std::unique_ptr<X64CodeCache> X64CodeCache::Create() {
 }
 
 PosixX64CodeCache::PosixX64CodeCache() = default;
-PosixX64CodeCache::~PosixX64CodeCache() = default;
 
-bool PosixX64CodeCache::Initialize() { return X64CodeCache::Initialize(); }
+PosixX64CodeCache::~PosixX64CodeCache() {
+  for (uint32_t i = 0; i < unwind_table_count_; ++i) {
+    const UnwindTableEntry& entry = unwind_table_[i];
+    if (entry.frame_registration) {
+      __deregister_frame(entry.frame_registration);
+    }
+  }
+}
+
+bool PosixX64CodeCache::Initialize() {
+  if (!X64CodeCache::Initialize()) {
+    return false;
+  }
+
+  // We don't support reallocing right now, so this should be high.
+  unwind_table_.resize(kMaximumFunctionCount);
+
+  return true;
+}
+
+PosixX64CodeCache::UnwindReservation
+PosixX64CodeCache::RequestUnwindReservation(uint8_t* entry_address) {
+  assert_false(unwind_table_count_ >= kMaximumFunctionCount);
+  UnwindReservation unwind_reservation;
+  unwind_reservation.data_size = xe::round_up(kUnwindInfoSize, 16);
+  unwind_reservation.table_slot = unwind_table_count_++;
+  unwind_reservation.entry_address = entry_address;
+  return unwind_reservation;
+}
+
+void PosixX64CodeCache::PlaceCode(uint32_t guest_address, void* machine_code,
+                                  const EmitFunctionInfo& func_info,
+                                  void* code_execute_address,
+                                  UnwindReservation unwind_reservation) {
+  InitializeUnwindEntry(unwind_reservation.entry_address,
+                        unwind_reservation.table_slot, code_execute_address,
+                        func_info);
+}
+
+void PosixX64CodeCache::InitializeUnwindEntry(
+    uint8_t* unwind_entry_address, size_t unwind_table_slot,
+    void* code_execute_address, const EmitFunctionInfo& func_info) {
+  UnwindTableEntry& table_entry = unwind_table_[unwind_table_slot];
+
+  // The unwinder keeps using the registered data, so it must be unregistered
+  // before rewriting it when the code range is reused.
+  if (table_entry.frame_registration) {
+    __deregister_frame(table_entry.frame_registration);
+    table_entry.frame_registration = nullptr;
+  }
+
+  assert_true(func_info.prolog_stack_alloc_offset < 256);
+  assert_true(func_info.stack_size < (1 << 21));
+
+  uint8_t* p = unwind_entry_address;
+  auto write_u8 = [&p](uint8_t value) { *(p++) = value; };
+  auto write_u32 = [&p](uint32_t value) {
+    std::memcpy(p, &value, sizeof(value));
+    p += sizeof(value);
+  };
+  auto write_u64 = [&p](uint64_t value) {
+    std::memcpy(p, &value, sizeof(value));
+    p += sizeof(value);
+  };
+  auto write_uleb128 = [&p](uint32_t value) {
+    do {
+      uint8_t byte = value & 0x7F;
+      value >>= 7;
+      *(p++) = byte | (value ? 0x80 : 0x00);
+    } while (value);
+  };
+  // Pads the entry to 8 bytes and writes its length.
+  auto end_entry = [&p](uint8_t* entry_start) {
+    while ((p - entry_start) & 7) {
+      *(p++) = DW_CFA_nop;
+    }
+    uint32_t length = uint32_t(p - entry_start - sizeof(uint32_t));
+    std::memcpy(entry_start, &length, sizeof(length));
+  };
+
+  // CIE - on entry, the CFA is rsp + 8, with the return address below it.
+  uint8_t* cie = p;
+  write_u32(0);  // Length.
+  write_u32(0);  // CIE ID.
+  write_u8(1);   // Version.
+  write_u8('z');
+  write_u8('R');
+  write_u8(0);
+  write_uleb128(1);  // Code alignment factor.
+  write_u8(0x78);    // Data alignment factor, -8 as SLEB128.
+  write_u8(DW_REG_RIP);
+  write_uleb128(1);  // Augmentation data length.
+  write_u8(DW_EH_PE_absptr);
+  write_u8(DW_CFA_def_cfa);
+  write_uleb128(DW_REG_RSP);
+  write_uleb128(8);
+  write_u8(DW_CFA_offset | DW_REG_RIP);
+  write_uleb128(1);
+  end_entry(cie);
+
+  // FDE - the only thing done to the stack in the prolog is the allocation.
+  // The nonvolatile registers saved by the thunks are not described, same as
+  // in the Windows unwind info.
+  uint8_t* fde = p;
+  write_u32(0);  // Length.
+  write_u32(uint32_t(p - cie));
+  write_u64(reinterpret_cast<uint64_t>(code_execute_address));
+  write_u64(func_info.code_size.total);
+  write_uleb128(0);  // Augmentation data length.
+  if (func_info.stack_size) {
+    if (func_info.prolog_stack_alloc_offset < 64) {
+      write_u8(DW_CFA_advance_loc |
+               uint8_t(func_info.prolog_stack_alloc_offset));
+    } else {
+      write_u8(DW_CFA_advance_loc1);
+      write_u8(uint8_t(func_info.prolog_stack_alloc_offset));
+    }
+    write_u8(DW_CFA_def_cfa_offset);
+    write_uleb128(uint32_t(func_info.stack_size + 8));
+  }
+  end_entry(fde);
+
+  write_u32(0);  // Terminator.
+  assert_true(size_t(p - unwind_entry_address) <= kUnwindInfoSize);
+
+  table_entry.begin_address = uint32_t(
+      reinterpret_cast<uint8_t*>(code_execute_address) -
+      generated_code_execute_base_);
+  table_entry.end_address =
+      uint32_t(table_entry.begin_address + func_info.code_size.total);
+  table_entry.prolog_stack_alloc_offset =
+      uint32_t(func_info.prolog_stack_alloc_offset);
+  table_entry.stack_size = uint32_t(func_info.stack_size);
+
+  // libgcc takes the whole section to the terminator, libunwind takes a single
+  // FDE.
+#if XE_PLATFORM_MAC
+  table_entry.frame_registration = fde;
+#else
+  table_entry.frame_registration = cie;
+#endif
+  __register_frame(table_entry.frame_registration);
+}
+
+void* PosixX64CodeCache::LookupUnwindInfo(uint64_t host_pc) {
+  return std::bsearch(
+      &host_pc, unwind_table_.data(), unwind_table_count_,
+      sizeof(UnwindTableEntry),
+      [](const void* key_ptr, const void* element_ptr) {
+        auto key = *reinterpret_cast<const uintptr_t*>(key_ptr) -
+                   kGeneratedCodeExecuteBase;
+        auto element = reinterpret_cast<const UnwindTableEntry*>(element_ptr);
+        if (key < element->begin_address) {
+          return -1;
+        } else if (key >= element->end_address) {
+          return 1;
+        } else {
+          return 0;
+        }
+      });
+}
 
 }  // namespace x64
 }  // namespace backend
 }  // namespace cpu
-}  // namespace xe
\ No newline at end of file
+}  // namespace xe
@@ -11,18 +11,23 @@
 
 #include <stddef.h>
 
+#include <algorithm>
 #include <climits>
 #include <cstring>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/assert.h"
 #include "xenia/base/atomic.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/debugging.h"
 #include "xenia/base/literals.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/threading.h"
 #include "xenia/base/vec128.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
@@ -43,6 +48,12 @@ DEFINE_bool(ignore_undefined_externs, true,
 DEFINE_bool(emit_source_annotations, false,
             "Add extra movs and nops to make disassembly easier to read.",
             "CPU");
+DEFINE_bool(x64_patch_call_sites, false,
+            "Patch calls to functions that weren't translated yet to call the "
+            "generated code directly once it's available, rather than going "
+            "through the indirection table every time. Not used with "
+            "x64_aot_cache.",
+            "x64");
 
 namespace xe {
 namespace cpu {
@@ -81,9 +92,18 @@ X64Emitter::X64Emitter(X64Backend* backend, XbyakAllocator* allocator)
     return;
   }
 
+  feature_flags_ = DetectFeatureFlags();
+}
+
+X64Emitter::~X64Emitter() = default;
+
+uint32_t X64Emitter::DetectFeatureFlags() {
+  Xbyak::util::Cpu cpu;
+  uint32_t feature_flags = 0;
+
 #define TEST_EMIT_FEATURE(emit, ext)                \
   if ((cvars::x64_extension_mask & emit) == emit) { \
-    feature_flags_ |= (cpu_.has(ext) ? emit : 0);   \
+    feature_flags |= (cpu.has(ext) ? emit : 0);     \
   }
 
   TEST_EMIT_FEATURE(kX64EmitAVX2, Xbyak::util::Cpu::tAVX2);
@@ -101,14 +121,58 @@ X64Emitter::X64Emitter(X64Backend* backend, XbyakAllocator* allocator)
   TEST_EMIT_FEATURE(kX64EmitAVX512VBMI, Xbyak::util::Cpu::tAVX512_VBMI);
 
 #undef TEST_EMIT_FEATURE
+
+  return feature_flags;
 }
 
-X64Emitter::~X64Emitter() = default;
+// This is used by baseline tier functions once they become hot.
+uint64_t RequestTierUp(void* raw_context, uint64_t function_ptr) {
+  auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
+  thread_state->processor()->RequestTierUp(
+      reinterpret_cast<GuestFunction*>(function_ptr));
+  return 0;
+}
+
+// This is used at safepoint polls when another thread wants this one to stop.
+uint64_t EnterSafepoint(void* raw_context) {
+  auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
+  thread_state->EnterSafepoint();
+  return 0;
+}
+
+// This is used in detected spin loops once the countdown expires.
+uint64_t SpinLoopYield(void* raw_context) {
+  auto context = reinterpret_cast<ppc::PPCContext*>(raw_context);
+  int32_t iterations = cvars::spin_loop_yield_iterations;
+  if (iterations <= 0) {
+    context->spin_loop_countdown = INT16_MAX;
+    return 0;
+  }
+  context->spin_loop_countdown = int16_t(std::min(iterations, INT16_MAX));
+  // Back off from letting other ready threads run to sleeping while the
+  // thread keeps spinning without doing anything else for long between the
+  // yields.
+  thread_local uint32_t yield_streak = 0;
+  thread_local uint64_t last_yield_end_tick = 0;
+  uint64_t tick = Clock::QueryHostTickCount();
+  if (tick - last_yield_end_tick > Clock::QueryHostTickFrequency() / 1000) {
+    yield_streak = 0;
+  }
+  if (yield_streak < 64) {
+    ++yield_streak;
+    xe::threading::MaybeYield();
+  } else {
+    xe::threading::Sleep(std::chrono::microseconds(100));
+  }
+  last_yield_end_tick = Clock::QueryHostTickCount();
+  return 0;
+}
 
 bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
                       uint32_t debug_info_flags, FunctionDebugInfo* debug_info,
                       void** out_code_address, size_t* out_code_size,
-                      std::vector<SourceMapEntry>* out_source_map) {
+                      std::vector<SourceMapEntry>* out_source_map,
+                      EmitFunctionInfo* out_func_info) {
   SCOPE_profile_cpu_f("cpu");
 
   // Reset.
@@ -116,6 +180,30 @@ bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
   debug_info_flags_ = debug_info_flags;
   trace_data_ = &function->trace_data();
   source_map_arena_.Reset();
+  relocations_.clear();
+  call_sites_.clear();
+  current_guest_address_ = 0;
+  // Instrumentation references trace buffers allocated for this session.
+  persistable_ = !debug_info_flags;
+  // Baseline code is only meant to be used until the optimized code is ready.
+  tier_up_function_ = nullptr;
+  if (function->translation_tier() == TranslationTier::kBaseline) {
+    tier_up_function_ = function;
+    persistable_ = false;
+  }
+  // Code of other functions is not covered by the storage's guest code check.
+  if (builder->attributes() & hir::FUNCTION_ATTRIB_INLINED_CALLS) {
+    persistable_ = false;
+  }
+  // Hot tier code is not profiled, as it's as far as recompilation goes.
+  profile_function_ = nullptr;
+  if (processor_->is_profiling_functions() &&
+      function->translation_tier() != TranslationTier::kHot &&
+      function->translation_tier() != TranslationTier::kRecompilingHot) {
+    function->EnsureProfileData();
+    profile_function_ = function;
+    persistable_ = false;
+  }
 
   // Fill the generator with code.
   EmitFunctionInfo func_info = {};
@@ -130,6 +218,10 @@ bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
   // Stash source map.
   source_map_arena_.CloneContents(out_source_map);
 
+  if (out_func_info) {
+    *out_func_info = func_info;
+  }
+
   return true;
 }
 
@@ -205,7 +297,12 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
   func_info.stack_size = stack_size;
   stack_size_ = stack_size;
 
-  sub(rsp, (uint32_t)stack_size);
+  // Always the imm32 form, so that X64CodeCache::InvalidateGuestCode can
+  // replace it with a jump.
+  db(0x48);
+  db(0x81);
+  db(0xEC);
+  dd(uint32_t(stack_size));
 
   code_offsets.prolog_stack_alloc = getSize();
   code_offsets.body = getSize();
@@ -242,10 +339,56 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
     bts(qword[low_address(&trace_header->function_thread_use)], rax);
   }
 
+  // Ask for the function to be optimized once it has been called enough.
+  // Only the call that takes the countdown to exactly zero makes the request.
+  if (tier_up_function_) {
+    Xbyak::Label skip_tier_up;
+    mov(rax,
+        reinterpret_cast<uint64_t>(tier_up_function_->tier_up_countdown()));
+    lock();
+    dec(dword[rax]);
+    jnz(skip_tier_up, CodeGenerator::T_NEAR);
+    mov(GetNativeParam(0), reinterpret_cast<uint64_t>(tier_up_function_));
+    CallNativeSafe(reinterpret_cast<void*>(RequestTierUp));
+    L(skip_tier_up);
+  }
+
+  // Count calls for the function profiler.
+  if (profile_function_) {
+    mov(rax, reinterpret_cast<uint64_t>(
+                 &profile_function_->profile_data()->call_count));
+    lock();
+    inc(qword[rax]);
+  }
+
   // Load membase.
   mov(GetMembaseReg(),
       qword[GetContextReg() + offsetof(ppc::PPCContext, virtual_membase)]);
 
+  // Blocks that are branched to from themselves or from later blocks start
+  // loops, and get a safepoint poll so that a thread spinning in guest code
+  // stops quickly when asked to.
+  std::unordered_set<const hir::Block*> loop_headers;
+  if (cvars::guest_safepoints) {
+    std::unordered_map<const hir::Block*, uint32_t> block_order;
+    uint32_t block_index = 0;
+    for (auto block = builder->first_block(); block; block = block->next) {
+      block_order.emplace(block, block_index++);
+      for (auto i = block->instr_head; i; i = i->next) {
+        hir::Label* target = nullptr;
+        if (i->opcode == &hir::OPCODE_BRANCH_info) {
+          target = i->src1.label;
+        } else if (i->opcode == &hir::OPCODE_BRANCH_TRUE_info ||
+                   i->opcode == &hir::OPCODE_BRANCH_FALSE_info) {
+          target = i->src2.label;
+        }
+        if (target && block_order.count(target->block)) {
+          loop_headers.insert(target->block);
+        }
+      }
+    }
+  }
+
   // Body.
   auto block = builder->first_block();
   while (block) {
@@ -256,6 +399,51 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
       label = label->next;
     }
 
+    // The guest to host thunk preserves the volatile registers, so the poll
+    // is transparent to the code around it.
+    if (loop_headers.count(block)) {
+      Xbyak::Label skip_safepoint;
+      cmp(byte[GetContextReg() + offsetof(ppc::PPCContext, safepoint_request)],
+          0);
+      jz(skip_safepoint, CodeGenerator::T_NEAR);
+      CallNativeSafe(reinterpret_cast<void*>(EnterSafepoint));
+      L(skip_safepoint);
+    }
+
+    // Let the host CPU know about the spinning to give the resources to the
+    // other hardware thread of the core, and yield periodically so the guest
+    // thread being waited for can run when there are fewer host cores than
+    // guest hardware threads.
+    if (block->flags & hir::Block::SPIN_LOOP_HEADER) {
+      Xbyak::Label skip_spin_loop_yield;
+      pause();
+      dec(word[GetContextReg() +
+               offsetof(ppc::PPCContext, spin_loop_countdown)]);
+      jg(skip_spin_loop_yield, CodeGenerator::T_NEAR);
+      CallNativeSafe(reinterpret_cast<void*>(SpinLoopYield));
+      L(skip_spin_loop_yield);
+    }
+
+    // Count executions for the function profiler, by the guest instruction
+    // the block starts at.
+    if (profile_function_) {
+      auto profile_data = profile_function_->profile_data();
+      for (auto i = block->instr_head; i; i = i->next) {
+        if (i->opcode != &hir::OPCODE_SOURCE_OFFSET_info) {
+          continue;
+        }
+        uint32_t index =
+            (uint32_t(i->src1.offset) - profile_function_->address()) / 4;
+        if (index < profile_data->instruction_count) {
+          mov(rax, reinterpret_cast<uint64_t>(
+                       &profile_data->block_execute_counts[index]));
+          lock();
+          inc(qword[rax]);
+        }
+        break;
+      }
+    }
+
     // Process instructions.
     const Instr* instr = block->instr_head;
     while (instr) {
@@ -310,6 +498,7 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
 void X64Emitter::MarkSourceOffset(const Instr* i) {
   auto entry = source_map_arena_.Alloc<SourceMapEntry>();
   entry->guest_address = static_cast<uint32_t>(i->src1.offset);
+  current_guest_address_ = entry->guest_address;
   entry->hir_offset = uint32_t(i->block->ordinal << 16) | i->ordinal;
   entry->code_offset = static_cast<uint32_t>(getSize());
 
@@ -330,6 +519,16 @@ void X64Emitter::MarkSourceOffset(const Instr* i) {
   }
 }
 
+bool X64Emitter::IsKnownMmioAccess() const {
+  return current_guest_address_ &&
+         processor_->IsKnownMmioAccess(current_guest_address_);
+}
+
+bool X64Emitter::IsKnownWatchedStore() const {
+  return current_guest_address_ &&
+         processor_->IsKnownWatchedStore(current_guest_address_);
+}
+
 void X64Emitter::EmitGetCurrentThreadId() {
   // rsi must point to context. We could fetch from the stack if needed.
   mov(ax, word[GetContextReg() + offsetof(ppc::PPCContext, thread_id)]);
@@ -415,17 +614,40 @@ void X64Emitter::Call(const hir::Instr* instr, GuestFunction* function) {
   assert_not_null(function);
   auto fn = static_cast<X64Function*>(function);
   // Resolve address to the function to call and store in rax.
-  if (fn->machine_code()) {
+  // Code placed in the AOT cache may be loaded at a different location in the
+  // code cache on the next run, so it must always go through the indirection
+  // table rather than embed the address of another function. The same goes
+  // for code that will be replaced once it gets hot: baseline tier code, and
+  // optimized code when profiling.
+  bool final_tier =
+      fn->translation_tier() == TranslationTier::kHot ||
+      (fn->translation_tier() == TranslationTier::kOptimized &&
+       !processor_->is_profiling_functions());
+  if (fn->machine_code() && !backend()->aot_cache() && final_tier) {
     // TODO(benvanik): is it worth it to do this? It removes the need for
     // a ResolveFunction call, but makes the table less useful.
     assert_zero(uint64_t(fn->machine_code()) & 0xFFFFFFFF00000000);
+    code_cache_->PinCode(fn->machine_code());
     mov(eax, uint32_t(uint64_t(fn->machine_code())));
   } else if (code_cache_->has_indirection_table()) {
     // Load the pointer to the indirection table maintained in X64CodeCache.
     // The target dword will either contain the address of the generated code
     // or a thunk to ResolveAddress.
     mov(ebx, function->address());
-    mov(eax, dword[ebx]);
+    if (cvars::x64_patch_call_sites && !backend()->aot_cache()) {
+      // See X64CallSite. Code is placed at 16 byte alignment, so offsets
+      // within the function have the same alignment as the final address.
+      while ((getSize() & 7) > 2) {
+        nop();
+      }
+      call_sites_.push_back({uint32_t(getSize()), function->address()});
+      // mov eax, dword[ebx + 0], forcing a 32-bit displacement.
+      db(0x8B);
+      db(0x83);
+      dd(0);
+    } else {
+      mov(eax, dword[ebx]);
+    }
   } else {
     // Old-style resolve.
     // Not too important because indirection table is almost always available.
@@ -521,6 +743,8 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
       mov(rdx, reinterpret_cast<uint64_t>(builtin_function->arg0()));
       mov(r8, reinterpret_cast<uint64_t>(builtin_function->arg1()));
       call(rax);
+      // Builtin arguments are heap objects.
+      MarkNotPersistable();
       // rax = host return
     }
   } else if (function->behavior() == Function::Behavior::kExtern) {
@@ -533,7 +757,8 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
       // r9  = arg2
       auto thunk = backend()->guest_to_host_thunk();
       mov(rax, reinterpret_cast<uint64_t>(thunk));
-      mov(rcx, reinterpret_cast<uint64_t>(extern_function->extern_handler()));
+      MovHostImageAddress(rcx, reinterpret_cast<const void*>(
+                                   extern_function->extern_handler()));
       mov(rdx,
           qword[GetContextReg() + offsetof(ppc::PPCContext, kernel_state)]);
       call(rax);
@@ -542,6 +767,7 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
   }
   if (undefined) {
     CallNative(UndefinedCallExtern, reinterpret_cast<uint64_t>(function));
+    MarkNotPersistable();
   }
 }
 
@@ -568,7 +794,7 @@ void X64Emitter::CallNativeSafe(void* fn) {
   // r9  = arg2
   auto thunk = backend()->guest_to_host_thunk();
   mov(rax, reinterpret_cast<uint64_t>(thunk));
-  mov(rcx, reinterpret_cast<uint64_t>(fn));
+  MovHostImageAddress(rcx, fn);
   call(rax);
   // rax = host return
 }
@@ -620,6 +846,17 @@ void X64Emitter::nop(size_t length) {
   }
 }
 
+void X64Emitter::MovHostImageAddress(const Xbyak::Reg64& reg,
+                                     const void* address) {
+  // Encode as movabs manually - xbyak picks shorter forms for small values,
+  // but relocations need a fixed-size immediate.
+  db(0x48 | (reg.getIdx() >= 8 ? 0x01 : 0x00));
+  db(0xB8 | (reg.getIdx() & 0x7));
+  relocations_.push_back(
+      {uint32_t(getSize()), X64RelocationType::kHostImage});
+  dq(reinterpret_cast<uint64_t>(address));
+}
+
 bool X64Emitter::ConstantFitsIn32Reg(uint64_t v) {
   if ((v & ~0x7FFFFFFF) == 0) {
     // Fits under 31 bits, so just load using normal mov.
@@ -782,7 +1019,7 @@ uintptr_t X64Emitter::PlaceConstData() {
   void* mem = nullptr;
   while (!mem) {
     mem = memory::AllocFixed(
-        ptr, xe::round_up(kConstDataSize, memory::page_size()),
+        ptr, GetConstPoolOffset() + kConstPoolSize,
         memory::AllocationType::kReserveCommit, memory::PageAccess::kReadWrite);
 
     ptr += kConstDataIncrement;
@@ -801,6 +1038,11 @@ void X64Emitter::FreeConstData(uintptr_t data) {
                        memory::DeallocationType::kRelease);
 }
 
+size_t X64Emitter::GetConstPoolOffset() {
+  // The pool stays writable, so it must not share pages with the table.
+  return xe::round_up(kConstDataSize, memory::page_size());
+}
+
 Xbyak::Address X64Emitter::GetXmmConstPtr(XmmConst id) {
   // Load through fixed constant table setup by PlaceConstData.
   // It's important that the pointer is not signed, as it will be sign-extended.
@@ -818,9 +1060,14 @@ void X64Emitter::LoadConstantXmm(Xbyak::Xmm dest, const vec128_t& v) {
   } else if (v.low == ~uint64_t(0) && v.high == ~uint64_t(0)) {
     // 1111...
     vpcmpeqb(dest, dest);
+  } else if (uint32_t address = backend_->PoolConstant(v)) {
+    // Shared with all other code using the same constant. The displacement is
+    // the last field of the instruction, where it can be relocated.
+    vmovdqa(dest, ptr[reinterpret_cast<void*>(uintptr_t(address))]);
+    relocations_.push_back(
+        {uint32_t(getSize() - sizeof(uint32_t)),
+         X64RelocationType::kConstantPool});
   } else {
-    // TODO(benvanik): see what other common values are.
-    // TODO(benvanik): build constant table - 99% are reused.
     MovMem64(rsp + kStashOffset, v.low);
     MovMem64(rsp + kStashOffset + 8, v.high);
     vmovdqa(dest, ptr[rsp + kStashOffset]);
@@ -865,6 +1112,15 @@ void X64Emitter::LoadConstantXmm(Xbyak::Xmm dest, double v) {
   }
 }
 
+uint32_t X64Emitter::GetPooledStashAddress(const vec128_t& v) {
+  // The instruction the address is used in is unknown here, so the location
+  // of the displacement to relocate in stored code is too.
+  if (backend_->aot_cache()) {
+    return 0;
+  }
+  return backend_->PoolConstant(v);
+}
+
 Xbyak::Address X64Emitter::StashXmm(int index, const Xbyak::Xmm& r) {
   auto addr = ptr[rsp + kStashOffset + (index * 16)];
   vmovups(addr, r);
@@ -876,6 +1132,9 @@ Xbyak::Address X64Emitter::StashConstantXmm(int index, float v) {
     float f;
     uint32_t i;
   } x = {v};
+  if (uint32_t address = GetPooledStashAddress(vec128q(x.i, 0))) {
+    return ptr[reinterpret_cast<void*>(uintptr_t(address))];
+  }
   auto addr = rsp + kStashOffset + (index * 16);
   MovMem64(addr, x.i);
   MovMem64(addr + 8, 0);
@@ -887,6 +1146,9 @@ Xbyak::Address X64Emitter::StashConstantXmm(int index, double v) {
     double d;
     uint64_t i;
   } x = {v};
+  if (uint32_t address = GetPooledStashAddress(vec128q(x.i, 0))) {
+    return ptr[reinterpret_cast<void*>(uintptr_t(address))];
+  }
   auto addr = rsp + kStashOffset + (index * 16);
   MovMem64(addr, x.i);
   MovMem64(addr + 8, 0);
@@ -894,6 +1156,9 @@ Xbyak::Address X64Emitter::StashConstantXmm(int index, double v) {
 }
 
 Xbyak::Address X64Emitter::StashConstantXmm(int index, const vec128_t& v) {
+  if (uint32_t address = GetPooledStashAddress(v)) {
+    return ptr[reinterpret_cast<void*>(uintptr_t(address))];
+  }
   auto addr = rsp + kStashOffset + (index * 16);
   MovMem64(addr, v.low);
   MovMem64(addr + 8, v.high);
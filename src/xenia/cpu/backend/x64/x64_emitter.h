@@ -13,6 +13,8 @@
 #include <vector>
 
 #include "xenia/base/arena.h"
+#include "xenia/cpu/backend/x64/x64_aot_cache.h"
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/function_trace_data.h"
 #include "xenia/cpu/hir/hir_builder.h"
@@ -154,13 +156,45 @@ class X64Emitter : public Xbyak::CodeGenerator {
   Processor* processor() const { return processor_; }
   X64Backend* backend() const { return backend_; }
 
+  // The constant table, followed by the pages of the constant pool managed by
+  // X64Backend::PoolConstant.
   static uintptr_t PlaceConstData();
   static void FreeConstData(uintptr_t data);
+  static size_t GetConstPoolOffset();
+  static const size_t kConstPoolSize = 1024 * 1024;
+
+  // Returns the kX64Emit* features allowed by x64_extension_mask and supported
+  // by the host CPU.
+  static uint32_t DetectFeatureFlags();
 
   bool Emit(GuestFunction* function, hir::HIRBuilder* builder,
             uint32_t debug_info_flags, FunctionDebugInfo* debug_info,
             void** out_code_address, size_t* out_code_size,
-            std::vector<SourceMapEntry>* out_source_map);
+            std::vector<SourceMapEntry>* out_source_map,
+            EmitFunctionInfo* out_func_info);
+
+  uint32_t debug_info_flags() const { return debug_info_flags_; }
+
+  // Relocations recorded while emitting the last function.
+  const std::vector<X64Relocation>& relocations() const {
+    return relocations_;
+  }
+  // Whether the last emitted function only references state that is the same
+  // across runs, so it can be persisted in the AOT cache.
+  bool is_persistable() const { return persistable_; }
+  // Marks the function being emitted as referencing session-specific state
+  // (heap objects and such) that can't be relocated.
+  void MarkNotPersistable() { persistable_ = false; }
+  // Patchable calls through the indirection table in the last function.
+  const std::vector<X64CallSite>& call_sites() const { return call_sites_; }
+  // Whether the guest instruction being emitted has been seen accessing MMIO,
+  // so its memory accesses must check for MMIO ranges instead of relying on
+  // access violations.
+  bool IsKnownMmioAccess() const;
+  // Whether the guest instruction being emitted has been seen storing to
+  // write-watched physical memory, so its stores must check the watches
+  // instead of relying on access violations.
+  bool IsKnownWatchedStore() const;
 
  public:
   // Reserved:  rsp, rsi, rdi
@@ -220,6 +254,10 @@ class X64Emitter : public Xbyak::CodeGenerator {
 
   void nop(size_t length = 1);
 
+  // Moves the address of code or data in the emulator executable into the
+  // register, always as a full 64-bit immediate so it can be relocated.
+  void MovHostImageAddress(const Xbyak::Reg64& reg, const void* address);
+
   // Moves a 64bit immediate into memory.
   bool ConstantFitsIn32Reg(uint64_t v);
   void MovMem64(const Xbyak::RegExp& addr, uint64_t v);
@@ -232,6 +270,9 @@ class X64Emitter : public Xbyak::CodeGenerator {
   Xbyak::Address StashConstantXmm(int index, float v);
   Xbyak::Address StashConstantXmm(int index, double v);
   Xbyak::Address StashConstantXmm(int index, const vec128_t& v);
+  // Address of the constant in the pool for StashConstantXmm to return instead
+  // of a stash slot, or 0 if it must be stashed.
+  uint32_t GetPooledStashAddress(const vec128_t& v);
 
   bool IsFeatureEnabled(uint32_t feature_flag) const {
     return (feature_flags_ & feature_flag) == feature_flag;
@@ -263,10 +304,20 @@ class X64Emitter : public Xbyak::CodeGenerator {
   FunctionDebugInfo* debug_info_ = nullptr;
   uint32_t debug_info_flags_ = 0;
   FunctionTraceData* trace_data_ = nullptr;
+  // Baseline tier function being emitted, counting its calls until tier-up.
+  GuestFunction* tier_up_function_ = nullptr;
+  // Function being emitted with execution counting for the function profiler.
+  GuestFunction* profile_function_ = nullptr;
+  // Guest address of the last source offset marked.
+  uint32_t current_guest_address_ = 0;
   Arena source_map_arena_;
 
   size_t stack_size_ = 0;
 
+  std::vector<X64Relocation> relocations_;
+  bool persistable_ = true;
+  std::vector<X64CallSite> call_sites_;
+
   static const uint32_t gpr_reg_map_[GPR_COUNT];
   static const uint32_t xmm_reg_map_[XMM_COUNT];
 };
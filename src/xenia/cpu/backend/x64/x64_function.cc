@@ -28,6 +28,7 @@ X64Function::~X64Function() {
 void X64Function::Setup(uint8_t* machine_code, size_t machine_code_length) {
   machine_code_ = machine_code;
   machine_code_length_ = machine_code_length;
+  IndexSourceMap();
 }
 
 bool X64Function::CallImpl(ThreadState* thread_state, uint32_t return_address) {
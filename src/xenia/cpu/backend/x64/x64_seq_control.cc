@@ -13,6 +13,7 @@
 #include <cstring>
 
 #include "xenia/cpu/backend/x64/x64_op.h"
+#include "xenia/cpu/backend/x64/x64_tracers.h"
 
 namespace xe {
 namespace cpu {
@@ -444,12 +445,150 @@ struct BRANCH : Sequence<BRANCH, I<OPCODE_BRANCH, VoidOp, LabelOp>> {
 };
 EMITTER_OPCODE_TABLE(OPCODE_BRANCH, BRANCH);
 
+// ============================================================================
+// OPCODE_BRANCH_TRUE / OPCODE_BRANCH_FALSE fused with integer compares
+// ============================================================================
+// Guest compares and record forms store each condition register bit
+// separately, and branches test one of them, so a compare is usually
+// followed by a few more compares of the same operands (for the other bits)
+// and stores, which leave the flags of the compare as they are. Then the
+// branch can jump on them directly instead of testing the stored bit.
+static bool IsIntegerCompare(const Instr* instr) {
+  switch (instr->opcode->num) {
+    case OPCODE_COMPARE_EQ:
+    case OPCODE_COMPARE_NE:
+    case OPCODE_COMPARE_SLT:
+    case OPCODE_COMPARE_SLE:
+    case OPCODE_COMPARE_SGT:
+    case OPCODE_COMPARE_SGE:
+    case OPCODE_COMPARE_ULT:
+    case OPCODE_COMPARE_ULE:
+    case OPCODE_COMPARE_UGT:
+    case OPCODE_COMPARE_UGE:
+      return instr->src1.value->type <= INT64_TYPE;
+    default:
+      return false;
+  }
+}
+
+static bool HaveSameOperands(const Instr* a, const Instr* b) {
+  return a->src1.value == b->src1.value && a->src2.value == b->src2.value;
+}
+
+static bool PreservesFlags(X64Emitter& e, const Instr* instr) {
+  switch (instr->opcode->num) {
+    case OPCODE_COMMENT:
+    case OPCODE_NOP:
+    case OPCODE_CONTEXT_BARRIER:
+    case OPCODE_ASSIGN:
+    case OPCODE_LOAD_LOCAL:
+    case OPCODE_STORE_LOCAL:
+      return true;
+    case OPCODE_SOURCE_OFFSET:
+      return !(e.debug_info_flags() &
+               DebugInfoFlags::kDebugInfoTraceFunctionCoverage);
+    case OPCODE_LOAD_CONTEXT:
+    case OPCODE_STORE_CONTEXT:
+      return !IsTracingData();
+    default:
+      return false;
+  }
+}
+
+static bool EmitCompareBranch(X64Emitter& e, const Instr* branch,
+                              bool branch_if_true) {
+  const Value* cond = branch->src1.value;
+  const Instr* compare = cond->def;
+  if (cond->IsConstant() || !compare || compare->block != branch->block ||
+      !IsIntegerCompare(compare)) {
+    return false;
+  }
+  const Instr* prev = branch->prev;
+  while (prev != compare) {
+    if (!prev) {
+      return false;
+    }
+    if (!PreservesFlags(e, prev) &&
+        !(IsIntegerCompare(prev) && HaveSameOperands(prev, compare))) {
+      return false;
+    }
+    prev = prev->prev;
+  }
+  // The compare sequences swap the operands if the first is a constant.
+  Opcode opcode = compare->opcode->num;
+  if (compare->src1.value->IsConstant()) {
+    switch (opcode) {
+      case OPCODE_COMPARE_SLT:
+        opcode = OPCODE_COMPARE_SGT;
+        break;
+      case OPCODE_COMPARE_SLE:
+        opcode = OPCODE_COMPARE_SGE;
+        break;
+      case OPCODE_COMPARE_SGT:
+        opcode = OPCODE_COMPARE_SLT;
+        break;
+      case OPCODE_COMPARE_SGE:
+        opcode = OPCODE_COMPARE_SLE;
+        break;
+      case OPCODE_COMPARE_ULT:
+        opcode = OPCODE_COMPARE_UGT;
+        break;
+      case OPCODE_COMPARE_ULE:
+        opcode = OPCODE_COMPARE_UGE;
+        break;
+      case OPCODE_COMPARE_UGT:
+        opcode = OPCODE_COMPARE_ULT;
+        break;
+      case OPCODE_COMPARE_UGE:
+        opcode = OPCODE_COMPARE_ULE;
+        break;
+    }
+  }
+  const char* label = branch->src2.label->name;
+  switch (opcode) {
+    case OPCODE_COMPARE_EQ:
+      branch_if_true ? e.je(label, e.T_NEAR) : e.jne(label, e.T_NEAR);
+      break;
+    case OPCODE_COMPARE_NE:
+      branch_if_true ? e.jne(label, e.T_NEAR) : e.je(label, e.T_NEAR);
+      break;
+    case OPCODE_COMPARE_SLT:
+      branch_if_true ? e.jl(label, e.T_NEAR) : e.jge(label, e.T_NEAR);
+      break;
+    case OPCODE_COMPARE_SLE:
+      branch_if_true ? e.jle(label, e.T_NEAR) : e.jg(label, e.T_NEAR);
+      break;
+    case OPCODE_COMPARE_SGT:
+      branch_if_true ? e.jg(label, e.T_NEAR) : e.jle(label, e.T_NEAR);
+      break;
+    case OPCODE_COMPARE_SGE:
+      branch_if_true ? e.jge(label, e.T_NEAR) : e.jl(label, e.T_NEAR);
+      break;
+    case OPCODE_COMPARE_ULT:
+      branch_if_true ? e.jb(label, e.T_NEAR) : e.jae(label, e.T_NEAR);
+      break;
+    case OPCODE_COMPARE_ULE:
+      branch_if_true ? e.jbe(label, e.T_NEAR) : e.ja(label, e.T_NEAR);
+      break;
+    case OPCODE_COMPARE_UGT:
+      branch_if_true ? e.ja(label, e.T_NEAR) : e.jbe(label, e.T_NEAR);
+      break;
+    case OPCODE_COMPARE_UGE:
+      branch_if_true ? e.jae(label, e.T_NEAR) : e.jb(label, e.T_NEAR);
+      break;
+  }
+  return true;
+}
+
 // ============================================================================
 // OPCODE_BRANCH_TRUE
 // ============================================================================
 struct BRANCH_TRUE_I8
     : Sequence<BRANCH_TRUE_I8, I<OPCODE_BRANCH_TRUE, VoidOp, I8Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    if (EmitCompareBranch(e, i.instr, true)) {
+      return;
+    }
     e.test(i.src1, i.src1);
     e.jnz(i.src2.value->name, e.T_NEAR);
   }
@@ -499,6 +638,9 @@ EMITTER_OPCODE_TABLE(OPCODE_BRANCH_TRUE, BRANCH_TRUE_I8, BRANCH_TRUE_I16,
 struct BRANCH_FALSE_I8
     : Sequence<BRANCH_FALSE_I8, I<OPCODE_BRANCH_FALSE, VoidOp, I8Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    if (EmitCompareBranch(e, i.instr, false)) {
+      return;
+    }
     e.test(i.src1, i.src1);
     e.jz(i.src2.value->name, e.T_NEAR);
   }
@@ -15,6 +15,10 @@
 #include "xenia/base/memory.h"
 #include "xenia/cpu/backend/x64/x64_op.h"
 #include "xenia/cpu/backend/x64/x64_tracers.h"
+#include "xenia/cpu/mmio_handler.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/memory.h"
 
 namespace xe {
 namespace cpu {
@@ -103,6 +107,133 @@ RegExp ComputeMemoryAddress(X64Emitter& e, const T& guest) {
   }
 }
 
+// Memory accesses of guest instructions known to access MMIO ranges call the
+// range handlers through these rather than relying on access violations.
+// Values are in guest memory byte order.
+uint64_t LoadI32CheckingMmio(void* raw_context, uint64_t host_address) {
+  auto host_ptr = reinterpret_cast<const void*>(host_address);
+  auto mmio_handler = MMIOHandler::global_handler();
+  uint32_t value;
+  if (mmio_handler && mmio_handler->CheckLoadHost(host_ptr, &value)) {
+    return value;
+  }
+  return *reinterpret_cast<const uint32_t*>(host_ptr);
+}
+uint64_t StoreI32CheckingMmio(void* raw_context, uint64_t host_address,
+                              uint64_t value) {
+  auto host_ptr = reinterpret_cast<void*>(host_address);
+  auto mmio_handler = MMIOHandler::global_handler();
+  if (!mmio_handler ||
+      !mmio_handler->CheckStoreHost(host_ptr, uint32_t(value))) {
+    *reinterpret_cast<uint32_t*>(host_ptr) = uint32_t(value);
+  }
+  return 0;
+}
+
+template <typename T>
+void EmitLoadI32CheckingMmio(X64Emitter& e, const RegExp& addr, const T& dest,
+                             bool byte_swap) {
+  e.MarkNotPersistable();
+  e.lea(e.GetNativeParam(0), e.ptr[addr]);
+  e.CallNativeSafe(reinterpret_cast<void*>(LoadI32CheckingMmio));
+  if (byte_swap) {
+    e.bswap(e.eax);
+  }
+  e.mov(dest, e.eax);
+}
+
+template <typename T>
+void EmitStoreI32CheckingMmio(X64Emitter& e, const RegExp& addr,
+                              const T& value, bool byte_swap) {
+  e.MarkNotPersistable();
+  if (value.is_constant) {
+    uint32_t constant = static_cast<uint32_t>(value.constant());
+    e.mov(e.GetNativeParam(1).cvt32(),
+          byte_swap ? xe::byte_swap(constant) : constant);
+  } else {
+    e.mov(e.GetNativeParam(1).cvt32(), value);
+    if (byte_swap) {
+      e.bswap(e.GetNativeParam(1).cvt32());
+    }
+  }
+  e.lea(e.GetNativeParam(0), e.ptr[addr]);
+  e.CallNativeSafe(reinterpret_cast<void*>(StoreI32CheckingMmio));
+}
+
+// Stores of guest instructions known to write to watched physical memory test
+// the write watch flags of the page inline, and only call into the memory
+// system if it's still watched, rather than taking an access violation.
+uint64_t TriggerPhysicalWriteWatches(void* raw_context, uint64_t host_address,
+                                     uint64_t length) {
+  auto memory = reinterpret_cast<ppc::PPCContext*>(raw_context)
+                    ->processor->memory();
+  memory->TriggerPhysicalMemoryWriteCallbacks(
+      reinterpret_cast<void*>(host_address), uint32_t(length));
+  return 0;
+}
+
+// Returns the address to store to, which is in a register preserved by the
+// call if the check had to be emitted.
+RegExp CheckPhysicalWriteWatch(X64Emitter& e, const RegExp& addr,
+                               uint32_t size) {
+  if (!e.IsKnownWatchedStore()) {
+    return addr;
+  }
+  e.MarkNotPersistable();
+  Xbyak::Label skip;
+  e.lea(e.GetNativeParam(0), e.ptr[addr]);
+  e.mov(e.rcx, e.GetNativeParam(0));
+  e.sub(e.rcx, e.GetMembaseReg());
+  e.shr(e.rcx, xe::tzcnt(uint32_t(xe::memory::page_size())));
+  e.mov(e.rax, reinterpret_cast<uint64_t>(
+                   e.processor()->memory()->system_page_flags()));
+  e.bt(e.qword[e.rax], e.rcx);
+  e.jnc(skip);
+  e.mov(e.GetNativeParam(1).cvt32(), size);
+  e.CallNativeSafe(reinterpret_cast<void*>(TriggerPhysicalWriteWatches));
+  e.L(skip);
+  return e.GetNativeParam(0);
+}
+
+// Byte-swapped stores, with movbe if available. rcx is free after computing
+// the address.
+void EmitStoreByteSwapped(X64Emitter& e, const RegExp& addr,
+                          const I16Op& src) {
+  if (src.is_constant) {
+    e.mov(e.word[addr], xe::byte_swap(uint16_t(src.constant())));
+  } else if (e.IsFeatureEnabled(kX64EmitMovbe)) {
+    e.movbe(e.word[addr], src);
+  } else {
+    e.mov(e.cx, src);
+    e.ror(e.cx, 8);
+    e.mov(e.word[addr], e.cx);
+  }
+}
+void EmitStoreByteSwapped(X64Emitter& e, const RegExp& addr,
+                          const I32Op& src) {
+  if (src.is_constant) {
+    e.mov(e.dword[addr], xe::byte_swap(uint32_t(src.constant())));
+  } else if (e.IsFeatureEnabled(kX64EmitMovbe)) {
+    e.movbe(e.dword[addr], src);
+  } else {
+    e.mov(e.ecx, src);
+    e.bswap(e.ecx);
+    e.mov(e.dword[addr], e.ecx);
+  }
+}
+void EmitStoreByteSwapped(X64Emitter& e, const RegExp& addr,
+                          const I64Op& src) {
+  if (src.is_constant) {
+    e.MovMem64(addr, xe::byte_swap(uint64_t(src.constant())));
+  } else if (e.IsFeatureEnabled(kX64EmitMovbe)) {
+    e.movbe(e.qword[addr], src);
+  } else {
+    e.mov(e.rcx, src);
+    e.bswap(e.rcx);
+    e.mov(e.qword[addr], e.rcx);
+  }
+}
+
 // ============================================================================
 // OPCODE_ATOMIC_EXCHANGE
 // ============================================================================
@@ -556,6 +687,7 @@ struct LOAD_MMIO_I32
     // uint64_t (context, addr)
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
     auto read_address = uint32_t(i.src2.value);
+    e.MarkNotPersistable();
     e.mov(e.GetNativeParam(0), uint64_t(mmio_range->callback_context));
     e.mov(e.GetNativeParam(1).cvt32(), read_address);
     e.CallNativeSafe(reinterpret_cast<void*>(mmio_range->read));
@@ -581,6 +713,7 @@ struct STORE_MMIO_I32
     // void (context, addr, value)
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
     auto write_address = uint32_t(i.src2.value);
+    e.MarkNotPersistable();
     e.mov(e.GetNativeParam(0), uint64_t(mmio_range->callback_context));
     e.mov(e.GetNativeParam(1).cvt32(), write_address);
     if (i.src3.is_constant) {
@@ -635,6 +768,12 @@ struct LOAD_OFFSET_I32
     : Sequence<LOAD_OFFSET_I32, I<OPCODE_LOAD_OFFSET, I32Op, I64Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddressOffset(e, i.src1, i.src2);
+    if (e.IsKnownMmioAccess()) {
+      EmitLoadI32CheckingMmio(
+          e, addr, i.dest,
+          (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) != 0);
+      return;
+    }
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       if (e.IsFeatureEnabled(kX64EmitMovbe)) {
         e.movbe(i.dest, e.dword[addr]);
@@ -675,6 +814,7 @@ struct STORE_OFFSET_I8
                I<OPCODE_STORE_OFFSET, VoidOp, I64Op, I64Op, I8Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddressOffset(e, i.src1, i.src2);
+    addr = CheckPhysicalWriteWatch(e, addr, 1);
     if (i.src3.is_constant) {
       e.mov(e.byte[addr], i.src3.constant());
     } else {
@@ -688,13 +828,9 @@ struct STORE_OFFSET_I16
                I<OPCODE_STORE_OFFSET, VoidOp, I64Op, I64Op, I16Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddressOffset(e, i.src1, i.src2);
+    addr = CheckPhysicalWriteWatch(e, addr, 2);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
-      assert_false(i.src3.is_constant);
-      if (e.IsFeatureEnabled(kX64EmitMovbe)) {
-        e.movbe(e.word[addr], i.src3);
-      } else {
-        assert_always("not implemented");
-      }
+      EmitStoreByteSwapped(e, addr, i.src3);
     } else {
       if (i.src3.is_constant) {
         e.mov(e.word[addr], i.src3.constant());
@@ -710,13 +846,15 @@ struct STORE_OFFSET_I32
                I<OPCODE_STORE_OFFSET, VoidOp, I64Op, I64Op, I32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddressOffset(e, i.src1, i.src2);
+    if (e.IsKnownMmioAccess()) {
+      EmitStoreI32CheckingMmio(
+          e, addr, i.src3,
+          (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) != 0);
+      return;
+    }
+    addr = CheckPhysicalWriteWatch(e, addr, 4);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
-      assert_false(i.src3.is_constant);
-      if (e.IsFeatureEnabled(kX64EmitMovbe)) {
-        e.movbe(e.dword[addr], i.src3);
-      } else {
-        assert_always("not implemented");
-      }
+      EmitStoreByteSwapped(e, addr, i.src3);
     } else {
       if (i.src3.is_constant) {
         e.mov(e.dword[addr], i.src3.constant());
@@ -732,13 +870,9 @@ struct STORE_OFFSET_I64
                I<OPCODE_STORE_OFFSET, VoidOp, I64Op, I64Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddressOffset(e, i.src1, i.src2);
+    addr = CheckPhysicalWriteWatch(e, addr, 8);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
-      assert_false(i.src3.is_constant);
-      if (e.IsFeatureEnabled(kX64EmitMovbe)) {
-        e.movbe(e.qword[addr], i.src3);
-      } else {
-        assert_always("not implemented");
-      }
+      EmitStoreByteSwapped(e, addr, i.src3);
     } else {
       if (i.src3.is_constant) {
         e.MovMem64(addr, i.src3.constant());
@@ -788,6 +922,12 @@ struct LOAD_I16 : Sequence<LOAD_I16, I<OPCODE_LOAD, I16Op, I64Op>> {
 struct LOAD_I32 : Sequence<LOAD_I32, I<OPCODE_LOAD, I32Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    if (e.IsKnownMmioAccess()) {
+      EmitLoadI32CheckingMmio(
+          e, addr, i.dest,
+          (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) != 0);
+      return;
+    }
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       if (e.IsFeatureEnabled(kX64EmitMovbe)) {
         e.movbe(i.dest, e.dword[addr]);
@@ -879,6 +1019,7 @@ EMITTER_OPCODE_TABLE(OPCODE_LOAD, LOAD_I8, LOAD_I16, LOAD_I32, LOAD_I64,
 struct STORE_I8 : Sequence<STORE_I8, I<OPCODE_STORE, VoidOp, I64Op, I8Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    addr = CheckPhysicalWriteWatch(e, addr, 1);
     if (i.src2.is_constant) {
       e.mov(e.byte[addr], i.src2.constant());
     } else {
@@ -895,13 +1036,9 @@ struct STORE_I8 : Sequence<STORE_I8, I<OPCODE_STORE, VoidOp, I64Op, I8Op>> {
 struct STORE_I16 : Sequence<STORE_I16, I<OPCODE_STORE, VoidOp, I64Op, I16Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    addr = CheckPhysicalWriteWatch(e, addr, 2);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
-      assert_false(i.src2.is_constant);
-      if (e.IsFeatureEnabled(kX64EmitMovbe)) {
-        e.movbe(e.word[addr], i.src2);
-      } else {
-        assert_always("not implemented");
-      }
+      EmitStoreByteSwapped(e, addr, i.src2);
     } else {
       if (i.src2.is_constant) {
         e.mov(e.word[addr], i.src2.constant());
@@ -920,13 +1057,15 @@ struct STORE_I16 : Sequence<STORE_I16, I<OPCODE_STORE, VoidOp, I64Op, I16Op>> {
 struct STORE_I32 : Sequence<STORE_I32, I<OPCODE_STORE, VoidOp, I64Op, I32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    if (e.IsKnownMmioAccess()) {
+      EmitStoreI32CheckingMmio(
+          e, addr, i.src2,
+          (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) != 0);
+      return;
+    }
+    addr = CheckPhysicalWriteWatch(e, addr, 4);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
-      assert_false(i.src2.is_constant);
-      if (e.IsFeatureEnabled(kX64EmitMovbe)) {
-        e.movbe(e.dword[addr], i.src2);
-      } else {
-        assert_always("not implemented");
-      }
+      EmitStoreByteSwapped(e, addr, i.src2);
     } else {
       if (i.src2.is_constant) {
         e.mov(e.dword[addr], i.src2.constant());
@@ -945,13 +1084,9 @@ struct STORE_I32 : Sequence<STORE_I32, I<OPCODE_STORE, VoidOp, I64Op, I32Op>> {
 struct STORE_I64 : Sequence<STORE_I64, I<OPCODE_STORE, VoidOp, I64Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    addr = CheckPhysicalWriteWatch(e, addr, 8);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
-      assert_false(i.src2.is_constant);
-      if (e.IsFeatureEnabled(kX64EmitMovbe)) {
-        e.movbe(e.qword[addr], i.src2);
-      } else {
-        assert_always("not implemented");
-      }
+      EmitStoreByteSwapped(e, addr, i.src2);
     } else {
       if (i.src2.is_constant) {
         e.MovMem64(addr, i.src2.constant());
@@ -970,6 +1105,7 @@ struct STORE_I64 : Sequence<STORE_I64, I<OPCODE_STORE, VoidOp, I64Op, I64Op>> {
 struct STORE_F32 : Sequence<STORE_F32, I<OPCODE_STORE, VoidOp, I64Op, F32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    addr = CheckPhysicalWriteWatch(e, addr, 4);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       assert_false(i.src2.is_constant);
       assert_always("not yet implemented");
@@ -991,6 +1127,7 @@ struct STORE_F32 : Sequence<STORE_F32, I<OPCODE_STORE, VoidOp, I64Op, F32Op>> {
 struct STORE_F64 : Sequence<STORE_F64, I<OPCODE_STORE, VoidOp, I64Op, F64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    addr = CheckPhysicalWriteWatch(e, addr, 8);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       assert_false(i.src2.is_constant);
       assert_always("not yet implemented");
@@ -1013,6 +1150,7 @@ struct STORE_V128
     : Sequence<STORE_V128, I<OPCODE_STORE, VoidOp, I64Op, V128Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    addr = CheckPhysicalWriteWatch(e, addr, 16);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       assert_false(i.src2.is_constant);
       e.vpshufb(e.xmm0, i.src2, e.GetXmmConstPtr(XMMByteSwapMask));
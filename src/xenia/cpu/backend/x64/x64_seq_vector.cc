@@ -1659,7 +1659,7 @@ struct EXTRACT_I32
       e.mov(e.al, i.src2);
       e.and_(e.al, 0x03);
       e.shl(e.al, 4);
-      e.mov(e.rdx, reinterpret_cast<uint64_t>(extract_table_32));
+      e.MovHostImageAddress(e.rdx, extract_table_32);
       e.vmovaps(e.xmm0, e.ptr[e.rdx + e.rax]);
       e.vpshufb(e.xmm0, src1, e.xmm0);
       e.vpextrd(i.dest, e.xmm0, 0);
@@ -1816,9 +1816,47 @@ struct PERMUTE_I32
       }
     } else {
       // Permute by non-constant.
-      assert_always();
+      Xmm src2;
+      if (i.src2.is_constant) {
+        src2 = e.xmm1;
+        e.LoadConstantXmm(src2, i.src2.constant());
+      } else {
+        src2 = i.src2;
+      }
+      Xmm src3;
+      if (i.src3.is_constant) {
+        src3 = e.xmm2;
+        e.LoadConstantXmm(src3, i.src3.constant());
+      } else {
+        src3 = i.src3;
+      }
+      if (e.IsFeatureEnabled(kX64EmitAVX512Ortho)) {
+        // Each control byte selects a word in the src2:src3 table, with the
+        // 3rd bit picking src3, exactly like vpermi2d indices.
+        e.vmovd(e.xmm0, i.src1);
+        e.vpmovzxbd(e.xmm0, e.xmm0);
+        e.vpermi2d(e.xmm0, src2, src3);
+        e.vmovdqa(i.dest, e.xmm0);
+      } else {
+        e.lea(e.GetNativeParam(0), e.StashXmm(0, src2));
+        e.lea(e.GetNativeParam(1), e.StashXmm(1, src3));
+        e.mov(e.GetNativeParam(2).cvt32(), i.src1);
+        e.CallNativeSafe(reinterpret_cast<void*>(EmulatePermuteByInt32));
+        e.vmovaps(i.dest, e.xmm0);
+      }
     }
   }
+  static __m128i EmulatePermuteByInt32(void*, __m128i src2, __m128i src3,
+                                       uint32_t control) {
+    alignas(16) uint32_t a[8];
+    alignas(16) uint32_t b[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(a), src2);
+    _mm_store_si128(reinterpret_cast<__m128i*>(a + 4), src3);
+    for (int i = 0; i < 4; ++i) {
+      b[i] = a[(control >> (i * 8)) & 0x7];
+    }
+    return _mm_load_si128(reinterpret_cast<__m128i*>(b));
+  }
 };
 struct PERMUTE_V128
     : Sequence<PERMUTE_V128,
@@ -2318,7 +2356,29 @@ struct PACK : Sequence<PACK, I<OPCODE_PACK, V128Op, V128Op, V128Op>> {
     // TODO(benvanik): handle src2 (or src1) being constant zero
     if (IsPackInUnsigned(flags)) {
       if (IsPackOutUnsigned(flags)) {
-        if (IsPackOutSaturate(flags)) {
+        if (e.IsFeatureEnabled(kX64EmitAVX512Ortho | kX64EmitAVX512BW)) {
+          // Narrow each source into its own half (truncating or saturating),
+          // then merge the halves.
+          Xmm src1 = i.src1.is_constant ? e.xmm1 : i.src1;
+          if (i.src1.is_constant) {
+            e.LoadConstantXmm(src1, i.src1.constant());
+          }
+          Xmm src2 = i.src2.is_constant ? e.xmm0 : i.src2;
+          if (i.src2.is_constant) {
+            e.LoadConstantXmm(src2, i.src2.constant());
+          }
+          if (IsPackOutSaturate(flags)) {
+            // unsigned -> unsigned + saturate
+            e.vpmovuswb(e.xmm1, src1);
+            e.vpmovuswb(e.xmm0, src2);
+          } else {
+            // unsigned -> unsigned
+            e.vpmovwb(e.xmm1, src1);
+            e.vpmovwb(e.xmm0, src2);
+          }
+          e.vpunpcklqdq(i.dest, e.xmm1, e.xmm0);
+          e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMByteOrderMask));
+        } else if (IsPackOutSaturate(flags)) {
           // unsigned -> unsigned + saturate
           if (i.src2.is_constant) {
             e.lea(e.GetNativeParam(1),
@@ -2383,7 +2443,23 @@ struct PACK : Sequence<PACK, I<OPCODE_PACK, V128Op, V128Op, V128Op>> {
     // TODO(benvanik): handle src2 (or src1) being constant zero
     if (IsPackInUnsigned(flags)) {
       if (IsPackOutUnsigned(flags)) {
-        if (IsPackOutSaturate(flags)) {
+        if (IsPackOutSaturate(flags) &&
+            e.IsFeatureEnabled(kX64EmitAVX512Ortho)) {
+          // unsigned -> unsigned + saturate
+          Xmm src1 = i.src1.is_constant ? e.xmm1 : i.src1;
+          if (i.src1.is_constant) {
+            e.LoadConstantXmm(src1, i.src1.constant());
+          }
+          Xmm src2 = i.src2.is_constant ? e.xmm0 : i.src2;
+          if (i.src2.is_constant) {
+            e.LoadConstantXmm(src2, i.src2.constant());
+          }
+          e.vpmovusdw(e.xmm1, src1);
+          e.vpmovusdw(e.xmm0, src2);
+          e.vpunpcklqdq(i.dest, e.xmm1, e.xmm0);
+          e.vpshuflw(i.dest, i.dest, 0b10110001);
+          e.vpshufhw(i.dest, i.dest, 0b10110001);
+        } else if (IsPackOutSaturate(flags)) {
           // unsigned -> unsigned + saturate
           // Construct a saturation max value
           e.mov(e.eax, 0xFFFFu);
@@ -25,10 +25,12 @@
 #include "xenia/cpu/backend/x64/x64_sequences.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <unordered_map>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/string.h"
 #include "xenia/base/threading.h"
@@ -39,6 +41,13 @@
 #include "xenia/cpu/hir/hir_builder.h"
 #include "xenia/cpu/processor.h"
 
+DEFINE_bool(x64_relaxed_dot_product_overflow, false,
+            "Let vector dot products that overflow return infinity like the "
+            "host does instead of NaN like the console, which avoids MXCSR "
+            "accesses around them. Meant to be enabled in the configs of "
+            "titles known not to depend on it.",
+            "x64");
+
 namespace xe {
 namespace cpu {
 namespace backend {
@@ -65,6 +74,7 @@ struct COMMENT : Sequence<COMMENT, I<OPCODE_COMMENT, VoidOp, OffsetOp>> {
       // TODO(benvanik): pass through.
       // TODO(benvanik): don't just leak this memory.
       auto str_copy = xe_strdup(str);
+      e.MarkNotPersistable();
       e.mov(e.rdx, reinterpret_cast<uint64_t>(str_copy));
       e.CallNative(reinterpret_cast<void*>(TraceString));
     }
@@ -441,13 +451,15 @@ EMITTER_OPCODE_TABLE(OPCODE_ROUND, ROUND_F32, ROUND_F64, ROUND_V128);
 // ============================================================================
 struct LOAD_CLOCK : Sequence<LOAD_CLOCK, I<OPCODE_LOAD_CLOCK, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    // When scaling is disabled and the raw clock source is selected, the code
-    // in the Clock class is actually just forwarding tick counts after one
-    // simple multiply and division. In that case we rather bake the scaling in
-    // here to cut extra function calls with CPU cache misses and stack frame
-    // overhead.
-    if (cvars::clock_no_scaling && cvars::clock_source_raw) {
-      auto ratio = Clock::guest_tick_ratio();
+    // Titles busy-wait on mftb, so when the raw clock source is selected, the
+    // conversion done in the Clock class is inlined here, without function
+    // calls and division. The conversion is loaded through the pointer
+    // published by the Clock class, so time scalar changes don't require
+    // retranslation.
+    if (cvars::clock_source_raw) {
+      using Conversion = Clock::GuestTickConversion;
+      e.mov(e.rcx, uint64_t(&Clock::guest_tick_conversion()));
+      e.mov(e.rcx, e.qword[e.rcx]);
       // The 360 CPU is an in-order CPU, AMD64 usually isn't. Without
       // mfence/lfence magic the rdtsc instruction can be executed sooner or
       // later in the cache window. Since it's resolution however is much higher
@@ -458,14 +470,21 @@ struct LOAD_CLOCK : Sequence<LOAD_CLOCK, I<OPCODE_LOAD_CLOCK, I64Op>> {
       // Make it a 64 bit number in rax.
       e.shl(e.rdx, 32);
       e.or_(e.rax, e.rdx);
-      // Apply tick frequency scaling.
-      e.mov(e.rcx, ratio.first);
-      e.mul(e.rcx);
-      // We actually now have a 128 bit number in rdx:rax.
-      e.mov(e.rcx, ratio.second);
-      e.div(e.rcx);
-      e.mov(i.dest, e.rax);
+      // Make it relative to the base, clamping to 0 if behind it (mov rather
+      // than xor to keep the flags).
+      e.sub(e.rax, e.qword[e.rcx + offsetof(Conversion, host_base)]);
+      e.mov(e.edx, 0);
+      e.cmovb(e.rax, e.rdx);
+      // Apply the fixed-point tick frequency scaling to a 128 bit number in
+      // rdx:rax.
+      e.mul(e.qword[e.rcx + offsetof(Conversion, multiplier)]);
+      e.mov(i.dest, e.qword[e.rcx + offsetof(Conversion, guest_base)]);
+      e.mov(e.ecx, e.dword[e.rcx + offsetof(Conversion, shift)]);
+      e.shrd(e.rax, e.rdx, e.cl);
+      e.add(i.dest, e.rax);
     } else {
+      // The platform clock source (QueryPerformanceCounter, or clock_gettime
+      // in the vDSO) can't be inlined, but the conversion doesn't lock.
       e.CallNative(LoadClock);
       e.mov(i.dest, e.rax);
     }
@@ -673,8 +692,26 @@ struct SELECT_I64
 struct SELECT_F32
     : Sequence<SELECT_F32, I<OPCODE_SELECT, F32Op, I8Op, F32Op, F32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): find a shorter sequence.
     // dest = src1 != 0 ? src2 : src3
+    if (e.IsFeatureEnabled(kX64EmitAVX512Ortho)) {
+      Xmm src2 = i.src2.is_constant ? e.xmm1 : i.src2;
+      if (i.src2.is_constant) {
+        e.LoadConstantXmm(src2, i.src2.constant());
+      }
+      Xmm src3 = i.src3.is_constant ? e.xmm2 : i.src3;
+      if (i.src3.is_constant) {
+        e.LoadConstantXmm(src3, i.src3.constant());
+      }
+      // All mask bits set if src1 != 0.
+      e.movzx(e.eax, i.src1);
+      e.neg(e.eax);
+      e.sbb(e.eax, e.eax);
+      e.kmovw(e.k1, e.eax);
+      e.vpblendmd(e.xmm0 | e.k1, src3, src2);
+      e.vmovdqa(i.dest, e.xmm0);
+      return;
+    }
+    // TODO(benvanik): find a shorter sequence.
     e.movzx(e.eax, i.src1);
     e.vmovd(e.xmm1, e.eax);
     e.vxorps(e.xmm0, e.xmm0);
@@ -740,8 +777,26 @@ struct SELECT_F64
 struct SELECT_V128_I8
     : Sequence<SELECT_V128_I8, I<OPCODE_SELECT, V128Op, I8Op, V128Op, V128Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): find a shorter sequence.
     // dest = src1 != 0 ? src2 : src3
+    if (e.IsFeatureEnabled(kX64EmitAVX512Ortho)) {
+      Xmm src2 = i.src2.is_constant ? e.xmm1 : i.src2;
+      if (i.src2.is_constant) {
+        e.LoadConstantXmm(src2, i.src2.constant());
+      }
+      Xmm src3 = i.src3.is_constant ? e.xmm2 : i.src3;
+      if (i.src3.is_constant) {
+        e.LoadConstantXmm(src3, i.src3.constant());
+      }
+      // All mask bits set if src1 != 0.
+      e.movzx(e.eax, i.src1);
+      e.neg(e.eax);
+      e.sbb(e.eax, e.eax);
+      e.kmovw(e.k1, e.eax);
+      e.vpblendmd(e.xmm0 | e.k1, src3, src2);
+      e.vmovdqa(i.dest, e.xmm0);
+      return;
+    }
+    // TODO(benvanik): find a shorter sequence.
     e.movzx(e.eax, i.src1);
     e.vmovd(e.xmm1, e.eax);
     e.vpbroadcastd(e.xmm1, e.xmm1);
@@ -2573,7 +2628,84 @@ struct LOG2_V128 : Sequence<LOG2_V128, I<OPCODE_LOG2, V128Op, V128Op>> {
 EMITTER_OPCODE_TABLE(OPCODE_LOG2, LOG2_F32, LOG2_F64, LOG2_V128);
 
 struct DOT_PRODUCT_V128 {
-  static void Emit(X64Emitter& e, Xmm dest, Xmm src1, Xmm src2, uint8_t imm) {
+  // Overflow is detected through the sticky MXCSR overflow flag, which needs
+  // to be clear before the dot product. Every dot product leaves it clear, so
+  // it doesn't need to be cleared again (which is the expensive ldmxcsr) if
+  // the previous dot product in the block is only followed by instructions
+  // that can't overflow.
+  static bool IsOverflowFlagClear(const Instr* instr) {
+    for (const Instr* prev = instr->prev; prev; prev = prev->prev) {
+      switch (prev->opcode->num) {
+        case OPCODE_DOT_PRODUCT_3:
+        case OPCODE_DOT_PRODUCT_4:
+          return true;
+        case OPCODE_COMMENT:
+        case OPCODE_NOP:
+        case OPCODE_SOURCE_OFFSET:
+        case OPCODE_ASSIGN:
+        case OPCODE_CAST:
+        case OPCODE_ZERO_EXTEND:
+        case OPCODE_SIGN_EXTEND:
+        case OPCODE_TRUNCATE:
+        case OPCODE_LOAD_VECTOR_SHL:
+        case OPCODE_LOAD_VECTOR_SHR:
+        case OPCODE_LOAD_LOCAL:
+        case OPCODE_STORE_LOCAL:
+        case OPCODE_LOAD_CONTEXT:
+        case OPCODE_STORE_CONTEXT:
+        case OPCODE_CONTEXT_BARRIER:
+        // May call MMIO and write watch handlers, but those don't do
+        // floating-point math.
+        case OPCODE_LOAD_OFFSET:
+        case OPCODE_STORE_OFFSET:
+        case OPCODE_LOAD:
+        case OPCODE_STORE:
+        case OPCODE_MAX:
+        case OPCODE_VECTOR_MAX:
+        case OPCODE_MIN:
+        case OPCODE_VECTOR_MIN:
+        case OPCODE_SELECT:
+        case OPCODE_VECTOR_COMPARE_EQ:
+        case OPCODE_VECTOR_COMPARE_SGT:
+        case OPCODE_VECTOR_COMPARE_SGE:
+        case OPCODE_AND:
+        case OPCODE_AND_NOT:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_NOT:
+        case OPCODE_NEG:
+        case OPCODE_ABS:
+        case OPCODE_SHL:
+        case OPCODE_SHR:
+        case OPCODE_SHA:
+        case OPCODE_BYTE_SWAP:
+        case OPCODE_INSERT:
+        case OPCODE_EXTRACT:
+        case OPCODE_SPLAT:
+        case OPCODE_PERMUTE:
+        case OPCODE_SWIZZLE:
+          continue;
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+          if (prev->dest->type <= INT64_TYPE) {
+            continue;
+          }
+          return false;
+        default:
+          return false;
+      }
+    }
+    return false;
+  }
+
+  static void Emit(X64Emitter& e, const Instr* instr, Xmm dest, Xmm src1,
+                   Xmm src2, uint8_t imm) {
+    if (cvars::x64_relaxed_dot_product_overflow) {
+      e.vdpps(dest, src1, src2, imm);
+      return;
+    }
+
     // TODO(benvanik): apparently this is very slow
     // - find alternative?
     Xbyak::Label end;
@@ -2584,13 +2716,13 @@ struct DOT_PRODUCT_V128 {
     // something?
     e.sub(e.rsp, 8);
 
-    // Grab MXCSR and mask off the overflow flag,
-    // because it's sticky.
-    e.vstmxcsr(e.dword[e.rsp]);
-    e.mov(e.eax, e.dword[e.rsp]);
-    e.and_(e.eax, uint32_t(~8));
-    e.mov(e.dword[e.rsp], e.eax);
-    e.vldmxcsr(e.dword[e.rsp]);
+    if (!IsOverflowFlagClear(instr)) {
+      // Grab MXCSR and mask off the overflow flag,
+      // because it's sticky.
+      e.vstmxcsr(e.dword[e.rsp]);
+      e.and_(e.dword[e.rsp], uint32_t(~8));
+      e.vldmxcsr(e.dword[e.rsp]);
+    }
 
     // Hey we can do the dot product now.
     e.vdpps(dest, src1, src2, imm);
@@ -2598,18 +2730,20 @@ struct DOT_PRODUCT_V128 {
     // Load MXCSR...
     e.vstmxcsr(e.dword[e.rsp]);
 
-    // ..free our temporary space and get MXCSR at
-    // the same time
-    e.pop(e.rax);
-
     // Did we overflow?
-    e.test(e.al, 8);
+    e.test(e.byte[e.rsp], 8);
     e.jz(end);
 
     // Infinity? HA! Give NAN.
     e.vmovdqa(dest, e.GetXmmConstPtr(XMMQNaN));
 
+    // Clear the flag for the following dot products.
+    e.and_(e.dword[e.rsp], uint32_t(~8));
+    e.vldmxcsr(e.dword[e.rsp]);
+
     e.L(end);
+    // Free our temporary space.
+    e.add(e.rsp, 8);
     e.outLocalLabel();
   }
 };
@@ -2623,8 +2757,8 @@ struct DOT_PRODUCT_3_V128
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     // https://msdn.microsoft.com/en-us/library/bb514054(v=vs.90).aspx
     EmitCommutativeBinaryXmmOp(
-        e, i, [](X64Emitter& e, Xmm dest, Xmm src1, Xmm src2) {
-          DOT_PRODUCT_V128::Emit(e, dest, src1, src2, 0b01110001);
+        e, i, [&i](X64Emitter& e, Xmm dest, Xmm src1, Xmm src2) {
+          DOT_PRODUCT_V128::Emit(e, i.instr, dest, src1, src2, 0b01110001);
         });
   }
 };
@@ -2639,8 +2773,8 @@ struct DOT_PRODUCT_4_V128
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     // https://msdn.microsoft.com/en-us/library/bb514054(v=vs.90).aspx
     EmitCommutativeBinaryXmmOp(
-        e, i, [](X64Emitter& e, Xmm dest, Xmm src1, Xmm src2) {
-          DOT_PRODUCT_V128::Emit(e, dest, src1, src2, 0b11110001);
+        e, i, [&i](X64Emitter& e, Xmm dest, Xmm src1, Xmm src2) {
+          DOT_PRODUCT_V128::Emit(e, i.instr, dest, src1, src2, 0b11110001);
         });
   }
 };
@@ -3321,7 +3455,7 @@ struct SET_ROUNDING_MODE_I32
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     e.mov(e.rcx, i.src1);
     e.and_(e.rcx, 0x7);
-    e.mov(e.rax, uintptr_t(mxcsr_table));
+    e.MovHostImageAddress(e.rax, mxcsr_table);
     e.vldmxcsr(e.ptr[e.rax + e.rcx * 4]);
   }
 };
@@ -14,6 +14,10 @@
 
 #include <unordered_map>
 
+#include "xenia/base/cvar.h"
+
+DECLARE_bool(x64_relaxed_dot_product_overflow);
+
 namespace xe {
 namespace cpu {
 namespace backend {
@@ -67,6 +67,16 @@ GuestFunction* Breakpoint::guest_function() const {
 }
 
 bool Breakpoint::ContainsHostAddress(uintptr_t search_address) const {
+  if (installed_) {
+    // The patched addresses are already known, no need to look up the
+    // functions.
+    for (const auto& patch : backend_data_) {
+      if (patch.first == search_address) {
+        return true;
+      }
+    }
+    return false;
+  }
   bool contains = false;
   ForEachHostAddress([&contains, search_address](uintptr_t host_address) {
     if (host_address == search_address) {
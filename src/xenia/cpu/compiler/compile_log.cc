@@ -0,0 +1,115 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/compile_log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "xenia/base/logging.h"
+#include "xenia/base/string_buffer.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+void CompileLog::Add(Record record) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++function_count_;
+  emit_us_ += record.emit_us;
+  assemble_us_ += record.assemble_us;
+  total_us_ += record.total_us;
+  for (const Compiler::PassStatistics& pass : record.passes) {
+    auto totals_it = std::find_if(
+        pass_totals_.begin(), pass_totals_.end(),
+        [&pass](const PassTotals& totals) {
+          return !std::strcmp(totals.name, pass.name);
+        });
+    if (totals_it == pass_totals_.end()) {
+      pass_totals_.push_back({pass.name, 0, 0, 0, 0});
+      totals_it = pass_totals_.end() - 1;
+    }
+    totals_it->time_us += pass.time_us;
+    totals_it->runs += pass.runs;
+    totals_it->max_us = std::max(totals_it->max_us, pass.time_us);
+    totals_it->instr_delta +=
+        int64_t(pass.instrs_after) - int64_t(pass.instrs_before);
+  }
+  if (records_.size() < kMaxRecords) {
+    records_.push_back(std::move(record));
+    return;
+  }
+  auto fastest_it = std::min_element(
+      records_.begin(), records_.end(), [](const Record& a, const Record& b) {
+        return a.total_us < b.total_us;
+      });
+  if (fastest_it->total_us < record.total_us) {
+    *fastest_it = std::move(record);
+  }
+}
+
+void CompileLog::LogSummary(size_t count) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!function_count_) {
+    return;
+  }
+  XELOGI(
+      "Translated {} functions in {:.3f} ms: building HIR {:.3f} ms, "
+      "assembling {:.3f} ms",
+      function_count_, total_us_ / 1000.0, emit_us_ / 1000.0,
+      assemble_us_ / 1000.0);
+  // Grouped passes include the time of the passes in them.
+  std::vector<PassTotals> pass_totals = pass_totals_;
+  std::sort(pass_totals.begin(), pass_totals.end(),
+            [](const PassTotals& a, const PassTotals& b) {
+              return a.time_us > b.time_us;
+            });
+  for (const PassTotals& totals : pass_totals) {
+    XELOGI("  {:<28} {:>10.3f} ms in {:>7} runs, at most {:>8.3f} ms, {:+} "
+           "instructions",
+           totals.name, totals.time_us / 1000.0, totals.runs,
+           totals.max_us / 1000.0, totals.instr_delta);
+  }
+
+  std::vector<const Record*> slowest;
+  slowest.reserve(records_.size());
+  for (const Record& record : records_) {
+    slowest.push_back(&record);
+  }
+  count = std::min(count, slowest.size());
+  std::partial_sort(slowest.begin(), slowest.begin() + count, slowest.end(),
+                    [](const Record* a, const Record* b) {
+                      return a->total_us > b->total_us;
+                    });
+  if (count) {
+    XELOGI("Slowest functions to translate:");
+  }
+  StringBuffer passes;
+  for (size_t i = 0; i < count; ++i) {
+    const Record& record = *slowest[i];
+    passes.Reset();
+    for (const Compiler::PassStatistics& pass : record.passes) {
+      passes.AppendFormat(" {} {:.3f} ({}->{})", pass.name,
+                          pass.time_us / 1000.0, pass.instrs_before,
+                          pass.instrs_after);
+    }
+    XELOGI(
+        "  {:>9.3f} ms {:08X} {}{}: {} guest instructions, {} bytes, HIR "
+        "{:.3f} ms, assembly {:.3f} ms, passes:{}",
+        record.total_us / 1000.0, record.guest_address, record.name,
+        record.baseline ? " (baseline)" : "", record.guest_instrs,
+        record.code_size, record.emit_us / 1000.0, record.assemble_us / 1000.0,
+        passes.to_string_view());
+  }
+}
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,76 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_COMPILE_LOG_H_
+#define XENIA_CPU_COMPILER_COMPILE_LOG_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "xenia/cpu/compiler/compiler.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+// Times of the translations of guest functions, with the breakdown by
+// compiler pass, to find what dominates the compilation stalls. Thread-safe,
+// as functions are translated by the guest threads and the translation
+// workers.
+class CompileLog {
+ public:
+  struct Record {
+    uint32_t guest_address;
+    std::string name;
+    bool baseline;
+    uint32_t guest_instrs;
+    // Building the HIR from the guest code.
+    uint64_t emit_us;
+    // Emitting the host code.
+    uint64_t assemble_us;
+    uint64_t total_us;
+    size_t code_size;
+    std::vector<Compiler::PassStatistics> passes;
+  };
+
+  // The slowest records are kept when there are more translations.
+  static constexpr size_t kMaxRecords = 1024;
+
+  void Add(Record record);
+
+  // Logs the totals by pass and the slowest functions to compile.
+  void LogSummary(size_t count) const;
+
+ private:
+  struct PassTotals {
+    const char* name;
+    uint64_t time_us;
+    uint64_t runs;
+    uint64_t max_us;
+    // Change of the HIR instruction count, summed over the functions.
+    int64_t instr_delta;
+  };
+
+  mutable std::mutex mutex_;
+  std::vector<Record> records_;
+  std::vector<PassTotals> pass_totals_;
+  uint64_t function_count_ = 0;
+  uint64_t emit_us_ = 0;
+  uint64_t assemble_us_ = 0;
+  uint64_t total_us_ = 0;
+};
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_COMPILE_LOG_H_
@@ -9,13 +9,66 @@
 
 #include "xenia/cpu/compiler/compiler.h"
 
+#include <cstring>
+
+#include "xenia/base/clock.h"
 #include "xenia/base/profiling.h"
 #include "xenia/cpu/compiler/compiler_pass.h"
+#include "xenia/cpu/cpu_flags.h"
 
 namespace xe {
 namespace cpu {
 namespace compiler {
 
+namespace {
+
+uint32_t CountInstrs(hir::HIRBuilder* builder) {
+  uint32_t count = 0;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    for (auto i = block->instr_head; i; i = i->next) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+}  // namespace
+
+Compiler::PassScope::PassScope(Compiler* compiler, const CompilerPass* pass,
+                               hir::HIRBuilder* builder)
+    :
+#if XE_OPTION_PROFILING
+      profile_scope_(pass->profile_token()),
+#endif  // XE_OPTION_PROFILING
+      compiler_(compiler),
+      pass_(pass),
+      builder_(builder) {
+  if (cvars::profile_compiler_passes) {
+    instrs_before_ = CountInstrs(builder);
+    start_ticks_ = Clock::QueryHostTickCount();
+  }
+}
+
+Compiler::PassScope::~PassScope() {
+  if (!start_ticks_) {
+    return;
+  }
+  uint64_t time_us = (Clock::QueryHostTickCount() - start_ticks_) * 1000000 /
+                     Clock::QueryHostTickFrequency();
+  uint32_t instrs_after = CountInstrs(builder_);
+  // Passes used multiple times in the pipeline are added together.
+  for (PassStatistics& statistics : compiler_->pass_statistics_) {
+    if (!std::strcmp(statistics.name, pass_->name())) {
+      statistics.time_us += time_us;
+      ++statistics.runs;
+      statistics.instrs_after = instrs_after;
+      return;
+    }
+  }
+  compiler_->pass_statistics_.push_back(
+      {pass_->name(), time_us, 1, instrs_before_, instrs_after});
+}
+
 Compiler::Compiler(Processor* processor) : processor_(processor) {}
 
 Compiler::~Compiler() { Reset(); }
@@ -30,9 +83,11 @@ void Compiler::Reset() {}
 bool Compiler::Compile(xe::cpu::hir::HIRBuilder* builder) {
   // TODO(benvanik): sophisticated stuff. Run passes in parallel, run until they
   //                 stop changing things, etc.
+  pass_statistics_.clear();
   for (size_t i = 0; i < passes_.size(); ++i) {
     auto& pass = passes_[i];
     scratch_arena_.Reset();
+    PassScope pass_scope(this, pass.get(), builder);
     if (!pass->Run(builder)) {
       return false;
     }
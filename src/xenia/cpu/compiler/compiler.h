@@ -10,10 +10,12 @@
 #ifndef XENIA_CPU_COMPILER_COMPILER_H_
 #define XENIA_CPU_COMPILER_COMPILER_H_
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 
 #include "xenia/base/arena.h"
+#include "xenia/base/profiling.h"
 #include "xenia/cpu/hir/hir_builder.h"
 
 namespace xe {
@@ -30,6 +32,36 @@ class CompilerPass;
 
 class Compiler {
  public:
+  // Totals of the runs of a pass in the last Compile, collected with
+  // profile_compiler_passes.
+  struct PassStatistics {
+    const char* name;
+    uint64_t time_us;
+    uint32_t runs;
+    // HIR instructions before the first run and after the last.
+    uint32_t instrs_before;
+    uint32_t instrs_after;
+  };
+
+  // Profiles a run of a pass, in the profiler and in the pass statistics, for
+  // the duration of the containing block.
+  class PassScope {
+   public:
+    PassScope(Compiler* compiler, const CompilerPass* pass,
+              hir::HIRBuilder* builder);
+    ~PassScope();
+
+   private:
+#if XE_OPTION_PROFILING
+    MicroProfileScopeHandler profile_scope_;
+#endif  // XE_OPTION_PROFILING
+    Compiler* compiler_;
+    const CompilerPass* pass_;
+    hir::HIRBuilder* builder_;
+    uint64_t start_ticks_ = 0;
+    uint32_t instrs_before_ = 0;
+  };
+
   explicit Compiler(Processor* processor);
   ~Compiler();
 
@@ -42,11 +74,17 @@ class Compiler {
 
   bool Compile(hir::HIRBuilder* builder);
 
+  // In the order the passes first ran in, empty unless profiling passes.
+  const std::vector<PassStatistics>& pass_statistics() const {
+    return pass_statistics_;
+  }
+
  private:
   Processor* processor_;
   Arena scratch_arena_;
 
   std::vector<std::unique_ptr<CompilerPass>> passes_;
+  std::vector<PassStatistics> pass_statistics_;
 };
 
 }  // namespace compiler
@@ -22,6 +22,11 @@ CompilerPass::~CompilerPass() = default;
 bool CompilerPass::Initialize(Compiler* compiler) {
   processor_ = compiler->processor();
   compiler_ = compiler;
+#if XE_OPTION_PROFILING
+  profile_token_ =
+      MicroProfileGetToken("cpu", name(), xe::Profiler::GetColor(name()),
+                           MicroProfileTokenTypeCpu);
+#endif  // XE_OPTION_PROFILING
   return true;
 }
 
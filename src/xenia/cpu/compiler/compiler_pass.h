@@ -11,6 +11,7 @@
 #define XENIA_CPU_COMPILER_COMPILER_PASS_H_
 
 #include "xenia/base/arena.h"
+#include "xenia/base/profiling.h"
 #include "xenia/cpu/hir/hir_builder.h"
 
 namespace xe {
@@ -32,14 +33,26 @@ class CompilerPass {
 
   virtual bool Initialize(Compiler* compiler);
 
+  // Name in the profiler and the compilation statistics.
+  virtual const char* name() const = 0;
+
   virtual bool Run(hir::HIRBuilder* builder) = 0;
 
+#if XE_OPTION_PROFILING
+  MicroProfileToken profile_token() const { return profile_token_; }
+#endif  // XE_OPTION_PROFILING
+
  protected:
   Arena* scratch_arena() const;
 
  protected:
   Processor* processor_;
   Compiler* compiler_;
+
+ private:
+#if XE_OPTION_PROFILING
+  MicroProfileToken profile_token_ = MICROPROFILE_INVALID_TOKEN;
+#endif  // XE_OPTION_PROFILING
 };
 
 }  // namespace compiler
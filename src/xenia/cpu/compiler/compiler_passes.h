@@ -23,6 +23,7 @@
 #include "xenia/cpu/compiler/passes/register_allocation_pass.h"
 #include "xenia/cpu/compiler/passes/simplification_pass.h"
 #include "xenia/cpu/compiler/passes/validation_pass.h"
+#include "xenia/cpu/compiler/passes/value_numbering_pass.h"
 #include "xenia/cpu/compiler/passes/value_reduction_pass.h"
 
 #endif  // XENIA_CPU_COMPILER_COMPILER_PASSES_H_
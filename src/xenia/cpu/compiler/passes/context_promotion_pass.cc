@@ -20,6 +20,10 @@ DECLARE_bool(debug);
 
 DEFINE_bool(store_all_context_values, false,
             "Don't strip dead context stores to aid in debugging.", "CPU");
+DEFINE_bool(inter_block_context_promotion, true,
+            "Reuse context values from the block a block can only be entered "
+            "from, keeping guest registers in host registers across blocks.",
+            "CPU");
 
 namespace xe {
 namespace cpu {
@@ -46,6 +50,7 @@ bool ContextPromotionPass::Initialize(Compiler* compiler) {
   // This is a terrible implementation.
   context_values_.resize(sizeof(ppc::PPCContext));
   context_validity_.resize(static_cast<uint32_t>(sizeof(ppc::PPCContext)));
+  context_liveness_.resize(static_cast<uint32_t>(sizeof(ppc::PPCContext)));
 
   return true;
 }
@@ -67,7 +72,11 @@ bool ContextPromotionPass::Run(HIRBuilder* builder) {
   // instead as it may be faster (at least on the block-level).
 
   // Promote loads to values.
-  // Process each block independently, for now.
+  // Values are carried over from the block's only predecessor when it comes
+  // earlier in the block list. The defining block then dominates all uses,
+  // and everything executed between a definition and a use lies between them
+  // in block order, which the register allocator depends on.
+  FindEntryPredecessors(builder);
   auto block = builder->first_block();
   while (block) {
     PromoteBlock(block);
@@ -78,24 +87,89 @@ bool ContextPromotionPass::Run(HIRBuilder* builder) {
   // This will break debugging as we can't recover this information when
   // trying to extract stack traces/register values, so we don't do that.
   if (!cvars::debug && !cvars::store_all_context_values) {
-    block = builder->first_block();
-    while (block) {
-      RemoveDeadStoresBlock(block);
-      block = block->next;
-    }
+    RemoveDeadStores(builder);
   }
 
   return true;
 }
 
+void ContextPromotionPass::FindEntryPredecessors(HIRBuilder* builder) {
+  uint16_t block_ordinal = 0;
+  auto block = builder->first_block();
+  while (block) {
+    block->ordinal = block_ordinal++;
+    block = block->next;
+  }
+  entry_predecessors_.clear();
+  entry_predecessors_.resize(block_ordinal, nullptr);
+  exit_values_.resize(block_ordinal);
+  if (!cvars::inter_block_context_promotion) {
+    return;
+  }
+
+  // Number of ways into each block, saturating at 2. The control flow graph
+  // may be stale at this point, so this looks at the branches directly.
+  std::vector<uint8_t> entry_counts(block_ordinal, 0);
+  auto add_entry = [&](Block* from, Block* to) {
+    if (entry_counts[to->ordinal] < 2) {
+      ++entry_counts[to->ordinal];
+    }
+    entry_predecessors_[to->ordinal] = from;
+  };
+  // The first block is entered from the caller.
+  entry_counts[0] = 1;
+  block = builder->first_block();
+  while (block) {
+    for (Instr* i = block->instr_head; i; i = i->next) {
+      uint32_t signature = i->opcode->signature;
+      if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_L) {
+        add_entry(block, i->src1.label->block);
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_L) {
+        add_entry(block, i->src2.label->block);
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_L) {
+        add_entry(block, i->src3.label->block);
+      }
+    }
+    // Falls through to the next block unless it ends with a jump.
+    if (block->next && (!block->instr_tail ||
+                        !builder->IsUnconditionalJump(block->instr_tail))) {
+      add_entry(block, block->next);
+    }
+    block = block->next;
+  }
+  block = builder->first_block();
+  while (block) {
+    Block*& predecessor = entry_predecessors_[block->ordinal];
+    if (entry_counts[block->ordinal] != 1 ||
+        (predecessor && predecessor->ordinal >= block->ordinal)) {
+      predecessor = nullptr;
+    }
+    block = block->next;
+  }
+}
+
 void ContextPromotionPass::PromoteBlock(Block* block) {
   auto& validity = context_validity_;
   validity.reset();
 
+  Block* predecessor = entry_predecessors_[block->ordinal];
+  if (predecessor) {
+    for (const auto& exit_value : exit_values_[predecessor->ordinal]) {
+      context_values_[exit_value.first] = exit_value.second;
+      validity.set(exit_value.first);
+    }
+  }
+
   Instr* i = block->instr_head;
   while (i) {
     auto next = i->next;
-    if (i->opcode->flags & OPCODE_FLAG_VOLATILE) {
+    if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+        i->opcode == &OPCODE_BRANCH_FALSE_info) {
+      // Local branches don't touch the context, and end the block, so the
+      // values are still good in the blocks they lead to.
+    } else if (i->opcode->flags & OPCODE_FLAG_VOLATILE) {
       // Volatile instruction - requires all context values be flushed.
       validity.reset();
     } else if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
@@ -119,27 +193,114 @@ void ContextPromotionPass::PromoteBlock(Block* block) {
     }
     i = next;
   }
+
+  // Keep what the following blocks may pick up.
+  auto& exit_values = exit_values_[block->ordinal];
+  exit_values.clear();
+  if (cvars::inter_block_context_promotion) {
+    for (int offset = validity.find_first(); offset != -1;
+         offset = validity.find_next(offset)) {
+      exit_values.emplace_back(uint32_t(offset), context_values_[offset]);
+    }
+  }
 }
 
-void ContextPromotionPass::RemoveDeadStoresBlock(Block* block) {
-  auto& validity = context_validity_;
-  validity.reset();
+void ContextPromotionPass::RemoveDeadStores(HIRBuilder* builder) {
+  // Liveness of every context byte at the start of each block, over the whole
+  // function. A store is dead if none of the bytes it writes can be read
+  // before being written again on any path out of it - this also gets rid of
+  // most CR bit and XER CA updates, with DCE then removing the computation of
+  // the values stored.
+  // Blocks are numbered by FindEntryPredecessors.
+  size_t block_count = entry_predecessors_.size();
+  if (block_live_in_.size() < block_count) {
+    block_live_in_.resize(block_count);
+  }
+  for (size_t n = 0; n < block_count; ++n) {
+    block_live_in_[n].resize(static_cast<uint32_t>(sizeof(ppc::PPCContext)));
+    block_live_in_[n].reset();
+  }
+
+  // Iterate until nothing changes, as loops feed liveness back into earlier
+  // blocks.
+  bool changed;
+  do {
+    changed = false;
+    auto block = builder->last_block();
+    while (block) {
+      RemoveDeadStoresBlock(builder, block, false);
+      auto& live_in = block_live_in_[block->ordinal];
+      if (context_liveness_ != live_in) {
+        live_in = context_liveness_;
+        changed = true;
+      }
+      block = block->prev;
+    }
+  } while (changed);
 
-  // Walk backwards and mark offsets that are written to.
-  // If the offset was written to earlier, ignore the store.
+  auto block = builder->first_block();
+  while (block) {
+    RemoveDeadStoresBlock(builder, block, true);
+    block = block->next;
+  }
+}
+
+void ContextPromotionPass::RemoveDeadStoresBlock(HIRBuilder* builder,
+                                                 Block* block,
+                                                 bool remove_stores) {
+  auto& live = context_liveness_;
+
+  // Bytes live at the end of the block are those live in the block it falls
+  // through to. Falling off the end of the function leaves everything to the
+  // caller.
+  if (block->instr_tail && builder->IsUnconditionalJump(block->instr_tail)) {
+    live.reset();
+  } else if (block->next) {
+    live = block_live_in_[block->next->ordinal];
+  } else {
+    live.set();
+  }
+
+  // Walk backwards, making bytes live at loads and dead at stores.
   Instr* i = block->instr_tail;
   while (i) {
     Instr* prev = i->prev;
-    if (i->opcode->flags & (OPCODE_FLAG_VOLATILE | OPCODE_FLAG_BRANCH)) {
+    uint32_t signature = i->opcode->signature;
+    bool local_branch = false;
+    if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_L) {
+      live |= block_live_in_[i->src1.label->block->ordinal];
+      local_branch = true;
+    }
+    if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_L) {
+      live |= block_live_in_[i->src2.label->block->ordinal];
+      local_branch = true;
+    }
+    if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_L) {
+      live |= block_live_in_[i->src3.label->block->ordinal];
+      local_branch = true;
+    }
+    if (local_branch) {
+      // Branch within the function - nothing else is read.
+    } else if (i->opcode->flags & (OPCODE_FLAG_VOLATILE | OPCODE_FLAG_BRANCH)) {
       // Volatile instruction - requires all context values be flushed.
-      validity.reset();
+      live.set();
+    } else if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+      uint32_t offset = static_cast<uint32_t>(i->src1.offset);
+      live.set(offset, offset + uint32_t(GetTypeSize(i->dest->type)));
     } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
-      size_t offset = i->src1.offset;
-      if (!validity.test(static_cast<uint32_t>(offset))) {
-        // Offset not yet written, mark and continue.
-        validity.set(static_cast<uint32_t>(offset));
-      } else {
-        // Already written to. Remove this store.
+      uint32_t offset = static_cast<uint32_t>(i->src1.offset);
+      uint32_t end = offset + uint32_t(GetTypeSize(i->src2.value->type));
+      bool any_live = false;
+      for (uint32_t n = offset; n < end; ++n) {
+        if (live.test(n)) {
+          any_live = true;
+          break;
+        }
+      }
+      if (any_live) {
+        live.reset(offset, end);
+      } else if (remove_stores) {
+        // Overwritten before it can be read. Remove this store.
         i->Remove();
       }
     }
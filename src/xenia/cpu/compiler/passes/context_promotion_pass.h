@@ -11,6 +11,7 @@
 #define XENIA_CPU_COMPILER_PASSES_CONTEXT_PROMOTION_PASS_H_
 
 #include <cmath>
+#include <utility>
 #include <vector>
 
 #include "xenia/base/platform.h"
@@ -36,17 +37,33 @@ class ContextPromotionPass : public CompilerPass {
   ContextPromotionPass();
   virtual ~ContextPromotionPass() override;
 
+  const char* name() const override { return "ContextPromotion"; }
+
   bool Initialize(Compiler* compiler) override;
 
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
+  void FindEntryPredecessors(hir::HIRBuilder* builder);
   void PromoteBlock(hir::Block* block);
-  void RemoveDeadStoresBlock(hir::Block* block);
+  void RemoveDeadStores(hir::HIRBuilder* builder);
+  void RemoveDeadStoresBlock(hir::HIRBuilder* builder, hir::Block* block,
+                             bool remove_stores);
 
  private:
   std::vector<hir::Value*> context_values_;
   llvm::BitVector context_validity_;
+
+  // By block ordinal, the only block control can come from, if that block is
+  // before it in the block list.
+  std::vector<hir::Block*> entry_predecessors_;
+  // By block ordinal, context values known at the end of the block.
+  std::vector<std::vector<std::pair<uint32_t, hir::Value*>>> exit_values_;
+
+  // Context bytes that may be read before being written, by block ordinal at
+  // the start of the block, and while walking a block.
+  std::vector<llvm::BitVector> block_live_in_;
+  llvm::BitVector context_liveness_;
 };
 
 }  // namespace passes
@@ -12,6 +12,7 @@
 #include "xenia/base/profiling.h"
 #include "xenia/cpu/backend/backend.h"
 #include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/processor.h"
 
 namespace xe {
@@ -22,6 +23,7 @@ namespace passes {
 // TODO(benvanik): remove when enums redefined.
 using namespace xe::cpu::hir;
 
+using xe::cpu::hir::Block;
 using xe::cpu::hir::Edge;
 using xe::cpu::hir::HIRBuilder;
 
@@ -71,9 +73,108 @@ bool ControlFlowAnalysisPass::Run(HIRBuilder* builder) {
     block = block->next;
   }
 
+  if (cvars::spin_loop_hints) {
+    MarkSpinLoops(builder);
+  }
+
+  return true;
+}
+
+bool ControlFlowAnalysisPass::IsSpinLoopBlock(const Block* block,
+                                              bool& polls_out) {
+  // Only loading and comparing, possibly with arithmetic on the results (such
+  // as the time elapsed), and writing guest registers - repeating the block
+  // without anything else changing the memory has no effect.
+  for (auto instr = block->instr_head; instr; instr = instr->next) {
+    switch (instr->opcode->num) {
+      case OPCODE_LOAD:
+      case OPCODE_LOAD_OFFSET:
+      case OPCODE_LOAD_MMIO:
+      case OPCODE_LOAD_CLOCK:
+        polls_out = true;
+        break;
+      case OPCODE_COMMENT:
+      case OPCODE_NOP:
+      case OPCODE_SOURCE_OFFSET:
+      case OPCODE_BRANCH:
+      case OPCODE_BRANCH_TRUE:
+      case OPCODE_BRANCH_FALSE:
+      case OPCODE_ASSIGN:
+      case OPCODE_CAST:
+      case OPCODE_ZERO_EXTEND:
+      case OPCODE_SIGN_EXTEND:
+      case OPCODE_TRUNCATE:
+      case OPCODE_LOAD_LOCAL:
+      case OPCODE_STORE_LOCAL:
+      case OPCODE_LOAD_CONTEXT:
+      case OPCODE_STORE_CONTEXT:
+      case OPCODE_CONTEXT_BARRIER:
+      case OPCODE_MEMORY_BARRIER:
+      case OPCODE_SELECT:
+      case OPCODE_IS_TRUE:
+      case OPCODE_IS_FALSE:
+      case OPCODE_COMPARE_EQ:
+      case OPCODE_COMPARE_NE:
+      case OPCODE_COMPARE_SLT:
+      case OPCODE_COMPARE_SLE:
+      case OPCODE_COMPARE_SGT:
+      case OPCODE_COMPARE_SGE:
+      case OPCODE_COMPARE_ULT:
+      case OPCODE_COMPARE_ULE:
+      case OPCODE_COMPARE_UGT:
+      case OPCODE_COMPARE_UGE:
+      case OPCODE_ADD:
+      case OPCODE_SUB:
+      case OPCODE_AND:
+      case OPCODE_AND_NOT:
+      case OPCODE_OR:
+      case OPCODE_XOR:
+      case OPCODE_NOT:
+      case OPCODE_SHL:
+      case OPCODE_SHR:
+      case OPCODE_SHA:
+      case OPCODE_ROTATE_LEFT:
+      case OPCODE_BYTE_SWAP:
+        break;
+      default:
+        return false;
+    }
+  }
   return true;
 }
 
+void ControlFlowAnalysisPass::MarkSpinLoops(HIRBuilder* builder) {
+  // Back edges go to the same or an earlier block, with the body of the loop
+  // being the blocks from the destination to the source.
+  for (auto block = builder->first_block(); block; block = block->next) {
+    for (auto edge = block->outgoing_edge_head; edge;
+         edge = edge->outgoing_next) {
+      Block* header = edge->dest;
+      if (header->flags & Block::SPIN_LOOP_HEADER) {
+        continue;
+      }
+      // Loops without loads, such as delay loops counting down a register,
+      // don't wait for other threads.
+      bool polls = false;
+      bool is_spin_loop = false;
+      Block* body_block = header;
+      for (uint32_t i = 0; i < kMaxSpinLoopBlocks && body_block; ++i) {
+        if (!IsSpinLoopBlock(body_block, polls)) {
+          break;
+        }
+        if (body_block == block) {
+          is_spin_loop = polls;
+          break;
+        }
+        body_block = body_block->next;
+      }
+      if (is_spin_loop) {
+        header->flags |= Block::SPIN_LOOP_HEADER;
+      }
+    }
+  }
+}
+
 }  // namespace passes
 }  // namespace compiler
 }  // namespace cpu
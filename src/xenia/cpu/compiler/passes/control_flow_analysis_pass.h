@@ -22,9 +22,18 @@ class ControlFlowAnalysisPass : public CompilerPass {
   ControlFlowAnalysisPass();
   ~ControlFlowAnalysisPass() override;
 
+  const char* name() const override { return "ControlFlowAnalysis"; }
+
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
+  // Blocks in a loop for it to be considered tight.
+  static constexpr uint32_t kMaxSpinLoopBlocks = 4;
+
+  static bool IsSpinLoopBlock(const hir::Block* block, bool& polls_out);
+  // Marks the headers of the tight loops that only poll memory or the time
+  // base, such as while waiting for another thread.
+  static void MarkSpinLoops(hir::HIRBuilder* builder);
 };
 
 }  // namespace passes
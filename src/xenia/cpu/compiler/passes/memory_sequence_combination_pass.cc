@@ -28,6 +28,68 @@ MemorySequenceCombinationPass::MemorySequenceCombinationPass()
 
 MemorySequenceCombinationPass::~MemorySequenceCombinationPass() = default;
 
+namespace {
+
+// Whether byte swapping can be done by the memory access itself.
+bool IsSwappableType(TypeName type) {
+  return type == INT16_TYPE || type == INT32_TYPE || type == INT64_TYPE ||
+         type == VEC128_TYPE;
+}
+
+// Whether the value is the stored value of a store, not its address.
+bool IsStoredValue(const Instr* i, const Value* value) {
+  if (i->opcode == &OPCODE_STORE_info) {
+    return i->src2.value == value && i->src1.value != value;
+  }
+  if (i->opcode == &OPCODE_STORE_OFFSET_info) {
+    return i->src3.value == value && i->src1.value != value &&
+           i->src2.value != value;
+  }
+  return false;
+}
+
+// Whether every use of the value, through assignments, is a byte swap or a
+// store of the value, so swapping the value itself removes the swaps and only
+// inverts the stores.
+bool AreAllUsesSwappable(const Value* value) {
+  for (auto use = value->use_head; use; use = use->next) {
+    const Instr* use_instr = use->instr;
+    if (use_instr->opcode == &OPCODE_BYTE_SWAP_info) {
+      continue;
+    }
+    if (use_instr->opcode == &OPCODE_ASSIGN_info) {
+      if (!AreAllUsesSwappable(use_instr->dest)) {
+        return false;
+      }
+      continue;
+    }
+    if (!IsStoredValue(use_instr, value)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void SwapAllUses(Value* value) {
+  auto use = value->use_head;
+  while (use) {
+    auto next_use = use->next;
+    Instr* use_instr = use->instr;
+    if (use_instr->opcode == &OPCODE_BYTE_SWAP_info) {
+      // It's byte_swap vN -> assign vN, so not much to do.
+      use_instr->opcode = &OPCODE_ASSIGN_info;
+      use_instr->flags = 0;
+    } else if (use_instr->opcode == &OPCODE_ASSIGN_info) {
+      SwapAllUses(use_instr->dest);
+    } else {
+      use_instr->flags ^= LoadStoreFlags::LOAD_STORE_BYTE_SWAP;
+    }
+    use = next_use;
+  }
+}
+
+}  // namespace
+
 bool MemorySequenceCombinationPass::Run(HIRBuilder* builder) {
   // Run over all loads and stores and see if we can collapse sequences into the
   // fat opcodes. See the respective utility functions for examples.
@@ -68,31 +130,24 @@ void MemorySequenceCombinationPass::CombineLoadSequence(Instr* i) {
     return;
   }
 
-  // Ensure all uses of the load result are BYTE_SWAP - if it's mixed we
-  // shouldn't transform as we'd have to introduce new swaps!
-  auto use = i->dest->use_head;
-  while (use) {
-    if (use->instr->opcode != &OPCODE_BYTE_SWAP_info) {
-      // Not a swap.
-      return;
-    }
-    // TODO(benvanik): allow uses by STORE (we can make that swap).
-    use = use->next;
+  if (!IsSwappableType(i->dest->type)) {
+    return;
+  }
+
+  // Ensure all uses of the load result are BYTE_SWAP or stores - if it's
+  // mixed we shouldn't transform as we'd have to introduce new swaps!
+  // Assignments left by value numbering are looked through.
+  if (!AreAllUsesSwappable(i->dest)) {
+    return;
   }
 
   // Merge byte swap into load.
   // Note that we may have already been a swapped operation - this inverts that.
   i->flags ^= LoadStoreFlags::LOAD_STORE_BYTE_SWAP;
 
-  // Replace use of byte swap value with loaded value.
-  // It's byte_swap vN -> assign vN, so not much to do.
-  use = i->dest->use_head;
-  while (use) {
-    auto next_use = use->next;
-    use->instr->opcode = &OPCODE_ASSIGN_info;
-    use->instr->flags = 0;
-    use = next_use;
-  }
+  // Replace use of byte swap value with loaded value, and invert the stores
+  // of the loaded value.
+  SwapAllUses(i->dest);
 
   // TODO(benvanik): merge in extend/truncate.
 }
@@ -122,6 +177,9 @@ void MemorySequenceCombinationPass::CombineStoreSequence(Instr* i) {
     // Constant value write - ignore.
     return;
   }
+  if (!IsSwappableType(src->type)) {
+    return;
+  }
 
   // Find source and ensure it is a byte swap.
   auto def = src->def;
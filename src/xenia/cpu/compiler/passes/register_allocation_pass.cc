@@ -71,32 +71,39 @@ RegisterAllocationPass::~RegisterAllocationPass() {
 }
 
 bool RegisterAllocationPass::Run(HIRBuilder* builder) {
-  // Simple per-block allocator that operates on SSA form.
-  // Registers do not move across blocks, though this could be
-  // optimized with some intra-block analysis (dominators/etc).
+  // Linear scan allocator over the whole function that operates on SSA form.
+  // Values normally live within one block, but ContextPromotionPass may carry
+  // them into blocks that can only be entered from the defining block (or
+  // such blocks after it). Those always come after the definition in block
+  // order, with anything executed in between also being in between in block
+  // order, so a value keeps its register from its definition until its last
+  // use in block order - across block boundaries, without any moves.
   // Really, it'd just be nice to have someone who knew what they
   // were doing lower SSA and do this right.
 
+  // Number all blocks and instructions up front. This is required so that
+  // we can sort the usage pointers below, including uses in later blocks.
   uint16_t block_ordinal = 0;
   uint32_t instr_ordinal = 0;
   auto block = builder->first_block();
   while (block) {
     // Sequential block ordinals.
     block->ordinal = block_ordinal++;
-
-    // Reset all state.
-    PrepareBlockState();
-
-    // Renumber all instructions in the block. This is required so that
-    // we can sort the usage pointers below.
     auto instr = block->instr_head;
     while (instr) {
       // Sequential global instruction ordinals.
       instr->ordinal = instr_ordinal++;
       instr = instr->next;
     }
+    block = block->next;
+  }
 
-    instr = block->instr_head;
+  // Reset all state.
+  PrepareBlockState();
+
+  block = builder->first_block();
+  while (block) {
+    auto instr = block->instr_head;
     while (instr) {
       const auto info = instr->opcode;
       uint32_t signature = info->signature;
@@ -247,8 +254,6 @@ void RegisterAllocationPass::AdvanceUses(Instr* instr) {
         // Remove the iterator.
         auto value = upcoming_use.value;
         upcoming_uses.erase(upcoming_uses.begin() + j);
-        assert_true(next_use->instr->block == instr->block);
-        assert_true(value->def->block == instr->block);
         upcoming_uses.emplace_back(value, next_use);
         // i remains the same.
         continue;
@@ -350,8 +355,6 @@ bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
   auto furthest_usage =
       std::max_element(usage_set->upcoming_uses.begin(),
                        usage_set->upcoming_uses.end(), &RegisterUsage::Compare);
-  assert_true(furthest_usage->value->def->block == block);
-  assert_true(furthest_usage->use->instr->block == block);
   auto spill_value = furthest_usage->value;
   Value::Use* prev_use = furthest_usage->use->prev;
   Value::Use* next_use = furthest_usage->use;
@@ -380,7 +383,17 @@ bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
     auto spill_store = builder->last_instr();
     auto spill_store_use = spill_store->src2_use;
     assert_null(spill_store_use->prev);
-    if (prev_use && prev_use->instr->opcode->flags & OPCODE_FLAG_PAIRED_PREV) {
+    Block* def_block = spill_value->def->block;
+    if (prev_use && (prev_use->instr->block != def_block ||
+                     next_use->instr->block != def_block)) {
+      // Used in other blocks, which may be reached without going through the
+      // block of the previous use. Store right after the definition.
+      spill_store->MoveBefore(spill_value->def->next);
+
+      // Update last use.
+      spill_value->last_use = prev_use->instr;
+    } else if (prev_use &&
+               prev_use->instr->opcode->flags & OPCODE_FLAG_PAIRED_PREV) {
       // Instruction is paired. This is bad. We will insert the spill after the
       // paired instruction.
       assert_not_null(prev_use->instr->next);
@@ -435,12 +448,21 @@ bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
   // from the local.
   // We can quickly do this by walking the use list. Because the list is
   // already sorted we know we are going to end up with a sorted list.
+  // Uses in other blocks get their own load, as the block of the first one
+  // may not be on the way to them.
   auto walk_use = new_head_use;
-  auto new_use_tail = walk_use;
+  Instr* last_use_instr = nullptr;
   while (walk_use) {
     auto next_walk_use = walk_use->next;
     auto instr = walk_use->instr;
 
+    if (instr->block != new_value->def->block) {
+      new_value->last_use = last_use_instr;
+      new_value = builder->LoadLocal(spill_value->local_slot);
+      builder->last_instr()->MoveBefore(instr);
+      new_value->local_slot = spill_value->local_slot;
+    }
+
     uint32_t signature = instr->opcode->signature;
     if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
       if (instr->src1.value == spill_value) {
@@ -458,12 +480,10 @@ bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
       }
     }
 
+    last_use_instr = instr;
     walk_use = next_walk_use;
-    if (walk_use) {
-      new_use_tail = walk_use;
-    }
   }
-  new_value->last_use = new_use_tail->instr;
+  new_value->last_use = last_use_instr;
 
   // Update tracking.
   MarkRegAvailable(reg);
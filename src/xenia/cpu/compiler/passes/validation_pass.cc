@@ -75,9 +75,11 @@ bool ValidationPass::ValidateInstruction(Block* block, Instr* instr) {
 
   if (instr->dest) {
     assert_true(instr->dest->def == instr);
+    // Uses may be in later blocks only reachable through this one when
+    // context promotion carried the value across blocks.
     auto use = instr->dest->use_head;
     while (use) {
-      assert_true(use->instr->block == block);
+      assert_not_null(use->instr->block);
       use = use->next;
     }
   }
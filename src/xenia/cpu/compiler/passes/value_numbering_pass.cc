@@ -0,0 +1,344 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/value_numbering_pass.h"
+
+#include <tuple>
+#include <utility>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/profiling.h"
+#include "xenia/base/xxhash.h"
+#include "xenia/cpu/hir/hir_builder.h"
+
+DEFINE_bool(value_numbering, true,
+            "Eliminate common subexpressions in the generated code, such as "
+            "repeated address calculations and byte swaps.",
+            "CPU");
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Value;
+
+namespace {
+
+enum OperandKind : uint64_t {
+  kOperandNone,
+  kOperandValue,
+  kOperandConstant,
+  kOperandOther,
+};
+
+// Kind and two words identifying an instruction operand.
+struct Operand {
+  uint64_t kind;
+  uint64_t words[2];
+};
+
+Operand GetOperand(uint32_t sig_type, const Instr::Op& op) {
+  Operand operand = {kOperandNone, {0, 0}};
+  switch (sig_type) {
+    case OPCODE_SIG_TYPE_V:
+      if (op.value->IsConstant()) {
+        // Constants are separate values for every use - compare the contents.
+        operand.kind = kOperandConstant;
+        operand.words[0] = op.value->constant.v128.low;
+        operand.words[1] = op.value->type == VEC128_TYPE
+                               ? op.value->constant.v128.high
+                               : uint64_t(op.value->type);
+        if (op.value->type != VEC128_TYPE &&
+            op.value->type != INT64_TYPE && op.value->type != FLOAT64_TYPE) {
+          // Only the lower bytes are written by set_constant for small types.
+          uint64_t size = GetTypeSize(op.value->type);
+          operand.words[0] &= (UINT64_C(1) << (size * 8)) - 1;
+        }
+      } else {
+        operand.kind = kOperandValue;
+        operand.words[0] = uint64_t(reinterpret_cast<uintptr_t>(op.value));
+      }
+      break;
+    case OPCODE_SIG_TYPE_O:
+      operand.kind = kOperandOther;
+      operand.words[0] = op.offset;
+      break;
+    case OPCODE_SIG_TYPE_L:
+    case OPCODE_SIG_TYPE_S:
+      operand.kind = kOperandOther;
+      operand.words[0] = uint64_t(reinterpret_cast<uintptr_t>(op.label));
+      break;
+    default:
+      break;
+  }
+  return operand;
+}
+
+Value* ResolveAssignments(Value* value) {
+  while (!value->IsConstant() && value->def &&
+         value->def->opcode == &OPCODE_ASSIGN_info) {
+    value = value->def->src1.value;
+  }
+  return value;
+}
+
+}  // namespace
+
+size_t ValueNumberingPass::ExpressionKeyHasher::operator()(
+    const ExpressionKey& key) const {
+  return size_t(XXH3_64bits(key.data(), sizeof(key)));
+}
+
+ValueNumberingPass::ValueNumberingPass() : CompilerPass() {}
+
+ValueNumberingPass::~ValueNumberingPass() = default;
+
+bool ValueNumberingPass::Run(HIRBuilder* builder) {
+  if (!cvars::value_numbering) {
+    return true;
+  }
+
+  // Values are reused from the blocks a block can only be entered from, if
+  // they're before it in the block list, like in ContextPromotionPass, so the
+  // earlier definition dominates the use, and everything executed between
+  // them lies between them in block order, as the register allocator
+  // requires. The dominator tree is walked depth-first, with the expressions
+  // of a block available in the blocks it dominates.
+  FindDominatedBlocks(builder);
+  expressions_.clear();
+  undo_log_.clear();
+  next_epoch_ = 0;
+
+  std::vector<std::pair<Block*, BlockExit>> stack;
+  // Blocks not dominated by others start with nothing available, including
+  // the entry block.
+  std::vector<bool> dominated(dominated_blocks_.size(), false);
+  for (const auto& blocks : dominated_blocks_) {
+    for (Block* block : blocks) {
+      dominated[block->ordinal] = true;
+    }
+  }
+  for (auto block = builder->last_block(); block; block = block->prev) {
+    if (!dominated[block->ordinal]) {
+      BlockExit entry = {0, 0, 0};
+      entry.memory_epoch = ++next_epoch_;
+      entry.rounding_epoch = ++next_epoch_;
+      stack.emplace_back(block, entry);
+    }
+  }
+  while (!stack.empty()) {
+    Block* block = stack.back().first;
+    BlockExit dominator_exit = stack.back().second;
+    stack.pop_back();
+
+    // Drop the expressions of the blocks processed since the dominator, which
+    // aren't on the path to this block.
+    for (size_t i = dominator_exit.undo_log_size; i < undo_log_.size(); ++i) {
+      expressions_.erase(undo_log_[i]);
+    }
+    undo_log_.resize(dominator_exit.undo_log_size);
+    memory_epoch_ = dominator_exit.memory_epoch;
+    rounding_epoch_ = dominator_exit.rounding_epoch;
+
+    NumberBlock(block);
+
+    BlockExit exit = {undo_log_.size(), memory_epoch_, rounding_epoch_};
+    const std::vector<Block*>& dominated_blocks =
+        dominated_blocks_[block->ordinal];
+    for (auto it = dominated_blocks.rbegin(); it != dominated_blocks.rend();
+         ++it) {
+      stack.emplace_back(*it, exit);
+    }
+  }
+
+  expressions_.clear();
+  undo_log_.clear();
+  return true;
+}
+
+void ValueNumberingPass::FindDominatedBlocks(HIRBuilder* builder) {
+  uint16_t block_ordinal = 0;
+  auto block = builder->first_block();
+  while (block) {
+    block->ordinal = block_ordinal++;
+    block = block->next;
+  }
+
+  // Number of ways into each block, saturating at 2, and the last block
+  // entering it. The control flow graph may be stale at this point, so this
+  // looks at the branches directly.
+  std::vector<uint8_t> entry_counts(block_ordinal, 0);
+  std::vector<Block*> entry_predecessors(block_ordinal, nullptr);
+  auto add_entry = [&](Block* from, Block* to) {
+    if (entry_counts[to->ordinal] < 2) {
+      ++entry_counts[to->ordinal];
+    }
+    entry_predecessors[to->ordinal] = from;
+  };
+  // The first block is entered from the caller.
+  if (block_ordinal) {
+    entry_counts[0] = 1;
+  }
+  block = builder->first_block();
+  while (block) {
+    for (Instr* i = block->instr_head; i; i = i->next) {
+      uint32_t signature = i->opcode->signature;
+      if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_L) {
+        add_entry(block, i->src1.label->block);
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_L) {
+        add_entry(block, i->src2.label->block);
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_L) {
+        add_entry(block, i->src3.label->block);
+      }
+    }
+    // Falls through to the next block unless it ends with a jump.
+    if (block->next && (!block->instr_tail ||
+                        !builder->IsUnconditionalJump(block->instr_tail))) {
+      add_entry(block, block->next);
+    }
+    block = block->next;
+  }
+
+  for (auto& blocks : dominated_blocks_) {
+    blocks.clear();
+  }
+  dominated_blocks_.resize(block_ordinal);
+  block = builder->first_block();
+  while (block) {
+    Block* predecessor = entry_predecessors[block->ordinal];
+    if (entry_counts[block->ordinal] == 1 && predecessor &&
+        predecessor->ordinal < block->ordinal) {
+      dominated_blocks_[predecessor->ordinal].push_back(block);
+    }
+    block = block->next;
+  }
+}
+
+void ValueNumberingPass::NumberBlock(Block* block) {
+  for (Instr* i = block->instr_head; i; i = i->next) {
+    const OpcodeInfo* opcode = i->opcode;
+
+    // Use the sources of assignments directly, so expressions using the
+    // results of replaced instructions match too.
+    uint32_t signature = opcode->signature;
+    if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
+      i->set_src1(ResolveAssignments(i->src1.value));
+    }
+    if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
+      i->set_src2(ResolveAssignments(i->src2.value));
+    }
+    if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
+      i->set_src3(ResolveAssignments(i->src3.value));
+    }
+
+    if (opcode == &OPCODE_BRANCH_TRUE_info ||
+        opcode == &OPCODE_BRANCH_FALSE_info) {
+      // Local branches end the block without side effects.
+      continue;
+    }
+    if (opcode->flags & OPCODE_FLAG_VOLATILE) {
+      // Calls, traps and the like may do anything.
+      memory_epoch_ = ++next_epoch_;
+      rounding_epoch_ = ++next_epoch_;
+      continue;
+    }
+    if (opcode == &OPCODE_SET_ROUNDING_MODE_info) {
+      rounding_epoch_ = ++next_epoch_;
+      continue;
+    }
+    if ((opcode->flags & OPCODE_FLAG_MEMORY) &&
+        opcode != &OPCODE_LOAD_info && opcode != &OPCODE_LOAD_OFFSET_info) {
+      // Stores, atomics, MMIO, cache control and barriers. Barriers make
+      // stores from other threads visible.
+      memory_epoch_ = ++next_epoch_;
+      continue;
+    }
+
+    ExpressionKey key;
+    if (!MakeKey(i, key)) {
+      continue;
+    }
+    auto emplace_result = expressions_.emplace(key, i->dest);
+    if (emplace_result.second) {
+      undo_log_.push_back(key);
+      continue;
+    }
+    Value* previous_value = emplace_result.first->second;
+    i->Replace(&OPCODE_ASSIGN_info, 0);
+    i->set_src1(previous_value);
+  }
+}
+
+bool ValueNumberingPass::MakeKey(const Instr* instr,
+                                 ExpressionKey& key_out) const {
+  const OpcodeInfo* opcode = instr->opcode;
+  uint32_t signature = opcode->signature;
+  if (GET_OPCODE_SIG_TYPE_DEST(signature) != OPCODE_SIG_TYPE_V ||
+      (opcode->flags & OPCODE_FLAG_PAIRED_PREV)) {
+    return false;
+  }
+  // The instruction after may depend on this exact instruction, such as
+  // did_saturate.
+  if (instr->next && (instr->next->opcode->flags & OPCODE_FLAG_PAIRED_PREV)) {
+    return false;
+  }
+  // Context and local accesses are handled by ContextPromotionPass, and the
+  // clock changes constantly.
+  if (opcode == &OPCODE_ASSIGN_info || opcode == &OPCODE_LOAD_CONTEXT_info ||
+      opcode == &OPCODE_LOAD_LOCAL_info || opcode == &OPCODE_LOAD_CLOCK_info) {
+    return false;
+  }
+  uint32_t epoch;
+  if (opcode == &OPCODE_LOAD_info || opcode == &OPCODE_LOAD_OFFSET_info) {
+    epoch = memory_epoch_;
+  } else if (opcode->flags & OPCODE_FLAG_MEMORY) {
+    return false;
+  } else {
+    epoch = rounding_epoch_;
+  }
+
+  Operand operands[3] = {
+      GetOperand(GET_OPCODE_SIG_TYPE_SRC1(signature), instr->src1),
+      GetOperand(GET_OPCODE_SIG_TYPE_SRC2(signature), instr->src2),
+      GetOperand(GET_OPCODE_SIG_TYPE_SRC3(signature), instr->src3),
+  };
+  if (opcode->flags & OPCODE_FLAG_COMMUNATIVE) {
+    auto operand_tuple = [](const Operand& operand) {
+      return std::make_tuple(operand.kind, operand.words[0], operand.words[1]);
+    };
+    if (operand_tuple(operands[1]) < operand_tuple(operands[0])) {
+      std::swap(operands[0], operands[1]);
+    }
+  }
+
+  key_out[0] = uint64_t(reinterpret_cast<uintptr_t>(opcode));
+  key_out[1] = uint64_t(instr->flags) | (uint64_t(instr->dest->type) << 16) |
+               (uint64_t(epoch) << 32);
+  key_out[2] = operands[0].kind | (operands[1].kind << 4) |
+               (operands[2].kind << 8);
+  for (size_t i = 0; i < 3; ++i) {
+    key_out[3 + i * 2] = operands[i].words[0];
+    key_out[3 + i * 2 + 1] = operands[i].words[1];
+  }
+  return true;
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
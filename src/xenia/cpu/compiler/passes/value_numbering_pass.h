@@ -0,0 +1,80 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_VALUE_NUMBERING_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_VALUE_NUMBERING_PASS_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Common subexpression elimination: instructions computing what an earlier
+// instruction has already computed are replaced with assignments of the
+// earlier result, which the simplification and dead code elimination passes
+// then remove.
+class ValueNumberingPass : public CompilerPass {
+ public:
+  ValueNumberingPass();
+  ~ValueNumberingPass() override;
+
+  const char* name() const override { return "ValueNumbering"; }
+
+  bool Run(hir::HIRBuilder* builder) override;
+
+ private:
+  // Opcode, flags, dest type and epoch, operand kinds, and two words for each
+  // of the three operands.
+  using ExpressionKey = std::array<uint64_t, 9>;
+  struct ExpressionKeyHasher {
+    size_t operator()(const ExpressionKey& key) const;
+  };
+
+  // State at the end of a block, for the blocks only entered from it.
+  struct BlockExit {
+    size_t undo_log_size;
+    uint32_t memory_epoch;
+    uint32_t rounding_epoch;
+  };
+
+  void FindDominatedBlocks(hir::HIRBuilder* builder);
+  void NumberBlock(hir::Block* block);
+  bool MakeKey(const hir::Instr* instr, ExpressionKey& key_out) const;
+
+  // By block ordinal, the blocks that can only be entered from the block and
+  // come after it in the block list.
+  std::vector<std::vector<hir::Block*>> dominated_blocks_;
+
+  std::unordered_map<ExpressionKey, hir::Value*, ExpressionKeyHasher>
+      expressions_;
+  // Keys added to expressions_, to remove when leaving the blocks dominated
+  // by the block that added them.
+  std::vector<ExpressionKey> undo_log_;
+
+  // Loads are only reused while no memory may have been written, and
+  // floating-point results while the rounding mode hasn't changed.
+  uint32_t next_epoch_ = 0;
+  uint32_t memory_epoch_ = 0;
+  uint32_t rounding_epoch_ = 0;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_VALUE_NUMBERING_PASS_H_
@@ -16,6 +16,30 @@ DEFINE_string(
     "Loads a .map for symbol names and to diff with the generated symbol "
     "database.",
     "CPU");
+DEFINE_int32(
+    xex_load_threads, -1,
+    "Number of threads decrypting, verifying and scanning executable images "
+    "while loading them, including the loading thread.\n"
+    " 1 = load on the loading thread only.\n"
+    "-1 = pick based on the number of host CPU cores.",
+    "CPU");
+DEFINE_bool(xex_image_cache, true,
+            "Store the decrypted and decompressed image of executables in the "
+            "cache, and read it from there on later launches instead of "
+            "decrypting and decompressing the executable again.",
+            "CPU");
+DEFINE_bool(replace_crt_routines, true,
+            "Run C runtime routines statically linked into titles (such as "
+            "memcpy and memset), when they're recognized, as host code.",
+            "CPU");
+DEFINE_string(
+    crt_routine_signatures, "",
+    "Path to a file with the code signatures used to recognize C runtime "
+    "routines in titles. Each line is a routine name (memcpy, memmove, "
+    "memset, strlen, strcmp, XMemCpy or XMemSet) followed by the first "
+    "instruction words of its code in hexadecimal. Routines are also "
+    "recognized by name from the module map.",
+    "CPU");
 
 DEFINE_bool(disassemble_functions, false,
             "Disassemble functions during generation.", "CPU");
@@ -38,6 +62,138 @@ DEFINE_bool(
 DEFINE_bool(validate_hir, false,
             "Perform validation checks on the HIR during compilation.", "CPU");
 
+DEFINE_int32(
+    translation_threads, 0,
+    "Number of background threads translating guest functions before they "
+    "are first called (targets of calls in already translated code) and "
+    "re-optimizing hot functions with tiered_translation.\n"
+    " 0 = translate only when code is about to be executed.\n"
+    "-1 = pick based on the number of host CPU cores.",
+    "CPU");
+DEFINE_bool(
+    tiered_translation, false,
+    "Translate functions with a minimal set of optimization passes first, and "
+    "retranslate them with all passes once they are called often. Shortens "
+    "stalls on new code at the cost of slower code until it's re-optimized. "
+    "Requires translation_threads.",
+    "CPU");
+DEFINE_uint32(tier_up_call_count, 1000,
+              "Number of calls to a function translated with "
+              "tiered_translation before it is re-optimized.",
+              "CPU");
+DEFINE_bool(
+    profile_guided_recompilation, false,
+    "Count how often functions and their blocks are executed, and recompile "
+    "the hottest ones with small leaf functions they call inlined. Requires "
+    "translation_threads.",
+    "CPU");
+DEFINE_uint32(profile_sample_interval_ms, 2000,
+              "Milliseconds between looks at the execution counts with "
+              "profile_guided_recompilation.",
+              "CPU");
+DEFINE_uint32(profile_hot_function_count, 16,
+              "Maximum number of functions recompiled with "
+              "profile_guided_recompilation per sample.",
+              "CPU");
+DEFINE_uint32(profile_hot_call_count, 10000,
+              "Calls to a function within one sample needed for "
+              "profile_guided_recompilation to consider it hot.",
+              "CPU");
+DEFINE_bool(function_database, true,
+            "Store the boundaries of the functions found in a title and "
+            "declare them right after loading it on later launches, so they "
+            "can be translated ahead of execution with translation_threads.",
+            "CPU");
+DEFINE_bool(keep_translations_on_relaunch, true,
+            "Keep the translated code of the executable when the title "
+            "launches another one, and reuse it if the same executable is "
+            "loaded again, such as when returning from the game to the menu.",
+            "CPU");
+DEFINE_bool(learn_mmio_accesses, true,
+            "Retranslate functions accessing MMIO through access violations so "
+            "that the accesses call the MMIO handlers directly. Requires "
+            "translation_threads.",
+            "CPU");
+DEFINE_bool(learn_write_watched_stores, true,
+            "Retranslate functions writing to watched physical memory through "
+            "access violations so that the stores check the watches and "
+            "trigger them directly. Requires translation_threads.",
+            "CPU");
+DEFINE_bool(inline_leaf_functions, false,
+            "Emit the code of small straight-line leaf functions in place of "
+            "direct calls to them. Disabled with --debug.",
+            "CPU");
+DEFINE_bool(inline_tls_exports, true,
+            "Access thread local storage slots directly in the generated code "
+            "instead of calling KeTlsGetValue and KeTlsSetValue.",
+            "CPU");
+DEFINE_uint32(inline_leaf_instruction_count, 16,
+              "Maximum number of instructions in a leaf function inlined with "
+              "inline_leaf_functions or profile_guided_recompilation.",
+              "CPU");
+
+DEFINE_uint32(translation_region_instructions, 8192,
+              "Translate functions longer than this many instructions in "
+              "parts, the first one of which can run while the rest are "
+              "translated in the background. 0 to disable.",
+              "CPU");
+
+DEFINE_bool(invalidate_written_code, true,
+            "Watch the guest memory code was translated from for writes, and "
+            "translate the functions overlapping written pages again the next "
+            "time they're called.",
+            "CPU");
+
+DEFINE_uint32(code_cache_reclaim_threshold_mb, 16,
+              "Megabytes of generated code superseded by retranslations after "
+              "which the space of the code no thread is in anymore is reused. "
+              "0 to never reuse it. Needs a stack walker, so only available on "
+              "Windows.",
+              "CPU");
+
+DEFINE_bool(guest_sampling_profiler, false,
+            "Sample where the guest threads are in guest code and write the "
+            "samples as folded stacks for flame graph tools to the profiles "
+            "directory of the cache when the title exits. Needs a stack "
+            "walker, so only available on Windows.",
+            "CPU");
+DEFINE_uint32(guest_sampling_interval_ms, 1,
+              "Milliseconds between samples of guest_sampling_profiler.",
+              "CPU");
+
+DEFINE_bool(guest_safepoints, true,
+            "Poll for stop requests at loop back edges in the generated code, "
+            "so guest threads can be paused without suspending them through "
+            "the OS.",
+            "CPU");
+DEFINE_uint32(safepoint_timeout_us, 250,
+              "Microseconds to wait for guest threads to reach a safepoint "
+              "before suspending them through the OS.",
+              "CPU");
+
+DEFINE_bool(spin_loop_hints, true,
+            "Detect tight guest loops only polling memory or the time base, "
+            "and execute the pause instruction in them, periodically yielding "
+            "to the host scheduler so the thread being waited for can run on "
+            "hosts with fewer cores than the guest has hardware threads.",
+            "CPU");
+DEFINE_int32(spin_loop_yield_iterations, 256,
+             "Iterations of a detected guest spin loop after which the thread "
+             "yields to the host scheduler, backing off to sleeping if it "
+             "keeps spinning. 0 to only execute the pause instruction. Can be "
+             "set per title by the game compatibility database.",
+             "CPU");
+
+DEFINE_bool(profile_compiler_passes, false,
+            "Record the time taken by each compiler pass and the HIR "
+            "instruction counts around it for every translated function, and "
+            "log the totals and the slowest functions to compile at shutdown.",
+            "CPU");
+DEFINE_int32(profile_compiler_passes_slowest_count, 32,
+             "Number of the slowest functions to compile to log with "
+             "profile_compiler_passes.",
+             "CPU");
+
 DEFINE_uint64(
     pvr, 0x710700,
     "Processor version and revision number.\nBits 0 to 15 are the version "
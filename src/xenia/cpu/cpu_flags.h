@@ -14,6 +14,10 @@
 DECLARE_string(cpu);
 
 DECLARE_string(load_module_map);
+DECLARE_int32(xex_load_threads);
+DECLARE_bool(xex_image_cache);
+DECLARE_bool(replace_crt_routines);
+DECLARE_string(crt_routine_signatures);
 
 DECLARE_bool(disassemble_functions);
 
@@ -26,6 +30,39 @@ DECLARE_bool(disable_global_lock);
 
 DECLARE_bool(validate_hir);
 
+DECLARE_int32(translation_threads);
+DECLARE_bool(tiered_translation);
+DECLARE_uint32(tier_up_call_count);
+DECLARE_bool(profile_guided_recompilation);
+DECLARE_uint32(profile_sample_interval_ms);
+DECLARE_uint32(profile_hot_function_count);
+DECLARE_uint32(profile_hot_call_count);
+DECLARE_bool(function_database);
+DECLARE_bool(keep_translations_on_relaunch);
+DECLARE_bool(learn_mmio_accesses);
+DECLARE_bool(learn_write_watched_stores);
+DECLARE_bool(inline_leaf_functions);
+DECLARE_bool(inline_tls_exports);
+DECLARE_uint32(inline_leaf_instruction_count);
+
+DECLARE_uint32(translation_region_instructions);
+
+DECLARE_bool(invalidate_written_code);
+
+DECLARE_uint32(code_cache_reclaim_threshold_mb);
+
+DECLARE_bool(guest_sampling_profiler);
+DECLARE_uint32(guest_sampling_interval_ms);
+
+DECLARE_bool(guest_safepoints);
+DECLARE_uint32(safepoint_timeout_us);
+
+DECLARE_bool(spin_loop_hints);
+DECLARE_int32(spin_loop_yield_iterations);
+
+DECLARE_bool(profile_compiler_passes);
+DECLARE_int32(profile_compiler_passes_slowest_count);
+
 DECLARE_uint64(pvr);
 
 // Breakpoints:
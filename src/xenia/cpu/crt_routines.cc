@@ -0,0 +1,93 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/crt_routines.h"
+
+#include <cstring>
+
+#include "xenia/base/math.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/memory.h"
+
+namespace xe {
+namespace cpu {
+
+namespace {
+
+// void* memmove(void* dest, const void* src, size_t count)
+// Also used for memcpy and XMemCpy, as some titles pass overlapping ranges to
+// them anyway.
+void CrtMemmove(ppc::PPCContext* ppc_context, kernel::KernelState*) {
+  Memory* memory = ppc_context->processor->memory();
+  uint32_t dest = uint32_t(ppc_context->r[3]);
+  uint32_t src = uint32_t(ppc_context->r[4]);
+  uint32_t count = uint32_t(ppc_context->r[5]);
+  if (count) {
+    std::memmove(memory->TranslateVirtual(dest),
+                 memory->TranslateVirtual(src), count);
+  }
+  // r3 is left as dest.
+}
+
+// void* memset(void* dest, int c, size_t count)
+void CrtMemset(ppc::PPCContext* ppc_context, kernel::KernelState*) {
+  Memory* memory = ppc_context->processor->memory();
+  uint32_t dest = uint32_t(ppc_context->r[3]);
+  uint8_t c = uint8_t(ppc_context->r[4]);
+  uint32_t count = uint32_t(ppc_context->r[5]);
+  if (count) {
+    std::memset(memory->TranslateVirtual(dest), c, count);
+  }
+  // r3 is left as dest.
+}
+
+// size_t strlen(const char* str)
+void CrtStrlen(ppc::PPCContext* ppc_context, kernel::KernelState*) {
+  Memory* memory = ppc_context->processor->memory();
+  uint32_t str = uint32_t(ppc_context->r[3]);
+  ppc_context->r[3] = uint32_t(
+      std::strlen(memory->TranslateVirtual<const char*>(str)));
+}
+
+// int strcmp(const char* str1, const char* str2)
+void CrtStrcmp(ppc::PPCContext* ppc_context, kernel::KernelState*) {
+  Memory* memory = ppc_context->processor->memory();
+  uint32_t str1 = uint32_t(ppc_context->r[3]);
+  uint32_t str2 = uint32_t(ppc_context->r[4]);
+  // Like the guest C runtime, only the sign of the result is meaningful and
+  // characters are compared as unsigned.
+  int result = std::strcmp(memory->TranslateVirtual<const char*>(str1),
+                           memory->TranslateVirtual<const char*>(str2));
+  ppc_context->r[3] = uint64_t(int64_t(result < 0 ? -1 : result > 0));
+}
+
+struct CrtRoutine {
+  const char* name;
+  GuestFunction::ExternHandler handler;
+};
+
+const CrtRoutine kCrtRoutines[] = {
+    {"memcpy", CrtMemmove},  {"memmove", CrtMemmove}, {"memset", CrtMemset},
+    {"strlen", CrtStrlen},   {"strcmp", CrtStrcmp},   {"XMemCpy", CrtMemmove},
+    {"XMemSet", CrtMemset},
+};
+
+}  // namespace
+
+GuestFunction::ExternHandler LookupCrtRoutine(std::string_view name) {
+  for (size_t i = 0; i < xe::countof(kCrtRoutines); ++i) {
+    if (name == kCrtRoutines[i].name) {
+      return kCrtRoutines[i].handler;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,30 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_CRT_ROUTINES_H_
+#define XENIA_CPU_CRT_ROUTINES_H_
+
+#include <string_view>
+
+#include "xenia/cpu/function.h"
+
+namespace xe {
+namespace cpu {
+
+// Host implementations of C runtime routines that titles link statically,
+// bound to the guest functions found to be those routines to run them with
+// the (vectorized) host C runtime instead of through translated code. All of
+// them work on bytes, so guest byte order doesn't change their results.
+// Returns nullptr if there's no host implementation of the routine.
+GuestFunction::ExternHandler LookupCrtRoutine(std::string_view name);
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_CRT_ROUTINES_H_
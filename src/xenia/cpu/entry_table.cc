@@ -9,26 +9,63 @@
 
 #include "xenia/cpu/entry_table.h"
 
+#include "xenia/base/assert.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/threading.h"
+#include "xenia/cpu/function.h"
 
 namespace xe {
 namespace cpu {
 
-EntryTable::EntryTable() = default;
+EntryTable::EntryTable()
+    : pages_(std::make_unique<std::atomic<Page*>[]>(kPageCount)) {}
 
 EntryTable::~EntryTable() {
-  auto global_lock = global_critical_region_.Acquire();
-  for (auto it : map_) {
-    Entry* entry = it.second;
-    delete entry;
+  for (uint32_t i = 0; i < kPageCount; ++i) {
+    Page* page = pages_[i].load(std::memory_order_relaxed);
+    if (!page) {
+      continue;
+    }
+    for (uint32_t j = 0; j < kSlotsPerPage; ++j) {
+      delete page->slots[j].load(std::memory_order_relaxed);
+    }
+    delete page;
+  }
+}
+
+std::atomic<Entry*>* EntryTable::LookupSlot(uint32_t address) const {
+  Page* page = pages_[address >> kPageShift].load(std::memory_order_acquire);
+  if (!page) {
+    return nullptr;
   }
+  return &page->slots[(address & ((uint32_t(1) << kPageShift) - 1)) >> 2];
+}
+
+std::atomic<Entry*>* EntryTable::GetOrCreateSlot(uint32_t address) {
+  std::atomic<Page*>& page_slot = pages_[address >> kPageShift];
+  Page* page = page_slot.load(std::memory_order_acquire);
+  if (!page) {
+    // Value-initialized, so all slots start out null.
+    Page* new_page = new Page();
+    if (page_slot.compare_exchange_strong(page, new_page,
+                                          std::memory_order_acq_rel,
+                                          std::memory_order_acquire)) {
+      page = new_page;
+    } else {
+      // Another thread installed the page first, and it's in page now.
+      delete new_page;
+    }
+  }
+  return &page->slots[(address & ((uint32_t(1) << kPageShift) - 1)) >> 2];
 }
 
 Entry* EntryTable::Get(uint32_t address) {
-  auto global_lock = global_critical_region_.Acquire();
-  const auto& it = map_.find(address);
-  Entry* entry = it != map_.end() ? it->second : nullptr;
+  assert_zero(address & 3);
+  std::atomic<Entry*>* slot = LookupSlot(address);
+  if (!slot) {
+    return nullptr;
+  }
+  Entry* entry = slot->load(std::memory_order_acquire);
   if (entry) {
     // TODO(benvanik): wait if needed?
     if (entry->status != Entry::STATUS_READY) {
@@ -39,50 +76,78 @@ Entry* EntryTable::Get(uint32_t address) {
 }
 
 Entry::Status EntryTable::GetOrCreate(uint32_t address, Entry** out_entry) {
-  // TODO(benvanik): replace with a map with wait-free for find.
-  // https://github.com/facebook/folly/blob/master/folly/AtomicHashMap.h
-
-  auto global_lock = global_critical_region_.Acquire();
-  const auto& it = map_.find(address);
-  Entry* entry = it != map_.end() ? it->second : nullptr;
-  Entry::Status status;
-  if (entry) {
-    // If we aren't ready yet spin and wait.
-    if (entry->status == Entry::STATUS_COMPILING) {
-      // Still compiling, so spin.
-      do {
-        global_lock.unlock();
-        // TODO(benvanik): sleep for less time?
-        xe::threading::Sleep(std::chrono::microseconds(10));
-        global_lock.lock();
-      } while (entry->status == Entry::STATUS_COMPILING);
+  assert_zero(address & 3);
+  std::atomic<Entry*>* slot = GetOrCreateSlot(address);
+  Entry* entry = slot->load(std::memory_order_acquire);
+  if (!entry) {
+    // Create and try to claim the slot for initialization.
+    Entry* new_entry = new Entry();
+    new_entry->address = address;
+    new_entry->end_address = 0;
+    new_entry->status = Entry::STATUS_COMPILING;
+    new_entry->function = nullptr;
+    if (slot->compare_exchange_strong(entry, new_entry,
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_acquire)) {
+      *out_entry = new_entry;
+      return Entry::STATUS_NEW;
     }
-    status = entry->status;
-  } else {
-    // Create and return for initialization.
-    entry = new Entry();
-    entry->address = address;
-    entry->end_address = 0;
-    entry->status = Entry::STATUS_COMPILING;
-    entry->function = 0;
-    map_[address] = entry;
-    status = Entry::STATUS_NEW;
+    // Lost the race, entry now holds the winner.
+    delete new_entry;
+  }
+  // If we aren't ready yet spin and wait.
+  Entry::Status status;
+  while ((status = entry->status) == Entry::STATUS_COMPILING) {
+    // Still compiling, so spin.
+    // TODO(benvanik): sleep for less time?
+    xe::threading::Sleep(std::chrono::microseconds(10));
   }
-  global_lock.unlock();
   *out_entry = entry;
   return status;
 }
 
+void EntryTable::MarkReady(Entry* entry, Function* function) {
+  entry->function = function;
+  entry->end_address = function->end_address();
+  if (entry->end_address > entry->address) {
+    uint32_t length = entry->end_address - entry->address;
+    uint32_t max_length = max_entry_length_.load(std::memory_order_relaxed);
+    while (length > max_length &&
+           !max_entry_length_.compare_exchange_weak(
+               max_length, length, std::memory_order_relaxed)) {
+    }
+  }
+  entry->status = Entry::STATUS_READY;
+}
+
 std::vector<Function*> EntryTable::FindWithAddress(uint32_t address) {
-  auto global_lock = global_critical_region_.Acquire();
   std::vector<Function*> fns;
-  for (auto& it : map_) {
-    Entry* entry = it.second;
-    if (address >= entry->address && address <= entry->end_address) {
-      if (entry->status == Entry::STATUS_READY) {
-        fns.push_back(entry->function);
+  // Any entry containing the address starts at most max_entry_length_ bytes
+  // before it.
+  address &= ~uint32_t(3);
+  uint32_t max_length = max_entry_length_.load(std::memory_order_relaxed);
+  uint32_t first_address = address > max_length ? address - max_length : 0;
+  uint32_t entry_address = address;
+  while (true) {
+    std::atomic<Entry*>* slot = LookupSlot(entry_address);
+    if (!slot) {
+      // Nothing in this page, skip to the end of the previous one.
+      uint32_t page_start = entry_address & ~((uint32_t(1) << kPageShift) - 1);
+      if (page_start <= first_address || !page_start) {
+        break;
       }
+      entry_address = page_start - 4;
+      continue;
+    }
+    Entry* entry = slot->load(std::memory_order_acquire);
+    if (entry && entry->status == Entry::STATUS_READY &&
+        address <= entry->end_address) {
+      fns.push_back(entry->function);
+    }
+    if (entry_address <= first_address) {
+      break;
     }
+    entry_address -= 4;
   }
   return fns;
 }
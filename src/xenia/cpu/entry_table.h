@@ -10,11 +10,11 @@
 #ifndef XENIA_CPU_ENTRY_TABLE_H_
 #define XENIA_CPU_ENTRY_TABLE_H_
 
-#include <unordered_map>
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <vector>
 
-#include "xenia/base/mutex.h"
-
 namespace xe {
 namespace cpu {
 
@@ -30,10 +30,16 @@ typedef struct Entry_t {
 
   uint32_t address;
   uint32_t end_address;
-  Status status;
+  // Written last when the entry becomes ready, publishing the other fields.
+  std::atomic<Status> status;
   Function* function;
 } Entry;
 
+// Guest address -> entry lookup shared by all guest threads.
+// Entries live in a two-level direct-mapped table: the top level has one slot
+// per 64 KiB guest page, and each page has one slot per instruction. Pages
+// and entries are installed with compare-and-swap and never removed, so
+// lookups don't take any locks.
 class EntryTable {
  public:
   EntryTable();
@@ -41,13 +47,27 @@ class EntryTable {
 
   Entry* Get(uint32_t address);
   Entry::Status GetOrCreate(uint32_t address, Entry** out_entry);
+  // Publishes the function for an entry returned as STATUS_NEW.
+  void MarkReady(Entry* entry, Function* function);
 
   std::vector<Function*> FindWithAddress(uint32_t address);
 
  private:
-  xe::global_critical_region global_critical_region_;
-  // TODO(benvanik): replace with a better data structure.
-  std::unordered_map<uint32_t, Entry*> map_;
+  static constexpr uint32_t kPageShift = 16;
+  static constexpr uint32_t kPageCount = uint32_t(1) << (32 - kPageShift);
+  // Guest instructions are 4 byte aligned.
+  static constexpr uint32_t kSlotsPerPage = uint32_t(1) << (kPageShift - 2);
+
+  struct Page {
+    std::atomic<Entry*> slots[kSlotsPerPage];
+  };
+
+  std::atomic<Entry*>* LookupSlot(uint32_t address) const;
+  std::atomic<Entry*>* GetOrCreateSlot(uint32_t address);
+
+  std::unique_ptr<std::atomic<Page*>[]> pages_;
+  // Longest ready function, bounding how far back FindWithAddress looks.
+  std::atomic<uint32_t> max_entry_length_ = {0};
 };
 
 }  // namespace cpu
@@ -9,7 +9,12 @@
 
 #include "xenia/cpu/export_resolver.h"
 
+#include <algorithm>
+
+#include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/assert.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/math.h"
 #include "xenia/base/string.h"
 
@@ -93,5 +98,61 @@ void ExportResolver::SetFunctionMapping(const std::string_view module_name,
   export_entry->function_data.trampoline = trampoline;
 }
 
+std::vector<std::pair<const std::string*, Export*>>
+ExportResolver::GetCalledFunctions() const {
+  std::vector<std::pair<const std::string*, Export*>> functions;
+  for (const auto& table : tables_) {
+    for (Export* export_entry : table.exports_by_ordinal()) {
+      if (export_entry && export_entry->type == Export::Type::kFunction &&
+          export_entry->function_data.call_count) {
+        functions.emplace_back(&table.module_name(), export_entry);
+      }
+    }
+  }
+  std::sort(functions.begin(), functions.end(),
+            [](const auto& a, const auto& b) {
+              const auto& a_data = a.second->function_data;
+              const auto& b_data = b.second->function_data;
+              if (a_data.call_ticks != b_data.call_ticks) {
+                return a_data.call_ticks > b_data.call_ticks;
+              }
+              return a_data.call_count > b_data.call_count;
+            });
+  return functions;
+}
+
+bool ExportResolver::WriteCallProfile(const std::filesystem::path& path) const {
+  FILE* file = xe::filesystem::OpenFile(path, "w");
+  if (!file) {
+    return false;
+  }
+  double ticks_to_us = 1000000.0 / double(Clock::QueryHostTickFrequency());
+  std::fputs("module,ordinal,name,calls,total_us,average_us\n", file);
+  for (const auto& function : GetCalledFunctions()) {
+    const Export& export_entry = *function.second;
+    uint64_t call_count = export_entry.function_data.call_count;
+    double total_us =
+        double(export_entry.function_data.call_ticks) * ticks_to_us;
+    std::fputs(fmt::format("{},{},{},{},{:.3f},{:.3f}\n", *function.first,
+                           export_entry.ordinal, export_entry.name, call_count,
+                           total_us, total_us / double(call_count))
+                   .c_str(),
+               file);
+  }
+  std::fclose(file);
+  return true;
+}
+
+void ExportResolver::ResetCallProfile() {
+  for (const auto& table : tables_) {
+    for (Export* export_entry : table.exports_by_ordinal()) {
+      if (export_entry && export_entry->type == Export::Type::kFunction) {
+        export_entry->function_data.call_count = 0;
+        export_entry->function_data.call_ticks = 0;
+      }
+    }
+  }
+}
+
 }  // namespace cpu
 }  // namespace xe
@@ -10,7 +10,9 @@
 #ifndef XENIA_CPU_EXPORT_RESOLVER_H_
 #define XENIA_CPU_EXPORT_RESOLVER_H_
 
+#include <filesystem>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "xenia/base/math.h"
@@ -70,6 +72,16 @@ typedef void (*xe_kernel_export_shim_fn)(void*, void*);
 
 typedef void (*ExportTrampoline)(ppc::PPCContext* ppc_context);
 
+// Flags forming the index of a trampoline variant of an export.
+struct ExportTrampolineVariant {
+  // Logs the calls.
+  static const uint32_t kLog = 1u << 0;
+  // Measures the host time spent in the calls.
+  static const uint32_t kProfile = 1u << 1;
+
+  static const uint32_t kCount = 1u << 2;
+};
+
 class Export {
  public:
   enum class Type {
@@ -82,7 +94,7 @@ class Export {
       : ordinal(ordinal),
         type(type),
         tags(tags),
-        function_data({nullptr, nullptr, 0}) {
+        function_data({nullptr, nullptr, {}, 0, 0}) {
     std::strncpy(this->name, name, xe::countof(this->name));
   }
 
@@ -108,7 +120,16 @@ class Export {
       // Trampoline that is called from the guest-to-host thunk.
       // Expects only PPC context as first arg.
       ExportTrampoline trampoline;
+      // Variants of the trampoline, indexed by ExportTrampolineVariant flags.
+      // The one for the current configuration replaces the trampoline when
+      // the kernel module is loaded, so the trampoline doesn't check it.
+      ExportTrampoline trampoline_variants[ExportTrampolineVariant::kCount];
+      // Not synchronized, approximate if the export is called from multiple
+      // threads at once.
       uint64_t call_count;
+      // Host ticks (Clock::QueryHostTickCount) spent in the calls, counted
+      // only by the profiling trampoline variants.
+      uint64_t call_ticks;
     } function_data;
   };
 };
@@ -147,6 +168,15 @@ class ExportResolver {
   Export* GetExportByOrdinal(const std::string_view module_name,
                              uint16_t ordinal);
 
+  // Function exports that have been called, with the name of their module,
+  // sorted by the host time spent in them and then by the call count.
+  std::vector<std::pair<const std::string*, Export*>> GetCalledFunctions()
+      const;
+  // Writes the call counts and the host times of the called function exports
+  // as CSV.
+  bool WriteCallProfile(const std::filesystem::path& path) const;
+  void ResetCallProfile();
+
   void SetVariableMapping(const std::string_view module_name, uint16_t ordinal,
                           uint32_t value);
   void SetFunctionMapping(const std::string_view module_name, uint16_t ordinal,
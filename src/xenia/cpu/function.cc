@@ -9,6 +9,8 @@
 
 #include "xenia/cpu/function.h"
 
+#include <algorithm>
+
 #include "xenia/base/logging.h"
 #include "xenia/cpu/symbol.h"
 #include "xenia/cpu/thread_state.h"
@@ -60,14 +62,60 @@ GuestFunction::GuestFunction(Module* module, uint32_t address)
 
 GuestFunction::~GuestFunction() = default;
 
+FunctionProfileData* GuestFunction::EnsureProfileData() {
+  if (!profile_data_) {
+    profile_data_ = std::make_unique<FunctionProfileData>();
+    if (has_end_address()) {
+      profile_data_->instruction_count = (end_address() - address()) / 4 + 1;
+      profile_data_->block_execute_counts =
+          std::make_unique<uint64_t[]>(profile_data_->instruction_count);
+    }
+  }
+  return profile_data_.get();
+}
+
 void GuestFunction::SetupExtern(ExternHandler handler, Export* export_data) {
   behavior_ = Behavior::kExtern;
   extern_handler_ = handler;
   export_data_ = export_data;
 }
 
+void GuestFunction::IndexSourceMap() {
+  source_map_index_.clear();
+  if (source_map_.empty()) {
+    return;
+  }
+  uint32_t guest_address_min = UINT32_MAX, guest_address_max = 0;
+  for (const SourceMapEntry& entry : source_map_) {
+    guest_address_min = std::min(guest_address_min, entry.guest_address);
+    guest_address_max = std::max(guest_address_max, entry.guest_address);
+  }
+  source_map_index_base_ = guest_address_min & ~uint32_t(3);
+  source_map_index_.resize(
+      ((guest_address_max - source_map_index_base_) >> 2) + 1, 0);
+  for (size_t i = 0; i < source_map_.size(); ++i) {
+    uint32_t& index_entry =
+        source_map_index_[(source_map_[i].guest_address -
+                           source_map_index_base_) >>
+                          2];
+    if (!index_entry) {
+      index_entry = uint32_t(i + 1);
+    }
+  }
+}
+
 const SourceMapEntry* GuestFunction::LookupGuestAddress(
     uint32_t guest_address) const {
+  if (!source_map_index_.empty()) {
+    if (guest_address < source_map_index_base_ || (guest_address & 3)) {
+      return nullptr;
+    }
+    size_t index = (guest_address - source_map_index_base_) >> 2;
+    if (index >= source_map_index_.size() || !source_map_index_[index]) {
+      return nullptr;
+    }
+    return &source_map_[source_map_index_[index] - 1];
+  }
   // TODO(benvanik): binary search? We know the list is sorted by code order.
   for (size_t i = 0; i < source_map_.size(); ++i) {
     const auto& entry = source_map_[i];
@@ -32,6 +32,32 @@ struct SourceMapEntry {
   uint32_t code_offset;    // Offset from emitted code start.
 };
 
+// How much effort was put into generating the machine code of a function.
+enum class TranslationTier : uint32_t {
+  // Full pass pipeline.
+  kOptimized = 0,
+  // Minimal pass pipeline, counting calls to be retranslated once hot.
+  kBaseline,
+  // Baseline code still in use while the optimized code is being generated.
+  kTieringUp,
+  // Full pass pipeline with small leaf callees inlined, for functions found
+  // to be hot by profile guided recompilation.
+  kHot,
+  // Optimized code still in use while the hot code is being generated.
+  kRecompilingHot,
+};
+
+// Execution counts collected by the generated code for profile guided
+// recompilation. Block counts are indexed by the guest instruction the block
+// starts at, so that they stay meaningful across translations.
+struct FunctionProfileData {
+  uint64_t call_count = 0;
+  uint32_t instruction_count = 0;
+  std::unique_ptr<uint64_t[]> block_execute_counts;
+  // Owned by the profiler.
+  uint64_t sampled_call_count = 0;
+};
+
 class Function : public Symbol {
  public:
   enum class Behavior {
@@ -118,10 +144,27 @@ class GuestFunction : public Function {
   FunctionTraceData& trace_data() { return trace_data_; }
   std::vector<SourceMapEntry>& source_map() { return source_map_; }
 
+  TranslationTier translation_tier() const { return translation_tier_; }
+  void set_translation_tier(TranslationTier value) {
+    translation_tier_ = value;
+  }
+  // Calls left until baseline code asks for the function to be optimized.
+  // Decremented directly by the generated code.
+  int32_t* tier_up_countdown() { return &tier_up_countdown_; }
+  // Profile counters, if the function is being profiled. Once created they
+  // are kept for the lifetime of the function, as code referencing them may
+  // still be running after retranslation.
+  FunctionProfileData* profile_data() const { return profile_data_.get(); }
+  FunctionProfileData* EnsureProfileData();
+
   ExternHandler extern_handler() const { return extern_handler_; }
   Export* export_data() const { return export_data_; }
   void SetupExtern(ExternHandler handler, Export* export_data = nullptr);
 
+  // Builds the guest address index of the source map, must be called after
+  // the source map is filled for the machine code being set up.
+  void IndexSourceMap();
+
   const SourceMapEntry* LookupGuestAddress(uint32_t guest_address) const;
   const SourceMapEntry* LookupHIROffset(uint32_t offset) const;
   const SourceMapEntry* LookupMachineCodeOffset(uint32_t offset) const;
@@ -139,6 +182,14 @@ class GuestFunction : public Function {
   std::unique_ptr<FunctionDebugInfo> debug_info_;
   FunctionTraceData trace_data_;
   std::vector<SourceMapEntry> source_map_;
+  // For every guest instruction from source_map_index_base_, 1 + the index of
+  // its first source map entry, or 0 if it has none, for constant-time guest
+  // address lookups, such as when installing breakpoints.
+  uint32_t source_map_index_base_ = 0;
+  std::vector<uint32_t> source_map_index_;
+  TranslationTier translation_tier_ = TranslationTier::kOptimized;
+  int32_t tier_up_countdown_ = 0;
+  std::unique_ptr<FunctionProfileData> profile_data_;
   ExternHandler extern_handler_ = nullptr;
   Export* export_data_ = nullptr;
 };
@@ -0,0 +1,142 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/function_database.h"
+
+#include <cstring>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/mapped_memory.h"
+#include "xenia/base/xxhash.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/module.h"
+
+namespace xe {
+namespace cpu {
+
+// 'XEFD'.
+static const uint32_t kFunctionDatabaseMagic = 0x44464558;
+static const uint32_t kFunctionDatabaseVersion = 1;
+
+std::filesystem::path FunctionDatabase::GetPath(
+    const std::filesystem::path& cache_root, uint64_t module_hash) {
+  return cache_root / "functions" / fmt::format("{:016X}.xfd", module_hash);
+}
+
+std::vector<uint32_t> FunctionDatabase::Load(const std::filesystem::path& path,
+                                             uint64_t module_hash,
+                                             Module* module) {
+  std::vector<uint32_t> addresses;
+  auto mapping = xe::MappedMemory::Open(path, xe::MappedMemory::Mode::kRead);
+  if (!mapping || mapping->size() < sizeof(FileHeader)) {
+    return addresses;
+  }
+  FileHeader header;
+  std::memcpy(&header, mapping->data(), sizeof(header));
+  size_t functions_size = sizeof(StoredFunction) * header.function_count;
+  const uint8_t* functions_data = mapping->data() + sizeof(header);
+  if (header.magic != kFunctionDatabaseMagic ||
+      header.version != kFunctionDatabaseVersion ||
+      header.module_hash != module_hash ||
+      mapping->size() - sizeof(header) < functions_size ||
+      XXH3_64bits(functions_data, functions_size) != header.functions_hash) {
+    XELOGW("Function database {} is stale or corrupted, ignoring it",
+           xe::path_to_utf8(path));
+    return addresses;
+  }
+
+  addresses.reserve(header.function_count);
+  for (uint32_t i = 0; i < header.function_count; ++i) {
+    StoredFunction stored_function;
+    std::memcpy(&stored_function,
+                functions_data + sizeof(StoredFunction) * i,
+                sizeof(stored_function));
+    if (!module->ContainsAddress(stored_function.address) ||
+        stored_function.end_address < stored_function.address ||
+        stored_function.behavior >
+            uint32_t(Function::Behavior::kEpilogReturn)) {
+      continue;
+    }
+    // Functions already declared by the loader (such as the save and restore
+    // helpers) keep what it found.
+    Function* function = nullptr;
+    if (module->DeclareFunction(stored_function.address, &function) ==
+        Symbol::Status::kNew) {
+      function->set_end_address(stored_function.end_address);
+      function->set_behavior(Function::Behavior(stored_function.behavior));
+      function->set_status(Symbol::Status::kDeclared);
+    }
+    addresses.push_back(stored_function.address);
+  }
+  XELOGI("Function database: declared {} functions from {}", addresses.size(),
+         xe::path_to_utf8(path));
+  return addresses;
+}
+
+bool FunctionDatabase::Save(const std::filesystem::path& path,
+                            uint64_t module_hash, Module* module) {
+  std::vector<StoredFunction> stored_functions;
+  module->ForEachFunction([&](Function* function) {
+    // Imports are set up again by the loader.
+    if (!function->is_guest() ||
+        function->behavior() == Function::Behavior::kExtern ||
+        !function->has_end_address() ||
+        function->status() == Symbol::Status::kFailed) {
+      return;
+    }
+    StoredFunction stored_function;
+    stored_function.address = function->address();
+    stored_function.end_address = function->end_address();
+    stored_function.behavior = uint32_t(function->behavior());
+    stored_function.reserved = 0;
+    stored_functions.push_back(stored_function);
+  });
+  if (stored_functions.empty()) {
+    return true;
+  }
+
+  if (!xe::filesystem::CreateParentFolder(path)) {
+    XELOGE("Failed to create the function database directory: {}",
+           xe::path_to_utf8(path.parent_path()));
+    return false;
+  }
+  FILE* file = xe::filesystem::OpenFile(path, "wb");
+  if (!file) {
+    XELOGE("Failed to open the function database for writing: {}",
+           xe::path_to_utf8(path));
+    return false;
+  }
+  FileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = kFunctionDatabaseMagic;
+  header.version = kFunctionDatabaseVersion;
+  header.module_hash = module_hash;
+  header.function_count = uint32_t(stored_functions.size());
+  header.functions_hash =
+      XXH3_64bits(stored_functions.data(),
+                  sizeof(StoredFunction) * stored_functions.size());
+  bool written =
+      fwrite(&header, sizeof(header), 1, file) == 1 &&
+      fwrite(stored_functions.data(), sizeof(StoredFunction),
+             stored_functions.size(), file) == stored_functions.size();
+  fclose(file);
+  if (!written) {
+    XELOGE("Failed to write the function database: {}",
+           xe::path_to_utf8(path));
+    return false;
+  }
+  XELOGI("Function database: stored {} functions to {}",
+         stored_functions.size(), xe::path_to_utf8(path));
+  return true;
+}
+
+}  // namespace cpu
+}  // namespace xe
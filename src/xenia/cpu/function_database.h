@@ -0,0 +1,66 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_FUNCTION_DATABASE_H_
+#define XENIA_CPU_FUNCTION_DATABASE_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace xe {
+namespace cpu {
+
+class Module;
+
+// Boundaries and behaviors of the guest functions found in a module, stored
+// between runs in a file keyed by the module hash. Loading declares all the
+// functions known from earlier runs right after the module is loaded, so they
+// can be translated (or taken from the code storage) ahead of execution
+// instead of being discovered one call at a time.
+class FunctionDatabase {
+ public:
+  static std::filesystem::path GetPath(const std::filesystem::path& cache_root,
+                                       uint64_t module_hash);
+
+  // Declares the stored functions that aren't declared in the module yet.
+  // Returns the addresses of all the stored functions, or an empty vector if
+  // there's no valid database for the module.
+  static std::vector<uint32_t> Load(const std::filesystem::path& path,
+                                    uint64_t module_hash, Module* module);
+
+  // Replaces the database with the guest functions of the module that have
+  // known extents.
+  static bool Save(const std::filesystem::path& path, uint64_t module_hash,
+                   Module* module);
+
+ private:
+  struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t module_hash;
+    uint32_t function_count;
+    uint32_t reserved;
+    // Hash of the function records, to detect truncated writes.
+    uint64_t functions_hash;
+  };
+
+  struct StoredFunction {
+    uint32_t address;
+    uint32_t end_address;
+    // Function::Behavior.
+    uint32_t behavior;
+    uint32_t reserved;
+  };
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_FUNCTION_DATABASE_H_
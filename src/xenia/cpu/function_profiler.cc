@@ -0,0 +1,122 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/function_profiler.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/processor.h"
+
+namespace xe {
+namespace cpu {
+
+FunctionProfiler::FunctionProfiler(Processor* processor)
+    : processor_(processor) {}
+
+FunctionProfiler::~FunctionProfiler() { Shutdown(); }
+
+bool FunctionProfiler::Initialize() {
+  assert_null(thread_);
+  shutdown_event_ = xe::threading::Event::CreateManualResetEvent(false);
+  if (!shutdown_event_) {
+    return false;
+  }
+  xe::threading::Thread::CreationParameters params;
+  params.initial_priority = xe::threading::ThreadPriority::kBelowNormal;
+  thread_ =
+      xe::threading::Thread::Create(params, [this]() { SamplerThreadMain(); });
+  if (!thread_) {
+    XELOGE("Failed to create the function profiler thread");
+    return false;
+  }
+  thread_->set_name("Function Profiler");
+  return true;
+}
+
+void FunctionProfiler::Shutdown() {
+  if (!thread_) {
+    return;
+  }
+  shutdown_event_->Set();
+  xe::threading::Wait(thread_.get(), false);
+  thread_.reset();
+}
+
+void FunctionProfiler::AddFunction(GuestFunction* function) {
+  if (!function->profile_data()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  functions_.push_back(function);
+}
+
+void FunctionProfiler::SamplerThreadMain() {
+  auto interval = std::chrono::milliseconds(
+      std::max(cvars::profile_sample_interval_ms, uint32_t(1)));
+  while (xe::threading::Wait(shutdown_event_.get(), false, interval) ==
+         xe::threading::WaitResult::kTimeout) {
+    Sample();
+  }
+}
+
+void FunctionProfiler::Sample() {
+  SCOPE_profile_cpu_f("cpu");
+
+  // Calls since the last sample, of functions that can still be recompiled.
+  std::vector<std::pair<uint64_t, GuestFunction*>> candidates;
+  uint64_t sampled_call_count = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto function : functions_) {
+      auto profile_data = function->profile_data();
+      // Written by guest threads with lock inc, so this is just a bit stale.
+      uint64_t call_count = profile_data->call_count;
+      uint64_t calls = call_count - profile_data->sampled_call_count;
+      profile_data->sampled_call_count = call_count;
+      sampled_call_count += calls;
+      if (calls >= cvars::profile_hot_call_count &&
+          function->translation_tier() == TranslationTier::kOptimized) {
+        candidates.emplace_back(calls, function);
+      }
+    }
+  }
+  COUNT_profile_set("cpu/profiled_calls_per_sample", sampled_call_count);
+
+  size_t hot_count = std::min(candidates.size(),
+                              size_t(cvars::profile_hot_function_count));
+  std::partial_sort(
+      candidates.begin(), candidates.begin() + hot_count, candidates.end(),
+      [](const auto& a, const auto& b) { return a.first > b.first; });
+  for (size_t i = 0; i < hot_count; ++i) {
+    auto function = candidates[i].second;
+    auto profile_data = function->profile_data();
+    uint32_t hottest_block = 0;
+    for (uint32_t n = 1; n < profile_data->instruction_count; ++n) {
+      if (profile_data->block_execute_counts[n] >
+          profile_data->block_execute_counts[hottest_block]) {
+        hottest_block = n;
+      }
+    }
+    XELOGI("Recompiling hot function {:08X} ({} calls, hottest block {:08X})",
+           function->address(), candidates[i].first,
+           function->address() + hottest_block * 4);
+    processor_->RequestTierUp(function);
+  }
+  hot_function_count_ += hot_count;
+  COUNT_profile_set("cpu/hot_functions", hot_function_count_);
+}
+
+}  // namespace cpu
+}  // namespace xe
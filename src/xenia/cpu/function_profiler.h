@@ -0,0 +1,56 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_FUNCTION_PROFILER_H_
+#define XENIA_CPU_FUNCTION_PROFILER_H_
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace cpu {
+
+class GuestFunction;
+class Processor;
+
+// Looks at the execution counts gathered by profiled functions at a fixed
+// interval and has the functions that were called the most since the last
+// look recompiled at TranslationTier::kHot on the translation worker threads.
+class FunctionProfiler {
+ public:
+  explicit FunctionProfiler(Processor* processor);
+  ~FunctionProfiler();
+
+  bool Initialize();
+  void Shutdown();
+
+  // Starts sampling a function that has just been defined.
+  void AddFunction(GuestFunction* function);
+
+ private:
+  void SamplerThreadMain();
+  void Sample();
+
+  Processor* processor_ = nullptr;
+
+  std::unique_ptr<xe::threading::Thread> thread_;
+  std::unique_ptr<xe::threading::Event> shutdown_event_;
+
+  std::mutex mutex_;
+  std::vector<GuestFunction*> functions_;
+  uint64_t hot_function_count_ = 0;
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_FUNCTION_PROFILER_H_
@@ -0,0 +1,217 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/guest_sampling_profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/mutex.h"
+#include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/stack_walker.h"
+#include "xenia/cpu/thread.h"
+#include "xenia/cpu/thread_debug_info.h"
+
+namespace xe {
+namespace cpu {
+
+static std::string GetSampledFunctionName(const Function* function) {
+  if (!function) {
+    return "[host]";
+  }
+  if (!function->name().empty()) {
+    return function->name();
+  }
+  return fmt::format("sub_{:08X}", function->address());
+}
+
+GuestSamplingProfiler::GuestSamplingProfiler(Processor* processor)
+    : processor_(processor) {}
+
+GuestSamplingProfiler::~GuestSamplingProfiler() { Shutdown(); }
+
+std::filesystem::path GuestSamplingProfiler::GetPath(
+    const std::filesystem::path& cache_root, uint64_t module_hash) {
+  // A file per session, so runs can be compared.
+  auto session_time = std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::system_clock::now().time_since_epoch());
+  return cache_root / "profiles" /
+         fmt::format("{:016X}_{}.folded", module_hash, session_time.count());
+}
+
+bool GuestSamplingProfiler::Initialize(const std::filesystem::path& path) {
+  assert_null(thread_);
+  if (!processor_->stack_walker()) {
+    XELOGW("Guest sampling profiler unavailable without a stack walker");
+    return false;
+  }
+  path_ = path;
+  shutdown_event_ = xe::threading::Event::CreateManualResetEvent(false);
+  if (!shutdown_event_) {
+    return false;
+  }
+  xe::threading::Thread::CreationParameters params;
+  // Samples are only meaningful if they're taken when asked for.
+  params.initial_priority = xe::threading::ThreadPriority::kAboveNormal;
+  thread_ =
+      xe::threading::Thread::Create(params, [this]() { SamplerThreadMain(); });
+  if (!thread_) {
+    XELOGE("Failed to create the guest sampling profiler thread");
+    return false;
+  }
+  thread_->set_name("Guest Sampling Profiler");
+  return true;
+}
+
+void GuestSamplingProfiler::Shutdown() {
+  if (!thread_) {
+    return;
+  }
+  shutdown_event_->Set();
+  xe::threading::Wait(thread_.get(), false);
+  thread_.reset();
+  WriteSamples();
+}
+
+void GuestSamplingProfiler::SamplerThreadMain() {
+  auto interval = std::chrono::milliseconds(
+      std::max(cvars::guest_sampling_interval_ms, uint32_t(1)));
+  while (xe::threading::Wait(shutdown_event_.get(), false, interval) ==
+         xe::threading::WaitResult::kTimeout) {
+    Sample();
+  }
+}
+
+void GuestSamplingProfiler::Sample() {
+  StackWalker* stack_walker = processor_->stack_walker();
+  uint64_t frame_host_pcs[64];
+  StackFrame frames[64];
+  // Threads can't go away (or be suspended by someone else while holding the
+  // lock) while this is held.
+  auto global_lock = global_critical_region::AcquireDirect();
+  for (ThreadDebugInfo* thread_info : processor_->QueryThreadDebugInfos()) {
+    Thread* thread = thread_info->thread;
+    // Waiting threads don't use the CPU.
+    if (!thread || !thread->can_debugger_suspend() ||
+        thread_info->state != ThreadDebugInfo::State::kAlive) {
+      continue;
+    }
+    // Only capture while suspended, resolving takes locks the thread may hold.
+    if (!thread->thread()->Suspend()) {
+      continue;
+    }
+    size_t frame_count = stack_walker->CaptureStackTrace(
+        thread->thread()->native_handle(), frame_host_pcs, 0,
+        xe::countof(frame_host_pcs), nullptr, nullptr);
+    thread->thread()->Resume();
+    if (!frame_count) {
+      continue;
+    }
+    stack_walker->ResolveStack(frame_host_pcs, frames, frame_count);
+
+    std::vector<Function*> stack;
+    uint32_t leaf_guest_pc = 0;
+    Function* leaf_function = nullptr;
+    for (size_t i = frame_count; i-- > 0;) {
+      const StackFrame& frame = frames[i];
+      if (frame.type != StackFrame::Type::kGuest ||
+          !frame.guest_symbol.function) {
+        continue;
+      }
+      stack.push_back(frame.guest_symbol.function);
+      leaf_guest_pc = frame.guest_pc;
+      leaf_function = frame.guest_symbol.function;
+    }
+    if (stack.empty()) {
+      // Not running guest code at all.
+      continue;
+    }
+    if (frames[0].type != StackFrame::Type::kGuest) {
+      stack.push_back(nullptr);
+    }
+    ++stack_counts_[std::move(stack)];
+    if (leaf_guest_pc) {
+      auto& address_count = address_counts_[leaf_guest_pc];
+      address_count.first = leaf_function;
+      ++address_count.second;
+    }
+    ++sample_count_;
+  }
+}
+
+bool GuestSamplingProfiler::WriteSamples() const {
+  if (!sample_count_) {
+    return true;
+  }
+  if (!xe::filesystem::CreateParentFolder(path_)) {
+    XELOGE("Failed to create the guest profile directory: {}",
+           xe::path_to_utf8(path_.parent_path()));
+    return false;
+  }
+
+  FILE* file = xe::filesystem::OpenFile(path_, "wb");
+  if (!file) {
+    XELOGE("Failed to open the guest profile for writing: {}",
+           xe::path_to_utf8(path_));
+    return false;
+  }
+  for (const auto& stack_count : stack_counts_) {
+    std::string line;
+    for (const Function* function : stack_count.first) {
+      if (!line.empty()) {
+        line.push_back(';');
+      }
+      line += GetSampledFunctionName(function);
+    }
+    line += fmt::format(" {}\n", stack_count.second);
+    fwrite(line.data(), 1, line.size(), file);
+  }
+  fclose(file);
+
+  // Most sampled first.
+  std::vector<std::pair<uint64_t, uint32_t>> addresses;
+  addresses.reserve(address_counts_.size());
+  for (const auto& address_count : address_counts_) {
+    addresses.emplace_back(address_count.second.second, address_count.first);
+  }
+  std::sort(addresses.begin(), addresses.end(),
+            [](const auto& a, const auto& b) { return a.first > b.first; });
+  auto addresses_path = path_;
+  addresses_path.replace_extension(".addresses.txt");
+  file = xe::filesystem::OpenFile(addresses_path, "wb");
+  if (!file) {
+    XELOGE("Failed to open the guest profile addresses for writing: {}",
+           xe::path_to_utf8(addresses_path));
+    return false;
+  }
+  for (const auto& address : addresses) {
+    const Function* function = address_counts_.at(address.second).first;
+    std::string line = fmt::format(
+        "{:08X} {} {} {:.2f}%\n", address.second,
+        GetSampledFunctionName(function), address.first,
+        100.0 * double(address.first) / double(sample_count_));
+    fwrite(line.data(), 1, line.size(), file);
+  }
+  fclose(file);
+
+  XELOGI("Guest sampling profiler: wrote {} samples to {}", sample_count_,
+         xe::path_to_utf8(path_));
+  return true;
+}
+
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,68 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_GUEST_SAMPLING_PROFILER_H_
+#define XENIA_CPU_GUEST_SAMPLING_PROFILER_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace cpu {
+
+class Function;
+class Processor;
+
+// Periodically suspends the running guest threads and records where they are
+// in guest code, with the guest call stack found by the stack walker and the
+// guest addresses mapped back through the source maps of the generated code.
+// When shut down, the samples are written as folded stacks (one
+// "outer;...;inner count" line per distinct stack, as read by flame graph
+// tools) and, next to them, a list of the sampled guest instruction addresses.
+class GuestSamplingProfiler {
+ public:
+  explicit GuestSamplingProfiler(Processor* processor);
+  ~GuestSamplingProfiler();
+
+  static std::filesystem::path GetPath(const std::filesystem::path& cache_root,
+                                       uint64_t module_hash);
+
+  bool Initialize(const std::filesystem::path& path);
+  // Stops sampling and writes the samples taken.
+  void Shutdown();
+
+ private:
+  void SamplerThreadMain();
+  void Sample();
+  bool WriteSamples() const;
+
+  Processor* processor_ = nullptr;
+  std::filesystem::path path_;
+
+  std::unique_ptr<xe::threading::Thread> thread_;
+  std::unique_ptr<xe::threading::Event> shutdown_event_;
+
+  // Only accessed by the sampler thread until it exits.
+  // Guest functions of the sampled stacks, outermost first, with a null
+  // function at the end for samples taken in host code called by the guest.
+  std::map<std::vector<Function*>, uint64_t> stack_counts_;
+  std::map<uint32_t, std::pair<Function*, uint64_t>> address_counts_;
+  uint64_t sample_count_ = 0;
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_GUEST_SAMPLING_PROFILER_H_
@@ -45,6 +45,13 @@ class Edge {
 };
 
 class Block {
+ public:
+  enum BlockFlags {
+    // Starts a loop only waiting for memory or the time base to change,
+    // detected by the control flow analysis.
+    SPIN_LOOP_HEADER = (1 << 0),
+  };
+
  public:
   Arena* arena;
 
@@ -62,6 +69,7 @@ class Block {
   Instr* instr_tail;
 
   uint16_t ordinal;
+  uint16_t flags;
 
   void AssertNoCycles();
 };
@@ -387,6 +387,7 @@ void HIRBuilder::InsertLabel(Label* label, Instr* prev_instr) {
 
   Block* new_block = arena_->Alloc<Block>();
   new_block->ordinal = UINT16_MAX;
+  new_block->flags = 0;
   new_block->incoming_values = nullptr;
   new_block->arena = arena_;
   new_block->prev = prev_block;
@@ -632,6 +633,7 @@ void HIRBuilder::MergeAdjacentBlocks(Block* left, Block* right) {
 Block* HIRBuilder::AppendBlock() {
   Block* block = arena_->Alloc<Block>();
   block->ordinal = UINT16_MAX;
+  block->flags = 0;
   block->incoming_values = nullptr;
   block->arena = arena_;
   block->next = NULL;
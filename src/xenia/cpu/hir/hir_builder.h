@@ -28,6 +28,8 @@ namespace hir {
 
 enum FunctionAttributes {
   FUNCTION_ATTRIB_INLINE = (1 << 1),
+  // Contains code of other functions emitted in place of calls to them.
+  FUNCTION_ATTRIB_INLINED_CALLS = (1 << 2),
 };
 
 class HIRBuilder {
@@ -66,6 +68,9 @@ class HIRBuilder {
   void RemoveBlock(Block* block);
   void MergeAdjacentBlocks(Block* left, Block* right);
 
+  // Whether control never falls through past the instruction.
+  bool IsUnconditionalJump(Instr* instr);
+
   // static allocations:
   // Value* AllocStatic(size_t length);
 
@@ -271,7 +276,6 @@ class HIRBuilder {
  private:
   Block* AppendBlock();
   void EndBlock();
-  bool IsUnconditionalJump(Instr* instr);
   Instr* AppendInstr(const OpcodeInfo& opcode, uint16_t flags, Value* dest = 0);
   void CommentBuffer(const char* p);
   Value* CompareXX(const OpcodeInfo& opcode, Value* value1, Value* value2);
@@ -115,6 +115,39 @@ bool MMIOHandler::CheckStore(uint32_t virtual_address, uint32_t value) {
   return false;
 }
 
+bool MMIOHandler::CheckLoadHost(const void* host_address,
+                                uint32_t* out_memory_value) {
+  // Only virtual ranges are supported.
+  if (host_address < virtual_membase_ || host_address >= physical_membase_) {
+    return false;
+  }
+  uint32_t value;
+  if (!CheckLoad(
+          host_to_guest_virtual_(host_to_guest_virtual_context_, host_address),
+          &value)) {
+    return false;
+  }
+  *out_memory_value = xe::byte_swap(value);
+  return true;
+}
+
+bool MMIOHandler::CheckStoreHost(const void* host_address,
+                                 uint32_t memory_value) {
+  if (host_address < virtual_membase_ || host_address >= physical_membase_) {
+    return false;
+  }
+  return CheckStore(
+      host_to_guest_virtual_(host_to_guest_virtual_context_, host_address),
+      xe::byte_swap(memory_value));
+}
+
+void MMIOHandler::SetHandledAccessFaultCallback(
+    HandledAccessFaultCallback callback, void* callback_context) {
+  auto lock = global_critical_region_.Acquire();
+  handled_access_fault_callback_ = callback;
+  handled_access_fault_callback_context_ = callback_context;
+}
+
 bool MMIOHandler::TryDecodeLoadStore(const uint8_t* p,
                                      DecodedLoadStore& decoded_out) {
   std::memset(&decoded_out, 0, sizeof(decoded_out));
@@ -445,12 +478,17 @@ bool MMIOHandler::ExceptionCallback(Exception* ex) {
     }
     // The address is not found within any range, so either a write watch or an
     // actual access violation.
-    if (access_violation_callback_) {
-      return access_violation_callback_(std::move(lock),
-                                        access_violation_callback_context_,
-                                        fault_host_address, is_write);
+    if (!access_violation_callback_ ||
+        !access_violation_callback_(std::move(lock),
+                                    access_violation_callback_context_,
+                                    fault_host_address, is_write)) {
+      return false;
     }
-    return false;
+    if (is_write && handled_access_fault_callback_) {
+      handled_access_fault_callback_(handled_access_fault_callback_context_,
+                                     reinterpret_cast<void*>(ex->pc()), false);
+    }
+    return true;
   }
 
   auto rip = ex->pc();
@@ -564,6 +602,11 @@ bool MMIOHandler::ExceptionCallback(Exception* ex) {
   // Advance RIP to the next instruction so that we resume properly.
   ex->set_resume_pc(rip + decoded_load_store.length);
 
+  if (handled_access_fault_callback_) {
+    handled_access_fault_callback_(handled_access_fault_callback_context_,
+                                   reinterpret_cast<void*>(rip), true);
+  }
+
   return true;
 }
 
@@ -49,6 +49,11 @@ class MMIOHandler {
   typedef bool (*AccessViolationCallback)(
       std::unique_lock<std::recursive_mutex> global_lock_locked_once,
       void* context, void* host_address, bool is_write);
+  // Called after an access violation has been handled, with the address of
+  // the host instruction that caused it - either an access to a range, or a
+  // write to a watched page handled by access_violation_callback.
+  typedef void (*HandledAccessFaultCallback)(void* context, void* host_pc,
+                                             bool is_range_access);
 
   // access_violation_callback is called with global_critical_region locked once
   // on the thread, so if multiple threads trigger an access violation in the
@@ -68,6 +73,17 @@ class MMIOHandler {
 
   bool CheckLoad(uint32_t virtual_address, uint32_t* out_value);
   bool CheckStore(uint32_t virtual_address, uint32_t value);
+  // Same as CheckLoad/CheckStore, but for a host address in the guest memory
+  // mapping and with values in guest memory byte order, as code accessing
+  // the memory directly would see them.
+  bool CheckLoadHost(const void* host_address, uint32_t* out_memory_value);
+  bool CheckStoreHost(const void* host_address, uint32_t memory_value);
+
+  // Lets the code generator learn which of its instructions access ranges or
+  // watched pages, so that they can be made to stop relying on access
+  // violations.
+  void SetHandledAccessFaultCallback(HandledAccessFaultCallback callback,
+                                     void* callback_context);
 
  protected:
   MMIOHandler(uint8_t* virtual_membase, uint8_t* physical_membase,
@@ -91,6 +107,9 @@ class MMIOHandler {
   AccessViolationCallback access_violation_callback_;
   void* access_violation_callback_context_;
 
+  HandledAccessFaultCallback handled_access_fault_callback_ = nullptr;
+  void* handled_access_fault_callback_context_ = nullptr;
+
   static MMIOHandler* global_handler_;
 
   xe::global_critical_region global_critical_region_;
@@ -397,6 +397,15 @@ typedef struct PPCContext_s {
 
   uint8_t vscr_sat;
 
+  // Set by other threads to stop this one at the next safepoint poll in the
+  // generated code. See ThreadState::StopAtSafepoint.
+  volatile uint8_t safepoint_request;
+
+  // Iterations of detected spin loops left until yielding to the host
+  // scheduler, counted down by the generated code. 16-bit to fit in the
+  // padding before thread_id.
+  int16_t spin_loop_countdown;
+
   // uint32_t get_fprf() {
   //   return fpscr.value & 0x000F8000;
   // }
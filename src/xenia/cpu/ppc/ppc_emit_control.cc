@@ -81,6 +81,9 @@ int InstrEmit_branch(PPCHIRBuilder& f, const char* src, uint64_t cia,
           cond = f.IsFalse(cond);
         }
         f.CallTrue(cond, function, call_flags);
+      } else if (lk && (f.EmitInlineExport(function) ||
+                        f.EmitInlineCall(function))) {
+        // Emitted in place, execution just continues after the call.
       } else {
         f.Call(function, call_flags);
       }
@@ -431,7 +434,9 @@ int InstrEmit_sc(PPCHIRBuilder& f, const InstrData& i) {
     return 0;
   }
   if (i.SC.LEV == 2) {
-    f.CallExtern(f.function());
+    if (!f.EmitInlineExport(f.function())) {
+      f.CallExtern(f.function());
+    }
     return 0;
   }
   XEINSTRNOTIMPLEMENTED();
@@ -9,8 +9,11 @@
 
 #include "xenia/cpu/ppc/ppc_frontend.h"
 
+#include <algorithm>
+
 #include "xenia/base/atomic.h"
 #include "xenia/base/logging.h"
+#include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/cpu/ppc/ppc_emit.h"
 #include "xenia/cpu/ppc/ppc_opcode_info.h"
@@ -49,6 +52,11 @@ PPCFrontend::PPCFrontend(Processor* processor) : processor_(processor) {
 PPCFrontend::~PPCFrontend() {
   // Force cleanup now before we deinit.
   translator_pool_.Reset();
+
+  if (cvars::profile_compiler_passes) {
+    compile_log_.LogSummary(
+        size_t(std::max(cvars::profile_compiler_passes_slowest_count, 0)));
+  }
 }
 
 Memory* PPCFrontend::memory() const { return processor_->memory(); }
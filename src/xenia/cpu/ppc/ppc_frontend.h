@@ -13,6 +13,7 @@
 #include <memory>
 
 #include "xenia/base/type_pool.h"
+#include "xenia/cpu/compiler/compile_log.h"
 #include "xenia/cpu/function.h"
 #include "xenia/memory.h"
 
@@ -50,10 +51,13 @@ class PPCFrontend {
   bool DeclareFunction(GuestFunction* function);
   bool DefineFunction(GuestFunction* function, uint32_t debug_info_flags);
 
+  compiler::CompileLog& compile_log() { return compile_log_; }
+
  private:
   Processor* processor_;
   PPCBuiltins builtins_ = {0};
   TypePool<PPCTranslator, PPCFrontend*> translator_pool_;
+  compiler::CompileLog compile_log_;
 };
 
 }  // namespace ppc
@@ -26,6 +26,7 @@
 #include "xenia/cpu/ppc/ppc_decode_data.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
 #include "xenia/cpu/ppc/ppc_opcode_info.h"
+#include "xenia/cpu/ppc/ppc_scanner.h"
 #include "xenia/cpu/processor.h"
 
 DEFINE_bool(
@@ -79,6 +80,7 @@ void PPCHIRBuilder::Reset() {
   instr_offset_list_ = NULL;
   label_list_ = NULL;
   with_debug_info_ = false;
+  inline_leaf_calls_ = false;
   HIRBuilder::Reset();
 }
 
@@ -92,6 +94,8 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
   instr_count_ = (function_->end_address() - function_->address()) / 4 + 1;
 
   with_debug_info_ = (flags & EMIT_DEBUG_COMMENTS) == EMIT_DEBUG_COMMENTS;
+  inline_leaf_calls_ =
+      (flags & EMIT_INLINE_LEAF_CALLS) == EMIT_INLINE_LEAF_CALLS;
   if (with_debug_info_) {
     CommentFormat("{} fn {:08X}-{:08X} {}", function_->module()->name().c_str(),
                   function_->address(), function_->end_address(),
@@ -113,6 +117,19 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
   // Always mark entry with label.
   label_list_[0] = NewLabel();
 
+  // Guest functions replaced with host code, such as recognized C runtime
+  // routines, only call it. Import thunks are externs too, but their code has
+  // been rewritten to make the call with sc 2 and is translated normally.
+  if (function_->behavior() == Function::Behavior::kExtern &&
+      xe::load_and_swap<uint32_t>(memory->TranslateVirtual(start_address_)) !=
+          0x44000042) {
+    MarkLabel(label_list_[0]);
+    SourceOffset(start_address_);
+    CallExtern(function_);
+    Return();
+    return Finalize();
+  }
+
   uint32_t start_address = function_->address();
   uint32_t end_address = function_->end_address();
   for (uint32_t address = start_address, offset = 0; address <= end_address;
@@ -188,6 +205,18 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
     }
   }
 
+  // Functions split into regions by the translator, like ones that continue
+  // into the next function without a branch, go on with a tail call. Calls at
+  // the end are left to trap, as VC++ emits them for functions not returning.
+  uint32_t last_code =
+      xe::load_and_swap<uint32_t>(memory->TranslateVirtual(end_address));
+  if (PPCScanner::MayFallThrough(last_code) && !PPCScanner::IsCall(last_code)) {
+    Function* continuation = LookupFunction(end_address + 4);
+    if (continuation) {
+      Call(continuation, CALL_TAIL);
+    }
+  }
+
   if (false) {
     DumpAllOpcodeCounts();
   }
@@ -253,6 +282,135 @@ Function* PPCHIRBuilder::LookupFunction(uint32_t address) {
   return frontend_->processor()->LookupFunction(address);
 }
 
+bool PPCHIRBuilder::EmitInlineExport(Function* function) {
+  if (!cvars::inline_tls_exports || !function ||
+      function->behavior() != Function::Behavior::kExtern) {
+    return false;
+  }
+  Export* export_data = static_cast<GuestFunction*>(function)->export_data();
+  Processor* processor = frontend_->processor();
+  uint32_t slot_count = processor->guest_tls_slot_count();
+  if (!export_data || !slot_count) {
+    return false;
+  }
+  bool is_set;
+  if (!std::strcmp(export_data->name, "KeTlsGetValue")) {
+    is_set = false;
+  } else if (!std::strcmp(export_data->name, "KeTlsSetValue")) {
+    is_set = true;
+  } else {
+    return false;
+  }
+
+  // Like the host implementation, out of range slots read as 0 and aren't
+  // written.
+  if (with_debug_info_) {
+    CommentFormat("inlined {}", export_data->name);
+  }
+  // Values can't be used across blocks, so everything is loaded again after
+  // the branch when storing.
+  uint32_t slots_offset = processor->guest_tls_slots_offset();
+  auto load_index = [this]() { return Truncate(LoadGPR(3), INT32_TYPE); };
+  auto is_in_range = [this, slot_count](Value* index) {
+    return CompareULT(index, LoadConstantUint32(slot_count));
+  };
+  auto slot_address = [this, slots_offset](Value* index) {
+    Value* tls_address = ByteSwap(Load(LoadGPR(13), INT32_TYPE));
+    Value* address = Add(Add(tls_address, LoadConstantUint32(slots_offset)),
+                         Shl(index, int8_t(2)));
+    return ZeroExtend(address, INT64_TYPE);
+  };
+  Value* index = load_index();
+  Value* in_range = is_in_range(index);
+  if (!is_set) {
+    // Load from slot 0 instead so nothing outside TLS is touched.
+    Value* value = ByteSwap(Load(
+        slot_address(Select(in_range, index, LoadZeroInt32())), INT32_TYPE));
+    StoreGPR(3, ZeroExtend(Select(in_range, value, LoadZeroInt32()),
+                           INT64_TYPE));
+    return true;
+  }
+  Label* skip_label = NewLabel();
+  BranchFalse(in_range, skip_label);
+  Store(slot_address(load_index()),
+        ByteSwap(Truncate(LoadGPR(4), INT32_TYPE)));
+  MarkLabel(skip_label);
+  StoreGPR(3, ZeroExtend(is_in_range(load_index()), INT64_TYPE));
+  return true;
+}
+
+bool PPCHIRBuilder::EmitInlineCall(Function* function) {
+  if (!inline_leaf_calls_ || !function || function == function_ ||
+      function->behavior() == Function::Behavior::kBuiltin ||
+      function->behavior() == Function::Behavior::kExtern) {
+    return false;
+  }
+
+  // Only straight-line code returning with blr is taken, so that nothing in
+  // it can tell it wasn't called: no branches, traps or special registers.
+  // LR has already been set by the caller as the bl would have.
+  // Note that the caller keeps working with this copy of the callee.
+  Memory* memory = frontend_->memory();
+  Processor* processor = frontend_->processor();
+  uint32_t address = function->address();
+  uint32_t instr_count = 0;
+  while (true) {
+    // Breakpoints would never be hit in the copy.
+    if (processor->FindBreakpoint(address + instr_count * 4)) {
+      return false;
+    }
+    uint32_t code = xe::load_and_swap<uint32_t>(
+        memory->TranslateVirtual(address + instr_count * 4));
+    if (code == 0x4E800020) {
+      // blr
+      break;
+    }
+    if (instr_count >= cvars::inline_leaf_instruction_count) {
+      return false;
+    }
+    auto opcode = LookupOpcode(code);
+    if (opcode == PPCOpcode::kInvalid) {
+      return false;
+    }
+    auto& opcode_info = GetOpcodeInfo(opcode);
+    if (opcode_info.group == PPCOpcodeGroup::kB ||
+        opcode_info.group == PPCOpcodeGroup::kC ||
+        opcode_info.type == PPCOpcodeType::kSync || !opcode_info.emit) {
+      return false;
+    }
+    ++instr_count;
+  }
+
+  // No source offsets are marked, so to anything mapping the code back to the
+  // guest, such as exception handling and stack walks, the inlined code is
+  // still at the call.
+  set_attributes(attributes() | FUNCTION_ATTRIB_INLINED_CALLS);
+  if (with_debug_info_) {
+    CommentFormat("inlined fn {:08X}", address);
+  }
+  for (uint32_t n = 0; n < instr_count; ++n) {
+    trace_info_.dest_count = 0;
+    InstrData i;
+    i.address = address + n * 4;
+    i.code =
+        xe::load_and_swap<uint32_t>(memory->TranslateVirtual(i.address));
+    i.opcode = LookupOpcode(i.code);
+    i.opcode_info = &GetOpcodeInfo(i.opcode);
+    if (with_debug_info_) {
+      comment_buffer_.Reset();
+      comment_buffer_.AppendFormat("{:08X} {:08X} ", i.address, i.code);
+      DisasmPPC(i.address, i.code, &comment_buffer_);
+      Comment(comment_buffer_);
+    }
+    if (i.opcode_info->emit(*this, i)) {
+      XELOGE("Unimplemented instr {:08X} {:08X} in inlined function",
+             i.address, i.code);
+      Comment("UNIMPLEMENTED!");
+    }
+  }
+  return true;
+}
+
 Label* PPCHIRBuilder::LookupLabel(uint32_t address) {
   if (address < start_address_) {
     return nullptr;
@@ -37,12 +37,21 @@ class PPCHIRBuilder : public hir::HIRBuilder {
   enum EmitFlags {
     // Emit comment nodes.
     EMIT_DEBUG_COMMENTS = 1 << 0,
+    // Emit the code of small leaf functions in place of calls to them.
+    EMIT_INLINE_LEAF_CALLS = 1 << 1,
   };
   bool Emit(GuestFunction* function, uint32_t flags);
 
   GuestFunction* function() const { return function_; }
   Function* LookupFunction(uint32_t address);
   Label* LookupLabel(uint32_t address);
+  // Emits the body of the called function in place of the call if inlining
+  // is enabled and it's a small leaf function. Returns false if a call must
+  // be emitted instead.
+  bool EmitInlineCall(Function* function);
+  // Emits the kernel export inline if it's one that only accesses guest
+  // memory, such as KeTlsGetValue. Returns false if it must be called.
+  bool EmitInlineExport(Function* function);
 
   Value* LoadLR();
   void StoreLR(Value* value);
@@ -92,6 +101,7 @@ class PPCHIRBuilder : public hir::HIRBuilder {
 
   // Reset each Emit:
   bool with_debug_info_;
+  bool inline_leaf_calls_;
   GuestFunction* function_;
   uint64_t start_address_;
   uint64_t instr_count_;
@@ -64,6 +64,7 @@ bool PPCScanner::Scan(GuestFunction* function, FunctionDebugInfo* debug_info) {
   size_t blocks_found = 0;
   bool in_block = false;
   bool starts_with_mfspr_lr = false;
+  call_targets_.clear();
   while (true) {
     uint32_t code =
         xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
@@ -141,7 +142,10 @@ bool PPCScanner::Scan(GuestFunction* function, FunctionDebugInfo* debug_info) {
       if (d.I.LK()) {
         LOGPPC("bl {:08X} -> {:08X}", address, target);
         // Queue call target if needed.
-        // GetOrInsertFunction(target);
+        if (target != start_address &&
+            function->module()->ContainsAddress(target)) {
+          call_targets_.push_back(target);
+        }
       } else {
         LOGPPC("b {:08X} -> {:08X}", address, target);
 
@@ -292,6 +296,114 @@ bool PPCScanner::Scan(GuestFunction* function, FunctionDebugInfo* debug_info) {
   return true;
 }
 
+uint32_t PPCScanner::SplitRegion(GuestFunction* function,
+                                 uint32_t region_size) {
+  uint32_t start_address = function->address();
+  uint32_t end_address = function->end_address();
+  uint32_t instr_count = (end_address - start_address) / 4 + 1;
+  // Not worth it if the rest would be small.
+  if (!region_size || instr_count <= region_size + region_size / 2) {
+    return 0;
+  }
+  uint32_t last_split = instr_count - region_size / 2;
+
+  // Branches from the rest back into the region become tail calls, which is
+  // fine once but not on every iteration of a loop. For every instruction,
+  // find the lowest branch target in the function from it onwards, so splits
+  // with no loops across them can be preferred.
+  Memory* memory = frontend_->memory();
+  std::vector<uint32_t> lowest_target(instr_count + 1, UINT32_MAX);
+  for (uint32_t i = instr_count; i-- > region_size;) {
+    uint32_t address = start_address + i * 4;
+    PPCDecodeData d;
+    d.address = address;
+    d.code = xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
+    uint32_t target = UINT32_MAX;
+    auto opcode = LookupOpcode(d.code);
+    if (opcode == PPCOpcode::bx && !d.I.LK()) {
+      target = d.I.ADDR();
+    } else if (opcode == PPCOpcode::bcx && !d.B.LK()) {
+      target = d.B.ADDR();
+    }
+    if (target < start_address || target > end_address) {
+      target = UINT32_MAX;
+    }
+    lowest_target[i] = std::min(lowest_target[i + 1], target);
+  }
+
+  // From the best to the worst: after an instruction not falling through with
+  // no loops across, not after a call with no loops across, not after a call.
+  // Calls are avoided because their return would need a new function.
+  uint32_t split_after_jump = 0;
+  uint32_t split_clean = 0;
+  uint32_t split_any = 0;
+  for (uint32_t i = region_size; i <= last_split && !split_after_jump; ++i) {
+    uint32_t address = start_address + i * 4;
+    uint32_t previous_code =
+        xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address - 4));
+    if (IsCall(previous_code)) {
+      continue;
+    }
+    if (!split_any) {
+      split_any = address;
+    }
+    if (lowest_target[i] < address) {
+      continue;
+    }
+    if (!split_clean) {
+      split_clean = address;
+    }
+    if (!MayFallThrough(previous_code)) {
+      split_after_jump = address;
+    }
+  }
+  uint32_t split_address = split_after_jump ? split_after_jump
+                           : split_clean    ? split_clean
+                                            : split_any;
+  if (!split_address) {
+    return 0;
+  }
+  XELOGCPU("Splitting {} instruction function {:08X} at {:08X}", instr_count,
+           start_address, split_address);
+  function->set_end_address(split_address - 4);
+  return split_address;
+}
+
+bool PPCScanner::MayFallThrough(uint32_t code) {
+  PPCDecodeData d;
+  d.address = 0;
+  d.code = code;
+  switch (LookupOpcode(code)) {
+    case PPCOpcode::bx:
+      return d.I.LK();
+    case PPCOpcode::bcx:
+      // BO 1z1zz branches always.
+      return d.B.LK() || (d.B.BO() & 0x14) != 0x14;
+    case PPCOpcode::bclrx:
+    case PPCOpcode::bcctrx:
+      return d.XL.LK() || (d.XL.BO() & 0x14) != 0x14;
+    default:
+      return true;
+  }
+}
+
+bool PPCScanner::IsCall(uint32_t code) {
+  PPCDecodeData d;
+  d.address = 0;
+  d.code = code;
+  switch (LookupOpcode(code)) {
+    case PPCOpcode::bx:
+      return d.I.LK();
+    case PPCOpcode::bcx:
+      return d.B.LK();
+    case PPCOpcode::bclrx:
+    case PPCOpcode::bcctrx:
+      return d.XL.LK();
+    default:
+      return false;
+  }
+}
+
 std::vector<BlockInfo> PPCScanner::FindBlocks(GuestFunction* function) {
   Memory* memory = frontend_->memory();
 
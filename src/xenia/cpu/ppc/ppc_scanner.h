@@ -33,12 +33,28 @@ class PPCScanner {
 
   bool Scan(GuestFunction* function, FunctionDebugInfo* debug_info);
 
+  // Targets of bl instructions within the module found by the last Scan.
+  const std::vector<uint32_t>& call_targets() const { return call_targets_; }
+
   std::vector<BlockInfo> FindBlocks(GuestFunction* function);
 
+  // Shortens a function found by Scan that is longer than region_size
+  // instructions so it ends where the rest can be translated separately, and
+  // returns the address the rest starts at, or 0 if it wasn't split. The
+  // shortened function continues into the rest with a tail call.
+  uint32_t SplitRegion(GuestFunction* function, uint32_t region_size);
+
+  // Whether execution may continue with the instruction after the given one,
+  // including after a call returns.
+  static bool MayFallThrough(uint32_t code);
+  // Whether the instruction is a branch setting LR.
+  static bool IsCall(uint32_t code);
+
  private:
   bool IsRestGprLr(uint32_t address);
 
   PPCFrontend* frontend_ = nullptr;
+  std::vector<uint32_t> call_targets_;
 };
 
 }  // namespace ppc
@@ -9,12 +9,16 @@
 
 #include "xenia/cpu/ppc/ppc_translator.h"
 
+#include <algorithm>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/reset_scope.h"
 #include "xenia/base/string.h"
+#include "xenia/cpu/compiler/compile_log.h"
 #include "xenia/cpu/compiler/compiler_passes.h"
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
@@ -62,6 +66,11 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
   if (validate) sap->AddPass(std::make_unique<passes::ValidationPass>());
   compiler_->AddPass(std::move(sap));
 
+  // Common subexpression elimination, once the constants are folded so
+  // equal expressions look the same.
+  compiler_->AddPass(std::make_unique<passes::ValueNumberingPass>());
+  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+
   if (backend->machine_info()->supports_extended_load_store) {
     // Backend supports the advanced LOAD/STORE instructions.
     // These will save us a lot of HIR opcodes.
@@ -92,6 +101,24 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
 
   // Must come last. The HIR is not really HIR after this.
   compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
+
+  // Baseline tier: only what's required to emit code, plus context promotion
+  // which is cheap and removes most of the context loads and stores.
+  baseline_compiler_.reset(new Compiler(frontend->processor()));
+  baseline_compiler_->AddPass(
+      std::make_unique<passes::ControlFlowAnalysisPass>());
+  baseline_compiler_->AddPass(std::make_unique<passes::ContextPromotionPass>());
+  if (validate) {
+    baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  baseline_compiler_->AddPass(
+      std::make_unique<passes::DeadCodeEliminationPass>());
+  baseline_compiler_->AddPass(std::make_unique<passes::RegisterAllocationPass>(
+      backend->machine_info()));
+  if (validate) {
+    baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  baseline_compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
 }
 
 PPCTranslator::~PPCTranslator() = default;
@@ -100,9 +127,13 @@ bool PPCTranslator::Translate(GuestFunction* function,
                               uint32_t debug_info_flags) {
   SCOPE_profile_cpu_f("cpu");
 
+  bool profile_passes = cvars::profile_compiler_passes;
+  uint64_t start_ticks = profile_passes ? Clock::QueryHostTickCount() : 0;
+
   // Reset() all caching when we leave.
   xe::make_reset_scope(builder_);
   xe::make_reset_scope(compiler_);
+  xe::make_reset_scope(baseline_compiler_);
   xe::make_reset_scope(assembler_);
   xe::make_reset_scope(&string_buffer_);
 
@@ -131,6 +162,12 @@ bool PPCTranslator::Translate(GuestFunction* function,
   if (!scanner_->Scan(function, debug_info.get())) {
     return false;
   }
+  // Very large functions are translated in regions, each one continuing into
+  // the next, so the guest can start running with the first one sooner.
+  if (uint32_t next_region = scanner_->SplitRegion(
+          function, cvars::translation_region_instructions)) {
+    frontend_->processor()->QueueFunctionTranslations({next_region});
+  }
 
   // Setup trace data, if needed.
   if (debug_info_flags & DebugInfoFlags::kDebugInfoTraceFunctions) {
@@ -165,9 +202,20 @@ bool PPCTranslator::Translate(GuestFunction* function,
   if (debug_info) {
     emit_flags |= PPCHIRBuilder::EMIT_DEBUG_COMMENTS;
   }
+  // Inlined code can't be debugged as part of the function it came from.
+  bool is_baseline =
+      function->translation_tier() == TranslationTier::kBaseline;
+  if (function->translation_tier() == TranslationTier::kRecompilingHot ||
+      (cvars::inline_leaf_functions && !is_baseline && !debug_info_flags &&
+       !cvars::debug)) {
+    emit_flags |= PPCHIRBuilder::EMIT_INLINE_LEAF_CALLS;
+  }
+  uint64_t emit_start_ticks =
+      profile_passes ? Clock::QueryHostTickCount() : 0;
   if (!builder_->Emit(function, emit_flags)) {
     return false;
   }
+  uint64_t emit_end_ticks = profile_passes ? Clock::QueryHostTickCount() : 0;
 
   // Stash raw HIR.
   if (debug_info_flags & DebugInfoFlags::kDebugInfoDisasmRawHir) {
@@ -177,9 +225,14 @@ bool PPCTranslator::Translate(GuestFunction* function,
   }
 
   // Compile/optimize/etc.
-  if (!compiler_->Compile(builder_.get())) {
+  Compiler* compiler = is_baseline ? baseline_compiler_.get() : compiler_.get();
+  if (!compiler->Compile(builder_.get())) {
     return false;
   }
+  if (is_baseline) {
+    *function->tier_up_countdown() =
+        int32_t(std::max(cvars::tier_up_call_count, uint32_t(1)));
+  }
 
   // Stash optimized HIR.
   if (debug_info_flags & DebugInfoFlags::kDebugInfoDisasmHir) {
@@ -189,11 +242,36 @@ bool PPCTranslator::Translate(GuestFunction* function,
   }
 
   // Assemble to backend machine code.
+  uint64_t assemble_start_ticks =
+      profile_passes ? Clock::QueryHostTickCount() : 0;
   if (!assembler_->Assemble(function, builder_.get(), debug_info_flags,
                             std::move(debug_info))) {
     return false;
   }
 
+  if (profile_passes) {
+    uint64_t end_ticks = Clock::QueryHostTickCount();
+    uint64_t tick_frequency = Clock::QueryHostTickFrequency();
+    auto ticks_to_us = [tick_frequency](uint64_t ticks) {
+      return ticks * 1000000 / tick_frequency;
+    };
+    compiler::CompileLog::Record record;
+    record.guest_address = function->address();
+    record.name = function->name();
+    record.baseline = is_baseline;
+    record.guest_instrs =
+        (function->end_address() + 4 - function->address()) / 4;
+    record.emit_us = ticks_to_us(emit_end_ticks - emit_start_ticks);
+    record.assemble_us = ticks_to_us(end_ticks - assemble_start_ticks);
+    record.total_us = ticks_to_us(end_ticks - start_ticks);
+    record.code_size = function->machine_code_length();
+    record.passes = compiler->pass_statistics();
+    frontend_->compile_log().Add(std::move(record));
+  }
+
+  // Functions called from here are likely to be needed soon.
+  frontend_->processor()->QueueFunctionTranslations(scanner_->call_targets());
+
   return true;
 }
 
@@ -0,0 +1,563 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/console_app_main.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/literals.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/platform.h"
+#include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/raw_module.h"
+#include "xenia/cpu/thread_state.h"
+
+#if XE_ARCH_AMD64
+#include "xenia/cpu/backend/x64/x64_backend.h"
+#if XE_COMPILER_MSVC
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif  // XE_COMPILER_MSVC
+#endif  // XE_ARCH
+
+DEFINE_transient_string(benchmark_name, "",
+                        "Name of the only kernel to run, or empty to run all.",
+                        "General");
+DEFINE_int32(benchmark_translations, 10,
+             "Number of times to translate each kernel, with a new processor "
+             "every time.",
+             "Other");
+DEFINE_int32(benchmark_iterations, 100,
+             "Number of times to execute each kernel after translating it.",
+             "Other");
+DEFINE_path(benchmark_json_output, "",
+            "Path to write the results to as JSON, to compare the code "
+            "generation quality across commits.",
+            "Other");
+
+namespace xe {
+namespace cpu {
+namespace test {
+
+using xe::cpu::ppc::PPCContext;
+using namespace xe::literals;
+
+const uint32_t CODE_ADDRESS = 0x80000000;
+const uint32_t DATA_ADDRESS = 0x10000000;
+const uint32_t DATA_SIZE = 1_MiB;
+
+// Minimal PPC encoder for the instructions used by the kernels.
+class Assembler {
+ public:
+  size_t NewLabel() {
+    labels_.push_back(SIZE_MAX);
+    return labels_.size() - 1;
+  }
+  void Bind(size_t label) { labels_[label] = code_.size(); }
+
+  void D(uint32_t opcode, uint32_t rt, uint32_t ra, int32_t imm) {
+    code_.push_back((opcode << 26) | (rt << 21) | (ra << 16) |
+                    (uint32_t(imm) & 0xFFFF));
+  }
+  void X(uint32_t rt, uint32_t ra, uint32_t rb, uint32_t xo, bool rc = false) {
+    code_.push_back((31 << 26) | (rt << 21) | (ra << 16) | (rb << 11) |
+                    (xo << 1) | uint32_t(rc));
+  }
+  void VX128(uint32_t base, uint32_t vd, uint32_t va, uint32_t vb) {
+    code_.push_back(base | ((vd & 31) << 21) | ((vd >> 5) << 2) |
+                    ((va & 31) << 16) | (((va >> 5) & 1) << 5) |
+                    ((va >> 6) << 10) | ((vb & 31) << 11) | (vb >> 5));
+  }
+  void VX128_1(uint32_t base, uint32_t vd, uint32_t ra, uint32_t rb) {
+    code_.push_back(base | ((vd & 31) << 21) | ((vd >> 5) << 2) | (ra << 16) |
+                    (rb << 11));
+  }
+
+  void addi(uint32_t rd, uint32_t ra, int32_t imm) { D(14, rd, ra, imm); }
+  void li(uint32_t rd, int32_t imm) { addi(rd, 0, imm); }
+  void mulli(uint32_t rd, uint32_t ra, int32_t imm) { D(7, rd, ra, imm); }
+  void cmpwi(uint32_t crf, uint32_t ra, int32_t imm) {
+    D(11, crf << 2, ra, imm);
+  }
+  void lwzu(uint32_t rd, int32_t d, uint32_t ra) { D(33, rd, ra, d); }
+  void stwu(uint32_t rs, int32_t d, uint32_t ra) { D(37, rs, ra, d); }
+  void add(uint32_t rd, uint32_t ra, uint32_t rb) { X(rd, ra, rb, 266); }
+  void srawi(uint32_t ra, uint32_t rs, uint32_t sh) { X(rs, ra, sh, 824); }
+  void rlwinm_(uint32_t ra, uint32_t rs, uint32_t sh, uint32_t mb,
+               uint32_t me) {
+    code_.push_back((21 << 26) | (rs << 21) | (ra << 16) | (sh << 11) |
+                    (mb << 6) | (me << 1) | 1);
+  }
+  void mtctr(uint32_t rs) { code_.push_back(0x7C0903A6 | (rs << 21)); }
+
+  void lvx128(uint32_t vd, uint32_t ra, uint32_t rb) {
+    VX128_1(0x100000C3, vd, ra, rb);
+  }
+  void stvx128(uint32_t vs, uint32_t ra, uint32_t rb) {
+    VX128_1(0x100001C3, vs, ra, rb);
+  }
+  void vaddfp128(uint32_t vd, uint32_t va, uint32_t vb) {
+    VX128(0x14000010, vd, va, vb);
+  }
+  void vmulfp128(uint32_t vd, uint32_t va, uint32_t vb) {
+    VX128(0x14000090, vd, va, vb);
+  }
+  // vd = va * vb + vd.
+  void vmaddfp128(uint32_t vd, uint32_t va, uint32_t vb) {
+    VX128(0x140000D0, vd, va, vb);
+  }
+  void vmsum4fp128(uint32_t vd, uint32_t va, uint32_t vb) {
+    VX128(0x140001D0, vd, va, vb);
+  }
+
+  void b(size_t label) { Branch(0x48000000, 0x03FFFFFC, label); }
+  void beq(size_t label) { Branch(0x41820000, 0xFFFC, label); }
+  void bne(size_t label) { Branch(0x40820000, 0xFFFC, label); }
+  void bdnz(size_t label) { Branch(0x42000000, 0xFFFC, label); }
+  void blr() { code_.push_back(0x4E800020); }
+
+  std::vector<uint32_t> Finish() {
+    for (const Fixup& fixup : fixups_) {
+      int32_t offset =
+          int32_t(labels_[fixup.label] - fixup.position) * int32_t(4);
+      code_[fixup.position] |= uint32_t(offset) & fixup.mask;
+    }
+    fixups_.clear();
+    return code_;
+  }
+
+ private:
+  struct Fixup {
+    size_t position;
+    size_t label;
+    uint32_t mask;
+  };
+
+  void Branch(uint32_t code, uint32_t mask, size_t label) {
+    fixups_.push_back({code_.size(), label, mask});
+    code_.push_back(code);
+  }
+
+  std::vector<uint32_t> code_;
+  std::vector<size_t> labels_;
+  std::vector<Fixup> fixups_;
+};
+
+struct Kernel {
+  const char* name;
+  // Elements processed by an execution, for the per-element time.
+  uint32_t elements;
+  std::function<void(Assembler& a)> assemble;
+  std::function<void(Memory* memory, PPCContext* ctx)> setup;
+  // Checks the results of an execution, if the kernel is deterministic.
+  std::function<bool(Memory* memory, PPCContext* ctx)> check;
+};
+
+const uint32_t kTransformVectors = 4096;
+const uint32_t kCopyWords = 16384;
+const uint32_t kCollatzIterations = 65536;
+
+uint32_t CollatzReference(uint32_t iterations) {
+  uint32_t sum = 0;
+  int32_t x = 27;
+  for (uint32_t i = 0; i < iterations; ++i) {
+    x = (x & 1) ? x * 3 + 1 : x >> 1;
+    sum += uint32_t(x);
+    if (x == 1) {
+      x = 27;
+    }
+  }
+  return sum;
+}
+
+std::vector<Kernel> CreateKernels() {
+  std::vector<Kernel> kernels;
+
+  // VMX128 4x4 matrix transform of an array of vectors, like vertex
+  // processing: r3 = source, r4 = destination, r5 = count, r6 = matrix.
+  kernels.push_back(
+      {"vmx128_transform", kTransformVectors,
+       [](Assembler& a) {
+         for (uint32_t row = 0; row < 4; ++row) {
+           a.li(7, int32_t(row * 16));
+           a.lvx128(32 + row, 6, 7);
+         }
+         a.mtctr(5);
+         a.li(8, 0);
+         size_t loop = a.NewLabel();
+         a.Bind(loop);
+         a.lvx128(36, 3, 8);
+         a.vmsum4fp128(40, 36, 32);
+         a.vmsum4fp128(41, 36, 33);
+         a.vmsum4fp128(42, 36, 34);
+         a.vmsum4fp128(43, 36, 35);
+         a.vmulfp128(44, 40, 41);
+         a.vaddfp128(45, 42, 43);
+         a.vmaddfp128(45, 44, 36);
+         a.stvx128(45, 4, 8);
+         a.addi(8, 8, 16);
+         a.bdnz(loop);
+         a.blr();
+       },
+       [](Memory* memory, PPCContext* ctx) {
+         uint32_t matrix_address = DATA_ADDRESS;
+         uint32_t source_address = matrix_address + 64;
+         uint32_t destination_address = source_address + kTransformVectors * 16;
+         auto matrix = memory->TranslateVirtual<float*>(matrix_address);
+         for (uint32_t i = 0; i < 16; ++i) {
+           xe::store_and_swap<float>(matrix + i, (i % 5) ? 0.25f : 1.0f);
+         }
+         auto source = memory->TranslateVirtual<float*>(source_address);
+         for (uint32_t i = 0; i < kTransformVectors * 4; ++i) {
+           xe::store_and_swap<float>(source + i, float(i % 17) * 0.125f);
+         }
+         ctx->r[3] = source_address;
+         ctx->r[4] = destination_address;
+         ctx->r[5] = kTransformVectors;
+         ctx->r[6] = matrix_address;
+       },
+       nullptr});
+
+  // Word-by-word copy with update-form loads and stores, as in memcpy.
+  kernels.push_back(
+      {"memcpy_words", kCopyWords,
+       [](Assembler& a) {
+         a.mtctr(5);
+         a.addi(3, 3, -4);
+         a.addi(4, 4, -4);
+         size_t loop = a.NewLabel();
+         a.Bind(loop);
+         a.lwzu(6, 4, 3);
+         a.stwu(6, 4, 4);
+         a.bdnz(loop);
+         a.blr();
+       },
+       [](Memory* memory, PPCContext* ctx) {
+         auto source = memory->TranslateVirtual<uint32_t*>(DATA_ADDRESS);
+         for (uint32_t i = 0; i < kCopyWords; ++i) {
+           source[i] = i * 0x9E3779B9u;
+         }
+         std::memset(source + kCopyWords, 0, kCopyWords * 4);
+         ctx->r[3] = DATA_ADDRESS;
+         ctx->r[4] = DATA_ADDRESS + kCopyWords * 4;
+         ctx->r[5] = kCopyWords;
+       },
+       [](Memory* memory, PPCContext* ctx) {
+         auto source = memory->TranslateVirtual<uint32_t*>(DATA_ADDRESS);
+         return std::memcmp(source, source + kCopyWords, kCopyWords * 4) == 0;
+       }});
+
+  // Data-dependent branches on integer values: sums the Collatz sequence of
+  // 27 over and over. r5 = iterations, result in r3.
+  kernels.push_back(
+      {"branchy_integer", kCollatzIterations,
+       [](Assembler& a) {
+         size_t loop = a.NewLabel();
+         size_t even = a.NewLabel();
+         size_t next = a.NewLabel();
+         size_t skip = a.NewLabel();
+         a.li(3, 0);
+         a.li(6, 27);
+         a.mtctr(5);
+         a.Bind(loop);
+         a.rlwinm_(7, 6, 0, 31, 31);
+         a.beq(even);
+         a.mulli(6, 6, 3);
+         a.addi(6, 6, 1);
+         a.b(next);
+         a.Bind(even);
+         a.srawi(6, 6, 1);
+         a.Bind(next);
+         a.add(3, 3, 6);
+         a.cmpwi(0, 6, 1);
+         a.bne(skip);
+         a.li(6, 27);
+         a.Bind(skip);
+         a.bdnz(loop);
+         a.blr();
+       },
+       [](Memory* memory, PPCContext* ctx) {
+         ctx->r[5] = kCollatzIterations;
+       },
+       [](Memory* memory, PPCContext* ctx) {
+         return uint32_t(ctx->r[3]) == CollatzReference(kCollatzIterations);
+       }});
+
+  return kernels;
+}
+
+uint64_t ReadCycleCounter() {
+#if XE_ARCH_AMD64
+  return __rdtsc();
+#else
+  return Clock::QueryHostTickCount();
+#endif  // XE_ARCH
+}
+
+struct KernelResult {
+  std::string name;
+  uint32_t elements;
+  uint32_t instructions;
+  double translation_us_min;
+  double translation_us_median;
+  double execution_us_min;
+  double execution_us_median;
+  uint64_t execution_cycles_min;
+  uint64_t execution_cycles_median;
+  bool passed;
+};
+
+template <typename T>
+T Median(std::vector<T> values) {
+  if (values.empty()) {
+    return T(0);
+  }
+  std::nth_element(values.begin(), values.begin() + values.size() / 2,
+                   values.end());
+  return values[values.size() / 2];
+}
+
+class BenchmarkRunner {
+ public:
+  BenchmarkRunner() {
+    memory_.reset(new Memory());
+    memory_->Initialize();
+  }
+
+  ~BenchmarkRunner() {
+    thread_state_.reset();
+    processor_.reset();
+    memory_.reset();
+  }
+
+  bool Setup(const std::vector<uint32_t>& code) {
+    thread_state_.reset();
+    processor_.reset();
+    memory_->Reset();
+
+    std::unique_ptr<xe::cpu::backend::Backend> backend;
+#if XE_ARCH_AMD64
+    if (cvars::cpu == "x64" || cvars::cpu == "any") {
+      backend.reset(new xe::cpu::backend::x64::X64Backend());
+    }
+#endif  // XE_ARCH
+    if (!backend) {
+      XELOGE("No CPU backend available");
+      return false;
+    }
+    processor_.reset(new Processor(memory_.get(), nullptr));
+    processor_->Setup(std::move(backend));
+
+    uint32_t code_size = uint32_t(code.size() * sizeof(uint32_t));
+    if (!memory_->LookupHeap(CODE_ADDRESS)
+             ->AllocFixed(CODE_ADDRESS, code_size, 0,
+                          kMemoryAllocationReserve | kMemoryAllocationCommit,
+                          kMemoryProtectRead | kMemoryProtectWrite) ||
+        !memory_->LookupHeap(DATA_ADDRESS)
+             ->AllocFixed(DATA_ADDRESS, DATA_SIZE, 0,
+                          kMemoryAllocationReserve | kMemoryAllocationCommit,
+                          kMemoryProtectRead | kMemoryProtectWrite)) {
+      XELOGE("Failed to allocate the benchmark memory");
+      return false;
+    }
+    auto code_ptr = memory_->TranslateVirtual<uint32_t*>(CODE_ADDRESS);
+    for (size_t i = 0; i < code.size(); ++i) {
+      xe::store_and_swap<uint32_t>(code_ptr + i, code[i]);
+    }
+    auto module = std::make_unique<xe::cpu::RawModule>(processor_.get());
+    module->set_name("benchmark");
+    module->SetAddressRange(CODE_ADDRESS, code_size);
+    processor_->AddModule(std::move(module));
+
+    uint32_t stack_size = 64 * 1024;
+    uint32_t stack_address = CODE_ADDRESS - stack_size;
+    uint32_t pcr_address = stack_address - 0x1000;
+    thread_state_.reset(
+        new ThreadState(processor_.get(), 0x100, stack_address, pcr_address));
+    return true;
+  }
+
+  bool Run(const Kernel& kernel, KernelResult& result_out) {
+    Assembler assembler;
+    kernel.assemble(assembler);
+    std::vector<uint32_t> code = assembler.Finish();
+
+    result_out.name = kernel.name;
+    result_out.elements = kernel.elements;
+    result_out.instructions = uint32_t(code.size());
+    result_out.passed = true;
+
+    double ticks_per_us = double(Clock::QueryHostTickFrequency()) / 1000000.0;
+
+    // Translation, with a new processor every time so nothing is cached.
+    std::vector<double> translation_us;
+    Function* function = nullptr;
+    for (int32_t i = 0; i < std::max(cvars::benchmark_translations, 1); ++i) {
+      if (!Setup(code)) {
+        return false;
+      }
+      uint64_t start = Clock::QueryHostTickCount();
+      function = processor_->ResolveFunction(CODE_ADDRESS);
+      uint64_t end = Clock::QueryHostTickCount();
+      if (!function) {
+        XELOGE("Failed to translate {}", kernel.name);
+        return false;
+      }
+      translation_us.push_back(double(end - start) / ticks_per_us);
+    }
+    result_out.translation_us_min =
+        *std::min_element(translation_us.begin(), translation_us.end());
+    result_out.translation_us_median = Median(translation_us);
+
+    // Execution of the last translation.
+    std::vector<double> execution_us;
+    std::vector<uint64_t> execution_cycles;
+    auto ctx = thread_state_->context();
+    for (int32_t i = 0; i < std::max(cvars::benchmark_iterations, 1); ++i) {
+      kernel.setup(memory_.get(), ctx);
+      ctx->lr = 0xBCBCBCBC;
+      uint64_t start = Clock::QueryHostTickCount();
+      uint64_t start_cycles = ReadCycleCounter();
+      function->Call(thread_state_.get(), uint32_t(ctx->lr));
+      uint64_t end_cycles = ReadCycleCounter();
+      uint64_t end = Clock::QueryHostTickCount();
+      execution_us.push_back(double(end - start) / ticks_per_us);
+      execution_cycles.push_back(end_cycles - start_cycles);
+      if (kernel.check && !kernel.check(memory_.get(), ctx)) {
+        result_out.passed = false;
+      }
+    }
+    result_out.execution_us_min =
+        *std::min_element(execution_us.begin(), execution_us.end());
+    result_out.execution_us_median = Median(execution_us);
+    result_out.execution_cycles_min =
+        *std::min_element(execution_cycles.begin(), execution_cycles.end());
+    result_out.execution_cycles_median = Median(execution_cycles);
+    return true;
+  }
+
+ private:
+  std::unique_ptr<Memory> memory_;
+  std::unique_ptr<Processor> processor_;
+  std::unique_ptr<ThreadState> thread_state_;
+};
+
+std::string FormatResults(const std::vector<KernelResult>& results) {
+  std::string json = "{\n";
+#if XE_ARCH_AMD64
+  json += fmt::format("  \"x64_extension_mask\": {},\n",
+                      cvars::x64_extension_mask);
+#endif  // XE_ARCH_AMD64
+  json += "  \"kernels\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const KernelResult& result = results[i];
+    json += "    {\n";
+    json += fmt::format("      \"name\": \"{}\",\n", result.name);
+    json += fmt::format("      \"instructions\": {},\n", result.instructions);
+    json += fmt::format("      \"elements\": {},\n", result.elements);
+    json += fmt::format("      \"translation_us_min\": {:.3f},\n",
+                        result.translation_us_min);
+    json += fmt::format("      \"translation_us_median\": {:.3f},\n",
+                        result.translation_us_median);
+    json += fmt::format("      \"execution_us_min\": {:.3f},\n",
+                        result.execution_us_min);
+    json += fmt::format("      \"execution_us_median\": {:.3f},\n",
+                        result.execution_us_median);
+    json += fmt::format("      \"execution_cycles_min\": {},\n",
+                        result.execution_cycles_min);
+    json += fmt::format("      \"execution_cycles_median\": {},\n",
+                        result.execution_cycles_median);
+    json += fmt::format("      \"cycles_per_element\": {:.3f},\n",
+                        double(result.execution_cycles_min) /
+                            double(std::max(result.elements, uint32_t(1))));
+    json += fmt::format("      \"passed\": {}\n",
+                        result.passed ? "true" : "false");
+    json += i + 1 < results.size() ? "    },\n" : "    }\n";
+  }
+  json += "  ]\n";
+  json += "}\n";
+  return json;
+}
+
+bool RunBenchmarks(const std::string_view name) {
+#if XE_ARCH_AMD64
+  XELOGI("Instruction feature mask {}.", cvars::x64_extension_mask);
+#endif  // XE_ARCH_AMD64
+
+  BenchmarkRunner runner;
+  std::vector<KernelResult> results;
+  bool all_passed = true;
+  for (const Kernel& kernel : CreateKernels()) {
+    if (!name.empty() && name != kernel.name) {
+      continue;
+    }
+    KernelResult result;
+    if (!runner.Run(kernel, result)) {
+      XELOGE("{}: FAILED TO RUN", kernel.name);
+      all_passed = false;
+      continue;
+    }
+    XELOGI(
+        "{}: {} instructions, translation {:.3f} us (median {:.3f}), "
+        "execution {} cycles (median {}), {:.3f} us, {:.3f} cycles per "
+        "element{}",
+        result.name, result.instructions, result.translation_us_min,
+        result.translation_us_median, result.execution_cycles_min,
+        result.execution_cycles_median, result.execution_us_min,
+        double(result.execution_cycles_min) / double(result.elements),
+        result.passed ? "" : ", WRONG RESULTS");
+    all_passed &= result.passed;
+    results.push_back(std::move(result));
+  }
+  if (results.empty()) {
+    XELOGE("No benchmark kernels run - invalid name?");
+    return false;
+  }
+
+  if (!cvars::benchmark_json_output.empty()) {
+    std::string json = FormatResults(results);
+    xe::filesystem::CreateParentFolder(cvars::benchmark_json_output);
+    FILE* file = xe::filesystem::OpenFile(cvars::benchmark_json_output, "wb");
+    bool written = false;
+    if (file) {
+      written = fwrite(json.data(), 1, json.size(), file) == json.size();
+      fclose(file);
+    }
+    if (!written) {
+      XELOGE("Failed to write the benchmark results to {}",
+             xe::path_to_utf8(cvars::benchmark_json_output));
+      return false;
+    }
+  }
+  return all_passed;
+}
+
+int main(const std::vector<std::string>& args) {
+  return RunBenchmarks(cvars::benchmark_name) ? 0 : 1;
+}
+
+}  // namespace test
+}  // namespace cpu
+}  // namespace xe
+
+XE_DEFINE_CONSOLE_APP("xenia-cpu-ppc-benchmark", xe::cpu::test::main,
+                      "[benchmark name]", "benchmark_name");
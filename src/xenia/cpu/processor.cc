@@ -9,6 +9,8 @@
 
 #include "xenia/cpu/processor.h"
 
+#include <algorithm>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/atomic.h"
 #include "xenia/base/byte_order.h"
@@ -16,21 +18,28 @@
 #include "xenia/base/cvar.h"
 #include "xenia/base/debugging.h"
 #include "xenia/base/exception_handler.h"
+#include "xenia/base/frame_breakdown.h"
 #include "xenia/base/literals.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/threading.h"
+#include "xenia/base/xxhash.h"
+#include "xenia/cpu/backend/code_cache.h"
 #include "xenia/cpu/breakpoint.h"
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/export_resolver.h"
+#include "xenia/cpu/function_database.h"
+#include "xenia/cpu/function_profiler.h"
+#include "xenia/cpu/guest_sampling_profiler.h"
 #include "xenia/cpu/module.h"
 #include "xenia/cpu/ppc/ppc_decode_data.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
 #include "xenia/cpu/stack_walker.h"
 #include "xenia/cpu/thread.h"
 #include "xenia/cpu/thread_state.h"
+#include "xenia/cpu/translation_worker_pool.h"
 #include "xenia/cpu/xex_module.h"
 
 // TODO(benvanik): based on compiler support
@@ -86,6 +95,33 @@ Processor::Processor(xe::Memory* memory, ExportResolver* export_resolver)
     : memory_(memory), export_resolver_(export_resolver) {}
 
 Processor::~Processor() {
+  if ((cvars::learn_mmio_accesses || cvars::learn_write_watched_stores) &&
+      MMIOHandler::global_handler()) {
+    MMIOHandler::global_handler()->SetHandledAccessFaultCallback(nullptr,
+                                                                 nullptr);
+  }
+  if (cvars::invalidate_written_code && memory_) {
+    memory_->SetCodeWriteCallback(nullptr, nullptr);
+  }
+
+  // Names of the sampled functions are looked up when writing the samples.
+  if (guest_sampling_profiler_) {
+    guest_sampling_profiler_->Shutdown();
+    guest_sampling_profiler_.reset();
+  }
+
+  // Stop queueing recompilations before stopping the workers.
+  if (function_profiler_) {
+    function_profiler_->Shutdown();
+    function_profiler_.reset();
+  }
+
+  // Workers may be in the middle of translating code from the modules.
+  if (translation_worker_pool_) {
+    translation_worker_pool_->Shutdown();
+    translation_worker_pool_.reset();
+  }
+
   {
     auto global_lock = global_critical_region_.Acquire();
     modules_.clear();
@@ -130,6 +166,7 @@ bool Processor::Setup(std::unique_ptr<backend::Backend> backend) {
 
   backend_ = std::move(backend);
   frontend_ = std::move(frontend);
+  codegen_options_ = backend_->QueryCodegenOptions();
 
   // Stack walker is used when profiling, debugging, and dumping.
   // Note that creation may fail, in which case we'll have to disable those
@@ -154,6 +191,41 @@ bool Processor::Setup(std::unique_ptr<backend::Backend> backend) {
         ChunkedMappedMemoryWriter::Open(functions_trace_path_, 32_MiB, true);
   }
 
+  // Translation ahead of execution, unless there's no backend code to run.
+  int32_t translation_threads = cvars::translation_threads;
+  if (translation_threads < 0) {
+    translation_threads = int32_t(
+        std::max(xe::threading::logical_processor_count() / 4, uint32_t(1)));
+  }
+  if (translation_threads > 0 && code_cache) {
+    auto translation_worker_pool =
+        std::make_unique<TranslationWorkerPool>(this);
+    if (translation_worker_pool->Initialize(uint32_t(translation_threads))) {
+      translation_worker_pool_ = std::move(translation_worker_pool);
+    }
+  }
+  // The debugger expects code and source maps to stay where they are once a
+  // function is defined.
+  tiered_translation_ =
+      cvars::tiered_translation && translation_worker_pool_ && !cvars::debug;
+  if ((cvars::learn_mmio_accesses || cvars::learn_write_watched_stores) &&
+      translation_worker_pool_ && MMIOHandler::global_handler()) {
+    MMIOHandler::global_handler()->SetHandledAccessFaultCallback(
+        HandledAccessFaultThunk, this);
+  }
+  // Only translated code needs to be invalidated, and breakpoints are
+  // installed in code that must stay where it is.
+  if (cvars::invalidate_written_code && code_cache && !cvars::debug) {
+    memory_->SetCodeWriteCallback(CodeWriteThunk, this);
+  }
+  if (cvars::profile_guided_recompilation && translation_worker_pool_ &&
+      !cvars::debug) {
+    auto function_profiler = std::make_unique<FunctionProfiler>(this);
+    if (function_profiler->Initialize()) {
+      function_profiler_ = std::move(function_profiler);
+    }
+  }
+
   return true;
 }
 
@@ -169,6 +241,151 @@ void Processor::PreLaunch() {
   }
 }
 
+void Processor::InitializeCodeStorage(const std::filesystem::path& cache_root,
+                                      XexModule* module) {
+  if (!backend_ || !module || !module->base_address()) {
+    UnparkModuleTranslations(nullptr, 0);
+    return;
+  }
+  // Identify the module by its headers and the loaded image (after
+  // decompression, decryption and import setup, but before anything ran).
+  const xex2_header* xex_header = module->xex_header();
+  XXH3_state_t hash_state;
+  XXH3_64bits_reset(&hash_state);
+  XXH3_64bits_update(&hash_state, xex_header,
+                     uint32_t(xex_header->header_size));
+  XXH3_64bits_update(&hash_state,
+                     memory_->TranslateVirtual(module->base_address()),
+                     module->image_size());
+  uint64_t module_hash = XXH3_64bits_digest(&hash_state);
+  // The previous executable, if the title has launched another one without
+  // terminating.
+  if (function_database_module_) {
+    FunctionDatabase::Save(function_database_path_,
+                           function_database_module_hash_,
+                           function_database_module_);
+    function_database_module_ = nullptr;
+  }
+  code_storage_module_ = module;
+  code_storage_translation_module_ =
+      UnparkModuleTranslations(module, module_hash);
+  code_storage_module_hash_ = module_hash;
+  code_storage_root_ = cache_root;
+  backend_->InitializeCodeStorage(cache_root, module_hash);
+
+  if (cvars::guest_sampling_profiler) {
+    auto guest_sampling_profiler =
+        std::make_unique<GuestSamplingProfiler>(this);
+    if (guest_sampling_profiler->Initialize(
+            GuestSamplingProfiler::GetPath(cache_root, module_hash))) {
+      guest_sampling_profiler_ = std::move(guest_sampling_profiler);
+    }
+  }
+
+  // Translate the functions executed in earlier runs ahead of time, taking
+  // them from the code storage if they're there.
+  if (cvars::function_database) {
+    function_database_path_ =
+        FunctionDatabase::GetPath(cache_root, module_hash);
+    function_database_module_ = code_storage_translation_module_;
+    function_database_module_hash_ = module_hash;
+    QueueFunctionTranslations(
+        FunctionDatabase::Load(function_database_path_, module_hash,
+                               code_storage_translation_module_));
+  }
+}
+
+void Processor::ShutdownCodeStorage() {
+  if (guest_sampling_profiler_) {
+    guest_sampling_profiler_->Shutdown();
+    guest_sampling_profiler_.reset();
+  }
+  if (function_database_module_) {
+    FunctionDatabase::Save(function_database_path_,
+                           function_database_module_hash_,
+                           function_database_module_);
+    function_database_module_ = nullptr;
+  }
+  if (backend_) {
+    backend_->ShutdownCodeStorage();
+  }
+  code_storage_root_.clear();
+}
+
+void Processor::ApplyCodegenOptionChanges() {
+  if (!backend_) {
+    return;
+  }
+  uint32_t codegen_options = backend_->QueryCodegenOptions();
+  if (codegen_options == codegen_options_) {
+    return;
+  }
+  XELOGI("Code generation options changed from {:08X} to {:08X}, translating "
+         "the guest code again",
+         codegen_options_, codegen_options);
+  codegen_options_ = codegen_options;
+  if (!code_storage_root_.empty()) {
+    backend_->InitializeCodeStorage(code_storage_root_,
+                                    code_storage_module_hash_);
+  }
+  auto global_lock = global_critical_region_.Acquire();
+  for (const auto& module : modules_) {
+    module->ForEachFunction(
+        [this](Function* function) { InvalidateGuestFunction(function); });
+  }
+}
+
+void Processor::ParkModuleTranslations(XexModule* module) {
+  if (!cvars::keep_translations_on_relaunch || !module ||
+      module != code_storage_module_) {
+    return;
+  }
+  auto global_lock = global_critical_region_.Acquire();
+  parked_module_ = code_storage_translation_module_;
+  parked_module_hash_ = code_storage_module_hash_;
+  code_storage_module_ = nullptr;
+  code_storage_translation_module_ = nullptr;
+}
+
+XexModule* Processor::UnparkModuleTranslations(XexModule* module,
+                                               uint64_t module_hash) {
+  auto global_lock = global_critical_region_.Acquire();
+  XexModule* parked_module = parked_module_;
+  if (!parked_module) {
+    return module;
+  }
+  parked_module_ = nullptr;
+  // The parked module is earlier in the module list, so it's the one the code
+  // of the new module is looked up in.
+  bool keep = module && parked_module_hash_ == module_hash &&
+              parked_module->base_address() == module->base_address() &&
+              parked_module->image_size() == module->image_size();
+  uint32_t kept_count = 0;
+  parked_module->ForEachFunction([&](Function* function) {
+    if (!keep) {
+      InvalidateGuestFunction(function);
+      return;
+    }
+    // The watches of the code were removed when the image was released.
+    if (!function->is_guest() ||
+        function->status() != Symbol::Status::kDefined ||
+        !function->has_end_address() ||
+        static_cast<GuestFunction*>(function)->extern_handler()) {
+      return;
+    }
+    memory_->WatchCodeWrites(
+        function->address(),
+        function->end_address() + 4 - function->address());
+    ++kept_count;
+  });
+  if (!keep) {
+    return module;
+  }
+  XELOGI("Keeping {} functions translated before relaunching {}", kept_count,
+         module->name());
+  return parked_module;
+}
+
 bool Processor::AddModule(std::unique_ptr<Module> module) {
   auto global_lock = global_critical_region_.Acquire();
   modules_.push_back(std::move(module));
@@ -241,12 +458,15 @@ Function* Processor::ResolveFunction(uint32_t address) {
       entry->status = Entry::STATUS_FAILED;
       return nullptr;
     }
-    entry->function = function;
-    entry->end_address = function->end_address();
-    status = entry->status = Entry::STATUS_READY;
+    entry_table_.MarkReady(entry, function);
+    status = Entry::STATUS_READY;
   }
   if (status == Entry::STATUS_READY) {
-    // Ready to use.
+    // Ready to use, unless its code was overwritten since it was defined.
+    if (entry->function->status() == Symbol::Status::kDeclared &&
+        !DemandFunction(entry->function)) {
+      return nullptr;
+    }
     return entry->function;
   } else {
     // Failed or bad state.
@@ -301,12 +521,36 @@ bool Processor::DemandFunction(Function* function) {
   auto module = function->module();
   auto symbol_status = module->DefineFunction(function);
   if (symbol_status == Symbol::Status::kNew) {
-    // Symbol is undefined, so define now.
+    // Symbol is undefined, so define now - from the code storage if it was
+    // translated in an earlier run, which has no debug instrumentation.
     assert_true(function->is_guest());
-    if (!frontend_->DefineFunction(static_cast<GuestFunction*>(function),
-                                   debug_info_flags_)) {
-      function->set_status(Symbol::Status::kFailed);
-      return false;
+    auto guest_function = static_cast<GuestFunction*>(function);
+    // Defined again after the guest code was overwritten.
+    bool redefining = guest_function->machine_code() != nullptr;
+    if (debug_info_flags_ ||
+        !backend_->DefineStoredFunction(guest_function)) {
+      // Get the guest going quickly and optimize later if it's worth it.
+      if (tiered_translation_ && !debug_info_flags_) {
+        guest_function->set_translation_tier(TranslationTier::kBaseline);
+      }
+      frame_breakdown::ScopedTimer frame_breakdown_timer(
+          frame_breakdown::Category::kTranslation);
+      if (!frontend_->DefineFunction(guest_function, debug_info_flags_)) {
+        function->set_status(Symbol::Status::kFailed);
+        return false;
+      }
+      functions_translated_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      functions_loaded_from_storage_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (function_profiler_ && !redefining) {
+      function_profiler_->AddFunction(guest_function);
+    }
+    if (!guest_function->extern_handler() && function->has_end_address()) {
+      memory_->WatchCodeWrites(
+          function->address(),
+          function->end_address() + 4 - function->address());
     }
 
     // Before we give the symbol back to the rest, let the debugger know.
@@ -324,6 +568,230 @@ bool Processor::DemandFunction(Function* function) {
   return true;
 }
 
+void Processor::QueueFunctionTranslations(
+    const std::vector<uint32_t>& addresses) {
+  if (translation_worker_pool_) {
+    translation_worker_pool_->QueueFunctions(addresses);
+  }
+}
+
+void Processor::RequestTierUp(GuestFunction* function) {
+  if (translation_worker_pool_) {
+    translation_worker_pool_->QueueTierUp(function);
+  }
+}
+
+bool Processor::RetranslateFunction(GuestFunction* function) {
+  if (function->status() != Symbol::Status::kDefined) {
+    return false;
+  }
+  // The previous code stays in the code cache, as guest threads may still be
+  // running it, but the indirection table and new calls will point to the
+  // new code from now on.
+  bool has_new_learned_accesses;
+  {
+    std::lock_guard<std::mutex> lock(learned_access_mutex_);
+    has_new_learned_accesses =
+        learned_access_retranslations_.erase(function) != 0;
+  }
+  TranslationTier previous_tier = function->translation_tier();
+  TranslationTier new_tier;
+  if (previous_tier == TranslationTier::kBaseline) {
+    function->set_translation_tier(TranslationTier::kTieringUp);
+    new_tier = TranslationTier::kOptimized;
+  } else if (previous_tier == TranslationTier::kOptimized &&
+             has_new_learned_accesses) {
+    function->set_translation_tier(TranslationTier::kTieringUp);
+    new_tier = TranslationTier::kOptimized;
+  } else if (previous_tier == TranslationTier::kHot &&
+             has_new_learned_accesses) {
+    function->set_translation_tier(TranslationTier::kRecompilingHot);
+    new_tier = TranslationTier::kHot;
+  } else if (previous_tier == TranslationTier::kOptimized &&
+             function_profiler_) {
+    function->set_translation_tier(TranslationTier::kRecompilingHot);
+    new_tier = TranslationTier::kHot;
+  } else {
+    return false;
+  }
+  if (!frontend_->DefineFunction(function, debug_info_flags_)) {
+    XELOGW("Failed to retranslate hot function {:08X}, keeping previous code",
+           function->address());
+    function->set_translation_tier(previous_tier);
+    return false;
+  }
+  function->set_translation_tier(new_tier);
+  functions_retranslated_.fetch_add(1, std::memory_order_relaxed);
+  ReclaimRetiredCode();
+  return true;
+}
+
+Processor::TranslationStatistics Processor::QueryTranslationStatistics()
+    const {
+  TranslationStatistics statistics;
+  statistics.functions_translated =
+      functions_translated_.load(std::memory_order_relaxed);
+  statistics.functions_loaded_from_storage =
+      functions_loaded_from_storage_.load(std::memory_order_relaxed);
+  statistics.functions_retranslated =
+      functions_retranslated_.load(std::memory_order_relaxed);
+  statistics.translation_worker_cpu_time =
+      translation_worker_pool_ ? translation_worker_pool_->QueryCpuTime()
+                               : std::chrono::microseconds(0);
+  return statistics;
+}
+
+void Processor::ReclaimRetiredCode() {
+  auto code_cache = backend_->code_cache();
+  // Finding running code needs the stacks of all threads, and the debugger
+  // expects code to stay where it is.
+  if (!code_cache || !stack_walker_ ||
+      !stack_walker_->can_capture_suspended_threads() || cvars::debug ||
+      !cvars::code_cache_reclaim_threshold_mb ||
+      code_cache->retired_code_size() <
+          size_t(cvars::code_cache_reclaim_threshold_mb) * 1024 * 1024) {
+    return;
+  }
+  std::unique_lock<std::mutex> reclaim_lock(code_reclaim_mutex_,
+                                            std::try_to_lock);
+  // Give threads that had loaded the address of retired code before the last
+  // look time to have called it.
+  auto now = std::chrono::steady_clock::now();
+  if (!reclaim_lock.owns_lock() ||
+      now - last_code_reclaim_time_ < std::chrono::seconds(1)) {
+    return;
+  }
+  last_code_reclaim_time_ = now;
+
+  // Stacks are captured with all threads that may run guest code, host ones
+  // included, stopped, and only while the global lock is held, so none of
+  // them are holding it.
+  std::vector<uint64_t> host_pcs;
+  bool stacks_complete = true;
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    uint64_t frame_host_pcs[1024];
+    for (auto& it : thread_debug_infos_) {
+      auto thread_info = it.second.get();
+      if (!thread_info->thread ||
+          thread_info->state == ThreadDebugInfo::State::kZombie ||
+          thread_info->state == ThreadDebugInfo::State::kExited ||
+          (Thread::IsInThread() &&
+           thread_info->thread_id == Thread::GetCurrentThreadId())) {
+        continue;
+      }
+      auto thread = thread_info->thread->thread();
+      if (!thread->Suspend()) {
+        stacks_complete = false;
+        break;
+      }
+      size_t count = stack_walker_->CaptureStackTrace(
+          thread->native_handle(), frame_host_pcs, 0,
+          xe::countof(frame_host_pcs), nullptr, nullptr);
+      thread->Resume();
+      // Frames beyond the captured ones could be in any of the code.
+      if (!count || count == xe::countof(frame_host_pcs)) {
+        stacks_complete = false;
+        break;
+      }
+      host_pcs.insert(host_pcs.end(), frame_host_pcs, frame_host_pcs + count);
+    }
+  }
+  if (stacks_complete) {
+    code_cache->ReclaimRetiredCode(host_pcs);
+  }
+}
+
+bool Processor::IsKnownMmioAccess(uint32_t guest_address) {
+  std::lock_guard<std::mutex> lock(learned_access_mutex_);
+  return mmio_access_addresses_.count(guest_address) != 0;
+}
+
+bool Processor::IsKnownWatchedStore(uint32_t guest_address) {
+  std::lock_guard<std::mutex> lock(learned_access_mutex_);
+  return watched_store_addresses_.count(guest_address) != 0;
+}
+
+void Processor::CodeWriteThunk(void* context, uint32_t virtual_address,
+                               uint32_t length) {
+  reinterpret_cast<Processor*>(context)->OnCodeWritten(virtual_address,
+                                                       length);
+}
+
+void Processor::OnCodeWritten(uint32_t virtual_address, uint32_t length) {
+  auto global_lock = global_critical_region_.Acquire();
+  uint32_t end_address = virtual_address + length;
+  for (const auto& module : modules_) {
+    // The image of the parked module has been released, and whether its
+    // translations are still valid is checked when the next one is loaded.
+    if (module.get() == parked_module_ ||
+        (!module->ContainsAddress(virtual_address) &&
+         !module->ContainsAddress(end_address - 1))) {
+      continue;
+    }
+    module->ForEachFunction([&](Function* function) {
+      // Functions being defined are checked against the code once they are,
+      // when it's watched again.
+      if (!function->is_guest() ||
+          function->status() != Symbol::Status::kDefined ||
+          function->address() >= end_address ||
+          function->end_address() + 4 <= virtual_address) {
+        return;
+      }
+      InvalidateGuestFunction(function);
+    });
+  }
+}
+
+void Processor::InvalidateGuestFunction(Function* function) {
+  if (!function->is_guest() ||
+      function->status() != Symbol::Status::kDefined) {
+    return;
+  }
+  auto guest_function = static_cast<GuestFunction*>(function);
+  if (guest_function->extern_handler()) {
+    return;
+  }
+  // Threads already running the code finish running it.
+  backend_->InvalidateFunction(guest_function);
+  guest_function->set_end_address(0);
+  guest_function->set_translation_tier(TranslationTier::kOptimized);
+  guest_function->set_status(Symbol::Status::kDeclared);
+}
+
+void Processor::HandledAccessFaultThunk(void* context, void* host_pc,
+                                        bool is_range_access) {
+  reinterpret_cast<Processor*>(context)->OnHandledAccessFault(
+      host_pc, is_range_access);
+}
+
+void Processor::OnHandledAccessFault(void* host_pc, bool is_range_access) {
+  if (is_range_access ? !cvars::learn_mmio_accesses
+                      : !cvars::learn_write_watched_stores) {
+    return;
+  }
+  auto code_cache = backend_->code_cache();
+  auto function =
+      code_cache ? code_cache->LookupFunction(uint64_t(host_pc)) : nullptr;
+  if (!function) {
+    return;
+  }
+  uint32_t guest_address =
+      function->MapMachineCodeToGuestAddress(uintptr_t(host_pc));
+  {
+    std::lock_guard<std::mutex> lock(learned_access_mutex_);
+    auto& addresses = is_range_access ? mmio_access_addresses_
+                                      : watched_store_addresses_;
+    if (!guest_address || !addresses.insert(guest_address).second) {
+      return;
+    }
+    learned_access_retranslations_.insert(function);
+  }
+  // Rather than faulting every time, have the code call the range or the
+  // watch callbacks directly.
+  translation_worker_pool_->QueueTierUp(function);
+}
+
 bool Processor::Execute(ThreadState* thread_state, uint32_t address) {
   SCOPE_profile_cpu_f("cpu");
 
@@ -10,9 +10,14 @@
 #ifndef XENIA_CPU_PROCESSOR_H_
 #define XENIA_CPU_PROCESSOR_H_
 
+#include <atomic>
+#include <chrono>
+#include <filesystem>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include "xenia/base/cvar.h"
@@ -37,7 +42,10 @@ namespace cpu {
 constexpr fourcc_t kProcessorSaveSignature = make_fourcc("PROC");
 
 class Breakpoint;
+class FunctionProfiler;
+class GuestSamplingProfiler;
 class StackWalker;
+class TranslationWorkerPool;
 class XexModule;
 
 enum class Irql : uint32_t {
@@ -77,6 +85,29 @@ class Processor {
   // Runs any pre-launch logic once the module and thread have been setup.
   void PreLaunch();
 
+  // Opens the backend's persistent storage of translated code for the given
+  // freshly loaded module, so previously translated functions can be reused.
+  void InitializeCodeStorage(const std::filesystem::path& cache_root,
+                             XexModule* module);
+  void ShutdownCodeStorage();
+  // Called when the module is being unloaded, before its image is released.
+  // If it's the module of the code storage, its translations are kept rather
+  // than invalidated by the release, until the next code storage
+  // initialization, which reuses them if the same image is loaded at the same
+  // address again, as when a title relaunches its executable.
+  void ParkModuleTranslations(XexModule* module);
+  // Hash identifying the module of the last code storage initialization in
+  // the names of its files, or 0 if there's none.
+  uint64_t code_storage_module_hash() const {
+    return code_storage_module_hash_;
+  }
+
+  // Makes the functions already translated with code generation options that
+  // are different from the ones in the current config (such as after loading
+  // a game config) be translated again, and reopens the code storage for the
+  // new options.
+  void ApplyCodegenOptionChanges();
+
   // The current execution state of the emulator.
   ExecutionState execution_state() const { return execution_state_; }
 
@@ -100,6 +131,17 @@ class Processor {
     debug_info_flags_ = debug_info_flags;
   }
 
+  // Layout of the dynamic TLS slots of guest threads, set by the kernel so
+  // that KeTlsGetValue and KeTlsSetValue can be translated inline. The slots
+  // start slots_offset bytes after the TLS data pointer at 0(r13). 0 slots if
+  // the layout isn't known.
+  void set_guest_tls_slots(uint32_t slots_offset, uint32_t slot_count) {
+    guest_tls_slots_offset_ = slots_offset;
+    guest_tls_slot_count_ = slot_count;
+  }
+  uint32_t guest_tls_slots_offset() const { return guest_tls_slots_offset_; }
+  uint32_t guest_tls_slot_count() const { return guest_tls_slot_count_; }
+
   bool AddModule(std::unique_ptr<Module> module);
   Module* GetModule(const std::string_view name);
   std::vector<Module*> GetModules();
@@ -116,6 +158,38 @@ class Processor {
   Function* LookupFunction(Module* module, uint32_t address);
   Function* ResolveFunction(uint32_t address);
 
+  // Queues functions likely to be called soon for translation on the
+  // translation worker threads, if enabled.
+  void QueueFunctionTranslations(const std::vector<uint32_t>& addresses);
+  // Called by baseline tier code once it has been run enough times, and by
+  // the function profiler for hot optimized functions.
+  void RequestTierUp(GuestFunction* function);
+  // Replaces the code of a defined baseline tier function with fully
+  // optimized code, or of an optimized function with hot tier code.
+  bool RetranslateFunction(GuestFunction* function);
+  // Frees the space of code superseded by retranslations that no thread is
+  // in anymore, once there's enough of it.
+  void ReclaimRetiredCode();
+  // Whether newly translated code counts its executions.
+  bool is_profiling_functions() const { return function_profiler_ != nullptr; }
+
+  struct TranslationStatistics {
+    // Guest functions defined by translating them.
+    uint64_t functions_translated;
+    // Guest functions defined from the code storage of an earlier run.
+    uint64_t functions_loaded_from_storage;
+    // Tier-ups and retranslations of defined guest functions.
+    uint64_t functions_retranslated;
+    std::chrono::microseconds translation_worker_cpu_time;
+  };
+  TranslationStatistics QueryTranslationStatistics() const;
+  // Whether the guest load or store instruction at the address has been seen
+  // accessing an MMIO range through an access violation.
+  bool IsKnownMmioAccess(uint32_t guest_address);
+  // Whether the guest store instruction at the address has been seen writing
+  // to a write-watched page of physical memory through an access violation.
+  bool IsKnownWatchedStore(uint32_t guest_address);
+
   bool Execute(ThreadState* thread_state, uint32_t address);
   bool ExecuteRaw(ThreadState* thread_state, uint32_t address);
   uint64_t Execute(ThreadState* thread_state, uint32_t address, uint64_t args[],
@@ -225,6 +299,22 @@ class Processor {
 
   void OnFunctionDefined(Function* function);
 
+  static void HandledAccessFaultThunk(void* context, void* host_pc,
+                                      bool is_range_access);
+  void OnHandledAccessFault(void* host_pc, bool is_range_access);
+  static void CodeWriteThunk(void* context, uint32_t virtual_address,
+                             uint32_t length);
+  // Invalidates the translations of the functions overlapping the range, to
+  // be translated again the next time they're called.
+  void OnCodeWritten(uint32_t virtual_address, uint32_t length);
+  // Makes the defined guest function be translated again the next time it's
+  // called. Must be called with the global lock held.
+  void InvalidateGuestFunction(Function* function);
+  // Reuses the kept translations of the parked module if the module loaded in
+  // its place is the same image, or invalidates them otherwise. Returns the
+  // module owning the translations for the code of the loaded module.
+  XexModule* UnparkModuleTranslations(XexModule* module, uint64_t module_hash);
+
   static bool ExceptionCallbackThunk(Exception* ex, void* data);
   bool ExceptionCallback(Exception* ex);
   void OnStepCompleted(ThreadDebugInfo* thread_info);
@@ -246,12 +336,50 @@ class Processor {
 
   // Which debug features are enabled in generated code.
   uint32_t debug_info_flags_ = 0;
+  uint32_t guest_tls_slots_offset_ = 0;
+  uint32_t guest_tls_slot_count_ = 0;
   // If specified, the file trace data gets written to when running.
   std::filesystem::path functions_trace_path_;
   std::unique_ptr<ChunkedMappedMemoryWriter> functions_trace_file_;
 
   std::unique_ptr<ppc::PPCFrontend> frontend_;
   std::unique_ptr<backend::Backend> backend_;
+  std::unique_ptr<TranslationWorkerPool> translation_worker_pool_;
+  std::atomic<uint64_t> functions_translated_{0};
+  std::atomic<uint64_t> functions_loaded_from_storage_{0};
+  std::atomic<uint64_t> functions_retranslated_{0};
+  // Whether new functions are translated at the baseline tier first.
+  bool tiered_translation_ = false;
+  std::unique_ptr<FunctionProfiler> function_profiler_;
+  std::unique_ptr<GuestSamplingProfiler> guest_sampling_profiler_;
+  std::mutex code_reclaim_mutex_;
+  std::chrono::steady_clock::time_point last_code_reclaim_time_;
+  // Module whose functions are stored for the next run at code storage
+  // shutdown.
+  XexModule* function_database_module_ = nullptr;
+  uint64_t function_database_module_hash_ = 0;
+  uint64_t code_storage_module_hash_ = 0;
+  // Module of the last code storage initialization, and the module owning the
+  // translations of its code - the same one, or an unloaded earlier instance of
+  // the same image whose translations have been kept.
+  XexModule* code_storage_module_ = nullptr;
+  XexModule* code_storage_translation_module_ = nullptr;
+  // Unloaded module whose translations are kept until the next code storage
+  // initialization, and its hash.
+  XexModule* parked_module_ = nullptr;
+  uint64_t parked_module_hash_ = 0;
+  // Empty if the code storage is not open.
+  std::filesystem::path code_storage_root_;
+  // Backend code generation options the current translations were made with.
+  uint32_t codegen_options_ = 0;
+  std::filesystem::path function_database_path_;
+  // Guest instructions that accessed MMIO or wrote to watched pages, and
+  // functions containing them that are to be retranslated so that they check
+  // for MMIO and watches without faulting.
+  std::mutex learned_access_mutex_;
+  std::unordered_set<uint32_t> mmio_access_addresses_;
+  std::unordered_set<uint32_t> watched_store_addresses_;
+  std::unordered_set<GuestFunction*> learned_access_retranslations_;
   ExportResolver* export_resolver_ = nullptr;
 
   EntryTable entry_table_;
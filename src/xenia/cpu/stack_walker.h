@@ -87,6 +87,10 @@ class StackWalker {
                                    HostThreadContext* out_host_context,
                                    uint64_t* out_stack_hash = nullptr) = 0;
 
+  // Whether CaptureStackTrace for a suspended thread works without the host
+  // context being provided.
+  virtual bool can_capture_suspended_threads() const { return true; }
+
   // Resolves symbol information for the given stack frames.
   // Each frame provided must have host_pc set, and all other fields will be
   // populated.
@@ -9,16 +9,234 @@
 
 #include "xenia/cpu/stack_walker.h"
 
-#include "xenia/base/logging.h"
+#include <dlfcn.h>
+#include <pthread.h>
+#include <unwind.h>
+
+#include <cstdint>
+#include <cstring>
+
+#include "third_party/xxhash/xxhash.h"
+#include "xenia/base/platform.h"
+#include "xenia/cpu/backend/code_cache.h"
 
 namespace xe {
 namespace cpu {
 
+// Walks the frames of the generated code using the unwind info of the code
+// cache, which is also registered with the system unwinder, so the current
+// thread can be walked through both the host and the generated code with
+// _Unwind_Backtrace. For other threads, only the generated code frames can be
+// walked precisely, as the host code has no frame pointers necessarily, so the
+// walk continues through the host frames by following rbp only as long as it
+// looks like a frame pointer within the stack of the thread.
+class PosixStackWalker : public StackWalker {
+ public:
+  explicit PosixStackWalker(backend::CodeCache* code_cache)
+      : code_cache_(code_cache) {
+    code_cache_min_ = code_cache_->execute_base_address();
+    code_cache_max_ = code_cache_min_ + code_cache_->total_size();
+  }
+
+  size_t CaptureStackTrace(uint64_t* frame_host_pcs, size_t frame_offset,
+                           size_t frame_count,
+                           uint64_t* out_stack_hash) override {
+    struct BacktraceState {
+      uint64_t* frame_host_pcs;
+      // This function is skipped as well.
+      size_t frames_to_skip;
+      size_t frame_count;
+      size_t captured_count;
+    };
+    BacktraceState state;
+    state.frame_host_pcs = frame_host_pcs;
+    state.frames_to_skip = frame_offset + 1;
+    state.frame_count = frame_count;
+    state.captured_count = 0;
+    _Unwind_Backtrace(
+        [](_Unwind_Context* context, void* state_ptr) -> _Unwind_Reason_Code {
+          auto& state = *static_cast<BacktraceState*>(state_ptr);
+          if (state.frames_to_skip) {
+            --state.frames_to_skip;
+            return _URC_NO_REASON;
+          }
+          if (state.captured_count >= state.frame_count) {
+            return _URC_END_OF_STACK;
+          }
+          uintptr_t ip = _Unwind_GetIP(context);
+          if (!ip) {
+            return _URC_END_OF_STACK;
+          }
+          state.frame_host_pcs[state.captured_count++] = ip;
+          return _URC_NO_REASON;
+        },
+        &state);
+    if (out_stack_hash) {
+      *out_stack_hash = XXH3_64bits(frame_host_pcs,
+                                    sizeof(uint64_t) * state.captured_count);
+    }
+    return state.captured_count;
+  }
+
+  size_t CaptureStackTrace(void* thread_handle, uint64_t* frame_host_pcs,
+                           size_t frame_offset, size_t frame_count,
+                           const HostThreadContext* in_host_context,
+                           HostThreadContext* out_host_context,
+                           uint64_t* out_stack_hash) override {
+    if (out_stack_hash) {
+      *out_stack_hash = 0;
+    }
+    // There's no way to query the context of a suspended thread by its
+    // pthread handle.
+    if (!in_host_context) {
+      return 0;
+    }
+    if (out_host_context) {
+      *out_host_context = *in_host_context;
+    }
+    uint64_t stack_low, stack_high;
+    if (!GetThreadStackRange(thread_handle, stack_low, stack_high)) {
+      return 0;
+    }
+
+    uint64_t pc = in_host_context->rip;
+    uint64_t sp = in_host_context->rsp;
+    uint64_t fp = in_host_context->rbp;
+    // Whether the frame is the innermost one, where the prolog may have not
+    // allocated the stack yet, or a caller in the middle of a call.
+    bool innermost = true;
+    size_t frame_index = 0;
+    while (pc && frame_index < frame_offset + frame_count) {
+      if (frame_index >= frame_offset) {
+        frame_host_pcs[frame_index - frame_offset] = pc;
+      }
+      ++frame_index;
+      uint64_t return_address_address;
+      if (pc >= code_cache_min_ && pc < code_cache_max_) {
+        // Generated code doesn't use rbp, so it's still the frame pointer of
+        // the host caller.
+        auto unwind_info = static_cast<const backend::UnwindTableEntry*>(
+            code_cache_->LookupUnwindInfo(pc));
+        if (!unwind_info) {
+          break;
+        }
+        uint64_t offset = pc - code_cache_min_ - unwind_info->begin_address;
+        return_address_address = sp;
+        if (!innermost ||
+            offset >= unwind_info->prolog_stack_alloc_offset) {
+          return_address_address += unwind_info->stack_size;
+        }
+      } else {
+        // Host code - only usable with a frame pointer.
+        if (fp < sp || fp - sp > kMaxFrameSize || (fp & 7) ||
+            fp + 16 > stack_high) {
+          break;
+        }
+        return_address_address = fp + 8;
+        fp = *reinterpret_cast<const uint64_t*>(fp);
+      }
+      if (return_address_address < stack_low ||
+          return_address_address + 8 > stack_high) {
+        break;
+      }
+      pc = *reinterpret_cast<const uint64_t*>(return_address_address);
+      sp = return_address_address + 8;
+      innermost = false;
+    }
+
+    size_t captured_count =
+        frame_index > frame_offset ? frame_index - frame_offset : 0;
+    if (out_stack_hash) {
+      *out_stack_hash =
+          XXH3_64bits(frame_host_pcs, sizeof(uint64_t) * captured_count);
+    }
+    return captured_count;
+  }
+
+  bool can_capture_suspended_threads() const override { return false; }
+
+  bool ResolveStack(uint64_t* frame_host_pcs, StackFrame* frames,
+                    size_t frame_count) override {
+    for (size_t i = 0; i < frame_count; ++i) {
+      auto& frame = frames[i];
+      std::memset(&frame, 0, sizeof(frame));
+      frame.host_pc = frame_host_pcs[i];
+
+      // If in the generated range, we know it's ours.
+      if (frame.host_pc >= code_cache_min_ && frame.host_pc < code_cache_max_) {
+        // Guest symbol, so we can look it up quickly in the code cache.
+        frame.type = StackFrame::Type::kGuest;
+        auto function = code_cache_->LookupFunction(frame.host_pc);
+        if (function) {
+          frame.guest_symbol.function = function;
+          // Figure out where in guest code we are by looking up the
+          // displacement in x64 from the JIT'ed code start to the PC.
+          if (function->is_guest()) {
+            auto guest_function = static_cast<GuestFunction*>(function);
+            // Adjust the host PC by -1 so that we will go back into whatever
+            // instruction was executing before the capture (like a call).
+            frame.guest_pc =
+                guest_function->MapMachineCodeToGuestAddress(frame.host_pc - 1);
+          }
+        } else {
+          frame.guest_symbol.function = nullptr;
+        }
+      } else {
+        // Host symbol, which means either emulator or system. Only exported
+        // symbols are known to dladdr.
+        frame.type = StackFrame::Type::kHost;
+        Dl_info info;
+        if (dladdr(reinterpret_cast<void*>(frame.host_pc), &info) &&
+            info.dli_sname) {
+          frame.host_symbol.address =
+              reinterpret_cast<uint64_t>(info.dli_saddr);
+          std::strncpy(frame.host_symbol.name, info.dli_sname,
+                       sizeof(frame.host_symbol.name) - 1);
+        }
+      }
+    }
+    return true;
+  }
+
+ private:
+  static bool GetThreadStackRange(void* thread_handle, uint64_t& low_out,
+                                  uint64_t& high_out) {
+    auto thread = reinterpret_cast<pthread_t>(thread_handle);
+#if XE_PLATFORM_MAC
+    high_out = reinterpret_cast<uint64_t>(pthread_get_stackaddr_np(thread));
+    low_out = high_out - pthread_get_stacksize_np(thread);
+    return true;
+#else
+    pthread_attr_t attr;
+    if (pthread_getattr_np(thread, &attr)) {
+      return false;
+    }
+    void* stack_address;
+    size_t stack_size;
+    bool got_stack = !pthread_attr_getstack(&attr, &stack_address, &stack_size);
+    pthread_attr_destroy(&attr);
+    if (!got_stack) {
+      return false;
+    }
+    low_out = reinterpret_cast<uint64_t>(stack_address);
+    high_out = low_out + stack_size;
+    return true;
+#endif  // XE_PLATFORM_MAC
+  }
+
+  // Distance between consecutive frame pointers beyond which the value in rbp
+  // is considered not to be a frame pointer.
+  static constexpr uint64_t kMaxFrameSize = 1024 * 1024;
+
+  backend::CodeCache* code_cache_;
+  uintptr_t code_cache_min_;
+  uintptr_t code_cache_max_;
+};
+
 std::unique_ptr<StackWalker> StackWalker::Create(
     backend::CodeCache* code_cache) {
-  XELOGD("Stack walker unimplemented on posix");
-  return nullptr;
+  return std::make_unique<PosixStackWalker>(code_cache);
 }
 
 }  // namespace cpu
-}  // namespace xe
\ No newline at end of file
+}  // namespace xe
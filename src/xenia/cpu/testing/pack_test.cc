@@ -111,3 +111,62 @@ TEST_CASE("PACK_SHORT_2", "[instr]") {
         REQUIRE(result == vec128i(0, 0, 0, 0x80018001));
       });
 }
+
+TEST_CASE("PACK_8_IN_16_UN_UN_SAT", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3,
+            b.Pack(LoadVR(b, 4), LoadVR(b, 5),
+                   PACK_TYPE_8_IN_16 | PACK_TYPE_IN_UNSIGNED |
+                       PACK_TYPE_OUT_UNSIGNED | PACK_TYPE_OUT_SATURATE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128s(0x0100, 0x00FF, 0x0012, 0xFFFF, 0, 1, 0x8000, 0x7F);
+        ctx->v[5] = vec128s(1, 2, 3, 4, 5, 6, 7, 0x0100);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128b(0xFF, 0xFF, 0x12, 0xFF, 0, 1, 0xFF, 0x7F, 1,
+                                  2, 3, 4, 5, 6, 7, 0xFF));
+      });
+}
+
+TEST_CASE("PACK_8_IN_16_UN_UN", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3,
+            b.Pack(LoadVR(b, 4), LoadVR(b, 5),
+                   PACK_TYPE_8_IN_16 | PACK_TYPE_IN_UNSIGNED |
+                       PACK_TYPE_OUT_UNSIGNED | PACK_TYPE_OUT_UNSATURATE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128s(0x0100, 0x00FF, 0x0012, 0xFFFF, 0, 1, 0x8000, 0x7F);
+        ctx->v[5] = vec128s(1, 2, 3, 4, 5, 6, 7, 0x0100);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128b(0, 0xFF, 0x12, 0xFF, 0, 1, 0, 0x7F, 1, 2, 3,
+                                  4, 5, 6, 7, 0));
+      });
+}
+
+TEST_CASE("PACK_16_IN_32_UN_UN_SAT", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3,
+            b.Pack(LoadVR(b, 4), LoadVR(b, 5),
+                   PACK_TYPE_16_IN_32 | PACK_TYPE_IN_UNSIGNED |
+                       PACK_TYPE_OUT_UNSIGNED | PACK_TYPE_OUT_SATURATE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128i(0x12345, 0x10, 0xFFFFFFFF, 0x2);
+        ctx->v[5] = vec128i(1, 2, 3, 0x10000);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128s(0xFFFF, 0x10, 0xFFFF, 0x2, 1, 2, 3, 0xFFFF));
+      });
+}
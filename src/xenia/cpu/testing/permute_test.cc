@@ -153,3 +153,42 @@ TEST_CASE("PERMUTE_V128_BY_V128", "[instr]") {
                                   20, 19, 18, 17, 16));
       });
 }
+
+TEST_CASE("PERMUTE_V128_BY_INT32", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3,
+            b.Permute(b.Truncate(LoadGPR(b, 6), INT32_TYPE), LoadVR(b, 4),
+                      LoadVR(b, 5), INT32_TYPE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[6] = MakePermuteMask(0, 0, 0, 1, 0, 2, 0, 3);
+        ctx->v[4] = vec128i(0, 1, 2, 3);
+        ctx->v[5] = vec128i(4, 5, 6, 7);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128i(0, 1, 2, 3));
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[6] = MakePermuteMask(1, 3, 1, 2, 1, 1, 1, 0);
+        ctx->v[4] = vec128i(0, 1, 2, 3);
+        ctx->v[5] = vec128i(4, 5, 6, 7);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128i(7, 6, 5, 4));
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[6] = MakePermuteMask(1, 2, 0, 0, 1, 1, 0, 3);
+        ctx->v[4] = vec128i(0, 1, 2, 3);
+        ctx->v[5] = vec128i(4, 5, 6, 7);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128i(6, 0, 5, 3));
+      });
+}
@@ -0,0 +1,74 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+TEST_CASE("SELECT_V128_I8", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3,
+            b.Select(b.Truncate(LoadGPR(b, 6), INT8_TYPE), LoadVR(b, 4),
+                     LoadVR(b, 5)));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[6] = 0;
+        ctx->v[4] = vec128i(0, 1, 2, 3);
+        ctx->v[5] = vec128i(4, 5, 6, 7);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128i(4, 5, 6, 7));
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[6] = 0x80;
+        ctx->v[4] = vec128i(0, 1, 2, 3);
+        ctx->v[5] = vec128i(4, 5, 6, 7);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128i(0, 1, 2, 3));
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        // Only the low byte is the condition.
+        ctx->r[6] = 0x100;
+        ctx->v[4] = vec128i(0, 1, 2, 3);
+        ctx->v[5] = vec128i(4, 5, 6, 7);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128i(4, 5, 6, 7));
+      });
+}
+
+TEST_CASE("SELECT_V128_V128", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.Select(LoadVR(b, 6), LoadVR(b, 4), LoadVR(b, 5)));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[6] = vec128i(0, 0xFFFFFFFF, 0x0000FFFF, 0xF0F0F0F0);
+        ctx->v[4] = vec128i(0x11111111, 0x22222222, 0x33333333, 0x44444444);
+        ctx->v[5] = vec128i(0x55555555, 0x66666666, 0x77777777, 0x88888888);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result ==
+                vec128i(0x11111111, 0x66666666, 0x33337777, 0x84848484));
+      });
+}
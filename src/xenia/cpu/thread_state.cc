@@ -76,5 +76,44 @@ uint32_t ThreadState::GetThreadID() {
   return thread_state_ ? thread_state_->thread_id_ : 0xFFFFFFFF;
 }
 
+void ThreadState::RequestSafepoint() {
+  std::lock_guard<std::mutex> lock(safepoint_mutex_);
+  context_->safepoint_request = 1;
+}
+
+bool ThreadState::WaitForSafepoint(
+    std::chrono::steady_clock::time_point deadline) {
+  std::unique_lock<std::mutex> lock(safepoint_mutex_);
+  if (safepoint_cond_.wait_until(lock, deadline,
+                                 [this]() { return at_safepoint_; })) {
+    return true;
+  }
+  context_->safepoint_request = 0;
+  return false;
+}
+
+bool ThreadState::ReleaseSafepoint() {
+  bool was_at_safepoint;
+  {
+    std::lock_guard<std::mutex> lock(safepoint_mutex_);
+    was_at_safepoint = at_safepoint_;
+    context_->safepoint_request = 0;
+  }
+  safepoint_cond_.notify_all();
+  return was_at_safepoint;
+}
+
+void ThreadState::EnterSafepoint() {
+  std::unique_lock<std::mutex> lock(safepoint_mutex_);
+  // The request may have been withdrawn after the poll saw it.
+  if (!context_->safepoint_request) {
+    return;
+  }
+  at_safepoint_ = true;
+  safepoint_cond_.notify_all();
+  safepoint_cond_.wait(lock, [this]() { return !context_->safepoint_request; });
+  at_safepoint_ = false;
+}
+
 }  // namespace cpu
 }  // namespace xe
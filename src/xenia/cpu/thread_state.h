@@ -10,6 +10,9 @@
 #ifndef XENIA_CPU_THREAD_STATE_H_
 #define XENIA_CPU_THREAD_STATE_H_
 
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <string>
 
 #include "xenia/cpu/ppc/ppc_context.h"
@@ -37,6 +40,20 @@ class ThreadState {
   static ThreadState* Get();
   static uint32_t GetThreadID();
 
+  // Cooperative stopping of the thread by other threads, much faster than
+  // suspending it through the OS. Generated code polls for a request at loop
+  // back edges (with the flag in the context so it's a single compare) and
+  // waits there until released.
+  void RequestSafepoint();
+  // Waits for the thread to stop after RequestSafepoint. Returns false and
+  // withdraws the request if it doesn't by the deadline, for instance because
+  // it's waiting in the kernel.
+  bool WaitForSafepoint(std::chrono::steady_clock::time_point deadline);
+  // Lets the thread continue. Returns false if it wasn't stopped.
+  bool ReleaseSafepoint();
+  // Called on the thread itself once it has seen a request.
+  void EnterSafepoint();
+
  private:
   Processor* processor_;
   Memory* memory_;
@@ -47,6 +64,10 @@ class ThreadState {
 
   // NOTE: must be 64b aligned for SSE ops.
   ppc::PPCContext* context_;
+
+  std::mutex safepoint_mutex_;
+  std::condition_variable safepoint_cond_;
+  bool at_safepoint_ = false;
 };
 
 }  // namespace cpu
@@ -0,0 +1,157 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/translation_worker_pool.h"
+
+#include <utility>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/logging.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/processor.h"
+
+namespace xe {
+namespace cpu {
+
+TranslationWorkerPool::TranslationWorkerPool(Processor* processor)
+    : processor_(processor) {}
+
+TranslationWorkerPool::~TranslationWorkerPool() { Shutdown(); }
+
+bool TranslationWorkerPool::Initialize(uint32_t thread_count) {
+  assert_true(threads_.empty());
+  shutting_down_ = false;
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    xe::threading::Thread::CreationParameters params;
+    // Translation is important, but must not steal time from the guest.
+    params.initial_priority = xe::threading::ThreadPriority::kBelowNormal;
+    auto thread = xe::threading::Thread::Create(
+        params, [this]() { WorkerThreadMain(); });
+    if (!thread) {
+      XELOGE("Failed to create translation worker thread {}", i);
+      break;
+    }
+    thread->set_name(fmt::format("Translation Worker {}", i));
+    threads_.push_back(std::move(thread));
+  }
+  if (threads_.empty()) {
+    return false;
+  }
+  XELOGI("Translating functions ahead of execution on {} threads",
+         threads_.size());
+  return true;
+}
+
+std::chrono::microseconds TranslationWorkerPool::QueryCpuTime() const {
+  std::chrono::microseconds cpu_time(0);
+  for (const auto& thread : threads_) {
+    cpu_time += thread->QueryCpuTime();
+  }
+  return cpu_time;
+}
+
+void TranslationWorkerPool::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutting_down_ = true;
+    tier_up_queue_.clear();
+    function_queue_.clear();
+  }
+  work_cond_.notify_all();
+  for (auto& thread : threads_) {
+    xe::threading::Wait(thread.get(), false);
+  }
+  threads_.clear();
+}
+
+void TranslationWorkerPool::QueueFunction(uint32_t address) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (shutting_down_ || !queued_addresses_.insert(address).second) {
+      return;
+    }
+    function_queue_.push_back(address);
+  }
+  work_cond_.notify_one();
+}
+
+void TranslationWorkerPool::QueueFunctions(
+    const std::vector<uint32_t>& addresses) {
+  if (addresses.empty()) {
+    return;
+  }
+  size_t queued_count = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (shutting_down_) {
+      return;
+    }
+    for (uint32_t address : addresses) {
+      if (queued_addresses_.insert(address).second) {
+        function_queue_.push_back(address);
+        ++queued_count;
+      }
+    }
+  }
+  if (queued_count == 1) {
+    work_cond_.notify_one();
+  } else if (queued_count) {
+    work_cond_.notify_all();
+  }
+}
+
+void TranslationWorkerPool::QueueTierUp(GuestFunction* function) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (shutting_down_ || !queued_tier_up_functions_.insert(function).second) {
+      return;
+    }
+    tier_up_queue_.push_back(function);
+  }
+  work_cond_.notify_one();
+}
+
+void TranslationWorkerPool::WorkerThreadMain() {
+  while (true) {
+    GuestFunction* tier_up_function = nullptr;
+    uint32_t address = 0;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_cond_.wait(lock, [this]() {
+        return shutting_down_ || !tier_up_queue_.empty() ||
+               !function_queue_.empty();
+      });
+      if (shutting_down_) {
+        return;
+      }
+      if (!tier_up_queue_.empty()) {
+        tier_up_function = tier_up_queue_.front();
+        tier_up_queue_.pop_front();
+        // May be queued again to go up another tier.
+        queued_tier_up_functions_.erase(tier_up_function);
+      } else {
+        address = function_queue_.front();
+        function_queue_.pop_front();
+      }
+    }
+
+    if (tier_up_function) {
+      processor_->RetranslateFunction(tier_up_function);
+    } else {
+      // Goes through the entry table, so if a guest thread needs the function
+      // while it's being translated here it will wait for it rather than
+      // translating it again.
+      processor_->ResolveFunction(address);
+    }
+  }
+}
+
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,80 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_TRANSLATION_WORKER_POOL_H_
+#define XENIA_CPU_TRANSLATION_WORKER_POOL_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace cpu {
+
+class GuestFunction;
+class Processor;
+
+// Host threads translating guest functions off the guest threads.
+// Two kinds of work are queued:
+// - Call targets found while scanning translated functions, resolved through
+//   the regular Processor::ResolveFunction path so that by the time the guest
+//   gets to them they are usually ready.
+// - Baseline tier functions that turned out to be hot, retranslated with the
+//   full pass pipeline and swapped in through the indirection table, and
+//   optimized functions picked by the function profiler for the hot tier.
+// Retranslations go first as they are what the guest is currently spending
+// its time in.
+class TranslationWorkerPool {
+ public:
+  explicit TranslationWorkerPool(Processor* processor);
+  ~TranslationWorkerPool();
+
+  bool Initialize(uint32_t thread_count);
+  void Shutdown();
+
+  // Queues ahead-of-time translation of the function at the address. Each
+  // address is queued at most once.
+  void QueueFunction(uint32_t address);
+  void QueueFunctions(const std::vector<uint32_t>& addresses);
+
+  // Queues retranslation of a function at the next tier up. A function is
+  // only queued once at a time.
+  void QueueTierUp(GuestFunction* function);
+
+  // Total CPU time of the worker threads. Must not be called concurrently
+  // with Initialize or Shutdown.
+  std::chrono::microseconds QueryCpuTime() const;
+
+ private:
+  void WorkerThreadMain();
+
+  Processor* processor_ = nullptr;
+
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable work_cond_;
+  bool shutting_down_ = false;
+  std::deque<GuestFunction*> tier_up_queue_;
+  std::deque<uint32_t> function_queue_;
+  std::unordered_set<uint32_t> queued_addresses_;
+  std::unordered_set<GuestFunction*> queued_tier_up_functions_;
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_TRANSLATION_WORKER_POOL_H_
@@ -10,17 +10,31 @@
 #include "xenia/cpu/xex_module.h"
 
 #include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <vector>
 
 #include "third_party/fmt/include/fmt/format.h"
 
 #include "xenia/base/byte_order.h"
+#include "xenia/base/crypto.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/mapped_memory.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
+#include "xenia/base/startup_timeline.h"
+#include "xenia/base/threading.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/crt_routines.h"
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/lzx.h"
 #include "xenia/cpu/processor.h"
+#include "xenia/emulator.h"
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/kernel/xmodule.h"
 
@@ -36,17 +50,106 @@ static const uint8_t xe_xex2_devkit_key[16] = {
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
-void aes_decrypt_buffer(const uint8_t* session_key, const uint8_t* input_buffer,
-                        const size_t input_size, uint8_t* output_buffer,
-                        const size_t output_size) {
+namespace xe {
+namespace cpu {
+namespace {
+
+uint32_t GetXexLoadThreadCount() {
+  if (cvars::xex_load_threads >= 0) {
+    return std::max(uint32_t(cvars::xex_load_threads), uint32_t(1));
+  }
+  return std::max(xe::threading::logical_processor_count(), uint32_t(1));
+}
+
+// Calls the function for every index on up to xex_load_threads threads,
+// including the calling one, for parts of loading that are independent of
+// each other, like decrypting or hashing separate blocks of the image.
+void ParallelForEachXexChunk(size_t count,
+                             const std::function<void(size_t index)>& fn) {
+  uint32_t thread_count =
+      uint32_t(std::min(size_t(GetXexLoadThreadCount()), count));
+  if (thread_count <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      fn(i);
+    }
+    return;
+  }
+  std::atomic<size_t> next_index(0);
+  auto work = [&]() {
+    size_t i;
+    while ((i = next_index.fetch_add(1, std::memory_order_relaxed)) < count) {
+      fn(i);
+    }
+  };
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads;
+  for (uint32_t i = 1; i < thread_count; ++i) {
+    auto thread = xe::threading::Thread::Create({}, [&work]() { work(); });
+    if (!thread) {
+      break;
+    }
+    thread->set_name("XEX Load Worker");
+    threads.push_back(std::move(thread));
+  }
+  work();
+  for (auto& thread : threads) {
+    xe::threading::Wait(thread.get(), false);
+  }
+}
+
+// 'XEXI'.
+const uint32_t kImageCacheMagic = 0x49584558;
+const uint32_t kImageCacheVersion = 1;
+
+struct ImageCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t xex_hash;
+  uint64_t image_hash;
+  uint32_t image_size;
+  uint32_t is_dev_kit;
+};
+
+}  // namespace
+}  // namespace cpu
+}  // namespace xe
+
+// AES-128 decryption key schedule for the AES instructions of the host, or for
+// the portable implementation if it doesn't have them.
+struct AesDecryptionKey {
+  explicit AesDecryptionKey(const uint8_t* key)
+      : use_aes_instructions(xe::crypto::HasAesInstructions()) {
+    if (use_aes_instructions) {
+      uint8_t encryption_round_keys[xe::crypto::kAes128RoundKeysSize];
+      xe::crypto::Aes128ExpandKey(key, encryption_round_keys);
+      xe::crypto::Aes128InvertRoundKeys(encryption_round_keys, round_keys);
+    } else {
+      Nr = rijndaelKeySetupDec(rk, key, 128);
+    }
+  }
+
+  bool use_aes_instructions;
+  uint8_t round_keys[xe::crypto::kAes128RoundKeysSize];
   uint32_t rk[4 * (MAXNR + 1)];
+  int32_t Nr = 0;
+};
+
+// Decrypts AES-128 CBC data following the ciphertext block prev_ct, or at the
+// beginning of the stream if it's null.
+void aes_decrypt_cbc(const AesDecryptionKey& key, const uint8_t* ct,
+                     uint8_t* pt, const size_t size, const uint8_t* prev_ct) {
   uint8_t ivec[16] = {0};
-  int32_t Nr = rijndaelKeySetupDec(rk, session_key, 128);
-  const uint8_t* ct = input_buffer;
-  uint8_t* pt = output_buffer;
-  for (size_t n = 0; n < input_size; n += 16, ct += 16, pt += 16) {
+  if (prev_ct) {
+    std::memcpy(ivec, prev_ct, sizeof(ivec));
+  }
+  if (key.use_aes_instructions) {
+    // A partial last block is decrypted whole in both implementations.
+    xe::crypto::Aes128DecryptCbc(key.round_keys, ct, pt,
+                                 xe::round_up(size, size_t(16), false), ivec);
+    return;
+  }
+  for (size_t n = 0; n < size; n += 16, ct += 16, pt += 16) {
     // Decrypt 16 uint8_ts from input -> output.
-    rijndaelDecrypt(rk, Nr, ct, pt);
+    rijndaelDecrypt(key.rk, key.Nr, ct, pt);
     for (size_t i = 0; i < 16; i++) {
       // XOR with previous.
       pt[i] ^= ivec[i];
@@ -56,6 +159,22 @@ void aes_decrypt_buffer(const uint8_t* session_key, const uint8_t* input_buffer,
   }
 }
 
+void aes_decrypt_buffer(const uint8_t* session_key, const uint8_t* input_buffer,
+                        const size_t input_size, uint8_t* output_buffer,
+                        const size_t output_size) {
+  AesDecryptionKey key(session_key);
+  // Each block only depends on the previous ciphertext block, so the buffer
+  // is decrypted in independent segments.
+  const size_t kSegmentSize = 256 * 1024;
+  xe::cpu::ParallelForEachXexChunk(
+      (input_size + kSegmentSize - 1) / kSegmentSize, [&](size_t i) {
+        size_t offset = i * kSegmentSize;
+        aes_decrypt_cbc(key, input_buffer + offset, output_buffer + offset,
+                        std::min(kSegmentSize, input_size - offset),
+                        offset ? input_buffer + offset - 16 : nullptr);
+      });
+}
+
 namespace xe {
 namespace cpu {
 
@@ -212,7 +331,8 @@ int XexModule::ApplyPatch(XexModule* module) {
   // Compare hash inside delta descriptor to base XEX signature
   uint8_t digest[0x14];
   sha1::SHA1 s;
-  s.processBytes(module->xex_security_info()->rsa_signature, 0x100);
+  xe::crypto::Sha1ProcessBytes(&s, module->xex_security_info()->rsa_signature,
+                               0x100);
   s.finalize(digest);
 
   if (memcmp(digest, patch_header->digest_source, 0x14) != 0) {
@@ -404,7 +524,7 @@ int XexModule::ApplyPatch(XexModule* module) {
 
     // Compare block hash, if no match we probably used wrong decrypt key
     s.reset();
-    s.processBytes(p, cur_block->block_size);
+    xe::crypto::Sha1ProcessBytes(&s, p, cur_block->block_size);
     s.finalize(digest);
 
     if (memcmp(digest, cur_block->block_hash, 0x14) != 0) {
@@ -607,47 +727,50 @@ int XexModule::ReadImageBasicCompressed(const void* xex_addr,
 
   uint8_t* buffer = memory()->TranslateVirtual(base_address_);
   std::memset(buffer, 0, total_size);  // Quickly zero the contents.
-  uint8_t* d = buffer;
 
-  uint32_t rk[4 * (MAXNR + 1)];
-  uint8_t ivec[16] = {0};
-  int32_t Nr = rijndaelKeySetupDec(rk, session_key_, 128);
+  AesDecryptionKey key(session_key_);
 
+  xex2_encryption_type encryption_type =
+      opt_file_format_info()->encryption_type;
+  if (encryption_type != XEX_ENCRYPTION_NONE &&
+      encryption_type != XEX_ENCRYPTION_NORMAL) {
+    assert_always();
+    return 1;
+  }
+
+  // Locate the blocks first, then copy or decrypt them independently - in the
+  // source they're contiguous, so the CBC chaining between them is preserved
+  // by starting each from the ciphertext preceding it.
+  std::vector<uint32_t> source_offsets(block_count);
+  std::vector<uint32_t> dest_offsets(block_count);
+  uint32_t source_offset = 0;
+  uint32_t dest_offset = 0;
   for (size_t n = 0; n < block_count; n++) {
     const uint32_t data_size = comp_info.blocks[n].data_size;
     const uint32_t zero_size = comp_info.blocks[n].zero_size;
-
-    switch (opt_file_format_info()->encryption_type) {
-      case XEX_ENCRYPTION_NONE:
-        if (data_size > uncompressed_size - (d - buffer)) {
-          // Overflow.
-          return 1;
-        }
-        memcpy(d, p, data_size);
-        break;
-      case XEX_ENCRYPTION_NORMAL: {
-        const uint8_t* ct = p;
-        uint8_t* pt = d;
-        for (size_t m = 0; m < data_size; m += 16, ct += 16, pt += 16) {
-          // Decrypt 16 uint8_ts from input -> output.
-          rijndaelDecrypt(rk, Nr, ct, pt);
-          for (size_t i = 0; i < 16; i++) {
-            // XOR with previous.
-            pt[i] ^= ivec[i];
-            // Set previous.
-            ivec[i] = ct[i];
-          }
-        }
-      } break;
-      default:
-        assert_always();
-        return 1;
+    if (encryption_type == XEX_ENCRYPTION_NONE &&
+        data_size > uncompressed_size - dest_offset) {
+      // Overflow.
+      return 1;
     }
-
-    p += data_size;
-    d += data_size + zero_size;
+    source_offsets[n] = source_offset;
+    dest_offsets[n] = dest_offset;
+    source_offset += data_size;
+    dest_offset += data_size + zero_size;
   }
 
+  ParallelForEachXexChunk(block_count, [&](size_t n) {
+    const uint32_t data_size = comp_info.blocks[n].data_size;
+    const uint8_t* block_source = p + source_offsets[n];
+    uint8_t* block_dest = buffer + dest_offsets[n];
+    if (encryption_type == XEX_ENCRYPTION_NONE) {
+      memcpy(block_dest, block_source, data_size);
+    } else {
+      aes_decrypt_cbc(key, block_source, block_dest, data_size,
+                      source_offsets[n] ? block_source - 16 : nullptr);
+    }
+  });
+
   return 0;
 }
 
@@ -668,7 +791,6 @@ int XexModule::ReadImageCompressed(const void* xex_addr, size_t xex_length) {
   uint8_t* compress_buffer = NULL;
   const uint8_t* p = NULL;
   uint8_t* d = NULL;
-  sha1::SHA1 s;
 
   // Decrypt (if needed).
   bool free_input = false;
@@ -700,41 +822,61 @@ int XexModule::ReadImageCompressed(const void* xex_addr, size_t xex_length) {
   p = input_buffer;
   d = compress_buffer;
 
-  // De-block.
+  // Locate the blocks. Each one starts with the size and the hash of the next.
+  struct CompressedBlock {
+    const uint8_t* data;
+    uint32_t size;
+    const uint8_t* digest;
+  };
+  std::vector<CompressedBlock> blocks;
   int result_code = 0;
-
-  uint8_t block_calced_digest[0x14];
+  const uint8_t* input_end = input_buffer + input_size;
   while (cur_block->block_size) {
-    const uint8_t* pnext = p + cur_block->block_size;
+    if (size_t(input_end - p) < cur_block->block_size ||
+        cur_block->block_size < 24) {
+      result_code = 2;
+      break;
+    }
+    blocks.push_back({p, cur_block->block_size, cur_block->block_hash});
     const auto* next_block = (const xex2_compressed_block_info*)p;
+    p += cur_block->block_size;
+    cur_block = next_block;
+  }
 
-    // Compare block hash, if no match we probably used wrong decrypt key
-    s.reset();
-    s.processBytes(p, cur_block->block_size);
-    s.finalize(block_calced_digest);
-    if (memcmp(block_calced_digest, cur_block->block_hash, 0x14) != 0) {
+  // Compare block hashes, if no match we probably used wrong decrypt key.
+  if (!result_code) {
+    std::atomic<bool> hashes_match(true);
+    ParallelForEachXexChunk(blocks.size(), [&](size_t i) {
+      uint8_t block_calced_digest[0x14];
+      sha1::SHA1 s;
+      xe::crypto::Sha1ProcessBytes(&s, blocks[i].data, blocks[i].size);
+      s.finalize(block_calced_digest);
+      if (memcmp(block_calced_digest, blocks[i].digest, 0x14) != 0) {
+        hashes_match.store(false, std::memory_order_relaxed);
+      }
+    });
+    if (!hashes_match) {
       result_code = 2;
-      break;
     }
+  }
 
-    // skip block info
-    p += 4;
-    p += 20;
+  // De-block.
+  if (!result_code) {
+    for (const CompressedBlock& block : blocks) {
+      // skip block info
+      p = block.data + 4 + 20;
+      while (true) {
+        const size_t chunk_size = (p[0] << 8) | p[1];
+        p += 2;
+        if (!chunk_size) {
+          break;
+        }
 
-    while (true) {
-      const size_t chunk_size = (p[0] << 8) | p[1];
-      p += 2;
-      if (!chunk_size) {
-        break;
+        memcpy(d, p, chunk_size);
+        p += chunk_size;
+        d += chunk_size;
       }
-
-      memcpy(d, p, chunk_size);
-      p += chunk_size;
-      d += chunk_size;
     }
-
-    p = pnext;
-    cur_block = next_block;
   }
 
   if (!result_code) {
@@ -773,6 +915,101 @@ int XexModule::ReadImageCompressed(const void* xex_addr, size_t xex_length) {
   return result_code;
 }
 
+std::filesystem::path XexModule::GetImageCachePath(uint64_t xex_hash) const {
+  if (!kernel_state_ || !kernel_state_->emulator()) {
+    return {};
+  }
+  const std::filesystem::path& cache_root =
+      kernel_state_->emulator()->cache_root();
+  if (cache_root.empty()) {
+    return {};
+  }
+  return cache_root / "xex_images" / fmt::format("{:016X}.xei", xex_hash);
+}
+
+bool XexModule::ReadCachedImage(const std::filesystem::path& path,
+                                uint64_t xex_hash) {
+  auto mapping = xe::MappedMemory::Open(path, xe::MappedMemory::Mode::kRead);
+  if (!mapping || mapping->size() < sizeof(ImageCacheHeader)) {
+    return false;
+  }
+  ImageCacheHeader header;
+  std::memcpy(&header, mapping->data(), sizeof(header));
+  const uint8_t* image_data = mapping->data() + sizeof(header);
+  if (header.magic != kImageCacheMagic ||
+      header.version != kImageCacheVersion || header.xex_hash != xex_hash ||
+      !header.image_size ||
+      mapping->size() - sizeof(header) < header.image_size ||
+      XXH3_64bits(image_data, header.image_size) != header.image_hash) {
+    XELOGW("XEX image cache {} is stale or corrupted, ignoring it",
+           xe::path_to_utf8(path));
+    return false;
+  }
+
+  auto heap = memory()->LookupHeap(base_address_);
+  heap->Reset();
+  if (!heap->AllocFixed(
+          base_address_, header.image_size, 4096,
+          xe::kMemoryAllocationReserve | xe::kMemoryAllocationCommit,
+          xe::kMemoryProtectRead | xe::kMemoryProtectWrite)) {
+    XELOGE("Unable to allocate XEX memory at {:08X}-{:08X}.", base_address_,
+           header.image_size);
+    return false;
+  }
+  std::memcpy(memory()->TranslateVirtual(base_address_), image_data,
+              header.image_size);
+  if (!is_valid_executable()) {
+    return false;
+  }
+
+  // Still needed for applying patches.
+  is_dev_kit_ = header.is_dev_kit != 0;
+  aes_decrypt_buffer(
+      is_dev_kit_ ? xe_xex2_devkit_key : xe_xex2_retail_key,
+      reinterpret_cast<const uint8_t*>(xex_security_info()->aes_key), 16,
+      session_key_, 16);
+  XELOGI("Read the XEX image from the cache {}", xe::path_to_utf8(path));
+  return true;
+}
+
+void XexModule::WriteCachedImage(const std::filesystem::path& path,
+                                 uint64_t xex_hash) {
+  uint32_t image_size = 0;
+  if (!memory()->LookupHeap(base_address_)->QuerySize(base_address_,
+                                                      &image_size) ||
+      !image_size) {
+    return;
+  }
+  const uint8_t* image_data = memory()->TranslateVirtual(base_address_);
+
+  if (!xe::filesystem::CreateParentFolder(path)) {
+    XELOGE("Failed to create the XEX image cache directory: {}",
+           xe::path_to_utf8(path.parent_path()));
+    return;
+  }
+  FILE* file = xe::filesystem::OpenFile(path, "wb");
+  if (!file) {
+    XELOGE("Failed to open the XEX image cache for writing: {}",
+           xe::path_to_utf8(path));
+    return;
+  }
+  ImageCacheHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = kImageCacheMagic;
+  header.version = kImageCacheVersion;
+  header.xex_hash = xex_hash;
+  header.image_hash = XXH3_64bits(image_data, image_size);
+  header.image_size = image_size;
+  header.is_dev_kit = is_dev_kit_ ? 1 : 0;
+  // A partially written file is rejected by the image hash when reading.
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(image_data, 1, image_size, file) == image_size;
+  fclose(file);
+  if (!written) {
+    XELOGE("Failed to write the XEX image cache: {}", xe::path_to_utf8(path));
+  }
+}
+
 int XexModule::ReadPEHeaders() {
   const uint8_t* p = memory()->TranslateVirtual(base_address_);
 
@@ -897,6 +1134,7 @@ void XexModule::ReadSecurityInfo() {
 
 bool XexModule::Load(const std::string_view name, const std::string_view path,
                      const void* xex_addr, size_t xex_length) {
+  startup_timeline::ScopedPhase startup_phase("XexModule::Load");
   auto src_header = reinterpret_cast<const xex2_header*>(xex_addr);
 
   if (src_header->magic == kXEX1Signature) {
@@ -932,6 +1170,19 @@ bool XexModule::Load(const std::string_view name, const std::string_view path,
 
   uint8_t* data = memory()->TranslateVirtual(base_address_);
 
+  // Decrypting and decompressing a large executable takes a while, and the
+  // result only depends on the file.
+  uint64_t xex_hash = 0;
+  std::filesystem::path image_cache_path;
+  if (cvars::xex_image_cache && !is_patch()) {
+    xex_hash = XXH3_64bits(xex_addr, xex_length);
+    image_cache_path = GetImageCachePath(xex_hash);
+  }
+  if (!image_cache_path.empty() &&
+      ReadCachedImage(image_cache_path, xex_hash)) {
+    return true;
+  }
+
   // Load in the XEX basefile
   // We'll try using both XEX2 keys to see if any give a valid PE
   int result_code = ReadImage(xex_addr, xex_length, false);
@@ -947,6 +1198,10 @@ bool XexModule::Load(const std::string_view name, const std::string_view path,
     }
   }
 
+  if (!image_cache_path.empty()) {
+    WriteCachedImage(image_cache_path, xex_hash);
+  }
+
   // Note: caller will have to call LoadContinue once it's determined whether a
   // patch file exists or not!
   return true;
@@ -1061,6 +1316,12 @@ bool XexModule::LoadContinue() {
     }
   }
 
+  // Bind statically linked C runtime routines to host implementations, after
+  // the module map has named the functions.
+  if (cvars::replace_crt_routines) {
+    FindCrtRoutines();
+  }
+
   // Setup memory protection.
   for (uint32_t i = 0, page = 0; i < sec_header->page_descriptor_count; i++) {
     // Byteswap the bitfield manually.
@@ -1095,6 +1356,9 @@ bool XexModule::Unload() {
   if (!is_patch()) {
     assert_not_zero(base_address_);
 
+    // Releasing the image invalidates the translations of its code unless
+    // they are kept for the title being launched.
+    processor_->ParkModuleTranslations(this);
     memory()->LookupHeap(base_address_)->Release(base_address_);
   }
 
@@ -1457,9 +1721,16 @@ bool XexModule::FindSaveRest() {
   // TODO(benvanik): these are almost always sequential, if present.
   //     It'd be smarter to search around the other ones to prevent
   //     3 full module scans.
-  uint32_t gplr_start = 0;
-  uint32_t fpr_start = 0;
-  uint32_t vmx_start = 0;
+  // The code sections are split into chunks that are searched in parallel,
+  // and the first match of each sequence in address order is taken.
+  const uint32_t* const code_values[] = {gprlr_code_values, fpr_code_values,
+                                         vmx_code_values};
+  const size_t code_value_counts[] = {xe::countof(gprlr_code_values),
+                                      xe::countof(fpr_code_values),
+                                      xe::countof(vmx_code_values)};
+  const size_t kSequenceCount = xe::countof(code_values);
+  const uint32_t kSearchChunkSize = 1024 * 1024;
+  std::vector<std::pair<uint32_t, uint32_t>> search_chunks;
 
   auto page_size = base_address_ <= 0x90000000 ? 64 * 1024 : 4 * 1024;
   auto sec_header = xex_security_info();
@@ -1472,29 +1743,37 @@ bool XexModule::FindSaveRest() {
     const auto end_address = start_address + (desc.page_count * page_size);
 
     if (desc.info == XEX_SECTION_CODE) {
-      if (!gplr_start) {
-        gplr_start = memory_->SearchAligned(start_address, end_address,
-                                            gprlr_code_values,
-                                            xe::countof(gprlr_code_values));
-      }
-      if (!fpr_start) {
-        fpr_start =
-            memory_->SearchAligned(start_address, end_address, fpr_code_values,
-                                   xe::countof(fpr_code_values));
-      }
-      if (!vmx_start) {
-        vmx_start =
-            memory_->SearchAligned(start_address, end_address, vmx_code_values,
-                                   xe::countof(vmx_code_values));
-      }
-      if (gplr_start && fpr_start && vmx_start) {
-        break;
+      for (uint32_t chunk_start = start_address; chunk_start < end_address;
+           chunk_start += kSearchChunkSize) {
+        search_chunks.emplace_back(
+            chunk_start,
+            std::min(uint32_t(chunk_start + kSearchChunkSize), end_address));
       }
     }
 
     page += desc.page_count;
   }
 
+  std::vector<uint32_t> search_results(search_chunks.size() * kSequenceCount);
+  ParallelForEachXexChunk(search_results.size(), [&](size_t i) {
+    const auto& chunk = search_chunks[i / kSequenceCount];
+    size_t sequence = i % kSequenceCount;
+    // A match may extend past the end of the chunk.
+    search_results[i] =
+        memory_->SearchAligned(chunk.first, chunk.second, code_values[sequence],
+                               code_value_counts[sequence]);
+  });
+  uint32_t sequence_starts[kSequenceCount] = {};
+  for (size_t i = 0; i < search_results.size(); ++i) {
+    uint32_t& sequence_start = sequence_starts[i % kSequenceCount];
+    if (!sequence_start) {
+      sequence_start = search_results[i];
+    }
+  }
+  uint32_t gplr_start = sequence_starts[0];
+  uint32_t fpr_start = sequence_starts[1];
+  uint32_t vmx_start = sequence_starts[2];
+
   // Add function stubs.
   char name[32];
   if (gplr_start) {
@@ -1620,5 +1899,96 @@ bool XexModule::FindSaveRest() {
   return true;
 }
 
+void XexModule::FindCrtRoutines() {
+  std::vector<std::pair<uint32_t, GuestFunction::ExternHandler>> routines;
+  std::vector<std::string> routine_names;
+
+  // Functions named by the module map. Names may have a leading underscore.
+  ForEachFunction([&](Function* function) {
+    std::string_view name = function->name();
+    auto handler = LookupCrtRoutine(name);
+    if (!handler && name.size() > 1 && name[0] == '_') {
+      name.remove_prefix(1);
+      handler = LookupCrtRoutine(name);
+    }
+    if (handler && function->behavior() == Function::Behavior::kDefault) {
+      routines.emplace_back(function->address(), handler);
+      routine_names.emplace_back(name);
+    }
+  });
+
+  // Functions whose code starts with a known signature.
+  if (!cvars::crt_routine_signatures.empty()) {
+    std::ifstream signatures_file(xe::to_path(cvars::crt_routine_signatures));
+    if (!signatures_file) {
+      XELOGE("Failed to open the C runtime routine signatures file {}",
+             cvars::crt_routine_signatures);
+    }
+    auto page_size = base_address_ <= 0x90000000 ? 64 * 1024 : 4 * 1024;
+    auto sec_header = xex_security_info();
+    std::string line;
+    while (std::getline(signatures_file, line)) {
+      std::istringstream line_stream(line);
+      std::string name;
+      if (!(line_stream >> name) || name[0] == '#') {
+        continue;
+      }
+      auto handler = LookupCrtRoutine(name);
+      if (!handler) {
+        XELOGW("Unknown C runtime routine {} in the signatures file", name);
+        continue;
+      }
+      // Searched as loaded from memory.
+      std::vector<uint32_t> code_values;
+      uint32_t code;
+      while (line_stream >> std::hex >> code) {
+        code_values.push_back(xe::byte_swap(code));
+      }
+      if (code_values.empty()) {
+        continue;
+      }
+      for (uint32_t i = 0, page = 0; i < sec_header->page_descriptor_count;
+           i++) {
+        xex2_page_descriptor desc;
+        desc.value = xe::byte_swap(sec_header->page_descriptors[i].value);
+        uint32_t start_address = base_address_ + (page * page_size);
+        uint32_t end_address = start_address + (desc.page_count * page_size);
+        page += desc.page_count;
+        if (desc.info != XEX_SECTION_CODE) {
+          continue;
+        }
+        // The same routine may be linked in multiple times.
+        while (start_address < end_address) {
+          uint32_t address =
+              memory_->SearchAligned(start_address, end_address,
+                                     code_values.data(), code_values.size());
+          if (!address) {
+            break;
+          }
+          routines.emplace_back(address, handler);
+          routine_names.push_back(name);
+          start_address = address + 4;
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < routines.size(); ++i) {
+    Function* function;
+    DeclareFunction(routines[i].first, &function);
+    if (function->behavior() != Function::Behavior::kDefault) {
+      // Already taken by the save and restore helpers or an import.
+      continue;
+    }
+    if (function->name().empty()) {
+      function->set_name(routine_names[i]);
+    }
+    static_cast<GuestFunction*>(function)->SetupExtern(routines[i].second);
+    function->set_status(Symbol::Status::kDeclared);
+    XELOGI("Running {} at {:08X} as host code", routine_names[i],
+           routines[i].first);
+  }
+}
+
 }  // namespace cpu
 }  // namespace xe
@@ -10,6 +10,7 @@
 #ifndef XENIA_CPU_XEX_MODULE_H_
 #define XENIA_CPU_XEX_MODULE_H_
 
+#include <filesystem>
 #include <string>
 #include <vector>
 
@@ -185,11 +186,18 @@ class XexModule : public xe::cpu::Module {
   int ReadImageBasicCompressed(const void* xex_addr, size_t xex_length);
   int ReadImageCompressed(const void* xex_addr, size_t xex_length);
 
+  // The image of the executable, before applying patches, is cached by the
+  // hash of the whole executable file with xex_image_cache.
+  std::filesystem::path GetImageCachePath(uint64_t xex_hash) const;
+  bool ReadCachedImage(const std::filesystem::path& path, uint64_t xex_hash);
+  void WriteCachedImage(const std::filesystem::path& path, uint64_t xex_hash);
+
   int ReadPEHeaders();
 
   bool SetupLibraryImports(const std::string_view name,
                            const xex2_import_library* library);
   bool FindSaveRest();
+  void FindCrtRoutines();
 
   Processor* processor_ = nullptr;
   kernel::KernelState* kernel_state_ = nullptr;
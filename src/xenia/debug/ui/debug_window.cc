@@ -18,6 +18,7 @@
 #include "third_party/imgui/imgui.h"
 #include "third_party/imgui/imgui_internal.h"
 #include "xenia/base/clock.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/fuzzy.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
@@ -27,7 +28,9 @@
 #include "xenia/cpu/breakpoint.h"
 #include "xenia/cpu/ppc/ppc_opcode_info.h"
 #include "xenia/cpu/stack_walker.h"
+#include "xenia/gpu/command_processor.h"
 #include "xenia/gpu/graphics_system.h"
+#include "xenia/kernel/kernel_flags.h"
 #include "xenia/kernel/xmodule.h"
 #include "xenia/kernel/xthread.h"
 #include "xenia/ui/graphics_provider.h"
@@ -217,6 +220,12 @@ void DebugWindow::DrawFrame(ImGuiIO& io) {
   ImGui::SameLine();
   ImGui::RadioButton("Memory", &state_.right_pane_tab,
                      ImState::kRightPaneMemory);
+  ImGui::SameLine();
+  ImGui::RadioButton("Kernel Calls", &state_.right_pane_tab,
+                     ImState::kRightPaneKernelCalls);
+  ImGui::SameLine();
+  ImGui::RadioButton("Pipelines", &state_.right_pane_tab,
+                     ImState::kRightPanePipelines);
   ImGui::EndGroup();
   ImGui::Separator();
   switch (state_.right_pane_tab) {
@@ -230,6 +239,16 @@ void DebugWindow::DrawFrame(ImGuiIO& io) {
       DrawMemoryPane();
       ImGui::EndChild();
       break;
+    case ImState::kRightPaneKernelCalls:
+      ImGui::BeginChild("##kernel_calls_pane");
+      DrawKernelCallsPane();
+      ImGui::EndChild();
+      break;
+    case ImState::kRightPanePipelines:
+      ImGui::BeginChild("##pipelines_pane");
+      DrawPipelinesPane();
+      ImGui::EndChild();
+      break;
   }
   ImGui::EndChild();
   ImGui::InvisibleButton("##hsplitter0", ImVec2(-1, kSplitterWidth));
@@ -1116,6 +1135,117 @@ void DebugWindow::DrawMemoryPane() {
   // https://github.com/ocornut/imgui/wiki/memory_editor_example
 }
 
+void DebugWindow::DrawKernelCallsPane() {
+  auto export_resolver = emulator_->export_resolver();
+  ImGui::BeginGroup();
+  if (ImGui::Button("Save CSV")) {
+    std::filesystem::path path = cvars::kernel_call_profile_path;
+    if (path.empty()) {
+      path = "kernel_call_profile.csv";
+    }
+    if (!export_resolver->WriteCallProfile(path)) {
+      XELOGE("Failed to write the kernel call profile to {}",
+             xe::path_to_utf8(path));
+    }
+  }
+  ImGui::SameLine();
+  if (ImGui::Button("Reset")) {
+    export_resolver->ResetCallProfile();
+  }
+  if (!cvars::profile_kernel_calls) {
+    ImGui::SameLine();
+    ImGui::TextDisabled("Host times require --profile_kernel_calls");
+  }
+  ImGui::EndGroup();
+  ImGui::Separator();
+  ImGui::BeginChild("##kernel_calls_listing");
+  ImGui::Columns(4);
+  ImGui::Text("Export");
+  ImGui::NextColumn();
+  ImGui::Text("Calls");
+  ImGui::NextColumn();
+  ImGui::Text("Total ms");
+  ImGui::NextColumn();
+  ImGui::Text("Average us");
+  ImGui::NextColumn();
+  ImGui::Separator();
+  double ticks_to_us = 1000000.0 / double(Clock::QueryHostTickFrequency());
+  for (const auto& function : export_resolver->GetCalledFunctions()) {
+    const auto& function_data = function.second->function_data;
+    double total_us = double(function_data.call_ticks) * ticks_to_us;
+    ImGui::Text("%s!%s", function.first->c_str(), function.second->name);
+    ImGui::NextColumn();
+    ImGui::Text("%" PRIu64, function_data.call_count);
+    ImGui::NextColumn();
+    ImGui::Text("%.3f", total_us / 1000.0);
+    ImGui::NextColumn();
+    ImGui::Text("%.3f", total_us / double(function_data.call_count));
+    ImGui::NextColumn();
+  }
+  ImGui::Columns(1);
+  ImGui::EndChild();
+}
+
+void DebugWindow::DrawPipelinesPane() {
+  gpu::GraphicsSystem* graphics_system = emulator_->graphics_system();
+  gpu::CommandProcessor* command_processor =
+      graphics_system ? graphics_system->command_processor() : nullptr;
+  if (!command_processor) {
+    ImGui::TextDisabled("No GPU command processor");
+    return;
+  }
+  gpu::PipelineCompileLog& compile_log =
+      command_processor->pipeline_compile_log();
+  ImGui::BeginGroup();
+  if (ImGui::Button("Reset")) {
+    compile_log.Clear();
+  }
+  ImGui::SameLine();
+  ImGui::Text("%" PRIu64 " compiled, %.3f ms blocking draws",
+              compile_log.compile_count(),
+              compile_log.blocking_compile_us() / 1000.0);
+  ImGui::EndGroup();
+  ImGui::Separator();
+  ImGui::BeginChild("##pipelines_listing");
+  ImGui::Columns(6);
+  ImGui::Text("ms");
+  ImGui::NextColumn();
+  ImGui::Text("Blocking");
+  ImGui::NextColumn();
+  ImGui::Text("Frame");
+  ImGui::NextColumn();
+  ImGui::Text("Pipeline");
+  ImGui::NextColumn();
+  ImGui::Text("Vertex shader");
+  ImGui::NextColumn();
+  ImGui::Text("Pixel shader");
+  ImGui::NextColumn();
+  ImGui::Separator();
+  for (const gpu::PipelineCompileLog::Record& record :
+       compile_log.GetSlowest(gpu::PipelineCompileLog::kMaxRecords)) {
+    ImGui::Text("%.3f", record.compile_us / 1000.0);
+    ImGui::NextColumn();
+    ImGui::Text("%s", record.blocking ? "yes" : "no");
+    ImGui::NextColumn();
+    ImGui::Text("%" PRIu64, record.frame);
+    ImGui::NextColumn();
+    ImGui::Text("%016" PRIX64, record.description_hash);
+    ImGui::NextColumn();
+    ImGui::Text("%016" PRIX64 ":%016" PRIX64, record.vertex_shader_hash,
+                record.vertex_shader_modification);
+    ImGui::NextColumn();
+    if (record.pixel_shader_hash) {
+      ImGui::Text("%016" PRIX64 ":%016" PRIX64, record.pixel_shader_hash,
+                  record.pixel_shader_modification);
+    } else {
+      ImGui::TextDisabled("none");
+    }
+    ImGui::NextColumn();
+  }
+  ImGui::Columns(1);
+  ImGui::EndChild();
+}
+
 void DebugWindow::DrawBreakpointsPane() {
   auto& state = state_.breakpoints;
 
@@ -86,6 +86,8 @@ class DebugWindow : public cpu::DebugListener {
   bool DrawRegisterTextBoxes(int id, float* value);
   void DrawThreadsPane();
   void DrawMemoryPane();
+  void DrawKernelCallsPane();
+  void DrawPipelinesPane();
   void DrawBreakpointsPane();
   void DrawLogPane();
 
@@ -139,6 +141,8 @@ class DebugWindow : public cpu::DebugListener {
   struct ImState {
     static const int kRightPaneThreads = 0;
     static const int kRightPaneMemory = 1;
+    static const int kRightPaneKernelCalls = 2;
+    static const int kRightPanePipelines = 3;
     int right_pane_tab = kRightPaneThreads;
 
     cpu::ThreadDebugInfo* thread_info = nullptr;
@@ -11,7 +11,9 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cinttypes>
+#include <map>
 
 #include "config.h"
 #include "third_party/fmt/include/fmt/format.h"
@@ -23,13 +25,19 @@
 #include "xenia/base/cvar.h"
 #include "xenia/base/debugging.h"
 #include "xenia/base/exception_handler.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/game_compatibility.h"
 #include "xenia/base/literals.h"
+#include "xenia/base/lock_profiling.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/mapped_memory.h"
+#include "xenia/base/mutex.h"
 #include "xenia/base/platform.h"
+#include "xenia/base/startup_timeline.h"
 #include "xenia/base/string.h"
 #include "xenia/base/threading.h"
+#include "xenia/base/utf8.h"
+#include "xenia/cache_bundle.h"
 #include "xenia/cpu/backend/code_cache.h"
 #include "xenia/cpu/backend/null_backend.h"
 #include "xenia/cpu/cpu_flags.h"
@@ -59,8 +67,11 @@
 #include "xenia/cpu/backend/x64/x64_backend.h"
 #endif  // XE_ARCH
 
+DECLARE_int32(host_numa_node);
 DECLARE_int32(user_language);
 
+DECLARE_bool(profile_locks);
+
 DEFINE_double(time_scalar, 1.0,
               "Scalar used to speed or slow time (1x, 2x, 1/2x, etc).",
               "General");
@@ -70,6 +81,49 @@ DEFINE_string(
     "or the module specified by the game. Leave blank to launch the default "
     "module.",
     "General");
+DEFINE_path(
+    cache_bundle_root, "",
+    "Directory of per-title bundles of the caches that can be moved between "
+    "machines. Before a title is launched, the files of its bundle that are "
+    "missing or smaller in the cache root are copied there. Leave blank to "
+    "not use bundles.",
+    "General");
+DEFINE_bool(cache_bundle_export, false,
+            "Replace the bundle of the title in cache_bundle_root with the "
+            "caches of the cache root when the title is terminated.",
+            "General");
+DEFINE_bool(save_state_in_background, false,
+            "Only pause the title while copying its memory when saving the "
+            "state, and compress and write the copy to the file while the "
+            "title is running again. Needs as much free host memory as the "
+            "title has allocated.",
+            "General");
+DEFINE_bool(boot_snapshot, false,
+            "Save the state of a title some time after launching it, and on "
+            "later launches of the same executable, restore it instead of "
+            "booting the title. Experimental, as not everything is saved in "
+            "states yet.",
+            "General");
+DEFINE_uint32(boot_snapshot_delay, 20,
+              "Seconds after launching a title to save its boot_snapshot at.",
+              "General");
+DEFINE_path(compatibility_database, "",
+            "Path to the binary game compatibility database to load on "
+            "startup and to record settings to, or empty for "
+            "compatibility.xgcd in the storage root.",
+            "General");
+DEFINE_string(compatibility_record_settings, "",
+              "Settings to record for the launched title in the "
+              "compatibility database and to apply on its later launches, "
+              "such as the tuned performance settings, as name=value pairs "
+              "separated by semicolons, with the values in the TOML syntax.",
+              "General");
+DEFINE_bool(log_global_lock_contention, false,
+            "Track where threads wait for the global critical region, and on "
+            "shutdown, log the call sites that waited for it the longest, "
+            "along with the call sites last holding it. Makes acquiring it "
+            "slightly slower.",
+            "General");
 
 namespace xe {
 
@@ -109,13 +163,20 @@ Emulator::Emulator(const std::filesystem::path& command_line,
       title_id_(std::nullopt),
       paused_(false),
       restoring_(false),
-      restore_fence_() {}
+      restore_fence_() {
+  // The lock profiling receives the waits from the contention tracking.
+  global_critical_region::SetContentionTrackingEnabled(
+      cvars::log_global_lock_contention || cvars::profile_locks);
+}
 
 Emulator::~Emulator() {
   // Note that we delete things in the reverse order they were initialized.
 
   XELOGI("Emulator: Beginning shutdown sequence");
 
+  CancelBootSnapshot();
+  WaitForSaveState();
+
   // Terminate any running title first to ensure clean shutdown
   if (is_title_open()) {
     XELOGI("Emulator: Terminating open title before shutdown");
@@ -148,6 +209,41 @@ Emulator::~Emulator() {
 
   ExceptionHandler::Uninstall(Emulator::ExceptionCallbackThunk, this);
 
+  global_critical_region::SetContentionTrackingEnabled(false);
+  if (cvars::log_global_lock_contention) {
+    std::vector<global_critical_region::ContentionRecord> contention_records =
+        global_critical_region::GetContentionRecords();
+    constexpr size_t kMaxLoggedContentionRecords = 32;
+    XELOGI("Emulator: Global critical region contention ({} call site pairs):",
+           contention_records.size());
+    for (size_t i = 0; i < std::min(contention_records.size(),
+                                    kMaxLoggedContentionRecords);
+         ++i) {
+      const global_critical_region::ContentionRecord& record =
+          contention_records[i];
+      XELOGI("  {:.3f} ms in {} waits at {}, last held at {}",
+             record.wait_time_ns * 1e-6, record.wait_count,
+             record.waiter_location, record.holder_location);
+    }
+    global_critical_region::ResetContentionRecords();
+  }
+
+  if (lock_profiling::IsEnabled()) {
+    std::vector<lock_profiling::LockStatistics> lock_statistics =
+        lock_profiling::GetStatistics();
+    XELOGI("Emulator: Lock waits ({} locks):", lock_statistics.size());
+    for (const lock_profiling::LockStatistics& lock : lock_statistics) {
+      XELOGI("  {}: {:.3f} ms in {} waits, longest {:.3f} ms", lock.name,
+             lock.wait_us * 1e-3, lock.wait_count, lock.max_wait_us * 1e-3);
+      if (!lock.call_sites.empty()) {
+        const lock_profiling::CallSiteStatistics& top_call_site =
+            lock.call_sites.front();
+        XELOGI("    most at {}: {:.3f} ms in {} waits", top_call_site.location,
+               top_call_site.wait_us * 1e-3, top_call_site.wait_count);
+      }
+    }
+  }
+
   XELOGI("Emulator: Shutdown complete");
 }
 
@@ -177,6 +273,23 @@ X_STATUS Emulator::Setup(
   // logical processors.
   xe::threading::EnableAffinityConfiguration();
 
+  // Keep all the threads, and thus the memory they touch first, on one NUMA
+  // node, before any memory is allocated and any subsystem thread is created.
+  if (cvars::host_numa_node >= 0) {
+    std::vector<uint64_t> node_masks =
+        xe::threading::GetProcessorNodeAffinityMasks();
+    uint64_t node_mask = size_t(cvars::host_numa_node) < node_masks.size()
+                             ? node_masks[cvars::host_numa_node]
+                             : 0;
+    if (node_mask && xe::threading::RestrictProcessAffinity(node_mask)) {
+      XELOGI("Running on host NUMA node {}, logical processors 0x{:016X}",
+             cvars::host_numa_node, node_mask);
+    } else {
+      XELOGE("Failed to restrict the emulator to host NUMA node {}",
+             cvars::host_numa_node);
+    }
+  }
+
   // Create memory system first, as it is required for other systems.
   memory_ = std::make_unique<Memory>();
   if (!memory_->Initialize()) {
@@ -275,7 +388,15 @@ X_STATUS Emulator::Setup(
 #undef LOAD_KERNEL_MODULE
 
   // Initialize game compatibility database
-  game_compatibility::GameCompatibilityDatabase::GetInstance().Initialize();
+  auto& compatibility_database =
+      game_compatibility::GameCompatibilityDatabase::GetInstance();
+  compatibility_database.Initialize();
+  std::filesystem::path compatibility_database_path =
+      GetCompatibilityDatabasePath();
+  if (std::filesystem::exists(compatibility_database_path)) {
+    compatibility_database.LoadFromFile(
+        xe::path_to_utf8(compatibility_database_path));
+  }
 
   // Initialize emulator fallback exception handling last.
   ExceptionHandler::Install(Emulator::ExceptionCallbackThunk, this);
@@ -291,6 +412,8 @@ X_STATUS Emulator::TerminateTitle() {
     return X_STATUS_UNSUCCESSFUL;
   }
 
+  CancelBootSnapshot();
+
   XELOGI("TerminateTitle: Title ID was: 0x{:08X}", title_id_.value_or(0));
 
   if (kernel_state_) {
@@ -301,6 +424,16 @@ X_STATUS Emulator::TerminateTitle() {
     XELOGW("TerminateTitle: kernel_state_ is null!");
   }
 
+  if (processor_) {
+    processor_->ShutdownCodeStorage();
+    if (cvars::cache_bundle_export && !cvars::cache_bundle_root.empty() &&
+        title_id_.value_or(0) && processor_->code_storage_module_hash()) {
+      CacheBundle::Export(cache_root_, cvars::cache_bundle_root,
+                          title_id_.value(),
+                          processor_->code_storage_module_hash());
+    }
+  }
+
   XELOGI("TerminateTitle: Clearing title info...");
   title_id_ = std::nullopt;
   title_name_ = "";
@@ -324,9 +457,12 @@ X_STATUS Emulator::CloseTitle() {
 
 X_STATUS Emulator::LaunchPath(const std::filesystem::path& path) {
   XELOGI("=== LaunchPath: Attempting to launch '{}'", xe::path_to_utf8(path));
+  startup_timeline::Reset();
+  startup_timeline::ScopedPhase startup_phase("Emulator::LaunchPath");
 
   // If a title is already running, terminate it and clean up
   if (is_title_open()) {
+    startup_timeline::ScopedPhase terminate_phase("Terminate previous title");
     XELOGI("LaunchPath: Title already open, terminating current title");
     TerminateTitle();
 
@@ -357,6 +493,9 @@ X_STATUS Emulator::LaunchPath(const std::filesystem::path& path) {
     XELOGI("LaunchPath: Cleanup complete, ready for new title");
   }
 
+  // Ended in CompleteLaunch after the game device is registered.
+  startup_timeline::BeginPhase("VFS mount");
+
   // Launch based on file type.
   // This is a silly guess based on file extension.
   // First check if it is a directory (folder with extracted disc contents)
@@ -566,22 +705,44 @@ void Emulator::Pause() {
 
   // Only suspend threads if kernel state is initialized
   if (kernel_state_) {
-    auto lock = global_critical_region::AcquireDirect();
     auto threads =
         kernel_state()->object_table()->GetObjectsByType<kernel::XThread>(
             kernel::XObject::Type::Thread);
     auto current_thread = kernel::XThread::IsInThread()
                               ? kernel::XThread::GetCurrentThread()
                               : nullptr;
+    std::vector<kernel::object_ref<kernel::XThread>> pause_threads;
     for (auto thread : threads) {
       // Don't pause ourself or host threads.
-      if (thread == current_thread || !thread->can_debugger_suspend()) {
+      if (thread == current_thread || !thread->can_debugger_suspend() ||
+          !thread->is_running()) {
         continue;
       }
+      pause_threads.push_back(thread);
+    }
 
-      if (thread->is_running()) {
-        thread->thread()->Suspend(nullptr);
+    // Threads running guest code stop at the next safepoint poll, which is
+    // much faster than suspending them one by one. The ones that don't get to
+    // one in time, such as the ones waiting in the kernel, are suspended.
+    std::vector<kernel::object_ref<kernel::XThread>> suspend_threads;
+    if (cvars::guest_safepoints) {
+      for (auto& thread : pause_threads) {
+        thread->thread_state()->RequestSafepoint();
       }
+      auto deadline = std::chrono::steady_clock::now() +
+                      std::chrono::microseconds(cvars::safepoint_timeout_us);
+      for (auto& thread : pause_threads) {
+        if (!thread->thread_state()->WaitForSafepoint(deadline)) {
+          suspend_threads.push_back(thread);
+        }
+      }
+    } else {
+      suspend_threads = std::move(pause_threads);
+    }
+
+    auto lock = global_critical_region::AcquireDirect();
+    for (auto& thread : suspend_threads) {
+      thread->thread()->Suspend(nullptr);
     }
   }
 
@@ -614,7 +775,8 @@ void Emulator::Resume() {
         continue;
       }
 
-      if (thread->is_running()) {
+      if (thread->is_running() &&
+          !thread->thread_state()->ReleaseSafepoint()) {
         thread->thread()->Resume(nullptr);
       }
     }
@@ -622,11 +784,15 @@ void Emulator::Resume() {
 }
 
 bool Emulator::SaveToFile(const std::filesystem::path& path) {
+  // Only one save state is written at a time.
+  WaitForSaveState();
+
   Pause();
 
   filesystem::CreateEmptyFile(path);
   auto map = MappedMemory::Open(path, MappedMemory::Mode::kReadWrite, 0, 2_GiB);
   if (!map) {
+    Resume();
     return false;
   }
 
@@ -644,6 +810,30 @@ bool Emulator::SaveToFile(const std::filesystem::path& path) {
   graphics_system_->Save(&stream);
   audio_system_->Save(&stream);
   kernel_state_->Save(&stream);
+
+  if (cvars::save_state_in_background) {
+    // Copy the memory while still paused, the rest of the state is already in
+    // the file.
+    std::shared_ptr<Memory::Snapshot> snapshot = memory_->CaptureSnapshot();
+    Resume();
+    std::shared_ptr<MappedMemory> shared_map(std::move(map));
+    size_t offset = stream.offset();
+    auto write_memory = [this, shared_map, snapshot, offset, path]() {
+      ByteStream memory_stream(shared_map->data(), shared_map->size(),
+                               offset);
+      memory_->Save(&memory_stream, false, snapshot.get());
+      shared_map->Close(memory_stream.offset());
+      XELOGI("Saved the state to {}", xe::path_to_utf8(path));
+    };
+    save_state_thread_ = threading::Thread::Create({}, write_memory);
+    if (save_state_thread_) {
+      save_state_thread_->set_name("Save State Writer");
+    } else {
+      write_memory();
+    }
+    return true;
+  }
+
   memory_->Save(&stream);
   map->Close(stream.offset());
 
@@ -651,7 +841,77 @@ bool Emulator::SaveToFile(const std::filesystem::path& path) {
   return true;
 }
 
+void Emulator::WaitForSaveState() {
+  if (save_state_thread_) {
+    threading::Wait(save_state_thread_.get(), false);
+    save_state_thread_.reset();
+  }
+}
+
+std::filesystem::path Emulator::GetBootSnapshotPath() const {
+  if (!cvars::boot_snapshot || !title_id_.value_or(0) ||
+      !processor_->code_storage_module_hash()) {
+    return {};
+  }
+  return cache_root_ / "boot_snapshots" /
+         fmt::format("{:08X}_{:016X}.sav", title_id_.value(),
+                     processor_->code_storage_module_hash());
+}
+
+std::filesystem::path Emulator::GetCompatibilityDatabasePath() const {
+  if (!cvars::compatibility_database.empty()) {
+    return cvars::compatibility_database;
+  }
+  return storage_root_ / "compatibility.xgcd";
+}
+
+void Emulator::RecordCompatibilitySettings(uint32_t title_id) {
+  auto trim = [](std::string_view value) {
+    size_t first = value.find_first_not_of(" \t");
+    if (first == std::string_view::npos) {
+      return std::string();
+    }
+    size_t last = value.find_last_not_of(" \t");
+    return std::string(value.substr(first, last + 1 - first));
+  };
+  std::map<std::string, std::string> settings;
+  for (std::string_view setting :
+       xe::utf8::split(cvars::compatibility_record_settings, ";", true)) {
+    size_t equals = setting.find('=');
+    if (equals == std::string_view::npos) {
+      XELOGW("Ignoring the recorded setting without a value: {}", setting);
+      continue;
+    }
+    settings[trim(setting.substr(0, equals))] =
+        trim(setting.substr(equals + 1));
+  }
+  if (settings.empty()) {
+    return;
+  }
+  auto& compatibility_database =
+      game_compatibility::GameCompatibilityDatabase::GetInstance();
+  // Rewriting the loaded file in place.
+  compatibility_database.DetachBinaryFile();
+  compatibility_database.SetSettingsFix(title_id, title_name_,
+                                        "Recorded settings", settings);
+  std::filesystem::path path = GetCompatibilityDatabasePath();
+  xe::filesystem::CreateParentFolder(path);
+  if (compatibility_database.SaveBinaryFile(xe::path_to_utf8(path))) {
+    XELOGI("Recorded {} settings for title {:08X}", settings.size(),
+           title_id);
+  }
+}
+
+void Emulator::CancelBootSnapshot() {
+  if (auto boot_snapshot_timer = boot_snapshot_timer_.lock()) {
+    boot_snapshot_timer->Disarm();
+  }
+  boot_snapshot_timer_.reset();
+}
+
 bool Emulator::RestoreFromFile(const std::filesystem::path& path) {
+  WaitForSaveState();
+
   // Restore the emulator state from a file
   auto map = MappedMemory::Open(path, MappedMemory::Mode::kReadWrite);
   if (!map) {
@@ -700,6 +960,18 @@ bool Emulator::RestoreFromFile(const std::filesystem::path& path) {
     XELOGE("Could not restore kernel state!");
     return false;
   }
+  // The modules have been loaded again, but their memory hasn't been restored
+  // yet, so the executable is still identified the same as when it was
+  // launched, and the translations kept through the termination of the title
+  // can be checked against its code.
+  for (auto user_module :
+       kernel_state_->object_table()->GetObjectsByType<kernel::UserModule>()) {
+    if (user_module->xex_module() && user_module->is_executable()) {
+      processor_->InitializeCodeStorage(cache_root_,
+                                        user_module->xex_module());
+      break;
+    }
+  }
   if (!memory_->Restore(&stream)) {
     XELOGE("Could not restore memory!");
     return false;
@@ -732,6 +1004,7 @@ void Emulator::LaunchNextTitle() {
   auto xam = kernel_state()->GetKernelModule<kernel::xam::XamModule>("xam.xex");
   auto next_title = xam->loader_data().launch_path;
 
+  startup_timeline::Reset();
   CompleteLaunch("", next_title);
 }
 
@@ -1012,6 +1285,7 @@ X_STATUS Emulator::CompleteLaunch(const std::filesystem::path& path,
   // Making changes to the UI (setting the icon) and executing game config load
   // callbacks which expect to be called from the UI thread.
   assert_true(display_window_->app_context().IsInUIThread());
+  startup_timeline::EndPhase("VFS mount");
 
   // Setup NullDevices for raw HDD partition accesses
   // Cache/STFC code baked into games tries reading/writing to these
@@ -1033,6 +1307,7 @@ X_STATUS Emulator::CompleteLaunch(const std::filesystem::path& path,
   }
 
   // Reset state.
+  CancelBootSnapshot();
   title_id_ = std::nullopt;
   title_name_ = "";
   title_version_ = "";
@@ -1042,12 +1317,26 @@ X_STATUS Emulator::CompleteLaunch(const std::filesystem::path& path,
   auto xam = kernel_state()->GetKernelModule<kernel::xam::XamModule>("xam.xex");
 
   XELOGI("Launching module {}", module_path);
+  startup_timeline::BeginPhase("KernelState::LoadUserModule");
   auto module = kernel_state_->LoadUserModule(module_path);
+  startup_timeline::EndPhase("KernelState::LoadUserModule");
   if (!module) {
     XELOGE("Failed to load user module {}", xe::path_to_utf8(path));
     return X_STATUS_NOT_FOUND;
   }
 
+  // Warm the caches from the bundle of the title before they're opened.
+  if (!cvars::cache_bundle_root.empty() && module->title_id()) {
+    CacheBundle::Install(cvars::cache_bundle_root, cache_root_,
+                         module->title_id());
+  }
+
+  // Open the translated code storage before anything (such as compatibility
+  // patches below) modifies the module image.
+  startup_timeline::BeginPhase("Code storage open");
+  processor_->InitializeCodeStorage(cache_root_, module->xex_module());
+  startup_timeline::EndPhase("Code storage open");
+
   // Grab the current title ID.
   xex2_opt_execution_info* info = nullptr;
   module->GetOptHeader(XEX_HEADER_EXECUTION_INFO, &info);
@@ -1077,15 +1366,18 @@ X_STATUS Emulator::CompleteLaunch(const std::filesystem::path& path,
           ->PostGameConfigLoad();
     }
     game_config_load_callback_loop_next_index_ = SIZE_MAX;
+    // The code storage was opened and the functions from the previous runs
+    // were queued for translation with the options from the global config.
+    processor_->ApplyCodegenOptionChanges();
 
-    const kernel::util::XdbfGameData db = kernel_state_->module_xdbf(module);
+    const kernel::util::XdbfGameData& db = kernel_state_->module_xdbf(module);
     if (db.is_valid()) {
       XLanguage language =
           db.GetExistingLanguage(static_cast<XLanguage>(cvars::user_language));
       title_name_ = db.title(language);
 
       XELOGI("-------------------- ACHIEVEMENTS --------------------");
-      const std::vector<kernel::util::XdbfAchievementTableEntry>
+      const std::vector<kernel::util::XdbfAchievementTableEntry>&
           achievement_list = db.GetAchievements();
       for (const kernel::util::XdbfAchievementTableEntry& entry :
            achievement_list) {
@@ -1106,6 +1398,9 @@ X_STATUS Emulator::CompleteLaunch(const std::filesystem::path& path,
 
   // Apply game-specific compatibility fixes if available
   if (title_id_.has_value() && title_id_.value() != 0) {
+    if (!cvars::compatibility_record_settings.empty()) {
+      RecordCompatibilitySettings(title_id_.value());
+    }
     auto& compat_db = game_compatibility::GameCompatibilityDatabase::GetInstance();
     if (compat_db.HasGameInfo(title_id_.value())) {
       auto game_info = compat_db.GetGameInfo(title_id_.value());
@@ -1161,20 +1456,67 @@ X_STATUS Emulator::CompleteLaunch(const std::filesystem::path& path,
     }
   }
 
+  std::filesystem::path boot_snapshot_path = GetBootSnapshotPath();
+  bool restore_boot_snapshot = !boot_snapshot_path.empty() &&
+                               std::filesystem::exists(boot_snapshot_path);
+
   // Initializing the shader storage in a blocking way so the user doesn't miss
   // the initial seconds - for instance, sound from an intro video may start
   // playing before the video can be seen if doing this in parallel with the
-  // main thread.
-  on_shader_storage_initialization(true);
+  // main thread. The seconds after booting are restored from the boot snapshot
+  // though.
+  on_shader_storage_initialization(!restore_boot_snapshot);
+  startup_timeline::BeginPhase("Shader storage preload");
   graphics_system_->InitializeShaderStorage(cache_root_, title_id_.value(),
-                                            true);
+                                            !restore_boot_snapshot);
+  startup_timeline::EndPhase("Shader storage preload");
   on_shader_storage_initialization(false);
 
-  auto main_thread = kernel_state_->LaunchModule(module);
-  if (!main_thread) {
-    return X_STATUS_UNSUCCESSFUL;
+  if (restore_boot_snapshot) {
+    startup_timeline::BeginPhase("Boot snapshot restore");
+    bool restored = RestoreFromFile(boot_snapshot_path);
+    startup_timeline::EndPhase("Boot snapshot restore");
+    if (!restored) {
+      // The title has already been terminated for the restore. Booting
+      // normally on the next launch.
+      XELOGE("Failed to restore the boot snapshot {}, deleting it",
+             xe::path_to_utf8(boot_snapshot_path));
+      std::error_code error_code;
+      std::filesystem::remove(boot_snapshot_path, error_code);
+      return X_STATUS_UNSUCCESSFUL;
+    }
+    XELOGI("Restored the boot snapshot {}",
+           xe::path_to_utf8(boot_snapshot_path));
+  } else {
+    startup_timeline::BeginPhase("KernelState::LaunchModule");
+    auto main_thread = kernel_state_->LaunchModule(module);
+    startup_timeline::EndPhase("KernelState::LaunchModule");
+    if (!main_thread) {
+      return X_STATUS_UNSUCCESSFUL;
+    }
+    main_thread_ = main_thread;
+
+    if (!boot_snapshot_path.empty()) {
+      boot_snapshot_timer_ = threading::QueueTimerOnce(
+          [this, boot_snapshot_path](void*) {
+            display_window_->app_context().CallInUIThread(
+                [this, boot_snapshot_path]() {
+                  // The title may have been relaunched meanwhile.
+                  if (GetBootSnapshotPath() != boot_snapshot_path ||
+                      !xe::filesystem::CreateParentFolder(
+                          boot_snapshot_path)) {
+                    return;
+                  }
+                  XELOGI("Saving the boot snapshot {}",
+                         xe::path_to_utf8(boot_snapshot_path));
+                  SaveToFile(boot_snapshot_path);
+                });
+          },
+          nullptr,
+          threading::TimerQueueWaitItem::clock::now() +
+              std::chrono::seconds(cvars::boot_snapshot_delay));
+    }
   }
-  main_thread_ = main_thread;
   on_launch(title_id_.value(), title_name_);
 
   return X_STATUS_SUCCESS;
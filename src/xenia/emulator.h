@@ -13,12 +13,14 @@
 #include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <optional>
 #include <string>
 #include <vector>
 
 #include "xenia/base/delegate.h"
 #include "xenia/base/exception_handler.h"
+#include "xenia/base/threading_timer_queue.h"
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/memory.h"
 #include "xenia/vfs/virtual_file_system.h"
@@ -48,7 +50,8 @@ class Window;
 
 namespace xe {
 
-constexpr fourcc_t kEmulatorSaveSignature = make_fourcc("XSAV");
+// Changed along with incompatible changes to the format of save states.
+constexpr fourcc_t kEmulatorSaveSignature = make_fourcc("XSV2");
 
 // The main type that runs the whole emulator.
 // This is responsible for initializing and managing all the various subsystems.
@@ -224,6 +227,17 @@ class Emulator {
 
   std::string FindLaunchModule();
 
+  // Waits for the save state being written in the background, if any.
+  void WaitForSaveState();
+
+  // The state of the title saved once it has booted with boot_snapshot, for
+  // the current title and executable, or an empty path if not applicable.
+  std::filesystem::path GetBootSnapshotPath() const;
+  std::filesystem::path GetCompatibilityDatabasePath() const;
+  // Records compatibility_record_settings for the title as a game fix.
+  void RecordCompatibilitySettings(uint32_t title_id);
+  void CancelBootSnapshot();
+
   X_STATUS CompleteLaunch(const std::filesystem::path& path,
                           const std::string_view module_path);
 
@@ -265,6 +279,11 @@ class Emulator {
   bool paused_;
   bool restoring_;
   threading::Fence restore_fence_;  // Fired on restore finish.
+
+  // Writes the memory of the last save state with save_state_in_background.
+  std::unique_ptr<threading::Thread> save_state_thread_;
+  // Fires when the boot snapshot of the title launched last is to be saved.
+  std::weak_ptr<threading::TimerQueueWaitItem> boot_snapshot_timer_;
 };
 
 }  // namespace xe
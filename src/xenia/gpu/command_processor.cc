@@ -22,14 +22,17 @@
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/byte_stream.h"
+#include "xenia/base/frame_breakdown.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/ring_buffer.h"
+#include "xenia/base/startup_timeline.h"
 #include "xenia/gpu/gpu_flags.h"
 #include "xenia/gpu/graphics_system.h"
 #include "xenia/gpu/sampler_info.h"
+#include "xenia/gpu/texture_dump.h"
 #include "xenia/gpu/texture_info.h"
 #include "xenia/gpu/xenos.h"
 #include "xenia/kernel/kernel_state.h"
@@ -94,6 +97,9 @@ void CommandProcessor::Shutdown() {
   write_ptr_index_event_->Set();
   worker_thread_->Wait(0, 0, 0, nullptr);
   worker_thread_.reset();
+
+  pipeline_compile_log_.LogSummary();
+  FlushTextureDumps();
 }
 
 void CommandProcessor::InitializeShaderStorage(
@@ -259,8 +265,8 @@ void CommandProcessor::WorkerThreadMain() {
     // Execute. Note that we handle wraparound transparently.
     read_ptr_index_ = ExecutePrimaryBuffer(read_ptr_index_, write_ptr_index);
 
-    // TODO(benvanik): use reader->Read_update_freq_ and only issue after moving
-    //     that many indices.
+    // Intermediate positions are reported during execution every
+    // read_ptr_update_freq_ dwords, the final one is reported here.
     if (read_ptr_writeback_ptr_) {
       xe::store_and_swap<uint32_t>(
           memory_->TranslatePhysical(read_ptr_writeback_ptr_), read_ptr_index_);
@@ -396,9 +402,14 @@ void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
         bool write_gamma_ramp_component =
             (regs[XE_GPU_REG_DC_LUT_WRITE_EN_MASK] &
              (UINT32_C(1) << (2 - gamma_ramp_rw_component_))) != 0;
+        // Games may rewrite the same gamma ramp every frame - only notify the
+        // implementation about actual changes so it doesn't upload the ramp
+        // again.
+        bool gamma_ramp_changed = false;
         if (write_gamma_ramp_component) {
           reg::DC_LUT_30_COLOR& gamma_ramp_entry =
               gamma_ramp_256_entry_table_[gamma_ramp_rw_index.rw_index];
+          reg::DC_LUT_30_COLOR gamma_ramp_entry_old = gamma_ramp_entry;
           // Bits 0:5 are hardwired to zero.
           uint32_t gamma_ramp_seq_color =
               regs.Get<reg::DC_LUT_SEQ_COLOR>().seq_color >> 6;
@@ -413,6 +424,8 @@ void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
               gamma_ramp_entry.color_10_blue = gamma_ramp_seq_color;
               break;
           }
+          gamma_ramp_changed =
+              gamma_ramp_entry.value != gamma_ramp_entry_old.value;
         }
         if (++gamma_ramp_rw_component_ >= 3) {
           gamma_ramp_rw_component_ = 0;
@@ -422,7 +435,7 @@ void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
               XE_GPU_REG_DC_LUT_RW_INDEX,
               xe::memory::Reinterpret<uint32_t>(new_gamma_ramp_rw_index));
         }
-        if (write_gamma_ramp_component) {
+        if (gamma_ramp_changed) {
           OnGammaRamp256EntryTableValueWritten();
         }
       } break;
@@ -438,14 +451,18 @@ void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
         bool write_gamma_ramp_component =
             (regs[XE_GPU_REG_DC_LUT_WRITE_EN_MASK] &
              (UINT32_C(1) << (2 - gamma_ramp_rw_component_))) != 0;
+        bool gamma_ramp_changed = false;
         if (write_gamma_ramp_component) {
           reg::DC_LUT_PWL_DATA& gamma_ramp_entry =
               gamma_ramp_pwl_rgb_[gamma_ramp_rw_index_pwl]
                                  [gamma_ramp_rw_component_];
+          reg::DC_LUT_PWL_DATA gamma_ramp_entry_old = gamma_ramp_entry;
           auto gamma_ramp_value = regs.Get<reg::DC_LUT_PWL_DATA>();
           // Bits 0:5 are hardwired to zero.
           gamma_ramp_entry.base = gamma_ramp_value.base & ~UINT32_C(0x3F);
           gamma_ramp_entry.delta = gamma_ramp_value.delta & ~UINT32_C(0x3F);
+          gamma_ramp_changed =
+              gamma_ramp_entry.value != gamma_ramp_entry_old.value;
         }
         if (++gamma_ramp_rw_component_ >= 3) {
           gamma_ramp_rw_component_ = 0;
@@ -461,7 +478,7 @@ void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
               XE_GPU_REG_DC_LUT_RW_INDEX,
               xe::memory::Reinterpret<uint32_t>(new_gamma_ramp_rw_index));
         }
-        if (write_gamma_ramp_component) {
+        if (gamma_ramp_changed) {
           OnGammaRampPWLValueWritten();
         }
       } break;
@@ -472,9 +489,11 @@ void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
         auto gamma_ramp_rw_index = regs.Get<reg::DC_LUT_RW_INDEX>();
         uint32_t gamma_ramp_write_enable_mask =
             regs[XE_GPU_REG_DC_LUT_WRITE_EN_MASK] & 0b111;
+        bool gamma_ramp_changed = false;
         if (gamma_ramp_write_enable_mask) {
           reg::DC_LUT_30_COLOR& gamma_ramp_entry =
               gamma_ramp_256_entry_table_[gamma_ramp_rw_index.rw_index];
+          reg::DC_LUT_30_COLOR gamma_ramp_entry_old = gamma_ramp_entry;
           auto gamma_ramp_value = regs.Get<reg::DC_LUT_30_COLOR>();
           if (gamma_ramp_write_enable_mask & 0b001) {
             gamma_ramp_entry.color_10_blue = gamma_ramp_value.color_10_blue;
@@ -485,6 +504,8 @@ void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
           if (gamma_ramp_write_enable_mask & 0b100) {
             gamma_ramp_entry.color_10_red = gamma_ramp_value.color_10_red;
           }
+          gamma_ramp_changed =
+              gamma_ramp_entry.value != gamma_ramp_entry_old.value;
         }
         // TODO(Triang3l): Should this reset the component write index? If this
         // increase is assumed to behave like a full DC_LUT_RW_INDEX write, it
@@ -496,7 +517,7 @@ void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
         WriteRegister(
             XE_GPU_REG_DC_LUT_RW_INDEX,
             xe::memory::Reinterpret<uint32_t>(new_gamma_ramp_rw_index));
-        if (gamma_ramp_write_enable_mask) {
+        if (gamma_ramp_changed) {
           OnGammaRamp256EntryTableValueWritten();
         }
       } break;
@@ -504,6 +525,69 @@ void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
   }
 }
 
+void CommandProcessor::WriteRegisterRange(uint32_t first_index,
+                                          const uint32_t* values_guest,
+                                          uint32_t count) {
+  uint32_t end_index = first_index + count;
+  uint32_t index = first_index;
+  while (index < end_index) {
+    if (index < XE_GPU_REG_SHADER_CONSTANT_000_X ||
+        index > XE_GPU_REG_SHADER_CONSTANT_LOOP_31) {
+      WriteRegister(index, xe::byte_swap(values_guest[index - first_index]));
+      ++index;
+      continue;
+    }
+    uint32_t constant_count =
+        std::min(end_index, uint32_t(XE_GPU_REG_SHADER_CONSTANT_LOOP_31 + 1)) -
+        index;
+    xe::copy_and_swap_32_unaligned(register_file_->values + index,
+                                   values_guest + (index - first_index),
+                                   constant_count);
+    OnShaderConstantsWritten(index, constant_count);
+    index += constant_count;
+  }
+}
+
+void CommandProcessor::WriteRegisterRangeFromRing(RingBuffer* reader,
+                                                  uint32_t first_index,
+                                                  uint32_t count) {
+  RingBuffer::ReadRange read_range =
+      reader->BeginRead(sizeof(uint32_t) * count);
+  uint32_t first_count = uint32_t(read_range.first_length / sizeof(uint32_t));
+  WriteRegisterRange(first_index,
+                     reinterpret_cast<const uint32_t*>(read_range.first),
+                     first_count);
+  if (read_range.second) {
+    WriteRegisterRange(
+        first_index + first_count,
+        reinterpret_cast<const uint32_t*>(read_range.second),
+        uint32_t(read_range.second_length / sizeof(uint32_t)));
+  }
+  reader->EndRead(read_range);
+}
+
+uint32_t CommandProcessor::GatherFloatConstants(
+    const RegisterFile& regs, bool pixel, const uint64_t* float_constant_map,
+    float* dest) {
+  uint32_t first_register = pixel ? XE_GPU_REG_SHADER_CONSTANT_256_X
+                                  : XE_GPU_REG_SHADER_CONSTANT_000_X;
+  float* dest_start = dest;
+  for (uint32_t i = 0; i < 4; ++i) {
+    uint64_t float_constant_map_entry = float_constant_map[i];
+    uint32_t float_constant_index;
+    while (xe::bit_scan_forward(float_constant_map_entry,
+                                &float_constant_index)) {
+      float_constant_map_entry &= ~(1ull << float_constant_index);
+      std::memcpy(dest,
+                  &regs.values[first_register + (i << 8) +
+                               (float_constant_index << 2)],
+                  sizeof(float) * 4);
+      dest += 4;
+    }
+  }
+  return uint32_t(sizeof(float) * (dest - dest_start));
+}
+
 void CommandProcessor::MakeCoherent() {
   SCOPE_profile_cpu_f("gpu");
 
@@ -544,7 +628,10 @@ void CommandProcessor::MakeCoherent() {
   regs_volatile[XE_GPU_REG_COHER_STATUS_HOST] = 0;
 }
 
-void CommandProcessor::PrepareForWait() { trace_writer_.Flush(); }
+void CommandProcessor::PrepareForWait() {
+  CompletePendingReadbacks();
+  trace_writer_.Flush();
+}
 
 void CommandProcessor::ReturnFromWait() {}
 
@@ -577,6 +664,9 @@ uint32_t CommandProcessor::ExecutePrimaryBuffer(uint32_t read_index,
                     primary_buffer_size_);
   reader.set_read_offset(read_index * sizeof(uint32_t));
   reader.set_write_offset(write_index * sizeof(uint32_t));
+  uint32_t read_ptr_written_back_index = read_index;
+  uint32_t primary_buffer_size_dwords =
+      primary_buffer_size_ / sizeof(uint32_t);
   do {
     if (!ExecutePacket(&reader)) {
       // This probably should be fatal - but we're going to continue anyways.
@@ -584,6 +674,24 @@ uint32_t CommandProcessor::ExecutePrimaryBuffer(uint32_t read_index,
       assert_always();
       break;
     }
+    // Like the CP, report the progress every RB_BLKSZ rather than only after
+    // the whole range has been executed, so the guest waiting for space in the
+    // ring buffer is not stalled until all the draws in the range have been
+    // submitted to the host. Packets before the read pointer have been fully
+    // consumed by this point, so the guest may overwrite them.
+    if (read_ptr_writeback_ptr_) {
+      uint32_t read_ptr_index =
+          uint32_t(reader.read_offset() / sizeof(uint32_t));
+      if ((read_ptr_index + primary_buffer_size_dwords -
+           read_ptr_written_back_index) %
+              primary_buffer_size_dwords >=
+          read_ptr_update_freq_) {
+        xe::store_and_swap<uint32_t>(
+            memory_->TranslatePhysical(read_ptr_writeback_ptr_),
+            read_ptr_index);
+        read_ptr_written_back_index = read_ptr_index;
+      }
+    }
   } while (reader.read_count());
 
   OnPrimaryBufferEnd();
@@ -671,10 +779,12 @@ bool CommandProcessor::ExecutePacketType0(RingBuffer* reader, uint32_t packet) {
 
   uint32_t base_index = (packet & 0x7FFF);
   uint32_t write_one_reg = (packet >> 15) & 0x1;
-  for (uint32_t m = 0; m < count; m++) {
-    uint32_t reg_data = reader->ReadAndSwap<uint32_t>();
-    uint32_t target_index = write_one_reg ? base_index : base_index + m;
-    WriteRegister(target_index, reg_data);
+  if (write_one_reg) {
+    for (uint32_t m = 0; m < count; m++) {
+      WriteRegister(base_index, reader->ReadAndSwap<uint32_t>());
+    }
+  } else {
+    WriteRegisterRangeFromRing(reader, base_index, count);
   }
 
   trace_writer_.WritePacketEnd();
@@ -925,6 +1035,7 @@ bool CommandProcessor::ExecutePacketType3_INTERRUPT(RingBuffer* reader,
 
   // generate interrupt from the command stream
   uint32_t cpu_mask = reader->ReadAndSwap<uint32_t>();
+  CompletePendingReadbacks();
   for (int n = 0; n < 6; n++) {
     if (cpu_mask & (1 << n)) {
       graphics_system_->DispatchInterruptCallback(1, n);
@@ -956,8 +1067,11 @@ bool CommandProcessor::ExecutePacketType3_XE_SWAP(RingBuffer* reader,
   reader->AdvanceRead((count - 4) * sizeof(uint32_t));
 
   IssueSwap(frontbuffer_ptr, frontbuffer_width, frontbuffer_height);
+  startup_timeline::OnGuestSwap();
+  frame_breakdown::OnGuestSwap();
 
   ++counter_;
+  swap_count_.fetch_add(1, std::memory_order_relaxed);
   return true;
 }
 
@@ -1104,6 +1218,7 @@ bool CommandProcessor::ExecutePacketType3_REG_TO_MEM(RingBuffer* reader,
   auto endianness = static_cast<xenos::Endian>(mem_addr & 0x3);
   mem_addr &= ~0x3;
   reg_val = GpuSwap(reg_val, endianness);
+  CompletePendingReadbacks();
   xe::store(memory_->TranslatePhysical(mem_addr), reg_val);
   trace_writer_.WriteMemoryWrite(CpuToGpu(mem_addr), 4);
 
@@ -1114,6 +1229,7 @@ bool CommandProcessor::ExecutePacketType3_MEM_WRITE(RingBuffer* reader,
                                                     uint32_t packet,
                                                     uint32_t count) {
   uint32_t write_addr = reader->ReadAndSwap<uint32_t>();
+  CompletePendingReadbacks();
   for (uint32_t i = 0; i < count - 1; i++) {
     uint32_t write_data = reader->ReadAndSwap<uint32_t>();
 
@@ -1185,6 +1301,7 @@ bool CommandProcessor::ExecutePacketType3_COND_WRITE(RingBuffer* reader,
       auto endianness = static_cast<xenos::Endian>(write_reg_addr & 0x3);
       write_reg_addr &= ~0x3;
       write_data = GpuSwap(write_data, endianness);
+      CompletePendingReadbacks();
       xe::store(memory_->TranslatePhysical(write_reg_addr), write_data);
       trace_writer_.WriteMemoryWrite(CpuToGpu(write_reg_addr), 4);
     } else {
@@ -1232,6 +1349,8 @@ bool CommandProcessor::ExecutePacketType3_EVENT_WRITE_SHD(RingBuffer* reader,
   auto endianness = static_cast<xenos::Endian>(address & 0x3);
   address &= ~0x3;
   data_value = GpuSwap(data_value, endianness);
+  // Usually a fence the guest waits for before accessing what has been drawn.
+  CompletePendingReadbacks();
   xe::store(memory_->TranslatePhysical(address), data_value);
   trace_writer_.WriteMemoryWrite(CpuToGpu(address), 4);
   return true;
@@ -1279,12 +1398,31 @@ bool CommandProcessor::ExecutePacketType3_EVENT_WRITE_ZPD(RingBuffer* reader,
 
   // Occlusion queries:
   // This command is send on query begin and end.
+  uint32_t sample_count_address =
+      register_file_->values[XE_GPU_REG_RB_SAMPLE_COUNT_ADDR];
+  if (cvars::query_occlusion_host) {
+    auto* sample_counts =
+        memory_->TranslatePhysical<xe_gpu_depth_sample_counts*>(
+            sample_count_address);
+    if ((sample_counts->ZPass_A == kQueryFinished &&
+         sample_counts->ZPass_B == kQueryFinished) ||
+        (sample_counts->ZFail_A == kQueryFinished &&
+         sample_counts->ZFail_B == kQueryFinished)) {
+      // Keeping the end markers until the host query result is written.
+      if (EndOcclusionQuery(sample_count_address)) {
+        return true;
+      }
+    } else if (BeginOcclusionQuery()) {
+      std::memset(sample_counts, 0, sizeof(xe_gpu_depth_sample_counts));
+      return true;
+    }
+  }
   // As a workaround report some fixed amount of passed samples.
   auto fake_sample_count = cvars::query_occlusion_fake_sample_count;
   if (fake_sample_count >= 0) {
     auto* pSampleCounts =
         memory_->TranslatePhysical<xe_gpu_depth_sample_counts*>(
-            register_file_->values[XE_GPU_REG_RB_SAMPLE_COUNT_ADDR]);
+            sample_count_address);
     // 0xFFFFFEED is written to this two locations by D3D only on D3DISSUE_END
     // and used to detect a finished query.
     bool is_end_via_z_pass = pSampleCounts->ZPass_A == kQueryFinished &&
@@ -1302,6 +1440,21 @@ bool CommandProcessor::ExecutePacketType3_EVENT_WRITE_ZPD(RingBuffer* reader,
   return true;
 }
 
+void CommandProcessor::WriteOcclusionQueryResult(uint32_t sample_count_address,
+                                                 uint64_t sample_count) {
+  auto* sample_counts =
+      memory_->TranslatePhysical<xe_gpu_depth_sample_counts*>(
+          sample_count_address);
+  std::memset(sample_counts, 0, sizeof(xe_gpu_depth_sample_counts));
+  // The begin counts are zero, so the end counts are the passed samples.
+  uint32_t sample_count_32 =
+      uint32_t(std::min(sample_count, uint64_t(UINT32_MAX)));
+  sample_counts->ZPass_A = sample_count_32;
+  sample_counts->Total_A = sample_count_32;
+  trace_writer_.WriteMemoryWrite(CpuToGpu(sample_count_address),
+                                 sizeof(xe_gpu_depth_sample_counts));
+}
+
 bool CommandProcessor::ExecutePacketType3Draw(RingBuffer* reader,
                                               uint32_t packet,
                                               const char* opcode_name,
@@ -1476,10 +1629,7 @@ bool CommandProcessor::ExecutePacketType3_SET_CONSTANT(RingBuffer* reader,
       reader->AdvanceRead((count - 1) * sizeof(uint32_t));
       return true;
   }
-  for (uint32_t n = 0; n < count - 1; n++, index++) {
-    uint32_t data = reader->ReadAndSwap<uint32_t>();
-    WriteRegister(index, data);
-  }
+  WriteRegisterRangeFromRing(reader, index, count - 1);
   return true;
 }
 
@@ -1488,10 +1638,7 @@ bool CommandProcessor::ExecutePacketType3_SET_CONSTANT2(RingBuffer* reader,
                                                         uint32_t count) {
   uint32_t offset_type = reader->ReadAndSwap<uint32_t>();
   uint32_t index = offset_type & 0xFFFF;
-  for (uint32_t n = 0; n < count - 1; n++, index++) {
-    uint32_t data = reader->ReadAndSwap<uint32_t>();
-    WriteRegister(index, data);
-  }
+  WriteRegisterRangeFromRing(reader, index, count - 1);
   return true;
 }
 
@@ -1527,11 +1674,10 @@ bool CommandProcessor::ExecutePacketType3_LOAD_ALU_CONSTANT(RingBuffer* reader,
       return true;
   }
   trace_writer_.WriteMemoryRead(CpuToGpu(address), size_dwords * 4);
-  for (uint32_t n = 0; n < size_dwords; n++, index++) {
-    uint32_t data = xe::load_and_swap<uint32_t>(
-        memory_->TranslatePhysical(address + n * 4));
-    WriteRegister(index, data);
-  }
+  WriteRegisterRange(
+      index,
+      reinterpret_cast<const uint32_t*>(memory_->TranslatePhysical(address)),
+      size_dwords);
   return true;
 }
 
@@ -1539,10 +1685,7 @@ bool CommandProcessor::ExecutePacketType3_SET_SHADER_CONSTANTS(
     RingBuffer* reader, uint32_t packet, uint32_t count) {
   uint32_t offset_type = reader->ReadAndSwap<uint32_t>();
   uint32_t index = offset_type & 0xFFFF;
-  for (uint32_t n = 0; n < count - 1; n++, index++) {
-    uint32_t data = reader->ReadAndSwap<uint32_t>();
-    WriteRegister(index, data);
-  }
+  WriteRegisterRangeFromRing(reader, index, count - 1);
   return true;
 }
 
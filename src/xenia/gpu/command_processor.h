@@ -21,6 +21,7 @@
 
 #include "xenia/base/ring_buffer.h"
 #include "xenia/base/threading.h"
+#include "xenia/gpu/pipeline_compile_log.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/registers.h"
 #include "xenia/gpu/trace_writer.h"
@@ -79,6 +80,12 @@ class CommandProcessor {
 
   uint32_t counter() const { return counter_; }
   void increment_counter() { counter_++; }
+  // Guest frames swapped so far, can be read from any thread.
+  uint64_t swap_count() const {
+    return swap_count_.load(std::memory_order_relaxed);
+  }
+  // Filled by the pipeline cache of the backend.
+  PipelineCompileLog& pipeline_compile_log() { return pipeline_compile_log_; }
 
   Shader* active_vertex_shader() const { return active_vertex_shader_; }
   Shader* active_pixel_shader() const { return active_pixel_shader_; }
@@ -90,6 +97,31 @@ class CommandProcessor {
 
   virtual void ClearCaches();
 
+  // Cumulative counts of the work done by the host caches, for benchmarking.
+  struct CacheStatistics {
+    uint64_t pipelines_created = 0;
+    uint64_t textures_created = 0;
+    uint64_t texture_loads = 0;
+    // Invalidated textures with unchanged data that haven't been loaded again.
+    uint64_t texture_reloads_skipped = 0;
+    // Render target memory traffic at render pass boundaries, estimated from
+    // the attachment load and store operations (currently only on Vulkan).
+    uint64_t render_passes_begun = 0;
+    uint64_t attachment_load_bytes = 0;
+    uint64_t attachment_store_bytes = 0;
+    // With draw resolution scaling - not cumulative, the current amounts.
+    uint64_t scaled_resolve_committed_bytes = 0;
+    uint64_t scaled_resolve_used_bytes = 0;
+    // Cumulative.
+    uint64_t scaled_resolve_on_demand_commits = 0;
+  };
+  virtual void GetCacheStatistics(CacheStatistics& statistics_out) const {
+    statistics_out = CacheStatistics();
+  }
+  // Submits the pending host GPU work and waits for all of it to be completed.
+  // Must be called from the command processor thread.
+  virtual void AwaitHostGpuIdle() {}
+
   // "Desired" is for the external thread managing the post-processing effect.
   SwapPostEffect GetDesiredSwapPostEffect() const {
     return swap_post_effect_desired_;
@@ -152,6 +184,42 @@ class CommandProcessor {
   virtual void ShutdownContext() = 0;
 
   virtual void WriteRegister(uint32_t index, uint32_t value);
+  // Writes consecutive registers, with the values in the guest byte order.
+  // Shader constants don't need any special handling on write, so they are
+  // copied to the register file directly, and OnShaderConstantsWritten is
+  // called once for the whole copied range rather than WriteRegister for each.
+  void WriteRegisterRange(uint32_t first_index, const uint32_t* values_guest,
+                          uint32_t count);
+  void WriteRegisterRangeFromRing(RingBuffer* reader, uint32_t first_index,
+                                  uint32_t count);
+  // Called after the shader constant registers from first_index to
+  // first_index + count - 1 (float, fetch, bool and loop constants) have been
+  // written by WriteRegisterRange.
+  virtual void OnShaderConstantsWritten(uint32_t first_index, uint32_t count) {}
+  // Copies the float constants of the vertex or the pixel shader marked in a
+  // 256-bit map of the constants used by the shader, packed in the order of
+  // their indices. Returns the number of bytes written.
+  static uint32_t GatherFloatConstants(const RegisterFile& regs, bool pixel,
+                                       const uint64_t* float_constant_map,
+                                       float* dest);
+  // Whether any float constant from first to last (inclusive) is marked in a
+  // 256-bit map of the float constants used by a shader.
+  static bool AreFloatConstantsInMap(const uint64_t* float_constant_map,
+                                     uint32_t first, uint32_t last) {
+    for (uint32_t i = first >> 6; i <= last >> 6; ++i) {
+      uint64_t mask = ~uint64_t(0);
+      if (i == first >> 6) {
+        mask &= ~uint64_t(0) << (first & 63);
+      }
+      if (i == last >> 6) {
+        mask &= ~uint64_t(0) >> (63 - (last & 63));
+      }
+      if (float_constant_map[i] & mask) {
+        return true;
+      }
+    }
+    return false;
+  }
 
   const reg::DC_LUT_30_COLOR* gamma_ramp_256_entry_table() const {
     return gamma_ramp_256_entry_table_;
@@ -162,6 +230,26 @@ class CommandProcessor {
   virtual void OnGammaRamp256EntryTableValueWritten() {}
   virtual void OnGammaRampPWLValueWritten() {}
 
+  // Occlusion queries on EVENT_WRITE_ZPD. If the backend returns true from
+  // BeginOcclusionQuery, the samples passing the depth and stencil tests in the
+  // draws until EndOcclusionQuery need to be counted, and the result must be
+  // written via WriteOcclusionQueryResult, to the sample count address passed
+  // to EndOcclusionQuery, eventually (until then, the guest sees the query as
+  // not finished yet). The backend must return true from EndOcclusionQuery if
+  // it has taken ownership of the result.
+  virtual bool BeginOcclusionQuery() { return false; }
+  virtual bool EndOcclusionQuery(uint32_t sample_count_address) {
+    return false;
+  }
+  void WriteOcclusionQueryResult(uint32_t sample_count_address,
+                                 uint64_t sample_count);
+
+  // Called before the command processor makes the progress of the GPU visible
+  // to the guest CPU (writing fences, raising interrupts, waiting), so the
+  // data written by the GPU that the backend copies to the guest memory
+  // asynchronously must be in the guest memory when this returns.
+  virtual void CompletePendingReadbacks() {}
+
   virtual void MakeCoherent();
   virtual void PrepareForWait();
   virtual void ReturnFromWait();
@@ -270,6 +358,8 @@ class CommandProcessor {
   std::vector<uint32_t> me_bin_;
 
   uint32_t counter_ = 0;
+  std::atomic<uint64_t> swap_count_{0};
+  PipelineCompileLog pipeline_compile_log_;
 
   uint32_t primary_buffer_ptr_ = 0;
   uint32_t primary_buffer_size_ = 0;
@@ -19,6 +19,7 @@
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/gpu/d3d12/d3d12_command_processor.h"
 #include "xenia/gpu/d3d12/d3d12_graphics_system.h"
 #include "xenia/gpu/d3d12/d3d12_shader.h"
@@ -37,14 +38,16 @@ DEFINE_bool(d3d12_readback_memexport, false,
             "Read data written by memory export in shaders on the CPU. This "
             "may be needed in some games (but many only access exported data "
             "on the GPU, and this flag isn't needed to handle such behavior), "
-            "but causes mid-frame synchronization, so it has a huge "
-            "performance impact.",
+            "but the data is copied to the guest memory when the guest "
+            "synchronizes with the GPU, which may cause the CPU to wait for "
+            "the GPU, so it has a performance impact.",
             "D3D12");
 DEFINE_bool(d3d12_readback_resolve, false,
             "Read render-to-texture results on the CPU. This may be needed in "
             "some games, for instance, for screenshots in saved games, but "
-            "causes mid-frame synchronization, so it has a huge performance "
-            "impact.",
+            "the data is copied to the guest memory when the guest "
+            "synchronizes with the GPU, which may cause the CPU to wait for "
+            "the GPU, so it has a performance impact.",
             "D3D12");
 DEFINE_bool(d3d12_submit_on_primary_buffer_end, true,
             "Submit the command list when a PM4 primary buffer ends if it's "
@@ -76,10 +79,38 @@ void D3D12CommandProcessor::ClearCaches() {
   cache_clear_requested_ = true;
 }
 
+void D3D12CommandProcessor::GetCacheStatistics(
+    CacheStatistics& statistics_out) const {
+  statistics_out.pipelines_created =
+      pipeline_cache_ ? pipeline_cache_->pipelines_created() : 0;
+  statistics_out.textures_created =
+      texture_cache_ ? texture_cache_->textures_created() : 0;
+  statistics_out.texture_loads =
+      texture_cache_ ? texture_cache_->texture_loads() : 0;
+  statistics_out.texture_reloads_skipped =
+      texture_cache_ ? texture_cache_->texture_reloads_skipped() : 0;
+  if (texture_cache_) {
+    statistics_out.scaled_resolve_committed_bytes =
+        texture_cache_->scaled_resolve_committed_bytes();
+    statistics_out.scaled_resolve_used_bytes =
+        texture_cache_->GetScaledResolveUsedBytes();
+    statistics_out.scaled_resolve_on_demand_commits =
+        texture_cache_->scaled_resolve_on_demand_commits();
+  }
+}
+
+void D3D12CommandProcessor::AwaitHostGpuIdle() {
+  EndSubmission(false);
+  AwaitAllQueueOperationsCompletion();
+}
+
 void D3D12CommandProcessor::InitializeShaderStorage(
     const std::filesystem::path& cache_root, uint32_t title_id, bool blocking) {
   CommandProcessor::InitializeShaderStorage(cache_root, title_id, blocking);
   pipeline_cache_->InitializeShaderStorage(cache_root, title_id, blocking);
+  if (texture_cache_) {
+    texture_cache_->InitializeScaledResolveStorage(cache_root, title_id);
+  }
 }
 
 void D3D12CommandProcessor::RequestFrameTrace(
@@ -873,6 +904,8 @@ bool D3D12CommandProcessor::SetupContext() {
       provider,
       std::max(ui::d3d12::D3D12UploadBufferPool::kDefaultPageSize,
                sizeof(float) * 4 * D3D12_REQ_CONSTANT_BUFFER_ELEMENT_COUNT));
+  readback_buffer_pool_ = std::make_unique<ui::d3d12::D3D12UploadBufferPool>(
+      provider, kReadbackBufferPoolPageSize, true);
   if (bindless_resources_used_) {
     D3D12_DESCRIPTOR_HEAP_DESC view_bindless_heap_desc;
     view_bindless_heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
@@ -1578,6 +1611,65 @@ bool D3D12CommandProcessor::SetupContext() {
                           uint32_t(SystemBindlessView::kGammaRampPWLSRV)));
   }
 
+  // Occlusion queries - if unavailable, the fake sample count will be
+  // reported.
+  D3D12_QUERY_HEAP_DESC occlusion_query_heap_desc;
+  occlusion_query_heap_desc.Type = D3D12_QUERY_HEAP_TYPE_OCCLUSION;
+  occlusion_query_heap_desc.Count = kOcclusionQueryCount;
+  occlusion_query_heap_desc.NodeMask = 0;
+  if (SUCCEEDED(device->CreateQueryHeap(
+          &occlusion_query_heap_desc, IID_PPV_ARGS(&occlusion_query_heap_)))) {
+    D3D12_RESOURCE_DESC occlusion_query_readback_buffer_desc;
+    ui::d3d12::util::FillBufferResourceDesc(
+        occlusion_query_readback_buffer_desc,
+        sizeof(uint64_t) * kOcclusionQueryCount, D3D12_RESOURCE_FLAG_NONE);
+    if (FAILED(device->CreateCommittedResource(
+            &ui::d3d12::util::kHeapPropertiesReadback,
+            provider.GetHeapFlagCreateNotZeroed(),
+            &occlusion_query_readback_buffer_desc,
+            D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+            IID_PPV_ARGS(&occlusion_query_readback_buffer_)))) {
+      XELOGE("Failed to create the occlusion query readback buffer");
+      ui::d3d12::util::ReleaseAndNull(occlusion_query_heap_);
+    }
+  } else {
+    XELOGE("Failed to create the occlusion query heap");
+  }
+
+  // GPU profiling timestamps - if unavailable, the GPU scopes will be empty.
+  if (Profiler::is_enabled() &&
+      SUCCEEDED(provider.GetDirectQueue()->GetTimestampFrequency(
+          &gpu_timestamp_frequency_))) {
+    D3D12_QUERY_HEAP_DESC gpu_timestamp_heap_desc;
+    gpu_timestamp_heap_desc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+    gpu_timestamp_heap_desc.Count = kGpuTimestampCount;
+    gpu_timestamp_heap_desc.NodeMask = 0;
+    if (SUCCEEDED(device->CreateQueryHeap(
+            &gpu_timestamp_heap_desc, IID_PPV_ARGS(&gpu_timestamp_heap_)))) {
+      D3D12_RESOURCE_DESC gpu_timestamp_readback_buffer_desc;
+      ui::d3d12::util::FillBufferResourceDesc(
+          gpu_timestamp_readback_buffer_desc,
+          sizeof(uint64_t) * kGpuTimestampCount, D3D12_RESOURCE_FLAG_NONE);
+      if (SUCCEEDED(device->CreateCommittedResource(
+              &ui::d3d12::util::kHeapPropertiesReadback,
+              provider.GetHeapFlagCreateNotZeroed(),
+              &gpu_timestamp_readback_buffer_desc,
+              D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+              IID_PPV_ARGS(&gpu_timestamp_readback_buffer_)))) {
+        gpu_timestamp_values_ =
+            std::make_unique<uint64_t[]>(kGpuTimestampCount);
+        std::fill_n(gpu_timestamp_values_.get(), kGpuTimestampCount,
+                    UINT64_MAX);
+        Profiler::SetGpuTimerSource(&gpu_timer_source_);
+      } else {
+        XELOGE("Failed to create the GPU timestamp readback buffer");
+        ui::d3d12::util::ReleaseAndNull(gpu_timestamp_heap_);
+      }
+    } else {
+      XELOGE("Failed to create the GPU timestamp query heap");
+    }
+  }
+
   pix_capture_requested_.store(false, std::memory_order_relaxed);
   pix_capturing_ = false;
 
@@ -1590,8 +1682,27 @@ bool D3D12CommandProcessor::SetupContext() {
 void D3D12CommandProcessor::ShutdownContext() {
   AwaitAllQueueOperationsCompletion();
 
-  ui::d3d12::util::ReleaseAndNull(readback_buffer_);
-  readback_buffer_size_ = 0;
+  readbacks_pending_.clear();
+  readback_buffer_pool_.reset();
+
+  occlusion_queries_pending_.clear();
+  occlusion_query_host_active_ = false;
+  occlusion_query_guest_active_ = false;
+  occlusion_queries_allocated_ = 0;
+  ui::d3d12::util::ReleaseAndNull(occlusion_query_readback_buffer_);
+  ui::d3d12::util::ReleaseAndNull(occlusion_query_heap_);
+
+  if (gpu_timestamp_heap_) {
+    Profiler::SetGpuContext(nullptr);
+    Profiler::SetGpuTimerSource(nullptr);
+  }
+  gpu_timestamps_pending_.clear();
+  gpu_timestamps_allocated_ = 0;
+  gpu_timestamps_resolved_ = 0;
+  gpu_timestamps_read_ = 0;
+  gpu_timestamp_values_.reset();
+  ui::d3d12::util::ReleaseAndNull(gpu_timestamp_readback_buffer_);
+  ui::d3d12::util::ReleaseAndNull(gpu_timestamp_heap_);
 
   ui::d3d12::util::ReleaseAndNull(scratch_buffer_);
   scratch_buffer_size_ = 0;
@@ -1724,6 +1835,50 @@ void D3D12CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
   }
 }
 
+void D3D12CommandProcessor::OnShaderConstantsWritten(uint32_t first_index,
+                                                    uint32_t count) {
+  uint32_t last_index = first_index + count - 1;
+  if (frame_open_ && first_index <= XE_GPU_REG_SHADER_CONSTANT_511_W) {
+    uint32_t float_constant_first =
+        (first_index - XE_GPU_REG_SHADER_CONSTANT_000_X) >> 2;
+    uint32_t float_constant_last =
+        (std::min(last_index, uint32_t(XE_GPU_REG_SHADER_CONSTANT_511_W)) -
+         XE_GPU_REG_SHADER_CONSTANT_000_X) >>
+        2;
+    if (float_constant_first < 256 &&
+        AreFloatConstantsInMap(current_float_constant_map_vertex_,
+                               float_constant_first,
+                               std::min(float_constant_last, uint32_t(255)))) {
+      cbuffer_binding_float_vertex_.up_to_date = false;
+    }
+    if (float_constant_last >= 256 &&
+        AreFloatConstantsInMap(current_float_constant_map_pixel_,
+                               std::max(float_constant_first, uint32_t(256)) -
+                                   256,
+                               float_constant_last - 256)) {
+      cbuffer_binding_float_pixel_.up_to_date = false;
+    }
+  }
+  if (first_index <= XE_GPU_REG_SHADER_CONSTANT_FETCH_31_5 &&
+      last_index >= XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) {
+    cbuffer_binding_fetch_.up_to_date = false;
+    if (texture_cache_ != nullptr) {
+      texture_cache_->TextureFetchConstantsWritten(
+          (std::max(first_index,
+                    uint32_t(XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0)) -
+           XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) /
+              6,
+          (std::min(last_index,
+                    uint32_t(XE_GPU_REG_SHADER_CONSTANT_FETCH_31_5)) -
+           XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) /
+              6);
+    }
+  }
+  if (last_index >= XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031) {
+    cbuffer_binding_bool_loop_.up_to_date = false;
+  }
+}
+
 void D3D12CommandProcessor::OnGammaRamp256EntryTableValueWritten() {
   gamma_ramp_256_entry_table_up_to_date_ = false;
 }
@@ -2088,6 +2243,57 @@ void D3D12CommandProcessor::OnPrimaryBufferEnd() {
   }
 }
 
+bool D3D12CommandProcessor::BeginOcclusionQuery() {
+  if (!occlusion_query_heap_) {
+    return false;
+  }
+  // If the guest hasn't ended the previous query, drop it.
+  EndOcclusionQuerySegment();
+  occlusion_query_guest_active_ = true;
+  occlusion_query_guest_overflowed_ = false;
+  occlusion_query_guest_first_ = occlusion_queries_allocated_;
+  return true;
+}
+
+bool D3D12CommandProcessor::EndOcclusionQuery(uint32_t sample_count_address) {
+  if (!occlusion_query_guest_active_) {
+    return false;
+  }
+  EndOcclusionQuerySegment();
+  occlusion_query_guest_active_ = false;
+  if (occlusion_query_guest_overflowed_) {
+    return false;
+  }
+  if (occlusion_query_guest_first_ == occlusion_queries_allocated_) {
+    // Nothing has been drawn during the query.
+    WriteOcclusionQueryResult(sample_count_address, 0);
+    return true;
+  }
+  PendingOcclusionQuery& pending_query =
+      occlusion_queries_pending_.emplace_back();
+  pending_query.sample_count_address = sample_count_address;
+  pending_query.host_query_first = occlusion_query_guest_first_;
+  pending_query.host_query_end = occlusion_queries_allocated_;
+  pending_query.submission = occlusion_query_guest_last_submission_;
+  return true;
+}
+
+void D3D12CommandProcessor::CompletePendingReadbacks() {
+  if (!readbacks_pending_.empty()) {
+    CheckSubmissionFence(readbacks_pending_.back().submission);
+  }
+}
+
+void D3D12CommandProcessor::PrepareForWait() {
+  // The guest may be waiting for the results of the occlusion queries, which
+  // are only written when the submissions containing them are completed, and
+  // there's nothing else to do now anyway.
+  if (!occlusion_queries_pending_.empty()) {
+    CheckSubmissionFence(occlusion_queries_pending_.back().submission);
+  }
+  CommandProcessor::PrepareForWait();
+}
+
 Shader* D3D12CommandProcessor::LoadShader(xenos::ShaderType shader_type,
                                           uint32_t guest_address,
                                           const uint32_t* host_address,
@@ -2162,6 +2368,8 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
     return false;
   }
 
+  SCOPE_profile_gpu_i("gpu", "Draw");
+
   // Process primitives.
   PrimitiveProcessor::ProcessingResult primitive_processing_result;
   if (!primitive_processor_->Process(primitive_processing_result)) {
@@ -2426,6 +2634,8 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
   SetPrimitiveTopology(primitive_topology);
   // Must not call anything that may change the primitive topology from now on!
 
+  BeginOcclusionQuerySegment();
+
   // Draw.
   if (primitive_processing_result.index_buffer_type ==
       PrimitiveProcessor::ProcessedIndexBufferType::kNone) {
@@ -2493,15 +2703,30 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
         assert_unhandled_case(primitive_processing_result.index_buffer_type);
         return false;
     }
-    deferred_command_list_.D3DIASetIndexBuffer(&index_buffer_view);
     if (memexport_used) {
       shared_memory_->UseForWriting();
     } else {
       shared_memory_->UseForReading();
     }
     SubmitBarriers();
-    deferred_command_list_.D3DDrawIndexedInstanced(
-        primitive_processing_result.host_draw_vertex_count, 1, 0, 0, 0);
+    // Games often issue long runs of small draws with the same state, with
+    // the indices of each directly following the indices of the previous one.
+    // If nothing has been recorded since the previous draw, the host state is
+    // the same, so such draws can be done as one host draw.
+    uint32_t appendable_primitive_vertex_count =
+        scratch_index_buffer == nullptr
+            ? primitive_processing_result
+                  .GetAppendableIndicesPrimitiveVertexCount()
+            : 0;
+    if (!appendable_primitive_vertex_count ||
+        !deferred_command_list_.AppendToLastIndexedDraw(
+            index_buffer_view,
+            primitive_processing_result.host_draw_vertex_count,
+            appendable_primitive_vertex_count)) {
+      deferred_command_list_.D3DIASetIndexBuffer(&index_buffer_view);
+      deferred_command_list_.D3DDrawIndexedInstanced(
+          primitive_processing_result.host_draw_vertex_count, 1, 0, 0, 0);
+    }
     if (scratch_index_buffer != nullptr) {
       ReleaseScratchGPUBuffer(scratch_index_buffer,
                               D3D12_RESOURCE_STATE_INDEX_BUFFER);
@@ -2522,48 +2747,10 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
     }
     if (cvars::d3d12_readback_memexport) {
       // Read the exported data on the CPU.
-      uint32_t memexport_total_size = 0;
       for (const draw_util::MemExportRange& memexport_range :
            memexport_ranges_) {
-        memexport_total_size += memexport_range.size_bytes;
-      }
-      if (memexport_total_size != 0) {
-        ID3D12Resource* readback_buffer =
-            RequestReadbackBuffer(memexport_total_size);
-        if (readback_buffer != nullptr) {
-          shared_memory_->UseAsCopySource();
-          SubmitBarriers();
-          ID3D12Resource* shared_memory_buffer = shared_memory_->GetBuffer();
-          uint32_t readback_buffer_offset = 0;
-          for (const draw_util::MemExportRange& memexport_range :
-               memexport_ranges_) {
-            uint32_t memexport_range_size = memexport_range.size_bytes;
-            deferred_command_list_.D3DCopyBufferRegion(
-                readback_buffer, readback_buffer_offset, shared_memory_buffer,
-                memexport_range.base_address_dwords << 2, memexport_range_size);
-            readback_buffer_offset += memexport_range_size;
-          }
-          if (AwaitAllQueueOperationsCompletion()) {
-            D3D12_RANGE readback_range;
-            readback_range.Begin = 0;
-            readback_range.End = memexport_total_size;
-            void* readback_mapping;
-            if (SUCCEEDED(readback_buffer->Map(0, &readback_range,
-                                               &readback_mapping))) {
-              const uint8_t* readback_bytes =
-                  reinterpret_cast<const uint8_t*>(readback_mapping);
-              for (const draw_util::MemExportRange& memexport_range :
-                   memexport_ranges_) {
-                std::memcpy(memory_->TranslatePhysical(
-                                memexport_range.base_address_dwords << 2),
-                            readback_bytes, memexport_range.size_bytes);
-                readback_bytes += memexport_range.size_bytes;
-              }
-              D3D12_RANGE readback_write_range = {};
-              readback_buffer->Unmap(0, &readback_write_range);
-            }
-          }
-        }
+        ReadbackSharedMemory(memexport_range.base_address_dwords << 2,
+                             memexport_range.size_bytes);
       }
     }
   }
@@ -2600,6 +2787,7 @@ bool D3D12CommandProcessor::IssueCopy() {
   if (!BeginSubmission(true)) {
     return false;
   }
+  SCOPE_profile_gpu_i("gpu", "Resolve");
   uint32_t written_address, written_length;
   if (!render_target_cache_->Resolve(*memory_, *shared_memory_, *texture_cache_,
                                      written_address, written_length)) {
@@ -2608,28 +2796,7 @@ bool D3D12CommandProcessor::IssueCopy() {
   if (cvars::d3d12_readback_resolve &&
       !texture_cache_->IsDrawResolutionScaled() && written_length) {
     // Read the resolved data on the CPU.
-    ID3D12Resource* readback_buffer = RequestReadbackBuffer(written_length);
-    if (readback_buffer != nullptr) {
-      shared_memory_->UseAsCopySource();
-      SubmitBarriers();
-      ID3D12Resource* shared_memory_buffer = shared_memory_->GetBuffer();
-      deferred_command_list_.D3DCopyBufferRegion(
-          readback_buffer, 0, shared_memory_buffer, written_address,
-          written_length);
-      if (AwaitAllQueueOperationsCompletion()) {
-        D3D12_RANGE readback_range;
-        readback_range.Begin = 0;
-        readback_range.End = written_length;
-        void* readback_mapping;
-        if (SUCCEEDED(
-                readback_buffer->Map(0, &readback_range, &readback_mapping))) {
-          std::memcpy(memory_->TranslatePhysical(written_address),
-                      readback_mapping, written_length);
-          D3D12_RANGE readback_write_range = {};
-          readback_buffer->Unmap(0, &readback_write_range);
-        }
-      }
-    }
+    ReadbackSharedMemory(written_address, written_length);
   }
   return true;
 }
@@ -2714,6 +2881,10 @@ void D3D12CommandProcessor::CheckSubmissionFence(uint64_t await_submission) {
     view_bindless_one_use_descriptors_.pop_front();
   }
 
+  // Write the read back data before the readback buffers are reused.
+  WriteCompletedReadbacks();
+  readback_buffer_pool_->Reclaim(submission_completed_);
+
   // Delete transient resources marked for deletion.
   while (!resources_for_deletion_.empty()) {
     if (resources_for_deletion_.front().first > submission_completed_) {
@@ -2730,6 +2901,161 @@ void D3D12CommandProcessor::CheckSubmissionFence(uint64_t await_submission) {
   primitive_processor_->CompletedSubmissionUpdated();
 
   texture_cache_->CompletedSubmissionUpdated(submission_completed_);
+
+  WriteCompletedOcclusionQueryResults();
+
+  ReadCompletedGpuTimestamps();
+}
+
+void D3D12CommandProcessor::BeginOcclusionQuerySegment() {
+  if (!occlusion_query_guest_active_ || occlusion_query_guest_overflowed_ ||
+      occlusion_query_host_active_) {
+    return;
+  }
+  uint64_t occlusion_query_oldest_used =
+      occlusion_queries_pending_.empty()
+          ? occlusion_query_guest_first_
+          : occlusion_queries_pending_.front().host_query_first;
+  if (occlusion_queries_allocated_ - occlusion_query_oldest_used >=
+      kOcclusionQueryCount) {
+    XELOGW(
+        "Too many occlusion queries in flight, reporting the fake sample "
+        "count");
+    occlusion_query_guest_overflowed_ = true;
+    return;
+  }
+  deferred_command_list_.D3DBeginQuery(
+      occlusion_query_heap_, D3D12_QUERY_TYPE_OCCLUSION,
+      UINT(occlusion_queries_allocated_++ % kOcclusionQueryCount));
+  occlusion_query_host_active_ = true;
+  occlusion_query_guest_last_submission_ = submission_current_;
+}
+
+void D3D12CommandProcessor::EndOcclusionQuerySegment() {
+  if (!occlusion_query_host_active_) {
+    return;
+  }
+  assert_true(submission_open_);
+  UINT query_index =
+      UINT((occlusion_queries_allocated_ - 1) % kOcclusionQueryCount);
+  deferred_command_list_.D3DEndQuery(occlusion_query_heap_,
+                                     D3D12_QUERY_TYPE_OCCLUSION, query_index);
+  deferred_command_list_.D3DResolveQueryData(
+      occlusion_query_heap_, D3D12_QUERY_TYPE_OCCLUSION, query_index, 1,
+      occlusion_query_readback_buffer_, sizeof(uint64_t) * query_index);
+  occlusion_query_host_active_ = false;
+}
+
+void D3D12CommandProcessor::WriteCompletedOcclusionQueryResults() {
+  if (occlusion_queries_pending_.empty() ||
+      occlusion_queries_pending_.front().submission > submission_completed_) {
+    return;
+  }
+  void* readback_mapping;
+  if (FAILED(occlusion_query_readback_buffer_->Map(0, nullptr,
+                                                   &readback_mapping))) {
+    XELOGE("Failed to map the occlusion query readback buffer");
+    return;
+  }
+  const uint64_t* host_sample_counts =
+      reinterpret_cast<const uint64_t*>(readback_mapping);
+  // The guest counts the samples at the guest resolution. Rounding up not to
+  // report a partially visible object as occluded.
+  uint64_t draw_resolution_scale_area =
+      texture_cache_->draw_resolution_scale_x() *
+      texture_cache_->draw_resolution_scale_y();
+  while (!occlusion_queries_pending_.empty()) {
+    const PendingOcclusionQuery& pending_query =
+        occlusion_queries_pending_.front();
+    if (pending_query.submission > submission_completed_) {
+      break;
+    }
+    uint64_t sample_count = 0;
+    for (uint64_t i = pending_query.host_query_first;
+         i < pending_query.host_query_end; ++i) {
+      sample_count += host_sample_counts[i % kOcclusionQueryCount];
+    }
+    WriteOcclusionQueryResult(
+        pending_query.sample_count_address,
+        (sample_count + draw_resolution_scale_area - 1) /
+            draw_resolution_scale_area);
+    occlusion_queries_pending_.pop_front();
+  }
+  D3D12_RANGE readback_written_range = {};
+  occlusion_query_readback_buffer_->Unmap(0, &readback_written_range);
+}
+
+uint32_t D3D12CommandProcessor::InsertGpuTimestamp(void* context) {
+  if (!gpu_timestamp_heap_ || !submission_open_ ||
+      context != &deferred_command_list_ ||
+      gpu_timestamps_allocated_ - gpu_timestamps_read_ >= kGpuTimestampCount) {
+    return UINT32_MAX;
+  }
+  uint32_t index = uint32_t(gpu_timestamps_allocated_++ % kGpuTimestampCount);
+  gpu_timestamp_values_[index] = UINT64_MAX;
+  deferred_command_list_.D3DEndQuery(gpu_timestamp_heap_,
+                                     D3D12_QUERY_TYPE_TIMESTAMP, index);
+  return index;
+}
+
+void D3D12CommandProcessor::ResolveGpuTimestamps() {
+  if (gpu_timestamps_resolved_ >= gpu_timestamps_allocated_) {
+    return;
+  }
+  assert_true(submission_open_);
+  // The range may be split by the end of the ring.
+  while (gpu_timestamps_resolved_ < gpu_timestamps_allocated_) {
+    uint32_t first = uint32_t(gpu_timestamps_resolved_ % kGpuTimestampCount);
+    uint32_t count = uint32_t(
+        std::min(gpu_timestamps_allocated_ - gpu_timestamps_resolved_,
+                 uint64_t(kGpuTimestampCount - first)));
+    deferred_command_list_.D3DResolveQueryData(
+        gpu_timestamp_heap_, D3D12_QUERY_TYPE_TIMESTAMP, first, count,
+        gpu_timestamp_readback_buffer_, sizeof(uint64_t) * first);
+    gpu_timestamps_resolved_ += count;
+  }
+  PendingGpuTimestamps& pending_timestamps =
+      gpu_timestamps_pending_.emplace_back();
+  pending_timestamps.timestamp_end = gpu_timestamps_resolved_;
+  pending_timestamps.submission = submission_current_;
+}
+
+void D3D12CommandProcessor::ReadCompletedGpuTimestamps() {
+  if (gpu_timestamps_pending_.empty() ||
+      gpu_timestamps_pending_.front().submission > submission_completed_) {
+    return;
+  }
+  void* readback_mapping;
+  if (FAILED(gpu_timestamp_readback_buffer_->Map(0, nullptr,
+                                                 &readback_mapping))) {
+    XELOGE("Failed to map the GPU timestamp readback buffer");
+    return;
+  }
+  const uint64_t* readback_values =
+      reinterpret_cast<const uint64_t*>(readback_mapping);
+  while (!gpu_timestamps_pending_.empty()) {
+    const PendingGpuTimestamps& pending_timestamps =
+        gpu_timestamps_pending_.front();
+    if (pending_timestamps.submission > submission_completed_) {
+      break;
+    }
+    for (; gpu_timestamps_read_ < pending_timestamps.timestamp_end;
+         ++gpu_timestamps_read_) {
+      uint32_t index = uint32_t(gpu_timestamps_read_ % kGpuTimestampCount);
+      gpu_timestamp_values_[index] = readback_values[index];
+    }
+    gpu_timestamps_pending_.pop_front();
+  }
+  D3D12_RANGE readback_written_range = {};
+  gpu_timestamp_readback_buffer_->Unmap(0, &readback_written_range);
+}
+
+uint64_t D3D12CommandProcessor::GpuTimerSource::GetTimestamp(uint32_t index) {
+  if (index >= kGpuTimestampCount ||
+      !command_processor_.gpu_timestamp_values_) {
+    return UINT64_MAX;
+  }
+  return command_processor_.gpu_timestamp_values_[index];
 }
 
 bool D3D12CommandProcessor::BeginSubmission(bool is_guest_command) {
@@ -2789,6 +3115,7 @@ bool D3D12CommandProcessor::BeginSubmission(bool is_guest_command) {
     // end of the submission (when async pipeline creation requests are
     // fulfilled).
     deferred_command_list_.Reset();
+    Profiler::SetGpuContext(&deferred_command_list_);
 
     // Reset cached state of the command list.
     ff_viewport_update_needed_ = true;
@@ -2826,6 +3153,8 @@ bool D3D12CommandProcessor::BeginSubmission(bool is_guest_command) {
     cbuffer_binding_system_.up_to_date = false;
     cbuffer_binding_float_vertex_.up_to_date = false;
     cbuffer_binding_float_pixel_.up_to_date = false;
+    cbuffer_float_vertex_size_ = 0;
+    cbuffer_float_pixel_size_ = 0;
     cbuffer_binding_bool_loop_.up_to_date = false;
     cbuffer_binding_fetch_.up_to_date = false;
     current_shared_memory_binding_is_uav_.reset();
@@ -2893,14 +3222,36 @@ bool D3D12CommandProcessor::EndSubmission(bool is_swap) {
   bool is_closing_frame = is_swap && frame_open_;
 
   if (is_closing_frame) {
+    render_target_cache_->EndFrame();
+
     texture_cache_->EndFrame();
 
     primitive_processor_->EndFrame();
+
+    [[maybe_unused]] ui::GraphicsUploadBufferPool::Statistics
+        constant_buffer_pool_statistics =
+            constant_buffer_pool_->TakeStatistics();
+    COUNT_profile_set("gpu/d3d12/constant_upload_bytes_per_frame",
+                      constant_buffer_pool_statistics.bytes_requested);
+    COUNT_profile_set("gpu/d3d12/constant_upload_wasted_bytes_per_frame",
+                      constant_buffer_pool_statistics.bytes_wasted);
+    COUNT_profile_set("gpu/d3d12/constant_upload_pages_created_per_frame",
+                      constant_buffer_pool_statistics.pages_created);
+    COUNT_profile_set("gpu/d3d12/constant_upload_pages",
+                      constant_buffer_pool_->page_count());
   }
 
   if (submission_open_) {
     assert_false(scratch_buffer_used_);
 
+    // Host queries can't span multiple command lists, the guest query will be
+    // continued with a new host query in the next submission.
+    EndOcclusionQuerySegment();
+
+    // No more GPU profiling timestamps can be written in this submission.
+    Profiler::SetGpuContext(nullptr);
+    ResolveGpuTimestamps();
+
     pipeline_cache_->EndSubmission();
 
     // Submit barriers now because resources with the queued barriers may be
@@ -2981,6 +3332,7 @@ bool D3D12CommandProcessor::EndSubmission(bool is_swap) {
         view_bindful_heap_pool_->ClearCache();
       }
       constant_buffer_pool_->ClearCache();
+      readback_buffer_pool_->ClearCache();
 
       texture_cache_->ClearCache();
 
@@ -3698,62 +4050,63 @@ bool D3D12CommandProcessor::UpdateBindings(const D3D12Shader* vertex_shader,
     // still be provided, so if the first draw in the frame with the current
     // root signature doesn't have float constants at all, still allocate an
     // empty buffer.
-    uint8_t* float_constants = constant_buffer_pool_->Request(
-        frame_current_,
-        sizeof(float) * 4 * std::max(float_constant_count_vertex, uint32_t(1)),
-        D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, nullptr, nullptr,
-        &cbuffer_binding_float_vertex_.address);
-    if (float_constants == nullptr) {
-      return false;
+    uint32_t float_constants_size =
+        GatherFloatConstants(regs, false, current_float_constant_map_vertex_,
+                             float_constants_gathered_);
+    if (!float_constants_size) {
+      float_constants_size = sizeof(float) * 4;
+      std::memset(float_constants_gathered_, 0, float_constants_size);
     }
-    for (uint32_t i = 0; i < 4; ++i) {
-      uint64_t float_constant_map_entry =
-          float_constant_map_vertex.float_bitmap[i];
-      uint32_t float_constant_index;
-      while (xe::bit_scan_forward(float_constant_map_entry,
-                                  &float_constant_index)) {
-        float_constant_map_entry &= ~(1ull << float_constant_index);
-        std::memcpy(float_constants,
-                    &regs[XE_GPU_REG_SHADER_CONSTANT_000_X + (i << 8) +
-                          (float_constant_index << 2)],
-                    4 * sizeof(float));
-        float_constants += 4 * sizeof(float);
+    // Different constant ranges often end up containing the same values, such
+    // as when only the constants not used by the current shader are changed,
+    // keep using the previous buffer in this case.
+    uint64_t float_constants_hash =
+        XXH3_64bits(float_constants_gathered_, float_constants_size);
+    if (cbuffer_float_vertex_size_ != float_constants_size ||
+        cbuffer_float_vertex_hash_ != float_constants_hash) {
+      uint8_t* float_constants = constant_buffer_pool_->Request(
+          frame_current_, float_constants_size,
+          D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, nullptr, nullptr,
+          &cbuffer_binding_float_vertex_.address);
+      if (float_constants == nullptr) {
+        return false;
       }
+      std::memcpy(float_constants, float_constants_gathered_,
+                  float_constants_size);
+      cbuffer_float_vertex_hash_ = float_constants_hash;
+      cbuffer_float_vertex_size_ = float_constants_size;
+      current_graphics_root_up_to_date_ &=
+          ~(1u << root_parameter_float_constants_vertex);
     }
     cbuffer_binding_float_vertex_.up_to_date = true;
-    current_graphics_root_up_to_date_ &=
-        ~(1u << root_parameter_float_constants_vertex);
   }
   if (!cbuffer_binding_float_pixel_.up_to_date) {
-    uint8_t* float_constants = constant_buffer_pool_->Request(
-        frame_current_,
-        sizeof(float) * 4 * std::max(float_constant_count_pixel, uint32_t(1)),
-        D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, nullptr, nullptr,
-        &cbuffer_binding_float_pixel_.address);
-    if (float_constants == nullptr) {
-      return false;
+    uint32_t float_constants_size =
+        GatherFloatConstants(regs, true, current_float_constant_map_pixel_,
+                             float_constants_gathered_);
+    if (!float_constants_size) {
+      float_constants_size = sizeof(float) * 4;
+      std::memset(float_constants_gathered_, 0, float_constants_size);
     }
-    if (pixel_shader != nullptr) {
-      const Shader::ConstantRegisterMap& float_constant_map_pixel =
-          pixel_shader->constant_register_map();
-      for (uint32_t i = 0; i < 4; ++i) {
-        uint64_t float_constant_map_entry =
-            float_constant_map_pixel.float_bitmap[i];
-        uint32_t float_constant_index;
-        while (xe::bit_scan_forward(float_constant_map_entry,
-                                    &float_constant_index)) {
-          float_constant_map_entry &= ~(1ull << float_constant_index);
-          std::memcpy(float_constants,
-                      &regs[XE_GPU_REG_SHADER_CONSTANT_256_X + (i << 8) +
-                            (float_constant_index << 2)],
-                      4 * sizeof(float));
-          float_constants += 4 * sizeof(float);
-        }
+    uint64_t float_constants_hash =
+        XXH3_64bits(float_constants_gathered_, float_constants_size);
+    if (cbuffer_float_pixel_size_ != float_constants_size ||
+        cbuffer_float_pixel_hash_ != float_constants_hash) {
+      uint8_t* float_constants = constant_buffer_pool_->Request(
+          frame_current_, float_constants_size,
+          D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, nullptr, nullptr,
+          &cbuffer_binding_float_pixel_.address);
+      if (float_constants == nullptr) {
+        return false;
       }
+      std::memcpy(float_constants, float_constants_gathered_,
+                  float_constants_size);
+      cbuffer_float_pixel_hash_ = float_constants_hash;
+      cbuffer_float_pixel_size_ = float_constants_size;
+      current_graphics_root_up_to_date_ &=
+          ~(1u << root_parameter_float_constants_pixel);
     }
     cbuffer_binding_float_pixel_.up_to_date = true;
-    current_graphics_root_up_to_date_ &=
-        ~(1u << root_parameter_float_constants_pixel);
   }
   if (!cbuffer_binding_bool_loop_.up_to_date) {
     constexpr uint32_t kBoolLoopConstantsSize = (8 + 32) * sizeof(uint32_t);
@@ -4427,31 +4780,47 @@ bool D3D12CommandProcessor::UpdateBindings(const D3D12Shader* vertex_shader,
   return true;
 }
 
-ID3D12Resource* D3D12CommandProcessor::RequestReadbackBuffer(uint32_t size) {
-  if (size == 0) {
-    return nullptr;
+void D3D12CommandProcessor::ReadbackSharedMemory(uint32_t start,
+                                                 uint32_t length) {
+  if (!length) {
+    return;
   }
-  size = xe::align(size, kReadbackBufferSizeIncrement);
-  if (size > readback_buffer_size_) {
-    const ui::d3d12::D3D12Provider& provider = GetD3D12Provider();
-    ID3D12Device* device = provider.GetDevice();
-    D3D12_RESOURCE_DESC buffer_desc;
-    ui::d3d12::util::FillBufferResourceDesc(buffer_desc, size,
-                                            D3D12_RESOURCE_FLAG_NONE);
-    ID3D12Resource* buffer;
-    if (FAILED(device->CreateCommittedResource(
-            &ui::d3d12::util::kHeapPropertiesReadback,
-            provider.GetHeapFlagCreateNotZeroed(), &buffer_desc,
-            D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&buffer)))) {
-      XELOGE("Failed to create a {} MB readback buffer", size >> 20);
-      return nullptr;
+  shared_memory_->UseAsCopySource();
+  SubmitBarriers();
+  ID3D12Resource* shared_memory_buffer = shared_memory_->GetBuffer();
+  while (length) {
+    ID3D12Resource* readback_buffer;
+    size_t readback_buffer_offset, readback_size;
+    const uint8_t* readback_mapping = readback_buffer_pool_->RequestPartial(
+        submission_current_, length, 1, &readback_buffer,
+        &readback_buffer_offset, &readback_size, nullptr);
+    if (!readback_mapping) {
+      XELOGE("Failed to get a readback buffer for {} bytes", length);
+      return;
     }
-    if (readback_buffer_ != nullptr) {
-      readback_buffer_->Release();
+    deferred_command_list_.D3DCopyBufferRegion(
+        readback_buffer, readback_buffer_offset, shared_memory_buffer, start,
+        readback_size);
+    PendingReadback& pending_readback = readbacks_pending_.emplace_back();
+    pending_readback.submission = submission_current_;
+    pending_readback.mapping = readback_mapping;
+    pending_readback.guest_address = start;
+    pending_readback.length = uint32_t(readback_size);
+    start += uint32_t(readback_size);
+    length -= uint32_t(readback_size);
+  }
+}
+
+void D3D12CommandProcessor::WriteCompletedReadbacks() {
+  while (!readbacks_pending_.empty()) {
+    const PendingReadback& pending_readback = readbacks_pending_.front();
+    if (pending_readback.submission > submission_completed_) {
+      break;
     }
-    readback_buffer_ = buffer;
+    std::memcpy(memory_->TranslatePhysical(pending_readback.guest_address),
+                pending_readback.mapping, pending_readback.length);
+    readbacks_pending_.pop_front();
   }
-  return readback_buffer_;
 }
 
 void D3D12CommandProcessor::WriteGammaRampSRV(
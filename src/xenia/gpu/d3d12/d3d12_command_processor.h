@@ -21,6 +21,7 @@
 #include <vector>
 
 #include "xenia/base/assert.h"
+#include "xenia/base/profiling.h"
 #include "xenia/gpu/command_processor.h"
 #include "xenia/gpu/d3d12/d3d12_graphics_system.h"
 #include "xenia/gpu/d3d12/d3d12_primitive_processor.h"
@@ -52,6 +53,9 @@ class D3D12CommandProcessor : public CommandProcessor {
 
   void ClearCaches() override;
 
+  void GetCacheStatistics(CacheStatistics& statistics_out) const override;
+  void AwaitHostGpuIdle() override;
+
   void InitializeShaderStorage(const std::filesystem::path& cache_root,
                                uint32_t title_id, bool blocking) override;
 
@@ -215,6 +219,7 @@ class D3D12CommandProcessor : public CommandProcessor {
   void ShutdownContext() override;
 
   void WriteRegister(uint32_t index, uint32_t value) override;
+  void OnShaderConstantsWritten(uint32_t first_index, uint32_t count) override;
 
   void OnGammaRamp256EntryTableValueWritten() override;
   void OnGammaRampPWLValueWritten() override;
@@ -224,6 +229,13 @@ class D3D12CommandProcessor : public CommandProcessor {
 
   void OnPrimaryBufferEnd() override;
 
+  bool BeginOcclusionQuery() override;
+  bool EndOcclusionQuery(uint32_t sample_count_address) override;
+
+  void CompletePendingReadbacks() override;
+
+  void PrepareForWait() override;
+
   Shader* LoadShader(xenos::ShaderType shader_type, uint32_t guest_address,
                      const uint32_t* host_address,
                      uint32_t dword_count) override;
@@ -327,6 +339,28 @@ class D3D12CommandProcessor : public CommandProcessor {
   // the submission to await to simply check status, or pass submission_current_
   // to wait for all queue operations to be completed.
   void CheckSubmissionFence(uint64_t await_submission);
+
+  // Starts a host occlusion query for the draw being issued if the guest is
+  // counting the samples, and there's no host query running in the current
+  // submission yet.
+  void BeginOcclusionQuerySegment();
+  // Ends the running host occlusion query (because the guest query has been
+  // ended, or because host queries can't span multiple submissions) and
+  // resolves it to the readback buffer.
+  void EndOcclusionQuerySegment();
+  // Writes the sample counts of the guest occlusion queries whose host queries
+  // have been completed to the guest memory.
+  void WriteCompletedOcclusionQueryResults();
+
+  // For the GPU profiling scopes. Writes a timestamp query to the deferred
+  // command list if it's the context and the submission is open.
+  uint32_t InsertGpuTimestamp(void* context);
+  // Resolves the timestamps written in the current submission to the readback
+  // buffer.
+  void ResolveGpuTimestamps();
+  // Copies the timestamps of the completed submissions from the readback
+  // buffer for the profiler to take.
+  void ReadCompletedGpuTimestamps();
   // If is_guest_command is true, a new full frame - with full cleanup of
   // resources and, if needed, starting capturing - is opened if pending (as
   // opposed to simply resuming after mid-frame synchronization). Returns
@@ -379,9 +413,12 @@ class D3D12CommandProcessor : public CommandProcessor {
                       ID3D12RootSignature* root_signature,
                       bool shared_memory_is_uav);
 
-  // Returns a buffer for reading GPU data back to the CPU. Assuming
-  // synchronizing immediately after use. Always in COPY_DEST state.
-  ID3D12Resource* RequestReadbackBuffer(uint32_t size);
+  // Copies a range of the shared memory written by the GPU to readback
+  // buffers, to be written to the guest memory when the submission is
+  // completed, or when the guest needs it (whichever happens earlier).
+  void ReadbackSharedMemory(uint32_t start, uint32_t length);
+  // Writes the data of the completed readbacks to the guest memory.
+  void WriteCompletedReadbacks();
 
   void WriteGammaRampSRV(bool is_pwl, D3D12_CPU_DESCRIPTOR_HANDLE handle) const;
 
@@ -579,9 +616,74 @@ class D3D12CommandProcessor : public CommandProcessor {
   D3D12_RESOURCE_STATES scratch_buffer_state_;
   bool scratch_buffer_used_ = false;
 
-  static constexpr uint32_t kReadbackBufferSizeIncrement = 16 * 1024 * 1024;
-  ID3D12Resource* readback_buffer_ = nullptr;
-  uint32_t readback_buffer_size_ = 0;
+  static constexpr size_t kReadbackBufferPoolPageSize = 4 * 1024 * 1024;
+  std::unique_ptr<ui::d3d12::D3D12UploadBufferPool> readback_buffer_pool_;
+  struct PendingReadback {
+    uint64_t submission;
+    const uint8_t* mapping;
+    uint32_t guest_address;
+    uint32_t length;
+  };
+  std::deque<PendingReadback> readbacks_pending_;
+
+  // Host occlusion queries, allocated in a ring. One guest query may need
+  // multiple host queries if it spans multiple submissions, and they are
+  // consecutive in the ring. Positions in the ring are counted from the
+  // beginning of the emulation (the index in the heap is modulo the count).
+  static constexpr uint32_t kOcclusionQueryCount = 16384;
+  ID3D12QueryHeap* occlusion_query_heap_ = nullptr;
+  // 64-bit sample counts resolved from the queries with the same index.
+  ID3D12Resource* occlusion_query_readback_buffer_ = nullptr;
+  uint64_t occlusion_queries_allocated_ = 0;
+  bool occlusion_query_guest_active_ = false;
+  // Too many queries in flight - reporting the fake sample count instead.
+  bool occlusion_query_guest_overflowed_ = false;
+  bool occlusion_query_host_active_ = false;
+  uint64_t occlusion_query_guest_first_ = 0;
+  uint64_t occlusion_query_guest_last_submission_ = 0;
+  struct PendingOcclusionQuery {
+    uint32_t sample_count_address;
+    uint64_t host_query_first;
+    uint64_t host_query_end;
+    // The last submission containing the host queries.
+    uint64_t submission;
+  };
+  std::deque<PendingOcclusionQuery> occlusion_queries_pending_;
+
+  class GpuTimerSource final : public Profiler::GpuTimerSource {
+   public:
+    explicit GpuTimerSource(D3D12CommandProcessor& command_processor)
+        : command_processor_(command_processor) {}
+    uint32_t InsertTimer(void* context) override {
+      return command_processor_.InsertGpuTimestamp(context);
+    }
+    uint64_t GetTimestamp(uint32_t index) override;
+    uint64_t GetTicksPerSecond() override {
+      return command_processor_.gpu_timestamp_frequency_;
+    }
+
+   private:
+    D3D12CommandProcessor& command_processor_;
+  };
+  // Timestamp queries for the GPU profiling scopes, allocated in a ring like
+  // the occlusion queries, and resolved at the end of each submission. The
+  // profiler reads the values several frames later, so the ring is large
+  // enough to contain the timestamps of multiple frames.
+  static constexpr uint32_t kGpuTimestampCount = 32768;
+  ID3D12QueryHeap* gpu_timestamp_heap_ = nullptr;
+  ID3D12Resource* gpu_timestamp_readback_buffer_ = nullptr;
+  UINT64 gpu_timestamp_frequency_ = 0;
+  // Copied from the readback buffer, UINT64_MAX if not available yet.
+  std::unique_ptr<uint64_t[]> gpu_timestamp_values_;
+  uint64_t gpu_timestamps_allocated_ = 0;
+  uint64_t gpu_timestamps_resolved_ = 0;
+  uint64_t gpu_timestamps_read_ = 0;
+  struct PendingGpuTimestamps {
+    uint64_t timestamp_end;
+    uint64_t submission;
+  };
+  std::deque<PendingGpuTimestamps> gpu_timestamps_pending_;
+  GpuTimerSource gpu_timer_source_{*this};
 
   std::atomic<bool> pix_capture_requested_ = false;
   bool pix_capturing_;
@@ -629,6 +731,15 @@ class D3D12CommandProcessor : public CommandProcessor {
   ConstantBufferBinding cbuffer_binding_fetch_;
   ConstantBufferBinding cbuffer_binding_descriptor_indices_vertex_;
   ConstantBufferBinding cbuffer_binding_descriptor_indices_pixel_;
+  // Hashes and sizes of the float constants in cbuffer_binding_float_*_, for
+  // reusing the uploaded buffers for draws with the same constant values. The
+  // size is 0 if the buffer can't be reused (in a new frame).
+  uint64_t cbuffer_float_vertex_hash_;
+  uint64_t cbuffer_float_pixel_hash_;
+  uint32_t cbuffer_float_vertex_size_;
+  uint32_t cbuffer_float_pixel_size_;
+  // Used float constants gathered for hashing before uploading.
+  float float_constants_gathered_[256 * 4];
 
   // Whether the latest shared memory and EDRAM buffer binding contains the
   // shared memory UAV rather than the SRV.
@@ -23,8 +23,10 @@
 
 #include "xenia/base/assert.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/frame_breakdown.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/profiling.h"
 #include "xenia/base/string.h"
 #include "xenia/gpu/d3d12/d3d12_command_processor.h"
 #include "xenia/gpu/d3d12/d3d12_texture_cache.h"
@@ -1327,6 +1329,8 @@ bool D3D12RenderTargetCache::Resolve(const Memory& memory,
                                      D3D12TextureCache& texture_cache,
                                      uint32_t& written_address_out,
                                      uint32_t& written_length_out) {
+  frame_breakdown::ScopedTimer frame_breakdown_timer(
+      frame_breakdown::Category::kEdramTransfer);
   written_address_out = 0;
   written_length_out = 0;
 
@@ -1351,7 +1355,8 @@ bool D3D12RenderTargetCache::Resolve(const Memory& memory,
 
   // Copying.
   bool copied = false;
-  if (resolve_info.copy_dest_extent_length) {
+  if (resolve_info.copy_dest_extent_length &&
+      !IsResolveCopyUpToDate(resolve_info)) {
     if (GetPath() == Path::kHostRenderTargets) {
       // Dump the current contents of the render targets owning the affected
       // range to edram_buffer_.
@@ -1484,6 +1489,7 @@ bool D3D12RenderTargetCache::Resolve(const Memory& memory,
           written_address_out = resolve_info.copy_dest_extent_start;
           written_length_out = resolve_info.copy_dest_extent_length;
           copied = true;
+          ResolveCopyDone(resolve_info, shared_memory);
         }
       } else {
         XELOGE(
@@ -1492,6 +1498,7 @@ bool D3D12RenderTargetCache::Resolve(const Memory& memory,
       }
     }
   } else {
+    // Nothing to copy, or already copied.
     copied = true;
   }
 
@@ -4451,6 +4458,10 @@ void D3D12RenderTargetCache::PerformTransfersAndResolveClears(
     const uint64_t* render_target_resolve_clear_values,
     const Transfer::Rectangle* resolve_clear_rectangle) {
   assert_true(GetPath() == Path::kHostRenderTargets);
+  frame_breakdown::ScopedTimer frame_breakdown_timer(
+      frame_breakdown::Category::kEdramTransfer);
+
+  SCOPE_profile_gpu_i("gpu", "EDRAM transfers");
 
   const ui::d3d12::D3D12Provider& provider =
       command_processor_.GetD3D12Provider();
@@ -5323,6 +5334,10 @@ void D3D12RenderTargetCache::PerformTransfersAndResolveClears(
           command_processor_.SetExternalPipeline(transfer_pipelines[j]);
           command_list.D3DDrawInstanced(transfer_vertex_count, 1, 0, 0);
         }
+        CountTransferDraws(
+            is_stencil_bit ? 8 : 1,
+            uint32_t(std::distance(it_merged_first, it_merged_last)) + 1,
+            transfer_rectangle_count);
       }
     }
 
@@ -436,6 +436,9 @@ bool D3D12SharedMemory::UploadRanges(
           upload_buffer_mapping,
           memory().TranslatePhysical(upload_range_start << page_size_log2()),
           upload_buffer_size);
+      StoreUploadedPageHashes(upload_range_start,
+                              uint32_t(upload_buffer_size >> page_size_log2()),
+                              upload_buffer_mapping);
       command_list.D3DCopyBufferRegion(
           buffer_, upload_range_start << page_size_log2(), upload_buffer,
           UINT64(upload_buffer_offset), UINT64(upload_buffer_size));
@@ -93,6 +93,7 @@ class D3D12SharedMemory : public SharedMemory {
 
   bool UploadRanges(const std::vector<std::pair<uint32_t, uint32_t>>&
                         upload_page_ranges) override;
+  bool AreUploadsTraced() const override { return trace_writer_.is_open(); }
 
  private:
   D3D12CommandProcessor& command_processor_;
@@ -13,11 +13,15 @@
 #include <array>
 #include <cfloat>
 #include <cstddef>
+#include <cstdio>
 #include <cstring>
 #include <memory>
 #include <utility>
 
+#include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
@@ -30,6 +34,14 @@
 #include "xenia/ui/d3d12/d3d12_upload_buffer_pool.h"
 #include "xenia/ui/d3d12/d3d12_util.h"
 
+DEFINE_bool(
+    scaled_resolve_precommit, true,
+    "With draw resolution scaling, allocate the scaled resolve memory used by "
+    "the title in the previous session, and the memory likely to be needed "
+    "next, ahead of use on a background thread, to avoid stalls during "
+    "gameplay. Requires store_shaders for remembering the memory used.",
+    "GPU");
+
 namespace xe {
 namespace gpu {
 namespace d3d12 {
@@ -405,6 +417,18 @@ D3D12TextureCache::~D3D12TextureCache() {
   // ~D3D12Texture), destroy all textures.
   DestroyAllTextures(true);
 
+  ShutdownScaledResolveStorage();
+  if (scaled_resolve_heap_creation_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(scaled_resolve_heap_creation_mutex_);
+      scaled_resolve_heap_creation_shutdown_ = true;
+    }
+    scaled_resolve_heap_creation_cond_.notify_all();
+    xe::threading::Wait(scaled_resolve_heap_creation_thread_.get(), false);
+    scaled_resolve_heap_creation_thread_.reset();
+  }
+  scaled_resolve_precreated_heaps_.clear();
+
   // First release the buffers to detach them from the heaps.
   for (std::unique_ptr<ScaledResolveVirtualBuffer>& scaled_resolve_buffer_ptr :
        scaled_resolve_2gb_buffers_) {
@@ -428,8 +452,11 @@ bool D3D12TextureCache::Initialize() {
     uint64_t scaled_resolve_address_space_size =
         uint64_t(SharedMemory::kBufferSize) *
         (draw_resolution_scale_x() * draw_resolution_scale_y());
-    scaled_resolve_heaps_.resize(size_t(scaled_resolve_address_space_size >>
-                                        kScaledResolveHeapSizeLog2));
+    size_t scaled_resolve_heap_count = size_t(
+        scaled_resolve_address_space_size >> kScaledResolveHeapSizeLog2);
+    scaled_resolve_heaps_.resize(scaled_resolve_heap_count);
+    scaled_resolve_heaps_used_.resize(scaled_resolve_heap_count);
+    scaled_resolve_heaps_requested_.resize(scaled_resolve_heap_count);
   }
   scaled_resolve_heap_count_ = 0;
 
@@ -745,6 +772,10 @@ void D3D12TextureCache::BeginSubmission(uint64_t new_submission_index) {
 void D3D12TextureCache::BeginFrame() {
   TextureCache::BeginFrame();
 
+  if (!scaled_resolve_precommit_heaps_.empty()) {
+    CommitPrecreatedScaledResolveHeaps();
+  }
+
   std::memset(unsupported_format_features_used_, 0,
               sizeof(unsupported_format_features_used_));
 }
@@ -1174,9 +1205,29 @@ bool D3D12TextureCache::EnsureScaledResolveMemoryCommitted(
                           length_scaled_alignment_bits) &
                          ~length_scaled_alignment_bits;
 
-  const ui::d3d12::D3D12Provider& provider =
-      command_processor_.GetD3D12Provider();
-  ID3D12Device* device = provider.GetDevice();
+  if (!EnsureScaledResolveBuffersCreated(first_scaled, last_scaled)) {
+    return false;
+  }
+
+  uint32_t heap_first = uint32_t(first_scaled >> kScaledResolveHeapSizeLog2);
+  uint32_t heap_last = uint32_t(last_scaled >> kScaledResolveHeapSizeLog2);
+  for (uint32_t i = heap_first; i <= heap_last; ++i) {
+    scaled_resolve_heaps_used_[i] = true;
+    if (scaled_resolve_heaps_[i]) {
+      continue;
+    }
+    if (!CommitScaledResolveHeap(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool D3D12TextureCache::EnsureScaledResolveBuffersCreated(
+    uint64_t first_scaled, uint64_t last_scaled) {
+  uint32_t draw_resolution_scale_area =
+      draw_resolution_scale_x() * draw_resolution_scale_y();
+  ID3D12Device* device = command_processor_.GetD3D12Provider().GetDevice();
 
   // Ensure GPU virtual memory for buffers that may be used to access the range
   // is allocated - buffers are created. Always creating both buffers for all
@@ -1223,64 +1274,250 @@ bool D3D12TextureCache::EnsureScaledResolveMemoryCommitted(
     scaled_resolve_buffer_resource->Release();
   }
 
-  uint32_t heap_first = uint32_t(first_scaled >> kScaledResolveHeapSizeLog2);
-  uint32_t heap_last = uint32_t(last_scaled >> kScaledResolveHeapSizeLog2);
-  for (uint32_t i = heap_first; i <= heap_last; ++i) {
-    if (scaled_resolve_heaps_[i]) {
-      continue;
+  return true;
+}
+
+Microsoft::WRL::ComPtr<ID3D12Heap> D3D12TextureCache::CreateScaledResolveHeap(
+    const ui::d3d12::D3D12Provider& provider) {
+  D3D12_HEAP_DESC heap_desc = {};
+  heap_desc.SizeInBytes = kScaledResolveHeapSize;
+  heap_desc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+  heap_desc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS |
+                    provider.GetHeapFlagCreateNotZeroed();
+  Microsoft::WRL::ComPtr<ID3D12Heap> heap;
+  if (FAILED(provider.GetDevice()->CreateHeap(&heap_desc,
+                                              IID_PPV_ARGS(&heap)))) {
+    return nullptr;
+  }
+  return heap;
+}
+
+bool D3D12TextureCache::CommitScaledResolveHeap(uint32_t heap_index) {
+  assert_null(scaled_resolve_heaps_[heap_index]);
+  const ui::d3d12::D3D12Provider& provider =
+      command_processor_.GetD3D12Provider();
+
+  Microsoft::WRL::ComPtr<ID3D12Heap> scaled_resolve_heap;
+  {
+    std::lock_guard<std::mutex> lock(scaled_resolve_heap_creation_mutex_);
+    auto precreated_it = scaled_resolve_precreated_heaps_.find(heap_index);
+    if (precreated_it != scaled_resolve_precreated_heaps_.end()) {
+      scaled_resolve_heap = std::move(precreated_it->second);
+      scaled_resolve_precreated_heaps_.erase(precreated_it);
     }
-    auto direct_queue = provider.GetDirectQueue();
-    D3D12_HEAP_DESC heap_desc = {};
-    heap_desc.SizeInBytes = kScaledResolveHeapSize;
-    heap_desc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
-    heap_desc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS |
-                      provider.GetHeapFlagCreateNotZeroed();
-    Microsoft::WRL::ComPtr<ID3D12Heap> scaled_resolve_heap;
-    if (FAILED(device->CreateHeap(&heap_desc,
-                                  IID_PPV_ARGS(&scaled_resolve_heap)))) {
+  }
+  if (!scaled_resolve_heap) {
+    // Not created ahead of use - the command processor thread waits for the
+    // allocation.
+    scaled_resolve_heap = CreateScaledResolveHeap(provider);
+    if (!scaled_resolve_heap) {
       XELOGE("D3D12TextureCache: Failed to create a scaled resolve tile heap");
       return false;
     }
-    scaled_resolve_heaps_[i] = scaled_resolve_heap;
-    ++scaled_resolve_heap_count_;
-    COUNT_profile_set(
-        "gpu/texture_cache/scaled_resolve_buffer_used_mb",
-        scaled_resolve_heap_count_ << (kScaledResolveHeapSizeLog2 - 20));
-    D3D12_TILED_RESOURCE_COORDINATE region_start_coordinates;
-    region_start_coordinates.Y = 0;
-    region_start_coordinates.Z = 0;
-    region_start_coordinates.Subresource = 0;
-    D3D12_TILE_REGION_SIZE region_size;
-    region_size.NumTiles =
-        kScaledResolveHeapSize / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
-    region_size.UseBox = FALSE;
-    D3D12_TILE_RANGE_FLAGS range_flags = D3D12_TILE_RANGE_FLAG_NONE;
-    UINT heap_range_start_offset = 0;
-    UINT range_tile_count =
-        kScaledResolveHeapSize / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
-    std::array<size_t, 2> buffer_indices =
-        GetPossibleScaledResolveBufferIndices(uint64_t(i)
-                                              << kScaledResolveHeapSizeLog2);
-    for (size_t j = 0; j < 2; ++j) {
-      size_t buffer_index = buffer_indices[j];
-      if (j && buffer_index == buffer_indices[0]) {
-        break;
-      }
-      region_start_coordinates.X =
-          UINT(((uint64_t(i) << kScaledResolveHeapSizeLog2) -
-                (uint64_t(buffer_index) << 30)) /
-               D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES);
-      direct_queue->UpdateTileMappings(
-          scaled_resolve_2gb_buffers_[buffer_index]->resource(), 1,
-          &region_start_coordinates, &region_size, scaled_resolve_heap.Get(), 1,
-          &range_flags, &heap_range_start_offset, &range_tile_count,
-          D3D12_TILE_MAPPING_FLAG_NONE);
+    ++scaled_resolve_on_demand_commits_;
+    COUNT_profile_set("gpu/texture_cache/scaled_resolve_on_demand_commits",
+                      scaled_resolve_on_demand_commits_);
+  }
+  scaled_resolve_heaps_[heap_index] = scaled_resolve_heap;
+  ++scaled_resolve_heap_count_;
+  COUNT_profile_set(
+      "gpu/texture_cache/scaled_resolve_buffer_used_mb",
+      scaled_resolve_heap_count_ << (kScaledResolveHeapSizeLog2 - 20));
+  D3D12_TILED_RESOURCE_COORDINATE region_start_coordinates;
+  region_start_coordinates.Y = 0;
+  region_start_coordinates.Z = 0;
+  region_start_coordinates.Subresource = 0;
+  D3D12_TILE_REGION_SIZE region_size;
+  region_size.NumTiles =
+      kScaledResolveHeapSize / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+  region_size.UseBox = FALSE;
+  D3D12_TILE_RANGE_FLAGS range_flags = D3D12_TILE_RANGE_FLAG_NONE;
+  UINT heap_range_start_offset = 0;
+  UINT range_tile_count =
+      kScaledResolveHeapSize / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+  std::array<size_t, 2> buffer_indices = GetPossibleScaledResolveBufferIndices(
+      uint64_t(heap_index) << kScaledResolveHeapSizeLog2);
+  auto direct_queue = provider.GetDirectQueue();
+  for (size_t j = 0; j < 2; ++j) {
+    size_t buffer_index = buffer_indices[j];
+    if (j && buffer_index == buffer_indices[0]) {
+      break;
     }
-    command_processor_.NotifyQueueOperationsDoneDirectly();
+    region_start_coordinates.X =
+        UINT(((uint64_t(heap_index) << kScaledResolveHeapSizeLog2) -
+              (uint64_t(buffer_index) << 30)) /
+             D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES);
+    direct_queue->UpdateTileMappings(
+        scaled_resolve_2gb_buffers_[buffer_index]->resource(), 1,
+        &region_start_coordinates, &region_size, scaled_resolve_heap.Get(), 1,
+        &range_flags, &heap_range_start_offset, &range_tile_count,
+        D3D12_TILE_MAPPING_FLAG_NONE);
+  }
+  command_processor_.NotifyQueueOperationsDoneDirectly();
+
+  // Resolve destinations are often allocated next to each other - prepare the
+  // next heap so the command processor thread likely won't have to wait for
+  // creating it.
+  if (cvars::scaled_resolve_precommit &&
+      heap_index + 1 < scaled_resolve_heaps_.size()) {
+    RequestScaledResolveHeapCreation(heap_index + 1);
   }
   return true;
 }
 
+void D3D12TextureCache::RequestScaledResolveHeapCreation(uint32_t heap_index) {
+  if (scaled_resolve_heaps_[heap_index] ||
+      scaled_resolve_heaps_requested_[heap_index]) {
+    return;
+  }
+  scaled_resolve_heaps_requested_[heap_index] = true;
+  {
+    std::lock_guard<std::mutex> lock(scaled_resolve_heap_creation_mutex_);
+    if (!scaled_resolve_heap_creation_thread_) {
+      scaled_resolve_heap_creation_thread_ = xe::threading::Thread::Create(
+          {}, [this]() { ScaledResolveHeapCreationThread(); });
+      if (!scaled_resolve_heap_creation_thread_) {
+        XELOGE(
+            "D3D12TextureCache: Failed to create the scaled resolve heap "
+            "creation thread");
+        return;
+      }
+      scaled_resolve_heap_creation_thread_->set_name(
+          "D3D12 Scaled Resolve Heap Creation");
+    }
+    scaled_resolve_heap_creation_queue_.push_back(heap_index);
+  }
+  scaled_resolve_heap_creation_cond_.notify_one();
+}
+
+void D3D12TextureCache::ScaledResolveHeapCreationThread() {
+  const ui::d3d12::D3D12Provider& provider =
+      command_processor_.GetD3D12Provider();
+  while (true) {
+    uint32_t heap_index;
+    {
+      std::unique_lock<std::mutex> lock(scaled_resolve_heap_creation_mutex_);
+      scaled_resolve_heap_creation_cond_.wait(lock, [this]() {
+        return scaled_resolve_heap_creation_shutdown_ ||
+               !scaled_resolve_heap_creation_queue_.empty();
+      });
+      if (scaled_resolve_heap_creation_shutdown_) {
+        return;
+      }
+      heap_index = scaled_resolve_heap_creation_queue_.front();
+      scaled_resolve_heap_creation_queue_.pop_front();
+    }
+    // If this fails, creation will be attempted again when the heap is needed.
+    Microsoft::WRL::ComPtr<ID3D12Heap> heap = CreateScaledResolveHeap(provider);
+    if (heap) {
+      std::lock_guard<std::mutex> lock(scaled_resolve_heap_creation_mutex_);
+      scaled_resolve_precreated_heaps_.emplace(heap_index, std::move(heap));
+    }
+  }
+}
+
+void D3D12TextureCache::CommitPrecreatedScaledResolveHeaps() {
+  for (size_t i = 0; i < scaled_resolve_precommit_heaps_.size();) {
+    uint32_t heap_index = scaled_resolve_precommit_heaps_[i];
+    if (!scaled_resolve_heaps_[heap_index]) {
+      bool created;
+      {
+        std::lock_guard<std::mutex> lock(scaled_resolve_heap_creation_mutex_);
+        created = scaled_resolve_precreated_heaps_.find(heap_index) !=
+                  scaled_resolve_precreated_heaps_.end();
+      }
+      if (!created) {
+        ++i;
+        continue;
+      }
+      uint64_t first_scaled = uint64_t(heap_index)
+                              << kScaledResolveHeapSizeLog2;
+      if (EnsureScaledResolveBuffersCreated(
+              first_scaled, first_scaled + (kScaledResolveHeapSize - 1))) {
+        CommitScaledResolveHeap(heap_index);
+      }
+    }
+    scaled_resolve_precommit_heaps_[i] = scaled_resolve_precommit_heaps_.back();
+    scaled_resolve_precommit_heaps_.pop_back();
+  }
+}
+
+void D3D12TextureCache::InitializeScaledResolveStorage(
+    const std::filesystem::path& cache_root, uint32_t title_id) {
+  if (!IsDrawResolutionScaled()) {
+    return;
+  }
+  ShutdownScaledResolveStorage();
+
+  scaled_resolve_storage_path_ =
+      cache_root / "texture_cache" /
+      fmt::format("{:08X}.{}x{}.xsrh", title_id, draw_resolution_scale_x(),
+                  draw_resolution_scale_y());
+  if (!cvars::scaled_resolve_precommit) {
+    return;
+  }
+  FILE* file = xe::filesystem::OpenFile(scaled_resolve_storage_path_, "rb");
+  if (!file) {
+    return;
+  }
+  ScaledResolveStorageHeader header;
+  if (fread(&header, sizeof(header), 1, file) == 1 &&
+      header.magic == ScaledResolveStorageHeader::kMagic &&
+      header.version == ScaledResolveStorageHeader::kVersion &&
+      header.heap_size_log2 == kScaledResolveHeapSizeLog2) {
+    uint32_t heap_index;
+    while (fread(&heap_index, sizeof(heap_index), 1, file) == 1) {
+      if (heap_index < scaled_resolve_heaps_.size() &&
+          !scaled_resolve_heaps_[heap_index] &&
+          !scaled_resolve_heaps_requested_[heap_index]) {
+        scaled_resolve_precommit_heaps_.push_back(heap_index);
+        RequestScaledResolveHeapCreation(heap_index);
+      }
+    }
+  }
+  fclose(file);
+  if (!scaled_resolve_precommit_heaps_.empty()) {
+    XELOGI(
+        "D3D12TextureCache: Committing {} MB of scaled resolve memory used in "
+        "the previous session ahead of use",
+        scaled_resolve_precommit_heaps_.size()
+            << (kScaledResolveHeapSizeLog2 - 20));
+  }
+}
+
+void D3D12TextureCache::ShutdownScaledResolveStorage() {
+  if (scaled_resolve_storage_path_.empty()) {
+    return;
+  }
+  // Only the heaps actually needed in this session, not the ones committed
+  // ahead of use and never accessed, so the set doesn't only grow.
+  std::vector<uint32_t> used_heaps;
+  for (size_t i = 0; i < scaled_resolve_heaps_used_.size(); ++i) {
+    if (scaled_resolve_heaps_used_[i]) {
+      used_heaps.push_back(uint32_t(i));
+    }
+  }
+  if (!used_heaps.empty()) {
+    xe::filesystem::CreateParentFolder(scaled_resolve_storage_path_);
+    FILE* file = xe::filesystem::OpenFile(scaled_resolve_storage_path_, "wb");
+    if (file) {
+      ScaledResolveStorageHeader header;
+      header.magic = ScaledResolveStorageHeader::kMagic;
+      header.version = ScaledResolveStorageHeader::kVersion;
+      header.heap_size_log2 = kScaledResolveHeapSizeLog2;
+      fwrite(&header, sizeof(header), 1, file);
+      fwrite(used_heaps.data(), sizeof(uint32_t), used_heaps.size(), file);
+      fclose(file);
+    } else {
+      XELOGE("D3D12TextureCache: Failed to write {}",
+             xe::path_to_utf8(scaled_resolve_storage_path_));
+    }
+  }
+  scaled_resolve_storage_path_.clear();
+  std::fill(scaled_resolve_heaps_used_.begin(),
+            scaled_resolve_heaps_used_.end(), false);
+}
+
 bool D3D12TextureCache::MakeScaledResolveRangeCurrent(
     uint32_t start_unscaled, uint32_t length_unscaled,
     uint32_t length_scaled_alignment_log2) {
@@ -1551,6 +1788,12 @@ uint32_t D3D12TextureCache::GetHostFormatSwizzle(TextureKey key) const {
   return host_formats_[uint32_t(key.format)].swizzle;
 }
 
+bool D3D12TextureCache::GetHostMemoryBudget(uint64_t& budget_out,
+                                            uint64_t& usage_out) const {
+  return command_processor_.GetD3D12Provider().QueryLocalVideoMemoryInfo(
+      budget_out, usage_out);
+}
+
 uint32_t D3D12TextureCache::GetMaxHostTextureWidthHeight(
     xenos::DataDimension dimension) const {
   switch (dimension) {
@@ -1634,12 +1877,174 @@ std::unique_ptr<TextureCache::Texture> D3D12TextureCache::CreateTexture(
 bool D3D12TextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
                                                               bool load_base,
                                                               bool load_mips) {
-  D3D12Texture& d3d12_texture = static_cast<D3D12Texture&>(texture);
-  TextureKey texture_key = d3d12_texture.key();
+  TextureDataLoad load;
+  load.texture = &texture;
+  load.load_base = load_base;
+  load.load_mips = load_mips;
+  load.loaded = false;
+  LoadTexturesDataFromResidentMemoryImpl(&load, 1);
+  return load.loaded;
+}
+
+bool D3D12TextureCache::CopyTextureDataImpl(Texture& dest, Texture& source) {
+  D3D12Texture& d3d12_dest = static_cast<D3D12Texture&>(dest);
+  D3D12Texture& d3d12_source = static_cast<D3D12Texture&>(source);
+  command_processor_.PushTransitionBarrier(
+      d3d12_dest.resource(),
+      d3d12_dest.SetResourceState(D3D12_RESOURCE_STATE_COPY_DEST),
+      D3D12_RESOURCE_STATE_COPY_DEST);
+  command_processor_.PushTransitionBarrier(
+      d3d12_source.resource(),
+      d3d12_source.SetResourceState(D3D12_RESOURCE_STATE_COPY_SOURCE),
+      D3D12_RESOURCE_STATE_COPY_SOURCE);
+  command_processor_.SubmitBarriers();
+  // Update LRU caching because the textures will be used by the command list.
+  d3d12_dest.MarkAsUsed();
+  d3d12_source.MarkAsUsed();
+  command_processor_.GetDeferredCommandList().D3DCopyResource(
+      d3d12_dest.resource(), d3d12_source.resource());
+  return true;
+}
+
+void D3D12TextureCache::LoadTexturesDataFromResidentMemoryImpl(
+    TextureDataLoad* loads, size_t load_count) {
+  SCOPE_profile_gpu_i("gpu", "Texture load");
 
   DeferredCommandList& command_list =
       command_processor_.GetDeferredCommandList();
-  ID3D12Device* device = command_processor_.GetD3D12Provider().GetDevice();
+
+  // Place the host data of all the textures in a single buffer, so all the
+  // loading dispatches can be done before a single barrier, followed by all
+  // the copying to the textures.
+  texture_data_load_layouts_.resize(load_count);
+  texture_data_load_order_.clear();
+  UINT64 copy_buffer_size = 0;
+  uint32_t descriptor_count = 0;
+  bool any_unscaled = false;
+  for (size_t i = 0; i < load_count; ++i) {
+    TextureDataLoad& load = loads[i];
+    load.loaded = false;
+    TextureDataLoadLayout& layout = texture_data_load_layouts_[i];
+    if (!GetTextureDataLoadLayout(static_cast<D3D12Texture&>(*load.texture),
+                                  load.load_base, load.load_mips,
+                                  copy_buffer_size, layout)) {
+      continue;
+    }
+    // Destination.
+    ++descriptor_count;
+    if (load.texture->key().scaled_resolve) {
+      // Source - base and mips, one or both.
+      descriptor_count +=
+          (layout.level_first == 0 && layout.level_last != 0) ? 2 : 1;
+    } else {
+      // Source - shared memory.
+      if (!bindless_resources_used_) {
+        ++descriptor_count;
+      }
+      any_unscaled = true;
+    }
+    texture_data_load_order_.push_back(uint32_t(i));
+  }
+  if (texture_data_load_order_.empty()) {
+    return;
+  }
+  if (copy_buffer_size > UINT32_MAX) {
+    XELOGE("Texture data to load at once is too large ({} bytes)",
+           copy_buffer_size);
+    return;
+  }
+  // Group the dispatches by the pipeline and the shader bindings, so they are
+  // switched as few times as possible.
+  std::stable_sort(
+      texture_data_load_order_.begin(), texture_data_load_order_.end(),
+      [&](uint32_t a, uint32_t b) {
+        const TextureDataLoadLayout& layout_a = texture_data_load_layouts_[a];
+        const TextureDataLoadLayout& layout_b = texture_data_load_layouts_[b];
+        bool scaled_a = loads[a].texture->key().scaled_resolve;
+        bool scaled_b = loads[b].texture->key().scaled_resolve;
+        if (scaled_a != scaled_b) {
+          return scaled_b;
+        }
+        return layout_a.load_shader < layout_b.load_shader;
+      });
+
+  D3D12_RESOURCE_STATES copy_buffer_state =
+      D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+  ID3D12Resource* copy_buffer = command_processor_.RequestScratchGPUBuffer(
+      uint32_t(copy_buffer_size), copy_buffer_state);
+  if (copy_buffer == nullptr) {
+    return;
+  }
+  texture_data_load_descriptors_.resize(descriptor_count);
+  if (!command_processor_.RequestOneUseSingleViewDescriptors(
+          descriptor_count, texture_data_load_descriptors_.data())) {
+    command_processor_.ReleaseScratchGPUBuffer(copy_buffer, copy_buffer_state);
+    return;
+  }
+  if (any_unscaled) {
+    static_cast<D3D12SharedMemory&>(shared_memory()).UseForReading();
+  }
+
+  // Submit the copy buffer population commands.
+  command_list.D3DSetComputeRootSignature(load_root_signature_.Get());
+  TextureDataLoadBindings bindings;
+  bindings.descriptors = texture_data_load_descriptors_.data();
+  bindings.descriptor_count = descriptor_count;
+  bindings.descriptor_write_index = 0;
+  bindings.dest_bpe_log2 = UINT32_MAX;
+  bindings.unscaled_source_bpe_log2 = UINT32_MAX;
+  size_t loads_dispatched = 0;
+  for (uint32_t load_index : texture_data_load_order_) {
+    TextureDataLoad& load = loads[load_index];
+    if (!RecordTextureDataLoadDispatches(
+            static_cast<D3D12Texture&>(*load.texture),
+            texture_data_load_layouts_[load_index], copy_buffer,
+            uint32_t(copy_buffer_size), bindings)) {
+      continue;
+    }
+    load.loaded = true;
+    ++loads_dispatched;
+  }
+
+  if (loads_dispatched) {
+    // Submit copying from the copy buffer to the host textures.
+    for (uint32_t load_index : texture_data_load_order_) {
+      if (!loads[load_index].loaded) {
+        continue;
+      }
+      D3D12Texture& d3d12_texture =
+          static_cast<D3D12Texture&>(*loads[load_index].texture);
+      command_processor_.PushTransitionBarrier(
+          d3d12_texture.resource(),
+          d3d12_texture.SetResourceState(D3D12_RESOURCE_STATE_COPY_DEST),
+          D3D12_RESOURCE_STATE_COPY_DEST);
+    }
+    command_processor_.PushTransitionBarrier(copy_buffer, copy_buffer_state,
+                                             D3D12_RESOURCE_STATE_COPY_SOURCE);
+    copy_buffer_state = D3D12_RESOURCE_STATE_COPY_SOURCE;
+    command_processor_.SubmitBarriers();
+    for (uint32_t load_index : texture_data_load_order_) {
+      if (!loads[load_index].loaded) {
+        continue;
+      }
+      D3D12Texture& d3d12_texture =
+          static_cast<D3D12Texture&>(*loads[load_index].texture);
+      // Update LRU caching because the texture will be used by the command
+      // list.
+      d3d12_texture.MarkAsUsed();
+      RecordTextureDataLoadCopies(d3d12_texture,
+                                  texture_data_load_layouts_[load_index],
+                                  copy_buffer);
+    }
+  }
+
+  command_processor_.ReleaseScratchGPUBuffer(copy_buffer, copy_buffer_state);
+}
+
+bool D3D12TextureCache::GetTextureDataLoadLayout(
+    const D3D12Texture& texture, bool load_base, bool load_mips,
+    UINT64& copy_buffer_size, TextureDataLoadLayout& layout_out) const {
+  TextureKey texture_key = texture.key();
 
   // Get the pipeline.
   LoadShaderIndex load_shader = GetLoadShaderIndex(texture_key);
@@ -1647,19 +2052,16 @@ bool D3D12TextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
     return false;
   }
   bool texture_resolution_scaled = texture_key.scaled_resolve;
-  ID3D12PipelineState* pipeline =
-      texture_resolution_scaled ? load_pipelines_scaled_[load_shader].Get()
-                                : load_pipelines_[load_shader].Get();
-  if (pipeline == nullptr) {
+  if ((texture_resolution_scaled ? load_pipelines_scaled_[load_shader]
+                                 : load_pipelines_[load_shader]) == nullptr) {
     return false;
   }
+  layout_out.load_shader = load_shader;
   const LoadShaderInfo& load_shader_info = GetLoadShaderInfo(load_shader);
 
   // Get the guest layout.
-  const texture_util::TextureGuestLayout& guest_layout =
-      d3d12_texture.guest_layout();
-  xenos::DataDimension dimension = texture_key.dimension;
-  bool is_3d = dimension == xenos::DataDimension::k3D;
+  const texture_util::TextureGuestLayout& guest_layout = texture.guest_layout();
+  bool is_3d = texture_key.dimension == xenos::DataDimension::k3D;
   uint32_t width = texture_key.GetWidth();
   uint32_t height = texture_key.GetHeight();
   uint32_t depth_or_array_size = texture_key.GetDepthOrArraySize();
@@ -1669,10 +2071,11 @@ bool D3D12TextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
   const FormatInfo* guest_format_info = FormatInfo::Get(guest_format);
   uint32_t block_width = guest_format_info->block_width;
   uint32_t block_height = guest_format_info->block_height;
-  uint32_t bytes_per_block = guest_format_info->bytes_per_block();
   uint32_t level_first = load_base ? 0 : 1;
   uint32_t level_last = load_mips ? texture_key.mip_max_level : 0;
   assert_true(level_first <= level_last);
+  layout_out.level_first = level_first;
+  layout_out.level_last = level_last;
   uint32_t level_packed = guest_layout.packed_level;
   uint32_t level_stored_first = std::min(level_first, level_packed);
   uint32_t level_stored_last = std::min(level_last, level_packed);
@@ -1685,42 +2088,34 @@ bool D3D12TextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
   // tail is stored as mip 0, because in this case, it would be ambiguous since
   // both the base and the mips would be on "level 0", but stored in separate
   // places.
-  uint32_t loop_level_first, loop_level_last;
   if (level_packed == 0) {
     // Packed mip tail is the level 0 - may need to load mip tails for the base,
     // the mips, or both.
     // Loop iteration 0 - base packed mip tail.
     // Loop iteration 1 - mips packed mip tail.
-    loop_level_first = uint32_t(level_first != 0);
-    loop_level_last = uint32_t(level_last != 0);
+    layout_out.loop_level_first = uint32_t(level_first != 0);
+    layout_out.loop_level_last = uint32_t(level_last != 0);
   } else {
     // Packed mip tail is not the level 0.
     // Loop iteration is the actual level being loaded.
-    loop_level_first = level_stored_first;
-    loop_level_last = level_stored_last;
+    layout_out.loop_level_first = level_stored_first;
+    layout_out.loop_level_last = level_stored_last;
   }
 
-  // Get the host layout and the buffer.
+  // Get the host layout.
   bool host_block_compressed =
       host_formats_[uint32_t(guest_format)].is_block_compressed &&
       !IsDecompressionNeeded(guest_format, width, height);
   uint32_t host_block_width = host_block_compressed ? block_width : 1;
   uint32_t host_block_height = host_block_compressed ? block_height : 1;
+  layout_out.host_block_width = host_block_width;
+  layout_out.host_block_height = host_block_height;
   uint32_t host_x_blocks_per_thread =
       UINT32_C(1) << load_shader_info.guest_x_blocks_per_thread_log2;
   if (!host_block_compressed) {
     // Decompressing guest blocks.
     host_x_blocks_per_thread *= block_width;
   }
-  UINT64 copy_buffer_size = 0;
-  D3D12_PLACED_SUBRESOURCE_FOOTPRINT host_slice_layout_base;
-  UINT64 host_slice_size_base;
-  // Indexing is the same as for guest stored mips:
-  // 1...min(level_last, level_packed) if level_packed is not 0, or only 0 if
-  // level_packed == 0.
-  D3D12_PLACED_SUBRESOURCE_FOOTPRINT
-  host_slice_layouts_mips[xenos::kTextureMaxMips];
-  UINT64 host_slice_sizes_mips[xenos::kTextureMaxMips];
   // Using custom calculations instead of GetCopyableFootprints because
   // shaders may unconditionally copy multiple blocks along X per thread for
   // simplicity, to make sure all rows (also including the last one -
@@ -1729,12 +2124,13 @@ bool D3D12TextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
   // implicit assumptions about D3D12_TEXTURE_DATA_PITCH_ALIGNMENT.
   DXGI_FORMAT host_copy_format =
       GetDXGIResourceFormat(guest_format, width, height);
-  for (uint32_t loop_level = loop_level_first; loop_level <= loop_level_last;
-       ++loop_level) {
+  for (uint32_t loop_level = layout_out.loop_level_first;
+       loop_level <= layout_out.loop_level_last; ++loop_level) {
     bool is_base = loop_level == 0;
     uint32_t level = (level_packed == 0) ? 0 : loop_level;
     D3D12_PLACED_SUBRESOURCE_FOOTPRINT& level_host_slice_layout =
-        is_base ? host_slice_layout_base : host_slice_layouts_mips[level];
+        is_base ? layout_out.host_slice_layout_base
+                : layout_out.host_slice_layouts_mips[level];
     level_host_slice_layout.Offset = copy_buffer_size;
     level_host_slice_layout.Footprint.Format = host_copy_format;
     if (level == level_packed) {
@@ -1771,78 +2167,82 @@ bool D3D12TextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
             (level_host_slice_layout.Footprint.Height / host_block_height) *
             level_host_slice_layout.Footprint.Depth,
         UINT64(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT));
-    (is_base ? host_slice_size_base : host_slice_sizes_mips[level]) =
-        level_host_slice_size;
+    (is_base ? layout_out.host_slice_size_base
+             : layout_out.host_slice_sizes_mips[level]) = level_host_slice_size;
     copy_buffer_size += level_host_slice_size * array_size;
   }
-  D3D12_RESOURCE_STATES copy_buffer_state =
-      D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
-  ID3D12Resource* copy_buffer = command_processor_.RequestScratchGPUBuffer(
-      uint32_t(copy_buffer_size), copy_buffer_state);
-  if (copy_buffer == nullptr) {
-    return false;
-  }
+  return true;
+}
 
-  // Begin loading.
-  // May use different buffers for scaled base and mips, and also addressability
-  // of more than 128 * 2^20 (2^D3D12_REQ_BUFFER_RESOURCE_TEXEL_COUNT_2_TO_EXP)
-  // texels is not mandatory - need two separate UAV descriptors for base and
-  // mips.
-  // Destination.
-  uint32_t descriptor_count = 1;
-  if (texture_resolution_scaled) {
-    // Source - base and mips, one or both.
-    descriptor_count += (level_first == 0 && level_last != 0) ? 2 : 1;
-  } else {
-    // Source - shared memory.
-    if (!bindless_resources_used_) {
-      ++descriptor_count;
-    }
-  }
-  ui::d3d12::util::DescriptorCpuGpuHandlePair descriptors_allocated[3];
-  if (!command_processor_.RequestOneUseSingleViewDescriptors(
-          descriptor_count, descriptors_allocated)) {
-    command_processor_.ReleaseScratchGPUBuffer(copy_buffer, copy_buffer_state);
-    return false;
+bool D3D12TextureCache::RecordTextureDataLoadDispatches(
+    D3D12Texture& texture, const TextureDataLoadLayout& layout,
+    ID3D12Resource* copy_buffer, uint32_t copy_buffer_size,
+    TextureDataLoadBindings& bindings) {
+  DeferredCommandList& command_list =
+      command_processor_.GetDeferredCommandList();
+  ID3D12Device* device = command_processor_.GetD3D12Provider().GetDevice();
+
+  TextureKey texture_key = texture.key();
+  LoadShaderIndex load_shader = layout.load_shader;
+  bool texture_resolution_scaled = texture_key.scaled_resolve;
+  const LoadShaderInfo& load_shader_info = GetLoadShaderInfo(load_shader);
+  const texture_util::TextureGuestLayout& guest_layout = texture.guest_layout();
+  xenos::DataDimension dimension = texture_key.dimension;
+  bool is_3d = dimension == xenos::DataDimension::k3D;
+  uint32_t width = texture_key.GetWidth();
+  uint32_t height = texture_key.GetHeight();
+  uint32_t depth_or_array_size = texture_key.GetDepthOrArraySize();
+  uint32_t depth = is_3d ? depth_or_array_size : 1;
+  uint32_t array_size = is_3d ? 1 : depth_or_array_size;
+  const FormatInfo* guest_format_info = FormatInfo::Get(texture_key.format);
+  uint32_t block_width = guest_format_info->block_width;
+  uint32_t block_height = guest_format_info->block_height;
+  uint32_t bytes_per_block = guest_format_info->bytes_per_block();
+  uint32_t level_packed = guest_layout.packed_level;
+  uint32_t texture_resolution_scale_x =
+      texture_resolution_scaled ? draw_resolution_scale_x() : 1;
+  uint32_t texture_resolution_scale_y =
+      texture_resolution_scaled ? draw_resolution_scale_y() : 1;
+
+  command_processor_.SetExternalPipeline(
+      texture_resolution_scaled ? load_pipelines_scaled_[load_shader].Get()
+                                : load_pipelines_[load_shader].Get());
+  // Set up the destination descriptor if the element size is different than
+  // for the previous texture.
+  if (bindings.dest_bpe_log2 != load_shader_info.dest_bpe_log2) {
+    assert_true(bindings.descriptor_write_index < bindings.descriptor_count);
+    ui::d3d12::util::DescriptorCpuGpuHandlePair descriptor_dest =
+        bindings.descriptors[bindings.descriptor_write_index++];
+    ui::d3d12::util::CreateBufferTypedUAV(
+        device, descriptor_dest.first, copy_buffer,
+        ui::d3d12::util::GetUintPow2DXGIFormat(load_shader_info.dest_bpe_log2),
+        copy_buffer_size >> load_shader_info.dest_bpe_log2);
+    command_list.D3DSetComputeRootDescriptorTable(2, descriptor_dest.second);
+    bindings.dest_bpe_log2 = load_shader_info.dest_bpe_log2;
   }
-  uint32_t descriptor_write_index = 0;
-  command_processor_.SetExternalPipeline(pipeline);
-  command_list.D3DSetComputeRootSignature(load_root_signature_.Get());
-  // Set up the destination descriptor.
-  assert_true(descriptor_write_index < descriptor_count);
-  ui::d3d12::util::DescriptorCpuGpuHandlePair descriptor_dest =
-      descriptors_allocated[descriptor_write_index++];
-  ui::d3d12::util::CreateBufferTypedUAV(
-      device, descriptor_dest.first, copy_buffer,
-      ui::d3d12::util::GetUintPow2DXGIFormat(load_shader_info.dest_bpe_log2),
-      uint32_t(copy_buffer_size) >> load_shader_info.dest_bpe_log2);
-  command_list.D3DSetComputeRootDescriptorTable(2, descriptor_dest.second);
   // Set up the unscaled source descriptor (scaled needs two descriptors that
   // depend on the buffer being current, so they will be set later - for mips,
   // after loading the base is done).
-  if (!texture_resolution_scaled) {
-    D3D12SharedMemory& d3d12_shared_memory =
-        static_cast<D3D12SharedMemory&>(shared_memory());
-    d3d12_shared_memory.UseForReading();
+  if (!texture_resolution_scaled &&
+      bindings.unscaled_source_bpe_log2 != load_shader_info.source_bpe_log2) {
     ui::d3d12::util::DescriptorCpuGpuHandlePair descriptor_unscaled_source;
     if (bindless_resources_used_) {
       descriptor_unscaled_source =
           command_processor_.GetSharedMemoryUintPow2BindlessSRVHandlePair(
               load_shader_info.source_bpe_log2);
     } else {
-      assert_true(descriptor_write_index < descriptor_count);
+      assert_true(bindings.descriptor_write_index < bindings.descriptor_count);
       descriptor_unscaled_source =
-          descriptors_allocated[descriptor_write_index++];
-      d3d12_shared_memory.WriteUintPow2SRVDescriptor(
-          descriptor_unscaled_source.first, load_shader_info.source_bpe_log2);
+          bindings.descriptors[bindings.descriptor_write_index++];
+      static_cast<D3D12SharedMemory&>(shared_memory())
+          .WriteUintPow2SRVDescriptor(descriptor_unscaled_source.first,
+                                      load_shader_info.source_bpe_log2);
     }
     command_list.D3DSetComputeRootDescriptorTable(
         1, descriptor_unscaled_source.second);
+    bindings.unscaled_source_bpe_log2 = load_shader_info.source_bpe_log2;
   }
 
-  // Submit the copy buffer population commands.
-
-  auto& cbuffer_pool = command_processor_.GetConstantBufferPool();
   LoadConstants load_constants;
   // 3 bits for each.
   assert_true(texture_resolution_scale_x <= 7);
@@ -1859,8 +2259,8 @@ bool D3D12TextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
   bool scaled_mips_source_set_up = false;
   uint32_t guest_x_blocks_per_group_log2 =
       load_shader_info.GetGuestXBlocksPerGroupLog2();
-  for (uint32_t loop_level = loop_level_first; loop_level <= loop_level_last;
-       ++loop_level) {
+  for (uint32_t loop_level = layout.loop_level_first;
+       loop_level <= layout.loop_level_last; ++loop_level) {
     bool is_base = loop_level == 0;
     uint32_t level = (level_packed == 0) ? 0 : loop_level;
 
@@ -1870,23 +2270,23 @@ bool D3D12TextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
     // Set up the base or mips source, also making it accessible if loading from
     // scaled resolve memory.
     if (texture_resolution_scaled && (is_base || !scaled_mips_source_set_up)) {
-      uint32_t guest_size_unscaled = is_base ? d3d12_texture.GetGuestBaseSize()
-                                             : d3d12_texture.GetGuestMipsSize();
+      uint32_t guest_size_unscaled = is_base ? texture.GetGuestBaseSize()
+                                             : texture.GetGuestMipsSize();
       if (!MakeScaledResolveRangeCurrent(guest_address, guest_size_unscaled,
                                          load_shader_info.source_bpe_log2)) {
-        command_processor_.ReleaseScratchGPUBuffer(copy_buffer,
-                                                   copy_buffer_state);
         return false;
       }
       TransitionCurrentScaledResolveRange(
           D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-      assert_true(descriptor_write_index < descriptor_count);
+      assert_true(bindings.descriptor_write_index < bindings.descriptor_count);
       ui::d3d12::util::DescriptorCpuGpuHandlePair descriptor_scaled_source =
-          descriptors_allocated[descriptor_write_index++];
+          bindings.descriptors[bindings.descriptor_write_index++];
       CreateCurrentScaledResolveRangeUintPow2SRV(
           descriptor_scaled_source.first, load_shader_info.source_bpe_log2);
       command_list.D3DSetComputeRootDescriptorTable(
           1, descriptor_scaled_source.second);
+      // The source is not the shared memory for the next unscaled texture.
+      bindings.unscaled_source_bpe_log2 = UINT32_MAX;
       if (!is_base) {
         scaled_mips_source_set_up = true;
       }
@@ -1950,9 +2350,11 @@ bool D3D12TextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
         kLoadGuestYBlocksPerGroupLog2;
 
     const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& level_host_slice_layout =
-        is_base ? host_slice_layout_base : host_slice_layouts_mips[level];
+        is_base ? layout.host_slice_layout_base
+                : layout.host_slice_layouts_mips[level];
     uint32_t host_slice_size =
-        uint32_t(is_base ? host_slice_size_base : host_slice_sizes_mips[level]);
+        uint32_t(is_base ? layout.host_slice_size_base
+                         : layout.host_slice_sizes_mips[level]);
     load_constants.host_offset = uint32_t(level_host_slice_layout.Offset);
     load_constants.host_pitch = level_host_slice_layout.Footprint.RowPitch;
 
@@ -1973,7 +2375,8 @@ bool D3D12TextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
             &load_constants.host_offset,
             offsetof(LoadConstants, host_offset) / sizeof(uint32_t));
       }
-      assert_true(copy_buffer_state == D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+      // Only the barriers for the sources - the copy buffer regions written
+      // by the dispatches don't overlap.
       command_processor_.SubmitBarriers();
       command_list.D3DDispatch(group_count_x, group_count_y,
                                load_constants.size_blocks[2]);
@@ -1982,32 +2385,48 @@ bool D3D12TextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
     }
   }
 
-  // Update LRU caching because the texture will be used by the command list.
-  d3d12_texture.MarkAsUsed();
+  return true;
+}
+
+void D3D12TextureCache::RecordTextureDataLoadCopies(
+    D3D12Texture& texture, const TextureDataLoadLayout& layout,
+    ID3D12Resource* copy_buffer) {
+  DeferredCommandList& command_list =
+      command_processor_.GetDeferredCommandList();
+
+  TextureKey texture_key = texture.key();
+  bool texture_resolution_scaled = texture_key.scaled_resolve;
+  bool is_3d = texture_key.dimension == xenos::DataDimension::k3D;
+  uint32_t width = texture_key.GetWidth();
+  uint32_t height = texture_key.GetHeight();
+  uint32_t depth_or_array_size = texture_key.GetDepthOrArraySize();
+  uint32_t depth = is_3d ? depth_or_array_size : 1;
+  uint32_t array_size = is_3d ? 1 : depth_or_array_size;
+  xenos::TextureFormat guest_format = texture_key.format;
+  const FormatInfo* guest_format_info = FormatInfo::Get(guest_format);
+  uint32_t block_width = guest_format_info->block_width;
+  uint32_t block_height = guest_format_info->block_height;
+  uint32_t level_packed = texture.guest_layout().packed_level;
+  uint32_t texture_resolution_scale_x =
+      texture_resolution_scaled ? draw_resolution_scale_x() : 1;
+  uint32_t texture_resolution_scale_y =
+      texture_resolution_scaled ? draw_resolution_scale_y() : 1;
 
-  // Submit copying from the copy buffer to the host texture.
-  ID3D12Resource* texture_resource = d3d12_texture.resource();
-  command_processor_.PushTransitionBarrier(
-      texture_resource,
-      d3d12_texture.SetResourceState(D3D12_RESOURCE_STATE_COPY_DEST),
-      D3D12_RESOURCE_STATE_COPY_DEST);
-  command_processor_.PushTransitionBarrier(copy_buffer, copy_buffer_state,
-                                           D3D12_RESOURCE_STATE_COPY_SOURCE);
-  copy_buffer_state = D3D12_RESOURCE_STATE_COPY_SOURCE;
-  command_processor_.SubmitBarriers();
   uint32_t texture_level_count = texture_key.mip_max_level + 1;
   D3D12_TEXTURE_COPY_LOCATION location_source, location_dest;
   location_source.pResource = copy_buffer;
   location_source.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-  location_dest.pResource = texture_resource;
+  location_dest.pResource = texture.resource();
   location_dest.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-  for (uint32_t level = level_first; level <= level_last; ++level) {
+  for (uint32_t level = layout.level_first; level <= layout.level_last;
+       ++level) {
     uint32_t guest_level = std::min(level, level_packed);
     location_source.PlacedFootprint =
-        level ? host_slice_layouts_mips[guest_level] : host_slice_layout_base;
+        level ? layout.host_slice_layouts_mips[guest_level]
+              : layout.host_slice_layout_base;
     location_dest.SubresourceIndex = level;
-    UINT64 host_slice_size =
-        level ? host_slice_sizes_mips[guest_level] : host_slice_size_base;
+    UINT64 host_slice_size = level ? layout.host_slice_sizes_mips[guest_level]
+                                   : layout.host_slice_size_base;
     D3D12_BOX source_box;
     const D3D12_BOX* source_box_ptr;
     if (level >= level_packed) {
@@ -2024,12 +2443,12 @@ bool D3D12TextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
           source_box.left +
           xe::align(std::max((width * texture_resolution_scale_x) >> level,
                              uint32_t(1)),
-                    host_block_width);
+                    layout.host_block_width);
       source_box.bottom =
           source_box.top +
           xe::align(std::max((height * texture_resolution_scale_y) >> level,
                              uint32_t(1)),
-                    host_block_height);
+                    layout.host_block_height);
       source_box.back =
           source_box.front + std::max(depth >> level, uint32_t(1));
       source_box_ptr = &source_box;
@@ -2043,10 +2462,6 @@ bool D3D12TextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
       location_source.PlacedFootprint.Offset += host_slice_size;
     }
   }
-
-  command_processor_.ReleaseScratchGPUBuffer(copy_buffer, copy_buffer_state);
-
-  return true;
 }
 
 void D3D12TextureCache::UpdateTextureBindingsImpl(
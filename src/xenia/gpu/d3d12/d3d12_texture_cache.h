@@ -11,13 +11,18 @@
 #define XENIA_GPU_D3D12_D3D12_TEXTURE_CACHE_H_
 
 #include <array>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "xenia/base/assert.h"
+#include "xenia/base/threading.h"
 #include "xenia/gpu/d3d12/d3d12_shader.h"
 #include "xenia/gpu/d3d12/d3d12_shared_memory.h"
 #include "xenia/gpu/register_file.h"
@@ -26,6 +31,7 @@
 #include "xenia/gpu/xenos.h"
 #include "xenia/ui/d3d12/d3d12_api.h"
 #include "xenia/ui/d3d12/d3d12_provider.h"
+#include "xenia/ui/d3d12/d3d12_util.h"
 
 namespace xe {
 namespace gpu {
@@ -93,6 +99,21 @@ class D3D12TextureCache final : public TextureCache {
   void BeginFrame() override;
   void EndFrame();
 
+  // Loads the list of the scaled resolve memory heaps used by the title in the
+  // previous session to commit them ahead of use, and saves the list for the
+  // previous title.
+  void InitializeScaledResolveStorage(const std::filesystem::path& cache_root,
+                                      uint32_t title_id);
+
+  uint64_t scaled_resolve_committed_bytes() const {
+    return uint64_t(scaled_resolve_heap_count_) << kScaledResolveHeapSizeLog2;
+  }
+  // Heaps that the command processor thread had to wait for the creation of
+  // because they weren't created ahead of use.
+  uint64_t scaled_resolve_on_demand_commits() const {
+    return scaled_resolve_on_demand_commits_;
+  }
+
   // Must be called within a submission - creates and untiles textures needed by
   // shaders and puts them in the SRV state. This may bind compute pipelines
   // (notifying the command processor about that), so this must be called before
@@ -133,6 +154,18 @@ class D3D12TextureCache final : public TextureCache {
   bool EnsureScaledResolveMemoryCommitted(
       uint32_t start_unscaled, uint32_t length_unscaled,
       uint32_t length_scaled_alignment_log2 = 0) override;
+  bool EnsureScaledResolveBuffersCreated(uint64_t first_scaled,
+                                         uint64_t last_scaled);
+  static Microsoft::WRL::ComPtr<ID3D12Heap> CreateScaledResolveHeap(
+      const ui::d3d12::D3D12Provider& provider);
+  // Maps a heap, taking it from the ones created ahead of use if available.
+  // The buffers for the heap must be created.
+  bool CommitScaledResolveHeap(uint32_t heap_index);
+  void RequestScaledResolveHeapCreation(uint32_t heap_index);
+  void ScaledResolveHeapCreationThread();
+  // Maps the heaps used in the previous session that have been created.
+  void CommitPrecreatedScaledResolveHeaps();
+  void ShutdownScaledResolveStorage();
   // Makes the specified range of up to 1-2 GB currently accessible on the GPU.
   // One draw call can access only at most one range - the same memory is
   // accessible through different buffers based on the range needed, so aliasing
@@ -166,6 +199,9 @@ class D3D12TextureCache final : public TextureCache {
   bool IsScaledResolveSupportedForFormat(TextureKey key) const override;
   uint32_t GetHostFormatSwizzle(TextureKey key) const override;
 
+  bool GetHostMemoryBudget(uint64_t& budget_out,
+                           uint64_t& usage_out) const override;
+
   uint32_t GetMaxHostTextureWidthHeight(
       xenos::DataDimension dimension) const override;
   uint32_t GetMaxHostTextureDepthOrArraySize(
@@ -176,6 +212,9 @@ class D3D12TextureCache final : public TextureCache {
   // This binds pipelines, allocates descriptors, and copies!
   bool LoadTextureDataFromResidentMemoryImpl(Texture& texture, bool load_base,
                                              bool load_mips) override;
+  void LoadTexturesDataFromResidentMemoryImpl(TextureDataLoad* loads,
+                                              size_t load_count) override;
+  bool CopyTextureDataImpl(Texture& dest, Texture& source) override;
 
   void UpdateTextureBindingsImpl(uint32_t fetch_constant_mask) override;
 
@@ -325,6 +364,39 @@ class D3D12TextureCache final : public TextureCache {
     }
   };
 
+  // Where the host data of a texture being loaded is placed in the copy buffer
+  // shared by all the textures loaded at once.
+  struct TextureDataLoadLayout {
+    LoadShaderIndex load_shader;
+    uint32_t level_first;
+    uint32_t level_last;
+    // See the comment in GetTextureDataLoadLayout.
+    uint32_t loop_level_first;
+    uint32_t loop_level_last;
+    uint32_t host_block_width;
+    uint32_t host_block_height;
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT host_slice_layout_base;
+    UINT64 host_slice_size_base;
+    // Indexing is the same as for guest stored mips:
+    // 1...min(level_last, level_packed) if level_packed is not 0, or only 0 if
+    // level_packed == 0.
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT
+    host_slice_layouts_mips[xenos::kTextureMaxMips];
+    UINT64 host_slice_sizes_mips[xenos::kTextureMaxMips];
+  };
+
+  // Bindings of the texture loading dispatches, to skip changing them between
+  // textures using the same ones.
+  struct TextureDataLoadBindings {
+    const ui::d3d12::util::DescriptorCpuGpuHandlePair* descriptors;
+    uint32_t descriptor_count;
+    uint32_t descriptor_write_index;
+    // UINT32_MAX if not set up yet.
+    uint32_t dest_bpe_log2;
+    // UINT32_MAX if the source is not the shared memory currently.
+    uint32_t unscaled_source_bpe_log2;
+  };
+
   class ScaledResolveVirtualBuffer {
    public:
     explicit ScaledResolveVirtualBuffer(ID3D12Resource* resource,
@@ -390,6 +462,24 @@ class D3D12TextureCache final : public TextureCache {
 
   LoadShaderIndex GetLoadShaderIndex(TextureKey key) const;
 
+  // Places the host data of the texture at copy_buffer_size, increasing it.
+  // Returns false if the texture can't be loaded.
+  bool GetTextureDataLoadLayout(const D3D12Texture& texture, bool load_base,
+                                bool load_mips, UINT64& copy_buffer_size,
+                                TextureDataLoadLayout& layout_out) const;
+  // Records the dispatches writing the host data of the texture to the copy
+  // buffer, in the UNORDERED_ACCESS state.
+  bool RecordTextureDataLoadDispatches(D3D12Texture& texture,
+                                       const TextureDataLoadLayout& layout,
+                                       ID3D12Resource* copy_buffer,
+                                       uint32_t copy_buffer_size,
+                                       TextureDataLoadBindings& bindings);
+  // Records copying from the copy buffer, in the COPY_SOURCE state, to the
+  // texture, in the COPY_DEST state.
+  void RecordTextureDataLoadCopies(D3D12Texture& texture,
+                                   const TextureDataLoadLayout& layout,
+                                   ID3D12Resource* copy_buffer);
+
   static constexpr bool AreDimensionsCompatible(
       xenos::FetchOpDimension binding_dimension,
       xenos::DataDimension resource_dimension) {
@@ -478,6 +568,11 @@ class D3D12TextureCache final : public TextureCache {
   // Load pipelines for resolution-scaled resolve targets.
   std::array<Microsoft::WRL::ComPtr<ID3D12PipelineState>, kLoadShaderCount>
       load_pipelines_scaled_;
+  // Temporary storage for LoadTexturesDataFromResidentMemoryImpl.
+  std::vector<TextureDataLoadLayout> texture_data_load_layouts_;
+  std::vector<uint32_t> texture_data_load_order_;
+  std::vector<ui::d3d12::util::DescriptorCpuGpuHandlePair>
+      texture_data_load_descriptors_;
 
   std::vector<SRVDescriptorCachePage> srv_descriptor_cache_;
   uint32_t srv_descriptor_cache_allocated_;
@@ -552,6 +647,31 @@ class D3D12TextureCache final : public TextureCache {
   std::vector<Microsoft::WRL::ComPtr<ID3D12Heap>> scaled_resolve_heaps_;
   // Number of currently resident portions of the tiled buffer, for profiling.
   uint32_t scaled_resolve_heap_count_ = 0;
+  uint64_t scaled_resolve_on_demand_commits_ = 0;
+  // Heaps accessed in the current session, to store for the next one.
+  std::vector<bool> scaled_resolve_heaps_used_;
+  // Heaps queued for creation ahead of use or already created that way.
+  std::vector<bool> scaled_resolve_heaps_requested_;
+  // Heaps used in the previous session and not committed yet.
+  std::vector<uint32_t> scaled_resolve_precommit_heaps_;
+  std::filesystem::path scaled_resolve_storage_path_;
+  struct ScaledResolveStorageHeader {
+    static constexpr uint32_t kMagic = 0x48525358;  // 'XSRH'
+    static constexpr uint32_t kVersion = 1;
+    uint32_t magic;
+    uint32_t version;
+    uint32_t heap_size_log2;
+  };
+  // Heaps are created ahead of use on a separate thread, as creating a heap
+  // may take milliseconds, but mapped on the command processor thread, which
+  // owns the direct queue.
+  std::mutex scaled_resolve_heap_creation_mutex_;
+  std::condition_variable scaled_resolve_heap_creation_cond_;
+  std::deque<uint32_t> scaled_resolve_heap_creation_queue_;
+  bool scaled_resolve_heap_creation_shutdown_ = false;
+  std::unordered_map<uint32_t, Microsoft::WRL::ComPtr<ID3D12Heap>>
+      scaled_resolve_precreated_heaps_;
+  std::unique_ptr<xe::threading::Thread> scaled_resolve_heap_creation_thread_;
   // Current scaled resolve state.
   // For aliasing barrier placement, last owning buffer index for each of 1 GB.
   size_t
@@ -25,7 +25,10 @@ DeferredCommandList::DeferredCommandList(
   command_stream_.reserve(initial_size / sizeof(uintmax_t));
 }
 
-void DeferredCommandList::Reset() { command_stream_.clear(); }
+void DeferredCommandList::Reset() {
+  command_stream_.clear();
+  last_index_buffer_command_offset_ = SIZE_MAX;
+}
 
 void DeferredCommandList::Execute(ID3D12GraphicsCommandList* command_list,
                                   ID3D12GraphicsCommandList1* command_list_1) {
@@ -41,6 +44,10 @@ void DeferredCommandList::Execute(ID3D12GraphicsCommandList* command_list,
     stream += kCommandHeaderSizeElements;
     stream_remaining -= kCommandHeaderSizeElements;
     switch (header.command) {
+      case Command::kD3DBeginQuery: {
+        auto& args = *reinterpret_cast<const D3DQueryArguments*>(stream);
+        command_list->BeginQuery(args.query_heap, args.type, args.index);
+      } break;
       case Command::kD3DClearDepthStencilView: {
         auto& args =
             *reinterpret_cast<const ClearDepthStencilViewHeader*>(stream);
@@ -117,6 +124,10 @@ void DeferredCommandList::Execute(ID3D12GraphicsCommandList* command_list,
               args.start_vertex_location, args.start_instance_location);
         }
       } break;
+      case Command::kD3DEndQuery: {
+        auto& args = *reinterpret_cast<const D3DQueryArguments*>(stream);
+        command_list->EndQuery(args.query_heap, args.type, args.index);
+      } break;
       case Command::kD3DIASetIndexBuffer: {
         auto view = reinterpret_cast<const D3D12_INDEX_BUFFER_VIEW*>(stream);
         command_list->IASetIndexBuffer(
@@ -159,6 +170,13 @@ void DeferredCommandList::Execute(ID3D12GraphicsCommandList* command_list,
                 reinterpret_cast<const uint8_t*>(stream) +
                 xe::align(sizeof(UINT), alignof(D3D12_RESOURCE_BARRIER))));
       } break;
+      case Command::kD3DResolveQueryData: {
+        auto& args =
+            *reinterpret_cast<const D3DResolveQueryDataArguments*>(stream);
+        command_list->ResolveQueryData(
+            args.query_heap, args.type, args.start_index, args.num_queries,
+            args.destination_buffer, args.aligned_destination_buffer_offset);
+      } break;
       case Command::kRSSetScissorRect: {
         command_list->RSSetScissorRects(
             1, reinterpret_cast<const D3D12_RECT*>(stream));
@@ -265,6 +283,51 @@ void DeferredCommandList::Execute(ID3D12GraphicsCommandList* command_list,
   }
 }
 
+bool DeferredCommandList::AppendToLastIndexedDraw(
+    const D3D12_INDEX_BUFFER_VIEW& view, UINT index_count,
+    uint32_t primitive_vertex_count) {
+  size_t index_buffer_offset = last_index_buffer_command_offset_;
+  if (index_buffer_offset == SIZE_MAX) {
+    return false;
+  }
+  const CommandHeader& index_buffer_header =
+      *reinterpret_cast<const CommandHeader*>(command_stream_.data() +
+                                              index_buffer_offset);
+  size_t draw_offset = index_buffer_offset + kCommandHeaderSizeElements +
+                       index_buffer_header.arguments_size_elements;
+  if (draw_offset >= command_stream_.size()) {
+    return false;
+  }
+  const CommandHeader& draw_header = *reinterpret_cast<const CommandHeader*>(
+      command_stream_.data() + draw_offset);
+  if (draw_header.command != Command::kD3DDrawIndexedInstanced ||
+      draw_offset + kCommandHeaderSizeElements +
+              draw_header.arguments_size_elements !=
+          command_stream_.size()) {
+    return false;
+  }
+  auto& index_buffer_args = *reinterpret_cast<D3D12_INDEX_BUFFER_VIEW*>(
+      command_stream_.data() + index_buffer_offset +
+      kCommandHeaderSizeElements);
+  auto& draw_args = *reinterpret_cast<D3DDrawIndexedInstancedArguments*>(
+      command_stream_.data() + draw_offset + kCommandHeaderSizeElements);
+  if (index_buffer_args.Format != view.Format ||
+      index_buffer_args.BufferLocation + index_buffer_args.SizeInBytes !=
+          view.BufferLocation ||
+      draw_args.instance_count != 1 || draw_args.start_index_location ||
+      draw_args.base_vertex_location || draw_args.start_instance_location ||
+      draw_args.index_count_per_instance % primitive_vertex_count ||
+      index_buffer_args.SizeInBytes !=
+          draw_args.index_count_per_instance *
+              (view.Format == DXGI_FORMAT_R16_UINT ? sizeof(uint16_t)
+                                                   : sizeof(uint32_t))) {
+    return false;
+  }
+  index_buffer_args.SizeInBytes += view.SizeInBytes;
+  draw_args.index_count_per_instance += index_count;
+  return true;
+}
+
 void* DeferredCommandList::WriteCommand(Command command,
                                         size_t arguments_size_bytes) {
   size_t arguments_size_elements =
@@ -27,6 +27,8 @@
 #include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/filesystem.h"
+#include "xenia/base/frame_breakdown.h"
+#include "xenia/base/lock_profiling.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
@@ -61,6 +63,14 @@ DEFINE_int32(
 DEFINE_bool(d3d12_tessellation_wireframe, false,
             "Display tessellated surfaces as wireframe for debugging.",
             "D3D12");
+DEFINE_bool(
+    d3d12_dxil, false,
+    "Convert the shaders of the pipelines from DXBC to DXIL before creating "
+    "them, so the driver doesn't have to, if the device supports Shader Model "
+    "6.0, and dxilconv.dll, dxcompiler.dll and dxil.dll from the DirectX "
+    "Shader Compiler are present. Pipelines are created from DXBC if any of "
+    "their shaders can't be converted.",
+    "D3D12");
 
 namespace xe {
 namespace gpu {
@@ -92,21 +102,10 @@ PipelineCache::PipelineCache(D3D12CommandProcessor& command_processor,
       register_file_(register_file),
       render_target_cache_(render_target_cache),
       bindless_resources_used_(bindless_resources_used) {
-  const ui::d3d12::D3D12Provider& provider =
-      command_processor_.GetD3D12Provider();
-
-  bool edram_rov_used = render_target_cache.GetPath() ==
-                        RenderTargetCache::Path::kPixelShaderInterlock;
-
-  shader_translator_ = std::make_unique<DxbcShaderTranslator>(
-      provider.GetAdapterVendorID(), bindless_resources_used_, edram_rov_used,
-      render_target_cache_.gamma_render_target_as_srgb(),
-      render_target_cache_.msaa_2x_supported(),
-      render_target_cache_.draw_resolution_scale_x(),
-      render_target_cache_.draw_resolution_scale_y(),
-      provider.GetGraphicsAnalysis() != nullptr);
+  shader_translator_ = CreateShaderTranslator();
 
-  if (edram_rov_used) {
+  if (render_target_cache.GetPath() ==
+      RenderTargetCache::Path::kPixelShaderInterlock) {
     depth_only_pixel_shader_ =
         std::move(shader_translator_->CreateDepthOnlyPixelShader());
   }
@@ -143,6 +142,30 @@ bool PipelineCache::Initialize() {
     }
   }
 
+  // Initialize the DXIL conversion of the pipeline shaders.
+  dxil_converter_ = nullptr;
+  dxil_utils_ = nullptr;
+  dxil_validator_ = nullptr;
+  if (cvars::d3d12_dxil) {
+    if (provider.GetHighestShaderModel() < D3D_SHADER_MODEL_6_0) {
+      XELOGW(
+          "The Direct3D 12 device doesn't support DXIL shaders, pipelines will "
+          "be created from DXBC");
+    } else if (FAILED(provider.DxbcConverterCreateInstance(
+                   CLSID_DxbcConverter, IID_PPV_ARGS(&dxil_converter_))) ||
+               FAILED(provider.DxcCreateInstance(
+                   CLSID_DxcUtils, IID_PPV_ARGS(&dxil_utils_))) ||
+               FAILED(provider.DxcCreateInstance(
+                   CLSID_DxcValidator, IID_PPV_ARGS(&dxil_validator_)))) {
+      XELOGE(
+          "Failed to create the interfaces for DXIL conversion, pipelines will "
+          "be created from DXBC");
+      ui::d3d12::util::ReleaseAndNull(dxil_validator_);
+      ui::d3d12::util::ReleaseAndNull(dxil_utils_);
+      ui::d3d12::util::ReleaseAndNull(dxil_converter_);
+    }
+  }
+
   uint32_t logical_processor_count = xe::threading::logical_processor_count();
   if (!logical_processor_count) {
     // Pick some reasonable amount if couldn't determine the number of cores.
@@ -220,6 +243,10 @@ void PipelineCache::Shutdown() {
   shader_storage_index_ = 0;
 
   // Shut down shader translation.
+  dxil_conversions_.clear();
+  ui::d3d12::util::ReleaseAndNull(dxil_validator_);
+  ui::d3d12::util::ReleaseAndNull(dxil_utils_);
+  ui::d3d12::util::ReleaseAndNull(dxil_converter_);
   ui::d3d12::util::ReleaseAndNull(dxc_compiler_);
   ui::d3d12::util::ReleaseAndNull(dxc_utils_);
   ui::d3d12::util::ReleaseAndNull(dxbc_converter_);
@@ -227,6 +254,13 @@ void PipelineCache::Shutdown() {
 
 void PipelineCache::InitializeShaderStorage(
     const std::filesystem::path& cache_root, uint32_t title_id, bool blocking) {
+  // Still open for the title launching another of its executables - what's in
+  // the storage has already been loaded, and the shaders and the pipelines
+  // created since are kept across the launch anyway.
+  if (storage_write_thread_ && shader_storage_title_id_ == title_id &&
+      shader_storage_cache_root_ == cache_root) {
+    return;
+  }
   ShutdownShaderStorage();
 
   auto shader_storage_root = cache_root / "shaders";
@@ -273,6 +307,11 @@ void PipelineCache::InitializeShaderStorage(
     return;
   }
   pipeline_storage_file_flush_needed_ = false;
+  // Other emulator instances may be using the same storage files concurrently.
+  // They're read under a shared lock, records are only appended to them under
+  // an exclusive lock, and they're truncated or reinitialized only if no other
+  // instance has appended anything since they've been read.
+  xe::filesystem::LockStdioFile(pipeline_storage_file_, false);
   // 'XEPS'.
   const uint32_t pipeline_storage_magic = 0x53504558;
   // 'DXRO' or 'DXRT'.
@@ -339,6 +378,10 @@ void PipelineCache::InitializeShaderStorage(
       }
     }
   }
+  xe::filesystem::Seek(pipeline_storage_file_, 0, SEEK_END);
+  int64_t pipeline_storage_read_end =
+      xe::filesystem::Tell(pipeline_storage_file_);
+  xe::filesystem::UnlockStdioFile(pipeline_storage_file_);
 
   size_t logical_processor_count = xe::threading::logical_processor_count();
   if (!logical_processor_count) {
@@ -346,6 +389,145 @@ void PipelineCache::InitializeShaderStorage(
     logical_processor_count = 6;
   }
 
+  // Pipelines are created as soon as the shaders they use are translated,
+  // while the rest of the shaders are still being loaded and translated,
+  // rather than after all of them. <Shader hash, indices of the stored
+  // pipelines using it>, and the number of shaders each pipeline is waiting
+  // for.
+  std::unordered_map<uint64_t, std::vector<size_t>> shader_stored_pipelines;
+  std::vector<uint32_t> stored_pipeline_shaders_pending(
+      pipeline_stored_descriptions.size(), 0);
+  for (size_t i = 0; i < pipeline_stored_descriptions.size(); ++i) {
+    const PipelineDescription& pipeline_description =
+        pipeline_stored_descriptions[i].description;
+    shader_stored_pipelines[pipeline_description.vertex_shader_hash].push_back(
+        i);
+    ++stored_pipeline_shaders_pending[i];
+    if (pipeline_description.pixel_shader_hash &&
+        pipeline_description.pixel_shader_hash !=
+            pipeline_description.vertex_shader_hash) {
+      shader_stored_pipelines[pipeline_description.pixel_shader_hash]
+          .push_back(i);
+      ++stored_pipeline_shaders_pending[i];
+    }
+  }
+
+  size_t pipelines_created = 0;
+  auto create_stored_pipeline =
+      [&](const PipelineStoredDescription& pipeline_stored_description) {
+        const PipelineDescription& pipeline_description =
+            pipeline_stored_description.description;
+        // TODO(Triang3l): On Vulkan, skip pipelines requiring unsupported
+        // device features (to keep the cache files mostly shareable across
+        // devices).
+        // Skip already known pipelines - those have already been enqueued.
+        auto found_range = pipelines_.equal_range(
+            pipeline_stored_description.description_hash);
+        for (auto it = found_range.first; it != found_range.second; ++it) {
+          Pipeline* found_pipeline = it->second;
+          if (!std::memcmp(&found_pipeline->description.description,
+                           &pipeline_description,
+                           sizeof(pipeline_description))) {
+            return;
+          }
+        }
+
+        PipelineRuntimeDescription pipeline_runtime_description;
+        auto vertex_shader_it =
+            shaders_.find(pipeline_description.vertex_shader_hash);
+        if (vertex_shader_it == shaders_.end()) {
+          return;
+        }
+        D3D12Shader* vertex_shader = vertex_shader_it->second;
+        pipeline_runtime_description.vertex_shader =
+            static_cast<D3D12Shader::D3D12Translation*>(
+                vertex_shader->GetTranslation(
+                    pipeline_description.vertex_shader_modification));
+        if (!pipeline_runtime_description.vertex_shader ||
+            !pipeline_runtime_description.vertex_shader->is_translated() ||
+            !pipeline_runtime_description.vertex_shader->is_valid()) {
+          return;
+        }
+        D3D12Shader* pixel_shader;
+        if (pipeline_description.pixel_shader_hash) {
+          auto pixel_shader_it =
+              shaders_.find(pipeline_description.pixel_shader_hash);
+          if (pixel_shader_it == shaders_.end()) {
+            return;
+          }
+          pixel_shader = pixel_shader_it->second;
+          pipeline_runtime_description.pixel_shader =
+              static_cast<D3D12Shader::D3D12Translation*>(
+                  pixel_shader->GetTranslation(
+                      pipeline_description.pixel_shader_modification));
+          if (!pipeline_runtime_description.pixel_shader ||
+              !pipeline_runtime_description.pixel_shader->is_translated() ||
+              !pipeline_runtime_description.pixel_shader->is_valid()) {
+            return;
+          }
+        } else {
+          pixel_shader = nullptr;
+          pipeline_runtime_description.pixel_shader = nullptr;
+        }
+        GeometryShaderKey pipeline_geometry_shader_key;
+        pipeline_runtime_description.geometry_shader =
+            GetGeometryShaderKey(
+                pipeline_description.geometry_shader,
+                DxbcShaderTranslator::Modification(
+                    pipeline_description.vertex_shader_modification),
+                DxbcShaderTranslator::Modification(
+                    pipeline_description.pixel_shader_modification),
+                pipeline_geometry_shader_key)
+                ? &GetGeometryShader(pipeline_geometry_shader_key)
+                : nullptr;
+        pipeline_runtime_description.root_signature =
+            command_processor_.GetRootSignature(
+                vertex_shader, pixel_shader,
+                Shader::IsHostVertexShaderTypeDomain(
+                    DxbcShaderTranslator::Modification(
+                        pipeline_description.vertex_shader_modification)
+                        .vertex.host_vertex_shader_type));
+        if (!pipeline_runtime_description.root_signature) {
+          return;
+        }
+        std::memcpy(&pipeline_runtime_description.description,
+                    &pipeline_description, sizeof(pipeline_description));
+
+        Pipeline* new_pipeline = new Pipeline;
+        new_pipeline->state = nullptr;
+        std::memcpy(&new_pipeline->description, &pipeline_runtime_description,
+                    sizeof(pipeline_runtime_description));
+        pipelines_.emplace(pipeline_stored_description.description_hash,
+                           new_pipeline);
+        COUNT_profile_set("gpu/pipeline_cache/pipelines", pipelines_.size());
+        if (!creation_threads_.empty()) {
+          // Submit the pipeline for creation to any available thread.
+          {
+            std::lock_guard<std::mutex> lock(creation_request_lock_);
+            creation_queue_.push_back(new_pipeline);
+          }
+          creation_request_cond_.notify_one();
+        } else {
+          new_pipeline->state =
+              CreateD3D12Pipeline(pipeline_runtime_description, false);
+        }
+        ++pipelines_created;
+      };
+  // Called on the processor thread for every shader from the storage once all
+  // its needed modifications have been translated.
+  auto on_stored_shader_translated = [&](uint64_t ucode_data_hash) {
+    auto shader_stored_pipelines_it =
+        shader_stored_pipelines.find(ucode_data_hash);
+    if (shader_stored_pipelines_it == shader_stored_pipelines.end()) {
+      return;
+    }
+    for (size_t pipeline_index : shader_stored_pipelines_it->second) {
+      if (!--stored_pipeline_shaders_pending[pipeline_index]) {
+        create_stored_pipeline(pipeline_stored_descriptions[pipeline_index]);
+      }
+    }
+  };
+
   // Initialize the Xenos shader storage stream.
   uint64_t shader_storage_initialization_start =
       xe::Clock::QueryHostTickCount();
@@ -364,12 +546,35 @@ void PipelineCache::InitializeShaderStorage(
   }
   ++shader_storage_index_;
   shader_storage_file_flush_needed_ = false;
+
+  uint64_t pipeline_creation_start_ = xe::Clock::QueryHostTickCount();
+  // Launch additional creation threads to use all cores to create pipelines
+  // faster. Will also be using the main thread, so minus 1.
+  size_t creation_thread_original_count = creation_threads_.size();
+  if (!pipeline_stored_descriptions.empty()) {
+    size_t creation_thread_needed_count = std::max(
+        std::min(pipeline_stored_descriptions.size(), logical_processor_count) -
+            size_t(1),
+        creation_thread_original_count);
+    while (creation_threads_.size() < creation_thread_needed_count) {
+      size_t creation_thread_index = creation_threads_.size();
+      std::unique_ptr<xe::threading::Thread> creation_thread =
+          xe::threading::Thread::Create({}, [this, creation_thread_index]() {
+            CreationThread(creation_thread_index);
+          });
+      assert_not_null(creation_thread);
+      creation_thread->set_name("D3D12 Pipelines");
+      creation_threads_.push_back(std::move(creation_thread));
+    }
+  }
+
   struct {
     uint32_t magic;
     uint32_t version_swapped;
   } shader_storage_file_header;
   // 'XESH'.
   const uint32_t shader_storage_magic = 0x48534558;
+  xe::filesystem::LockStdioFile(shader_storage_file_, false);
   if (fread(&shader_storage_file_header, sizeof(shader_storage_file_header), 1,
             shader_storage_file_) &&
       shader_storage_file_header.magic == shader_storage_magic &&
@@ -381,27 +586,60 @@ void PipelineCache::InitializeShaderStorage(
     ShaderStoredHeader shader_header;
     std::vector<uint32_t> ucode_dwords;
     ucode_dwords.reserve(0xFFFF);
+    std::vector<uint8_t> ucode_analysis;
     size_t shaders_translated = 0;
 
-    // Threads overlapping file reading.
+    // Threads overlapping file reading. Once the whole file has been read, the
+    // processor thread takes shaders from the same queue too.
     std::mutex shaders_translation_thread_mutex;
     std::condition_variable shaders_translation_thread_cond;
     std::deque<D3D12Shader*> shaders_to_translate;
     size_t shader_translation_threads_busy = 0;
     bool shader_translation_threads_shutdown = false;
+    // Shaders with all the needed modifications translated, for creating the
+    // pipelines using them on the processor thread. Protected with
+    // shaders_translation_thread_mutex, notify shaders_translated_cond.
+    std::condition_variable shaders_translated_cond;
+    std::vector<D3D12Shader*> shaders_translated_pending;
     std::mutex shaders_failed_to_translate_mutex;
     std::vector<D3D12Shader::D3D12Translation*> shaders_failed_to_translate;
+    auto translate_stored_shader = [&](D3D12Shader* shader_to_translate,
+                                       StringBuffer& ucode_disasm_buffer,
+                                       DxbcShaderTranslator& translator,
+                                       IDxbcConverter* dxbc_converter,
+                                       IDxcUtils* dxc_utils,
+                                       IDxcCompiler* dxc_compiler) {
+      shader_to_translate->AnalyzeUcode(ucode_disasm_buffer);
+      // Translate each needed modification on this thread after performing
+      // modification-independent analysis of the whole shader.
+      uint64_t ucode_data_hash = shader_to_translate->ucode_data_hash();
+      for (auto modification_it = shader_translations_needed.lower_bound(
+               std::make_pair(ucode_data_hash, uint64_t(0)));
+           modification_it != shader_translations_needed.end() &&
+           modification_it->first == ucode_data_hash;
+           ++modification_it) {
+        D3D12Shader::D3D12Translation* translation =
+            static_cast<D3D12Shader::D3D12Translation*>(
+                shader_to_translate->GetOrCreateTranslation(
+                    modification_it->second));
+        // Only try (and delete in case of failure) if it's a new translation.
+        // If it's a shader previously encountered in the game, translation of
+        // which has failed, and the shader storage is loaded later, keep it
+        // this way not to try to translate it again.
+        if (!translation->is_translated() &&
+            !TranslateAnalyzedShader(translator, *translation, dxbc_converter,
+                                     dxc_utils, dxc_compiler)) {
+          std::lock_guard<std::mutex> lock(shaders_failed_to_translate_mutex);
+          shaders_failed_to_translate.push_back(translation);
+        }
+      }
+    };
     auto shader_translation_thread_function = [&]() {
       const ui::d3d12::D3D12Provider& provider =
           command_processor_.GetD3D12Provider();
       StringBuffer ucode_disasm_buffer;
-      DxbcShaderTranslator translator(
-          provider.GetAdapterVendorID(), bindless_resources_used_,
-          edram_rov_used, render_target_cache_.gamma_render_target_as_srgb(),
-          render_target_cache_.msaa_2x_supported(),
-          render_target_cache_.draw_resolution_scale_x(),
-          render_target_cache_.draw_resolution_scale_y(),
-          provider.GetGraphicsAnalysis() != nullptr);
+      std::unique_ptr<DxbcShaderTranslator> translator =
+          AcquireShaderTranslator();
       // If needed and possible, create objects needed for DXIL conversion and
       // disassembly on this thread.
       IDxbcConverter* dxbc_converter = nullptr;
@@ -417,48 +655,28 @@ void PipelineCache::InitializeShaderStorage(
       }
       for (;;) {
         D3D12Shader* shader_to_translate;
-        for (;;) {
+        {
           std::unique_lock<std::mutex> lock(shaders_translation_thread_mutex);
+          shaders_translation_thread_cond.wait(lock, [&]() {
+            return !shaders_to_translate.empty() ||
+                   shader_translation_threads_shutdown;
+          });
           if (shaders_to_translate.empty()) {
-            if (shader_translation_threads_shutdown) {
-              return;
-            }
-            shaders_translation_thread_cond.wait(lock);
-            continue;
+            break;
           }
           shader_to_translate = shaders_to_translate.front();
           shaders_to_translate.pop_front();
           ++shader_translation_threads_busy;
-          break;
-        }
-        shader_to_translate->AnalyzeUcode(ucode_disasm_buffer);
-        // Translate each needed modification on this thread after performing
-        // modification-independent analysis of the whole shader.
-        uint64_t ucode_data_hash = shader_to_translate->ucode_data_hash();
-        for (auto modification_it = shader_translations_needed.lower_bound(
-                 std::make_pair(ucode_data_hash, uint64_t(0)));
-             modification_it != shader_translations_needed.end() &&
-             modification_it->first == ucode_data_hash;
-             ++modification_it) {
-          D3D12Shader::D3D12Translation* translation =
-              static_cast<D3D12Shader::D3D12Translation*>(
-                  shader_to_translate->GetOrCreateTranslation(
-                      modification_it->second));
-          // Only try (and delete in case of failure) if it's a new translation.
-          // If it's a shader previously encountered in the game, translation of
-          // which has failed, and the shader storage is loaded later, keep it
-          // this way not to try to translate it again.
-          if (!translation->is_translated() &&
-              !TranslateAnalyzedShader(translator, *translation, dxbc_converter,
-                                       dxc_utils, dxc_compiler)) {
-            std::lock_guard<std::mutex> lock(shaders_failed_to_translate_mutex);
-            shaders_failed_to_translate.push_back(translation);
-          }
         }
+        translate_stored_shader(shader_to_translate, ucode_disasm_buffer,
+                                *translator, dxbc_converter, dxc_utils,
+                                dxc_compiler);
         {
           std::lock_guard<std::mutex> lock(shaders_translation_thread_mutex);
           --shader_translation_threads_busy;
+          shaders_translated_pending.push_back(shader_to_translate);
         }
+        shaders_translated_cond.notify_one();
       }
       if (dxc_compiler) {
         dxc_compiler->Release();
@@ -469,9 +687,21 @@ void PipelineCache::InitializeShaderStorage(
       if (dxbc_converter) {
         dxbc_converter->Release();
       }
+      ReleaseShaderTranslator(std::move(translator));
     };
     std::vector<std::unique_ptr<xe::threading::Thread>>
         shader_translation_threads;
+    std::vector<D3D12Shader*> shaders_translated_taken;
+    auto take_translated_shaders = [&]() {
+      {
+        std::lock_guard<std::mutex> lock(shaders_translation_thread_mutex);
+        shaders_translated_taken.swap(shaders_translated_pending);
+      }
+      for (D3D12Shader* shader : shaders_translated_taken) {
+        on_stored_shader_translated(shader->ucode_data_hash());
+      }
+      shaders_translated_taken.clear();
+    };
 
     while (true) {
       if (!fread(&shader_header, sizeof(shader_header), 1,
@@ -492,7 +722,14 @@ void PipelineCache::InitializeShaderStorage(
         // Validation failed.
         break;
       }
-      shader_storage_valid_bytes += sizeof(shader_header) + ucode_byte_count;
+      ucode_analysis.resize(shader_header.ucode_analysis_size);
+      if (shader_header.ucode_analysis_size &&
+          !fread(ucode_analysis.data(), shader_header.ucode_analysis_size, 1,
+                 shader_storage_file_)) {
+        break;
+      }
+      shader_storage_valid_bytes += sizeof(shader_header) + ucode_byte_count +
+                                    shader_header.ucode_analysis_size;
       D3D12Shader* shader =
           LoadShader(shader_header.type, ucode_dwords.data(),
                      shader_header.ucode_dword_count, ucode_data_hash);
@@ -503,6 +740,13 @@ void PipelineCache::InitializeShaderStorage(
       }
       // Loaded from the current storage - don't write again.
       shader->set_ucode_storage_index(shader_storage_index_);
+      // Skip the analysis on the translation threads if the results are
+      // stored and valid for this build (AnalyzeUcode returns immediately for
+      // an analyzed shader).
+      if (!ucode_analysis.empty()) {
+        shader->DeserializeUcodeAnalysis(ucode_analysis.data(),
+                                         ucode_analysis.size());
+      }
       // Create new threads if the currently existing threads can't keep up
       // with file reading, but not more than the number of logical processors
       // minus one.
@@ -530,6 +774,41 @@ void PipelineCache::InitializeShaderStorage(
       }
       shaders_translation_thread_cond.notify_one();
       ++shaders_translated;
+      // Start creating the pipelines whose shaders are ready while still
+      // reading.
+      take_translated_shaders();
+    }
+    xe::filesystem::Seek(shader_storage_file_, 0, SEEK_END);
+    int64_t shader_storage_read_end =
+        xe::filesystem::Tell(shader_storage_file_);
+    xe::filesystem::UnlockStdioFile(shader_storage_file_);
+    // Help the translation threads with the rest of the queue, and keep
+    // creating the pipelines as their shaders become ready.
+    while (true) {
+      D3D12Shader* shader_to_translate = nullptr;
+      {
+        std::unique_lock<std::mutex> lock(shaders_translation_thread_mutex);
+        shaders_translated_cond.wait(lock, [&]() {
+          return !shaders_translated_pending.empty() ||
+                 !shaders_to_translate.empty() ||
+                 !shader_translation_threads_busy;
+        });
+        if (shaders_translated_pending.empty()) {
+          if (shaders_to_translate.empty()) {
+            break;
+          }
+          shader_to_translate = shaders_to_translate.front();
+          shaders_to_translate.pop_front();
+        }
+      }
+      if (shader_to_translate) {
+        translate_stored_shader(shader_to_translate, ucode_disasm_buffer_,
+                                *shader_translator_, dxbc_converter_,
+                                dxc_utils_, dxc_compiler_);
+        on_stored_shader_translated(shader_to_translate->ucode_data_hash());
+      } else {
+        take_translated_shaders();
+      }
     }
     if (!shader_translation_threads.empty()) {
       {
@@ -541,14 +820,15 @@ void PipelineCache::InitializeShaderStorage(
         xe::threading::Wait(shader_translation_thread.get(), false);
       }
       shader_translation_threads.clear();
-      for (D3D12Shader::D3D12Translation* translation :
-           shaders_failed_to_translate) {
-        D3D12Shader* shader = static_cast<D3D12Shader*>(&translation->shader());
-        shader->DestroyTranslation(translation->modification());
-        if (shader->translations().empty()) {
-          shaders_.erase(shader->ucode_data_hash());
-          delete shader;
-        }
+    }
+    // Not referenced by any pipeline as only valid translations are used.
+    for (D3D12Shader::D3D12Translation* translation :
+         shaders_failed_to_translate) {
+      D3D12Shader* shader = static_cast<D3D12Shader*>(&translation->shader());
+      shader->DestroyTranslation(translation->modification());
+      if (shader->translations().empty()) {
+        shaders_.erase(shader->ucode_data_hash());
+        delete shader;
       }
     }
     XELOGGPU("Translated {} shaders from the storage in {} milliseconds",
@@ -556,141 +836,38 @@ void PipelineCache::InitializeShaderStorage(
              (xe::Clock::QueryHostTickCount() -
               shader_storage_initialization_start) *
                  1000 / xe::Clock::QueryHostTickFrequency());
-    xe::filesystem::TruncateStdioFile(shader_storage_file_,
-                                      shader_storage_valid_bytes);
+    if (int64_t(shader_storage_valid_bytes) != shader_storage_read_end &&
+        xe::filesystem::LockStdioFileIfUnchanged(
+            shader_storage_file_, uint64_t(shader_storage_read_end))) {
+      xe::filesystem::TruncateStdioFile(shader_storage_file_,
+                                        shader_storage_valid_bytes);
+      xe::filesystem::UnlockStdioFile(shader_storage_file_);
+    }
   } else {
-    xe::filesystem::TruncateStdioFile(shader_storage_file_, 0);
-    shader_storage_file_header.magic = shader_storage_magic;
-    shader_storage_file_header.version_swapped =
-        xe::byte_swap(ShaderStoredHeader::kVersion);
-    fwrite(&shader_storage_file_header, sizeof(shader_storage_file_header), 1,
-           shader_storage_file_);
-  }
-
-  // Create the pipelines.
+    xe::filesystem::Seek(shader_storage_file_, 0, SEEK_END);
+    int64_t shader_storage_read_end =
+        xe::filesystem::Tell(shader_storage_file_);
+    xe::filesystem::UnlockStdioFile(shader_storage_file_);
+    if (xe::filesystem::LockStdioFileIfUnchanged(
+            shader_storage_file_, uint64_t(shader_storage_read_end))) {
+      xe::filesystem::TruncateStdioFile(shader_storage_file_, 0);
+      shader_storage_file_header.magic = shader_storage_magic;
+      shader_storage_file_header.version_swapped =
+          xe::byte_swap(ShaderStoredHeader::kVersion);
+      fwrite(&shader_storage_file_header, sizeof(shader_storage_file_header),
+             1, shader_storage_file_);
+      xe::filesystem::UnlockStdioFile(shader_storage_file_);
+    }
+  }
+
+  // Finish creating the pipelines.
   if (!pipeline_stored_descriptions.empty()) {
-    uint64_t pipeline_creation_start_ = xe::Clock::QueryHostTickCount();
-
-    // Launch additional creation threads to use all cores to create
-    // pipelines faster. Will also be using the main thread, so minus 1.
-    size_t creation_thread_original_count = creation_threads_.size();
-    size_t creation_thread_needed_count = std::max(
-        std::min(pipeline_stored_descriptions.size(), logical_processor_count) -
-            size_t(1),
-        creation_thread_original_count);
-    while (creation_threads_.size() < creation_thread_original_count) {
-      size_t creation_thread_index = creation_threads_.size();
-      std::unique_ptr<xe::threading::Thread> creation_thread =
-          xe::threading::Thread::Create({}, [this, creation_thread_index]() {
-            CreationThread(creation_thread_index);
-          });
-      assert_not_null(creation_thread);
-      creation_thread->set_name("D3D12 Pipelines");
-      creation_threads_.push_back(std::move(creation_thread));
-    }
-
-    size_t pipelines_created = 0;
-    for (const PipelineStoredDescription& pipeline_stored_description :
-         pipeline_stored_descriptions) {
-      const PipelineDescription& pipeline_description =
-          pipeline_stored_description.description;
-      // TODO(Triang3l): On Vulkan, skip pipelines requiring unsupported device
-      // features (to keep the cache files mostly shareable across devices).
-      // Skip already known pipelines - those have already been enqueued.
-      auto found_range =
-          pipelines_.equal_range(pipeline_stored_description.description_hash);
-      bool pipeline_found = false;
-      for (auto it = found_range.first; it != found_range.second; ++it) {
-        Pipeline* found_pipeline = it->second;
-        if (!std::memcmp(&found_pipeline->description.description,
-                         &pipeline_description, sizeof(pipeline_description))) {
-          pipeline_found = true;
-          break;
-        }
-      }
-      if (pipeline_found) {
-        continue;
-      }
-
-      PipelineRuntimeDescription pipeline_runtime_description;
-      auto vertex_shader_it =
-          shaders_.find(pipeline_description.vertex_shader_hash);
-      if (vertex_shader_it == shaders_.end()) {
-        continue;
-      }
-      D3D12Shader* vertex_shader = vertex_shader_it->second;
-      pipeline_runtime_description.vertex_shader =
-          static_cast<D3D12Shader::D3D12Translation*>(
-              vertex_shader->GetTranslation(
-                  pipeline_description.vertex_shader_modification));
-      if (!pipeline_runtime_description.vertex_shader ||
-          !pipeline_runtime_description.vertex_shader->is_translated() ||
-          !pipeline_runtime_description.vertex_shader->is_valid()) {
-        continue;
-      }
-      D3D12Shader* pixel_shader;
-      if (pipeline_description.pixel_shader_hash) {
-        auto pixel_shader_it =
-            shaders_.find(pipeline_description.pixel_shader_hash);
-        if (pixel_shader_it == shaders_.end()) {
-          continue;
-        }
-        pixel_shader = pixel_shader_it->second;
-        pipeline_runtime_description.pixel_shader =
-            static_cast<D3D12Shader::D3D12Translation*>(
-                pixel_shader->GetTranslation(
-                    pipeline_description.pixel_shader_modification));
-        if (!pipeline_runtime_description.pixel_shader ||
-            !pipeline_runtime_description.pixel_shader->is_translated() ||
-            !pipeline_runtime_description.pixel_shader->is_valid()) {
-          continue;
-        }
-      } else {
-        pixel_shader = nullptr;
-        pipeline_runtime_description.pixel_shader = nullptr;
-      }
-      GeometryShaderKey pipeline_geometry_shader_key;
-      pipeline_runtime_description.geometry_shader =
-          GetGeometryShaderKey(
-              pipeline_description.geometry_shader,
-              DxbcShaderTranslator::Modification(
-                  pipeline_description.vertex_shader_modification),
-              DxbcShaderTranslator::Modification(
-                  pipeline_description.pixel_shader_modification),
-              pipeline_geometry_shader_key)
-              ? &GetGeometryShader(pipeline_geometry_shader_key)
-              : nullptr;
-      pipeline_runtime_description.root_signature =
-          command_processor_.GetRootSignature(
-              vertex_shader, pixel_shader,
-              Shader::IsHostVertexShaderTypeDomain(
-                  DxbcShaderTranslator::Modification(
-                      pipeline_description.vertex_shader_modification)
-                      .vertex.host_vertex_shader_type));
-      if (!pipeline_runtime_description.root_signature) {
-        continue;
-      }
-      std::memcpy(&pipeline_runtime_description.description,
-                  &pipeline_description, sizeof(pipeline_description));
-
-      Pipeline* new_pipeline = new Pipeline;
-      new_pipeline->state = nullptr;
-      std::memcpy(&new_pipeline->description, &pipeline_runtime_description,
-                  sizeof(pipeline_runtime_description));
-      pipelines_.emplace(pipeline_stored_description.description_hash,
-                         new_pipeline);
-      COUNT_profile_set("gpu/pipeline_cache/pipelines", pipelines_.size());
-      if (!creation_threads_.empty()) {
-        // Submit the pipeline for creation to any available thread.
-        {
-          std::lock_guard<std::mutex> lock(creation_request_lock_);
-          creation_queue_.push_back(new_pipeline);
-        }
-        creation_request_cond_.notify_one();
-      } else {
-        new_pipeline->state = CreateD3D12Pipeline(pipeline_runtime_description);
+    // The shaders of the pipelines still waiting for them weren't in the
+    // shader storage, but may have been loaded before it.
+    for (size_t i = 0; i < pipeline_stored_descriptions.size(); ++i) {
+      if (stored_pipeline_shaders_pending[i]) {
+        create_stored_pipeline(pipeline_stored_descriptions[i]);
       }
-      ++pipelines_created;
     }
 
     if (!creation_threads_.empty()) {
@@ -737,12 +914,19 @@ void PipelineCache::InitializeShaderStorage(
             xe::Clock::QueryHostTickFrequency());
     // If any pipeline descriptions were corrupted (or the whole file has excess
     // bytes in the end), truncate to the last valid pipeline description.
-    xe::filesystem::TruncateStdioFile(
-        pipeline_storage_file_,
-        uint64_t(sizeof(pipeline_storage_file_header) +
-                 sizeof(PipelineStoredDescription) *
-                     pipeline_stored_descriptions.size()));
-  } else {
+    uint64_t pipeline_storage_valid_bytes =
+        sizeof(pipeline_storage_file_header) +
+        sizeof(PipelineStoredDescription) * pipeline_stored_descriptions.size();
+    if (int64_t(pipeline_storage_valid_bytes) != pipeline_storage_read_end &&
+        xe::filesystem::LockStdioFileIfUnchanged(
+            pipeline_storage_file_, uint64_t(pipeline_storage_read_end))) {
+      xe::filesystem::TruncateStdioFile(pipeline_storage_file_,
+                                        pipeline_storage_valid_bytes);
+      xe::filesystem::UnlockStdioFile(pipeline_storage_file_);
+    }
+  } else if (xe::filesystem::LockStdioFileIfUnchanged(
+                 pipeline_storage_file_,
+                 uint64_t(pipeline_storage_read_end))) {
     xe::filesystem::TruncateStdioFile(pipeline_storage_file_, 0);
     pipeline_storage_file_header.magic = pipeline_storage_magic;
     pipeline_storage_file_header.magic_api = pipeline_storage_magic_api;
@@ -750,6 +934,7 @@ void PipelineCache::InitializeShaderStorage(
         pipeline_storage_version_swapped;
     fwrite(&pipeline_storage_file_header, sizeof(pipeline_storage_file_header),
            1, pipeline_storage_file_);
+    xe::filesystem::UnlockStdioFile(pipeline_storage_file_);
   }
 
   shader_storage_cache_root_ = cache_root;
@@ -768,7 +953,8 @@ void PipelineCache::InitializeShaderStorage(
 void PipelineCache::ShutdownShaderStorage() {
   if (storage_write_thread_) {
     {
-      std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+      auto lock = lock_profiling::Acquire(
+          storage_write_request_lock_, "D3D12 pipeline storage");
       storage_write_thread_shutdown_ = true;
     }
     storage_write_request_cond_.notify_all();
@@ -798,7 +984,8 @@ void PipelineCache::EndSubmission() {
   if (shader_storage_file_flush_needed_ ||
       pipeline_storage_file_flush_needed_) {
     {
-      std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+      auto lock = lock_profiling::Acquire(
+          storage_write_request_lock_, "D3D12 pipeline storage");
       if (shader_storage_file_flush_needed_) {
         storage_write_flush_shaders_ = true;
       }
@@ -996,7 +1183,8 @@ bool PipelineCache::ConfigurePipeline(
       assert_not_null(storage_write_thread_);
       shader_storage_file_flush_needed_ = true;
       {
-        std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+        auto lock = lock_profiling::Acquire(
+            storage_write_request_lock_, "D3D12 pipeline storage");
         storage_write_shader_queue_.push_back(&vertex_shader->shader());
       }
       storage_write_request_cond_.notify_all();
@@ -1022,7 +1210,8 @@ bool PipelineCache::ConfigurePipeline(
         assert_not_null(storage_write_thread_);
         shader_storage_file_flush_needed_ = true;
         {
-          std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+          auto lock = lock_profiling::Acquire(
+              storage_write_request_lock_, "D3D12 pipeline storage");
           storage_write_shader_queue_.push_back(&pixel_shader->shader());
         }
         storage_write_request_cond_.notify_all();
@@ -1071,6 +1260,7 @@ bool PipelineCache::ConfigurePipeline(
   std::memcpy(&new_pipeline->description, &runtime_description,
               sizeof(runtime_description));
   pipelines_.emplace(hash, new_pipeline);
+  ++pipelines_created_;
   COUNT_profile_set("gpu/pipeline_cache/pipelines", pipelines_.size());
 
   if (!creation_threads_.empty()) {
@@ -1081,14 +1271,15 @@ bool PipelineCache::ConfigurePipeline(
     }
     creation_request_cond_.notify_one();
   } else {
-    new_pipeline->state = CreateD3D12Pipeline(runtime_description);
+    new_pipeline->state = CreateD3D12Pipeline(runtime_description, true);
   }
 
   if (pipeline_storage_file_) {
     assert_not_null(storage_write_thread_);
     pipeline_storage_file_flush_needed_ = true;
     {
-      std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+      auto lock = lock_profiling::Acquire(
+          storage_write_request_lock_, "D3D12 pipeline storage");
       storage_write_pipeline_queue_.emplace_back();
       PipelineStoredDescription& stored_description =
           storage_write_pipeline_queue_.back();
@@ -1105,6 +1296,41 @@ bool PipelineCache::ConfigurePipeline(
   return true;
 }
 
+std::unique_ptr<DxbcShaderTranslator> PipelineCache::CreateShaderTranslator()
+    const {
+  const ui::d3d12::D3D12Provider& provider =
+      command_processor_.GetD3D12Provider();
+  return std::make_unique<DxbcShaderTranslator>(
+      provider.GetAdapterVendorID(), bindless_resources_used_,
+      render_target_cache_.GetPath() ==
+          RenderTargetCache::Path::kPixelShaderInterlock,
+      render_target_cache_.gamma_render_target_as_srgb(),
+      render_target_cache_.msaa_2x_supported(),
+      render_target_cache_.draw_resolution_scale_x(),
+      render_target_cache_.draw_resolution_scale_y(),
+      provider.GetGraphicsAnalysis() != nullptr);
+}
+
+std::unique_ptr<DxbcShaderTranslator> PipelineCache::AcquireShaderTranslator() {
+  {
+    std::lock_guard<std::mutex> lock(shader_translator_pool_mutex_);
+    if (!shader_translator_pool_.empty()) {
+      std::unique_ptr<DxbcShaderTranslator> shader_translator =
+          std::move(shader_translator_pool_.back());
+      shader_translator_pool_.pop_back();
+      return shader_translator;
+    }
+  }
+  return CreateShaderTranslator();
+}
+
+void PipelineCache::ReleaseShaderTranslator(
+    std::unique_ptr<DxbcShaderTranslator> shader_translator) {
+  assert_not_null(shader_translator);
+  std::lock_guard<std::mutex> lock(shader_translator_pool_mutex_);
+  shader_translator_pool_.push_back(std::move(shader_translator));
+}
+
 bool PipelineCache::TranslateAnalyzedShader(
     DxbcShaderTranslator& translator,
     D3D12Shader::D3D12Translation& translation, IDxbcConverter* dxbc_converter,
@@ -1285,8 +1511,8 @@ bool PipelineCache::TranslateAnalyzedShader(
   if (cvars::d3d12_dxbc_disasm_dxilconv) {
     translation.DisassembleDxbcAndDxil(provider, cvars::d3d12_dxbc_disasm,
                                        dxbc_converter, dxc_utils, dxc_compiler);
-  } else {
-    translation.DisassembleDxbcAndDxil(provider, cvars::d3d12_dxbc_disasm);
+  } else if (cvars::d3d12_dxbc_disasm) {
+    translation.DisassembleDxbcAndDxil(provider, true);
   }
 
   // Dump shader files if desired.
@@ -2802,8 +3028,85 @@ const std::vector<uint32_t>& PipelineCache::GetGeometryShader(
   return geometry_shaders_.emplace(key, std::move(shader)).first->second;
 }
 
+const std::vector<uint8_t>* PipelineCache::ConvertShaderToDxil(
+    const D3D12_SHADER_BYTECODE& dxbc) {
+  uint64_t dxbc_hash = XXH3_64bits(dxbc.pShaderBytecode, dxbc.BytecodeLength);
+  auto [it, inserted] = dxil_conversions_.try_emplace(dxbc_hash);
+  std::vector<uint8_t>& dxil = it->second;
+  if (!inserted) {
+    return dxil.empty() ? nullptr : &dxil;
+  }
+  void* converted;
+  UINT32 converted_size;
+  if (FAILED(dxil_converter_->Convert(
+          dxbc.pShaderBytecode, UINT32(dxbc.BytecodeLength), nullptr,
+          &converted, &converted_size, nullptr)) ||
+      converted == nullptr) {
+    XELOGE("Failed to convert a DXBC shader with hash {:016X} to DXIL",
+           dxbc_hash);
+    return nullptr;
+  }
+  dxil.resize(converted_size);
+  std::memcpy(dxil.data(), converted, converted_size);
+  CoTaskMemFree(converted);
+  // The runtime only accepts DXIL signed by the validator, which writes the
+  // hash into the container in place.
+  HRESULT validation_status = E_FAIL;
+  IDxcBlobEncoding* dxil_blob;
+  if (SUCCEEDED(dxil_utils_->CreateBlobFromPinned(
+          dxil.data(), UINT32(dxil.size()), DXC_CP_ACP, &dxil_blob))) {
+    IDxcOperationResult* validation_result;
+    if (SUCCEEDED(dxil_validator_->Validate(
+            dxil_blob, DxcValidatorFlags_InPlaceEdit, &validation_result))) {
+      if (FAILED(validation_result->GetStatus(&validation_status))) {
+        validation_status = E_FAIL;
+      }
+      validation_result->Release();
+    }
+    dxil_blob->Release();
+  }
+  if (FAILED(validation_status)) {
+    XELOGE("Failed to validate the DXIL shader converted from {:016X}",
+           dxbc_hash);
+    dxil.clear();
+    return nullptr;
+  }
+  return &dxil;
+}
+
+bool PipelineCache::ConvertPipelineShadersToDxil(
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC& state_desc) {
+  // DXBC and DXIL shaders can't be used in the same pipeline.
+  D3D12_SHADER_BYTECODE* stages[] = {&state_desc.VS, &state_desc.HS,
+                                     &state_desc.DS, &state_desc.GS,
+                                     &state_desc.PS};
+  const std::vector<uint8_t>* stages_dxil[xe::countof(stages)] = {};
+  {
+    std::lock_guard<std::mutex> lock(dxil_conversion_mutex_);
+    for (size_t i = 0; i < xe::countof(stages); ++i) {
+      if (!stages[i]->BytecodeLength) {
+        continue;
+      }
+      stages_dxil[i] = ConvertShaderToDxil(*stages[i]);
+      if (!stages_dxil[i]) {
+        return false;
+      }
+    }
+  }
+  for (size_t i = 0; i < xe::countof(stages); ++i) {
+    if (stages_dxil[i]) {
+      stages[i]->pShaderBytecode = stages_dxil[i]->data();
+      stages[i]->BytecodeLength = stages_dxil[i]->size();
+    }
+  }
+  return true;
+}
+
 ID3D12PipelineState* PipelineCache::CreateD3D12Pipeline(
-    const PipelineRuntimeDescription& runtime_description) {
+    const PipelineRuntimeDescription& runtime_description, bool blocking) {
+  frame_breakdown::ScopedTimer frame_breakdown_timer(
+      frame_breakdown::Category::kPipelineCreation);
+  uint64_t compile_start_tick = Clock::QueryHostTickCount();
   const PipelineDescription& description = runtime_description.description;
 
   if (runtime_description.pixel_shader != nullptr) {
@@ -3198,6 +3501,11 @@ ID3D12PipelineState* PipelineCache::CreateD3D12Pipeline(
     state_desc.DepthStencilState.StencilEnable = FALSE;
   }
 
+  if (dxil_converter_ && !ConvertPipelineShadersToDxil(state_desc)) {
+    XELOGW("Creating a pipeline from DXBC as not all its shaders could be "
+           "converted to DXIL");
+  }
+
   // Create the D3D12 pipeline state object.
   ID3D12Device* device = command_processor_.GetD3D12Provider().GetDevice();
   ID3D12PipelineState* state;
@@ -3213,6 +3521,28 @@ ID3D12PipelineState* PipelineCache::CreateD3D12Pipeline(
     }
     return nullptr;
   }
+  PipelineCompileLog::Record compile_record;
+  compile_record.description_hash =
+      XXH3_64bits(&description, sizeof(description));
+  compile_record.vertex_shader_hash =
+      runtime_description.vertex_shader->shader().ucode_data_hash();
+  compile_record.vertex_shader_modification =
+      runtime_description.vertex_shader->modification();
+  if (runtime_description.pixel_shader != nullptr) {
+    compile_record.pixel_shader_hash =
+        runtime_description.pixel_shader->shader().ucode_data_hash();
+    compile_record.pixel_shader_modification =
+        runtime_description.pixel_shader->modification();
+  } else {
+    compile_record.pixel_shader_hash = 0;
+    compile_record.pixel_shader_modification = 0;
+  }
+  compile_record.frame = command_processor_.swap_count();
+  compile_record.compile_us =
+      (Clock::QueryHostTickCount() - compile_start_tick) * 1000000 /
+      Clock::QueryHostTickFrequency();
+  compile_record.blocking = blocking;
+  command_processor_.pipeline_compile_log().Add(compile_record);
   std::wstring name;
   if (runtime_description.pixel_shader != nullptr) {
     name = fmt::format(
@@ -3235,6 +3565,7 @@ void PipelineCache::StorageWriteThread() {
 
   std::vector<uint32_t> ucode_guest_endian;
   ucode_guest_endian.reserve(0xFFFF);
+  std::vector<uint8_t> ucode_analysis;
 
   bool flush_shaders = false;
   bool flush_pipelines = false;
@@ -3255,7 +3586,8 @@ void PipelineCache::StorageWriteThread() {
     PipelineStoredDescription pipeline_description;
     bool write_pipeline = false;
     {
-      std::unique_lock<std::mutex> lock(storage_write_request_lock_);
+      auto lock = lock_profiling::Acquire(
+          storage_write_request_lock_, "D3D12 pipeline storage");
       if (storage_write_thread_shutdown_) {
         return;
       }
@@ -3286,7 +3618,18 @@ void PipelineCache::StorageWriteThread() {
       shader_header.ucode_data_hash = shader->ucode_data_hash();
       shader_header.ucode_dword_count = shader->ucode_dword_count();
       shader_header.type = shader->type();
+      // Shaders are written to the storage after being translated, so they are
+      // already analyzed.
+      if (shader->is_ucode_analyzed()) {
+        shader->SerializeUcodeAnalysis(ucode_analysis);
+      } else {
+        ucode_analysis.clear();
+      }
+      shader_header.ucode_analysis_size = uint32_t(ucode_analysis.size());
       assert_not_null(shader_storage_file_);
+      // The whole record is written under the lock, so records of different
+      // emulator instances are not interleaved.
+      xe::filesystem::LockStdioFile(shader_storage_file_, true);
       fwrite(&shader_header, sizeof(shader_header), 1, shader_storage_file_);
       if (shader_header.ucode_dword_count) {
         ucode_guest_endian.resize(shader_header.ucode_dword_count);
@@ -3298,12 +3641,19 @@ void PipelineCache::StorageWriteThread() {
                shader_header.ucode_dword_count * sizeof(uint32_t), 1,
                shader_storage_file_);
       }
+      if (!ucode_analysis.empty()) {
+        fwrite(ucode_analysis.data(), ucode_analysis.size(), 1,
+               shader_storage_file_);
+      }
+      xe::filesystem::UnlockStdioFile(shader_storage_file_);
     }
 
     if (write_pipeline) {
       assert_not_null(pipeline_storage_file_);
+      xe::filesystem::LockStdioFile(pipeline_storage_file_, true);
       fwrite(&pipeline_description, sizeof(pipeline_description), 1,
              pipeline_storage_file_);
+      xe::filesystem::UnlockStdioFile(pipeline_storage_file_);
     }
   }
 }
@@ -3340,7 +3690,7 @@ void PipelineCache::CreationThread(size_t thread_index) {
 
     // Create the D3D12 pipeline state object.
     pipeline_to_create->state =
-        CreateD3D12Pipeline(pipeline_to_create->description);
+        CreateD3D12Pipeline(pipeline_to_create->description, false);
 
     // Pipeline created - the thread is not busy anymore, safe to set the
     // completion event if needed (at the next iteration, or in some other
@@ -3365,7 +3715,7 @@ void PipelineCache::CreateQueuedPipelinesOnProcessorThread() {
       creation_queue_.pop_front();
     }
     pipeline_to_create->state =
-        CreateD3D12Pipeline(pipeline_to_create->description);
+        CreateD3D12Pipeline(pipeline_to_create->description, false);
   }
 }
 
@@ -102,6 +102,10 @@ class PipelineCache {
     return reinterpret_cast<const Pipeline*>(handle)->state;
   }
 
+  // Number of pipelines that weren't found in the cache when configuring
+  // draws, not including the ones loaded from the storage, for benchmarking.
+  uint64_t pipelines_created() const { return pipelines_created_; }
+
  private:
   XEPACKEDSTRUCT(ShaderStoredHeader, {
     uint64_t ucode_data_hash;
@@ -109,7 +113,11 @@ class PipelineCache {
     uint32_t ucode_dword_count : 31;
     xenos::ShaderType type : 1;
 
-    static constexpr uint32_t kVersion = 0x20201219;
+    // Size of the Shader::SerializeUcodeAnalysis data following the ucode, or
+    // 0 if not stored.
+    uint32_t ucode_analysis_size;
+
+    static constexpr uint32_t kVersion = 0x20261014;
   });
 
   // Update PipelineDescription::kVersion if any of the Pipeline* enums are
@@ -271,6 +279,13 @@ class PipelineCache {
                           const uint32_t* host_address, uint32_t dword_count,
                           uint64_t data_hash);
 
+  std::unique_ptr<DxbcShaderTranslator> CreateShaderTranslator() const;
+  // For the shader storage loading threads, reused between the loads of the
+  // storages of different titles. Thread-safe.
+  std::unique_ptr<DxbcShaderTranslator> AcquireShaderTranslator();
+  void ReleaseShaderTranslator(
+      std::unique_ptr<DxbcShaderTranslator> shader_translator);
+
   // Can be called from multiple threads.
   bool TranslateAnalyzedShader(DxbcShaderTranslator& translator,
                                D3D12Shader::D3D12Translation& translation,
@@ -300,8 +315,19 @@ class PipelineCache {
                                        std::vector<uint32_t>& shader_out);
   const std::vector<uint32_t>& GetGeometryShader(GeometryShaderKey key);
 
+  // blocking is whether a guest draw is waiting for the pipeline, for the
+  // pipeline compilation log.
   ID3D12PipelineState* CreateD3D12Pipeline(
-      const PipelineRuntimeDescription& runtime_description);
+      const PipelineRuntimeDescription& runtime_description, bool blocking);
+  // Returns the signed DXIL converted from the DXBC shader, converting it the
+  // first time, or nullptr if it can't be converted. Must be called with
+  // dxil_conversion_mutex_ held.
+  const std::vector<uint8_t>* ConvertShaderToDxil(
+      const D3D12_SHADER_BYTECODE& dxbc);
+  // Replaces the DXBC shaders of the pipeline with DXIL if all of them can be
+  // converted, otherwise leaves all of them as DXBC and returns false.
+  bool ConvertPipelineShadersToDxil(
+      D3D12_GRAPHICS_PIPELINE_STATE_DESC& state_desc);
 
   D3D12CommandProcessor& command_processor_;
   const RegisterFile& register_file_;
@@ -312,6 +338,9 @@ class PipelineCache {
   StringBuffer ucode_disasm_buffer_;
   // Reusable shader translator for the processor thread.
   std::unique_ptr<DxbcShaderTranslator> shader_translator_;
+  // Translators not currently used by the shader storage loading threads.
+  std::mutex shader_translator_pool_mutex_;
+  std::vector<std::unique_ptr<DxbcShaderTranslator>> shader_translator_pool_;
 
   // Command processor thread DXIL conversion/disassembly interfaces, if DXIL
   // disassembly is enabled.
@@ -319,6 +348,18 @@ class PipelineCache {
   IDxcUtils* dxc_utils_ = nullptr;
   IDxcCompiler* dxc_compiler_ = nullptr;
 
+  // DXBC to DXIL conversion of the shaders of all pipelines, if enabled and
+  // supported. Pipelines are created on multiple threads, but converting each
+  // shader only once, the interfaces are shared.
+  std::mutex dxil_conversion_mutex_;
+  IDxbcConverter* dxil_converter_ = nullptr;
+  IDxcUtils* dxil_utils_ = nullptr;
+  IDxcValidator* dxil_validator_ = nullptr;
+  // DXBC hash -> DXIL, empty if the conversion has failed.
+  std::unordered_map<uint64_t, std::vector<uint8_t>,
+                     xe::hash::IdentityHasher<uint64_t>>
+      dxil_conversions_;
+
   // Ucode hash -> shader.
   std::unordered_map<uint64_t, D3D12Shader*, xe::hash::IdentityHasher<uint64_t>>
       shaders_;
@@ -369,6 +410,8 @@ class PipelineCache {
   // changed.
   Pipeline* current_pipeline_ = nullptr;
 
+  uint64_t pipelines_created_ = 0;
+
   // Currently open shader storage path.
   std::filesystem::path shader_storage_cache_root_;
   uint32_t shader_storage_title_id_ = 0;
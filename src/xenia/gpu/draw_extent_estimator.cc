@@ -12,12 +12,16 @@
 #include <algorithm>
 #include <cfloat>
 #include <cstdint>
+#include <cstring>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/math.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/gpu/registers.h"
+#include "xenia/gpu/shared_memory.h"
 #include "xenia/gpu/ucode.h"
 #include "xenia/gpu/xenos.h"
 #include "xenia/ui/graphics_util.h"
@@ -108,6 +112,8 @@ uint32_t DrawExtentEstimator::EstimateVertexMaxY(const Shader& vertex_shader) {
     const uint16_t* index_buffer_16;
     const uint32_t* index_buffer_32;
   };
+  index_buffer = nullptr;
+  uint32_t index_buffer_size = 0;
   xenos::Endian index_endian = vgt_dma_size.swap_mode;
   if (vgt_draw_initiator.source_select == xenos::SourceSelect::kDMA) {
     xenos::IndexFormat index_format = vgt_draw_initiator.index_size;
@@ -123,6 +129,7 @@ uint32_t DrawExtentEstimator::EstimateVertexMaxY(const Shader& vertex_shader) {
         index_endian = xenos::Endian::kNone;
       }
       index_buffer_base &= ~uint32_t(sizeof(uint16_t) - 1);
+      index_buffer_size = sizeof(uint16_t) * index_buffer_read_count;
       if (trace_writer_) {
         trace_writer_->WriteMemoryRead(
             index_buffer_base, sizeof(uint16_t) * index_buffer_read_count);
@@ -130,6 +137,7 @@ uint32_t DrawExtentEstimator::EstimateVertexMaxY(const Shader& vertex_shader) {
     } else {
       assert_true(vgt_draw_initiator.index_size == xenos::IndexFormat::kInt32);
       index_buffer_base &= ~uint32_t(sizeof(uint32_t) - 1);
+      index_buffer_size = sizeof(uint32_t) * index_buffer_read_count;
       if (trace_writer_) {
         trace_writer_->WriteMemoryRead(
             index_buffer_base, sizeof(uint32_t) * index_buffer_read_count);
@@ -137,6 +145,19 @@ uint32_t DrawExtentEstimator::EstimateVertexMaxY(const Shader& vertex_shader) {
     }
     index_buffer = memory_.TranslatePhysical(index_buffer_base);
   }
+
+  // Interpreting the shader is expensive, but the same draws, such as
+  // full-screen quads, are often repeated.
+  uint64_t cache_key;
+  bool cache_result = GetVertexMaxYCacheKey(vertex_shader, index_buffer,
+                                           index_buffer_size, cache_key);
+  if (cache_result) {
+    auto cache_it = vertex_max_y_cache_.find(cache_key);
+    if (cache_it != vertex_max_y_cache_.cend()) {
+      return cache_it->second;
+    }
+  }
+
   auto pa_su_sc_mode_cntl = regs.Get<reg::PA_SU_SC_MODE_CNTL>();
   uint32_t reset_index =
       regs.Get<reg::VGT_MULTI_PRIM_IB_RESET_INDX>().reset_indx;
@@ -170,6 +191,13 @@ uint32_t DrawExtentEstimator::EstimateVertexMaxY(const Shader& vertex_shader) {
 
   shader_interpreter_.SetShader(vertex_shader);
 
+  // Indexed geometry references most vertices multiple times, and the result
+  // for the same index is always the same within the draw, as the shader has
+  // no other varying inputs - skip the vertices that have been processed
+  // recently, like the post-transform vertex cache of a GPU.
+  std::memset(processed_vertex_indices_, 0xFF,
+              sizeof(processed_vertex_indices_));
+
   PositionYExportSink position_y_export_sink;
   shader_interpreter_.SetExportSink(&position_y_export_sink);
   for (uint32_t i = 0; i < vgt_draw_initiator.num_indices; ++i) {
@@ -197,6 +225,13 @@ uint32_t DrawExtentEstimator::EstimateVertexMaxY(const Shader& vertex_shader) {
     vertex_index =
         std::min(max_index,
                  std::max(min_index, (vertex_index + index_offset) & 0xFFFFFF));
+    uint32_t& processed_vertex_index =
+        processed_vertex_indices_[vertex_index &
+                                  (kProcessedVertexIndexCacheSize - 1)];
+    if (processed_vertex_index == vertex_index) {
+      continue;
+    }
+    processed_vertex_index = vertex_index;
 
     position_y_export_sink.Reset();
 
@@ -262,10 +297,141 @@ uint32_t DrawExtentEstimator::EstimateVertexMaxY(const Shader& vertex_shader) {
   }
   // Top-left rule - .5 exclusive without MSAA, 1. exclusive with MSAA.
   auto rb_surface_info = regs.Get<reg::RB_SURFACE_INFO>();
-  return (uint32_t(std::max(int32_t(0), max_y_24p8)) +
-          ((rb_surface_info.msaa_samples == xenos::MsaaSamples::k1X) ? 127
-                                                                     : 255)) >>
-         8;
+  uint32_t vertex_max_y =
+      (uint32_t(std::max(int32_t(0), max_y_24p8)) +
+       ((rb_surface_info.msaa_samples == xenos::MsaaSamples::k1X) ? 127
+                                                                  : 255)) >>
+      8;
+
+  if (cache_result) {
+    if (vertex_max_y_cache_.size() >= kVertexMaxYCacheMaxSize) {
+      vertex_max_y_cache_.clear();
+    }
+    vertex_max_y_cache_.emplace(cache_key, vertex_max_y);
+  }
+
+  return vertex_max_y;
+}
+
+bool DrawExtentEstimator::GetVertexMaxYCacheKey(const Shader& vertex_shader,
+                                                const void* index_buffer,
+                                                uint32_t index_buffer_size,
+                                                uint64_t& key_out) const {
+  // The memory reads done by the interpreter must be written to the trace.
+  if (trace_writer_ && trace_writer_->is_open()) {
+    return false;
+  }
+
+  const RegisterFile& regs = register_file_;
+
+  XXH3_state_t hash_state;
+  XXH3_64bits_reset(&hash_state);
+  uint64_t ucode_data_hash = vertex_shader.ucode_data_hash();
+  XXH3_64bits_update(&hash_state, &ucode_data_hash, sizeof(ucode_data_hash));
+
+  // State used for getting the vertex indices and the position of the bottom
+  // of the vertices.
+  static const uint32_t kStateRegisters[] = {
+      XE_GPU_REG_VGT_DRAW_INITIATOR,
+      XE_GPU_REG_VGT_DMA_BASE,
+      XE_GPU_REG_VGT_DMA_SIZE,
+      XE_GPU_REG_PA_SU_SC_MODE_CNTL,
+      XE_GPU_REG_VGT_MULTI_PRIM_IB_RESET_INDX,
+      XE_GPU_REG_VGT_INDX_OFFSET,
+      XE_GPU_REG_VGT_MIN_VTX_INDX,
+      XE_GPU_REG_VGT_MAX_VTX_INDX,
+      XE_GPU_REG_PA_CL_VTE_CNTL,
+      XE_GPU_REG_PA_CL_VPORT_YSCALE,
+      XE_GPU_REG_PA_CL_VPORT_YOFFSET,
+      XE_GPU_REG_PA_SU_POINT_MINMAX,
+      XE_GPU_REG_PA_SU_POINT_SIZE,
+      XE_GPU_REG_PA_SU_VTX_CNTL,
+      XE_GPU_REG_PA_SC_WINDOW_OFFSET,
+      XE_GPU_REG_RB_SURFACE_INFO,
+      XE_GPU_REG_SQ_VS_CONST,
+  };
+  uint32_t state[xe::countof(kStateRegisters)];
+  for (size_t i = 0; i < xe::countof(kStateRegisters); ++i) {
+    state[i] = regs[kStateRegisters[i]];
+  }
+  XXH3_64bits_update(&hash_state, state, sizeof(state));
+
+  // Constants accessible by the shader.
+  const Shader::ConstantRegisterMap& constant_map =
+      vertex_shader.constant_register_map();
+  auto sq_vs_const = regs.Get<reg::SQ_VS_CONST>();
+  if (constant_map.float_dynamic_addressing) {
+    uint32_t float_constant_end =
+        std::min(uint32_t(sq_vs_const.base) + sq_vs_const.size + 1,
+                 UINT32_C(512));
+    if (float_constant_end > sq_vs_const.base) {
+      XXH3_64bits_update(
+          &hash_state,
+          &regs[XE_GPU_REG_SHADER_CONSTANT_000_X + 4 * sq_vs_const.base],
+          sizeof(float) * 4 * (float_constant_end - sq_vs_const.base));
+    }
+  } else {
+    for (uint32_t i = 0; i < xe::countof(constant_map.float_bitmap); ++i) {
+      uint64_t float_bitmap_remaining = constant_map.float_bitmap[i];
+      uint32_t float_bit;
+      while (xe::bit_scan_forward(float_bitmap_remaining, &float_bit)) {
+        float_bitmap_remaining &= ~(UINT64_C(1) << float_bit);
+        uint32_t float_constant = i * 64 + float_bit;
+        if (float_constant > sq_vs_const.size ||
+            sq_vs_const.base + float_constant >= 512) {
+          continue;
+        }
+        XXH3_64bits_update(
+            &hash_state,
+            &regs[XE_GPU_REG_SHADER_CONSTANT_000_X +
+                  4 * (sq_vs_const.base + float_constant)],
+            sizeof(float) * 4);
+      }
+    }
+  }
+  XXH3_64bits_update(&hash_state,
+                     &regs[XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031],
+                     sizeof(uint32_t) * 8);
+  XXH3_64bits_update(&hash_state, &regs[XE_GPU_REG_SHADER_CONSTANT_LOOP_00],
+                     sizeof(uint32_t) * 32);
+
+  // Vertex data.
+  const uint8_t* physical_membase = memory_.physical_membase();
+  uint32_t vertex_data_size = 0;
+  for (uint32_t i = 0; i < xe::countof(constant_map.vertex_fetch_bitmap);
+       ++i) {
+    uint32_t vertex_fetches_remaining = constant_map.vertex_fetch_bitmap[i];
+    uint32_t vertex_fetch_bit;
+    while (xe::bit_scan_forward(vertex_fetches_remaining, &vertex_fetch_bit)) {
+      vertex_fetches_remaining &= ~(UINT32_C(1) << vertex_fetch_bit);
+      xenos::xe_gpu_vertex_fetch_t vertex_fetch =
+          regs.GetVertexFetch(i * 32 + vertex_fetch_bit);
+      XXH3_64bits_update(&hash_state, &vertex_fetch, sizeof(vertex_fetch));
+      if (!vertex_fetch.size) {
+        continue;
+      }
+      uint64_t vertex_buffer_end =
+          (uint64_t(vertex_fetch.address) + vertex_fetch.size) *
+          sizeof(uint32_t);
+      vertex_data_size += sizeof(uint32_t) * vertex_fetch.size;
+      if (vertex_buffer_end > SharedMemory::kBufferSize ||
+          vertex_data_size > kVertexMaxYCacheMaxVertexDataSize) {
+        return false;
+      }
+      XXH3_64bits_update(
+          &hash_state,
+          physical_membase + sizeof(uint32_t) * vertex_fetch.address,
+          sizeof(uint32_t) * vertex_fetch.size);
+    }
+  }
+
+  // Index data.
+  if (index_buffer_size) {
+    XXH3_64bits_update(&hash_state, index_buffer, index_buffer_size);
+  }
+
+  key_out = XXH3_64bits_digest(&hash_state);
+  return true;
 }
 
 uint32_t DrawExtentEstimator::EstimateMaxY(bool try_to_estimate_vertex_max_y,
@@ -12,6 +12,7 @@
 
 #include <cstdint>
 #include <optional>
+#include <unordered_map>
 
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/shader.h"
@@ -39,6 +40,15 @@ class DrawExtentEstimator {
                         const Shader& vertex_shader);
 
  private:
+  // Results of interpreting the vertex shader are reused for draws with the
+  // same shader, constants, vertex and index data and relevant state.
+  static constexpr size_t kVertexMaxYCacheMaxSize = 4096;
+  // Larger vertex buffers are not hashed, as hashing all of them may be slower
+  // than interpreting the shader for the few vertices of the draw.
+  static constexpr uint32_t kVertexMaxYCacheMaxVertexDataSize = 256 * 1024;
+  // Must be a power of two.
+  static constexpr uint32_t kProcessedVertexIndexCacheSize = 256;
+
   class PositionYExportSink : public ShaderInterpreter::ExportSink {
    public:
     void Export(ucode::ExportRegister export_register, const float* value,
@@ -63,11 +73,23 @@ class DrawExtentEstimator {
     std::optional<uint32_t> vertex_kill_;
   };
 
+  // Returns false if the result of the current draw must not be cached.
+  bool GetVertexMaxYCacheKey(const Shader& vertex_shader,
+                             const void* index_buffer,
+                             uint32_t index_buffer_size,
+                             uint64_t& key_out) const;
+
   const RegisterFile& register_file_;
   const Memory& memory_;
   TraceWriter* trace_writer_;
 
   ShaderInterpreter shader_interpreter_;
+
+  std::unordered_map<uint64_t, uint32_t> vertex_max_y_cache_;
+
+  // Vertex indices (24-bit, UINT32_MAX if empty) of the recently interpreted
+  // vertices of the current draw.
+  uint32_t processed_vertex_indices_[kProcessedVertexIndexCacheSize];
 };
 
 }  // namespace gpu
@@ -63,6 +63,18 @@ bool IsRasterizationPotentiallyDone(const RegisterFile& regs,
   return true;
 }
 
+static bool IsStencilFaceNoOp(xenos::CompareFunction func,
+                              xenos::StencilOp fail, xenos::StencilOp zpass,
+                              xenos::StencilOp zfail,
+                              reg::RB_STENCILREFMASK ref_mask) {
+  if (func != xenos::CompareFunction::kAlways) {
+    return false;
+  }
+  return !ref_mask.stencilwritemask || (fail == xenos::StencilOp::kKeep &&
+                                        zpass == xenos::StencilOp::kKeep &&
+                                        zfail == xenos::StencilOp::kKeep);
+}
+
 reg::RB_DEPTHCONTROL GetNormalizedDepthControl(const RegisterFile& regs) {
   xenos::EdramMode edram_mode = regs.Get<reg::RB_MODECONTROL>().edram_mode;
   if (edram_mode != xenos::EdramMode::kColorDepth &&
@@ -79,8 +91,22 @@ reg::RB_DEPTHCONTROL GetNormalizedDepthControl(const RegisterFile& regs) {
       depthcontrol.zfunc == xenos::CompareFunction::kAlways) {
     depthcontrol.z_enable = 0;
   }
-  // Stencil is more complex and is expected to be usually enabled explicitly
-  // when needed.
+  // Stencil always passing and either keeping the values or not writing any
+  // bits has no effect either - skipping it lets the pixel shader interlock
+  // path avoid reading and writing the depth / stencil samples in the EDRAM
+  // entirely when depth is not needed too.
+  if (depthcontrol.stencil_enable &&
+      IsStencilFaceNoOp(depthcontrol.stencilfunc, depthcontrol.stencilfail,
+                        depthcontrol.stencilzpass, depthcontrol.stencilzfail,
+                        regs.Get<reg::RB_STENCILREFMASK>()) &&
+      (!depthcontrol.backface_enable ||
+       IsStencilFaceNoOp(
+           depthcontrol.stencilfunc_bf, depthcontrol.stencilfail_bf,
+           depthcontrol.stencilzpass_bf, depthcontrol.stencilzfail_bf,
+           regs.Get<reg::RB_STENCILREFMASK>(
+               XE_GPU_REG_RB_STENCILREFMASK_BF)))) {
+    depthcontrol.stencil_enable = 0;
+  }
   return depthcontrol;
 }
 
@@ -55,3 +55,12 @@ DEFINE_int32(query_occlusion_fake_sample_count, 1000,
              "EVENT_WRITE_ZPD by this number. Setting this to 0 means "
              "everything is reported as occluded.",
              "GPU");
+
+DEFINE_bool(query_occlusion_host, true,
+            "Count the samples passing the depth and stencil tests for "
+            "occlusion queries using host GPU queries if supported by the "
+            "backend, writing the results to the guest memory when the host "
+            "GPU has completed the draws in the queries. If disabled, or if "
+            "the host queries can't be used, query_occlusion_fake_sample_count "
+            "is reported instead.",
+            "GPU");
@@ -32,6 +32,12 @@ DEFINE_bool(
     "Store shaders persistently and load them when loading games to avoid "
     "runtime spikes and freezes when playing the game not for the first time.",
     "GPU");
+DEFINE_bool(
+    vsync_host_display_sync, false,
+    "Align the guest vertical blanking intervals to the ones of the host "
+    "display when it's refreshed at the guest rate of 60 Hz, reducing judder. "
+    "Currently only supported on Windows, and not with a time scalar.",
+    "GPU");
 
 namespace xe {
 namespace gpu {
@@ -98,18 +104,7 @@ X_STATUS GraphicsSystem::Setup(cpu::Processor* processor,
   vsync_worker_running_ = true;
   vsync_worker_thread_ = kernel::object_ref<kernel::XHostThread>(
       new kernel::XHostThread(kernel_state_, 128 * 1024, 0, [this]() {
-        uint64_t vsync_duration = cvars::vsync ? 16 : 1;
-        uint64_t last_frame_time = Clock::QueryGuestTickCount();
-        while (vsync_worker_running_) {
-          uint64_t current_time = Clock::QueryGuestTickCount();
-          uint64_t elapsed = (current_time - last_frame_time) /
-                             (Clock::guest_tick_frequency() / 1000);
-          if (elapsed >= vsync_duration) {
-            MarkVblank();
-            last_frame_time = current_time;
-          }
-          xe::threading::Sleep(std::chrono::milliseconds(1));
-        }
+        VsyncWorkerMain();
         return 0;
       }));
   // As we run vblank interrupts the debugger must be able to suspend us.
@@ -260,11 +255,104 @@ void GraphicsSystem::DispatchInterruptCallback(uint32_t source, uint32_t cpu) {
                                args, xe::countof(args));
 }
 
+void GraphicsSystem::VsyncWorkerMain() {
+  // Without vsync, vblanks are generated at 1000 Hz to unlock the frame rate.
+  const uint64_t vblank_rate = cvars::vsync ? 60 : 1000;
+  // Rather than dispatching a burst of interrupts after a stall (such as a
+  // debugger break), the vblanks are restarted from the current time.
+  const uint64_t kMaxLateVblanks = 4;
+  // How often the host display refresh rate is checked again after it was
+  // found not to match the guest one.
+  const uint64_t kHostDisplayRecheckVblanks = 600;
+
+  auto timer = xe::threading::Timer::CreateSynchronizationTimer();
+  const uint64_t guest_tick_frequency = Clock::guest_tick_frequency();
+  const uint64_t vblank_period = guest_tick_frequency / vblank_rate;
+  // Deadlines are calculated from the start of the chain rather than from the
+  // previous vblank, so they don't drift.
+  uint64_t chain_start_tick = Clock::QueryGuestTickCount();
+  uint64_t chain_vblank = 0;
+  auto vblank_deadline = [&](uint64_t vblank) {
+    return chain_start_tick + vblank * guest_tick_frequency / vblank_rate;
+  };
+  // Waits on the timer until the guest tick, accounting for the time scalar.
+  auto wait_until = [&](uint64_t guest_tick) {
+    uint64_t now = Clock::QueryGuestTickCount();
+    if (!timer || guest_tick <= now) {
+      return;
+    }
+    double host_seconds = double(guest_tick - now) /
+                          double(guest_tick_frequency) /
+                          Clock::guest_time_scalar();
+    timer->SetOnceAfter(xe::chrono::hundrednanoseconds(
+        int64_t(host_seconds * 10000000.0)));
+    xe::threading::Wait(timer.get(), false);
+  };
+
+  const uint64_t host_tick_frequency = Clock::QueryHostTickFrequency();
+  uint64_t last_host_vblank_tick = 0;
+  uint64_t host_display_check_vblank = 0;
+
+  while (vsync_worker_running_) {
+    uint64_t deadline = vblank_deadline(++chain_vblank);
+    if (Clock::QueryGuestTickCount() >=
+        vblank_deadline(chain_vblank + kMaxLateVblanks)) {
+      chain_start_tick = Clock::QueryGuestTickCount();
+      chain_vblank = 0;
+      deadline = chain_start_tick;
+    }
+
+    if (cvars::vsync_host_display_sync && cvars::vsync && presenter_ &&
+        Clock::guest_time_scalar() == 1.0 &&
+        chain_vblank >= host_display_check_vblank) {
+      // Waking up a bit early to catch the host vblank closest to the
+      // deadline.
+      wait_until(deadline - vblank_period / 4);
+      if (presenter_->WaitForHostVblank()) {
+        uint64_t host_vblank_tick = Clock::QueryHostTickCount();
+        uint64_t host_interval = host_vblank_tick - last_host_vblank_tick;
+        last_host_vblank_tick = host_vblank_tick;
+        // Within 5% of the guest refresh rate.
+        uint64_t guest_interval = host_tick_frequency / vblank_rate;
+        if (host_interval * 20 >= guest_interval * 19 &&
+            host_interval * 20 <= guest_interval * 21) {
+          MarkVblank();
+          // Following the phase of the host display from now on.
+          chain_start_tick = Clock::QueryGuestTickCount();
+          chain_vblank = 0;
+          host_display_check_vblank = 0;
+          continue;
+        }
+        // The first measurement may span more than one host vblank, checking
+        // again on the next one.
+        if (host_interval > guest_interval * 2) {
+          host_display_check_vblank = chain_vblank + 1;
+        } else {
+          host_display_check_vblank = chain_vblank + kHostDisplayRecheckVblanks;
+        }
+      } else {
+        host_display_check_vblank = chain_vblank + kHostDisplayRecheckVblanks;
+      }
+    }
+
+    wait_until(deadline);
+    if (!vsync_worker_running_) {
+      break;
+    }
+    MarkVblank();
+  }
+}
+
 void GraphicsSystem::MarkVblank() {
   SCOPE_profile_cpu_f("gpu");
 
   // Increment vblank counter (so the game sees us making progress).
   command_processor_->increment_counter();
+  vblank_count_.fetch_add(1, std::memory_order_relaxed);
+
+  if (presenter_) {
+    presenter_->MarkGuestVblank();
+  }
 
   // TODO(benvanik): we shouldn't need to do the dispatch here, but there's
   //     something wrong and the CP will block waiting for code that
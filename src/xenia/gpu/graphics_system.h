@@ -69,6 +69,10 @@ class GraphicsSystem {
 
   virtual void SetInterruptCallback(uint32_t callback, uint32_t user_data);
   void DispatchInterruptCallback(uint32_t source, uint32_t cpu);
+  // Guest vertical blanking intervals generated so far.
+  uint64_t vblank_count() const {
+    return vblank_count_.load(std::memory_order_relaxed);
+  }
 
   virtual void ClearCaches();
 
@@ -98,6 +102,7 @@ class GraphicsSystem {
   uint32_t ReadRegister(uint32_t addr);
   void WriteRegister(uint32_t addr, uint32_t value);
 
+  void VsyncWorkerMain();
   void MarkVblank();
 
   Memory* memory_ = nullptr;
@@ -110,6 +115,7 @@ class GraphicsSystem {
   uint32_t interrupt_callback_data_ = 0;
 
   std::atomic<bool> vsync_worker_running_;
+  std::atomic<uint64_t> vblank_count_{0};
   kernel::object_ref<kernel::XHostThread> vsync_worker_thread_;
 
   RegisterFile register_file_;
@@ -0,0 +1,110 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/pipeline_compile_log.h"
+
+#include <algorithm>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/logging.h"
+
+DEFINE_int32(pipeline_compile_summary_count, 16,
+             "Number of the slowest host pipeline compilations, with the guest "
+             "shaders they were for, to log when the command processor is "
+             "shut down.",
+             "GPU");
+
+namespace xe {
+namespace gpu {
+
+void PipelineCompileLog::Add(const Record& record) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++compile_count_;
+  compile_us_ += record.compile_us;
+  if (record.blocking) {
+    ++blocking_compile_count_;
+    blocking_compile_us_ += record.compile_us;
+  }
+  if (records_.size() < kMaxRecords) {
+    records_.push_back(record);
+    return;
+  }
+  auto fastest_it = std::min_element(
+      records_.begin(), records_.end(), [](const Record& a, const Record& b) {
+        return a.compile_us < b.compile_us;
+      });
+  if (fastest_it->compile_us < record.compile_us) {
+    *fastest_it = record;
+  }
+}
+
+void PipelineCompileLog::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  records_.clear();
+  compile_count_ = 0;
+  compile_us_ = 0;
+  blocking_compile_count_ = 0;
+  blocking_compile_us_ = 0;
+}
+
+std::vector<PipelineCompileLog::Record> PipelineCompileLog::GetSlowest(
+    size_t count) const {
+  std::vector<Record> slowest;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    slowest = records_;
+  }
+  count = std::min(count, slowest.size());
+  std::partial_sort(slowest.begin(), slowest.begin() + count, slowest.end(),
+                    [](const Record& a, const Record& b) {
+                      return a.compile_us > b.compile_us;
+                    });
+  slowest.resize(count);
+  return slowest;
+}
+
+uint64_t PipelineCompileLog::compile_count() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return compile_count_;
+}
+
+uint64_t PipelineCompileLog::blocking_compile_us() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return blocking_compile_us_;
+}
+
+void PipelineCompileLog::LogSummary() const {
+  if (cvars::pipeline_compile_summary_count <= 0) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!compile_count_) {
+      return;
+    }
+    XELOGI(
+        "Pipeline compilations: {} taking {:.3f} ms, {} of them blocking guest "
+        "draws taking {:.3f} ms",
+        compile_count_, compile_us_ / 1000.0, blocking_compile_count_,
+        blocking_compile_us_ / 1000.0);
+  }
+  for (const Record& record :
+       GetSlowest(size_t(cvars::pipeline_compile_summary_count))) {
+    XELOGI(
+        "  {:>9.3f} ms {} frame {:>6} pipeline {:016X} VS {:016X}:{:016X} "
+        "PS {:016X}:{:016X}",
+        record.compile_us / 1000.0, record.blocking ? "blocking" : "async   ",
+        record.frame, record.description_hash, record.vertex_shader_hash,
+        record.vertex_shader_modification, record.pixel_shader_hash,
+        record.pixel_shader_modification);
+  }
+}
+
+}  // namespace gpu
+}  // namespace xe
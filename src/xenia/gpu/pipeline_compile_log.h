@@ -0,0 +1,69 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_PIPELINE_COMPILE_LOG_H_
+#define XENIA_GPU_PIPELINE_COMPILE_LOG_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace xe {
+namespace gpu {
+
+// Host pipeline compilations with the guest shaders they were for, to find the
+// ones causing hitches (and worth having in the pipeline storage of the
+// title). Thread-safe, as pipelines may be created by the creation threads of
+// the pipeline cache.
+class PipelineCompileLog {
+ public:
+  struct Record {
+    // Hash of the backend-specific pipeline description.
+    uint64_t description_hash;
+    uint64_t vertex_shader_hash;
+    uint64_t vertex_shader_modification;
+    // 0 if there's no pixel shader.
+    uint64_t pixel_shader_hash;
+    uint64_t pixel_shader_modification;
+    // Guest swaps done before the compilation.
+    uint64_t frame;
+    uint64_t compile_us;
+    // Whether a guest draw waited for the compilation, as opposed to the
+    // pipeline being created in the background or from the storage.
+    bool blocking;
+  };
+
+  // The slowest records are kept when there are more compilations.
+  static constexpr size_t kMaxRecords = 4096;
+
+  void Add(const Record& record);
+  void Clear();
+
+  // The slowest compilations, from the slowest.
+  std::vector<Record> GetSlowest(size_t count) const;
+  uint64_t compile_count() const;
+  uint64_t blocking_compile_us() const;
+
+  // Logs the totals and the slowest compilations.
+  void LogSummary() const;
+
+ private:
+  mutable std::mutex mutex_;
+  std::vector<Record> records_;
+  uint64_t compile_count_ = 0;
+  uint64_t compile_us_ = 0;
+  uint64_t blocking_compile_count_ = 0;
+  uint64_t blocking_compile_us_ = 0;
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_PIPELINE_COMPILE_LOG_H_
@@ -68,6 +68,23 @@ DEFINE_int32(
     "while a very low value may result in excessive locking and lookups.\n"
     "Negative values disable caching.",
     "GPU");
+DEFINE_bool(
+    primitive_processor_cache_across_frames, true,
+    "Keep the results of index processing in the cache across frames while the "
+    "guest indices are not modified, so static geometry is not processed again "
+    "every frame. Converted indices are kept in the host memory and are copied "
+    "to the index buffer of the frame when they are reused in later frames.",
+    "GPU");
+DEFINE_int32(
+    primitive_processor_gpu_conversion_min_indices, 4096,
+    "Smallest number of guest indices in indexed triangle fans and quad lists "
+    "to convert to triangle lists on the GPU rather than on the CPU, on "
+    "backends supporting it. The GPU conversion uses a built-in index buffer "
+    "and loads the guest indices from the shared memory in the vertex shaders, "
+    "so it takes no time on the CPU, but makes each vertex shader invocation "
+    "slower and can't be used if the guest uses primitive reset in the draw.\n"
+    "Negative values disable the GPU conversion.",
+    "GPU");
 
 namespace xe {
 namespace gpu {
@@ -109,7 +126,8 @@ bool PrimitiveProcessor::InitializeCommon(
     bool full_32bit_vertex_indices_supported, bool triangle_fans_supported,
     bool line_loops_supported, bool quad_lists_supported,
     bool point_sprites_supported_without_vs_expansion,
-    bool rectangle_lists_supported_without_vs_expansion) {
+    bool rectangle_lists_supported_without_vs_expansion,
+    bool builtin_ib_for_dma_conversion_supported) {
   full_32bit_vertex_indices_used_ = full_32bit_vertex_indices_supported;
   convert_triangle_fans_to_lists_ =
       !triangle_fans_supported || cvars::force_convert_triangle_fans_to_lists;
@@ -124,6 +142,8 @@ bool PrimitiveProcessor::InitializeCommon(
   expand_point_sprites_in_vs_ = !point_sprites_supported_without_vs_expansion;
   expand_rectangle_lists_in_vs_ =
       !rectangle_lists_supported_without_vs_expansion;
+  builtin_ib_for_dma_conversion_supported_ =
+      builtin_ib_for_dma_conversion_supported;
 
   // Initialize the index buffer for conversion of auto-indexed primitive types.
   size_t builtin_index_buffer_size = 0;
@@ -257,6 +277,7 @@ void PrimitiveProcessor::ShutdownCommon() {
         memory_invalidation_callback_handle_);
     memory_invalidation_callback_handle_ = nullptr;
     cache_entry_pool_.clear();
+    cache_frame_ = 0;
   }
 }
 
@@ -266,9 +287,29 @@ void PrimitiveProcessor::ClearPerFrameCache() {
     return;
   }
   auto global_lock = global_critical_region_.Acquire();
+  ++cache_frame_;
+  if (cvars::primitive_processor_cache_across_frames) {
+    // Host index buffers of the entries are requested again when needed, only
+    // drop what hasn't been used for a while (most likely geometry that's not
+    // drawn anymore, but may also be transient data in a ring buffer that is
+    // overwritten before it's accessed with the same key again).
+    std::vector<size_t> unused_entries;
+    for (const std::pair<CacheKey, size_t>& cache_map_entry : cache_map_) {
+      if (cache_entry_pool_[cache_map_entry.second].last_used_frame +
+              kCacheMaxUnusedFrames <
+          cache_frame_) {
+        unused_entries.push_back(cache_map_entry.second);
+      }
+    }
+    for (size_t entry_index : unused_entries) {
+      RemoveCacheEntry(entry_index, global_lock);
+    }
+    return;
+  }
   for (const std::pair<CacheKey, size_t>& cache_map_entry : cache_map_) {
-    cache_entry_pool_[cache_map_entry.second].free_next =
-        cache_bucket_free_first_entry_;
+    CacheEntry& entry = cache_entry_pool_[cache_map_entry.second];
+    entry.host_indices.reset();
+    entry.free_next = cache_bucket_free_first_entry_;
     cache_bucket_free_first_entry_ = cache_map_entry.second;
   }
   cache_map_.clear();
@@ -673,7 +714,56 @@ bool PrimitiveProcessor::Process(ProcessingResult& result_out) {
         guest_index_format == xenos::IndexFormat::kInt16
             ? UINT16_MAX
             : GpuSwap(xenos::kVertexIndexMask, guest_index_endian);
-    if (host_primitive_type != guest_primitive_type) {
+    // Large indexed triangle fans and quad lists are converted using the
+    // built-in index buffer, with the guest indices loaded from the shared
+    // memory in the vertex shaders, instead of converting them on the CPU
+    // (which also can't be reused if the guest indices change every frame).
+    // Primitive reset, however, requires gathering the single primitives, so
+    // it's still done on the CPU if actually used in the draw.
+    bool convert_primitive_type_on_gpu = false;
+    if (host_primitive_type != guest_primitive_type &&
+        builtin_ib_for_dma_conversion_supported_ &&
+        (guest_primitive_type == xenos::PrimitiveType::kTriangleFan ||
+         guest_primitive_type == xenos::PrimitiveType::kQuadList) &&
+        cvars::primitive_processor_gpu_conversion_min_indices >= 0 &&
+        guest_draw_vertex_count >=
+            uint32_t(cvars::primitive_processor_gpu_conversion_min_indices)) {
+      convert_primitive_type_on_gpu = true;
+      if (guest_primitive_reset_enabled) {
+        if (guest_index_format == xenos::IndexFormat::kInt16) {
+          convert_primitive_type_on_gpu = !IsResetUsed(
+              memory_.TranslatePhysical<const uint16_t*>(guest_index_base),
+              guest_draw_vertex_count,
+              uint16_t(guest_primitive_reset_index_guest_endian));
+        } else {
+          convert_primitive_type_on_gpu = !IsResetUsed(
+              memory_.TranslatePhysical<const uint32_t*>(guest_index_base),
+              guest_draw_vertex_count,
+              guest_primitive_reset_index_guest_endian,
+              guest_index_mask_guest_endian);
+        }
+      }
+    }
+    if (convert_primitive_type_on_gpu) {
+      cacheable.index_buffer_type =
+          ProcessedIndexBufferType::kHostBuiltinForDMA;
+      cacheable.host_index_format = xenos::IndexFormat::kInt16;
+      cacheable.host_primitive_reset_enabled = false;
+      if (guest_primitive_type == xenos::PrimitiveType::kTriangleFan) {
+        cacheable.host_draw_vertex_count =
+            GetTriangleFanListIndexCount(guest_draw_vertex_count);
+        assert_true(builtin_ib_offset_triangle_fans_to_lists_ != SIZE_MAX);
+        cacheable.host_index_buffer_handle =
+            builtin_ib_offset_triangle_fans_to_lists_;
+      } else {
+        cacheable.host_draw_vertex_count =
+            GetQuadListTriangleListIndexCount(guest_draw_vertex_count);
+        assert_true(builtin_ib_offset_quad_lists_to_triangle_lists_ !=
+                    SIZE_MAX);
+        cacheable.host_index_buffer_handle =
+            builtin_ib_offset_quad_lists_to_triangle_lists_;
+      }
+    } else if (host_primitive_type != guest_primitive_type) {
       // Already converting to a different index type - primitive reset is
       // performed during conversion here. Also doing the endian swap here for
       // hosts not supporting 32-bit indices because indirection is only used
@@ -686,6 +776,9 @@ bool PrimitiveProcessor::Process(ProcessingResult& result_out) {
           *this, CacheKey(guest_index_base, guest_draw_vertex_count,
                           guest_index_format, guest_index_endian,
                           guest_primitive_reset_enabled, guest_primitive_type));
+      if (cache_transaction.HasFailed()) {
+        return false;
+      }
       if (cache_transaction.GetFoundResult()) {
         cacheable = *cache_transaction.GetFoundResult();
       } else {
@@ -735,7 +828,7 @@ bool PrimitiveProcessor::Process(ProcessingResult& result_out) {
                 0, guest_draw_vertex_count, cacheable.host_draw_vertex_count);
           }
           auto host_indices = reinterpret_cast<uint16_t*>(
-              RequestHostConvertedIndexBufferForCurrentFrame(
+              cache_transaction.RequestHostConvertedIndexBuffer(
                   xenos::IndexFormat::kInt16, cacheable.host_draw_vertex_count,
                   false, guest_index_base, cacheable.host_index_buffer_handle));
           if (!host_indices) {
@@ -769,7 +862,7 @@ bool PrimitiveProcessor::Process(ProcessingResult& result_out) {
                 0, guest_draw_vertex_count, cacheable.host_draw_vertex_count);
           }
           auto host_indices = reinterpret_cast<uint32_t*>(
-              RequestHostConvertedIndexBufferForCurrentFrame(
+              cache_transaction.RequestHostConvertedIndexBuffer(
                   xenos::IndexFormat::kInt32, cacheable.host_draw_vertex_count,
                   false, guest_index_base, cacheable.host_index_buffer_handle));
           if (!host_indices) {
@@ -851,6 +944,9 @@ bool PrimitiveProcessor::Process(ProcessingResult& result_out) {
                 *this, CacheKey(guest_index_base, guest_draw_vertex_count,
                                 guest_index_format, guest_index_endian,
                                 guest_primitive_reset_enabled));
+            if (cache_transaction.HasFailed()) {
+              return false;
+            }
             if (cache_transaction.GetFoundResult()) {
               cacheable = *cache_transaction.GetFoundResult();
             } else {
@@ -868,7 +964,7 @@ bool PrimitiveProcessor::Process(ProcessingResult& result_out) {
                                                   ? xenos::IndexFormat::kInt32
                                                   : xenos::IndexFormat::kInt16;
                 void* host_indices_ptr =
-                    RequestHostConvertedIndexBufferForCurrentFrame(
+                    cache_transaction.RequestHostConvertedIndexBuffer(
                         cacheable.host_index_format, guest_draw_vertex_count,
                         true, guest_index_base,
                         cacheable.host_index_buffer_handle);
@@ -909,6 +1005,9 @@ bool PrimitiveProcessor::Process(ProcessingResult& result_out) {
               *this, CacheKey(guest_index_base, guest_draw_vertex_count,
                               guest_index_format, guest_index_endian,
                               guest_primitive_reset_enabled));
+          if (cache_transaction.HasFailed()) {
+            return false;
+          }
           if (cache_transaction.GetFoundResult()) {
             cacheable = *cache_transaction.GetFoundResult();
           } else {
@@ -920,7 +1019,7 @@ bool PrimitiveProcessor::Process(ProcessingResult& result_out) {
               cacheable.index_buffer_type =
                   ProcessedIndexBufferType::kHostConverted;
               auto host_indices = reinterpret_cast<uint32_t*>(
-                  RequestHostConvertedIndexBufferForCurrentFrame(
+                  cache_transaction.RequestHostConvertedIndexBuffer(
                       xenos::IndexFormat::kInt32, guest_draw_vertex_count, true,
                       guest_index_base, cacheable.host_index_buffer_handle));
               if (!host_indices) {
@@ -1427,12 +1526,29 @@ PrimitiveProcessor::CacheTransaction::CacheTransaction(
       (key_.format == xenos::IndexFormat::kInt16 ? sizeof(uint16_t)
                                                  : sizeof(uint32_t)) *
       key_.count;
+  // Converted indices from an earlier frame that need to be uploaded again.
+  bool reupload_host_indices = false;
+  std::shared_ptr<std::vector<uint8_t>> reused_host_indices;
+  size_t reused_host_indices_offset = 0;
+  size_t reused_host_indices_size = 0;
   {
     auto global_lock = processor_.global_critical_region_.Acquire();
     auto cache_map_it = processor_.cache_map_.find(key_);
     if (cache_map_it != processor_.cache_map_.end()) {
-      result_ = processor_.cache_entry_pool_[cache_map_it->second].result;
+      CacheEntry& entry = processor_.cache_entry_pool_[cache_map_it->second];
+      entry.last_used_frame = processor_.cache_frame_;
+      result_ = entry.result;
       result_type_ = ResultType::kExisting;
+      if (result_.index_buffer_type ==
+              ProcessedIndexBufferType::kHostConverted &&
+          entry.result_frame != processor_.cache_frame_) {
+        // The entry may be invalidated concurrently while uploading outside
+        // the lock, but the shared copy of the indices stays alive.
+        reupload_host_indices = true;
+        reused_host_indices = entry.host_indices;
+        reused_host_indices_offset = entry.host_indices_offset;
+        reused_host_indices_size = entry.host_indices_size;
+      }
     } else {
       // Inhibit writing the new result if the range happens to be modified
       // during the processing outside the lock.
@@ -1440,7 +1556,35 @@ PrimitiveProcessor::CacheTransaction::CacheTransaction(
       processor_.cache_currently_processing_size_bytes_ = size_bytes;
     }
   }
-  if (result_type_ != ResultType::kExisting) {
+  if (result_type_ == ResultType::kExisting) {
+    if (reupload_host_indices) {
+      // Reusing the result from an earlier frame - the host index buffer of
+      // that frame is not available anymore.
+      void* mapping = nullptr;
+      if (reused_host_indices) {
+        mapping = processor_.RequestHostConvertedIndexBufferForCurrentFrame(
+            result_.host_index_format, result_.host_draw_vertex_count, false,
+            key_.base, result_.host_index_buffer_handle);
+      }
+      if (!mapping) {
+        failed_ = true;
+        return;
+      }
+      std::memcpy(mapping,
+                  reused_host_indices->data() + reused_host_indices_offset,
+                  reused_host_indices_size);
+      auto global_lock = processor_.global_critical_region_.Acquire();
+      auto cache_map_it = processor_.cache_map_.find(key_);
+      if (cache_map_it != processor_.cache_map_.end()) {
+        CacheEntry& entry = processor_.cache_entry_pool_[cache_map_it->second];
+        if (entry.host_indices == reused_host_indices) {
+          entry.result.host_index_buffer_handle =
+              result_.host_index_buffer_handle;
+          entry.result_frame = processor_.cache_frame_;
+        }
+      }
+    }
+  } else {
     // Enable the invalidation callback before reading the indices.
     // Also, only enable invalidation callbacks if anything needed processing at
     // all - don't waste time in the access violation handler doing nothing if
@@ -1455,6 +1599,47 @@ PrimitiveProcessor::CacheTransaction::CacheTransaction(
   }
 }
 
+void* PrimitiveProcessor::CacheTransaction::RequestHostConvertedIndexBuffer(
+    xenos::IndexFormat format, uint32_t index_count, bool coalign_for_simd,
+    uint32_t coalignment_original_address, size_t& backend_handle_out) {
+  assert_true(result_type_ == ResultType::kNewUnset);
+  void* mapping = processor_.RequestHostConvertedIndexBufferForCurrentFrame(
+      format, index_count, coalign_for_simd, coalignment_original_address,
+      backend_handle_out);
+  if (!mapping || !key_.count ||
+      !cvars::primitive_processor_cache_across_frames) {
+    return mapping;
+  }
+  host_indices_mapping_ = mapping;
+  host_indices_size_ =
+      (format == xenos::IndexFormat::kInt16 ? sizeof(uint16_t)
+                                            : sizeof(uint32_t)) *
+      index_count;
+  // Same padding as the host buffer for SIMD processing.
+  host_indices_ = std::make_shared<std::vector<uint8_t>>(
+      host_indices_size_ + XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE);
+  host_indices_offset_ = 0;
+  if (coalign_for_simd) {
+    host_indices_offset_ = size_t(GetSimdCoalignmentOffset(
+        host_indices_->data(), coalignment_original_address));
+  }
+  return host_indices_->data() + host_indices_offset_;
+}
+
+void PrimitiveProcessor::CacheTransaction::SetNewResult(
+    const CachedResult& new_result) {
+  // Replacement of an existing entry is not allowed.
+  assert_true(result_type_ != ResultType::kExisting);
+  result_ = new_result;
+  result_type_ = ResultType::kNewSet;
+  if (host_indices_mapping_) {
+    std::memcpy(host_indices_mapping_,
+                host_indices_->data() + host_indices_offset_,
+                host_indices_size_);
+    host_indices_mapping_ = nullptr;
+  }
+}
+
 PrimitiveProcessor::CacheTransaction::~CacheTransaction() {
   if (!key_.count || result_type_ == ResultType::kExisting) {
     return;
@@ -1511,6 +1696,11 @@ PrimitiveProcessor::CacheTransaction::~CacheTransaction() {
 
     new_entry.key = key_;
     new_entry.result = result_;
+    new_entry.last_used_frame = processor_.cache_frame_;
+    new_entry.result_frame = processor_.cache_frame_;
+    new_entry.host_indices = std::move(host_indices_);
+    new_entry.host_indices_offset = host_indices_offset_;
+    new_entry.host_indices_size = host_indices_size_;
 
     processor_.cache_map_.emplace(key_, new_entry_index);
   }
@@ -1608,60 +1798,12 @@ std::pair<uint32_t, uint32_t> PrimitiveProcessor::MemoryInvalidationCallback(
               entry.buckets_next[bucket_index - entry_bucket_index_first];
           // For exact_range, don't invalidate bucket entries that are outside
           // the specified range.
-          if (entry_key.base < physical_address_end) {
-            uint32_t entry_end = entry_key.base + entry_key.GetSizeBytes();
-            if (entry_end > physical_address_end) {
-              // Invalidate the entry.
-              any_invalidated = true;
-              // Remove the entry from the cache map.
-              auto entry_map_it = cache_map_.find(entry_key);
-              assert_true(entry_map_it != cache_map_.end());
-              if (entry_map_it != cache_map_.end()) {
-                cache_map_.erase(entry_map_it);
-              }
-              // Unlink the entry from the bucket's list.
-              uint32_t entry_link_index_last =
-                  ((entry_end - 1) >> kCacheBucketSizeBytesLog2) -
-                  entry_bucket_index_first;
-              assert_true(
-                  entry_link_index_last <= 1,
-                  "Cache entries only store list links within two buckets");
-              for (uint32_t entry_link_index = 0;
-                   entry_link_index <= entry_link_index_last;
-                   ++entry_link_index) {
-                uint32_t entry_bucket_index =
-                    entry_bucket_index_first + entry_link_index;
-                size_t entry_link_prev = entry.buckets_prev[entry_link_index];
-                size_t entry_link_next = entry.buckets_next[entry_link_index];
-                if (entry_link_prev != SIZE_MAX) {
-                  CacheEntry& entry_prev = cache_entry_pool_[entry_link_prev];
-                  entry_prev.buckets_next[size_t(
-                      (entry_prev.key.base >> kCacheBucketSizeBytesLog2) !=
-                      entry_bucket_index)] = entry_link_next;
-                } else {
-                  if (entry_link_next != SIZE_MAX) {
-                    cache_bucket_first_entries_[entry_bucket_index] =
-                        entry_link_next;
-                  } else {
-                    // The only entry that was remaining in the bucket - it's
-                    // empty now.
-                    cache_buckets_non_empty_l1_[entry_bucket_index >> 6] &=
-                        ~(uint64_t(1) << (entry_bucket_index & 63));
-                    UpdateCacheBucketsNonEmptyL2(entry_bucket_index >> 6,
-                                                 global_lock);
-                  }
-                }
-                if (entry_link_next != SIZE_MAX) {
-                  CacheEntry& entry_next = cache_entry_pool_[entry_link_next];
-                  entry_next.buckets_prev[size_t(
-                      (entry_next.key.base >> kCacheBucketSizeBytesLog2) !=
-                      entry_bucket_index)] = entry_link_prev;
-                }
-              }
-              // Make the entry free for reuse.
-              entry.free_next = cache_bucket_free_first_entry_;
-              cache_bucket_free_first_entry_ = entry_index;
-            }
+          if (entry_key.base < physical_address_end &&
+              entry_key.base + entry_key.GetSizeBytes() >
+                  physical_address_start) {
+            // Invalidate the entry.
+            any_invalidated = true;
+            RemoveCacheEntry(entry_index, global_lock);
           }
           entry_index = next_entry_index;
         } while (entry_index != SIZE_MAX);
@@ -1674,6 +1816,54 @@ std::pair<uint32_t, uint32_t> PrimitiveProcessor::MemoryInvalidationCallback(
              : std::make_pair(uint32_t(0), UINT32_MAX);
 }
 
+void PrimitiveProcessor::RemoveCacheEntry(
+    size_t entry_index,
+    const std::unique_lock<std::recursive_mutex>& global_lock) {
+  CacheEntry& entry = cache_entry_pool_[entry_index];
+  CacheKey entry_key = entry.key;
+  // Remove the entry from the cache map.
+  auto entry_map_it = cache_map_.find(entry_key);
+  assert_true(entry_map_it != cache_map_.end());
+  if (entry_map_it != cache_map_.end()) {
+    cache_map_.erase(entry_map_it);
+  }
+  // Unlink the entry from the lists of its buckets.
+  uint32_t entry_bucket_index_first =
+      entry_key.base >> kCacheBucketSizeBytesLog2;
+  uint32_t entry_link_count = entry.GetBucketCount();
+  for (uint32_t entry_link_index = 0; entry_link_index < entry_link_count;
+       ++entry_link_index) {
+    uint32_t entry_bucket_index = entry_bucket_index_first + entry_link_index;
+    size_t entry_link_prev = entry.buckets_prev[entry_link_index];
+    size_t entry_link_next = entry.buckets_next[entry_link_index];
+    if (entry_link_prev != SIZE_MAX) {
+      CacheEntry& entry_prev = cache_entry_pool_[entry_link_prev];
+      entry_prev.buckets_next[size_t(
+          (entry_prev.key.base >> kCacheBucketSizeBytesLog2) !=
+          entry_bucket_index)] = entry_link_next;
+    } else {
+      if (entry_link_next != SIZE_MAX) {
+        cache_bucket_first_entries_[entry_bucket_index] = entry_link_next;
+      } else {
+        // The only entry that was remaining in the bucket - it's empty now.
+        cache_buckets_non_empty_l1_[entry_bucket_index >> 6] &=
+            ~(uint64_t(1) << (entry_bucket_index & 63));
+        UpdateCacheBucketsNonEmptyL2(entry_bucket_index >> 6, global_lock);
+      }
+    }
+    if (entry_link_next != SIZE_MAX) {
+      CacheEntry& entry_next = cache_entry_pool_[entry_link_next];
+      entry_next.buckets_prev[size_t(
+          (entry_next.key.base >> kCacheBucketSizeBytesLog2) !=
+          entry_bucket_index)] = entry_link_prev;
+    }
+  }
+  // Make the entry free for reuse.
+  entry.host_indices.reset();
+  entry.free_next = cache_bucket_free_first_entry_;
+  cache_bucket_free_first_entry_ = entry_index;
+}
+
 std::pair<uint32_t, uint32_t>
 PrimitiveProcessor::MemoryInvalidationCallbackThunk(
     void* context_ptr, uint32_t physical_address_start, uint32_t length,
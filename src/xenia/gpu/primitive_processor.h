@@ -17,9 +17,11 @@
 #include <cstring>
 #include <deque>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/cvar.h"
@@ -152,6 +154,30 @@ class PrimitiveProcessor {
     bool IsTessellated() const {
       return Shader::IsHostVertexShaderTypeDomain(host_vertex_shader_type);
     }
+    // If the draw uses the guest indices directly, and the host primitives are
+    // independent from each other, so the indices of another draw with the
+    // same state directly following the indices of this one in memory can be
+    // appended to this host draw, returns the number of vertices in each
+    // primitive. Returns 0 if appending is not possible.
+    uint32_t GetAppendableIndicesPrimitiveVertexCount() const {
+      if (index_buffer_type != ProcessedIndexBufferType::kGuestDMA ||
+          IsTessellated()) {
+        return 0;
+      }
+      switch (host_primitive_type) {
+        case xenos::PrimitiveType::kPointList:
+          return 1;
+        case xenos::PrimitiveType::kLineList:
+          return 2;
+        case xenos::PrimitiveType::kTriangleList:
+        case xenos::PrimitiveType::kRectangleList:
+          return 3;
+        case xenos::PrimitiveType::kQuadList:
+          return 4;
+        default:
+          return 0;
+      }
+    }
   };
 
   virtual ~PrimitiveProcessor();
@@ -253,11 +279,19 @@ class PrimitiveProcessor {
   //     emulation. Overrides do not apply to these as hosts are not required to
   //     support the fallback paths since they require different vertex shader
   //     structure (for the fallback HostVertexShaderTypes).
+  // - builtin_ib_for_dma_conversion_supported:
+  //   - Pass true if the vertex shaders of HostVertexShaderType kVertex can
+  //     load the guest vertex index from the shared memory for index buffers
+  //     of ProcessedIndexBufferType kHostBuiltinForDMA, treating the host
+  //     index as the position in the guest index buffer. Large indexed triangle
+  //     fans and quad lists may then be converted to triangle lists on the GPU
+  //     using the built-in index buffer rather than on the CPU.
   bool InitializeCommon(bool full_32bit_vertex_indices_supported,
                         bool triangle_fans_supported, bool line_loops_supported,
                         bool quad_lists_supported,
                         bool point_sprites_supported_without_vs_expansion,
-                        bool rectangle_lists_supported_without_vs_expansion);
+                        bool rectangle_lists_supported_without_vs_expansion,
+                        bool builtin_ib_for_dma_conversion_supported);
   // If any primitive type conversion is needed for auto-indexed draws, called
   // from InitializeCommon (thus only once in the primitive processor's
   // lifetime) to set up the backend's index buffer containing indices for
@@ -272,7 +306,10 @@ class PrimitiveProcessor {
 
   // Call at boundaries of lifespans of converted data (between frames,
   // preferably in the end of a frame so between the swap and the next draw,
-  // access violation handlers need to do less work).
+  // access violation handlers need to do less work). Unless caching across
+  // frames is disabled, only drops the entries that haven't been used for a
+  // while, and the host buffers of the rest are requested again when they're
+  // needed in the next frames.
   void ClearPerFrameCache();
 
   static constexpr size_t GetBuiltinIndexBufferOffsetBytes(size_t handle) {
@@ -701,6 +738,7 @@ class PrimitiveProcessor {
   bool convert_quad_lists_to_triangle_lists_ = false;
   bool expand_point_sprites_in_vs_ = false;
   bool expand_rectangle_lists_in_vs_ = false;
+  bool builtin_ib_for_dma_conversion_supported_ = false;
 
   // Byte offsets used, for simplicity, directly as handles.
   size_t builtin_ib_offset_two_triangle_strips_ = SIZE_MAX;
@@ -709,7 +747,12 @@ class PrimitiveProcessor {
 
   std::deque<SinglePrimitiveRange> single_primitive_ranges_;
 
-  // Caching for reuse of converted indices within a frame.
+  // Caching for reuse of converted indices within a frame, and, while the
+  // guest indices are not modified, across frames.
+
+  // Cache entries not used for this many frames are dropped in
+  // ClearPerFrameCache.
+  static constexpr uint64_t kCacheMaxUnusedFrames = 64;
 
   // 256 KB as the largest possible guest index buffer - 0xFFFF 32-bit indices -
   // is slightly smaller than 256 KB, thus cache entries need store links within
@@ -792,6 +835,15 @@ class PrimitiveProcessor {
     size_t buckets_next[2];
     CacheKey key;
     CachedResult result;
+    uint64_t last_used_frame;
+    // For ProcessedIndexBufferType::kHostConverted results - the frame in
+    // which result.host_index_buffer_handle was obtained, and, if caching
+    // across frames, a copy of the converted indices (at host_indices_offset)
+    // for uploading them again in later frames.
+    uint64_t result_frame;
+    std::shared_ptr<std::vector<uint8_t>> host_indices;
+    size_t host_indices_offset;
+    size_t host_indices_size;
     static uint32_t GetBucketCount(CacheKey key) {
       uint32_t count =
           ((key.base + (key.GetSizeBytes() - 1)) >> kCacheBucketSizeBytesLog2) -
@@ -824,19 +876,27 @@ class PrimitiveProcessor {
   //     entry in the cache.
   // If an entry was found in the cache (GetFoundResult results non-null), it
   // MUST be used instead of processing - this class doesn't provide the
-  // possibility replace existing entries.
+  // possibility replace existing entries. If the entry was found, but its host
+  // index buffer couldn't be recreated for the current frame, HasFailed
+  // returns true, and processing must fail.
   class CacheTransaction final {
    public:
     CacheTransaction(PrimitiveProcessor& processor, CacheKey key);
     const CachedResult* GetFoundResult() const {
       return result_type_ == ResultType::kExisting ? &result_ : nullptr;
     }
-    void SetNewResult(const CachedResult& new_result) {
-      // Replacement of an existing entry is not allowed.
-      assert_true(result_type_ != ResultType::kExisting);
-      result_ = new_result;
-      result_type_ = ResultType::kNewSet;
-    }
+    bool HasFailed() const { return failed_; }
+    // Wraps RequestHostConvertedIndexBufferForCurrentFrame. The indices must
+    // be written to the returned buffer before SetNewResult. If the result may
+    // be kept in the cache across frames, the returned buffer is a copy in the
+    // host memory which is uploaded to the host index buffer by SetNewResult,
+    // so the indices are not read back from write-combined memory later.
+    void* RequestHostConvertedIndexBuffer(xenos::IndexFormat format,
+                                          uint32_t index_count,
+                                          bool coalign_for_simd,
+                                          uint32_t coalignment_original_address,
+                                          size_t& backend_handle_out);
+    void SetNewResult(const CachedResult& new_result);
     ~CacheTransaction();
 
    private:
@@ -853,6 +913,12 @@ class PrimitiveProcessor {
       kExisting,
     };
     ResultType result_type_ = ResultType::kNewUnset;
+    bool failed_ = false;
+    // The host index buffer and the copy of the newly converted indices.
+    void* host_indices_mapping_ = nullptr;
+    std::shared_ptr<std::vector<uint8_t>> host_indices_;
+    size_t host_indices_offset_ = 0;
+    size_t host_indices_size_ = 0;
   };
 
   std::deque<CacheEntry> cache_entry_pool_;
@@ -871,6 +937,8 @@ class PrimitiveProcessor {
   // 0 if not in a cache transaction that hasn't found an existing entry
   // currently.
   uint32_t cache_currently_processing_size_bytes_ = 0;
+  // Incremented in every ClearPerFrameCache.
+  uint64_t cache_frame_ = 0;
   // Modified by both the processor and the invalidation callback.
   size_t cache_bucket_free_first_entry_ = SIZE_MAX;
   // Modified by both the processor and the invalidation callback.
@@ -880,6 +948,11 @@ class PrimitiveProcessor {
   // Modified by both the processor and the invalidation callback.
   uint64_t cache_buckets_non_empty_l2_[(kCacheBucketCount + (64 * 64 - 1)) /
                                        (64 * 64)] = {};
+  // Removes the entry from the map and the buckets, and makes it free for
+  // reuse. Must be called in a global critical region.
+  void RemoveCacheEntry(
+      size_t entry_index,
+      const std::unique_lock<std::recursive_mutex>& global_lock);
   // Must be called in a global critical region.
   void UpdateCacheBucketsNonEmptyL2(
       uint32_t bucket_index_div_64,
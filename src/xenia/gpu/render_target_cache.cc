@@ -203,10 +203,49 @@ DEFINE_bool(
     "If this is enabled, excessive barriers may be eliminated when switching "
     "between different render targets in separate EDRAM locations.",
     "GPU");
+DEFINE_bool(
+    resolve_skip_unmodified, true,
+    "Don't copy the EDRAM contents to the memory again when the guest repeats "
+    "a resolve, and neither the EDRAM tiles it reads nor the destination "
+    "memory have been modified since the previous one. Only when using host "
+    "render targets.",
+    "GPU");
+DEFINE_bool(
+    log_render_target_transfers, false,
+    "Log the number of copies between host render targets done when the "
+    "ownership of EDRAM ranges is changed, and of the draws needed for them, "
+    "in each frame.",
+    "GPU");
 
 namespace xe {
 namespace gpu {
 
+// Whether the resolves would write the same data to the same location given the
+// same EDRAM contents.
+static bool AreResolveCopiesSame(const draw_util::ResolveInfo& a,
+                                 const draw_util::ResolveInfo& b) {
+  if (a.IsCopyingDepth() != b.IsCopyingDepth() ||
+      a.rb_copy_control.copy_src_select != b.rb_copy_control.copy_src_select ||
+      a.rb_copy_control.copy_sample_select !=
+          b.rb_copy_control.copy_sample_select ||
+      a.rb_copy_control.copy_command != b.rb_copy_control.copy_command) {
+    return false;
+  }
+  const draw_util::ResolveEdramInfo& a_edram_info =
+      a.IsCopyingDepth() ? a.depth_edram_info : a.color_edram_info;
+  const draw_util::ResolveEdramInfo& b_edram_info =
+      b.IsCopyingDepth() ? b.depth_edram_info : b.color_edram_info;
+  return a_edram_info.packed == b_edram_info.packed &&
+         a.coordinate_info.packed == b.coordinate_info.packed &&
+         a.height_div_8 == b.height_div_8 &&
+         a.copy_dest_info.value == b.copy_dest_info.value &&
+         a.copy_dest_coordinate_info.packed ==
+             b.copy_dest_coordinate_info.packed &&
+         a.copy_dest_base == b.copy_dest_base &&
+         a.copy_dest_extent_start == b.copy_dest_extent_start &&
+         a.copy_dest_extent_length == b.copy_dest_extent_length;
+}
+
 void RenderTargetCache::GetPSIColorFormatInfo(
     xenos::ColorRenderTargetFormat format, uint32_t write_mask,
     float& clamp_rgb_low, float& clamp_alpha_low, float& clamp_rgb_high,
@@ -513,6 +552,8 @@ void RenderTargetCache::InitializeCommon() {
 }
 
 void RenderTargetCache::DestroyAllRenderTargets(bool shutting_down) {
+  ClearResolveCopyRecords();
+
   ownership_ranges_.clear();
   if (!shutting_down) {
     ownership_ranges_.emplace(
@@ -536,20 +577,7 @@ void RenderTargetCache::ClearCache() {
   if (!render_targets_.empty()) {
     std::unordered_set<RenderTargetKey, RenderTargetKey::Hasher>
         used_render_targets;
-    for (const auto& ownership_range_pair : ownership_ranges_) {
-      const OwnershipRange& ownership_range = ownership_range_pair.second;
-      if (!ownership_range.render_target.IsEmpty()) {
-        used_render_targets.emplace(ownership_range.render_target);
-      }
-      if (!ownership_range.host_depth_render_target_unorm24.IsEmpty()) {
-        used_render_targets.emplace(
-            ownership_range.host_depth_render_target_unorm24);
-      }
-      if (!ownership_range.host_depth_render_target_float24.IsEmpty()) {
-        used_render_targets.emplace(
-            ownership_range.host_depth_render_target_float24);
-      }
-    }
+    GetRenderTargetsOwningEdram(used_render_targets);
     if (render_targets_.size() != used_render_targets.size()) {
       typename decltype(render_targets_)::iterator it_next;
       for (auto it = render_targets_.begin(); it != render_targets_.end();
@@ -571,6 +599,75 @@ void RenderTargetCache::ClearCache() {
 
 void RenderTargetCache::BeginFrame() { ResetAccumulatedRenderTargets(); }
 
+void RenderTargetCache::DestroyRenderTargetsNotOwningEdram(
+    const std::function<bool(RenderTarget& render_target)>& can_destroy) {
+  if (render_targets_.empty()) {
+    return;
+  }
+  std::unordered_set<RenderTargetKey, RenderTargetKey::Hasher>
+      used_render_targets;
+  GetRenderTargetsOwningEdram(used_render_targets);
+  if (render_targets_.size() == used_render_targets.size()) {
+    return;
+  }
+  typename decltype(render_targets_)::iterator it_next;
+  for (auto it = render_targets_.begin(); it != render_targets_.end();
+       it = it_next) {
+    it_next = std::next(it);
+    if (!it->second || used_render_targets.find(it->second->key()) !=
+                           used_render_targets.end()) {
+      continue;
+    }
+    // The bindings from the last update may be reused by the next draw without
+    // looking up the render targets again. Only comparing the pointers as
+    // these arrays may be stale.
+    if (std::find(std::begin(last_update_used_render_targets_),
+                  std::end(last_update_used_render_targets_),
+                  it->second) != std::end(last_update_used_render_targets_) ||
+        std::find(std::begin(last_update_accumulated_render_targets_),
+                  std::end(last_update_accumulated_render_targets_),
+                  it->second) !=
+            std::end(last_update_accumulated_render_targets_)) {
+      continue;
+    }
+    if (!can_destroy(*it->second)) {
+      continue;
+    }
+    delete it->second;
+    render_targets_.erase(it);
+  }
+}
+
+void RenderTargetCache::GetRenderTargetsOwningEdram(
+    std::unordered_set<RenderTargetKey, RenderTargetKey::Hasher>& keys_out)
+    const {
+  for (const auto& ownership_range_pair : ownership_ranges_) {
+    const OwnershipRange& ownership_range = ownership_range_pair.second;
+    if (!ownership_range.render_target.IsEmpty()) {
+      keys_out.emplace(ownership_range.render_target);
+    }
+    if (!ownership_range.host_depth_render_target_unorm24.IsEmpty()) {
+      keys_out.emplace(ownership_range.host_depth_render_target_unorm24);
+    }
+    if (!ownership_range.host_depth_render_target_float24.IsEmpty()) {
+      keys_out.emplace(ownership_range.host_depth_render_target_float24);
+    }
+  }
+}
+
+void RenderTargetCache::EndFrame() {
+  if (cvars::log_render_target_transfers && frame_transfer_count_) {
+    XELOGI(
+        "Render target transfers in the frame: {} transfers, {} rectangles, "
+        "{} draws",
+        frame_transfer_count_, frame_transfer_rectangle_count_,
+        frame_transfer_draw_count_);
+  }
+  frame_transfer_count_ = 0;
+  frame_transfer_rectangle_count_ = 0;
+  frame_transfer_draw_count_ = 0;
+}
+
 bool RenderTargetCache::Update(bool is_rasterization_done,
                                reg::RB_DEPTHCONTROL normalized_depth_control,
                                uint32_t normalized_color_mask,
@@ -1370,6 +1467,127 @@ bool RenderTargetCache::PrepareHostRenderTargetsResolveClear(
   return true;
 }
 
+bool RenderTargetCache::IsResolveCopyUpToDate(
+    const draw_util::ResolveInfo& resolve_info) {
+  if (!cvars::resolve_skip_unmodified ||
+      GetPath() != Path::kHostRenderTargets ||
+      !resolve_copy_records_edram_up_to_date_) {
+    return false;
+  }
+  for (uint32_t i = 0; i < kResolveCopyRecordCount; ++i) {
+    const ResolveCopyRecord& record = resolve_copy_records_[i];
+    if (!record.edram_up_to_date ||
+        !AreResolveCopiesSame(record.resolve_info, resolve_info)) {
+      continue;
+    }
+    auto global_lock = global_critical_region_.Acquire();
+    return record.dest_watch != nullptr;
+  }
+  return false;
+}
+
+void RenderTargetCache::ResolveCopyDone(
+    const draw_util::ResolveInfo& resolve_info, SharedMemory& shared_memory) {
+  if (!cvars::resolve_skip_unmodified ||
+      GetPath() != Path::kHostRenderTargets) {
+    return;
+  }
+  assert_true(!resolve_copy_shared_memory_ ||
+              resolve_copy_shared_memory_ == &shared_memory);
+  resolve_copy_shared_memory_ = &shared_memory;
+  // Replace the record of the same copy if it exists, or the oldest one.
+  uint32_t record_index = resolve_copy_record_next_;
+  for (uint32_t i = 0; i < kResolveCopyRecordCount; ++i) {
+    if (AreResolveCopiesSame(resolve_copy_records_[i].resolve_info,
+                             resolve_info)) {
+      record_index = i;
+      break;
+    }
+  }
+  if (record_index == resolve_copy_record_next_) {
+    resolve_copy_record_next_ =
+        (resolve_copy_record_next_ + 1) % kResolveCopyRecordCount;
+  }
+  ResolveCopyRecord& record = resolve_copy_records_[record_index];
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    if (record.dest_watch) {
+      shared_memory.UnwatchMemoryRange(record.dest_watch);
+      record.dest_watch = nullptr;
+    }
+  }
+  if (record.edram_up_to_date) {
+    record.edram_up_to_date = false;
+    --resolve_copy_records_edram_up_to_date_;
+  }
+  record.resolve_info = resolve_info;
+  uint32_t span_base, span_row_length_used, span_rows, span_pitch;
+  resolve_info.GetCopyEdramTileSpan(span_base, span_row_length_used, span_rows,
+                                    span_pitch);
+  if (!span_rows) {
+    return;
+  }
+  record.edram_start_tiles = span_base & (xenos::kEdramTileCount - 1);
+  record.edram_end_tiles =
+      record.edram_start_tiles +
+      std::min((span_rows - 1) * span_pitch + span_row_length_used,
+               xenos::kEdramTileCount);
+  // Watching with the lock, so the watch can't be triggered before the handle
+  // is stored.
+  auto global_lock = global_critical_region_.Acquire();
+  record.dest_watch = shared_memory.WatchMemoryRange(
+      resolve_info.copy_dest_extent_start, resolve_info.copy_dest_extent_length,
+      ResolveCopyDestWatchCallback, this, &record, 0);
+  if (record.dest_watch) {
+    record.edram_up_to_date = true;
+    ++resolve_copy_records_edram_up_to_date_;
+  }
+}
+
+void RenderTargetCache::ResolveCopyDestWatchCallback(
+    const std::unique_lock<std::recursive_mutex>& global_lock, void* context,
+    void* data, uint64_t argument, bool invalidated_by_gpu) {
+  // The watch is cancelled after the callback.
+  static_cast<ResolveCopyRecord*>(data)->dest_watch = nullptr;
+}
+
+void RenderTargetCache::InvalidateResolveCopyRecords(uint32_t start_tiles,
+                                                     uint32_t end_tiles) {
+  if (!resolve_copy_records_edram_up_to_date_) {
+    return;
+  }
+  for (uint32_t i = 0; i < kResolveCopyRecordCount; ++i) {
+    ResolveCopyRecord& record = resolve_copy_records_[i];
+    if (!record.edram_up_to_date) {
+      continue;
+    }
+    if ((start_tiles < record.edram_end_tiles &&
+         end_tiles > record.edram_start_tiles) ||
+        (record.edram_end_tiles > xenos::kEdramTileCount &&
+         start_tiles < record.edram_end_tiles - xenos::kEdramTileCount)) {
+      record.edram_up_to_date = false;
+      --resolve_copy_records_edram_up_to_date_;
+    }
+  }
+}
+
+void RenderTargetCache::ClearResolveCopyRecords() {
+  if (resolve_copy_shared_memory_) {
+    auto global_lock = global_critical_region_.Acquire();
+    for (uint32_t i = 0; i < kResolveCopyRecordCount; ++i) {
+      ResolveCopyRecord& record = resolve_copy_records_[i];
+      if (record.dest_watch) {
+        resolve_copy_shared_memory_->UnwatchMemoryRange(record.dest_watch);
+        record.dest_watch = nullptr;
+      }
+    }
+  }
+  for (uint32_t i = 0; i < kResolveCopyRecordCount; ++i) {
+    resolve_copy_records_[i].edram_up_to_date = false;
+  }
+  resolve_copy_records_edram_up_to_date_ = 0;
+}
+
 RenderTargetCache::RenderTarget*
 RenderTargetCache::PrepareFullEdram1280xRenderTargetForSnapshotRestoration(
     xenos::ColorRenderTargetFormat color_format) {
@@ -1553,6 +1771,8 @@ void RenderTargetCache::ChangeOwnership(
       IsHostDepthEncodingDifferent(dest.GetDepthFormat());
   auto change_ownership_in_extent = [&](uint32_t extent_start,
                                         uint32_t extent_end) {
+    // Any change of the ownership is done before writing to the EDRAM range.
+    InvalidateResolveCopyRecords(extent_start, extent_end);
     // The map contains consecutive ranges, merged if the adjacent ones are the
     // same. Find the range starting at >= the start. A portion of the range
     // preceding it may be intersecting the render target's range (or even fully
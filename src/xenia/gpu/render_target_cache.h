@@ -15,6 +15,7 @@
 #include <functional>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -26,6 +27,7 @@
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/registers.h"
 #include "xenia/gpu/shader.h"
+#include "xenia/gpu/shared_memory.h"
 #include "xenia/gpu/xenos.h"
 
 DECLARE_bool(depth_transfer_not_equal_test);
@@ -210,6 +212,9 @@ class RenderTargetCache {
   virtual void ClearCache();
 
   virtual void BeginFrame();
+  // Logs the statistics of the ownership transfers done during the frame if
+  // requested, and resets them.
+  void EndFrame();
 
   virtual bool Update(bool is_rasterization_done,
                       reg::RB_DEPTHCONTROL normalized_depth_control,
@@ -541,6 +546,13 @@ class RenderTargetCache {
   virtual bool IsHostDepthEncodingDifferent(
       xenos::DepthRenderTargetFormat format) const = 0;
 
+  // Destroys the render targets not owning any EDRAM data and not bound by the
+  // last update, for which can_destroy returns true. can_destroy is called
+  // right before deleting the render target, so the implementation may release
+  // its own objects referencing it there.
+  void DestroyRenderTargetsNotOwningEdram(
+      const std::function<bool(RenderTarget& render_target)>& can_destroy);
+
   void ResetAccumulatedRenderTargets() {
     are_accumulated_render_targets_valid_ = false;
   }
@@ -598,6 +610,18 @@ class RenderTargetCache {
       RenderTarget*& color_render_target_out,
       std::vector<Transfer>& color_transfers_out);
 
+  // Whether the copying part of the resolve can be skipped because exactly the
+  // same copy has been done before, and since then, neither the EDRAM tiles it
+  // reads (according to the ownership changes, which are done for every write
+  // to the EDRAM with host render targets) nor the destination memory have
+  // been modified. Only for host render targets.
+  bool IsResolveCopyUpToDate(const draw_util::ResolveInfo& resolve_info);
+  // To be called by the implementation after a resolve copy has been done and
+  // the destination range has been marked as written by the GPU, to remember it
+  // for IsResolveCopyUpToDate.
+  void ResolveCopyDone(const draw_util::ResolveInfo& resolve_info,
+                       SharedMemory& shared_memory);
+
   // For restoring EDRAM contents from frame traces, obtains or creates a render
   // target at base 0 with of 1280 (only 1 sample and color because copying
   // between MSAA render targets and buffers is not possible in Direct3D 12, and
@@ -608,6 +632,15 @@ class RenderTargetCache {
   RenderTarget* PrepareFullEdram1280xRenderTargetForSnapshotRestoration(
       xenos::ColorRenderTargetFormat color_format);
 
+  // To be called by the implementation after drawing the rectangles of one or
+  // multiple merged ownership transfers, for the statistics.
+  void CountTransferDraws(uint32_t draw_count, uint32_t transfer_count,
+                          uint32_t rectangle_count) {
+    frame_transfer_draw_count_ += draw_count;
+    frame_transfer_count_ += transfer_count;
+    frame_transfer_rectangle_count_ += rectangle_count;
+  }
+
   // For pixel shader interlock.
 
   virtual void RequestPixelShaderInterlockBarrier() {}
@@ -625,6 +658,10 @@ class RenderTargetCache {
 
   // For host render targets.
 
+  uint32_t frame_transfer_count_ = 0;
+  uint32_t frame_transfer_rectangle_count_ = 0;
+  uint32_t frame_transfer_draw_count_ = 0;
+
   struct OwnershipRange {
     uint32_t end_tiles;
     // Need to store keys, not pointers to render targets themselves, because
@@ -718,6 +755,10 @@ class RenderTargetCache {
   bool WouldOwnershipChangeRequireTransfers(RenderTargetKey dest,
                                             uint32_t start_tiles_base_relative,
                                             uint32_t length_tiles) const;
+  void GetRenderTargetsOwningEdram(
+      std::unordered_set<RenderTargetKey, RenderTargetKey::Hasher>& keys_out)
+      const;
+
   // Updates ownership_ranges_, adds the transfers needed for the ownership
   // change to transfers_append_out if it's not null.
   void ChangeOwnership(
@@ -738,11 +779,42 @@ class RenderTargetCache {
   // changes to this throughout a frame are pretty rare.
   std::map<uint32_t, OwnershipRange> ownership_ranges_;
 
+  // Recently done resolve copies, for skipping repeated ones if they have
+  // nothing new to copy.
+  struct ResolveCopyRecord {
+    draw_util::ResolveInfo resolve_info;
+    // EDRAM tiles read by the copy, the end may be in the next EDRAM
+    // addressing period.
+    uint32_t edram_start_tiles;
+    uint32_t edram_end_tiles;
+    // Whether none of the EDRAM tiles read have been modified since the copy.
+    // Only accessed by the command processor thread.
+    bool edram_up_to_date;
+    // Watch of the destination range, reset to nullptr (with the global
+    // critical region locked) when the destination is modified.
+    SharedMemory::WatchHandle dest_watch;
+  };
+  static constexpr uint32_t kResolveCopyRecordCount = 8;
+  ResolveCopyRecord resolve_copy_records_[kResolveCopyRecordCount] = {};
+  uint32_t resolve_copy_record_next_ = 0;
+  // Number of records with edram_up_to_date, to skip checking the records on
+  // every ownership change if there are none.
+  uint32_t resolve_copy_records_edram_up_to_date_ = 0;
+  SharedMemory* resolve_copy_shared_memory_ = nullptr;
+  xe::global_critical_region global_critical_region_;
+  static void ResolveCopyDestWatchCallback(
+      const std::unique_lock<std::recursive_mutex>& global_lock, void* context,
+      void* data, uint64_t argument, bool invalidated_by_gpu);
+  // Drops the records of the copies reading the EDRAM tiles in the range
+  // (within one EDRAM addressing period).
+  void InvalidateResolveCopyRecords(uint32_t start_tiles, uint32_t end_tiles);
+  void ClearResolveCopyRecords();
+
   // Render targets actually used by the draw call with the last successful
   // update. 0 is depth, color starting from 1, nullptr if not bound.
   // Only valid for non-pixel-shader-interlock paths.
   RenderTarget*
-      last_update_used_render_targets_[1 + xenos::kMaxColorRenderTargets];
+      last_update_used_render_targets_[1 + xenos::kMaxColorRenderTargets] = {};
   // Render targets used by the draw call with the last successful update or
   // previous updates, unless a different or a totally new one was bound (or
   // surface info was changed), to avoid unneeded render target switching (which
@@ -752,9 +824,8 @@ class RenderTargetCache {
   // whether it's safe to enable depth / stencil or writing to a specific color
   // render target in the pipeline for this draw call.
   // Only valid for non-pixel-shader-interlock paths.
-  RenderTarget*
-      last_update_accumulated_render_targets_[1 +
-                                              xenos::kMaxColorRenderTargets];
+  RenderTarget* last_update_accumulated_render_targets_
+      [1 + xenos::kMaxColorRenderTargets] = {};
   // Whether the color render targets (in bits 0...3) from the last successful
   // update have k_8_8_8_8_GAMMA format, for sRGB emulation on the host if
   // needed.
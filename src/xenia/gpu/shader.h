@@ -831,6 +831,12 @@ class Shader {
     // If there was some failure during preparation on the implementation side.
     void MakeInvalid() { is_valid_ = false; }
 
+    // For post-processing of the translated binary on the implementation side,
+    // such as optimization.
+    void set_translated_binary(std::vector<uint8_t> binary) {
+      translated_binary_ = std::move(binary);
+    }
+
    private:
     friend class Shader;
     friend class ShaderTranslator;
@@ -865,6 +871,16 @@ class Shader {
   // ucode_disasm_buffer is temporary storage for disassembly (provided
   // externally so it won't need to be reallocated for every shader).
   void AnalyzeUcode(StringBuffer& ucode_disasm_buffer);
+  // The results of AnalyzeUcode, except for the disassembly, can be stored
+  // along with the microcode in the shader storage, so the analysis is skipped
+  // for shaders loaded from it. The format is host-specific, and data written
+  // by a build with a different layout of the structures is rejected.
+  // Serialization must only be done after the analysis.
+  void SerializeUcodeAnalysis(std::vector<uint8_t>& out) const;
+  // Returns false if the data is invalid, in this case AnalyzeUcode must be
+  // called as usual. Also fails if shaders are being dumped, as that requires
+  // the disassembly.
+  bool DeserializeUcodeAnalysis(const uint8_t* data, size_t size);
 
   // The following parameters, until the translation, are valid if ucode
   // information has been gathered.
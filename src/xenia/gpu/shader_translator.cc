@@ -19,6 +19,7 @@
 #include "xenia/base/assert.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/gpu/gpu_flags.h"
 
 namespace xe {
@@ -333,6 +334,279 @@ void Shader::AnalyzeUcode(StringBuffer& ucode_disasm_buffer) {
   }
 }
 
+struct TextureFetchOpcodeInfo {
+  const char* name;
+  bool has_dest;
+  bool has_const;
+  bool has_attributes;
+  uint32_t override_component_count;
+};
+
+// Returns false if the opcode is unknown.
+static bool GetTextureFetchOpcodeInfo(FetchOpcode opcode,
+                                      xenos::FetchOpDimension dimension,
+                                      TextureFetchOpcodeInfo& info_out) {
+  switch (opcode) {
+    case FetchOpcode::kTextureFetch: {
+      static const char* kNames[] = {"tfetch1D", "tfetch2D", "tfetch3D",
+                                     "tfetchCube"};
+      info_out = {kNames[static_cast<int>(dimension)], true, true, true, 0};
+    } break;
+    case FetchOpcode::kGetTextureBorderColorFrac: {
+      static const char* kNames[] = {"getBCF1D", "getBCF2D", "getBCF3D",
+                                     "getBCFCube"};
+      info_out = {kNames[static_cast<int>(dimension)], true, true, true, 0};
+    } break;
+    case FetchOpcode::kGetTextureComputedLod: {
+      static const char* kNames[] = {"getCompTexLOD1D", "getCompTexLOD2D",
+                                     "getCompTexLOD3D", "getCompTexLODCube"};
+      info_out = {kNames[static_cast<int>(dimension)], true, true, true, 0};
+    } break;
+    case FetchOpcode::kGetTextureGradients:
+      info_out = {"getGradients", true, true, true, 2};
+      break;
+    case FetchOpcode::kGetTextureWeights: {
+      static const char* kNames[] = {"getWeights1D", "getWeights2D",
+                                     "getWeights3D", "getWeightsCube"};
+      info_out = {kNames[static_cast<int>(dimension)], true, true, true, 0};
+    } break;
+    case FetchOpcode::kSetTextureLod:
+      info_out = {"setTexLOD", false, false, false, 1};
+      break;
+    case FetchOpcode::kSetTextureGradientsHorz:
+      info_out = {"setGradientH", false, false, false, 3};
+      break;
+    case FetchOpcode::kSetTextureGradientsVert:
+      info_out = {"setGradientV", false, false, false, 3};
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+// Increase if anything serialized is changed in a way not detected by the
+// layout hash.
+static constexpr uint32_t kUcodeAnalysisSerializationVersion = 1;
+
+static uint64_t GetUcodeAnalysisLayoutHash() {
+  const uint64_t layout[] = {
+      kUcodeAnalysisSerializationVersion,
+      sizeof(ParsedVertexFetchInstruction),
+      sizeof(ParsedTextureFetchInstruction),
+      sizeof(Shader::ConstantRegisterMap),
+      sizeof(Shader::ControlFlowMemExportInfo),
+  };
+  return XXH3_64bits(layout, sizeof(layout));
+}
+
+void Shader::SerializeUcodeAnalysis(std::vector<uint8_t>& out) const {
+  assert_true(is_ucode_analyzed_);
+  // The layout hash and the content hash, written after everything else.
+  out.resize(sizeof(uint64_t) * 2);
+  auto append = [&out](const void* data, size_t size) {
+    const uint8_t* data_bytes = reinterpret_cast<const uint8_t*>(data);
+    out.insert(out.end(), data_bytes, data_bytes + size);
+  };
+  auto append_uint32 = [&append](uint32_t value) {
+    append(&value, sizeof(value));
+  };
+
+  append_uint32(cf_pair_index_bound_);
+  append_uint32(register_static_address_bound_);
+  append_uint32(writes_interpolators_);
+  append_uint32(writes_point_size_edge_flag_kill_vertex_);
+  append_uint32(writes_color_targets_);
+  append_uint32(uint32_t(uses_register_dynamic_addressing_) |
+                (uint32_t(kills_pixels_) << 1) |
+                (uint32_t(uses_texture_fetch_instruction_results_) << 2) |
+                (uint32_t(writes_depth_) << 3) |
+                (uint32_t(memexport_eM_written_) << 8) |
+                (uint32_t(memexport_eM_potentially_written_before_end_) << 16));
+  append(&constant_register_map_, sizeof(constant_register_map_));
+  append_uint32(uint32_t(label_addresses_.size()));
+  for (uint32_t label_address : label_addresses_) {
+    append_uint32(label_address);
+  }
+  append_uint32(uint32_t(memexport_stream_constants_.size()));
+  for (uint32_t memexport_stream_constant : memexport_stream_constants_) {
+    append_uint32(memexport_stream_constant);
+  }
+  append_uint32(uint32_t(cf_memexport_info_.size()));
+  append(cf_memexport_info_.data(),
+         sizeof(ControlFlowMemExportInfo) * cf_memexport_info_.size());
+  append_uint32(uint32_t(vertex_bindings_.size()));
+  for (const VertexBinding& vertex_binding : vertex_bindings_) {
+    append_uint32(uint32_t(vertex_binding.binding_index));
+    append_uint32(vertex_binding.fetch_constant);
+    append_uint32(vertex_binding.stride_words);
+    append_uint32(uint32_t(vertex_binding.attributes.size()));
+    for (const VertexBinding::Attribute& attribute :
+         vertex_binding.attributes) {
+      append(&attribute.fetch_instr, sizeof(attribute.fetch_instr));
+    }
+  }
+  append_uint32(uint32_t(texture_bindings_.size()));
+  for (const TextureBinding& texture_binding : texture_bindings_) {
+    append_uint32(uint32_t(texture_binding.binding_index));
+    append_uint32(texture_binding.fetch_constant);
+    append(&texture_binding.fetch_instr, sizeof(texture_binding.fetch_instr));
+  }
+
+  uint64_t hashes[2];
+  hashes[0] = GetUcodeAnalysisLayoutHash();
+  hashes[1] =
+      XXH3_64bits(out.data() + sizeof(hashes), out.size() - sizeof(hashes));
+  std::memcpy(out.data(), hashes, sizeof(hashes));
+}
+
+bool Shader::DeserializeUcodeAnalysis(const uint8_t* data, size_t size) {
+  if (is_ucode_analyzed_) {
+    return true;
+  }
+  if (!cvars::dump_shaders.empty()) {
+    return false;
+  }
+  uint64_t hashes[2];
+  if (size < sizeof(hashes)) {
+    return false;
+  }
+  std::memcpy(hashes, data, sizeof(hashes));
+  if (hashes[0] != GetUcodeAnalysisLayoutHash() ||
+      hashes[1] != XXH3_64bits(data + sizeof(hashes), size - sizeof(hashes))) {
+    return false;
+  }
+
+  size_t offset = sizeof(hashes);
+  auto read = [&](void* data_out, size_t read_size) {
+    if (size - offset < read_size) {
+      return false;
+    }
+    std::memcpy(data_out, data + offset, read_size);
+    offset += read_size;
+    return true;
+  };
+  // Counts are validated against the remaining size before allocating.
+  auto read_count = [&](uint32_t& count_out, size_t element_size) {
+    return read(&count_out, sizeof(count_out)) &&
+           (size - offset) / element_size >= count_out;
+  };
+  bool succeeded = [&]() {
+    uint32_t flags;
+    if (!read(&cf_pair_index_bound_, sizeof(cf_pair_index_bound_)) ||
+        !read(&register_static_address_bound_,
+              sizeof(register_static_address_bound_)) ||
+        !read(&writes_interpolators_, sizeof(writes_interpolators_)) ||
+        !read(&writes_point_size_edge_flag_kill_vertex_,
+              sizeof(writes_point_size_edge_flag_kill_vertex_)) ||
+        !read(&writes_color_targets_, sizeof(writes_color_targets_)) ||
+        !read(&flags, sizeof(flags)) ||
+        !read(&constant_register_map_, sizeof(constant_register_map_))) {
+      return false;
+    }
+    uses_register_dynamic_addressing_ = (flags & (1 << 0)) != 0;
+    kills_pixels_ = (flags & (1 << 1)) != 0;
+    uses_texture_fetch_instruction_results_ = (flags & (1 << 2)) != 0;
+    writes_depth_ = (flags & (1 << 3)) != 0;
+    memexport_eM_written_ = uint8_t(flags >> 8);
+    memexport_eM_potentially_written_before_end_ = uint8_t(flags >> 16);
+
+    uint32_t count;
+    if (!read_count(count, sizeof(uint32_t))) {
+      return false;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+      uint32_t label_address;
+      read(&label_address, sizeof(label_address));
+      label_addresses_.insert(label_address);
+    }
+    if (!read_count(count, sizeof(uint32_t))) {
+      return false;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+      uint32_t memexport_stream_constant;
+      read(&memexport_stream_constant, sizeof(memexport_stream_constant));
+      memexport_stream_constants_.insert(memexport_stream_constant);
+    }
+    if (!read_count(count, sizeof(ControlFlowMemExportInfo))) {
+      return false;
+    }
+    cf_memexport_info_.resize(count);
+    read(cf_memexport_info_.data(), sizeof(ControlFlowMemExportInfo) * count);
+
+    if (!read_count(count, sizeof(uint32_t) * 4)) {
+      return false;
+    }
+    vertex_bindings_.resize(count);
+    for (VertexBinding& vertex_binding : vertex_bindings_) {
+      uint32_t binding_index, attribute_count;
+      if (!read(&binding_index, sizeof(binding_index)) ||
+          !read(&vertex_binding.fetch_constant,
+                sizeof(vertex_binding.fetch_constant)) ||
+          !read(&vertex_binding.stride_words,
+                sizeof(vertex_binding.stride_words)) ||
+          !read_count(attribute_count, sizeof(ParsedVertexFetchInstruction))) {
+        return false;
+      }
+      vertex_binding.binding_index = int(binding_index);
+      vertex_binding.attributes.resize(attribute_count);
+      for (VertexBinding::Attribute& attribute : vertex_binding.attributes) {
+        ParsedVertexFetchInstruction& fetch_instr = attribute.fetch_instr;
+        read(&fetch_instr, sizeof(fetch_instr));
+        // Pointers to the static names can't be stored.
+        fetch_instr.opcode_name =
+            fetch_instr.is_mini_fetch ? "vfetch_mini" : "vfetch_full";
+      }
+    }
+
+    if (!read_count(count, sizeof(uint32_t) * 2 +
+                               sizeof(ParsedTextureFetchInstruction))) {
+      return false;
+    }
+    texture_bindings_.resize(count);
+    for (TextureBinding& texture_binding : texture_bindings_) {
+      uint32_t binding_index;
+      read(&binding_index, sizeof(binding_index));
+      texture_binding.binding_index = binding_index;
+      read(&texture_binding.fetch_constant,
+           sizeof(texture_binding.fetch_constant));
+      ParsedTextureFetchInstruction& fetch_instr = texture_binding.fetch_instr;
+      read(&fetch_instr, sizeof(fetch_instr));
+      TextureFetchOpcodeInfo opcode_info;
+      if (!GetTextureFetchOpcodeInfo(fetch_instr.opcode, fetch_instr.dimension,
+                                     opcode_info)) {
+        return false;
+      }
+      fetch_instr.opcode_name = opcode_info.name;
+    }
+    return offset == size;
+  }();
+
+  if (!succeeded) {
+    // Return to the initial state for AnalyzeUcode.
+    cf_pair_index_bound_ = 0;
+    register_static_address_bound_ = 0;
+    writes_interpolators_ = 0;
+    writes_point_size_edge_flag_kill_vertex_ = 0;
+    writes_color_targets_ = 0b0000;
+    uses_register_dynamic_addressing_ = false;
+    kills_pixels_ = false;
+    uses_texture_fetch_instruction_results_ = false;
+    writes_depth_ = false;
+    memexport_eM_written_ = 0;
+    memexport_eM_potentially_written_before_end_ = 0;
+    constant_register_map_ = {};
+    label_addresses_.clear();
+    memexport_stream_constants_.clear();
+    cf_memexport_info_.clear();
+    vertex_bindings_.clear();
+    texture_bindings_.clear();
+    return false;
+  }
+  is_ucode_analyzed_ = true;
+  return true;
+}
+
 uint32_t Shader::GetInterpolatorInputMask(reg::SQ_PROGRAM_CNTL sq_program_cntl,
                                           reg::SQ_CONTEXT_MISC sq_context_misc,
                                           uint32_t& param_gen_pos_out) const {
@@ -1060,53 +1334,10 @@ bool ParseVertexFetchInstruction(const VertexFetchInstruction& op,
 
 void ParseTextureFetchInstruction(const TextureFetchInstruction& op,
                                   ParsedTextureFetchInstruction& instr) {
-  struct TextureFetchOpcodeInfo {
-    const char* name;
-    bool has_dest;
-    bool has_const;
-    bool has_attributes;
-    uint32_t override_component_count;
-  } opcode_info;
-  switch (op.opcode()) {
-    case FetchOpcode::kTextureFetch: {
-      static const char* kNames[] = {"tfetch1D", "tfetch2D", "tfetch3D",
-                                     "tfetchCube"};
-      opcode_info = {kNames[static_cast<int>(op.dimension())], true, true, true,
-                     0};
-    } break;
-    case FetchOpcode::kGetTextureBorderColorFrac: {
-      static const char* kNames[] = {"getBCF1D", "getBCF2D", "getBCF3D",
-                                     "getBCFCube"};
-      opcode_info = {kNames[static_cast<int>(op.dimension())], true, true, true,
-                     0};
-    } break;
-    case FetchOpcode::kGetTextureComputedLod: {
-      static const char* kNames[] = {"getCompTexLOD1D", "getCompTexLOD2D",
-                                     "getCompTexLOD3D", "getCompTexLODCube"};
-      opcode_info = {kNames[static_cast<int>(op.dimension())], true, true, true,
-                     0};
-    } break;
-    case FetchOpcode::kGetTextureGradients:
-      opcode_info = {"getGradients", true, true, true, 2};
-      break;
-    case FetchOpcode::kGetTextureWeights: {
-      static const char* kNames[] = {"getWeights1D", "getWeights2D",
-                                     "getWeights3D", "getWeightsCube"};
-      opcode_info = {kNames[static_cast<int>(op.dimension())], true, true, true,
-                     0};
-    } break;
-    case FetchOpcode::kSetTextureLod:
-      opcode_info = {"setTexLOD", false, false, false, 1};
-      break;
-    case FetchOpcode::kSetTextureGradientsHorz:
-      opcode_info = {"setGradientH", false, false, false, 3};
-      break;
-    case FetchOpcode::kSetTextureGradientsVert:
-      opcode_info = {"setGradientV", false, false, false, 3};
-      break;
-    default:
-      assert_unhandled_case(fetch_opcode);
-      return;
+  TextureFetchOpcodeInfo opcode_info;
+  if (!GetTextureFetchOpcodeInfo(op.opcode(), op.dimension(), opcode_info)) {
+    assert_unhandled_case(op.opcode());
+    return;
   }
 
   instr.opcode = op.opcode();
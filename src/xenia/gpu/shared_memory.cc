@@ -14,11 +14,22 @@
 
 #include "xenia/base/assert.h"
 #include "xenia/base/bit_range.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/memory.h"
 
+DEFINE_bool(
+    shared_memory_skip_unchanged_uploads, true,
+    "Keep hashes of the data uploaded to each page of the GPU shared memory, "
+    "and skip reuploading pages that have been written by the CPU, but still "
+    "contain the same data (for instance, if lots of unmodified data is "
+    "copied over itself, or a page is spuriously invalidated due to a "
+    "modification of its neighbors).",
+    "GPU");
+
 namespace xe {
 namespace gpu {
 
@@ -32,6 +43,13 @@ void SharedMemory::InitializeCommon() {
   system_page_flags_.clear();
   system_page_flags_.resize(((kBufferSize >> page_size_log2_) + 63) / 64);
 
+  upload_page_hashes_.clear();
+  upload_page_hashes_known_.clear();
+  if (cvars::shared_memory_skip_unchanged_uploads) {
+    upload_page_hashes_.resize(kBufferSize >> page_size_log2_);
+    upload_page_hashes_known_.resize(system_page_flags_.size());
+  }
+
   memory_invalidation_callback_handle_ =
       memory_.RegisterPhysicalMemoryInvalidationCallback(
           MemoryInvalidationCallbackThunk, this);
@@ -84,6 +102,11 @@ void SharedMemory::ShutdownCommon() {
   host_gpu_memory_sparse_allocated_.clear();
   host_gpu_memory_sparse_allocated_.shrink_to_fit();
   host_gpu_memory_sparse_granularity_log2_ = UINT32_MAX;
+
+  upload_page_hashes_.clear();
+  upload_page_hashes_.shrink_to_fit();
+  upload_page_hashes_known_.clear();
+  upload_page_hashes_known_.shrink_to_fit();
 }
 
 void SharedMemory::ClearCache() {
@@ -310,6 +333,10 @@ void SharedMemory::MakeRangeValid(uint32_t start, uint32_t length,
       } else {
         block.valid_and_gpu_resolved &= ~valid_bits;
       }
+      // The data from the latest upload is not in the buffer anymore.
+      if (written_by_gpu && !upload_page_hashes_known_.empty()) {
+        upload_page_hashes_known_[i] &= ~valid_bits;
+      }
     }
   }
 
@@ -432,9 +459,135 @@ bool SharedMemory::RequestRange(uint32_t start, uint32_t length,
     return true;
   }
 
+  if (!upload_page_hashes_.empty() && !AreUploadsTraced()) {
+    SkipUnchangedUploadPages();
+    if (upload_ranges_.empty()) {
+      return true;
+    }
+  }
+  MergeUploadRanges();
+
   return UploadRanges(upload_ranges_);
 }
 
+void SharedMemory::SkipUnchangedUploadPages() {
+  upload_ranges_changed_.clear();
+  auto add_changed_pages = [this](uint32_t page_first, uint32_t page_count) {
+    if (!upload_ranges_changed_.empty()) {
+      std::pair<uint32_t, uint32_t>& last_range = upload_ranges_changed_.back();
+      if (last_range.first + last_range.second == page_first) {
+        last_range.second += page_count;
+        return;
+      }
+    }
+    upload_ranges_changed_.emplace_back(page_first, page_count);
+  };
+  auto is_hash_known = [this](uint32_t page) {
+    return bool((upload_page_hashes_known_[page >> 6] >> (page & 63)) & 1);
+  };
+  uint32_t page_size = uint32_t(1) << page_size_log2_;
+  for (const std::pair<uint32_t, uint32_t>& upload_range : upload_ranges_) {
+    uint32_t range_end = upload_range.first + upload_range.second;
+    uint32_t page = upload_range.first;
+    while (page < range_end) {
+      bool hash_known = is_hash_known(page);
+      uint32_t run_end = page + 1;
+      while (run_end < range_end && is_hash_known(run_end) == hash_known) {
+        ++run_end;
+      }
+      if (!hash_known) {
+        add_changed_pages(page, run_end - page);
+        page = run_end;
+        continue;
+      }
+      // Make the pages valid (and protect them) before reading the data, so a
+      // CPU write during the comparison invalidates them again rather than
+      // being missed.
+      MakeRangeValid(page << page_size_log2_,
+                     (run_end - page) << page_size_log2_, false, false);
+      for (; page < run_end; ++page) {
+        if (XXH3_64bits(memory_.TranslatePhysical(page << page_size_log2_),
+                        page_size) != upload_page_hashes_[page]) {
+          add_changed_pages(page, 1);
+        }
+      }
+    }
+  }
+  upload_ranges_.swap(upload_ranges_changed_);
+}
+
+void SharedMemory::MergeUploadRanges() {
+  if (upload_ranges_.size() < 2) {
+    return;
+  }
+  auto global_lock = global_critical_region_.Acquire();
+  size_t merged_count = 1;
+  for (size_t i = 1; i < upload_ranges_.size(); ++i) {
+    std::pair<uint32_t, uint32_t>& merged_range =
+        upload_ranges_[merged_count - 1];
+    const std::pair<uint32_t, uint32_t>& range = upload_ranges_[i];
+    uint32_t gap_first = merged_range.first + merged_range.second;
+    uint32_t gap_count = range.first - gap_first;
+    // The pages in the gap are valid, so reuploading them is safe, unless the
+    // GPU has written data to them that the guest memory doesn't have.
+    bool merge = gap_count <= kUploadRangeMaxMergedGapPages;
+    for (uint32_t j = 0; merge && j < gap_count; ++j) {
+      uint32_t gap_page = gap_first + j;
+      if (system_page_flags_[gap_page >> 6].valid_and_gpu_written &
+          (uint64_t(1) << (gap_page & 63))) {
+        merge = false;
+      }
+    }
+    if (merge) {
+      merged_range.second = range.first + range.second - merged_range.first;
+    } else {
+      upload_ranges_[merged_count++] = range;
+    }
+  }
+  upload_ranges_.resize(merged_count);
+}
+
+void SharedMemory::StoreUploadedPageHashes(uint32_t page_first,
+                                           uint32_t page_count,
+                                           const void* data) {
+  if (upload_page_hashes_.empty()) {
+    return;
+  }
+  uint32_t page_size = uint32_t(1) << page_size_log2_;
+  const uint8_t* page_data = reinterpret_cast<const uint8_t*>(data);
+  for (uint32_t i = 0; i < page_count; ++i) {
+    uint32_t page = page_first + i;
+    upload_page_hashes_[page] = XXH3_64bits(page_data, page_size);
+    upload_page_hashes_known_[page >> 6] |= uint64_t(1) << (page & 63);
+    page_data += page_size;
+  }
+}
+
+bool SharedMemory::IsRangeGpuWritten(uint32_t start, uint32_t length) {
+  if (!length || start >= kBufferSize) {
+    return false;
+  }
+  length = std::min(length, kBufferSize - start);
+  uint32_t page_first = start >> page_size_log2_;
+  uint32_t page_last = (start + length - 1) >> page_size_log2_;
+  uint32_t block_first = page_first >> 6;
+  uint32_t block_last = page_last >> 6;
+  auto global_lock = global_critical_region_.Acquire();
+  for (uint32_t i = block_first; i <= block_last; ++i) {
+    uint64_t block_gpu_written = system_page_flags_[i].valid_and_gpu_written;
+    if (i == block_first) {
+      block_gpu_written &= ~((uint64_t(1) << (page_first & 63)) - 1);
+    }
+    if (i == block_last && (page_last & 63) != 63) {
+      block_gpu_written &= (uint64_t(1) << ((page_last & 63) + 1)) - 1;
+    }
+    if (block_gpu_written) {
+      return true;
+    }
+  }
+  return false;
+}
+
 std::pair<uint32_t, uint32_t> SharedMemory::MemoryInvalidationCallbackThunk(
     void* context_ptr, uint32_t physical_address_start, uint32_t length,
     bool exact_range) {
@@ -33,6 +33,8 @@ class SharedMemory {
   // Call in the implementation-specific ClearCache.
   virtual void ClearCache();
 
+  Memory& memory() const { return memory_; }
+
   typedef void (*GlobalWatchCallback)(
       const std::unique_lock<std::recursive_mutex>& global_lock, void* context,
       uint32_t address_first, uint32_t address_last, bool invalidated_by_gpu);
@@ -79,6 +81,10 @@ class SharedMemory {
   bool RequestRange(uint32_t start, uint32_t length,
                     bool* any_data_resolved_out = nullptr);
 
+  // Checks if any page in the range contains data written on the GPU (by
+  // resolves or memexport) that the guest memory may not have yet.
+  bool IsRangeGpuWritten(uint32_t start, uint32_t length);
+
   // Marks the range and, if not exact_range, potentially its surroundings
   // (to up to the first GPU-written page, as an access violation exception
   // count optimization) as modified by the CPU, also invalidating GPU-written
@@ -110,8 +116,6 @@ class SharedMemory {
   static constexpr uint32_t kHostGpuMemoryOptimalSparseAllocationLog2 = 22;
   static_assert(kHostGpuMemoryOptimalSparseAllocationLog2 <= kBufferSizeLog2);
 
-  Memory& memory() const { return memory_; }
-
   uint32_t page_size_log2() const { return page_size_log2_; }
 
   uint32_t host_gpu_memory_sparse_granularity_log2() const {
@@ -140,6 +144,13 @@ class SharedMemory {
   // overall bounds of pages to be uploaded.
   virtual bool UploadRanges(
       const std::vector<std::pair<uint32_t, uint32_t>>& upload_page_ranges) = 0;
+  // To be called by UploadRanges with the data copied to the upload buffer for
+  // the pages, so spurious invalidations of them can be detected later.
+  void StoreUploadedPageHashes(uint32_t page_first, uint32_t page_count,
+                               const void* data);
+  // Whether the data of every upload must be given to UploadRanges even if it's
+  // already in the buffer, for recording to a trace.
+  virtual bool AreUploadsTraced() const { return false; }
 
   const std::vector<std::pair<uint32_t, uint32_t>>& trace_download_ranges() {
     return trace_download_ranges_;
@@ -177,6 +188,21 @@ class SharedMemory {
   // Ranges that need to be uploaded, generated by GetRangesToUpload (a
   // persistently allocated vector).
   std::vector<std::pair<uint32_t, uint32_t>> upload_ranges_;
+  std::vector<std::pair<uint32_t, uint32_t>> upload_ranges_changed_;
+
+  // Ranges separated by no more than this number of valid pages not written
+  // by the GPU are uploaded as one, as that's cheaper than separate copies.
+  static constexpr uint32_t kUploadRangeMaxMergedGapPages = 4;
+  // Removes pages invalidated by the CPU, but still containing the same data
+  // as in the latest upload, from upload_ranges_, making them valid.
+  void SkipUnchangedUploadPages();
+  void MergeUploadRanges();
+
+  // Hashes of the data of each page as of its latest upload, valid only if
+  // the page hasn't been written by the GPU since then (only accessed by the
+  // command processor thread, not by the guest). Empty if not used.
+  std::vector<uint64_t> upload_page_hashes_;
+  std::vector<uint64_t> upload_page_hashes_known_;
 
   // GPU-written memory downloading for traces. <Start address, length>.
   std::vector<std::pair<uint32_t, uint32_t>> trace_download_ranges_;
@@ -141,6 +141,9 @@ class SpirvShaderTranslator : public ShaderTranslator {
     // because the same system constants may be used for the memexporting
     // compute shader and the vertex shader for the same draw, but
     // kSysFlag_VertexIndexLoad may be not needed.
+    // For kVertex, whether the host index buffer is a built-in one for
+    // primitive type conversion, containing the positions of the vertices in
+    // the guest index buffer rather than the guest indices themselves.
     kSysFlag_ComputeOrPrimitiveVertexIndexLoad =
         1u << kSysFlag_ComputeOrPrimitiveVertexIndexLoad_Shift,
     kSysFlag_ComputeOrPrimitiveVertexIndexLoad32Bit =
@@ -606,6 +609,10 @@ class SpirvShaderTranslator : public ShaderTranslator {
   // Perform endian swap of a uint4 vector.
   spv::Id EndianSwap128Uint4(spv::Id value, spv::Id endian);
 
+  // Loads the guest vertex index at the index in the guest index buffer at
+  // kSystemConstantVertexIndexLoadAddress, 16-bit or 32-bit depending on
+  // kSysFlag_ComputeOrPrimitiveVertexIndexLoad32Bit, without endian swapping.
+  spv::Id LoadVertexIndexFromSharedMemory(spv::Id index_in_buffer);
   spv::Id LoadUint32FromSharedMemory(spv::Id address_dwords_int);
   // If `replace_mask` is provided, the bits specified in the mask will be
   // replaced with those from the value via OpAtomicAnd/Or.
@@ -726,6 +733,9 @@ class SpirvShaderTranslator : public ShaderTranslator {
   bool is_depth_only_fragment_shader_ = false;
 
   std::unique_ptr<SpirvBuilder> builder_;
+  // Words of the module being serialized, kept across translations so the
+  // storage grown for earlier shaders is reused.
+  std::vector<unsigned int> module_uints_;
 
   std::vector<spv::Id> id_vector_temp_;
   // For helper functions like operand loading, so they don't conflict with
@@ -16,9 +16,11 @@
 #include "xenia/base/assert.h"
 #include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/frame_breakdown.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/gpu/gpu_flags.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/texture_info.h"
@@ -59,6 +61,31 @@ DEFINE_uint32(
     "Maximum host texture memory usage (in megabytes) above which textures "
     "will be destroyed as soon as possible.",
     "GPU");
+DEFINE_uint32(
+    texture_cache_memory_limit_device_budget, 90,
+    "Percentage of the video memory budget given to the emulator by the host "
+    "OS and driver (if available, via DXGI or VK_EXT_memory_budget) above "
+    "which texture memory usage is treated as exceeding "
+    "texture_cache_memory_limit_hard, so textures are destroyed early rather "
+    "than making the driver page video memory out. 0 to use only the fixed "
+    "limits.",
+    "GPU");
+DEFINE_bool(
+    texture_cache_content_hash, false,
+    "Hash the guest data of textures loaded from the CPU-written memory, and "
+    "if a texture with the same format, size and contents already exists at a "
+    "different address, copy its host data instead of decoding the guest data "
+    "again. Helps games streaming the same textures to different places, but "
+    "hashing takes CPU time for every texture load.",
+    "GPU");
+DEFINE_bool(
+    texture_cache_skip_unchanged_reloads, false,
+    "Hash the guest data of the base level and of the mips of textures loaded "
+    "from the CPU-written memory, and when the CPU writes to a page containing "
+    "them, only load them again if the bytes of the texture have actually "
+    "changed. Avoids reloading textures sharing pages with other resources "
+    "that the CPU updates, at the cost of hashing on every invalidation.",
+    "GPU");
 DEFINE_uint32(
     texture_cache_memory_limit_render_to_texture, 24,
     "Part of the host texture memory budget (in megabytes) that will be scaled "
@@ -69,6 +96,13 @@ DEFINE_uint32(
     "textures - so with 2x2 resolution scaling, the soft limit will be 360 + "
     "96 MB, and with 3x3, it will be 360 + 216 MB.",
     "GPU");
+DEFINE_path(
+    texture_replacement_pack, "",
+    "Path to a texture replacement pack with images, in formats the host GPU "
+    "can sample directly, replacing guest textures with the same content hash. "
+    "The images are read from the pack in the background, and the original "
+    "textures are displayed until they're ready.",
+    "GPU");
 
 namespace xe {
 namespace gpu {
@@ -171,6 +205,11 @@ TextureCache::TextureCache(const RegisterFile& register_file,
     scaled_resolve_global_watch_handle_ = shared_memory.RegisterGlobalWatch(
         ScaledResolveGlobalWatchCallbackThunk, this);
   }
+
+  if (!cvars::texture_replacement_pack.empty()) {
+    replacement_pack_ =
+        TextureReplacementPack::Open(cvars::texture_replacement_pack);
+  }
 }
 
 TextureCache::~TextureCache() {
@@ -196,6 +235,34 @@ bool TextureCache::GetConfigDrawResolutionScale(uint32_t& x_out,
 
 void TextureCache::ClearCache() { DestroyAllTextures(); }
 
+void TextureCache::ProcessTextureReplacements() {
+  for (size_t i = 0; i < textures_awaiting_replacement_.size();) {
+    Texture& texture = *textures_awaiting_replacement_[i];
+    // The guest data may have been reloaded with different contents since.
+    if (texture.has_content_hash() &&
+        replacement_pack_->Contains(texture.content_hash())) {
+      const TextureReplacementPack::Image* image =
+          replacement_pack_->Request(texture.content_hash());
+      if (!image) {
+        ++i;
+        continue;
+      }
+      if (ReplaceTextureDataImpl(texture, *image)) {
+        texture.SetReplaced(true);
+        texture.LogAction("Replaced");
+      } else {
+        XELOGW(
+            "Failed to replace the texture with the content hash {:016X} with "
+            "a {}x{} image",
+            texture.content_hash(), image->width, image->height);
+      }
+    }
+    texture.SetAwaitingReplacement(false);
+    textures_awaiting_replacement_[i] = textures_awaiting_replacement_.back();
+    textures_awaiting_replacement_.pop_back();
+  }
+}
+
 void TextureCache::CompletedSubmissionUpdated(
     uint64_t completed_submission_index) {
   // If memory usage is too high, destroy unused textures.
@@ -210,6 +277,30 @@ void TextureCache::CompletedSubmissionUpdated(
       cvars::texture_cache_memory_limit_soft + limit_scaled_resolve_add_mb;
   uint32_t limit_hard_mb =
       cvars::texture_cache_memory_limit_hard + limit_scaled_resolve_add_mb;
+  // The fixed limits may be too high for the host GPU, especially with
+  // resolution scaling, and the budget also changes with what other
+  // applications are doing, so limit the textures to what's left in the
+  // budget after the other allocations made by the process.
+  if (cvars::texture_cache_memory_limit_device_budget) {
+    uint64_t device_budget, device_usage;
+    if (GetHostMemoryBudget(device_budget, device_usage)) {
+      uint64_t device_budget_limit =
+          device_budget / 100 *
+          std::min(cvars::texture_cache_memory_limit_device_budget,
+                   uint32_t(100));
+      uint64_t non_texture_usage =
+          device_usage -
+          std::min(device_usage, textures_total_host_memory_usage_);
+      uint64_t limit_budget_mb =
+          (device_budget_limit -
+           std::min(device_budget_limit, non_texture_usage)) >>
+          20;
+      if (limit_budget_mb < limit_hard_mb) {
+        limit_hard_mb = uint32_t(limit_budget_mb);
+        limit_soft_mb = std::min(limit_soft_mb, limit_hard_mb);
+      }
+    }
+  }
   uint32_t limit_soft_lifetime =
       cvars::texture_cache_memory_limit_soft_lifetime * 1000;
   bool destroyed_any = false;
@@ -258,6 +349,11 @@ void TextureCache::BeginSubmission(uint64_t new_submission_index) {
 }
 
 void TextureCache::BeginFrame() {
+  // Before resetting the bindings, as replacing may recreate host textures.
+  if (!textures_awaiting_replacement_.empty()) {
+    ProcessTextureReplacements();
+  }
+
   // In case there was a failure to create something in the previous frame, make
   // sure bindings are reset so a new attempt will surely be made if the texture
   // is requested again.
@@ -296,6 +392,25 @@ void TextureCache::MarkRangeAsResolved(uint32_t start_unscaled,
   shared_memory().RangeWrittenByGpu(start_unscaled, length_unscaled, true);
 }
 
+uint64_t TextureCache::GetScaledResolveUsedBytes() {
+  if (!IsDrawResolutionScaled()) {
+    return 0;
+  }
+  uint64_t page_count = 0;
+  auto global_lock = global_critical_region_.Acquire();
+  for (uint32_t i = 0; i < uint32_t(xe::countof(scaled_resolve_pages_l2_));
+       ++i) {
+    uint64_t l2_block = scaled_resolve_pages_l2_[i];
+    uint32_t l2_bit;
+    while (xe::bit_scan_forward(l2_block, &l2_bit)) {
+      l2_block &= ~(UINT64_C(1) << l2_bit);
+      page_count += xe::bit_count(scaled_resolve_pages_[(i << 6) + l2_bit]);
+    }
+  }
+  return page_count * 4096 * draw_resolution_scale_x() *
+         draw_resolution_scale_y();
+}
+
 uint32_t TextureCache::GuestToHostSwizzle(uint32_t guest_swizzle,
                                           uint32_t host_format_swizzle) {
   uint32_t host_swizzle = 0;
@@ -325,7 +440,9 @@ void TextureCache::RequestTextures(uint32_t used_texture_mask) {
     ResetTextureBindings();
   }
 
-  // Update the texture keys and the textures.
+  // Update the texture keys and the textures, gathering the textures that need
+  // to be loaded to load all of them at once.
+  texture_data_loads_.clear();
   uint32_t bindings_changed = 0;
   uint32_t textures_remaining = used_texture_mask & ~texture_bindings_in_sync_;
   uint32_t index = 0;
@@ -402,17 +519,83 @@ void TextureCache::RequestTextures(uint32_t used_texture_mask) {
       binding.texture_signed = nullptr;
     }
     if (load_unsigned_data && binding.texture != nullptr) {
-      LoadTextureData(*binding.texture);
+      AddTextureDataLoad(*binding.texture);
     }
     if (load_signed_data && binding.texture_signed != nullptr) {
-      LoadTextureData(*binding.texture_signed);
+      AddTextureDataLoad(*binding.texture_signed);
     }
   }
+  if (!texture_data_loads_.empty()) {
+    LoadTexturesData(texture_data_loads_.data(), texture_data_loads_.size());
+    for (const TextureDataLoad& load : texture_data_loads_) {
+      if (load.loaded) {
+        CompleteTextureDataLoad(load);
+      }
+    }
+    texture_data_loads_.clear();
+  }
   if (bindings_changed) {
     UpdateTextureBindingsImpl(bindings_changed);
   }
 }
 
+void TextureCache::AddTextureDataLoad(Texture& texture) {
+  // The same texture may be bound to multiple fetch constants.
+  for (const TextureDataLoad& load : texture_data_loads_) {
+    if (load.texture == &texture) {
+      return;
+    }
+  }
+  TextureDataLoad load;
+  if (!PrepareTextureDataLoad(texture, load) ||
+      (!load.load_base && !load.load_mips)) {
+    return;
+  }
+  texture_data_loads_.push_back(load);
+}
+
+void TextureCache::LoadTexturesData(TextureDataLoad* loads,
+                                    size_t load_count) {
+  // Move the loads satisfied by copying to the end, and load the rest from the
+  // guest memory.
+  size_t guest_load_count = load_count;
+  for (size_t i = 0; i < guest_load_count;) {
+    TextureDataLoad& load = loads[i];
+    if (cvars::texture_cache_content_hash && load.has_content_hash) {
+      auto source_it = textures_by_content_hash_.find(load.content_hash);
+      if (source_it != textures_by_content_hash_.end()) {
+        Texture& source = *source_it->second;
+        assert_true(&source != load.texture);
+        bool source_up_to_date;
+        {
+          auto global_lock = global_critical_region_.Acquire();
+          source_up_to_date = !source.base_outdated(global_lock) &&
+                              !source.mips_outdated(global_lock);
+        }
+        TextureKey source_key = source.key();
+        TextureKey dest_key = load.texture->key();
+        source_key.base_page = 0;
+        source_key.mip_page = 0;
+        dest_key.base_page = 0;
+        dest_key.mip_page = 0;
+        if (source_up_to_date && source.has_content_hash() &&
+            source.content_hash() == load.content_hash &&
+            source_key == dest_key &&
+            CopyTextureDataImpl(*load.texture, source)) {
+          load.loaded = true;
+          std::swap(load, loads[--guest_load_count]);
+          continue;
+        }
+      }
+    }
+    ++i;
+  }
+  if (guest_load_count) {
+    texture_loads_ += guest_load_count;
+    LoadTexturesDataFromResidentMemoryImpl(loads, guest_load_count);
+  }
+}
+
 const char* TextureCache::TextureKey::GetLogDimensionName(
     xenos::DataDimension dimension) {
   switch (dimension) {
@@ -484,6 +667,16 @@ TextureCache::Texture::Texture(TextureCache& texture_cache,
 }
 
 TextureCache::Texture::~Texture() {
+  SetContentHash(false, 0);
+
+  if (awaiting_replacement_) {
+    auto& textures_awaiting_replacement =
+        texture_cache_.textures_awaiting_replacement_;
+    textures_awaiting_replacement.erase(
+        std::find(textures_awaiting_replacement.begin(),
+                  textures_awaiting_replacement.end(), this));
+  }
+
   if (mips_watch_handle_) {
     texture_cache().shared_memory().UnwatchMemoryRange(mips_watch_handle_);
   }
@@ -505,6 +698,24 @@ TextureCache::Texture::~Texture() {
   texture_cache_.UpdateTexturesTotalHostMemoryUsage(0, host_memory_usage_);
 }
 
+void TextureCache::Texture::SetContentHash(bool has_content_hash,
+                                           uint64_t content_hash) {
+  auto& textures_by_content_hash = texture_cache_.textures_by_content_hash_;
+  if (has_content_hash_ &&
+      (!has_content_hash || content_hash_ != content_hash)) {
+    auto content_hash_it = textures_by_content_hash.find(content_hash_);
+    if (content_hash_it != textures_by_content_hash.end() &&
+        content_hash_it->second == this) {
+      textures_by_content_hash.erase(content_hash_it);
+    }
+  }
+  has_content_hash_ = has_content_hash;
+  content_hash_ = content_hash;
+  if (has_content_hash) {
+    textures_by_content_hash[content_hash] = this;
+  }
+}
+
 void TextureCache::Texture::MakeUpToDateAndWatch(
     const std::unique_lock<std::recursive_mutex>& global_lock) {
   SharedMemory& shared_memory = texture_cache().shared_memory();
@@ -636,12 +847,38 @@ TextureCache::Texture* TextureCache::FindOrCreateTexture(TextureKey key) {
     texture =
         textures_.emplace(key, std::move(new_texture)).first->second.get();
   }
+  ++textures_created_;
   COUNT_profile_set("gpu/texture_cache/textures", textures_.size());
   texture->LogAction("Created");
   return texture;
 }
 
 bool TextureCache::LoadTextureData(Texture& texture) {
+  frame_breakdown::ScopedTimer frame_breakdown_timer(
+      frame_breakdown::Category::kTextureLoad);
+  TextureDataLoad load;
+  if (!PrepareTextureDataLoad(texture, load)) {
+    return false;
+  }
+  if (!load.load_base && !load.load_mips) {
+    return true;
+  }
+  LoadTexturesData(&load, 1);
+  if (!load.loaded) {
+    return false;
+  }
+  CompleteTextureDataLoad(load);
+  return true;
+}
+
+bool TextureCache::PrepareTextureDataLoad(Texture& texture,
+                                          TextureDataLoad& load_out) {
+  load_out.texture = &texture;
+  load_out.has_base_data_hash = false;
+  load_out.has_mips_data_hash = false;
+  load_out.has_content_hash = false;
+  load_out.loaded = false;
+
   // Check what needs to be uploaded.
   bool base_outdated, mips_outdated;
   {
@@ -649,6 +886,8 @@ bool TextureCache::LoadTextureData(Texture& texture) {
     base_outdated = texture.base_outdated(global_lock);
     mips_outdated = texture.mips_outdated(global_lock);
   }
+  load_out.load_base = base_outdated;
+  load_out.load_mips = mips_outdated;
   if (!base_outdated && !mips_outdated) {
     return true;
   }
@@ -702,18 +941,96 @@ bool TextureCache::LoadTextureData(Texture& texture) {
     }
   }
 
-  // Actually load the texture data.
-  if (!LoadTextureDataFromResidentMemoryImpl(texture, base_outdated,
-                                             mips_outdated)) {
-    return false;
+  load_out.base_resolved = base_resolved;
+  load_out.mips_resolved = mips_resolved;
+
+  uint32_t base_size = texture.GetGuestBaseSize();
+  uint32_t mips_size = texture.GetGuestMipsSize();
+
+  // The pages are invalidated as a whole, so a write to another resource in a
+  // page shared with the texture makes it outdated too. Not loading the parts
+  // whose bytes are still the same as when they were loaded.
+  if (cvars::texture_cache_skip_unchanged_reloads &&
+      !texture_key.scaled_resolve) {
+    const Memory& memory = shared_memory().memory();
+    if (base_outdated && !base_resolved &&
+        !shared_memory().IsRangeGpuWritten(texture_key.base_page << 12,
+                                           base_size)) {
+      load_out.has_base_data_hash = true;
+      load_out.base_data_hash = XXH3_64bits(
+          memory.TranslatePhysical(texture_key.base_page << 12), base_size);
+      if (texture.has_base_data_hash() &&
+          texture.base_data_hash() == load_out.base_data_hash) {
+        load_out.load_base = false;
+      }
+    }
+    if (mips_outdated && !mips_resolved &&
+        !shared_memory().IsRangeGpuWritten(texture_key.mip_page << 12,
+                                           mips_size)) {
+      load_out.has_mips_data_hash = true;
+      load_out.mips_data_hash = XXH3_64bits(
+          memory.TranslatePhysical(texture_key.mip_page << 12), mips_size);
+      if (texture.has_mips_data_hash() &&
+          texture.mips_data_hash() == load_out.mips_data_hash) {
+        load_out.load_mips = false;
+      }
+    }
+    if (!load_out.load_base && !load_out.load_mips) {
+      // Watching the memory again, with the host data kept as it is.
+      texture.MakeUpToDateAndWatch(global_critical_region_.Acquire());
+      ++texture_reloads_skipped_;
+      texture.LogAction("Kept unchanged");
+      return true;
+    }
+  }
+
+  // Only hash when all the data is reloaded, and it's in the guest memory -
+  // not in the scaled resolve buffer or written by the GPU, which the guest
+  // memory may not contain yet.
+  // The hash is also the key of the images in the texture replacement pack.
+  if ((cvars::texture_cache_content_hash || replacement_pack_) &&
+      !texture_key.scaled_resolve &&
+      (base_outdated || !base_size) && (mips_outdated || !mips_size) &&
+      !base_resolved && !mips_resolved &&
+      !shared_memory().IsRangeGpuWritten(texture_key.base_page << 12,
+                                         base_size) &&
+      !shared_memory().IsRangeGpuWritten(texture_key.mip_page << 12,
+                                         mips_size)) {
+    SCOPE_profile_cpu_i("gpu", "xe::gpu::TextureCache::HashTextureData");
+    const Memory& memory = shared_memory().memory();
+    // Textures with the same data, but with different formats or sizes, must
+    // not be treated as the same.
+    TextureKey hash_key = texture_key;
+    hash_key.base_page = 0;
+    hash_key.mip_page = 0;
+    XXH3_state_t hash_state;
+    XXH3_64bits_reset(&hash_state);
+    XXH3_64bits_update(&hash_state, &hash_key, sizeof(hash_key));
+    if (base_size) {
+      XXH3_64bits_update(&hash_state,
+                         memory.TranslatePhysical(texture_key.base_page << 12),
+                         base_size);
+    }
+    if (mips_size) {
+      XXH3_64bits_update(&hash_state,
+                         memory.TranslatePhysical(texture_key.mip_page << 12),
+                         mips_size);
+    }
+    load_out.has_content_hash = true;
+    load_out.content_hash = XXH3_64bits_digest(&hash_state);
   }
+  return true;
+}
+
+void TextureCache::CompleteTextureDataLoad(const TextureDataLoad& load) {
+  Texture& texture = *load.texture;
 
   // Update the source of the texture (resolve vs. CPU or memexport) for
   // purposes of handling piecewise gamma emulation via sRGB and for resolution
   // scale in sampling offsets.
-  if (!texture_key.scaled_resolve) {
-    texture.SetBaseResolved(base_resolved);
-    texture.SetMipsResolved(mips_resolved);
+  if (!texture.key().scaled_resolve) {
+    texture.SetBaseResolved(load.base_resolved);
+    texture.SetMipsResolved(load.mips_resolved);
   }
 
   // Mark the ranges as uploaded and watch them. This is needed for scaled
@@ -722,9 +1039,41 @@ bool TextureCache::LoadTextureData(Texture& texture) {
   // not up to date anymore.
   texture.MakeUpToDateAndWatch(global_critical_region_.Acquire());
 
+  // Only the parts that have been loaded are known to match the new hashes,
+  // the others are still the same as before.
+  if (load.load_base) {
+    texture.SetBaseDataHash(load.has_base_data_hash,
+                            load.has_base_data_hash ? load.base_data_hash : 0);
+  }
+  if (load.load_mips) {
+    texture.SetMipsDataHash(load.has_mips_data_hash,
+                            load.has_mips_data_hash ? load.mips_data_hash : 0);
+  }
+
+  // Make the texture the source for copying to textures with the same contents
+  // loaded later, or stop using it as one if its data isn't known to match the
+  // hash anymore.
+  texture.SetContentHash(load.has_content_hash,
+                         load.has_content_hash ? load.content_hash : 0);
+
   texture.LogAction("Loaded");
 
-  return true;
+  // The guest data has overwritten the replacement if there was one. Start
+  // streaming the replacement image in if there's one for the new data.
+  texture.SetReplaced(false);
+  if (replacement_pack_ && !IsTextureReplacementSupported()) {
+    XELOGW(
+        "Texture replacement is not supported by the GPU backend, not using "
+        "the texture replacement pack");
+    replacement_pack_.reset();
+  }
+  if (replacement_pack_ && load.has_content_hash &&
+      !texture.awaiting_replacement() &&
+      replacement_pack_->Contains(load.content_hash)) {
+    replacement_pack_->Request(load.content_hash);
+    texture.SetAwaitingReplacement(true);
+    textures_awaiting_replacement_.push_back(&texture);
+  }
 }
 
 void TextureCache::BindingInfoFromFetchConstant(
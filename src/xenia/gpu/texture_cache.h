@@ -16,12 +16,14 @@
 #include <cstring>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/hash.h"
 #include "xenia/base/mutex.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/shared_memory.h"
+#include "xenia/gpu/texture_replacement_pack.h"
 #include "xenia/gpu/texture_util.h"
 #include "xenia/gpu/xenos.h"
 
@@ -83,6 +85,20 @@ class TextureCache {
 
   virtual void ClearCache();
 
+  // Cumulative counts since the creation of the cache, not reset by
+  // ClearCache, for benchmarking.
+  uint64_t textures_created() const { return textures_created_; }
+  // Loads from the guest memory, not including copies from textures with the
+  // same contents.
+  uint64_t texture_loads() const { return texture_loads_; }
+  // Outdated textures not loaded again with
+  // texture_cache_skip_unchanged_reloads as their data hasn't changed.
+  uint64_t texture_reloads_skipped() const { return texture_reloads_skipped_; }
+  // Host memory for the scaled resolve data currently in the guest memory
+  // pages containing resolve results (as opposed to the memory committed for
+  // them, which is never released).
+  uint64_t GetScaledResolveUsedBytes();
+
   virtual void CompletedSubmissionUpdated(uint64_t completed_submission_index);
   virtual void BeginSubmission(uint64_t new_submission_index);
   virtual void BeginFrame();
@@ -102,6 +118,11 @@ class TextureCache {
   void TextureFetchConstantWritten(uint32_t index) {
     texture_bindings_in_sync_ &= ~(UINT32_C(1) << index);
   }
+  // Both first_index and last_index are inclusive.
+  void TextureFetchConstantsWritten(uint32_t first_index, uint32_t last_index) {
+    texture_bindings_in_sync_ &=
+        ~((UINT32_MAX >> (31 - last_index)) & (UINT32_MAX << first_index));
+  }
 
   virtual void RequestTextures(uint32_t used_texture_mask);
 
@@ -237,6 +258,40 @@ class TextureCache {
     }
     bool IsResolved() const { return base_resolved_ || mips_resolved_; }
 
+    // Hash of the guest data and the address-independent parts of the key, if
+    // the current contents were loaded entirely from guest memory with
+    // texture_cache_content_hash enabled.
+    bool has_content_hash() const { return has_content_hash_; }
+    uint64_t content_hash() const { return content_hash_; }
+    void SetContentHash(bool has_content_hash, uint64_t content_hash);
+
+    // Hashes of the guest data of the base and the mips as of their latest
+    // loads if those were from guest memory with
+    // texture_cache_skip_unchanged_reloads enabled.
+    bool has_base_data_hash() const { return has_base_data_hash_; }
+    uint64_t base_data_hash() const { return base_data_hash_; }
+    void SetBaseDataHash(bool has_hash, uint64_t hash) {
+      has_base_data_hash_ = has_hash;
+      base_data_hash_ = hash;
+    }
+    bool has_mips_data_hash() const { return has_mips_data_hash_; }
+    uint64_t mips_data_hash() const { return mips_data_hash_; }
+    void SetMipsDataHash(bool has_hash, uint64_t hash) {
+      has_mips_data_hash_ = has_hash;
+      mips_data_hash_ = hash;
+    }
+
+    // Whether the host data currently comes from the texture replacement pack
+    // rather than from the guest data.
+    bool replaced() const { return replaced_; }
+    void SetReplaced(bool replaced) { replaced_ = replaced; }
+    // Whether the texture is in the list of textures checked every frame for
+    // the replacement image to be streamed in.
+    bool awaiting_replacement() const { return awaiting_replacement_; }
+    void SetAwaitingReplacement(bool awaiting_replacement) {
+      awaiting_replacement_ = awaiting_replacement;
+    }
+
     bool base_outdated(
         const std::unique_lock<std::recursive_mutex>& global_lock) const {
       return base_outdated_;
@@ -289,6 +344,17 @@ class TextureCache {
     bool base_resolved_;
     bool mips_resolved_;
 
+    bool has_content_hash_ = false;
+    uint64_t content_hash_ = 0;
+
+    bool has_base_data_hash_ = false;
+    bool has_mips_data_hash_ = false;
+    uint64_t base_data_hash_ = 0;
+    uint64_t mips_data_hash_ = 0;
+
+    bool replaced_ = false;
+    bool awaiting_replacement_ = false;
+
     // These are to be accessed within the global critical region to synchronize
     // with shared memory.
     // Whether the recent base level data needs reloading from the memory.
@@ -532,6 +598,13 @@ class TextureCache {
   // TODO(Triang3l): Find out the correct contents of unused texture components.
   virtual uint32_t GetHostFormatSwizzle(TextureKey key) const = 0;
 
+  // Returns the video memory budget of the process on the host GPU and the
+  // total current usage by the process, in bytes, or false if not available.
+  virtual bool GetHostMemoryBudget(uint64_t& budget_out,
+                                   uint64_t& usage_out) const {
+    return false;
+  }
+
   virtual uint32_t GetMaxHostTextureWidthHeight(
       xenos::DataDimension dimension) const = 0;
   virtual uint32_t GetMaxHostTextureDepthOrArraySize(
@@ -552,6 +625,26 @@ class TextureCache {
     assert_true(load_shader_index < kLoadShaderCount);
     return load_shader_info_[load_shader_index];
   }
+  struct TextureDataLoad {
+    Texture* texture;
+    // At least one is true.
+    bool load_base;
+    bool load_mips;
+    bool base_resolved;
+    bool mips_resolved;
+    // Whether the load covers all of the texture with data that only comes
+    // from guest memory, so textures with the same contents can be reused.
+    bool has_content_hash;
+    uint64_t content_hash;
+    // Hashes of just the guest data of the base and the mips, with
+    // texture_cache_skip_unchanged_reloads, if it's only in guest memory.
+    bool has_base_data_hash;
+    bool has_mips_data_hash;
+    uint64_t base_data_hash;
+    uint64_t mips_data_hash;
+    // Set by the implementation.
+    bool loaded;
+  };
   bool LoadTextureData(Texture& texture);
   // Writes the texture data (for base, mips or both - but not neither) from the
   // shared memory or the scaled resolve memory. The shared memory management is
@@ -560,6 +653,38 @@ class TextureCache {
   virtual bool LoadTextureDataFromResidentMemoryImpl(Texture& texture,
                                                      bool load_base,
                                                      bool load_mips) = 0;
+  // Loads the data of multiple different textures, setting `loaded` for each.
+  // All the textures requested for a draw are loaded at once, so the
+  // implementation may group the work for them, for instance, to avoid
+  // barriers between loading each texture.
+  virtual void LoadTexturesDataFromResidentMemoryImpl(TextureDataLoad* loads,
+                                                      size_t load_count) {
+    for (size_t i = 0; i < load_count; ++i) {
+      TextureDataLoad& load = loads[i];
+      load.loaded = LoadTextureDataFromResidentMemoryImpl(
+          *load.texture, load.load_base, load.load_mips);
+    }
+  }
+
+  // Copies all the host data of a texture to another with the same key
+  // disregarding the guest addresses. Returns false if not supported or failed,
+  // in which case the data is loaded from the guest memory instead.
+  virtual bool CopyTextureDataImpl(Texture& dest, Texture& source) {
+    return false;
+  }
+
+  // Whether the implementation can replace the host data of textures with
+  // images from the texture replacement pack.
+  virtual bool IsTextureReplacementSupported() const { return false; }
+  // Replaces the host data of the texture with the image, which may have a
+  // different size and format than the guest texture, so the implementation
+  // may recreate the host resources of the texture (the texture bindings are
+  // reset afterwards). Returns false if the image can't be used for the
+  // texture, in which case the guest data stays in the texture.
+  virtual bool ReplaceTextureDataImpl(
+      Texture& texture, const TextureReplacementPack::Image& image) {
+    return false;
+  }
 
   // Converts a texture fetch constant to a texture key, normalizing and
   // validating the values, or creating an invalid key, and also gets the
@@ -585,6 +710,21 @@ class TextureCache {
  private:
   void UpdateTexturesTotalHostMemoryUsage(uint64_t add, uint64_t subtract);
 
+  // Checks what needs to be loaded for the texture and makes the guest data
+  // resident, setting neither load_base nor load_mips if the texture is up to
+  // date. Returns false in case of a failure.
+  bool PrepareTextureDataLoad(Texture& texture, TextureDataLoad& load_out);
+  void CompleteTextureDataLoad(const TextureDataLoad& load);
+  // Adds the texture to texture_data_loads_ if it needs to be loaded.
+  void AddTextureDataLoad(Texture& texture);
+  // Loads the textures, first trying to copy the data from existing textures
+  // with the same contents.
+  void LoadTexturesData(TextureDataLoad* loads, size_t load_count);
+
+  // Replaces the data of the textures awaiting replacement whose images have
+  // been streamed in.
+  void ProcessTextureReplacements();
+
   // Shared memory callback for texture data invalidation.
   static void WatchCallback(
       const std::unique_lock<std::recursive_mutex>& global_lock, void* context,
@@ -630,6 +770,21 @@ class TextureCache {
 
   uint64_t textures_total_host_memory_usage_ = 0;
 
+  uint64_t textures_created_ = 0;
+  uint64_t texture_loads_ = 0;
+  uint64_t texture_reloads_skipped_ = 0;
+
+  // The most recently loaded texture with each content hash, for copying the
+  // data instead of loading it again when the same guest texture is placed at
+  // a different address (texture_cache_content_hash).
+  std::unordered_map<uint64_t, Texture*> textures_by_content_hash_;
+
+  // Loaded from texture_replacement_pack.
+  std::unique_ptr<TextureReplacementPack> replacement_pack_;
+  // Textures with guest data whose content hash is in the replacement pack,
+  // checked every frame until the image has been streamed in.
+  std::vector<Texture*> textures_awaiting_replacement_;
+
   Texture* texture_used_first_ = nullptr;
   Texture* texture_used_last_ = nullptr;
 
@@ -643,6 +798,9 @@ class TextureCache {
   // Bit vector with bits reset on fetch constant writes to avoid parsing fetch
   // constants again and again.
   uint32_t texture_bindings_in_sync_ = 0;
+
+  // Textures to load in the current RequestTextures call.
+  std::vector<TextureDataLoad> texture_data_loads_;
 };
 
 }  // namespace gpu
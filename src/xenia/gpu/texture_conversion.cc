@@ -10,16 +10,28 @@
 #include "xenia/gpu/texture_conversion.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstring>
 #include <functional>
+#include <memory>
+#include <vector>
 
+#include "xenia/base/byte_order.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/threading.h"
 #include "xenia/base/xxhash.h"
 
+DEFINE_int32(untile_threads, -1,
+             "Maximum number of threads, including the calling one, to untile "
+             "large textures on the CPU with. -1 to use all logical "
+             "processors.",
+             "GPU");
+
 namespace xe {
 namespace gpu {
 namespace texture_conversion {
@@ -37,7 +49,7 @@ void CopySwapBlock(xenos::Endian endian, void* output, const void* input,
       break;
     case xenos::Endian::k16in32:  // Swap high and low 16 bits within a 32 bit
                                   // word
-      xe::copy_and_swap_16_in_32_unaligned(output, input, length);
+      xe::copy_and_swap_16_in_32_unaligned(output, input, length / 4);
       break;
     default:
     case xenos::Endian::kNone:
@@ -109,39 +121,172 @@ static uint32_t TiledOffset2DColumn(uint32_t x, uint32_t y, uint32_t log2_bpp,
          ((y & 16) << 7) + (((((y & 8) >> 2) + (x >> 3)) & 3) << 6);
 }
 
-void Untile(uint8_t* output_buffer, const uint8_t* input_buffer,
-            const UntileInfo* untile_info) {
-  SCOPE_profile_cpu_f("gpu");
-  assert_not_null(untile_info);
-  assert_not_null(untile_info->input_format_info);
-  assert_not_null(untile_info->output_format_info);
+namespace {
+
+// Rows of blocks untiled by one task when untiling on multiple threads - a row
+// of 32x32 macro tiles.
+constexpr uint32_t kUntileRowsPerTask = 32;
+// Textures smaller than this are untiled on the calling thread only, as
+// creating the threads would take longer than untiling.
+constexpr size_t kUntileMinParallelBytes = 1024 * 1024;
+
+// Calls the function for every group of rows on up to untile_threads threads,
+// including the calling one.
+void ParallelForEachUntileRowGroup(
+    uint32_t row_count, size_t total_bytes,
+    const std::function<void(uint32_t y_begin, uint32_t y_end)>& fn) {
+  uint32_t group_count =
+      (row_count + kUntileRowsPerTask - 1) / kUntileRowsPerTask;
+  uint32_t thread_count = cvars::untile_threads >= 0
+                              ? uint32_t(cvars::untile_threads)
+                              : xe::threading::logical_processor_count();
+  thread_count = std::min(std::max(thread_count, uint32_t(1)), group_count);
+  if (thread_count <= 1 || total_bytes < kUntileMinParallelBytes) {
+    fn(0, row_count);
+    return;
+  }
+  std::atomic<uint32_t> next_group(0);
+  auto work = [&]() {
+    uint32_t group;
+    while ((group = next_group.fetch_add(1, std::memory_order_relaxed)) <
+           group_count) {
+      uint32_t y_begin = group * kUntileRowsPerTask;
+      fn(y_begin, std::min(y_begin + kUntileRowsPerTask, row_count));
+    }
+  };
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads;
+  for (uint32_t i = 1; i < thread_count; ++i) {
+    auto thread = xe::threading::Thread::Create({}, [&work]() { work(); });
+    if (!thread) {
+      break;
+    }
+    thread->set_name("Untile Worker");
+    threads.push_back(std::move(thread));
+  }
+  work();
+  for (auto& thread : threads) {
+    xe::threading::Wait(thread.get(), false);
+  }
+}
 
+// Copies a number of bytes known at compile time with endian swapping, which
+// the compiler can turn into a few vector shuffles.
+template <xenos::Endian kEndian, size_t kLength>
+inline void CopySwapFixed(uint8_t* output, const uint8_t* input) {
+  if constexpr (kEndian == xenos::Endian::k8in16) {
+    for (size_t i = 0; i < kLength; i += sizeof(uint16_t)) {
+      uint16_t value;
+      std::memcpy(&value, input + i, sizeof(value));
+      value = xe::byte_swap(value);
+      std::memcpy(output + i, &value, sizeof(value));
+    }
+  } else if constexpr (kEndian == xenos::Endian::k8in32) {
+    for (size_t i = 0; i < kLength; i += sizeof(uint32_t)) {
+      uint32_t value;
+      std::memcpy(&value, input + i, sizeof(value));
+      value = xe::byte_swap(value);
+      std::memcpy(output + i, &value, sizeof(value));
+    }
+  } else if constexpr (kEndian == xenos::Endian::k16in32) {
+    for (size_t i = 0; i < kLength; i += sizeof(uint32_t)) {
+      uint32_t value;
+      std::memcpy(&value, input + i, sizeof(value));
+      value = (value >> 16) | (value << 16);
+      std::memcpy(output + i, &value, sizeof(value));
+    }
+  } else {
+    std::memcpy(output, input, kLength);
+  }
+}
+
+// Untiles rows without format conversion. Horizontally adjacent blocks in a
+// tiled texture are stored in runs of 16 bytes (8 bytes for 8bpp) that are
+// contiguous in memory, so whole runs are copied at once.
+template <uint32_t kLog2Bpp, xenos::Endian kEndian>
+void UntileRowsWithoutConversion(uint8_t* output_buffer,
+                                 const uint8_t* input_buffer,
+                                 const UntileInfo& untile_info,
+                                 uint32_t y_begin, uint32_t y_end) {
+  constexpr uint32_t kBytesPerBlock = uint32_t(1) << kLog2Bpp;
+  constexpr uint32_t kRunBlocks = kLog2Bpp ? (16 >> kLog2Bpp) : 8;
+  size_t output_pitch = size_t(untile_info.output_pitch) * kBytesPerBlock;
+  for (uint32_t y = y_begin; y < y_end; ++y) {
+    uint32_t tiled_y = untile_info.offset_y + y;
+    uint32_t input_row_offset =
+        TiledOffset2DRow(tiled_y, untile_info.input_pitch, kLog2Bpp);
+    uint8_t* output_row = output_buffer + output_pitch * y;
+    uint32_t x = 0;
+    while (x < untile_info.width) {
+      uint32_t tiled_x = untile_info.offset_x + x;
+      uint32_t run_blocks = std::min(kRunBlocks - (tiled_x & (kRunBlocks - 1)),
+                                     untile_info.width - x);
+      uint32_t input_offset = TiledOffset2DColumn(tiled_x, tiled_y, kLog2Bpp,
+                                                  input_row_offset) >>
+                              kLog2Bpp;
+      const uint8_t* input =
+          input_buffer + size_t(input_offset) * kBytesPerBlock;
+      uint8_t* output = output_row + size_t(x) * kBytesPerBlock;
+      if (run_blocks == kRunBlocks) {
+        CopySwapFixed<kEndian, kRunBlocks * kBytesPerBlock>(output, input);
+      } else {
+        CopySwapBlock(kEndian, output, input, run_blocks * kBytesPerBlock);
+      }
+      x += run_blocks;
+    }
+  }
+}
+
+template <uint32_t kLog2Bpp>
+void UntileRowsWithoutConversion(uint8_t* output_buffer,
+                                 const uint8_t* input_buffer,
+                                 const UntileInfo& untile_info,
+                                 uint32_t y_begin, uint32_t y_end) {
+  switch (untile_info.endian) {
+    case xenos::Endian::k8in16:
+      UntileRowsWithoutConversion<kLog2Bpp, xenos::Endian::k8in16>(
+          output_buffer, input_buffer, untile_info, y_begin, y_end);
+      break;
+    case xenos::Endian::k8in32:
+      UntileRowsWithoutConversion<kLog2Bpp, xenos::Endian::k8in32>(
+          output_buffer, input_buffer, untile_info, y_begin, y_end);
+      break;
+    case xenos::Endian::k16in32:
+      UntileRowsWithoutConversion<kLog2Bpp, xenos::Endian::k16in32>(
+          output_buffer, input_buffer, untile_info, y_begin, y_end);
+      break;
+    default:
+      UntileRowsWithoutConversion<kLog2Bpp, xenos::Endian::kNone>(
+          output_buffer, input_buffer, untile_info, y_begin, y_end);
+      break;
+  }
+}
+
+void UntileRowsWithCallback(uint8_t* output_buffer,
+                            const uint8_t* input_buffer,
+                            const UntileInfo& untile_info, uint32_t log2_bpp,
+                            uint32_t y_begin, uint32_t y_end) {
   uint32_t input_bytes_per_block =
-      untile_info->input_format_info->bytes_per_block();
+      untile_info.input_format_info->bytes_per_block();
   uint32_t output_bytes_per_block =
-      untile_info->output_format_info->bytes_per_block();
-  uint32_t output_pitch = untile_info->output_pitch * output_bytes_per_block;
-
-  // Bytes per pixel
-  auto log2_bpp = (input_bytes_per_block / 4) +
-                  ((input_bytes_per_block / 2) >> (input_bytes_per_block / 4));
+      untile_info.output_format_info->bytes_per_block();
+  uint32_t output_pitch = untile_info.output_pitch * output_bytes_per_block;
 
   // Offset to the current row, in bytes.
-  uint32_t output_row_offset = 0;
-  for (uint32_t y = 0; y < untile_info->height; y++) {
+  size_t output_row_offset = size_t(output_pitch) * y_begin;
+  for (uint32_t y = y_begin; y < y_end; y++) {
     auto input_row_offset = TiledOffset2DRow(
-        untile_info->offset_y + y, untile_info->input_pitch, log2_bpp);
+        untile_info.offset_y + y, untile_info.input_pitch, log2_bpp);
 
     // Go block-by-block on this row.
-    uint32_t output_offset = output_row_offset;
+    size_t output_offset = output_row_offset;
 
-    for (uint32_t x = 0; x < untile_info->width; x++) {
-      auto input_offset = TiledOffset2DColumn(untile_info->offset_x + x,
-                                              untile_info->offset_y + y,
+    for (uint32_t x = 0; x < untile_info.width; x++) {
+      auto input_offset = TiledOffset2DColumn(untile_info.offset_x + x,
+                                              untile_info.offset_y + y,
                                               log2_bpp, input_row_offset);
       input_offset >>= log2_bpp;
 
-      untile_info->copy_callback(
+      untile_info.copy_callback(
           &output_buffer[output_offset],
           &input_buffer[input_offset * input_bytes_per_block],
           output_bytes_per_block);
@@ -153,6 +298,65 @@ void Untile(uint8_t* output_buffer, const uint8_t* input_buffer,
   }
 }
 
+}  // namespace
+
+void Untile(uint8_t* output_buffer, const uint8_t* input_buffer,
+            const UntileInfo* untile_info) {
+  SCOPE_profile_cpu_f("gpu");
+  assert_not_null(untile_info);
+  assert_not_null(untile_info->input_format_info);
+  assert_not_null(untile_info->output_format_info);
+
+  uint32_t input_bytes_per_block =
+      untile_info->input_format_info->bytes_per_block();
+  uint32_t output_bytes_per_block =
+      untile_info->output_format_info->bytes_per_block();
+
+  // Bytes per pixel
+  auto log2_bpp = (input_bytes_per_block / 4) +
+                  ((input_bytes_per_block / 2) >> (input_bytes_per_block / 4));
+
+  size_t total_bytes = size_t(untile_info->width) * untile_info->height *
+                       output_bytes_per_block;
+  if (untile_info->copy_callback) {
+    ParallelForEachUntileRowGroup(
+        untile_info->height, total_bytes,
+        [&](uint32_t y_begin, uint32_t y_end) {
+          UntileRowsWithCallback(output_buffer, input_buffer, *untile_info,
+                                 log2_bpp, y_begin, y_end);
+        });
+    return;
+  }
+
+  assert_true(input_bytes_per_block == output_bytes_per_block);
+  ParallelForEachUntileRowGroup(
+      untile_info->height, total_bytes, [&](uint32_t y_begin, uint32_t y_end) {
+        switch (log2_bpp) {
+          case 0:
+            UntileRowsWithoutConversion<0>(output_buffer, input_buffer,
+                                           *untile_info, y_begin, y_end);
+            break;
+          case 1:
+            UntileRowsWithoutConversion<1>(output_buffer, input_buffer,
+                                           *untile_info, y_begin, y_end);
+            break;
+          case 2:
+            UntileRowsWithoutConversion<2>(output_buffer, input_buffer,
+                                           *untile_info, y_begin, y_end);
+            break;
+          case 3:
+            UntileRowsWithoutConversion<3>(output_buffer, input_buffer,
+                                           *untile_info, y_begin, y_end);
+            break;
+          default:
+            assert_true(log2_bpp == 4);
+            UntileRowsWithoutConversion<4>(output_buffer, input_buffer,
+                                           *untile_info, y_begin, y_end);
+            break;
+        }
+      });
+}
+
 }  //  namespace texture_conversion
 }  //  namespace gpu
 }  //  namespace xe
@@ -34,6 +34,8 @@ void ConvertTexelDXT3AToDXT3(xenos::Endian endian, void* output,
 
 typedef std::function<void(void*, const void*, size_t)> UntileCopyBlockCallback;
 
+// Large textures are untiled on multiple threads (see the untile_threads
+// cvar), so the copy callback must be safe to call concurrently.
 typedef struct UntileInfo {
   uint32_t offset_x;
   uint32_t offset_y;
@@ -43,7 +45,11 @@ typedef struct UntileInfo {
   uint32_t output_pitch;
   const FormatInfo* input_format_info;
   const FormatInfo* output_format_info;
+  // If empty, the blocks are copied with endian swapping, without conversion -
+  // the input and the output formats must have the same block size then.
   UntileCopyBlockCallback copy_callback;
+  // For copying without a callback.
+  xenos::Endian endian;
 } UntileInfo;
 
 void Untile(uint8_t* output_buffer, const uint8_t* input_buffer,
@@ -13,17 +13,145 @@
 #pragma clang diagnostic ignored "-Wnontrivial-memcall"
 #endif
 
+#include "xenia/gpu/texture_dump.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
 #include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/hash.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
-#include "xenia/gpu/texture_info.h"
+#include "xenia/base/threading.h"
+#include "xenia/base/xxhash.h"
 
 DEFINE_bool(texture_dump, false, "Dump textures to DDS", "GPU");
+DEFINE_int32(texture_dump_threads, 2,
+             "Number of background threads writing the DDS files of dumped "
+             "textures.",
+             "GPU");
 
 namespace xe {
 namespace gpu {
 
-void TextureDump(const TextureInfo& src, void* buffer, size_t length) {
+namespace {
+
+struct PendingTextureDump {
+  std::filesystem::path path;
+  // The DDS signature and header followed by the texture data.
+  std::vector<uint8_t> data;
+};
+
+// Writes the dumps on background threads, so the command processor thread
+// only copies the data.
+class TextureDumpWriter {
+ public:
+  // Returns false if the same data has already been dumped.
+  bool Mark(uint64_t hash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dumped_hashes_.insert(hash).second;
+  }
+
+  void Enqueue(PendingTextureDump&& dump) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (threads_.empty()) {
+        uint32_t thread_count =
+            uint32_t(std::max(cvars::texture_dump_threads, int32_t(1)));
+        for (uint32_t i = 0; i < thread_count; ++i) {
+          auto thread =
+              xe::threading::Thread::Create({}, [this]() { WriteThread(); });
+          if (!thread) {
+            break;
+          }
+          thread->set_name("Texture Dump Writer");
+          threads_.push_back(std::move(thread));
+        }
+      }
+      if (threads_.empty()) {
+        // Couldn't create any thread - write synchronously as a fallback.
+        ++writes_pending_;
+      } else {
+        queue_.push_back(std::move(dump));
+        ++writes_pending_;
+        request_cond_.notify_one();
+        return;
+      }
+    }
+    Write(dump);
+    CompleteWrite();
+  }
+
+  void Flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    completion_cond_.wait(lock, [this]() { return !writes_pending_; });
+  }
+
+ private:
+  void WriteThread() {
+    while (true) {
+      PendingTextureDump dump;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        request_cond_.wait(lock, [this]() { return !queue_.empty(); });
+        dump = std::move(queue_.front());
+        queue_.pop_front();
+      }
+      Write(dump);
+      CompleteWrite();
+    }
+  }
+
+  static void Write(const PendingTextureDump& dump) {
+    xe::filesystem::CreateParentFolder(dump.path);
+    FILE* handle = filesystem::OpenFile(dump.path, "wb");
+    bool written = false;
+    if (handle) {
+      written = fwrite(dump.data.data(), 1, dump.data.size(), handle) ==
+                dump.data.size();
+      fclose(handle);
+    }
+    if (!written) {
+      XELOGE("Failed to write the texture dump {}",
+             xe::path_to_utf8(dump.path));
+    }
+  }
+
+  void CompleteWrite() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!--writes_pending_) {
+      completion_cond_.notify_all();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable request_cond_;
+  std::condition_variable completion_cond_;
+  std::deque<PendingTextureDump> queue_;
+  // Queued or being written.
+  size_t writes_pending_ = 0;
+  std::unordered_set<uint64_t, xe::hash::IdentityHasher<uint64_t>>
+      dumped_hashes_;
+  // The threads are never stopped, like the process-wide writer itself.
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads_;
+};
+
+TextureDumpWriter& GetTextureDumpWriter() {
+  // Intentionally leaked, so the writer threads don't outlive it during exit.
+  static TextureDumpWriter* writer = new TextureDumpWriter;
+  return *writer;
+}
+
+}  // namespace
+
+void TextureDump(const TextureInfo& src, const void* buffer, size_t length) {
   struct {
     uint32_t size;
     uint32_t flags;
@@ -98,22 +226,32 @@ void TextureDump(const TextureInfo& src, void* buffer, size_t length) {
 
   dds_header.caps[0] = 8u | 0x1000u;
 
-  static int dump_counter = 0;
-  std::filesystem::path path = "texture_dumps";
-  path /= fmt::format("{:05d}_{:08X}_{:08X}_{:08X}.dds", dump_counter++,
-                      src.memory.base_address, src.memory.mip_address,
-                      src.format_info()->name);
-
-  FILE* handle = filesystem::OpenFile(path, "wb");
-  if (handle) {
-    const char signature[4] = {'D', 'D', 'S', ' '};
-    fwrite(&signature, sizeof(signature), 1, handle);
-    fwrite(&dds_header, sizeof(dds_header), 1, handle);
-    fwrite(buffer, 1, length, handle);
-    fclose(handle);
+  // Staging copy of the whole file, also hashed to skip textures that have
+  // already been dumped (textures are commonly reloaded, and the same data is
+  // often stored at multiple addresses).
+  const char signature[4] = {'D', 'D', 'S', ' '};
+  PendingTextureDump dump;
+  dump.data.resize(sizeof(signature) + sizeof(dds_header) + length);
+  std::memcpy(dump.data.data(), signature, sizeof(signature));
+  std::memcpy(dump.data.data() + sizeof(signature), &dds_header,
+              sizeof(dds_header));
+  std::memcpy(dump.data.data() + sizeof(signature) + sizeof(dds_header),
+              buffer, length);
+  uint64_t hash = XXH3_64bits(dump.data.data(), dump.data.size());
+
+  TextureDumpWriter& writer = GetTextureDumpWriter();
+  if (!writer.Mark(hash)) {
+    return;
   }
+  dump.path = "texture_dumps";
+  dump.path /= fmt::format("{:016X}_{:08X}_{:08X}_{}.dds", hash,
+                           src.memory.base_address, src.memory.mip_address,
+                           src.format_info()->name);
+  writer.Enqueue(std::move(dump));
 }
 
+void FlushTextureDumps() { GetTextureDumpWriter().Flush(); }
+
 }  // namespace gpu
 }  // namespace xe
 
@@ -0,0 +1,31 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_TEXTURE_DUMP_H_
+#define XENIA_GPU_TEXTURE_DUMP_H_
+
+#include <cstddef>
+
+#include "xenia/gpu/texture_info.h"
+
+namespace xe {
+namespace gpu {
+
+// Queues the loaded texture data to be written to a DDS file in texture_dumps
+// on a background thread, if the same data hasn't been dumped already. The
+// data is copied, so the buffer may be reused once this returns.
+void TextureDump(const TextureInfo& src, const void* buffer, size_t length);
+
+// Waits for all the queued texture dumps to be written.
+void FlushTextureDumps();
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_TEXTURE_DUMP_H_
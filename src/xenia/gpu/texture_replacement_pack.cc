@@ -0,0 +1,210 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/texture_replacement_pack.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/string.h"
+
+namespace xe {
+namespace gpu {
+
+size_t TextureReplacementPack::GetImageDataSize(Format format, uint32_t width,
+                                                uint32_t height,
+                                                uint32_t mip_count) {
+  uint32_t block_size_log2;
+  uint32_t bytes_per_block;
+  switch (format) {
+    case Format::kBC1:
+      block_size_log2 = 2;
+      bytes_per_block = 8;
+      break;
+    case Format::kBC3:
+    case Format::kBC7:
+      block_size_log2 = 2;
+      bytes_per_block = 16;
+      break;
+    default:
+      block_size_log2 = 0;
+      bytes_per_block = 4;
+      break;
+  }
+  uint32_t block_size_mask = (uint32_t(1) << block_size_log2) - 1;
+  size_t size = 0;
+  for (uint32_t mip = 0; mip < mip_count; ++mip) {
+    uint32_t mip_width = std::max(width >> mip, uint32_t(1));
+    uint32_t mip_height = std::max(height >> mip, uint32_t(1));
+    size += size_t((mip_width + block_size_mask) >> block_size_log2) *
+            ((mip_height + block_size_mask) >> block_size_log2) *
+            bytes_per_block;
+  }
+  return size;
+}
+
+std::unique_ptr<TextureReplacementPack> TextureReplacementPack::Open(
+    const std::filesystem::path& path) {
+  auto mapping = MappedMemory::Open(path, MappedMemory::Mode::kRead);
+  if (!mapping) {
+    XELOGE("Failed to open the texture replacement pack {}",
+           xe::path_to_utf8(path));
+    return nullptr;
+  }
+  size_t file_size = mapping->size();
+  PackHeader header;
+  if (file_size < sizeof(header)) {
+    XELOGE("Texture replacement pack {} is truncated", xe::path_to_utf8(path));
+    return nullptr;
+  }
+  std::memcpy(&header, mapping->data(), sizeof(header));
+  if (header.magic != kMagic || header.version != kVersion) {
+    XELOGE("Texture replacement pack {} has an unsupported format",
+           xe::path_to_utf8(path));
+    return nullptr;
+  }
+  if ((file_size - sizeof(header)) / sizeof(PackIndexEntry) <
+      header.image_count) {
+    XELOGE("Texture replacement pack {} has a truncated index",
+           xe::path_to_utf8(path));
+    return nullptr;
+  }
+
+  std::unique_ptr<TextureReplacementPack> pack(new TextureReplacementPack);
+  // The header is 16 bytes, so the index is aligned to 8 bytes in the mapping.
+  pack->index_ = reinterpret_cast<const PackIndexEntry*>(mapping->data() +
+                                                         sizeof(header));
+  pack->index_count_ = header.image_count;
+  pack->images_.reserve(header.image_count);
+  for (size_t i = 0; i < pack->index_count_; ++i) {
+    const PackIndexEntry& entry = pack->index_[i];
+    if ((i && entry.content_hash <= pack->index_[i - 1].content_hash) ||
+        entry.format >= Format::kCount || !entry.width || !entry.height ||
+        !entry.mip_count || entry.mip_count > 16 ||
+        entry.data_offset > file_size ||
+        entry.data_size > file_size - entry.data_offset ||
+        entry.data_size < GetImageDataSize(entry.format, entry.width,
+                                           entry.height, entry.mip_count)) {
+      XELOGE("Texture replacement pack {} has an invalid index entry {}",
+             xe::path_to_utf8(path), i);
+      return nullptr;
+    }
+    Image& image = pack->images_.emplace_back();
+    image.width = entry.width;
+    image.height = entry.height;
+    image.mip_count = entry.mip_count;
+    image.format = entry.format;
+    image.data = mapping->data() + entry.data_offset;
+    image.data_size = size_t(entry.data_size);
+  }
+  pack->image_states_ =
+      std::make_unique<std::atomic<ImageState>[]>(pack->index_count_);
+  for (size_t i = 0; i < pack->index_count_; ++i) {
+    pack->image_states_[i].store(ImageState::kNotRequested,
+                                 std::memory_order_relaxed);
+  }
+  pack->mapping_ = std::move(mapping);
+
+  TextureReplacementPack* pack_ptr = pack.get();
+  pack->streaming_thread_ = xe::threading::Thread::Create(
+      {}, [pack_ptr]() { pack_ptr->StreamingThread(); });
+  if (!pack->streaming_thread_) {
+    XELOGE("Failed to create the texture replacement streaming thread");
+    return nullptr;
+  }
+  pack->streaming_thread_->set_name("Texture Replacement Streaming");
+
+  XELOGI("Opened the texture replacement pack {} with {} images",
+         xe::path_to_utf8(path), pack->index_count_);
+  return pack;
+}
+
+TextureReplacementPack::~TextureReplacementPack() {
+  if (streaming_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(streaming_mutex_);
+      streaming_shutdown_ = true;
+    }
+    streaming_cond_.notify_all();
+    xe::threading::Wait(streaming_thread_.get(), false);
+  }
+}
+
+size_t TextureReplacementPack::FindIndex(uint64_t content_hash) const {
+  const PackIndexEntry* index_end = index_ + index_count_;
+  const PackIndexEntry* entry = std::lower_bound(
+      index_, index_end, content_hash,
+      [](const PackIndexEntry& entry, uint64_t content_hash) {
+        return entry.content_hash < content_hash;
+      });
+  if (entry == index_end || entry->content_hash != content_hash) {
+    return SIZE_MAX;
+  }
+  return size_t(entry - index_);
+}
+
+const TextureReplacementPack::Image* TextureReplacementPack::Request(
+    uint64_t content_hash) {
+  size_t index = FindIndex(content_hash);
+  if (index == SIZE_MAX) {
+    return nullptr;
+  }
+  std::atomic<ImageState>& state = image_states_[index];
+  ImageState current_state = state.load(std::memory_order_acquire);
+  if (current_state == ImageState::kResident) {
+    return &images_[index];
+  }
+  if (current_state == ImageState::kNotRequested &&
+      state.compare_exchange_strong(current_state, ImageState::kQueued,
+                                    std::memory_order_relaxed)) {
+    {
+      std::lock_guard<std::mutex> lock(streaming_mutex_);
+      streaming_queue_.push_back(index);
+    }
+    streaming_cond_.notify_one();
+  }
+  return nullptr;
+}
+
+void TextureReplacementPack::StreamingThread() {
+  size_t page_size = xe::memory::page_size();
+  while (true) {
+    size_t index;
+    {
+      std::unique_lock<std::mutex> lock(streaming_mutex_);
+      streaming_cond_.wait(lock, [this]() {
+        return streaming_shutdown_ || !streaming_queue_.empty();
+      });
+      if (streaming_shutdown_) {
+        return;
+      }
+      index = streaming_queue_.front();
+      streaming_queue_.pop_front();
+    }
+    // Read the whole image in large requests, and touch every page so the
+    // command processor thread won't take page faults reading from the
+    // storage while uploading it.
+    const PackIndexEntry& entry = index_[index];
+    mapping_->Prefetch(size_t(entry.data_offset), size_t(entry.data_size),
+                       true);
+    const volatile uint8_t* data = images_[index].data;
+    size_t data_size = images_[index].data_size;
+    for (size_t offset = 0; offset < data_size; offset += page_size) {
+      (void)data[offset];
+    }
+    image_states_[index].store(ImageState::kResident,
+                               std::memory_order_release);
+  }
+}
+
+}  // namespace gpu
+}  // namespace xe
@@ -0,0 +1,137 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_TEXTURE_REPLACEMENT_PACK_H_
+#define XENIA_GPU_TEXTURE_REPLACEMENT_PACK_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "xenia/base/mapped_memory.h"
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace gpu {
+
+// Replacement images for guest textures, keyed by the content hash of the
+// guest texture, stored in a memory-mapped pack file already in formats that
+// the host GPU can sample directly, so nothing is decoded on the CPU.
+//
+// The pack file (little-endian) consists of:
+// - PackHeader.
+// - PackHeader::image_count PackIndexEntry structures sorted by content_hash.
+// - The data of the images, with the mips from the largest, each mip being
+//   rows of blocks without padding.
+//
+// The data of an image is read from the file on a background thread when it's
+// requested the first time, so the command processor thread doesn't wait for
+// the storage - the original texture is used until the image is resident.
+class TextureReplacementPack {
+ public:
+  static constexpr uint32_t kMagic = 0x50525458;  // 'XTRP'
+  static constexpr uint32_t kVersion = 1;
+
+  enum class Format : uint32_t {
+    kBC1,
+    kBC3,
+    kBC7,
+    kR8G8B8A8,
+
+    kCount,
+  };
+
+  struct PackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t image_count;
+    uint32_t reserved;
+  };
+
+  struct PackIndexEntry {
+    uint64_t content_hash;
+    // From the beginning of the file.
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mip_count;
+    Format format;
+  };
+  static_assert(sizeof(PackIndexEntry) == 40, "Pack index entry layout");
+
+  struct Image {
+    uint32_t width;
+    uint32_t height;
+    uint32_t mip_count;
+    Format format;
+    const uint8_t* data;
+    size_t data_size;
+  };
+
+  // Returns the size of the data of all the mips of an image.
+  static size_t GetImageDataSize(Format format, uint32_t width,
+                                 uint32_t height, uint32_t mip_count);
+
+  // Returns nullptr if the file is not a valid pack.
+  static std::unique_ptr<TextureReplacementPack> Open(
+      const std::filesystem::path& path);
+
+  TextureReplacementPack(const TextureReplacementPack& pack) = delete;
+  TextureReplacementPack& operator=(const TextureReplacementPack& pack) =
+      delete;
+  ~TextureReplacementPack();
+
+  size_t image_count() const { return index_count_; }
+
+  bool Contains(uint64_t content_hash) const {
+    return FindIndex(content_hash) != SIZE_MAX;
+  }
+
+  // Returns the image if its data is resident in memory, otherwise queues it
+  // for streaming (if not queued yet) and returns nullptr.
+  const Image* Request(uint64_t content_hash);
+
+ private:
+  enum class ImageState : uint8_t {
+    kNotRequested,
+    kQueued,
+    kResident,
+  };
+
+  TextureReplacementPack() = default;
+
+  // SIZE_MAX if not in the pack.
+  size_t FindIndex(uint64_t content_hash) const;
+
+  void StreamingThread();
+
+  std::unique_ptr<MappedMemory> mapping_;
+  const PackIndexEntry* index_ = nullptr;
+  size_t index_count_ = 0;
+  std::vector<Image> images_;
+  std::unique_ptr<std::atomic<ImageState>[]> image_states_;
+
+  std::mutex streaming_mutex_;
+  std::condition_variable streaming_cond_;
+  std::deque<size_t> streaming_queue_;
+  bool streaming_shutdown_ = false;
+  std::unique_ptr<xe::threading::Thread> streaming_thread_;
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_TEXTURE_REPLACEMENT_PACK_H_
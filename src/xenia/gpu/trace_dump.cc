@@ -9,9 +9,15 @@
 
 #include "xenia/gpu/trace_dump.h"
 
+#include <string>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
 #include "third_party/stb/stb_image_write.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/string.h"
 #include "xenia/base/threading.h"
@@ -30,6 +36,24 @@
 
 DEFINE_path(target_trace_file, "", "Specifies the trace file to load.", "GPU");
 DEFINE_path(trace_dump_path, "", "Output path for dumped files.", "GPU");
+DEFINE_int32(trace_dump_benchmark_iterations, 0,
+             "If above 0, instead of dumping the output image, replay the "
+             "whole trace this many times, and write the command processor "
+             "and host GPU time, the pipeline and texture cache misses of each "
+             "replay, and the peak memory usage as JSON. The caches are "
+             "cleared only before the first replay.",
+             "GPU");
+DEFINE_bool(trace_dump_benchmark_per_frame, false,
+            "In the benchmark mode, replay the trace frame by frame, waiting "
+            "for the host GPU after each frame, and also write the command "
+            "processor and host GPU time of every frame. The GPU can't overlap "
+            "the processing of the next frame then, so the total time is "
+            "higher than without this option.",
+            "GPU");
+DEFINE_path(trace_dump_benchmark_output, "",
+            "Path to write the benchmark JSON to, or empty to write it to the "
+            "standard output.",
+            "GPU");
 
 namespace xe {
 namespace gpu {
@@ -89,6 +113,9 @@ int TraceDump::Main(const std::vector<std::string>& args) {
   // Ensure output path exists.
   xe::filesystem::CreateParentFolder(base_output_path_);
 
+  if (cvars::trace_dump_benchmark_iterations > 0) {
+    return RunBenchmark(uint32_t(cvars::trace_dump_benchmark_iterations));
+  }
   return Run();
 }
 
@@ -151,5 +178,157 @@ int TraceDump::Run() {
   return result;
 }
 
+static std::string EscapeJsonString(const std::string_view str) {
+  std::string escaped;
+  escaped.reserve(str.size());
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      escaped.push_back('\\');
+      escaped.push_back(c);
+    } else if (uint8_t(c) < 0x20) {
+      escaped.append(fmt::format("\\u{:04x}", uint8_t(c)));
+    } else {
+      escaped.push_back(c);
+    }
+  }
+  return escaped;
+}
+
+int TraceDump::RunBenchmark(uint32_t iterations) {
+  CommandProcessor* command_processor = graphics_system_->command_processor();
+  std::unique_ptr<xe::threading::Event> idle_event =
+      xe::threading::Event::CreateAutoResetEvent(false);
+  // Host GPU work is awaited and the statistics are taken on the command
+  // processor thread, where the caches are modified.
+  auto await_idle = [&](CommandProcessor::CacheStatistics& statistics_out) {
+    command_processor->CallInThread([&]() {
+      command_processor->AwaitHostGpuIdle();
+      command_processor->GetCacheStatistics(statistics_out);
+      idle_event->Set();
+    });
+    xe::threading::Wait(idle_event.get(), false);
+  };
+
+  struct FrameTiming {
+    uint64_t command_processor_ticks;
+    uint64_t gpu_wait_ticks;
+  };
+  struct Replay {
+    uint64_t command_processor_ticks;
+    uint64_t gpu_wait_ticks;
+    CommandProcessor::CacheStatistics statistics;
+    std::vector<FrameTiming> frames;
+  };
+  bool per_frame = cvars::trace_dump_benchmark_per_frame;
+  int frame_count = player_->frame_count();
+  std::vector<Replay> replays;
+  replays.reserve(iterations);
+  CommandProcessor::CacheStatistics statistics_before;
+  await_idle(statistics_before);
+  for (uint32_t i = 0; i < iterations; ++i) {
+    Replay& replay = replays.emplace_back();
+    CommandProcessor::CacheStatistics statistics_after;
+    if (per_frame) {
+      replay.command_processor_ticks = 0;
+      replay.gpu_wait_ticks = 0;
+      replay.frames.reserve(size_t(frame_count));
+      for (int j = 0; j < frame_count; ++j) {
+        uint64_t start_ticks = Clock::QueryHostTickCount();
+        player_->PlayFrame(j, !i && !j);
+        player_->WaitOnPlayback();
+        uint64_t playback_end_ticks = Clock::QueryHostTickCount();
+        await_idle(statistics_after);
+        uint64_t idle_ticks = Clock::QueryHostTickCount();
+        FrameTiming& frame = replay.frames.emplace_back();
+        frame.command_processor_ticks = playback_end_ticks - start_ticks;
+        frame.gpu_wait_ticks = idle_ticks - playback_end_ticks;
+        replay.command_processor_ticks += frame.command_processor_ticks;
+        replay.gpu_wait_ticks += frame.gpu_wait_ticks;
+      }
+      if (!frame_count) {
+        await_idle(statistics_after);
+      }
+    } else {
+      uint64_t start_ticks = Clock::QueryHostTickCount();
+      player_->PlayEntireTrace(!i);
+      player_->WaitOnPlayback();
+      uint64_t playback_end_ticks = Clock::QueryHostTickCount();
+      await_idle(statistics_after);
+      uint64_t idle_ticks = Clock::QueryHostTickCount();
+      replay.command_processor_ticks = playback_end_ticks - start_ticks;
+      replay.gpu_wait_ticks = idle_ticks - playback_end_ticks;
+    }
+    replay.statistics.pipelines_created = statistics_after.pipelines_created -
+                                          statistics_before.pipelines_created;
+    replay.statistics.textures_created =
+        statistics_after.textures_created - statistics_before.textures_created;
+    replay.statistics.texture_loads =
+        statistics_after.texture_loads - statistics_before.texture_loads;
+    statistics_before = statistics_after;
+  }
+
+  // Fixed formatting of the numbers and the order of the fields, so the output
+  // of different runs can be compared directly.
+  double ms_per_tick = 1000.0 / double(Clock::QueryHostTickFrequency());
+  std::string json = "{\n";
+  json += fmt::format("  \"trace\": \"{}\",\n",
+                      EscapeJsonString(xe::path_to_utf8(trace_file_path_)));
+  json += fmt::format("  \"frames\": {},\n", player_->frame_count());
+  json += "  \"replays\": [\n";
+  for (size_t i = 0; i < replays.size(); ++i) {
+    const Replay& replay = replays[i];
+    json += fmt::format(
+        "    {{\"command_processor_ms\": {:.3f}, \"gpu_wait_ms\": {:.3f}, "
+        "\"pipelines_created\": {}, \"textures_created\": {}, "
+        "\"texture_loads\": {}",
+        replay.command_processor_ticks * ms_per_tick,
+        replay.gpu_wait_ticks * ms_per_tick,
+        replay.statistics.pipelines_created,
+        replay.statistics.textures_created, replay.statistics.texture_loads);
+    if (per_frame) {
+      json += ", \"frames\": [";
+      for (size_t j = 0; j < replay.frames.size(); ++j) {
+        const FrameTiming& frame = replay.frames[j];
+        json += fmt::format(
+            "{}{{\"command_processor_ms\": {:.3f}, \"gpu_wait_ms\": {:.3f}}}",
+            j ? ", " : "", frame.command_processor_ticks * ms_per_tick,
+            frame.gpu_wait_ticks * ms_per_tick);
+      }
+      json += "]";
+    }
+    json += fmt::format("}}{}\n", i + 1 < replays.size() ? "," : "");
+  }
+  json += "  ],\n";
+  json += fmt::format("  \"peak_working_set_bytes\": {}\n",
+                      xe::memory::peak_working_set_size());
+  json += "}\n";
+
+  int result = 0;
+  if (cvars::trace_dump_benchmark_output.empty()) {
+    fwrite(json.data(), 1, json.size(), stdout);
+    fflush(stdout);
+  } else {
+    xe::filesystem::CreateParentFolder(cvars::trace_dump_benchmark_output);
+    FILE* file =
+        xe::filesystem::OpenFile(cvars::trace_dump_benchmark_output, "wb");
+    if (file) {
+      if (fwrite(json.data(), 1, json.size(), file) != json.size()) {
+        result = 1;
+      }
+      fclose(file);
+    } else {
+      result = 1;
+    }
+    if (result) {
+      XELOGE("Failed to write the benchmark results to {}",
+             xe::path_to_utf8(cvars::trace_dump_benchmark_output));
+    }
+  }
+
+  player_.reset();
+  emulator_.reset();
+  return result;
+}
+
 }  //  namespace gpu
 }  //  namespace xe
@@ -11,6 +11,7 @@
 #define XENIA_GPU_TRACE_DUMP_H_
 
 #include <string>
+#include <vector>
 
 #include "xenia/emulator.h"
 #include "xenia/gpu/shader.h"
@@ -47,6 +48,9 @@ class TraceDump {
   bool Setup();
   bool Load(const std::filesystem::path& trace_file_path);
   int Run();
+  // Replays the whole trace multiple times and writes the timing and the cache
+  // statistics of each replay as JSON.
+  int RunBenchmark(uint32_t iterations);
 
   std::filesystem::path trace_file_path_;
   std::filesystem::path base_output_path_;
@@ -9,6 +9,7 @@
 
 #include "xenia/gpu/trace_player.h"
 
+#include <algorithm>
 #include <memory>
 
 #include "xenia/gpu/command_processor.h"
@@ -81,6 +82,25 @@ void TracePlayer::SeekCommand(int target_command) {
   }
 }
 
+void TracePlayer::PlayEntireTrace(bool clear_caches) {
+  current_frame_index_ = std::max(frame_count() - 1, 0);
+  const Frame* frame = current_frame();
+  current_command_index_ = frame ? int(frame->commands.size()) - 1 : -1;
+  PlayTrace(trace_data_ + sizeof(TraceHeader),
+            trace_size_ - sizeof(TraceHeader), TracePlaybackMode::kUntilEnd,
+            clear_caches);
+}
+
+void TracePlayer::PlayFrame(int target_frame, bool clear_caches) {
+  current_frame_index_ = target_frame;
+  const Frame* frame = current_frame();
+  assert_not_null(frame);
+  current_command_index_ = int(frame->commands.size()) - 1;
+  assert_true(frame->start_ptr <= frame->end_ptr);
+  PlayTrace(frame->start_ptr, frame->end_ptr - frame->start_ptr,
+            TracePlaybackMode::kUntilEnd, clear_caches);
+}
+
 void TracePlayer::WaitOnPlayback() {
   xe::threading::Wait(playback_event_.get(), true);
 }
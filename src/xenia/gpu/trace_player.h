@@ -43,6 +43,13 @@ class TracePlayer : public TraceReader {
 
   void SeekFrame(int target_frame);
   void SeekCommand(int target_command);
+  // Plays all the frames of the trace from the beginning, without breaking on
+  // swaps.
+  void PlayEntireTrace(bool clear_caches);
+  // Plays a single frame of the trace until its end. To replay the trace with
+  // consistent guest state, the frames must be played in order, starting from
+  // the first one.
+  void PlayFrame(int target_frame, bool clear_caches);
 
   void WaitOnPlayback();
 
@@ -23,7 +23,7 @@ static const char kTraceExtension[] = "xtr";
 // Other changes besides the file format may require bumps, such as
 // anything that changes what is recorded into the files (new GPU
 // command processor commands, etc).
-constexpr uint32_t kTraceFormatVersion = 1;
+constexpr uint32_t kTraceFormatVersion = 2;
 
 // Trace file header identifying information about the trace.
 // This must be positioned at the start of the file and must only occur once.
@@ -95,6 +95,20 @@ enum class MemoryEncodingFormat {
   kNone,
   // Data is compressed with third_party/snappy.
   kSnappy,
+  // Data is identical to data stored earlier in the trace file, and is encoded
+  // as a MemoryReference to it.
+  kReference,
+};
+
+// Location of earlier encoded data in the trace file, for large buffers
+// recorded multiple times with the same contents.
+struct MemoryReference {
+  // Offset of the encoded data from the beginning of the trace file.
+  uint64_t offset;
+  // Encoding format of the referenced data, never kReference.
+  MemoryEncodingFormat encoding_format;
+  // Number of bytes the referenced data occupies in the trace file.
+  uint32_t encoded_length;
 };
 
 // Represents the GPU reading or writing data from or to memory.
@@ -10,6 +10,7 @@
 #include "xenia/gpu/trace_reader.h"
 
 #include <cinttypes>
+#include <cstring>
 
 #include "third_party/snappy/snappy.h"
 #include "xenia/base/filesystem.h"
@@ -248,6 +249,21 @@ bool TraceReader::DecompressMemory(MemoryEncodingFormat encoding_format,
     case MemoryEncodingFormat::kSnappy:
       return snappy::RawUncompress(reinterpret_cast<const char*>(src), src_size,
                                    reinterpret_cast<char*>(dest));
+    case MemoryEncodingFormat::kReference: {
+      MemoryReference reference;
+      if (src_size != sizeof(reference)) {
+        return false;
+      }
+      std::memcpy(&reference, src, sizeof(reference));
+      if (reference.encoding_format == MemoryEncodingFormat::kReference ||
+          reference.offset > trace_size_ ||
+          trace_size_ - reference.offset < reference.encoded_length) {
+        return false;
+      }
+      return DecompressMemory(reference.encoding_format,
+                              trace_data_ + reference.offset,
+                              reference.encoded_length, dest, dest_size);
+    }
     default:
       assert_unhandled_case(encoding_format);
       return false;
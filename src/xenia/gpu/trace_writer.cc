@@ -9,10 +9,11 @@
 
 #include "xenia/gpu/trace_writer.h"
 
+#include <cstddef>
 #include <cstring>
 #include <memory>
+#include <utility>
 
-#include "third_party/snappy/snappy-sinksource.h"
 #include "third_party/snappy/snappy.h"
 
 #include "build/version.h"
@@ -20,6 +21,7 @@
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/string.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/gpu/registers.h"
 #include "xenia/gpu/xenos.h"
 
@@ -29,7 +31,7 @@ namespace gpu {
 TraceWriter::TraceWriter(uint8_t* membase)
     : membase_(membase), file_(nullptr) {}
 
-TraceWriter::~TraceWriter() = default;
+TraceWriter::~TraceWriter() { Close(); }
 
 bool TraceWriter::Open(const std::filesystem::path& path, uint32_t title_id) {
   Close();
@@ -52,6 +54,18 @@ bool TraceWriter::Open(const std::filesystem::path& path, uint32_t title_id) {
               sizeof(header.build_commit_sha));
   header.title_id = title_id;
   fwrite(&header, sizeof(header), 1, file_);
+  file_offset_ = sizeof(header);
+
+  writer_shutdown_ = false;
+  writer_thread_ =
+      xe::threading::Thread::Create({}, [this]() { WriterThread(); });
+  if (!writer_thread_) {
+    XELOGE("Failed to create the GPU trace writer thread");
+    fclose(file_);
+    file_ = nullptr;
+    return false;
+  }
+  writer_thread_->set_name("GPU Trace Writer");
 
   cached_memory_reads_.clear();
   return true;
@@ -59,7 +73,12 @@ bool TraceWriter::Open(const std::filesystem::path& path, uint32_t title_id) {
 
 void TraceWriter::Flush() {
   if (file_) {
-    fflush(file_);
+    SubmitCurrentBlock();
+    {
+      std::lock_guard<std::mutex> lock(writer_mutex_);
+      writer_flush_requested_ = true;
+    }
+    writer_request_cond_.notify_one();
   }
 }
 
@@ -67,12 +86,173 @@ void TraceWriter::Close() {
   if (file_) {
     cached_memory_reads_.clear();
 
+    SubmitCurrentBlock();
+    {
+      std::lock_guard<std::mutex> lock(writer_mutex_);
+      writer_shutdown_ = true;
+    }
+    writer_request_cond_.notify_all();
+    xe::threading::Wait(writer_thread_.get(), false);
+    writer_thread_.reset();
+    writer_flush_requested_ = false;
+    blocks_free_.clear();
+    written_payloads_.clear();
+    compressed_payload_.clear();
+    compressed_payload_.shrink_to_fit();
+
     fflush(file_);
     fclose(file_);
     file_ = nullptr;
   }
 }
 
+void TraceWriter::AppendRaw(const void* data, size_t size) {
+  if (!current_block_) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    if (!blocks_free_.empty()) {
+      current_block_ = std::move(blocks_free_.back());
+      blocks_free_.pop_back();
+    } else {
+      current_block_ = std::make_unique<Block>();
+    }
+  }
+  const uint8_t* data_bytes = reinterpret_cast<const uint8_t*>(data);
+  current_block_->data.insert(current_block_->data.end(), data_bytes,
+                              data_bytes + size);
+}
+
+template <typename Command>
+uint8_t* TraceWriter::AppendPayloadCommand(const Command& cmd, uint32_t length,
+                                           bool compress) {
+  AppendRaw(&cmd, sizeof(cmd));
+  Payload& payload = current_block_->payloads.emplace_back();
+  payload.header_offset = current_block_->data.size() - sizeof(cmd);
+  payload.header_size = uint32_t(sizeof(cmd));
+  payload.encoding_format_offset = uint32_t(offsetof(Command, encoding_format));
+  payload.encoded_length_offset = uint32_t(offsetof(Command, encoded_length));
+  payload.length = length;
+  payload.compress = compress;
+  current_block_->data.resize(current_block_->data.size() + length);
+  return current_block_->data.data() + current_block_->data.size() - length;
+}
+
+void TraceWriter::SubmitCurrentBlock() {
+  if (!current_block_ || current_block_->data.empty()) {
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> lock(writer_mutex_);
+    // Bound the memory usage if the writer thread can't keep up.
+    writer_completion_cond_.wait(lock, [this]() {
+      return blocks_pending_.size() < kMaxPendingBlocks;
+    });
+    blocks_pending_.push_back(std::move(current_block_));
+  }
+  writer_request_cond_.notify_one();
+}
+
+void TraceWriter::WriterThread() {
+  while (true) {
+    std::unique_ptr<Block> block;
+    bool flush = false;
+    {
+      std::unique_lock<std::mutex> lock(writer_mutex_);
+      writer_request_cond_.wait(lock, [this]() {
+        return writer_shutdown_ || writer_flush_requested_ ||
+               !blocks_pending_.empty();
+      });
+      if (blocks_pending_.empty()) {
+        if (writer_shutdown_) {
+          // Shutting down with everything written.
+          return;
+        }
+        // Flushing once everything requested before has been written.
+        writer_flush_requested_ = false;
+        flush = true;
+      } else {
+        block = std::move(blocks_pending_.front());
+        blocks_pending_.pop_front();
+      }
+    }
+    if (flush) {
+      fflush(file_);
+      continue;
+    }
+    WriteBlock(*block);
+    block->data.clear();
+    block->payloads.clear();
+    {
+      std::lock_guard<std::mutex> lock(writer_mutex_);
+      blocks_free_.push_back(std::move(block));
+    }
+    writer_completion_cond_.notify_all();
+  }
+}
+
+void TraceWriter::WriteBlock(Block& block) {
+  uint8_t* data = block.data.data();
+  size_t raw_start = 0;
+  for (const Payload& payload : block.payloads) {
+    WriteToFile(data + raw_start, payload.header_offset - raw_start);
+    uint8_t* header = data + payload.header_offset;
+    const uint8_t* payload_data = header + payload.header_size;
+    raw_start = payload.header_offset + payload.header_size + payload.length;
+
+    MemoryEncodingFormat encoding_format = MemoryEncodingFormat::kNone;
+    const void* encoded_data = payload_data;
+    uint32_t encoded_length = payload.length;
+    // Large buffers, such as textures and vertex data, are often recorded
+    // multiple times with the same contents - store them only once.
+    bool deduplicate = payload.length > compression_threshold_;
+    uint64_t hash = 0;
+    MemoryReference reference;
+    if (deduplicate) {
+      hash = XXH3_64bits(payload_data, payload.length);
+      auto written_it = written_payloads_.find(hash);
+      if (written_it != written_payloads_.end() &&
+          written_it->second.length == payload.length) {
+        reference.offset = written_it->second.offset;
+        reference.encoding_format = written_it->second.encoding_format;
+        reference.encoded_length = written_it->second.encoded_length;
+        encoding_format = MemoryEncodingFormat::kReference;
+        encoded_data = &reference;
+        encoded_length = uint32_t(sizeof(reference));
+      }
+    }
+    if (encoding_format != MemoryEncodingFormat::kReference &&
+        payload.compress) {
+      snappy::Compress(reinterpret_cast<const char*>(payload_data),
+                       payload.length, &compressed_payload_);
+      encoding_format = MemoryEncodingFormat::kSnappy;
+      encoded_data = compressed_payload_.data();
+      encoded_length = uint32_t(compressed_payload_.size());
+    }
+
+    std::memcpy(header + payload.encoding_format_offset, &encoding_format,
+                sizeof(encoding_format));
+    std::memcpy(header + payload.encoded_length_offset, &encoded_length,
+                sizeof(encoded_length));
+    WriteToFile(header, payload.header_size);
+    if (deduplicate && encoding_format != MemoryEncodingFormat::kReference) {
+      WrittenPayload& written_payload = written_payloads_[hash];
+      written_payload.offset = file_offset_;
+      written_payload.encoding_format = encoding_format;
+      written_payload.encoded_length = encoded_length;
+      written_payload.length = payload.length;
+    }
+    WriteToFile(encoded_data, encoded_length);
+  }
+  WriteToFile(data + raw_start, block.data.size() - raw_start);
+}
+
+void TraceWriter::WriteToFile(const void* data, size_t size) {
+  if (!size) {
+    return;
+  }
+  fwrite(data, 1, size, file_);
+  file_offset_ += size;
+}
+
 void TraceWriter::WritePrimaryBufferStart(uint32_t base_ptr, uint32_t count) {
   if (!file_) {
     return;
@@ -82,7 +262,7 @@ void TraceWriter::WritePrimaryBufferStart(uint32_t base_ptr, uint32_t count) {
       base_ptr,
       0,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  AppendRaw(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WritePrimaryBufferEnd() {
@@ -92,7 +272,7 @@ void TraceWriter::WritePrimaryBufferEnd() {
   PrimaryBufferEndCommand cmd = {
       TraceCommandType::kPrimaryBufferEnd,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  AppendRaw(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WriteIndirectBufferStart(uint32_t base_ptr, uint32_t count) {
@@ -104,7 +284,7 @@ void TraceWriter::WriteIndirectBufferStart(uint32_t base_ptr, uint32_t count) {
       base_ptr,
       0,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  AppendRaw(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WriteIndirectBufferEnd() {
@@ -114,7 +294,7 @@ void TraceWriter::WriteIndirectBufferEnd() {
   IndirectBufferEndCommand cmd = {
       TraceCommandType::kIndirectBufferEnd,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  AppendRaw(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WritePacketStart(uint32_t base_ptr, uint32_t count) {
@@ -126,8 +306,8 @@ void TraceWriter::WritePacketStart(uint32_t base_ptr, uint32_t count) {
       base_ptr,
       count,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
-  fwrite(membase_ + base_ptr, 4, count, file_);
+  AppendRaw(&cmd, sizeof(cmd));
+  AppendRaw(membase_ + base_ptr, sizeof(uint32_t) * count);
 }
 
 void TraceWriter::WritePacketEnd() {
@@ -137,7 +317,10 @@ void TraceWriter::WritePacketEnd() {
   PacketEndCommand cmd = {
       TraceCommandType::kPacketEnd,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  AppendRaw(&cmd, sizeof(cmd));
+  if (current_block_->data.size() >= kBlockSubmitSize) {
+    SubmitCurrentBlock();
+  }
 }
 
 void TraceWriter::WriteMemoryRead(uint32_t base_ptr, size_t length,
@@ -182,18 +365,6 @@ void TraceWriter::WriteMemoryWrite(uint32_t base_ptr, size_t length,
                      host_ptr);
 }
 
-class SnappySink : public snappy::Sink {
- public:
-  SnappySink(FILE* file) : file_(file) {}
-
-  void Append(const char* bytes, size_t n) override {
-    fwrite(bytes, 1, n, file_);
-  }
-
- private:
-  FILE* file_ = nullptr;
-};
-
 void TraceWriter::WriteMemoryCommand(TraceCommandType type, uint32_t base_ptr,
                                      size_t length, const void* host_ptr) {
   MemoryCommand cmd = {};
@@ -206,62 +377,28 @@ void TraceWriter::WriteMemoryCommand(TraceCommandType type, uint32_t base_ptr,
     host_ptr = membase_ + cmd.base_ptr;
   }
 
+  // The data is copied now as the memory may be modified later, and encoded on
+  // the writer thread.
   bool compress = compress_output_ && length > compression_threshold_;
-  if (compress) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
-    cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    snappy::ByteArraySource snappy_source(
-        reinterpret_cast<const char*>(host_ptr), cmd.decoded_length);
-    SnappySink snappy_sink(file_);
-    cmd.encoded_length =
-        static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
-  } else {
-    // Uncompressed - write buffer directly to the file.
-    cmd.encoding_format = MemoryEncodingFormat::kNone;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(host_ptr, 1, cmd.decoded_length, file_);
+  std::memcpy(AppendPayloadCommand(cmd, cmd.decoded_length, compress),
+              host_ptr, cmd.decoded_length);
+  if (current_block_->data.size() >= kBlockSubmitSize) {
+    SubmitCurrentBlock();
   }
 }
 
 void TraceWriter::WriteEdramSnapshot(const void* snapshot) {
+  if (!file_) {
+    return;
+  }
   EdramSnapshotCommand cmd = {};
   cmd.type = TraceCommandType::kEdramSnapshot;
-
-  if (compress_output_) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
-    cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    snappy::ByteArraySource snappy_source(
-        reinterpret_cast<const char*>(snapshot), xenos::kEdramSizeBytes);
-    SnappySink snappy_sink(file_);
-    cmd.encoded_length =
-        static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
-  } else {
-    // Uncompressed - write buffer directly to the file.
-    cmd.encoding_format = MemoryEncodingFormat::kNone;
-    cmd.encoded_length = xenos::kEdramSizeBytes;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(snapshot, 1, xenos::kEdramSizeBytes, file_);
-  }
+  cmd.encoding_format = MemoryEncodingFormat::kNone;
+  cmd.encoded_length = xenos::kEdramSizeBytes;
+  std::memcpy(
+      AppendPayloadCommand(cmd, xenos::kEdramSizeBytes, compress_output_),
+      snapshot, xenos::kEdramSizeBytes);
+  SubmitCurrentBlock();
 }
 
 void TraceWriter::WriteEvent(EventCommand::Type event_type) {
@@ -272,13 +409,18 @@ void TraceWriter::WriteEvent(EventCommand::Type event_type) {
       TraceCommandType::kEvent,
       event_type,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  AppendRaw(&cmd, sizeof(cmd));
+  // Swaps are a good point to hand the frame over for writing.
+  SubmitCurrentBlock();
 }
 
 void TraceWriter::WriteRegisters(uint32_t first_register,
                                  const uint32_t* register_values,
                                  uint32_t register_count,
                                  bool execute_callbacks_on_play) {
+  if (!file_) {
+    return;
+  }
   RegistersCommand cmd = {};
   cmd.type = TraceCommandType::kRegisters;
   cmd.first_register = first_register;
@@ -286,37 +428,20 @@ void TraceWriter::WriteRegisters(uint32_t first_register,
   cmd.execute_callbacks = execute_callbacks_on_play;
 
   uint32_t uncompressed_length = uint32_t(sizeof(uint32_t) * register_count);
-  if (compress_output_) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
-    cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    snappy::ByteArraySource snappy_source(
-        reinterpret_cast<const char*>(register_values), uncompressed_length);
-    SnappySink snappy_sink(file_);
-    cmd.encoded_length =
-        static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
-  } else {
-    // Uncompressed - write the values directly to the file.
-    cmd.encoding_format = MemoryEncodingFormat::kNone;
-    cmd.encoded_length = uncompressed_length;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(register_values, 1, uncompressed_length, file_);
-  }
+  cmd.encoding_format = MemoryEncodingFormat::kNone;
+  cmd.encoded_length = uncompressed_length;
+  std::memcpy(
+      AppendPayloadCommand(cmd, uncompressed_length, compress_output_),
+      register_values, uncompressed_length);
 }
 
 void TraceWriter::WriteGammaRamp(
     const reg::DC_LUT_30_COLOR* gamma_ramp_256_entry_table,
     const reg::DC_LUT_PWL_DATA* gamma_ramp_pwl_rgb,
     uint32_t gamma_ramp_rw_component) {
+  if (!file_) {
+    return;
+  }
   GammaRampCommand cmd = {};
   cmd.type = TraceCommandType::kGammaRamp;
   cmd.rw_component = uint8_t(gamma_ramp_rw_component);
@@ -327,40 +452,14 @@ void TraceWriter::WriteGammaRamp(
       sizeof(reg::DC_LUT_PWL_DATA) * 3 * 128;
   constexpr uint32_t kUncompressedLength =
       k256EntryTableUncompressedLength + kPWLUncompressedLength;
-  if (compress_output_) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
-    cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    {
-      std::unique_ptr<char[]> gamma_ramps(new char[kUncompressedLength]);
-      std::memcpy(gamma_ramps.get(), gamma_ramp_256_entry_table,
-                  k256EntryTableUncompressedLength);
-      std::memcpy(gamma_ramps.get() + k256EntryTableUncompressedLength,
-                  gamma_ramp_pwl_rgb, kPWLUncompressedLength);
-      snappy::ByteArraySource snappy_source(gamma_ramps.get(),
-                                            kUncompressedLength);
-      SnappySink snappy_sink(file_);
-      cmd.encoded_length =
-          static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-    }
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
-  } else {
-    // Uncompressed - write the values directly to the file.
-    cmd.encoding_format = MemoryEncodingFormat::kNone;
-    cmd.encoded_length = kUncompressedLength;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(gamma_ramp_256_entry_table, 1, k256EntryTableUncompressedLength,
-           file_);
-    fwrite(gamma_ramp_pwl_rgb, 1, kPWLUncompressedLength, file_);
-  }
+  cmd.encoding_format = MemoryEncodingFormat::kNone;
+  cmd.encoded_length = kUncompressedLength;
+  uint8_t* gamma_ramps =
+      AppendPayloadCommand(cmd, kUncompressedLength, compress_output_);
+  std::memcpy(gamma_ramps, gamma_ramp_256_entry_table,
+              k256EntryTableUncompressedLength);
+  std::memcpy(gamma_ramps + k256EntryTableUncompressedLength,
+              gamma_ramp_pwl_rgb, kPWLUncompressedLength);
 }
 
 }  //  namespace gpu
@@ -10,10 +10,20 @@
 #ifndef XENIA_GPU_TRACE_WRITER_H_
 #define XENIA_GPU_TRACE_WRITER_H_
 
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
 #include <filesystem>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+#include "xenia/base/threading.h"
 #include "xenia/gpu/registers.h"
 #include "xenia/gpu/trace_protocol.h"
 
@@ -28,6 +38,8 @@ class TraceWriter {
   bool is_open() const { return file_ != nullptr; }
 
   bool Open(const std::filesystem::path& path, uint32_t title_id);
+  // Hands the recorded commands over to the writer thread, and makes it flush
+  // the file once they're written, without waiting for that.
   void Flush();
   void Close();
 
@@ -52,6 +64,48 @@ class TraceWriter {
                       uint32_t gamma_ramp_rw_component);
 
  private:
+  // Commands are recorded to blocks with the raw data on the thread writing
+  // the trace, and are encoded and written to the file on a separate thread,
+  // so compression and file access don't slow down emulation much.
+  struct Payload {
+    // Offset of the command header in the block data, followed by the raw
+    // payload data.
+    size_t header_offset;
+    uint32_t header_size;
+    // Offsets of the MemoryEncodingFormat and the encoded length fields in the
+    // command header, filled on the writer thread.
+    uint32_t encoding_format_offset;
+    uint32_t encoded_length_offset;
+    uint32_t length;
+    bool compress;
+  };
+  struct Block {
+    std::vector<uint8_t> data;
+    std::vector<Payload> payloads;
+  };
+  // A block is submitted to the writer thread once it has this much data.
+  static constexpr size_t kBlockSubmitSize = 4 * 1024 * 1024;
+  // Recording waits for the writer thread if this many blocks are pending.
+  static constexpr size_t kMaxPendingBlocks = 16;
+
+  struct WrittenPayload {
+    uint64_t offset;
+    MemoryEncodingFormat encoding_format;
+    uint32_t encoded_length;
+    uint32_t length;
+  };
+
+  void AppendRaw(const void* data, size_t size);
+  // Returns where the payload data needs to be copied.
+  template <typename Command>
+  uint8_t* AppendPayloadCommand(const Command& cmd, uint32_t length,
+                                bool compress);
+  void SubmitCurrentBlock();
+
+  void WriterThread();
+  void WriteBlock(Block& block);
+  void WriteToFile(const void* data, size_t size);
+
   void WriteMemoryCommand(TraceCommandType type, uint32_t base_ptr,
                           size_t length, const void* host_ptr = nullptr);
 
@@ -61,6 +115,27 @@ class TraceWriter {
 
   bool compress_output_ = true;
   size_t compression_threshold_ = 1024;  // Min. number of bytes to compress.
+
+  std::unique_ptr<Block> current_block_;
+
+  std::unique_ptr<xe::threading::Thread> writer_thread_;
+  std::mutex writer_mutex_;
+  // Notified when a block is submitted or on shutdown.
+  std::condition_variable writer_request_cond_;
+  // Notified when a block has been written.
+  std::condition_variable writer_completion_cond_;
+  std::deque<std::unique_ptr<Block>> blocks_pending_;
+  std::vector<std::unique_ptr<Block>> blocks_free_;
+  bool writer_flush_requested_ = false;
+  bool writer_shutdown_ = false;
+
+  // Writer thread state.
+  uint64_t file_offset_ = 0;
+  // Payloads larger than compression_threshold_ already written to the file,
+  // by the hash of the raw data, for referencing when the same data is
+  // recorded again.
+  std::unordered_map<uint64_t, WrittenPayload> written_payloads_;
+  std::string compressed_payload_;
 };
 
 }  // namespace gpu
@@ -29,7 +29,10 @@ DeferredCommandBuffer::DeferredCommandBuffer(
   command_stream_.reserve(initial_size / sizeof(uintmax_t));
 }
 
-void DeferredCommandBuffer::Reset() { command_stream_.clear(); }
+void DeferredCommandBuffer::Reset() {
+  command_stream_.clear();
+  last_index_buffer_command_offset_ = SIZE_MAX;
+}
 
 void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
 #if XE_GPU_FINE_GRAINED_DRAW_SCOPES
@@ -40,6 +43,8 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
       command_processor_.GetVulkanDevice()->functions();
   const uintmax_t* stream = command_stream_.data();
   size_t stream_remaining = command_stream_.size();
+  // Whether the bound graphics pipeline has failed to be created.
+  bool graphics_pipeline_missing = false;
   while (stream_remaining) {
     const CommandHeader& header =
         *reinterpret_cast<const CommandHeader*>(stream);
@@ -102,6 +107,9 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
         auto& args = *reinterpret_cast<const ArgsVkBindPipeline*>(stream);
         dfn.vkCmdBindPipeline(command_buffer, args.pipeline_bind_point,
                               args.pipeline);
+        if (args.pipeline_bind_point == VK_PIPELINE_BIND_POINT_GRAPHICS) {
+          graphics_pipeline_missing = false;
+        }
       } break;
 
       case Command::kVkBindVertexBuffers: {
@@ -173,12 +181,18 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
       } break;
 
       case Command::kVkDraw: {
+        if (graphics_pipeline_missing) {
+          break;
+        }
         auto& args = *reinterpret_cast<const ArgsVkDraw*>(stream);
         dfn.vkCmdDraw(command_buffer, args.vertex_count, args.instance_count,
                       args.first_vertex, args.first_instance);
       } break;
 
       case Command::kVkDrawIndexed: {
+        if (graphics_pipeline_missing) {
+          break;
+        }
         auto& args = *reinterpret_cast<const ArgsVkDrawIndexed*>(stream);
         dfn.vkCmdDrawIndexed(command_buffer, args.index_count,
                              args.instance_count, args.first_index,
@@ -236,6 +250,12 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
                                    sizeof(ArgsVkPushConstants));
       } break;
 
+      case Command::kVkResetQueryPool: {
+        auto& args = *reinterpret_cast<const ArgsVkResetQueryPool*>(stream);
+        dfn.vkCmdResetQueryPool(command_buffer, args.query_pool,
+                                args.first_query, args.query_count);
+      } break;
+
       case Command::kVkSetBlendConstants: {
         auto& args = *reinterpret_cast<const ArgsVkSetBlendConstants*>(stream);
         dfn.vkCmdSetBlendConstants(command_buffer, args.blend_constants);
@@ -287,6 +307,22 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
                 xe::align(sizeof(ArgsVkSetViewport), alignof(VkViewport))));
       } break;
 
+      case Command::kVkWriteTimestamp: {
+        auto& args = *reinterpret_cast<const ArgsVkWriteTimestamp*>(stream);
+        dfn.vkCmdWriteTimestamp(command_buffer, args.pipeline_stage,
+                                args.query_pool, args.query);
+      } break;
+
+      case Command::kBindPipelineHandle: {
+        VkPipeline pipeline = VulkanPipelineCache::GetVulkanPipelineByHandle(
+            *reinterpret_cast<const void* const*>(stream));
+        graphics_pipeline_missing = pipeline == VK_NULL_HANDLE;
+        if (!graphics_pipeline_missing) {
+          dfn.vkCmdBindPipeline(command_buffer,
+                                VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        }
+      } break;
+
       default:
         assert_unhandled_case(header.command);
         break;
@@ -349,6 +385,51 @@ void DeferredCommandBuffer::CmdVkPipelineBarrier(
   }
 }
 
+bool DeferredCommandBuffer::AppendToLastIndexedDraw(
+    VkBuffer buffer, VkDeviceSize offset, VkIndexType index_type,
+    uint32_t index_count, uint32_t primitive_vertex_count) {
+  size_t index_buffer_offset = last_index_buffer_command_offset_;
+  if (index_buffer_offset == SIZE_MAX) {
+    return false;
+  }
+  const CommandHeader& index_buffer_header =
+      *reinterpret_cast<const CommandHeader*>(command_stream_.data() +
+                                              index_buffer_offset);
+  size_t draw_offset = index_buffer_offset + kCommandHeaderSizeElements +
+                       index_buffer_header.arguments_size_elements;
+  if (draw_offset >= command_stream_.size()) {
+    return false;
+  }
+  const CommandHeader& draw_header = *reinterpret_cast<const CommandHeader*>(
+      command_stream_.data() + draw_offset);
+  if (draw_header.command != Command::kVkDrawIndexed ||
+      draw_offset + kCommandHeaderSizeElements +
+              draw_header.arguments_size_elements !=
+          command_stream_.size()) {
+    return false;
+  }
+  const auto& index_buffer_args =
+      *reinterpret_cast<const ArgsVkBindIndexBuffer*>(
+          command_stream_.data() + index_buffer_offset +
+          kCommandHeaderSizeElements);
+  auto& draw_args = *reinterpret_cast<ArgsVkDrawIndexed*>(
+      command_stream_.data() + draw_offset + kCommandHeaderSizeElements);
+  if (index_buffer_args.buffer != buffer ||
+      index_buffer_args.index_type != index_type ||
+      draw_args.instance_count != 1 || draw_args.first_index ||
+      draw_args.vertex_offset || draw_args.first_instance ||
+      draw_args.index_count % primitive_vertex_count ||
+      index_buffer_args.offset +
+              VkDeviceSize(draw_args.index_count) *
+                  (index_type == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t)
+                                                      : sizeof(uint32_t)) !=
+          offset) {
+    return false;
+  }
+  draw_args.index_count += index_count;
+  return true;
+}
+
 void* DeferredCommandBuffer::WriteCommand(Command command,
                                           size_t arguments_size_bytes) {
   size_t arguments_size_elements =
@@ -13,6 +13,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <utility>
 #include <vector>
 
 #include "xenia/base/assert.h"
@@ -32,6 +33,14 @@ class DeferredCommandBuffer {
 
   void Reset();
   void Execute(VkCommandBuffer command_buffer);
+  // Exchanges the recorded commands with another deferred command buffer of
+  // the same command processor, without copying them.
+  void Swap(DeferredCommandBuffer& other) {
+    assert_true(&command_processor_ == &other.command_processor_);
+    command_stream_.swap(other.command_stream_);
+    std::swap(last_index_buffer_command_offset_,
+              other.last_index_buffer_command_offset_);
+  }
 
   // render_pass_begin->pNext of all barriers must be null.
   void CmdVkBeginRenderPass(const VkRenderPassBeginInfo* render_pass_begin,
@@ -94,6 +103,7 @@ class DeferredCommandBuffer {
 
   void CmdVkBindIndexBuffer(VkBuffer buffer, VkDeviceSize offset,
                             VkIndexType index_type) {
+    last_index_buffer_command_offset_ = command_stream_.size();
     auto& args = *reinterpret_cast<ArgsVkBindIndexBuffer*>(WriteCommand(
         Command::kVkBindIndexBuffer, sizeof(ArgsVkBindIndexBuffer)));
     args.buffer = buffer;
@@ -101,6 +111,17 @@ class DeferredCommandBuffer {
     args.index_type = index_type;
   }
 
+  // If the last two commands are binding an index buffer and drawing from its
+  // beginning as one instance, and the new indices directly follow the drawn
+  // ones in the same buffer and have the same type, extends the last draw to
+  // the new indices instead of recording a new draw. The previous index count
+  // must be a multiple of primitive_vertex_count so primitives don't cross the
+  // boundary between the draws. Returns whether the indices have been
+  // appended.
+  bool AppendToLastIndexedDraw(VkBuffer buffer, VkDeviceSize offset,
+                               VkIndexType index_type, uint32_t index_count,
+                               uint32_t primitive_vertex_count);
+
   void CmdVkBindPipeline(VkPipelineBindPoint pipeline_bind_point,
                          VkPipeline pipeline) {
     auto& args = *reinterpret_cast<ArgsVkBindPipeline*>(
@@ -109,6 +130,16 @@ class DeferredCommandBuffer {
     args.pipeline = pipeline;
   }
 
+  // Binds a graphics pipeline from the VulkanPipelineCache, which may still be
+  // being created while the command buffer is being recorded. Draws are
+  // skipped until the next graphics pipeline binding if the creation has
+  // failed.
+  void CmdBindPipelineHandle(const void* pipeline_handle) {
+    auto& arg = *reinterpret_cast<const void**>(
+        WriteCommand(Command::kBindPipelineHandle, sizeof(const void*)));
+    arg = pipeline_handle;
+  }
+
   void CmdVkBindVertexBuffers(uint32_t first_binding, uint32_t binding_count,
                               const VkBuffer* buffers,
                               const VkDeviceSize* offsets) {
@@ -289,6 +320,15 @@ class DeferredCommandBuffer {
     std::memcpy(args_ptr + sizeof(ArgsVkPushConstants), values, size);
   }
 
+  void CmdVkResetQueryPool(VkQueryPool query_pool, uint32_t first_query,
+                           uint32_t query_count) {
+    auto& args = *reinterpret_cast<ArgsVkResetQueryPool*>(WriteCommand(
+        Command::kVkResetQueryPool, sizeof(ArgsVkResetQueryPool)));
+    args.query_pool = query_pool;
+    args.first_query = first_query;
+    args.query_count = query_count;
+  }
+
   void CmdVkSetBlendConstants(const float* blend_constants) {
     auto& args = *reinterpret_cast<ArgsVkSetBlendConstants*>(WriteCommand(
         Command::kVkSetBlendConstants, sizeof(ArgsVkSetBlendConstants)));
@@ -358,6 +398,15 @@ class DeferredCommandBuffer {
                 sizeof(VkViewport) * viewport_count);
   }
 
+  void CmdVkWriteTimestamp(VkPipelineStageFlagBits pipeline_stage,
+                           VkQueryPool query_pool, uint32_t query) {
+    auto& args = *reinterpret_cast<ArgsVkWriteTimestamp*>(WriteCommand(
+        Command::kVkWriteTimestamp, sizeof(ArgsVkWriteTimestamp)));
+    args.pipeline_stage = pipeline_stage;
+    args.query_pool = query_pool;
+    args.query = query;
+  }
+
  private:
   enum class Command {
     kVkBeginRenderPass,
@@ -375,6 +424,7 @@ class DeferredCommandBuffer {
     kVkEndRenderPass,
     kVkPipelineBarrier,
     kVkPushConstants,
+    kVkResetQueryPool,
     kVkSetBlendConstants,
     kVkSetDepthBias,
     kVkSetScissor,
@@ -382,6 +432,8 @@ class DeferredCommandBuffer {
     kVkSetStencilReference,
     kVkSetStencilWriteMask,
     kVkSetViewport,
+    kVkWriteTimestamp,
+    kBindPipelineHandle,
   };
 
   struct CommandHeader {
@@ -507,6 +559,12 @@ class DeferredCommandBuffer {
     // Followed by `size` bytes of values.
   };
 
+  struct ArgsVkResetQueryPool {
+    VkQueryPool query_pool;
+    uint32_t first_query;
+    uint32_t query_count;
+  };
+
   struct ArgsVkSetBlendConstants {
     float blend_constants[4];
   };
@@ -536,12 +594,21 @@ class DeferredCommandBuffer {
     static_assert(alignof(VkViewport) <= alignof(uintmax_t));
   };
 
+  struct ArgsVkWriteTimestamp {
+    VkPipelineStageFlagBits pipeline_stage;
+    VkQueryPool query_pool;
+    uint32_t query;
+  };
+
   void* WriteCommand(Command command, size_t arguments_size_bytes);
 
   const VulkanCommandProcessor& command_processor_;
 
   // uintmax_t to ensure uint64_t and pointer alignment of all structures.
   std::vector<uintmax_t> command_stream_;
+  // Offset of the header of the last kVkBindIndexBuffer in command_stream_, or
+  // SIZE_MAX if not recorded since the last reset.
+  size_t last_index_buffer_command_offset_ = SIZE_MAX;
 };
 
 }  // namespace vulkan
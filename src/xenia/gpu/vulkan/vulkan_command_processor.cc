@@ -19,9 +19,11 @@
 
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/gpu/draw_util.h"
 #include "xenia/gpu/gpu_flags.h"
 #include "xenia/gpu/registers.h"
@@ -35,6 +37,13 @@
 #include "xenia/ui/vulkan/vulkan_presenter.h"
 #include "xenia/ui/vulkan/vulkan_util.h"
 
+DEFINE_bool(
+    vulkan_submission_thread, false,
+    "Record the Vulkan command buffers from the deferred command buffers and "
+    "submit them on a separate thread, so the command processor thread can "
+    "process the guest commands of the next submission meanwhile.",
+    "Vulkan");
+
 namespace xe {
 namespace gpu {
 namespace vulkan {
@@ -70,6 +79,7 @@ VulkanCommandProcessor::VulkanCommandProcessor(
     VulkanGraphicsSystem* graphics_system, kernel::KernelState* kernel_state)
     : CommandProcessor(graphics_system, kernel_state),
       deferred_command_buffer_(*this),
+      submission_thread_deferred_command_buffer_(*this),
       transient_descriptor_allocator_uniform_buffer_(
           static_cast<const ui::vulkan::VulkanProvider*>(
               graphics_system->provider())
@@ -97,6 +107,37 @@ void VulkanCommandProcessor::ClearCaches() {
   cache_clear_requested_ = true;
 }
 
+void VulkanCommandProcessor::GetCacheStatistics(
+    CacheStatistics& statistics_out) const {
+  statistics_out.pipelines_created =
+      pipeline_cache_ ? pipeline_cache_->pipelines_created() : 0;
+  statistics_out.textures_created =
+      texture_cache_ ? texture_cache_->textures_created() : 0;
+  statistics_out.texture_loads =
+      texture_cache_ ? texture_cache_->texture_loads() : 0;
+  statistics_out.texture_reloads_skipped =
+      texture_cache_ ? texture_cache_->texture_reloads_skipped() : 0;
+  if (render_target_cache_) {
+    statistics_out.render_passes_begun =
+        render_target_cache_->render_passes_begun();
+    statistics_out.attachment_load_bytes =
+        render_target_cache_->attachment_load_bytes();
+    statistics_out.attachment_store_bytes =
+        render_target_cache_->attachment_store_bytes();
+  }
+}
+
+void VulkanCommandProcessor::AwaitHostGpuIdle() {
+  EndSubmission(false);
+  AwaitAllQueueOperationsCompletion();
+}
+
+void VulkanCommandProcessor::InitializeShaderStorage(
+    const std::filesystem::path& cache_root, uint32_t title_id, bool blocking) {
+  CommandProcessor::InitializeShaderStorage(cache_root, title_id, blocking);
+  pipeline_cache_->InitializeShaderStorage(cache_root, title_id, blocking);
+}
+
 void VulkanCommandProcessor::TracePlaybackWroteMemory(uint32_t base_ptr,
                                                       uint32_t length) {
   shared_memory_->MemoryInvalidationCallback(base_ptr, length, true);
@@ -1017,21 +1058,87 @@ bool VulkanCommandProcessor::SetupContext() {
     return false;
   }
 
+  // GPU profiling timestamps - if unavailable, the GPU scopes will be empty.
+  uint32_t gpu_timestamp_valid_bits =
+      vulkan_device
+          ->queue_families()[vulkan_device->queue_family_graphics_compute()]
+          .timestamp_valid_bits;
+  if (Profiler::is_enabled() && gpu_timestamp_valid_bits) {
+    VkQueryPoolCreateInfo gpu_timestamp_query_pool_create_info;
+    gpu_timestamp_query_pool_create_info.sType =
+        VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    gpu_timestamp_query_pool_create_info.pNext = nullptr;
+    gpu_timestamp_query_pool_create_info.flags = 0;
+    gpu_timestamp_query_pool_create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    gpu_timestamp_query_pool_create_info.queryCount = kGpuTimestampCount;
+    gpu_timestamp_query_pool_create_info.pipelineStatistics = 0;
+    if (dfn.vkCreateQueryPool(device, &gpu_timestamp_query_pool_create_info,
+                              nullptr,
+                              &gpu_timestamp_query_pool_) == VK_SUCCESS) {
+      gpu_timestamp_valid_mask_ =
+          gpu_timestamp_valid_bits >= 64
+              ? UINT64_MAX
+              : (uint64_t(1) << gpu_timestamp_valid_bits) - 1;
+      gpu_timestamp_values_ = std::make_unique<uint64_t[]>(kGpuTimestampCount);
+      std::fill_n(gpu_timestamp_values_.get(), kGpuTimestampCount, UINT64_MAX);
+      Profiler::SetGpuTimerSource(&gpu_timer_source_);
+    } else {
+      XELOGE("Failed to create the GPU timestamp Vulkan query pool");
+    }
+  }
+
   // Just not to expose uninitialized memory.
   std::memset(&system_constants_, 0, sizeof(system_constants_));
 
+  if (cvars::vulkan_submission_thread) {
+    submission_thread_submission_pending_ = false;
+    submission_thread_shutdown_ = false;
+    submission_thread_result_ = VK_SUCCESS;
+    submission_thread_ = xe::threading::Thread::Create(
+        {}, [this]() { SubmissionThread(); });
+    if (!submission_thread_) {
+      XELOGE("Failed to create the Vulkan submission thread");
+      return false;
+    }
+    submission_thread_->set_name("Vulkan Submission");
+  }
+
   return true;
 }
 
 void VulkanCommandProcessor::ShutdownContext() {
   AwaitAllQueueOperationsCompletion();
 
+  if (submission_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(submission_thread_mutex_);
+      submission_thread_shutdown_ = true;
+    }
+    submission_thread_request_cond_.notify_all();
+    xe::threading::Wait(submission_thread_.get(), false);
+    submission_thread_.reset();
+  }
+  submission_thread_deferred_command_buffer_.Reset();
+
   const ui::vulkan::VulkanDevice* const vulkan_device = GetVulkanDevice();
   const ui::vulkan::VulkanDevice::Functions& dfn = vulkan_device->functions();
   const VkDevice device = vulkan_device->device();
 
   DestroyScratchBuffer();
 
+  if (gpu_timestamp_query_pool_ != VK_NULL_HANDLE) {
+    Profiler::SetGpuContext(nullptr);
+    Profiler::SetGpuTimerSource(nullptr);
+  }
+  gpu_timestamps_pending_.clear();
+  gpu_timestamps_allocated_ = 0;
+  gpu_timestamps_submitted_ = 0;
+  gpu_timestamps_read_ = 0;
+  gpu_timestamps_reset_end_ = 0;
+  gpu_timestamp_values_.reset();
+  ui::vulkan::util::DestroyAndNullHandle(dfn.vkDestroyQueryPool, device,
+                                         gpu_timestamp_query_pool_);
+
   for (SwapFramebuffer& swap_framebuffer : swap_framebuffers_) {
     ui::vulkan::util::DestroyAndNullHandle(dfn.vkDestroyFramebuffer, device,
                                            swap_framebuffer.framebuffer);
@@ -1230,6 +1337,54 @@ void VulkanCommandProcessor::SparseBindBuffer(
   sparse_bind_wait_stage_mask_ |= wait_stage_mask;
 }
 
+void VulkanCommandProcessor::OnShaderConstantsWritten(uint32_t first_index,
+                                                     uint32_t count) {
+  uint32_t last_index = first_index + count - 1;
+  if (frame_open_ && first_index <= XE_GPU_REG_SHADER_CONSTANT_511_W) {
+    uint32_t float_constant_first =
+        (first_index - XE_GPU_REG_SHADER_CONSTANT_000_X) >> 2;
+    uint32_t float_constant_last =
+        (std::min(last_index, uint32_t(XE_GPU_REG_SHADER_CONSTANT_511_W)) -
+         XE_GPU_REG_SHADER_CONSTANT_000_X) >>
+        2;
+    if (float_constant_first < 256 &&
+        AreFloatConstantsInMap(current_float_constant_map_vertex_,
+                               float_constant_first,
+                               std::min(float_constant_last, uint32_t(255)))) {
+      current_constant_buffers_up_to_date_ &= ~(
+          UINT32_C(1) << SpirvShaderTranslator::kConstantBufferFloatVertex);
+    }
+    if (float_constant_last >= 256 &&
+        AreFloatConstantsInMap(current_float_constant_map_pixel_,
+                               std::max(float_constant_first, uint32_t(256)) -
+                                   256,
+                               float_constant_last - 256)) {
+      current_constant_buffers_up_to_date_ &= ~(
+          UINT32_C(1) << SpirvShaderTranslator::kConstantBufferFloatPixel);
+    }
+  }
+  if (first_index <= XE_GPU_REG_SHADER_CONSTANT_FETCH_31_5 &&
+      last_index >= XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) {
+    current_constant_buffers_up_to_date_ &=
+        ~(UINT32_C(1) << SpirvShaderTranslator::kConstantBufferFetch);
+    if (texture_cache_) {
+      texture_cache_->TextureFetchConstantsWritten(
+          (std::max(first_index,
+                    uint32_t(XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0)) -
+           XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) /
+              6,
+          (std::min(last_index,
+                    uint32_t(XE_GPU_REG_SHADER_CONSTANT_FETCH_31_5)) -
+           XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) /
+              6);
+    }
+  }
+  if (last_index >= XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031) {
+    current_constant_buffers_up_to_date_ &=
+        ~(UINT32_C(1) << SpirvShaderTranslator::kConstantBufferBoolLoop);
+  }
+}
+
 void VulkanCommandProcessor::OnGammaRamp256EntryTableValueWritten() {
   gamma_ramp_256_entry_table_current_frame_ = UINT32_MAX;
 }
@@ -1567,6 +1722,7 @@ void VulkanCommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
         // presenter so it can submit its own commands for displaying it to the
         // queue, and also need to submit the release barrier.
         EndSubmission(true);
+        AwaitSubmissionThread();
         return true;
       });
 
@@ -1773,7 +1929,12 @@ void VulkanCommandProcessor::SubmitBarriersAndEnterRenderTargetCacheRenderPass(
   VkRenderPassBeginInfo render_pass_begin_info;
   render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   render_pass_begin_info.pNext = nullptr;
-  render_pass_begin_info.renderPass = render_pass;
+  // May be a variant of the render pass with different load operations, but
+  // compatible with it, so drawing with the same framebuffer and pipelines
+  // continues in it.
+  render_pass_begin_info.renderPass =
+      render_target_cache_->GetHostRenderTargetsRenderPassToBegin(
+          render_pass, *framebuffer);
   render_pass_begin_info.framebuffer = framebuffer->framebuffer;
   render_pass_begin_info.renderArea.offset.x = 0;
   render_pass_begin_info.renderArea.offset.y = 0;
@@ -2081,7 +2242,7 @@ void VulkanCommandProcessor::BindExternalGraphicsPipeline(
   deferred_command_buffer_.CmdVkBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS,
                                              pipeline);
   current_external_graphics_pipeline_ = pipeline;
-  current_guest_graphics_pipeline_ = VK_NULL_HANDLE;
+  current_guest_graphics_pipeline_ = nullptr;
   current_guest_graphics_pipeline_layout_ = VK_NULL_HANDLE;
 }
 
@@ -2344,6 +2505,8 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
     CheckSubmissionFenceAndDeviceLoss(sampler_overflow_await_submission);
   }
 
+  SCOPE_profile_gpu_i("gpu", "Draw");
+
   // Set up the render targets - this may perform dispatches and draws.
   reg::RB_DEPTHCONTROL normalized_depth_control =
       draw_util::GetNormalizedDepthControl(regs);
@@ -2360,16 +2523,20 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
   // Create the pipeline (for this, need the render pass from the render target
   // cache), translating the shaders - doing this now to obtain the used
   // textures.
-  VkPipeline pipeline;
+  void* pipeline_handle;
   const VulkanPipelineCache::PipelineLayoutProvider* pipeline_layout_provider;
   if (!pipeline_cache_->ConfigurePipeline(
           vertex_shader_translation, pixel_shader_translation,
           primitive_processing_result, normalized_depth_control,
           normalized_color_mask,
-          render_target_cache_->last_update_render_pass_key(), pipeline,
+          render_target_cache_->last_update_render_pass_key(), pipeline_handle,
           pipeline_layout_provider)) {
     return false;
   }
+  if (!pipeline_handle) {
+    // Draws are skipped while their pipelines are being created.
+    return true;
+  }
 
   // Update the textures before most other work in the submission because
   // samplers depend on this (and in case of sampler overflow in a submission,
@@ -2384,10 +2551,9 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
   // Update the graphics pipeline, and if the new graphics pipeline has a
   // different layout, invalidate incompatible descriptor sets before updating
   // current_guest_graphics_pipeline_layout_.
-  if (current_guest_graphics_pipeline_ != pipeline) {
-    deferred_command_buffer_.CmdVkBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                               pipeline);
-    current_guest_graphics_pipeline_ = pipeline;
+  if (current_guest_graphics_pipeline_ != pipeline_handle) {
+    deferred_command_buffer_.CmdBindPipelineHandle(pipeline_handle);
+    current_guest_graphics_pipeline_ = pipeline_handle;
     current_external_graphics_pipeline_ = VK_NULL_HANDLE;
   }
   auto pipeline_layout =
@@ -2589,14 +2755,27 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
         assert_unhandled_case(primitive_processing_result.index_buffer_type);
         return false;
     }
-    deferred_command_buffer_.CmdVkBindIndexBuffer(
-        index_buffer.first, index_buffer.second,
+    VkIndexType index_type =
         primitive_processing_result.host_index_format ==
                 xenos::IndexFormat::kInt16
             ? VK_INDEX_TYPE_UINT16
-            : VK_INDEX_TYPE_UINT32);
-    deferred_command_buffer_.CmdVkDrawIndexed(
-        primitive_processing_result.host_draw_vertex_count, 1, 0, 0, 0);
+            : VK_INDEX_TYPE_UINT32;
+    // Games often issue long runs of small draws with the same state, with
+    // the indices of each directly following the indices of the previous one.
+    // If nothing has been recorded since the previous draw, the host state is
+    // the same, so such draws can be done as one host draw.
+    uint32_t appendable_primitive_vertex_count =
+        primitive_processing_result.GetAppendableIndicesPrimitiveVertexCount();
+    if (!appendable_primitive_vertex_count ||
+        !deferred_command_buffer_.AppendToLastIndexedDraw(
+            index_buffer.first, index_buffer.second, index_type,
+            primitive_processing_result.host_draw_vertex_count,
+            appendable_primitive_vertex_count)) {
+      deferred_command_buffer_.CmdVkBindIndexBuffer(
+          index_buffer.first, index_buffer.second, index_type);
+      deferred_command_buffer_.CmdVkDrawIndexed(
+          primitive_processing_result.host_draw_vertex_count, 1, 0, 0, 0);
+    }
   }
 
   // Invalidate textures in memexported memory and watch for changes.
@@ -2617,6 +2796,8 @@ bool VulkanCommandProcessor::IssueCopy() {
     return false;
   }
 
+  SCOPE_profile_gpu_i("gpu", "Resolve");
+
   uint32_t written_address, written_length;
   if (!render_target_cache_->Resolve(*memory_, *shared_memory_, *texture_cache_,
                                      written_address, written_length)) {
@@ -2666,6 +2847,14 @@ void VulkanCommandProcessor::CheckSubmissionFenceAndDeviceLoss(
   const ui::vulkan::VulkanDevice::Functions& dfn = vulkan_device->functions();
   const VkDevice device = vulkan_device->device();
 
+  if (await_submission > submission_completed_) {
+    // The fences must have been submitted before waiting for them.
+    AwaitSubmissionThread();
+    if (device_lost_) {
+      return;
+    }
+  }
+
   size_t fences_total = submissions_in_flight_fences_.size();
   size_t fences_awaited = 0;
   if (await_submission > submission_completed_) {
@@ -2749,6 +2938,8 @@ void VulkanCommandProcessor::CheckSubmissionFenceAndDeviceLoss(
 
   texture_cache_->CompletedSubmissionUpdated(submission_completed_);
 
+  ReadCompletedGpuTimestamps();
+
   // Destroy objects scheduled for destruction.
   while (!destroy_framebuffers_.empty()) {
     const auto& destroy_pair = destroy_framebuffers_.front();
@@ -2776,6 +2967,103 @@ void VulkanCommandProcessor::CheckSubmissionFenceAndDeviceLoss(
   }
 }
 
+VkResult VulkanCommandProcessor::ExecuteAndSubmit(
+    DeferredCommandBuffer& deferred_command_buffer,
+    const PendingSubmission& submission) {
+  const ui::vulkan::VulkanDevice* const vulkan_device = GetVulkanDevice();
+  const ui::vulkan::VulkanDevice::Functions& dfn = vulkan_device->functions();
+
+  VkCommandBufferBeginInfo command_buffer_begin_info;
+  command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  command_buffer_begin_info.pNext = nullptr;
+  command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  command_buffer_begin_info.pInheritanceInfo = nullptr;
+  VkResult result = dfn.vkBeginCommandBuffer(submission.command_buffer,
+                                             &command_buffer_begin_info);
+  if (result != VK_SUCCESS) {
+    XELOGE("Failed to begin a Vulkan command buffer");
+    return result;
+  }
+  deferred_command_buffer.Execute(submission.command_buffer);
+  result = dfn.vkEndCommandBuffer(submission.command_buffer);
+  if (result != VK_SUCCESS) {
+    XELOGE("Failed to end a Vulkan command buffer");
+    return result;
+  }
+
+  VkSubmitInfo submit_info;
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.pNext = nullptr;
+  if (!submission.wait_semaphores.empty()) {
+    submit_info.waitSemaphoreCount =
+        uint32_t(submission.wait_semaphores.size());
+    submit_info.pWaitSemaphores = submission.wait_semaphores.data();
+    submit_info.pWaitDstStageMask = submission.wait_stage_masks.data();
+  } else {
+    submit_info.waitSemaphoreCount = 0;
+    submit_info.pWaitSemaphores = nullptr;
+    submit_info.pWaitDstStageMask = nullptr;
+  }
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &submission.command_buffer;
+  submit_info.signalSemaphoreCount = 0;
+  submit_info.pSignalSemaphores = nullptr;
+  {
+    ui::vulkan::VulkanDevice::Queue::Acquisition queue_acquisition =
+        vulkan_device->AcquireQueue(
+            vulkan_device->queue_family_graphics_compute(), 0);
+    result = dfn.vkQueueSubmit(queue_acquisition.queue(), 1, &submit_info,
+                               submission.fence);
+  }
+  if (result != VK_SUCCESS) {
+    XELOGE("Failed to submit a Vulkan command buffer");
+  }
+  return result;
+}
+
+void VulkanCommandProcessor::SubmissionThread() {
+  std::unique_lock<std::mutex> lock(submission_thread_mutex_);
+  while (true) {
+    submission_thread_request_cond_.wait(lock, [this]() {
+      return submission_thread_submission_pending_ ||
+             submission_thread_shutdown_;
+    });
+    if (!submission_thread_submission_pending_) {
+      return;
+    }
+    lock.unlock();
+    VkResult result = ExecuteAndSubmit(
+        submission_thread_deferred_command_buffer_,
+        submission_thread_submission_);
+    lock.lock();
+    if (result != VK_SUCCESS && submission_thread_result_ == VK_SUCCESS) {
+      submission_thread_result_ = result;
+    }
+    submission_thread_submission_pending_ = false;
+    submission_thread_completion_cond_.notify_all();
+  }
+}
+
+void VulkanCommandProcessor::AwaitSubmissionThread() {
+  if (!submission_thread_) {
+    return;
+  }
+  VkResult result;
+  {
+    std::unique_lock<std::mutex> lock(submission_thread_mutex_);
+    submission_thread_completion_cond_.wait(
+        lock, [this]() { return !submission_thread_submission_pending_; });
+    result = submission_thread_result_;
+  }
+  if (result != VK_SUCCESS && !device_lost_) {
+    // The fence of the submission will never be signaled, and completely
+    // dropping the submission is not permitted because resources would be
+    // left in an undefined state.
+    device_lost_ = true;
+    graphics_system_->OnHostGpuLossFromAnyThread(true);
+  }
+}
+
 bool VulkanCommandProcessor::BeginSubmission(bool is_guest_command) {
 #if XE_GPU_FINE_GRAINED_DRAW_SCOPES
   SCOPE_profile_cpu_f("gpu");
@@ -2826,6 +3114,8 @@ bool VulkanCommandProcessor::BeginSubmission(bool is_guest_command) {
     // the end of the submission (when async pipeline object creation requests
     // are fulfilled).
     deferred_command_buffer_.Reset();
+    ResetReadGpuTimestamps();
+    Profiler::SetGpuContext(&deferred_command_buffer_);
 
     // Reset cached state of the command buffer.
     dynamic_viewport_update_needed_ = true;
@@ -2840,11 +3130,22 @@ bool VulkanCommandProcessor::BeginSubmission(bool is_guest_command) {
     dynamic_stencil_reference_back_update_needed_ = true;
     current_render_pass_ = VK_NULL_HANDLE;
     current_framebuffer_ = nullptr;
-    current_guest_graphics_pipeline_ = VK_NULL_HANDLE;
+    current_guest_graphics_pipeline_ = nullptr;
     current_external_graphics_pipeline_ = VK_NULL_HANDLE;
     current_external_compute_pipeline_ = VK_NULL_HANDLE;
     current_guest_graphics_pipeline_layout_ = nullptr;
     current_graphics_descriptor_sets_bound_up_to_date_ = 0;
+    texture_descriptor_set_cache_.clear();
+    texture_descriptor_set_cache_image_info_.clear();
+    // Samplers and image views are only destroyed after the submissions using
+    // them are completed, so only within a single submission the same handle
+    // in reused texture descriptors always refers to the same object. If
+    // opening a frame, all the bindings are reset below.
+    if (frame_open_) {
+      current_graphics_descriptor_set_values_up_to_date_ &= ~(
+          (UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesVertex) |
+          (UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesPixel));
+    }
 
     primitive_processor_->BeginSubmission();
 
@@ -2862,6 +3163,8 @@ bool VulkanCommandProcessor::BeginSubmission(bool is_guest_command) {
     std::memset(current_graphics_descriptor_sets_, 0,
                 sizeof(current_graphics_descriptor_sets_));
     current_constant_buffers_up_to_date_ = 0;
+    current_float_constants_size_vertex_ = 0;
+    current_float_constants_size_pixel_ = 0;
     current_graphics_descriptor_sets_
         [SpirvShaderTranslator::kDescriptorSetSharedMemoryAndEdram] =
             shared_memory_and_edram_descriptor_set_;
@@ -2919,6 +3222,8 @@ bool VulkanCommandProcessor::BeginSubmission(bool is_guest_command) {
     primitive_processor_->BeginFrame();
 
     texture_cache_->BeginFrame();
+
+    render_target_cache_->BeginFrame();
   }
 
   return true;
@@ -2993,7 +3298,20 @@ bool VulkanCommandProcessor::EndSubmission(bool is_swap) {
   bool is_closing_frame = is_swap && frame_open_;
 
   if (is_closing_frame) {
+    render_target_cache_->EndFrame();
+
     primitive_processor_->EndFrame();
+
+    [[maybe_unused]] ui::GraphicsUploadBufferPool::Statistics
+        uniform_buffer_pool_statistics = uniform_buffer_pool_->TakeStatistics();
+    COUNT_profile_set("gpu/vulkan/uniform_upload_bytes_per_frame",
+                      uniform_buffer_pool_statistics.bytes_requested);
+    COUNT_profile_set("gpu/vulkan/uniform_upload_wasted_bytes_per_frame",
+                      uniform_buffer_pool_statistics.bytes_wasted);
+    COUNT_profile_set("gpu/vulkan/uniform_upload_pages_created_per_frame",
+                      uniform_buffer_pool_statistics.pages_created);
+    COUNT_profile_set("gpu/vulkan/uniform_upload_pages",
+                      uniform_buffer_pool_->page_count());
   }
 
   if (submission_open_) {
@@ -3001,6 +3319,18 @@ bool VulkanCommandProcessor::EndSubmission(bool is_swap) {
 
     EndRenderPass();
 
+    // No more GPU profiling timestamps can be written in this submission.
+    Profiler::SetGpuContext(nullptr);
+    if (gpu_timestamps_allocated_ > gpu_timestamps_submitted_) {
+      PendingGpuTimestamps& pending_timestamps =
+          gpu_timestamps_pending_.emplace_back();
+      pending_timestamps.timestamp_end = gpu_timestamps_allocated_;
+      pending_timestamps.submission = GetCurrentSubmission();
+      gpu_timestamps_submitted_ = gpu_timestamps_allocated_;
+    }
+
+    pipeline_cache_->EndSubmission();
+
     render_target_cache_->EndSubmission();
 
     primitive_processor_->EndSubmission();
@@ -3070,63 +3400,47 @@ bool VulkanCommandProcessor::EndSubmission(bool is_swap) {
       XELOGE("Failed to reset a Vulkan command pool");
       return false;
     }
-    VkCommandBufferBeginInfo command_buffer_begin_info;
-    command_buffer_begin_info.sType =
-        VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    command_buffer_begin_info.pNext = nullptr;
-    command_buffer_begin_info.flags =
-        VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    command_buffer_begin_info.pInheritanceInfo = nullptr;
-    if (dfn.vkBeginCommandBuffer(command_buffer.buffer,
-                                 &command_buffer_begin_info) != VK_SUCCESS) {
-      XELOGE("Failed to begin a Vulkan command buffer");
-      return false;
-    }
-    deferred_command_buffer_.Execute(command_buffer.buffer);
-    if (dfn.vkEndCommandBuffer(command_buffer.buffer) != VK_SUCCESS) {
-      XELOGE("Failed to end a Vulkan command buffer");
-      return false;
-    }
-
-    VkSubmitInfo submit_info;
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.pNext = nullptr;
-    if (!current_submission_wait_semaphores_.empty()) {
-      submit_info.waitSemaphoreCount =
-          uint32_t(current_submission_wait_semaphores_.size());
-      submit_info.pWaitSemaphores = current_submission_wait_semaphores_.data();
-      submit_info.pWaitDstStageMask =
-          current_submission_wait_stage_masks_.data();
-    } else {
-      submit_info.waitSemaphoreCount = 0;
-      submit_info.pWaitSemaphores = nullptr;
-      submit_info.pWaitDstStageMask = nullptr;
-    }
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command_buffer.buffer;
-    submit_info.signalSemaphoreCount = 0;
-    submit_info.pSignalSemaphores = nullptr;
     assert_false(fences_free_.empty());
     VkFence fence = fences_free_.back();
     if (dfn.vkResetFences(device, 1, &fence) != VK_SUCCESS) {
       XELOGE("Failed to reset a Vulkan submission fence");
       return false;
     }
-    VkResult submit_result;
-    {
-      ui::vulkan::VulkanDevice::Queue::Acquisition queue_acquisition =
-          vulkan_device->AcquireQueue(
-              vulkan_device->queue_family_graphics_compute(), 0);
-      submit_result =
-          dfn.vkQueueSubmit(queue_acquisition.queue(), 1, &submit_info, fence);
-    }
-    if (submit_result != VK_SUCCESS) {
-      XELOGE("Failed to submit a Vulkan command buffer");
-      if (submit_result == VK_ERROR_DEVICE_LOST && !device_lost_) {
-        device_lost_ = true;
-        graphics_system_->OnHostGpuLossFromAnyThread(true);
+    if (submission_thread_) {
+      // Only one submission can be pending on the submission thread, and its
+      // deferred command buffer is reused for recording the next submission.
+      AwaitSubmissionThread();
+      if (device_lost_) {
+        return false;
+      }
+      {
+        std::lock_guard<std::mutex> lock(submission_thread_mutex_);
+        submission_thread_deferred_command_buffer_.Swap(
+            deferred_command_buffer_);
+        submission_thread_submission_.command_buffer = command_buffer.buffer;
+        submission_thread_submission_.fence = fence;
+        submission_thread_submission_.wait_semaphores =
+            current_submission_wait_semaphores_;
+        submission_thread_submission_.wait_stage_masks =
+            current_submission_wait_stage_masks_;
+        submission_thread_submission_pending_ = true;
+      }
+      submission_thread_request_cond_.notify_one();
+    } else {
+      PendingSubmission submission;
+      submission.command_buffer = command_buffer.buffer;
+      submission.fence = fence;
+      submission.wait_semaphores = current_submission_wait_semaphores_;
+      submission.wait_stage_masks = current_submission_wait_stage_masks_;
+      VkResult submit_result =
+          ExecuteAndSubmit(deferred_command_buffer_, submission);
+      if (submit_result != VK_SUCCESS) {
+        if (submit_result == VK_ERROR_DEVICE_LOST && !device_lost_) {
+          device_lost_ = true;
+          graphics_system_->OnHostGpuLossFromAnyThread(true);
+        }
+        return false;
       }
-      return false;
     }
     uint64_t submission_current = GetCurrentSubmission();
     current_submission_wait_stage_masks_.clear();
@@ -3186,7 +3500,85 @@ bool VulkanCommandProcessor::EndSubmission(bool is_swap) {
   return true;
 }
 
+uint32_t VulkanCommandProcessor::InsertGpuTimestamp(void* context) {
+  if (gpu_timestamp_query_pool_ == VK_NULL_HANDLE || !submission_open_ ||
+      context != &deferred_command_buffer_ ||
+      gpu_timestamps_allocated_ >= gpu_timestamps_reset_end_) {
+    return UINT32_MAX;
+  }
+  uint32_t index = uint32_t(gpu_timestamps_allocated_++ % kGpuTimestampCount);
+  gpu_timestamp_values_[index] = UINT64_MAX;
+  deferred_command_buffer_.CmdVkWriteTimestamp(
+      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, gpu_timestamp_query_pool_, index);
+  return index;
+}
+
+void VulkanCommandProcessor::ResetReadGpuTimestamps() {
+  if (gpu_timestamp_query_pool_ == VK_NULL_HANDLE) {
+    return;
+  }
+  uint64_t reset_end = gpu_timestamps_read_ + kGpuTimestampCount;
+  // The range may be split by the end of the ring.
+  while (gpu_timestamps_reset_end_ < reset_end) {
+    uint32_t first = uint32_t(gpu_timestamps_reset_end_ % kGpuTimestampCount);
+    uint32_t count =
+        uint32_t(std::min(reset_end - gpu_timestamps_reset_end_,
+                          uint64_t(kGpuTimestampCount - first)));
+    deferred_command_buffer_.CmdVkResetQueryPool(gpu_timestamp_query_pool_,
+                                                 first, count);
+    gpu_timestamps_reset_end_ += count;
+  }
+}
+
+void VulkanCommandProcessor::ReadCompletedGpuTimestamps() {
+  const ui::vulkan::VulkanDevice* const vulkan_device = GetVulkanDevice();
+  const ui::vulkan::VulkanDevice::Functions& dfn = vulkan_device->functions();
+  const VkDevice device = vulkan_device->device();
+  while (!gpu_timestamps_pending_.empty()) {
+    const PendingGpuTimestamps& pending_timestamps =
+        gpu_timestamps_pending_.front();
+    if (pending_timestamps.submission > submission_completed_) {
+      break;
+    }
+    while (gpu_timestamps_read_ < pending_timestamps.timestamp_end) {
+      uint32_t first = uint32_t(gpu_timestamps_read_ % kGpuTimestampCount);
+      uint32_t count = uint32_t(
+          std::min(pending_timestamps.timestamp_end - gpu_timestamps_read_,
+                   uint64_t(kGpuTimestampCount - first)));
+      uint64_t* values = gpu_timestamp_values_.get() + first;
+      if (dfn.vkGetQueryPoolResults(
+              device, gpu_timestamp_query_pool_, first, count,
+              sizeof(uint64_t) * count, values, sizeof(uint64_t),
+              VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        for (uint32_t i = 0; i < count; ++i) {
+          values[i] &= gpu_timestamp_valid_mask_;
+        }
+      }
+      gpu_timestamps_read_ += count;
+    }
+    gpu_timestamps_pending_.pop_front();
+  }
+}
+
+uint64_t VulkanCommandProcessor::GpuTimerSource::GetTimestamp(
+    uint32_t index) {
+  if (index >= kGpuTimestampCount ||
+      !command_processor_.gpu_timestamp_values_) {
+    return UINT64_MAX;
+  }
+  return command_processor_.gpu_timestamp_values_[index];
+}
+
+uint64_t VulkanCommandProcessor::GpuTimerSource::GetTicksPerSecond() {
+  // timestampPeriod is the number of nanoseconds per tick.
+  float timestamp_period =
+      command_processor_.GetVulkanDevice()->properties().timestampPeriod;
+  return uint64_t(1000000000.0 / double(timestamp_period));
+}
+
 void VulkanCommandProcessor::ClearTransientDescriptorPools() {
+  texture_descriptor_set_cache_.clear();
+  texture_descriptor_set_cache_image_info_.clear();
   texture_transient_descriptor_sets_free_.clear();
   texture_transient_descriptor_sets_used_.clear();
   transient_descriptor_allocator_textures_.Reset();
@@ -3991,8 +4383,9 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
   assert_zero(current_constant_buffers_up_to_date_ & ~kAllConstantBuffersMask);
   if ((current_constant_buffers_up_to_date_ & kAllConstantBuffersMask) !=
       kAllConstantBuffersMask) {
-    current_graphics_descriptor_set_values_up_to_date_ &=
-        ~(UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetConstants);
+    // If only float constants with the same values as in the current buffers
+    // are requested, the descriptor set doesn't need to be rewritten.
+    bool constant_buffer_infos_changed = false;
     size_t uniform_buffer_alignment =
         size_t(vulkan_device->properties().minUniformBufferOffsetAlignment);
     // System constants.
@@ -4011,40 +4404,43 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
                   sizeof(SpirvShaderTranslator::SystemConstants));
       current_constant_buffers_up_to_date_ |=
           UINT32_C(1) << SpirvShaderTranslator::kConstantBufferSystem;
+      constant_buffer_infos_changed = true;
     }
     // Vertex shader float constants.
     if (!(current_constant_buffers_up_to_date_ &
           (UINT32_C(1) << SpirvShaderTranslator::kConstantBufferFloatVertex))) {
-      VkDescriptorBufferInfo& buffer_info = current_constant_buffer_infos_
-          [SpirvShaderTranslator::kConstantBufferFloatVertex];
       // Even if the shader doesn't need any float constants, a valid binding
       // must still be provided (the pipeline layout always has float constants,
       // for both the vertex shader and the pixel shader), so if the first draw
       // in the frame doesn't have float constants at all, still allocate a
       // dummy buffer.
-      size_t float_constants_size =
-          sizeof(float) * 4 *
-          std::max(float_constant_count_vertex, UINT32_C(1));
-      uint8_t* mapping = uniform_buffer_pool_->Request(
-          frame_current_, float_constants_size, uniform_buffer_alignment,
-          buffer_info.buffer, buffer_info.offset);
-      if (!mapping) {
-        return false;
+      uint32_t float_constants_size =
+          GatherFloatConstants(regs, false, current_float_constant_map_vertex_,
+                               float_constants_gathered_);
+      if (!float_constants_size) {
+        float_constants_size = sizeof(float) * 4;
+        std::memset(float_constants_gathered_, 0, float_constants_size);
       }
-      buffer_info.range = VkDeviceSize(float_constants_size);
-      for (uint32_t i = 0; i < 4; ++i) {
-        uint64_t float_constant_map_entry =
-            current_float_constant_map_vertex_[i];
-        uint32_t float_constant_index;
-        while (xe::bit_scan_forward(float_constant_map_entry,
-                                    &float_constant_index)) {
-          float_constant_map_entry &= ~(1ull << float_constant_index);
-          std::memcpy(mapping,
-                      &regs[XE_GPU_REG_SHADER_CONSTANT_000_X + (i << 8) +
-                            (float_constant_index << 2)],
-                      sizeof(float) * 4);
-          mapping += sizeof(float) * 4;
+      // Different constant ranges often end up containing the same values,
+      // such as when only the constants not used by the current shader are
+      // changed, keep using the previous buffer in this case.
+      uint64_t float_constants_hash =
+          XXH3_64bits(float_constants_gathered_, float_constants_size);
+      if (current_float_constants_size_vertex_ != float_constants_size ||
+          current_float_constants_hash_vertex_ != float_constants_hash) {
+        VkDescriptorBufferInfo& buffer_info = current_constant_buffer_infos_
+            [SpirvShaderTranslator::kConstantBufferFloatVertex];
+        uint8_t* mapping = uniform_buffer_pool_->Request(
+            frame_current_, float_constants_size, uniform_buffer_alignment,
+            buffer_info.buffer, buffer_info.offset);
+        if (!mapping) {
+          return false;
         }
+        buffer_info.range = VkDeviceSize(float_constants_size);
+        std::memcpy(mapping, float_constants_gathered_, float_constants_size);
+        current_float_constants_hash_vertex_ = float_constants_hash;
+        current_float_constants_size_vertex_ = float_constants_size;
+        constant_buffer_infos_changed = true;
       }
       current_constant_buffers_up_to_date_ |=
           UINT32_C(1) << SpirvShaderTranslator::kConstantBufferFloatVertex;
@@ -4052,30 +4448,30 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
     // Pixel shader float constants.
     if (!(current_constant_buffers_up_to_date_ &
           (UINT32_C(1) << SpirvShaderTranslator::kConstantBufferFloatPixel))) {
-      VkDescriptorBufferInfo& buffer_info = current_constant_buffer_infos_
-          [SpirvShaderTranslator::kConstantBufferFloatPixel];
-      size_t float_constants_size =
-          sizeof(float) * 4 * std::max(float_constant_count_pixel, UINT32_C(1));
-      uint8_t* mapping = uniform_buffer_pool_->Request(
-          frame_current_, float_constants_size, uniform_buffer_alignment,
-          buffer_info.buffer, buffer_info.offset);
-      if (!mapping) {
-        return false;
+      uint32_t float_constants_size =
+          GatherFloatConstants(regs, true, current_float_constant_map_pixel_,
+                               float_constants_gathered_);
+      if (!float_constants_size) {
+        float_constants_size = sizeof(float) * 4;
+        std::memset(float_constants_gathered_, 0, float_constants_size);
       }
-      buffer_info.range = VkDeviceSize(float_constants_size);
-      for (uint32_t i = 0; i < 4; ++i) {
-        uint64_t float_constant_map_entry =
-            current_float_constant_map_pixel_[i];
-        uint32_t float_constant_index;
-        while (xe::bit_scan_forward(float_constant_map_entry,
-                                    &float_constant_index)) {
-          float_constant_map_entry &= ~(1ull << float_constant_index);
-          std::memcpy(mapping,
-                      &regs[XE_GPU_REG_SHADER_CONSTANT_256_X + (i << 8) +
-                            (float_constant_index << 2)],
-                      sizeof(float) * 4);
-          mapping += sizeof(float) * 4;
+      uint64_t float_constants_hash =
+          XXH3_64bits(float_constants_gathered_, float_constants_size);
+      if (current_float_constants_size_pixel_ != float_constants_size ||
+          current_float_constants_hash_pixel_ != float_constants_hash) {
+        VkDescriptorBufferInfo& buffer_info = current_constant_buffer_infos_
+            [SpirvShaderTranslator::kConstantBufferFloatPixel];
+        uint8_t* mapping = uniform_buffer_pool_->Request(
+            frame_current_, float_constants_size, uniform_buffer_alignment,
+            buffer_info.buffer, buffer_info.offset);
+        if (!mapping) {
+          return false;
         }
+        buffer_info.range = VkDeviceSize(float_constants_size);
+        std::memcpy(mapping, float_constants_gathered_, float_constants_size);
+        current_float_constants_hash_pixel_ = float_constants_hash;
+        current_float_constants_size_pixel_ = float_constants_size;
+        constant_buffer_infos_changed = true;
       }
       current_constant_buffers_up_to_date_ |=
           UINT32_C(1) << SpirvShaderTranslator::kConstantBufferFloatPixel;
@@ -4097,6 +4493,7 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
                   kBoolLoopConstantsSize);
       current_constant_buffers_up_to_date_ |=
           UINT32_C(1) << SpirvShaderTranslator::kConstantBufferBoolLoop;
+      constant_buffer_infos_changed = true;
     }
     // Fetch constants.
     if (!(current_constant_buffers_up_to_date_ &
@@ -4115,6 +4512,11 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
                   kFetchConstantsSize);
       current_constant_buffers_up_to_date_ |=
           UINT32_C(1) << SpirvShaderTranslator::kConstantBufferFetch;
+      constant_buffer_infos_changed = true;
+    }
+    if (constant_buffer_infos_changed) {
+      current_graphics_descriptor_set_values_up_to_date_ &=
+          ~(UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetConstants);
     }
   }
 
@@ -4139,47 +4541,25 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
     sampler_count_pixel = 0;
     texture_count_pixel = 0;
   }
-  // TODO(Triang3l): Reuse texture and sampler bindings if not changed.
-  current_graphics_descriptor_set_values_up_to_date_ &=
-      ~((UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesVertex) |
-        (UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesPixel));
-
-  // Make sure new descriptor sets are bound to the command buffer.
-
-  current_graphics_descriptor_sets_bound_up_to_date_ &=
-      current_graphics_descriptor_set_values_up_to_date_;
-
   // Fill the texture and sampler write image infos.
 
-  bool write_vertex_textures =
-      (texture_count_vertex || sampler_count_vertex) &&
-      !(current_graphics_descriptor_set_values_up_to_date_ &
-        (UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesVertex));
-  bool write_pixel_textures =
-      (texture_count_pixel || sampler_count_pixel) &&
-      !(current_graphics_descriptor_set_values_up_to_date_ &
-        (UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesPixel));
   descriptor_write_image_info_.clear();
   descriptor_write_image_info_.reserve(
-      (write_vertex_textures ? texture_count_vertex + sampler_count_vertex
-                             : 0) +
-      (write_pixel_textures ? texture_count_pixel + sampler_count_pixel : 0));
+      texture_count_vertex + sampler_count_vertex + texture_count_pixel +
+      sampler_count_pixel);
   size_t vertex_texture_image_info_offset = descriptor_write_image_info_.size();
-  if (write_vertex_textures && texture_count_vertex) {
-    for (const VulkanShader::TextureBinding& texture_binding :
-         textures_vertex) {
-      VkDescriptorImageInfo& descriptor_image_info =
-          descriptor_write_image_info_.emplace_back();
-      descriptor_image_info.imageView =
-          texture_cache_->GetActiveBindingOrNullImageView(
-              texture_binding.fetch_constant, texture_binding.dimension,
-              bool(texture_binding.is_signed));
-      descriptor_image_info.imageLayout =
-          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    }
+  for (const VulkanShader::TextureBinding& texture_binding : textures_vertex) {
+    VkDescriptorImageInfo& descriptor_image_info =
+        descriptor_write_image_info_.emplace_back();
+    descriptor_image_info.imageView =
+        texture_cache_->GetActiveBindingOrNullImageView(
+            texture_binding.fetch_constant, texture_binding.dimension,
+            bool(texture_binding.is_signed));
+    descriptor_image_info.imageLayout =
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
   }
   size_t vertex_sampler_image_info_offset = descriptor_write_image_info_.size();
-  if (write_vertex_textures && sampler_count_vertex) {
+  if (sampler_count_vertex) {
     for (const std::pair<VulkanTextureCache::SamplerParameters, VkSampler>&
              sampler_pair : current_samplers_vertex_) {
       VkDescriptorImageInfo& descriptor_image_info =
@@ -4188,7 +4568,7 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
     }
   }
   size_t pixel_texture_image_info_offset = descriptor_write_image_info_.size();
-  if (write_pixel_textures && texture_count_pixel) {
+  if (texture_count_pixel) {
     for (const VulkanShader::TextureBinding& texture_binding :
          *textures_pixel) {
       VkDescriptorImageInfo& descriptor_image_info =
@@ -4202,7 +4582,7 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
     }
   }
   size_t pixel_sampler_image_info_offset = descriptor_write_image_info_.size();
-  if (write_pixel_textures && sampler_count_pixel) {
+  if (sampler_count_pixel) {
     for (const std::pair<VulkanTextureCache::SamplerParameters, VkSampler>&
              sampler_pair : current_samplers_pixel_) {
       VkDescriptorImageInfo& descriptor_image_info =
@@ -4211,6 +4591,74 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
     }
   }
 
+  // Reuse the texture descriptor sets written earlier in the frame if the
+  // layout and all the image views and samplers are the same - consecutive
+  // draws commonly only change the constants. Transient descriptor sets are
+  // only reclaimed after the frame they were used in is completed, and the
+  // texture descriptor sets are invalidated when a new submission is opened.
+  auto are_texture_descriptors_up_to_date =
+      [this](uint32_t descriptor_set_index,
+             VkDescriptorSetLayout descriptor_set_layout,
+             VkDescriptorSetLayout current_descriptor_set_layout,
+             const std::vector<VkDescriptorImageInfo>& current_image_info,
+             size_t image_info_offset, size_t image_info_count) {
+        if (!(current_graphics_descriptor_set_values_up_to_date_ &
+              (UINT32_C(1) << descriptor_set_index)) ||
+            descriptor_set_layout != current_descriptor_set_layout ||
+            current_image_info.size() != image_info_count) {
+          return false;
+        }
+        const VkDescriptorImageInfo* image_info =
+            descriptor_write_image_info_.data() + image_info_offset;
+        for (size_t i = 0; i < image_info_count; ++i) {
+          if (image_info[i].sampler != current_image_info[i].sampler ||
+              image_info[i].imageView != current_image_info[i].imageView) {
+            return false;
+          }
+        }
+        return true;
+      };
+  VkDescriptorSetLayout texture_descriptor_set_layout_vertex =
+      current_guest_graphics_pipeline_layout_
+          ->descriptor_set_layout_textures_vertex_ref();
+  VkDescriptorSetLayout texture_descriptor_set_layout_pixel =
+      current_guest_graphics_pipeline_layout_
+          ->descriptor_set_layout_textures_pixel_ref();
+  if (!are_texture_descriptors_up_to_date(
+          SpirvShaderTranslator::kDescriptorSetTexturesVertex,
+          texture_descriptor_set_layout_vertex,
+          current_texture_descriptor_set_layout_vertex_,
+          current_texture_descriptor_image_info_vertex_,
+          vertex_texture_image_info_offset,
+          texture_count_vertex + sampler_count_vertex)) {
+    current_graphics_descriptor_set_values_up_to_date_ &=
+        ~(UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesVertex);
+  }
+  if (!are_texture_descriptors_up_to_date(
+          SpirvShaderTranslator::kDescriptorSetTexturesPixel,
+          texture_descriptor_set_layout_pixel,
+          current_texture_descriptor_set_layout_pixel_,
+          current_texture_descriptor_image_info_pixel_,
+          pixel_texture_image_info_offset,
+          texture_count_pixel + sampler_count_pixel)) {
+    current_graphics_descriptor_set_values_up_to_date_ &=
+        ~(UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesPixel);
+  }
+
+  // Make sure new descriptor sets are bound to the command buffer.
+
+  current_graphics_descriptor_sets_bound_up_to_date_ &=
+      current_graphics_descriptor_set_values_up_to_date_;
+
+  bool write_vertex_textures =
+      (texture_count_vertex || sampler_count_vertex) &&
+      !(current_graphics_descriptor_set_values_up_to_date_ &
+        (UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesVertex));
+  bool write_pixel_textures =
+      (texture_count_pixel || sampler_count_pixel) &&
+      !(current_graphics_descriptor_set_values_up_to_date_ &
+        (UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesPixel));
+
   // Write the new descriptor sets.
 
   // Consecutive bindings updated via a single VkWriteDescriptorSet must have
@@ -4270,45 +4718,85 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
   }
   // Vertex shader textures and samplers.
   if (write_vertex_textures) {
-    VkWriteDescriptorSet* write_textures =
-        write_descriptor_sets.data() + write_descriptor_set_count;
-    uint32_t texture_descriptor_set_write_count = WriteTransientTextureBindings(
-        true, texture_count_vertex, sampler_count_vertex,
-        current_guest_graphics_pipeline_layout_
-            ->descriptor_set_layout_textures_vertex_ref(),
-        descriptor_write_image_info_.data() + vertex_texture_image_info_offset,
-        descriptor_write_image_info_.data() + vertex_sampler_image_info_offset,
-        write_textures);
-    if (!texture_descriptor_set_write_count) {
-      return false;
+    const VkDescriptorImageInfo* image_info =
+        descriptor_write_image_info_.data() + vertex_texture_image_info_offset;
+    size_t image_info_count = texture_count_vertex + sampler_count_vertex;
+    uint64_t cache_hash = HashTextureDescriptorSet(
+        texture_descriptor_set_layout_vertex, image_info, image_info_count);
+    VkDescriptorSet texture_descriptor_set = FindCachedTextureDescriptorSet(
+        cache_hash, texture_descriptor_set_layout_vertex, image_info,
+        image_info_count);
+    if (texture_descriptor_set == VK_NULL_HANDLE) {
+      VkWriteDescriptorSet* write_textures =
+          write_descriptor_sets.data() + write_descriptor_set_count;
+      uint32_t texture_descriptor_set_write_count =
+          WriteTransientTextureBindings(
+              true, texture_count_vertex, sampler_count_vertex,
+              texture_descriptor_set_layout_vertex, image_info,
+              descriptor_write_image_info_.data() +
+                  vertex_sampler_image_info_offset,
+              write_textures);
+      if (!texture_descriptor_set_write_count) {
+        return false;
+      }
+      write_descriptor_set_count += texture_descriptor_set_write_count;
+      texture_descriptor_set = write_textures[0].dstSet;
+      CacheTextureDescriptorSet(cache_hash,
+                                texture_descriptor_set_layout_vertex,
+                                image_info, image_info_count,
+                                texture_descriptor_set);
     }
-    write_descriptor_set_count += texture_descriptor_set_write_count;
     write_descriptor_set_bits |=
         UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesVertex;
     current_graphics_descriptor_sets_
         [SpirvShaderTranslator::kDescriptorSetTexturesVertex] =
-            write_textures[0].dstSet;
+            texture_descriptor_set;
+    current_texture_descriptor_set_layout_vertex_ =
+        texture_descriptor_set_layout_vertex;
+    current_texture_descriptor_image_info_vertex_.assign(
+        descriptor_write_image_info_.data() + vertex_texture_image_info_offset,
+        descriptor_write_image_info_.data() + pixel_texture_image_info_offset);
   }
   // Pixel shader textures and samplers.
   if (write_pixel_textures) {
-    VkWriteDescriptorSet* write_textures =
-        write_descriptor_sets.data() + write_descriptor_set_count;
-    uint32_t texture_descriptor_set_write_count = WriteTransientTextureBindings(
-        false, texture_count_pixel, sampler_count_pixel,
-        current_guest_graphics_pipeline_layout_
-            ->descriptor_set_layout_textures_pixel_ref(),
-        descriptor_write_image_info_.data() + pixel_texture_image_info_offset,
-        descriptor_write_image_info_.data() + pixel_sampler_image_info_offset,
-        write_textures);
-    if (!texture_descriptor_set_write_count) {
-      return false;
+    const VkDescriptorImageInfo* image_info =
+        descriptor_write_image_info_.data() + pixel_texture_image_info_offset;
+    size_t image_info_count = texture_count_pixel + sampler_count_pixel;
+    uint64_t cache_hash = HashTextureDescriptorSet(
+        texture_descriptor_set_layout_pixel, image_info, image_info_count);
+    VkDescriptorSet texture_descriptor_set = FindCachedTextureDescriptorSet(
+        cache_hash, texture_descriptor_set_layout_pixel, image_info,
+        image_info_count);
+    if (texture_descriptor_set == VK_NULL_HANDLE) {
+      VkWriteDescriptorSet* write_textures =
+          write_descriptor_sets.data() + write_descriptor_set_count;
+      uint32_t texture_descriptor_set_write_count =
+          WriteTransientTextureBindings(
+              false, texture_count_pixel, sampler_count_pixel,
+              texture_descriptor_set_layout_pixel, image_info,
+              descriptor_write_image_info_.data() +
+                  pixel_sampler_image_info_offset,
+              write_textures);
+      if (!texture_descriptor_set_write_count) {
+        return false;
+      }
+      write_descriptor_set_count += texture_descriptor_set_write_count;
+      texture_descriptor_set = write_textures[0].dstSet;
+      CacheTextureDescriptorSet(cache_hash, texture_descriptor_set_layout_pixel,
+                                image_info, image_info_count,
+                                texture_descriptor_set);
     }
-    write_descriptor_set_count += texture_descriptor_set_write_count;
     write_descriptor_set_bits |=
         UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesPixel;
     current_graphics_descriptor_sets_
         [SpirvShaderTranslator::kDescriptorSetTexturesPixel] =
-            write_textures[0].dstSet;
+            texture_descriptor_set;
+    current_texture_descriptor_set_layout_pixel_ =
+        texture_descriptor_set_layout_pixel;
+    current_texture_descriptor_image_info_pixel_.assign(
+        descriptor_write_image_info_.data() + pixel_texture_image_info_offset,
+        descriptor_write_image_info_.data() +
+            descriptor_write_image_info_.size());
   }
   // Write.
   if (write_descriptor_set_count) {
@@ -4440,6 +4928,68 @@ uint32_t VulkanCommandProcessor::WriteTransientTextureBindings(
   return descriptor_set_write_count;
 }
 
+uint64_t VulkanCommandProcessor::HashTextureDescriptorSet(
+    VkDescriptorSetLayout descriptor_set_layout,
+    const VkDescriptorImageInfo* image_info, size_t image_info_count) {
+  // Only the handles - the image layout is always the same, and the structure
+  // has padding.
+  XXH3_state_t hash_state;
+  XXH3_64bits_reset(&hash_state);
+  XXH3_64bits_update(&hash_state, &descriptor_set_layout,
+                     sizeof(descriptor_set_layout));
+  for (size_t i = 0; i < image_info_count; ++i) {
+    XXH3_64bits_update(&hash_state, &image_info[i].sampler,
+                       sizeof(image_info[i].sampler));
+    XXH3_64bits_update(&hash_state, &image_info[i].imageView,
+                       sizeof(image_info[i].imageView));
+  }
+  return XXH3_64bits_digest(&hash_state);
+}
+
+VkDescriptorSet VulkanCommandProcessor::FindCachedTextureDescriptorSet(
+    uint64_t hash, VkDescriptorSetLayout descriptor_set_layout,
+    const VkDescriptorImageInfo* image_info, size_t image_info_count) const {
+  auto found_range = texture_descriptor_set_cache_.equal_range(hash);
+  for (auto it = found_range.first; it != found_range.second; ++it) {
+    const CachedTextureDescriptorSet& cached_set = it->second;
+    if (cached_set.layout != descriptor_set_layout ||
+        cached_set.image_info_count != image_info_count) {
+      continue;
+    }
+    const VkDescriptorImageInfo* cached_image_info =
+        texture_descriptor_set_cache_image_info_.data() +
+        cached_set.image_info_offset;
+    size_t i = 0;
+    for (; i < image_info_count; ++i) {
+      if (image_info[i].sampler != cached_image_info[i].sampler ||
+          image_info[i].imageView != cached_image_info[i].imageView) {
+        break;
+      }
+    }
+    if (i == image_info_count) {
+      return cached_set.set;
+    }
+  }
+  return VK_NULL_HANDLE;
+}
+
+void VulkanCommandProcessor::CacheTextureDescriptorSet(
+    uint64_t hash, VkDescriptorSetLayout descriptor_set_layout,
+    const VkDescriptorImageInfo* image_info, size_t image_info_count,
+    VkDescriptorSet descriptor_set) {
+  CachedTextureDescriptorSet& cached_set =
+      texture_descriptor_set_cache_.emplace(hash, CachedTextureDescriptorSet())
+          ->second;
+  cached_set.layout = descriptor_set_layout;
+  cached_set.image_info_offset =
+      texture_descriptor_set_cache_image_info_.size();
+  cached_set.image_info_count = image_info_count;
+  cached_set.set = descriptor_set;
+  texture_descriptor_set_cache_image_info_.insert(
+      texture_descriptor_set_cache_image_info_.cend(), image_info,
+      image_info + image_info_count);
+}
+
 }  // namespace vulkan
 }  // namespace gpu
 }  // namespace xe
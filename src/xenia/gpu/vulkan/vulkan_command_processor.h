@@ -12,10 +12,12 @@
 
 #include <array>
 #include <climits>
+#include <condition_variable>
 #include <cstdint>
 #include <deque>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -23,6 +25,8 @@
 
 #include "xenia/base/assert.h"
 #include "xenia/base/hash.h"
+#include "xenia/base/profiling.h"
+#include "xenia/base/threading.h"
 #include "xenia/gpu/command_processor.h"
 #include "xenia/gpu/draw_util.h"
 #include "xenia/gpu/registers.h"
@@ -138,6 +142,12 @@ class VulkanCommandProcessor : public CommandProcessor {
 
   void ClearCaches() override;
 
+  void GetCacheStatistics(CacheStatistics& statistics_out) const override;
+  void AwaitHostGpuIdle() override;
+
+  void InitializeShaderStorage(const std::filesystem::path& cache_root,
+                               uint32_t title_id, bool blocking) override;
+
   void TracePlaybackWroteMemory(uint32_t base_ptr, uint32_t length) override;
 
   void RestoreEdramSnapshot(const void* snapshot) override;
@@ -255,6 +265,7 @@ class VulkanCommandProcessor : public CommandProcessor {
   void ShutdownContext() override;
 
   void WriteRegister(uint32_t index, uint32_t value) override;
+  void OnShaderConstantsWritten(uint32_t first_index, uint32_t count) override;
 
   void OnGammaRamp256EntryTableValueWritten() override;
   void OnGammaRampPWLValueWritten() override;
@@ -279,6 +290,15 @@ class VulkanCommandProcessor : public CommandProcessor {
     VkCommandBuffer buffer;
   };
 
+  // Everything needed to submit a recorded deferred command buffer, other
+  // than the deferred command buffer itself.
+  struct PendingSubmission {
+    VkCommandBuffer command_buffer;
+    VkFence fence;
+    std::vector<VkSemaphore> wait_semaphores;
+    std::vector<VkPipelineStageFlags> wait_stage_masks;
+  };
+
   struct SparseBufferBind {
     VkBuffer buffer;
     size_t bind_offset;
@@ -377,6 +397,13 @@ class VulkanCommandProcessor : public CommandProcessor {
     VkDescriptorSet set;
   };
 
+  struct CachedTextureDescriptorSet {
+    VkDescriptorSetLayout layout;
+    size_t image_info_offset;
+    size_t image_info_count;
+    VkDescriptorSet set;
+  };
+
   enum SwapApplyGammaDescriptorSet : uint32_t {
     kSwapApplyGammaDescriptorSetRamp,
     kSwapApplyGammaDescriptorSetSource,
@@ -413,11 +440,30 @@ class VulkanCommandProcessor : public CommandProcessor {
   // clearing and stopping capturing. Returns whether the submission was done
   // successfully, if it has failed, leaves it open.
   bool EndSubmission(bool is_swap);
+  // Records the deferred command buffer into the Vulkan command buffer, which
+  // must be reset, and submits it to the queue - on the command processor
+  // thread or the submission thread.
+  VkResult ExecuteAndSubmit(DeferredCommandBuffer& deferred_command_buffer,
+                            const PendingSubmission& submission);
+  void SubmissionThread();
+  // Waits until the submission thread has submitted the last ended
+  // submission. A failure to do that is treated as a device loss, as the
+  // submission can't be dropped or retried anymore.
+  void AwaitSubmissionThread();
   bool AwaitAllQueueOperationsCompletion() {
     CheckSubmissionFenceAndDeviceLoss(GetCurrentSubmission());
     return !submission_open_ && submissions_in_flight_fences_.empty();
   }
 
+  // For the GPU profiling scopes. Writes a timestamp query to the deferred
+  // command buffer if it's the context and the submission is open.
+  uint32_t InsertGpuTimestamp(void* context);
+  // Resets the timestamp queries that have been read, for reuse, in the
+  // beginning of a submission (outside a render pass).
+  void ResetReadGpuTimestamps();
+  // Reads the timestamps of the completed submissions for the profiler to take.
+  void ReadCompletedGpuTimestamps();
+
   void ClearTransientDescriptorPools();
 
   void SplitPendingBarrier();
@@ -449,6 +495,20 @@ class VulkanCommandProcessor : public CommandProcessor {
       const VkDescriptorImageInfo* texture_image_info,
       const VkDescriptorImageInfo* sampler_image_info,
       VkWriteDescriptorSet* descriptor_set_writes_out);
+  static uint64_t HashTextureDescriptorSet(
+      VkDescriptorSetLayout descriptor_set_layout,
+      const VkDescriptorImageInfo* image_info, size_t image_info_count);
+  // Returns a texture descriptor set with the same layout and image infos
+  // (image views followed by samplers) written earlier in the current
+  // submission, or VK_NULL_HANDLE if there's none.
+  VkDescriptorSet FindCachedTextureDescriptorSet(
+      uint64_t hash, VkDescriptorSetLayout descriptor_set_layout,
+      const VkDescriptorImageInfo* image_info, size_t image_info_count) const;
+  void CacheTextureDescriptorSet(uint64_t hash,
+                                 VkDescriptorSetLayout descriptor_set_layout,
+                                 const VkDescriptorImageInfo* image_info,
+                                 size_t image_info_count,
+                                 VkDescriptorSet descriptor_set);
 
   bool device_lost_ = false;
 
@@ -491,6 +551,63 @@ class VulkanCommandProcessor : public CommandProcessor {
   std::deque<std::pair<uint64_t, CommandBuffer>> command_buffers_submitted_;
   DeferredCommandBuffer deferred_command_buffer_;
 
+  class GpuTimerSource final : public Profiler::GpuTimerSource {
+   public:
+    explicit GpuTimerSource(VulkanCommandProcessor& command_processor)
+        : command_processor_(command_processor) {}
+    uint32_t InsertTimer(void* context) override {
+      return command_processor_.InsertGpuTimestamp(context);
+    }
+    uint64_t GetTimestamp(uint32_t index) override;
+    uint64_t GetTicksPerSecond() override;
+
+   private:
+    VulkanCommandProcessor& command_processor_;
+  };
+  // Timestamp queries for the GPU profiling scopes, allocated in a ring, and
+  // reset for reuse in the beginning of submissions after they have been read.
+  // The profiler reads the values several frames later, so the ring is large
+  // enough to contain the timestamps of multiple frames.
+  static constexpr uint32_t kGpuTimestampCount = 32768;
+  VkQueryPool gpu_timestamp_query_pool_ = VK_NULL_HANDLE;
+  uint64_t gpu_timestamp_valid_mask_ = 0;
+  // UINT64_MAX if not available yet.
+  std::unique_ptr<uint64_t[]> gpu_timestamp_values_;
+  uint64_t gpu_timestamps_allocated_ = 0;
+  uint64_t gpu_timestamps_submitted_ = 0;
+  uint64_t gpu_timestamps_read_ = 0;
+  // Timestamps before this have been reset in a recorded submission, and can
+  // be written.
+  uint64_t gpu_timestamps_reset_end_ = 0;
+  struct PendingGpuTimestamps {
+    uint64_t timestamp_end;
+    uint64_t submission;
+  };
+  std::deque<PendingGpuTimestamps> gpu_timestamps_pending_;
+  GpuTimerSource gpu_timer_source_{*this};
+
+  // If enabled, recording of the Vulkan command buffer of the last ended
+  // submission and submitting it are done on this thread, while the command
+  // processor thread is processing the guest commands of the next
+  // submission. The deferred command buffers are swapped when handing the
+  // submission over.
+  std::unique_ptr<xe::threading::Thread> submission_thread_;
+  DeferredCommandBuffer submission_thread_deferred_command_buffer_;
+  std::mutex submission_thread_mutex_;
+  // Notified on new submissions and shutdown.
+  std::condition_variable submission_thread_request_cond_;
+  // Notified when the pending submission has been submitted.
+  std::condition_variable submission_thread_completion_cond_;
+  // Protected with submission_thread_mutex_. While a submission is pending,
+  // submission_thread_submission_ and
+  // submission_thread_deferred_command_buffer_ are owned by the submission
+  // thread.
+  PendingSubmission submission_thread_submission_;
+  bool submission_thread_submission_pending_ = false;
+  bool submission_thread_shutdown_ = false;
+  // The first error of the submission thread.
+  VkResult submission_thread_result_ = VK_SUCCESS;
+
   std::vector<VkSparseMemoryBind> sparse_memory_binds_;
   std::vector<SparseBufferBind> sparse_buffer_binds_;
   // SparseBufferBind converted to VkSparseBufferMemoryBindInfo to this buffer
@@ -552,6 +669,19 @@ class VulkanCommandProcessor : public CommandProcessor {
                      std::vector<VkDescriptorSet>,
                      TextureDescriptorSetLayoutKey::Hasher>
       texture_transient_descriptor_sets_free_;
+  // Texture descriptor sets written in the current submission, for reusing
+  // them for all draws with the same bindings, not only consecutive ones.
+  // Image views and samplers are only destroyed after the submissions using
+  // them are completed, and transient descriptor sets are only reclaimed after
+  // the frame, so within one submission, the same handles always refer to the
+  // same objects. Keys are hashes of the layout and the image infos, values
+  // need manual collision resolution using
+  // image_info_offset:image_info_count of
+  // texture_descriptor_set_cache_image_info_.
+  std::unordered_multimap<uint64_t, CachedTextureDescriptorSet,
+                          xe::hash::IdentityHasher<uint64_t>>
+      texture_descriptor_set_cache_;
+  std::vector<VkDescriptorImageInfo> texture_descriptor_set_cache_image_info_;
 
   std::unique_ptr<VulkanSharedMemory> shared_memory_;
 
@@ -683,12 +813,11 @@ class VulkanCommandProcessor : public CommandProcessor {
   VkRenderPass current_render_pass_;
   const VulkanRenderTargetCache::Framebuffer* current_framebuffer_;
 
-  // Currently bound graphics pipeline, either from the pipeline cache (with
-  // potentially deferred creation - current_external_graphics_pipeline_ is
-  // VK_NULL_HANDLE in this case) or a non-Xenos one
-  // (current_guest_graphics_pipeline_ is VK_NULL_HANDLE in this case).
-  // TODO(Triang3l): Change to a deferred compilation handle.
-  VkPipeline current_guest_graphics_pipeline_;
+  // Currently bound graphics pipeline, either from the pipeline cache (a
+  // handle with potentially deferred creation -
+  // current_external_graphics_pipeline_ is VK_NULL_HANDLE in this case) or a
+  // non-Xenos one (current_guest_graphics_pipeline_ is nullptr in this case).
+  void* current_guest_graphics_pipeline_;
   VkPipeline current_external_graphics_pipeline_;
   VkPipeline current_external_compute_pipeline_;
 
@@ -699,11 +828,30 @@ class VulkanCommandProcessor : public CommandProcessor {
   // Whether up-to-date data has been written to constant (uniform) buffers, and
   // the buffer infos in current_constant_buffer_infos_ point to them.
   uint32_t current_constant_buffers_up_to_date_;
+  // Hashes and sizes of the float constants in the current float constant
+  // buffers, for reusing the uploaded buffers for draws with the same constant
+  // values. The size is 0 if the buffer can't be reused (in a new frame).
+  uint64_t current_float_constants_hash_vertex_;
+  uint64_t current_float_constants_hash_pixel_;
+  uint32_t current_float_constants_size_vertex_;
+  uint32_t current_float_constants_size_pixel_;
+  // Used float constants gathered for hashing before uploading.
+  float float_constants_gathered_[256 * 4];
   VkDescriptorSet current_graphics_descriptor_sets_
       [SpirvShaderTranslator::kDescriptorSetCount];
   // Whether descriptor sets in current_graphics_descriptor_sets_ point to
   // up-to-date data.
   uint32_t current_graphics_descriptor_set_values_up_to_date_;
+  // Layouts and image infos (image views followed by samplers) of the texture
+  // descriptor sets in current_graphics_descriptor_sets_, for reusing them
+  // for draws with the same bindings. Valid only while the respective bit in
+  // current_graphics_descriptor_set_values_up_to_date_ is set.
+  VkDescriptorSetLayout current_texture_descriptor_set_layout_vertex_;
+  VkDescriptorSetLayout current_texture_descriptor_set_layout_pixel_;
+  std::vector<VkDescriptorImageInfo>
+      current_texture_descriptor_image_info_vertex_;
+  std::vector<VkDescriptorImageInfo>
+      current_texture_descriptor_image_info_pixel_;
   // Whether the descriptor sets currently bound to the command buffer - only
   // low bits for the descriptor set layouts that remained the same are kept
   // when changing the pipeline layout. May be out of sync with
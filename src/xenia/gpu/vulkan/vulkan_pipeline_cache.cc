@@ -11,17 +11,30 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <tuple>
 #include <utility>
 #include <vector>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/assert.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/frame_breakdown.h"
+#include "xenia/base/lock_profiling.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/string_buffer.h"
 #include "xenia/base/xxhash.h"
 #include "xenia/gpu/draw_util.h"
 #include "xenia/gpu/gpu_flags.h"
@@ -34,6 +47,39 @@
 #include "xenia/gpu/xenos.h"
 #include "xenia/ui/vulkan/vulkan_util.h"
 
+DEFINE_int32(
+    vulkan_pipeline_creation_threads, -1,
+    "Number of threads used for graphics pipeline creation. -1 to calculate "
+    "automatically (75% of logical CPU cores), a positive number to specify "
+    "the number of threads explicitly (up to the number of logical CPU cores), "
+    "0 to disable multithreaded pipeline creation.",
+    "Vulkan");
+DEFINE_bool(
+    vulkan_pipeline_creation_skip_draws, false,
+    "Skip draws with graphics pipelines that are still being created on the "
+    "pipeline creation threads instead of waiting for them at the end of the "
+    "submission. Removes stuttering when new pipelines are encountered, but "
+    "objects may be missing for a few frames.",
+    "Vulkan");
+DEFINE_bool(
+    vulkan_pipeline_creation_fallback, false,
+    "While a graphics pipeline is being created on the pipeline creation "
+    "threads, draw with an already created pipeline that has the same "
+    "shaders, render pass and primitive topology, but different "
+    "rasterization, depth / stencil or blending state, if there is one, "
+    "instead of waiting for the creation or skipping the draw. Removes "
+    "stuttering when new pipeline states are encountered for known shaders, "
+    "but objects may be drawn incorrectly for a few frames.",
+    "Vulkan");
+DEFINE_bool(
+    vulkan_spirv_optimize, false,
+    "Run the SPIRV-Tools optimizer (loaded from the Vulkan SDK) on the "
+    "translated shaders to reduce the size of the SPIR-V given to the driver, "
+    "speeding up pipeline creation. To avoid extra stuttering, only done on "
+    "the threads translating shaders from the shader storage, not for shaders "
+    "translated during drawing.",
+    "Vulkan");
+
 namespace xe {
 namespace gpu {
 namespace vulkan {
@@ -81,6 +127,44 @@ bool VulkanPipelineCache::Initialize() {
     }
   }
 
+  if (cvars::vulkan_spirv_optimize) {
+    spirv_tools_context_ = std::make_unique<ui::vulkan::SpirvToolsContext>();
+    if (!spirv_tools_context_->Initialize(
+            SpirvShaderTranslator::Features(vulkan_device).spirv_version) ||
+        !spirv_tools_context_->IsOptimizerAvailable()) {
+      XELOGW(
+          "VulkanPipelineCache: SPIR-V optimization is not available, shaders "
+          "will be used unoptimized");
+      spirv_tools_context_.reset();
+    }
+  }
+
+  if (cvars::vulkan_pipeline_creation_threads != 0) {
+    uint32_t logical_processor_count =
+        xe::threading::logical_processor_count();
+    if (!logical_processor_count) {
+      // Pick some reasonable amount if couldn't determine the number of cores.
+      logical_processor_count = 6;
+    }
+    size_t creation_thread_count;
+    if (cvars::vulkan_pipeline_creation_threads < 0) {
+      creation_thread_count =
+          std::max(logical_processor_count * 3 / 4, uint32_t(1));
+    } else {
+      creation_thread_count =
+          std::min(uint32_t(cvars::vulkan_pipeline_creation_threads),
+                   logical_processor_count);
+    }
+    creation_threads_shutdown_ = false;
+    for (size_t i = 0; i < creation_thread_count; ++i) {
+      std::unique_ptr<xe::threading::Thread> creation_thread =
+          xe::threading::Thread::Create({}, [this]() { CreationThread(); });
+      assert_not_null(creation_thread);
+      creation_thread->set_name("Vulkan Pipelines");
+      creation_threads_.push_back(std::move(creation_thread));
+    }
+  }
+
   return true;
 }
 
@@ -90,8 +174,30 @@ void VulkanPipelineCache::Shutdown() {
   const ui::vulkan::VulkanDevice::Functions& dfn = vulkan_device->functions();
   const VkDevice device = vulkan_device->device();
 
+  // Shut down all threads, before destroying the pipelines since they may be
+  // creating them.
+  if (!creation_threads_.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(creation_request_lock_);
+      creation_threads_shutdown_ = true;
+    }
+    creation_request_cond_.notify_all();
+    for (auto& creation_thread : creation_threads_) {
+      xe::threading::Wait(creation_thread.get(), false);
+    }
+    creation_threads_.clear();
+  }
+  creation_queue_.clear();
+  creation_background_queue_.clear();
+  creation_urgent_pending_ = 0;
+  creation_threads_busy_ = 0;
+  creation_awaited_in_submission_ = false;
+
+  ShutdownShaderStorage();
+
   // Destroy all pipelines.
   last_pipeline_ = nullptr;
+  fallback_pipelines_.clear();
   for (const auto& pipeline_pair : pipelines_) {
     if (pipeline_pair.second.pipeline != VK_NULL_HANDLE) {
       dfn.vkDestroyPipeline(device, pipeline_pair.second.pipeline, nullptr);
@@ -114,6 +220,8 @@ void VulkanPipelineCache::Shutdown() {
     delete it.second;
   }
   shaders_.clear();
+
+  spirv_tools_context_.reset();
   texture_binding_layout_map_.clear();
   texture_binding_layouts_.clear();
 
@@ -121,12 +229,778 @@ void VulkanPipelineCache::Shutdown() {
   shader_translator_.reset();
 }
 
+void VulkanPipelineCache::InitializeShaderStorage(
+    const std::filesystem::path& cache_root, uint32_t title_id, bool blocking) {
+  // Still open for the title launching another of its executables - what's in
+  // the storage has already been loaded, and the shaders and the pipelines
+  // created since are kept across the launch anyway.
+  if (storage_write_thread_ && shader_storage_title_id_ == title_id &&
+      shader_storage_cache_root_ == cache_root) {
+    return;
+  }
+  ShutdownShaderStorage();
+
+  auto shader_storage_root = cache_root / "shaders";
+  // For files that can be moved between different hosts. The pipeline cache
+  // data of the driver is stored in shaders/local/ instead.
+  auto shader_storage_shareable_root = shader_storage_root / "shareable";
+  if (!std::filesystem::exists(shader_storage_shareable_root)) {
+    std::error_code ec;
+    std::filesystem::create_directories(shader_storage_shareable_root, ec);
+    if (!std::filesystem::exists(shader_storage_shareable_root)) {
+      XELOGE(
+          "Failed to create the shareable shader storage directory, persistent "
+          "shader storage will be disabled: {} (error: {})",
+          xe::path_to_utf8(shader_storage_shareable_root),
+          ec ? ec.message() : "unknown");
+      return;
+    }
+  }
+
+  const ui::vulkan::VulkanDevice* const vulkan_device =
+      command_processor_.GetVulkanDevice();
+
+  bool edram_fragment_shader_interlock =
+      render_target_cache_.GetPath() ==
+      RenderTargetCache::Path::kPixelShaderInterlock;
+
+  // Initialize the pipeline storage stream - read pipeline descriptions and
+  // collect used shader modifications to translate.
+  std::vector<PipelineStoredDescription> pipeline_stored_descriptions;
+  // <Shader hash, modification bits>.
+  std::set<std::pair<uint64_t, uint64_t>> shader_translations_needed;
+  auto pipeline_storage_file_path =
+      shader_storage_shareable_root /
+      fmt::format("{:08X}.{}.vulkan.xpso", title_id,
+                  edram_fragment_shader_interlock ? "fsi" : "rt");
+  pipeline_storage_file_ =
+      xe::filesystem::OpenFile(pipeline_storage_file_path, "a+b");
+  if (!pipeline_storage_file_) {
+    XELOGE(
+        "Failed to open the Vulkan pipeline description storage file for "
+        "writing, persistent shader storage will be disabled: {}",
+        xe::path_to_utf8(pipeline_storage_file_path));
+    return;
+  }
+  pipeline_storage_file_flush_needed_ = false;
+  // Other emulator instances may be using the same storage files concurrently.
+  // They're read under a shared lock, records are only appended to them under
+  // an exclusive lock, and they're truncated or reinitialized only if no other
+  // instance has appended anything since they've been read.
+  xe::filesystem::LockStdioFile(pipeline_storage_file_, false);
+  // 'XEPS'.
+  const uint32_t pipeline_storage_magic = 0x53504558;
+  // 'VKFI' or 'VKRT'.
+  const uint32_t pipeline_storage_magic_api =
+      edram_fragment_shader_interlock ? 0x49464B56 : 0x54524B56;
+  const uint32_t pipeline_storage_version_swapped =
+      xe::byte_swap(std::max(PipelineDescription::kVersion,
+                             SpirvShaderTranslator::Modification::kVersion));
+  struct {
+    uint32_t magic;
+    uint32_t magic_api;
+    uint32_t version_swapped;
+  } pipeline_storage_file_header;
+  if (fread(&pipeline_storage_file_header, sizeof(pipeline_storage_file_header),
+            1, pipeline_storage_file_) &&
+      pipeline_storage_file_header.magic == pipeline_storage_magic &&
+      pipeline_storage_file_header.magic_api == pipeline_storage_magic_api &&
+      pipeline_storage_file_header.version_swapped ==
+          pipeline_storage_version_swapped) {
+    xe::filesystem::Seek(pipeline_storage_file_, 0, SEEK_END);
+    int64_t pipeline_storage_told_end =
+        xe::filesystem::Tell(pipeline_storage_file_);
+    size_t pipeline_storage_told_count =
+        size_t(pipeline_storage_told_end >=
+                       int64_t(sizeof(pipeline_storage_file_header))
+                   ? (uint64_t(pipeline_storage_told_end) -
+                      sizeof(pipeline_storage_file_header)) /
+                         sizeof(PipelineStoredDescription)
+                   : 0);
+    if (pipeline_storage_told_count &&
+        xe::filesystem::Seek(pipeline_storage_file_,
+                             int64_t(sizeof(pipeline_storage_file_header)),
+                             SEEK_SET)) {
+      pipeline_stored_descriptions.resize(pipeline_storage_told_count);
+      pipeline_stored_descriptions.resize(
+          fread(pipeline_stored_descriptions.data(),
+                sizeof(PipelineStoredDescription), pipeline_storage_told_count,
+                pipeline_storage_file_));
+      size_t pipeline_storage_read_count = pipeline_stored_descriptions.size();
+      for (size_t i = 0; i < pipeline_storage_read_count; ++i) {
+        const PipelineStoredDescription& pipeline_stored_description =
+            pipeline_stored_descriptions[i];
+        // Validate file integrity, stop and truncate the stream if data is
+        // corrupted.
+        if (pipeline_stored_description.description.GetHash() !=
+            pipeline_stored_description.description_hash) {
+          pipeline_stored_descriptions.resize(i);
+          break;
+        }
+        // Pipelines requiring device features not available on this device
+        // are kept in the file (so it stays shareable across devices), but
+        // not created.
+        if (!ArePipelineRequirementsMet(
+                pipeline_stored_description.description)) {
+          continue;
+        }
+        // Mark the shader modifications as needed for translation.
+        shader_translations_needed.emplace(
+            pipeline_stored_description.description.vertex_shader_hash,
+            pipeline_stored_description.description.vertex_shader_modification);
+        // Vertex shaders used for point sprites or rectangles expanded to
+        // strips on the host are commonly also used with other primitive
+        // types, and they may first be drawn with a different point parameter
+        // output configuration with another pixel shader. Translate those
+        // modifications in the background too, so they don't have to be
+        // compiled during gameplay, though without creating the pipelines,
+        // which have not been recorded.
+        SpirvShaderTranslator::Modification vertex_shader_modification(
+            pipeline_stored_description.description.vertex_shader_modification);
+        Shader::HostVertexShaderType stored_host_vertex_shader_type =
+            vertex_shader_modification.vertex.host_vertex_shader_type;
+        if (stored_host_vertex_shader_type ==
+                Shader::HostVertexShaderType::kPointListAsTriangleStrip ||
+            stored_host_vertex_shader_type ==
+                Shader::HostVertexShaderType::kRectangleListAsTriangleStrip) {
+          static const Shader::HostVertexShaderType
+              kSiblingHostVertexShaderTypes[] = {
+                  Shader::HostVertexShaderType::kVertex,
+                  Shader::HostVertexShaderType::kPointListAsTriangleStrip,
+                  Shader::HostVertexShaderType::kRectangleListAsTriangleStrip,
+              };
+          for (Shader::HostVertexShaderType sibling_host_vertex_shader_type :
+               kSiblingHostVertexShaderTypes) {
+            SpirvShaderTranslator::Modification sibling_modification =
+                vertex_shader_modification;
+            sibling_modification.vertex.host_vertex_shader_type =
+                sibling_host_vertex_shader_type;
+            // Point size output for kVertex depends on the primitive type that
+            // is not known here, assume not points as they're expanded.
+            sibling_modification.vertex.output_point_parameters = 0;
+            shader_translations_needed.emplace(
+                pipeline_stored_description.description.vertex_shader_hash,
+                sibling_modification.value);
+            if (sibling_host_vertex_shader_type ==
+                Shader::HostVertexShaderType::kPointListAsTriangleStrip) {
+              sibling_modification.vertex.output_point_parameters = 1;
+              shader_translations_needed.emplace(
+                  pipeline_stored_description.description.vertex_shader_hash,
+                  sibling_modification.value);
+            }
+          }
+        }
+        if (pipeline_stored_description.description.pixel_shader_hash) {
+          shader_translations_needed.emplace(
+              pipeline_stored_description.description.pixel_shader_hash,
+              pipeline_stored_description.description
+                  .pixel_shader_modification);
+        }
+      }
+    }
+  }
+  xe::filesystem::Seek(pipeline_storage_file_, 0, SEEK_END);
+  int64_t pipeline_storage_read_end =
+      xe::filesystem::Tell(pipeline_storage_file_);
+  xe::filesystem::UnlockStdioFile(pipeline_storage_file_);
+
+  size_t logical_processor_count = xe::threading::logical_processor_count();
+  if (!logical_processor_count) {
+    // Pick some reasonable amount if couldn't determine the number of cores.
+    logical_processor_count = 6;
+  }
+
+  // Pipelines are set up for creation as soon as the shaders they use are
+  // translated, while the rest of the shaders are still being loaded and
+  // translated, rather than after all of them. <Shader hash, indices of the
+  // stored pipelines using it>, and the number of shaders each pipeline is
+  // waiting for.
+  std::unordered_map<uint64_t, std::vector<size_t>> shader_stored_pipelines;
+  std::vector<uint32_t> stored_pipeline_shaders_pending(
+      pipeline_stored_descriptions.size(), 0);
+  for (size_t i = 0; i < pipeline_stored_descriptions.size(); ++i) {
+    const PipelineDescription& pipeline_description =
+        pipeline_stored_descriptions[i].description;
+    if (!ArePipelineRequirementsMet(pipeline_description)) {
+      continue;
+    }
+    shader_stored_pipelines[pipeline_description.vertex_shader_hash].push_back(
+        i);
+    ++stored_pipeline_shaders_pending[i];
+    if (pipeline_description.pixel_shader_hash &&
+        pipeline_description.pixel_shader_hash !=
+            pipeline_description.vertex_shader_hash) {
+      shader_stored_pipelines[pipeline_description.pixel_shader_hash]
+          .push_back(i);
+      ++stored_pipeline_shaders_pending[i];
+    }
+  }
+
+  // Initialize the Xenos shader storage stream. The file is the same as on
+  // Direct3D 12.
+  uint64_t shader_storage_initialization_start =
+      xe::Clock::QueryHostTickCount();
+  auto shader_storage_file_path =
+      shader_storage_shareable_root / fmt::format("{:08X}.xsh", title_id);
+  shader_storage_file_ =
+      xe::filesystem::OpenFile(shader_storage_file_path, "a+b");
+  if (!shader_storage_file_) {
+    XELOGE(
+        "Failed to open the guest shader storage file for writing, persistent "
+        "shader storage will be disabled: {}",
+        xe::path_to_utf8(shader_storage_file_path));
+    fclose(pipeline_storage_file_);
+    pipeline_storage_file_ = nullptr;
+    return;
+  }
+  ++shader_storage_index_;
+  shader_storage_file_flush_needed_ = false;
+
+  // The driver's own cache makes creation of the stored pipelines, as well as
+  // of the ones first encountered during this run, mostly a lookup. Needed
+  // before any stored pipeline is submitted for creation.
+  InitializeDriverPipelineCache(shader_storage_root / "local" /
+                                fmt::format("{:08X}.vulkan.vkpc", title_id));
+
+  uint64_t pipeline_creation_start = xe::Clock::QueryHostTickCount();
+  std::vector<PipelineCreationArguments> pipelines_to_create;
+  // Looks up everything needed for creation of a stored pipeline on this
+  // thread, as the render pass, layout and geometry shader caches are not
+  // thread-safe, and submits it to the creation threads if there are any.
+  auto create_stored_pipeline =
+      [&](const PipelineDescription& pipeline_description) {
+        if (!ArePipelineRequirementsMet(pipeline_description)) {
+          return;
+        }
+        // Skip already known pipelines.
+        if (pipelines_.find(pipeline_description) != pipelines_.end()) {
+          return;
+        }
+        auto vertex_shader_it =
+            shaders_.find(pipeline_description.vertex_shader_hash);
+        if (vertex_shader_it == shaders_.end()) {
+          return;
+        }
+        auto vertex_shader = static_cast<VulkanShader::VulkanTranslation*>(
+            vertex_shader_it->second->GetTranslation(
+                pipeline_description.vertex_shader_modification));
+        if (!vertex_shader || !vertex_shader->is_translated() ||
+            !vertex_shader->is_valid()) {
+          return;
+        }
+        VulkanShader::VulkanTranslation* pixel_shader = nullptr;
+        if (pipeline_description.pixel_shader_hash) {
+          auto pixel_shader_it =
+              shaders_.find(pipeline_description.pixel_shader_hash);
+          if (pixel_shader_it == shaders_.end()) {
+            return;
+          }
+          pixel_shader = static_cast<VulkanShader::VulkanTranslation*>(
+              pixel_shader_it->second->GetTranslation(
+                  pipeline_description.pixel_shader_modification));
+          if (!pixel_shader || !pixel_shader->is_translated() ||
+              !pixel_shader->is_valid()) {
+            return;
+          }
+        }
+        PipelineCreationArguments creation_arguments;
+        const PipelineLayoutProvider* pipeline_layout;
+        if (!GetPipelineCreationObjects(pipeline_description, vertex_shader,
+                                        pixel_shader, pipeline_layout,
+                                        creation_arguments.geometry_shader,
+                                        creation_arguments.render_pass)) {
+          return;
+        }
+        creation_arguments.pipeline =
+            &EmplacePipeline(pipeline_description, pipeline_layout);
+        creation_arguments.vertex_shader = vertex_shader;
+        creation_arguments.pixel_shader = pixel_shader;
+        pipelines_to_create.push_back(creation_arguments);
+        if (!creation_threads_.empty()) {
+          // Create the pipeline on the creation threads when there are no
+          // pipelines needed by draws to create.
+          {
+            std::lock_guard<std::mutex> lock(creation_request_lock_);
+            creation_background_queue_.push_back(creation_arguments);
+          }
+          creation_request_cond_.notify_one();
+        }
+      };
+  // Called on the command processor thread for every shader from the storage
+  // once all its needed modifications have been translated.
+  auto on_stored_shader_translated = [&](uint64_t ucode_data_hash) {
+    auto shader_stored_pipelines_it =
+        shader_stored_pipelines.find(ucode_data_hash);
+    if (shader_stored_pipelines_it == shader_stored_pipelines.end()) {
+      return;
+    }
+    for (size_t pipeline_index : shader_stored_pipelines_it->second) {
+      if (!--stored_pipeline_shaders_pending[pipeline_index]) {
+        create_stored_pipeline(
+            pipeline_stored_descriptions[pipeline_index].description);
+      }
+    }
+  };
+
+  struct {
+    uint32_t magic;
+    uint32_t version_swapped;
+  } shader_storage_file_header;
+  // 'XESH'.
+  const uint32_t shader_storage_magic = 0x48534558;
+  xe::filesystem::LockStdioFile(shader_storage_file_, false);
+  if (fread(&shader_storage_file_header, sizeof(shader_storage_file_header), 1,
+            shader_storage_file_) &&
+      shader_storage_file_header.magic == shader_storage_magic &&
+      xe::byte_swap(shader_storage_file_header.version_swapped) ==
+          ShaderStoredHeader::kVersion) {
+    uint64_t shader_storage_valid_bytes = sizeof(shader_storage_file_header);
+    // Load and translate shaders written by previous Xenia executions until the
+    // end of the file or until a corrupted one is detected.
+    ShaderStoredHeader shader_header;
+    std::vector<uint32_t> ucode_dwords;
+    ucode_dwords.reserve(0xFFFF);
+    std::vector<uint8_t> ucode_analysis;
+    size_t shaders_translated = 0;
+
+    // Threads overlapping file reading. Once the whole file has been read, the
+    // command processor thread takes shaders from the same queue too.
+    std::mutex shaders_translation_thread_mutex;
+    std::condition_variable shaders_translation_thread_cond;
+    std::deque<VulkanShader*> shaders_to_translate;
+    size_t shader_translation_threads_busy = 0;
+    bool shader_translation_threads_shutdown = false;
+    // Shaders with all the needed modifications translated, for setting up the
+    // pipelines using them on the command processor thread. Protected with
+    // shaders_translation_thread_mutex, notify shaders_translated_cond.
+    std::condition_variable shaders_translated_cond;
+    std::vector<VulkanShader*> shaders_translated_pending;
+    std::mutex shaders_failed_to_translate_mutex;
+    std::vector<VulkanShader::VulkanTranslation*> shaders_failed_to_translate;
+    auto translate_stored_shader = [&](VulkanShader* shader_to_translate,
+                                       StringBuffer& ucode_disasm_buffer,
+                                       SpirvShaderTranslator& translator) {
+      shader_to_translate->AnalyzeUcode(ucode_disasm_buffer);
+      // Translate each needed modification on this thread after performing
+      // modification-independent analysis of the whole shader.
+      uint64_t ucode_data_hash = shader_to_translate->ucode_data_hash();
+      for (auto modification_it = shader_translations_needed.lower_bound(
+               std::make_pair(ucode_data_hash, uint64_t(0)));
+           modification_it != shader_translations_needed.end() &&
+           modification_it->first == ucode_data_hash;
+           ++modification_it) {
+        VulkanShader::VulkanTranslation* translation =
+            static_cast<VulkanShader::VulkanTranslation*>(
+                shader_to_translate->GetOrCreateTranslation(
+                    modification_it->second));
+        // Only try (and delete in case of failure) if it's a new translation.
+        // If it's a shader previously encountered in the game, translation of
+        // which has failed, and the shader storage is loaded later, keep it
+        // this way not to try to translate it again.
+        if (!translation->is_translated() &&
+            !TranslateAnalyzedShader(translator, *translation, true)) {
+          std::lock_guard<std::mutex> lock(shaders_failed_to_translate_mutex);
+          shaders_failed_to_translate.push_back(translation);
+        }
+      }
+    };
+    auto shader_translation_thread_function = [&]() {
+      StringBuffer ucode_disasm_buffer;
+      SpirvShaderTranslator translator(
+          SpirvShaderTranslator::Features(vulkan_device),
+          render_target_cache_.msaa_2x_attachments_supported(),
+          render_target_cache_.msaa_2x_no_attachments_supported(),
+          edram_fragment_shader_interlock);
+      for (;;) {
+        VulkanShader* shader_to_translate;
+        {
+          std::unique_lock<std::mutex> lock(shaders_translation_thread_mutex);
+          shaders_translation_thread_cond.wait(lock, [&]() {
+            return !shaders_to_translate.empty() ||
+                   shader_translation_threads_shutdown;
+          });
+          if (shaders_to_translate.empty()) {
+            return;
+          }
+          shader_to_translate = shaders_to_translate.front();
+          shaders_to_translate.pop_front();
+          ++shader_translation_threads_busy;
+        }
+        translate_stored_shader(shader_to_translate, ucode_disasm_buffer,
+                                translator);
+        {
+          std::lock_guard<std::mutex> lock(shaders_translation_thread_mutex);
+          --shader_translation_threads_busy;
+          shaders_translated_pending.push_back(shader_to_translate);
+        }
+        shaders_translated_cond.notify_one();
+      }
+    };
+    std::vector<std::unique_ptr<xe::threading::Thread>>
+        shader_translation_threads;
+    std::vector<VulkanShader*> shaders_translated_taken;
+    auto take_translated_shaders = [&]() {
+      {
+        std::lock_guard<std::mutex> lock(shaders_translation_thread_mutex);
+        shaders_translated_taken.swap(shaders_translated_pending);
+      }
+      for (VulkanShader* shader : shaders_translated_taken) {
+        on_stored_shader_translated(shader->ucode_data_hash());
+      }
+      shaders_translated_taken.clear();
+    };
+
+    while (true) {
+      if (!fread(&shader_header, sizeof(shader_header), 1,
+                 shader_storage_file_)) {
+        break;
+      }
+      size_t ucode_byte_count =
+          shader_header.ucode_dword_count * sizeof(uint32_t);
+      ucode_dwords.resize(shader_header.ucode_dword_count);
+      if (shader_header.ucode_dword_count &&
+          !fread(ucode_dwords.data(), ucode_byte_count, 1,
+                 shader_storage_file_)) {
+        break;
+      }
+      uint64_t ucode_data_hash =
+          XXH3_64bits(ucode_dwords.data(), ucode_byte_count);
+      if (shader_header.ucode_data_hash != ucode_data_hash) {
+        // Validation failed.
+        break;
+      }
+      ucode_analysis.resize(shader_header.ucode_analysis_size);
+      if (shader_header.ucode_analysis_size &&
+          !fread(ucode_analysis.data(), shader_header.ucode_analysis_size, 1,
+                 shader_storage_file_)) {
+        break;
+      }
+      shader_storage_valid_bytes += sizeof(shader_header) + ucode_byte_count +
+                                    shader_header.ucode_analysis_size;
+      VulkanShader* shader =
+          LoadShader(shader_header.type, ucode_dwords.data(),
+                     shader_header.ucode_dword_count, ucode_data_hash);
+      if (shader->ucode_storage_index() == shader_storage_index_) {
+        // Appeared twice in this file for some reason - skip, otherwise race
+        // condition will be caused by translating twice in parallel.
+        continue;
+      }
+      // Loaded from the current storage - don't write again.
+      shader->set_ucode_storage_index(shader_storage_index_);
+      // Skip the analysis on the translation threads if the results are
+      // stored and valid for this build (AnalyzeUcode returns immediately for
+      // an analyzed shader).
+      if (!ucode_analysis.empty()) {
+        shader->DeserializeUcodeAnalysis(ucode_analysis.data(),
+                                         ucode_analysis.size());
+      }
+      // Create new threads if the currently existing threads can't keep up
+      // with file reading, but not more than the number of logical processors
+      // minus one.
+      size_t shader_translation_threads_needed;
+      {
+        std::lock_guard<std::mutex> lock(shaders_translation_thread_mutex);
+        shader_translation_threads_needed =
+            std::min(shader_translation_threads_busy +
+                         shaders_to_translate.size() + size_t(1),
+                     logical_processor_count - size_t(1));
+      }
+      while (shader_translation_threads.size() <
+             shader_translation_threads_needed) {
+        auto thread = xe::threading::Thread::Create(
+            {}, shader_translation_thread_function);
+        assert_not_null(thread);
+        thread->set_name("Shader Translation");
+        shader_translation_threads.push_back(std::move(thread));
+      }
+      // Request ucode information gathering and translation of all the needed
+      // shaders.
+      {
+        std::lock_guard<std::mutex> lock(shaders_translation_thread_mutex);
+        shaders_to_translate.push_back(shader);
+      }
+      shaders_translation_thread_cond.notify_one();
+      ++shaders_translated;
+      // Start creating the pipelines whose shaders are ready while still
+      // reading.
+      take_translated_shaders();
+    }
+    xe::filesystem::Seek(shader_storage_file_, 0, SEEK_END);
+    int64_t shader_storage_read_end =
+        xe::filesystem::Tell(shader_storage_file_);
+    xe::filesystem::UnlockStdioFile(shader_storage_file_);
+    // Help the translation threads with the rest of the queue, and keep
+    // setting up the pipelines as their shaders become ready.
+    while (true) {
+      VulkanShader* shader_to_translate = nullptr;
+      {
+        std::unique_lock<std::mutex> lock(shaders_translation_thread_mutex);
+        shaders_translated_cond.wait(lock, [&]() {
+          return !shaders_translated_pending.empty() ||
+                 !shaders_to_translate.empty() ||
+                 !shader_translation_threads_busy;
+        });
+        if (shaders_translated_pending.empty()) {
+          if (shaders_to_translate.empty()) {
+            break;
+          }
+          shader_to_translate = shaders_to_translate.front();
+          shaders_to_translate.pop_front();
+        }
+      }
+      if (shader_to_translate) {
+        translate_stored_shader(shader_to_translate, ucode_disasm_buffer_,
+                                *shader_translator_);
+        on_stored_shader_translated(shader_to_translate->ucode_data_hash());
+      } else {
+        take_translated_shaders();
+      }
+    }
+    if (!shader_translation_threads.empty()) {
+      {
+        std::lock_guard<std::mutex> lock(shaders_translation_thread_mutex);
+        shader_translation_threads_shutdown = true;
+      }
+      shaders_translation_thread_cond.notify_all();
+      for (auto& shader_translation_thread : shader_translation_threads) {
+        xe::threading::Wait(shader_translation_thread.get(), false);
+      }
+      shader_translation_threads.clear();
+    }
+    // Not referenced by any pipeline as only valid translations are used.
+    for (VulkanShader::VulkanTranslation* translation :
+         shaders_failed_to_translate) {
+      VulkanShader* shader = static_cast<VulkanShader*>(&translation->shader());
+      shader->DestroyTranslation(translation->modification());
+      if (shader->translations().empty()) {
+        shaders_.erase(shader->ucode_data_hash());
+        delete shader;
+      }
+    }
+    XELOGGPU("Translated {} shaders from the storage in {} milliseconds",
+             shaders_translated,
+             (xe::Clock::QueryHostTickCount() -
+              shader_storage_initialization_start) *
+                 1000 / xe::Clock::QueryHostTickFrequency());
+    if (int64_t(shader_storage_valid_bytes) != shader_storage_read_end &&
+        xe::filesystem::LockStdioFileIfUnchanged(
+            shader_storage_file_, uint64_t(shader_storage_read_end))) {
+      xe::filesystem::TruncateStdioFile(shader_storage_file_,
+                                        shader_storage_valid_bytes);
+      xe::filesystem::UnlockStdioFile(shader_storage_file_);
+    }
+  } else {
+    xe::filesystem::Seek(shader_storage_file_, 0, SEEK_END);
+    int64_t shader_storage_read_end =
+        xe::filesystem::Tell(shader_storage_file_);
+    xe::filesystem::UnlockStdioFile(shader_storage_file_);
+    if (xe::filesystem::LockStdioFileIfUnchanged(
+            shader_storage_file_, uint64_t(shader_storage_read_end))) {
+      xe::filesystem::TruncateStdioFile(shader_storage_file_, 0);
+      shader_storage_file_header.magic = shader_storage_magic;
+      shader_storage_file_header.version_swapped =
+          xe::byte_swap(ShaderStoredHeader::kVersion);
+      fwrite(&shader_storage_file_header, sizeof(shader_storage_file_header),
+             1, shader_storage_file_);
+      xe::filesystem::UnlockStdioFile(shader_storage_file_);
+    }
+  }
+
+  // Finish creating the pipelines.
+  if (!pipeline_stored_descriptions.empty()) {
+    // The shaders of the pipelines still waiting for them weren't in the
+    // shader storage, but may have been loaded before it.
+    for (size_t i = 0; i < pipeline_stored_descriptions.size(); ++i) {
+      if (stored_pipeline_shaders_pending[i]) {
+        create_stored_pipeline(pipeline_stored_descriptions[i].description);
+      }
+    }
+
+    if (creation_threads_.empty() || blocking) {
+      if (creation_threads_.empty()) {
+        // Create the pipelines on all cores, including this thread. References
+        // to unordered_map elements stay valid while nothing is erased from it.
+        std::atomic<size_t> pipeline_creation_next_index(0);
+        auto pipeline_creation_thread_function = [&]() {
+          for (;;) {
+            size_t pipeline_index = pipeline_creation_next_index.fetch_add(1);
+            if (pipeline_index >= pipelines_to_create.size()) {
+              return;
+            }
+            EnsurePipelineCreated(pipelines_to_create[pipeline_index], false);
+          }
+        };
+        std::vector<std::unique_ptr<xe::threading::Thread>>
+            pipeline_creation_threads;
+        size_t pipeline_creation_thread_count =
+            std::min(pipelines_to_create.size(), logical_processor_count);
+        while (pipeline_creation_threads.size() + 1 <
+               pipeline_creation_thread_count) {
+          auto thread = xe::threading::Thread::Create(
+              {}, pipeline_creation_thread_function);
+          assert_not_null(thread);
+          thread->set_name("Vulkan Pipelines");
+          pipeline_creation_threads.push_back(std::move(thread));
+        }
+        pipeline_creation_thread_function();
+        for (auto& pipeline_creation_thread : pipeline_creation_threads) {
+          xe::threading::Wait(pipeline_creation_thread.get(), false);
+        }
+        pipeline_creation_threads.clear();
+        for (const PipelineCreationArguments& creation_arguments :
+             pipelines_to_create) {
+          creation_arguments.pipeline->second.created.store(
+              true, std::memory_order_relaxed);
+        }
+      } else {
+        // If the invocation is blocking, all the shader storage initialization
+        // is expected to be done before proceeding, to avoid latency in the
+        // command processor after the invocation.
+        AwaitAllPipelineCreation();
+      }
+      size_t pipelines_created = 0;
+      for (const PipelineCreationArguments& creation_arguments :
+           pipelines_to_create) {
+        if (creation_arguments.pipeline->second.pipeline != VK_NULL_HANDLE) {
+          ++pipelines_created;
+        }
+      }
+      XELOGGPU(
+          "Created {} graphics pipelines (not including reading the "
+          "descriptions) from the storage in {} milliseconds",
+          pipelines_created,
+          (xe::Clock::QueryHostTickCount() - pipeline_creation_start) * 1000 /
+              xe::Clock::QueryHostTickFrequency());
+    } else {
+      XELOGGPU(
+          "Queued {} graphics pipelines from the storage for creation in the "
+          "background",
+          pipelines_to_create.size());
+    }
+    // If any pipeline descriptions were corrupted (or the whole file has excess
+    // bytes in the end), truncate to the last valid pipeline description.
+    uint64_t pipeline_storage_valid_bytes =
+        sizeof(pipeline_storage_file_header) +
+        sizeof(PipelineStoredDescription) * pipeline_stored_descriptions.size();
+    if (int64_t(pipeline_storage_valid_bytes) != pipeline_storage_read_end &&
+        xe::filesystem::LockStdioFileIfUnchanged(
+            pipeline_storage_file_, uint64_t(pipeline_storage_read_end))) {
+      xe::filesystem::TruncateStdioFile(pipeline_storage_file_,
+                                        pipeline_storage_valid_bytes);
+      xe::filesystem::UnlockStdioFile(pipeline_storage_file_);
+    }
+  } else if (xe::filesystem::LockStdioFileIfUnchanged(
+                 pipeline_storage_file_,
+                 uint64_t(pipeline_storage_read_end))) {
+    xe::filesystem::TruncateStdioFile(pipeline_storage_file_, 0);
+    pipeline_storage_file_header.magic = pipeline_storage_magic;
+    pipeline_storage_file_header.magic_api = pipeline_storage_magic_api;
+    pipeline_storage_file_header.version_swapped =
+        pipeline_storage_version_swapped;
+    fwrite(&pipeline_storage_file_header, sizeof(pipeline_storage_file_header),
+           1, pipeline_storage_file_);
+    xe::filesystem::UnlockStdioFile(pipeline_storage_file_);
+  }
+
+  shader_storage_cache_root_ = cache_root;
+  shader_storage_title_id_ = title_id;
+
+  // Start the storage writing thread.
+  storage_write_flush_shaders_ = false;
+  storage_write_flush_pipelines_ = false;
+  storage_write_thread_shutdown_ = false;
+  storage_write_thread_ =
+      xe::threading::Thread::Create({}, [this]() { StorageWriteThread(); });
+  assert_not_null(storage_write_thread_);
+  storage_write_thread_->set_name("Vulkan Storage writer");
+}
+
+void VulkanPipelineCache::ShutdownShaderStorage() {
+  if (storage_write_thread_) {
+    {
+      auto lock = lock_profiling::Acquire(
+          storage_write_request_lock_, "Vulkan pipeline storage");
+      storage_write_thread_shutdown_ = true;
+    }
+    storage_write_request_cond_.notify_all();
+    xe::threading::Wait(storage_write_thread_.get(), false);
+    storage_write_thread_.reset();
+  }
+  storage_write_shader_queue_.clear();
+  storage_write_pipeline_queue_.clear();
+
+  if (pipeline_storage_file_) {
+    fclose(pipeline_storage_file_);
+    pipeline_storage_file_ = nullptr;
+    pipeline_storage_file_flush_needed_ = false;
+  }
+
+  if (shader_storage_file_) {
+    fclose(shader_storage_file_);
+    shader_storage_file_ = nullptr;
+    shader_storage_file_flush_needed_ = false;
+  }
+
+  // The creation threads may be using the pipeline cache of the driver. The
+  // pipelines queued ahead of time that no draw has needed yet are dropped
+  // rather than waited for.
+  if (!creation_threads_.empty()) {
+    std::deque<PipelineCreationArguments> background_queue;
+    {
+      std::lock_guard<std::mutex> lock(creation_request_lock_);
+      background_queue.swap(creation_background_queue_);
+    }
+    for (const PipelineCreationArguments& creation_arguments :
+         background_queue) {
+      // Not passing a reference to the key of the element being erased.
+      PipelineDescription pipeline_description =
+          creation_arguments.pipeline->first;
+      pipelines_.erase(pipeline_description);
+    }
+    AwaitAllPipelineCreation();
+  }
+  ShutdownDriverPipelineCache();
+
+  shader_storage_cache_root_.clear();
+  shader_storage_title_id_ = 0;
+}
+
+void VulkanPipelineCache::EndSubmission() {
+  if (shader_storage_file_flush_needed_ ||
+      pipeline_storage_file_flush_needed_) {
+    {
+      auto lock = lock_profiling::Acquire(
+          storage_write_request_lock_, "Vulkan pipeline storage");
+      if (shader_storage_file_flush_needed_) {
+        storage_write_flush_shaders_ = true;
+      }
+      if (pipeline_storage_file_flush_needed_) {
+        storage_write_flush_pipelines_ = true;
+      }
+    }
+    storage_write_request_cond_.notify_one();
+    shader_storage_file_flush_needed_ = false;
+    pipeline_storage_file_flush_needed_ = false;
+  }
+  // Pipeline handles are resolved when the submission is executed.
+  if (creation_awaited_in_submission_) {
+    creation_awaited_in_submission_ = false;
+    AwaitUrgentPipelineCreation();
+  }
+}
+
 VulkanShader* VulkanPipelineCache::LoadShader(xenos::ShaderType shader_type,
                                               const uint32_t* host_address,
                                               uint32_t dword_count) {
   // Hash the input memory and lookup the shader.
-  uint64_t data_hash =
-      XXH3_64bits(host_address, dword_count * sizeof(uint32_t));
+  return LoadShader(shader_type, host_address, dword_count,
+                    XXH3_64bits(host_address, dword_count * sizeof(uint32_t)));
+}
+
+VulkanShader* VulkanPipelineCache::LoadShader(xenos::ShaderType shader_type,
+                                              const uint32_t* host_address,
+                                              uint32_t dword_count,
+                                              uint64_t data_hash) {
   auto it = shaders_.find(data_hash);
   if (it != shaders_.end()) {
     // Shader has been previously loaded.
@@ -238,6 +1112,18 @@ bool VulkanPipelineCache::EnsureShadersTranslated(
       XELOGE("Failed to translate the vertex shader!");
       return false;
     }
+    if (shader_storage_file_ && vertex_shader->shader().ucode_storage_index() !=
+                                    shader_storage_index_) {
+      vertex_shader->shader().set_ucode_storage_index(shader_storage_index_);
+      assert_not_null(storage_write_thread_);
+      shader_storage_file_flush_needed_ = true;
+      {
+        auto lock = lock_profiling::Acquire(
+            storage_write_request_lock_, "Vulkan pipeline storage");
+        storage_write_shader_queue_.push_back(&vertex_shader->shader());
+      }
+      storage_write_request_cond_.notify_all();
+    }
   }
   if (!vertex_shader->is_valid()) {
     // Translation attempted previously, but not valid.
@@ -250,6 +1136,19 @@ bool VulkanPipelineCache::EnsureShadersTranslated(
         XELOGE("Failed to translate the pixel shader!");
         return false;
       }
+      if (shader_storage_file_ &&
+          pixel_shader->shader().ucode_storage_index() !=
+              shader_storage_index_) {
+        pixel_shader->shader().set_ucode_storage_index(shader_storage_index_);
+        assert_not_null(storage_write_thread_);
+        shader_storage_file_flush_needed_ = true;
+        {
+          auto lock = lock_profiling::Acquire(
+              storage_write_request_lock_, "Vulkan pipeline storage");
+          storage_write_shader_queue_.push_back(&pixel_shader->shader());
+        }
+        storage_write_request_cond_.notify_all();
+      }
     }
     if (!pixel_shader->is_valid()) {
       // Translation attempted previously, but not valid.
@@ -266,7 +1165,7 @@ bool VulkanPipelineCache::ConfigurePipeline(
     reg::RB_DEPTHCONTROL normalized_depth_control,
     uint32_t normalized_color_mask,
     VulkanRenderTargetCache::RenderPassKey render_pass_key,
-    VkPipeline& pipeline_out,
+    void*& pipeline_handle_out,
     const PipelineLayoutProvider*& pipeline_layout_out) {
 #if XE_GPU_FINE_GRAINED_DRAW_SCOPES
   SCOPE_profile_cpu_f("gpu");
@@ -285,90 +1184,191 @@ bool VulkanPipelineCache::ConfigurePipeline(
     return false;
   }
   if (last_pipeline_ && last_pipeline_->first == description) {
-    pipeline_out = last_pipeline_->second.pipeline;
+    pipeline_handle_out = GetPipelineHandleForDraw(*last_pipeline_);
     pipeline_layout_out = last_pipeline_->second.pipeline_layout;
     return true;
   }
   auto it = pipelines_.find(description);
   if (it != pipelines_.end()) {
     last_pipeline_ = &*it;
-    pipeline_out = it->second.pipeline;
+    pipeline_handle_out = GetPipelineHandleForDraw(*it);
     pipeline_layout_out = it->second.pipeline_layout;
     return true;
   }
 
   // Create the pipeline if not the latest and not already existing.
-  const PipelineLayoutProvider* pipeline_layout =
-      command_processor_.GetPipelineLayout(
-          pixel_shader
-              ? static_cast<const VulkanShader&>(pixel_shader->shader())
-                    .GetTextureBindingsAfterTranslation()
-                    .size()
-              : 0,
-          pixel_shader
-              ? static_cast<const VulkanShader&>(pixel_shader->shader())
-                    .GetSamplerBindingsAfterTranslation()
-                    .size()
-              : 0,
-          static_cast<const VulkanShader&>(vertex_shader->shader())
-              .GetTextureBindingsAfterTranslation()
-              .size(),
-          static_cast<const VulkanShader&>(vertex_shader->shader())
-              .GetSamplerBindingsAfterTranslation()
-              .size());
-  if (!pipeline_layout) {
-    return false;
-  }
-  VkShaderModule geometry_shader = VK_NULL_HANDLE;
-  GeometryShaderKey geometry_shader_key;
-  if (GetGeometryShaderKey(
-          description.geometry_shader,
-          SpirvShaderTranslator::Modification(vertex_shader->modification()),
-          SpirvShaderTranslator::Modification(
-              pixel_shader ? pixel_shader->modification() : 0),
-          geometry_shader_key)) {
-    geometry_shader = GetGeometryShader(geometry_shader_key);
-    if (geometry_shader == VK_NULL_HANDLE) {
-      return false;
-    }
-  }
-  VkRenderPass render_pass =
-      render_target_cache_.GetPath() ==
-              RenderTargetCache::Path::kPixelShaderInterlock
-          ? render_target_cache_.GetFragmentShaderInterlockRenderPass()
-          : render_target_cache_.GetHostRenderTargetsRenderPass(
-                render_pass_key);
-  if (render_pass == VK_NULL_HANDLE) {
+  const PipelineLayoutProvider* pipeline_layout;
+  VkShaderModule geometry_shader;
+  VkRenderPass render_pass;
+  if (!GetPipelineCreationObjects(description, vertex_shader, pixel_shader,
+                                  pipeline_layout, geometry_shader,
+                                  render_pass)) {
     return false;
   }
   PipelineCreationArguments creation_arguments;
-  auto& pipeline =
-      *pipelines_.emplace(description, Pipeline(pipeline_layout)).first;
+  auto& pipeline = EmplacePipeline(description, pipeline_layout);
+  ++pipelines_created_;
   creation_arguments.pipeline = &pipeline;
   creation_arguments.vertex_shader = vertex_shader;
   creation_arguments.pixel_shader = pixel_shader;
   creation_arguments.geometry_shader = geometry_shader;
   creation_arguments.render_pass = render_pass;
-  if (!EnsurePipelineCreated(creation_arguments)) {
-    return false;
+  if (!creation_threads_.empty()) {
+    // Submit the pipeline for creation to any available thread.
+    {
+      std::lock_guard<std::mutex> lock(creation_request_lock_);
+      pipeline.second.creation_urgent = true;
+      ++creation_urgent_pending_;
+      creation_queue_.push_back(creation_arguments);
+    }
+    creation_request_cond_.notify_one();
+  } else {
+    bool created = EnsurePipelineCreated(creation_arguments, true);
+    pipeline.second.created.store(true, std::memory_order_release);
+    if (!created) {
+      return false;
+    }
   }
-  pipeline_out = pipeline.second.pipeline;
+  if (pipeline_storage_file_) {
+    assert_not_null(storage_write_thread_);
+    pipeline_storage_file_flush_needed_ = true;
+    {
+      auto lock = lock_profiling::Acquire(
+          storage_write_request_lock_, "Vulkan pipeline storage");
+      storage_write_pipeline_queue_.emplace_back();
+      PipelineStoredDescription& stored_description =
+          storage_write_pipeline_queue_.back();
+      stored_description.description_hash = description.GetHash();
+      std::memcpy(&stored_description.description, &description,
+                  sizeof(description));
+    }
+    storage_write_request_cond_.notify_all();
+  }
+  last_pipeline_ = &pipeline;
+  pipeline_handle_out = GetPipelineHandleForDraw(pipeline);
   pipeline_layout_out = pipeline_layout;
   return true;
 }
 
+std::pair<const VulkanPipelineCache::PipelineDescription,
+          VulkanPipelineCache::Pipeline>&
+VulkanPipelineCache::EmplacePipeline(
+    const PipelineDescription& description,
+    const PipelineLayoutProvider* pipeline_layout) {
+  // Pipeline is not movable because of the atomic.
+  return *pipelines_
+              .emplace(std::piecewise_construct,
+                       std::forward_as_tuple(description),
+                       std::forward_as_tuple(pipeline_layout))
+              .first;
+}
+
+VulkanPipelineCache::PipelineDescription
+VulkanPipelineCache::GetFallbackDescription(
+    const PipelineDescription& description) {
+  PipelineDescription fallback_description;
+  fallback_description.vertex_shader_hash = description.vertex_shader_hash;
+  fallback_description.vertex_shader_modification =
+      description.vertex_shader_modification;
+  fallback_description.pixel_shader_hash = description.pixel_shader_hash;
+  fallback_description.pixel_shader_modification =
+      description.pixel_shader_modification;
+  fallback_description.render_pass_key = description.render_pass_key;
+  fallback_description.geometry_shader = description.geometry_shader;
+  fallback_description.primitive_topology = description.primitive_topology;
+  fallback_description.primitive_restart = description.primitive_restart;
+  return fallback_description;
+}
+
+void* VulkanPipelineCache::GetPipelineHandleForDraw(
+    std::pair<const PipelineDescription, Pipeline>& pipeline) {
+  if (pipeline.second.created.load(std::memory_order_acquire)) {
+    if (!pipeline.second.fallback_registered) {
+      pipeline.second.fallback_registered = true;
+      if (pipeline.second.pipeline != VK_NULL_HANDLE) {
+        fallback_pipelines_.emplace(GetFallbackDescription(pipeline.first),
+                                    &pipeline);
+      }
+    }
+    return &pipeline;
+  }
+  {
+    std::lock_guard<std::mutex> lock(creation_request_lock_);
+    if (!pipeline.second.creation_urgent &&
+        !pipeline.second.created.load(std::memory_order_relaxed)) {
+      // Queued ahead of time, but needed now - move it to the urgent queue if
+      // no thread has taken it yet.
+      pipeline.second.creation_urgent = true;
+      ++creation_urgent_pending_;
+      auto background_it = std::find_if(
+          creation_background_queue_.begin(), creation_background_queue_.end(),
+          [&pipeline](const PipelineCreationArguments& creation_arguments) {
+            return creation_arguments.pipeline == &pipeline;
+          });
+      if (background_it != creation_background_queue_.end()) {
+        creation_queue_.push_back(*background_it);
+        creation_background_queue_.erase(background_it);
+      }
+    }
+  }
+  if (cvars::vulkan_pipeline_creation_fallback) {
+    // Only contains pipelines that have been created successfully.
+    auto fallback_it =
+        fallback_pipelines_.find(GetFallbackDescription(pipeline.first));
+    if (fallback_it != fallback_pipelines_.end()) {
+      return fallback_it->second;
+    }
+  }
+  if (cvars::vulkan_pipeline_creation_skip_draws) {
+    return nullptr;
+  }
+  creation_awaited_in_submission_ = true;
+  return &pipeline;
+}
+
 bool VulkanPipelineCache::TranslateAnalyzedShader(
     SpirvShaderTranslator& translator,
-    VulkanShader::VulkanTranslation& translation) {
+    VulkanShader::VulkanTranslation& translation, bool optimize) {
   VulkanShader& shader = static_cast<VulkanShader&>(translation.shader());
 
   // Perform translation.
   // If this fails the shader will be marked as invalid and ignored later.
+  uint64_t translation_start = xe::Clock::QueryHostTickCount();
   if (!translator.TranslateAnalyzedShader(translation)) {
     XELOGE("Shader {:016X} translation failed; marking as ignored",
            shader.ucode_data_hash());
     return false;
   }
+
+  if (optimize && spirv_tools_context_ && translation.is_valid()) {
+    // The modification bits are already taken into account by the translator,
+    // so this mostly removes the branches and the computations that turned
+    // out to be unneeded for the specific modification, and promotes the
+    // local variables to SSA for the driver.
+    static const char* const kOptimizationPassFlags[] = {
+        "--eliminate-local-single-block",
+        "--eliminate-local-single-store",
+        "--ssa-rewrite",
+        "--ccp",
+        "--eliminate-dead-branches",
+        "--merge-blocks",
+        "--eliminate-dead-code-aggressive",
+    };
+    uint64_t optimization_start = xe::Clock::QueryHostTickCount();
+    size_t unoptimized_size = translation.translated_binary().size();
+    if (translation.Optimize(*spirv_tools_context_, kOptimizationPassFlags,
+                             xe::countof(kOptimizationPassFlags))) {
+      uint64_t optimization_end = xe::Clock::QueryHostTickCount();
+      uint64_t tick_frequency = xe::Clock::QueryHostTickFrequency();
+      XELOGGPU(
+          "Shader {:016X} modification {:016X}: translated in {} us, optimized "
+          "in {} us, {} -> {} bytes",
+          shader.ucode_data_hash(), translation.modification(),
+          (optimization_start - translation_start) * 1000000 / tick_frequency,
+          (optimization_end - optimization_start) * 1000000 / tick_frequency,
+          unoptimized_size, translation.translated_binary().size());
+    }
+  }
   if (translation.GetOrCreateShaderModule() == VK_NULL_HANDLE) {
     return false;
   }
@@ -378,6 +1378,8 @@ bool VulkanPipelineCache::TranslateAnalyzedShader(
 
   // Set up the texture binding layout.
   if (shader.EnterBindingLayoutUserUIDSetup()) {
+    // May be called from shader storage loading threads.
+    std::lock_guard<std::mutex> layouts_lock(layouts_mutex_);
     // Obtain the unique IDs of the binding layout if there are any texture
     // bindings, for invalidation in the command processor.
     size_t texture_binding_layout_uid = kLayoutUIDEmpty;
@@ -1770,11 +2772,60 @@ VkShaderModule VulkanPipelineCache::GetGeometryShader(GeometryShaderKey key) {
   return shader_module;
 }
 
+bool VulkanPipelineCache::GetPipelineCreationObjects(
+    const PipelineDescription& description,
+    const VulkanShader::VulkanTranslation* vertex_shader,
+    const VulkanShader::VulkanTranslation* pixel_shader,
+    const PipelineLayoutProvider*& pipeline_layout_out,
+    VkShaderModule& geometry_shader_out, VkRenderPass& render_pass_out) {
+  pipeline_layout_out = command_processor_.GetPipelineLayout(
+      pixel_shader ? static_cast<const VulkanShader&>(pixel_shader->shader())
+                         .GetTextureBindingsAfterTranslation()
+                         .size()
+                   : 0,
+      pixel_shader ? static_cast<const VulkanShader&>(pixel_shader->shader())
+                         .GetSamplerBindingsAfterTranslation()
+                         .size()
+                   : 0,
+      static_cast<const VulkanShader&>(vertex_shader->shader())
+          .GetTextureBindingsAfterTranslation()
+          .size(),
+      static_cast<const VulkanShader&>(vertex_shader->shader())
+          .GetSamplerBindingsAfterTranslation()
+          .size());
+  if (!pipeline_layout_out) {
+    return false;
+  }
+  geometry_shader_out = VK_NULL_HANDLE;
+  GeometryShaderKey geometry_shader_key;
+  if (GetGeometryShaderKey(
+          description.geometry_shader,
+          SpirvShaderTranslator::Modification(vertex_shader->modification()),
+          SpirvShaderTranslator::Modification(
+              pixel_shader ? pixel_shader->modification() : 0),
+          geometry_shader_key)) {
+    geometry_shader_out = GetGeometryShader(geometry_shader_key);
+    if (geometry_shader_out == VK_NULL_HANDLE) {
+      return false;
+    }
+  }
+  render_pass_out =
+      render_target_cache_.GetPath() ==
+              RenderTargetCache::Path::kPixelShaderInterlock
+          ? render_target_cache_.GetFragmentShaderInterlockRenderPass()
+          : render_target_cache_.GetHostRenderTargetsRenderPass(
+                description.render_pass_key);
+  return render_pass_out != VK_NULL_HANDLE;
+}
+
 bool VulkanPipelineCache::EnsurePipelineCreated(
-    const PipelineCreationArguments& creation_arguments) {
+    const PipelineCreationArguments& creation_arguments, bool blocking) {
   if (creation_arguments.pipeline->second.pipeline != VK_NULL_HANDLE) {
     return true;
   }
+  frame_breakdown::ScopedTimer frame_breakdown_timer(
+      frame_breakdown::Category::kPipelineCreation);
+  uint64_t compile_start_tick = Clock::QueryHostTickCount();
 
   // This function preferably should validate the description to prevent
   // unsupported behavior that may be dangerous/crashing because pipelines can
@@ -2166,7 +3217,7 @@ bool VulkanPipelineCache::EnsurePipelineCreated(
   const ui::vulkan::VulkanDevice::Functions& dfn = vulkan_device->functions();
   const VkDevice device = vulkan_device->device();
   VkPipeline pipeline;
-  if (dfn.vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1,
+  if (dfn.vkCreateGraphicsPipelines(device, driver_pipeline_cache_, 1,
                                     &pipeline_create_info, nullptr,
                                     &pipeline) != VK_SUCCESS) {
     // TODO(Triang3l): Move these error messages outside.
@@ -2182,9 +3233,352 @@ bool VulkanPipelineCache::EnsurePipelineCreated(
     return false;
   }
   creation_arguments.pipeline->second.pipeline = pipeline;
+
+  PipelineCompileLog::Record compile_record;
+  compile_record.description_hash =
+      XXH3_64bits(&description, sizeof(description));
+  compile_record.vertex_shader_hash =
+      creation_arguments.vertex_shader->shader().ucode_data_hash();
+  compile_record.vertex_shader_modification =
+      creation_arguments.vertex_shader->modification();
+  if (creation_arguments.pixel_shader) {
+    compile_record.pixel_shader_hash =
+        creation_arguments.pixel_shader->shader().ucode_data_hash();
+    compile_record.pixel_shader_modification =
+        creation_arguments.pixel_shader->modification();
+  } else {
+    compile_record.pixel_shader_hash = 0;
+    compile_record.pixel_shader_modification = 0;
+  }
+  compile_record.frame = command_processor_.swap_count();
+  compile_record.compile_us =
+      (Clock::QueryHostTickCount() - compile_start_tick) * 1000000 /
+      Clock::QueryHostTickFrequency();
+  compile_record.blocking = blocking;
+  command_processor_.pipeline_compile_log().Add(compile_record);
   return true;
 }
 
+void VulkanPipelineCache::InitializeDriverPipelineCache(
+    const std::filesystem::path& file_path) {
+  const ui::vulkan::VulkanDevice* const vulkan_device =
+      command_processor_.GetVulkanDevice();
+  const ui::vulkan::VulkanDevice::Functions& dfn = vulkan_device->functions();
+  const VkDevice device = vulkan_device->device();
+  const ui::vulkan::VulkanDevice::Properties& device_properties =
+      vulkan_device->properties();
+
+  std::vector<uint8_t> initial_data;
+  FILE* file = xe::filesystem::OpenFile(file_path, "rb");
+  if (file) {
+    VkPipelineCacheHeaderVersionOne header;
+    xe::filesystem::Seek(file, 0, SEEK_END);
+    int64_t file_size = xe::filesystem::Tell(file);
+    if (file_size >= int64_t(sizeof(header)) &&
+        xe::filesystem::Seek(file, 0, SEEK_SET)) {
+      initial_data.resize(size_t(file_size));
+      if (fread(initial_data.data(), initial_data.size(), 1, file)) {
+        // Drivers must ignore incompatible data themselves, but not all of
+        // them are robust against it, so only pass data created for the same
+        // device and driver.
+        std::memcpy(&header, initial_data.data(), sizeof(header));
+        if (header.headerSize < sizeof(header) ||
+            header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+            header.vendorID != device_properties.vendorID ||
+            header.deviceID != device_properties.deviceID ||
+            std::memcmp(header.pipelineCacheUUID,
+                        device_properties.pipelineCacheUUID, VK_UUID_SIZE)) {
+          XELOGGPU(
+              "Discarding the Vulkan pipeline cache data created for a "
+              "different device or driver: {}",
+              xe::path_to_utf8(file_path));
+          initial_data.clear();
+        }
+      } else {
+        initial_data.clear();
+      }
+    }
+    fclose(file);
+  }
+
+  VkPipelineCacheCreateInfo pipeline_cache_create_info;
+  pipeline_cache_create_info.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  pipeline_cache_create_info.pNext = nullptr;
+  pipeline_cache_create_info.flags = 0;
+  pipeline_cache_create_info.initialDataSize = initial_data.size();
+  pipeline_cache_create_info.pInitialData = initial_data.data();
+  if (dfn.vkCreatePipelineCache(device, &pipeline_cache_create_info, nullptr,
+                                &driver_pipeline_cache_) != VK_SUCCESS) {
+    driver_pipeline_cache_ = VK_NULL_HANDLE;
+    if (!initial_data.empty()) {
+      XELOGW(
+          "Failed to create the Vulkan pipeline cache from the stored data, "
+          "creating an empty one");
+      pipeline_cache_create_info.initialDataSize = 0;
+      pipeline_cache_create_info.pInitialData = nullptr;
+      if (dfn.vkCreatePipelineCache(device, &pipeline_cache_create_info,
+                                    nullptr, &driver_pipeline_cache_) !=
+          VK_SUCCESS) {
+        driver_pipeline_cache_ = VK_NULL_HANDLE;
+      }
+    }
+    if (driver_pipeline_cache_ == VK_NULL_HANDLE) {
+      XELOGE("Failed to create the Vulkan pipeline cache");
+      return;
+    }
+  }
+  driver_pipeline_cache_file_path_ = file_path;
+}
+
+void VulkanPipelineCache::ShutdownDriverPipelineCache() {
+  if (driver_pipeline_cache_ == VK_NULL_HANDLE) {
+    return;
+  }
+  const ui::vulkan::VulkanDevice* const vulkan_device =
+      command_processor_.GetVulkanDevice();
+  const ui::vulkan::VulkanDevice::Functions& dfn = vulkan_device->functions();
+  const VkDevice device = vulkan_device->device();
+
+  size_t data_size = 0;
+  std::vector<uint8_t> data;
+  if (dfn.vkGetPipelineCacheData(device, driver_pipeline_cache_, &data_size,
+                                 nullptr) == VK_SUCCESS &&
+      data_size) {
+    data.resize(data_size);
+    // VK_INCOMPLETE still returns a valid, though partial, cache.
+    if (dfn.vkGetPipelineCacheData(device, driver_pipeline_cache_, &data_size,
+                                   data.data()) < VK_SUCCESS) {
+      data_size = 0;
+    }
+  }
+  if (data_size) {
+    if (!xe::filesystem::CreateParentFolder(
+            driver_pipeline_cache_file_path_)) {
+      XELOGE("Failed to create the local shader storage directory: {}",
+             xe::path_to_utf8(driver_pipeline_cache_file_path_.parent_path()));
+    } else {
+      FILE* file =
+          xe::filesystem::OpenFile(driver_pipeline_cache_file_path_, "wb");
+      if (file) {
+        fwrite(data.data(), data_size, 1, file);
+        fclose(file);
+      } else {
+        XELOGE("Failed to open the Vulkan pipeline cache file for writing: {}",
+               xe::path_to_utf8(driver_pipeline_cache_file_path_));
+      }
+    }
+  }
+
+  dfn.vkDestroyPipelineCache(device, driver_pipeline_cache_, nullptr);
+  driver_pipeline_cache_ = VK_NULL_HANDLE;
+  driver_pipeline_cache_file_path_.clear();
+}
+
+void VulkanPipelineCache::StorageWriteThread() {
+  ShaderStoredHeader shader_header;
+  // Don't leak anything in unused bits.
+  std::memset(&shader_header, 0, sizeof(shader_header));
+
+  std::vector<uint32_t> ucode_guest_endian;
+  ucode_guest_endian.reserve(0xFFFF);
+  std::vector<uint8_t> ucode_analysis;
+
+  bool flush_shaders = false;
+  bool flush_pipelines = false;
+
+  while (true) {
+    if (flush_shaders) {
+      flush_shaders = false;
+      assert_not_null(shader_storage_file_);
+      fflush(shader_storage_file_);
+    }
+    if (flush_pipelines) {
+      flush_pipelines = false;
+      assert_not_null(pipeline_storage_file_);
+      fflush(pipeline_storage_file_);
+    }
+
+    const Shader* shader = nullptr;
+    PipelineStoredDescription pipeline_description;
+    bool write_pipeline = false;
+    {
+      auto lock = lock_profiling::Acquire(
+          storage_write_request_lock_, "Vulkan pipeline storage");
+      if (storage_write_thread_shutdown_) {
+        return;
+      }
+      if (!storage_write_shader_queue_.empty()) {
+        shader = storage_write_shader_queue_.front();
+        storage_write_shader_queue_.pop_front();
+      } else if (storage_write_flush_shaders_) {
+        storage_write_flush_shaders_ = false;
+        flush_shaders = true;
+      }
+      if (!storage_write_pipeline_queue_.empty()) {
+        std::memcpy(&pipeline_description,
+                    &storage_write_pipeline_queue_.front(),
+                    sizeof(pipeline_description));
+        storage_write_pipeline_queue_.pop_front();
+        write_pipeline = true;
+      } else if (storage_write_flush_pipelines_) {
+        storage_write_flush_pipelines_ = false;
+        flush_pipelines = true;
+      }
+      if (!shader && !write_pipeline) {
+        storage_write_request_cond_.wait(lock);
+        continue;
+      }
+    }
+
+    if (shader) {
+      shader_header.ucode_data_hash = shader->ucode_data_hash();
+      shader_header.ucode_dword_count = shader->ucode_dword_count();
+      shader_header.type = shader->type();
+      // Shaders are written to the storage after being translated, so they are
+      // already analyzed.
+      if (shader->is_ucode_analyzed()) {
+        shader->SerializeUcodeAnalysis(ucode_analysis);
+      } else {
+        ucode_analysis.clear();
+      }
+      shader_header.ucode_analysis_size = uint32_t(ucode_analysis.size());
+      assert_not_null(shader_storage_file_);
+      // The whole record is written under the lock, so records of different
+      // emulator instances are not interleaved.
+      xe::filesystem::LockStdioFile(shader_storage_file_, true);
+      fwrite(&shader_header, sizeof(shader_header), 1, shader_storage_file_);
+      if (shader_header.ucode_dword_count) {
+        ucode_guest_endian.resize(shader_header.ucode_dword_count);
+        // Need to swap because the hash is calculated for the shader with guest
+        // endianness.
+        xe::copy_and_swap(ucode_guest_endian.data(), shader->ucode_dwords(),
+                          shader_header.ucode_dword_count);
+        fwrite(ucode_guest_endian.data(),
+               shader_header.ucode_dword_count * sizeof(uint32_t), 1,
+               shader_storage_file_);
+      }
+      if (!ucode_analysis.empty()) {
+        fwrite(ucode_analysis.data(), ucode_analysis.size(), 1,
+               shader_storage_file_);
+      }
+      xe::filesystem::UnlockStdioFile(shader_storage_file_);
+    }
+
+    if (write_pipeline) {
+      assert_not_null(pipeline_storage_file_);
+      xe::filesystem::LockStdioFile(pipeline_storage_file_, true);
+      fwrite(&pipeline_description, sizeof(pipeline_description), 1,
+             pipeline_storage_file_);
+      xe::filesystem::UnlockStdioFile(pipeline_storage_file_);
+    }
+  }
+}
+
+void VulkanPipelineCache::CreationThread() {
+  while (true) {
+    PipelineCreationArguments creation_arguments;
+    {
+      std::unique_lock<std::mutex> lock(creation_request_lock_);
+      if (creation_threads_shutdown_) {
+        return;
+      }
+      if (!creation_queue_.empty()) {
+        creation_arguments = creation_queue_.front();
+        creation_queue_.pop_front();
+      } else if (!creation_background_queue_.empty()) {
+        creation_arguments = creation_background_queue_.front();
+        creation_background_queue_.pop_front();
+      } else {
+        creation_request_cond_.wait(lock);
+        continue;
+      }
+      // Other threads must be able to dequeue requests, but whoever awaits
+      // the completion of all the pipelines must know that this one is still
+      // being created.
+      ++creation_threads_busy_;
+    }
+    CreateQueuedPipeline(creation_arguments);
+  }
+}
+
+void VulkanPipelineCache::CreateQueuedPipeline(
+    const PipelineCreationArguments& creation_arguments) {
+  // The caller has incremented creation_threads_busy_ when dequeueing.
+  Pipeline& pipeline = creation_arguments.pipeline->second;
+  bool urgent;
+  {
+    // May be made urgent by the command processor thread at any time.
+    std::lock_guard<std::mutex> lock(creation_request_lock_);
+    urgent = pipeline.creation_urgent;
+  }
+  EnsurePipelineCreated(creation_arguments, urgent);
+  bool notify_completion = false;
+  {
+    std::lock_guard<std::mutex> lock(creation_request_lock_);
+    pipeline.created.store(true, std::memory_order_release);
+    if (pipeline.creation_urgent) {
+      assert_not_zero(creation_urgent_pending_);
+      notify_completion = !--creation_urgent_pending_;
+    }
+    assert_not_zero(creation_threads_busy_);
+    --creation_threads_busy_;
+    notify_completion |= !creation_threads_busy_ && creation_queue_.empty() &&
+                         creation_background_queue_.empty();
+  }
+  if (notify_completion) {
+    creation_completion_cond_.notify_all();
+  }
+}
+
+void VulkanPipelineCache::AwaitUrgentPipelineCreation() {
+  assert_false(creation_threads_.empty());
+  // Don't stay idle while the creation threads are working on the pipelines
+  // needed by the submission.
+  while (true) {
+    PipelineCreationArguments creation_arguments;
+    {
+      std::lock_guard<std::mutex> lock(creation_request_lock_);
+      if (creation_queue_.empty()) {
+        break;
+      }
+      creation_arguments = creation_queue_.front();
+      creation_queue_.pop_front();
+      ++creation_threads_busy_;
+    }
+    CreateQueuedPipeline(creation_arguments);
+  }
+  std::unique_lock<std::mutex> lock(creation_request_lock_);
+  creation_completion_cond_.wait(
+      lock, [this]() { return !creation_urgent_pending_; });
+}
+
+void VulkanPipelineCache::AwaitAllPipelineCreation() {
+  assert_false(creation_threads_.empty());
+  while (true) {
+    PipelineCreationArguments creation_arguments;
+    {
+      std::lock_guard<std::mutex> lock(creation_request_lock_);
+      if (!creation_queue_.empty()) {
+        creation_arguments = creation_queue_.front();
+        creation_queue_.pop_front();
+      } else if (!creation_background_queue_.empty()) {
+        creation_arguments = creation_background_queue_.front();
+        creation_background_queue_.pop_front();
+      } else {
+        break;
+      }
+      ++creation_threads_busy_;
+    }
+    CreateQueuedPipeline(creation_arguments);
+  }
+  std::unique_lock<std::mutex> lock(creation_request_lock_);
+  creation_completion_cond_.wait(lock, [this]() {
+    return !creation_threads_busy_ && creation_queue_.empty() &&
+           creation_background_queue_.empty();
+  });
+}
+
 }  // namespace vulkan
 }  // namespace gpu
 }  // namespace xe
@@ -10,15 +10,23 @@
 #ifndef XENIA_GPU_VULKAN_VULKAN_PIPELINE_STATE_CACHE_H_
 #define XENIA_GPU_VULKAN_VULKAN_PIPELINE_STATE_CACHE_H_
 
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdio>
 #include <cstring>
+#include <deque>
+#include <filesystem>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "xenia/base/hash.h"
 #include "xenia/base/platform.h"
+#include "xenia/base/threading.h"
 #include "xenia/base/xxhash.h"
 #include "xenia/gpu/primitive_processor.h"
 #include "xenia/gpu/register_file.h"
@@ -65,6 +73,12 @@ class VulkanPipelineCache {
   bool Initialize();
   void Shutdown();
 
+  void InitializeShaderStorage(const std::filesystem::path& cache_root,
+                               uint32_t title_id, bool blocking);
+  void ShutdownShaderStorage();
+
+  void EndSubmission();
+
   VulkanShader* LoadShader(xenos::ShaderType shader_type,
                            const uint32_t* host_address, uint32_t dword_count);
   // Analyze shader microcode on the translator thread.
@@ -84,7 +98,14 @@ class VulkanPipelineCache {
 
   bool EnsureShadersTranslated(VulkanShader::VulkanTranslation* vertex_shader,
                                VulkanShader::VulkanTranslation* pixel_shader);
-  // TODO(Triang3l): Return a deferred creation handle.
+  // Returns a handle of the pipeline, which may still be being created on the
+  // creation threads - it must be bound via
+  // DeferredCommandBuffer::CmdBindPipelineHandle, and is resolved when the
+  // submission is executed, after EndSubmission has awaited the creation. If
+  // draws are skipped while their pipelines are being created, the handle is
+  // nullptr (and true is returned) if the pipeline is not ready yet. If
+  // fallback pipelines are enabled, the handle may be of an already created
+  // pipeline that differs only in fixed-function state instead.
   bool ConfigurePipeline(
       VulkanShader::VulkanTranslation* vertex_shader,
       VulkanShader::VulkanTranslation* pixel_shader,
@@ -92,10 +113,37 @@ class VulkanPipelineCache {
       reg::RB_DEPTHCONTROL normalized_depth_control,
       uint32_t normalized_color_mask,
       VulkanRenderTargetCache::RenderPassKey render_pass_key,
-      VkPipeline& pipeline_out,
+      void*& pipeline_handle_out,
       const PipelineLayoutProvider*& pipeline_layout_out);
 
+  // For handles returned during the current submission, may be called only
+  // after EndSubmission. VK_NULL_HANDLE if failed to create the pipeline.
+  static VkPipeline GetVulkanPipelineByHandle(const void* handle) {
+    return static_cast<const std::pair<const PipelineDescription, Pipeline>*>(
+               handle)
+        ->second.pipeline;
+  }
+
+  // Number of pipelines that weren't found in the cache when configuring
+  // draws, not including the ones loaded from the storage, for benchmarking.
+  uint64_t pipelines_created() const { return pipelines_created_; }
+
  private:
+  // Same format as on Direct3D 12, so the guest shader storage file is shared
+  // between the backends.
+  XEPACKEDSTRUCT(ShaderStoredHeader, {
+    uint64_t ucode_data_hash;
+
+    uint32_t ucode_dword_count : 31;
+    xenos::ShaderType type : 1;
+
+    // Size of the Shader::SerializeUcodeAnalysis data following the ucode, or
+    // 0 if not stored.
+    uint32_t ucode_analysis_size;
+
+    static constexpr uint32_t kVersion = 0x20261014;
+  });
+
   enum class PipelineGeometryShader : uint32_t {
     kNone,
     kPointList,
@@ -185,6 +233,8 @@ class VulkanPipelineCache {
     // Filled only for the attachments present in the render pass object.
     PipelineRenderTarget render_targets[xenos::kMaxColorRenderTargets];
 
+    static constexpr uint32_t kVersion = 0x20261014;
+
     // Including all the padding, for a stable hash.
     PipelineDescription() { Reset(); }
     PipelineDescription(const PipelineDescription& description) {
@@ -206,11 +256,27 @@ class VulkanPipelineCache {
     };
   });
 
+  XEPACKEDSTRUCT(PipelineStoredDescription, {
+    uint64_t description_hash;
+    PipelineDescription description;
+  });
+
   struct Pipeline {
     VkPipeline pipeline = VK_NULL_HANDLE;
     // The layouts are owned by the VulkanCommandProcessor, and must not be
     // destroyed by it while the pipeline cache is active.
     const PipelineLayoutProvider* pipeline_layout;
+    // Whether the creation has been completed, successfully or not. Set with
+    // release ordering, under creation_request_lock_ if creation threads are
+    // used, after writing `pipeline`.
+    std::atomic<bool> created{false};
+    // Whether a draw in the current or a past submission needs the pipeline,
+    // so the creation can't be left for the background. Protected with
+    // creation_request_lock_.
+    bool creation_urgent = false;
+    // Whether the pipeline, once created, has been considered for
+    // fallback_pipelines_. Command processor thread only.
+    bool fallback_registered = false;
     Pipeline(const PipelineLayoutProvider* pipeline_layout_provider)
         : pipeline_layout(pipeline_layout_provider) {}
   };
@@ -252,9 +318,15 @@ class VulkanPipelineCache {
     }
   };
 
-  // Can be called from multiple threads.
+  VulkanShader* LoadShader(xenos::ShaderType shader_type,
+                           const uint32_t* host_address, uint32_t dword_count,
+                           uint64_t data_hash);
+
+  // Can be called from multiple threads. Optimization, if enabled, is only
+  // requested when the translation isn't blocking drawing.
   bool TranslateAnalyzedShader(SpirvShaderTranslator& translator,
-                               VulkanShader::VulkanTranslation& translation);
+                               VulkanShader::VulkanTranslation& translation,
+                               bool optimize = false);
 
   void WritePipelineRenderTargetDescription(
       reg::RB_BLENDCONTROL blend_control, uint32_t write_mask,
@@ -280,9 +352,42 @@ class VulkanPipelineCache {
 
   // Can be called from creation threads - all needed data must be fully set up
   // at the point of the call: shaders must be translated, pipeline layout and
-  // render pass objects must be available.
+  // render pass objects must be available. blocking is whether a guest draw is
+  // waiting for the pipeline, for the pipeline compilation log.
   bool EnsurePipelineCreated(
-      const PipelineCreationArguments& creation_arguments);
+      const PipelineCreationArguments& creation_arguments, bool blocking);
+
+  // Looks up or creates the objects, other than the shaders, needed to create
+  // the pipeline for the description. The shaders must be translated.
+  // Emplaces a new pipeline that is not created yet.
+  std::pair<const PipelineDescription, Pipeline>& EmplacePipeline(
+      const PipelineDescription& description,
+      const PipelineLayoutProvider* pipeline_layout);
+  // Returns the description with only the state that must be the same for a
+  // pipeline to be usable in place of another one for a draw - the shaders,
+  // the render pass and the input assembly state.
+  static PipelineDescription GetFallbackDescription(
+      const PipelineDescription& description);
+  // Returns the handle to give to a draw using the pipeline, requesting its
+  // creation to be completed before the end of the submission, giving the
+  // handle of a compatible already created pipeline if fallback pipelines are
+  // enabled, or giving nullptr if creation is still in progress and draws are
+  // skipped until their pipelines are ready.
+  void* GetPipelineHandleForDraw(
+      std::pair<const PipelineDescription, Pipeline>& pipeline);
+
+  bool GetPipelineCreationObjects(
+      const PipelineDescription& description,
+      const VulkanShader::VulkanTranslation* vertex_shader,
+      const VulkanShader::VulkanTranslation* pixel_shader,
+      const PipelineLayoutProvider*& pipeline_layout_out,
+      VkShaderModule& geometry_shader_out, VkRenderPass& render_pass_out);
+
+  // Loads the pipeline cache of the driver stored in a previous run, or
+  // creates an empty one if it's missing or was created for a different device
+  // or driver.
+  void InitializeDriverPipelineCache(const std::filesystem::path& file_path);
+  void ShutdownDriverPipelineCache();
 
   VulkanCommandProcessor& command_processor_;
   const RegisterFile& register_file_;
@@ -293,6 +398,8 @@ class VulkanPipelineCache {
   StringBuffer ucode_disasm_buffer_;
   // Reusable shader translator on the command processor thread.
   std::unique_ptr<SpirvShaderTranslator> shader_translator_;
+  // Null if SPIR-V optimization is disabled or not available.
+  std::unique_ptr<ui::vulkan::SpirvToolsContext> spirv_tools_context_;
 
   struct LayoutUID {
     size_t uid;
@@ -327,9 +434,88 @@ class VulkanPipelineCache {
   std::unordered_map<PipelineDescription, Pipeline, PipelineDescription::Hasher>
       pipelines_;
 
+  // Fallback description -> the first created pipeline with it used by a draw,
+  // for drawing while pipelines with different fixed-function state are being
+  // created. Command processor thread only.
+  std::unordered_map<PipelineDescription,
+                     std::pair<const PipelineDescription, Pipeline>*,
+                     PipelineDescription::Hasher>
+      fallback_pipelines_;
+
   // Previously used pipeline, to avoid lookups if the state wasn't changed.
-  const std::pair<const PipelineDescription, Pipeline>* last_pipeline_ =
-      nullptr;
+  std::pair<const PipelineDescription, Pipeline>* last_pipeline_ = nullptr;
+
+  uint64_t pipelines_created_ = 0;
+
+  // Pipeline creation threads.
+  void CreationThread();
+  // Creates the pipeline and marks it as created, for pipelines from the
+  // creation queues.
+  void CreateQueuedPipeline(
+      const PipelineCreationArguments& creation_arguments);
+  // Creates the remaining urgent pipelines on the command processor thread
+  // and waits for the ones being created on the creation threads.
+  void AwaitUrgentPipelineCreation();
+  // Creates or waits for the creation of all the queued pipelines.
+  void AwaitAllPipelineCreation();
+  std::vector<std::unique_ptr<xe::threading::Thread>> creation_threads_;
+  std::mutex creation_request_lock_;
+  // Notified on new requests and shutdown.
+  std::condition_variable creation_request_cond_;
+  // Notified when creation_urgent_pending_ becomes zero, or when all queued
+  // pipelines have been created.
+  std::condition_variable creation_completion_cond_;
+  // Protected with creation_request_lock_. Pipelines needed by draws are
+  // created before those queued ahead of time (loaded from the pipeline
+  // storage), which are only created when there's nothing more urgent to do.
+  std::deque<PipelineCreationArguments> creation_queue_;
+  std::deque<PipelineCreationArguments> creation_background_queue_;
+  // Number of pipelines in creation_queue_ or being created with
+  // Pipeline::creation_urgent set. Protected with creation_request_lock_.
+  size_t creation_urgent_pending_ = 0;
+  // Number of threads currently creating a pipeline. Protected with
+  // creation_request_lock_.
+  size_t creation_threads_busy_ = 0;
+  bool creation_threads_shutdown_ = false;
+  // Whether a draw in the current submission has been given a handle of a
+  // pipeline still being created, so the submission must wait for the urgent
+  // pipelines before it's executed. Command processor thread only.
+  bool creation_awaited_in_submission_ = false;
+
+  // Currently open shader storage path.
+  std::filesystem::path shader_storage_cache_root_;
+  uint32_t shader_storage_title_id_ = 0;
+
+  // Shader storage output stream, for preload in the next emulator runs.
+  FILE* shader_storage_file_ = nullptr;
+  // For only writing shaders to the currently open storage once, incremented
+  // when switching the storage.
+  uint32_t shader_storage_index_ = 0;
+  bool shader_storage_file_flush_needed_ = false;
+
+  // Pipeline storage output stream, for preload in the next emulator runs.
+  FILE* pipeline_storage_file_ = nullptr;
+  bool pipeline_storage_file_flush_needed_ = false;
+
+  // Pipeline cache of the driver, used for all pipeline creation while the
+  // shader storage is open. Its data is specific to the device and the driver,
+  // so unlike the descriptions, it's stored in the local, not the shareable,
+  // part of the storage, and written only when the storage is shut down.
+  VkPipelineCache driver_pipeline_cache_ = VK_NULL_HANDLE;
+  std::filesystem::path driver_pipeline_cache_file_path_;
+
+  // Thread for asynchronous writing to the storage streams.
+  void StorageWriteThread();
+  std::mutex storage_write_request_lock_;
+  std::condition_variable storage_write_request_cond_;
+  // Storage thread input is protected with storage_write_request_lock_, and the
+  // thread is notified about its change via storage_write_request_cond_.
+  std::deque<const Shader*> storage_write_shader_queue_;
+  std::deque<PipelineStoredDescription> storage_write_pipeline_queue_;
+  bool storage_write_flush_shaders_ = false;
+  bool storage_write_flush_pipelines_ = false;
+  bool storage_write_thread_shutdown_ = false;
+  std::unique_ptr<xe::threading::Thread> storage_write_thread_;
 };
 
 }  // namespace vulkan
@@ -33,7 +33,8 @@ bool VulkanPrimitiveProcessor::Initialize() {
   if (!InitializeCommon(
           device_properties.fullDrawIndexUint32, device_properties.triangleFans,
           false, device_properties.geometryShader,
-          device_properties.geometryShader, device_properties.geometryShader)) {
+          device_properties.geometryShader, device_properties.geometryShader,
+          true)) {
     Shutdown();
     return false;
   }
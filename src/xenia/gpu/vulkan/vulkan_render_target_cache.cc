@@ -22,8 +22,10 @@
 #include "third_party/glslang/SPIRV/GLSL.std.450.h"
 #include "xenia/base/assert.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/frame_breakdown.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/profiling.h"
 #include "xenia/gpu/draw_util.h"
 #include "xenia/gpu/registers.h"
 #include "xenia/gpu/spirv_builder.h"
@@ -54,6 +56,19 @@ DEFINE_string(
     "  Choose what is considered the most optimal for the system (currently "
     "always FB because the FSI path is much slower now).",
     "GPU");
+DEFINE_uint32(
+    vulkan_render_target_eviction_submissions, 60,
+    "Number of submissions after which a host render target not containing "
+    "any up-to-date EDRAM data is destroyed on Vulkan if it hasn't been used, "
+    "so its memory can be reused for other render targets.\n"
+    "0 to keep the render targets until the cache is cleared.",
+    "GPU");
+DEFINE_bool(
+    vulkan_dont_care_undefined_attachment_loads, true,
+    "Don't load the contents of host render targets that haven't been drawn "
+    "to since their creation when beginning render passes on Vulkan, saving "
+    "the memory bandwidth of loading the tiles on tiled GPUs.",
+    "GPU");
 
 namespace xe {
 namespace gpu {
@@ -217,6 +232,14 @@ bool VulkanRenderTargetCache::Initialize(uint32_t shared_memory_binding_count) {
   const ui::vulkan::VulkanDevice::Properties& device_properties =
       vulkan_device->properties();
 
+  // Externally synchronized, render targets are only created and destroyed
+  // by the command processor thread.
+  vma_allocator_ = ui::vulkan::CreateVmaAllocator(vulkan_device, true);
+  if (vma_allocator_ == VK_NULL_HANDLE) {
+    Shutdown();
+    return false;
+  }
+
   if (cvars::render_target_path_vulkan == "fsi") {
     path_ = Path::kPixelShaderInterlock;
   } else {
@@ -953,6 +976,12 @@ void VulkanRenderTargetCache::Shutdown(bool from_destructor) {
     }
   }
   render_passes_.clear();
+  for (const auto& render_pass_pair : dont_care_load_render_passes_) {
+    if (render_pass_pair.second != VK_NULL_HANDLE) {
+      dfn.vkDestroyRenderPass(device, render_pass_pair.second, nullptr);
+    }
+  }
+  dont_care_load_render_passes_.clear();
 
   for (VkPipeline& resolve_copy_pipeline : resolve_copy_pipelines_) {
     ui::vulkan::util::DestroyAndNullHandle(dfn.vkDestroyPipeline, device,
@@ -981,6 +1010,11 @@ void VulkanRenderTargetCache::Shutdown(bool from_destructor) {
                                          device,
                                          descriptor_set_layout_storage_buffer_);
 
+  if (vma_allocator_ != VK_NULL_HANDLE) {
+    vmaDestroyAllocator(vma_allocator_);
+    vma_allocator_ = VK_NULL_HANDLE;
+  }
+
   if (!from_destructor) {
     ShutdownCommon();
   }
@@ -1006,10 +1040,45 @@ void VulkanRenderTargetCache::ClearCache() {
     dfn.vkDestroyRenderPass(device, render_pass_pair.second, nullptr);
   }
   render_passes_.clear();
+  for (const auto& render_pass_pair : dont_care_load_render_passes_) {
+    dfn.vkDestroyRenderPass(device, render_pass_pair.second, nullptr);
+  }
+  dont_care_load_render_passes_.clear();
 
   RenderTargetCache::ClearCache();
 }
 
+void VulkanRenderTargetCache::BeginFrame() {
+  RenderTargetCache::BeginFrame();
+
+  // Render targets are only needed for their EDRAM contents, or while
+  // submissions that haven't been completed yet may access them - evict the
+  // ones without either that haven't been used for a while, so their memory is
+  // released to the allocator to be reused by render targets of other sizes
+  // and formats instead of staying allocated until the cache is cleared.
+  uint32_t eviction_submissions =
+      cvars::vulkan_render_target_eviction_submissions;
+  if (!eviction_submissions || GetPath() != Path::kHostRenderTargets) {
+    return;
+  }
+  uint64_t current_submission = command_processor_.GetCurrentSubmission();
+  if (current_submission <= eviction_submissions) {
+    return;
+  }
+  uint64_t evict_usage_before =
+      std::min(command_processor_.GetCompletedSubmission() + 1,
+               current_submission - eviction_submissions);
+  DestroyRenderTargetsNotOwningEdram([this, evict_usage_before](
+                                         RenderTarget& render_target) {
+    if (static_cast<const VulkanRenderTarget&>(render_target)
+            .last_usage_submission() >= evict_usage_before) {
+      return false;
+    }
+    DestroyRenderTargetFramebuffers(render_target);
+    return true;
+  });
+}
+
 void VulkanRenderTargetCache::CompletedSubmissionUpdated() {
   if (transfer_vertex_buffer_pool_) {
     transfer_vertex_buffer_pool_->Reclaim(
@@ -1028,6 +1097,8 @@ bool VulkanRenderTargetCache::Resolve(const Memory& memory,
                                       VulkanTextureCache& texture_cache,
                                       uint32_t& written_address_out,
                                       uint32_t& written_length_out) {
+  frame_breakdown::ScopedTimer frame_breakdown_timer(
+      frame_breakdown::Category::kEdramTransfer);
   written_address_out = 0;
   written_length_out = 0;
 
@@ -1055,7 +1126,8 @@ bool VulkanRenderTargetCache::Resolve(const Memory& memory,
 
   // Copying.
   bool copied = false;
-  if (resolve_info.copy_dest_extent_length) {
+  if (resolve_info.copy_dest_extent_length &&
+      !IsResolveCopyUpToDate(resolve_info)) {
     if (GetPath() == Path::kHostRenderTargets) {
       // Dump the current contents of the render targets owning the affected
       // range to edram_buffer_.
@@ -1170,10 +1242,12 @@ bool VulkanRenderTargetCache::Resolve(const Memory& memory,
           written_address_out = resolve_info.copy_dest_extent_start;
           written_length_out = resolve_info.copy_dest_extent_length;
           copied = true;
+          ResolveCopyDone(resolve_info, shared_memory);
         }
       }
     }
   } else {
+    // Nothing to copy, or already copied.
     copied = true;
   }
 
@@ -1425,12 +1499,22 @@ bool VulkanRenderTargetCache::Update(
 }
 
 VkRenderPass VulkanRenderTargetCache::GetHostRenderTargetsRenderPass(
-    RenderPassKey key) {
+    RenderPassKey key, uint32_t dont_care_load_attachments) {
   assert_true(GetPath() == Path::kHostRenderTargets);
 
-  auto it = render_passes_.find(key);
-  if (it != render_passes_.end()) {
-    return it->second;
+  dont_care_load_attachments &= key.depth_and_color_used;
+  uint64_t dont_care_load_key =
+      uint64_t(key.key) | (uint64_t(dont_care_load_attachments) << 32);
+  if (dont_care_load_attachments) {
+    auto it = dont_care_load_render_passes_.find(dont_care_load_key);
+    if (it != dont_care_load_render_passes_.end()) {
+      return it->second;
+    }
+  } else {
+    auto it = render_passes_.find(key);
+    if (it != render_passes_.end()) {
+      return it->second;
+    }
   }
 
   VkSampleCountFlagBits samples;
@@ -1456,9 +1540,12 @@ VkRenderPass VulkanRenderTargetCache::GetHostRenderTargetsRenderPass(
     attachment.flags = 0;
     attachment.format = GetDepthVulkanFormat(key.depth_format);
     attachment.samples = samples;
-    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    VkAttachmentLoadOp load_op = (dont_care_load_attachments & 0b1)
+                                     ? VK_ATTACHMENT_LOAD_OP_DONT_CARE
+                                     : VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachment.loadOp = load_op;
     attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachment.stencilLoadOp = load_op;
     attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
     attachment.initialLayout = VulkanRenderTarget::kDepthDrawLayout;
     attachment.finalLayout = VulkanRenderTarget::kDepthDrawLayout;
@@ -1489,7 +1576,9 @@ VkRenderPass VulkanRenderTargetCache::GetHostRenderTargetsRenderPass(
             ? GetColorOwnershipTransferVulkanFormat(color_format)
             : GetColorVulkanFormat(color_format);
     attachment.samples = samples;
-    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachment.loadOp = (dont_care_load_attachments & attachment_bit)
+                            ? VK_ATTACHMENT_LOAD_OP_DONT_CARE
+                            : VK_ATTACHMENT_LOAD_OP_LOAD;
     attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -1564,13 +1653,64 @@ VkRenderPass VulkanRenderTargetCache::GetHostRenderTargetsRenderPass(
   if (dfn.vkCreateRenderPass(device, &render_pass_create_info, nullptr,
                              &render_pass) != VK_SUCCESS) {
     XELOGE("VulkanRenderTargetCache: Failed to create a render pass");
-    render_passes_.emplace(key, VK_NULL_HANDLE);
-    return VK_NULL_HANDLE;
+    render_pass = VK_NULL_HANDLE;
+  }
+  if (dont_care_load_attachments) {
+    dont_care_load_render_passes_.emplace(dont_care_load_key, render_pass);
+  } else {
+    render_passes_.emplace(key, render_pass);
   }
-  render_passes_.emplace(key, render_pass);
   return render_pass;
 }
 
+VkRenderPass VulkanRenderTargetCache::GetHostRenderTargetsRenderPassToBegin(
+    VkRenderPass render_pass, const Framebuffer& framebuffer) {
+  ++render_passes_begun_;
+  RenderPassKey render_pass_key = framebuffer.render_pass_key;
+  if (GetPath() != Path::kHostRenderTargets ||
+      !render_pass_key.depth_and_color_used) {
+    return render_pass;
+  }
+  uint32_t host_samples =
+      (render_pass_key.msaa_samples == xenos::MsaaSamples::k2X &&
+       !msaa_2x_attachments_supported_)
+          ? 4
+          : uint32_t(1) << uint32_t(render_pass_key.msaa_samples);
+  uint64_t host_sample_count = uint64_t(framebuffer.host_extent.width) *
+                               framebuffer.host_extent.height * host_samples;
+  uint32_t dont_care_load_attachments = 0;
+  uint32_t depth_and_color_rts_remaining = render_pass_key.depth_and_color_used;
+  uint32_t rt_index;
+  while (xe::bit_scan_forward(depth_and_color_rts_remaining, &rt_index)) {
+    depth_and_color_rts_remaining &= ~(uint32_t(1) << rt_index);
+    auto& vulkan_rt = *const_cast<VulkanRenderTarget*>(
+        static_cast<const VulkanRenderTarget*>(
+            framebuffer.render_targets[rt_index]));
+    uint64_t attachment_bytes =
+        host_sample_count *
+        (vulkan_rt.key().Is64bpp() ? sizeof(uint64_t) : sizeof(uint32_t));
+    attachment_store_bytes_ += attachment_bytes;
+    if (vulkan_rt.contents_initialized()) {
+      attachment_load_bytes_ += attachment_bytes;
+      continue;
+    }
+    vulkan_rt.SetContentsInitialized();
+    if (cvars::vulkan_dont_care_undefined_attachment_loads) {
+      dont_care_load_attachments |= uint32_t(1) << rt_index;
+    } else {
+      attachment_load_bytes_ += attachment_bytes;
+    }
+  }
+  if (!dont_care_load_attachments) {
+    return render_pass;
+  }
+  VkRenderPass dont_care_load_render_pass = GetHostRenderTargetsRenderPass(
+      render_pass_key, dont_care_load_attachments);
+  return dont_care_load_render_pass != VK_NULL_HANDLE
+             ? dont_care_load_render_pass
+             : render_pass;
+}
+
 VkFormat VulkanRenderTargetCache::GetDepthVulkanFormat(
     xenos::DepthRenderTargetFormat format) const {
   if (format == xenos::DepthRenderTargetFormat::kD24S8 &&
@@ -1668,8 +1808,17 @@ VulkanRenderTargetCache::VulkanRenderTarget::~VulkanRenderTarget() {
     dfn.vkDestroyImageView(device, view_depth_stencil_, nullptr);
   }
   dfn.vkDestroyImageView(device, view_depth_color_, nullptr);
-  dfn.vkDestroyImage(device, image_, nullptr);
-  dfn.vkFreeMemory(device, memory_, nullptr);
+  vmaDestroyImage(render_target_cache_.vma_allocator_, image_, allocation_);
+}
+
+void VulkanRenderTargetCache::VulkanRenderTarget::SetUsage(
+    VkPipelineStageFlags stage_mask, VkAccessFlags access_mask,
+    VkImageLayout layout) {
+  current_stage_mask_ = stage_mask;
+  current_access_mask_ = access_mask;
+  current_layout_ = layout;
+  last_usage_submission_ =
+      render_target_cache_.command_processor_.GetCurrentSubmission();
 }
 
 uint32_t VulkanRenderTargetCache::GetMaxRenderTargetWidth() const {
@@ -1744,11 +1893,16 @@ RenderTargetCache::RenderTarget* VulkanRenderTargetCache::CreateRenderTarget(
            key.is_depth ? "depth" : "color", key.resource_format);
     return nullptr;
   }
+  // Suballocated like textures, as there may be many small render targets -
+  // VMA still uses dedicated allocations for the ones the driver prefers to
+  // have them.
+  VmaAllocationCreateInfo allocation_create_info = {};
+  allocation_create_info.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
   VkImage image;
-  VkDeviceMemory memory;
-  if (!ui::vulkan::util::CreateDedicatedAllocationImage(
-          vulkan_device, image_create_info,
-          ui::vulkan::util::MemoryPurpose::kDeviceLocal, image, memory)) {
+  VmaAllocation allocation;
+  if (vmaCreateImage(vma_allocator_, &image_create_info,
+                     &allocation_create_info, &image, &allocation,
+                     nullptr) != VK_SUCCESS) {
     XELOGE(
         "VulkanRenderTarget: Failed to create a {}x{} {}xMSAA {} render target "
         "image",
@@ -1782,8 +1936,7 @@ RenderTargetCache::RenderTarget* VulkanRenderTargetCache::CreateRenderTarget(
         key.is_depth ? "depth" : "color", image_create_info.extent.width,
         image_create_info.extent.height,
         uint32_t(1) << uint32_t(key.msaa_samples), key.GetFormatName());
-    dfn.vkDestroyImage(device, image, nullptr);
-    dfn.vkFreeMemory(device, memory, nullptr);
+    vmaDestroyImage(vma_allocator_, image, allocation);
     return nullptr;
   }
   VkImageView view_depth_stencil = VK_NULL_HANDLE;
@@ -1802,8 +1955,7 @@ RenderTargetCache::RenderTarget* VulkanRenderTargetCache::CreateRenderTarget(
           uint32_t(1) << uint32_t(key.msaa_samples),
           xenos::GetDepthRenderTargetFormatName(key.GetDepthFormat()));
       dfn.vkDestroyImageView(device, view_depth_color, nullptr);
-      dfn.vkDestroyImage(device, image, nullptr);
-      dfn.vkFreeMemory(device, memory, nullptr);
+      vmaDestroyImage(vma_allocator_, image, allocation);
       return nullptr;
     }
     view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_STENCIL_BIT;
@@ -1817,8 +1969,7 @@ RenderTargetCache::RenderTarget* VulkanRenderTargetCache::CreateRenderTarget(
           xenos::GetDepthRenderTargetFormatName(key.GetDepthFormat()));
       dfn.vkDestroyImageView(device, view_depth_stencil, nullptr);
       dfn.vkDestroyImageView(device, view_depth_color, nullptr);
-      dfn.vkDestroyImage(device, image, nullptr);
-      dfn.vkFreeMemory(device, memory, nullptr);
+      vmaDestroyImage(vma_allocator_, image, allocation);
       return nullptr;
     }
   } else {
@@ -1833,8 +1984,7 @@ RenderTargetCache::RenderTarget* VulkanRenderTargetCache::CreateRenderTarget(
             uint32_t(1) << uint32_t(key.msaa_samples),
             xenos::GetColorRenderTargetFormatName(key.GetColorFormat()));
         dfn.vkDestroyImageView(device, view_depth_color, nullptr);
-        dfn.vkDestroyImage(device, image, nullptr);
-        dfn.vkFreeMemory(device, memory, nullptr);
+        vmaDestroyImage(vma_allocator_, image, allocation);
         return nullptr;
       }
     }
@@ -1851,8 +2001,7 @@ RenderTargetCache::RenderTarget* VulkanRenderTargetCache::CreateRenderTarget(
           dfn.vkDestroyImageView(device, view_srgb, nullptr);
         }
         dfn.vkDestroyImageView(device, view_depth_color, nullptr);
-        dfn.vkDestroyImage(device, image, nullptr);
-        dfn.vkFreeMemory(device, memory, nullptr);
+        vmaDestroyImage(vma_allocator_, image, allocation);
         return nullptr;
       }
     }
@@ -1874,8 +2023,7 @@ RenderTargetCache::RenderTarget* VulkanRenderTargetCache::CreateRenderTarget(
       dfn.vkDestroyImageView(device, view_srgb, nullptr);
     }
     dfn.vkDestroyImageView(device, view_depth_color, nullptr);
-    dfn.vkDestroyImage(device, image, nullptr);
-    dfn.vkFreeMemory(device, memory, nullptr);
+    vmaDestroyImage(vma_allocator_, image, allocation);
     return nullptr;
   }
   VkDescriptorSet descriptor_set_transfer_source =
@@ -1919,7 +2067,7 @@ RenderTargetCache::RenderTarget* VulkanRenderTargetCache::CreateRenderTarget(
   dfn.vkUpdateDescriptorSets(device, key.is_depth ? 2 : 1, descriptor_set_write,
                              0, nullptr);
 
-  return new VulkanRenderTarget(key, *this, image, memory, view_depth_color,
+  return new VulkanRenderTarget(key, *this, image, allocation, view_depth_color,
                                 view_depth_stencil, view_stencil, view_srgb,
                                 view_color_transfer_separate,
                                 descriptor_set_index_transfer_source);
@@ -2139,10 +2287,46 @@ VulkanRenderTargetCache::GetHostRenderTargetsFramebuffer(
     return nullptr;
   }
   // Creates at a persistent location - safe to use pointers.
-  return &framebuffers_
-              .emplace(std::piecewise_construct, std::forward_as_tuple(key),
-                       std::forward_as_tuple(framebuffer, host_extent))
-              .first->second;
+  Framebuffer& new_framebuffer =
+      framebuffers_
+          .emplace(std::piecewise_construct, std::forward_as_tuple(key),
+                   std::forward_as_tuple(framebuffer, host_extent))
+          .first->second;
+  new_framebuffer.render_pass_key = render_pass_key;
+  depth_and_color_rts_remaining = render_pass_key.depth_and_color_used;
+  while (xe::bit_scan_forward(depth_and_color_rts_remaining, &rt_index)) {
+    depth_and_color_rts_remaining &= ~(uint32_t(1) << rt_index);
+    new_framebuffer.render_targets[rt_index] =
+        depth_and_color_render_targets[rt_index];
+  }
+  return &new_framebuffer;
+}
+
+void VulkanRenderTargetCache::DestroyRenderTargetFramebuffers(
+    const RenderTarget& render_target) {
+  const ui::vulkan::VulkanDevice* const vulkan_device =
+      command_processor_.GetVulkanDevice();
+  const ui::vulkan::VulkanDevice::Functions& dfn = vulkan_device->functions();
+  const VkDevice device = vulkan_device->device();
+  // Only the depth attachment may be a depth render target, and only the color
+  // attachments may be color render targets.
+  uint32_t rt_index_first = render_target.key().is_depth ? 0 : 1;
+  uint32_t rt_index_end =
+      render_target.key().is_depth ? 1 : 1 + xenos::kMaxColorRenderTargets;
+  for (auto it = framebuffers_.begin(); it != framebuffers_.end();) {
+    const Framebuffer& framebuffer = it->second;
+    if (std::find(framebuffer.render_targets + rt_index_first,
+                  framebuffer.render_targets + rt_index_end, &render_target) ==
+        framebuffer.render_targets + rt_index_end) {
+      ++it;
+      continue;
+    }
+    if (last_update_framebuffer_ == &framebuffer) {
+      last_update_framebuffer_ = nullptr;
+    }
+    dfn.vkDestroyFramebuffer(device, framebuffer.framebuffer, nullptr);
+    it = framebuffers_.erase(it);
+  }
 }
 
 VkShaderModule VulkanRenderTargetCache::GetTransferShader(
@@ -4483,6 +4667,10 @@ void VulkanRenderTargetCache::PerformTransfersAndResolveClears(
     const uint64_t* render_target_resolve_clear_values,
     const Transfer::Rectangle* resolve_clear_rectangle) {
   assert_true(GetPath() == Path::kHostRenderTargets);
+  frame_breakdown::ScopedTimer frame_breakdown_timer(
+      frame_breakdown::Category::kEdramTransfer);
+
+  SCOPE_profile_gpu_i("gpu", "EDRAM transfers");
 
   const ui::vulkan::VulkanDevice* const vulkan_device =
       command_processor_.GetVulkanDevice();
@@ -5306,6 +5494,10 @@ void VulkanRenderTargetCache::PerformTransfersAndResolveClears(
             command_buffer.CmdVkDraw(transfer_vertex_count, 1, 0, 0);
           }
         }
+        CountTransferDraws(
+            transfer_sample_pipeline_count * (transfer_is_stencil_bit ? 8 : 1),
+            uint32_t(std::distance(it_merged_first, it_merged_last)) + 1,
+            transfer_rectangle_count);
       }
     }
 
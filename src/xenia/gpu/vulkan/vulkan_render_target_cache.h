@@ -24,6 +24,7 @@
 #include "xenia/gpu/vulkan/vulkan_texture_cache.h"
 #include "xenia/gpu/xenos.h"
 #include "xenia/ui/vulkan/single_layout_descriptor_set_pool.h"
+#include "xenia/ui/vulkan/vulkan_mem_alloc.h"
 #include "xenia/ui/vulkan/vulkan_upload_buffer_pool.h"
 
 // Suppress warning about memset/memcpy on non-trivially copyable types
@@ -96,6 +97,11 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
   struct Framebuffer {
     VkFramebuffer framebuffer = VK_NULL_HANDLE;
     VkExtent2D host_extent{};
+    // Render targets the attachment views are of, for destroying the
+    // framebuffer along with them.
+    const RenderTarget* render_targets[1 + xenos::kMaxColorRenderTargets] = {};
+    // For choosing the render pass to begin with the framebuffer.
+    RenderPassKey render_pass_key;
     Framebuffer() = default;
     Framebuffer(VkFramebuffer framebuffer, const VkExtent2D& host_extent)
         : framebuffer(framebuffer), host_extent(host_extent) {}
@@ -114,6 +120,8 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
   void Shutdown(bool from_destructor = false);
   void ClearCache() override;
 
+  void BeginFrame() override;
+
   void CompletedSubmissionUpdated();
   void EndSubmission();
 
@@ -176,7 +184,21 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
   // Returns the render pass object, or VK_NULL_HANDLE if failed to create.
   // A render pass managed by the render target cache may be ended and resumed
   // at any time (to allow for things like copying and texture loading).
-  VkRenderPass GetHostRenderTargetsRenderPass(RenderPassKey key);
+  // The attachments in dont_care_load_attachments (in the layout of
+  // depth_and_color_used) use LOAD_OP_DONT_CARE, which doesn't affect the
+  // compatibility of the render pass with framebuffers and pipelines.
+  VkRenderPass GetHostRenderTargetsRenderPass(
+      RenderPassKey key, uint32_t dont_care_load_attachments = 0);
+  // Returns the render pass to actually begin in place of render_pass with the
+  // framebuffer, which, with vulkan_dont_care_undefined_attachment_loads, may
+  // skip loading the attachments that haven't been rendered to since their
+  // creation, and counts the attachment memory traffic of the render pass.
+  VkRenderPass GetHostRenderTargetsRenderPassToBegin(
+      VkRenderPass render_pass, const Framebuffer& framebuffer);
+  // Cumulative, for measuring the tile memory traffic on tiled GPUs.
+  uint64_t render_passes_begun() const { return render_passes_begun_; }
+  uint64_t attachment_load_bytes() const { return attachment_load_bytes_; }
+  uint64_t attachment_store_bytes() const { return attachment_store_bytes_; }
   VkRenderPass GetFragmentShaderInterlockRenderPass() const {
     assert_true(GetPath() == Path::kPixelShaderInterlock);
     return fsi_render_pass_;
@@ -285,6 +307,9 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
   std::unique_ptr<ui::vulkan::SingleLayoutDescriptorSetPool>
       descriptor_set_pool_sampled_image_x2_;
 
+  // For the render target images.
+  VmaAllocator vma_allocator_ = VK_NULL_HANDLE;
+
   VkDeviceMemory edram_buffer_memory_ = VK_NULL_HANDLE;
   VkBuffer edram_buffer_ = VK_NULL_HANDLE;
   EdramBufferUsage edram_buffer_usage_;
@@ -336,7 +361,7 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
     // Takes ownership of the Vulkan objects passed to the constructor.
     VulkanRenderTarget(RenderTargetKey key,
                        VulkanRenderTargetCache& render_target_cache,
-                       VkImage image, VkDeviceMemory memory,
+                       VkImage image, VmaAllocation allocation,
                        VkImageView view_depth_color,
                        VkImageView view_depth_stencil, VkImageView view_stencil,
                        VkImageView view_srgb,
@@ -345,7 +370,7 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
         : RenderTarget(key),
           render_target_cache_(render_target_cache),
           image_(image),
-          memory_(memory),
+          allocation_(allocation),
           view_depth_color_(view_depth_color),
           view_depth_stencil_(view_depth_stencil),
           view_stencil_(view_stencil),
@@ -400,12 +425,15 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
     }
     VkAccessFlags current_access_mask() const { return current_access_mask_; }
     VkImageLayout current_layout() const { return current_layout_; }
+    // Also marks the render target as used in the current submission.
     void SetUsage(VkPipelineStageFlags stage_mask, VkAccessFlags access_mask,
-                  VkImageLayout layout) {
-      current_stage_mask_ = stage_mask;
-      current_access_mask_ = access_mask;
-      current_layout_ = layout;
-    }
+                  VkImageLayout layout);
+    uint64_t last_usage_submission() const { return last_usage_submission_; }
+
+    // Until the render target is an attachment in a render pass for the first
+    // time, its contents are undefined, and don't need to be loaded.
+    bool contents_initialized() const { return contents_initialized_; }
+    void SetContentsInitialized() { contents_initialized_ = true; }
 
     uint32_t temporary_sort_index() const { return temporary_sort_index_; }
     void SetTemporarySortIndex(uint32_t index) {
@@ -416,7 +444,7 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
     VulkanRenderTargetCache& render_target_cache_;
 
     VkImage image_;
-    VkDeviceMemory memory_;
+    VmaAllocation allocation_;
 
     // TODO(Triang3l): Per-format drawing views for mutable formats with EDRAM
     // aliasing without transfers.
@@ -433,6 +461,8 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
     VkPipelineStageFlags current_stage_mask_ = 0;
     VkAccessFlags current_access_mask_ = 0;
     VkImageLayout current_layout_ = VK_IMAGE_LAYOUT_UNDEFINED;
+    uint64_t last_usage_submission_ = 0;
+    bool contents_initialized_ = false;
 
     // Temporary storage for indices in operations like transfers and dumps.
     uint32_t temporary_sort_index_ = 0;
@@ -844,6 +874,9 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
   const Framebuffer* GetHostRenderTargetsFramebuffer(
       RenderPassKey render_pass_key, uint32_t pitch_tiles_at_32bpp,
       const RenderTarget* const* depth_and_color_render_targets);
+  // Destroys the framebuffers with attachments from the render target, which
+  // must not be used by any pending submission.
+  void DestroyRenderTargetFramebuffers(const RenderTarget& render_target);
 
   VkShaderModule GetTransferShader(TransferShaderKey key);
   // With sample-rate shading, returns a pointer to one pipeline. Without
@@ -880,6 +913,13 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
   // VK_NULL_HANDLE if failed to create.
   std::unordered_map<RenderPassKey, VkRenderPass, RenderPassKey::Hasher>
       render_passes_;
+  // Variants of render_passes_ not loading some attachments, keyed by the
+  // render pass key and the dont_care_load_attachments mask << 32.
+  // VK_NULL_HANDLE if failed to create.
+  std::unordered_map<uint64_t, VkRenderPass> dont_care_load_render_passes_;
+  uint64_t render_passes_begun_ = 0;
+  uint64_t attachment_load_bytes_ = 0;
+  uint64_t attachment_store_bytes_ = 0;
 
   std::unordered_map<FramebufferKey, Framebuffer, FramebufferKey::Hasher>
       framebuffers_;
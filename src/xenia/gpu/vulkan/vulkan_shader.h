@@ -10,10 +10,12 @@
 #ifndef XENIA_GPU_VULKAN_VULKAN_SHADER_H_
 #define XENIA_GPU_VULKAN_VULKAN_SHADER_H_
 
+#include <cstddef>
 #include <cstdint>
 
 #include "xenia/gpu/spirv_shader.h"
 #include "xenia/gpu/xenos.h"
+#include "xenia/ui/vulkan/spirv_tools_context.h"
 #include "xenia/ui/vulkan/vulkan_device.h"
 
 namespace xe {
@@ -28,6 +30,12 @@ class VulkanShader : public SpirvShader {
         : SpirvTranslation(shader, modification) {}
     ~VulkanTranslation() override;
 
+    // Replaces the translated SPIR-V with the optimized version. Must be called
+    // before the shader module is created. Returns whether the optimization
+    // has succeeded, keeping the original code otherwise.
+    bool Optimize(const ui::vulkan::SpirvToolsContext& spirv_tools_context,
+                  const char* const* pass_flags, size_t pass_flag_count);
+
     VkShaderModule GetOrCreateShaderModule();
     VkShaderModule shader_module() const { return shader_module_; }
 
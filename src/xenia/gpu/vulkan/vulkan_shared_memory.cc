@@ -415,6 +415,9 @@ bool VulkanSharedMemory::UploadRanges(
           upload_buffer_mapping,
           memory().TranslatePhysical(upload_range_start << page_size_log2()),
           upload_buffer_size);
+      StoreUploadedPageHashes(upload_range_start,
+                              uint32_t(upload_buffer_size >> page_size_log2()),
+                              upload_buffer_mapping);
       if (upload_buffer_previous != upload_buffer && !upload_regions_.empty()) {
         assert_true(upload_buffer_previous != VK_NULL_HANDLE);
         command_buffer.CmdVkCopyBuffer(upload_buffer_previous, buffer_,
@@ -63,6 +63,7 @@ class VulkanSharedMemory : public SharedMemory {
 
   bool UploadRanges(const std::vector<std::pair<uint32_t, uint32_t>>&
                         upload_page_ranges) override;
+  bool AreUploadsTraced() const override { return trace_writer_.is_open(); }
 
  private:
   void GetUsageMasks(Usage usage, VkPipelineStageFlags& stage_mask,
@@ -940,6 +940,32 @@ uint32_t VulkanTextureCache::GetHostFormatSwizzle(TextureKey key) const {
   return GetHostFormatPair(key).swizzle;
 }
 
+bool VulkanTextureCache::GetHostMemoryBudget(uint64_t& budget_out,
+                                             uint64_t& usage_out) const {
+  // Without VK_EXT_memory_budget, the Vulkan Memory Allocator only estimates
+  // the budget from the heap sizes and its own allocations, which doesn't
+  // reflect the actual state of the host GPU memory.
+  if (!command_processor_.GetVulkanDevice()
+           ->extensions()
+           .ext_EXT_memory_budget) {
+    return false;
+  }
+  const VkPhysicalDeviceMemoryProperties* memory_properties;
+  vmaGetMemoryProperties(vma_allocator_, &memory_properties);
+  VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+  vmaGetHeapBudgets(vma_allocator_, budgets);
+  budget_out = 0;
+  usage_out = 0;
+  for (uint32_t i = 0; i < memory_properties->memoryHeapCount; ++i) {
+    if (memory_properties->memoryHeaps[i].flags &
+        VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+      budget_out += budgets[i].budget;
+      usage_out += budgets[i].usage;
+    }
+  }
+  return budget_out != 0;
+}
+
 uint32_t VulkanTextureCache::GetMaxHostTextureWidthHeight(
     xenos::DataDimension dimension) const {
   const ui::vulkan::VulkanDevice::Properties& device_properties =
@@ -1079,8 +1105,182 @@ std::unique_ptr<TextureCache::Texture> VulkanTextureCache::CreateTexture(
 bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
                                                                bool load_base,
                                                                bool load_mips) {
-  VulkanTexture& vulkan_texture = static_cast<VulkanTexture&>(texture);
-  TextureKey texture_key = vulkan_texture.key();
+  TextureDataLoad load;
+  load.texture = &texture;
+  load.load_base = load_base;
+  load.load_mips = load_mips;
+  load.loaded = false;
+  LoadTexturesDataFromResidentMemoryImpl(&load, 1);
+  return load.loaded;
+}
+
+void VulkanTextureCache::LoadTexturesDataFromResidentMemoryImpl(
+    TextureDataLoad* loads, size_t load_count) {
+  SCOPE_profile_gpu_i("gpu", "Texture load");
+
+  const ui::vulkan::VulkanDevice* const vulkan_device =
+      command_processor_.GetVulkanDevice();
+
+  // Place the host data of all the textures in a single buffer, so all the
+  // loading dispatches can be done before a single barrier, followed by all
+  // the copying to the textures.
+  texture_data_load_layouts_.resize(load_count);
+  texture_data_load_order_.clear();
+  VkDeviceSize scratch_buffer_size = 0;
+  for (size_t i = 0; i < load_count; ++i) {
+    TextureDataLoad& load = loads[i];
+    load.loaded = false;
+    if (!GetTextureDataLoadLayout(static_cast<VulkanTexture&>(*load.texture),
+                                  load.load_base, load.load_mips,
+                                  scratch_buffer_size,
+                                  texture_data_load_layouts_[i])) {
+      continue;
+    }
+    texture_data_load_order_.push_back(uint32_t(i));
+  }
+  if (texture_data_load_order_.empty()) {
+    return;
+  }
+  // The destination is accessed via a single storage buffer descriptor, with
+  // 32-bit offsets in the load constants.
+  VkDeviceSize scratch_buffer_max_size =
+      std::min(VkDeviceSize(UINT32_MAX),
+               VkDeviceSize(vulkan_device->properties().maxStorageBufferRange));
+  if (texture_data_load_order_.size() > 1 &&
+      scratch_buffer_size > scratch_buffer_max_size) {
+    // Too much data to load at once, load the textures one by one.
+    for (size_t i = 0; i < load_count; ++i) {
+      LoadTexturesDataFromResidentMemoryImpl(&loads[i], 1);
+    }
+    return;
+  }
+  // Group the dispatches by the pipeline, so it's switched as few times as
+  // possible.
+  std::stable_sort(
+      texture_data_load_order_.begin(), texture_data_load_order_.end(),
+      [&](uint32_t a, uint32_t b) {
+        const TextureDataLoadLayout& layout_a = texture_data_load_layouts_[a];
+        const TextureDataLoadLayout& layout_b = texture_data_load_layouts_[b];
+        bool scaled_a = loads[a].texture->key().scaled_resolve;
+        bool scaled_b = loads[b].texture->key().scaled_resolve;
+        if (scaled_a != scaled_b) {
+          return scaled_b;
+        }
+        return layout_a.load_shader < layout_b.load_shader;
+      });
+
+  VulkanCommandProcessor::ScratchBufferAcquisition scratch_buffer_acquisition(
+      command_processor_.AcquireScratchGpuBuffer(
+          scratch_buffer_size, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+          VK_ACCESS_SHADER_WRITE_BIT));
+  VkBuffer scratch_buffer = scratch_buffer_acquisition.buffer();
+  if (scratch_buffer == VK_NULL_HANDLE) {
+    return;
+  }
+
+  // Begin loading.
+  // TODO(Triang3l): Going from one descriptor to another on per-array-layer
+  // or even per-8-depth-slices level to stay within maxStorageBufferRange.
+  const ui::vulkan::VulkanDevice::Functions& dfn = vulkan_device->functions();
+  const VkDevice device = vulkan_device->device();
+  VkDescriptorSet descriptor_set_dest =
+      command_processor_.AllocateSingleTransientDescriptor(
+          VulkanCommandProcessor::SingleTransientDescriptorLayout ::
+              kStorageBufferCompute);
+  if (!descriptor_set_dest) {
+    return;
+  }
+  VkDescriptorBufferInfo write_descriptor_set_dest_buffer_info;
+  write_descriptor_set_dest_buffer_info.buffer = scratch_buffer;
+  write_descriptor_set_dest_buffer_info.offset = 0;
+  write_descriptor_set_dest_buffer_info.range = scratch_buffer_size;
+  VkWriteDescriptorSet write_descriptor_set_dest;
+  write_descriptor_set_dest.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write_descriptor_set_dest.pNext = nullptr;
+  write_descriptor_set_dest.dstSet = descriptor_set_dest;
+  write_descriptor_set_dest.dstBinding = 0;
+  write_descriptor_set_dest.dstArrayElement = 0;
+  write_descriptor_set_dest.descriptorCount = 1;
+  write_descriptor_set_dest.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  write_descriptor_set_dest.pImageInfo = nullptr;
+  write_descriptor_set_dest.pBufferInfo =
+      &write_descriptor_set_dest_buffer_info;
+  write_descriptor_set_dest.pTexelBufferView = nullptr;
+  dfn.vkUpdateDescriptorSets(device, 1, &write_descriptor_set_dest, 0,
+                             nullptr);
+  static_cast<VulkanSharedMemory&>(shared_memory())
+      .Use(VulkanSharedMemory::Usage::kRead);
+
+  // Submit the scratch buffer population commands.
+  DeferredCommandBuffer& command_buffer =
+      command_processor_.deferred_command_buffer();
+  command_buffer.CmdVkBindDescriptorSets(
+      VK_PIPELINE_BIND_POINT_COMPUTE, load_pipeline_layout_,
+      kLoadDescriptorSetIndexDestination, 1, &descriptor_set_dest, 0, nullptr);
+  size_t loads_dispatched = 0;
+  for (uint32_t load_index : texture_data_load_order_) {
+    TextureDataLoad& load = loads[load_index];
+    if (!RecordTextureDataLoadDispatches(
+            static_cast<VulkanTexture&>(*load.texture),
+            texture_data_load_layouts_[load_index])) {
+      continue;
+    }
+    load.loaded = true;
+    ++loads_dispatched;
+  }
+  if (!loads_dispatched) {
+    return;
+  }
+
+  // Submit copying from the scratch buffer to the host textures.
+  command_processor_.PushBufferMemoryBarrier(
+      scratch_buffer, 0, VK_WHOLE_SIZE,
+      scratch_buffer_acquisition.SetStageMask(VK_PIPELINE_STAGE_TRANSFER_BIT),
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      scratch_buffer_acquisition.SetAccessMask(VK_ACCESS_TRANSFER_READ_BIT),
+      VK_ACCESS_TRANSFER_READ_BIT);
+  for (uint32_t load_index : texture_data_load_order_) {
+    if (!loads[load_index].loaded) {
+      continue;
+    }
+    VulkanTexture& vulkan_texture =
+        static_cast<VulkanTexture&>(*loads[load_index].texture);
+    vulkan_texture.MarkAsUsed();
+    VulkanTexture::Usage texture_old_usage =
+        vulkan_texture.SetUsage(VulkanTexture::Usage::kTransferDestination);
+    if (texture_old_usage != VulkanTexture::Usage::kTransferDestination) {
+      VkPipelineStageFlags texture_src_stage_mask, texture_dst_stage_mask;
+      VkAccessFlags texture_src_access_mask, texture_dst_access_mask;
+      VkImageLayout texture_old_layout, texture_new_layout;
+      GetTextureUsageMasks(texture_old_usage, texture_src_stage_mask,
+                           texture_src_access_mask, texture_old_layout);
+      GetTextureUsageMasks(VulkanTexture::Usage::kTransferDestination,
+                           texture_dst_stage_mask, texture_dst_access_mask,
+                           texture_new_layout);
+      command_processor_.PushImageMemoryBarrier(
+          vulkan_texture.image(),
+          ui::vulkan::util::InitializeSubresourceRange(),
+          texture_src_stage_mask, texture_dst_stage_mask,
+          texture_src_access_mask, texture_dst_access_mask,
+          texture_old_layout, texture_new_layout);
+    }
+  }
+  command_processor_.SubmitBarriers(true);
+  for (uint32_t load_index : texture_data_load_order_) {
+    if (!loads[load_index].loaded) {
+      continue;
+    }
+    RecordTextureDataLoadCopies(
+        static_cast<VulkanTexture&>(*loads[load_index].texture),
+        texture_data_load_layouts_[load_index], scratch_buffer);
+  }
+}
+
+bool VulkanTextureCache::GetTextureDataLoadLayout(
+    const VulkanTexture& texture, bool load_base, bool load_mips,
+    VkDeviceSize& scratch_buffer_size,
+    TextureDataLoadLayout& layout_out) const {
+  TextureKey texture_key = texture.key();
 
   // Get the pipeline.
   const HostFormatPair& host_format_pair = GetHostFormatPair(texture_key);
@@ -1104,26 +1304,26 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
   if (pipeline == VK_NULL_HANDLE) {
     return false;
   }
+  layout_out.load_shader = load_shader;
+  layout_out.pipeline = pipeline;
   const LoadShaderInfo& load_shader_info = GetLoadShaderInfo(load_shader);
 
   // Get the guest layout.
-  const texture_util::TextureGuestLayout& guest_layout =
-      vulkan_texture.guest_layout();
-  xenos::DataDimension dimension = texture_key.dimension;
-  bool is_3d = dimension == xenos::DataDimension::k3D;
+  const texture_util::TextureGuestLayout& guest_layout = texture.guest_layout();
+  bool is_3d = texture_key.dimension == xenos::DataDimension::k3D;
   uint32_t width = texture_key.GetWidth();
   uint32_t height = texture_key.GetHeight();
   uint32_t depth_or_array_size = texture_key.GetDepthOrArraySize();
   uint32_t depth = is_3d ? depth_or_array_size : 1;
   uint32_t array_size = is_3d ? 1 : depth_or_array_size;
-  xenos::TextureFormat guest_format = texture_key.format;
-  const FormatInfo* guest_format_info = FormatInfo::Get(guest_format);
+  const FormatInfo* guest_format_info = FormatInfo::Get(texture_key.format);
   uint32_t block_width = guest_format_info->block_width;
   uint32_t block_height = guest_format_info->block_height;
-  uint32_t bytes_per_block = guest_format_info->bytes_per_block();
   uint32_t level_first = load_base ? 0 : 1;
   uint32_t level_last = load_mips ? texture_key.mip_max_level : 0;
   assert_true(level_first <= level_last);
+  layout_out.level_first = level_first;
+  layout_out.level_last = level_last;
   uint32_t level_packed = guest_layout.packed_level;
   uint32_t level_stored_first = std::min(level_first, level_packed);
   uint32_t level_stored_last = std::min(level_last, level_packed);
@@ -1136,49 +1336,44 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
   // tail is stored as mip 0, because in this case, it would be ambiguous since
   // both the base and the mips would be on "level 0", but stored in separate
   // places.
-  uint32_t loop_level_first, loop_level_last;
   if (level_packed == 0) {
     // Packed mip tail is the level 0 - may need to load mip tails for the base,
     // the mips, or both.
     // Loop iteration 0 - base packed mip tail.
     // Loop iteration 1 - mips packed mip tail.
-    loop_level_first = uint32_t(level_first != 0);
-    loop_level_last = uint32_t(level_last != 0);
+    layout_out.loop_level_first = uint32_t(level_first != 0);
+    layout_out.loop_level_last = uint32_t(level_last != 0);
   } else {
     // Packed mip tail is not the level 0.
     // Loop iteration is the actual level being loaded.
-    loop_level_first = level_stored_first;
-    loop_level_last = level_stored_last;
+    layout_out.loop_level_first = level_stored_first;
+    layout_out.loop_level_last = level_stored_last;
   }
 
-  // Get the host layout and the buffer.
+  // Get the host layout.
+  layout_out.host_block_compressed = host_format.block_compressed;
   uint32_t host_block_width = host_format.block_compressed ? block_width : 1;
   uint32_t host_block_height = host_format.block_compressed ? block_height : 1;
+  layout_out.host_block_width = host_block_width;
+  layout_out.host_block_height = host_block_height;
   uint32_t host_x_blocks_per_thread =
       UINT32_C(1) << load_shader_info.guest_x_blocks_per_thread_log2;
   if (!host_format.block_compressed) {
     // Decompressing guest blocks.
     host_x_blocks_per_thread *= block_width;
   }
-  VkDeviceSize host_buffer_size = 0;
-  struct HostLayout {
-    VkDeviceSize offset_bytes;
-    VkDeviceSize slice_size_bytes;
-    uint32_t x_pitch_blocks;
-    uint32_t y_pitch_blocks;
-  };
-  HostLayout host_layout_base;
-  // Indexing is the same as for guest stored mips:
-  // 1...min(level_last, level_packed) if level_packed is not 0, or only 0 if
-  // level_packed == 0.
-  HostLayout host_layout_mips[xenos::kTextureMaxMips];
-  for (uint32_t loop_level = loop_level_first; loop_level <= loop_level_last;
-       ++loop_level) {
+  for (uint32_t loop_level = layout_out.loop_level_first;
+       loop_level <= layout_out.loop_level_last; ++loop_level) {
     bool is_base = loop_level == 0;
     uint32_t level = (level_packed == 0) ? 0 : loop_level;
-    HostLayout& level_host_layout =
-        is_base ? host_layout_base : host_layout_mips[level];
-    level_host_layout.offset_bytes = host_buffer_size;
+    TextureDataLoadLayout::HostLayout& level_host_layout =
+        is_base ? layout_out.host_layout_base
+                : layout_out.host_layouts_mips[level];
+    // Other textures may precede this one in the buffer - keep the offset
+    // aligned to the largest element written by the shaders, which is also
+    // a multiple of the texel block size required for copying.
+    scratch_buffer_size = xe::align(scratch_buffer_size, VkDeviceSize(16));
+    level_host_layout.offset_bytes = scratch_buffer_size;
     uint32_t level_guest_x_extent_texels_unscaled;
     uint32_t level_guest_y_extent_texels_unscaled;
     uint32_t level_guest_z_extent_texels;
@@ -1212,55 +1407,42 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
         VkDeviceSize(load_shader_info.bytes_per_host_block) *
         level_host_layout.x_pitch_blocks * level_host_layout.y_pitch_blocks *
         level_guest_z_extent_texels;
-    host_buffer_size += level_host_layout.slice_size_bytes * array_size;
-  }
-  VulkanCommandProcessor::ScratchBufferAcquisition scratch_buffer_acquisition(
-      command_processor_.AcquireScratchGpuBuffer(
-          host_buffer_size, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-          VK_ACCESS_SHADER_WRITE_BIT));
-  VkBuffer scratch_buffer = scratch_buffer_acquisition.buffer();
-  if (scratch_buffer == VK_NULL_HANDLE) {
-    return false;
+    scratch_buffer_size += level_host_layout.slice_size_bytes * array_size;
   }
+  return true;
+}
+
+bool VulkanTextureCache::RecordTextureDataLoadDispatches(
+    VulkanTexture& texture, const TextureDataLoadLayout& layout) {
+  TextureKey texture_key = texture.key();
+  const LoadShaderInfo& load_shader_info =
+      GetLoadShaderInfo(layout.load_shader);
+  const texture_util::TextureGuestLayout& guest_layout = texture.guest_layout();
+  xenos::DataDimension dimension = texture_key.dimension;
+  bool is_3d = dimension == xenos::DataDimension::k3D;
+  uint32_t width = texture_key.GetWidth();
+  uint32_t height = texture_key.GetHeight();
+  uint32_t depth_or_array_size = texture_key.GetDepthOrArraySize();
+  uint32_t depth = is_3d ? depth_or_array_size : 1;
+  uint32_t array_size = is_3d ? 1 : depth_or_array_size;
+  const FormatInfo* guest_format_info = FormatInfo::Get(texture_key.format);
+  uint32_t block_width = guest_format_info->block_width;
+  uint32_t block_height = guest_format_info->block_height;
+  uint32_t bytes_per_block = guest_format_info->bytes_per_block();
+  uint32_t level_packed = guest_layout.packed_level;
+  uint32_t texture_resolution_scale_x =
+      texture_key.scaled_resolve ? draw_resolution_scale_x() : 1;
+  uint32_t texture_resolution_scale_y =
+      texture_key.scaled_resolve ? draw_resolution_scale_y() : 1;
 
-  // Begin loading.
-  // TODO(Triang3l): Going from one descriptor to another on per-array-layer
-  // or even per-8-depth-slices level to stay within maxStorageBufferRange.
   const ui::vulkan::VulkanDevice* const vulkan_device =
       command_processor_.GetVulkanDevice();
   const ui::vulkan::VulkanDevice::Functions& dfn = vulkan_device->functions();
   const VkDevice device = vulkan_device->device();
   VulkanSharedMemory& vulkan_shared_memory =
       static_cast<VulkanSharedMemory&>(shared_memory());
-  std::array<VkWriteDescriptorSet, 3> write_descriptor_sets;
+  std::array<VkWriteDescriptorSet, 2> write_descriptor_sets;
   uint32_t write_descriptor_set_count = 0;
-  VkDescriptorSet descriptor_set_dest =
-      command_processor_.AllocateSingleTransientDescriptor(
-          VulkanCommandProcessor::SingleTransientDescriptorLayout ::
-              kStorageBufferCompute);
-  if (!descriptor_set_dest) {
-    return false;
-  }
-  VkDescriptorBufferInfo write_descriptor_set_dest_buffer_info;
-  {
-    write_descriptor_set_dest_buffer_info.buffer = scratch_buffer;
-    write_descriptor_set_dest_buffer_info.offset = 0;
-    write_descriptor_set_dest_buffer_info.range = host_buffer_size;
-    VkWriteDescriptorSet& write_descriptor_set_dest =
-        write_descriptor_sets[write_descriptor_set_count++];
-    write_descriptor_set_dest.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write_descriptor_set_dest.pNext = nullptr;
-    write_descriptor_set_dest.dstSet = descriptor_set_dest;
-    write_descriptor_set_dest.dstBinding = 0;
-    write_descriptor_set_dest.dstArrayElement = 0;
-    write_descriptor_set_dest.descriptorCount = 1;
-    write_descriptor_set_dest.descriptorType =
-        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    write_descriptor_set_dest.pImageInfo = nullptr;
-    write_descriptor_set_dest.pBufferInfo =
-        &write_descriptor_set_dest_buffer_info;
-    write_descriptor_set_dest.pTexelBufferView = nullptr;
-  }
   // TODO(Triang3l): Use a single 512 MB shared memory binding if possible.
   // TODO(Triang3l): Scaled resolve buffer bindings.
   // Aligning because if the data for a vector in a storage buffer is provided
@@ -1272,7 +1454,7 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
   VkDescriptorSet descriptor_set_source_mips = VK_NULL_HANDLE;
   VkDescriptorBufferInfo write_descriptor_set_source_base_buffer_info;
   VkDescriptorBufferInfo write_descriptor_set_source_mips_buffer_info;
-  if (level_first == 0) {
+  if (layout.level_first == 0) {
     descriptor_set_source_base =
         command_processor_.AllocateSingleTransientDescriptor(
             VulkanCommandProcessor::SingleTransientDescriptorLayout ::
@@ -1285,7 +1467,7 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
     write_descriptor_set_source_base_buffer_info.offset = texture_key.base_page
                                                           << 12;
     write_descriptor_set_source_base_buffer_info.range =
-        xe::align(vulkan_texture.GetGuestBaseSize(), source_length_alignment);
+        xe::align(texture.GetGuestBaseSize(), source_length_alignment);
     VkWriteDescriptorSet& write_descriptor_set_source_base =
         write_descriptor_sets[write_descriptor_set_count++];
     write_descriptor_set_source_base.sType =
@@ -1302,7 +1484,7 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
         &write_descriptor_set_source_base_buffer_info;
     write_descriptor_set_source_base.pTexelBufferView = nullptr;
   }
-  if (level_last != 0) {
+  if (layout.level_last != 0) {
     descriptor_set_source_mips =
         command_processor_.AllocateSingleTransientDescriptor(
             VulkanCommandProcessor::SingleTransientDescriptorLayout ::
@@ -1315,7 +1497,7 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
     write_descriptor_set_source_mips_buffer_info.offset = texture_key.mip_page
                                                           << 12;
     write_descriptor_set_source_mips_buffer_info.range =
-        xe::align(vulkan_texture.GetGuestMipsSize(), source_length_alignment);
+        xe::align(texture.GetGuestMipsSize(), source_length_alignment);
     VkWriteDescriptorSet& write_descriptor_set_source_mips =
         write_descriptor_sets[write_descriptor_set_count++];
     write_descriptor_set_source_mips.sType =
@@ -1336,18 +1518,11 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
     dfn.vkUpdateDescriptorSets(device, write_descriptor_set_count,
                                write_descriptor_sets.data(), 0, nullptr);
   }
-  vulkan_shared_memory.Use(VulkanSharedMemory::Usage::kRead);
-
-  // Submit the copy buffer population commands.
 
   DeferredCommandBuffer& command_buffer =
       command_processor_.deferred_command_buffer();
 
-  command_processor_.BindExternalComputePipeline(pipeline);
-
-  command_buffer.CmdVkBindDescriptorSets(
-      VK_PIPELINE_BIND_POINT_COMPUTE, load_pipeline_layout_,
-      kLoadDescriptorSetIndexDestination, 1, &descriptor_set_dest, 0, nullptr);
+  command_processor_.BindExternalComputePipeline(layout.pipeline);
 
   VkDescriptorSet descriptor_set_source_current = VK_NULL_HANDLE;
 
@@ -1362,8 +1537,8 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
 
   uint32_t guest_x_blocks_per_group_log2 =
       load_shader_info.GetGuestXBlocksPerGroupLog2();
-  for (uint32_t loop_level = loop_level_first; loop_level <= loop_level_last;
-       ++loop_level) {
+  for (uint32_t loop_level = layout.loop_level_first;
+       loop_level <= layout.loop_level_last; ++loop_level) {
     bool is_base = loop_level == 0;
     uint32_t level = (level_packed == 0) ? 0 : loop_level;
 
@@ -1427,9 +1602,8 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
          ((UINT32_C(1) << kLoadGuestYBlocksPerGroupLog2) - 1)) >>
         kLoadGuestYBlocksPerGroupLog2;
 
-    // TODO(Triang3l): host_offset relative to the storage buffer origin.
-    const HostLayout& level_host_layout =
-        is_base ? host_layout_base : host_layout_mips[level];
+    const TextureDataLoadLayout::HostLayout& level_host_layout =
+        is_base ? layout.host_layout_base : layout.host_layouts_mips[level];
     load_constants.host_offset = uint32_t(level_host_layout.offset_bytes);
     load_constants.host_pitch = load_shader_info.bytes_per_host_block *
                                 level_host_layout.x_pitch_blocks;
@@ -1461,39 +1635,42 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
     }
   }
 
-  // Submit copying from the copy buffer to the host texture.
-  command_processor_.PushBufferMemoryBarrier(
-      scratch_buffer, 0, VK_WHOLE_SIZE,
-      scratch_buffer_acquisition.SetStageMask(VK_PIPELINE_STAGE_TRANSFER_BIT),
-      VK_PIPELINE_STAGE_TRANSFER_BIT,
-      scratch_buffer_acquisition.SetAccessMask(VK_ACCESS_TRANSFER_READ_BIT),
-      VK_ACCESS_TRANSFER_READ_BIT);
-  vulkan_texture.MarkAsUsed();
-  VulkanTexture::Usage texture_old_usage =
-      vulkan_texture.SetUsage(VulkanTexture::Usage::kTransferDestination);
-  if (texture_old_usage != VulkanTexture::Usage::kTransferDestination) {
-    VkPipelineStageFlags texture_src_stage_mask, texture_dst_stage_mask;
-    VkAccessFlags texture_src_access_mask, texture_dst_access_mask;
-    VkImageLayout texture_old_layout, texture_new_layout;
-    GetTextureUsageMasks(texture_old_usage, texture_src_stage_mask,
-                         texture_src_access_mask, texture_old_layout);
-    GetTextureUsageMasks(VulkanTexture::Usage::kTransferDestination,
-                         texture_dst_stage_mask, texture_dst_access_mask,
-                         texture_new_layout);
-    command_processor_.PushImageMemoryBarrier(
-        vulkan_texture.image(), ui::vulkan::util::InitializeSubresourceRange(),
-        texture_src_stage_mask, texture_dst_stage_mask, texture_src_access_mask,
-        texture_dst_access_mask, texture_old_layout, texture_new_layout);
-  }
-  command_processor_.SubmitBarriers(true);
-  VkBufferImageCopy* copy_regions = command_buffer.CmdCopyBufferToImageEmplace(
-      scratch_buffer, vulkan_texture.image(),
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, level_last - level_first + 1);
+  return true;
+}
+
+void VulkanTextureCache::RecordTextureDataLoadCopies(
+    VulkanTexture& texture, const TextureDataLoadLayout& layout,
+    VkBuffer scratch_buffer) {
+  TextureKey texture_key = texture.key();
+  const LoadShaderInfo& load_shader_info =
+      GetLoadShaderInfo(layout.load_shader);
+  bool is_3d = texture_key.dimension == xenos::DataDimension::k3D;
+  uint32_t width = texture_key.GetWidth();
+  uint32_t height = texture_key.GetHeight();
+  uint32_t depth_or_array_size = texture_key.GetDepthOrArraySize();
+  uint32_t depth = is_3d ? depth_or_array_size : 1;
+  uint32_t array_size = is_3d ? 1 : depth_or_array_size;
+  xenos::TextureFormat guest_format = texture_key.format;
+  const FormatInfo* guest_format_info = FormatInfo::Get(guest_format);
+  uint32_t block_width = guest_format_info->block_width;
+  uint32_t block_height = guest_format_info->block_height;
+  uint32_t level_first = layout.level_first;
+  uint32_t level_last = layout.level_last;
+  uint32_t level_packed = texture.guest_layout().packed_level;
+  uint32_t texture_resolution_scale_x =
+      texture_key.scaled_resolve ? draw_resolution_scale_x() : 1;
+  uint32_t texture_resolution_scale_y =
+      texture_key.scaled_resolve ? draw_resolution_scale_y() : 1;
+
+  VkBufferImageCopy* copy_regions =
+      command_processor_.deferred_command_buffer().CmdCopyBufferToImageEmplace(
+          scratch_buffer, texture.image(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+          level_last - level_first + 1);
   for (uint32_t level = level_first; level <= level_last; ++level) {
     VkBufferImageCopy& copy_region = copy_regions[level - level_first];
-    const HostLayout& level_host_layout =
-        level != 0 ? host_layout_mips[std::min(level, level_packed)]
-                   : host_layout_base;
+    const TextureDataLoadLayout::HostLayout& level_host_layout =
+        level != 0 ? layout.host_layouts_mips[std::min(level, level_packed)]
+                   : layout.host_layout_base;
     copy_region.bufferOffset = level_host_layout.offset_bytes;
     if (level >= level_packed) {
       uint32_t level_offset_blocks_x, level_offset_blocks_y, level_offset_z;
@@ -1504,7 +1681,7 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
           texture_resolution_scale_x * level_offset_blocks_x;
       uint32_t level_offset_host_blocks_y =
           texture_resolution_scale_y * level_offset_blocks_y;
-      if (!host_format.block_compressed) {
+      if (!layout.host_block_compressed) {
         level_offset_host_blocks_x *= block_width;
         level_offset_host_blocks_y *= block_height;
       }
@@ -1516,9 +1693,9 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
                                                  VkDeviceSize(level_offset_z)));
     }
     copy_region.bufferRowLength =
-        level_host_layout.x_pitch_blocks * host_block_width;
+        level_host_layout.x_pitch_blocks * layout.host_block_width;
     copy_region.bufferImageHeight =
-        level_host_layout.y_pitch_blocks * host_block_height;
+        level_host_layout.y_pitch_blocks * layout.host_block_height;
     copy_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     copy_region.imageSubresource.mipLevel = level;
     copy_region.imageSubresource.baseArrayLayer = 0;
@@ -1532,8 +1709,6 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
         std::max((height * texture_resolution_scale_y) >> level, UINT32_C(1));
     copy_region.imageExtent.depth = std::max(depth >> level, UINT32_C(1));
   }
-
-  return true;
 }
 
 void VulkanTextureCache::UpdateTextureBindingsImpl(
@@ -14,6 +14,7 @@
 #include <memory>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "xenia/base/hash.h"
 #include "xenia/gpu/texture_cache.h"
@@ -125,6 +126,9 @@ class VulkanTextureCache final : public TextureCache {
   bool IsSignedVersionSeparateForFormat(TextureKey key) const override;
   uint32_t GetHostFormatSwizzle(TextureKey key) const override;
 
+  bool GetHostMemoryBudget(uint64_t& budget_out,
+                           uint64_t& usage_out) const override;
+
   uint32_t GetMaxHostTextureWidthHeight(
       xenos::DataDimension dimension) const override;
   uint32_t GetMaxHostTextureDepthOrArraySize(
@@ -134,6 +138,8 @@ class VulkanTextureCache final : public TextureCache {
 
   bool LoadTextureDataFromResidentMemoryImpl(Texture& texture, bool load_base,
                                              bool load_mips) override;
+  void LoadTexturesDataFromResidentMemoryImpl(TextureDataLoad* loads,
+                                              size_t load_count) override;
 
   void UpdateTextureBindingsImpl(uint32_t fetch_constant_mask) override;
 
@@ -297,6 +303,32 @@ class VulkanTextureCache final : public TextureCache {
     }
   }
 
+  // Where the host data of a texture being loaded is placed in the scratch
+  // buffer shared by all the textures loaded at once.
+  struct TextureDataLoadLayout {
+    struct HostLayout {
+      VkDeviceSize offset_bytes;
+      VkDeviceSize slice_size_bytes;
+      uint32_t x_pitch_blocks;
+      uint32_t y_pitch_blocks;
+    };
+    LoadShaderIndex load_shader;
+    VkPipeline pipeline;
+    bool host_block_compressed;
+    uint32_t level_first;
+    uint32_t level_last;
+    // See the comment in GetTextureDataLoadLayout.
+    uint32_t loop_level_first;
+    uint32_t loop_level_last;
+    uint32_t host_block_width;
+    uint32_t host_block_height;
+    HostLayout host_layout_base;
+    // Indexing is the same as for guest stored mips:
+    // 1...min(level_last, level_packed) if level_packed is not 0, or only 0 if
+    // level_packed == 0.
+    HostLayout host_layouts_mips[xenos::kTextureMaxMips];
+  };
+
   explicit VulkanTextureCache(
       const RegisterFile& register_file, VulkanSharedMemory& shared_memory,
       uint32_t draw_resolution_scale_x, uint32_t draw_resolution_scale_y,
@@ -307,6 +339,22 @@ class VulkanTextureCache final : public TextureCache {
 
   const HostFormatPair& GetHostFormatPair(TextureKey key) const;
 
+  // Places the host data of the texture at scratch_buffer_size, increasing it.
+  // Returns false if the texture can't be loaded.
+  bool GetTextureDataLoadLayout(const VulkanTexture& texture, bool load_base,
+                                bool load_mips,
+                                VkDeviceSize& scratch_buffer_size,
+                                TextureDataLoadLayout& layout_out) const;
+  // Records the dispatches writing the host data of the texture to the scratch
+  // buffer, with the destination descriptor set already bound.
+  bool RecordTextureDataLoadDispatches(VulkanTexture& texture,
+                                       const TextureDataLoadLayout& layout);
+  // Records copying from the scratch buffer, available for transfer reads, to
+  // the texture in the transfer destination layout.
+  void RecordTextureDataLoadCopies(VulkanTexture& texture,
+                                   const TextureDataLoadLayout& layout,
+                                   VkBuffer scratch_buffer);
+
   void GetTextureUsageMasks(VulkanTexture::Usage usage,
                             VkPipelineStageFlags& stage_mask,
                             VkAccessFlags& access_mask, VkImageLayout& layout);
@@ -330,6 +378,9 @@ class VulkanTextureCache final : public TextureCache {
   VkPipelineLayout load_pipeline_layout_ = VK_NULL_HANDLE;
   std::array<VkPipeline, kLoadShaderCount> load_pipelines_{};
   std::array<VkPipeline, kLoadShaderCount> load_pipelines_scaled_{};
+  // Temporary storage for LoadTexturesDataFromResidentMemoryImpl.
+  std::vector<TextureDataLoadLayout> texture_data_load_layouts_;
+  std::vector<uint32_t> texture_data_load_order_;
 
   // If both images can be placed in the same allocation, it's one allocation,
   // otherwise it's two separate.
@@ -11,3 +11,10 @@
 
 DEFINE_bool(guide_button, false, "Forward guide button presses to guest.",
             "HID");
+
+DEFINE_uint32(hid_poll_rate, 500,
+              "Rate, in times per second, at which the input drivers are "
+              "polled in the background for the controller state returned to "
+              "the guest. 0 to ask the drivers every time the guest requests "
+              "the state.",
+              "HID");
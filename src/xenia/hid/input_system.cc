@@ -9,6 +9,11 @@
 
 #include "xenia/hid/input_system.h"
 
+#include <algorithm>
+#include <chrono>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/input_latency.h"
 #include "xenia/base/profiling.h"
 #include "xenia/hid/hid_flags.h"
 #include "xenia/hid/input_driver.h"
@@ -18,9 +23,53 @@ namespace hid {
 
 InputSystem::InputSystem(xe::ui::Window* window) : window_(window) {}
 
-InputSystem::~InputSystem() = default;
+InputSystem::~InputSystem() {
+  // The thread uses the drivers.
+  if (poll_thread_) {
+    poll_shutdown_event_->Set();
+    xe::threading::Wait(poll_thread_.get(), false);
+  }
+}
+
+X_STATUS InputSystem::Setup() {
+  if (!cvars::hid_poll_rate || drivers_.empty()) {
+    return X_STATUS_SUCCESS;
+  }
+  // Polled once before the guest can request the state, so it doesn't see
+  // the controllers as disconnected until the thread has started.
+  StateSnapshot& snapshot = snapshots_[0];
+  for (uint32_t i = 0; i < kPolledUserCount; ++i) {
+    snapshot.results[i] = PollState(i, &snapshot.states[i]);
+  }
+  poll_shutdown_event_ = xe::threading::Event::CreateAutoResetEvent(false);
+  assert_not_null(poll_shutdown_event_);
+  poll_thread_ =
+      xe::threading::Thread::Create({}, [this]() { PollThreadMain(); });
+  if (!poll_thread_) {
+    // Keep asking the drivers directly.
+    return X_STATUS_SUCCESS;
+  }
+  poll_thread_->set_name("Input Polling");
+  return X_STATUS_SUCCESS;
+}
 
-X_STATUS InputSystem::Setup() { return X_STATUS_SUCCESS; }
+void InputSystem::PollThreadMain() {
+  auto interval = std::chrono::milliseconds(
+      std::max(uint32_t(1000) / cvars::hid_poll_rate, uint32_t(1)));
+  while (xe::threading::Wait(poll_shutdown_event_.get(), false, interval) ==
+         xe::threading::WaitResult::kTimeout) {
+    SCOPE_profile_cpu_f("hid");
+    uint64_t generation = snapshot_generation_.load(std::memory_order_relaxed);
+    // The snapshot was current until the previous increment, the reads of it
+    // noticing the writes must also notice the increment.
+    std::atomic_thread_fence(std::memory_order_release);
+    StateSnapshot& snapshot = snapshots_[(generation + 1) & 1];
+    for (uint32_t i = 0; i < kPolledUserCount; ++i) {
+      snapshot.results[i] = PollState(i, &snapshot.states[i]);
+    }
+    snapshot_generation_.store(generation + 1, std::memory_order_release);
+  }
+}
 
 void InputSystem::AddDriver(std::unique_ptr<InputDriver> driver) {
   drivers_.push_back(std::move(driver));
@@ -44,6 +93,33 @@ X_RESULT InputSystem::GetCapabilities(uint32_t user_index, uint32_t flags,
 }
 
 X_RESULT InputSystem::GetState(uint32_t user_index, X_INPUT_STATE* out_state) {
+  X_RESULT result;
+  if (!poll_thread_ || user_index >= kPolledUserCount) {
+    result = PollState(user_index, out_state);
+  } else {
+    while (true) {
+      uint64_t generation =
+          snapshot_generation_.load(std::memory_order_acquire);
+      const StateSnapshot& snapshot = snapshots_[generation & 1];
+      result = snapshot.results[user_index];
+      X_INPUT_STATE state = snapshot.states[user_index];
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (snapshot_generation_.load(std::memory_order_relaxed) == generation) {
+        if (result == X_ERROR_SUCCESS) {
+          *out_state = state;
+        }
+        break;
+      }
+    }
+  }
+  if (result == X_ERROR_SUCCESS && input_latency::IsEnabled()) {
+    input_latency::OnInputRead(user_index, out_state->packet_number);
+  }
+  return result;
+}
+
+X_RESULT InputSystem::PollState(uint32_t user_index,
+                                X_INPUT_STATE* out_state) {
   SCOPE_profile_cpu_f("hid");
 
   bool any_connected = false;
@@ -53,6 +129,9 @@ X_RESULT InputSystem::GetState(uint32_t user_index, X_INPUT_STATE* out_state) {
       any_connected = true;
     }
     if (result == X_ERROR_SUCCESS) {
+      if (input_latency::IsEnabled()) {
+        input_latency::OnInputReceived(user_index, out_state->packet_number);
+      }
       return result;
     }
   }
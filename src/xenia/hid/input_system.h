@@ -10,9 +10,11 @@
 #ifndef XENIA_HID_INPUT_SYSTEM_H_
 #define XENIA_HID_INPUT_SYSTEM_H_
 
+#include <atomic>
 #include <memory>
 #include <vector>
 
+#include "xenia/base/threading.h"
 #include "xenia/hid/input.h"
 #include "xenia/hid/input_driver.h"
 #include "xenia/xbox.h"
@@ -45,9 +47,31 @@ class InputSystem {
                         X_INPUT_KEYSTROKE* out_keystroke);
 
  private:
+  // Users whose state is polled in the background.
+  static constexpr uint32_t kPolledUserCount = 4;
+
+  struct StateSnapshot {
+    X_RESULT results[kPolledUserCount];
+    X_INPUT_STATE states[kPolledUserCount];
+  };
+
+  // Asks the drivers for the state of the user directly.
+  X_RESULT PollState(uint32_t user_index, X_INPUT_STATE* out_state);
+  void PollThreadMain();
+
   xe::ui::Window* window_ = nullptr;
 
   std::vector<std::unique_ptr<InputDriver>> drivers_;
+
+  std::unique_ptr<xe::threading::Thread> poll_thread_;
+  std::unique_ptr<xe::threading::Event> poll_shutdown_event_;
+  // The polling thread fills the snapshot other than the current one, then
+  // makes it current by incrementing the generation. Readers copy the state
+  // from the current snapshot without locking, and retry if the generation
+  // has changed meanwhile, as the polling thread may have started overwriting
+  // it.
+  StateSnapshot snapshots_[2] = {};
+  std::atomic<uint64_t> snapshot_generation_{0};
 };
 
 }  // namespace hid
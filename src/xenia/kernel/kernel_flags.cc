@@ -14,3 +14,16 @@ DEFINE_bool(headless, false,
             "UI");
 DEFINE_bool(log_high_frequency_kernel_calls, false,
             "Log kernel calls with the kHighFrequency tag.", "Kernel");
+DEFINE_bool(deliver_dpcs, true,
+            "Run the deferred procedure calls queued by the guest with "
+            "KeInsertQueueDpc on the kernel dispatch thread. If disabled, they "
+            "stay queued.",
+            "Kernel");
+DEFINE_bool(profile_kernel_calls, false,
+            "Measure the host time spent in each kernel export, shown with "
+            "the call counts in the Kernel Calls tab of the debugger.",
+            "Kernel");
+DEFINE_path(kernel_call_profile_path, "",
+            "CSV file to write the kernel export call counts and host times "
+            "to when the emulator shuts down. Leave blank to not write it.",
+            "Kernel");
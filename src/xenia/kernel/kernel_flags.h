@@ -13,5 +13,8 @@
 
 DECLARE_bool(headless);
 DECLARE_bool(log_high_frequency_kernel_calls);
+DECLARE_bool(deliver_dpcs);
+DECLARE_bool(profile_kernel_calls);
+DECLARE_path(kernel_call_profile_path);
 
 #endif  // XENIA_KERNEL_KERNEL_FLAGS_H_
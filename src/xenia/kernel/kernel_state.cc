@@ -19,6 +19,8 @@
 #include "xenia/base/string.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/emulator.h"
+#include "xenia/kernel/kernel_flags.h"
+#include "xenia/kernel/socket_event_loop.h"
 #include "xenia/kernel/user_module.h"
 #include "xenia/kernel/util/shim_utils.h"
 #include "xenia/kernel/xam/xam_module.h"
@@ -29,6 +31,12 @@
 #include "xenia/kernel/xobject.h"
 #include "xenia/kernel/xthread.h"
 
+DEFINE_uint32(file_io_threads, 1,
+              "Number of host threads performing overlapped file reads "
+              "requested by the guest, which return to the title before the "
+              "read is done. 0 to do them on the requesting guest thread.",
+              "Kernel");
+
 namespace xe {
 namespace kernel {
 
@@ -47,6 +55,7 @@ KernelState::KernelState(Emulator* emulator)
       dispatch_thread_running_(false),
       dpc_list_(emulator->memory()) {
   processor_ = emulator->processor();
+  dispatch_event_ = xe::threading::Event::CreateAutoResetEvent(false);
   file_system_ = emulator->file_system();
 
   app_manager_ = std::make_unique<xam::AppManager>();
@@ -72,9 +81,34 @@ KernelState::~KernelState() {
 
   if (dispatch_thread_running_) {
     dispatch_thread_running_ = false;
-    dispatch_cond_.notify_all();
+    dispatch_event_->Set();
     dispatch_thread_->Wait(0, 0, 0, nullptr);
   }
+  // Dropping the work queued too late to be dispatched.
+  DispatchEntry* dispatch_entry = dispatch_queue_head_.exchange(nullptr);
+  while (dispatch_entry) {
+    DispatchEntry* next_dispatch_entry = dispatch_entry->next;
+    delete dispatch_entry;
+    dispatch_entry = next_dispatch_entry;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(file_io_mutex_);
+    file_io_shutting_down_ = true;
+  }
+  file_io_cond_.notify_all();
+  for (auto& thread : file_io_threads_) {
+    xe::threading::Wait(thread.get(), false);
+  }
+  file_io_threads_.clear();
+
+  // Releases the sockets with overlapped receives pending.
+  socket_event_loop_.reset();
+
+  if (!cvars::kernel_call_profile_path.empty()) {
+    processor()->export_resolver()->WriteCallProfile(
+        cvars::kernel_call_profile_path);
+  }
 
   executable_module_.reset();
   user_modules_.clear();
@@ -105,24 +139,14 @@ uint32_t KernelState::title_id() const {
   return 0;
 }
 
-util::XdbfGameData KernelState::title_xdbf() const {
+const util::XdbfGameData& KernelState::title_xdbf() const {
   return module_xdbf(executable_module_);
 }
 
-util::XdbfGameData KernelState::module_xdbf(
+const util::XdbfGameData& KernelState::module_xdbf(
     object_ref<UserModule> exec_module) const {
   assert_not_null(exec_module);
-
-  uint32_t resource_data = 0;
-  uint32_t resource_size = 0;
-  if (XSUCCEEDED(exec_module->GetSection(
-          fmt::format("{:08X}", exec_module->title_id()).c_str(),
-          &resource_data, &resource_size))) {
-    util::XdbfGameData db(memory()->TranslateVirtual(resource_data),
-                          resource_size);
-    return db;
-  }
-  return util::XdbfGameData(nullptr, resource_size);
+  return exec_module->xdbf();
 }
 
 uint32_t KernelState::process_type() const {
@@ -367,25 +391,7 @@ void KernelState::SetExecutableModule(object_ref<UserModule> module) {
     dispatch_thread_running_ = true;
     dispatch_thread_ =
         object_ref<XHostThread>(new XHostThread(this, 128 * 1024, 0, [this]() {
-          // As we run guest callbacks the debugger must be able to suspend us.
-          dispatch_thread_->set_can_debugger_suspend(true);
-
-          auto global_lock = global_critical_region_.AcquireDeferred();
-          while (dispatch_thread_running_) {
-            global_lock.lock();
-            if (dispatch_queue_.empty()) {
-              dispatch_cond_.wait(global_lock);
-              if (!dispatch_thread_running_) {
-                global_lock.unlock();
-                break;
-              }
-            }
-            auto fn = std::move(dispatch_queue_.front());
-            dispatch_queue_.pop_front();
-            global_lock.unlock();
-
-            fn();
-          }
+          DispatchThreadMain();
           return 0;
         }));
     dispatch_thread_->set_name("Kernel Dispatch");
@@ -393,7 +399,95 @@ void KernelState::SetExecutableModule(object_ref<UserModule> module) {
   }
 }
 
+void KernelState::QueueDispatch(std::function<void()> fn) {
+  auto entry = new DispatchEntry{std::move(fn), nullptr};
+  entry->next = dispatch_queue_head_.load(std::memory_order_relaxed);
+  while (!dispatch_queue_head_.compare_exchange_weak(
+      entry->next, entry, std::memory_order_release,
+      std::memory_order_relaxed)) {
+  }
+  dispatch_event_->Set();
+}
+
+void KernelState::NotifyDpcQueued() {
+  if (!cvars::deliver_dpcs) {
+    return;
+  }
+  if (!dpcs_queued_.exchange(true, std::memory_order_acq_rel)) {
+    dispatch_event_->Set();
+  }
+}
+
+void KernelState::DispatchThreadMain() {
+  // As we run guest callbacks the debugger must be able to suspend us.
+  dispatch_thread_->set_can_debugger_suspend(true);
+
+  while (dispatch_thread_running_) {
+    xe::threading::Wait(dispatch_event_.get(), false);
+    if (!dispatch_thread_running_) {
+      break;
+    }
+    // DPCs go first, as on the guest they interrupt the threads.
+    if (dpcs_queued_.exchange(false, std::memory_order_acq_rel)) {
+      RunQueuedDpcs();
+    }
+    DispatchEntry* entry =
+        dispatch_queue_head_.exchange(nullptr, std::memory_order_acquire);
+    // Pushed newest first, reversing to run them in the order they were
+    // queued.
+    DispatchEntry* oldest_entry = nullptr;
+    while (entry) {
+      DispatchEntry* next_entry = entry->next;
+      entry->next = oldest_entry;
+      oldest_entry = entry;
+      entry = next_entry;
+    }
+    while (oldest_entry) {
+      DispatchEntry* next_entry = oldest_entry->next;
+      oldest_entry->fn();
+      delete oldest_entry;
+      oldest_entry = next_entry;
+      if (dpcs_queued_.exchange(false, std::memory_order_acq_rel)) {
+        RunQueuedDpcs();
+      }
+    }
+  }
+}
+
+void KernelState::RunQueuedDpcs() {
+  struct QueuedDpc {
+    uint32_t dpc_ptr;
+    uint32_t routine;
+    uint32_t context;
+    uint32_t arg1;
+    uint32_t arg2;
+  };
+  // Taken in one go, so a DPC re-queued by its routine runs in the next batch.
+  std::vector<QueuedDpc> dpcs;
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    while (uint32_t list_entry_ptr = dpc_list_.Shift()) {
+      // The list entry follows the type field in KDPC.
+      uint32_t dpc_ptr = list_entry_ptr - 4;
+      auto dpc = memory()->TranslateVirtual<xe::be<uint32_t>*>(dpc_ptr);
+      dpcs.push_back({dpc_ptr, dpc[3], dpc[4], dpc[5], dpc[6]});
+    }
+  }
+  // The list is newest first.
+  for (auto it = dpcs.rbegin(); it != dpcs.rend(); ++it) {
+    if (!it->routine) {
+      continue;
+    }
+    uint64_t args[] = {it->dpc_ptr, it->context, it->arg1, it->arg2};
+    processor()->Execute(dispatch_thread_->thread_state(), it->routine, args,
+                         xe::countof(args));
+  }
+}
+
 void KernelState::LoadKernelModule(object_ref<KernelModule> kernel_module) {
+  // The module has registered its exports, and the imports of the titles are
+  // bound to them only after all kernel modules are loaded.
+  shim::SelectExportTrampolines(processor()->export_resolver());
   auto global_lock = global_critical_region_.Acquire();
   kernel_modules_.push_back(std::move(kernel_module));
 }
@@ -799,9 +893,8 @@ void KernelState::CompleteOverlappedDeferredEx(
   auto ptr = memory()->TranslateVirtual(overlapped_ptr);
   XOverlappedSetResult(ptr, X_ERROR_IO_PENDING);
   XOverlappedSetContext(ptr, XThread::GetCurrentThreadHandle());
-  auto global_lock = global_critical_region_.Acquire();
-  dispatch_queue_.push_back([this, completion_callback, overlapped_ptr,
-                             pre_callback, post_callback]() {
+  QueueDispatch([this, completion_callback, overlapped_ptr, pre_callback,
+                 post_callback]() {
     if (pre_callback) {
       pre_callback();
     }
@@ -814,7 +907,61 @@ void KernelState::CompleteOverlappedDeferredEx(
       post_callback();
     }
   });
-  dispatch_cond_.notify_all();
+}
+
+bool KernelState::QueueFileIO(std::function<void()> work) {
+  {
+    std::lock_guard<std::mutex> lock(file_io_mutex_);
+    if (file_io_shutting_down_) {
+      return false;
+    }
+    if (file_io_threads_.empty()) {
+      for (uint32_t i = 0; i < cvars::file_io_threads; ++i) {
+        auto thread = xe::threading::Thread::Create(
+            {}, [this]() { FileIOThreadMain(); });
+        if (!thread) {
+          XELOGE("Failed to create file I/O thread {}", i);
+          break;
+        }
+        thread->set_name(fmt::format("Kernel File I/O {}", i));
+        file_io_threads_.push_back(std::move(thread));
+      }
+      if (file_io_threads_.empty()) {
+        return false;
+      }
+    }
+    file_io_queue_.push_back(std::move(work));
+  }
+  file_io_cond_.notify_one();
+  return true;
+}
+
+SocketEventLoop* KernelState::socket_event_loop() {
+  std::lock_guard<std::mutex> lock(socket_event_loop_mutex_);
+  if (!socket_event_loop_created_) {
+    socket_event_loop_created_ = true;
+    socket_event_loop_ = SocketEventLoop::Create();
+  }
+  return socket_event_loop_.get();
+}
+
+void KernelState::FileIOThreadMain() {
+  while (true) {
+    std::function<void()> work;
+    {
+      std::unique_lock<std::mutex> lock(file_io_mutex_);
+      file_io_cond_.wait(lock, [this]() {
+        return file_io_shutting_down_ || !file_io_queue_.empty();
+      });
+      // Finish the queued I/O, the guest may be waiting for it.
+      if (file_io_queue_.empty()) {
+        return;
+      }
+      work = std::move(file_io_queue_.front());
+      file_io_queue_.pop_front();
+    }
+    work();
+  }
 }
 
 bool KernelState::Save(ByteStream* stream) {
@@ -898,11 +1045,11 @@ bool KernelState::Restore(ByteStream* stream) {
 
   // Read the TLS allocation bitmap
   auto num_bitmap_entries = stream->Read<uint32_t>();
-  auto& tls_bitmap = tls_bitmap_.data();
-  tls_bitmap.resize(num_bitmap_entries);
+  std::vector<uint64_t> tls_bitmap(num_bitmap_entries);
   for (uint32_t i = 0; i < num_bitmap_entries; i++) {
     tls_bitmap[i] = stream->Read<uint64_t>();
   }
+  tls_bitmap_.SetData(std::move(tls_bitmap));
 
   uint32_t num_threads = stream->Read<uint32_t>();
   XELOGD("Loading {} threads...", num_threads);
@@ -12,14 +12,17 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include "xenia/base/bit_map.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/mutex.h"
+#include "xenia/base/threading.h"
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/kernel/util/native_list.h"
 #include "xenia/kernel/util/object_table.h"
@@ -47,6 +50,7 @@ constexpr fourcc_t kKernelSaveSignature = make_fourcc("KRNL");
 class Dispatcher;
 class XHostThread;
 class KernelModule;
+class SocketEventLoop;
 class XModule;
 class XNotifyListener;
 class XThread;
@@ -100,8 +104,9 @@ class KernelState {
   vfs::VirtualFileSystem* file_system() const { return file_system_; }
 
   uint32_t title_id() const;
-  util::XdbfGameData title_xdbf() const;
-  util::XdbfGameData module_xdbf(object_ref<UserModule> exec_module) const;
+  const util::XdbfGameData& title_xdbf() const;
+  const util::XdbfGameData& module_xdbf(
+      object_ref<UserModule> exec_module) const;
 
   xam::AppManager* app_manager() const { return app_manager_.get(); }
   xam::ContentManager* content_manager() const {
@@ -176,7 +181,11 @@ class KernelState {
   void UnregisterNotifyListener(XNotifyListener* listener);
   void BroadcastNotification(XNotificationID id, uint32_t data);
 
+  // Must be guarded by the global critical region. Call NotifyDpcQueued after
+  // inserting into it.
   util::NativeList* dpc_list() { return &dpc_list_; }
+  // Makes the dispatch thread run the queued DPCs.
+  void NotifyDpcQueued();
 
   void CompleteOverlapped(uint32_t overlapped_ptr, X_RESULT result);
   void CompleteOverlappedEx(uint32_t overlapped_ptr, X_RESULT result,
@@ -205,11 +214,21 @@ class KernelState {
       uint32_t overlapped_ptr, std::function<void()> pre_callback = nullptr,
       std::function<void()> post_callback = nullptr);
 
+  // Runs file I/O requested by the guest with overlapped (non-synchronous)
+  // access on a host I/O thread, so the requesting guest thread doesn't wait
+  // for the device. Returns false without running the function if there are
+  // no I/O threads, in which case the I/O should be done synchronously.
+  bool QueueFileIO(std::function<void()> work);
+
+  // Created on first use, null if the host event loop couldn't be created.
+  SocketEventLoop* socket_event_loop();
+
   bool Save(ByteStream* stream);
   bool Restore(ByteStream* stream);
 
  private:
   void LoadKernelModule(object_ref<KernelModule> kernel_module);
+  void FileIOThreadMain();
 
   Emulator* emulator_;
   Memory* memory_;
@@ -236,13 +255,39 @@ class KernelState {
 
   uint32_t process_info_block_address_ = 0;
 
+  struct DispatchEntry {
+    std::function<void()> fn;
+    DispatchEntry* next;
+  };
+  // Queues the function to run on the dispatch thread, without locking.
+  void QueueDispatch(std::function<void()> fn);
+  void DispatchThreadMain();
+  // Runs the DPCs in dpc_list_, holding the global critical region only while
+  // taking them from the list.
+  void RunQueuedDpcs();
+
   std::atomic<bool> dispatch_thread_running_;
   std::atomic<bool> terminating_{false};  // Global termination flag
   object_ref<XHostThread> dispatch_thread_;
   // Must be guarded by the global critical region.
   util::NativeList dpc_list_;
-  std::condition_variable_any dispatch_cond_;
-  std::list<std::function<void()>> dispatch_queue_;
+  std::atomic<bool> dpcs_queued_{false};
+  // Pushed by any thread, newest first, and taken as a whole by the dispatch
+  // thread.
+  std::atomic<DispatchEntry*> dispatch_queue_head_{nullptr};
+  // Auto-reset, set when something is queued for the dispatch thread.
+  std::unique_ptr<xe::threading::Event> dispatch_event_;
+
+  // Created on first use.
+  std::mutex file_io_mutex_;
+  std::condition_variable file_io_cond_;
+  bool file_io_shutting_down_ = false;
+  std::deque<std::function<void()>> file_io_queue_;
+  std::vector<std::unique_ptr<xe::threading::Thread>> file_io_threads_;
+
+  std::mutex socket_event_loop_mutex_;
+  bool socket_event_loop_created_ = false;
+  std::unique_ptr<SocketEventLoop> socket_event_loop_;
 
   BitMap tls_bitmap_;
 
@@ -0,0 +1,96 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/socket_event_loop.h"
+
+#include "xenia/base/logging.h"
+#include "xenia/kernel/xsocket.h"
+
+namespace xe {
+namespace kernel {
+
+SocketEventLoop::SocketEventLoop() = default;
+
+SocketEventLoop::~SocketEventLoop() {
+  if (thread_) {
+    shutting_down_ = true;
+    WakeHost();
+    xe::threading::Wait(thread_.get(), false);
+    thread_.reset();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sockets_.clear();
+  }
+  ShutdownHost();
+}
+
+std::unique_ptr<SocketEventLoop> SocketEventLoop::Create() {
+  auto loop = std::unique_ptr<SocketEventLoop>(new SocketEventLoop());
+  if (!loop->InitializeHost()) {
+    XELOGE("Failed to initialize the socket event loop");
+    return nullptr;
+  }
+  SocketEventLoop* loop_ptr = loop.get();
+  loop->thread_ = xe::threading::Thread::Create(
+      {}, [loop_ptr]() { loop_ptr->ThreadMain(); });
+  if (!loop->thread_) {
+    XELOGE("Failed to create the socket event loop thread");
+    return nullptr;
+  }
+  loop->thread_->set_name("Kernel Socket Event Loop");
+  return loop;
+}
+
+void SocketEventLoop::Watch(object_ref<XSocket> socket) {
+  uint64_t native_handle = socket->native_handle();
+  std::lock_guard<std::mutex> lock(mutex_);
+  sockets_[native_handle] = std::move(socket);
+  ArmHost(native_handle);
+}
+
+void SocketEventLoop::Unwatch(XSocket* socket) {
+  // Released outside the lock, as the last reference may destroy the socket.
+  object_ref<XSocket> watched_socket;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sockets_.find(socket->native_handle());
+    if (it == sockets_.end() || it->second.get() != socket) {
+      return;
+    }
+    watched_socket = std::move(it->second);
+    sockets_.erase(it);
+    DisarmHost(socket->native_handle());
+  }
+}
+
+void SocketEventLoop::ThreadMain() {
+  std::vector<uint64_t> ready_handles;
+  while (!shutting_down_) {
+    ready_handles.clear();
+    WaitHost(&ready_handles);
+    for (uint64_t native_handle : ready_handles) {
+      object_ref<XSocket> socket;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = sockets_.find(native_handle);
+        if (it == sockets_.end()) {
+          continue;
+        }
+        socket = std::move(it->second);
+        sockets_.erase(it);
+      }
+      // Watches the socket again if there are still receives pending.
+      socket->OnReadable();
+    }
+  }
+}
+
+}  // namespace kernel
+}  // namespace xe
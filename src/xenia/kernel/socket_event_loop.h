@@ -0,0 +1,77 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_KERNEL_SOCKET_EVENT_LOOP_H_
+#define XENIA_KERNEL_SOCKET_EVENT_LOOP_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/threading.h"
+#include "xenia/kernel/xobject.h"
+
+namespace xe {
+namespace kernel {
+
+class XSocket;
+
+// Waits for the host sockets of all guest sockets with overlapped receives
+// pending on a single host thread (using epoll on Linux and WSAPoll on
+// Windows), so the guest threads don't have to be blocked in the host
+// receive calls.
+class SocketEventLoop {
+ public:
+  static std::unique_ptr<SocketEventLoop> Create();
+  ~SocketEventLoop();
+
+  // Makes the loop call XSocket::OnReadable once when the host socket has data
+  // to receive or an error - the socket must be watched again if it's still
+  // needed after that. The loop keeps a reference to the socket until then.
+  void Watch(object_ref<XSocket> socket);
+  // Must be called before closing the host socket.
+  void Unwatch(XSocket* socket);
+
+ private:
+  struct HostState;
+
+  SocketEventLoop();
+
+  void ThreadMain();
+
+  // Implemented for each platform.
+  bool InitializeHost();
+  void ShutdownHost();
+  // Whether the host socket should be waited for, one-shot.
+  void ArmHost(uint64_t native_handle);
+  void DisarmHost(uint64_t native_handle);
+  // Interrupts WaitHost.
+  void WakeHost();
+  // Waits until the armed sockets are readable or WakeHost is called,
+  // appending the native handles of the readable ones and disarming them.
+  void WaitHost(std::vector<uint64_t>* ready_handles);
+
+  // Created by InitializeHost and destroyed by ShutdownHost.
+  HostState* host_ = nullptr;
+
+  std::mutex mutex_;
+  // Sockets being watched, by their native handle.
+  std::unordered_map<uint64_t, object_ref<XSocket>> sockets_;
+
+  std::atomic<bool> shutting_down_{false};
+  std::unique_ptr<xe::threading::Thread> thread_;
+};
+
+}  // namespace kernel
+}  // namespace xe
+
+#endif  // XENIA_KERNEL_SOCKET_EVENT_LOOP_H_
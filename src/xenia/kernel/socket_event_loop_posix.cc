@@ -0,0 +1,97 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/socket_event_loop.h"
+
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+
+namespace xe {
+namespace kernel {
+
+struct SocketEventLoop::HostState {
+  int epoll_fd = -1;
+  int wake_fd = -1;
+};
+
+bool SocketEventLoop::InitializeHost() {
+  host_ = new HostState;
+  host_->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (host_->epoll_fd == -1) {
+    return false;
+  }
+  host_->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (host_->wake_fd == -1) {
+    return false;
+  }
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = uint64_t(host_->wake_fd);
+  return epoll_ctl(host_->epoll_fd, EPOLL_CTL_ADD, host_->wake_fd, &event) == 0;
+}
+
+void SocketEventLoop::ShutdownHost() {
+  if (!host_) {
+    return;
+  }
+  if (host_->wake_fd != -1) {
+    close(host_->wake_fd);
+  }
+  if (host_->epoll_fd != -1) {
+    close(host_->epoll_fd);
+  }
+  delete host_;
+  host_ = nullptr;
+}
+
+void SocketEventLoop::ArmHost(uint64_t native_handle) {
+  int fd = int(native_handle);
+  epoll_event event = {};
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.u64 = native_handle;
+  // Sockets that have already triggered stay registered, but disabled.
+  if (epoll_ctl(host_->epoll_fd, EPOLL_CTL_MOD, fd, &event) == 0) {
+    return;
+  }
+  if (errno != ENOENT ||
+      epoll_ctl(host_->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+    XELOGE("Failed to add socket {} to the event loop, errno {}", fd, errno);
+  }
+}
+
+void SocketEventLoop::DisarmHost(uint64_t native_handle) {
+  epoll_ctl(host_->epoll_fd, EPOLL_CTL_DEL, int(native_handle), nullptr);
+}
+
+void SocketEventLoop::WakeHost() {
+  uint64_t value = 1;
+  write(host_->wake_fd, &value, sizeof(value));
+}
+
+void SocketEventLoop::WaitHost(std::vector<uint64_t>* ready_handles) {
+  epoll_event events[64];
+  int count = epoll_wait(host_->epoll_fd, events, int(xe::countof(events)), -1);
+  for (int i = 0; i < count; ++i) {
+    uint64_t native_handle = events[i].data.u64;
+    if (native_handle == uint64_t(host_->wake_fd)) {
+      uint64_t value;
+      read(host_->wake_fd, &value, sizeof(value));
+      continue;
+    }
+    ready_handles->push_back(native_handle);
+  }
+}
+
+}  // namespace kernel
+}  // namespace xe
@@ -0,0 +1,138 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/socket_event_loop.h"
+
+#include <algorithm>
+
+// clang-format off
+#include "xenia/base/platform_win.h"
+#include <WS2tcpip.h>
+#include <WinSock2.h>
+// clang-format on
+
+#include "xenia/base/logging.h"
+
+namespace xe {
+namespace kernel {
+
+struct SocketEventLoop::HostState {
+  // WSAPoll can't wait for events, so the loop is woken up by sending a
+  // datagram to this socket connected to itself.
+  SOCKET wake_socket = INVALID_SOCKET;
+  std::mutex mutex;
+  std::vector<SOCKET> armed_sockets;
+  std::vector<WSAPOLLFD> poll_fds;
+};
+
+bool SocketEventLoop::InitializeHost() {
+  host_ = new HostState;
+  host_->wake_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (host_->wake_socket == INVALID_SOCKET) {
+    return false;
+  }
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int address_length = sizeof(address);
+  if (bind(host_->wake_socket, reinterpret_cast<sockaddr*>(&address),
+           address_length) != 0 ||
+      getsockname(host_->wake_socket, reinterpret_cast<sockaddr*>(&address),
+                  &address_length) != 0 ||
+      connect(host_->wake_socket, reinterpret_cast<sockaddr*>(&address),
+              address_length) != 0) {
+    return false;
+  }
+  u_long non_blocking = 1;
+  return ioctlsocket(host_->wake_socket, FIONBIO, &non_blocking) == 0;
+}
+
+void SocketEventLoop::ShutdownHost() {
+  if (!host_) {
+    return;
+  }
+  if (host_->wake_socket != INVALID_SOCKET) {
+    closesocket(host_->wake_socket);
+  }
+  delete host_;
+  host_ = nullptr;
+}
+
+void SocketEventLoop::ArmHost(uint64_t native_handle) {
+  {
+    std::lock_guard<std::mutex> lock(host_->mutex);
+    auto& armed_sockets = host_->armed_sockets;
+    SOCKET socket = SOCKET(native_handle);
+    if (std::find(armed_sockets.begin(), armed_sockets.end(), socket) !=
+        armed_sockets.end()) {
+      return;
+    }
+    armed_sockets.push_back(socket);
+  }
+  WakeHost();
+}
+
+void SocketEventLoop::DisarmHost(uint64_t native_handle) {
+  {
+    std::lock_guard<std::mutex> lock(host_->mutex);
+    auto& armed_sockets = host_->armed_sockets;
+    auto it = std::find(armed_sockets.begin(), armed_sockets.end(),
+                        SOCKET(native_handle));
+    if (it == armed_sockets.end()) {
+      return;
+    }
+    armed_sockets.erase(it);
+  }
+  // Not polling the socket anymore before it's closed.
+  WakeHost();
+}
+
+void SocketEventLoop::WakeHost() {
+  char value = 0;
+  send(host_->wake_socket, &value, sizeof(value), 0);
+}
+
+void SocketEventLoop::WaitHost(std::vector<uint64_t>* ready_handles) {
+  auto& poll_fds = host_->poll_fds;
+  poll_fds.clear();
+  poll_fds.push_back({host_->wake_socket, POLLRDNORM, 0});
+  {
+    std::lock_guard<std::mutex> lock(host_->mutex);
+    for (SOCKET socket : host_->armed_sockets) {
+      poll_fds.push_back({socket, POLLRDNORM, 0});
+    }
+  }
+  int count = WSAPoll(poll_fds.data(), ULONG(poll_fds.size()), -1);
+  if (count <= 0) {
+    return;
+  }
+  if (poll_fds[0].revents) {
+    char values[64];
+    while (recv(host_->wake_socket, values, sizeof(values), 0) > 0) {
+    }
+  }
+  std::lock_guard<std::mutex> lock(host_->mutex);
+  auto& armed_sockets = host_->armed_sockets;
+  for (size_t i = 1; i < poll_fds.size(); ++i) {
+    if (!poll_fds[i].revents) {
+      continue;
+    }
+    auto it = std::find(armed_sockets.begin(), armed_sockets.end(),
+                        poll_fds[i].fd);
+    if (it == armed_sockets.end()) {
+      // Disarmed while waiting.
+      continue;
+    }
+    armed_sockets.erase(it);
+    ready_handles->push_back(uint64_t(poll_fds[i].fd));
+  }
+}
+
+}  // namespace kernel
+}  // namespace xe
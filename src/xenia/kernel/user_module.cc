@@ -11,6 +11,7 @@
 
 #include <vector>
 
+#include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/logging.h"
 #include "xenia/cpu/elf_module.h"
@@ -241,6 +242,10 @@ X_STATUS UserModule::LoadXexContinue() {
 }
 
 X_STATUS UserModule::Unload() {
+  {
+    std::lock_guard<std::mutex> lock(xdbf_mutex_);
+    xdbf_.reset();
+  }
   if (module_format_ == kModuleFormatXex &&
       (!processor_module_ || !xex_module()->loaded())) {
     // Quick abort.
@@ -287,6 +292,22 @@ X_STATUS UserModule::GetSection(const std::string_view name,
   return X_STATUS_NOT_FOUND;
 }
 
+const util::XdbfGameData& UserModule::xdbf() {
+  std::lock_guard<std::mutex> lock(xdbf_mutex_);
+  if (!xdbf_) {
+    uint32_t resource_data = 0;
+    uint32_t resource_size = 0;
+    if (XSUCCEEDED(GetSection(fmt::format("{:08X}", title_id()).c_str(),
+                              &resource_data, &resource_size))) {
+      xdbf_ = std::make_unique<util::XdbfGameData>(
+          memory()->TranslateVirtual(resource_data), resource_size);
+    } else {
+      xdbf_ = std::make_unique<util::XdbfGameData>(nullptr, resource_size);
+    }
+  }
+  return *xdbf_;
+}
+
 X_STATUS UserModule::GetOptHeader(xex2_header_keys key, void** out_ptr) {
   assert_not_null(out_ptr);
 
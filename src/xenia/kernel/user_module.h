@@ -10,10 +10,13 @@
 #ifndef XENIA_KERNEL_USER_MODULE_H_
 #define XENIA_KERNEL_USER_MODULE_H_
 
+#include <memory>
+#include <mutex>
 #include <string>
 
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/xex_module.h"
+#include "xenia/kernel/util/xdbf_utils.h"
 #include "xenia/kernel/util/xex2_info.h"
 #include "xenia/kernel/xmodule.h"
 #include "xenia/xbox.h"
@@ -73,6 +76,10 @@ class UserModule : public XModule {
   X_STATUS GetSection(const std::string_view name, uint32_t* out_section_data,
                       uint32_t* out_section_size) override;
 
+  // The XDBF resource of the title, parsed on the first query and kept until
+  // the module is unloaded.
+  const util::XdbfGameData& xdbf();
+
   // Get optional header - FOR HOST USE ONLY!
   X_STATUS GetOptHeader(xex2_header_keys key, void** out_ptr);
 
@@ -107,6 +114,9 @@ class UserModule : public XModule {
   bool is_dll_module_ = false;
   uint32_t entry_point_ = 0;
   uint32_t stack_size_ = 0;
+
+  std::mutex xdbf_mutex_;
+  std::unique_ptr<util::XdbfGameData> xdbf_;
 };
 
 }  // namespace kernel
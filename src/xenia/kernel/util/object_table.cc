@@ -14,6 +14,7 @@
 
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/threading.h"
 #include "xenia/kernel/xobject.h"
 #include "xenia/kernel/xthread.h"
 
@@ -21,79 +22,97 @@ namespace xe {
 namespace kernel {
 namespace util {
 
-ObjectTable::ObjectTable() {}
+ObjectTable::ObjectTable()
+    : chunks_(new std::atomic<ObjectTableEntry*>[kMaxChunkCount]()),
+      native_object_cache_(
+          new NativeObjectCacheEntry[kNativeObjectCacheSize]) {}
 
 ObjectTable::~ObjectTable() { Reset(); }
 
 void ObjectTable::Reset() {
   auto global_lock = global_critical_region_.Acquire();
 
+  ClearNativeObjectCache();
+
   // Release all objects.
-  for (uint32_t n = 0; n < table_capacity_; n++) {
-    ObjectTableEntry& entry = table_[n];
-    if (entry.object) {
-      entry.object->Release();
+  for (uint32_t n = 0; n < kMaxChunkCount; n++) {
+    ObjectTableEntry* chunk = chunks_[n].exchange(nullptr);
+    if (!chunk) {
+      continue;
+    }
+    for (uint32_t i = 0; i < kChunkSize; i++) {
+      XObject* object = chunk[i].object.load();
+      if (object) {
+        object->Release();
+      }
     }
+    delete[] chunk;
   }
 
-  table_capacity_ = 0;
-  last_free_entry_ = 0;
-  free(table_);
-  table_ = nullptr;
+  slot_count_ = 1;
+  free_slots_.clear();
+  for (auto& handle_count : handle_counts_) {
+    handle_count.store(0, std::memory_order_relaxed);
+  }
+}
+
+ObjectTable::ObjectTableEntry* ObjectTable::GetSlotEntry(uint32_t slot) const {
+  if (slot >= kMaxSlotCount) {
+    return nullptr;
+  }
+  ObjectTableEntry* chunk =
+      chunks_[slot >> kChunkSizeLog2].load(std::memory_order_acquire);
+  if (!chunk) {
+    return nullptr;
+  }
+  return &chunk[slot & (kChunkSize - 1)];
+}
+
+bool ObjectTable::EnsureSlotCount(uint32_t slot_count) {
+  if (slot_count > kMaxSlotCount) {
+    return false;
+  }
+  for (uint32_t n = 0; n < (slot_count + kChunkSize - 1) >> kChunkSizeLog2;
+       n++) {
+    if (!chunks_[n].load(std::memory_order_relaxed)) {
+      chunks_[n].store(new ObjectTableEntry[kChunkSize],
+                       std::memory_order_release);
+    }
+  }
+  return true;
 }
 
 X_STATUS ObjectTable::FindFreeSlot(uint32_t* out_slot) {
-  // Find a free slot.
-  uint32_t slot = last_free_entry_;
-  uint32_t scan_count = 0;
-  while (scan_count < table_capacity_) {
-    ObjectTableEntry& entry = table_[slot];
-    if (!entry.object) {
+  while (!free_slots_.empty()) {
+    uint32_t slot = free_slots_.front();
+    free_slots_.pop_front();
+    // May have been taken by a restored object since being released.
+    if (!GetSlotEntry(slot)->object.load(std::memory_order_relaxed)) {
       *out_slot = slot;
       return X_STATUS_SUCCESS;
     }
-    scan_count++;
-    slot = (slot + 1) % table_capacity_;
-    if (slot == 0) {
-      // Never allow 0 handles.
-      scan_count++;
-      slot++;
-    }
   }
 
-  // Table out of slots, expand.
-  uint32_t new_table_capacity = std::max(16 * 1024u, table_capacity_ * 2);
-  if (!Resize(new_table_capacity)) {
+  // Never allow 0 handles, which is why slot_count_ starts at 1.
+  if (!EnsureSlotCount(slot_count_ + 1)) {
     return X_STATUS_NO_MEMORY;
   }
-
-  // Never allow 0 handles.
-  slot = ++last_free_entry_;
-  *out_slot = slot;
-
+  *out_slot = slot_count_++;
   return X_STATUS_SUCCESS;
 }
 
-bool ObjectTable::Resize(uint32_t new_capacity) {
-  uint32_t new_size = new_capacity * sizeof(ObjectTableEntry);
-  uint32_t old_size = table_capacity_ * sizeof(ObjectTableEntry);
-  auto new_table =
-      reinterpret_cast<ObjectTableEntry*>(realloc(table_, new_size));
-  if (!new_table) {
-    return false;
+XObject* ObjectTable::ClearEntry(ObjectTableEntry& entry) {
+  XObject* object = entry.object.exchange(nullptr);
+  entry.handle_ref_count = 0;
+  // Lookups that have seen the object may be about to retain it.
+  while (entry.reader_count.load()) {
+    xe::threading::MaybeYield();
   }
-
-  // Zero out new entries.
-  if (new_size > old_size) {
-    std::memset(reinterpret_cast<uint8_t*>(new_table) + old_size, 0,
-                new_size - old_size);
+  if (object) {
+    handle_counts_[size_t(object->type())].fetch_sub(
+        1, std::memory_order_relaxed);
   }
-
-  last_free_entry_ = table_capacity_;
-  table_capacity_ = new_capacity;
-  table_ = new_table;
-
-  return true;
+  return object;
 }
 
 X_STATUS ObjectTable::AddHandle(XObject* object, X_HANDLE* out_handle) {
@@ -109,14 +128,16 @@ X_STATUS ObjectTable::AddHandle(XObject* object, X_HANDLE* out_handle) {
 
     // Stash.
     if (XSUCCEEDED(result)) {
-      ObjectTableEntry& entry = table_[slot];
-      entry.object = object;
+      ObjectTableEntry& entry = *GetSlotEntry(slot);
       entry.handle_ref_count = 1;
       handle = XObject::kHandleBase + (slot << 2);
       object->handles().push_back(handle);
 
       // Retain so long as the object is in the table.
       object->Retain();
+      entry.object.store(object);
+      handle_counts_[size_t(object->type())].fetch_add(
+          1, std::memory_order_relaxed);
 
       XELOGI("Added handle:{:08X} for {}", handle, typeid(*object).name());
     }
@@ -135,7 +156,7 @@ X_STATUS ObjectTable::DuplicateHandle(X_HANDLE handle, X_HANDLE* out_handle) {
   X_STATUS result = X_STATUS_SUCCESS;
   handle = TranslateHandle(handle);
 
-  XObject* object = LookupObject(handle, false);
+  XObject* object = LookupObject(handle);
   if (object) {
     result = AddHandle(object, out_handle);
     object->Release();  // Release the ref that LookupObject took
@@ -190,11 +211,11 @@ X_STATUS ObjectTable::RemoveHandle(X_HANDLE handle) {
   }
 
   auto global_lock = global_critical_region_.Acquire();
-  if (entry->object) {
-    auto object = entry->object;
-    entry->object = nullptr;
+  if (entry->object.load(std::memory_order_relaxed)) {
+    EvictNativeObject(handle);
     assert_zero(entry->handle_ref_count);
-    entry->handle_ref_count = 0;
+    auto object = ClearEntry(*entry);
+    free_slots_.push_back(GetHandleSlot(handle));
 
     // Walk the object's handles and remove this one.
     auto handle_entry =
@@ -220,12 +241,13 @@ std::vector<object_ref<XObject>> ObjectTable::GetAllObjects() {
   auto lock = global_critical_region_.Acquire();
   std::vector<object_ref<XObject>> results;
 
-  for (uint32_t slot = 0; slot < table_capacity_; slot++) {
-    auto& entry = table_[slot];
-    if (entry.object && std::find(results.begin(), results.end(),
-                                  entry.object) == results.end()) {
-      entry.object->Retain();
-      results.push_back(object_ref<XObject>(entry.object));
+  for (uint32_t slot = 1; slot < slot_count_; slot++) {
+    XObject* object =
+        GetSlotEntry(slot)->object.load(std::memory_order_relaxed);
+    if (object &&
+        std::find(results.begin(), results.end(), object) == results.end()) {
+      object->Retain();
+      results.push_back(object_ref<XObject>(object));
     }
   }
 
@@ -234,13 +256,13 @@ std::vector<object_ref<XObject>> ObjectTable::GetAllObjects() {
 
 void ObjectTable::PurgeAllObjects() {
   auto lock = global_critical_region_.Acquire();
-  for (uint32_t slot = 0; slot < table_capacity_; slot++) {
-    auto& entry = table_[slot];
-    if (entry.object && !entry.object->is_host_object()) {
-      entry.handle_ref_count = 0;
-      entry.object->Release();
-
-      entry.object = nullptr;
+  ClearNativeObjectCache();
+  for (uint32_t slot = 1; slot < slot_count_; slot++) {
+    auto& entry = *GetSlotEntry(slot);
+    XObject* object = entry.object.load(std::memory_order_relaxed);
+    if (object && !object->is_host_object()) {
+      ClearEntry(entry)->Release();
+      free_slots_.push_back(slot);
     }
   }
 }
@@ -251,68 +273,118 @@ ObjectTable::ObjectTableEntry* ObjectTable::LookupTable(X_HANDLE handle) {
     return nullptr;
   }
 
-  auto global_lock = global_critical_region_.Acquire();
-
   // Lower 2 bits are ignored.
-  uint32_t slot = GetHandleSlot(handle);
-  if (slot <= table_capacity_) {
-    return &table_[slot];
-  }
-
-  return nullptr;
+  return GetSlotEntry(GetHandleSlot(handle));
 }
 
 // Generic lookup
 template <>
 object_ref<XObject> ObjectTable::LookupObject<XObject>(X_HANDLE handle) {
-  auto object = ObjectTable::LookupObject(handle, false);
+  auto object = ObjectTable::LookupObject(handle);
   auto result = object_ref<XObject>(reinterpret_cast<XObject*>(object));
   return result;
 }
 
-XObject* ObjectTable::LookupObject(X_HANDLE handle, bool already_locked) {
-  handle = TranslateHandle(handle);
-  if (!handle) {
+XObject* ObjectTable::LookupObject(X_HANDLE handle) {
+  ObjectTableEntry* entry = LookupTable(handle);
+  if (!entry || !entry->object.load(std::memory_order_relaxed)) {
     return nullptr;
   }
 
-  XObject* object = nullptr;
-  if (!already_locked) {
-    global_critical_region_.mutex().lock();
+  // The object is read again after announcing the lookup, as it may have been
+  // removed and released in between.
+  entry->reader_count.fetch_add(1);
+  XObject* object = entry->object.load();
+  // Retain the object pointer.
+  if (object) {
+    object->Retain();
   }
+  entry->reader_count.fetch_sub(1);
 
-  // Lower 2 bits are ignored.
-  uint32_t slot = GetHandleSlot(handle);
+  return object;
+}
 
-  // Verify slot.
-  if (slot < table_capacity_) {
-    ObjectTableEntry& entry = table_[slot];
-    if (entry.object) {
-      object = entry.object;
+object_ref<XObject> ObjectTable::LookupNativeObject(uint32_t native_ptr,
+                                                    X_HANDLE handle) {
+  uint64_t key = uint64_t(native_ptr) << 32 | handle;
+  for (uint32_t i = 0; i < kNativeObjectCacheMaxProbes; ++i) {
+    NativeObjectCacheEntry& entry =
+        native_object_cache_[GetNativeObjectCacheSlot(native_ptr, i)];
+    if (entry.key.load(std::memory_order_relaxed) != key) {
+      continue;
+    }
+    // The key is checked again after announcing the lookup, as the object
+    // might have been evicted and released in between.
+    entry.reader_count.fetch_add(1);
+    XObject* object = nullptr;
+    if (entry.key.load() == key) {
+      object = entry.object.load();
+      if (object) {
+        object->Retain();
+      }
+    }
+    entry.reader_count.fetch_sub(1);
+    if (object) {
+      return object_ref<XObject>(object);
     }
   }
+  return nullptr;
+}
 
-  // Retain the object pointer.
-  if (object) {
+void ObjectTable::CacheNativeObject(uint32_t native_ptr, X_HANDLE handle,
+                                    XObject* object) {
+  auto global_lock = global_critical_region_.Acquire();
+  // The header may have been reinitialized for another object since.
+  EvictNativeObject(handle);
+  for (uint32_t i = 0; i < kNativeObjectCacheMaxProbes; ++i) {
+    uint32_t slot = GetNativeObjectCacheSlot(native_ptr, i);
+    NativeObjectCacheEntry& entry = native_object_cache_[slot];
+    if (entry.key.load(std::memory_order_relaxed)) {
+      continue;
+    }
     object->Retain();
+    entry.object.store(object);
+    entry.key.store(uint64_t(native_ptr) << 32 | handle);
+    native_object_cache_slots_.emplace(handle, slot);
+    return;
   }
+  // All the slots are taken - keep using the slow path for this object.
+}
 
-  if (!already_locked) {
-    global_critical_region_.mutex().unlock();
+void ObjectTable::EvictNativeObject(X_HANDLE handle) {
+  auto it = native_object_cache_slots_.find(handle);
+  if (it == native_object_cache_slots_.end()) {
+    return;
+  }
+  NativeObjectCacheEntry& entry = native_object_cache_[it->second];
+  native_object_cache_slots_.erase(it);
+  entry.key.store(0);
+  XObject* object = entry.object.exchange(nullptr);
+  // Lookups that have seen the old key may be about to retain the object.
+  while (entry.reader_count.load()) {
+    xe::threading::MaybeYield();
+  }
+  if (object) {
+    object->Release();
   }
+}
 
-  return object;
+void ObjectTable::ClearNativeObjectCache() {
+  while (!native_object_cache_slots_.empty()) {
+    EvictNativeObject(native_object_cache_slots_.begin()->first);
+  }
 }
 
 void ObjectTable::GetObjectsByType(XObject::Type type,
                                    std::vector<object_ref<XObject>>* results) {
   auto global_lock = global_critical_region_.Acquire();
-  for (uint32_t slot = 0; slot < table_capacity_; ++slot) {
-    auto& entry = table_[slot];
-    if (entry.object) {
-      if (entry.object->type() == type) {
-        entry.object->Retain();
-        results->push_back(object_ref<XObject>(entry.object));
+  for (uint32_t slot = 1; slot < slot_count_; ++slot) {
+    XObject* object =
+        GetSlotEntry(slot)->object.load(std::memory_order_relaxed);
+    if (object) {
+      if (object->type() == type) {
+        object->Retain();
+        results->push_back(object_ref<XObject>(object));
       }
     }
   }
@@ -362,7 +434,7 @@ X_STATUS ObjectTable::GetObjectByName(const std::string_view name,
   *out_handle = it->second;
 
   // We need to ref the handle. I think.
-  auto obj = LookupObject(it->second, true);
+  auto obj = LookupObject(it->second);
   if (obj) {
     obj->RetainHandle();
     obj->Release();
@@ -372,19 +444,27 @@ X_STATUS ObjectTable::GetObjectByName(const std::string_view name,
 }
 
 bool ObjectTable::Save(ByteStream* stream) {
-  stream->Write<uint32_t>(table_capacity_);
-  for (uint32_t i = 0; i < table_capacity_; i++) {
-    auto& entry = table_[i];
-    stream->Write<int32_t>(entry.handle_ref_count);
+  auto global_lock = global_critical_region_.Acquire();
+  stream->Write<uint32_t>(slot_count_);
+  // Slot 0 is never used, but is still stored for compatibility.
+  stream->Write<int32_t>(0);
+  for (uint32_t i = 1; i < slot_count_; i++) {
+    stream->Write<int32_t>(GetSlotEntry(i)->handle_ref_count);
   }
 
   return true;
 }
 
 bool ObjectTable::Restore(ByteStream* stream) {
-  Resize(stream->Read<uint32_t>());
-  for (uint32_t i = 0; i < table_capacity_; i++) {
-    auto& entry = table_[i];
+  auto global_lock = global_critical_region_.Acquire();
+  uint32_t slot_count = stream->Read<uint32_t>();
+  if (!EnsureSlotCount(slot_count)) {
+    return false;
+  }
+  slot_count_ = std::max(slot_count_, slot_count);
+  stream->Read<int32_t>();
+  for (uint32_t i = 1; i < slot_count; i++) {
+    auto& entry = *GetSlotEntry(i);
     // entry.object = nullptr;
     entry.handle_ref_count = stream->Read<int32_t>();
   }
@@ -393,13 +473,16 @@ bool ObjectTable::Restore(ByteStream* stream) {
 }
 
 X_STATUS ObjectTable::RestoreHandle(X_HANDLE handle, XObject* object) {
+  auto global_lock = global_critical_region_.Acquire();
   uint32_t slot = GetHandleSlot(handle);
-  assert_true(table_capacity_ >= slot);
+  assert_true(slot < slot_count_);
 
-  if (table_capacity_ >= slot) {
-    auto& entry = table_[slot];
-    entry.object = object;
+  if (slot && slot < slot_count_) {
+    auto& entry = *GetSlotEntry(slot);
     object->Retain();
+    entry.object.store(object);
+    handle_counts_[size_t(object->type())].fetch_add(
+        1, std::memory_order_relaxed);
   }
 
   return X_STATUS_SUCCESS;
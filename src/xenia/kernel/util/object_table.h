@@ -10,6 +10,9 @@
 #ifndef XENIA_KERNEL_UTIL_OBJECT_TABLE_H_
 #define XENIA_KERNEL_UTIL_OBJECT_TABLE_H_
 
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -49,7 +52,7 @@ class ObjectTable {
 
   template <typename T>
   object_ref<T> LookupObject(X_HANDLE handle) {
-    auto object = LookupObject(handle, false);
+    auto object = LookupObject(handle);
     if (object) {
       assert_true(object->type() == T::kObjectType);
     }
@@ -57,6 +60,16 @@ class ObjectTable {
     return result;
   }
 
+  // Looks up an object initialized from a guest dispatcher header (see
+  // XObject::GetNativeObject) without taking the global critical region. The
+  // handle is the one stashed in the header, so a header reinitialized for a
+  // different object will miss.
+  object_ref<XObject> LookupNativeObject(uint32_t native_ptr, X_HANDLE handle);
+  // Makes the object available to LookupNativeObject until its handle is
+  // removed from the table.
+  void CacheNativeObject(uint32_t native_ptr, X_HANDLE handle,
+                         XObject* object);
+
   X_STATUS AddNameMapping(const std::string_view name, X_HANDLE handle);
   void RemoveNameMapping(const std::string_view name);
   X_STATUS GetObjectByName(const std::string_view name, X_HANDLE* out_handle);
@@ -77,17 +90,64 @@ class ObjectTable {
     return results;
   }
 
+  // Number of handles to objects of the type currently in the table.
+  uint32_t GetHandleCount(XObject::Type type) const {
+    return handle_counts_[size_t(type)].load(std::memory_order_relaxed);
+  }
+
   std::vector<object_ref<XObject>> GetAllObjects();
   void PurgeAllObjects();  // Purges the object table of all guest objects
 
  private:
   struct ObjectTableEntry {
+    std::atomic<XObject*> object{nullptr};
+    // Lookups between reading the object and retaining it, waited for before
+    // the reference held by the table is released.
+    std::atomic<uint32_t> reader_count{0};
     int handle_ref_count = 0;
-    XObject* object = nullptr;
   };
 
+  // Entries are allocated in chunks that never move once created, so lookups
+  // can read them without the global critical region while the table grows.
+  // Everything that modifies the table still takes it.
+  static constexpr uint32_t kChunkSizeLog2 = 14;
+  static constexpr uint32_t kChunkSize = uint32_t(1) << kChunkSizeLog2;
+  static constexpr uint32_t kMaxSlotCount =
+      ((UINT32_MAX - XObject::kHandleBase) >> 2) + 1;
+  static constexpr uint32_t kMaxChunkCount = kMaxSlotCount / kChunkSize;
+  static constexpr size_t kObjectTypeCount = size_t(XObject::Type::Timer) + 1;
+
+  struct NativeObjectCacheEntry {
+    // native_ptr << 32 | handle, or 0 if the entry is free.
+    std::atomic<uint64_t> key{0};
+    // Holds a reference while in the cache.
+    std::atomic<XObject*> object{nullptr};
+    // Lookups between reading the key and retaining the object, waited for
+    // before the reference held by the cache is released.
+    std::atomic<uint32_t> reader_count{0};
+  };
+  static constexpr uint32_t kNativeObjectCacheSizeLog2 = 12;
+  static constexpr uint32_t kNativeObjectCacheSize =
+      uint32_t(1) << kNativeObjectCacheSizeLog2;
+  static constexpr uint32_t kNativeObjectCacheMaxProbes = 8;
+  static constexpr uint32_t GetNativeObjectCacheSlot(uint32_t native_ptr,
+                                                     uint32_t probe) {
+    return ((uint32_t(native_ptr * UINT32_C(0x9E3779B1)) >>
+             (32 - kNativeObjectCacheSizeLog2)) +
+            probe) &
+           (kNativeObjectCacheSize - 1);
+  }
+  // The global critical region must be held by the caller for these.
+  void EvictNativeObject(X_HANDLE handle);
+  void ClearNativeObjectCache();
+
   ObjectTableEntry* LookupTable(X_HANDLE handle);
-  XObject* LookupObject(X_HANDLE handle, bool already_locked);
+  ObjectTableEntry* GetSlotEntry(uint32_t slot) const;
+  XObject* LookupObject(X_HANDLE handle);
+  // Clears the entry, returning the object with the reference held by the
+  // table, once no lookup can retain it anymore.
+  XObject* ClearEntry(ObjectTableEntry& entry);
+  bool EnsureSlotCount(uint32_t slot_count);
   void GetObjectsByType(XObject::Type type,
                         std::vector<object_ref<XObject>>* results);
 
@@ -96,13 +156,19 @@ class ObjectTable {
     return (handle - XObject::kHandleBase) >> 2;
   }
   X_STATUS FindFreeSlot(uint32_t* out_slot);
-  bool Resize(uint32_t new_capacity);
 
   xe::global_critical_region global_critical_region_;
-  uint32_t table_capacity_ = 0;
-  ObjectTableEntry* table_ = nullptr;
-  uint32_t last_free_entry_ = 0;
+  std::unique_ptr<std::atomic<ObjectTableEntry*>[]> chunks_;
+  // Slots from 1 (0 is never a valid handle) to slot_count_ have been used.
+  uint32_t slot_count_ = 1;
+  // Released slots, reused in the order they were released so stale handles
+  // don't immediately refer to new objects.
+  std::deque<uint32_t> free_slots_;
+  std::atomic<uint32_t> handle_counts_[kObjectTypeCount] = {};
   std::unordered_map<string_key_case, X_HANDLE> name_table_;
+  std::unique_ptr<NativeObjectCacheEntry[]> native_object_cache_;
+  // Cache slots of the handles, for eviction.
+  std::unordered_map<X_HANDLE, uint32_t> native_object_cache_slots_;
 };
 
 // Generic lookup
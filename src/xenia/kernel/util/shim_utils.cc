@@ -17,6 +17,41 @@ thread_local StringBuffer string_buffer_;
 
 StringBuffer* thread_local_string_buffer() { return &string_buffer_; }
 
+bool ShouldLogKernelCalls(xe::cpu::ExportTag::type tags) {
+  if (!(tags & xe::cpu::ExportTag::kLog)) {
+    return false;
+  }
+  if ((tags & xe::cpu::ExportTag::kHighFrequency) &&
+      !cvars::log_high_frequency_kernel_calls) {
+    return false;
+  }
+  return xe::logging::ShouldLog((tags & xe::cpu::ExportTag::kImportant)
+                                    ? xe::LogLevel::Info
+                                    : xe::LogLevel::Debug);
+}
+
+void SelectExportTrampolines(const xe::cpu::ExportResolver* export_resolver) {
+  for (const auto& table : export_resolver->tables()) {
+    for (xe::cpu::Export* export_entry : table.exports_by_ordinal()) {
+      if (!export_entry ||
+          export_entry->type != xe::cpu::Export::Type::kFunction) {
+        continue;
+      }
+      auto& function_data = export_entry->function_data;
+      uint32_t variant = 0;
+      if (ShouldLogKernelCalls(export_entry->tags)) {
+        variant |= xe::cpu::ExportTrampolineVariant::kLog;
+      }
+      if (cvars::profile_kernel_calls) {
+        variant |= xe::cpu::ExportTrampolineVariant::kProfile;
+      }
+      if (function_data.trampoline_variants[variant]) {
+        function_data.trampoline = function_data.trampoline_variants[variant];
+      }
+    }
+  }
+}
+
 }  // namespace shim
 }  // namespace kernel
 }  // namespace xe
@@ -16,6 +16,7 @@
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/string_buffer.h"
@@ -514,11 +515,74 @@ void PrintKernelCall(cpu::Export* export_entry, const Tuple& params) {
   }
 }
 
+// Whether calls to an export with the tags are logged with the current logging
+// configuration.
+bool ShouldLogKernelCalls(xe::cpu::ExportTag::type tags);
+// Makes the exports with trampoline variants use the one for the current
+// logging and profiling configuration. Must be done before the trampolines are
+// bound to the imports.
+void SelectExportTrampolines(const xe::cpu::ExportResolver* export_resolver);
+
 template <typename F, typename Tuple, std::size_t... I>
 auto KernelTrampoline(F&& f, Tuple&& t, std::index_sequence<I...>) {
   return std::forward<F>(f)(std::get<I>(std::forward<Tuple>(t))...);
 }
 
+// The export and the function of each RegisterExport instantiation, with the
+// trampolines calling it.
+template <KernelModuleId MODULE, uint16_t ORDINAL, typename R, typename... Ps>
+struct ExportThunk {
+  static inline cpu::Export* export_entry = nullptr;
+  static inline R (*FN)(Ps&...) = nullptr;
+
+  template <uint32_t kVariant>
+  static void Trampoline(PPCContext* ppc_context) {
+    constexpr bool kLogCall =
+        (kVariant & cpu::ExportTrampolineVariant::kLog) != 0;
+    constexpr bool kProfileCall =
+        (kVariant & cpu::ExportTrampolineVariant::kProfile) != 0;
+    ++export_entry->function_data.call_count;
+    Param::Init init = {
+        ppc_context,
+        0,
+    };
+    // Using braces initializer instead of make_tuple because braces
+    // enforce execution order across compilers.
+    // The make_tuple order is undefined per the C++ standard and
+    // cause inconsitencies between msvc and clang.
+    std::tuple<Ps...> params = {Ps(init)...};
+    if constexpr (kLogCall) {
+      PrintKernelCall(export_entry, params);
+    }
+    uint64_t start_ticks = 0;
+    if constexpr (kProfileCall) {
+      start_ticks = Clock::QueryHostTickCount();
+    }
+    if constexpr (std::is_void<R>::value) {
+      KernelTrampoline(FN, std::forward<std::tuple<Ps...>>(params),
+                       std::make_index_sequence<sizeof...(Ps)>());
+    } else {
+      auto result =
+          KernelTrampoline(FN, std::forward<std::tuple<Ps...>>(params),
+                           std::make_index_sequence<sizeof...(Ps)>());
+      result.Store(ppc_context);
+      if constexpr (kLogCall) {
+        // TODO(benvanik): log result.
+      }
+    }
+    if constexpr (kProfileCall) {
+      export_entry->function_data.call_ticks +=
+          Clock::QueryHostTickCount() - start_ticks;
+    }
+  }
+
+  template <size_t... I>
+  static void SetTrampolineVariants(cpu::ExportTrampoline* variants,
+                                    std::index_sequence<I...>) {
+    ((variants[I] = &Trampoline<uint32_t(I)>), ...);
+  }
+};
+
 template <KernelModuleId MODULE, uint16_t ORDINAL, typename R, typename... Ps>
 xe::cpu::Export* RegisterExport(R (*fn)(Ps&...), const char* name,
                                 xe::cpu::ExportTag::type tags) {
@@ -527,43 +591,18 @@ xe::cpu::Export* RegisterExport(R (*fn)(Ps&...), const char* name,
       "R must be void or derive from shim::Result");
   static_assert((std::is_base_of_v<shim::Param, Ps> && ...),
                 "Ps must derive from shim::Param");
-  static const auto export_entry = new cpu::Export(
+  using Thunk = ExportThunk<MODULE, ORDINAL, R, Ps...>;
+  auto export_entry = new cpu::Export(
       ORDINAL, xe::cpu::Export::Type::kFunction, name,
       tags | xe::cpu::ExportTag::kImplemented | xe::cpu::ExportTag::kLog);
-  static R (*FN)(Ps & ...) = fn;
-  struct X {
-    static void Trampoline(PPCContext* ppc_context) {
-      ++export_entry->function_data.call_count;
-      Param::Init init = {
-          ppc_context,
-          0,
-      };
-      // Using braces initializer instead of make_tuple because braces
-      // enforce execution order across compilers.
-      // The make_tuple order is undefined per the C++ standard and
-      // cause inconsitencies between msvc and clang.
-      std::tuple<Ps...> params = {Ps(init)...};
-      if (export_entry->tags & xe::cpu::ExportTag::kLog &&
-          (!(export_entry->tags & xe::cpu::ExportTag::kHighFrequency) ||
-           cvars::log_high_frequency_kernel_calls)) {
-        PrintKernelCall(export_entry, params);
-      }
-      if constexpr (std::is_void<R>::value) {
-        KernelTrampoline(FN, std::forward<std::tuple<Ps...>>(params),
-                         std::make_index_sequence<sizeof...(Ps)>());
-      } else {
-        auto result =
-            KernelTrampoline(FN, std::forward<std::tuple<Ps...>>(params),
-                             std::make_index_sequence<sizeof...(Ps)>());
-        result.Store(ppc_context);
-        if (export_entry->tags &
-            (xe::cpu::ExportTag::kLog | xe::cpu::ExportTag::kLogResult)) {
-          // TODO(benvanik): log result.
-        }
-      }
-    }
-  };
-  export_entry->function_data.trampoline = &X::Trampoline;
+  Thunk::export_entry = export_entry;
+  Thunk::FN = fn;
+  Thunk::SetTrampolineVariants(
+      export_entry->function_data.trampoline_variants,
+      std::make_index_sequence<cpu::ExportTrampolineVariant::kCount>());
+  // Not logging until SelectExportTrampolines finds that the calls should be.
+  export_entry->function_data.trampoline =
+      export_entry->function_data.trampoline_variants[0];
   return export_entry;
 }
 
@@ -60,12 +60,18 @@ XdbfBlock XdbfWrapper::GetEntry(XdbfSection section, uint64_t id) const {
   return {0};
 }
 
-std::string XdbfWrapper::GetStringTableEntry(XLanguage language,
-                                             uint16_t string_id) const {
+const XdbfWrapper::StringTable& XdbfWrapper::GetStringTable(
+    XLanguage language) const {
+  auto [it, inserted] = string_tables_.try_emplace(uint32_t(language));
+  StringTable& string_table = it->second;
+  if (!inserted) {
+    return string_table;
+  }
+
   auto language_block =
       GetEntry(XdbfSection::kStringTable, static_cast<uint64_t>(language));
   if (!language_block) {
-    return "";
+    return string_table;
   }
 
   auto xstr_head =
@@ -74,20 +80,43 @@ std::string XdbfWrapper::GetStringTableEntry(XLanguage language,
   assert_true(xstr_head->version == 1);
 
   const uint8_t* ptr = language_block.buffer + sizeof(XdbfSectionHeader);
+  string_table.reserve(xstr_head->count);
   for (uint16_t i = 0; i < xstr_head->count; ++i) {
     auto entry = reinterpret_cast<const XdbfStringTableEntry*>(ptr);
     ptr += sizeof(XdbfStringTableEntry);
-    if (entry->id == string_id) {
-      return std::string(reinterpret_cast<const char*>(ptr),
-                         entry->string_length);
-    }
+    // The first of the entries with the same ID is used.
+    string_table.try_emplace(
+        entry->id, reinterpret_cast<const char*>(ptr), entry->string_length);
     ptr += entry->string_length;
   }
-  return "";
+  return string_table;
+}
+
+std::string XdbfWrapper::GetStringTableEntry(XLanguage language,
+                                             uint16_t string_id) const {
+  if (!is_valid()) {
+    return "";
+  }
+  std::lock_guard<std::mutex> lock(decode_mutex_);
+  const StringTable& string_table = GetStringTable(language);
+  auto it = string_table.find(string_id);
+  if (it == string_table.end()) {
+    return "";
+  }
+  return std::string(it->second);
 }
 
-std::vector<XdbfAchievementTableEntry> XdbfWrapper::GetAchievements() const {
-  std::vector<XdbfAchievementTableEntry> achievements;
+const std::vector<XdbfAchievementTableEntry>& XdbfWrapper::GetAchievements()
+    const {
+  std::lock_guard<std::mutex> lock(decode_mutex_);
+  if (achievements_) {
+    return *achievements_;
+  }
+  std::vector<XdbfAchievementTableEntry>& achievements =
+      achievements_.emplace();
+  if (!is_valid()) {
+    return achievements;
+  }
 
   auto achievement_table = GetEntry(XdbfSection::kMetadata, kXdbfIdXach);
   if (!achievement_table) {
@@ -100,13 +129,13 @@ std::vector<XdbfAchievementTableEntry> XdbfWrapper::GetAchievements() const {
   assert_true(xach_head->version == 1);
 
   const uint8_t* ptr = achievement_table.buffer + sizeof(XdbfSectionHeader);
+  achievements.reserve(xach_head->count);
   for (uint16_t i = 0; i < xach_head->count; ++i) {
     auto entry = reinterpret_cast<const XdbfAchievementTableEntry*>(ptr);
     ptr += sizeof(XdbfAchievementTableEntry);
     achievements.push_back(*entry);
   }
   return achievements;
-
 }
 
 XLanguage XdbfGameData::GetExistingLanguage(XLanguage language_to_check) const {
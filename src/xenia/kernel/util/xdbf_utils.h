@@ -10,7 +10,11 @@
 #ifndef XENIA_KERNEL_UTIL_XDBF_UTILS_H_
 #define XENIA_KERNEL_UTIL_XDBF_UTILS_H_
 
+#include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include "xenia/base/memory.h"
@@ -102,9 +106,13 @@ struct XdbfBlock {
 
 // Wraps an XBDF (XboxDataBaseFormat) in-memory database.
 // https://free60project.github.io/wiki/XDBF.html
+// The string tables and the achievements are decoded once on the first query,
+// referencing the strings in the wrapped memory, which must stay valid.
 class XdbfWrapper {
  public:
   XdbfWrapper(const uint8_t* data, size_t data_size);
+  XdbfWrapper(const XdbfWrapper&) = delete;
+  XdbfWrapper& operator=(const XdbfWrapper&) = delete;
 
   // True if the target memory contains a valid XDBF instance.
   bool is_valid() const { return data_ != nullptr; }
@@ -116,9 +124,13 @@ class XdbfWrapper {
   // Gets a string from the string table in the given language.
   // Returns the empty string if the entry is not found.
   std::string GetStringTableEntry(XLanguage language, uint16_t string_id) const;
-  std::vector<XdbfAchievementTableEntry> GetAchievements() const;
+  const std::vector<XdbfAchievementTableEntry>& GetAchievements() const;
 
  private:
+  using StringTable = std::unordered_map<uint16_t, std::string_view>;
+  // Must be called with decode_mutex_ held.
+  const StringTable& GetStringTable(XLanguage language) const;
+
   const uint8_t* data_ = nullptr;
   size_t data_size_ = 0;
   const uint8_t* content_offset_ = nullptr;
@@ -126,6 +138,10 @@ class XdbfWrapper {
   const XbdfHeader* header_ = nullptr;
   const XbdfEntry* entries_ = nullptr;
   const XbdfFileLoc* files_ = nullptr;
+
+  mutable std::mutex decode_mutex_;
+  mutable std::unordered_map<uint32_t, StringTable> string_tables_;
+  mutable std::optional<std::vector<XdbfAchievementTableEntry>> achievements_;
 };
 
 class XdbfGameData : public XdbfWrapper {
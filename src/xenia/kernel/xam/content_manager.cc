@@ -89,17 +89,12 @@ std::vector<XCONTENT_AGGREGATE_DATA> ContentManager::ListContent(
   // Search path:
   // content_root/title_id/type_name/*
   auto package_root = ResolvePackageRoot(content_type, title_id);
-  auto file_infos = xe::filesystem::ListFiles(package_root);
-  for (const auto& file_info : file_infos) {
-    if (file_info.type != xe::filesystem::FileInfo::Type::kDirectory) {
-      // Directories only.
-      continue;
-    }
+  for (const auto& package_name : ListPackageNames(package_root)) {
     XCONTENT_AGGREGATE_DATA content_data;
     content_data.device_id = device_id;
     content_data.content_type = content_type;
-    content_data.set_display_name(xe::path_to_utf16(file_info.name));
-    content_data.set_file_name(xe::path_to_utf8(file_info.name));
+    content_data.set_display_name(xe::path_to_utf16(package_name));
+    content_data.set_file_name(xe::path_to_utf8(package_name));
     content_data.title_id = title_id;
     result.emplace_back(std::move(content_data));
   }
@@ -107,6 +102,45 @@ std::vector<XCONTENT_AGGREGATE_DATA> ContentManager::ListContent(
   return result;
 }
 
+std::vector<std::filesystem::path> ContentManager::ListPackageNames(
+    const std::filesystem::path& package_root) {
+  std::error_code error_code;
+  auto write_time = std::filesystem::last_write_time(package_root, error_code);
+  if (error_code) {
+    // Usually there's no content of the type for the title.
+    InvalidatePackageRootIndex(package_root);
+    return {};
+  }
+  {
+    std::lock_guard<std::mutex> lock(package_root_index_mutex_);
+    auto it = package_root_index_.find(package_root.native());
+    if (it != package_root_index_.cend() &&
+        it->second.write_time == write_time) {
+      return it->second.package_names;
+    }
+  }
+
+  PackageRootIndex index;
+  index.write_time = write_time;
+  for (const auto& file_info : xe::filesystem::ListFiles(package_root)) {
+    if (file_info.type != xe::filesystem::FileInfo::Type::kDirectory) {
+      // Directories only.
+      continue;
+    }
+    index.package_names.push_back(file_info.name);
+  }
+  std::lock_guard<std::mutex> lock(package_root_index_mutex_);
+  return package_root_index_.insert_or_assign(package_root.native(),
+                                              std::move(index))
+      .first->second.package_names;
+}
+
+void ContentManager::InvalidatePackageRootIndex(
+    const std::filesystem::path& package_root) {
+  std::lock_guard<std::mutex> lock(package_root_index_mutex_);
+  package_root_index_.erase(package_root.native());
+}
+
 std::unique_ptr<ContentPackage> ContentManager::ResolvePackage(
     const std::string_view root_name, const XCONTENT_AGGREGATE_DATA& data) {
   auto package_path = ResolvePackagePath(data);
@@ -148,6 +182,9 @@ X_RESULT ContentManager::CreateContent(const std::string_view root_name,
       return X_ERROR_ACCESS_DENIED;
     }
   }
+  // In case the modification time of the root doesn't change, such as when
+  // it has a coarse resolution.
+  InvalidatePackageRootIndex(package_path.parent_path());
 
   auto package = ResolvePackage(root_name, data);
   assert_not_null(package);
@@ -221,6 +258,7 @@ X_RESULT ContentManager::SetContentThumbnail(
   auto global_lock = global_critical_region_.Acquire();
   auto package_path = ResolvePackagePath(data);
   std::filesystem::create_directories(package_path);
+  InvalidatePackageRootIndex(package_path.parent_path());
   if (std::filesystem::exists(package_path)) {
     auto thumb_path = package_path / kThumbnailFileName;
     auto file = xe::filesystem::OpenFile(thumb_path, "wb");
@@ -241,6 +279,7 @@ X_RESULT ContentManager::DeleteContent(const XCONTENT_AGGREGATE_DATA& data) {
   }
 
   auto package_path = ResolvePackagePath(data);
+  InvalidatePackageRootIndex(package_path.parent_path());
   if (std::filesystem::remove_all(package_path) > 0) {
     return X_ERROR_SUCCESS;
   } else {
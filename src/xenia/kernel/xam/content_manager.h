@@ -10,7 +10,9 @@
 #ifndef XENIA_KERNEL_XAM_CONTENT_MANAGER_H_
 #define XENIA_KERNEL_XAM_CONTENT_MANAGER_H_
 
+#include <filesystem>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -164,16 +166,33 @@ class ContentManager {
   void CloseOpenedFilesFromContent(const std::string_view root_name);
 
  private:
+  // Packages found in a package root directory, reused while the directory
+  // isn't modified.
+  struct PackageRootIndex {
+    std::filesystem::file_time_type write_time;
+    std::vector<std::filesystem::path> package_names;
+  };
+
   std::filesystem::path ResolvePackageRoot(XContentType content_type,
                                            uint32_t title_id = -1);
   std::filesystem::path ResolvePackagePath(const XCONTENT_AGGREGATE_DATA& data);
 
+  std::vector<std::filesystem::path> ListPackageNames(
+      const std::filesystem::path& package_root);
+  void InvalidatePackageRootIndex(const std::filesystem::path& package_root);
+
   KernelState* kernel_state_;
   std::filesystem::path root_path_;
 
   // TODO(benvanik): remove use of global lock, it's bad here!
   xe::global_critical_region global_critical_region_;
   std::unordered_map<string_key, ContentPackage*> open_packages_;
+
+  // Titles enumerate the same package roots repeatedly, often for several
+  // content types and alternate title IDs at startup.
+  std::mutex package_root_index_mutex_;
+  std::unordered_map<std::filesystem::path::string_type, PackageRootIndex>
+      package_root_index_;
 };
 
 }  // namespace xam
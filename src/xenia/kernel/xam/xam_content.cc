@@ -315,14 +315,16 @@ DECLARE_XAM_EXPORT1(XamContentFlush, kContent, kImplemented);
 dword_result_t XamContentClose_entry(lpstring_t root_name,
                                      lpunknown_t overlapped_ptr) {
   // Closes a previously opened root from XamContentCreate*.
-  auto result =
-      kernel_state()->content_manager()->CloseContent(root_name.value());
+  auto run = [content_manager = kernel_state()->content_manager(),
+              root_name = root_name.value()]() -> X_RESULT {
+    return content_manager->CloseContent(root_name);
+  };
 
-  if (overlapped_ptr) {
-    kernel_state()->CompleteOverlappedImmediate(overlapped_ptr, result);
-    return X_ERROR_IO_PENDING;
+  if (!overlapped_ptr) {
+    return run();
   } else {
-    return result;
+    kernel_state()->CompleteOverlappedDeferred(run, overlapped_ptr);
+    return X_ERROR_IO_PENDING;
   }
 }
 DECLARE_XAM_EXPORT1(XamContentClose, kContent, kImplemented);
@@ -332,14 +334,12 @@ dword_result_t XamContentGetCreator_entry(dword_t user_index,
                                           lpdword_t is_creator_ptr,
                                           lpqword_t creator_xuid_ptr,
                                           lpunknown_t overlapped_ptr) {
-  auto result = X_ERROR_SUCCESS;
-
   XCONTENT_AGGREGATE_DATA content_data = *content_data_ptr.as<XCONTENT_DATA*>();
 
-  bool content_exists =
-      kernel_state()->content_manager()->ContentExists(content_data);
-
-  if (content_exists) {
+  auto run = [content_data, is_creator_ptr, creator_xuid_ptr]() -> X_RESULT {
+    if (!kernel_state()->content_manager()->ContentExists(content_data)) {
+      return X_ERROR_PATH_NOT_FOUND;
+    }
     if (content_data.content_type == XContentType::kSavedGame) {
       // User always creates saves.
       *is_creator_ptr = 1;
@@ -352,15 +352,14 @@ dword_result_t XamContentGetCreator_entry(dword_t user_index,
         *creator_xuid_ptr = 0;
       }
     }
-  } else {
-    result = X_ERROR_PATH_NOT_FOUND;
-  }
+    return X_ERROR_SUCCESS;
+  };
 
-  if (overlapped_ptr) {
-    kernel_state()->CompleteOverlappedImmediate(overlapped_ptr, result);
-    return X_ERROR_IO_PENDING;
+  if (!overlapped_ptr) {
+    return run();
   } else {
-    return result;
+    kernel_state()->CompleteOverlappedDeferred(run, overlapped_ptr);
+    return X_ERROR_IO_PENDING;
   }
 }
 DECLARE_XAM_EXPORT1(XamContentGetCreator, kContent, kImplemented);
@@ -374,32 +373,36 @@ dword_result_t XamContentGetThumbnail_entry(dword_t user_index,
   uint32_t buffer_size = *buffer_size_ptr;
   XCONTENT_AGGREGATE_DATA content_data = *content_data_ptr.as<XCONTENT_DATA*>();
 
-  // Get thumbnail (if it exists).
-  std::vector<uint8_t> buffer;
-  auto result = kernel_state()->content_manager()->GetContentThumbnail(
-      content_data, &buffer);
-
-  *buffer_size_ptr = uint32_t(buffer.size());
-
-  if (XSUCCEEDED(result)) {
-    // Write data, if we were given a pointer.
-    // This may have just been a size query.
-    if (buffer_ptr) {
-      if (buffer_size < buffer.size()) {
-        // Dest buffer too small.
-        result = X_ERROR_INSUFFICIENT_BUFFER;
-      } else {
-        // Copy data.
-        std::memcpy((uint8_t*)buffer_ptr, buffer.data(), buffer.size());
+  auto run = [content_data, buffer_ptr, buffer_size,
+              buffer_size_ptr]() -> X_RESULT {
+    // Get thumbnail (if it exists).
+    std::vector<uint8_t> buffer;
+    auto result = kernel_state()->content_manager()->GetContentThumbnail(
+        content_data, &buffer);
+
+    *buffer_size_ptr = uint32_t(buffer.size());
+
+    if (XSUCCEEDED(result)) {
+      // Write data, if we were given a pointer.
+      // This may have just been a size query.
+      if (buffer_ptr) {
+        if (buffer_size < buffer.size()) {
+          // Dest buffer too small.
+          result = X_ERROR_INSUFFICIENT_BUFFER;
+        } else {
+          // Copy data.
+          std::memcpy((uint8_t*)buffer_ptr, buffer.data(), buffer.size());
+        }
       }
     }
-  }
+    return result;
+  };
 
-  if (overlapped_ptr) {
-    kernel_state()->CompleteOverlappedImmediate(overlapped_ptr, result);
-    return X_ERROR_IO_PENDING;
+  if (!overlapped_ptr) {
+    return run();
   } else {
-    return result;
+    kernel_state()->CompleteOverlappedDeferred(run, overlapped_ptr);
+    return X_ERROR_IO_PENDING;
   }
 }
 DECLARE_XAM_EXPORT1(XamContentGetThumbnail, kContent, kImplemented);
@@ -414,14 +417,16 @@ dword_result_t XamContentSetThumbnail_entry(dword_t user_index,
   // Buffer is PNG data.
   auto buffer = std::vector<uint8_t>((uint8_t*)buffer_ptr,
                                      (uint8_t*)buffer_ptr + buffer_size);
-  auto result = kernel_state()->content_manager()->SetContentThumbnail(
-      content_data, std::move(buffer));
+  auto run = [content_data, buffer = std::move(buffer)]() -> X_RESULT {
+    return kernel_state()->content_manager()->SetContentThumbnail(content_data,
+                                                                  buffer);
+  };
 
-  if (overlapped_ptr) {
-    kernel_state()->CompleteOverlappedImmediate(overlapped_ptr, result);
-    return X_ERROR_IO_PENDING;
+  if (!overlapped_ptr) {
+    return run();
   } else {
-    return result;
+    kernel_state()->CompleteOverlappedDeferred(run, overlapped_ptr);
+    return X_ERROR_IO_PENDING;
   }
 }
 DECLARE_XAM_EXPORT1(XamContentSetThumbnail, kContent, kImplemented);
@@ -431,13 +436,15 @@ dword_result_t XamContentDelete_entry(dword_t user_index,
                                       lpunknown_t overlapped_ptr) {
   XCONTENT_AGGREGATE_DATA content_data = *content_data_ptr.as<XCONTENT_DATA*>();
 
-  auto result = kernel_state()->content_manager()->DeleteContent(content_data);
+  auto run = [content_data]() -> X_RESULT {
+    return kernel_state()->content_manager()->DeleteContent(content_data);
+  };
 
-  if (overlapped_ptr) {
-    kernel_state()->CompleteOverlappedImmediate(overlapped_ptr, result);
-    return X_ERROR_IO_PENDING;
+  if (!overlapped_ptr) {
+    return run();
   } else {
-    return result;
+    kernel_state()->CompleteOverlappedDeferred(run, overlapped_ptr);
+    return X_ERROR_IO_PENDING;
   }
 }
 DECLARE_XAM_EXPORT1(XamContentDelete, kContent, kImplemented);
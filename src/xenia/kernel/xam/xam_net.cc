@@ -31,6 +31,7 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <poll.h>
 #include <sys/socket.h>
 #endif
 
@@ -98,24 +99,6 @@ struct X_WSADATA {
   xe::be<uint32_t> vendor_info_ptr;
 };
 
-struct XWSABUF {
-  xe::be<uint32_t> len;
-  xe::be<uint32_t> buf_ptr;
-};
-
-struct XWSAOVERLAPPED {
-  xe::be<uint32_t> internal;
-  xe::be<uint32_t> internal_high;
-  union {
-    struct {
-      xe::be<uint32_t> low;
-      xe::be<uint32_t> high;
-    } offset;  // must be named to avoid GCC error
-    xe::be<uint32_t> pointer;
-  };
-  xe::be<uint32_t> event_handle;
-};
-
 void LoadSockaddr(const uint8_t* ptr, sockaddr* out_addr) {
   out_addr->sa_family = xe::load_and_swap<uint16_t>(ptr + 0);
   switch (out_addr->sa_family) {
@@ -299,25 +282,172 @@ dword_result_t NetDll_WSAGetLastError_entry() {
 }
 DECLARE_XAM_EXPORT1(NetDll_WSAGetLastError, kNetworking, kImplemented);
 
+// Overlapped receives are completed by the socket event loop, the
+// non-overlapped ones block like recvfrom.
+int32_t RecvFromSocket(uint32_t socket_handle, const XWSABUF* buffers,
+                       uint32_t buffer_count, xe::be<uint32_t>* num_bytes_recv,
+                       xe::be<uint32_t>* flags_ptr, XSOCKADDR_IN* from_ptr,
+                       xe::be<uint32_t>* fromlen_ptr,
+                       uint32_t overlapped_ptr) {
+  auto socket =
+      kernel_state()->object_table()->LookupObject<XSocket>(socket_handle);
+  if (!socket) {
+    // WSAENOTSOCK
+    XThread::SetLastError(0x2736);
+    return -1;
+  }
+
+  uint32_t flags = flags_ptr ? uint32_t(*flags_ptr) : 0;
+  if (overlapped_ptr) {
+    uint32_t num_bytes = 0;
+    uint32_t error = socket->RecvFromOverlapped(buffers, buffer_count, flags,
+                                                from_ptr, fromlen_ptr,
+                                                overlapped_ptr, &num_bytes);
+    if (error) {
+      XThread::SetLastError(error);
+      return -1;
+    }
+    if (num_bytes_recv) {
+      *num_bytes_recv = num_bytes;
+    }
+    if (flags_ptr) {
+      *flags_ptr = 0;
+    }
+    return 0;
+  }
+
+  // Our sockets implementation doesn't support multiple buffers, so receiving
+  // into a combined one.
+  std::vector<uint8_t> combined_buffer_mem;
+  uint32_t combined_buffer_size = 0;
+  for (uint32_t i = 0; i < buffer_count; i++) {
+    combined_buffer_size += buffers[i].len;
+  }
+  combined_buffer_mem.resize(combined_buffer_size);
+
+  N_XSOCKADDR_IN native_from;
+  if (from_ptr) {
+    native_from = *from_ptr;
+  }
+  uint32_t native_fromlen = fromlen_ptr ? uint32_t(*fromlen_ptr) : 0;
+  int ret = socket->RecvFrom(combined_buffer_mem.data(), combined_buffer_size,
+                             flags, &native_from,
+                             fromlen_ptr ? &native_fromlen : nullptr);
+  if (ret == -1) {
+#ifdef XE_PLATFORM_WIN32
+    uint32_t error_code = WSAGetLastError();
+    XThread::SetLastError(error_code);
+#else
+    XThread::SetLastError(0x0);
+#endif
+    return -1;
+  }
+
+  uint32_t combined_buffer_offset = 0;
+  for (uint32_t i = 0;
+       i < buffer_count && combined_buffer_offset < uint32_t(ret); i++) {
+    uint32_t copy_length =
+        std::min(uint32_t(buffers[i].len), ret - combined_buffer_offset);
+    std::memcpy(kernel_memory()->TranslateVirtual(buffers[i].buf_ptr),
+                combined_buffer_mem.data() + combined_buffer_offset,
+                copy_length);
+    combined_buffer_offset += copy_length;
+  }
+  if (from_ptr) {
+    from_ptr->sin_family = native_from.sin_family;
+    from_ptr->sin_port = native_from.sin_port;
+    from_ptr->sin_addr = native_from.sin_addr;
+    std::memset(from_ptr->x_sin_zero, 0, sizeof(from_ptr->x_sin_zero));
+  }
+  if (fromlen_ptr) {
+    *fromlen_ptr = native_fromlen;
+  }
+  if (num_bytes_recv) {
+    *num_bytes_recv = uint32_t(ret);
+  }
+  if (flags_ptr) {
+    *flags_ptr = 0;
+  }
+  return 0;
+}
+
 dword_result_t NetDll_WSARecvFrom_entry(
-    dword_t caller, dword_t socket, pointer_t<XWSABUF> buffers_ptr,
+    dword_t caller, dword_t socket_handle, pointer_t<XWSABUF> buffers_ptr,
     dword_t buffer_count, lpdword_t num_bytes_recv, lpdword_t flags_ptr,
-    pointer_t<XSOCKADDR_IN> from_addr, pointer_t<XWSAOVERLAPPED> overlapped_ptr,
-    lpvoid_t completion_routine_ptr) {
-  if (overlapped_ptr) {
-    // auto evt = kernel_state()->object_table()->LookupObject<XEvent>(
-    //    overlapped_ptr->event_handle);
+    pointer_t<XSOCKADDR_IN> from_ptr, lpdword_t fromlen_ptr,
+    pointer_t<XWSAOVERLAPPED> overlapped_ptr, lpvoid_t completion_routine_ptr) {
+  assert(!completion_routine_ptr);
+  return RecvFromSocket(socket_handle, buffers_ptr, buffer_count,
+                        num_bytes_recv, flags_ptr, from_ptr, fromlen_ptr,
+                        overlapped_ptr.guest_address());
+}
+DECLARE_XAM_EXPORT2(NetDll_WSARecvFrom, kNetworking, kImplemented,
+                    kHighFrequency);
+
+dword_result_t NetDll_WSARecv_entry(dword_t caller, dword_t socket_handle,
+                                    pointer_t<XWSABUF> buffers_ptr,
+                                    dword_t buffer_count,
+                                    lpdword_t num_bytes_recv,
+                                    lpdword_t flags_ptr,
+                                    pointer_t<XWSAOVERLAPPED> overlapped_ptr,
+                                    lpvoid_t completion_routine_ptr) {
+  assert(!completion_routine_ptr);
+  return RecvFromSocket(socket_handle, buffers_ptr, buffer_count,
+                        num_bytes_recv, flags_ptr, nullptr, nullptr,
+                        overlapped_ptr.guest_address());
+}
+DECLARE_XAM_EXPORT2(NetDll_WSARecv, kNetworking, kImplemented,
+                    kHighFrequency);
+
+dword_result_t NetDll_WSAGetOverlappedResult_entry(
+    dword_t caller, dword_t socket_handle,
+    pointer_t<XWSAOVERLAPPED> overlapped_ptr, lpdword_t bytes_transferred,
+    dword_t wait, lpdword_t flags_ptr) {
+  if (!overlapped_ptr) {
+    XThread::SetLastError(X_WSAEINVAL);
+    return 0;
+  }
+
+  if (overlapped_ptr->internal == X_STATUS_PENDING) {
+    auto event = kernel_state()->object_table()->LookupObject<XEvent>(
+        overlapped_ptr->event_handle);
+    if (!wait || !event) {
+      XThread::SetLastError(X_WSA_IO_INCOMPLETE);
+      return 0;
+    }
+    event->Wait(0, 0, false, nullptr);
+  }
+
+  if (bytes_transferred) {
+    *bytes_transferred = overlapped_ptr->internal_high;
+  }
+  if (flags_ptr) {
+    *flags_ptr = 0;
+  }
+  uint32_t error = overlapped_ptr->internal;
+  if (error) {
+    XThread::SetLastError(error);
+    return 0;
+  }
+  return 1;
+}
+DECLARE_XAM_EXPORT2(NetDll_WSAGetOverlappedResult, kNetworking, kImplemented,
+                    kHighFrequency);
 
-    // if (evt) {
-    //  //evt->Set(0, false);
-    //}
+dword_result_t NetDll_WSACancelOverlappedIO_entry(dword_t caller,
+                                                  dword_t socket_handle) {
+  auto socket =
+      kernel_state()->object_table()->LookupObject<XSocket>(socket_handle);
+  if (!socket) {
+    // WSAENOTSOCK
+    XThread::SetLastError(0x2736);
+    return -1;
   }
 
-  // we're not going to be receiving packets any time soon
-  // return error so we don't wait on that - Cancerous
-  return -1;
+  socket->CancelOverlappedReceives();
+  return 0;
 }
-DECLARE_XAM_EXPORT2(NetDll_WSARecvFrom, kNetworking, kStub, kHighFrequency);
+DECLARE_XAM_EXPORT1(NetDll_WSACancelOverlappedIO, kNetworking, kImplemented);
 
 // If the socket is a VDP socket, buffer 0 is the game data length, and buffer 1
 // is the unencrypted game data.
@@ -924,6 +1054,15 @@ dword_result_t NetDll_accept_entry(dword_t caller, dword_t socket_handle,
 }
 DECLARE_XAM_EXPORT1(NetDll_accept, kNetworking, kImplemented);
 
+#ifdef XE_PLATFORM_WIN32
+typedef WSAPOLLFD host_pollfd;
+typedef ULONG nfds_t;
+#define host_poll WSAPoll
+#else
+typedef pollfd host_pollfd;
+#define host_poll poll
+#endif
+
 struct x_fd_set {
   xe::be<uint32_t> fd_count;
   xe::be<uint32_t> fd_array[64];
@@ -958,18 +1097,21 @@ struct host_set {
     }
   }
 
-  void Store(fd_set* native_set) {
-    FD_ZERO(native_set);
+  void Store(std::vector<host_pollfd>* native_fds, short events) {
     for (uint32_t i = 0; i < this->count; ++i) {
-      FD_SET(this->sockets[i]->native_handle(), native_set);
+      host_pollfd native_fd = {};
+      native_fd.fd = decltype(native_fd.fd)(this->sockets[i]->native_handle());
+      native_fd.events = events;
+      native_fds->push_back(native_fd);
     }
   }
 
-  void UpdateFrom(fd_set* native_set) {
+  // The native fds are the ones appended by Store, starting at the first.
+  void UpdateFrom(const host_pollfd* native_fds, short ready_events) {
     uint32_t new_count = 0;
     for (uint32_t i = 0; i < this->count; ++i) {
       auto socket = this->sockets[i];
-      if (FD_ISSET(socket->native_handle(), native_set)) {
+      if (native_fds[i].revents & ready_events) {
         this->sockets[new_count++] = socket;
       }
     }
@@ -977,57 +1119,86 @@ struct host_set {
   }
 };
 
+// poll instead of select, which on POSIX is limited to descriptors below
+// FD_SETSIZE regardless of how many are in the sets.
+#ifdef XE_PLATFORM_WIN32
+constexpr short kSelectReadEvents = POLLRDNORM;
+constexpr short kSelectReadReadyEvents = POLLRDNORM | POLLHUP | POLLERR;
+constexpr short kSelectWriteEvents = POLLWRNORM;
+constexpr short kSelectWriteReadyEvents = POLLWRNORM | POLLHUP | POLLERR;
+// WSAPoll doesn't support POLLPRI, and the exception set of select on Windows
+// reports failed connection attempts.
+constexpr short kSelectExceptEvents = 0;
+constexpr short kSelectExceptReadyEvents = POLLERR;
+#else
+constexpr short kSelectReadEvents = POLLIN;
+constexpr short kSelectReadReadyEvents = POLLIN | POLLHUP | POLLERR;
+constexpr short kSelectWriteEvents = POLLOUT;
+constexpr short kSelectWriteReadyEvents = POLLOUT | POLLHUP | POLLERR;
+constexpr short kSelectExceptEvents = POLLPRI;
+constexpr short kSelectExceptReadyEvents = POLLPRI;
+#endif
+
 int_result_t NetDll_select_entry(int_t caller, int_t nfds,
                                  pointer_t<x_fd_set> readfds,
                                  pointer_t<x_fd_set> writefds,
                                  pointer_t<x_fd_set> exceptfds,
                                  lpvoid_t timeout_ptr) {
+  std::vector<host_pollfd> native_fds;
   host_set host_readfds = {0};
-  fd_set native_readfds = {0};
   if (readfds) {
     host_readfds.Load(readfds);
-    host_readfds.Store(&native_readfds);
+    host_readfds.Store(&native_fds, kSelectReadEvents);
   }
+  size_t native_writefds_offset = native_fds.size();
   host_set host_writefds = {0};
-  fd_set native_writefds = {0};
   if (writefds) {
     host_writefds.Load(writefds);
-    host_writefds.Store(&native_writefds);
+    host_writefds.Store(&native_fds, kSelectWriteEvents);
   }
+  size_t native_exceptfds_offset = native_fds.size();
   host_set host_exceptfds = {0};
-  fd_set native_exceptfds = {0};
   if (exceptfds) {
     host_exceptfds.Load(exceptfds);
-    host_exceptfds.Store(&native_exceptfds);
+    host_exceptfds.Store(&native_fds, kSelectExceptEvents);
   }
-  timeval* timeout_in = nullptr;
-  timeval timeout;
+  int timeout_ms = -1;
   if (timeout_ptr) {
-    timeout = {static_cast<int32_t>(timeout_ptr.as_array<int32_t>()[0]),
-               static_cast<int32_t>(timeout_ptr.as_array<int32_t>()[1])};
-    Clock::ScaleGuestDurationTimeval(
-        reinterpret_cast<int32_t*>(&timeout.tv_sec),
-        reinterpret_cast<int32_t*>(&timeout.tv_usec));
-    timeout_in = &timeout;
-  }
-  int ret = select(nfds, readfds ? &native_readfds : nullptr,
-                   writefds ? &native_writefds : nullptr,
-                   exceptfds ? &native_exceptfds : nullptr, timeout_in);
+    int32_t timeout_sec = timeout_ptr.as_array<int32_t>()[0];
+    int32_t timeout_usec = timeout_ptr.as_array<int32_t>()[1];
+    Clock::ScaleGuestDurationTimeval(&timeout_sec, &timeout_usec);
+    // Rounded up so the wait isn't shorter than requested.
+    timeout_ms = int(std::max(
+        int64_t(timeout_sec) * 1000 + (int64_t(timeout_usec) + 999) / 1000,
+        int64_t(0)));
+  }
+  int ret = host_poll(native_fds.data(), nfds_t(native_fds.size()),
+                      timeout_ms);
+  if (ret < 0) {
+#ifdef XE_PLATFORM_WIN32
+    XThread::SetLastError(WSAGetLastError());
+#else
+    XThread::SetLastError(0x0);
+#endif
+    return -1;
+  }
   if (readfds) {
-    host_readfds.UpdateFrom(&native_readfds);
+    host_readfds.UpdateFrom(native_fds.data(), kSelectReadReadyEvents);
     host_readfds.Store(readfds);
   }
   if (writefds) {
-    host_writefds.UpdateFrom(&native_writefds);
+    host_writefds.UpdateFrom(native_fds.data() + native_writefds_offset,
+                             kSelectWriteReadyEvents);
     host_writefds.Store(writefds);
   }
   if (exceptfds) {
-    host_exceptfds.UpdateFrom(&native_exceptfds);
+    host_exceptfds.UpdateFrom(native_fds.data() + native_exceptfds_offset,
+                              kSelectExceptReadyEvents);
     host_exceptfds.Store(exceptfds);
   }
 
-  // TODO(gibbed): modify ret to be what's actually copied to the guest fd_sets?
-  return ret;
+  // Like select, the total number of sockets in the sets.
+  return host_readfds.count + host_writefds.count + host_exceptfds.count;
 }
 DECLARE_XAM_EXPORT1(NetDll_select, kNetworking, kImplemented);
 
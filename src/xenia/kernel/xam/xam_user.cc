@@ -680,12 +680,12 @@ dword_result_t XamUserCreateAchievementEnumerator_entry(
     return result;
   }
 
-  const util::XdbfGameData db = kernel_state()->title_xdbf();
+  const util::XdbfGameData& db = kernel_state()->title_xdbf();
 
   if (db.is_valid()) {
     const XLanguage language =
         db.GetExistingLanguage(static_cast<XLanguage>(cvars::user_language));
-    const std::vector<util::XdbfAchievementTableEntry> achievement_list =
+    const std::vector<util::XdbfAchievementTableEntry>& achievement_list =
         db.GetAchievements();
 
     for (const util::XdbfAchievementTableEntry& entry : achievement_list) {
@@ -11,7 +11,9 @@
 #include <chrono>
 #include <random>
 
+#include "xenia/base/crypto.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/math.h"
 #include "xenia/base/platform.h"
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/kernel/util/shim_utils.h"
@@ -126,7 +128,7 @@ void XeCryptShaUpdate_entry(pointer_t<XECRYPT_SHA_STATE> sha_state,
   sha1::SHA1 sha;
   InitSha1(&sha, sha_state);
 
-  sha.processBytes(input, input_size);
+  xe::crypto::Sha1ProcessBytes(&sha, input, input_size);
 
   StoreSha1(&sha, sha_state);
 }
@@ -153,13 +155,13 @@ void XeCryptSha_entry(lpvoid_t input_1, dword_t input_1_size, lpvoid_t input_2,
   sha1::SHA1 sha;
 
   if (input_1 && input_1_size) {
-    sha.processBytes(input_1, input_1_size);
+    xe::crypto::Sha1ProcessBytes(&sha, input_1, input_1_size);
   }
   if (input_2 && input_2_size) {
-    sha.processBytes(input_2, input_2_size);
+    xe::crypto::Sha1ProcessBytes(&sha, input_2, input_2_size);
   }
   if (input_3 && input_3_size) {
-    sha.processBytes(input_3, input_3_size);
+    xe::crypto::Sha1ProcessBytes(&sha, input_3, input_3_size);
   }
 
   uint8_t digest[0x14];
@@ -522,6 +524,19 @@ void XeCryptAesEcb_entry(pointer_t<XECRYPT_AES_STATE> state_ptr,
                          lpvoid_t inp_ptr, lpvoid_t out_ptr, dword_t encrypt) {
   const uint8_t* keytab =
       reinterpret_cast<const uint8_t*>(state_ptr->keytabenc);
+  if (xe::crypto::HasAesInstructions()) {
+    if (encrypt) {
+      xe::crypto::Aes128EncryptEcb(keytab, inp_ptr.as<const uint8_t*>(),
+                                   out_ptr.as<uint8_t*>(), 16);
+    } else {
+      // Only keytabenc is used by the portable implementation too.
+      uint8_t keytabdec[xe::crypto::kAes128RoundKeysSize];
+      xe::crypto::Aes128InvertRoundKeys(keytab, keytabdec);
+      xe::crypto::Aes128DecryptEcb(keytabdec, inp_ptr.as<const uint8_t*>(),
+                                   out_ptr.as<uint8_t*>(), 16);
+    }
+    return;
+  }
   if (encrypt) {
     aes_encrypt_128(keytab, inp_ptr, out_ptr);
   } else {
@@ -538,6 +553,19 @@ void XeCryptAesCbc_entry(pointer_t<XECRYPT_AES_STATE> state_ptr,
   const uint8_t* inp = inp_ptr.as<const uint8_t*>();
   uint8_t* out = out_ptr.as<uint8_t*>();
   uint8_t* feed = feed_ptr.as<uint8_t*>();
+  if (xe::crypto::HasAesInstructions()) {
+    // Like the portable implementation, a partial last block is processed
+    // whole.
+    size_t size = xe::round_up(size_t(inp_size), size_t(16), false);
+    if (encrypt) {
+      xe::crypto::Aes128EncryptCbc(keytab, inp, out, size, feed);
+    } else {
+      uint8_t keytabdec[xe::crypto::kAes128RoundKeysSize];
+      xe::crypto::Aes128InvertRoundKeys(keytab, keytabdec);
+      xe::crypto::Aes128DecryptCbc(keytabdec, inp, out, size, feed);
+    }
+    return;
+  }
   if (encrypt) {
     for (uint32_t i = 0; i < inp_size; i += 16) {
       for (uint32_t j = 0; j < 16; ++j) {
@@ -581,7 +609,7 @@ void XeCryptHmacSha_entry(lpvoid_t key, dword_t key_size_in, lpvoid_t inp_1,
   // If > block size, use its hash
   if (key_size > 0x40) {
     sha1::SHA1 sha_key;
-    sha_key.processBytes(key, key_size);
+    xe::crypto::Sha1ProcessBytes(&sha_key, key, key_size);
     sha_key.finalize((uint8_t*)tmp_key);
 
     key_size = 0x14u;
@@ -595,18 +623,18 @@ void XeCryptHmacSha_entry(lpvoid_t key, dword_t key_size_in, lpvoid_t inp_1,
   }
 
   // Inner
-  sha.processBytes(kpad_i, 0x40);
+  xe::crypto::Sha1ProcessBytes(&sha, kpad_i, 0x40);
 
   if (inp_1_size) {
-    sha.processBytes(inp_1, inp_1_size);
+    xe::crypto::Sha1ProcessBytes(&sha, inp_1, inp_1_size);
   }
 
   if (inp_2_size) {
-    sha.processBytes(inp_2, inp_2_size);
+    xe::crypto::Sha1ProcessBytes(&sha, inp_2, inp_2_size);
   }
 
   if (inp_3_size) {
-    sha.processBytes(inp_3, inp_3_size);
+    xe::crypto::Sha1ProcessBytes(&sha, inp_3, inp_3_size);
   }
 
   uint8_t digest[0x14];
@@ -614,8 +642,8 @@ void XeCryptHmacSha_entry(lpvoid_t key, dword_t key_size_in, lpvoid_t inp_1,
   sha.reset();
 
   // Outer
-  sha.processBytes(kpad_o, 0x40);
-  sha.processBytes(digest, 0x14);
+  xe::crypto::Sha1ProcessBytes(&sha, kpad_o, 0x40);
+  xe::crypto::Sha1ProcessBytes(&sha, digest, 0x14);
   sha.finalize(digest);
 
   std::memcpy(out, digest, std::min((uint32_t)out_size, 0x14u));
@@ -199,6 +199,45 @@ dword_result_t NtReadFile_entry(dword_t file_handle, dword_t event_handle,
     result = X_STATUS_INVALID_HANDLE;
   }
 
+  // Reads from the current position are done synchronously to keep their
+  // order.
+  if (XSUCCEEDED(result) && !file->is_synchronous() && byte_offset_ptr) {
+    uint32_t buffer_ptr = buffer.guest_address();
+    uint32_t length = buffer_length;
+    uint64_t byte_offset = *byte_offset_ptr;
+    uint32_t io_status_block_ptr = io_status_block.guest_address();
+    uint32_t apc_routine = static_cast<uint32_t>(apc_routine_ptr) & ~1u;
+    uint32_t apc_context_ptr = apc_context.guest_address();
+    auto thread = retain_object(XThread::GetCurrentThread());
+    if (io_status_block) {
+      io_status_block->status = X_STATUS_PENDING;
+      io_status_block->information = 0;
+    }
+    if (kernel_state()->QueueFileIO([=]() {
+          uint32_t bytes_read = 0;
+          X_STATUS read_result = file->Read(buffer_ptr, length, byte_offset,
+                                            &bytes_read, apc_context_ptr);
+          if (io_status_block_ptr) {
+            auto status_block = kernel_state()
+                                    ->memory()
+                                    ->TranslateVirtual<X_IO_STATUS_BLOCK*>(
+                                        io_status_block_ptr);
+            status_block->status = read_result;
+            status_block->information = bytes_read;
+          }
+          // Delivered to the thread that requested the read, as usual.
+          if (apc_routine && apc_context_ptr) {
+            thread->EnqueueApc(apc_routine, apc_context_ptr,
+                               io_status_block_ptr, 0);
+          }
+          if (ev) {
+            ev->Set(0, false);
+          }
+        })) {
+      return X_STATUS_PENDING;
+    }
+  }
+
   if (XSUCCEEDED(result)) {
     if (true || file->is_synchronous()) {
       // Synchronous.
@@ -565,11 +604,11 @@ dword_result_t NtQueryDirectoryFile_entry(
   }
 
   if (file) {
-    X_FILE_DIRECTORY_INFORMATION dir_info = {0};
-    result =
-        file->QueryDirectory(file_info_ptr, length, name, restart_scan != 0);
+    size_t info_length = 0;
+    result = file->QueryDirectory(file_info_ptr, length, name,
+                                  restart_scan != 0, &info_length);
     if (XSUCCEEDED(result)) {
-      info = length;
+      info = uint32_t(info_length);
     }
   } else {
     result = X_STATUS_NO_SUCH_FILE;
@@ -597,10 +636,9 @@ dword_result_t NtFlushBuffersFile_entry(
   if (!file) {
     result = X_STATUS_INVALID_HANDLE;
   } else {
-    // NtFlushBuffersFile flushes any buffered data to the underlying device
-    // For our emulated VFS, writes are typically synchronous already
-    // We just validate the handle and return success
+    // NtFlushBuffersFile flushes any buffered data to the underlying device.
     XELOGD("NtFlushBuffersFile({:08X}) - file: {}", file_handle, file->path());
+    result = file->file()->Flush();
   }
 
   if (io_status_block_ptr) {
@@ -19,6 +19,7 @@
 #include "xenia/kernel/xevent.h"
 #include "xenia/kernel/xfile.h"
 #include "xenia/kernel/xiocompletion.h"
+#include "xenia/kernel/xsocket.h"
 #include "xenia/kernel/xsymboliclink.h"
 #include "xenia/kernel/xthread.h"
 #include "xenia/vfs/device.h"
@@ -113,6 +114,7 @@ dword_result_t NtQueryInformationFile_entry(
       // Make sure we're working with up-to-date information, just in case the
       // file size has changed via something other than NtSetInfoFile
       // (eg. seems NtWriteFile might extend the file in some cases)
+      file->file()->Flush();
       file->entry()->update();
 
       auto info = info_ptr.as<X_FILE_NETWORK_OPEN_INFORMATION*>();
@@ -194,6 +196,30 @@ dword_result_t NtSetInformationFile_entry(
     return X_STATUS_INFO_LENGTH_MISMATCH;
   }
 
+  if (info_class == XFileCompletionInformation) {
+    // Sockets can be associated with completion ports too, for the overlapped
+    // WSA functions.
+    auto object =
+        kernel_state()->object_table()->LookupObject<XObject>(file_handle);
+    if (object && object->type() == XObject::Type::Socket) {
+      auto info = info_ptr.as<X_FILE_COMPLETION_INFORMATION*>();
+      auto port = kernel_state()->object_table()->LookupObject<XIOCompletion>(
+          uint32_t(info->handle));
+      X_STATUS result = X_STATUS_SUCCESS;
+      if (!port) {
+        result = X_STATUS_INVALID_HANDLE;
+      } else {
+        static_cast<XSocket*>(object.get())
+            ->RegisterIOCompletionPort(uint32_t(info->key), port);
+      }
+      if (io_status_block) {
+        io_status_block->status = result;
+        io_status_block->information = sizeof(*info);
+      }
+      return result;
+    }
+  }
+
   auto file = kernel_state()->object_table()->LookupObject<XFile>(file_handle);
   if (!file) {
     return X_STATUS_INVALID_HANDLE;
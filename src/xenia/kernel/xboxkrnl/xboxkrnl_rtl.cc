@@ -10,11 +10,17 @@
 #include "xenia/kernel/xboxkrnl/xboxkrnl_rtl.h"
 
 #include <algorithm>
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
 #include "xenia/base/atomic.h"
 #include "xenia/base/chrono.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/profiling.h"
 #include "xenia/base/string.h"
 #include "xenia/base/threading.h"
 #include "xenia/kernel/kernel_state.h"
@@ -25,6 +31,17 @@
 #include "xenia/kernel/xevent.h"
 #include "xenia/kernel/xthread.h"
 
+DEFINE_int32(critical_section_host_spin_count, -1,
+             "Number of times a contended guest critical section is checked "
+             "before the thread waits for it, for critical sections without "
+             "a spin count set by the title. -1 to choose based on the number "
+             "of logical processors.",
+             "Kernel");
+DEFINE_bool(log_critical_section_contention, false,
+            "Log guest critical sections each time the number of waits for "
+            "them reaches a power of two, starting from 1024.",
+            "Kernel");
+
 namespace xe {
 namespace kernel {
 namespace xboxkrnl {
@@ -32,21 +49,9 @@ namespace xboxkrnl {
 // https://msdn.microsoft.com/en-us/library/ff561778
 dword_result_t RtlCompareMemory_entry(lpvoid_t source1, lpvoid_t source2,
                                       dword_t length) {
-  uint8_t* p1 = source1;
-  uint8_t* p2 = source2;
-
   // Note that the return value is the number of bytes that match, so it's best
   // we just do this ourselves vs. using memcmp.
-  // On Windows we could use the builtin function.
-
-  uint32_t c = 0;
-  for (uint32_t n = 0; n < length; n++, p1++, p2++) {
-    if (*p1 == *p2) {
-      c++;
-    }
-  }
-
-  return c;
+  return uint32_t(xe::count_equal_8(source1, source2, length));
 }
 DECLARE_XBOXKRNL_EXPORT1(RtlCompareMemory, kMemory, kImplemented);
 
@@ -58,16 +63,9 @@ dword_result_t RtlCompareMemoryUlong_entry(lpvoid_t source, dword_t length,
     return 0;
   }
 
-  uint32_t n = 0;
-  for (uint32_t i = 0; i < (length / 4); i++) {
-    // FIXME: This assumes as_array returns xe::be
-    uint32_t val = source.as_array<uint32_t>()[i];
-    if (val == pattern) {
-      n++;
-    }
-  }
-
-  return n;
+  // Comparing the big-endian elements in memory with the swapped pattern.
+  return uint32_t(xe::count_equal_32(source.as<const uint32_t*>(), length / 4,
+                                     xe::byte_swap(pattern.value())));
 }
 DECLARE_XBOXKRNL_EXPORT1(RtlCompareMemoryUlong, kMemory, kImplemented);
 
@@ -77,11 +75,8 @@ void RtlFillMemoryUlong_entry(lpvoid_t destination, dword_t length,
   // NOTE: length must be % 4, so we can work on uint32s.
   uint32_t count = length >> 2;
 
-  uint32_t* p = destination.as<uint32_t*>();
-  uint32_t swapped_pattern = xe::byte_swap(pattern.value());
-  for (uint32_t n = 0; n < count; n++, p++) {
-    *p = swapped_pattern;
-  }
+  xe::fill_32(destination.as<uint32_t*>(), xe::byte_swap(pattern.value()),
+              count);
 }
 DECLARE_XBOXKRNL_EXPORT1(RtlFillMemoryUlong, kMemory, kImplemented);
 
@@ -275,9 +270,9 @@ dword_result_t RtlMultiByteToUnicodeN_entry(lpword_t destination_ptr,
   // TODO(benvanik): maybe use MultiByteToUnicode on Win32? would require
   // swapping.
 
-  for (uint32_t i = 0; i < copy_len; i++) {
-    destination_ptr[i] = source_ptr[i];
-  }
+  xe::widen_8_to_16_be(
+      reinterpret_cast<uint16_t*>(destination_ptr.host_address()),
+      source_ptr, copy_len);
 
   if (written_ptr.guest_address() != 0) {
     *written_ptr = copy_len << 1;
@@ -298,10 +293,10 @@ dword_result_t RtlUnicodeToMultiByteN_entry(pointer_t<uint8_t> destination_ptr,
   copy_len = copy_len < destination_len ? copy_len : destination_len.value();
 
   // TODO(benvanik): maybe use UnicodeToMultiByte on Win32?
-  for (uint32_t i = 0; i < copy_len; i++) {
-    uint16_t c = source_ptr[i];
-    destination_ptr[i] = c < 256 ? (uint8_t)c : '?';
-  }
+  xe::narrow_16_be_to_8(
+      destination_ptr,
+      reinterpret_cast<const uint16_t*>(source_ptr.host_address()), copy_len,
+      '?');
 
   if (written_ptr.guest_address() != 0) {
     *written_ptr = copy_len;
@@ -375,6 +370,75 @@ struct X_RTL_CRITICAL_SECTION {
 #pragma pack(pop)
 static_assert_size(X_RTL_CRITICAL_SECTION, 28);
 
+// Threads waiting for contended critical sections, parked on the host by the
+// guest address of the critical section. Going through the dispatcher header
+// with xeKeWaitForSingleObject would create or look up an XEvent for it under
+// the global critical region on every contended entry.
+class CriticalSectionWaitTable {
+ public:
+  void Wait(uint32_t cs_ptr) {
+    Bucket& bucket = GetBucket(cs_ptr);
+    std::unique_lock<std::mutex> lock(bucket.mutex);
+    Waitable& waitable = bucket.waitables[cs_ptr];
+    uint64_t wait_count = ++waitable.wait_count;
+    COUNT_profile_add("kernel/critical_section_waits", 1);
+    if (cvars::log_critical_section_contention && wait_count >= 1024 &&
+        xe::is_pow2(wait_count)) {
+      XELOGI("Critical section {:08X} waited for {} times", cs_ptr,
+             wait_count);
+    }
+    bucket.cond.wait(lock, [&waitable]() { return waitable.wake_count; });
+    --waitable.wake_count;
+  }
+
+  void Wake(uint32_t cs_ptr) {
+    Bucket& bucket = GetBucket(cs_ptr);
+    {
+      std::lock_guard<std::mutex> lock(bucket.mutex);
+      ++bucket.waitables[cs_ptr].wake_count;
+    }
+    // Other critical sections may be waited for in the same bucket.
+    bucket.cond.notify_all();
+  }
+
+ private:
+  struct Waitable {
+    // Like the auto-reset event in the header, a wake may happen before the
+    // thread it's for starts waiting.
+    uint32_t wake_count = 0;
+    uint64_t wait_count = 0;
+  };
+  struct Bucket {
+    std::mutex mutex;
+    std::condition_variable cond;
+    // Never erased, as there's no RtlDeleteCriticalSection on the 360.
+    std::unordered_map<uint32_t, Waitable> waitables;
+  };
+
+  static constexpr uint32_t kBucketCountLog2 = 6;
+  Bucket& GetBucket(uint32_t cs_ptr) {
+    return buckets_[uint32_t(cs_ptr * UINT32_C(0x9E3779B1)) >>
+                    (32 - kBucketCountLog2)];
+  }
+
+  Bucket buckets_[size_t(1) << kBucketCountLog2];
+};
+
+static CriticalSectionWaitTable critical_section_wait_table;
+
+static uint32_t GetCriticalSectionHostSpinCount() {
+  static const uint32_t host_spin_count = []() {
+    if (cvars::critical_section_host_spin_count >= 0) {
+      return uint32_t(cvars::critical_section_host_spin_count);
+    }
+    // Spinning only helps if the owner can be running on another core at the
+    // same time.
+    return xe::threading::logical_processor_count() > 2 ? uint32_t(1024)
+                                                        : uint32_t(0);
+  }();
+  return host_spin_count;
+}
+
 void xeRtlInitializeCriticalSection(X_RTL_CRITICAL_SECTION* cs,
                                     uint32_t cs_ptr) {
   cs->header.type = 1;      // EventSynchronizationObject (auto reset)
@@ -421,6 +485,9 @@ DECLARE_XBOXKRNL_EXPORT1(RtlInitializeCriticalSectionAndSpinCount, kNone,
 void RtlEnterCriticalSection_entry(pointer_t<X_RTL_CRITICAL_SECTION> cs) {
   uint32_t cur_thread = XThread::GetCurrentThread()->guest_object();
   uint32_t spin_count = cs->header.absolute * 256;
+  if (!spin_count) {
+    spin_count = GetCriticalSectionHostSpinCount();
+  }
 
   if (cs->owning_thread == cur_thread) {
     // We already own the lock.
@@ -437,12 +504,14 @@ void RtlEnterCriticalSection_entry(pointer_t<X_RTL_CRITICAL_SECTION> cs) {
       cs->recursion_count = 1;
       return;
     }
+#if XE_ARCH_AMD64
+    _mm_pause();
+#endif
   }
 
   if (xe::atomic_inc(&cs->lock_count) != 0) {
-    // Create a full waiter.
-    xeKeWaitForSingleObject(reinterpret_cast<void*>(cs.host_address()), 8, 0, 0,
-                            nullptr);
+    // Wait for the owner to hand the critical section over.
+    critical_section_wait_table.Wait(cs.guest_address());
   }
 
   assert_true(cs->owning_thread == 0);
@@ -490,7 +559,7 @@ void RtlLeaveCriticalSection_entry(pointer_t<X_RTL_CRITICAL_SECTION> cs) {
   cs->owning_thread = 0;
   if (xe::atomic_dec(&cs->lock_count) != -1) {
     // There were waiters - wake one of them.
-    xeKeSetEvent(reinterpret_cast<X_KEVENT*>(cs.host_address()), 1, 0);
+    critical_section_wait_table.Wake(cs.guest_address());
   }
 }
 DECLARE_XBOXKRNL_EXPORT2(RtlLeaveCriticalSection, kNone, kImplemented,
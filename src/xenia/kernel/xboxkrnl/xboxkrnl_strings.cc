@@ -562,15 +562,10 @@ int32_t format_core(PPCContext* ppc_context, FormatData& data, ArgList& args,
               int32_t length;
 
               if (!is_wide) {
-                length = 0;
-                for (auto s = (const uint8_t*)str; cap > 0 && *s; ++s, cap--) {
-                  length++;
-                }
+                length = int32_t(strnlen((const char*)str, size_t(cap)));
               } else {
-                length = 0;
-                for (auto s = (const uint16_t*)str; cap > 0 && *s; ++s, cap--) {
-                  length++;
-                }
+                length =
+                    int32_t(xe::string_length_16((const uint16_t*)str, cap));
               }
 
               text.buffer = str;
@@ -1146,9 +1146,8 @@ DECLARE_XBOXKRNL_EXPORT2(KeInitializeDpc, kThreading, kImplemented, kSketchy);
 dword_result_t KeInsertQueueDpc_entry(pointer_t<XDPC> dpc, dword_t arg1,
                                       dword_t arg2) {
   // DPCs (Deferred Procedure Calls) are used to schedule work at DISPATCH_LEVEL.
-  // On real hardware, these would be executed by the DPC dispatcher.
-  // For emulation, we just queue them - most games don't actually require
-  // DPC execution to proceed, they just need the queue operation to succeed.
+  // They're run on the kernel dispatch thread. A DPC queued again before it has
+  // run is only run once.
 
   uint32_t list_entry_ptr = dpc.guest_address() + 4;
 
@@ -1166,10 +1165,7 @@ dword_result_t KeInsertQueueDpc_entry(pointer_t<XDPC> dpc, dword_t arg1,
   dpc->arg2 = (uint32_t)arg2;
 
   dpc_list->Insert(list_entry_ptr);
-
-  // Log DPC queue for debugging
-  XELOGD("KeInsertQueueDpc: Queued DPC routine {:08X} context {:08X}",
-         (uint32_t)dpc->routine, (uint32_t)dpc->context);
+  kernel_state()->NotifyDpcQueued();
 
   return 1;
 }
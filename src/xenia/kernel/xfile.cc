@@ -10,7 +10,11 @@
 #include "xenia/kernel/xfile.h"
 #include "xenia/vfs/virtual_file_system.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "xenia/base/byte_stream.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/mutex.h"
@@ -18,6 +22,12 @@
 #include "xenia/kernel/xevent.h"
 #include "xenia/memory.h"
 
+DEFINE_bool(query_directory_multiple_entries, false,
+            "Return as many directory entries as fit in the buffer from "
+            "NtQueryDirectoryFile, rather than one per call, reducing the "
+            "number of calls for titles enumerating large directories.",
+            "Kernel");
+
 namespace xe {
 namespace kernel {
 
@@ -42,57 +52,111 @@ XFile::~XFile() {
 
 X_STATUS XFile::QueryDirectory(X_FILE_DIRECTORY_INFORMATION* out_info,
                                size_t length, const std::string_view file_name,
-                               bool restart) {
+                               bool restart, size_t* out_length) {
   assert_not_null(out_info);
-
-  vfs::Entry* entry = nullptr;
+  *out_length = 0;
 
   if (!file_name.empty()) {
     // Only queries in the current directory are supported for now.
     assert_true(utf8::find_any_of(file_name, "\\") == std::string_view::npos);
 
     find_engine_.SetRule(file_name);
+    find_match_all_ = file_name == "*" || file_name == "*.*";
+    find_exact_name_.clear();
+    if (utf8::find_any_of(file_name, "*?") == std::string_view::npos) {
+      find_exact_name_ = file_name;
+    }
 
     // Always restart the search?
     find_index_ = 0;
-    entry = file_->entry()->IterateChildren(find_engine_, &find_index_);
-    if (!entry) {
-      return X_STATUS_NO_SUCH_FILE;
-    }
+    UpdateFindEntries(true);
   } else {
     if (restart) {
       find_index_ = 0;
     }
+    UpdateFindEntries(restart || !find_entries_collected_);
+  }
 
-    entry = file_->entry()->IterateChildren(find_engine_, &find_index_);
-    if (!entry) {
-      return X_STATUS_NO_MORE_FILES;
+  auto buffer = reinterpret_cast<uint8_t*>(out_info);
+  size_t offset = 0;
+  X_FILE_DIRECTORY_INFORMATION* previous_info = nullptr;
+  while (find_index_ < find_entries_.size()) {
+    vfs::Entry* entry = find_entries_[find_index_];
+    auto info =
+        reinterpret_cast<X_FILE_DIRECTORY_INFORMATION*>(buffer + offset);
+    const auto& entry_name = entry->name();
+    size_t name_offset =
+        reinterpret_cast<uint8_t*>(&info->file_name[0]) - buffer;
+    if (name_offset + entry_name.size() > length) {
+      if (previous_info) {
+        // Returned by the next call.
+        break;
+      }
+      assert_always("Buffer overflow?");
+      return X_STATUS_NO_SUCH_FILE;
     }
-  }
+    ++find_index_;
 
-  auto end = reinterpret_cast<uint8_t*>(out_info) + length;
-  const auto& entry_name = entry->name();
-  if (reinterpret_cast<uint8_t*>(&out_info->file_name[0]) + entry_name.size() >
-      end) {
-    assert_always("Buffer overflow?");
-    return X_STATUS_NO_SUCH_FILE;
+    if (previous_info) {
+      previous_info->next_entry_offset = uint32_t(
+          reinterpret_cast<uint8_t*>(info) -
+          reinterpret_cast<uint8_t*>(previous_info));
+    }
+    info->next_entry_offset = 0;
+    info->file_index = static_cast<uint32_t>(find_index_);
+    info->creation_time = entry->create_timestamp();
+    info->last_access_time = entry->access_timestamp();
+    info->last_write_time = entry->write_timestamp();
+    info->change_time = entry->write_timestamp();
+    info->end_of_file = entry->size();
+    info->allocation_size = entry->allocation_size();
+    info->attributes = entry->attributes();
+    info->file_name_length = static_cast<uint32_t>(entry_name.size());
+    std::memcpy(info->file_name, entry_name.data(), entry_name.size());
+    *out_length = name_offset + entry_name.size();
+    previous_info = info;
+
+    if (!cvars::query_directory_multiple_entries) {
+      break;
+    }
+    // The entries are 8-byte aligned.
+    offset = xe::round_up(*out_length, size_t(8));
   }
 
-  out_info->next_entry_offset = 0;
-  out_info->file_index = static_cast<uint32_t>(find_index_);
-  out_info->creation_time = entry->create_timestamp();
-  out_info->last_access_time = entry->access_timestamp();
-  out_info->last_write_time = entry->write_timestamp();
-  out_info->change_time = entry->write_timestamp();
-  out_info->end_of_file = entry->size();
-  out_info->allocation_size = entry->allocation_size();
-  out_info->attributes = entry->attributes();
-  out_info->file_name_length = static_cast<uint32_t>(entry_name.size());
-  std::memcpy(out_info->file_name, entry_name.data(), entry_name.size());
-
+  if (!previous_info) {
+    return file_name.empty() ? X_STATUS_NO_MORE_FILES : X_STATUS_NO_SUCH_FILE;
+  }
   return X_STATUS_SUCCESS;
 }
 
+void XFile::UpdateFindEntries(bool from_scratch) {
+  vfs::Entry* directory = file_->entry();
+  // Entries may have been destroyed if any children have been removed.
+  uint64_t destruction_count = vfs::Entry::destruction_count();
+  if (from_scratch || destruction_count != find_destruction_count_) {
+    find_entries_.clear();
+    find_child_count_ = 0;
+  }
+  find_entries_collected_ = true;
+  find_destruction_count_ = destruction_count;
+  size_t child_count = directory->child_count();
+  if (!find_exact_name_.empty()) {
+    if (find_child_count_ != child_count) {
+      find_entries_.clear();
+      vfs::Entry* child = directory->GetChild(find_exact_name_);
+      if (child) {
+        find_entries_.push_back(child);
+      }
+    }
+  } else if (find_child_count_ < child_count) {
+    // New children are appended.
+    directory->FindChildren(find_engine_, find_match_all_, find_child_count_,
+                            find_entries_);
+  }
+  find_child_count_ = child_count;
+  find_index_ = std::min(find_index_, find_entries_.size());
+}
+
 X_STATUS XFile::Read(uint32_t buffer_guest_address, uint32_t buffer_length,
                      uint64_t byte_offset, uint32_t* out_bytes_read,
                      uint32_t apc_context, bool notify_completion) {
@@ -91,8 +91,12 @@ class XFile : public XObject {
   uint64_t position() const { return position_; }
   void set_position(uint64_t value) { position_ = value; }
 
+  // Writes as many entries as fit in the buffer with the
+  // query_directory_multiple_entries option, or one otherwise, returning the
+  // number of bytes written in out_length.
   X_STATUS QueryDirectory(X_FILE_DIRECTORY_INFORMATION* out_info, size_t length,
-                          const std::string_view file_name, bool restart);
+                          const std::string_view file_name, bool restart,
+                          size_t* out_length);
 
   // Don't do within the global critical region because invalidation callbacks
   // may be triggered (as per the usual rule of not doing I/O within the global
@@ -140,8 +144,25 @@ class XFile : public XObject {
 
   uint64_t position_ = 0;
 
+  // Collects the children matching the pattern of the enumeration into
+  // find_entries_, from scratch, or only the ones added since if the children
+  // haven't been removed.
+  void UpdateFindEntries(bool from_scratch);
+
   xe::filesystem::WildcardEngine find_engine_;
+  // No pattern, or a wildcard for everything.
+  bool find_match_all_ = true;
+  // If the pattern has no wildcards, the name looked up via the index of the
+  // directory instead.
+  std::string find_exact_name_;
+  // The children of the directory matching the pattern, kept between calls,
+  // and the position of the next one to return.
+  std::vector<vfs::Entry*> find_entries_;
   size_t find_index_ = 0;
+  // For updating the list when the children have changed.
+  bool find_entries_collected_ = false;
+  size_t find_child_count_ = 0;
+  uint64_t find_destruction_count_ = 0;
 
   bool is_synchronous_ = false;
 };
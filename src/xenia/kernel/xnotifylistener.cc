@@ -20,7 +20,16 @@ namespace kernel {
 XNotifyListener::XNotifyListener(KernelState* kernel_state)
     : XObject(kernel_state, kObjectType) {}
 
-XNotifyListener::~XNotifyListener() {}
+XNotifyListener::~XNotifyListener() {
+  for (Notification* head :
+       {pending_head_, incoming_notifications_.load()}) {
+    while (head) {
+      Notification* next = head->next;
+      delete head;
+      head = next;
+    }
+  }
+}
 
 void XNotifyListener::Initialize(uint64_t mask, uint32_t max_version) {
   assert_false(wait_handle_);
@@ -43,48 +52,91 @@ void XNotifyListener::EnqueueNotification(XNotificationID id, uint32_t data) {
   if (key.version > max_version_) {
     return;
   }
-  auto global_lock = global_critical_region_.Acquire();
-  notifications_.push_back(std::pair<XNotificationID, uint32_t>(id, data));
+  auto notification = new Notification;
+  notification->id = id;
+  notification->data = data;
+  Notification* head = incoming_notifications_.load(std::memory_order_relaxed);
+  do {
+    notification->next = head;
+  } while (!incoming_notifications_.compare_exchange_weak(head, notification));
   wait_handle_->Set();
 }
 
+void XNotifyListener::TakeIncomingNotifications() {
+  Notification* notification = incoming_notifications_.exchange(nullptr);
+  if (!notification) {
+    return;
+  }
+  // Reverse the stack to the order the notifications were pushed in.
+  Notification* tail = notification;
+  Notification* head = nullptr;
+  while (notification) {
+    Notification* next = notification->next;
+    notification->next = head;
+    head = notification;
+    notification = next;
+  }
+  if (pending_tail_) {
+    pending_tail_->next = head;
+  } else {
+    pending_head_ = head;
+  }
+  pending_tail_ = tail;
+  has_pending_ = true;
+}
+
+void XNotifyListener::RemovePendingNotification(Notification* previous,
+                                                Notification* notification) {
+  (previous ? previous->next : pending_head_) = notification->next;
+  if (pending_tail_ == notification) {
+    pending_tail_ = previous;
+  }
+  delete notification;
+  if (!pending_head_) {
+    has_pending_ = false;
+    wait_handle_->Reset();
+    // A notification may have been pushed before the reset.
+    if (incoming_notifications_.load()) {
+      wait_handle_->Set();
+    }
+  }
+}
+
 bool XNotifyListener::DequeueNotification(XNotificationID* out_id,
                                           uint32_t* out_data) {
-  auto global_lock = global_critical_region_.Acquire();
-  bool dequeued = false;
-  if (notifications_.size()) {
-    dequeued = true;
-    auto it = notifications_.begin();
-    *out_id = it->first;
-    *out_data = it->second;
-    notifications_.erase(it);
-    if (!notifications_.size()) {
-      wait_handle_->Reset();
-    }
+  if (!has_pending_ && !incoming_notifications_.load()) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(consumer_mutex_);
+  TakeIncomingNotifications();
+  Notification* notification = pending_head_;
+  if (!notification) {
+    return false;
   }
-  return dequeued;
+  *out_id = notification->id;
+  *out_data = notification->data;
+  RemovePendingNotification(nullptr, notification);
+  return true;
 }
 
 bool XNotifyListener::DequeueNotification(XNotificationID id,
                                           uint32_t* out_data) {
-  auto global_lock = global_critical_region_.Acquire();
-  if (!notifications_.size()) {
+  if (!has_pending_ && !incoming_notifications_.load()) {
     return false;
   }
-  bool dequeued = false;
-  for (auto it = notifications_.begin(); it != notifications_.end(); ++it) {
-    if (it->first != id) {
-      continue;
-    }
-    dequeued = true;
-    *out_data = it->second;
-    notifications_.erase(it);
-    if (!notifications_.size()) {
-      wait_handle_->Reset();
+  std::lock_guard<std::mutex> lock(consumer_mutex_);
+  TakeIncomingNotifications();
+  Notification* previous = nullptr;
+  for (Notification* notification = pending_head_; notification;
+       notification = notification->next) {
+    if (notification->id == id) {
+      *out_data = notification->data;
+      RemovePendingNotification(previous, notification);
+      return true;
     }
-    break;
+    previous = notification;
   }
-  return dequeued;
+  return false;
 }
 
 bool XNotifyListener::Save(ByteStream* stream) {
@@ -92,10 +144,19 @@ bool XNotifyListener::Save(ByteStream* stream) {
 
   stream->Write(mask_);
   stream->Write(max_version_);
-  stream->Write(notifications_.size());
-  for (auto pair : notifications_) {
-    stream->Write<uint32_t>(pair.first);
-    stream->Write<uint32_t>(pair.second);
+
+  std::lock_guard<std::mutex> lock(consumer_mutex_);
+  TakeIncomingNotifications();
+  size_t notification_count = 0;
+  for (Notification* notification = pending_head_; notification;
+       notification = notification->next) {
+    ++notification_count;
+  }
+  stream->Write(notification_count);
+  for (Notification* notification = pending_head_; notification;
+       notification = notification->next) {
+    stream->Write<uint32_t>(notification->id);
+    stream->Write<uint32_t>(notification->data);
   }
 
   return true;
@@ -113,11 +174,22 @@ object_ref<XNotifyListener> XNotifyListener::Restore(KernelState* kernel_state,
   notify->Initialize(mask, max_version);
 
   auto notification_count_ = stream->Read<size_t>();
+  std::lock_guard<std::mutex> lock(notify->consumer_mutex_);
   for (size_t i = 0; i < notification_count_; i++) {
-    std::pair<XNotificationID, uint32_t> pair;
-    pair.first = stream->Read<uint32_t>();
-    pair.second = stream->Read<uint32_t>();
-    notify->notifications_.push_back(pair);
+    auto notification = new Notification;
+    notification->next = nullptr;
+    notification->id = stream->Read<uint32_t>();
+    notification->data = stream->Read<uint32_t>();
+    if (notify->pending_tail_) {
+      notify->pending_tail_->next = notification;
+    } else {
+      notify->pending_head_ = notification;
+    }
+    notify->pending_tail_ = notification;
+  }
+  if (notify->pending_head_) {
+    notify->has_pending_ = true;
+    notify->wait_handle_->Set();
   }
 
   return object_ref<XNotifyListener>(notify);
@@ -10,7 +10,9 @@
 #ifndef XENIA_KERNEL_XNOTIFYLISTENER_H_
 #define XENIA_KERNEL_XNOTIFYLISTENER_H_
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 
 #include "xenia/base/assert.h"
@@ -66,9 +68,26 @@ class XNotifyListener : public XObject {
   }
 
  private:
+  struct Notification {
+    Notification* next;
+    XNotificationID id;
+    uint32_t data;
+  };
+
+  // Must be called with consumer_mutex_ locked.
+  void TakeIncomingNotifications();
+  void RemovePendingNotification(Notification* previous,
+                                 Notification* notification);
+
   std::unique_ptr<xe::threading::Event> wait_handle_;
-  xe::global_critical_region global_critical_region_;
-  std::vector<std::pair<XNotificationID, uint32_t>> notifications_;
+  // Notifications are pushed by the broadcasting threads to a lock-free LIFO
+  // stack, and moved from there in FIFO order to the pending list by the
+  // XNotifyGetNext callers. Polling with no notifications doesn't lock.
+  std::atomic<Notification*> incoming_notifications_{nullptr};
+  std::mutex consumer_mutex_;
+  Notification* pending_head_ = nullptr;
+  Notification* pending_tail_ = nullptr;
+  std::atomic<bool> has_pending_{false};
   uint64_t mask_ = 0;
   uint32_t max_version_ = 0;
 };
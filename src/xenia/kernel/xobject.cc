@@ -13,6 +13,8 @@
 
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/clock.h"
+#include "xenia/base/frame_breakdown.h"
+#include "xenia/base/lock_profiling.h"
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/kernel/util/shim_utils.h"
 #include "xenia/kernel/xboxkrnl/xboxkrnl_private.h"
@@ -29,6 +31,28 @@
 namespace xe {
 namespace kernel {
 
+namespace {
+
+// Names of the guest waits in the lock profiling statistics.
+const char* GetLockProfilingWaitName(XObject::Type type) {
+  switch (type) {
+    case XObject::Type::Event:
+      return "Guest wait: event";
+    case XObject::Type::Mutant:
+      return "Guest wait: mutant";
+    case XObject::Type::Semaphore:
+      return "Guest wait: semaphore";
+    case XObject::Type::Thread:
+      return "Guest wait: thread";
+    case XObject::Type::Timer:
+      return "Guest wait: timer";
+    default:
+      return "Guest wait: other";
+  }
+}
+
+}  // namespace
+
 XObject::XObject(Type type)
     : kernel_state_(nullptr), pointer_ref_count_(1), type_(type) {
   handles_.reserve(10);
@@ -198,6 +222,10 @@ X_STATUS XObject::Wait(uint32_t wait_reason, uint32_t processor_mode,
     // Object doesn't support waiting.
     return X_STATUS_SUCCESS;
   }
+  frame_breakdown::ScopedTimer frame_breakdown_timer(
+      frame_breakdown::Category::kKernelWait);
+  lock_profiling::ScopedWait lock_profiling_wait(
+      GetLockProfilingWaitName(type()));
 
   auto timeout_ms =
       opt_timeout ? std::chrono::milliseconds(Clock::ScaleGuestDurationMillis(
@@ -226,6 +254,10 @@ X_STATUS XObject::Wait(uint32_t wait_reason, uint32_t processor_mode,
 X_STATUS XObject::SignalAndWait(XObject* signal_object, XObject* wait_object,
                                 uint32_t wait_reason, uint32_t processor_mode,
                                 uint32_t alertable, uint64_t* opt_timeout) {
+  frame_breakdown::ScopedTimer frame_breakdown_timer(
+      frame_breakdown::Category::kKernelWait);
+  lock_profiling::ScopedWait lock_profiling_wait(
+      GetLockProfilingWaitName(wait_object->type()));
   auto timeout_ms =
       opt_timeout ? std::chrono::milliseconds(Clock::ScaleGuestDurationMillis(
                         TimeoutTicksToMs(*opt_timeout)))
@@ -255,6 +287,11 @@ X_STATUS XObject::WaitMultiple(uint32_t count, XObject** objects,
                                uint32_t wait_type, uint32_t wait_reason,
                                uint32_t processor_mode, uint32_t alertable,
                                uint64_t* opt_timeout) {
+  frame_breakdown::ScopedTimer frame_breakdown_timer(
+      frame_breakdown::Category::kKernelWait);
+  lock_profiling::ScopedWait lock_profiling_wait(
+      wait_type ? "Guest wait: any of multiple"
+                : "Guest wait: all of multiple");
   std::vector<xe::threading::WaitHandle*> wait_handles(count);
   for (size_t i = 0; i < count; ++i) {
     wait_handles[i] = objects[i]->GetWaitHandle();
@@ -373,9 +410,20 @@ object_ref<XObject> XObject::GetNativeObject(KernelState* kernel_state,
   // We identify this by setting wait_list_flink to a magic value. When set,
   // wait_list_blink will hold a handle to our object.
 
-  auto global_lock = xe::global_critical_region::AcquireDirect();
-
   auto header = reinterpret_cast<X_DISPATCH_HEADER*>(native_ptr);
+  uint32_t guest_ptr = kernel_state->memory()->HostToGuestVirtual(native_ptr);
+
+  // Objects that have been used before are cached by their header address, so
+  // the frequent Set/Reset/Wait calls on them don't need the global lock.
+  if (header->wait_list_flink == kXObjSignature) {
+    auto object = kernel_state->object_table()->LookupNativeObject(
+        guest_ptr, header->wait_list_blink);
+    if (object) {
+      return object;
+    }
+  }
+
+  auto global_lock = xe::global_critical_region::AcquireDirect();
 
   if (as_type == -1) {
     as_type = header->type;
@@ -386,6 +434,10 @@ object_ref<XObject> XObject::GetNativeObject(KernelState* kernel_state,
     // TODO: assert if the type of the object != as_type
     uint32_t handle = header->wait_list_blink;
     auto object = kernel_state->object_table()->LookupObject<XObject>(handle);
+    if (object) {
+      kernel_state->object_table()->CacheNativeObject(guest_ptr, handle,
+                                                      object.get());
+    }
 
     // TODO(benvanik): assert nothing has been changed in the struct.
     return object;
@@ -436,6 +488,8 @@ object_ref<XObject> XObject::GetNativeObject(KernelState* kernel_state,
     // Stash pointer in struct.
     // FIXME: This assumes the object contains a dispatch header (some don't!)
     StashHandle(header, object->handle());
+    kernel_state->object_table()->CacheNativeObject(guest_ptr, object->handle(),
+                                                    object);
 
     return object_ref<XObject>(object);
   }
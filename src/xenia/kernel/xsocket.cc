@@ -9,10 +9,12 @@
 
 #include "src/xenia/kernel/xsocket.h"
 
+#include <algorithm>
 #include <cstring>
 
 #include "xenia/base/platform.h"
 #include "xenia/kernel/kernel_state.h"
+#include "xenia/kernel/socket_event_loop.h"
 #include "xenia/kernel/xam/xam_module.h"
 // #include "xenia/kernel/xnet.h"
 
@@ -28,11 +30,37 @@
 #include <netinet/ip.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <cerrno>
 #endif
 
 namespace xe {
 namespace kernel {
 
+namespace {
+
+uint32_t GetLastSocketError() {
+#if XE_PLATFORM_WIN32
+  return uint32_t(WSAGetLastError());
+#else
+  switch (errno) {
+    case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+    case EWOULDBLOCK:
+#endif
+      return X_WSAEWOULDBLOCK;
+    case EMSGSIZE:
+      return X_WSAEMSGSIZE;
+    case ECONNRESET:
+    case ECONNREFUSED:
+      return X_WSAECONNRESET;
+    default:
+      return X_WSAEINVAL;
+  }
+#endif
+}
+
+}  // namespace
+
 XSocket::XSocket(KernelState* kernel_state)
     : XObject(kernel_state, kObjectType) {}
 
@@ -60,6 +88,20 @@ X_STATUS XSocket::Initialize(AddressFamily af, Type type, Protocol proto) {
 }
 
 X_STATUS XSocket::Close() {
+  std::lock_guard<std::mutex> lock(pending_receive_mutex_);
+  if (closed_) {
+    return X_STATUS_SUCCESS;
+  }
+  closed_ = true;
+  AbortPendingReceives();
+  if (watched_) {
+    // The socket must not be polled anymore when its handle is reused.
+    SocketEventLoop* event_loop = kernel_state_->socket_event_loop();
+    if (event_loop) {
+      event_loop->Unwatch(this);
+    }
+  }
+
 #if XE_PLATFORM_WIN32
   int ret = closesocket(native_handle_);
 #elif XE_PLATFORM_LINUX
@@ -241,6 +283,191 @@ int XSocket::SendTo(uint8_t* buf, uint32_t buf_len, uint32_t flags,
                 to ? (sockaddr*)&nto : nullptr, to_len);
 }
 
+uint32_t XSocket::RecvFromOverlapped(const XWSABUF* buffers,
+                                     uint32_t buffer_count, uint32_t flags,
+                                     XSOCKADDR_IN* from,
+                                     xe::be<uint32_t>* from_len,
+                                     uint32_t overlapped_ptr,
+                                     uint32_t* num_bytes_recv) {
+  SocketEventLoop* event_loop = kernel_state_->socket_event_loop();
+  if (!event_loop) {
+    return X_WSAEINVAL;
+  }
+
+  PendingReceive receive;
+  receive.buffers.reserve(buffer_count);
+  for (uint32_t i = 0; i < buffer_count; ++i) {
+    receive.buffers.push_back(
+        {memory()->TranslateVirtual<uint8_t*>(buffers[i].buf_ptr),
+         buffers[i].len});
+  }
+  receive.flags = flags;
+  receive.from = from;
+  receive.from_len = from_len;
+  receive.overlapped_ptr = overlapped_ptr;
+
+  auto overlapped = memory()->TranslateVirtual<XWSAOVERLAPPED*>(overlapped_ptr);
+  if (overlapped->event_handle) {
+    receive.event = kernel_state_->object_table()->LookupObject<XEvent>(
+        overlapped->event_handle);
+    if (receive.event) {
+      receive.event->Reset();
+    }
+  }
+  overlapped->internal_high = 0;
+  overlapped->internal = X_STATUS_PENDING;
+
+  std::lock_guard<std::mutex> lock(pending_receive_mutex_);
+  if (closed_) {
+    CompleteReceive(receive, X_WSAENOTSOCK, 0);
+    return X_WSAENOTSOCK;
+  }
+  // Completing immediately only if that doesn't reorder the receives.
+  if (pending_receives_.empty()) {
+    uint32_t error, num_bytes;
+    if (TryReceive(receive, &error, &num_bytes)) {
+      CompleteReceive(receive, error, num_bytes);
+      if (!error && num_bytes_recv) {
+        *num_bytes_recv = num_bytes;
+      }
+      return error;
+    }
+  }
+  pending_receives_.push_back(std::move(receive));
+  // Watched with the lock held so it can't be done after Close.
+  watched_ = true;
+  event_loop->Watch(retain_object(this));
+  return X_WSA_IO_PENDING;
+}
+
+bool XSocket::CancelOverlappedReceives() {
+  std::lock_guard<std::mutex> lock(pending_receive_mutex_);
+  if (pending_receives_.empty()) {
+    return false;
+  }
+  AbortPendingReceives();
+  return true;
+}
+
+void XSocket::OnReadable() {
+  std::lock_guard<std::mutex> lock(pending_receive_mutex_);
+  while (!pending_receives_.empty()) {
+    PendingReceive& receive = pending_receives_.front();
+    uint32_t error, num_bytes;
+    if (!TryReceive(receive, &error, &num_bytes)) {
+      break;
+    }
+    CompleteReceive(receive, error, num_bytes);
+    pending_receives_.pop_front();
+  }
+  if (!pending_receives_.empty() && !closed_) {
+    SocketEventLoop* event_loop = kernel_state_->socket_event_loop();
+    if (event_loop) {
+      event_loop->Watch(retain_object(this));
+    }
+  }
+}
+
+void XSocket::RegisterIOCompletionPort(uint32_t key,
+                                       object_ref<XIOCompletion> port) {
+  std::lock_guard<std::mutex> lock(completion_port_lock_);
+  completion_ports_.push_back({key, port});
+}
+
+bool XSocket::TryReceive(PendingReceive& receive, uint32_t* error_out,
+                         uint32_t* num_bytes_out) {
+  uint8_t* data;
+  uint32_t length = 0;
+  if (receive.buffers.size() == 1) {
+    data = receive.buffers[0].data;
+    length = receive.buffers[0].length;
+  } else {
+    for (const PendingReceive::Buffer& buffer : receive.buffers) {
+      length += buffer.length;
+    }
+    receive_buffer_.resize(length);
+    data = receive_buffer_.data();
+  }
+
+  sockaddr_in nfrom = {};
+  socklen_t nfromlen = sizeof(sockaddr_in);
+#if XE_PLATFORM_WIN32
+  // No per-call non-blocking flag, and the guest may have made the socket
+  // blocking.
+  WSAPOLLFD poll_fd = {SOCKET(native_handle_), POLLRDNORM, 0};
+  if (WSAPoll(&poll_fd, 1, 0) <= 0) {
+    return false;
+  }
+  int native_flags = int(receive.flags);
+#else
+  int native_flags = int(receive.flags) | MSG_DONTWAIT;
+#endif
+  int ret = recvfrom(native_handle_, reinterpret_cast<char*>(data), length,
+                     native_flags, (sockaddr*)&nfrom, &nfromlen);
+  if (ret < 0) {
+    uint32_t error = GetLastSocketError();
+    if (error == X_WSAEWOULDBLOCK) {
+      return false;
+    }
+    *error_out = error;
+    *num_bytes_out = 0;
+    return true;
+  }
+
+  if (receive.buffers.size() != 1) {
+    uint32_t offset = 0;
+    for (const PendingReceive::Buffer& buffer : receive.buffers) {
+      if (offset >= uint32_t(ret)) {
+        break;
+      }
+      uint32_t copy_length = std::min(buffer.length, uint32_t(ret) - offset);
+      std::memcpy(buffer.data, data + offset, copy_length);
+      offset += copy_length;
+    }
+  }
+  if (receive.from) {
+    receive.from->sin_family = nfrom.sin_family;
+    receive.from->sin_addr = ntohl(nfrom.sin_addr.s_addr);  // BE <- BE
+    receive.from->sin_port = nfrom.sin_port;
+    std::memset(receive.from->x_sin_zero, 0,
+                sizeof(receive.from->x_sin_zero));
+  }
+  if (receive.from_len) {
+    *receive.from_len = uint32_t(nfromlen);
+  }
+  *error_out = 0;
+  *num_bytes_out = uint32_t(ret);
+  return true;
+}
+
+void XSocket::CompleteReceive(PendingReceive& receive, uint32_t error,
+                              uint32_t num_bytes) {
+  auto overlapped =
+      memory()->TranslateVirtual<XWSAOVERLAPPED*>(receive.overlapped_ptr);
+  overlapped->internal_high = num_bytes;
+  overlapped->internal = error;
+  if (receive.event) {
+    receive.event->Set(0, false);
+  }
+
+  XIOCompletion::IONotification notification;
+  notification.apc_context = receive.overlapped_ptr;
+  notification.status = error ? X_STATUS_UNSUCCESSFUL : X_STATUS_SUCCESS;
+  notification.num_bytes = num_bytes;
+  std::lock_guard<std::mutex> lock(completion_port_lock_);
+  for (auto& port : completion_ports_) {
+    notification.key_context = port.first;
+    port.second->QueueNotification(notification);
+  }
+}
+
+void XSocket::AbortPendingReceives() {
+  for (PendingReceive& receive : pending_receives_) {
+    CompleteReceive(receive, X_WSA_OPERATION_ABORTED, 0);
+  }
+  pending_receives_.clear();
+}
+
 bool XSocket::QueuePacket(uint32_t src_ip, uint16_t src_port,
                           const uint8_t* buf, size_t len) {
   packet* pkt = reinterpret_cast<packet*>(new uint8_t[sizeof(packet) + len]);
@@ -11,10 +11,14 @@
 #define XENIA_KERNEL_XSOCKET_H_
 
 #include <cstring>
+#include <deque>
 #include <queue>
+#include <vector>
 
 #include "xenia/base/byte_order.h"
 #include "xenia/base/math.h"
+#include "xenia/kernel/xevent.h"
+#include "xenia/kernel/xiocompletion.h"
 #include "xenia/kernel/xobject.h"
 
 namespace xe {
@@ -67,6 +71,34 @@ struct N_XSOCKADDR_IN {
   char x_sin_zero[8];
 };
 
+struct XWSABUF {
+  xe::be<uint32_t> len;
+  xe::be<uint32_t> buf_ptr;
+};
+
+struct XWSAOVERLAPPED {
+  xe::be<uint32_t> internal;
+  xe::be<uint32_t> internal_high;
+  union {
+    struct {
+      xe::be<uint32_t> low;
+      xe::be<uint32_t> high;
+    } offset;  // must be named to avoid GCC error
+    xe::be<uint32_t> pointer;
+  };
+  xe::be<uint32_t> event_handle;
+};
+
+// WSA error codes.
+constexpr uint32_t X_WSA_OPERATION_ABORTED = 995;
+constexpr uint32_t X_WSA_IO_INCOMPLETE = 996;
+constexpr uint32_t X_WSA_IO_PENDING = 997;
+constexpr uint32_t X_WSAEINVAL = 10022;
+constexpr uint32_t X_WSAENOTSOCK = 10038;
+constexpr uint32_t X_WSAEWOULDBLOCK = 10035;
+constexpr uint32_t X_WSAEMSGSIZE = 10040;
+constexpr uint32_t X_WSAECONNRESET = 10054;
+
 class XSocket : public XObject {
  public:
   static const XObject::Type kObjectType = XObject::Type::Socket;
@@ -117,6 +149,25 @@ class XSocket : public XObject {
   int SendTo(uint8_t* buf, uint32_t buf_len, uint32_t flags, N_XSOCKADDR_IN* to,
              uint32_t to_len);
 
+  // Overlapped WSARecvFrom (from and from_len may be null). Returns 0 if the
+  // data has been received immediately, or a WSA error code - X_WSA_IO_PENDING
+  // if the receive will be completed by the socket event loop once there's
+  // data. Either way, the result is stored in the overlapped structure (the
+  // error code in internal, X_STATUS_PENDING until completion, and the size in
+  // internal_high), its event is set and the completion ports are notified.
+  uint32_t RecvFromOverlapped(const XWSABUF* buffers, uint32_t buffer_count,
+                              uint32_t flags, XSOCKADDR_IN* from,
+                              xe::be<uint32_t>* from_len,
+                              uint32_t overlapped_ptr,
+                              uint32_t* num_bytes_recv);
+  // Completes the pending overlapped receives with X_WSA_OPERATION_ABORTED.
+  // Returns false if there were none.
+  bool CancelOverlappedReceives();
+  // Called by the socket event loop when the host socket has become readable.
+  void OnReadable();
+
+  void RegisterIOCompletionPort(uint32_t key, object_ref<XIOCompletion> port);
+
   struct packet {
     // These values are in network byte order.
     xe::be<uint16_t> src_port;
@@ -131,7 +182,29 @@ class XSocket : public XObject {
                    size_t len);
 
  private:
+  struct PendingReceive {
+    struct Buffer {
+      uint8_t* data;
+      uint32_t length;
+    };
+    std::vector<Buffer> buffers;
+    uint32_t flags;
+    XSOCKADDR_IN* from;
+    xe::be<uint32_t>* from_len;
+    uint32_t overlapped_ptr;
+    object_ref<XEvent> event;
+  };
+
   XSocket(KernelState* kernel_state, uint64_t native_handle);
+
+  // Returns false if there's no data to receive yet.
+  bool TryReceive(PendingReceive& receive, uint32_t* error_out,
+                  uint32_t* num_bytes_out);
+  void CompleteReceive(PendingReceive& receive, uint32_t error,
+                       uint32_t num_bytes);
+  // Must be called with pending_receive_mutex_ locked.
+  void AbortPendingReceives();
+
   uint64_t native_handle_ = -1;
 
   AddressFamily af_;    // Address family
@@ -147,6 +220,16 @@ class XSocket : public XObject {
   std::unique_ptr<xe::threading::Event> event_;
   std::mutex incoming_packet_mutex_;
   std::queue<uint8_t*> incoming_packets_;
+
+  std::mutex pending_receive_mutex_;
+  std::deque<PendingReceive> pending_receives_;
+  bool closed_ = false;
+  bool watched_ = false;
+  // Used when the receive is done to multiple buffers.
+  std::vector<uint8_t> receive_buffer_;
+
+  std::mutex completion_port_lock_;
+  std::vector<std::pair<uint32_t, object_ref<XIOCompletion>>> completion_ports_;
 };
 
 }  // namespace kernel
@@ -9,7 +9,10 @@
 
 #include "xenia/kernel/xthread.h"
 
+#include <array>
+#include <charconv>
 #include <cstring>
+#include <mutex>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/byte_stream.h"
@@ -19,6 +22,7 @@
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/threading.h"
+#include "xenia/base/utf8.h"
 #include "xenia/cpu/breakpoint.h"
 #include "xenia/cpu/ppc/ppc_decode_data.h"
 #include "xenia/cpu/processor.h"
@@ -32,6 +36,26 @@ DEFINE_bool(ignore_thread_priorities, true,
             "Ignores game-specified thread priorities.", "Kernel");
 DEFINE_bool(ignore_thread_affinities, true,
             "Ignores game-specified thread affinities.", "Kernel");
+DEFINE_uint32(guest_thread_host_stack_size, 16,
+              "Size of the host stack of each guest thread, in MiB. Guest code "
+              "uses its own stack in guest memory, the host stack only holds "
+              "the frames of the translated code and the kernel.",
+              "Kernel");
+DEFINE_uint32(delay_execution_spin_us, 0,
+              "Final part of KeDelayExecutionThread delays, in microseconds, "
+              "waited for by yielding the host thread rather than sleeping, as "
+              "host sleeps may end late by up to the host timer granularity. "
+              "Improves the pacing of titles that sleep to wait for the next "
+              "frame at the cost of processor time.",
+              "Kernel");
+DEFINE_string(
+    guest_cpu_host_processors, "",
+    "Comma-separated host logical processor numbers to run each of the six "
+    "guest hardware threads on when thread affinities aren't ignored. If "
+    "empty, they are picked from the host processor topology, placing the two "
+    "hardware threads of a guest core on SMT siblings of one host core if "
+    "possible.",
+    "Kernel");
 
 namespace xe {
 namespace kernel {
@@ -44,6 +68,10 @@ using xe::cpu::ppc::PPCOpcode;
 
 using namespace xe::literals;
 
+static size_t GetHostStackSize() {
+  return std::max(cvars::guest_thread_host_stack_size, uint32_t(1)) * 1_MiB;
+}
+
 uint32_t next_xthread_id_ = 0;
 
 XThread::XThread(KernelState* kernel_state)
@@ -314,6 +342,11 @@ X_STATUS XThread::Create() {
 
   // Zero all of TLS.
   memory()->Fill(tls_static_address_, tls_total_size_, 0);
+  // Same for all threads of the title, which is all that runs guest code.
+  if (module) {
+    kernel_state()->processor()->set_guest_tls_slots(tls_extended_size,
+                                                     tls_slots);
+  }
   if (tls_extended_size) {
     // If game has extended data, copy in the default values.
     assert_not_zero(tls_header->raw_data_address);
@@ -373,7 +406,7 @@ X_STATUS XThread::Create() {
   RetainHandle();
 
   xe::threading::Thread::CreationParameters params;
-  params.stack_size = 16_MiB;  // Allocate a big host stack.
+  params.stack_size = GetHostStackSize();
   params.create_suspended = true;
   thread_ = xe::threading::Thread::Create(params, [this]() {
     // Set thread ID override. This is used by logging.
@@ -752,6 +785,95 @@ void XThread::SetPriority(int32_t increment) {
   }
 }
 
+namespace {
+// Host affinity masks for the guest hardware threads, zero if there are not
+// enough host logical processors to give each its own. Derived again when the
+// game config changes guest_cpu_host_processors.
+struct HostAffinityMasks {
+  std::array<uint64_t, 6> masks;
+  void Load();
+};
+}  // namespace
+
+void HostAffinityMasks::Load() {
+  masks = {};
+  if (!cvars::guest_cpu_host_processors.empty()) {
+    auto parts = xe::utf8::split(cvars::guest_cpu_host_processors, ", ", true);
+    for (size_t i = 0; i < std::min(parts.size(), masks.size()); ++i) {
+      uint32_t processor;
+      auto [end, error] = std::from_chars(
+          parts[i].data(), parts[i].data() + parts[i].size(), processor);
+      if (error == std::errc() && processor < 64) {
+        masks[i] = uint64_t(1) << processor;
+      } else {
+        XELOGE("Invalid host processor number \"{}\" in "
+               "guest_cpu_host_processors",
+               parts[i]);
+      }
+    }
+    return;
+  }
+
+  std::vector<uint64_t> core_masks =
+      xe::threading::GetProcessorCoreAffinityMasks();
+  // Only the logical processors the emulator may run on, such as the ones of
+  // the host NUMA node chosen with host_numa_node, can be used.
+  uint64_t process_mask = xe::threading::GetProcessAffinity();
+  if (process_mask) {
+    size_t allowed_core_count = 0;
+    for (uint64_t core_mask : core_masks) {
+      core_mask &= process_mask;
+      if (core_mask) {
+        core_masks[allowed_core_count++] = core_mask;
+      }
+    }
+    core_masks.resize(allowed_core_count);
+  }
+  std::vector<uint64_t> smt_core_masks;
+  for (uint64_t core_mask : core_masks) {
+    if (xe::bit_count(core_mask) >= 2) {
+      smt_core_masks.push_back(core_mask);
+    }
+  }
+  // The first host core, usually busiest with other work, is left out if
+  // there are enough cores without it.
+  if (smt_core_masks.size() >= 3) {
+    size_t first_core = smt_core_masks.size() >= 4 ? 1 : 0;
+    for (size_t i = 0; i < masks.size(); ++i) {
+      uint64_t core_mask = smt_core_masks[first_core + i / 2];
+      if (i & 1) {
+        // The second hardware thread of the guest core goes on the sibling.
+        core_mask &= core_mask - 1;
+      }
+      masks[i] = core_mask & ~(core_mask - 1);
+    }
+  } else if (core_masks.size() >= masks.size()) {
+    size_t first_core = core_masks.size() > masks.size() ? 1 : 0;
+    for (size_t i = 0; i < masks.size(); ++i) {
+      uint64_t core_mask = core_masks[first_core + i];
+      masks[i] = core_mask & ~(core_mask - 1);
+    }
+  } else if (process_mask) {
+    if (size_t(xe::bit_count(process_mask)) >= masks.size()) {
+      for (size_t i = 0; i < masks.size(); ++i) {
+        masks[i] = process_mask & ~(process_mask - 1);
+        process_mask &= process_mask - 1;
+      }
+    }
+  } else if (xe::threading::logical_processor_count() >= masks.size()) {
+    for (size_t i = 0; i < masks.size(); ++i) {
+      masks[i] = uint64_t(1) << i;
+    }
+  }
+}
+
+static uint64_t GetHostAffinityMask(uint8_t cpu_index) {
+  static std::mutex snapshot_mutex;
+  static cvar::Snapshot<HostAffinityMasks> snapshot;
+  std::lock_guard<std::mutex> lock(snapshot_mutex);
+  return snapshot.Get().masks[cpu_index];
+}
+
 void XThread::SetAffinity(uint32_t affinity) {
   SetActiveCpu(GetFakeCpuNumber(affinity));
 }
@@ -775,9 +897,10 @@ void XThread::SetActiveCpu(uint8_t cpu_index) {
     thread_object.current_cpu = cpu_index;
   }
 
-  if (xe::threading::logical_processor_count() >= 6) {
+  uint64_t host_affinity_mask = GetHostAffinityMask(cpu_index);
+  if (host_affinity_mask) {
     if (!cvars::ignore_thread_affinities) {
-      thread_->set_affinity_mask(uint64_t(1) << cpu_index);
+      thread_->set_affinity_mask(host_affinity_mask);
     }
   } else {
     XELOGW("Too few processor cores - scheduling will be wonky");
@@ -838,33 +961,44 @@ X_STATUS XThread::Suspend(uint32_t* out_suspend_count) {
 X_STATUS XThread::Delay(uint32_t processor_mode, uint32_t alertable,
                         uint64_t interval) {
   int64_t timeout_ticks = interval;
-  uint32_t timeout_ms;
+  uint64_t delay_us;
   if (timeout_ticks > 0) {
     // Absolute time, based on January 1, 1601.
-    // TODO(benvanik): convert time to relative time.
-    assert_always();
-    timeout_ms = 0;
-  } else if (timeout_ticks < 0) {
-    // Relative time.
-    timeout_ms = uint32_t(-timeout_ticks / 10000);  // Ticks -> MS
+    uint64_t guest_time = Clock::QueryGuestSystemTime();
+    delay_us = uint64_t(timeout_ticks) > guest_time
+                   ? (uint64_t(timeout_ticks) - guest_time) / 10
+                   : 0;
   } else {
-    timeout_ms = 0;
+    // Relative time, or 0 to yield.
+    delay_us = (uint64_t(0) - uint64_t(timeout_ticks)) / 10;  // Ticks -> us
   }
-  timeout_ms = Clock::ScaleGuestDurationMillis(timeout_ms);
+  delay_us = Clock::ScaleGuestDurationMicros(delay_us);
+
+  // Sleep until close to the end of the delay, and yield for the rest.
+  uint64_t spin_us = std::min(uint64_t(cvars::delay_execution_spin_us),
+                              delay_us);
+  uint64_t deadline_tick = 0;
+  if (spin_us) {
+    uint64_t tick_frequency = Clock::QueryHostTickFrequency();
+    deadline_tick = Clock::QueryHostTickCount() +
+                    delay_us / 1000000 * tick_frequency +
+                    delay_us % 1000000 * tick_frequency / 1000000;
+  }
+  auto sleep_duration = std::chrono::microseconds(
+      std::min(delay_us - spin_us,
+               uint64_t(std::chrono::microseconds::max().count())));
   if (alertable) {
-    auto result =
-        xe::threading::AlertableSleep(std::chrono::milliseconds(timeout_ms));
-    switch (result) {
-      default:
-      case xe::threading::SleepResult::kSuccess:
-        return X_STATUS_SUCCESS;
-      case xe::threading::SleepResult::kAlerted:
-        return X_STATUS_USER_APC;
+    if (xe::threading::AlertableSleep(sleep_duration) ==
+        xe::threading::SleepResult::kAlerted) {
+      return X_STATUS_USER_APC;
     }
-  } else {
-    xe::threading::Sleep(std::chrono::milliseconds(timeout_ms));
-    return X_STATUS_SUCCESS;
+  } else if (sleep_duration.count() || !spin_us) {
+    xe::threading::Sleep(sleep_duration);
+  }
+  while (spin_us && Clock::QueryHostTickCount() < deadline_tick) {
+    xe::threading::MaybeYield();
   }
+  return X_STATUS_SUCCESS;
 }
 
 struct ThreadSavedState {
@@ -1038,7 +1172,7 @@ object_ref<XThread> XThread::Restore(KernelState* kernel_state,
 
     xe::threading::Thread::CreationParameters params;
     params.create_suspended = true;  // Not done restoring yet.
-    params.stack_size = 16_MiB;
+    params.stack_size = GetHostStackSize();
     thread->thread_ = xe::threading::Thread::Create(params, [thread, state]() {
       // Set thread ID override. This is used by logging.
       xe::threading::set_current_thread_id(thread->handle());
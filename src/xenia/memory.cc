@@ -10,10 +10,14 @@
 #include "xenia/memory.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <functional>
+#include <string>
 #include <utility>
 
 #include "third_party/fmt/include/fmt/format.h"
+#include "third_party/snappy/snappy.h"
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/clock.h"
@@ -21,6 +25,7 @@
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/threading.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/cpu/mmio_handler.h"
 
 // TODO(benvanik): move xbox.h out
@@ -32,6 +37,30 @@ DEFINE_bool(protect_on_release, false,
             "Protect released memory to prevent accesses.", "Memory");
 DEFINE_bool(scribble_heap, false,
             "Scribble 0xCD into all allocated heap memory.", "Memory");
+DEFINE_int32(
+    save_state_threads, -1,
+    "Number of threads compressing and decompressing memory pages while "
+    "saving and restoring state, including the calling thread.\n"
+    " 1 = compress on the calling thread only.\n"
+    "-1 = pick based on the number of host CPU cores.",
+    "Memory");
+DEFINE_bool(host_huge_pages, false,
+            "Back guest memory and generated code with huge host pages where "
+            "the host supports them (transparent huge pages on Linux), for "
+            "fewer TLB misses.",
+            "Memory");
+DEFINE_int32(host_numa_node, -1,
+             "Host NUMA node to allocate guest memory and generated code from "
+             "and to run all the emulator threads on, for hosts with multiple "
+             "processor sockets.\n"
+             "-1 = let the host decide.",
+             "Memory");
+DEFINE_bool(host_numa_interleave, false,
+            "Interleave guest memory and generated code between all the host "
+            "NUMA nodes, to spread the memory bandwidth between them when the "
+            "emulator threads run on all of them. Ignored if host_numa_node is "
+            "set.",
+            "Memory");
 
 namespace xe {
 uint32_t get_page_count(uint32_t value, uint32_t page_size) {
@@ -87,6 +116,8 @@ Memory::Memory() {
   system_page_size_ = uint32_t(xe::memory::page_size());
   system_allocation_granularity_ =
       uint32_t(xe::memory::allocation_granularity());
+  system_page_flags_.resize(
+      ((size_t(1) << 32) / system_page_size_ + 63) / 64);
   assert_zero(active_memory_);
   active_memory_ = this;
 }
@@ -124,6 +155,27 @@ Memory::~Memory() {
   physical_membase_ = nullptr;
 }
 
+bool Memory::PlaceOnHostNumaNodes(void* host_address, size_t length) {
+  if (cvars::host_numa_node >= 0) {
+    if (cvars::host_numa_node >= 64) {
+      return false;
+    }
+    return xe::memory::SetNumaPolicy(
+        host_address, length, uint64_t(1) << cvars::host_numa_node, false);
+  }
+  if (cvars::host_numa_interleave) {
+    size_t node_count =
+        xe::threading::GetProcessorNodeAffinityMasks().size();
+    if (!node_count) {
+      return false;
+    }
+    uint64_t node_mask =
+        node_count >= 64 ? ~uint64_t(0) : (uint64_t(1) << node_count) - 1;
+    return xe::memory::SetNumaPolicy(host_address, length, node_mask, true);
+  }
+  return true;
+}
+
 bool Memory::Initialize() {
   file_name_ = fmt::format("xenia_memory_{}", Clock::QueryHostTickCount());
 
@@ -290,6 +342,32 @@ int Memory::MapViews(uint8_t* mapping_base) {
       return 1;
     }
   }
+
+  if (cvars::host_huge_pages) {
+    size_t huge_page_size = 0;
+    size_t total_size = 0;
+    for (size_t n = 0; n < xe::countof(map_info); n++) {
+      size_t length = map_info[n].virtual_address_end -
+                      map_info[n].virtual_address_start + 1;
+      huge_page_size +=
+          xe::memory::AdviseHugePages(views_.all_views[n], length);
+      total_size += length;
+    }
+    XELOGI("Guest memory: {} of {} MB may be backed by huge host pages",
+           huge_page_size >> 20, total_size >> 20);
+  }
+
+  bool numa_placed = true;
+  for (size_t n = 0; n < xe::countof(map_info); n++) {
+    numa_placed &= PlaceOnHostNumaNodes(
+        views_.all_views[n], map_info[n].virtual_address_end -
+                                 map_info[n].virtual_address_start + 1);
+  }
+  if (!numa_placed) {
+    XELOGW(
+        "Guest memory: the host doesn't support NUMA placement, pages will be "
+        "on the nodes of the threads first touching them");
+  }
   return 0;
 }
 
@@ -382,17 +460,17 @@ uint32_t Memory::GetPhysicalAddress(uint32_t address) const {
 }
 
 void Memory::Zero(uint32_t address, uint32_t size) {
-  std::memset(TranslateVirtual(address), 0, size);
+  xe::fill_streaming(TranslateVirtual(address), 0, size);
 }
 
 void Memory::Fill(uint32_t address, uint32_t size, uint8_t value) {
-  std::memset(TranslateVirtual(address), value, size);
+  xe::fill_streaming(TranslateVirtual(address), value, size);
 }
 
 void Memory::Copy(uint32_t dest, uint32_t src, uint32_t size) {
   uint8_t* pdest = TranslateVirtual(dest);
   const uint8_t* psrc = TranslateVirtual(src);
-  std::memcpy(pdest, psrc, size);
+  xe::copy_streaming(pdest, psrc, size);
 }
 
 uint32_t Memory::SearchAligned(uint32_t start, uint32_t end,
@@ -400,23 +478,8 @@ uint32_t Memory::SearchAligned(uint32_t start, uint32_t end,
   assert_true(start <= end);
   auto p = TranslateVirtual<const uint32_t*>(start);
   auto pe = TranslateVirtual<const uint32_t*>(end);
-  while (p != pe) {
-    if (*p == values[0]) {
-      const uint32_t* pc = p + 1;
-      size_t matched = 1;
-      for (size_t n = 1; n < value_count; n++, pc++) {
-        if (*pc != values[n]) {
-          break;
-        }
-        matched++;
-      }
-      if (matched == value_count) {
-        return HostToGuestVirtual(p);
-      }
-    }
-    p++;
-  }
-  return 0;
+  const uint32_t* match = xe::search_aligned_32(p, pe, values, value_count);
+  return match ? HostToGuestVirtual(match) : 0;
 }
 
 bool Memory::AddVirtualMappedRange(uint32_t virtual_address, uint32_t mask,
@@ -452,7 +515,7 @@ bool Memory::AccessViolationCallback(
   uint32_t virtual_address = HostToGuestVirtual(host_address);
   BaseHeap* heap = LookupHeap(virtual_address);
   if (heap->heap_type() != HeapType::kGuestPhysical) {
-    return false;
+    return is_write && TriggerCodeWriteWatch(virtual_address);
   }
 
   // Access violation callbacks from the guest are triggered when the global
@@ -486,6 +549,20 @@ bool Memory::TriggerPhysicalMemoryCallbacks(
   return false;
 }
 
+bool Memory::TriggerPhysicalMemoryWriteCallbacks(void* host_address,
+                                                 uint32_t length) {
+  if (reinterpret_cast<size_t>(host_address) <
+          reinterpret_cast<size_t>(virtual_membase_) ||
+      reinterpret_cast<size_t>(host_address) >=
+          reinterpret_cast<size_t>(physical_membase_)) {
+    return false;
+  }
+  auto global_lock = global_critical_region_.Acquire();
+  return TriggerPhysicalMemoryCallbacks(std::move(global_lock),
+                                        HostToGuestVirtual(host_address),
+                                        length, true, false);
+}
+
 void* Memory::RegisterPhysicalMemoryInvalidationCallback(
     PhysicalMemoryInvalidationCallback callback, void* callback_context) {
   auto entry = new std::pair<PhysicalMemoryInvalidationCallback, void*>(
@@ -580,26 +657,43 @@ void Memory::DumpMap() {
   XELOGE("");
 }
 
-bool Memory::Save(ByteStream* stream) {
+std::unique_ptr<Memory::Snapshot> Memory::CaptureSnapshot() {
+  XELOGD("Capturing memory...");
+  auto snapshot = std::make_unique<Snapshot>();
+  heaps_.v00000000.CaptureSnapshot(&snapshot->heaps[0]);
+  heaps_.v40000000.CaptureSnapshot(&snapshot->heaps[1]);
+  heaps_.v80000000.CaptureSnapshot(&snapshot->heaps[2]);
+  heaps_.v90000000.CaptureSnapshot(&snapshot->heaps[3]);
+  heaps_.physical.CaptureSnapshot(&snapshot->heaps[4]);
+  return snapshot;
+}
+
+bool Memory::Save(ByteStream* stream, bool incremental,
+                  const Snapshot* snapshot) {
   XELOGD("Serializing memory...");
-  heaps_.v00000000.Save(stream);
-  heaps_.v40000000.Save(stream);
-  heaps_.v80000000.Save(stream);
-  heaps_.v90000000.Save(stream);
-  heaps_.physical.Save(stream);
+  heaps_.v00000000.Save(stream, incremental,
+                        snapshot ? &snapshot->heaps[0] : nullptr);
+  heaps_.v40000000.Save(stream, incremental,
+                        snapshot ? &snapshot->heaps[1] : nullptr);
+  heaps_.v80000000.Save(stream, incremental,
+                        snapshot ? &snapshot->heaps[2] : nullptr);
+  heaps_.v90000000.Save(stream, incremental,
+                        snapshot ? &snapshot->heaps[3] : nullptr);
+  heaps_.physical.Save(stream, incremental,
+                       snapshot ? &snapshot->heaps[4] : nullptr);
 
   return true;
 }
 
 bool Memory::Restore(ByteStream* stream) {
   XELOGD("Restoring memory...");
-  heaps_.v00000000.Restore(stream);
-  heaps_.v40000000.Restore(stream);
-  heaps_.v80000000.Restore(stream);
-  heaps_.v90000000.Restore(stream);
-  heaps_.physical.Restore(stream);
+  bool restored = heaps_.v00000000.Restore(stream);
+  restored = heaps_.v40000000.Restore(stream) && restored;
+  restored = heaps_.v80000000.Restore(stream) && restored;
+  restored = heaps_.v90000000.Restore(stream) && restored;
+  restored = heaps_.physical.Restore(stream) && restored;
 
-  return true;
+  return restored;
 }
 
 xe::memory::PageAccess ToPageAccess(uint32_t protect) {
@@ -634,6 +728,124 @@ uint32_t FromPageAccess(xe::memory::PageAccess protect) {
   return kMemoryProtectNoAccess;
 }
 
+// Limits the access violations taken on pages that mix code with data
+// written all the time.
+static const uint32_t kMaxCodeWatchesPerPage = 64;
+
+void Memory::SetCodeWriteCallback(CodeWriteCallback callback,
+                                  void* callback_context) {
+  auto global_lock = global_critical_region_.Acquire();
+  code_write_callback_ = callback;
+  code_write_callback_context_ = callback_context;
+}
+
+void Memory::WatchCodeWrites(uint32_t virtual_address, uint32_t length) {
+  if (!length) {
+    return;
+  }
+  BaseHeap* heap = LookupHeap(virtual_address);
+  if (!heap || (heap->heap_type() != HeapType::kGuestVirtual &&
+                heap->heap_type() != HeapType::kGuestXex)) {
+    return;
+  }
+  auto global_lock = global_critical_region_.Acquire();
+  if (!code_write_callback_) {
+    return;
+  }
+  if (code_watched_pages_.empty()) {
+    code_watched_pages_.resize(
+        ((uint64_t(1) << 32) / system_page_size_ + 63) / 64);
+  }
+  uint32_t first_page = virtual_address / system_page_size_;
+  uint32_t last_page =
+      uint32_t((uint64_t(virtual_address) + length - 1) / system_page_size_);
+  xe::memory::ProtectionBatch protection_batch;
+  for (uint32_t page = first_page; page <= last_page; ++page) {
+    uint64_t page_bit = uint64_t(1) << (page & 63);
+    if (code_watched_pages_[page >> 6] & page_bit) {
+      continue;
+    }
+    uint32_t page_address = page * system_page_size_;
+    // Writes to pages the guest can't write to fault anyway.
+    uint32_t protect;
+    if (!heap->QueryProtect(page_address, &protect) ||
+        !(protect & kMemoryProtectWrite)) {
+      continue;
+    }
+    uint32_t& watch_count = code_watch_counts_[page];
+    if (watch_count >= kMaxCodeWatchesPerPage) {
+      continue;
+    }
+    if (++watch_count == kMaxCodeWatchesPerPage) {
+      XELOGW(
+          "Code in the page at {:08X} keeps being overwritten, not watching "
+          "it for writes anymore",
+          page_address);
+    }
+    protection_batch.Add(TranslateVirtual(page_address), system_page_size_,
+                         xe::memory::PageAccess::kReadOnly);
+    code_watched_pages_[page >> 6] |= page_bit;
+  }
+}
+
+bool Memory::TriggerCodeWriteWatch(uint32_t virtual_address,
+                                   xe::memory::ProtectionBatch* batch) {
+  uint32_t page = virtual_address / system_page_size_;
+  uint64_t page_bit = uint64_t(1) << (page & 63);
+  if (code_watched_pages_.empty() ||
+      !(code_watched_pages_[page >> 6] & page_bit)) {
+    return false;
+  }
+  code_watched_pages_[page >> 6] &= ~page_bit;
+  uint32_t page_address = page * system_page_size_;
+  uint32_t protect = kMemoryProtectRead | kMemoryProtectWrite;
+  LookupHeap(page_address)->QueryProtect(page_address, &protect);
+  if (batch) {
+    batch->Add(TranslateVirtual(page_address), system_page_size_,
+               ToPageAccess(protect));
+  } else {
+    xe::memory::Protect(TranslateVirtual(page_address), system_page_size_,
+                        ToPageAccess(protect), nullptr);
+  }
+  if (code_write_callback_) {
+    code_write_callback_(code_write_callback_context_, page_address,
+                         system_page_size_);
+  }
+  return true;
+}
+
+void Memory::TriggerCodeWriteWatches(uint32_t virtual_address,
+                                     uint32_t length) {
+  if (code_watched_pages_.empty() || !length) {
+    return;
+  }
+  uint32_t first_page = virtual_address / system_page_size_;
+  uint32_t last_page =
+      uint32_t((uint64_t(virtual_address) + length - 1) / system_page_size_);
+  xe::memory::ProtectionBatch protection_batch;
+  for (uint32_t page = first_page; page <= last_page; ++page) {
+    TriggerCodeWriteWatch(page * system_page_size_, &protection_batch);
+  }
+}
+
+void Memory::ReapplyCodeWriteWatches(uint32_t virtual_address,
+                                     uint32_t length) {
+  if (code_watched_pages_.empty() || !length) {
+    return;
+  }
+  uint32_t first_page = virtual_address / system_page_size_;
+  uint32_t last_page =
+      uint32_t((uint64_t(virtual_address) + length - 1) / system_page_size_);
+  xe::memory::ProtectionBatch protection_batch;
+  for (uint32_t page = first_page; page <= last_page; ++page) {
+    if (code_watched_pages_[page >> 6] & (uint64_t(1) << (page & 63))) {
+      protection_batch.Add(TranslateVirtual(page * system_page_size_),
+                           system_page_size_,
+                           xe::memory::PageAccess::kReadOnly);
+    }
+  }
+}
+
 BaseHeap::BaseHeap()
     : membase_(nullptr), heap_base_(0), heap_size_(0), page_size_(0) {}
 
@@ -650,6 +862,77 @@ void BaseHeap::Initialize(Memory* memory, uint8_t* membase, HeapType heap_type,
   page_size_ = page_size;
   host_address_offset_ = host_address_offset;
   page_table_.resize(heap_size / page_size);
+  RebuildFreeExtents();
+  page_hashes_.clear();
+  page_hashes_.resize(page_table_.size());
+}
+
+void BaseHeap::MarkPagesReserved(uint32_t start_page_number,
+                                 uint32_t page_count) {
+  uint32_t end_page_number = start_page_number + page_count;
+  auto it = free_extents_.upper_bound(start_page_number);
+  if (it != free_extents_.begin()) {
+    auto previous = std::prev(it);
+    if (previous->first + previous->second > start_page_number) {
+      it = previous;
+    }
+  }
+  // Cut the range out of every free extent it overlaps, keeping whatever is
+  // left on either side.
+  while (it != free_extents_.end() && it->first < end_page_number) {
+    uint32_t extent_start = it->first;
+    uint32_t extent_end = it->first + it->second;
+    it = free_extents_.erase(it);
+    if (extent_start < start_page_number) {
+      free_extents_.emplace(extent_start, start_page_number - extent_start);
+    }
+    if (extent_end > end_page_number) {
+      it = free_extents_.emplace(end_page_number, extent_end - end_page_number)
+               .first;
+      break;
+    }
+  }
+}
+
+void BaseHeap::MarkPagesFree(uint32_t start_page_number, uint32_t page_count) {
+  uint32_t new_start = start_page_number;
+  uint32_t new_end = start_page_number + page_count;
+  auto it = free_extents_.upper_bound(start_page_number);
+  if (it != free_extents_.begin()) {
+    auto previous = std::prev(it);
+    if (previous->first + previous->second >= new_start) {
+      new_start = previous->first;
+      new_end = std::max(new_end, previous->first + previous->second);
+      free_extents_.erase(previous);
+    }
+  }
+  // Merge with the following extents that overlap or touch the range.
+  while (it != free_extents_.end() && it->first <= new_end) {
+    new_end = std::max(new_end, it->first + it->second);
+    it = free_extents_.erase(it);
+  }
+  free_extents_.emplace(new_start, new_end - new_start);
+}
+
+void BaseHeap::RebuildFreeExtents() {
+  free_extents_.clear();
+  uint32_t page_count = uint32_t(page_table_.size());
+  uint32_t extent_start = UINT_MAX;
+  for (uint32_t i = 0; i < page_count; ++i) {
+    if (!page_table_[i].state) {
+      if (extent_start == UINT_MAX) {
+        extent_start = i;
+      }
+    } else if (extent_start != UINT_MAX) {
+      free_extents_.emplace_hint(free_extents_.end(), extent_start,
+                                 i - extent_start);
+      extent_start = UINT_MAX;
+    }
+  }
+  if (extent_start != UINT_MAX) {
+    free_extents_.emplace_hint(free_extents_.end(), extent_start,
+                               page_count - extent_start);
+  }
 }
 
 void BaseHeap::Dispose() {
@@ -721,54 +1004,207 @@ uint32_t BaseHeap::GetTotalPageCount() { return uint32_t(page_table_.size()); }
 uint32_t BaseHeap::GetUnreservedPageCount() {
   auto global_lock = global_critical_region_.Acquire();
   uint32_t count = 0;
-  bool is_empty_span = false;
-  uint32_t empty_span_start = 0;
-  uint32_t size = uint32_t(page_table_.size());
-  for (uint32_t i = 0; i < size; ++i) {
-    auto& page = page_table_[i];
-    if (!page.state) {
-      if (!is_empty_span) {
-        is_empty_span = true;
-        empty_span_start = i;
-      }
-      continue;
+  for (const auto& extent : free_extents_) {
+    count += extent.second;
+  }
+  return count;
+}
+
+namespace {
+
+// Committed pages are saved in blocks of about this size, compressed
+// independently so blocks can be processed on separate threads.
+constexpr size_t kSaveStateBlockSize = 256 * 1024;
+
+// Stored for every committed page before the compressed data of its block.
+enum class SavedPageKind : uint8_t {
+  // All bytes are zero, not in the compressed data.
+  kZero,
+  // Same as in the previous snapshot, not in the compressed data.
+  kUnchanged,
+  // In the compressed data.
+  kData,
+};
+
+// Calls the function for every index on up to save_state_threads threads,
+// including the calling one.
+void ParallelForEachSaveStateBlock(
+    size_t count, const std::function<void(size_t index)>& fn) {
+  uint32_t thread_count = cvars::save_state_threads >= 0
+                              ? uint32_t(cvars::save_state_threads)
+                              : xe::threading::logical_processor_count();
+  thread_count = uint32_t(
+      std::min(size_t(std::max(thread_count, uint32_t(1))), count));
+  if (thread_count <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      fn(i);
     }
-    if (is_empty_span) {
-      is_empty_span = false;
-      count += i - empty_span_start;
+    return;
+  }
+  std::atomic<size_t> next_index(0);
+  auto work = [&]() {
+    size_t i;
+    while ((i = next_index.fetch_add(1, std::memory_order_relaxed)) < count) {
+      fn(i);
     }
-    i += page.region_page_count - 1;
+  };
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads;
+  for (uint32_t i = 1; i < thread_count; ++i) {
+    auto thread = xe::threading::Thread::Create({}, [&work]() { work(); });
+    if (!thread) {
+      break;
+    }
+    thread->set_name("Save State Worker");
+    threads.push_back(std::move(thread));
   }
-  if (is_empty_span) {
-    count += size - empty_span_start;
+  work();
+  for (auto& thread : threads) {
+    xe::threading::Wait(thread.get(), false);
   }
-  return count;
 }
 
-bool BaseHeap::Save(ByteStream* stream) {
-  XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
+bool IsZeroPage(const uint8_t* data, size_t length) {
+  auto words = reinterpret_cast<const uint64_t*>(data);
+  for (size_t i = 0; i < length / sizeof(uint64_t); ++i) {
+    if (words[i]) {
+      return false;
+    }
+  }
+  return true;
+}
 
-  for (size_t i = 0; i < page_table_.size(); i++) {
-    auto& page = page_table_[i];
-    stream->Write(page.qword);
-    if (!page.state) {
-      // Unallocated.
+}  // namespace
+
+void BaseHeap::CaptureSnapshot(Snapshot* snapshot) {
+  snapshot->page_table = page_table_;
+  std::vector<uint32_t> committed_pages;
+  memory::ProtectionBatch protection_batch;
+  for (uint32_t i = 0; i < uint32_t(page_table_.size()); ++i) {
+    const PageEntry& page = page_table_[i];
+    if (!(page.state & kMemoryAllocationCommit)) {
       continue;
     }
+    committed_pages.push_back(i);
+    // Only pages the guest can't read need their protection changed to be
+    // copied.
+    if (!(page.current_protect & kMemoryProtectRead)) {
+      protection_batch.Add(TranslateRelative(i * page_size_), page_size_,
+                           memory::PageAccess::kReadOnly);
+    }
+  }
+  protection_batch.Apply();
+
+  snapshot->committed_page_data.resize(committed_pages.size() * page_size_);
+  size_t pages_per_block =
+      std::max(kSaveStateBlockSize / page_size_, size_t(1));
+  size_t block_count =
+      (committed_pages.size() + pages_per_block - 1) / pages_per_block;
+  ParallelForEachSaveStateBlock(block_count, [&](size_t block_index) {
+    size_t first_page = block_index * pages_per_block;
+    size_t block_page_count =
+        std::min(pages_per_block, committed_pages.size() - first_page);
+    for (size_t i = first_page; i < first_page + block_page_count; ++i) {
+      std::memcpy(snapshot->committed_page_data.data() + i * page_size_,
+                  TranslateRelative(committed_pages[i] * page_size_),
+                  page_size_);
+    }
+  });
 
-    // TODO(DrChat): write compressed with snappy.
-    if (page.state & kMemoryAllocationCommit) {
-      void* addr = TranslateRelative(i * page_size_);
-
-      memory::PageAccess old_access;
-      memory::Protect(addr, page_size_, memory::PageAccess::kReadWrite,
-                      &old_access);
+  for (uint32_t page_number : committed_pages) {
+    uint32_t protect = page_table_[page_number].current_protect;
+    if (!(protect & kMemoryProtectRead)) {
+      protection_batch.Add(TranslateRelative(page_number * page_size_),
+                           page_size_, ToPageAccess(protect));
+    }
+  }
+}
 
-      stream->Write(addr, page_size_);
+bool BaseHeap::Save(ByteStream* stream, bool incremental,
+                    const Snapshot* snapshot) {
+  XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
 
-      memory::Protect(addr, page_size_, old_access, nullptr);
+  const std::vector<PageEntry>& page_table =
+      snapshot ? snapshot->page_table : page_table_;
+  stream->Write(page_table.data(), sizeof(PageEntry) * page_table.size());
+  stream->Write(incremental);
+
+  std::vector<uint32_t> committed_pages;
+  memory::ProtectionBatch protection_batch;
+  for (uint32_t i = 0; i < uint32_t(page_table.size()); ++i) {
+    const PageEntry& page = page_table[i];
+    if (!(page.state & kMemoryAllocationCommit)) {
+      page_hashes_[i] = 0;
+      continue;
+    }
+    committed_pages.push_back(i);
+    // Only pages the guest can't read need their protection changed to be
+    // copied.
+    if (!snapshot && !(page.current_protect & kMemoryProtectRead)) {
+      protection_batch.Add(TranslateRelative(i * page_size_), page_size_,
+                           memory::PageAccess::kReadOnly);
     }
   }
+  protection_batch.Apply();
+
+  size_t pages_per_block =
+      std::max(kSaveStateBlockSize / page_size_, size_t(1));
+  size_t block_count =
+      (committed_pages.size() + pages_per_block - 1) / pages_per_block;
+  std::vector<std::string> blocks(block_count);
+  ParallelForEachSaveStateBlock(block_count, [&](size_t block_index) {
+    size_t first_page = block_index * pages_per_block;
+    size_t block_page_count =
+        std::min(pages_per_block, committed_pages.size() - first_page);
+    std::string& block = blocks[block_index];
+    block.resize(block_page_count);
+    std::string data;
+    for (size_t i = 0; i < block_page_count; ++i) {
+      uint32_t page_number = committed_pages[first_page + i];
+      const uint8_t* page_data;
+      if (snapshot) {
+        page_data = snapshot->committed_page_data.data() +
+                    (first_page + i) * page_size_;
+      } else {
+        page_data = TranslateRelative<const uint8_t*>(page_number * page_size_);
+      }
+      SavedPageKind kind = SavedPageKind::kZero;
+      uint64_t hash = 0;
+      if (!IsZeroPage(page_data, page_size_)) {
+        hash = XXH3_64bits(page_data, page_size_);
+        if (incremental && page_hashes_[page_number] == hash) {
+          kind = SavedPageKind::kUnchanged;
+        } else {
+          kind = SavedPageKind::kData;
+          data.append(reinterpret_cast<const char*>(page_data), page_size_);
+        }
+      }
+      page_hashes_[page_number] = hash;
+      block[i] = char(kind);
+    }
+    std::string compressed;
+    if (!data.empty()) {
+      snappy::Compress(data.data(), data.size(), &compressed);
+    }
+    uint32_t compressed_size = uint32_t(compressed.size());
+    block.append(reinterpret_cast<const char*>(&compressed_size),
+                 sizeof(compressed_size));
+    block.append(compressed);
+  });
+
+  if (!snapshot) {
+    for (uint32_t page_number : committed_pages) {
+      uint32_t protect = page_table_[page_number].current_protect;
+      if (!(protect & kMemoryProtectRead)) {
+        protection_batch.Add(TranslateRelative(page_number * page_size_),
+                             page_size_, ToPageAccess(protect));
+      }
+    }
+    protection_batch.Apply();
+  }
+
+  for (const std::string& block : blocks) {
+    stream->Write(block.data(), block.size());
+  }
 
   return true;
 }
@@ -776,42 +1212,120 @@ bool BaseHeap::Save(ByteStream* stream) {
 bool BaseHeap::Restore(ByteStream* stream) {
   XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
 
-  for (size_t i = 0; i < page_table_.size(); i++) {
-    auto& page = page_table_[i];
-    page.qword = stream->Read<uint64_t>();
-    if (!page.state) {
-      // Unallocated.
-      continue;
+  stream->Read(page_table_.data(), sizeof(PageEntry) * page_table_.size());
+  bool incremental = stream->Read<bool>();
+  RebuildFreeExtents();
+
+  std::vector<uint32_t> committed_pages;
+  for (uint32_t i = 0; i < uint32_t(page_table_.size()); ++i) {
+    if (page_table_[i].state & kMemoryAllocationCommit) {
+      committed_pages.push_back(i);
+    } else {
+      page_hashes_[i] = 0;
     }
+  }
 
-    memory::PageAccess page_access = memory::PageAccess::kNoAccess;
-    if ((page.current_protect & kMemoryProtectRead) &&
-        (page.current_protect & kMemoryProtectWrite)) {
-      page_access = memory::PageAccess::kReadWrite;
-    } else if (page.current_protect & kMemoryProtectRead) {
-      page_access = memory::PageAccess::kReadOnly;
+  // Find where each block is so they can be decompressed in parallel.
+  struct SavedBlock {
+    const uint8_t* page_kinds;
+    const char* compressed_data;
+    uint32_t compressed_size;
+  };
+  size_t pages_per_block =
+      std::max(kSaveStateBlockSize / page_size_, size_t(1));
+  size_t block_count =
+      (committed_pages.size() + pages_per_block - 1) / pages_per_block;
+  std::vector<SavedBlock> blocks(block_count);
+  for (size_t i = 0; i < block_count; ++i) {
+    SavedBlock& block = blocks[i];
+    size_t block_page_count =
+        std::min(pages_per_block, committed_pages.size() - i * pages_per_block);
+    if (stream->data_length() - stream->offset() <
+        block_page_count + sizeof(uint32_t)) {
+      XELOGE("BaseHeap::Restore: saved pages are truncated");
+      return false;
+    }
+    block.page_kinds = stream->data() + stream->offset();
+    stream->Advance(block_page_count);
+    block.compressed_size = stream->Read<uint32_t>();
+    if (stream->data_length() - stream->offset() < block.compressed_size) {
+      XELOGE("BaseHeap::Restore: saved pages are truncated");
+      return false;
+    }
+    block.compressed_data =
+        reinterpret_cast<const char*>(stream->data() + stream->offset());
+    stream->Advance(block.compressed_size);
+  }
+
+  std::atomic<bool> corrupted(false);
+  ParallelForEachSaveStateBlock(block_count, [&](size_t block_index) {
+    const SavedBlock& block = blocks[block_index];
+    size_t first_page = block_index * pages_per_block;
+    size_t block_page_count =
+        std::min(pages_per_block, committed_pages.size() - first_page);
+    size_t data_page_count = 0;
+    for (size_t i = 0; i < block_page_count; ++i) {
+      auto kind = SavedPageKind(block.page_kinds[i]);
+      if (kind == SavedPageKind::kData) {
+        ++data_page_count;
+      } else if (kind != SavedPageKind::kZero &&
+                 (kind != SavedPageKind::kUnchanged || !incremental)) {
+        corrupted = true;
+        return;
+      }
+    }
+    std::vector<uint8_t> data(data_page_count * page_size_);
+    size_t uncompressed_size;
+    if (data_page_count &&
+        (!snappy::GetUncompressedLength(block.compressed_data,
+                                        block.compressed_size,
+                                        &uncompressed_size) ||
+         uncompressed_size != data.size() ||
+         !snappy::RawUncompress(block.compressed_data, block.compressed_size,
+                                reinterpret_cast<char*>(data.data())))) {
+      corrupted = true;
+      return;
     }
 
     // Commit the memory if it isn't already. We do not need to reserve any
-    // memory, as the mapping has already taken care of that.
-    if (page.state & kMemoryAllocationCommit) {
-      xe::memory::AllocFixed(TranslateRelative(i * page_size_), page_size_,
-                             memory::AllocationType::kCommit,
-                             memory::PageAccess::kReadWrite);
+    // memory, as the mapping has already taken care of that. Pages that are
+    // unchanged were committed for the previous snapshot.
+    memory::ProtectionBatch protection_batch;
+    for (size_t i = 0; i < block_page_count; ++i) {
+      if (SavedPageKind(block.page_kinds[i]) != SavedPageKind::kUnchanged) {
+        void* addr = TranslateRelative(committed_pages[first_page + i] *
+                                       page_size_);
+        xe::memory::AllocFixed(addr, page_size_,
+                               memory::AllocationType::kCommit,
+                               memory::PageAccess::kReadWrite);
+        protection_batch.Add(addr, page_size_, memory::PageAccess::kReadWrite);
+      }
     }
-
-    // Now read into memory. We'll set R/W protection first, then set the
-    // protection back to its previous state.
-    // TODO(DrChat): read compressed with snappy.
-    if (page.state & kMemoryAllocationCommit) {
-      void* addr = TranslateRelative(i * page_size_);
-      xe::memory::Protect(addr, page_size_, memory::PageAccess::kReadWrite,
-                          nullptr);
-
-      stream->Read(addr, page_size_);
-
-      xe::memory::Protect(addr, page_size_, page_access, nullptr);
+    protection_batch.Apply();
+
+    const uint8_t* page_data = data.data();
+    for (size_t i = 0; i < block_page_count; ++i) {
+      uint32_t page_number = committed_pages[first_page + i];
+      auto kind = SavedPageKind(block.page_kinds[i]);
+      void* addr = TranslateRelative(page_number * page_size_);
+      if (kind != SavedPageKind::kUnchanged) {
+        if (kind == SavedPageKind::kData) {
+          std::memcpy(addr, page_data, page_size_);
+          page_hashes_[page_number] = XXH3_64bits(page_data, page_size_);
+          page_data += page_size_;
+        } else {
+          std::memset(addr, 0, page_size_);
+          page_hashes_[page_number] = 0;
+        }
+      }
+      protection_batch.Add(
+          addr, page_size_,
+          ToPageAccess(page_table_[page_number].current_protect));
     }
+  });
+  if (corrupted) {
+    XELOGE("BaseHeap::Restore: saved pages are corrupted");
+    return false;
   }
 
   return true;
@@ -820,6 +1334,8 @@ bool BaseHeap::Restore(ByteStream* stream) {
 void BaseHeap::Reset() {
   // TODO(DrChat): protect pages.
   std::memset(page_table_.data(), 0, sizeof(PageEntry) * page_table_.size());
+  RebuildFreeExtents();
+  std::fill(page_hashes_.begin(), page_hashes_.end(), uint64_t(0));
   // TODO(Triang3l): Remove access callbacks from pages if this is a physical
   // memory heap.
 }
@@ -915,6 +1431,7 @@ bool BaseHeap::AllocFixed(uint32_t base_address, uint32_t size,
     page_entry.current_protect = protect;
     page_entry.state = kMemoryAllocationReserve | allocation_type;
   }
+  MarkPagesReserved(start_page_number, page_count);
 
   return true;
 }
@@ -956,83 +1473,62 @@ bool BaseHeap::AllocRange(uint32_t low_address, uint32_t high_address,
   auto global_lock = global_critical_region_.Acquire();
 
   // Find a free page range.
-  // The base page must match the requested alignment, so we first scan for
-  // a free aligned page and only then check for continuous free pages.
-  // TODO(benvanik): optimized searching (free list buckets, bitmap, etc).
+  // The base page must match the requested alignment, so each free extent
+  // that may hold the range is checked for an aligned base page with enough
+  // free pages after it, skipping over reserved regions entirely.
   uint32_t start_page_number = UINT_MAX;
   uint32_t end_page_number = UINT_MAX;
   uint32_t page_scan_stride = alignment / page_size_;
   high_page_number = high_page_number - (high_page_number % page_scan_stride);
   if (top_down) {
-    for (int64_t base_page_number =
-             high_page_number - xe::round_up(page_count, page_scan_stride);
-         base_page_number >= low_page_number;
-         base_page_number -= page_scan_stride) {
-      if (page_table_[base_page_number].state != 0) {
-        // Base page not free, skip to next usable page.
-        continue;
+    int64_t highest_base_page_number =
+        int64_t(high_page_number) - xe::round_up(page_count, page_scan_stride);
+    auto it = free_extents_.begin();
+    if (highest_base_page_number >= 0) {
+      it = free_extents_.upper_bound(uint32_t(highest_base_page_number));
+    }
+    while (it != free_extents_.begin()) {
+      --it;
+      uint32_t extent_end = it->first + it->second;
+      if (extent_end <= low_page_number) {
+        break;
       }
-      // Check requested range to ensure free.
-      start_page_number = uint32_t(base_page_number);
-      end_page_number = uint32_t(base_page_number) + page_count - 1;
-      assert_true(end_page_number < page_table_.size());
-      bool any_taken = false;
-      for (uint32_t page_number = uint32_t(base_page_number);
-           !any_taken && page_number <= end_page_number; ++page_number) {
-        bool is_free = page_table_[page_number].state == 0;
-        if (!is_free) {
-          // At least one page in the range is used, skip to next.
-          // We know we'll be starting at least before this page.
-          any_taken = true;
-          if (page_count > page_number) {
-            // Not enough space left to fit entire page range. Breaks outer
-            // loop.
-            base_page_number = -1;
-          } else {
-            base_page_number = page_number - page_count;
-            base_page_number -= base_page_number % page_scan_stride;
-            base_page_number += page_scan_stride;  // cancel out loop logic
-          }
-          break;
-        }
+      if (it->second < page_count) {
+        continue;
       }
-      if (!any_taken) {
-        // Found our place.
+      int64_t base_page_number = std::min(highest_base_page_number,
+                                          int64_t(extent_end - page_count));
+      base_page_number -= base_page_number % page_scan_stride;
+      if (base_page_number >= int64_t(std::max(it->first, low_page_number))) {
+        start_page_number = uint32_t(base_page_number);
+        end_page_number = start_page_number + page_count - 1;
         break;
       }
-      // Retry.
-      start_page_number = end_page_number = UINT_MAX;
     }
-  } else {
-    for (uint32_t base_page_number = low_page_number;
-         base_page_number <= high_page_number - page_count;
-         base_page_number += page_scan_stride) {
-      if (page_table_[base_page_number].state != 0) {
-        // Base page not free, skip to next usable page.
-        continue;
+  } else if (high_page_number >= page_count) {
+    uint32_t highest_base_page_number = high_page_number - page_count;
+    auto it = free_extents_.upper_bound(low_page_number);
+    if (it != free_extents_.begin()) {
+      auto previous = std::prev(it);
+      if (previous->first + previous->second > low_page_number) {
+        it = previous;
       }
-      // Check requested range to ensure free.
-      start_page_number = base_page_number;
-      end_page_number = base_page_number + page_count - 1;
-      bool any_taken = false;
-      for (uint32_t page_number = base_page_number;
-           !any_taken && page_number <= end_page_number; ++page_number) {
-        bool is_free = page_table_[page_number].state == 0;
-        if (!is_free) {
-          // At least one page in the range is used, skip to next.
-          // We know we'll be starting at least after this page.
-          any_taken = true;
-          base_page_number = xe::round_up(page_number + 1, page_scan_stride);
-          base_page_number -= page_scan_stride;  // cancel out loop logic
-          break;
-        }
+    }
+    for (; it != free_extents_.end() && it->first <= highest_base_page_number;
+         ++it) {
+      if (it->second < page_count) {
+        continue;
       }
-      if (!any_taken) {
-        // Found our place.
+      uint32_t base_page_number =
+          low_page_number +
+          xe::round_up(std::max(it->first, low_page_number) - low_page_number,
+                       page_scan_stride, false);
+      if (base_page_number <= highest_base_page_number &&
+          base_page_number + page_count <= it->first + it->second) {
+        start_page_number = base_page_number;
+        end_page_number = base_page_number + page_count - 1;
         break;
       }
-      // Retry.
-      start_page_number = end_page_number = UINT_MAX;
     }
   }
   if (start_page_number == UINT_MAX || end_page_number == UINT_MAX) {
@@ -1071,6 +1567,7 @@ bool BaseHeap::AllocRange(uint32_t low_address, uint32_t high_address,
     page_entry.current_protect = protect;
     page_entry.state = kMemoryAllocationReserve | allocation_type;
   }
+  MarkPagesReserved(start_page_number, page_count);
 
   *out_address = heap_base_ + (start_page_number * page_size_);
   return true;
@@ -1147,6 +1644,11 @@ bool BaseHeap::Release(uint32_t base_address, uint32_t* out_region_size) {
     PLOGE("BaseHeap::Release failed due to host VirtualFree failure");
     return false;
   }*/
+  // Code translated from the region is gone with it.
+  memory_->TriggerCodeWriteWatches(
+      heap_base_ + base_page_number * page_size_,
+      base_page_entry.region_page_count * page_size_);
+
   // Instead, we just protect it, if we can.
   if (page_size_ == xe::memory::page_size() ||
       ((base_page_entry.region_page_count * page_size_) %
@@ -1173,6 +1675,7 @@ bool BaseHeap::Release(uint32_t base_address, uint32_t* out_region_size) {
     auto& page_entry = page_table_[page_number];
     page_entry.qword = 0;
   }
+  MarkPagesFree(base_page_number, base_page_entry.region_page_count);
 
   return true;
 }
@@ -1260,6 +1763,12 @@ bool BaseHeap::Protect(uint32_t address, uint32_t size, uint32_t protect,
     page_entry.current_protect = protect;
   }
 
+  // The host protection of watched code pages has just been replaced.
+  if (protect & kMemoryProtectWrite) {
+    memory_->ReapplyCodeWriteWatches(
+        heap_base_ + start_page_number * page_size_, page_count * page_size_);
+  }
+
   return true;
 }
 
@@ -1411,7 +1920,11 @@ void PhysicalHeap::Initialize(Memory* memory, uint8_t* membase,
   system_page_count_ =
       (size_t(heap_size_) + host_address_offset + (system_page_size_ - 1)) /
       system_page_size_;
-  system_page_flags_.resize((system_page_count_ + 63) / 64);
+  // The view takes a whole number of flag blocks in the array shared by all
+  // views.
+  assert_zero((heap_base / system_page_size_) & 63);
+  system_page_flags_ =
+      &memory->system_page_flags_[(heap_base / system_page_size_) >> 6];
 }
 
 bool PhysicalHeap::Alloc(uint32_t size, uint32_t alignment,
@@ -11,9 +11,11 @@
 #define XENIA_MEMORY_H_
 
 #include <cstdint>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -187,7 +189,22 @@ class BaseHeap {
   xe::memory::PageAccess QueryRangeAccess(uint32_t low_address,
                                           uint32_t high_address);
 
-  bool Save(ByteStream* stream);
+  // Copy of the page table and the committed pages of the heap, so the heap
+  // can be saved while the guest keeps running.
+  struct Snapshot {
+    std::vector<PageEntry> page_table;
+    // Committed pages in the order of their page numbers.
+    std::vector<uint8_t> committed_page_data;
+  };
+  void CaptureSnapshot(Snapshot* snapshot);
+
+  // Writes the page table and the committed pages, compressed, from the heap
+  // or from a snapshot captured from it. If incremental, pages that haven't
+  // changed since the previous Save or Restore of the heap are only marked as
+  // unchanged, and restoring the snapshot is valid only when the heap holds
+  // the state of that previous snapshot.
+  bool Save(ByteStream* stream, bool incremental = false,
+            const Snapshot* snapshot = nullptr);
   bool Restore(ByteStream* stream);
 
   void Reset();
@@ -199,6 +216,14 @@ class BaseHeap {
                   uint32_t heap_base, uint32_t heap_size, uint32_t page_size,
                   uint32_t host_address_offset = 0);
 
+  // Keep free_extents_ in sync with page entries changing between free and
+  // reserved. Must be called with the global lock held.
+  void MarkPagesReserved(uint32_t start_page_number, uint32_t page_count);
+  void MarkPagesFree(uint32_t start_page_number, uint32_t page_count);
+  // Recreates free_extents_ from page_table_, after the whole table has
+  // changed.
+  void RebuildFreeExtents();
+
   Memory* memory_;
   uint8_t* membase_;
   HeapType heap_type_;
@@ -208,6 +233,13 @@ class BaseHeap {
   uint32_t host_address_offset_;
   xe::global_critical_region global_critical_region_;
   std::vector<PageEntry> page_table_;
+  // Runs of free pages in page_table_, as start page number to page count,
+  // so allocations skip over reserved regions instead of scanning each page.
+  // Adjacent runs are always merged.
+  std::map<uint32_t, uint32_t> free_extents_;
+  // Hashes of the committed pages as of the last Save or Restore, 0 if not
+  // known or if the page was all zeros, for incremental snapshots.
+  std::vector<uint64_t> page_hashes_;
 };
 
 // Normal heap allowing allocations from guest virtual address ranges.
@@ -263,20 +295,22 @@ class PhysicalHeap : public BaseHeap {
 
   uint32_t GetPhysicalAddress(uint32_t address) const;
 
+  struct SystemPageFlagsBlock {
+    // Whether writing to each page should result trigger invalidation
+    // callbacks.
+    uint64_t notify_on_invalidation;
+  };
+
  protected:
   VirtualHeap* parent_heap_;
 
   uint32_t system_page_size_;
   uint32_t system_page_count_;
 
-  struct SystemPageFlagsBlock {
-    // Whether writing to each page should result trigger invalidation
-    // callbacks.
-    uint64_t notify_on_invalidation;
-  };
   // Protected by global_critical_region. Flags for each 64 system pages,
   // interleaved as blocks, so bit scan can be used to quickly extract ranges.
-  std::vector<SystemPageFlagsBlock> system_page_flags_;
+  // A part of Memory::system_page_flags_, the flags of all physical views.
+  SystemPageFlagsBlock* system_page_flags_ = nullptr;
 };
 
 // Models the entire guest memory system on the console.
@@ -306,6 +340,11 @@ class Memory {
   // Resets all memory to zero and resets all allocations.
   void Reset();
 
+  // Sets up the allocation of the host pages backing the range from the host
+  // NUMA nodes chosen with host_numa_node or host_numa_interleave, if any.
+  // Returns false if a placement was chosen, but the host doesn't support it.
+  static bool PlaceOnHostNumaNodes(void* host_address, size_t length);
+
   // Full file name and path of the memory-mapped file backing all memory.
   const std::filesystem::path& file_name() const { return file_name_; }
 
@@ -448,6 +487,34 @@ class Memory {
       uint32_t virtual_address, uint32_t length, bool is_write,
       bool unwatch_exact_range, bool unprotect = true);
 
+  // Write watch flags of all system pages of the guest virtual address space,
+  // indexed by the offset of the host address from virtual_membase() divided
+  // by the system page size. Only pages of physical memory views are ever
+  // watched. May be read without locking to quickly check whether a store
+  // needs to trigger the callbacks, as if it was a stale result, the store
+  // still triggers them through an access violation.
+  const PhysicalHeap::SystemPageFlagsBlock* system_page_flags() const {
+    return system_page_flags_.data();
+  }
+  // Triggers the watch callbacks for a store to the host address in the
+  // virtual memory mapping, like an access violation would, but without
+  // taking one. The global critical region must not be locked.
+  bool TriggerPhysicalMemoryWriteCallbacks(void* host_address,
+                                           uint32_t length);
+
+  // Code write watches on guest virtual memory outside the physical memory
+  // views, for invalidating translated code when the guest overwrites it.
+  // The host pages are protected from writing until the first write to them,
+  // which calls the callback with the global critical region locked and lets
+  // the write through. Pages are watched again once code is translated from
+  // them again, up to a limit per page, so pages mixing code with frequently
+  // written data stop being watched.
+  typedef void (*CodeWriteCallback)(void* context, uint32_t virtual_address,
+                                    uint32_t length);
+  void SetCodeWriteCallback(CodeWriteCallback callback,
+                            void* callback_context);
+  void WatchCodeWrites(uint32_t virtual_address, uint32_t length);
+
   // Allocates virtual memory from the 'system' heap.
   // System memory is kept separate from game memory but is still accessible
   // using normal guest virtual addresses. Kernel structures and other internal
@@ -475,7 +542,16 @@ class Memory {
   // Dumps a map of all allocated memory to the log.
   void DumpMap();
 
-  bool Save(ByteStream* stream);
+  // Copies of all heaps that are saved, see BaseHeap::Snapshot.
+  struct Snapshot {
+    BaseHeap::Snapshot heaps[5];
+  };
+  std::unique_ptr<Snapshot> CaptureSnapshot();
+
+  // Saves the state of all heaps, or of a snapshot captured earlier, see
+  // BaseHeap::Save for incremental.
+  bool Save(ByteStream* stream, bool incremental = false,
+            const Snapshot* snapshot = nullptr);
   bool Restore(ByteStream* stream);
 
  private:
@@ -491,6 +567,14 @@ class Memory {
   static bool AccessViolationCallbackThunk(
       std::unique_lock<std::recursive_mutex> global_lock_locked_once,
       void* context, void* host_address, bool is_write);
+  // Requires the global critical region. Returns whether the page was
+  // watched. If there's a batch, its protection is restored through it.
+  bool TriggerCodeWriteWatch(uint32_t virtual_address,
+                             xe::memory::ProtectionBatch* batch = nullptr);
+  void TriggerCodeWriteWatches(uint32_t virtual_address, uint32_t length);
+  // Write-protects the watched pages in the range again after the guest has
+  // changed their protection. Requires the global critical region.
+  void ReapplyCodeWriteWatches(uint32_t virtual_address, uint32_t length);
 
   std::filesystem::path file_name_;
   uint32_t system_page_size_ = 0;
@@ -534,8 +618,17 @@ class Memory {
 
   friend class PhysicalHeap;
   xe::global_critical_region global_critical_region_;
+  std::vector<PhysicalHeap::SystemPageFlagsBlock> system_page_flags_;
   std::vector<std::pair<PhysicalMemoryInvalidationCallback, void*>*>
       physical_memory_invalidation_callbacks_;
+
+  CodeWriteCallback code_write_callback_ = nullptr;
+  void* code_write_callback_context_ = nullptr;
+  // Bits of the system pages of the guest virtual address space with code
+  // write watches, allocated on the first watch.
+  std::vector<uint64_t> code_watched_pages_;
+  // Number of times each system page was watched, by page index.
+  std::unordered_map<uint32_t, uint32_t> code_watch_counts_;
 };
 
 }  // namespace xe
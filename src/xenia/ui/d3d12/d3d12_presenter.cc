@@ -18,6 +18,7 @@
 #include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/profiling.h"
 #include "xenia/ui/d3d12/d3d12_provider.h"
 #include "xenia/ui/d3d12/d3d12_util.h"
 #include "xenia/ui/surface_win.h"
@@ -28,6 +29,12 @@ DEFINE_bool(
     "it. On displays not supporting VRR, screen tearing may occur in certain "
     "cases.",
     "D3D12");
+DEFINE_bool(
+    d3d12_present_low_latency, false,
+    "Limit the number of frames queued for presentation to one using a frame "
+    "latency waitable object, waiting for the previous frame to be picked by "
+    "the display before painting the next one.",
+    "D3D12");
 
 namespace xe {
 namespace ui {
@@ -227,9 +234,10 @@ D3D12Presenter::ConnectOrReconnectPaintingToSurfaceFromUIThread(
       return SurfacePaintConnectResult::kSuccessUnchanged;
     }
     paint_context_.AwaitSwapChainUsageCompletion();
-    // Using the current swap_chain_allows_tearing_ value that's consistent with
-    // the creation of the swap chain because ResizeBuffers can't toggle the
-    // tearing flag.
+    // Using the current swap_chain_allows_tearing_ and
+    // swap_chain_frame_latency_waitable values that are consistent with the
+    // creation of the swap chain because ResizeBuffers can't toggle the tearing
+    // and the frame latency waitable object flags.
     for (Microsoft::WRL::ComPtr<ID3D12Resource>& swap_chain_buffer_ref :
          paint_context_.swap_chain_buffers) {
       swap_chain_buffer_ref.Reset();
@@ -238,9 +246,12 @@ D3D12Presenter::ConnectOrReconnectPaintingToSurfaceFromUIThread(
         SUCCEEDED(paint_context_.swap_chain->ResizeBuffers(
             0, UINT(new_swap_chain_width), UINT(new_swap_chain_height),
             DXGI_FORMAT_UNKNOWN,
-            paint_context_.swap_chain_allows_tearing
-                ? DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING
-                : 0));
+            (paint_context_.swap_chain_allows_tearing
+                 ? DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING
+                 : 0) |
+                (paint_context_.swap_chain_frame_latency_waitable
+                     ? DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT
+                     : 0)));
     if (swap_chain_resized) {
       for (uint32_t i = 0; i < PaintContext::kSwapChainBufferCount; ++i) {
         if (FAILED(paint_context_.swap_chain->GetBuffer(
@@ -291,6 +302,10 @@ D3D12Presenter::ConnectOrReconnectPaintingToSurfaceFromUIThread(
       // rate.
       swap_chain_desc.Flags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
     }
+    if (cvars::d3d12_present_low_latency) {
+      swap_chain_desc.Flags |=
+          DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+    }
     IDXGIFactory2* dxgi_factory = provider_.GetDXGIFactory();
     ID3D12CommandQueue* direct_queue = provider_.GetDirectQueue();
     Microsoft::WRL::ComPtr<IDXGISwapChain1> swap_chain_1;
@@ -333,6 +348,23 @@ D3D12Presenter::ConnectOrReconnectPaintingToSurfaceFromUIThread(
     paint_context_.swap_chain_height = new_swap_chain_height;
     paint_context_.swap_chain_allows_tearing =
         (swap_chain_desc.Flags & DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING) != 0;
+    paint_context_.swap_chain_frame_latency_waitable =
+        (swap_chain_desc.Flags &
+         DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT) != 0;
+    if (paint_context_.swap_chain_frame_latency_waitable) {
+      // Not fatal if failed - just presenting with the default latency then.
+      if (SUCCEEDED(paint_context_.swap_chain->SetMaximumFrameLatency(1))) {
+        paint_context_.swap_chain_frame_latency_waitable_object =
+            paint_context_.swap_chain->GetFrameLatencyWaitableObject();
+      }
+      if (!paint_context_.swap_chain_frame_latency_waitable_object) {
+        XELOGW(
+            "D3D12Presenter: Failed to set up the frame latency waitable "
+            "object");
+      }
+    }
+    paint_context_.recent_presents.fill({});
+    paint_context_.last_measured_present_count = 0;
     for (uint32_t i = 0; i < PaintContext::kSwapChainBufferCount; ++i) {
       if (FAILED(paint_context_.swap_chain->GetBuffer(
               i, IID_PPV_ARGS(&paint_context_.swap_chain_buffers[i])))) {
@@ -442,7 +474,12 @@ void D3D12Presenter::PaintContext::DestroySwapChain() {
        swap_chain_buffers) {
     swap_chain_buffer_ref.Reset();
   }
+  if (swap_chain_frame_latency_waitable_object) {
+    CloseHandle(swap_chain_frame_latency_waitable_object);
+    swap_chain_frame_latency_waitable_object = nullptr;
+  }
   swap_chain.Reset();
+  swap_chain_frame_latency_waitable = false;
   swap_chain_allows_tearing = false;
   swap_chain_height = 0;
   swap_chain_width = 0;
@@ -450,6 +487,16 @@ void D3D12Presenter::PaintContext::DestroySwapChain() {
 
 Presenter::PaintResult D3D12Presenter::PaintAndPresentImpl(
     bool execute_ui_drawers) {
+  if (paint_context_.swap_chain_frame_latency_waitable_object) {
+    // Wait until the swap chain can accept a new frame without queueing it
+    // behind the one already waiting to be displayed, so the painted guest
+    // output is as recent as possible when it's displayed. Not waiting forever
+    // in case the display stops picking frames (when the window is occluded,
+    // for instance).
+    WaitForSingleObjectEx(
+        paint_context_.swap_chain_frame_latency_waitable_object, 1000, TRUE);
+  }
+
   // Begin the command list with the command allocator not currently potentially
   // used on the GPU.
   UINT64 current_paint_submission =
@@ -623,6 +670,7 @@ Presenter::PaintResult D3D12Presenter::PaintAndPresentImpl(
           intermediate_current_size.second = intermediate_current_desc.Height;
         }
         if (intermediate_current_size != intermediate_needed_size) {
+          paint_context_.guest_output_intermediate_refresh_index = 0;
           if (intermediate_needed_size.first &&
               intermediate_needed_size.second) {
             // Need to replace immediately as a new texture with the requested
@@ -715,11 +763,32 @@ Presenter::PaintResult D3D12Presenter::PaintAndPresentImpl(
         command_list->SetDescriptorHeaps(1, &view_heap);
       }
 
+      // If the guest output hasn't been refreshed since the intermediate
+      // textures were drawn, only draw the final effect.
+      size_t first_effect = 0;
+      if (guest_output_flow.effect_count > 1) {
+        if (guest_output_properties.refresh_index &&
+            paint_context_.guest_output_intermediate_refresh_index ==
+                guest_output_properties.refresh_index &&
+            AreGuestOutputPaintIntermediateEffectsSame(
+                guest_output_flow, guest_output_paint_config,
+                paint_context_.guest_output_intermediate_flow,
+                paint_context_.guest_output_intermediate_config)) {
+          first_effect = guest_output_flow.effect_count - 1;
+        } else {
+          paint_context_.guest_output_intermediate_refresh_index =
+              guest_output_properties.refresh_index;
+          paint_context_.guest_output_intermediate_flow = guest_output_flow;
+          paint_context_.guest_output_intermediate_config =
+              guest_output_paint_config;
+        }
+      }
+
       // This effect loop must not be aborted so the states of the resources
       // involved are consistent.
       D3D12_GPU_DESCRIPTOR_HANDLE view_heap_gpu_start =
           view_heap->GetGPUDescriptorHandleForHeapStart();
-      for (size_t i = 0; i < guest_output_flow.effect_count; ++i) {
+      for (size_t i = first_effect; i < guest_output_flow.effect_count; ++i) {
         bool is_final_effect = i + 1 >= guest_output_flow.effect_count;
 
         GuestOutputPaintEffect effect = guest_output_flow.effects[i];
@@ -1075,6 +1144,9 @@ Presenter::PaintResult D3D12Presenter::PaintAndPresentImpl(
   // internally before the failure according to Jesse Natalie from the DirectX
   // Discord server.
   paint_context_.present_submission_tracker.NextSubmission();
+  if (SUCCEEDED(present_result)) {
+    MeasurePresentLatency();
+  }
   switch (present_result) {
     case DXGI_ERROR_DEVICE_REMOVED:
       return PaintResult::kGpuLostExternally;
@@ -1086,6 +1158,45 @@ Presenter::PaintResult D3D12Presenter::PaintAndPresentImpl(
   }
 }
 
+void D3D12Presenter::MeasurePresentLatency() {
+  IDXGISwapChain3* swap_chain = paint_context_.swap_chain.Get();
+  UINT present_count;
+  LARGE_INTEGER present_counter;
+  if (SUCCEEDED(swap_chain->GetLastPresentCount(&present_count)) &&
+      QueryPerformanceCounter(&present_counter)) {
+    paint_context_.recent_presents[present_count %
+                                   paint_context_.recent_presents.size()] =
+        std::make_pair(present_count, present_counter);
+  }
+  // Not available in some configurations (such as when composed by the
+  // desktop window manager on older versions of Windows), and may be disjoint
+  // after mode changes.
+  DXGI_FRAME_STATISTICS frame_statistics;
+  if (FAILED(swap_chain->GetFrameStatistics(&frame_statistics)) ||
+      frame_statistics.PresentCount ==
+          paint_context_.last_measured_present_count) {
+    return;
+  }
+  paint_context_.last_measured_present_count = frame_statistics.PresentCount;
+  const std::pair<UINT, LARGE_INTEGER>& displayed_present =
+      paint_context_.recent_presents[frame_statistics.PresentCount %
+                                     paint_context_.recent_presents.size()];
+  if (displayed_present.first != frame_statistics.PresentCount ||
+      frame_statistics.SyncQPCTime.QuadPart <
+          displayed_present.second.QuadPart) {
+    return;
+  }
+  LARGE_INTEGER counter_frequency;
+  if (!QueryPerformanceFrequency(&counter_frequency)) {
+    return;
+  }
+  COUNT_profile_set(
+      "gpu/presenter/present_to_display_latency_us",
+      uint64_t(frame_statistics.SyncQPCTime.QuadPart -
+               displayed_present.second.QuadPart) *
+          1000000 / uint64_t(counter_frequency.QuadPart));
+}
+
 bool D3D12Presenter::InitializeSurfaceIndependent() {
   // Check if DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING is supported.
   {
@@ -262,13 +262,29 @@ class D3D12Presenter final : public Presenter {
                kMaxGuestOutputPaintEffects - 1>
         guest_output_intermediate_textures;
     UINT64 guest_output_intermediate_texture_last_usage = 0;
+    // The guest output refresh, the flow and the configuration the current
+    // contents of the intermediate textures were drawn for, to skip drawing
+    // them again if the guest output hasn't been refreshed since the last
+    // paint. refresh_index is 0 if the contents are not valid.
+    uint64_t guest_output_intermediate_refresh_index = 0;
+    GuestOutputPaintFlow guest_output_intermediate_flow = {};
+    GuestOutputPaintConfig guest_output_intermediate_config;
 
     // Connection-specific.
 
     uint32_t swap_chain_width = 0;
     uint32_t swap_chain_height = 0;
     bool swap_chain_allows_tearing = false;
+    bool swap_chain_frame_latency_waitable = false;
+    // If not null, painting waits for this object to keep at most one frame
+    // queued for presentation.
+    HANDLE swap_chain_frame_latency_waitable_object = nullptr;
     Microsoft::WRL::ComPtr<IDXGISwapChain3> swap_chain;
+    // QueryPerformanceCounter values at recent successful presents, indexed by
+    // the present count modulo the size, for measuring the latency until the
+    // frame is displayed from the frame statistics.
+    std::array<std::pair<UINT, LARGE_INTEGER>, 8> recent_presents = {};
+    UINT last_measured_present_count = 0;
     std::array<Microsoft::WRL::ComPtr<ID3D12Resource>, kSwapChainBufferCount>
         swap_chain_buffers;
   };
@@ -281,6 +297,11 @@ class D3D12Presenter final : public Presenter {
 
   bool InitializeSurfaceIndependent();
 
+  // Records the time of the latest successful present, and reports the time
+  // between presenting and displaying for the latest frame displayed to the
+  // profiler.
+  void MeasurePresentLatency();
+
   const D3D12Provider& provider_;
 
   // Whether DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING is supported by DXGI (depends in
@@ -74,6 +74,9 @@ D3D12Provider::~D3D12Provider() {
   if (device_ != nullptr) {
     device_->Release();
   }
+  if (adapter3_ != nullptr) {
+    adapter3_->Release();
+  }
   if (dxgi_factory_ != nullptr) {
     dxgi_factory_->Release();
   }
@@ -312,6 +315,9 @@ bool D3D12Provider::Initialize() {
     dxgi_factory->Release();
     return false;
   }
+  if (FAILED(adapter->QueryInterface(IID_PPV_ARGS(&adapter3_)))) {
+    adapter3_ = nullptr;
+  }
   adapter->Release();
 
   // Configure the Direct3D 12 debug info queue.
@@ -454,8 +460,18 @@ bool D3D12Provider::Initialize() {
     virtual_address_bits_per_resource_ =
         virtual_address_support.MaxGPUVirtualAddressBitsPerResource;
   }
+  // Fails if DXIL is not supported by the OS.
+  highest_shader_model_ = D3D_SHADER_MODEL_5_1;
+  D3D12_FEATURE_DATA_SHADER_MODEL shader_model;
+  shader_model.HighestShaderModel = D3D_SHADER_MODEL_6_0;
+  if (SUCCEEDED(device->CheckFeatureSupport(D3D12_FEATURE_SHADER_MODEL,
+                                            &shader_model,
+                                            sizeof(shader_model)))) {
+    highest_shader_model_ = shader_model.HighestShaderModel;
+  }
   XELOGD3D(
       "Direct3D 12 device and OS features:\n"
+      "* Highest shader model: {}.{}\n"
       "* Max GPU virtual address bits per resource: {}\n"
       "* Non-zeroed heap creation: {}\n"
       "* Pixel-shader-specified stencil reference: {}\n"
@@ -464,7 +480,8 @@ bool D3D12Provider::Initialize() {
       "* Resource binding: tier {}\n"
       "* Tiled resources: tier {}\n"
       "* Unaligned block-compressed textures: {}",
-      virtual_address_bits_per_resource_,
+      uint32_t(highest_shader_model_) >> 4,
+      uint32_t(highest_shader_model_) & 0xF, virtual_address_bits_per_resource_,
       (heap_flag_create_not_zeroed_ & D3D12_HEAP_FLAG_CREATE_NOT_ZEROED) ? "yes"
                                                                          : "no",
       ps_specified_stencil_reference_supported_ ? "yes" : "no",
@@ -480,6 +497,21 @@ bool D3D12Provider::Initialize() {
   return true;
 }
 
+bool D3D12Provider::QueryLocalVideoMemoryInfo(uint64_t& budget_out,
+                                              uint64_t& usage_out) const {
+  if (adapter3_ == nullptr) {
+    return false;
+  }
+  DXGI_QUERY_VIDEO_MEMORY_INFO video_memory_info;
+  if (FAILED(adapter3_->QueryVideoMemoryInfo(
+          0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &video_memory_info))) {
+    return false;
+  }
+  budget_out = video_memory_info.Budget;
+  usage_out = video_memory_info.CurrentUsage;
+  return true;
+}
+
 std::unique_ptr<Presenter> D3D12Provider::CreatePresenter(
     Presenter::HostGpuLossCallback host_gpu_loss_callback) {
   return D3D12Presenter::Create(host_gpu_loss_callback, *this);
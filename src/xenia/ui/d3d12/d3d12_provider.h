@@ -85,6 +85,11 @@ class D3D12Provider : public GraphicsProvider {
 
   // Adapter info.
   GpuVendorID GetAdapterVendorID() const { return adapter_vendor_id_; }
+  // Gets the local (video) memory budget given to the process by the OS and
+  // how much of it is currently used by the process. Returns false if not
+  // available (IDXGIAdapter3 requires Windows 10).
+  bool QueryLocalVideoMemoryInfo(uint64_t& budget_out,
+                                 uint64_t& usage_out) const;
 
   // Device features.
   D3D12_HEAP_FLAGS GetHeapFlagCreateNotZeroed() const {
@@ -112,6 +117,10 @@ class D3D12Provider : public GraphicsProvider {
   uint32_t GetVirtualAddressBitsPerResource() const {
     return virtual_address_bits_per_resource_;
   }
+  // Queried up to 6.0, to tell whether DXIL shaders can be used.
+  D3D_SHADER_MODEL GetHighestShaderModel() const {
+    return highest_shader_model_;
+  }
 
   // Proxies for DirectX functions since they are loaded dynamically.
   HRESULT SerializeRootSignature(const D3D12_ROOT_SIGNATURE_DESC* desc,
@@ -175,6 +184,8 @@ class D3D12Provider : public GraphicsProvider {
   DxcCreateInstanceProc pfn_dxcompiler_dxc_create_instance_ = nullptr;
 
   IDXGIFactory2* dxgi_factory_ = nullptr;
+  // Null if not supported.
+  IDXGIAdapter3* adapter3_ = nullptr;
   ID3D12Device* device_ = nullptr;
   ID3D12CommandQueue* direct_queue_ = nullptr;
   IDXGraphicsAnalysis* graphics_analysis_ = nullptr;
@@ -188,6 +199,7 @@ class D3D12Provider : public GraphicsProvider {
   D3D12_RESOURCE_BINDING_TIER resource_binding_tier_;
   D3D12_TILED_RESOURCES_TIER tiled_resources_tier_;
   uint32_t virtual_address_bits_per_resource_;
+  D3D_SHADER_MODEL highest_shader_model_;
   bool ps_specified_stencil_reference_supported_;
   bool rasterizer_ordered_views_supported_;
   bool unaligned_block_textures_supported_;
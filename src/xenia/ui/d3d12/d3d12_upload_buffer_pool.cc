@@ -21,10 +21,11 @@ namespace d3d12 {
 // it's smaller (the size of the heap backing the buffer will be aligned to
 // D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT anyway).
 D3D12UploadBufferPool::D3D12UploadBufferPool(const D3D12Provider& provider,
-                                             size_t page_size)
+                                             size_t page_size, bool readback)
     : GraphicsUploadBufferPool(xe::align(
           page_size, size_t(D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT))),
-      provider_(provider) {}
+      provider_(provider),
+      readback_(readback) {}
 
 uint8_t* D3D12UploadBufferPool::Request(
     uint64_t submission_index, size_t size, size_t alignment,
@@ -82,18 +83,24 @@ D3D12UploadBufferPool::CreatePageImplementation() {
                                D3D12_RESOURCE_FLAG_NONE);
   Microsoft::WRL::ComPtr<ID3D12Resource> buffer;
   if (FAILED(provider_.GetDevice()->CreateCommittedResource(
-          &util::kHeapPropertiesUpload, provider_.GetHeapFlagCreateNotZeroed(),
-          &buffer_desc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
-          IID_PPV_ARGS(&buffer)))) {
-    XELOGE("Failed to create a D3D upload buffer with {} bytes", page_size_);
+          readback_ ? &util::kHeapPropertiesReadback
+                    : &util::kHeapPropertiesUpload,
+          provider_.GetHeapFlagCreateNotZeroed(), &buffer_desc,
+          readback_ ? D3D12_RESOURCE_STATE_COPY_DEST
+                    : D3D12_RESOURCE_STATE_GENERIC_READ,
+          nullptr, IID_PPV_ARGS(&buffer)))) {
+    XELOGE("Failed to create a D3D {} buffer with {} bytes",
+           readback_ ? "readback" : "upload", page_size_);
     return nullptr;
   }
+  // Readback buffers are read by the CPU in their entirety.
   D3D12_RANGE read_range;
   read_range.Begin = 0;
-  read_range.End = 0;
+  read_range.End = readback_ ? page_size_ : 0;
   void* mapping;
   if (FAILED(buffer->Map(0, &read_range, &mapping))) {
-    XELOGE("Failed to map a D3D upload buffer with {} bytes", page_size_);
+    XELOGE("Failed to map a D3D {} buffer with {} bytes",
+           readback_ ? "readback" : "upload", page_size_);
     buffer->Release();
     return nullptr;
   }
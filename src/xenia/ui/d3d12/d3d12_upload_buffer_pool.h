@@ -19,8 +19,13 @@ namespace d3d12 {
 
 class D3D12UploadBufferPool : public GraphicsUploadBufferPool {
  public:
+  // If readback is true, the pages are created in the readback heap instead,
+  // in the copy destination state, for the GPU to copy data to, and the
+  // returned mappings are for reading that data after the submission is
+  // completed.
   D3D12UploadBufferPool(const D3D12Provider& provider,
-                        size_t page_size = kDefaultPageSize);
+                        size_t page_size = kDefaultPageSize,
+                        bool readback = false);
 
   uint8_t* Request(uint64_t submission_index, size_t size, size_t alignment,
                    ID3D12Resource** buffer_out, size_t* offset_out,
@@ -44,6 +49,7 @@ class D3D12UploadBufferPool : public GraphicsUploadBufferPool {
   };
 
   const D3D12Provider& provider_;
+  bool readback_;
 };
 
 }  // namespace d3d12
@@ -61,6 +61,7 @@ void GraphicsUploadBufferPool::ClearCache() {
   // Called from the destructor - must not call virtual functions here.
   current_page_flushed_ = 0;
   current_page_used_ = 0;
+  page_count_ = 0;
   while (submitted_first_) {
     Page* next_ = submitted_first_->next_;
     delete submitted_first_;
@@ -77,6 +78,13 @@ void GraphicsUploadBufferPool::ClearCache() {
 
 GraphicsUploadBufferPool::Page::~Page() {}
 
+GraphicsUploadBufferPool::Statistics
+GraphicsUploadBufferPool::TakeStatistics() {
+  Statistics statistics = statistics_;
+  statistics_ = Statistics();
+  return statistics;
+}
+
 void GraphicsUploadBufferPool::FlushWrites() {
   if (current_page_flushed_ >= current_page_used_) {
     return;
@@ -106,6 +114,7 @@ GraphicsUploadBufferPool::Page* GraphicsUploadBufferPool::Request(
     // Start a new page if can't fit all the bytes or don't have an open page.
     if (writable_first_) {
       // Close the page that was current.
+      statistics_.bytes_wasted += page_size_ - current_page_used_;
       FlushWrites();
       if (submitted_last_) {
         submitted_last_->next_ = writable_first_;
@@ -129,6 +138,8 @@ GraphicsUploadBufferPool::Page* GraphicsUploadBufferPool::Request(
       writable_first_->last_submission_index_ = submission_index;
       writable_first_->next_ = nullptr;
       writable_last_ = writable_first_;
+      ++page_count_;
+      ++statistics_.pages_created;
       // After CreatePageImplementation (more specifically, the first successful
       // call), page_size_ may grow - but this doesn't matter here.
     }
@@ -137,6 +148,8 @@ GraphicsUploadBufferPool::Page* GraphicsUploadBufferPool::Request(
     current_page_flushed_ = 0;
   }
   writable_first_->last_submission_index_ = submission_index;
+  statistics_.bytes_requested +=
+      current_page_used_aligned + size - current_page_used_;
   offset_out = current_page_used_aligned;
   current_page_used_ = current_page_used_aligned + size;
   return writable_first_;
@@ -39,6 +39,19 @@ class GraphicsUploadBufferPool {
   // implementation doesn't require explicit flushing.
   void FlushWrites();
 
+  struct Statistics {
+    // Including the alignment padding.
+    uint64_t bytes_requested = 0;
+    // Left unused at the end of the pages closed because a request didn't fit.
+    uint64_t bytes_wasted = 0;
+    // Created because no page has been reclaimed yet - when using a single
+    // ring buffer, this is where waiting for the GPU would be needed.
+    uint64_t pages_created = 0;
+  };
+  // Returns the statistics since the previous call, such as per frame.
+  Statistics TakeStatistics();
+  size_t page_count() const { return page_count_; }
+
  protected:
   // Extended by the implementation.
   struct Page {
@@ -77,6 +90,9 @@ class GraphicsUploadBufferPool {
 
   size_t current_page_used_ = 0;
   size_t current_page_flushed_ = 0;
+
+  size_t page_count_ = 0;
+  Statistics statistics_;
 };
 
 }  // namespace ui
@@ -10,12 +10,16 @@
 #include "xenia/ui/presenter.h"
 
 #include <algorithm>
+#include <chrono>
 #include <utility>
 
 #include "xenia/base/assert.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/input_latency.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/platform.h"
+#include "xenia/base/threading.h"
 #include "xenia/ui/window.h"
 
 #if XE_PLATFORM_WIN32
@@ -40,6 +44,17 @@ DEFINE_bool(
     "host window system.",
     "Display");
 
+// Titles not waiting for the vertical blank before swapping may refresh the
+// guest output many times within one guest frame, with most of the images
+// dropped by the mailbox but uneven frame times shown to the user.
+DEFINE_bool(
+    present_pace_to_guest_vblank, false,
+    "Hold guest output images refreshed within the same guest vertical "
+    "blanking interval as an already presented image until the next guest "
+    "vertical blank, to make frame times more even for titles swapping "
+    "without waiting for the vertical blank.",
+    "Display");
+
 DEFINE_bool(
     present_render_pass_clear, true,
     "On graphics backends where this is supported, use the clear render pass "
@@ -352,6 +367,31 @@ void Presenter::PaintFromUIThread(bool force_paint) {
   }
 }
 
+void Presenter::MarkGuestVblank() {
+  uint64_t vblank_tick = Clock::QueryHostTickCount();
+  uint64_t last_vblank_tick =
+      guest_vblank_last_tick_.exchange(vblank_tick, std::memory_order_relaxed);
+  if (last_vblank_tick && vblank_tick > last_vblank_tick) {
+    guest_vblank_interval_ticks_.store(vblank_tick - last_vblank_tick,
+                                       std::memory_order_relaxed);
+  }
+}
+
+bool Presenter::WaitForHostVblank() {
+#if XE_PLATFORM_WIN32
+  // Holding a new reference to the output while waiting, like in
+  // DXGIUITickThread.
+  Microsoft::WRL::ComPtr<IDXGIOutput> dxgi_output;
+  {
+    std::scoped_lock<std::mutex> dxgi_ui_tick_lock(dxgi_ui_tick_mutex_);
+    dxgi_output = dxgi_ui_tick_output_;
+  }
+  return dxgi_output && SUCCEEDED(dxgi_output->WaitForVBlank());
+#else
+  return false;
+#endif  // XE_PLATFORM
+}
+
 bool Presenter::RefreshGuestOutput(
     uint32_t frontbuffer_width, uint32_t frontbuffer_height,
     uint32_t display_aspect_ratio_x, uint32_t display_aspect_ratio_y,
@@ -363,6 +403,7 @@ bool Presenter::RefreshGuestOutput(
   writable_properties.display_aspect_ratio_x = display_aspect_ratio_x;
   writable_properties.display_aspect_ratio_y = display_aspect_ratio_y;
   writable_properties.is_8bpc = false;
+  writable_properties.refresh_index = ++guest_output_last_refresh_index_;
   bool is_active = writable_properties.IsActive();
   if (is_active) {
     if (!RefreshGuestOutputImpl(guest_output_mailbox_writable_,
@@ -422,6 +463,39 @@ bool Presenter::RefreshGuestOutput(
         (3 - last_acquired - guest_output_mailbox_writable_) % 3;
   }
 
+  if (input_latency::IsEnabled()) {
+    input_latency::OnGuestSwap();
+  }
+
+  threading::Event* refresh_event =
+      guest_output_refresh_event_.load(std::memory_order_acquire);
+  if (refresh_event) {
+    refresh_event->Set();
+  }
+
+  if (cvars::present_pace_to_guest_vblank) {
+    uint64_t vblank_tick =
+        guest_vblank_last_tick_.load(std::memory_order_relaxed);
+    uint64_t vblank_interval_ticks =
+        guest_vblank_interval_ticks_.load(std::memory_order_relaxed);
+    if (vblank_interval_ticks &&
+        guest_output_last_paced_tick_ >= vblank_tick) {
+      // An image has already been sent to the host within the current guest
+      // vertical blanking interval - wait until the next predicted one, but
+      // not longer than an interval in case vertical blanks have stopped (the
+      // emulation is paused, for instance).
+      uint64_t next_vblank_tick = vblank_tick + vblank_interval_ticks;
+      uint64_t current_tick = Clock::QueryHostTickCount();
+      if (next_vblank_tick > current_tick) {
+        uint64_t wait_ticks =
+            std::min(next_vblank_tick - current_tick, vblank_interval_ticks);
+        xe::threading::Sleep(std::chrono::microseconds(
+            wait_ticks * 1000000 / Clock::QueryHostTickFrequency()));
+      }
+    }
+    guest_output_last_paced_tick_ = Clock::QueryHostTickCount();
+  }
+
   // Trigger the presentation on the host.
   PaintResult paint_result = PaintResult::kNotPresented;
   {
@@ -651,6 +725,31 @@ std::unique_lock<std::mutex> Presenter::ConsumeGuestOutput(
   return std::move(consumer_lock);
 }
 
+bool Presenter::AreGuestOutputPaintIntermediateEffectsSame(
+    const GuestOutputPaintFlow& flow_a,
+    const GuestOutputPaintConfig& config_a,
+    const GuestOutputPaintFlow& flow_b,
+    const GuestOutputPaintConfig& config_b) {
+  if (flow_a.effect_count != flow_b.effect_count ||
+      flow_a.properties.frontbuffer_width !=
+          flow_b.properties.frontbuffer_width ||
+      flow_a.properties.frontbuffer_height !=
+          flow_b.properties.frontbuffer_height ||
+      config_a.GetCasAdditionalSharpness() !=
+          config_b.GetCasAdditionalSharpness() ||
+      config_a.GetFsrSharpnessReduction() !=
+          config_b.GetFsrSharpnessReduction()) {
+    return false;
+  }
+  for (size_t i = 0; i + 1 < flow_a.effect_count; ++i) {
+    if (flow_a.effects[i] != flow_b.effects[i] ||
+        flow_a.effect_output_sizes[i] != flow_b.effect_output_sizes[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
 Presenter::GuestOutputPaintFlow Presenter::GetGuestOutputPaintFlow(
     const GuestOutputProperties& properties, uint32_t host_rt_width,
     uint32_t host_rt_height, uint32_t max_rt_width, uint32_t max_rt_height,
@@ -1278,7 +1377,16 @@ Presenter::PaintResult Presenter::PaintAndPresent(bool execute_ui_drawers) {
   assert_false(execute_ui_drawers && !is_in_ui_thread_paint_);
   assert_true(surface_paint_connection_state_ ==
               SurfacePaintConnectionState::kConnectedPaintable);
+  // Taken before the guest output is acquired for painting, so the swaps
+  // after that aren't counted as presented.
+  uint64_t input_latency_last_swap =
+      input_latency::IsEnabled() ? input_latency::GetLastGuestSwap() : 0;
   PaintResult result = PaintAndPresentImpl(execute_ui_drawers);
+  if (input_latency_last_swap &&
+      (result == PaintResult::kPresented ||
+       result == PaintResult::kPresentedSuboptimal)) {
+    input_latency::OnGuestOutputPresented(input_latency_last_swap);
+  }
   switch (result) {
     case PaintResult::kPresented:
       surface_paint_connection_was_optimal_at_successful_paint_ = true;
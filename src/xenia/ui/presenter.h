@@ -31,6 +31,7 @@
 #include "xenia/base/cvar.h"
 #include "xenia/base/math.h"
 #include "xenia/base/platform.h"
+#include "xenia/base/threading.h"
 #include "xenia/ui/surface.h"
 #include "xenia/ui/ui_drawer.h"
 
@@ -318,10 +319,25 @@ class Presenter {
       uint32_t frontbuffer_width, uint32_t frontbuffer_height,
       uint32_t display_aspect_ratio_x, uint32_t display_aspect_ratio_y,
       std::function<bool(GuestOutputRefreshContext& context)> refresher);
+  // For calling from the thread generating guest vertical blanking intervals,
+  // to let guest output refreshing be paced to the guest refresh rate if
+  // configured.
+  void MarkGuestVblank();
+  // Blocks until the next vertical blanking interval of the display the
+  // surface is on, for pacing guest vblanks to it. Returns false without
+  // waiting if this is not possible on the platform or with the current
+  // surface.
+  bool WaitForHostVblank();
   // The implementation must be callable from any thread, including from
   // multiple at the same time, and it should acquire the latest guest output
   // image via ConsumeGuestOutput.
   virtual bool CaptureGuestOutput(RawImage& image_out) = 0;
+  // The event, if not null, is set after every guest output refresh, for
+  // capturing the guest output continuously from another thread. The event
+  // must be kept alive until it's replaced.
+  void SetGuestOutputRefreshEvent(threading::Event* event) {
+    guest_output_refresh_event_.store(event, std::memory_order_release);
+  }
   const GuestOutputPaintConfig& GetGuestOutputPaintConfigFromUIThread() const {
     return guest_output_paint_config_;
   }
@@ -368,6 +384,9 @@ class Presenter {
     uint32_t display_aspect_ratio_x;
     uint32_t display_aspect_ratio_y;
     bool is_8bpc;
+    // Unique among the refreshes, for detecting whether the image is the same
+    // as the one painted previously. 0 if never refreshed.
+    uint64_t refresh_index = 0;
 
     GuestOutputProperties() { SetToInactive(); }
 
@@ -649,6 +668,16 @@ class Presenter {
       const GuestOutputProperties& properties, uint32_t host_rt_width,
       uint32_t host_rt_height, uint32_t max_rt_width, uint32_t max_rt_height,
       const GuestOutputPaintConfig& config) const;
+  // Whether the effects before the final one in the two flows produce the same
+  // intermediate images from the same guest output image, so if the guest
+  // output hasn't been refreshed since the last paint, only the final effect
+  // needs to be drawn again - the intermediate effects never dither, so their
+  // results depend only on the sizes and the configuration.
+  static bool AreGuestOutputPaintIntermediateEffectsSame(
+      const GuestOutputPaintFlow& flow_a,
+      const GuestOutputPaintConfig& config_a,
+      const GuestOutputPaintFlow& flow_b,
+      const GuestOutputPaintConfig& config_b);
   // is_8bpc_out_ref is where to write whether the source actually has no more
   // than 8 bits of precision per channel (though the image provided by the
   // refresher may still have a higher storage precision) - if not written, it
@@ -959,6 +988,16 @@ class Presenter {
   // Accessible only by refreshing, whether the last refresh contained an image
   // rather than being blank.
   bool guest_output_active_last_refresh_ = false;
+  // Accessible only by refreshing.
+  uint64_t guest_output_last_refresh_index_ = 0;
+  std::atomic<threading::Event*> guest_output_refresh_event_{nullptr};
+  // Host ticks of the latest guest vertical blank and the interval between the
+  // latest two, written by MarkGuestVblank.
+  std::atomic<uint64_t> guest_vblank_last_tick_{0};
+  std::atomic<uint64_t> guest_vblank_interval_ticks_{0};
+  // Accessible only by refreshing, host tick when the last refreshed image was
+  // sent to the host presentation.
+  uint64_t guest_output_last_paced_tick_ = 0;
 
   // Ordered by the Z order, and then by the time of addition.
   // Note: All the iteration logic involving this Z ordering must be the same as
@@ -12,6 +12,7 @@
 #include <cstdlib>
 #include <filesystem>
 #include <string>
+#include <vector>
 
 #include "xenia/base/logging.h"
 #include "xenia/base/platform.h"
@@ -63,17 +64,30 @@ bool SpirvToolsContext::Initialize(unsigned int spirv_version) {
     Shutdown();
     return false;
   }
-  spv_target_env target_env;
+  // Optional, older versions don't have the optimizer in the C interface.
+  if (!LoadLibraryFunction(fn_spvBinaryDestroy_, "spvBinaryDestroy") ||
+      !LoadLibraryFunction(fn_spvOptimizerCreate_, "spvOptimizerCreate") ||
+      !LoadLibraryFunction(fn_spvOptimizerDestroy_, "spvOptimizerDestroy") ||
+      !LoadLibraryFunction(fn_spvOptimizerRegisterPassesFromFlags_,
+                           "spvOptimizerRegisterPassesFromFlags") ||
+      !LoadLibraryFunction(fn_spvOptimizerRun_, "spvOptimizerRun") ||
+      !LoadLibraryFunction(fn_spvOptimizerOptionsCreate_,
+                           "spvOptimizerOptionsCreate") ||
+      !LoadLibraryFunction(fn_spvOptimizerOptionsDestroy_,
+                           "spvOptimizerOptionsDestroy")) {
+    XELOGW("SPIRV-Tools: The optimizer is not available");
+    fn_spvOptimizerCreate_ = nullptr;
+  }
   if (spirv_version >= 0x10500) {
-    target_env = SPV_ENV_VULKAN_1_2;
+    target_env_ = SPV_ENV_VULKAN_1_2;
   } else if (spirv_version >= 0x10400) {
-    target_env = SPV_ENV_VULKAN_1_1_SPIRV_1_4;
+    target_env_ = SPV_ENV_VULKAN_1_1_SPIRV_1_4;
   } else if (spirv_version >= 0x10300) {
-    target_env = SPV_ENV_VULKAN_1_1;
+    target_env_ = SPV_ENV_VULKAN_1_1;
   } else {
-    target_env = SPV_ENV_VULKAN_1_0;
+    target_env_ = SPV_ENV_VULKAN_1_0;
   }
-  context_ = fn_spvContextCreate_(target_env);
+  context_ = fn_spvContextCreate_(target_env_);
   if (!context_) {
     XELOGE("SPIRV-Tools: Failed to create a Vulkan 1.0 context");
     Shutdown();
@@ -95,6 +109,7 @@ void SpirvToolsContext::Shutdown() {
 #endif
     library_ = nullptr;
   }
+  fn_spvOptimizerCreate_ = nullptr;
 }
 
 spv_result_t SpirvToolsContext::Validate(const uint32_t* words,
@@ -118,6 +133,37 @@ spv_result_t SpirvToolsContext::Validate(const uint32_t* words,
   return result;
 }
 
+spv_result_t SpirvToolsContext::Optimize(
+    const uint32_t* words, size_t num_words, const char* const* pass_flags,
+    size_t pass_flag_count, std::vector<uint32_t>& optimized_out) const {
+  optimized_out.clear();
+  if (!context_ || !IsOptimizerAvailable()) {
+    return SPV_UNSUPPORTED;
+  }
+  // Optimizers have their own state, so a new one is created for each call to
+  // allow calling this from multiple threads.
+  spv_optimizer_t* optimizer = fn_spvOptimizerCreate_(target_env_);
+  if (!optimizer) {
+    return SPV_ERROR_OUT_OF_MEMORY;
+  }
+  spv_result_t result = SPV_ERROR_INVALID_LOOKUP;
+  if (fn_spvOptimizerRegisterPassesFromFlags_(
+          optimizer, const_cast<const char**>(pass_flags), pass_flag_count)) {
+    spv_optimizer_options options = fn_spvOptimizerOptionsCreate_();
+    spv_binary binary = nullptr;
+    result = fn_spvOptimizerRun_(optimizer, words, num_words, &binary, options);
+    if (binary) {
+      if (result == SPV_SUCCESS) {
+        optimized_out.assign(binary->code, binary->code + binary->wordCount);
+      }
+      fn_spvBinaryDestroy_(binary);
+    }
+    fn_spvOptimizerOptionsDestroy_(options);
+  }
+  fn_spvOptimizerDestroy_(optimizer);
+  return result;
+}
+
 }  // namespace vulkan
 }  // namespace ui
 }  // namespace xe
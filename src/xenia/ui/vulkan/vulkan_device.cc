@@ -346,6 +346,9 @@ std::unique_ptr<VulkanDevice> VulkanDevice::CreateIfSupported(
     const VkQueueFamilyProperties& queue_family_properties =
         queue_families[queue_family_index];
 
+    queue_family.timestamp_valid_bits =
+        queue_family_properties.timestampValidBits;
+
     const VkQueueFlags queue_unsupported_flags =
         ~queue_family_properties.queueFlags;
 
@@ -486,6 +489,8 @@ std::unique_ptr<VulkanDevice> VulkanDevice::CreateIfSupported(
   device->properties_.vendorID = properties.vendorID;
   device->properties_.deviceID = properties.deviceID;
   std::strcpy(device->properties_.deviceName, properties.deviceName);
+  std::memcpy(device->properties_.pipelineCacheUUID,
+              properties.pipelineCacheUUID, VK_UUID_SIZE);
 
   XELOGI(
       "Vulkan device '{}': API {}.{}.{}, vendor 0x{:04X}, device 0x{:04X}, "
@@ -595,6 +600,8 @@ std::unique_ptr<VulkanDevice> VulkanDevice::CreateIfSupported(
   XE_UI_VULKAN_LIMIT(optimalBufferCopyOffsetAlignment)
   XE_UI_VULKAN_LIMIT(optimalBufferCopyRowPitchAlignment)
   XE_UI_VULKAN_LIMIT(nonCoherentAtomSize)
+  XE_UI_VULKAN_LIMIT(timestampComputeAndGraphics)
+  XE_UI_VULKAN_LIMIT(timestampPeriod)
 
   if (with_gpu_emulation) {
     XE_UI_VULKAN_FEATURE(robustBufferAccess)
@@ -53,6 +53,7 @@ class VulkanDevice {
     uint32_t vendorID = 0;
     uint32_t deviceID = 0;
     char deviceName[VK_MAX_PHYSICAL_DEVICE_NAME_SIZE] = {};
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE] = {};
 
     uint32_t maxImageDimension2D = 4096;
     uint32_t maxImageDimension3D = 256;
@@ -95,6 +96,8 @@ class VulkanDevice {
     VkDeviceSize optimalBufferCopyOffsetAlignment = 1;
     VkDeviceSize optimalBufferCopyRowPitchAlignment = 1;
     VkDeviceSize nonCoherentAtomSize = 256;
+    bool timestampComputeAndGraphics = false;
+    float timestampPeriod = 1.0f;
 
     bool robustBufferAccess = false;
     bool fullDrawIndexUint32 = false;
@@ -239,6 +242,8 @@ class VulkanDevice {
 
   struct QueueFamily {
     VkQueueFlags queue_flags = 0;
+    // 0 if timestamps are not supported on the queues of the family.
+    uint32_t timestamp_valid_bits = 0;
     bool may_support_presentation = false;
     std::vector<std::unique_ptr<Queue>> queues;
   };
@@ -1612,6 +1612,7 @@ Presenter::PaintResult VulkanPresenter::PaintAndPresentImpl(
                 intermediate_needed_size.first ||
             intermediate_current_extent.height !=
                 intermediate_needed_size.second) {
+          paint_context_.guest_output_intermediate_refresh_index = 0;
           if (intermediate_needed_size.first &&
               intermediate_needed_size.second) {
             // Need to replace immediately as a new image with the requested
@@ -1765,11 +1766,28 @@ Presenter::PaintResult VulkanPresenter::PaintAndPresentImpl(
         VkRect2D guest_output_scissor;
         guest_output_scissor.offset.x = 0;
         guest_output_scissor.offset.y = 0;
+        size_t first_effect = 0;
         if (guest_output_flow.effect_count > 1) {
           paint_context_.guest_output_intermediate_image_last_submission =
               current_paint_submission_index;
+          if (guest_output_properties.refresh_index &&
+              paint_context_.guest_output_intermediate_refresh_index ==
+                  guest_output_properties.refresh_index &&
+              AreGuestOutputPaintIntermediateEffectsSame(
+                  guest_output_flow, guest_output_paint_config,
+                  paint_context_.guest_output_intermediate_flow,
+                  paint_context_.guest_output_intermediate_config)) {
+            first_effect = guest_output_flow.effect_count - 1;
+          } else {
+            paint_context_.guest_output_intermediate_refresh_index =
+                guest_output_properties.refresh_index;
+            paint_context_.guest_output_intermediate_flow = guest_output_flow;
+            paint_context_.guest_output_intermediate_config =
+                guest_output_paint_config;
+          }
         }
-        for (size_t i = 0; i < guest_output_flow.effect_count; ++i) {
+        for (size_t i = first_effect; i < guest_output_flow.effect_count;
+             ++i) {
           bool is_final_effect = i + 1 >= guest_output_flow.effect_count;
 
           int32_t effect_rect_x, effect_rect_y;
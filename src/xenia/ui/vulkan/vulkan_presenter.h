@@ -422,6 +422,15 @@ class VulkanPresenter final : public Presenter {
     std::array<VkFramebuffer, kMaxGuestOutputPaintEffects - 1>
         guest_output_intermediate_framebuffers = {};
     uint64_t guest_output_intermediate_image_last_submission = 0;
+    // The guest output refresh, the flow and the configuration the current
+    // contents of the intermediate images were drawn for, to skip drawing them
+    // again if the guest output hasn't been refreshed since the last paint
+    // (such as when the host refresh rate is higher than the guest frame
+    // rate), especially for the expensive upscaling passes at high host
+    // resolutions. refresh_index is 0 if the contents are not valid.
+    uint64_t guest_output_intermediate_refresh_index = 0;
+    GuestOutputPaintFlow guest_output_intermediate_flow = {};
+    GuestOutputPaintConfig guest_output_intermediate_config;
 
     // Command buffers optionally executed before the draw command buffer,
     // outside the painting render pass.
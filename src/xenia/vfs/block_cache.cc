@@ -0,0 +1,197 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/block_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "xenia/base/cvar.h"
+
+DEFINE_uint32(vfs_block_cache_size, 32,
+              "Size of the cache of host file contents read by the guest, in "
+              "MiB. 0 to read from the host files directly every time.",
+              "Storage");
+DEFINE_uint32(vfs_read_ahead_blocks, 4,
+              "Number of 64 KiB blocks read past the requested data when a "
+              "file is read sequentially, if the file cache is enabled.",
+              "Storage");
+
+namespace xe {
+namespace vfs {
+
+BlockCache::BlockCache(size_t max_size, uint32_t read_ahead_block_count)
+    : max_block_count_(max_size / kBlockSize),
+      read_ahead_block_count_(
+          std::min(read_ahead_block_count, uint32_t(kMaxBlocksPerRead - 1))) {
+  if (max_block_count_ < kMaxBlocksPerRead) {
+    max_block_count_ = 0;
+  }
+}
+
+BlockCache& BlockCache::shared() {
+  static BlockCache shared_cache(size_t(cvars::vfs_block_cache_size) << 20,
+                                 cvars::vfs_read_ahead_blocks);
+  return shared_cache;
+}
+
+X_STATUS BlockCache::Read(const void* owner, void* buffer, size_t length,
+                          size_t offset, size_t* out_bytes_read,
+                          const ReadFunction& read_function) {
+  if (!is_enabled()) {
+    return read_function(offset, buffer, length, out_bytes_read);
+  }
+
+  *out_bytes_read = 0;
+  if (!length) {
+    return X_STATUS_SUCCESS;
+  }
+
+  bool sequential;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto next_read_offset_it = next_read_offsets_.emplace(owner, 0).first;
+    sequential = offset && next_read_offset_it->second == offset;
+    next_read_offset_it->second = offset + length;
+  }
+
+  auto out = reinterpret_cast<uint8_t*>(buffer);
+  size_t bytes_done = 0;
+  std::vector<uint8_t> read_buffer;
+  while (bytes_done < length) {
+    size_t position = offset + bytes_done;
+    BlockKey key = {owner, position >> kBlockSizeLog2};
+    size_t block_offset = position & (kBlockSize - 1);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      size_t block_bytes_copied = CopyFromBlock(
+          key, block_offset, out + bytes_done, length - bytes_done);
+      if (block_bytes_copied != SIZE_MAX) {
+        bytes_done += block_bytes_copied;
+        if (!block_bytes_copied ||
+            ((position + block_bytes_copied) & (kBlockSize - 1))) {
+          // Reached a block shorter than kBlockSize - the end of the file.
+          break;
+        }
+        continue;
+      }
+    }
+
+    // Read the rest of the request along with the read-ahead, in whole blocks,
+    // without holding the lock during the host read.
+    size_t block_end =
+        ((offset + length - 1) >> kBlockSizeLog2) + 1 +
+        (sequential ? read_ahead_block_count_ : 0);
+    size_t block_count =
+        std::min(block_end - key.index, size_t(kMaxBlocksPerRead));
+    read_buffer.resize(block_count << kBlockSizeLog2);
+    uint64_t invalidation_count;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      invalidation_count = invalidation_count_;
+    }
+    size_t host_bytes_read = 0;
+    X_STATUS result =
+        read_function(key.index << kBlockSizeLog2, read_buffer.data(),
+                      read_buffer.size(), &host_bytes_read);
+    if (XFAILED(result)) {
+      if (!bytes_done) {
+        return result;
+      }
+      break;
+    }
+    host_bytes_read = std::min(host_bytes_read, read_buffer.size());
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      // A short block is only cached as the end of the file.
+      for (size_t i = 0;
+           i < block_count && invalidation_count == invalidation_count_; ++i) {
+        size_t block_start = i << kBlockSizeLog2;
+        if (block_start > host_bytes_read ||
+            (block_start == host_bytes_read && i)) {
+          break;
+        }
+        InsertBlock({owner, key.index + i}, read_buffer.data() + block_start,
+                    std::min(host_bytes_read - block_start, kBlockSize));
+      }
+    }
+    if (block_offset >= host_bytes_read) {
+      break;
+    }
+    size_t bytes_copied =
+        std::min(length - bytes_done, host_bytes_read - block_offset);
+    std::memcpy(out + bytes_done, read_buffer.data() + block_offset,
+                bytes_copied);
+    bytes_done += bytes_copied;
+    if (host_bytes_read < read_buffer.size()) {
+      // The end of the file.
+      break;
+    }
+  }
+
+  *out_bytes_read = bytes_done;
+  return X_STATUS_SUCCESS;
+}
+
+void BlockCache::Invalidate(const void* owner) {
+  if (!is_enabled()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++invalidation_count_;
+  next_read_offsets_.erase(owner);
+  for (auto it = blocks_.begin(); it != blocks_.end();) {
+    if (it->key.owner == owner) {
+      block_map_.erase(it->key);
+      it = blocks_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+size_t BlockCache::CopyFromBlock(const BlockKey& key, size_t block_offset,
+                                 uint8_t* buffer, size_t length) {
+  auto it = block_map_.find(key);
+  if (it == block_map_.end()) {
+    return SIZE_MAX;
+  }
+  blocks_.splice(blocks_.begin(), blocks_, it->second);
+  const Block& block = *it->second;
+  if (block_offset >= block.size) {
+    return 0;
+  }
+  size_t bytes_copied = std::min(length, block.size - block_offset);
+  std::memcpy(buffer, block.data.get() + block_offset, bytes_copied);
+  return bytes_copied;
+}
+
+void BlockCache::InsertBlock(const BlockKey& key, const uint8_t* data,
+                             size_t size) {
+  auto it = block_map_.find(key);
+  if (it != block_map_.end()) {
+    // Read by another thread in the meantime, keep the newer data.
+    blocks_.erase(it->second);
+    block_map_.erase(it);
+  } else if (blocks_.size() >= max_block_count_) {
+    block_map_.erase(blocks_.back().key);
+    blocks_.pop_back();
+  }
+  Block block;
+  block.key = key;
+  block.size = size;
+  block.data = std::make_unique<uint8_t[]>(kBlockSize);
+  std::memcpy(block.data.get(), data, size);
+  blocks_.push_front(std::move(block));
+  block_map_.emplace(key, blocks_.begin());
+}
+
+}  // namespace vfs
+}  // namespace xe
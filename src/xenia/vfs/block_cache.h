@@ -0,0 +1,108 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_BLOCK_CACHE_H_
+#define XENIA_VFS_BLOCK_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include "xenia/xbox.h"
+
+namespace xe {
+namespace vfs {
+
+// Least recently used cache of fixed-size blocks of file contents, for devices
+// where each read is a host call, so titles doing many small reads (such as 4
+// KB at a time from archives) cause fewer, larger host reads. When an owner is
+// read sequentially, the blocks after the requested range are read along with
+// it.
+// Blocks are keyed by an owner pointer, usually the Entry, that must be
+// invalidated when the data changes or the owner is destroyed.
+class BlockCache {
+ public:
+  static constexpr size_t kBlockSizeLog2 = 16;
+  static constexpr size_t kBlockSize = size_t(1) << kBlockSizeLog2;
+  // Upper limit of a single read of the underlying file.
+  static constexpr size_t kMaxBlocksPerRead = 16;
+
+  // Reads length bytes at offset into buffer, returning the status and the
+  // number of bytes read, with fewer bytes read at the end of the file.
+  using ReadFunction =
+      std::function<X_STATUS(size_t offset, void* buffer, size_t length,
+                             size_t* out_bytes_read)>;
+
+  // The cache is disabled if it can't hold a single read of the maximum size.
+  BlockCache(size_t max_size, uint32_t read_ahead_block_count);
+
+  // The cache shared by all devices, configured via cvars.
+  static BlockCache& shared();
+
+  bool is_enabled() const { return max_block_count_ != 0; }
+
+  // Reads through the cache, calling read_function for the missing blocks.
+  X_STATUS Read(const void* owner, void* buffer, size_t length, size_t offset,
+                size_t* out_bytes_read, const ReadFunction& read_function);
+
+  // Drops all the blocks of the owner.
+  void Invalidate(const void* owner);
+
+ private:
+  struct BlockKey {
+    const void* owner;
+    size_t index;
+    bool operator==(const BlockKey& other) const {
+      return owner == other.owner && index == other.index;
+    }
+  };
+  struct BlockKeyHasher {
+    size_t operator()(const BlockKey& key) const {
+      return std::hash<const void*>()(key.owner) ^
+             std::hash<size_t>()(key.index * size_t(0x9E3779B97F4A7C15));
+    }
+  };
+  struct Block {
+    BlockKey key;
+    // Shorter than kBlockSize for the last block of the file.
+    size_t size;
+    std::unique_ptr<uint8_t[]> data;
+  };
+
+  // Returns how many bytes were copied from the block, or SIZE_MAX if it's
+  // not cached. Must be called with the mutex locked.
+  size_t CopyFromBlock(const BlockKey& key, size_t block_offset,
+                       uint8_t* buffer, size_t length);
+  // Must be called with the mutex locked.
+  void InsertBlock(const BlockKey& key, const uint8_t* data, size_t size);
+
+  size_t max_block_count_;
+  uint32_t read_ahead_block_count_;
+
+  std::mutex mutex_;
+  // Most recently used first.
+  std::list<Block> blocks_;
+  std::unordered_map<BlockKey, std::list<Block>::iterator, BlockKeyHasher>
+      block_map_;
+  // Where the next read of each owner would start if it's sequential.
+  std::unordered_map<const void*, size_t> next_read_offsets_;
+  // Blocks read while anything was invalidated may be stale, and are not
+  // inserted.
+  uint64_t invalidation_count_ = 0;
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_BLOCK_CACHE_H_
@@ -0,0 +1,269 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/compressed_disc_image.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "third_party/snappy/snappy.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/xxhash.h"
+
+DEFINE_uint32(vfs_compressed_image_cache_size, 32,
+              "Size of the cache of decompressed chunks of compressed disc "
+              "images, in MiB. 0 to decompress the chunks on every read.",
+              "Storage");
+DECLARE_uint32(vfs_read_ahead_blocks);
+
+namespace xe {
+namespace vfs {
+
+bool CompressedDiscImage::HasMagic(const uint8_t* data, size_t size) {
+  uint32_t magic;
+  if (size < sizeof(FileHeader)) {
+    return false;
+  }
+  std::memcpy(&magic, data, sizeof(magic));
+  return magic == kMagic;
+}
+
+std::unique_ptr<CompressedDiscImage> CompressedDiscImage::Open(
+    MappedMemory* mmap) {
+  if (!HasMagic(mmap->data(), mmap->size())) {
+    return nullptr;
+  }
+  FileHeader header;
+  std::memcpy(&header, mmap->data(), sizeof(header));
+  if (header.version != 1 && header.version != kVersion) {
+    XELOGE("Unsupported compressed disc image version {}", header.version);
+    return nullptr;
+  }
+  if (!header.chunk_size || header.chunk_size > 16 * 1024 * 1024 ||
+      header.chunk_count != (header.image_size + header.chunk_size - 1) /
+                                header.chunk_size ||
+      header.index_offset < sizeof(header) ||
+      header.index_offset > mmap->size() ||
+      (mmap->size() - header.index_offset) / sizeof(uint64_t) <=
+          uint64_t(header.chunk_count) * (header.version >= 2 ? 2 : 1)) {
+    XELOGE("Compressed disc image header is corrupted");
+    return nullptr;
+  }
+
+  // Validate the whole index once so reads only need to check the data.
+  const uint8_t* chunk_offsets = mmap->data() + header.index_offset;
+  uint64_t previous_offset = sizeof(header);
+  for (uint32_t i = 0; i <= header.chunk_count; ++i) {
+    uint64_t offset;
+    std::memcpy(&offset, chunk_offsets + sizeof(uint64_t) * i, sizeof(offset));
+    if (offset < previous_offset || offset > header.index_offset) {
+      XELOGE("Compressed disc image chunk {} has an invalid offset", i);
+      return nullptr;
+    }
+    previous_offset = offset;
+  }
+
+  XELOGI("Compressed disc image: {} bytes in {} chunks of {} bytes",
+         header.image_size, header.chunk_count, header.chunk_size);
+  return std::unique_ptr<CompressedDiscImage>(
+      new CompressedDiscImage(mmap, header));
+}
+
+CompressedDiscImage::CompressedDiscImage(MappedMemory* mmap,
+                                         const FileHeader& header)
+    : mmap_(mmap),
+      image_size_(header.image_size),
+      chunk_size_(header.chunk_size),
+      chunk_count_(header.chunk_count),
+      chunk_offsets_(mmap->data() + header.index_offset),
+      chunk_hashes_(header.version >= 2
+                        ? chunk_offsets_ + sizeof(uint64_t) *
+                                               (size_t(chunk_count_) + 1)
+                        : nullptr),
+      verified_chunks_((size_t(chunk_count_) + 63) / 64),
+      cache_(size_t(cvars::vfs_compressed_image_cache_size) << 20,
+             cvars::vfs_read_ahead_blocks) {}
+
+size_t CompressedDiscImage::GetChunkLength(size_t chunk_index) const {
+  return size_t(std::min(uint64_t(chunk_size_),
+                         image_size_ - uint64_t(chunk_index) * chunk_size_));
+}
+
+X_STATUS CompressedDiscImage::DecompressChunk(size_t chunk_index,
+                                              uint8_t* buffer) {
+  uint64_t offsets[2];
+  std::memcpy(offsets, chunk_offsets_ + sizeof(uint64_t) * chunk_index,
+              sizeof(offsets));
+  auto stored_data = reinterpret_cast<const char*>(mmap_->data() + offsets[0]);
+  size_t stored_length = size_t(offsets[1] - offsets[0]);
+  size_t chunk_length = GetChunkLength(chunk_index);
+  if (stored_length == chunk_length) {
+    // Didn't compress.
+    std::memcpy(buffer, stored_data, chunk_length);
+  } else {
+    size_t uncompressed_length;
+    if (!snappy::GetUncompressedLength(stored_data, stored_length,
+                                       &uncompressed_length) ||
+        uncompressed_length != chunk_length ||
+        !snappy::RawUncompress(stored_data, stored_length,
+                               reinterpret_cast<char*>(buffer))) {
+      XELOGE("Compressed disc image chunk {} is corrupted", chunk_index);
+      return X_STATUS_CRC_ERROR;
+    }
+  }
+
+  if (!chunk_hashes_) {
+    return X_STATUS_SUCCESS;
+  }
+  std::atomic<uint64_t>& verified_bits = verified_chunks_[chunk_index / 64];
+  uint64_t verified_bit = uint64_t(1) << (chunk_index % 64);
+  if (verified_bits.load(std::memory_order_relaxed) & verified_bit) {
+    return X_STATUS_SUCCESS;
+  }
+  uint64_t hash;
+  std::memcpy(&hash, chunk_hashes_ + sizeof(uint64_t) * chunk_index,
+              sizeof(hash));
+  if (XXH3_64bits(buffer, chunk_length) != hash) {
+    XELOGE("Compressed disc image chunk {} has an invalid hash", chunk_index);
+    return X_STATUS_CRC_ERROR;
+  }
+  if (!(verified_bits.fetch_or(verified_bit) & verified_bit)) {
+    ++verified_chunk_count_;
+  }
+  return X_STATUS_SUCCESS;
+}
+
+X_STATUS CompressedDiscImage::Read(void* buffer, size_t length, size_t offset,
+                                   size_t* out_bytes_read) {
+  return cache_.Read(this, buffer, length, offset, out_bytes_read,
+                     [this](size_t read_offset, void* read_buffer,
+                            size_t read_length, size_t* out_read_bytes) {
+                       return ReadChunks(read_offset, read_buffer, read_length,
+                                         out_read_bytes);
+                     });
+}
+
+X_STATUS CompressedDiscImage::ReadChunks(size_t offset, void* buffer,
+                                         size_t length,
+                                         size_t* out_bytes_read) {
+  *out_bytes_read = 0;
+  if (offset >= image_size_) {
+    return X_STATUS_SUCCESS;
+  }
+  length = size_t(std::min(uint64_t(length), image_size_ - offset));
+  auto out = reinterpret_cast<uint8_t*>(buffer);
+  std::vector<uint8_t> chunk_buffer;
+  size_t bytes_done = 0;
+  while (bytes_done < length) {
+    size_t position = offset + bytes_done;
+    size_t chunk_index = position / chunk_size_;
+    size_t chunk_offset = position % chunk_size_;
+    size_t chunk_length = GetChunkLength(chunk_index);
+    size_t bytes_to_copy =
+        std::min(length - bytes_done, chunk_length - chunk_offset);
+    if (!chunk_offset && bytes_to_copy == chunk_length) {
+      // The whole chunk is needed, decompress it in place.
+      X_STATUS result = DecompressChunk(chunk_index, out + bytes_done);
+      if (XFAILED(result)) {
+        return result;
+      }
+    } else {
+      chunk_buffer.resize(chunk_size_);
+      X_STATUS result = DecompressChunk(chunk_index, chunk_buffer.data());
+      if (XFAILED(result)) {
+        return result;
+      }
+      std::memcpy(out + bytes_done, chunk_buffer.data() + chunk_offset,
+                  bytes_to_copy);
+    }
+    bytes_done += bytes_to_copy;
+  }
+  *out_bytes_read = bytes_done;
+  return X_STATUS_SUCCESS;
+}
+
+bool CompressedDiscImage::Convert(const std::filesystem::path& source_path,
+                                  const std::filesystem::path& target_path,
+                                  uint32_t chunk_size) {
+  if (!chunk_size) {
+    return false;
+  }
+  auto source = MappedMemory::Open(source_path, MappedMemory::Mode::kRead);
+  if (!source) {
+    XELOGE("Failed to open the disc image {}", xe::path_to_utf8(source_path));
+    return false;
+  }
+  FILE* file = xe::filesystem::OpenFile(target_path, "wb");
+  if (!file) {
+    XELOGE("Failed to open the compressed disc image {} for writing",
+           xe::path_to_utf8(target_path));
+    return false;
+  }
+
+  FileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.image_size = source->size();
+  header.chunk_size = chunk_size;
+  header.chunk_count =
+      uint32_t((header.image_size + chunk_size - 1) / chunk_size);
+  // Written with the index offset once all the chunks are.
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+
+  std::vector<uint64_t> chunk_offsets;
+  chunk_offsets.reserve(size_t(header.chunk_count) * 2 + 1);
+  std::vector<uint64_t> chunk_hashes;
+  chunk_hashes.reserve(header.chunk_count);
+  uint64_t offset = sizeof(header);
+  std::string compressed;
+  for (uint32_t i = 0; written && i < header.chunk_count; ++i) {
+    auto chunk_data = reinterpret_cast<const char*>(source->data()) +
+                      size_t(i) * chunk_size;
+    size_t chunk_length = std::min(size_t(chunk_size),
+                                   source->size() - size_t(i) * chunk_size);
+    snappy::Compress(chunk_data, chunk_length, &compressed);
+    chunk_offsets.push_back(offset);
+    chunk_hashes.push_back(XXH3_64bits(chunk_data, chunk_length));
+    if (compressed.size() >= chunk_length) {
+      // The reader tells stored chunks apart by their length.
+      written = fwrite(chunk_data, 1, chunk_length, file) == chunk_length;
+      offset += chunk_length;
+    } else {
+      written = fwrite(compressed.data(), 1, compressed.size(), file) ==
+                compressed.size();
+      offset += compressed.size();
+    }
+  }
+  chunk_offsets.push_back(offset);
+  chunk_offsets.insert(chunk_offsets.end(), chunk_hashes.begin(),
+                       chunk_hashes.end());
+  header.index_offset = offset;
+  written = written &&
+            fwrite(chunk_offsets.data(), sizeof(uint64_t),
+                   chunk_offsets.size(), file) == chunk_offsets.size() &&
+            !fseek(file, 0, SEEK_SET) &&
+            fwrite(&header, sizeof(header), 1, file) == 1;
+  fclose(file);
+  if (!written) {
+    XELOGE("Failed to write the compressed disc image {}",
+           xe::path_to_utf8(target_path));
+    return false;
+  }
+  XELOGI("Compressed {} bytes of {} to {} bytes", header.image_size,
+         xe::path_to_utf8(source_path), offset);
+  return true;
+}
+
+}  // namespace vfs
+}  // namespace xe
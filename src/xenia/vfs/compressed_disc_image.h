@@ -0,0 +1,115 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_COMPRESSED_DISC_IMAGE_H_
+#define XENIA_VFS_COMPRESSED_DISC_IMAGE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "xenia/base/mapped_memory.h"
+#include "xenia/vfs/block_cache.h"
+#include "xenia/xbox.h"
+
+namespace xe {
+namespace vfs {
+
+// Disc image split into fixed-size chunks compressed independently with
+// snappy, with an index of the chunk offsets, so any part of the image can be
+// read by decompressing only the chunks it covers. Chunks that don't compress
+// are stored as is. Decompressed chunks are kept in a cache, so small reads
+// from the same chunk only decompress it once. Each chunk has a hash of its
+// uncompressed data, checked the first time the chunk is decompressed, so a
+// corrupted chunk fails only the reads of the files it's a part of.
+class CompressedDiscImage {
+ public:
+  static constexpr uint32_t kDefaultChunkSize =
+      uint32_t(BlockCache::kBlockSize);
+
+  // Whether the data starts like a compressed disc image, regardless of
+  // whether the rest is valid.
+  static bool HasMagic(const uint8_t* data, size_t size);
+
+  // Returns nullptr if the mapping doesn't contain a valid compressed disc
+  // image. The mapping must outlive the image.
+  static std::unique_ptr<CompressedDiscImage> Open(MappedMemory* mmap);
+
+  // Writes the compressed version of the uncompressed image at source_path to
+  // target_path.
+  static bool Convert(const std::filesystem::path& source_path,
+                      const std::filesystem::path& target_path,
+                      uint32_t chunk_size = kDefaultChunkSize);
+
+  // Size of the uncompressed image.
+  uint64_t image_size() const { return image_size_; }
+  uint32_t chunk_size() const { return chunk_size_; }
+
+  // Reads length bytes of the uncompressed image at offset, with fewer bytes
+  // read at the end of the image. Returns X_STATUS_CRC_ERROR if the data is
+  // corrupted.
+  X_STATUS Read(void* buffer, size_t length, size_t offset,
+                size_t* out_bytes_read);
+
+  // Number of chunks whose hash has been checked.
+  size_t verified_chunk_count() const { return verified_chunk_count_; }
+
+ private:
+  // 'XCDI'.
+  static constexpr uint32_t kMagic = 0x49444358;
+  // Version 1 has no chunk hashes.
+  static constexpr uint32_t kVersion = 2;
+
+  struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t image_size;
+    uint32_t chunk_size;
+    uint32_t chunk_count;
+    // Offset of chunk_count + 1 uint64_t offsets of the chunks in the file,
+    // the last being the end of the last chunk, followed by the chunk_count
+    // uint64_t XXH3 hashes of the uncompressed chunks.
+    uint64_t index_offset;
+  };
+
+  CompressedDiscImage(MappedMemory* mmap, const FileHeader& header);
+
+  // Decompressed size of a chunk, shorter for the last one.
+  size_t GetChunkLength(size_t chunk_index) const;
+  // Decompresses chunk_length bytes of the chunk into buffer, checking the
+  // hash of the chunk if it hasn't been yet.
+  X_STATUS DecompressChunk(size_t chunk_index, uint8_t* buffer);
+  // Reads directly from the chunks, used to fill the cache.
+  X_STATUS ReadChunks(size_t offset, void* buffer, size_t length,
+                      size_t* out_bytes_read);
+
+  MappedMemory* mmap_;
+  uint64_t image_size_;
+  uint32_t chunk_size_;
+  uint32_t chunk_count_;
+  const uint8_t* chunk_offsets_;
+  // Null for version 1 images.
+  const uint8_t* chunk_hashes_;
+
+  // Bit per chunk, set once the hash of the chunk has matched, so chunks
+  // decompressed again after leaving the cache aren't hashed again.
+  std::vector<std::atomic<uint64_t>> verified_chunks_;
+  std::atomic<size_t> verified_chunk_count_{0};
+
+  // Decompressed chunks.
+  BlockCache cache_;
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_COMPRESSED_DISC_IMAGE_H_
@@ -11,6 +11,7 @@
 #define XENIA_VFS_DEVICE_H_
 
 #include <memory>
+#include <mutex>
 #include <string>
 
 #include "xenia/base/mutex.h"
@@ -42,8 +43,12 @@ class Device {
   virtual uint32_t sectors_per_allocation_unit() const = 0;
   virtual uint32_t bytes_per_sector() const = 0;
 
+  // Guards the children of the entries of the device. Never held while
+  // acquiring the global critical region.
+  std::recursive_mutex& entry_mutex() { return entry_mutex_; }
+
  protected:
-  xe::global_critical_region global_critical_region_;
+  std::recursive_mutex entry_mutex_;
   std::string mount_path_;
 };
 
@@ -9,8 +9,10 @@
 
 #include "xenia/vfs/devices/disc_image_device.h"
 
+#include <algorithm>
 #include <chrono>
-#include <thread>
+#include <functional>
+#include <vector>
 
 #include "xenia/base/literals.h"
 #include "xenia/base/logging.h"
@@ -29,7 +31,11 @@ DiscImageDevice::DiscImageDevice(const std::string_view mount_path,
                                  const std::filesystem::path& host_path)
     : Device(mount_path), name_("GDFX"), host_path_(host_path) {}
 
-DiscImageDevice::~DiscImageDevice() = default;
+DiscImageDevice::~DiscImageDevice() {
+  if (root_entry_) {
+    LogReadStats();
+  }
+}
 
 bool DiscImageDevice::Initialize() {
   XELOGI("=== Loading Disc Image with Robust I/O ===");
@@ -43,17 +49,17 @@ bool DiscImageDevice::Initialize() {
     XELOGW("  Continuing with retry logic enabled...");
   }
 
-  // Attempt to open with retry logic
-  const int max_retries = 5;
+  // Attempt to open with retry logic, waiting longer between the attempts
+  // only while I/O is slow.
+  robust_io::RobustIOConfig retry_config;
+  const int max_retries = retry_config.max_retries;
+  robust_io::RetryPolicy retry_policy(retry_config);
   for (int retry = 0; retry <= max_retries; retry++) {
     if (retry > 0) {
       XELOGW("Retry attempt {} of {} for disc image", retry, max_retries);
-
-      // Wait before retry (exponential backoff)
-      int wait_ms = 100 * (1 << (retry - 1));
-      wait_ms = std::min(wait_ms, 2000);  // Max 2 seconds
-      XELOGI("  Waiting {}ms before retry...", wait_ms);
-      std::this_thread::sleep_for(std::chrono::milliseconds(wait_ms));
+      if (!retry_policy.WaitBeforeRetry(retry)) {
+        break;
+      }
 
       // Check interference level
       if (interference.IsInterferenceActive()) {
@@ -117,9 +123,17 @@ bool DiscImageDevice::Initialize() {
     return false;
   }
 
+  if (CompressedDiscImage::HasMagic(mmap_->data(), mmap_->size())) {
+    compressed_image_ = CompressedDiscImage::Open(mmap_.get());
+    if (!compressed_image_) {
+      XELOGE("Failed to open the compressed disc image");
+      return false;
+    }
+  }
+
   ParseState state = {0};
-  state.ptr = mmap_->data();
-  state.size = mmap_->size();
+  state.ptr = compressed_image_ ? nullptr : mmap_->data();
+  state.size = image_size();
 
   XELOGI("  Verifying disc image...");
   auto result = Verify(&state);
@@ -140,7 +154,13 @@ bool DiscImageDevice::Initialize() {
   }
 
   XELOGI("  Reading directory entries...");
-  result = ReadAllEntries(&state, state.ptr + state.root_offset);
+  const uint8_t* root_buffer =
+      ReadImage(&state, state.root_offset, state.root_size);
+  if (!root_buffer) {
+    XELOGE("Failed to read the GDFX root directory");
+    return false;
+  }
+  result = ReadAllEntries(&state, root_buffer);
   if (result != Error::kSuccess) {
     XELOGE("Failed to read all GDFX entries: {}", static_cast<int>(result));
     return false;
@@ -151,10 +171,70 @@ bool DiscImageDevice::Initialize() {
 }
 
 void DiscImageDevice::Dump(StringBuffer* string_buffer) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::recursive_mutex> lock(entry_mutex_);
   root_entry_->Dump(string_buffer, 0);
 }
 
+void DiscImageDevice::RecordRead(DiscImageEntry* entry, size_t bytes_read,
+                                 uint64_t hard_fault_count,
+                                 uint64_t read_time_us) {
+  DiscImageEntry::ReadStats& stats = entry->read_stats();
+  stats.read_count.fetch_add(1, std::memory_order_relaxed);
+  stats.bytes_read.fetch_add(bytes_read, std::memory_order_relaxed);
+  stats.hard_fault_count.fetch_add(hard_fault_count,
+                                   std::memory_order_relaxed);
+  stats.read_time_us.fetch_add(read_time_us, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> lock(io_timing_mutex_);
+  io_timing_pending_bytes_ += bytes_read;
+  io_timing_pending_time_us_ += read_time_us;
+  if (io_timing_pending_bytes_ >= kIOTimingSampleSize) {
+    robust_io::InterferenceDetector::GetInstance().RecordIOTiming(
+        io_timing_pending_time_us_ / 1000, io_timing_pending_bytes_);
+    io_timing_pending_bytes_ = 0;
+    io_timing_pending_time_us_ = 0;
+  }
+}
+
+void DiscImageDevice::LogReadStats() {
+  std::vector<DiscImageEntry*> read_entries;
+  std::function<void(Entry*)> collect_entries = [&](Entry* entry) {
+    auto disc_image_entry = static_cast<DiscImageEntry*>(entry);
+    if (disc_image_entry->read_stats().read_count.load(
+            std::memory_order_relaxed)) {
+      read_entries.push_back(disc_image_entry);
+    }
+    for (auto& child : entry->children()) {
+      collect_entries(child.get());
+    }
+  };
+  collect_entries(root_entry_.get());
+  if (read_entries.empty()) {
+    return;
+  }
+
+  // Slowest first.
+  std::sort(read_entries.begin(), read_entries.end(),
+            [](DiscImageEntry* a, DiscImageEntry* b) {
+              return a->read_stats().read_time_us.load(
+                         std::memory_order_relaxed) >
+                     b->read_stats().read_time_us.load(
+                         std::memory_order_relaxed);
+            });
+  const size_t kMaxLoggedEntries = 16;
+  XELOGI("Disc image reads of {} files, slowest first:", read_entries.size());
+  for (size_t i = 0; i < std::min(read_entries.size(), kMaxLoggedEntries);
+       ++i) {
+    const DiscImageEntry::ReadStats& stats = read_entries[i]->read_stats();
+    XELOGI("  {}: {} reads, {} bytes, {} hard faults, {} us",
+           read_entries[i]->path(),
+           stats.read_count.load(std::memory_order_relaxed),
+           stats.bytes_read.load(std::memory_order_relaxed),
+           stats.hard_fault_count.load(std::memory_order_relaxed),
+           stats.read_time_us.load(std::memory_order_relaxed));
+  }
+}
+
 Entry* DiscImageDevice::ResolvePath(const std::string_view path) {
   // The filesystem will have stripped our prefix off already, so the path will
   // be in the form:
@@ -191,7 +271,11 @@ DiscImageDevice::Error DiscImageDevice::Verify(ParseState* state) {
     XELOGE("  File too small for GDFX header");
     return Error::kErrorReadError;
   }
-  uint8_t* fs_ptr = state->ptr + state->game_offset + (32 * kXESectorSize);
+  const uint8_t* fs_ptr =
+      ReadImage(state, state->game_offset + (32 * kXESectorSize), 28);
+  if (!fs_ptr) {
+    return Error::kErrorReadError;
+  }
   state->root_sector = xe::load<uint32_t>(fs_ptr + 20);
   state->root_size = xe::load<uint32_t>(fs_ptr + 24);
   state->root_offset =
@@ -232,17 +316,34 @@ bool DiscImageDevice::VerifyMagic(ParseState* state, size_t offset) {
   }
 
   // Simple check to see if the given offset contains the magic value.
-  return std::memcmp(state->ptr + offset, "MICROSOFT*XBOX*MEDIA", 20) == 0;
+  const uint8_t* magic = ReadImage(state, offset, 20);
+  return magic && std::memcmp(magic, "MICROSOFT*XBOX*MEDIA", 20) == 0;
+}
+
+const uint8_t* DiscImageDevice::ReadImage(ParseState* state, size_t offset,
+                                          size_t length) {
+  if (!compressed_image_) {
+    return state->ptr + offset;
+  }
+  state->buffers.emplace_back(length);
+  std::vector<uint8_t>& buffer = state->buffers.back();
+  size_t bytes_read = 0;
+  if (XFAILED(compressed_image_->Read(buffer.data(), length, offset,
+                                      &bytes_read))) {
+    return nullptr;
+  }
+  return buffer.data();
 }
 
 DiscImageDevice::Error DiscImageDevice::ReadAllEntries(
     ParseState* state, const uint8_t* root_buffer) {
   auto root_entry = new DiscImageEntry(this, nullptr, "", mmap_.get());
   root_entry->attributes_ = kFileAttributeDirectory;
+  root_entry->compressed_image_ = compressed_image_.get();
   root_entry_ = std::unique_ptr<Entry>(root_entry);
 
   XELOGI("  Parsing root directory:");
-  XELOGI("    Root buffer offset: 0x{:X}", root_buffer - state->ptr);
+  XELOGI("    Root buffer offset: 0x{:X}", state->root_offset);
   XELOGI("    Root buffer size: {} bytes", state->root_size);
   XELOGI("    First 16 bytes: {:02X} {:02X} {:02X} {:02X} {:02X} {:02X} {:02X} {:02X} {:02X} {:02X} {:02X} {:02X} {:02X} {:02X} {:02X} {:02X}",
          root_buffer[0], root_buffer[1], root_buffer[2], root_buffer[3],
@@ -392,6 +493,7 @@ bool DiscImageDevice::ReadEntry(ParseState* state, const uint8_t* buffer,
   auto name = std::string(name_buffer, name_length);
 
   auto entry = DiscImageEntry::Create(this, parent, name, mmap_.get());
+  entry->compressed_image_ = compressed_image_.get();
   entry->attributes_ = attributes | kFileAttributeReadOnly;
   entry->size_ = length;
   entry->allocation_size_ = xe::round_up(length, bytes_per_sector());
@@ -422,9 +524,10 @@ bool DiscImageDevice::ReadEntry(ParseState* state, const uint8_t* buffer,
           XELOGI("  Directory '{}': reading children from sector {} (offset 0x{:X}, length {})",
                  name, sector, folder_offset, length);
         }
-        uint8_t* folder_ptr = state->ptr + folder_offset;
+        const uint8_t* folder_ptr = ReadImage(state, folder_offset, length);
         // New buffer for subfolder, so reset visited set but keep depth tracking
-        if (!ReadEntry(state, folder_ptr, 0, entry.get(), length, depth + 1,
+        if (!folder_ptr ||
+            !ReadEntry(state, folder_ptr, 0, entry.get(), length, depth + 1,
                        nullptr)) {
           XELOGW("  WARNING: Failed to read children of directory '{}'", name);
           XELOGW("    Directory may be corrupt or have invalid entries");
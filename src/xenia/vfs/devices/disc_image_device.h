@@ -10,11 +10,15 @@
 #ifndef XENIA_VFS_DEVICES_DISC_IMAGE_DEVICE_H_
 #define XENIA_VFS_DEVICES_DISC_IMAGE_DEVICE_H_
 
+#include <list>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 #include "xenia/base/mapped_memory.h"
+#include "xenia/vfs/compressed_disc_image.h"
 #include "xenia/vfs/device.h"
 
 namespace xe {
@@ -37,14 +41,23 @@ class DiscImageDevice : public Device {
   uint32_t component_name_max_length() const override { return 255; }
 
   uint32_t total_allocation_units() const override {
-    return uint32_t(mmap_->size() / sectors_per_allocation_unit() /
+    return uint32_t(image_size() / sectors_per_allocation_unit() /
                     bytes_per_sector());
   }
   uint32_t available_allocation_units() const override { return 0; }
   uint32_t sectors_per_allocation_unit() const override { return 1; }
   uint32_t bytes_per_sector() const override { return 0x200; }
 
+  // Adds a read of the entry to its statistics and to the I/O timing samples
+  // of the interference detector.
+  void RecordRead(DiscImageEntry* entry, size_t bytes_read,
+                  uint64_t hard_fault_count, uint64_t read_time_us);
+
  private:
+  // Reads are accumulated into I/O timing samples of at least this size, so
+  // they are comparable with the samples of whole chunk reads.
+  static constexpr size_t kIOTimingSampleSize = 1024 * 1024;
+
   enum class Error {
     kSuccess = 0,
     kErrorOutOfMemory = -1,
@@ -57,6 +70,17 @@ class DiscImageDevice : public Device {
   std::filesystem::path host_path_;
   std::unique_ptr<Entry> root_entry_;
   std::unique_ptr<MappedMemory> mmap_;
+  // Null if the image is not compressed.
+  std::unique_ptr<CompressedDiscImage> compressed_image_;
+
+  std::mutex io_timing_mutex_;
+  size_t io_timing_pending_bytes_ = 0;
+  uint64_t io_timing_pending_time_us_ = 0;
+
+  size_t image_size() const {
+    return compressed_image_ ? size_t(compressed_image_->image_size())
+                             : mmap_->size();
+  }
 
   typedef struct {
     uint8_t* ptr;
@@ -65,8 +89,16 @@ class DiscImageDevice : public Device {
     size_t root_sector;  // Offset (sector) of root.
     size_t root_offset;  // Offset (bytes) of root.
     size_t root_size;    // Size (bytes) of root.
+    // Decompressed parts of a compressed image, until parsing is done.
+    std::list<std::vector<uint8_t>> buffers;
   } ParseState;
 
+  // Returns the length bytes of the image at offset, zero-filled past the end
+  // of the image, or nullptr if they couldn't be read.
+  const uint8_t* ReadImage(ParseState* state, size_t offset, size_t length);
+
+  void LogReadStats();
+
   Error Verify(ParseState* state);
   bool VerifyMagic(ParseState* state, size_t offset);
   Error ReadAllEntries(ParseState* state, const uint8_t* root_buffer);
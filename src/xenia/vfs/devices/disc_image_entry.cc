@@ -41,13 +41,15 @@ X_STATUS DiscImageEntry::Open(uint32_t desired_access, File** out_file) {
 
 std::unique_ptr<MappedMemory> DiscImageEntry::OpenMapped(
     MappedMemory::Mode mode, size_t offset, size_t length) {
-  if (mode != MappedMemory::Mode::kRead) {
+  if (mode != MappedMemory::Mode::kRead || compressed_image_) {
     // Only allow reads.
     return nullptr;
   }
 
   size_t real_offset = data_offset_ + offset;
   size_t real_length = length ? std::min(length, data_size_) : data_size_;
+  // Mapped files are usually loaded as a whole, such as modules.
+  mmap_->Prefetch(real_offset, real_length, true);
   return mmap_->Slice(real_offset, real_length);
 }
 
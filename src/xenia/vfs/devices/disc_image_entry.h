@@ -10,10 +10,12 @@
 #ifndef XENIA_VFS_DEVICES_DISC_IMAGE_ENTRY_H_
 #define XENIA_VFS_DEVICES_DISC_IMAGE_ENTRY_H_
 
+#include <atomic>
 #include <string>
 #include <vector>
 
 #include "xenia/base/mapped_memory.h"
+#include "xenia/vfs/compressed_disc_image.h"
 #include "xenia/vfs/entry.h"
 
 namespace xe {
@@ -23,6 +25,15 @@ class DiscImageDevice;
 
 class DiscImageEntry : public Entry {
  public:
+  // Reads of the contents, for finding the files that are slow to load.
+  struct ReadStats {
+    std::atomic<uint64_t> read_count{0};
+    std::atomic<uint64_t> bytes_read{0};
+    // Page faults that required reading from the backing storage.
+    std::atomic<uint64_t> hard_fault_count{0};
+    std::atomic<uint64_t> read_time_us{0};
+  };
+
   DiscImageEntry(Device* device, Entry* parent, const std::string_view path,
                  MappedMemory* mmap);
   ~DiscImageEntry() override;
@@ -32,12 +43,16 @@ class DiscImageEntry : public Entry {
                                                 MappedMemory* mmap);
 
   MappedMemory* mmap() const { return mmap_; }
+  // Null if the image is not compressed, in which case the data is in mmap.
+  CompressedDiscImage* compressed_image() const { return compressed_image_; }
   size_t data_offset() const { return data_offset_; }
   size_t data_size() const { return data_size_; }
+  ReadStats& read_stats() { return read_stats_; }
 
   X_STATUS Open(uint32_t desired_access, File** out_file) override;
 
-  bool can_map() const override { return true; }
+  // Compressed images have no mapping to view, and are read via files.
+  bool can_map() const override { return !compressed_image_; }
   std::unique_ptr<MappedMemory> OpenMapped(MappedMemory::Mode mode,
                                            size_t offset,
                                            size_t length) override;
@@ -46,8 +61,10 @@ class DiscImageEntry : public Entry {
   friend class DiscImageDevice;
 
   MappedMemory* mmap_;
+  CompressedDiscImage* compressed_image_ = nullptr;
   size_t data_offset_;
   size_t data_size_;
+  ReadStats read_stats_;
 };
 
 }  // namespace vfs
@@ -10,7 +10,10 @@
 #include "xenia/vfs/devices/disc_image_file.h"
 
 #include <algorithm>
+#include <chrono>
 
+#include "xenia/base/logging.h"
+#include "xenia/vfs/devices/disc_image_device.h"
 #include "xenia/vfs/devices/disc_image_entry.h"
 
 namespace xe {
@@ -31,9 +34,50 @@ X_STATUS DiscImageFile::ReadSync(void* buffer, size_t buffer_length,
   size_t real_offset = entry_->data_offset() + byte_offset;
   size_t real_length =
       std::min(buffer_length, entry_->data_size() - byte_offset);
-  std::memcpy(buffer, entry_->mmap()->data() + real_offset, real_length);
-  *out_bytes_read = real_length;
-  return X_STATUS_SUCCESS;
+  bool sequential = byte_offset && byte_offset == next_read_offset_;
+  next_read_offset_ = byte_offset + real_length;
+
+  auto start_time = std::chrono::steady_clock::now();
+  uint64_t start_hard_fault_count = MappedMemory::GetThreadHardFaultCount();
+  X_STATUS result = X_STATUS_SUCCESS;
+  if (entry_->compressed_image()) {
+    result = entry_->compressed_image()->Read(buffer, real_length, real_offset,
+                                              out_bytes_read);
+  } else {
+    MappedMemory* mmap = entry_->mmap();
+    // Fault in large reads with a few big requests rather than page by page.
+    if (real_length >= kPrefetchMinLength) {
+      mmap->Prefetch(real_offset, real_length);
+    }
+    std::memcpy(buffer, mmap->data() + real_offset, real_length);
+    *out_bytes_read = real_length;
+    if (real_length >= kDiscardMinLength) {
+      mmap->Discard(real_offset, real_length);
+    }
+    // Start reading the next part of sequentially read files in the
+    // background.
+    size_t data_remaining = entry_->data_size() - (byte_offset + real_length);
+    if (sequential && data_remaining) {
+      mmap->Prefetch(
+          real_offset + real_length,
+          std::min(std::max(real_length, kPrefetchMinLength), data_remaining),
+          true);
+    }
+  }
+  if (result == X_STATUS_CRC_ERROR) {
+    XELOGE("Data of {} at offset {} in the disc image is corrupted",
+           entry_->path(), byte_offset);
+  }
+  if (XSUCCEEDED(result)) {
+    uint64_t hard_fault_count =
+        MappedMemory::GetThreadHardFaultCount() - start_hard_fault_count;
+    auto read_time = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_time);
+    static_cast<DiscImageDevice*>(entry_->device())
+        ->RecordRead(entry_, *out_bytes_read, hard_fault_count,
+                     uint64_t(read_time.count()));
+  }
+  return result;
 }
 
 }  // namespace vfs
@@ -33,7 +33,16 @@ class DiscImageFile : public File {
   X_STATUS SetLength(size_t length) override { return X_STATUS_ACCESS_DENIED; }
 
  private:
+  // Reads at least this large are prefetched as a whole.
+  static constexpr size_t kPrefetchMinLength = 64 * 1024;
+  // Pages of reads at least this large, usually streamed textures and movies,
+  // are removed from the working set once copied to the guest, rather than
+  // being kept in memory twice.
+  static constexpr size_t kDiscardMinLength = 1024 * 1024;
+
   DiscImageEntry* entry_;
+  // Where the next read would start if the file is read sequentially.
+  size_t next_read_offset_ = 0;
 };
 
 }  // namespace vfs
@@ -48,7 +48,7 @@ bool HostPathDevice::Initialize() {
 }
 
 void HostPathDevice::Dump(StringBuffer* string_buffer) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::recursive_mutex> lock(entry_mutex_);
   root_entry_->Dump(string_buffer, 0);
 }
 
@@ -9,8 +9,22 @@
 
 #include "xenia/vfs/devices/host_path_file.h"
 
+#include "xenia/base/cvar.h"
+#include "xenia/base/logging.h"
+#include "xenia/vfs/block_cache.h"
 #include "xenia/vfs/devices/host_path_entry.h"
 
+DEFINE_uint32(vfs_write_buffer_size, 256,
+              "Size of the buffer of each host file opened for writing, in "
+              "KiB, to write adjacent small writes by the guest to the host "
+              "together. The buffer is written when the file is closed or "
+              "flushed. 0 to write immediately.",
+              "Storage");
+DEFINE_uint32(vfs_write_buffer_timeout, 1000,
+              "Time after which data in the buffer of a host file is written "
+              "on the next access to the file, in milliseconds.",
+              "Storage");
+
 namespace xe {
 namespace vfs {
 
@@ -19,7 +33,10 @@ HostPathFile::HostPathFile(
     std::unique_ptr<xe::filesystem::FileHandle> file_handle)
     : File(file_access, entry), file_handle_(std::move(file_handle)) {}
 
-HostPathFile::~HostPathFile() = default;
+HostPathFile::~HostPathFile() {
+  std::lock_guard<std::mutex> lock(write_buffer_mutex_);
+  FlushWriteBuffer();
+}
 
 void HostPathFile::Destroy() { delete this; }
 
@@ -30,11 +47,25 @@ X_STATUS HostPathFile::ReadSync(void* buffer, size_t buffer_length,
     return X_STATUS_ACCESS_DENIED;
   }
 
-  if (file_handle_->Read(byte_offset, buffer, buffer_length, out_bytes_read)) {
-    return X_STATUS_SUCCESS;
-  } else {
-    return X_STATUS_END_OF_FILE;
+  {
+    // The guest may read back what it has written.
+    std::lock_guard<std::mutex> lock(write_buffer_mutex_);
+    X_STATUS result = FlushWriteBuffer();
+    if (XFAILED(result)) {
+      return result;
+    }
   }
+
+  return BlockCache::shared().Read(
+      entry_, buffer, buffer_length, byte_offset, out_bytes_read,
+      [this](size_t offset, void* read_buffer, size_t length,
+             size_t* out_read_length) {
+        if (file_handle_->Read(offset, read_buffer, length, out_read_length)) {
+          return X_STATUS_SUCCESS;
+        } else {
+          return X_STATUS_END_OF_FILE;
+        }
+      });
 }
 
 X_STATUS HostPathFile::WriteSync(const void* buffer, size_t buffer_length,
@@ -45,8 +76,37 @@ X_STATUS HostPathFile::WriteSync(const void* buffer, size_t buffer_length,
     return X_STATUS_ACCESS_DENIED;
   }
 
-  if (file_handle_->Write(byte_offset, buffer, buffer_length,
-                          out_bytes_written)) {
+  size_t buffer_capacity = size_t(cvars::vfs_write_buffer_size) << 10;
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(write_buffer_mutex_);
+  if (!write_buffer_.empty() &&
+      (byte_offset != write_buffer_offset_ + write_buffer_.size() ||
+       write_buffer_.size() + buffer_length > buffer_capacity ||
+       now - write_buffer_time_ >= std::chrono::milliseconds(
+                                       cvars::vfs_write_buffer_timeout))) {
+    X_STATUS result = FlushWriteBuffer();
+    if (XFAILED(result)) {
+      *out_bytes_written = 0;
+      return result;
+    }
+  }
+  if (buffer_length < buffer_capacity) {
+    if (write_buffer_.empty()) {
+      write_buffer_.reserve(buffer_capacity);
+      write_buffer_offset_ = byte_offset;
+      write_buffer_time_ = now;
+    }
+    auto data = reinterpret_cast<const uint8_t*>(buffer);
+    write_buffer_.insert(write_buffer_.end(), data, data + buffer_length);
+    *out_bytes_written = buffer_length;
+    return X_STATUS_SUCCESS;
+  }
+
+  bool written = file_handle_->Write(byte_offset, buffer, buffer_length,
+                                     out_bytes_written);
+  // After writing, so blocks read during the write are not kept either.
+  BlockCache::shared().Invalidate(entry_);
+  if (written) {
     return X_STATUS_SUCCESS;
   } else {
     return X_STATUS_END_OF_FILE;
@@ -59,12 +119,41 @@ X_STATUS HostPathFile::SetLength(size_t length) {
     return X_STATUS_ACCESS_DENIED;
   }
 
-  if (file_handle_->SetLength(length)) {
+  std::lock_guard<std::mutex> lock(write_buffer_mutex_);
+  X_STATUS result = FlushWriteBuffer();
+  if (XFAILED(result)) {
+    return result;
+  }
+  bool length_set = file_handle_->SetLength(length);
+  BlockCache::shared().Invalidate(entry_);
+  if (length_set) {
     return X_STATUS_SUCCESS;
   } else {
     return X_STATUS_END_OF_FILE;
   }
 }
 
+X_STATUS HostPathFile::Flush() {
+  std::lock_guard<std::mutex> lock(write_buffer_mutex_);
+  return FlushWriteBuffer();
+}
+
+X_STATUS HostPathFile::FlushWriteBuffer() {
+  if (write_buffer_.empty()) {
+    return X_STATUS_SUCCESS;
+  }
+  size_t bytes_written;
+  bool written = file_handle_->Write(write_buffer_offset_, write_buffer_.data(),
+                                     write_buffer_.size(), &bytes_written);
+  if (!written) {
+    XELOGE("Failed to write {} buffered bytes at {} to {}",
+           write_buffer_.size(), write_buffer_offset_,
+           xe::path_to_utf8(file_handle_->path()));
+  }
+  write_buffer_.clear();
+  BlockCache::shared().Invalidate(entry_);
+  return written ? X_STATUS_SUCCESS : X_STATUS_END_OF_FILE;
+}
+
 }  // namespace vfs
 }  // namespace xe
@@ -10,7 +10,10 @@
 #ifndef XENIA_VFS_DEVICES_HOST_PATH_FILE_H_
 #define XENIA_VFS_DEVICES_HOST_PATH_FILE_H_
 
+#include <chrono>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "xenia/base/filesystem.h"
 #include "xenia/vfs/file.h"
@@ -33,9 +36,21 @@ class HostPathFile : public File {
   X_STATUS WriteSync(const void* buffer, size_t buffer_length,
                      size_t byte_offset, size_t* out_bytes_written) override;
   X_STATUS SetLength(size_t length) override;
+  X_STATUS Flush() override;
 
  private:
+  // Writes the buffered data to the host file. write_buffer_mutex_ must be
+  // held.
+  X_STATUS FlushWriteBuffer();
+
   std::unique_ptr<xe::filesystem::FileHandle> file_handle_;
+
+  // Adjacent writes not written to the host file yet, starting at
+  // write_buffer_offset_.
+  std::mutex write_buffer_mutex_;
+  std::vector<uint8_t> write_buffer_;
+  size_t write_buffer_offset_ = 0;
+  std::chrono::steady_clock::time_point write_buffer_time_;
 };
 
 }  // namespace vfs
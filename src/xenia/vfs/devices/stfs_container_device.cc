@@ -10,14 +10,25 @@
 #include "xenia/vfs/devices/stfs_container_device.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <queue>
 #include <unordered_set>
 #include <vector>
 
+#include "xenia/base/crypto.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/threading.h"
 #include "xenia/vfs/devices/stfs_container_entry.h"
 
+DEFINE_bool(vfs_verify_stfs_hashes, false,
+            "Check the hashes of the file and directory blocks of STFS "
+            "packages when mounting them. Damaged blocks are reported, but "
+            "the package is still mounted.",
+            "Storage");
+
 namespace xe {
 namespace vfs {
 
@@ -94,7 +105,7 @@ StfsContainerDevice::Error StfsContainerDevice::OpenFiles() {
   if (header_.metadata.data_file_count <= 1) {
     XELOGI("STFS container is a single file.");
     files_.emplace(std::make_pair(0, header_file));
-    return Error::kSuccess;
+    return OpenDataHandle(0, host_path_);
   }
 
   // If the STFS package is multi-file, it is an SVOD system. We need to map
@@ -134,21 +145,51 @@ StfsContainerDevice::Error StfsContainerDevice::OpenFiles() {
     files_total_size_ += xe::filesystem::Tell(file);
     // no need to seek back, any reads from this file will seek first anyway
     files_.emplace(std::make_pair(i, file));
+    Error handle_result = OpenDataHandle(i, path);
+    if (handle_result != Error::kSuccess) {
+      CloseFiles();
+      return handle_result;
+    }
   }
   XELOGI("SVOD successfully mapped {} files.", fragment_files.size());
   return Error::kSuccess;
 }
 
+StfsContainerDevice::Error StfsContainerDevice::OpenDataHandle(
+    size_t file_index, const std::filesystem::path& path) {
+  auto handle = xe::filesystem::FileHandle::OpenExisting(
+      path, xe::filesystem::FileAccess::kFileReadData);
+  if (!handle) {
+    XELOGE("Failed to open STFS data file {} for reading.",
+           xe::path_to_utf8(path));
+    return Error::kErrorReadError;
+  }
+  data_handles_.emplace(file_index, std::move(handle));
+  return Error::kSuccess;
+}
+
+bool StfsContainerDevice::ReadData(size_t file_index, size_t offset,
+                                   void* buffer, size_t length,
+                                   size_t* out_bytes_read) {
+  *out_bytes_read = 0;
+  auto it = data_handles_.find(file_index);
+  if (it == data_handles_.cend()) {
+    return false;
+  }
+  return it->second->Read(offset, buffer, length, out_bytes_read);
+}
+
 void StfsContainerDevice::CloseFiles() {
   for (auto& file : files_) {
     fclose(file.second);
   }
   files_.clear();
+  data_handles_.clear();
   files_total_size_ = 0;
 }
 
 void StfsContainerDevice::Dump(StringBuffer* string_buffer) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::recursive_mutex> lock(entry_mutex_);
   root_entry_->Dump(string_buffer, 0);
 }
 
@@ -420,8 +461,6 @@ StfsContainerDevice::Error StfsContainerDevice::ReadEntrySVOD(
       uint32_t block_index = dir_entry.data_block;
       size_t remaining_size = xe::round_up(dir_entry.length, 0x800);
 
-      size_t last_record = -1;
-      size_t last_offset = -1;
       while (remaining_size) {
         const size_t BLOCK_SIZE = 0x800;
 
@@ -431,16 +470,7 @@ StfsContainerDevice::Error StfsContainerDevice::ReadEntrySVOD(
         block_index++;
         remaining_size -= BLOCK_SIZE;
 
-        if (offset - last_offset == 0x800) {
-          // Consecutive, so append to last entry.
-          entry->block_list_[last_record].length += BLOCK_SIZE;
-          last_offset = offset;
-          continue;
-        }
-
-        entry->block_list_.push_back({file_index, offset, BLOCK_SIZE});
-        last_record = entry->block_list_.size() - 1;
-        last_offset = offset;
+        entry->AppendBlock(file_index, offset, BLOCK_SIZE);
       }
     }
   }
@@ -535,6 +565,16 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
   uint32_t table_block_index = descriptor.file_table_block_number();
   // Security: Track visited table blocks to detect cycles
   std::unordered_set<uint32_t> visited_table_blocks;
+  // Collected while walking the block chains, which needs the hash tables
+  // anyway, and hashed once the whole directory is read.
+  std::vector<BlockHashCheck> hash_checks;
+  auto add_hash_check = [&](size_t offset, const StfsHashEntry* block_hash) {
+    if (cvars::vfs_verify_stfs_hashes) {
+      BlockHashCheck& check = hash_checks.emplace_back();
+      check.offset = offset;
+      std::memcpy(check.sha1, block_hash->sha1, sizeof(check.sha1));
+    }
+  };
   size_t n = 0;
   for (n = 0; n < descriptor.file_table_block_count; n++) {
     // Security: Check for circular table block chain
@@ -608,6 +648,7 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
       if (entry->attributes() & X_FILE_ATTRIBUTE_NORMAL) {
         uint32_t block_index = dir_entry.start_block_number();
         size_t remaining_size = dir_entry.length;
+        uint32_t block_count = 0;
         // Security: Track visited blocks to detect cycles
         std::unordered_set<uint32_t> visited_blocks;
         while (remaining_size && block_index != kEndOfChain) {
@@ -624,7 +665,8 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
           size_t block_size =
               std::min(static_cast<size_t>(kBlockSize), remaining_size);
           size_t offset = BlockToOffsetSTFS(block_index);
-          entry->block_list_.push_back({0, offset, block_size});
+          entry->AppendBlock(0, offset, block_size);
+          ++block_count;
           remaining_size -= block_size;
           auto block_hash = GetBlockHash(block_index);
           // Security: Check for null pointer from GetBlockHash
@@ -635,6 +677,7 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
                 block_index);
             return Error::kErrorDamagedFile;
           }
+          add_hash_check(offset, block_hash);
           block_index = block_hash->level0_next_block();
         }
 
@@ -650,12 +693,11 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
 
         // Check that the number of blocks retrieved from hash entries matches
         // the block count read from the file entry
-        if (entry->block_list_.size() != dir_entry.allocated_data_blocks()) {
+        if (block_count != dir_entry.allocated_data_blocks()) {
           XELOGW(
               "STFS failed to read correct block-chain for entry {}, read {} "
               "blocks, expected {}",
-              entry->name_, entry->block_list_.size(),
-              dir_entry.allocated_data_blocks());
+              entry->name_, block_count, dir_entry.allocated_data_blocks());
           assert_always();
         }
       }
@@ -672,6 +714,7 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
           table_block_index);
       return Error::kErrorDamagedFile;
     }
+    add_hash_check(offset, block_hash);
     table_block_index = block_hash->level0_next_block();
     if (table_block_index == kEndOfChain) {
       break;
@@ -684,9 +727,63 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
     assert_always();
   }
 
+  if (!hash_checks.empty()) {
+    size_t damaged_block_count = VerifyBlockHashes(hash_checks);
+    if (damaged_block_count) {
+      XELOGE("STFS: {} of {} blocks have invalid hashes", damaged_block_count,
+             hash_checks.size());
+    } else {
+      XELOGI("STFS: Verified the hashes of {} blocks", hash_checks.size());
+    }
+  }
+
   return Error::kSuccess;
 }
 
+size_t StfsContainerDevice::VerifyBlockHashes(
+    const std::vector<BlockHashCheck>& checks) {
+  std::atomic<size_t> next_index(0);
+  std::atomic<size_t> damaged_block_count(0);
+  // Data handle reads are positional, so the threads can share the file.
+  auto work = [&]() {
+    uint8_t block[kBlockSize];
+    size_t i;
+    while ((i = next_index.fetch_add(1, std::memory_order_relaxed)) <
+           checks.size()) {
+      const BlockHashCheck& check = checks[i];
+      size_t bytes_read = 0;
+      uint8_t digest[0x14];
+      if (ReadData(0, check.offset, block, kBlockSize, &bytes_read) &&
+          bytes_read == kBlockSize) {
+        sha1::SHA1 sha;
+        xe::crypto::Sha1ProcessBytes(&sha, block, kBlockSize);
+        sha.finalize(digest);
+        if (!std::memcmp(digest, check.sha1, sizeof(digest))) {
+          continue;
+        }
+      }
+      XELOGW("STFS: Block at 0x{:X} has an invalid hash", check.offset);
+      damaged_block_count.fetch_add(1, std::memory_order_relaxed);
+    }
+  };
+  uint32_t thread_count = uint32_t(std::min(
+      size_t(xe::threading::logical_processor_count()), checks.size()));
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads;
+  for (uint32_t i = 1; i < thread_count; ++i) {
+    auto thread = xe::threading::Thread::Create({}, [&work]() { work(); });
+    if (!thread) {
+      break;
+    }
+    thread->set_name("STFS Verify Worker");
+    threads.push_back(std::move(thread));
+  }
+  work();
+  for (auto& thread : threads) {
+    xe::threading::Wait(thread.get(), false);
+  }
+  return damaged_block_count;
+}
+
 size_t StfsContainerDevice::BlockToOffsetSTFS(uint64_t block_index) const {
   // For every level there is a hash table
   // Level 0: hash table of next 170 blocks
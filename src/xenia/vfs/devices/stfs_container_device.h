@@ -14,7 +14,9 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
+#include "xenia/base/filesystem.h"
 #include "xenia/base/math.h"
 #include "xenia/base/string_util.h"
 #include "xenia/kernel/util/xex2_info.h"
@@ -46,6 +48,12 @@ class StfsContainerDevice : public Device {
   void Dump(StringBuffer* string_buffer) override;
   Entry* ResolvePath(const std::string_view path) override;
 
+  // Reads contents of a data file. Reads are positional, so they can be done
+  // from multiple threads at once, including from different data files of
+  // SVOD content.
+  bool ReadData(size_t file_index, size_t offset, void* buffer, size_t length,
+                size_t* out_bytes_read);
+
   const std::string& name() const override { return name_; }
   uint32_t attributes() const override { return 0; }
   uint32_t component_name_max_length() const override { return 40; }
@@ -107,6 +115,7 @@ class StfsContainerDevice : public Device {
   bool ResolveFromFolder(const std::filesystem::path& path);
 
   Error OpenFiles();
+  Error OpenDataHandle(size_t file_index, const std::filesystem::path& path);
   void CloseFiles();
 
   Error ReadHeaderAndVerify(FILE* header_file);
@@ -125,10 +134,21 @@ class StfsContainerDevice : public Device {
 
   const StfsHashEntry* GetBlockHash(uint32_t block_index);
 
+  struct BlockHashCheck {
+    size_t offset;
+    uint8_t sha1[0x14];
+  };
+  // Hashes the blocks on multiple threads, returning the number of blocks
+  // whose data doesn't match the hash from the hash tables.
+  size_t VerifyBlockHashes(const std::vector<BlockHashCheck>& checks);
+
   std::string name_;
   std::filesystem::path host_path_;
 
+  // Used for parsing the metadata.
   std::map<size_t, FILE*> files_;
+  // Used for reading the contents of the entries.
+  std::map<size_t, std::unique_ptr<xe::filesystem::FileHandle>> data_handles_;
   size_t files_total_size_;
 
   size_t svod_base_offset_;
@@ -37,6 +37,19 @@ std::unique_ptr<StfsContainerEntry> StfsContainerEntry::Create(
   return std::move(entry);
 }
 
+void StfsContainerEntry::AppendBlock(size_t file, size_t offset,
+                                     size_t length) {
+  if (!block_list_.empty()) {
+    BlockRecord& last_record = block_list_.back();
+    if (last_record.file == file &&
+        last_record.offset + last_record.length == offset) {
+      last_record.length += length;
+      return;
+    }
+  }
+  block_list_.push_back({file, offset, length});
+}
+
 X_STATUS StfsContainerEntry::Open(uint32_t desired_access, File** out_file) {
   *out_file = new StfsContainerFile(desired_access, this);
   return X_STATUS_SUCCESS;
@@ -51,6 +51,11 @@ class StfsContainerEntry : public Entry {
  private:
   friend class StfsContainerDevice;
 
+  // Adds a block of the contents, extending the last record if the block
+  // directly follows it in the same file, so contiguous runs of blocks are
+  // read in one host read.
+  void AppendBlock(size_t file, size_t offset, size_t length);
+
   MultiFileHandles* files_;
   size_t data_offset_;
   size_t data_size_;
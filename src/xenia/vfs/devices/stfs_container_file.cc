@@ -13,6 +13,7 @@
 #include <cmath>
 
 #include "xenia/base/math.h"
+#include "xenia/vfs/devices/stfs_container_device.h"
 #include "xenia/vfs/devices/stfs_container_entry.h"
 
 namespace xe {
@@ -38,6 +39,7 @@ X_STATUS StfsContainerFile::ReadSync(void* buffer, size_t buffer_length,
   size_t remaining_length =
       std::min(buffer_length, entry_->size() - byte_offset);
 
+  auto device = static_cast<StfsContainerDevice*>(entry_->device());
   *out_bytes_read = 0;
   for (size_t i = 0; i < entry_->block_list().size(); i++) {
     auto& record = entry_->block_list()[i];
@@ -52,15 +54,18 @@ X_STATUS StfsContainerFile::ReadSync(void* buffer, size_t buffer_length,
     size_t read_length =
         std::min(record.length - read_offset, remaining_length);
 
-    auto& file = entry_->files()->at(record.file);
-    xe::filesystem::Seek(file, record.offset + read_offset, SEEK_SET);
-    auto num_read = fread(p, 1, read_length, file);
+    // Contiguous blocks are in one record, read with one host read.
+    size_t num_read = 0;
+    if (!device->ReadData(record.file, record.offset + read_offset, p,
+                          read_length, &num_read)) {
+      break;
+    }
 
     *out_bytes_read += num_read;
     p += num_read;
     src_offset += record.length;
     remaining_length -= read_length;
-    if (remaining_length == 0) {
+    if (remaining_length == 0 || num_read < read_length) {
       break;
     }
   }
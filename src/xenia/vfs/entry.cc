@@ -11,6 +11,7 @@
 
 #include "xenia/base/filesystem.h"
 #include "xenia/base/string.h"
+#include "xenia/vfs/block_cache.h"
 #include "xenia/vfs/device.h"
 
 namespace xe {
@@ -31,7 +32,12 @@ Entry::Entry(Device* device, Entry* parent, const std::string_view path)
   name_ = xe::utf8::find_name_from_guest_path(path);
 }
 
-Entry::~Entry() = default;
+std::atomic<uint64_t> Entry::destruction_count_(0);
+
+Entry::~Entry() {
+  BlockCache::shared().Invalidate(this);
+  destruction_count_.fetch_add(1, std::memory_order_release);
+}
 
 void Entry::Dump(xe::StringBuffer* string_buffer, int indent) {
   for (int i = 0; i < indent; ++i) {
@@ -47,7 +53,12 @@ void Entry::Dump(xe::StringBuffer* string_buffer, int indent) {
 bool Entry::is_read_only() const { return device_->is_read_only(); }
 
 Entry* Entry::GetChild(const std::string_view name) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::recursive_mutex> lock(device_->entry_mutex());
+  if (children_.size() >= kChildIndexMinCount) {
+    UpdateChildIndex();
+    auto it = child_index_.find(string_key_case(name));
+    return it != child_index_.cend() ? it->second : nullptr;
+  }
   auto it = std::find_if(children_.cbegin(), children_.cend(),
                          [&](const auto& child) {
                            return xe::utf8::equal_case(child->name(), name);
@@ -58,6 +69,16 @@ Entry* Entry::GetChild(const std::string_view name) {
   return (*it).get();
 }
 
+void Entry::UpdateChildIndex() {
+  for (; indexed_child_count_ < children_.size(); ++indexed_child_count_) {
+    Entry* child = children_[indexed_child_count_].get();
+    // Like the linear search, the first of the children with the same name is
+    // found.
+    child_index_.emplace(string_key_case(std::string_view(child->name())),
+                         child);
+  }
+}
+
 Entry* Entry::ResolvePath(const std::string_view path) {
   // Walk the path, one separator at a time.
   Entry* entry = this;
@@ -73,7 +94,7 @@ Entry* Entry::ResolvePath(const std::string_view path) {
 
 Entry* Entry::IterateChildren(const xe::filesystem::WildcardEngine& engine,
                               size_t* current_index) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::recursive_mutex> lock(device_->entry_mutex());
   while (*current_index < children_.size()) {
     auto& child = children_[*current_index];
     *current_index = *current_index + 1;
@@ -84,8 +105,20 @@ Entry* Entry::IterateChildren(const xe::filesystem::WildcardEngine& engine,
   return nullptr;
 }
 
+void Entry::FindChildren(const xe::filesystem::WildcardEngine& engine,
+                         bool match_all, size_t first_index,
+                         std::vector<Entry*>& entries_out) {
+  std::lock_guard<std::recursive_mutex> lock(device_->entry_mutex());
+  for (size_t i = first_index; i < children_.size(); ++i) {
+    Entry* child = children_[i].get();
+    if (match_all || engine.Match(child->name())) {
+      entries_out.push_back(child);
+    }
+  }
+}
+
 Entry* Entry::CreateEntry(const std::string_view name, uint32_t attributes) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::recursive_mutex> lock(device_->entry_mutex());
   if (is_read_only()) {
     return nullptr;
   }
@@ -104,7 +137,7 @@ Entry* Entry::CreateEntry(const std::string_view name, uint32_t attributes) {
 }
 
 bool Entry::Delete(Entry* entry) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::recursive_mutex> lock(device_->entry_mutex());
   if (is_read_only()) {
     return false;
   }
@@ -120,6 +153,9 @@ bool Entry::Delete(Entry* entry) {
       break;
     }
   }
+  // The entry may have hidden another child with the same name.
+  child_index_.clear();
+  indexed_child_count_ = 0;
   Touch();
   return true;
 }
@@ -10,8 +10,10 @@
 #ifndef XENIA_VFS_ENTRY_H_
 #define XENIA_VFS_ENTRY_H_
 
+#include <atomic>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "xenia/base/filesystem.h"
@@ -19,6 +21,7 @@
 #include "xenia/base/mapped_memory.h"
 #include "xenia/base/mutex.h"
 #include "xenia/base/string_buffer.h"
+#include "xenia/base/string_key.h"
 #include "xenia/xbox.h"
 
 namespace xe {
@@ -96,6 +99,12 @@ class Entry {
 
   bool is_read_only() const;
 
+  // Incremented whenever any entry is destroyed, so pointers to entries kept
+  // elsewhere can be dropped when it changes.
+  static uint64_t destruction_count() {
+    return destruction_count_.load(std::memory_order_acquire);
+  }
+
   Entry* GetChild(const std::string_view name);
   Entry* ResolvePath(const std::string_view path);
 
@@ -105,6 +114,11 @@ class Entry {
   size_t child_count() const { return children_.size(); }
   Entry* IterateChildren(const xe::filesystem::WildcardEngine& engine,
                          size_t* current_index);
+  // Appends the children from first_index, in their order, matching the
+  // engine, or all of them if match_all is true.
+  void FindChildren(const xe::filesystem::WildcardEngine& engine,
+                    bool match_all, size_t first_index,
+                    std::vector<Entry*>& entries_out);
 
   Entry* CreateEntry(const std::string_view name, uint32_t attributes);
   bool Delete(Entry* entry);
@@ -132,7 +146,9 @@ class Entry {
   }
   virtual bool DeleteEntryInternal(Entry* entry) { return false; }
 
-  xe::global_critical_region global_critical_region_;
+  // Directories with at least this many children are looked up via an index.
+  static constexpr size_t kChildIndexMinCount = 16;
+
   Device* device_;
   Entry* parent_;
   std::string path_;
@@ -145,6 +161,19 @@ class Entry {
   uint64_t access_timestamp_;
   uint64_t write_timestamp_;
   std::vector<std::unique_ptr<Entry>> children_;
+
+ private:
+  // Adds the children appended since the last update to the index.
+  void UpdateChildIndex();
+
+  static std::atomic<uint64_t> destruction_count_;
+
+  // Children by their names, referencing the names of the entries, built on
+  // lookup. Devices append to children_ directly, so the first
+  // indexed_child_count_ children are indexed, and the index is reset when a
+  // child is removed.
+  std::unordered_map<string_key_case, Entry*> child_index_;
+  size_t indexed_child_count_ = 0;
 };
 
 }  // namespace vfs
@@ -46,6 +46,9 @@ class File {
 
   virtual X_STATUS SetLength(size_t length) { return X_STATUS_NOT_IMPLEMENTED; }
 
+  // Writes any data buffered by the file to the device.
+  virtual X_STATUS Flush() { return X_STATUS_SUCCESS; }
+
   // xe::filesystem::FileAccess
   uint32_t file_access() const { return file_access_; }
   const Entry* entry() const { return entry_; }
@@ -0,0 +1,106 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/block_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::vfs::test {
+
+class TestFile {
+ public:
+  explicit TestFile(size_t size) : data_(size) {
+    for (size_t i = 0; i < size; ++i) {
+      data_[i] = uint8_t(i * 7 + i / 251);
+    }
+  }
+
+  std::vector<uint8_t>& data() { return data_; }
+  uint32_t read_count() const { return read_count_; }
+
+  BlockCache::ReadFunction read_function() {
+    return [this](size_t offset, void* buffer, size_t length,
+                  size_t* out_bytes_read) {
+      ++read_count_;
+      size_t bytes_read =
+          offset < data_.size() ? std::min(length, data_.size() - offset) : 0;
+      std::memcpy(buffer, data_.data() + std::min(offset, data_.size()),
+                  bytes_read);
+      *out_bytes_read = bytes_read;
+      return X_STATUS_SUCCESS;
+    };
+  }
+
+  bool Matches(const uint8_t* buffer, size_t offset, size_t length) const {
+    return offset + length <= data_.size() &&
+           !std::memcmp(buffer, data_.data() + offset, length);
+  }
+
+ private:
+  std::vector<uint8_t> data_;
+  uint32_t read_count_ = 0;
+};
+
+TEST_CASE("Block cache sequential reads", "[block_cache]") {
+  TestFile file(1000003);
+  BlockCache cache(4 * 1024 * 1024, 4);
+  REQUIRE(cache.is_enabled());
+  std::vector<uint8_t> buffer(4096);
+  for (size_t offset = 0; offset < file.data().size(); offset += 4096) {
+    size_t bytes_read = 0;
+    REQUIRE(cache.Read(&file, buffer.data(), buffer.size(), offset,
+                       &bytes_read,
+                       file.read_function()) == X_STATUS_SUCCESS);
+    REQUIRE(bytes_read ==
+            std::min(buffer.size(), file.data().size() - offset));
+    REQUIRE(file.Matches(buffer.data(), offset, bytes_read));
+  }
+  // Whole blocks with read-ahead instead of one host read per 4 KB.
+  REQUIRE(file.read_count() < 8);
+}
+
+TEST_CASE("Block cache reads past the end", "[block_cache]") {
+  TestFile file(100000);
+  BlockCache cache(2 * 1024 * 1024, 0);
+  std::vector<uint8_t> buffer(8192);
+  size_t bytes_read = 0;
+  REQUIRE(cache.Read(&file, buffer.data(), buffer.size(), 96000, &bytes_read,
+                     file.read_function()) == X_STATUS_SUCCESS);
+  REQUIRE(bytes_read == 4000);
+  REQUIRE(file.Matches(buffer.data(), 96000, bytes_read));
+  REQUIRE(cache.Read(&file, buffer.data(), buffer.size(), 200000,
+                     &bytes_read, file.read_function()) == X_STATUS_SUCCESS);
+  REQUIRE(bytes_read == 0);
+}
+
+TEST_CASE("Block cache invalidation", "[block_cache]") {
+  TestFile file(300000);
+  BlockCache cache(2 * 1024 * 1024, 0);
+  uint8_t buffer[16];
+  size_t bytes_read = 0;
+  cache.Read(&file, buffer, sizeof(buffer), 70000, &bytes_read,
+             file.read_function());
+  uint32_t read_count = file.read_count();
+  cache.Read(&file, buffer, sizeof(buffer), 70000, &bytes_read,
+             file.read_function());
+  REQUIRE(file.read_count() == read_count);
+
+  file.data()[70005] ^= 0xFF;
+  cache.Invalidate(&file);
+  cache.Read(&file, buffer, sizeof(buffer), 70000, &bytes_read,
+             file.read_function());
+  REQUIRE(file.read_count() == read_count + 1);
+  REQUIRE(file.Matches(buffer, 70000, sizeof(buffer)));
+}
+
+}  // namespace xe::vfs::test
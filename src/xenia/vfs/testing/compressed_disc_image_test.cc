@@ -0,0 +1,109 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/compressed_disc_image.h"
+
+#include <cstring>
+#include <vector>
+
+#include "third_party/catch/include/catch.hpp"
+#include "xenia/base/filesystem.h"
+
+namespace xe::vfs::test {
+
+TEST_CASE("Compressed disc image random access", "[compressed_disc_image]") {
+  // Compressible data followed by data that's stored as is, with a partial
+  // last chunk.
+  std::vector<uint8_t> data(20 * 4096 + 1234);
+  uint32_t seed = 1;
+  for (size_t i = 0; i < data.size(); ++i) {
+    if (i < 2 * 4096) {
+      data[i] = uint8_t(i / 64);
+    } else {
+      seed = seed * 1103515245 + 12345;
+      data[i] = uint8_t(seed >> 16);
+    }
+  }
+
+  auto temp_path = std::filesystem::temp_directory_path();
+  auto source_path = temp_path / "xenia_compressed_disc_image_test.iso";
+  auto target_path = temp_path / "xenia_compressed_disc_image_test.xcdi";
+  FILE* file = xe::filesystem::OpenFile(source_path, "wb");
+  REQUIRE(file);
+  REQUIRE(fwrite(data.data(), 1, data.size(), file) == data.size());
+  fclose(file);
+  REQUIRE(CompressedDiscImage::Convert(source_path, target_path, 4096));
+
+  {
+    auto mmap = MappedMemory::Open(target_path, MappedMemory::Mode::kRead);
+    REQUIRE(mmap);
+    REQUIRE(mmap->size() < data.size());
+    auto image = CompressedDiscImage::Open(mmap.get());
+    REQUIRE(image);
+    REQUIRE(image->image_size() == data.size());
+
+    const size_t ranges[][2] = {
+        {0, 16}, {4000, 200}, {8190, 5000}, {0, data.size()}, {20000, 5000},
+    };
+    for (const auto& range : ranges) {
+      std::vector<uint8_t> buffer(range[1]);
+      size_t bytes_read = 0;
+      REQUIRE(image->Read(buffer.data(), buffer.size(), range[0],
+                          &bytes_read) == X_STATUS_SUCCESS);
+      REQUIRE(bytes_read == std::min(range[1], data.size() - range[0]));
+      REQUIRE(!std::memcmp(buffer.data(), data.data() + range[0], bytes_read));
+    }
+  }
+
+  // Damage the last byte of a chunk that's stored as is, past the first block
+  // of the cache.
+  {
+    auto mmap = MappedMemory::Open(target_path, MappedMemory::Mode::kRead);
+    REQUIRE(mmap);
+    uint64_t index_offset;
+    std::memcpy(&index_offset, mmap->data() + 24, sizeof(index_offset));
+    uint64_t chunk_end;
+    std::memcpy(&chunk_end, mmap->data() + index_offset + 18 * sizeof(uint64_t),
+                sizeof(chunk_end));
+    std::vector<uint8_t> image(mmap->data(), mmap->data() + mmap->size());
+    image[chunk_end - 1] ^= 0xFF;
+    mmap.reset();
+    file = xe::filesystem::OpenFile(target_path, "wb");
+    REQUIRE(file);
+    REQUIRE(fwrite(image.data(), 1, image.size(), file) == image.size());
+    fclose(file);
+  }
+  {
+    auto mmap = MappedMemory::Open(target_path, MappedMemory::Mode::kRead);
+    REQUIRE(mmap);
+    auto image = CompressedDiscImage::Open(mmap.get());
+    REQUIRE(image);
+    std::vector<uint8_t> buffer(4096);
+    size_t bytes_read = 0;
+    REQUIRE(image->Read(buffer.data(), buffer.size(), 0, &bytes_read) ==
+            X_STATUS_SUCCESS);
+    REQUIRE(image->verified_chunk_count() >= 1);
+    REQUIRE(image->Read(buffer.data(), buffer.size(), 17 * 4096,
+                        &bytes_read) == X_STATUS_CRC_ERROR);
+  }
+
+  std::filesystem::remove(source_path);
+  std::filesystem::remove(target_path);
+}
+
+TEST_CASE("Compressed disc image rejects other files",
+          "[compressed_disc_image]") {
+  uint8_t data[64] = {};
+  REQUIRE(!CompressedDiscImage::HasMagic(data, sizeof(data)));
+  std::memcpy(data, "XCDI", 4);
+  REQUIRE(CompressedDiscImage::HasMagic(data, sizeof(data)));
+  REQUIRE(!CompressedDiscImage::HasMagic(data, 8));
+}
+
+}  // namespace xe::vfs::test
@@ -0,0 +1,81 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
+#include "xenia/base/filesystem.h"
+#include "xenia/vfs/devices/host_path_device.h"
+#include "xenia/vfs/file.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::vfs::test {
+
+TEST_CASE("Host path file write buffering", "[host_path_file]") {
+  auto temp_path =
+      std::filesystem::temp_directory_path() / "xenia_host_path_file_test";
+  std::filesystem::remove_all(temp_path);
+  REQUIRE(std::filesystem::create_directories(temp_path));
+  auto host_path = temp_path / "save.bin";
+
+  HostPathDevice device("\\Device\\Test", temp_path, false);
+  REQUIRE(device.Initialize());
+  Entry* entry =
+      device.ResolvePath("")->CreateEntry("save.bin", kFileAttributeNormal);
+  REQUIRE(entry);
+  File* file = nullptr;
+  REQUIRE(entry->Open(xe::filesystem::FileAccess::kFileWriteData, &file) ==
+          X_STATUS_SUCCESS);
+
+  // Small adjacent writes are kept until the file is flushed.
+  std::vector<uint8_t> data(100 * 16);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = uint8_t(i * 13);
+  }
+  for (size_t offset = 0; offset < data.size(); offset += 16) {
+    size_t bytes_written = 0;
+    REQUIRE(file->WriteSync(data.data() + offset, 16, offset,
+                            &bytes_written) == X_STATUS_SUCCESS);
+    REQUIRE(bytes_written == 16);
+  }
+  REQUIRE(std::filesystem::file_size(host_path) == 0);
+  REQUIRE(file->Flush() == X_STATUS_SUCCESS);
+  REQUIRE(std::filesystem::file_size(host_path) == data.size());
+
+  // A write elsewhere writes the buffered data first.
+  size_t bytes_written = 0;
+  REQUIRE(file->WriteSync(data.data(), 16, data.size(), &bytes_written) ==
+          X_STATUS_SUCCESS);
+  REQUIRE(file->WriteSync(data.data(), 16, 0, &bytes_written) ==
+          X_STATUS_SUCCESS);
+  REQUIRE(std::filesystem::file_size(host_path) == data.size() + 16);
+
+  // Closing the file writes the rest.
+  REQUIRE(file->WriteSync(data.data(), 16, data.size() + 16, &bytes_written) ==
+          X_STATUS_SUCCESS);
+  REQUIRE(std::filesystem::file_size(host_path) == data.size() + 16);
+  file->Destroy();
+  REQUIRE(std::filesystem::file_size(host_path) == data.size() + 32);
+
+  std::vector<uint8_t> expected(data);
+  expected.insert(expected.end(), data.begin(), data.begin() + 16);
+  expected.insert(expected.end(), data.begin(), data.begin() + 16);
+  std::vector<uint8_t> buffer(expected.size());
+  FILE* host_file = xe::filesystem::OpenFile(host_path, "rb");
+  REQUIRE(host_file);
+  REQUIRE(fread(buffer.data(), 1, buffer.size(), host_file) == buffer.size());
+  fclose(host_file);
+  REQUIRE(buffer == expected);
+
+  std::filesystem::remove_all(temp_path);
+}
+
+}  // namespace xe::vfs::test
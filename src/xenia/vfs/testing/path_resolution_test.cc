@@ -0,0 +1,59 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <memory>
+#include <string>
+
+#include "xenia/vfs/devices/null_device.h"
+#include "xenia/vfs/virtual_file_system.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::vfs::test {
+
+TEST_CASE("Resolve paths in large directories", "[path_resolution]") {
+  // The null device takes the paths of its files relative to the mount path.
+  std::initializer_list<std::string> paths = {
+      "\\Alpha",   "\\Bravo",  "\\Charlie", "\\Delta",   "\\Echo",
+      "\\Foxtrot", "\\Golf",   "\\Hotel",   "\\India",   "\\Juliett",
+      "\\Kilo",    "\\Lima",   "\\Mike",    "\\Oscar",   "\\Papa",
+      "\\Quebec",  "\\Romeo",  "\\Sierra",  "\\Tango",   "\\Victor",
+      "\\Whiskey", "\\X-ray",  "\\Yankee",  "\\Zulu",
+  };
+  auto device = std::make_unique<NullDevice>("\\Device\\Test", paths);
+  REQUIRE(device->Initialize());
+  Entry* root = device->ResolvePath("");
+  REQUIRE(root);
+  REQUIRE(root->child_count() == paths.size());
+
+  for (const std::string& path : paths) {
+    std::string name = path.substr(1);
+    Entry* entry = root->GetChild(name);
+    REQUIRE(entry);
+    REQUIRE(entry->name() == name);
+    REQUIRE(root->GetChild(xe::utf8::upper_ascii(name)) == entry);
+  }
+  REQUIRE(!root->GetChild("November"));
+
+  VirtualFileSystem file_system;
+  REQUIRE(file_system.RegisterDevice(std::move(device)));
+  REQUIRE(file_system.RegisterSymbolicLink("test:", "\\Device\\Test"));
+  Entry* entry = file_system.ResolvePath("test:\\Sierra");
+  REQUIRE(entry);
+  REQUIRE(entry->name() == "Sierra");
+  // Resolved again from the cache.
+  REQUIRE(file_system.ResolvePath("test:\\Sierra") == entry);
+  REQUIRE(file_system.ResolvePath("test:\\SIERRA") == entry);
+  REQUIRE(!file_system.ResolvePath("test:\\November"));
+
+  REQUIRE(file_system.UnregisterSymbolicLink("test:"));
+  REQUIRE(!file_system.ResolvePath("test:\\Sierra"));
+}
+
+}  // namespace xe::vfs::test
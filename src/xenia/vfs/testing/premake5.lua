@@ -4,6 +4,7 @@ include(project_root.."/tools/build")
 test_suite("xenia-vfs-tests", project_root, ".", {
   links = {
     "fmt",
+    "snappy",
     "xenia-base",
     "xenia-vfs",
   },
@@ -17,6 +17,7 @@
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 
+#include "xenia/vfs/compressed_disc_image.h"
 #include "xenia/vfs/devices/stfs_container_device.h"
 #include "xenia/vfs/file.h"
 
@@ -31,7 +32,19 @@ DEFINE_transient_path(source, "", "Specifies the file to dump from.",
 DEFINE_transient_path(dump_path, "",
                       "Specifies the directory to dump files to.", "General");
 
+DEFINE_transient_path(compress_disc_image, "",
+                      "Instead of dumping files, converts the source disc "
+                      "image to a compressed disc image at this path.",
+                      "General");
+
 int vfs_dump_main(const std::vector<std::string>& args) {
+  if (!cvars::source.empty() && !cvars::compress_disc_image.empty()) {
+    return CompressedDiscImage::Convert(cvars::source,
+                                        cvars::compress_disc_image)
+               ? 0
+               : 1;
+  }
+
   if (cvars::source.empty() || cvars::dump_path.empty()) {
     XELOGE("Usage: {} [source] [dump_path]", xe::path_to_utf8(args[0]));
     return 1;
@@ -26,17 +26,19 @@ VirtualFileSystem::~VirtualFileSystem() {
 }
 
 bool VirtualFileSystem::RegisterDevice(std::unique_ptr<Device> device) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::mutex> lock(mutex_);
   devices_.emplace_back(std::move(device));
+  resolved_paths_.clear();
   return true;
 }
 
 bool VirtualFileSystem::UnregisterDevice(const std::string_view path) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::mutex> lock(mutex_);
   for (auto it = devices_.begin(); it != devices_.end(); ++it) {
     if ((*it)->mount_path() == path) {
       XELOGD("Unregistered device: {}", (*it)->mount_path());
       devices_.erase(it);
+      resolved_paths_.clear();
       return true;
     }
   }
@@ -45,15 +47,16 @@ bool VirtualFileSystem::UnregisterDevice(const std::string_view path) {
 
 bool VirtualFileSystem::RegisterSymbolicLink(const std::string_view path,
                                              const std::string_view target) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::mutex> lock(mutex_);
   symlinks_.insert({std::string(path), std::string(target)});
+  resolved_paths_.clear();
   XELOGD("Registered symbolic link: {} => {}", path, target);
 
   return true;
 }
 
 bool VirtualFileSystem::UnregisterSymbolicLink(const std::string_view path) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::mutex> lock(mutex_);
   auto it = std::find_if(
       symlinks_.cbegin(), symlinks_.cend(),
       [&](const auto& s) { return xe::utf8::equal_case(path, s.first); });
@@ -63,11 +66,13 @@ bool VirtualFileSystem::UnregisterSymbolicLink(const std::string_view path) {
   XELOGD("Unregistered symbolic link: {} => {}", it->first, it->second);
 
   symlinks_.erase(it);
+  resolved_paths_.clear();
   return true;
 }
 
 bool VirtualFileSystem::FindSymbolicLink(const std::string_view path,
                                          std::string& target) {
+  std::lock_guard<std::mutex> lock(mutex_);
   auto it = std::find_if(
       symlinks_.cbegin(), symlinks_.cend(),
       [&](const auto& s) { return xe::utf8::starts_with_case(path, s.first); });
@@ -100,8 +105,31 @@ bool VirtualFileSystem::ResolveSymbolicLink(const std::string_view path,
 }
 
 Entry* VirtualFileSystem::ResolvePath(const std::string_view path) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::mutex> lock(mutex_);
 
+  uint64_t destruction_count = Entry::destruction_count();
+  if (resolved_paths_destruction_count_ != destruction_count) {
+    resolved_paths_.clear();
+    resolved_paths_destruction_count_ = destruction_count;
+  }
+  auto it = resolved_paths_.find(string_key(path));
+  if (it != resolved_paths_.cend()) {
+    return it->second;
+  }
+
+  Entry* entry = ResolvePathUncached(path);
+  // Paths that don't exist are not cached since entries may be created
+  // without going through the file system.
+  if (entry) {
+    if (resolved_paths_.size() >= kMaxResolvedPaths) {
+      resolved_paths_.clear();
+    }
+    resolved_paths_.emplace(string_key::create(path), entry);
+  }
+  return entry;
+}
+
+Entry* VirtualFileSystem::ResolvePathUncached(const std::string_view path) {
   // Resolve relative paths
   auto normalized_path(xe::utf8::canonicalize_guest_path(path));
 
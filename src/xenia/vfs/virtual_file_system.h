@@ -11,11 +11,12 @@
 #define XENIA_VFS_VIRTUAL_FILE_SYSTEM_H_
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
-#include "xenia/base/mutex.h"
+#include "xenia/base/string_key.h"
 #include "xenia/vfs/device.h"
 #include "xenia/vfs/entry.h"
 #include "xenia/vfs/file.h"
@@ -48,11 +49,23 @@ class VirtualFileSystem {
                     FileAction* out_action);
 
  private:
-  xe::global_critical_region global_critical_region_;
+  // The resolved paths are dropped all at once when there are more.
+  static constexpr size_t kMaxResolvedPaths = 4096;
+
+  // Guards the devices, the symbolic links and the resolved paths, acquired
+  // after the global critical region if both are needed, and before the entry
+  // mutex of a device.
+  std::mutex mutex_;
   std::vector<std::unique_ptr<Device>> devices_;
   std::unordered_map<std::string, std::string> symlinks_;
 
+  // Entries found for the paths passed to ResolvePath, valid while no entry
+  // has been destroyed and the devices and links are the same.
+  std::unordered_map<string_key, Entry*> resolved_paths_;
+  uint64_t resolved_paths_destruction_count_ = 0;
+
   bool ResolveSymbolicLink(const std::string_view path, std::string& result);
+  Entry* ResolvePathUncached(const std::string_view path);
 };
 
 }  // namespace vfs